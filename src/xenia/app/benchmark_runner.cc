@@ -0,0 +1,276 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/app/benchmark_runner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/emulator.h"
+#include "xenia/gpu/graphics_system.h"
+
+#include "third_party/fmt/include/fmt/format.h"
+
+DEFINE_int32(benchmark_frames, 0,
+             "Number of guest frames to measure after the launch of the title "
+             "before writing the benchmark results to benchmark_output and "
+             "exiting. If benchmark_seconds is also set, the benchmark ends "
+             "when either is reached. Combine with --headless for unattended "
+             "runs.",
+             "General");
+DEFINE_double(benchmark_seconds, 0.0,
+              "Host time in seconds to measure after the launch of the title "
+              "before writing the benchmark results to benchmark_output and "
+              "exiting.",
+              "General");
+DEFINE_int32(benchmark_skip_frames, 0,
+             "Guest frames to skip after the launch of the title before the "
+             "benchmark measurement starts, to exclude loading.",
+             "General");
+DEFINE_transient_path(benchmark_output, "benchmark.json",
+                      "Path to write the benchmark results JSON to.",
+                      "General");
+
+namespace xe {
+namespace app {
+
+namespace {
+
+// Nearest-rank percentile of sorted values.
+uint64_t GetPercentile(const std::vector<uint64_t>& sorted_values,
+                       double percentile) {
+  if (sorted_values.empty()) {
+    return 0;
+  }
+  size_t rank = size_t(
+      std::ceil(percentile / 100.0 * double(sorted_values.size())));
+  return sorted_values[std::min(std::max(rank, size_t(1)),
+                                sorted_values.size()) -
+                       1];
+}
+
+}  // namespace
+
+bool BenchmarkRunner::IsRequested() {
+  return cvars::benchmark_frames > 0 || cvars::benchmark_seconds > 0.0;
+}
+
+BenchmarkRunner::BenchmarkRunner(
+    Emulator* emulator, std::function<void(bool succeeded)> on_finished)
+    : emulator_(emulator), on_finished_(std::move(on_finished)) {}
+
+void BenchmarkRunner::Start() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (started_) {
+      return;
+    }
+    started_ = true;
+    frames_to_skip_ = uint32_t(std::max(cvars::benchmark_skip_frames, 0));
+    if (cvars::benchmark_frames > 0) {
+      frame_host_ticks_.reserve(size_t(cvars::benchmark_frames));
+    }
+  }
+  gpu::CommandProcessor* command_processor =
+      emulator_->graphics_system()->command_processor();
+  command_processor->on_swap.AddListener(
+      [this](uint64_t host_tick) { OnSwap(host_tick); });
+  XELOGI("Benchmark: started for title {:08X}", emulator_->title_id());
+}
+
+void BenchmarkRunner::OnSwap(uint64_t host_tick) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (finished_) {
+    return;
+  }
+  if (frames_to_skip_) {
+    --frames_to_skip_;
+    return;
+  }
+  if (!start_host_tick_) {
+    // The first measured swap only marks the beginning of the first frame.
+    start_host_tick_ = host_tick;
+    last_swap_host_tick_ = host_tick;
+    emulator_->processor()->GetStatistics(processor_start_statistics_);
+    emulator_->graphics_system()->command_processor()->GetStatistics(
+        gpu_start_statistics_);
+    emulator_->graphics_system()->GetInterruptStatistics(
+        gpu_interrupt_start_statistics_);
+    emulator_->memory()->GetStatistics(memory_start_statistics_);
+    pm4_start_statistics_available_ =
+        emulator_->graphics_system()->command_processor()->GetPm4Statistics(
+            pm4_start_statistics_);
+    return;
+  }
+  frame_host_ticks_.push_back(host_tick - last_swap_host_tick_);
+  last_swap_host_tick_ = host_tick;
+  bool frames_reached =
+      cvars::benchmark_frames > 0 &&
+      frame_host_ticks_.size() >= size_t(cvars::benchmark_frames);
+  bool seconds_reached =
+      cvars::benchmark_seconds > 0.0 &&
+      double(host_tick - start_host_tick_) >=
+          cvars::benchmark_seconds * double(Clock::QueryHostTickFrequency());
+  if (!frames_reached && !seconds_reached) {
+    return;
+  }
+  finished_ = true;
+  bool succeeded = WriteResults(host_tick);
+  lock.unlock();
+  if (on_finished_) {
+    on_finished_(succeeded);
+  }
+}
+
+bool BenchmarkRunner::WriteResults(uint64_t end_host_tick) {
+  cpu::ProcessorStatistics processor_statistics;
+  emulator_->processor()->GetStatistics(processor_statistics);
+  gpu::CommandProcessor::Statistics gpu_statistics;
+  emulator_->graphics_system()->command_processor()->GetStatistics(
+      gpu_statistics);
+  gpu::GraphicsSystem::InterruptStatistics gpu_interrupt_statistics;
+  emulator_->graphics_system()->GetInterruptStatistics(
+      gpu_interrupt_statistics);
+  MemoryStatistics memory_statistics;
+  emulator_->memory()->GetStatistics(memory_statistics);
+
+  double ms_per_tick = 1000.0 / double(Clock::QueryHostTickFrequency());
+  std::vector<uint64_t> sorted_frame_host_ticks(frame_host_ticks_);
+  std::sort(sorted_frame_host_ticks.begin(), sorted_frame_host_ticks.end());
+  size_t frame_count = sorted_frame_host_ticks.size();
+  double total_ms = double(end_host_tick - start_host_tick_) * ms_per_tick;
+  double average_ms = frame_count ? total_ms / double(frame_count) : 0.0;
+  uint64_t interrupt_count = gpu_interrupt_statistics.interrupt_count -
+                             gpu_interrupt_start_statistics_.interrupt_count;
+  double interrupt_latency_ms =
+      double(gpu_interrupt_statistics.latency_host_ticks -
+             gpu_interrupt_start_statistics_.latency_host_ticks) *
+      ms_per_tick;
+
+  std::string json = fmt::format(
+      "{{\n"
+      "  \"title_id\": \"{:08X}\",\n"
+      "  \"frames\": {},\n"
+      "  \"total_ms\": {:.3f},\n"
+      "  \"fps_avg\": {:.3f},\n"
+      "  \"frame_time_ms\": {{\"avg\": {:.3f}, \"min\": {:.3f}, "
+      "\"p50\": {:.3f}, \"p90\": {:.3f}, \"p95\": {:.3f}, \"p99\": {:.3f}, "
+      "\"max\": {:.3f}}},\n",
+      emulator_->title_id(), frame_count, total_ms,
+      average_ms > 0.0 ? 1000.0 / average_ms : 0.0, average_ms,
+      frame_count ? double(sorted_frame_host_ticks.front()) * ms_per_tick
+                  : 0.0,
+      double(GetPercentile(sorted_frame_host_ticks, 50.0)) * ms_per_tick,
+      double(GetPercentile(sorted_frame_host_ticks, 90.0)) * ms_per_tick,
+      double(GetPercentile(sorted_frame_host_ticks, 95.0)) * ms_per_tick,
+      double(GetPercentile(sorted_frame_host_ticks, 99.0)) * ms_per_tick,
+      frame_count ? double(sorted_frame_host_ticks.back()) * ms_per_tick
+                  : 0.0);
+  json += fmt::format(
+      "  \"jit\": {{\"functions_defined\": {}, \"definition_ms\": {:.3f}}},\n"
+      "  \"gpu\": {{\"shaders_translated\": {}, \"translation_ms\": {:.3f}, "
+      "\"pipelines_created\": {}, \"interrupts\": {}, "
+      "\"interrupt_latency_us_avg\": {:.3f}}},\n"
+      "  \"memory\": {{\"write_watch_faults\": {}, "
+      "\"write_watch_fault_unprotected_pages\": {}}}",
+      processor_statistics.function_definition_count -
+          processor_start_statistics_.function_definition_count,
+      double(processor_statistics.function_definition_microseconds -
+             processor_start_statistics_.function_definition_microseconds) /
+          1000.0,
+      gpu_statistics.shader_translation_count -
+          gpu_start_statistics_.shader_translation_count,
+      double(gpu_statistics.shader_translation_host_ticks -
+             gpu_start_statistics_.shader_translation_host_ticks) *
+          ms_per_tick,
+      gpu_statistics.pipeline_creation_count -
+          gpu_start_statistics_.pipeline_creation_count,
+      interrupt_count,
+      interrupt_count
+          ? interrupt_latency_ms * 1000.0 / double(interrupt_count)
+          : 0.0,
+      memory_statistics.write_watch_fault_count -
+          memory_start_statistics_.write_watch_fault_count,
+      memory_statistics.write_watch_fault_unprotected_page_count -
+          memory_start_statistics_.write_watch_fault_unprotected_page_count);
+  gpu::CommandProcessor::Pm4Statistics pm4_statistics;
+  if (pm4_start_statistics_available_ &&
+      emulator_->graphics_system()->command_processor()->GetPm4Statistics(
+          pm4_statistics)) {
+    using Pm4PacketCategory = gpu::CommandProcessor::Pm4PacketCategory;
+    json += ",\n  \"gpu_pm4\": {\"packets\": {";
+    for (size_t i = 0; i < size_t(Pm4PacketCategory::kCount); ++i) {
+      json += fmt::format(
+          "{}\"{}\": {{\"count\": {}, \"ms\": {:.3f}}}", i ? ", " : "",
+          gpu::CommandProcessor::GetPm4PacketCategoryName(
+              Pm4PacketCategory(i)),
+          pm4_statistics.packet_counts[i] -
+              pm4_start_statistics_.packet_counts[i],
+          double(pm4_statistics.packet_host_ticks[i] -
+                 pm4_start_statistics_.packet_host_ticks[i]) *
+              ms_per_tick);
+    }
+    // Most frequently written registers during the benchmark.
+    std::vector<std::pair<uint64_t, uint32_t>> register_writes;
+    for (uint32_t i = 0;
+         i < uint32_t(pm4_statistics.register_write_counts.size()); ++i) {
+      uint64_t write_count = pm4_statistics.register_write_counts[i] -
+                             pm4_start_statistics_.register_write_counts[i];
+      if (write_count) {
+        register_writes.emplace_back(write_count, i);
+      }
+    }
+    size_t top_register_count =
+        std::min(register_writes.size(), kTopWrittenRegisterCount);
+    std::partial_sort(register_writes.begin(),
+                      register_writes.begin() + top_register_count,
+                      register_writes.end(),
+                      [](const std::pair<uint64_t, uint32_t>& a,
+                         const std::pair<uint64_t, uint32_t>& b) {
+                        return a.first > b.first;
+                      });
+    json += "}, \"top_written_registers\": [";
+    for (size_t i = 0; i < top_register_count; ++i) {
+      const gpu::RegisterInfo* register_info =
+          gpu::RegisterFile::GetRegisterInfo(register_writes[i].second);
+      json += fmt::format(
+          "{}{{\"index\": \"0x{:04X}\", \"name\": \"{}\", \"writes\": {}}}",
+          i ? ", " : "", register_writes[i].second,
+          register_info ? register_info->name : "", register_writes[i].first);
+    }
+    json += "]}";
+  }
+  json += "\n}\n";
+
+  XELOGI(
+      "Benchmark: {} frames in {:.3f} ms, average {:.3f} ms, 99th percentile "
+      "{:.3f} ms",
+      frame_count, total_ms, average_ms,
+      double(GetPercentile(sorted_frame_host_ticks, 99.0)) * ms_per_tick);
+
+  FILE* handle = filesystem::OpenFile(cvars::benchmark_output, "wb");
+  if (!handle) {
+    XELOGE("Failed to open the benchmark output file {}",
+           xe::path_to_utf8(cvars::benchmark_output));
+    return false;
+  }
+  fwrite(json.data(), 1, json.size(), handle);
+  fclose(handle);
+  XELOGI("Benchmark results written to {}",
+         xe::path_to_utf8(cvars::benchmark_output));
+  return true;
+}
+
+}  // namespace app
+}  // namespace xe
@@ -0,0 +1,77 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_APP_BENCHMARK_RUNNER_H_
+#define XENIA_APP_BENCHMARK_RUNNER_H_
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "xenia/cpu/processor.h"
+#include "xenia/gpu/command_processor.h"
+#include "xenia/gpu/graphics_system.h"
+#include "xenia/memory.h"
+
+namespace xe {
+class Emulator;
+}  // namespace xe
+
+namespace xe {
+namespace app {
+
+// Measures a title for a fixed number of frames or seconds after its launch,
+// and writes the frame times and the counters of the subsystems gathered over
+// that period as JSON, for comparing the performance between builds.
+class BenchmarkRunner {
+ public:
+  // Whether the benchmark cvars request a run.
+  static bool IsRequested();
+
+  // on_finished is called on the GPU command processor thread once the results
+  // have been written, with whether writing has succeeded.
+  BenchmarkRunner(Emulator* emulator,
+                  std::function<void(bool succeeded)> on_finished);
+
+  // Called when the title has been launched. Only the first call has effect.
+  void Start();
+
+ private:
+  void OnSwap(uint64_t host_tick);
+  bool WriteResults(uint64_t end_host_tick);
+
+  // Number of the most frequently written registers in the results with
+  // gpu_pm4_statistics.
+  static constexpr size_t kTopWrittenRegisterCount = 16;
+
+  Emulator* emulator_;
+  std::function<void(bool succeeded)> on_finished_;
+
+  std::mutex mutex_;
+  bool started_ = false;
+  bool finished_ = false;
+  uint32_t frames_to_skip_ = 0;
+  // Zero until the first measured swap.
+  uint64_t start_host_tick_ = 0;
+  uint64_t last_swap_host_tick_ = 0;
+  std::vector<uint64_t> frame_host_ticks_;
+  cpu::ProcessorStatistics processor_start_statistics_;
+  gpu::CommandProcessor::Statistics gpu_start_statistics_;
+  gpu::GraphicsSystem::InterruptStatistics gpu_interrupt_start_statistics_;
+  MemoryStatistics memory_start_statistics_;
+  bool pm4_start_statistics_available_ = false;
+  gpu::CommandProcessor::Pm4Statistics pm4_start_statistics_;
+};
+
+}  // namespace app
+}  // namespace xe
+
+#endif  // XENIA_APP_BENCHMARK_RUNNER_H_
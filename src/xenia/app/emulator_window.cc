@@ -9,6 +9,8 @@
 
 #include "xenia/app/emulator_window.h"
 
+#include <algorithm>
+#include <cinttypes>
 #include <filesystem>
 #include <functional>
 #include <memory>
@@ -19,11 +21,14 @@
 #include "third_party/cpptoml/include/cpptoml.h"
 #include "third_party/fmt/include/fmt/format.h"
 #include "third_party/imgui/imgui.h"
+#include "xenia/apu/audio_system.h"
+#include "xenia/apu/xma_decoder.h"
 #include "xenia/base/assert.h"
 #include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/debugging.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/math.h"
 #include "xenia/base/platform.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/system.h"
@@ -535,6 +540,347 @@ void EmulatorWindow::DisplayConfigDialog::OnDraw(ImGuiIO& io) {
   }
 }
 
+void EmulatorWindow::MemoryStatisticsDialog::OnDraw(ImGuiIO& io) {
+  Memory* memory = emulator_window_.emulator_->memory();
+  if (!memory) {
+    return;
+  }
+
+  MemoryStatistics statistics;
+  memory->GetStatistics(statistics);
+  uint64_t host_ticks = Clock::QueryHostTickCount();
+  uint64_t host_tick_frequency = Clock::QueryHostTickFrequency();
+  if (host_ticks - sample_host_ticks_ >= host_tick_frequency) {
+    // Per-second differences of all the counters.
+    const uint64_t* counters = reinterpret_cast<const uint64_t*>(&statistics);
+    const uint64_t* sample_counters =
+        reinterpret_cast<const uint64_t*>(&sample_statistics_);
+    uint64_t* rates = reinterpret_cast<uint64_t*>(&sample_rates_);
+    for (size_t i = 0; i < sizeof(MemoryStatistics) / sizeof(uint64_t); ++i) {
+      rates[i] = (counters[i] - sample_counters[i]) * host_tick_frequency /
+                 (host_ticks - sample_host_ticks_);
+    }
+    sample_host_ticks_ = host_ticks;
+    sample_statistics_ = statistics;
+  }
+
+  ImGui::SetNextWindowPos(ImVec2(20, 20), ImGuiCond_FirstUseEver);
+  // Columns don't work with automatic resizing.
+  ImGui::SetNextWindowSize(ImVec2(480, 240), ImGuiCond_FirstUseEver);
+  ImGui::SetNextWindowBgAlpha(0.6f);
+  bool dialog_open = true;
+  if (!ImGui::Begin("Memory statistics", &dialog_open,
+                    ImGuiWindowFlags_NoCollapse)) {
+    ImGui::End();
+    return;
+  }
+
+  static const char* const kHeapTypeNames[] = {"Virtual", "XEX", "Physical",
+                                               "Host physical"};
+  static_assert(xe::countof(kHeapTypeNames) ==
+                MemoryStatistics::kHeapTypeCount);
+  ImGui::Columns(4);
+  ImGui::TextUnformatted("Heap type");
+  ImGui::NextColumn();
+  ImGui::TextUnformatted("Committed");
+  ImGui::NextColumn();
+  ImGui::TextUnformatted("Allocations/s");
+  ImGui::NextColumn();
+  ImGui::TextUnformatted("Releases/s");
+  ImGui::NextColumn();
+  ImGui::Separator();
+  for (size_t i = 0; i < MemoryStatistics::kHeapTypeCount; ++i) {
+    ImGui::TextUnformatted(kHeapTypeNames[i]);
+    ImGui::NextColumn();
+    ImGui::Text("%.1f MB", statistics.committed_bytes[i] / (1024.0 * 1024.0));
+    ImGui::NextColumn();
+    ImGui::Text("%" PRIu64, sample_rates_.allocation_count[i]);
+    ImGui::NextColumn();
+    ImGui::Text("%" PRIu64, sample_rates_.release_count[i]);
+    ImGui::NextColumn();
+  }
+  ImGui::Columns(1);
+  ImGui::Spacing();
+  ImGui::Text("Write watch faults/s: %" PRIu64,
+              sample_rates_.write_watch_fault_count);
+  ImGui::Text(
+      "Pages unprotected per fault: %.1f",
+      sample_rates_.write_watch_fault_count
+          ? double(sample_rates_.write_watch_fault_unprotected_page_count) /
+                double(sample_rates_.write_watch_fault_count)
+          : 0.0);
+  ImGui::Text("Callback triggers/s: %" PRIu64,
+              sample_rates_.trigger_callbacks_count);
+  ImGui::Text("Time in callback triggers: %.2f ms/s",
+              sample_rates_.trigger_callbacks_microseconds / 1000.0);
+
+  ImGui::End();
+
+  if (!dialog_open) {
+    emulator_window_.ToggleMemoryStatisticsDialog();
+    // `this` might have been destroyed by ToggleMemoryStatisticsDialog.
+    return;
+  }
+}
+
+void EmulatorWindow::AudioStatisticsDialog::OnDraw(ImGuiIO& io) {
+  apu::AudioSystem* audio_system = emulator_window_.emulator_->audio_system();
+  if (!audio_system) {
+    return;
+  }
+  apu::XmaDecoder* xma_decoder = audio_system->xma_decoder();
+
+  uint32_t context_count = xma_decoder->context_count();
+  std::vector<apu::XmaContext::Statistics> statistics(context_count);
+  std::vector<bool> allocated(context_count);
+  for (uint32_t i = 0; i < context_count; ++i) {
+    allocated[i] = xma_decoder->GetContextStatistics(i, statistics[i]);
+  }
+  uint64_t host_ticks = Clock::QueryHostTickCount();
+  uint64_t host_tick_frequency = Clock::QueryHostTickFrequency();
+  if (sample_statistics_.size() != context_count) {
+    sample_host_ticks_ = host_ticks;
+    sample_statistics_ = statistics;
+    sample_rates_.assign(context_count, {});
+  } else if (host_ticks - sample_host_ticks_ >= host_tick_frequency) {
+    // Per-second differences of all the counters.
+    constexpr size_t kCounterCount =
+        sizeof(apu::XmaContext::Statistics) / sizeof(uint64_t);
+    for (uint32_t i = 0; i < context_count; ++i) {
+      const uint64_t* counters =
+          reinterpret_cast<const uint64_t*>(&statistics[i]);
+      const uint64_t* sample_counters =
+          reinterpret_cast<const uint64_t*>(&sample_statistics_[i]);
+      uint64_t* rates = reinterpret_cast<uint64_t*>(&sample_rates_[i]);
+      for (size_t j = 0; j < kCounterCount; ++j) {
+        rates[j] = (counters[j] - sample_counters[j]) * host_tick_frequency /
+                   (host_ticks - sample_host_ticks_);
+      }
+    }
+    sample_host_ticks_ = host_ticks;
+    sample_statistics_ = statistics;
+  }
+
+  ImGui::SetNextWindowPos(ImVec2(20, 20), ImGuiCond_FirstUseEver);
+  // Columns don't work with automatic resizing.
+  ImGui::SetNextWindowSize(ImVec2(560, 400), ImGuiCond_FirstUseEver);
+  ImGui::SetNextWindowBgAlpha(0.6f);
+  bool dialog_open = true;
+  if (!ImGui::Begin("Audio statistics", &dialog_open,
+                    ImGuiWindowFlags_NoCollapse)) {
+    ImGui::End();
+    return;
+  }
+
+  ImGui::Columns(4);
+  ImGui::TextUnformatted("Client");
+  ImGui::NextColumn();
+  ImGui::TextUnformatted("Queued frames");
+  ImGui::NextColumn();
+  ImGui::TextUnformatted("Latency");
+  ImGui::NextColumn();
+  ImGui::TextUnformatted("Underruns");
+  ImGui::NextColumn();
+  ImGui::Separator();
+  for (size_t i = 0; i < audio_system->client_count(); ++i) {
+    apu::AudioSystem::ClientStats client_stats;
+    if (!audio_system->GetClientStats(i, &client_stats)) {
+      continue;
+    }
+    ImGui::Text("%zu", i);
+    ImGui::NextColumn();
+    ImGui::Text("%u", client_stats.queued_frames);
+    ImGui::NextColumn();
+    ImGui::Text("%.1f ms", client_stats.latency_ms);
+    ImGui::NextColumn();
+    ImGui::Text("%" PRIu64, client_stats.underrun_count);
+    ImGui::NextColumn();
+  }
+  ImGui::Columns(1);
+  ImGui::Spacing();
+
+  // The contexts taking the most decoding time first.
+  std::vector<uint32_t> active_contexts;
+  for (uint32_t i = 0; i < context_count; ++i) {
+    if (allocated[i] && sample_rates_[i].decode_count) {
+      active_contexts.push_back(i);
+    }
+  }
+  std::sort(active_contexts.begin(), active_contexts.end(),
+            [this](uint32_t a, uint32_t b) {
+              return sample_rates_[a].decode_host_ticks >
+                     sample_rates_[b].decode_host_ticks;
+            });
+  uint64_t total_decode_host_ticks = 0;
+  for (uint32_t i : active_contexts) {
+    total_decode_host_ticks += sample_rates_[i].decode_host_ticks;
+  }
+  ImGui::Text("Active XMA contexts: %zu", active_contexts.size());
+  ImGui::Text("Time in decoding: %.2f ms/s",
+              total_decode_host_ticks * 1000.0 / host_tick_frequency);
+  ImGui::Spacing();
+  ImGui::Columns(6);
+  ImGui::TextUnformatted("XMA context");
+  ImGui::NextColumn();
+  ImGui::TextUnformatted("Kicks/s");
+  ImGui::NextColumn();
+  ImGui::TextUnformatted("Packets/s");
+  ImGui::NextColumn();
+  ImGui::TextUnformatted("Frames/s");
+  ImGui::NextColumn();
+  ImGui::TextUnformatted("Cached frames/s");
+  ImGui::NextColumn();
+  ImGui::TextUnformatted("Decoding");
+  ImGui::NextColumn();
+  ImGui::Separator();
+  for (uint32_t i : active_contexts) {
+    const apu::XmaContext::Statistics& rates = sample_rates_[i];
+    ImGui::Text("%u", i);
+    ImGui::NextColumn();
+    ImGui::Text("%" PRIu64, rates.decode_count);
+    ImGui::NextColumn();
+    ImGui::Text("%" PRIu64, rates.packet_count);
+    ImGui::NextColumn();
+    ImGui::Text("%" PRIu64, rates.frame_count);
+    ImGui::NextColumn();
+    ImGui::Text("%" PRIu64, rates.cached_frame_count);
+    ImGui::NextColumn();
+    ImGui::Text("%.2f ms/s",
+                rates.decode_host_ticks * 1000.0 / host_tick_frequency);
+    ImGui::NextColumn();
+  }
+  ImGui::Columns(1);
+
+  ImGui::End();
+
+  if (!dialog_open) {
+    emulator_window_.ToggleAudioStatisticsDialog();
+    // `this` might have been destroyed by ToggleAudioStatisticsDialog.
+    return;
+  }
+}
+
+void EmulatorWindow::PerformanceOverlayDialog::OnDraw(ImGuiIO& io) {
+  cpu::Processor* processor = emulator_window_.emulator_->processor();
+  gpu::GraphicsSystem* graphics_system =
+      emulator_window_.emulator_->graphics_system();
+  gpu::CommandProcessor* command_processor =
+      graphics_system ? graphics_system->command_processor() : nullptr;
+  if (!processor || !command_processor) {
+    return;
+  }
+
+  Sample sample;
+  sample.host_ticks = Clock::QueryHostTickCount();
+  processor->GetStatistics(sample.processor);
+  command_processor->GetStatistics(sample.gpu);
+  sample.xma_decode_host_ticks = 0;
+  apu::AudioSystem* audio_system = emulator_window_.emulator_->audio_system();
+  if (audio_system) {
+    apu::XmaDecoder* xma_decoder = audio_system->xma_decoder();
+    for (uint32_t i = 0; i < xma_decoder->context_count(); ++i) {
+      apu::XmaContext::Statistics context_statistics;
+      if (xma_decoder->GetContextStatistics(i, context_statistics)) {
+        sample.xma_decode_host_ticks += context_statistics.decode_host_ticks;
+      }
+    }
+  }
+  uint64_t host_tick_frequency = Clock::QueryHostTickFrequency();
+  uint64_t sample_host_ticks = sample.host_ticks - sample_.host_ticks;
+  if (sample_host_ticks >= host_tick_frequency) {
+    if (sample_.host_ticks) {
+      sample_swap_count_ = sample.gpu.swap_count - sample_.gpu.swap_count;
+      sample_command_processor_idle_ =
+          double(sample.gpu.idle_host_ticks - sample_.gpu.idle_host_ticks) /
+          double(sample_host_ticks);
+      sample_command_processor_idle_spin_ =
+          double(sample.gpu.idle_spin_host_ticks -
+                 sample_.gpu.idle_spin_host_ticks) /
+          double(sample_host_ticks);
+      // Per-frame averages.
+      double frames = double(std::max(sample_swap_count_, uint64_t(1)));
+      sample_function_definitions_ =
+          double(sample.processor.function_definition_count -
+                 sample_.processor.function_definition_count) /
+          frames;
+      sample_function_definition_ms_ =
+          double(sample.processor.function_definition_microseconds -
+                 sample_.processor.function_definition_microseconds) /
+          (1000.0 * frames);
+      sample_shader_translations_ =
+          double(sample.gpu.shader_translation_count -
+                 sample_.gpu.shader_translation_count) /
+          frames;
+      sample_shader_translation_ms_ =
+          double(sample.gpu.shader_translation_host_ticks -
+                 sample_.gpu.shader_translation_host_ticks) *
+          1000.0 / (double(host_tick_frequency) * frames);
+      sample_pipeline_creations_ =
+          double(sample.gpu.pipeline_creation_count -
+                 sample_.gpu.pipeline_creation_count) /
+          frames;
+      sample_texture_loads_ = double(sample.gpu.texture_load_count -
+                                     sample_.gpu.texture_load_count) /
+                              frames;
+      sample_xma_decode_ms_ =
+          double(sample.xma_decode_host_ticks - sample_.xma_decode_host_ticks) *
+          1000.0 / (double(host_tick_frequency) * frames);
+    }
+    sample_ = sample;
+  }
+
+  uint32_t frame_times_us[gpu::CommandProcessor::kFrameTimeHistoryLength];
+  size_t frame_count = command_processor->GetFrameTimeHistory(frame_times_us);
+  float frame_times_ms[gpu::CommandProcessor::kFrameTimeHistoryLength];
+  float frame_time_max_ms = 0.0f;
+  double frame_time_total_ms = 0.0;
+  for (size_t i = 0; i < frame_count; ++i) {
+    frame_times_ms[i] = float(frame_times_us[i]) * 0.001f;
+    frame_time_max_ms = std::max(frame_time_max_ms, frame_times_ms[i]);
+    frame_time_total_ms += frame_times_ms[i];
+  }
+
+  ImGui::SetNextWindowPos(ImVec2(20, 20), ImGuiCond_FirstUseEver);
+  ImGui::SetNextWindowBgAlpha(0.6f);
+  bool dialog_open = true;
+  if (!ImGui::Begin("Performance", &dialog_open,
+                    ImGuiWindowFlags_NoCollapse |
+                        ImGuiWindowFlags_AlwaysAutoResize)) {
+    ImGui::End();
+    return;
+  }
+
+  ImGui::Text("Guest: %" PRIu64 " FPS, %.2f ms average, %.2f ms max",
+              sample_swap_count_,
+              frame_count ? frame_time_total_ms / double(frame_count) : 0.0,
+              frame_time_max_ms);
+  ImGui::PlotLines("##FrameTimes", frame_times_ms, int(frame_count), 0,
+                   nullptr, 0.0f, std::max(frame_time_max_ms, 33.4f),
+                   ImVec2(360, 80));
+  ImGui::Text("Host: %.0f FPS, %.2f ms", io.Framerate,
+              io.DeltaTime * 1000.0f);
+  ImGui::Text("Command processor idle: %.1f%% (%.1f%% spinning)",
+              sample_command_processor_idle_ * 100.0,
+              sample_command_processor_idle_spin_ * 100.0);
+  ImGui::Spacing();
+  ImGui::TextUnformatted("Per frame:");
+  ImGui::Text("JIT functions: %.2f (%.2f ms)", sample_function_definitions_,
+              sample_function_definition_ms_);
+  ImGui::Text("Shader translations: %.2f (%.2f ms)",
+              sample_shader_translations_, sample_shader_translation_ms_);
+  ImGui::Text("Pipeline creations: %.2f", sample_pipeline_creations_);
+  ImGui::Text("Texture loads: %.2f", sample_texture_loads_);
+  ImGui::Text("XMA decoding: %.2f ms", sample_xma_decode_ms_);
+
+  ImGui::End();
+
+  if (!dialog_open) {
+    emulator_window_.TogglePerformanceOverlayDialog();
+    // `this` might have been destroyed by TogglePerformanceOverlayDialog.
+    return;
+  }
+}
+
 bool EmulatorWindow::Initialize() {
   window_->AddListener(&window_listener_);
   window_->AddInputListener(&window_listener_, kZOrderEmulatorWindowInput);
@@ -591,6 +937,15 @@ bool EmulatorWindow::Initialize() {
     cpu_menu->AddChild(MenuItem::Create(MenuItem::Type::kString,
                                         "&Pause/Resume Profiler", "`",
                                         []() { Profiler::TogglePause(); }));
+    cpu_menu->AddChild(MenuItem::Create(
+        MenuItem::Type::kString, "&Memory Statistics",
+        std::bind(&EmulatorWindow::ToggleMemoryStatisticsDialog, this)));
+    cpu_menu->AddChild(MenuItem::Create(
+        MenuItem::Type::kString, "&Audio Statistics",
+        std::bind(&EmulatorWindow::ToggleAudioStatisticsDialog, this)));
+    cpu_menu->AddChild(MenuItem::Create(
+        MenuItem::Type::kString, "P&erformance Overlay", "F10",
+        std::bind(&EmulatorWindow::TogglePerformanceOverlayDialog, this)));
   }
   cpu_menu->AddChild(MenuItem::Create(MenuItem::Type::kSeparator));
   {
@@ -812,6 +1167,9 @@ void EmulatorWindow::OnKeyDown(ui::KeyEvent& e) {
     case ui::VirtualKey::kF6: {
       ToggleDisplayConfigDialog();
     } break;
+    case ui::VirtualKey::kF10: {
+      TogglePerformanceOverlayDialog();
+    } break;
     case ui::VirtualKey::kF11: {
       ToggleFullscreen();
     } break;
@@ -827,8 +1185,7 @@ void EmulatorWindow::OnKeyDown(ui::KeyEvent& e) {
     case ui::VirtualKey::kF7: {
       // Save to file
       // TODO: Choose path based on user input, or from options
-      // TODO: Spawn a new thread to do this.
-      emulator()->SaveToFile("test.sav");
+      emulator()->SaveToFile("test.sav", false, true);
     } break;
     case ui::VirtualKey::kF8: {
       // Restore from file
@@ -881,9 +1238,10 @@ void EmulatorWindow::FileOpen() {
   file_picker->set_multi_selection(false);
   file_picker->set_title("Select Content Package");
   file_picker->set_extensions({
-      {"Supported Files", "*.iso;*.xex;*.zar;*.*"},
+      {"Supported Files", "*.iso;*.xex;*.zar;*.xcz;*.*"},
       {"Disc Image (*.iso)", "*.iso"},
       {"Disc Archive (*.zar)", "*.zar"},
+      {"Compressed Disc Image (*.xcz)", "*.xcz"},
       {"Xbox Executable (*.xex)", "*.xex"},
       //{"Content Package (*.xcp)", "*.xcp" },
       {"All Files (*.*)", "*.*"},
@@ -1020,6 +1378,33 @@ void EmulatorWindow::ToggleDisplayConfigDialog() {
   }
 }
 
+void EmulatorWindow::ToggleMemoryStatisticsDialog() {
+  if (!memory_statistics_dialog_) {
+    memory_statistics_dialog_ = std::unique_ptr<MemoryStatisticsDialog>(
+        new MemoryStatisticsDialog(imgui_drawer_.get(), *this));
+  } else {
+    memory_statistics_dialog_.reset();
+  }
+}
+
+void EmulatorWindow::ToggleAudioStatisticsDialog() {
+  if (!audio_statistics_dialog_) {
+    audio_statistics_dialog_ = std::unique_ptr<AudioStatisticsDialog>(
+        new AudioStatisticsDialog(imgui_drawer_.get(), *this));
+  } else {
+    audio_statistics_dialog_.reset();
+  }
+}
+
+void EmulatorWindow::TogglePerformanceOverlayDialog() {
+  if (!performance_overlay_dialog_) {
+    performance_overlay_dialog_ = std::unique_ptr<PerformanceOverlayDialog>(
+        new PerformanceOverlayDialog(imgui_drawer_.get(), *this));
+  } else {
+    performance_overlay_dialog_.reset();
+  }
+}
+
 void EmulatorWindow::ToggleControllerVibration() {
   auto input_sys = emulator()->input_system();
   if (input_sys) {
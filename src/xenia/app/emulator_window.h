@@ -12,9 +12,13 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
+#include "xenia/apu/xma_context.h"
+#include "xenia/cpu/processor.h"
 #include "xenia/emulator.h"
 #include "xenia/gpu/command_processor.h"
+#include "xenia/memory.h"
 #include "xenia/ui/imgui_dialog.h"
 #include "xenia/ui/imgui_drawer.h"
 #include "xenia/ui/immediate_drawer.h"
@@ -162,6 +166,72 @@ class EmulatorWindow {
     EmulatorWindow& emulator_window_;
   };
 
+  class MemoryStatisticsDialog final : public ui::ImGuiDialog {
+   public:
+    MemoryStatisticsDialog(ui::ImGuiDrawer* imgui_drawer,
+                           EmulatorWindow& emulator_window)
+        : ui::ImGuiDialog(imgui_drawer), emulator_window_(emulator_window) {}
+
+   protected:
+    void OnDraw(ImGuiIO& io) override;
+
+   private:
+    EmulatorWindow& emulator_window_;
+    // The rates are shown for the last full second.
+    uint64_t sample_host_ticks_ = 0;
+    MemoryStatistics sample_statistics_ = {};
+    MemoryStatistics sample_rates_ = {};
+  };
+
+  class AudioStatisticsDialog final : public ui::ImGuiDialog {
+   public:
+    AudioStatisticsDialog(ui::ImGuiDrawer* imgui_drawer,
+                          EmulatorWindow& emulator_window)
+        : ui::ImGuiDialog(imgui_drawer), emulator_window_(emulator_window) {}
+
+   protected:
+    void OnDraw(ImGuiIO& io) override;
+
+   private:
+    EmulatorWindow& emulator_window_;
+    // The rates are shown for the last full second, indexed by the XMA context
+    // ID.
+    uint64_t sample_host_ticks_ = 0;
+    std::vector<apu::XmaContext::Statistics> sample_statistics_;
+    std::vector<apu::XmaContext::Statistics> sample_rates_;
+  };
+
+  class PerformanceOverlayDialog final : public ui::ImGuiDialog {
+   public:
+    PerformanceOverlayDialog(ui::ImGuiDrawer* imgui_drawer,
+                             EmulatorWindow& emulator_window)
+        : ui::ImGuiDialog(imgui_drawer), emulator_window_(emulator_window) {}
+
+   protected:
+    void OnDraw(ImGuiIO& io) override;
+
+   private:
+    struct Sample {
+      uint64_t host_ticks;
+      cpu::ProcessorStatistics processor;
+      gpu::CommandProcessor::Statistics gpu;
+      uint64_t xma_decode_host_ticks;
+    };
+    EmulatorWindow& emulator_window_;
+    // The per-frame values are averaged over the last full second.
+    Sample sample_ = {};
+    uint64_t sample_swap_count_ = 0;
+    double sample_command_processor_idle_ = 0.0;
+    double sample_command_processor_idle_spin_ = 0.0;
+    double sample_function_definitions_ = 0.0;
+    double sample_function_definition_ms_ = 0.0;
+    double sample_shader_translations_ = 0.0;
+    double sample_shader_translation_ms_ = 0.0;
+    double sample_pipeline_creations_ = 0.0;
+    double sample_texture_loads_ = 0.0;
+    double sample_xma_decode_ms_ = 0.0;
+  };
+
   explicit EmulatorWindow(Emulator* emulator,
                           ui::WindowedAppContext& app_context);
 
@@ -197,6 +267,9 @@ class EmulatorWindow {
   void GpuTraceFrame();
   void GpuClearCaches();
   void ToggleDisplayConfigDialog();
+  void ToggleMemoryStatisticsDialog();
+  void ToggleAudioStatisticsDialog();
+  void TogglePerformanceOverlayDialog();
   void ToggleControllerVibration();
   void ShowCompatibility();
   void ShowFAQ();
@@ -233,6 +306,9 @@ class EmulatorWindow {
   bool initializing_shader_storage_ = false;
 
   std::unique_ptr<DisplayConfigDialog> display_config_dialog_;
+  std::unique_ptr<MemoryStatisticsDialog> memory_statistics_dialog_;
+  std::unique_ptr<AudioStatisticsDialog> audio_statistics_dialog_;
+  std::unique_ptr<PerformanceOverlayDialog> performance_overlay_dialog_;
 
   std::vector<RecentTitleEntry> recently_launched_titles_;
 };
@@ -15,6 +15,7 @@
 #include <thread>
 #include <vector>
 
+#include "xenia/app/benchmark_runner.h"
 #include "xenia/app/discord/discord_presence.h"
 #include "xenia/app/emulator_window.h"
 #include "xenia/base/assert.h"
@@ -220,6 +221,9 @@ class EmulatorApp final : public xe::ui::WindowedApp {
 
   DebugWindowClosedListener debug_window_closed_listener_;
 
+  // Listening to the events of the emulator - placed before it.
+  std::unique_ptr<BenchmarkRunner> benchmark_runner_;
+
   std::unique_ptr<Emulator> emulator_;
   std::unique_ptr<EmulatorWindow> emulator_window_;
 
@@ -575,7 +579,16 @@ void EmulatorApp::EmulatorThread() {
         });
   }
 
+  if (BenchmarkRunner::IsRequested()) {
+    benchmark_runner_ = std::make_unique<BenchmarkRunner>(
+        emulator_.get(),
+        [this](bool succeeded) { app_context().RequestDeferredQuit(); });
+  }
+
   emulator_->on_launch.AddListener([&](auto title_id, const auto& game_title) {
+    if (benchmark_runner_) {
+      benchmark_runner_->Start();
+    }
     if (cvars::discord) {
       discord::DiscordPresence::PlayingTitle(
           game_title.empty() ? "Unknown Title" : std::string(game_title));
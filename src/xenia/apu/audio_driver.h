@@ -10,6 +10,9 @@
 #ifndef XENIA_APU_AUDIO_DRIVER_H_
 #define XENIA_APU_AUDIO_DRIVER_H_
 
+#include <atomic>
+#include <cstdint>
+
 #include "xenia/memory.h"
 #include "xenia/xbox.h"
 
@@ -23,12 +26,22 @@ class AudioDriver {
 
   virtual void SubmitFrame(uint32_t samples_ptr) = 0;
 
+  // Times the device ran out of submitted frames while playing.
+  uint64_t underrun_count() const {
+    return underrun_count_.load(std::memory_order_relaxed);
+  }
+
  protected:
+  void ReportUnderrun() {
+    underrun_count_.fetch_add(1, std::memory_order_relaxed);
+  }
+
   inline uint8_t* TranslatePhysical(uint32_t guest_address) const {
     return memory_->TranslatePhysical(guest_address);
   }
 
   Memory* memory_ = nullptr;
+  std::atomic<uint64_t> underrun_count_ = {0};
 };
 
 }  // namespace apu
@@ -9,11 +9,15 @@
 
 #include "xenia/apu/audio_system.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include "xenia/apu/apu_flags.h"
 #include "xenia/apu/audio_driver.h"
 #include "xenia/apu/xma_decoder.h"
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_stream.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
@@ -37,17 +41,28 @@
 
 DEFINE_uint32(
     apu_max_queued_frames, 64,
-    "Allows changing max buffered audio frames to reduce audio delay. Minimum is 16.", "APU");
+    "Allows changing max buffered audio frames to reduce audio delay, each "
+    "frame is 256 samples (5.3 ms). Minimum is 4.",
+    "APU");
+
+DEFINE_bool(apu_low_latency, false,
+            "Keeps as few audio frames queued as the host plays without "
+            "underruns, adapting to them, up to apu_max_queued_frames.",
+            "APU");
 
 namespace xe {
 namespace apu {
 
+// Samples per channel in a frame, and their rate.
+constexpr uint32_t kFrameSamples = 256;
+constexpr uint32_t kFrameFrequency = 48000;
+
 AudioSystem::AudioSystem(cpu::Processor* processor)
     : memory_(processor->memory()),
       processor_(processor),
       worker_running_(false) {
   std::memset(clients_, 0, sizeof(clients_));
-  queued_frames_ = std::max(cvars::apu_max_queued_frames, (uint32_t)16);
+  queued_frames_ = std::max(cvars::apu_max_queued_frames, (uint32_t)4);
 
   for (size_t i = 0; i < kMaximumClientCount; ++i) {
     client_semaphores_[i] = xe::threading::Semaphore::Create(0, queued_frames_);
@@ -124,6 +139,11 @@ void AudioSystem::WorkerThreadMain() {
       auto global_lock = global_critical_region_.Acquire();
       uint32_t client_callback = clients_[index].callback;
       uint32_t client_callback_arg = clients_[index].wrapped_callback_arg;
+      if (cvars::apu_low_latency && client_callback &&
+          !UpdateClientLatency(index)) {
+        client_callback = 0;
+      }
+      UpdateProfilerCounters();
       global_lock.unlock();
 
       if (client_callback) {
@@ -161,6 +181,98 @@ int AudioSystem::FindFreeClient() {
   return -1;
 }
 
+uint32_t AudioSystem::ResetClientLatency(size_t index) {
+  ClientLatency& latency = client_latencies_[index];
+  latency = {};
+  latency.queued_frames =
+      cvars::apu_low_latency
+          ? std::min(kLowLatencyMinimumFrames * 2, queued_frames_)
+          : queued_frames_;
+  latency.target_queued_frames = latency.queued_frames;
+  return latency.queued_frames;
+}
+
+bool AudioSystem::UpdateClientLatency(size_t index) {
+  ClientLatency& latency = client_latencies_[index];
+  AudioDriver* driver = clients_[index].driver;
+
+  // Frames are normally taken once every frame period.
+  double period_ticks = double(Clock::QueryHostTickFrequency()) *
+                        kFrameSamples / kFrameFrequency;
+  uint64_t tick = Clock::QueryHostTickCount();
+  if (latency.last_frame_tick) {
+    double deviation =
+        std::abs(double(tick - latency.last_frame_tick) - period_ticks);
+    latency.jitter_ticks += (deviation - latency.jitter_ticks) / 16.0;
+  }
+  latency.last_frame_tick = tick;
+
+  uint32_t target = latency.target_queued_frames;
+  uint64_t underrun_count = driver ? driver->underrun_count() : 0;
+  if (underrun_count != latency.underrun_count) {
+    latency.underrun_count = underrun_count;
+    latency.stable_frames = 0;
+    target += 2;
+  } else if (++latency.stable_frames >= kLowLatencyStableFrames) {
+    latency.stable_frames = 0;
+    --target;
+  }
+  uint32_t jitter_frames =
+      uint32_t(std::ceil(2.0 * latency.jitter_ticks / period_ticks));
+  target = std::min(std::max(target, kLowLatencyMinimumFrames + jitter_frames),
+                    queued_frames_);
+  if (target != latency.target_queued_frames) {
+    latency.target_queued_frames = target;
+    XELOGAPU("AudioSystem: client {} now queues {} frames ({:.1f} ms)", index,
+             target, double(target + 1) * kFrameSamples * 1000.0 /
+                         kFrameFrequency);
+  }
+
+  if (latency.queued_frames > target) {
+    // Let the frame that has been taken go without a replacement.
+    --latency.queued_frames;
+    return false;
+  }
+  if (latency.queued_frames < target) {
+    auto ret = client_semaphores_[index]->Release(
+        int(target - latency.queued_frames), nullptr);
+    assert_true(ret);
+    latency.queued_frames = target;
+  }
+  return true;
+}
+
+void AudioSystem::UpdateProfilerCounters() {
+  uint32_t queued_frames = 0;
+  uint64_t underrun_count = 0;
+  for (size_t i = 0; i < kMaximumClientCount; ++i) {
+    if (!clients_[i].in_use) {
+      continue;
+    }
+    queued_frames += client_latencies_[i].queued_frames;
+    if (clients_[i].driver) {
+      underrun_count += clients_[i].driver->underrun_count();
+    }
+  }
+  COUNT_profile_set("apu/queued_frames", queued_frames);
+  COUNT_profile_set("apu/underruns", underrun_count);
+}
+
+bool AudioSystem::GetClientStats(size_t index, ClientStats* out_stats) {
+  auto global_lock = global_critical_region_.Acquire();
+  if (index >= kMaximumClientCount || !clients_[index].in_use) {
+    return false;
+  }
+  // The drivers are given one more frame to play currently.
+  uint32_t queued_frames = client_latencies_[index].queued_frames;
+  out_stats->queued_frames = queued_frames;
+  out_stats->latency_ms =
+      double(queued_frames + 1) * kFrameSamples * 1000.0 / kFrameFrequency;
+  out_stats->underrun_count =
+      clients_[index].driver ? clients_[index].driver->underrun_count() : 0;
+  return true;
+}
+
 void AudioSystem::Initialize() {}
 
 void AudioSystem::Shutdown() {
@@ -180,7 +292,7 @@ X_STATUS AudioSystem::RegisterClient(uint32_t callback, uint32_t callback_arg,
   assert_true(index >= 0);
 
   auto client_semaphore = client_semaphores_[index].get();
-  auto ret = client_semaphore->Release(queued_frames_, nullptr);
+  auto ret = client_semaphore->Release(ResetClientLatency(index), nullptr);
   assert_true(ret);
 
   AudioDriver* driver;
@@ -283,7 +395,7 @@ bool AudioSystem::Restore(ByteStream* stream) {
     client.in_use = true;
 
     auto client_semaphore = client_semaphores_[id].get();
-    auto ret = client_semaphore->Release(queued_frames_, nullptr);
+    auto ret = client_semaphore->Release(ResetClientLatency(id), nullptr);
     assert_true(ret);
 
     AudioDriver* driver = nullptr;
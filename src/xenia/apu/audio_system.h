@@ -44,6 +44,17 @@ class AudioSystem {
   void UnregisterClient(size_t index);
   void SubmitFrame(size_t index, uint32_t samples_ptr);
 
+  struct ClientStats {
+    // Frames the client may have submitted ahead of playback.
+    uint32_t queued_frames;
+    // From a frame being submitted to it being played, at most.
+    double latency_ms;
+    uint64_t underrun_count;
+  };
+  // Returns false if the client is not registered.
+  bool GetClientStats(size_t index, ClientStats* out_stats);
+  size_t client_count() const { return kMaximumClientCount; }
+
   bool Save(ByteStream* stream);
   bool Restore(ByteStream* stream);
 
@@ -87,6 +98,31 @@ class AudioSystem {
 
   int FindFreeClient();
 
+  // With apu_low_latency, the frames clients may queue are varied between
+  // kLowLatencyMinimumFrames and queued_frames_, depending on the underruns
+  // and the jitter of the driver taking the frames. Frames are let through by
+  // the semaphores, which are given more or fewer releases to change it.
+  static const uint32_t kLowLatencyMinimumFrames = 2;
+  // About 10 seconds.
+  static const uint32_t kLowLatencyStableFrames = 1875;
+  struct ClientLatency {
+    uint32_t queued_frames;
+    uint32_t target_queued_frames;
+    uint32_t stable_frames;
+    uint64_t underrun_count;
+    uint64_t last_frame_tick;
+    double jitter_ticks;
+  } client_latencies_[kMaximumClientCount];
+
+  // Returns the frames to initially let the client queue.
+  uint32_t ResetClientLatency(size_t index);
+  // Called with the global lock when a frame of the client has been taken by
+  // the driver. Returns false if the client must not be asked for a frame to
+  // replace it.
+  bool UpdateClientLatency(size_t index);
+  // Totals of all the clients, called with the global lock.
+  void UpdateProfilerCounters();
+
   std::unique_ptr<xe::threading::Semaphore>
       client_semaphores_[kMaximumClientCount];
   // Event is always there in case we have no clients.
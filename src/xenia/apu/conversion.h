@@ -21,52 +21,44 @@ namespace conversion {
 
 #if XE_ARCH_AMD64
 
-
-XE_NOINLINE
-static void _generic_sequential_6_BE_to_interleaved_6_LE(
-    float* XE_RESTRICT output, const float* XE_RESTRICT input,
-    unsigned ch_sample_count) {
-  for (unsigned sample = 0; sample < ch_sample_count; sample++) {
-    for (unsigned channel = 0; channel < 6; channel++) {
-      unsigned int value = *reinterpret_cast<const unsigned int*>(
-          &input[channel * ch_sample_count + sample]);
-
-      *reinterpret_cast<unsigned int*>(&output[sample * 6 + channel]) =
-          xe::byte_swap(value);
+inline void sequential_6_BE_to_interleaved_6_LE(float* output,
+                                                const float* input,
+                                                size_t ch_sample_count) {
+  const __m128i byte_swap_shuffle =
+      _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  size_t sample = 0;
+  for (; sample + 4 <= ch_sample_count; sample += 4) {
+    // load 4 samples from 6 channels each
+    __m128 c[6];
+    for (size_t channel = 0; channel < 6; channel++) {
+      c[channel] = _mm_castsi128_ps(_mm_shuffle_epi8(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+              &input[channel * ch_sample_count + sample])),
+          byte_swap_shuffle));
     }
+    // transpose the 6x4 samples to 4x6, in pairs of channels
+    __m128 c01_lo = _mm_unpacklo_ps(c[0], c[1]);
+    __m128 c01_hi = _mm_unpackhi_ps(c[0], c[1]);
+    __m128 c23_lo = _mm_unpacklo_ps(c[2], c[3]);
+    __m128 c23_hi = _mm_unpackhi_ps(c[2], c[3]);
+    __m128 c45_lo = _mm_unpacklo_ps(c[4], c[5]);
+    __m128 c45_hi = _mm_unpackhi_ps(c[4], c[5]);
+    float* out = &output[sample * 6];
+    _mm_storeu_ps(out, _mm_movelh_ps(c01_lo, c23_lo));
+    _mm_storeu_ps(out + 4, _mm_shuffle_ps(c45_lo, c01_lo, 0xE4));
+    _mm_storeu_ps(out + 8, _mm_movehl_ps(c45_lo, c23_lo));
+    _mm_storeu_ps(out + 12, _mm_movelh_ps(c01_hi, c23_hi));
+    _mm_storeu_ps(out + 16, _mm_shuffle_ps(c45_hi, c01_hi, 0xE4));
+    _mm_storeu_ps(out + 20, _mm_movehl_ps(c45_hi, c23_hi));
   }
-}
-#if XE_COMPILER_CLANG_CL != 1
-// load_be_u32 unavailable on clang-cl
-XE_NOINLINE
-static void _movbe_sequential_6_BE_to_interleaved_6_LE(
-    float* XE_RESTRICT output, const float* XE_RESTRICT input,
-    unsigned ch_sample_count) {
-  for (unsigned sample = 0; sample < ch_sample_count; sample++) {
-    for (unsigned channel = 0; channel < 6; channel++) {
-      *reinterpret_cast<unsigned int*>(&output[sample * 6 + channel]) =
-          _load_be_u32(reinterpret_cast<const unsigned int*>(
-              &input[channel * ch_sample_count + sample]));
+  for (; sample < ch_sample_count; sample++) {
+    for (size_t channel = 0; channel < 6; channel++) {
+      output[sample * 6 + channel] =
+          xe::byte_swap(input[channel * ch_sample_count + sample]);
     }
   }
 }
 
-inline static void sequential_6_BE_to_interleaved_6_LE(
-    float* output, const float* input, unsigned ch_sample_count) {
-  if (amd64::GetFeatureFlags() & amd64::kX64EmitMovbe) {
-    _movbe_sequential_6_BE_to_interleaved_6_LE(output, input, ch_sample_count);
-  } else {
-    _generic_sequential_6_BE_to_interleaved_6_LE(output, input,
-                                                 ch_sample_count);
-  }
-}
-#else
-inline static void sequential_6_BE_to_interleaved_6_LE(
-    float* output, const float* input, unsigned ch_sample_count) {
-  _generic_sequential_6_BE_to_interleaved_6_LE(output, input, ch_sample_count);
-}
-#endif
-
 inline void sequential_6_BE_to_interleaved_2_LE(float* output,
                                                 const float* input,
                                                 size_t ch_sample_count) {
@@ -24,13 +24,11 @@ namespace apu {
 namespace sdl {
 
 SDLAudioDriver::SDLAudioDriver(Memory* memory,
-                               xe::threading::Semaphore* semaphore)
-    : AudioDriver(memory), semaphore_(semaphore) {}
+                               xe::threading::Semaphore* semaphore,
+                               uint32_t frame_count)
+    : AudioDriver(memory), semaphore_(semaphore), frame_count_(frame_count) {}
 
-SDLAudioDriver::~SDLAudioDriver() {
-  assert_true(frames_queued_.empty());
-  assert_true(frames_unused_.empty());
-};
+SDLAudioDriver::~SDLAudioDriver() { assert_null(frames_); };
 
 bool SDLAudioDriver::Initialize() {
   SDL_version ver = {};
@@ -80,6 +78,9 @@ bool SDLAudioDriver::Initialize() {
     return false;
   }
   sdl_device_channels_ = obtained_spec.channels;
+  device_frame_samples_ = channel_samples_ * sdl_device_channels_;
+  frames_ = std::make_unique<float[]>(size_t(frame_count_) *
+                                      device_frame_samples_);
 
   SDL_PauseAudioDevice(sdl_device_id_, 0);
 
@@ -87,23 +88,39 @@ bool SDLAudioDriver::Initialize() {
 }
 
 void SDLAudioDriver::SubmitFrame(uint32_t frame_ptr) {
+  uint32_t written = frames_written_.load(std::memory_order_relaxed);
+  if (written - frames_read_.load(std::memory_order_acquire) >= frame_count_) {
+    // Only if the client submitted without waiting for the semaphore, drop the
+    // frame but let it continue.
+    auto ret = semaphore_->Release(1, nullptr);
+    assert_true(ret);
+    return;
+  }
+
+  // Converted here rather than in the callback, which must return quickly.
   const auto input_frame = memory_->TranslateVirtual<float*>(frame_ptr);
-  float* output_frame;
-  {
-    std::unique_lock<std::mutex> guard(frames_mutex_);
-    if (frames_unused_.empty()) {
-      output_frame = new float[frame_samples_];
-    } else {
-      output_frame = frames_unused_.top();
-      frames_unused_.pop();
+  float* output_frame =
+      &frames_[size_t(written % frame_count_) * device_frame_samples_];
+  if (cvars::mute) {
+    std::memset(output_frame, 0, sizeof(float) * device_frame_samples_);
+  } else {
+    switch (sdl_device_channels_) {
+      case 2:
+        conversion::sequential_6_BE_to_interleaved_2_LE(
+            output_frame, input_frame, channel_samples_);
+        break;
+      case 6:
+        conversion::sequential_6_BE_to_interleaved_6_LE(
+            output_frame, input_frame, channel_samples_);
+        break;
+      default:
+        assert_unhandled_case(sdl_device_channels_);
+        break;
     }
   }
-
-  std::memcpy(output_frame, input_frame, frame_samples_ * sizeof(float));
-
-  {
-    std::unique_lock<std::mutex> guard(frames_mutex_);
-    frames_queued_.push(output_frame);
+  frames_written_.store(written + 1, std::memory_order_release);
+  if (starved_.exchange(false, std::memory_order_relaxed)) {
+    ReportUnderrun();
   }
 }
 
@@ -116,15 +133,8 @@ void SDLAudioDriver::Shutdown() {
     SDL_QuitSubSystem(SDL_INIT_AUDIO);
     sdl_initialized_ = false;
   }
-  std::unique_lock<std::mutex> guard(frames_mutex_);
-  while (!frames_unused_.empty()) {
-    delete[] frames_unused_.top();
-    frames_unused_.pop();
-  };
-  while (!frames_queued_.empty()) {
-    delete[] frames_queued_.front();
-    frames_queued_.pop();
-  };
+  // The callback doesn't run anymore with the device closed.
+  frames_.reset();
 }
 
 void SDLAudioDriver::SDLCallback(void* userdata, Uint8* stream, int len) {
@@ -137,30 +147,18 @@ void SDLAudioDriver::SDLCallback(void* userdata, Uint8* stream, int len) {
   assert_true(len ==
               sizeof(float) * channel_samples_ * driver->sdl_device_channels_);
 
-  std::unique_lock<std::mutex> guard(driver->frames_mutex_);
-  if (driver->frames_queued_.empty()) {
+  uint32_t read = driver->frames_read_.load(std::memory_order_relaxed);
+  if (read == driver->frames_written_.load(std::memory_order_acquire)) {
     std::memset(stream, 0, len);
-  } else {
-    auto buffer = driver->frames_queued_.front();
-    driver->frames_queued_.pop();
-    if (cvars::mute) {
-      std::memset(stream, 0, len);
-    } else {
-      switch (driver->sdl_device_channels_) {
-        case 2:
-          conversion::sequential_6_BE_to_interleaved_2_LE(
-              reinterpret_cast<float*>(stream), buffer, channel_samples_);
-          break;
-        case 6:
-          conversion::sequential_6_BE_to_interleaved_6_LE(
-              reinterpret_cast<float*>(stream), buffer, channel_samples_);
-          break;
-        default:
-          assert_unhandled_case(driver->sdl_device_channels_);
-          break;
-      }
+    if (read) {
+      driver->starved_.store(true, std::memory_order_relaxed);
     }
-    driver->frames_unused_.push(buffer);
+  } else {
+    std::memcpy(stream,
+                &driver->frames_[size_t(read % driver->frame_count_) *
+                                 driver->device_frame_samples_],
+                len);
+    driver->frames_read_.store(read + 1, std::memory_order_release);
 
     auto ret = driver->semaphore_->Release(1, nullptr);
     assert_true(ret);
@@ -10,9 +10,8 @@
 #ifndef XENIA_APU_SDL_SDL_AUDIO_DRIVER_H_
 #define XENIA_APU_SDL_SDL_AUDIO_DRIVER_H_
 
-#include <mutex>
-#include <queue>
-#include <stack>
+#include <atomic>
+#include <memory>
 
 #include "SDL.h"
 #include "xenia/apu/audio_driver.h"
@@ -24,7 +23,9 @@ namespace sdl {
 
 class SDLAudioDriver : public AudioDriver {
  public:
-  SDLAudioDriver(Memory* memory, xe::threading::Semaphore* semaphore);
+  // The semaphore limits the submitted frames not played yet to frame_count.
+  SDLAudioDriver(Memory* memory, xe::threading::Semaphore* semaphore,
+                 uint32_t frame_count);
   ~SDLAudioDriver() override;
 
   bool Initialize();
@@ -45,9 +46,18 @@ class SDLAudioDriver : public AudioDriver {
   static const uint32_t channel_samples_ = 256;
   static const uint32_t frame_samples_ = frame_channels_ * channel_samples_;
   static const uint32_t frame_size_ = sizeof(float) * frame_samples_;
-  std::queue<float*> frames_queued_ = {};
-  std::stack<float*> frames_unused_ = {};
-  std::mutex frames_mutex_ = {};
+
+  // Frames already converted to the layout of the device, in a ring written
+  // only by SubmitFrame and read only by the callback, so neither waits for
+  // the other.
+  uint32_t frame_count_;
+  uint32_t device_frame_samples_ = 0;
+  std::unique_ptr<float[]> frames_;
+  std::atomic<uint32_t> frames_written_ = {0};
+  std::atomic<uint32_t> frames_read_ = {0};
+  // Set by the callback when it had nothing to play, reported as an underrun
+  // once playback continues, so stopping submitting isn't an underrun.
+  std::atomic<bool> starved_ = {false};
 };
 
 }  // namespace sdl
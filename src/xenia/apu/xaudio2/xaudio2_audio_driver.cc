@@ -196,6 +196,10 @@ void XAudio2AudioDriver::SubmitFrame(uint32_t frame_ptr) {
     objects_.api_2_7.pcm_voice->GetState(&state);
   }
   assert_true(state.BuffersQueued < frame_count_);
+  if (!state.BuffersQueued && submitted_frames_) {
+    ReportUnderrun();
+  }
+  submitted_frames_ = true;
 
   auto input_frame = memory_->TranslateVirtual<float*>(frame_ptr);
   auto output_frame = reinterpret_cast<float*>(frames_[current_frame_]);
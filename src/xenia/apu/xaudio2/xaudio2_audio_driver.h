@@ -101,6 +101,7 @@ class XAudio2AudioDriver : public AudioDriver {
   static const uint32_t frame_size_ = sizeof(float) * frame_samples_;
   float frames_[frame_count_][frame_samples_];
   uint32_t current_frame_ = 0;
+  bool submitted_frames_ = false;
 };
 
 }  // namespace xaudio2
@@ -14,11 +14,14 @@
 
 #include "xenia/apu/xma_decoder.h"
 #include "xenia/apu/xma_helpers.h"
+#include "xenia/apu/xma_pcm_cache.h"
 #include "xenia/base/bit_stream.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/platform.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/ring_buffer.h"
+#include "xenia/base/xxhash.h"
 
 extern "C" {
 #if XE_COMPILER_MSVC
@@ -54,10 +57,12 @@ XmaContext::~XmaContext() {
   //  }
 }
 
-int XmaContext::Setup(uint32_t id, Memory* memory, uint32_t guest_ptr) {
+int XmaContext::Setup(uint32_t id, Memory* memory, uint32_t guest_ptr,
+                      XmaPcmCache* pcm_cache) {
   id_ = id;
   memory_ = memory;
   guest_ptr_ = guest_ptr;
+  pcm_cache_ = pcm_cache;
 
   // Allocate ffmpeg stuff:
   av_packet_ = av_packet_alloc();
@@ -98,19 +103,37 @@ bool XmaContext::Work() {
   }
   {
     std::lock_guard<xe_mutex> lock(lock_);
-    set_is_enabled(false);
+    // Could have been locked by the guest after the check.
+    if (!is_enabled_.exchange(false, std::memory_order_acq_rel)) {
+      return false;
+    }
 
     auto context_ptr = memory()->TranslateVirtual(guest_ptr());
     XMA_CONTEXT_DATA data(context_ptr);
+    uint64_t start_ticks = Clock::QueryHostTickCount();
     Decode(&data);
+    decode_host_ticks_.fetch_add(Clock::QueryHostTickCount() - start_ticks,
+                                 std::memory_order_relaxed);
+    decode_count_.fetch_add(1, std::memory_order_relaxed);
     data.Store(context_ptr);
     return true;
   }
 }
 
-void XmaContext::Enable() {
-  std::lock_guard<xe_mutex> lock(lock_);
+void XmaContext::GetStatistics(Statistics& statistics) const {
+  statistics.decode_count = decode_count_.load(std::memory_order_relaxed);
+  statistics.packet_count = packet_count_.load(std::memory_order_relaxed);
+  statistics.frame_count = frame_count_.load(std::memory_order_relaxed);
+  statistics.cached_frame_count =
+      cached_frame_count_.load(std::memory_order_relaxed);
+  statistics.decode_host_ticks =
+      decode_host_ticks_.load(std::memory_order_relaxed);
+}
 
+void XmaContext::Enable() {
+  // The context data is only read here, there's no need to wait for the
+  // decoder to finish working on the context. If it's working on it now, it
+  // will be decoded again.
   auto context_ptr = memory()->TranslateVirtual(guest_ptr());
   XMA_CONTEXT_DATA data(context_ptr);
 
@@ -120,8 +143,6 @@ void XmaContext::Enable() {
                                      : data.input_buffer_1_packet_count) *
                kBitsPerPacket);
 
-  data.Store(context_ptr);
-
   set_is_enabled(true);
 }
 
@@ -160,7 +181,8 @@ void XmaContext::Clear() {
 }
 
 void XmaContext::Disable() {
-  std::lock_guard<xe_mutex> lock(lock_);
+  // Only prevents further decoding, waiting for the current one is done via
+  // Block.
   XELOGAPU("XmaContext: disabling context {}", id());
   set_is_enabled(false);
 }
@@ -458,6 +480,8 @@ void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
                                data->input_buffer_read_offset);
       while (packets_skip_ > 0) {
         packets_skip_--;
+        packet_count_.fetch_add(1, std::memory_order_relaxed);
+        COUNT_profile_add("apu/xma/packets", 1);
         packet_idx++;
         if (packet_idx > current_input_packet_count) {
           if (!reuse_input_buffer) {
@@ -609,6 +633,8 @@ void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
         packets_skip_ = xma::GetPacketSkipCount(packet) + 1;
         while (packets_skip_ > 0) {
           packets_skip_--;
+          packet_count_.fetch_add(1, std::memory_order_relaxed);
+          COUNT_profile_add("apu/xma/packets", 1);
           packet += kBytesPerPacket;
           packet_idx++;
           if (packet_idx >= current_input_packet_count) {
@@ -647,28 +673,14 @@ void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
     split_frame_len_partial_ = 0;
     split_frame_padding_start_ = 0;
 
-    auto ret = avcodec_send_packet(av_context_, av_packet_);
-    if (ret < 0) {
-      XELOGE("XmaContext {}: Error - Sending packet for decoding failed", id());
-      // TODO bail out
-      assert_always();
-    }
-    ret = avcodec_receive_frame(av_context_, av_frame_);
-    /*
-    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
-      // TODO AVERROR_EOF???
-      break;
-    else
-    */
-    if (ret < 0) {
-      XELOGE("XmaContext {}: Error - Decoding failed", id());
+    auto byte_count = kBytesPerFrameChannel << data->is_stereo;
+    if (!DecodeFrame(byte_count)) {
       data->parser_error_status = 4;  // TODO(Gliniak): Find all parsing errors
                                       // and create enumerator from them
       SwapInputBuffer(data);
       assert_always();
       return;  // TODO bail out
     }
-    assert_true(ret == 0);
 
     {
       // copy over 1 frame
@@ -676,17 +688,13 @@ void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
 
       // assert(decoded_consumed_samples_ + kSamplesPerFrame <=
       //       current_frame_.size());
-      assert_true(av_context_->sample_fmt == AV_SAMPLE_FMT_FLTP);
       // assert_true(frame_is_split == (frame_idx == -1));
-
-      //			dump_raw(av_frame_, id());
-      ConvertFrame((const uint8_t**)av_frame_->data,
-                   bool(av_frame_->channels > 1), raw_frame_.data());
       // decoded_consumed_samples_ += kSamplesPerFrame;
 
-      auto byte_count = kBytesPerFrameChannel << data->is_stereo;
       assert_true(output_remaining_bytes >= byte_count);
       output_rb.Write(raw_frame_.data(), byte_count);
+      frame_count_.fetch_add(1, std::memory_order_relaxed);
+      COUNT_profile_add("apu/xma/frames", 1);
       output_remaining_bytes -= byte_count;
       data->output_buffer_write_offset = output_rb.write_offset() / 256;
 
@@ -708,6 +716,8 @@ void XmaContext::Decode(XMA_CONTEXT_DATA* data) {
         packets_skip_ = xma::GetPacketSkipCount(packet) + 1;
         while (packets_skip_ > 0) {
           packets_skip_--;
+          packet_count_.fetch_add(1, std::memory_order_relaxed);
+          COUNT_profile_add("apu/xma/packets", 1);
           packet_idx++;
           if (packet_idx >= current_input_packet_count) {
             if (!reuse_input_buffer) {
@@ -934,6 +944,69 @@ std::tuple<int, bool> XmaContext::GetPacketFrameCount(uint8_t* packet) {
   }
 }
 
+bool XmaContext::DecodeFrame(size_t pcm_size) {
+  uint64_t cache_key = 0;
+  if (pcm_cache_) {
+    uint64_t frame_hash =
+        XXH3_64bits(av_packet_->data, size_t(av_packet_->size));
+    cache_key = XXH3_64bits_withSeed(
+        &previous_xma_frame_hash_, sizeof(previous_xma_frame_hash_),
+        frame_hash ^ (uint64_t(av_context_->sample_rate) << 8) ^
+            uint64_t(av_context_->channels));
+    bool cached = pcm_cache_->Lookup(cache_key, raw_frame_.data(), pcm_size);
+    if (!cached && decoder_behind_) {
+      // Catch up with the skipped frame, its output is already known.
+      uint8_t* data = av_packet_->data;
+      int size = av_packet_->size;
+      av_packet_->data = previous_xma_frame_.data();
+      av_packet_->size = int(previous_xma_frame_size_);
+      if (avcodec_send_packet(av_context_, av_packet_) >= 0) {
+        avcodec_receive_frame(av_context_, av_frame_);
+      }
+      av_packet_->data = data;
+      av_packet_->size = size;
+    }
+    decoder_behind_ = cached;
+    std::memcpy(previous_xma_frame_.data(), av_packet_->data,
+                size_t(av_packet_->size));
+    previous_xma_frame_size_ = size_t(av_packet_->size);
+    previous_xma_frame_hash_ = frame_hash;
+    if (cached) {
+      cached_frame_count_.fetch_add(1, std::memory_order_relaxed);
+      COUNT_profile_add("apu/xma/cached_frames", 1);
+      return true;
+    }
+  }
+
+  auto ret = avcodec_send_packet(av_context_, av_packet_);
+  if (ret < 0) {
+    XELOGE("XmaContext {}: Error - Sending packet for decoding failed", id());
+    // TODO bail out
+    assert_always();
+  }
+  ret = avcodec_receive_frame(av_context_, av_frame_);
+  /*
+  if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+    // TODO AVERROR_EOF???
+    break;
+  else
+  */
+  if (ret < 0) {
+    XELOGE("XmaContext {}: Error - Decoding failed", id());
+    return false;
+  }
+  assert_true(ret == 0);
+  assert_true(av_context_->sample_fmt == AV_SAMPLE_FMT_FLTP);
+
+  //			dump_raw(av_frame_, id());
+  ConvertFrame((const uint8_t**)av_frame_->data, bool(av_frame_->channels > 1),
+               raw_frame_.data());
+  if (pcm_cache_) {
+    pcm_cache_->Insert(cache_key, raw_frame_.data(), pcm_size);
+  }
+  return true;
+}
+
 int XmaContext::PrepareDecoder(uint8_t* packet, int sample_rate,
                                bool is_two_channel) {
   // Sanity check: Packet metadata is always 1 for XMA2/0 for XMA
@@ -952,6 +1025,11 @@ int XmaContext::PrepareDecoder(uint8_t* packet, int sample_rate,
     av_context_->sample_rate = sample_rate;
     av_context_->channels = channels;
 
+    // The decoder starts without overlap from a previous frame.
+    previous_xma_frame_size_ = 0;
+    previous_xma_frame_hash_ = 0;
+    decoder_behind_ = false;
+
     if (avcodec_open2(av_context_, av_codec_, NULL) < 0) {
       XELOGE("XmaContext: Failed to reopen FFmpeg context");
       return -1;
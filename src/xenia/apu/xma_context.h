@@ -39,6 +39,8 @@ struct AVPacket;
 namespace xe {
 namespace apu {
 
+class XmaPcmCache;
+
 // This is stored in guest space in big-endian order.
 // We load and swap the whole thing to splat here so that we can
 // use bitfields.
@@ -150,7 +152,9 @@ class XmaContext {
   explicit XmaContext();
   ~XmaContext();
 
-  int Setup(uint32_t id, Memory* memory, uint32_t guest_ptr);
+  // pcm_cache may be null.
+  int Setup(uint32_t id, Memory* memory, uint32_t guest_ptr,
+            XmaPcmCache* pcm_cache);
   bool Work();
 
   void Enable();
@@ -164,10 +168,23 @@ class XmaContext {
   uint32_t id() { return id_; }
   uint32_t guest_ptr() { return guest_ptr_; }
   bool is_allocated() { return is_allocated_; }
-  bool is_enabled() { return is_enabled_; }
+  bool is_enabled() { return is_enabled_.load(std::memory_order_acquire); }
 
   void set_is_allocated(bool is_allocated) { is_allocated_ = is_allocated; }
-  void set_is_enabled(bool is_enabled) { is_enabled_ = is_enabled; }
+  void set_is_enabled(bool is_enabled) {
+    is_enabled_.store(is_enabled, std::memory_order_release);
+  }
+
+  // Totals of this hardware context over all its allocations, can be read
+  // without the lock.
+  struct Statistics {
+    uint64_t decode_count;
+    uint64_t packet_count;
+    uint64_t frame_count;
+    uint64_t cached_frame_count;
+    uint64_t decode_host_ticks;
+  };
+  void GetStatistics(Statistics& statistics) const;
 
  private:
   static void SwapInputBuffer(XMA_CONTEXT_DATA* data);
@@ -191,6 +208,8 @@ class XmaContext {
   static void ConvertFrame(const uint8_t** samples, bool is_two_channel,
                            uint8_t* output_buffer);
 
+  // Decodes the frame in av_packet_ to raw_frame_, or takes it from the cache.
+  bool DecodeFrame(size_t pcm_size);
   bool ValidFrameOffset(uint8_t* block, size_t size_bytes,
                         size_t frame_offset_bits);
   void Decode(XMA_CONTEXT_DATA* data);
@@ -201,12 +220,15 @@ class XmaContext {
   uint32_t GetPacketFirstFrameOffset(const XMA_CONTEXT_DATA* data);
 
   Memory* memory_ = nullptr;
+  XmaPcmCache* pcm_cache_ = nullptr;
 
   uint32_t id_ = 0;
   uint32_t guest_ptr_ = 0;
   xe_mutex lock_;
   volatile bool is_allocated_ = false;
-  volatile bool is_enabled_ = false;
+  // Set by kicks and cleared by locks without taking lock_, so guest register
+  // writes don't wait for the decoding of the context.
+  std::atomic<bool> is_enabled_ = false;
   // bool is_dirty_ = true;
 
   // ffmpeg structures
@@ -236,6 +258,19 @@ class XmaContext {
   // uint8_t* current_frame_ = nullptr;
   // conversion buffer for 2 channel frame
   std::array<uint8_t, kBytesPerFrameChannel * 2> raw_frame_;
+  // The decoder output overlaps with the previous frame, so cached PCM is
+  // looked up for the pair. If it was taken from the cache, the frame is fed to
+  // the decoder before decoding the next one.
+  std::array<uint8_t, 1 + 4096> previous_xma_frame_;
+  size_t previous_xma_frame_size_ = 0;
+  uint64_t previous_xma_frame_hash_ = 0;
+  bool decoder_behind_ = false;
+
+  std::atomic<uint64_t> decode_count_ = {0};
+  std::atomic<uint64_t> packet_count_ = {0};
+  std::atomic<uint64_t> frame_count_ = {0};
+  std::atomic<uint64_t> cached_frame_count_ = {0};
+  std::atomic<uint64_t> decode_host_ticks_ = {0};
   // std::vector<uint8_t> current_frame_ = std::vector<uint8_t>(0);
 };
 
@@ -9,6 +9,9 @@
 
 #include "xenia/apu/xma_decoder.h"
 
+#include <algorithm>
+
+#include "third_party/fmt/include/fmt/format.h"
 #include "xenia/apu/xma_context.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
@@ -48,6 +51,21 @@ extern "C" {
 // do this, it's likely they are either passing the context to XAudio or
 // using the XMA* functions.
 
+DEFINE_int32(xma_decoder_host_processor, -1,
+             "Host logical processor to pin the XMA decoder thread to, or -1 "
+             "to let the host schedule it freely.",
+             "APU");
+DEFINE_int32(xma_decoder_threads, 0,
+             "Threads decoding XMA contexts in parallel when several are "
+             "kicked at once, including the XMA decoder thread. 1 decodes all "
+             "of them on the XMA decoder thread, 0 picks a count based on the "
+             "host processors.",
+             "APU");
+DEFINE_uint32(xma_pcm_cache_size_mb, 0,
+              "Megabytes of decoded XMA frames to keep for reusing when the "
+              "same frames are played again, such as by looping and repeated "
+              "sounds. 0 to decode every frame.",
+              "APU");
 DEFINE_bool(ffmpeg_verbose, false, "Verbose FFmpeg output (debug and above)",
             "APU");
 
@@ -128,16 +146,49 @@ X_STATUS XmaDecoder::Setup(kernel::KernelState* kernel_state) {
       memory()->GetPhysicalAddress(context_data_first_ptr_);
 
   // Setup XMA contexts.
+  if (cvars::xma_pcm_cache_size_mb) {
+    pcm_cache_ = std::make_unique<XmaPcmCache>(
+        size_t(cvars::xma_pcm_cache_size_mb) * 1024 * 1024);
+  }
   for (int i = 0; i < kContextCount; ++i) {
     uint32_t guest_ptr = context_data_first_ptr_ + i * sizeof(XMA_CONTEXT_DATA);
     XmaContext& context = contexts_[i];
-    if (context.Setup(i, memory(), guest_ptr)) {
+    if (context.Setup(i, memory(), guest_ptr, pcm_cache_.get())) {
       assert_always();
     }
   }
   register_file_[XmaRegister::NextContextIndex] = 1;
   context_bitmap_.Resize(kContextCount);
 
+  uint32_t thread_count = uint32_t(std::max(cvars::xma_decoder_threads, 0));
+  if (!thread_count) {
+    thread_count =
+        std::min(std::max(xe::threading::logical_processor_count() / 4, 1u),
+                 4u);
+  }
+  if (thread_count > 1) {
+    pass_contexts_.reserve(kContextCount);
+    helper_semaphore_ = xe::threading::Semaphore::Create(0, thread_count - 1);
+    pass_done_event_ = xe::threading::Event::CreateAutoResetEvent(false);
+    assert_not_null(helper_semaphore_);
+    assert_not_null(pass_done_event_);
+    // Created before the worker thread, which checks for them.
+    for (uint32_t i = 1; i < thread_count; ++i) {
+      auto helper_thread = kernel::object_ref<kernel::XHostThread>(
+          new kernel::XHostThread(
+              kernel_state, 128 * 1024, 0,
+              [this]() {
+                HelperThreadMain();
+                return 0;
+              },
+              kernel_state->GetIdleProcess()));
+      helper_thread->set_name(fmt::format("XMA Decoder Helper {}", i));
+      helper_thread->set_can_debugger_suspend(true);
+      helper_thread->Create();
+      helper_threads_.push_back(std::move(helper_thread));
+    }
+  }
+
   worker_running_ = true;
   work_event_ = xe::threading::Event::CreateAutoResetEvent(false);
   assert_not_null(work_event_);
@@ -147,6 +198,11 @@ X_STATUS XmaDecoder::Setup(kernel::KernelState* kernel_state) {
         return 0;
       }, kernel_state->GetIdleProcess()));//this one doesnt need any process actually. never calls any guest code
   worker_thread_->set_name("XMA Decoder");
+  if (cvars::xma_decoder_host_processor >= 0 &&
+      cvars::xma_decoder_host_processor < 64) {
+    worker_thread_->set_host_affinity_mask(
+        uint64_t(1) << cvars::xma_decoder_host_processor);
+  }
   worker_thread_->set_can_debugger_suspend(true);
   worker_thread_->Create();
 
@@ -158,14 +214,36 @@ void XmaDecoder::WorkerThreadMain() {
   while (worker_running_) {
     // Okay, let's loop through XMA contexts to find ones we need to decode!
     bool did_work = false;
-    for (uint32_t n = 0; n < kContextCount; n++) {
-      XmaContext& context = contexts_[n];
-      did_work = context.Work() || did_work;
-
-      // TODO: Need thread safety to do this.
-      // Probably not too important though.
-      // registers_.current_context = n;
-      // registers_.next_context = (n + 1) % kContextCount;
+    if (helper_threads_.empty()) {
+      TakeKickedContexts(worker_contexts_);
+      for (uint32_t n : worker_contexts_) {
+        XmaContext& context = contexts_[n];
+        did_work = context.Work() || did_work;
+
+        // TODO: Need thread safety to do this.
+        // Probably not too important though.
+        // registers_.current_context = n;
+        // registers_.next_context = (n + 1) % kContextCount;
+      }
+    } else {
+      size_t pass_size;
+      {
+        std::lock_guard<std::mutex> lock(pass_mutex_);
+        TakeKickedContexts(pass_contexts_);
+        pass_next_ = 0;
+        pass_size = pass_contexts_.size();
+        pass_remaining_.store(pass_size, std::memory_order_relaxed);
+      }
+      if (pass_size) {
+        size_t helper_count = std::min(pass_size - 1, helper_threads_.size());
+        if (helper_count) {
+          // Fails if some helpers haven't woken up for the previous pass yet,
+          // they will join this one then.
+          helper_semaphore_->Release(int(helper_count), nullptr);
+        }
+        did_work = WorkOnPass();
+        xe::threading::Wait(pass_done_event_.get(), false);
+      }
     }
 
     if (paused_) {
@@ -182,6 +260,57 @@ void XmaDecoder::WorkerThreadMain() {
   }
 }
 
+void XmaDecoder::HelperThreadMain() {
+  while (true) {
+    xe::threading::Wait(helper_semaphore_.get(), false);
+    if (!worker_running_) {
+      break;
+    }
+    WorkOnPass();
+  }
+}
+
+void XmaDecoder::TakeKickedContexts(std::vector<uint32_t>& context_ids_out) {
+  context_ids_out.clear();
+  for (uint32_t i = 0; i < xe::countof(kicked_contexts_); ++i) {
+    // Checking before exchanging to avoid taking the cache line from the guest
+    // threads if there are no kicks.
+    if (!kicked_contexts_[i].load(std::memory_order_relaxed)) {
+      continue;
+    }
+    uint32_t kicked =
+        kicked_contexts_[i].exchange(0, std::memory_order_acq_rel);
+    uint32_t bit;
+    while (xe::bit_scan_forward(kicked, &bit)) {
+      kicked &= ~(uint32_t(1) << bit);
+      uint32_t context_id = i * 32 + bit;
+      XmaContext& context = contexts_[context_id];
+      if (context.is_enabled() && context.is_allocated()) {
+        context_ids_out.push_back(context_id);
+      }
+    }
+  }
+}
+
+bool XmaDecoder::WorkOnPass() {
+  bool did_work = false;
+  while (true) {
+    uint32_t context_id;
+    {
+      std::lock_guard<std::mutex> lock(pass_mutex_);
+      if (pass_next_ >= pass_contexts_.size()) {
+        break;
+      }
+      context_id = pass_contexts_[pass_next_++];
+    }
+    did_work = contexts_[context_id].Work() || did_work;
+    if (pass_remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      pass_done_event_->Set();
+    }
+  }
+  return did_work;
+}
+
 void XmaDecoder::Shutdown() {
   worker_running_ = false;
 
@@ -199,6 +328,15 @@ void XmaDecoder::Shutdown() {
     worker_thread_.reset();
   }
 
+  for (size_t i = 0; i < helper_threads_.size(); ++i) {
+    // Only released per thread, as the semaphore can't go above the count.
+    helper_semaphore_->Release(1, nullptr);
+  }
+  for (auto& helper_thread : helper_threads_) {
+    xe::threading::Wait(helper_thread->thread(), false);
+  }
+  helper_threads_.clear();
+
   if (context_data_first_ptr_) {
     memory()->SystemHeapFree(context_data_first_ptr_);
   }
@@ -248,6 +386,15 @@ bool XmaDecoder::BlockOnContext(uint32_t guest_ptr, bool poll) {
   return context.Block(poll);
 }
 
+bool XmaDecoder::GetContextStatistics(uint32_t id,
+                                      XmaContext::Statistics& statistics) {
+  if (id >= kContextCount || !contexts_[id].is_allocated()) {
+    return false;
+  }
+  contexts_[id].GetStatistics(statistics);
+  return true;
+}
+
 uint32_t XmaDecoder::ReadRegister(uint32_t addr) {
   auto r = (addr & 0xFFFF) / 4;
 
@@ -301,7 +448,9 @@ void XmaDecoder::WriteRegister(uint32_t addr, uint32_t value) {
     // XMAEnableContext
 
     // The context ID is a bit in the range of the entire context array.
-    uint32_t base_context_id = (r - XmaRegister::Context0Kick) * 32;
+    uint32_t kick_index = r - XmaRegister::Context0Kick;
+    uint32_t base_context_id = kick_index * 32;
+    uint32_t kicked = value;
     for (int i = 0; value && i < 32; ++i, value >>= 1) {
       if (value & 1) {
         uint32_t context_id = base_context_id + i;
@@ -309,6 +458,8 @@ void XmaDecoder::WriteRegister(uint32_t addr, uint32_t value) {
         context.Enable();
       }
     }
+    // After enabling, so the worker sees the contexts enabled.
+    kicked_contexts_[kick_index].fetch_or(kicked, std::memory_order_acq_rel);
     // Signal the decoder thread to start processing.
     work_event_->SetBoostPriority();
   } else if (r >= XmaRegister::Context0Lock && r <= XmaRegister::Context9Lock) {
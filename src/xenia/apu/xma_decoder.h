@@ -13,8 +13,10 @@
 #include <atomic>
 #include <mutex>
 #include <queue>
+#include <vector>
 
 #include "xenia/apu/xma_context.h"
+#include "xenia/apu/xma_pcm_cache.h"
 #include "xenia/apu/xma_register_file.h"
 #include "xenia/base/bit_map.h"
 #include "xenia/kernel/xthread.h"
@@ -44,6 +46,10 @@ class XmaDecoder {
   void ReleaseContext(uint32_t guest_ptr);
   bool BlockOnContext(uint32_t guest_ptr, bool poll);
 
+  uint32_t context_count() const { return kContextCount; }
+  // Returns false if the context is not allocated.
+  bool GetContextStatistics(uint32_t id, XmaContext::Statistics& statistics);
+
   uint32_t ReadRegister(uint32_t addr);
   void WriteRegister(uint32_t addr, uint32_t value);
 
@@ -56,6 +62,12 @@ class XmaDecoder {
 
  private:
   void WorkerThreadMain();
+  void HelperThreadMain();
+  // Decodes the contexts of the current pass until none is left.
+  bool WorkOnPass();
+  // Takes the contexts kicked since the last call that are still enabled and
+  // allocated.
+  void TakeKickedContexts(std::vector<uint32_t>& context_ids_out);
 
   static uint32_t MMIOReadRegisterThunk(void* ppc_context, XmaDecoder* as,
                                         uint32_t addr) {
@@ -74,6 +86,19 @@ class XmaDecoder {
   kernel::object_ref<kernel::XHostThread> worker_thread_;
   std::unique_ptr<xe::threading::Event> work_event_ = nullptr;
 
+  // When several contexts are kicked at once, the worker thread shares them
+  // with the helper threads and waits for all of them to be decoded. Contexts
+  // are independent, each has its own decoder and lock.
+  std::vector<kernel::object_ref<kernel::XHostThread>> helper_threads_;
+  std::unique_ptr<xe::threading::Semaphore> helper_semaphore_;
+  std::unique_ptr<xe::threading::Event> pass_done_event_;
+  std::mutex pass_mutex_;
+  std::vector<uint32_t> pass_contexts_;
+  size_t pass_next_ = 0;
+  std::atomic<size_t> pass_remaining_ = {0};
+  // Contexts to work on when there are no helper threads.
+  std::vector<uint32_t> worker_contexts_;
+
   bool paused_ = false;
   xe::threading::Fence pause_fence_;   // Signaled when worker paused.
   xe::threading::Fence resume_fence_;  // Signaled when resume requested.
@@ -82,6 +107,12 @@ class XmaDecoder {
 
   static const uint32_t kContextCount = 320;
   XmaContext contexts_[kContextCount];
+  // Contexts kicked since the worker last looked at them, set by the kick
+  // register writes without locking. A context may also be locked again after
+  // being marked here, whether it's still enabled is checked when working on
+  // it.
+  std::atomic<uint32_t> kicked_contexts_[kContextCount / 32] = {};
+  std::unique_ptr<XmaPcmCache> pcm_cache_;
   BitMap context_bitmap_;
 
   uint32_t context_data_first_ptr_ = 0;
@@ -0,0 +1,51 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/apu/xma_pcm_cache.h"
+
+#include <cstring>
+
+namespace xe {
+namespace apu {
+
+bool XmaPcmCache::Lookup(uint64_t key, uint8_t* pcm, size_t size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entry_map_.find(key);
+  if (it == entry_map_.end() || it->second->pcm.size() != size) {
+    return false;
+  }
+  entries_.splice(entries_.begin(), entries_, it->second);
+  std::memcpy(pcm, it->second->pcm.data(), size);
+  return true;
+}
+
+void XmaPcmCache::Insert(uint64_t key, const uint8_t* pcm, size_t size) {
+  if (size > capacity_bytes_) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entry_map_.find(key);
+  if (it != entry_map_.end()) {
+    size_bytes_ -= it->second->pcm.size();
+    entries_.erase(it->second);
+    entry_map_.erase(it);
+  }
+  while (size_bytes_ + size > capacity_bytes_) {
+    const Entry& oldest = entries_.back();
+    size_bytes_ -= oldest.pcm.size();
+    entry_map_.erase(oldest.key);
+    entries_.pop_back();
+  }
+  entries_.push_front({key, std::vector<uint8_t>(pcm, pcm + size)});
+  entry_map_.emplace(key, entries_.begin());
+  size_bytes_ += size;
+}
+
+}  // namespace apu
+}  // namespace xe
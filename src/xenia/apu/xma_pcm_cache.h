@@ -0,0 +1,52 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_APU_XMA_PCM_CACHE_H_
+#define XENIA_APU_XMA_PCM_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace xe {
+namespace apu {
+
+// Least recently used converted PCM of XMA frames, shared by all contexts, so
+// looping and repeated sounds aren't decoded again. The keys identify the
+// frame along with everything the decoder output depends on.
+class XmaPcmCache {
+ public:
+  explicit XmaPcmCache(size_t capacity_bytes)
+      : capacity_bytes_(capacity_bytes) {}
+
+  // Copies the PCM to pcm if it's cached with exactly this size.
+  bool Lookup(uint64_t key, uint8_t* pcm, size_t size);
+  void Insert(uint64_t key, const uint8_t* pcm, size_t size);
+
+ private:
+  struct Entry {
+    uint64_t key;
+    std::vector<uint8_t> pcm;
+  };
+
+  std::mutex mutex_;
+  size_t capacity_bytes_;
+  size_t size_bytes_ = 0;
+  // Most recently used first.
+  std::list<Entry> entries_;
+  std::unordered_map<uint64_t, std::list<Entry>::iterator> entry_map_;
+};
+
+}  // namespace apu
+}  // namespace xe
+
+#endif  // XENIA_APU_XMA_PCM_CACHE_H_
@@ -9,6 +9,7 @@
 
 #include "xenia/base/arena.h"
 
+#include <algorithm>
 #include <cstring>
 #include <memory>
 
@@ -58,21 +59,35 @@ void* Arena::Alloc(size_t size, size_t align) {
     return (align - deviation) & mask;
   };
 
+  // Allocations larger than the usual chunk size get a chunk with the size
+  // rounded up to a multiple of it, kept for reuse like the others.
+  const auto create_chunk = [this](size_t min_capacity) {
+    size_t capacity = xe::round_up(std::max(min_capacity, chunk_size_),
+                                   chunk_size_);
+    reserved_size_ += capacity;
+    return new Chunk(capacity);
+  };
+
   if (active_chunk_) {
     if (active_chunk_->capacity - active_chunk_->offset <
         size + get_padding() + 4_KiB) {
+      // Chunks start at an aligned address, so no padding is needed in a new
+      // one.
+      size_t min_capacity = size + 4_KiB;
       Chunk* next = active_chunk_->next;
-      if (!next) {
-        assert_true(size + get_padding() < chunk_size_,
-                    "need to support larger chunks");
-        next = new Chunk(chunk_size_);
-        active_chunk_->next = next;
+      if (!next || next->capacity < min_capacity) {
+        // Insert a new chunk before the remaining ones not used since the
+        // reset, so they're still reused.
+        Chunk* new_chunk = create_chunk(min_capacity);
+        new_chunk->next = next;
+        active_chunk_->next = new_chunk;
+        next = new_chunk;
       }
       next->offset = 0;
       active_chunk_ = next;
     }
   } else {
-    head_chunk_ = active_chunk_ = new Chunk(chunk_size_);
+    head_chunk_ = active_chunk_ = create_chunk(size + 4_KiB);
   }
 
   active_chunk_->offset += get_padding();
@@ -85,7 +100,7 @@ void* Arena::Alloc(size_t size, size_t align) {
 
 void Arena::Rewind(size_t size) { active_chunk_->offset -= size; }
 
-size_t Arena::CalculateSize() {
+size_t Arena::CalculateSize() const {
   size_t total_length = 0;
   Chunk* chunk = head_chunk_;
   while (chunk) {
@@ -25,9 +25,16 @@ class Arena {
   explicit Arena(size_t chunk_size = 4_MiB);
   ~Arena();
 
+  // Keeps the chunks for reuse by the following allocations. The memory is not
+  // cleared.
   void Reset();
   void DebugFill();
 
+  // Bytes allocated since the last reset, including the alignment padding.
+  size_t CalculateSize() const;
+  // Bytes of all the chunks, including the ones not used since the last reset.
+  size_t reserved_size() const { return reserved_size_; }
+
   void* Alloc(size_t size, size_t align);
   template <typename T>
   T* Alloc() {
@@ -57,10 +64,10 @@ class Arena {
     size_t offset;
   };
 
-  size_t CalculateSize();
   void CloneContents(void* buffer, size_t buffer_length);
 
   size_t chunk_size_;
+  size_t reserved_size_ = 0;
   Chunk* head_chunk_;
   Chunk* active_chunk_;
 };
@@ -62,6 +62,29 @@ int64_t Tell(FILE* file);
 // undefined.
 bool TruncateStdioFile(FILE* file, uint64_t length);
 
+// Waits for and takes an advisory lock of the whole stdio file shared between
+// processes, for instance, for storage files that multiple emulator instances
+// validate and append to, so none of them sees partially written data.
+// Buffered writes must be flushed before unlocking.
+bool LockStdioFile(FILE* file, bool exclusive);
+void UnlockStdioFile(FILE* file);
+
+class ScopedStdioFileLock {
+ public:
+  explicit ScopedStdioFileLock(FILE* file, bool exclusive = true)
+      : file_(file && LockStdioFile(file, exclusive) ? file : nullptr) {}
+  ScopedStdioFileLock(const ScopedStdioFileLock& lock) = delete;
+  ScopedStdioFileLock& operator=(const ScopedStdioFileLock& lock) = delete;
+  ~ScopedStdioFileLock() {
+    if (file_) {
+      UnlockStdioFile(file_);
+    }
+  }
+
+ private:
+  FILE* file_;
+};
+
 struct FileAccess {
   // Implies kFileReadData.
   static const uint32_t kGenericRead = 0x80000000;
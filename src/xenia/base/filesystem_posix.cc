@@ -14,12 +14,14 @@
 
 #include <assert.h>
 #include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <ftw.h>
 #include <libgen.h>
 #include <pwd.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -106,6 +108,16 @@ bool TruncateStdioFile(FILE* file, uint64_t length) {
   return true;
 }
 
+bool LockStdioFile(FILE* file, bool exclusive) {
+  int result;
+  do {
+    result = flock(fileno(file), exclusive ? LOCK_EX : LOCK_SH);
+  } while (result && errno == EINTR);
+  return !result;
+}
+
+void UnlockStdioFile(FILE* file) { flock(fileno(file), LOCK_UN); }
+
 static int removeCallback(const char* fpath, const struct stat* sb,
                           int typeflag, struct FTW* ftwbuf) {
   int rv = remove(fpath);
@@ -103,6 +103,19 @@ bool TruncateStdioFile(FILE* file, uint64_t length) {
   return true;
 }
 
+bool LockStdioFile(FILE* file, bool exclusive) {
+  OVERLAPPED overlapped = {};
+  return LockFileEx(reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file))),
+                    exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0, 0, MAXDWORD,
+                    MAXDWORD, &overlapped) != FALSE;
+}
+
+void UnlockStdioFile(FILE* file) {
+  OVERLAPPED overlapped = {};
+  UnlockFileEx(reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file))), 0,
+               MAXDWORD, MAXDWORD, &overlapped);
+}
+
 class Win32FileHandle : public FileHandle {
  public:
   Win32FileHandle(const std::filesystem::path& path, HANDLE handle)
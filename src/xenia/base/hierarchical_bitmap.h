@@ -0,0 +1,174 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_HIERARCHICAL_BITMAP_H_
+#define XENIA_BASE_HIERARCHICAL_BITMAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "xenia/base/math.h"
+
+namespace xe {
+
+// Bitmap with a summary level telling which 64-bit words have any bits set and
+// which have all of them set, so the next or the previous set or clear bit is
+// found with bit scans, skipping 4096 bits per summary word, rather than by
+// testing every bit.
+class HierarchicalBitmap {
+ public:
+  static constexpr size_t kNotFound = SIZE_MAX;
+
+  size_t size() const { return size_; }
+
+  void Reset(size_t size, bool value) {
+    size_ = size;
+    size_t word_count = (size + 63) >> 6;
+    words_.assign(word_count, value ? ~uint64_t(0) : 0);
+    if (value && (size & 63)) {
+      // Bits past the end are always clear.
+      words_.back() = (uint64_t(1) << (size & 63)) - 1;
+    }
+    size_t summary_word_count = (word_count + 63) >> 6;
+    summary_any_.assign(summary_word_count, 0);
+    summary_full_.assign(summary_word_count, 0);
+    for (size_t i = 0; i < word_count; ++i) {
+      UpdateSummary(i);
+    }
+  }
+
+  bool Test(size_t index) const {
+    return (words_[index >> 6] >> (index & 63)) & 1;
+  }
+
+  void SetRange(size_t first, size_t count, bool value) {
+    if (!count) {
+      return;
+    }
+    size_t last = first + count - 1;
+    size_t word_first = first >> 6;
+    size_t word_last = last >> 6;
+    for (size_t i = word_first; i <= word_last; ++i) {
+      uint64_t mask = ~uint64_t(0);
+      if (i == word_first) {
+        mask &= ~uint64_t(0) << (first & 63);
+      }
+      if (i == word_last) {
+        mask &= ~uint64_t(0) >> (63 - (last & 63));
+      }
+      if (value) {
+        words_[i] |= mask;
+      } else {
+        words_[i] &= ~mask;
+      }
+      UpdateSummary(i);
+    }
+  }
+
+  // Returns the lowest index not below the specified one with the bit equal
+  // to value, or kNotFound.
+  size_t FindNext(size_t index, bool value) const {
+    if (index >= size_) {
+      return kNotFound;
+    }
+    size_t word_index = index >> 6;
+    uint64_t word = (value ? words_[word_index] : ~words_[word_index]) &
+                    (~uint64_t(0) << (index & 63));
+    if (!word) {
+      size_t next_word_index = word_index + 1;
+      word_index = kNotFound;
+      for (size_t i = next_word_index >> 6; i < summary_any_.size(); ++i) {
+        uint64_t summary = value ? summary_any_[i] : ~summary_full_[i];
+        if (i == next_word_index >> 6) {
+          summary &= ~uint64_t(0) << (next_word_index & 63);
+        }
+        if (summary) {
+          word_index = (i << 6) + xe::tzcnt(summary);
+          break;
+        }
+      }
+      if (word_index >= words_.size()) {
+        return kNotFound;
+      }
+      word = value ? words_[word_index] : ~words_[word_index];
+    }
+    size_t result = (word_index << 6) + xe::tzcnt(word);
+    return result < size_ ? result : kNotFound;
+  }
+
+  // Returns the highest index not above the specified one with the bit equal
+  // to value, or kNotFound.
+  size_t FindPrevious(size_t index, bool value) const {
+    if (index >= size_) {
+      index = size_ - 1;
+      if (!size_) {
+        return kNotFound;
+      }
+    }
+    size_t word_index = index >> 6;
+    uint64_t word = (value ? words_[word_index] : ~words_[word_index]) &
+                    (~uint64_t(0) >> (63 - (index & 63)));
+    if (!word) {
+      if (!word_index) {
+        return kNotFound;
+      }
+      size_t previous_word_index = word_index - 1;
+      word_index = kNotFound;
+      for (size_t i = (previous_word_index >> 6) + 1; i-- > 0;) {
+        uint64_t summary = value ? summary_any_[i] : ~summary_full_[i];
+        if (i == previous_word_index >> 6) {
+          summary &= ~uint64_t(0) >> (63 - (previous_word_index & 63));
+        }
+        if (summary) {
+          word_index = (i << 6) + (63 - xe::lzcnt(summary));
+          break;
+        }
+      }
+      if (word_index == kNotFound) {
+        return kNotFound;
+      }
+      word = value ? words_[word_index] : ~words_[word_index];
+      if (!value && word_index == words_.size() - 1 && (size_ & 63)) {
+        word &= (uint64_t(1) << (size_ & 63)) - 1;
+      }
+    }
+    return (word_index << 6) + (63 - xe::lzcnt(word));
+  }
+
+ private:
+  void UpdateSummary(size_t word_index) {
+    uint64_t full_word = ~uint64_t(0);
+    if (word_index == words_.size() - 1 && (size_ & 63)) {
+      full_word = (uint64_t(1) << (size_ & 63)) - 1;
+    }
+    uint64_t summary_bit = uint64_t(1) << (word_index & 63);
+    uint64_t& any = summary_any_[word_index >> 6];
+    uint64_t& full = summary_full_[word_index >> 6];
+    if (words_[word_index]) {
+      any |= summary_bit;
+    } else {
+      any &= ~summary_bit;
+    }
+    if (words_[word_index] == full_word) {
+      full |= summary_bit;
+    } else {
+      full &= ~summary_bit;
+    }
+  }
+
+  size_t size_ = 0;
+  std::vector<uint64_t> words_;
+  std::vector<uint64_t> summary_any_;
+  std::vector<uint64_t> summary_full_;
+};
+
+}  // namespace xe
+
+#endif  // XENIA_BASE_HIERARCHICAL_BITMAP_H_
@@ -55,6 +55,14 @@ DEFINE_bool(log_to_debugprint, false, "Dump the log to DebugPrint.", "Logging");
 #endif  // XE_PLATFORM_ANDROID
 DEFINE_bool(flush_log, true, "Flush log file after each log line batch.",
             "Logging");
+DEFINE_bool(log_deferred_formatting, false,
+            "Copy the format strings and the arguments of log lines to the log "
+            "buffer and format them on the logging thread, reducing the cost "
+            "of logging for the threads producing the lines, such as with "
+            "log_high_frequency_kernel_calls or "
+            "log_string_format_kernel_calls. Lines with arguments of types "
+            "that can't be copied are still formatted immediately.",
+            "Logging");
 
 DEFINE_uint32(log_mask, 0,
               "Disables specific categorizes for more granular debug logging. "
@@ -76,6 +84,9 @@ class Logger;
 Logger* logger_ = nullptr;
 
 struct LogLine {
+  // If not null, the buffer contains the payload of a line with deferred
+  // formatting rather than the text.
+  logging::internal::DeferredLogFormatter formatter;
   size_t buffer_length;
   uint32_t thread_id;
   uint16_t _pad_0;  // (2b) padding
@@ -268,6 +279,10 @@ class Logger {
 
   std::vector<std::unique_ptr<LogSink>> sinks_;
 
+  // For lines with deferred formatting, used by the writer thread.
+  std::vector<char> deferred_payload_;
+  std::vector<char> deferred_text_;
+
   std::unique_ptr<xe::threading::Thread> write_thread_;
 
   void Write(const char* buf, size_t size) {
@@ -336,7 +351,34 @@ class Logger {
             Write(prefix, sizeof(prefix) - 1);
           }
 
-          if (line.buffer_length) {
+          if (line.formatter && line.buffer_length) {
+            // The formatter needs the payload to be contiguous.
+            auto line_range = rb.BeginRead(line.buffer_length);
+            const char* payload =
+                reinterpret_cast<const char*>(line_range.first);
+            if (line_range.second_length) {
+              deferred_payload_.resize(line.buffer_length);
+              std::memcpy(deferred_payload_.data(), line_range.first,
+                          line_range.first_length);
+              std::memcpy(deferred_payload_.data() + line_range.first_length,
+                          line_range.second, line_range.second_length);
+              payload = deferred_payload_.data();
+            }
+            if (deferred_text_.empty()) {
+              deferred_text_.resize(sizeof(thread_log_buffer_));
+            }
+            size_t text_length = std::min(
+                line.formatter(payload, deferred_text_.data(),
+                               deferred_text_.size()),
+                deferred_text_.size());
+            rb.EndRead(std::move(line_range));
+            Write(deferred_text_.data(), text_length);
+            // Always ensure there is a newline.
+            if (!text_length || deferred_text_[text_length - 1] != '\n') {
+              const char suffix[1] = {'\n'};
+              Write(suffix, 1);
+            }
+          } else if (line.buffer_length) {
             // Get access to the line data - which may be split in the ring
             // buffer - and write it out in parts.
             auto line_range = rb.BeginRead(line.buffer_length);
@@ -405,7 +447,8 @@ class Logger {
  public:
   void AppendLine(uint32_t thread_id, const char prefix_char,
                   const char* buffer_data, size_t buffer_length,
-                  bool terminate = false) {
+                  bool terminate = false,
+                  logging::internal::DeferredLogFormatter formatter = nullptr) {
     size_t count = BlockCount(sizeof(LogLine) + buffer_length);
 
     auto range = claim_strategy_.claim(count);
@@ -416,6 +459,7 @@ class Logger {
     rb.set_read_offset(BlockOffset(range.end()));
 
     LogLine line = {};
+    line.formatter = formatter;
     line.buffer_length = buffer_length;
     line.thread_id = thread_id;
     line.prefix_char = prefix_char;
@@ -496,6 +540,22 @@ void logging::internal::AppendLogLine(LogLevel log_level,
                       thread_log_buffer_, written);
 }
 
+bool logging::internal::ShouldDeferFormatting() {
+  return cvars::log_deferred_formatting;
+}
+
+XE_NOALIAS
+void logging::internal::AppendDeferredLogLine(LogLevel log_level,
+                                              const char prefix_char,
+                                              DeferredLogFormatter formatter,
+                                              size_t payload_length) {
+  if (!logger_ || !ShouldLog(log_level)) {
+    return;
+  }
+  logger_->AppendLine(xe::threading::current_thread_id(), prefix_char,
+                      thread_log_buffer_, payload_length, false, formatter);
+}
+
 void logging::AppendLogLine(LogLevel log_level, const char prefix_char,
                             const std::string_view str, uint32_t log_mask) {
   if (!internal::ShouldLog(log_level, log_mask) || !str.size()) {
@@ -12,7 +12,11 @@
 
 #include <cstdarg>
 #include <cstdint>
+#include <cstring>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/string.h"
@@ -90,6 +94,120 @@ std::pair<char*, size_t> GetThreadBuffer();
 XE_NOALIAS
 void AppendLogLine(LogLevel log_level, const char prefix_char, size_t written);
 
+// Deferred formatting (log_deferred_formatting): instead of the text, the
+// format string and the arguments are copied to the log ring buffer, and the
+// line is formatted on the logging writer thread by the formatter
+// instantiated for the argument types.
+using DeferredLogFormatter = size_t (*)(const char* payload, char* out,
+                                        size_t out_capacity);
+bool ShouldDeferFormatting();
+// The payload is in the thread buffer.
+XE_NOALIAS
+void AppendDeferredLogLine(LogLevel log_level, const char prefix_char,
+                           DeferredLogFormatter formatter,
+                           size_t payload_length);
+
+// How an argument of a deferred log line is stored until formatting. Only
+// types that can be copied without referencing the memory of the caller are
+// supported, the rest are formatted immediately.
+template <typename T, typename Enable = void>
+struct DeferredLogArg {
+  static constexpr bool kSupported = false;
+};
+
+template <typename T>
+struct DeferredLogArg<
+    T, std::enable_if_t<std::is_arithmetic_v<T> || std::is_enum_v<T> ||
+                        (std::is_pointer_v<T> &&
+                         !std::is_same_v<
+                             std::remove_cv_t<std::remove_pointer_t<T>>,
+                             char>)>> {
+  static constexpr bool kSupported = true;
+  static size_t Size(const T&) { return sizeof(T); }
+  static char* Pack(char* out, const T& value) {
+    std::memcpy(out, &value, sizeof(T));
+    return out + sizeof(T);
+  }
+  static T Unpack(const char*& in) {
+    T value;
+    std::memcpy(&value, in, sizeof(T));
+    in += sizeof(T);
+    return value;
+  }
+};
+
+// Strings are stored as their length followed by the characters, and passed
+// to the formatter as string views.
+struct DeferredLogStringArg {
+  static constexpr bool kSupported = true;
+  static size_t Size(std::string_view value) {
+    return sizeof(size_t) + value.size();
+  }
+  static char* Pack(char* out, std::string_view value) {
+    size_t length = value.size();
+    std::memcpy(out, &length, sizeof(size_t));
+    std::memcpy(out + sizeof(size_t), value.data(), length);
+    return out + sizeof(size_t) + length;
+  }
+  static std::string_view Unpack(const char*& in) {
+    size_t length;
+    std::memcpy(&length, in, sizeof(size_t));
+    std::string_view value(in + sizeof(size_t), length);
+    in += sizeof(size_t) + length;
+    return value;
+  }
+};
+template <>
+struct DeferredLogArg<std::string> : DeferredLogStringArg {};
+template <>
+struct DeferredLogArg<std::string_view> : DeferredLogStringArg {};
+template <>
+struct DeferredLogArg<const char*> : DeferredLogStringArg {};
+template <>
+struct DeferredLogArg<char*> : DeferredLogStringArg {};
+template <size_t N>
+struct DeferredLogArg<char[N]> : DeferredLogStringArg {};
+
+template <typename... Args>
+size_t FormatDeferredLogLine(const char* payload, char* out,
+                             size_t out_capacity) {
+  // The format string is stored with the terminator.
+  size_t format_length;
+  std::memcpy(&format_length, payload, sizeof(size_t));
+  const char* format = payload + sizeof(size_t);
+  const char* in = format + format_length + 1;
+  // Braced initialization is evaluated in order.
+  std::tuple<decltype(DeferredLogArg<Args>::Unpack(in))...> values{
+      DeferredLogArg<Args>::Unpack(in)...};
+  return std::apply(
+      [out, out_capacity, format](const auto&... unpacked_args) {
+        return fmt::format_to_n(out, out_capacity, format, unpacked_args...)
+            .size;
+      },
+      values);
+}
+
+// Returns false if the line doesn't fit in the thread buffer.
+template <typename... Args>
+bool PackDeferredLogLine(LogLevel log_level, const char prefix_char,
+                         const char* format, const Args&... args) {
+  size_t format_length = std::strlen(format);
+  size_t payload_length = sizeof(size_t) + format_length + 1;
+  ((payload_length += DeferredLogArg<Args>::Size(args)), ...);
+  auto target = GetThreadBuffer();
+  if (payload_length > target.second) {
+    return false;
+  }
+  char* out = target.first;
+  std::memcpy(out, &format_length, sizeof(size_t));
+  std::memcpy(out + sizeof(size_t), format, format_length + 1);
+  out += sizeof(size_t) + format_length + 1;
+  ((out = DeferredLogArg<Args>::Pack(out, args)), ...);
+  AppendDeferredLogLine(log_level, prefix_char, &FormatDeferredLogLine<Args...>,
+                        payload_length);
+  return true;
+}
+
 }  // namespace internal
 // technically, noalias is incorrect here, these functions do in fact alias
 // global memory, but msvc will not optimize the calls away, and the global
@@ -99,6 +217,13 @@ template <typename... Args>
 XE_NOALIAS XE_NOINLINE XE_COLD static void AppendLogLineFormat_Impl(
     LogLevel log_level, const char prefix_char, const char* format,
     const Args&... args) {
+  if constexpr ((internal::DeferredLogArg<Args>::kSupported && ...)) {
+    if (internal::ShouldDeferFormatting() &&
+        internal::PackDeferredLogLine(log_level, prefix_char, format,
+                                      args...)) {
+      return;
+    }
+  }
   auto target = internal::GetThreadBuffer();
   auto result = fmt::format_to_n(target.first, target.second, format, args...);
   internal::AppendLogLine(log_level, prefix_char, result.size);
@@ -112,7 +112,9 @@ std::unique_ptr<MappedMemory> MappedMemory::Open(
   switch (mode) {
     case Mode::kRead:
       file_access |= GENERIC_READ;
-      file_share |= FILE_SHARE_READ;
+      // Allow mapping files that are being appended to, such as caches shared
+      // between emulator instances.
+      file_share |= FILE_SHARE_READ | FILE_SHARE_WRITE;
       create_mode |= OPEN_EXISTING;
       mapping_protect |= PAGE_READONLY;
       view_access |= FILE_MAP_READ;
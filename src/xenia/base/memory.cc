@@ -10,6 +10,7 @@
 #include "xenia/base/memory.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/math.h"
 #include "xenia/base/platform.h"
 
 #if XE_ARCH_ARM64
@@ -17,6 +18,7 @@
 #endif
 
 #include <algorithm>
+#include <cstring>
 
 DEFINE_bool(
     writable_executable_memory, true,
@@ -217,6 +219,77 @@ void vastcpy(uint8_t* XE_RESTRICT physaddr, uint8_t* XE_RESTRICT rdmapping,
   return vastcpy_dispatch((CacheLine*)physaddr, (CacheLine*)rdmapping,
                           written_length);
 }
+
+XE_NOINLINE
+void streaming_memcpy(void* XE_RESTRICT destination,
+                      const void* XE_RESTRICT source, size_t length) {
+#if XE_ARCH_AMD64 == 1
+  auto dest = reinterpret_cast<uint8_t*>(destination);
+  auto src = reinterpret_cast<const uint8_t*>(source);
+  // Copy normally until the destination is at a cache line boundary, so the
+  // write combining buffers are always filled completely.
+  size_t head_length =
+      std::min(size_t(-reinterpret_cast<uintptr_t>(dest) &
+                      (XE_HOST_CACHE_LINE_SIZE - 1)),
+               length);
+  std::memcpy(dest, src, head_length);
+  dest += head_length;
+  src += head_length;
+  length -= head_length;
+  for (; length >= 128; length -= 128, dest += 128, src += 128) {
+    __m256i data0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+    __m256i data1 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32));
+    __m256i data2 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 64));
+    __m256i data3 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 96));
+    XE_MSVC_REORDER_BARRIER();
+    _mm256_stream_si256(reinterpret_cast<__m256i*>(dest), data0);
+    _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + 32), data1);
+    _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + 64), data2);
+    _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + 96), data3);
+  }
+  for (; length >= 32; length -= 32, dest += 32, src += 32) {
+    _mm256_stream_si256(
+        reinterpret_cast<__m256i*>(dest),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src)));
+  }
+  // Non-temporal stores are weakly ordered.
+  xe::swcache::WriteFence();
+  std::memcpy(dest, src, length);
+#else
+  std::memcpy(destination, source, length);
+#endif
+}
+
+XE_NOINLINE
+void streaming_memset(void* destination, uint8_t value, size_t length) {
+#if XE_ARCH_AMD64 == 1
+  auto dest = reinterpret_cast<uint8_t*>(destination);
+  size_t head_length =
+      std::min(size_t(-reinterpret_cast<uintptr_t>(dest) &
+                      (XE_HOST_CACHE_LINE_SIZE - 1)),
+               length);
+  std::memset(dest, value, head_length);
+  dest += head_length;
+  length -= head_length;
+  __m256i data = _mm256_set1_epi8(char(value));
+  for (; length >= 128; length -= 128, dest += 128) {
+    _mm256_stream_si256(reinterpret_cast<__m256i*>(dest), data);
+    _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + 32), data);
+    _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + 64), data);
+    _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + 96), data);
+  }
+  for (; length >= 32; length -= 32, dest += 32) {
+    _mm256_stream_si256(reinterpret_cast<__m256i*>(dest), data);
+  }
+  xe::swcache::WriteFence();
+  std::memset(dest, value, length);
+#else
+  std::memset(destination, value, length);
+#endif
+}
 }  // namespace memory
 
 // TODO(benvanik): fancy AVX versions.
@@ -243,8 +316,137 @@ void copy_128_aligned(void* dest, const void* src, size_t count) {
 #else
 #define XE_WORKAROUND_CONSTANT_RETURN_IF(x)
 #endif
+
+namespace {
+
+// Element swaps done with a byte shuffle, the same mask in every 128-bit lane.
+struct CopyAndSwap16 {
+  using Element = uint16_t;
+  static Element Swap(Element value) { return byte_swap(value); }
+  static __m128i ShuffleMask() {
+    return _mm_set_epi8(0x0E, 0x0F, 0x0C, 0x0D, 0x0A, 0x0B, 0x08, 0x09, 0x06,
+                        0x07, 0x04, 0x05, 0x02, 0x03, 0x00, 0x01);
+  }
+};
+struct CopyAndSwap32 {
+  using Element = uint32_t;
+  static Element Swap(Element value) { return byte_swap(value); }
+  static __m128i ShuffleMask() {
+    return _mm_set_epi8(0x0C, 0x0D, 0x0E, 0x0F, 0x08, 0x09, 0x0A, 0x0B, 0x04,
+                        0x05, 0x06, 0x07, 0x00, 0x01, 0x02, 0x03);
+  }
+};
+struct CopyAndSwap64 {
+  using Element = uint64_t;
+  static Element Swap(Element value) { return byte_swap(value); }
+  static __m128i ShuffleMask() {
+    return _mm_set_epi8(0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x00,
+                        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07);
+  }
+};
+struct CopyAndSwap16In32 {
+  using Element = uint32_t;
+  static Element Swap(Element value) { return (value >> 16) | (value << 16); }
+  static __m128i ShuffleMask() {
+    return _mm_set_epi8(0x0D, 0x0C, 0x0F, 0x0E, 0x09, 0x08, 0x0B, 0x0A, 0x05,
+                        0x04, 0x07, 0x06, 0x01, 0x00, 0x03, 0x02);
+  }
+};
+
+// Below these lengths, the 128-bit loops are used, as the alignment head and
+// the residual elements dominate, and 512-bit instructions may also lower the
+// clock speed for some time on certain CPUs.
+constexpr size_t kCopyAndSwapAVX2MinLength = 256;
+constexpr size_t kCopyAndSwapAVX512MinLength = 4096;
+
+bool IsCopyAndSwapWide(size_t length) {
+  return length >= kCopyAndSwapAVX2MinLength &&
+         (amd64::GetFeatureFlags() & amd64::kX64EmitAVX2);
+}
+
+// 256-bit or 512-bit copy and swap with the stores aligned to cache lines if
+// the destination is aligned to the element size, optionally non-temporal.
+template <typename Swap, bool kStreaming>
+void CopyAndSwapWide(void* dest_ptr, const void* src_ptr, size_t count) {
+  using Element = typename Swap::Element;
+  auto dest = reinterpret_cast<uint8_t*>(dest_ptr);
+  auto src = reinterpret_cast<const uint8_t*>(src_ptr);
+  size_t length = count * sizeof(Element);
+  bool dest_aligned = false;
+  if (!(reinterpret_cast<uintptr_t>(dest) & (sizeof(Element) - 1))) {
+    size_t head_length =
+        std::min(size_t(-reinterpret_cast<uintptr_t>(dest) &
+                        (XE_HOST_CACHE_LINE_SIZE - 1)),
+                 length);
+    for (size_t i = 0; i < head_length; i += sizeof(Element)) {
+      store<Element>(dest + i, Swap::Swap(load<Element>(src + i)));
+    }
+    dest += head_length;
+    src += head_length;
+    length -= head_length;
+    dest_aligned = true;
+  }
+  __m128i shufmask = Swap::ShuffleMask();
+  if (length >= kCopyAndSwapAVX512MinLength &&
+      (amd64::GetFeatureFlags() &
+       (amd64::kX64EmitAVX512F | amd64::kX64EmitAVX512BW)) ==
+          (amd64::kX64EmitAVX512F | amd64::kX64EmitAVX512BW)) {
+    __m512i shufmask_512 = _mm512_broadcast_i32x4(shufmask);
+    for (; length >= 128; length -= 128, dest += 128, src += 128) {
+      __m512i output0 = _mm512_shuffle_epi8(
+          _mm512_loadu_si512(reinterpret_cast<const __m512i*>(src)),
+          shufmask_512);
+      __m512i output1 = _mm512_shuffle_epi8(
+          _mm512_loadu_si512(reinterpret_cast<const __m512i*>(src + 64)),
+          shufmask_512);
+      if (kStreaming && dest_aligned) {
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dest), output0);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dest + 64), output1);
+      } else if (dest_aligned) {
+        _mm512_store_si512(reinterpret_cast<__m512i*>(dest), output0);
+        _mm512_store_si512(reinterpret_cast<__m512i*>(dest + 64), output1);
+      } else {
+        _mm512_storeu_si512(reinterpret_cast<__m512i*>(dest), output0);
+        _mm512_storeu_si512(reinterpret_cast<__m512i*>(dest + 64), output1);
+      }
+    }
+  }
+  __m256i shufmask_256 = _mm256_broadcastsi128_si256(shufmask);
+  for (; length >= 64; length -= 64, dest += 64, src += 64) {
+    __m256i output0 = _mm256_shuffle_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src)),
+        shufmask_256);
+    __m256i output1 = _mm256_shuffle_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32)),
+        shufmask_256);
+    if (kStreaming && dest_aligned) {
+      _mm256_stream_si256(reinterpret_cast<__m256i*>(dest), output0);
+      _mm256_stream_si256(reinterpret_cast<__m256i*>(dest + 32), output1);
+    } else if (dest_aligned) {
+      _mm256_store_si256(reinterpret_cast<__m256i*>(dest), output0);
+      _mm256_store_si256(reinterpret_cast<__m256i*>(dest + 32), output1);
+    } else {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest), output0);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + 32), output1);
+    }
+  }
+  if (kStreaming) {
+    // Non-temporal stores are weakly ordered.
+    xe::swcache::WriteFence();
+  }
+  for (size_t i = 0; i < length; i += sizeof(Element)) {
+    store<Element>(dest + i, Swap::Swap(load<Element>(src + i)));
+  }
+}
+
+}  // namespace
+
 void copy_and_swap_16_aligned(void* dest_ptr, const void* src_ptr,
                               size_t count) {
+  if (IsCopyAndSwapWide(count * sizeof(uint16_t))) {
+    CopyAndSwapWide<CopyAndSwap16, false>(dest_ptr, src_ptr, count);
+    return;
+  }
   assert_zero(reinterpret_cast<uintptr_t>(dest_ptr) & 0xF);
   assert_zero(reinterpret_cast<uintptr_t>(src_ptr) & 0xF);
 
@@ -268,6 +470,10 @@ void copy_and_swap_16_aligned(void* dest_ptr, const void* src_ptr,
 
 void copy_and_swap_16_unaligned(void* dest_ptr, const void* src_ptr,
                                 size_t count) {
+  if (IsCopyAndSwapWide(count * sizeof(uint16_t))) {
+    CopyAndSwapWide<CopyAndSwap16, false>(dest_ptr, src_ptr, count);
+    return;
+  }
   auto dest = reinterpret_cast<uint16_t*>(dest_ptr);
   auto src = reinterpret_cast<const uint16_t*>(src_ptr);
   __m128i shufmask =
@@ -288,6 +494,10 @@ void copy_and_swap_16_unaligned(void* dest_ptr, const void* src_ptr,
 
 void copy_and_swap_32_aligned(void* dest_ptr, const void* src_ptr,
                               size_t count) {
+  if (IsCopyAndSwapWide(count * sizeof(uint32_t))) {
+    CopyAndSwapWide<CopyAndSwap32, false>(dest_ptr, src_ptr, count);
+    return;
+  }
   assert_zero(reinterpret_cast<uintptr_t>(dest_ptr) & 0xF);
   assert_zero(reinterpret_cast<uintptr_t>(src_ptr) & 0xF);
 
@@ -311,6 +521,10 @@ void copy_and_swap_32_aligned(void* dest_ptr, const void* src_ptr,
 
 void copy_and_swap_32_unaligned(void* dest_ptr, const void* src_ptr,
                                 size_t count) {
+  if (IsCopyAndSwapWide(count * sizeof(uint32_t))) {
+    CopyAndSwapWide<CopyAndSwap32, false>(dest_ptr, src_ptr, count);
+    return;
+  }
   auto dest = reinterpret_cast<uint32_t*>(dest_ptr);
   auto src = reinterpret_cast<const uint32_t*>(src_ptr);
   size_t i;
@@ -380,6 +594,10 @@ void copy_and_swap_32_unaligned(void* dest_ptr, const void* src_ptr,
 
 void copy_and_swap_64_aligned(void* dest_ptr, const void* src_ptr,
                               size_t count) {
+  if (IsCopyAndSwapWide(count * sizeof(uint64_t))) {
+    CopyAndSwapWide<CopyAndSwap64, false>(dest_ptr, src_ptr, count);
+    return;
+  }
   assert_zero(reinterpret_cast<uintptr_t>(dest_ptr) & 0xF);
   assert_zero(reinterpret_cast<uintptr_t>(src_ptr) & 0xF);
 
@@ -403,6 +621,10 @@ void copy_and_swap_64_aligned(void* dest_ptr, const void* src_ptr,
 
 void copy_and_swap_64_unaligned(void* dest_ptr, const void* src_ptr,
                                 size_t count) {
+  if (IsCopyAndSwapWide(count * sizeof(uint64_t))) {
+    CopyAndSwapWide<CopyAndSwap64, false>(dest_ptr, src_ptr, count);
+    return;
+  }
   auto dest = reinterpret_cast<uint64_t*>(dest_ptr);
   auto src = reinterpret_cast<const uint64_t*>(src_ptr);
   __m128i shufmask =
@@ -423,6 +645,10 @@ void copy_and_swap_64_unaligned(void* dest_ptr, const void* src_ptr,
 
 void copy_and_swap_16_in_32_aligned(void* dest_ptr, const void* src_ptr,
                                     size_t count) {
+  if (IsCopyAndSwapWide(count * sizeof(uint32_t))) {
+    CopyAndSwapWide<CopyAndSwap16In32, false>(dest_ptr, src_ptr, count);
+    return;
+  }
   auto dest = reinterpret_cast<uint32_t*>(dest_ptr);
   auto src = reinterpret_cast<const uint32_t*>(src_ptr);
   size_t i;
@@ -440,6 +666,10 @@ void copy_and_swap_16_in_32_aligned(void* dest_ptr, const void* src_ptr,
 
 void copy_and_swap_16_in_32_unaligned(void* dest_ptr, const void* src_ptr,
                                       size_t count) {
+  if (IsCopyAndSwapWide(count * sizeof(uint32_t))) {
+    CopyAndSwapWide<CopyAndSwap16In32, false>(dest_ptr, src_ptr, count);
+    return;
+  }
   auto dest = reinterpret_cast<uint32_t*>(dest_ptr);
   auto src = reinterpret_cast<const uint32_t*>(src_ptr);
   size_t i;
@@ -455,6 +685,33 @@ void copy_and_swap_16_in_32_unaligned(void* dest_ptr, const void* src_ptr,
   }
 }
 
+void copy_and_swap_16_streaming(void* dest_ptr, const void* src_ptr,
+                                size_t count) {
+  if (IsCopyAndSwapWide(count * sizeof(uint16_t))) {
+    CopyAndSwapWide<CopyAndSwap16, true>(dest_ptr, src_ptr, count);
+    return;
+  }
+  copy_and_swap_16_unaligned(dest_ptr, src_ptr, count);
+}
+
+void copy_and_swap_32_streaming(void* dest_ptr, const void* src_ptr,
+                                size_t count) {
+  if (IsCopyAndSwapWide(count * sizeof(uint32_t))) {
+    CopyAndSwapWide<CopyAndSwap32, true>(dest_ptr, src_ptr, count);
+    return;
+  }
+  copy_and_swap_32_unaligned(dest_ptr, src_ptr, count);
+}
+
+void copy_and_swap_64_streaming(void* dest_ptr, const void* src_ptr,
+                                size_t count) {
+  if (IsCopyAndSwapWide(count * sizeof(uint64_t))) {
+    CopyAndSwapWide<CopyAndSwap64, true>(dest_ptr, src_ptr, count);
+    return;
+  }
+  copy_and_swap_64_unaligned(dest_ptr, src_ptr, count);
+}
+
 #elif XE_ARCH_ARM64
 
 // Although NEON offers vector rev instructions (like vrev32q_u8), they are
@@ -641,4 +898,126 @@ void copy_and_swap_16_in_32_unaligned(void* dst_ptr, const void* src_ptr,
 
 #endif
 
+#if !XE_ARCH_AMD64
+void copy_and_swap_16_streaming(void* dest, const void* src, size_t count) {
+  copy_and_swap_16_unaligned(dest, src, count);
+}
+
+void copy_and_swap_32_streaming(void* dest, const void* src, size_t count) {
+  copy_and_swap_32_unaligned(dest, src, count);
+}
+
+void copy_and_swap_64_streaming(void* dest, const void* src, size_t count) {
+  copy_and_swap_64_unaligned(dest, src, count);
+}
+#endif
+
+// The vectors are SSE4.1, which the AVX baseline implies, as the Rtl calls
+// these are mostly made for short buffers.
+size_t find_first_mismatch(const void* a, const void* b, size_t length) {
+  auto pa = reinterpret_cast<const uint8_t*>(a);
+  auto pb = reinterpret_cast<const uint8_t*>(b);
+  size_t i = 0;
+#if XE_ARCH_AMD64
+  for (; i + 16 <= length; i += 16) {
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pa + i));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pb + i));
+    uint32_t mismatch =
+        uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb))) ^ 0xFFFF;
+    if (mismatch) {
+      return i + xe::tzcnt(mismatch);
+    }
+  }
+#endif
+  for (; i < length && pa[i] == pb[i]; ++i) {
+  }
+  return i;
+}
+
+size_t find_first_mismatch_32(const void* data, uint32_t value, size_t count) {
+  auto p = reinterpret_cast<const uint32_t*>(data);
+  size_t i = 0;
+#if XE_ARCH_AMD64
+  __m128i vvalue = _mm_set1_epi32(int(value));
+  for (; i + 4 <= count; i += 4) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+    uint32_t mismatch =
+        uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi32(v, vvalue))) ^ 0xFFFF;
+    if (mismatch) {
+      return i + xe::tzcnt(mismatch) / 4;
+    }
+  }
+#endif
+  for (; i < count && p[i] == value; ++i) {
+  }
+  return i;
+}
+
+void fill_32(void* dest, uint32_t value, size_t count) {
+  auto p = reinterpret_cast<uint32_t*>(dest);
+  size_t i = 0;
+#if XE_ARCH_AMD64
+  __m128i vvalue = _mm_set1_epi32(int(value));
+  for (; i + 8 <= count; i += 8) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p + i), vvalue);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p + i + 4), vvalue);
+  }
+#endif
+  for (; i < count; ++i) {
+    p[i] = value;
+  }
+}
+
+void widen_and_swap_8_to_16(void* dest, const void* src, size_t count) {
+  auto d = reinterpret_cast<uint16_t*>(dest);
+  auto s = reinterpret_cast<const uint8_t*>(src);
+  size_t i = 0;
+#if XE_ARCH_AMD64
+  // Putting the zero bytes first gives big-endian words.
+  __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= count; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i),
+                     _mm_unpacklo_epi8(zero, v));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i + 8),
+                     _mm_unpackhi_epi8(zero, v));
+  }
+#endif
+  for (; i < count; ++i) {
+    d[i] = xe::byte_swap(uint16_t(s[i]));
+  }
+}
+
+void narrow_and_swap_16_to_8(void* dest, const void* src, size_t count,
+                             uint8_t replacement) {
+  auto d = reinterpret_cast<uint8_t*>(dest);
+  auto s = reinterpret_cast<const uint16_t*>(src);
+  size_t i = 0;
+#if XE_ARCH_AMD64
+  __m128i shufmask =
+      _mm_set_epi8(0x0E, 0x0F, 0x0C, 0x0D, 0x0A, 0x0B, 0x08, 0x09, 0x06, 0x07,
+                   0x04, 0x05, 0x02, 0x03, 0x00, 0x01);
+  __m128i zero = _mm_setzero_si128();
+  __m128i vreplacement = _mm_set1_epi16(replacement);
+  for (; i + 16 <= count; i += 16) {
+    __m128i v0 = _mm_shuffle_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i)), shufmask);
+    __m128i v1 = _mm_shuffle_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i + 8)),
+        shufmask);
+    // Everything left is below 0x100, so the pack doesn't saturate.
+    v0 = _mm_blendv_epi8(
+        vreplacement, v0, _mm_cmpeq_epi16(_mm_srli_epi16(v0, 8), zero));
+    v1 = _mm_blendv_epi8(
+        vreplacement, v1, _mm_cmpeq_epi16(_mm_srli_epi16(v1, 8), zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(d + i),
+                     _mm_packus_epi16(v0, v1));
+  }
+#endif
+  for (; i < count; ++i) {
+    uint16_t c = xe::byte_swap(s[i]);
+    d[i] = c < 0x100 ? uint8_t(c) : replacement;
+  }
+}
+
 }  // namespace xe
@@ -37,6 +37,11 @@ size_t page_size();
 // This is likely 64KiB.
 size_t allocation_granularity();
 
+// Returns the alignment of the addresses and the file offsets MapFileView can
+// map views at, which is the page size where the host supports mapping views
+// more finely than the allocation granularity.
+size_t file_view_granularity();
+
 enum class PageAccess {
   kNoAccess = 0,
   kReadOnly = 1 << 0,
@@ -132,6 +137,24 @@ void CloseFileMappingHandle(FileMappingHandle handle,
 void* MapFileView(FileMappingHandle handle, void* base_address, size_t length,
                   PageAccess access, size_t file_offset);
 bool UnmapFileView(FileMappingHandle handle, void* base_address, size_t length);
+// Asks the system to back the given view with huge pages where possible, as
+// a hint: smaller pages are still used where the protection or the alignment
+// of the range requires them. Returns false if not supported.
+bool AdviseHugePages(void* base_address, size_t length);
+// Asks the system to start reading the pages of the given range of a file
+// view from the storage asynchronously, as a hint, so accessing them later
+// doesn't cause synchronous page faults. Returns false if not supported.
+bool PrefetchFileView(const void* base_address, size_t length);
+
+// Starts tracking writes to the given range of mapped memory in the kernel,
+// without access violations, for polling them with GetAndResetWrittenRanges.
+// Returns false if not supported.
+bool EnableWriteTracking(void* base_address, size_t length);
+// Calls the callback for the runs of pages in the range written to since
+// EnableWriteTracking or the last call, resetting their state atomically.
+bool GetAndResetWrittenRanges(
+    void* base_address, size_t length,
+    const std::function<void(void* base_address, size_t length)>& callback);
 
 inline size_t hash_combine(size_t seed) { return seed; }
 
@@ -146,6 +169,15 @@ XE_NOINLINE
 void vastcpy(uint8_t* XE_RESTRICT physaddr, uint8_t* XE_RESTRICT rdmapping,
              uint32_t written_length);
 
+// memcpy/memset for transfers much larger than the cache, with non-temporal
+// stores so the destination doesn't evict everything else. No alignment
+// requirements, the ranges must not overlap.
+XE_NOINLINE
+void streaming_memcpy(void* XE_RESTRICT destination,
+                      const void* XE_RESTRICT source, size_t length);
+XE_NOINLINE
+void streaming_memset(void* destination, uint8_t value, size_t length);
+
 }  // namespace memory
 
 // TODO(benvanik): move into xe::memory::
@@ -165,6 +197,27 @@ void copy_and_swap_64_unaligned(void* dest, const void* src, size_t count);
 void copy_and_swap_16_in_32_aligned(void* dest, const void* src, size_t count);
 void copy_and_swap_16_in_32_unaligned(void* dest, const void* src,
                                       size_t count);
+// With non-temporal stores where available, for large buffers that won't be
+// read by the CPU soon, such as uploads to the GPU, to avoid evicting the
+// caches.
+void copy_and_swap_16_streaming(void* dest, const void* src, size_t count);
+void copy_and_swap_32_streaming(void* dest, const void* src, size_t count);
+void copy_and_swap_64_streaming(void* dest, const void* src, size_t count);
+
+// Helpers for the kernel Rtl routines, vectorized where possible. Counts are
+// in elements.
+// Returns the index of the first byte that differs, or length if none does.
+size_t find_first_mismatch(const void* a, const void* b, size_t length);
+// Same for 32-bit elements compared with value, already in memory byte order.
+size_t find_first_mismatch_32(const void* data, uint32_t value, size_t count);
+// Stores value, already in memory byte order, count times.
+void fill_32(void* dest, uint32_t value, size_t count);
+// Zero-extends bytes to big-endian 16-bit characters.
+void widen_and_swap_8_to_16(void* dest, const void* src, size_t count);
+// Narrows big-endian 16-bit characters to bytes, replacing the ones above 0xFF
+// with replacement.
+void narrow_and_swap_16_to_8(void* dest, const void* src, size_t count,
+                             uint8_t replacement);
 
 template <typename T>
 void copy_and_swap(T* dest, const T* src, size_t count) {
@@ -27,6 +27,13 @@
 #include "xenia/base/main_android.h"
 #endif
 
+#if XE_PLATFORM_LINUX
+#include <linux/fs.h>
+#include <linux/userfaultfd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
 namespace xe {
 namespace memory {
 
@@ -60,6 +67,7 @@ void AndroidShutdown() {
 
 size_t page_size() { return getpagesize(); }
 size_t allocation_granularity() { return page_size(); }
+size_t file_view_granularity() { return page_size(); }
 
 uint32_t ToPosixProtectFlags(PageAccess access) {
   switch (access) {
@@ -105,6 +113,117 @@ bool DeallocFixed(void* base_address, size_t length,
   return munmap(base_address, length) == 0;
 }
 
+bool PrefetchFileView(const void* base_address, size_t length) {
+  // madvise requires the address to be page-aligned.
+  uintptr_t page_mask = uintptr_t(page_size() - 1);
+  uintptr_t address = reinterpret_cast<uintptr_t>(base_address);
+  uintptr_t address_aligned = address & ~page_mask;
+  return madvise(reinterpret_cast<void*>(address_aligned),
+                 length + (address - address_aligned), MADV_WILLNEED) == 0;
+}
+
+bool AdviseHugePages(void* base_address, size_t length) {
+#ifdef MADV_HUGEPAGE
+  // Transparent huge pages are split by the kernel when parts of them are
+  // protected differently, unlike hugetlb pages, so protections stay at the
+  // page granularity.
+  return madvise(base_address, length, MADV_HUGEPAGE) == 0;
+#else
+  return false;
+#endif
+}
+
+#if XE_PLATFORM_LINUX && defined(PAGEMAP_SCAN) && \
+    defined(UFFD_FEATURE_WP_ASYNC)
+// Asynchronous userfaultfd write protection (Linux 6.7+) resolves the write
+// faults in the kernel, only marking the pages as written, and PAGEMAP_SCAN
+// gets and write-protects them again at once.
+static int write_tracking_uffd_ = -1;
+static int write_tracking_pagemap_ = -1;
+
+static bool InitializeWriteTracking() {
+  static const bool initialized = []() {
+    int uffd = int(syscall(SYS_userfaultfd,
+                           O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY));
+    if (uffd < 0) {
+      return false;
+    }
+    uffdio_api api = {};
+    api.api = UFFD_API;
+    api.features = UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED;
+    int pagemap = -1;
+    if (ioctl(uffd, UFFDIO_API, &api) == 0) {
+      pagemap = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    }
+    if (pagemap < 0) {
+      close(uffd);
+      return false;
+    }
+    write_tracking_uffd_ = uffd;
+    write_tracking_pagemap_ = pagemap;
+    return true;
+  }();
+  return initialized;
+}
+
+bool EnableWriteTracking(void* base_address, size_t length) {
+  if (!InitializeWriteTracking()) {
+    return false;
+  }
+  uffdio_register uffd_register = {};
+  uffd_register.range.start = uintptr_t(base_address);
+  uffd_register.range.len = length;
+  uffd_register.mode = UFFDIO_REGISTER_MODE_WP;
+  if (ioctl(write_tracking_uffd_, UFFDIO_REGISTER, &uffd_register) != 0) {
+    return false;
+  }
+  uffdio_writeprotect uffd_writeprotect = {};
+  uffd_writeprotect.range = uffd_register.range;
+  uffd_writeprotect.mode = UFFDIO_WRITEPROTECT_MODE_WP;
+  return ioctl(write_tracking_uffd_, UFFDIO_WRITEPROTECT,
+               &uffd_writeprotect) == 0;
+}
+
+bool GetAndResetWrittenRanges(
+    void* base_address, size_t length,
+    const std::function<void(void* base_address, size_t length)>& callback) {
+  if (write_tracking_pagemap_ < 0) {
+    return false;
+  }
+  page_region regions[64];
+  pm_scan_arg scan = {};
+  scan.size = sizeof(scan);
+  scan.flags = PM_SCAN_WP_MATCHING | PM_SCAN_CHECK_WPASYNC;
+  scan.start = uintptr_t(base_address);
+  scan.end = scan.start + length;
+  scan.vec = uintptr_t(regions);
+  scan.vec_len = xe::countof(regions);
+  scan.category_mask = PAGE_IS_WRITTEN;
+  scan.return_mask = PAGE_IS_WRITTEN;
+  while (scan.start < scan.end) {
+    int region_count = ioctl(write_tracking_pagemap_, PAGEMAP_SCAN, &scan);
+    if (region_count < 0) {
+      return false;
+    }
+    for (int i = 0; i < region_count; ++i) {
+      callback(reinterpret_cast<void*>(uintptr_t(regions[i].start)),
+               size_t(regions[i].end - regions[i].start));
+    }
+    // Stops early if the regions don't fit.
+    scan.start = scan.walk_end;
+  }
+  return true;
+}
+#else
+bool EnableWriteTracking(void* base_address, size_t length) { return false; }
+
+bool GetAndResetWrittenRanges(
+    void* base_address, size_t length,
+    const std::function<void(void* base_address, size_t length)>& callback) {
+  return false;
+}
+#endif
+
 bool Protect(void* base_address, size_t length, PageAccess access,
              PageAccess* out_old_access) {
   // Linux does not have a syscall to query memory permissions.
@@ -55,6 +55,78 @@ size_t allocation_granularity() {
 #endif
 }
 
+#ifdef XE_BASE_MEMORY_WIN_USE_DESKTOP_FUNCTIONS
+// Placeholders, allowing views to be mapped at page granularity, were added in
+// Windows 10 1803, so the functions are loaded dynamically.
+typedef PVOID(WINAPI* VirtualAlloc2Fn)(HANDLE process, PVOID base_address,
+                                       SIZE_T size, ULONG allocation_type,
+                                       ULONG page_protection,
+                                       MEM_EXTENDED_PARAMETER* parameters,
+                                       ULONG parameter_count);
+typedef PVOID(WINAPI* MapViewOfFile3Fn)(
+    HANDLE file_mapping, HANDLE process, PVOID base_address, ULONG64 offset,
+    SIZE_T view_size, ULONG allocation_type, ULONG page_protection,
+    MEM_EXTENDED_PARAMETER* parameters, ULONG parameter_count);
+
+struct PlaceholderFunctions {
+  VirtualAlloc2Fn virtual_alloc_2 = nullptr;
+  MapViewOfFile3Fn map_view_of_file_3 = nullptr;
+};
+
+// Null functions if page granularity views aren't supported.
+static const PlaceholderFunctions& GetPlaceholderFunctions() {
+  static const PlaceholderFunctions functions = []() {
+    PlaceholderFunctions loaded;
+    HMODULE kernelbase = GetModuleHandleW(L"kernelbase.dll");
+    if (!kernelbase) {
+      return loaded;
+    }
+    loaded.virtual_alloc_2 = reinterpret_cast<VirtualAlloc2Fn>(
+        GetProcAddress(kernelbase, "VirtualAlloc2"));
+    loaded.map_view_of_file_3 = reinterpret_cast<MapViewOfFile3Fn>(
+        GetProcAddress(kernelbase, "MapViewOfFile3"));
+    if (!loaded.virtual_alloc_2 || !loaded.map_view_of_file_3) {
+      return PlaceholderFunctions();
+    }
+    // Check that a view can actually be mapped at a page offset.
+    HANDLE section = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr,
+                                        PAGE_READWRITE, 0, 0x2000, nullptr);
+    if (!section) {
+      return PlaceholderFunctions();
+    }
+    HANDLE process = GetCurrentProcess();
+    bool mapped = false;
+    void* placeholder = loaded.virtual_alloc_2(
+        process, nullptr, 0x1000, MEM_RESERVE | MEM_RESERVE_PLACEHOLDER,
+        PAGE_NOACCESS, nullptr, 0);
+    if (placeholder) {
+      void* view = loaded.map_view_of_file_3(section, process, placeholder,
+                                             0x1000, 0x1000,
+                                             MEM_REPLACE_PLACEHOLDER,
+                                             PAGE_READWRITE, nullptr, 0);
+      if (view) {
+        mapped = true;
+        UnmapViewOfFile(view);
+      } else {
+        VirtualFree(placeholder, 0, MEM_RELEASE);
+      }
+    }
+    CloseHandle(section);
+    return mapped ? loaded : PlaceholderFunctions();
+  }();
+  return functions;
+}
+#endif  // XE_BASE_MEMORY_WIN_USE_DESKTOP_FUNCTIONS
+
+size_t file_view_granularity() {
+#ifdef XE_BASE_MEMORY_WIN_USE_DESKTOP_FUNCTIONS
+  if (GetPlaceholderFunctions().map_view_of_file_3) {
+    return page_size();
+  }
+#endif
+  return allocation_granularity();
+}
+
 DWORD ToWin32ProtectFlags(PageAccess access) {
   switch (access) {
     case PageAccess::kNoAccess:
@@ -255,6 +327,30 @@ void* MapFileView(FileMappingHandle handle, void* base_address, size_t length,
       assert_unhandled_case(access);
       return nullptr;
   }
+  if ((file_offset | reinterpret_cast<uintptr_t>(base_address)) &
+      (allocation_granularity() - 1)) {
+    const PlaceholderFunctions& placeholder_functions =
+        GetPlaceholderFunctions();
+    if (!placeholder_functions.map_view_of_file_3) {
+      return nullptr;
+    }
+    HANDLE process = GetCurrentProcess();
+    void* placeholder = placeholder_functions.virtual_alloc_2(
+        process, base_address, length, MEM_RESERVE | MEM_RESERVE_PLACEHOLDER,
+        PAGE_NOACCESS, nullptr, 0);
+    if (!placeholder) {
+      return nullptr;
+    }
+    void* mapping = placeholder_functions.map_view_of_file_3(
+        handle, process, placeholder, ULONG64(file_offset), length,
+        MEM_REPLACE_PLACEHOLDER, ULONG(ToWin32ProtectFlags(access)), nullptr,
+        0);
+    if (!mapping) {
+      VirtualFree(placeholder, 0, MEM_RELEASE);
+      return nullptr;
+    }
+    return mapping;
+  }
   return MapViewOfFileEx(handle, file_access, target_address_high,
                          target_address_low, length, base_address);
 #else
@@ -283,5 +379,30 @@ bool UnmapFileView(FileMappingHandle handle, void* base_address,
   return UnmapViewOfFile(base_address) ? true : false;
 }
 
+bool PrefetchFileView(const void* base_address, size_t length) {
+  WIN32_MEMORY_RANGE_ENTRY range;
+  range.VirtualAddress = const_cast<void*>(base_address);
+  range.NumberOfBytes = length;
+  return PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0) != FALSE;
+}
+
+bool AdviseHugePages(void* base_address, size_t length) {
+  // Large pages for sections require SEC_LARGE_PAGES, the whole section being
+  // committed and locked at creation, and don't allow protecting 4 KB pages.
+  return false;
+}
+
+bool EnableWriteTracking(void* base_address, size_t length) {
+  // GetWriteWatch only works with VirtualAlloc MEM_WRITE_WATCH memory, not
+  // with views of sections.
+  return false;
+}
+
+bool GetAndResetWrittenRanges(
+    void* base_address, size_t length,
+    const std::function<void(void* base_address, size_t length)>& callback) {
+  return false;
+}
+
 }  // namespace memory
 }  // namespace xe
@@ -0,0 +1,89 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_MPSC_QUEUE_H_
+#define XENIA_BASE_MPSC_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace xe {
+
+// Fixed-capacity lock-free queue with multiple producers and a single
+// consumer, with all the storage preallocated. Every slot has a sequence
+// number telling whether it's free for the producer at the position or filled
+// for the consumer, so neither side ever waits for the other.
+template <typename T, size_t kCapacity>
+class BoundedMpscQueue {
+  static_assert(kCapacity && !(kCapacity & (kCapacity - 1)),
+                "The capacity must be a power of two");
+
+ public:
+  BoundedMpscQueue() {
+    for (size_t i = 0; i < kCapacity; ++i) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+  BoundedMpscQueue(const BoundedMpscQueue& queue) = delete;
+  BoundedMpscQueue& operator=(const BoundedMpscQueue& queue) = delete;
+
+  static constexpr size_t capacity() { return kCapacity; }
+
+  // May be called from any thread. Returns false if the queue is full.
+  bool Push(const T& value) {
+    size_t position = write_position_.load(std::memory_order_relaxed);
+    while (true) {
+      Slot& slot = slots_[position & (kCapacity - 1)];
+      size_t sequence = slot.sequence.load(std::memory_order_acquire);
+      ptrdiff_t difference = ptrdiff_t(sequence) - ptrdiff_t(position);
+      if (!difference) {
+        if (write_position_.compare_exchange_weak(position, position + 1,
+                                                  std::memory_order_relaxed)) {
+          slot.value = value;
+          slot.sequence.store(position + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (difference < 0) {
+        // Not consumed yet since the previous lap.
+        return false;
+      } else {
+        position = write_position_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Must be called only from the consumer thread. Returns false if the queue
+  // is empty, or the oldest value is still being written.
+  bool Pop(T& value_out) {
+    Slot& slot = slots_[read_position_ & (kCapacity - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != read_position_ + 1) {
+      return false;
+    }
+    value_out = slot.value;
+    slot.sequence.store(read_position_ + kCapacity, std::memory_order_release);
+    ++read_position_;
+    return true;
+  }
+
+ private:
+  struct Slot {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  // Separate cache lines for the producers and the consumer.
+  alignas(64) std::atomic<size_t> write_position_{0};
+  alignas(64) size_t read_position_ = 0;
+  alignas(64) Slot slots_[kCapacity];
+};
+
+}  // namespace xe
+
+#endif  // XENIA_BASE_MPSC_QUEUE_H_
@@ -8,10 +8,22 @@
  */
 
 #include "xenia/base/mutex.h"
+#include "xenia/base/assert.h"
+#include "xenia/base/math.h"
 #if XE_PLATFORM_WIN32 == 1
 #include "xenia/base/platform_win.h"
 #endif
 
+#if XE_ENABLE_LOCK_PROFILING == 1
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/profiling.h"
+#endif
+
 namespace xe {
 #if XE_PLATFORM_WIN32 == 1 && XE_ENABLE_FAST_WIN32_MUTEX == 1
 // default spincount for entercriticalsection is insane on windows, 0x20007D0i64
@@ -65,6 +77,216 @@ bool xe_fast_mutex::try_lock() {
   return TryEnterCriticalSection(fast_crit(this));
 }
 #endif
+
+#if XE_ENABLE_LOCK_PROFILING == 1
+namespace {
+
+struct LockSite {
+  // Written before used is set.
+  const char* file;
+  uint32_t line;
+  std::atomic<bool> used;
+  std::atomic<uint64_t> acquisition_count;
+  std::atomic<uint64_t> contention_count;
+  std::atomic<uint64_t> wait_host_ticks;
+  std::atomic<uint64_t> hold_host_ticks;
+#if XE_OPTION_PROFILING
+  char counter_name_wait[128];
+  char counter_name_hold[128];
+  MicroProfileToken counter_wait;
+  MicroProfileToken counter_hold;
+#endif  // XE_OPTION_PROFILING
+};
+
+// Open addressing, sites are never removed. There are a few hundred users of
+// the global critical region.
+constexpr uint32_t kLockSiteCountLog2 = 12;
+LockSite lock_sites[1 << kLockSiteCountLog2];
+std::mutex lock_site_registration_mutex;
+
+LockSite* GetLockSite(const char* file, uint32_t line) {
+  constexpr uint32_t kMask = (1 << kLockSiteCountLog2) - 1;
+  uint32_t index =
+      uint32_t((reinterpret_cast<uintptr_t>(file) >> 3) * 31 + line) & kMask;
+  for (uint32_t i = 0; i <= kMask; ++i, index = (index + 1) & kMask) {
+    LockSite& site = lock_sites[index];
+    if (!site.used.load(std::memory_order_acquire)) {
+      std::lock_guard<std::mutex> lock(lock_site_registration_mutex);
+      if (!site.used.load(std::memory_order_relaxed)) {
+        site.file = file;
+        site.line = line;
+#if XE_OPTION_PROFILING
+        std::snprintf(site.counter_name_wait, sizeof(site.counter_name_wait),
+                      "global_lock/%s:%u/wait_us", file, line);
+        std::snprintf(site.counter_name_hold, sizeof(site.counter_name_hold),
+                      "global_lock/%s:%u/hold_us", file, line);
+        site.counter_wait = MicroProfileGetCounterToken(site.counter_name_wait);
+        site.counter_hold = MicroProfileGetCounterToken(site.counter_name_hold);
+#endif  // XE_OPTION_PROFILING
+        site.used.store(true, std::memory_order_release);
+        return &site;
+      }
+    }
+    if (site.file == file && site.line == line) {
+      return &site;
+    }
+  }
+  // Out of space, attribute to the last one probed.
+  return &lock_sites[index];
+}
+
+uint64_t HostTicksToMicroseconds(uint64_t host_ticks) {
+  return host_ticks * 1000000 / Clock::QueryHostTickFrequency();
+}
+
+}  // namespace
+
+void profiled_global_mutex::lock(const char* file, uint32_t line) {
+  LockSite* site = GetLockSite(file, line);
+  site->acquisition_count.fetch_add(1, std::memory_order_relaxed);
+  if (!mutex_.try_lock()) {
+    uint64_t wait_start_host_tick = Clock::QueryHostTickCount();
+    mutex_.lock();
+    uint64_t wait_host_ticks =
+        Clock::QueryHostTickCount() - wait_start_host_tick;
+    site->contention_count.fetch_add(1, std::memory_order_relaxed);
+    site->wait_host_ticks.fetch_add(wait_host_ticks,
+                                    std::memory_order_relaxed);
+#if XE_OPTION_PROFILING
+    MicroProfileCounterAdd(site->counter_wait,
+                           int64_t(HostTicksToMicroseconds(wait_host_ticks)));
+#endif  // XE_OPTION_PROFILING
+  }
+  OnAcquired(site, Clock::QueryHostTickCount());
+}
+
+bool profiled_global_mutex::try_lock(const char* file, uint32_t line) {
+  if (!mutex_.try_lock()) {
+    return false;
+  }
+  LockSite* site = GetLockSite(file, line);
+  site->acquisition_count.fetch_add(1, std::memory_order_relaxed);
+  OnAcquired(site, Clock::QueryHostTickCount());
+  return true;
+}
+
+void profiled_global_mutex::OnAcquired(void* site,
+                                       uint64_t acquire_host_tick) {
+  if (!recursion_depth_++) {
+    hold_site_ = site;
+    hold_start_host_tick_ = acquire_host_tick;
+  }
+}
+
+void profiled_global_mutex::unlock() {
+  if (!--recursion_depth_) {
+    auto site = reinterpret_cast<LockSite*>(hold_site_);
+    uint64_t hold_host_ticks =
+        Clock::QueryHostTickCount() - hold_start_host_tick_;
+    site->hold_host_ticks.fetch_add(hold_host_ticks,
+                                    std::memory_order_relaxed);
+#if XE_OPTION_PROFILING
+    MicroProfileCounterAdd(site->counter_hold,
+                           int64_t(HostTicksToMicroseconds(hold_host_ticks)));
+#endif  // XE_OPTION_PROFILING
+  }
+  mutex_.unlock();
+}
+
+void profiled_global_mutex::GetSiteStatistics(
+    std::vector<lock_site_statistics>& sites_out) {
+  sites_out.clear();
+  for (const LockSite& site : lock_sites) {
+    if (!site.used.load(std::memory_order_acquire)) {
+      continue;
+    }
+    lock_site_statistics& site_out = sites_out.emplace_back();
+    site_out.file = site.file;
+    site_out.line = site.line;
+    site_out.acquisition_count =
+        site.acquisition_count.load(std::memory_order_relaxed);
+    site_out.contention_count =
+        site.contention_count.load(std::memory_order_relaxed);
+    site_out.wait_microseconds = HostTicksToMicroseconds(
+        site.wait_host_ticks.load(std::memory_order_relaxed));
+    site_out.hold_microseconds = HostTicksToMicroseconds(
+        site.hold_host_ticks.load(std::memory_order_relaxed));
+  }
+  std::sort(sites_out.begin(), sites_out.end(),
+            [](const lock_site_statistics& a, const lock_site_statistics& b) {
+              return a.wait_microseconds > b.wait_microseconds;
+            });
+}
+
+void profiled_global_mutex::DumpSiteStatistics() {
+  std::vector<lock_site_statistics> sites;
+  GetSiteStatistics(sites);
+  XELOGI("Global critical region acquisition sites by wait time:");
+  for (const lock_site_statistics& site : sites) {
+    XELOGI(
+        "  {}:{}: {} acquisitions, {} contended, {} us waiting, {} us held",
+        site.file, site.line, site.acquisition_count, site.contention_count,
+        site.wait_microseconds, site.hold_microseconds);
+  }
+}
+#endif  // XE_ENABLE_LOCK_PROFILING
+
+#if XE_CHECK_LOCK_DOMAIN_ORDER == 1
+static thread_local uint32_t
+    lock_domain_recursion_depths[size_t(lock_domain::kCount)];
+
+void check_no_lock_domain_held() {
+  for (uint32_t depth : lock_domain_recursion_depths) {
+    assert_zero(depth, "Global critical region acquired while holding a lock "
+                       "domain");
+  }
+}
+#endif  // XE_CHECK_LOCK_DOMAIN_ORDER
+
+void domain_mutex::lock() {
+#if XE_CHECK_LOCK_DOMAIN_ORDER == 1
+  for (size_t i = size_t(domain_) + 1; i < size_t(lock_domain::kCount); ++i) {
+    assert_zero(lock_domain_recursion_depths[i],
+                "Lock domain acquired out of order");
+  }
+#endif  // XE_CHECK_LOCK_DOMAIN_ORDER
+  mutex_.lock();
+#if XE_CHECK_LOCK_DOMAIN_ORDER == 1
+  ++lock_domain_recursion_depths[size_t(domain_)];
+#endif  // XE_CHECK_LOCK_DOMAIN_ORDER
+}
+
+void domain_mutex::unlock() {
+#if XE_CHECK_LOCK_DOMAIN_ORDER == 1
+  assert_not_zero(lock_domain_recursion_depths[size_t(domain_)]);
+  --lock_domain_recursion_depths[size_t(domain_)];
+#endif  // XE_CHECK_LOCK_DOMAIN_ORDER
+  mutex_.unlock();
+}
+
+bool domain_mutex::try_lock() {
+  // Not waiting, so can't deadlock regardless of the order.
+  if (!mutex_.try_lock()) {
+    return false;
+  }
+#if XE_CHECK_LOCK_DOMAIN_ORDER == 1
+  ++lock_domain_recursion_depths[size_t(domain_)];
+#endif  // XE_CHECK_LOCK_DOMAIN_ORDER
+  return true;
+}
+
+domain_mutex& get_lock_domain_mutex(lock_domain domain) {
+  static domain_mutex mutexes[] = {
+      domain_mutex(lock_domain::kKernelObjects),
+      domain_mutex(lock_domain::kCpu),
+      domain_mutex(lock_domain::kMemory),
+      domain_mutex(lock_domain::kMmio),
+      domain_mutex(lock_domain::kGpuWatch),
+  };
+  static_assert(xe::countof(mutexes) == size_t(lock_domain::kCount));
+  return mutexes[size_t(domain)];
+}
+
 // chrispy: moved this out of body of function to eliminate the initialization
 // guards
 static global_mutex_type global_mutex;
@@ -10,9 +10,16 @@
 #ifndef XENIA_BASE_MUTEX_H_
 #define XENIA_BASE_MUTEX_H_
 #include <mutex>
+#include <vector>
 #include "platform.h"
 #include "memory.h"
 #define XE_ENABLE_FAST_WIN32_MUTEX 1
+// Set to 1 to record, for every site acquiring the global critical region, the
+// number of the acquisitions, how many of them had to wait, and the time spent
+// waiting and holding the lock, to find out which users of the global lock are
+// worth moving to their own locks. Adds overhead to every acquisition. The
+// statistics are exposed as profiler counters and printed by Profiler::Dump.
+#define XE_ENABLE_LOCK_PROFILING 0
 namespace xe {
 
 #if XE_PLATFORM_WIN32 == 1 && XE_ENABLE_FAST_WIN32_MUTEX == 1
@@ -36,7 +43,7 @@ class alignas(4096) xe_global_mutex {
   void unlock();
   bool try_lock();
 };
-using global_mutex_type = xe_global_mutex;
+using global_mutex_base_type = xe_global_mutex;
 
 class alignas(64) xe_fast_mutex {
 	XE_MAYBE_UNUSED
@@ -81,10 +88,52 @@ class xe_unlikely_mutex {
 };
 using xe_mutex = xe_fast_mutex;
 #else
-using global_mutex_type = std::recursive_mutex;
+using global_mutex_base_type = std::recursive_mutex;
 using xe_mutex = std::mutex;
 using xe_unlikely_mutex = std::mutex;
 #endif
+
+#if XE_ENABLE_LOCK_PROFILING == 1
+struct lock_site_statistics {
+  const char* file;
+  uint32_t line;
+  uint64_t acquisition_count;
+  // Acquisitions that had to wait for another thread to release the lock.
+  uint64_t contention_count;
+  uint64_t wait_microseconds;
+  // Only the outermost recursive acquisition of a thread counts as holding.
+  uint64_t hold_microseconds;
+};
+
+// Attributes the acquisitions to the source location of the caller of lock,
+// or of Acquire / AcquireDirect of global_critical_region. Locking via
+// std::unique_lock or std::lock_guard is attributed to the standard library
+// header.
+class profiled_global_mutex {
+ public:
+  void lock(const char* file = __builtin_FILE(),
+            uint32_t line = __builtin_LINE());
+  void unlock();
+  bool try_lock(const char* file = __builtin_FILE(),
+                uint32_t line = __builtin_LINE());
+
+  // Sorted by the total wait time, descending.
+  static void GetSiteStatistics(std::vector<lock_site_statistics>& sites_out);
+  static void DumpSiteStatistics();
+
+ private:
+  void OnAcquired(void* site, uint64_t acquire_host_tick);
+
+  global_mutex_base_type mutex_;
+  // Accessed only by the owner.
+  uint32_t recursion_depth_ = 0;
+  void* hold_site_ = nullptr;
+  uint64_t hold_start_host_tick_ = 0;
+};
+using global_mutex_type = profiled_global_mutex;
+#else
+using global_mutex_type = global_mutex_base_type;
+#endif
 struct null_mutex {
  public:
   static void lock() {}
@@ -93,6 +142,70 @@ struct null_mutex {
 };
 
 using global_unique_lock_type = std::unique_lock<global_mutex_type>;
+
+#if !defined(NDEBUG)
+#define XE_CHECK_LOCK_DOMAIN_ORDER 1
+#else
+#define XE_CHECK_LOCK_DOMAIN_ORDER 0
+#endif
+
+// Locks guarding the state of a single subsystem, for the users of the global
+// critical region that don't call out to other code while holding it, so they
+// don't contend with everything else.
+//
+// Ordering: the global critical region is always acquired first, then the
+// domains in the order of their values. A thread holding a domain may only
+// acquire it recursively or the domains following it, and must not acquire the
+// global critical region. Checked in debug builds.
+//
+// Unlike the global critical region, a domain doesn't prevent the suspension of
+// the threads holding it, so code that suspends guest threads must not require
+// any of them until the threads are resumed.
+enum class lock_domain : uint32_t {
+  // Kernel object handle tables.
+  kKernelObjects,
+  // JIT function entry table and code cache.
+  kCpu,
+  // Guest memory heaps.
+  kMemory,
+  kMmio,
+  // GPU memory watches.
+  kGpuWatch,
+
+  kCount,
+};
+
+class domain_mutex {
+ public:
+  explicit domain_mutex(lock_domain domain) : domain_(domain) {}
+
+  void lock();
+  void unlock();
+  bool try_lock();
+
+ private:
+  lock_domain domain_;
+  global_mutex_base_type mutex_;
+};
+
+domain_mutex& get_lock_domain_mutex(lock_domain domain);
+#if XE_CHECK_LOCK_DOMAIN_ORDER == 1
+// Asserts that the calling thread isn't holding any domain.
+void check_no_lock_domain_held();
+#endif
+
+// Keep an instance near the data guarded by the domain, like
+// global_critical_region.
+template <lock_domain domain>
+class domain_critical_region {
+ public:
+  static domain_mutex& mutex() { return get_lock_domain_mutex(domain); }
+
+  static std::unique_lock<domain_mutex> Acquire() {
+    return std::unique_lock<domain_mutex>(mutex());
+  }
+};
+using cpu_critical_region = domain_critical_region<lock_domain::kCpu>;
 // The global critical region mutex singleton.
 // This must guard any operation that may suspend threads or be sensitive to
 // being suspended such as global table locks and such.
@@ -140,14 +253,42 @@ class global_critical_region {
   // Use this when keeping an instance is not possible. Otherwise, prefer
   // to keep an instance of global_critical_region near the members requiring
   // it to keep things readable.
+#if XE_ENABLE_LOCK_PROFILING == 1
+  static global_unique_lock_type AcquireDirect(
+      const char* file = __builtin_FILE(), uint32_t line = __builtin_LINE()) {
+#if XE_CHECK_LOCK_DOMAIN_ORDER == 1
+    check_no_lock_domain_held();
+#endif
+    mutex().lock(file, line);
+    return global_unique_lock_type(mutex(), std::adopt_lock);
+  }
+#else
   static global_unique_lock_type AcquireDirect() {
+#if XE_CHECK_LOCK_DOMAIN_ORDER == 1
+    check_no_lock_domain_held();
+#endif
     return global_unique_lock_type(mutex());
   }
+#endif
 
   // Acquires a lock on the global critical section.
+#if XE_ENABLE_LOCK_PROFILING == 1
+  static inline global_unique_lock_type Acquire(
+      const char* file = __builtin_FILE(), uint32_t line = __builtin_LINE()) {
+#if XE_CHECK_LOCK_DOMAIN_ORDER == 1
+    check_no_lock_domain_held();
+#endif
+    mutex().lock(file, line);
+    return global_unique_lock_type(mutex(), std::adopt_lock);
+  }
+#else
   static inline global_unique_lock_type Acquire() {
+#if XE_CHECK_LOCK_DOMAIN_ORDER == 1
+    check_no_lock_domain_held();
+#endif
     return global_unique_lock_type(mutex());
   }
+#endif
 
   static inline void PrepareToAcquire() {
 #if XE_PLATFORM_WIN32 == 1
@@ -127,6 +127,9 @@ void InitFeatureFlags() {
     if ((data[1] & (1 << 9)) && (cvars::x64_extension_mask & kX64FastRepMovs)) {
       feature_flags_ |= kX64FastRepMovs;
     }
+    if ((data[2] & (1 << 5)) && (cvars::x64_extension_mask & kX64WaitPkg)) {
+      feature_flags_ |= kX64WaitPkg;
+    }
   }
   g_feature_flags = feature_flags_;
   g_did_initialize_feature_flags = true;
@@ -13,6 +13,7 @@
 // NOTE: this must be included before microprofile as macro expansion needs
 // XELOGI.
 #include "xenia/base/logging.h"
+#include "xenia/base/mutex.h"
 
 #include "third_party/fmt/include/fmt/printf.h"
 
@@ -106,6 +107,9 @@ void Profiler::Dump() {
 #if XE_OPTION_PROFILING_UI
   MicroProfileDumpTimers();
 #endif  // XE_OPTION_PROFILING_UI
+#if XE_ENABLE_LOCK_PROFILING == 1
+  profiled_global_mutex::DumpSiteStatistics();
+#endif  // XE_ENABLE_LOCK_PROFILING
   // MicroProfileDumpHtml("profile.html");
   // MicroProfileDumpHtmlToFile();
 }
@@ -336,7 +340,11 @@ void Profiler::PostInputEvent() {
 bool Profiler::is_enabled() { return false; }
 bool Profiler::is_visible() { return false; }
 void Profiler::Initialize() {}
-void Profiler::Dump() {}
+void Profiler::Dump() {
+#if XE_ENABLE_LOCK_PROFILING == 1
+  profiled_global_mutex::DumpSiteStatistics();
+#endif  // XE_ENABLE_LOCK_PROFILING
+}
 void Profiler::Shutdown() {}
 uint32_t Profiler::GetColor(const char* str) { return 0; }
 void Profiler::ThreadEnter(const char* name) {}
@@ -10,39 +10,165 @@
 #ifndef XENIA_BASE_SPLIT_MAP_H_
 #define XENIA_BASE_SPLIT_MAP_H_
 #include <algorithm>
+#include <cstdint>
+#include <type_traits>
 #include <vector>
+
+#include "xenia/base/math.h"
+#include "xenia/base/platform.h"
+
+#if XE_ARCH_AMD64
+#include <emmintrin.h>
+#endif
+
 namespace xe {
+
+// Search policies of split_map, locating the lower bound of a key in the sorted
+// key vector. Invalidate is called whenever the keys are modified.
+
+// std::lower_bound over the whole key vector.
+template <typename TKey>
+class split_map_binary_search {
+ public:
+  void Invalidate() {}
+  uint32_t IndexForKey(const std::vector<TKey>& keys, const TKey& k) {
+    auto lbound = std::lower_bound(keys.begin(), keys.end(), k);
+    return static_cast<uint32_t>(lbound - keys.begin());
+  }
+};
+
+// Keys grouped into blocks of one cache line (for 32-bit keys), with the last
+// key of every block copied into a compact vector that is binary searched
+// without branches while prefetching the next probes, followed by a linear
+// (SIMD for 32-bit keys on x86-64) scan of the single block. For large maps with
+// frequent lookups, as the probes of the plain binary search are all cache
+// misses except for the last few. The block vector is rebuilt on the first
+// lookup after a modification.
+template <typename TKey>
+class split_map_blocked_search {
+ public:
+  static constexpr uint32_t kBlockSize = 16;
+
+  void Invalidate() { block_last_keys_valid_ = false; }
+
+  uint32_t IndexForKey(const std::vector<TKey>& keys, const TKey& k) {
+    if (!block_last_keys_valid_) {
+      UpdateBlockLastKeys(keys);
+    }
+    uint32_t block_count = static_cast<uint32_t>(block_last_keys_.size());
+    if (!block_count) {
+      return 0;
+    }
+    const TKey* block_last_keys = block_last_keys_.data();
+    uint32_t block = 0;
+    uint32_t remaining = block_count;
+    while (remaining > 1) {
+      uint32_t half = remaining / 2;
+      remaining -= half;
+#if XE_ARCH_AMD64
+      // Both candidates for the next probe.
+      _mm_prefetch(reinterpret_cast<const char*>(block_last_keys + block +
+                                                 remaining / 2),
+                   _MM_HINT_T0);
+      _mm_prefetch(reinterpret_cast<const char*>(block_last_keys + block +
+                                                 half + remaining / 2),
+                   _MM_HINT_T0);
+#endif
+      block = block_last_keys[block + half] < k ? block + half : block;
+    }
+    block += block_last_keys[block] < k ? 1 : 0;
+    if (block >= block_count) {
+      return static_cast<uint32_t>(keys.size());
+    }
+    uint32_t block_start = block * kBlockSize;
+    uint32_t block_length = std::min(
+        kBlockSize, static_cast<uint32_t>(keys.size()) - block_start);
+    return block_start + CountLess(keys.data() + block_start, block_length, k);
+  }
+
+ private:
+  void UpdateBlockLastKeys(const std::vector<TKey>& keys) {
+    block_last_keys_.clear();
+    size_t key_count = keys.size();
+    for (size_t i = kBlockSize - 1; i < key_count; i += kBlockSize) {
+      block_last_keys_.push_back(keys[i]);
+    }
+    if (key_count % kBlockSize) {
+      block_last_keys_.push_back(keys.back());
+    }
+    block_last_keys_valid_ = true;
+  }
+
+  // As the keys are sorted, the number of the keys less than k in the block is
+  // the offset of the lower bound in it.
+  static uint32_t CountLess(const TKey* keys, uint32_t count, const TKey& k) {
+#if XE_ARCH_AMD64
+    if constexpr (std::is_same_v<TKey, uint32_t>) {
+      if (count == kBlockSize) {
+        // SSE2 only has signed comparison, flip the sign bits.
+        const __m128i sign = _mm_set1_epi32(INT32_MIN);
+        __m128i k_signed = _mm_xor_si128(_mm_set1_epi32(int32_t(k)), sign);
+        uint32_t less_mask = 0;
+        for (uint32_t i = 0; i < kBlockSize; i += 4) {
+          __m128i keys_signed = _mm_xor_si128(
+              _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)),
+              sign);
+          less_mask |= uint32_t(_mm_movemask_ps(
+                           _mm_castsi128_ps(_mm_cmplt_epi32(keys_signed,
+                                                            k_signed))))
+                       << i;
+        }
+        return xe::bit_count(less_mask);
+      }
+    }
+#endif
+    uint32_t less_count = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      less_count += keys[i] < k ? 1 : 0;
+    }
+    return less_count;
+  }
+
+  std::vector<TKey> block_last_keys_;
+  bool block_last_keys_valid_ = false;
+};
+
 /*
         a map structure that is optimized for infrequent
    reallocation/resizing/erasure and frequent searches by key implemented as 2
    std::vectors, one of the keys and one of the values
 */
-template <typename TKey, typename TValue>
+template <typename TKey, typename TValue,
+          template <typename> class TSearch = split_map_binary_search>
 class split_map {
   using key_vector = std::vector<TKey>;
   using value_vector = std::vector<TValue>;
 
   key_vector keys_;
   value_vector values_;
+  TSearch<TKey> search_;
 
  public:
-  using my_type = split_map<TKey, TValue>;
+  using my_type = split_map<TKey, TValue, TSearch>;
 
-  uint32_t IndexForKey(const TKey& k) {
-    auto lbound = std::lower_bound(keys_.begin(), keys_.end(), k);
-    return static_cast<uint32_t>(lbound - keys_.begin());
-  }
+  uint32_t IndexForKey(const TKey& k) { return search_.IndexForKey(keys_, k); }
 
   uint32_t size() const { return static_cast<uint32_t>(keys_.size()); }
-  key_vector& Keys() { return keys_; }
+  // The keys may be modified through the reference until the next lookup.
+  key_vector& Keys() {
+    search_.Invalidate();
+    return keys_;
+  }
   value_vector& Values() { return values_; }
   void clear() {
     keys_.clear();
     values_.clear();
+    search_.Invalidate();
   }
   void resize(uint32_t new_size) {
     keys_.resize(static_cast<size_t>(new_size));
     values_.resize(static_cast<size_t>(new_size));
+    search_.Invalidate();
   }
 
   void reserve(uint32_t new_size) {
@@ -69,6 +195,7 @@ class split_map {
 
     values_.insert(values_.begin() + idx, v);
     keys_.insert(keys_.begin() + idx, k);
+    search_.Invalidate();
   }
   void EraseAt(uint32_t idx) {
     uint32_t old_size = size();
@@ -77,6 +204,7 @@ class split_map {
     } else {
       values_.erase(values_.begin() + idx);
       keys_.erase(keys_.begin() + idx);
+      search_.Invalidate();
     }
   }
 };
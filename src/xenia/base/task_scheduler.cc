@@ -0,0 +1,256 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/base/task_scheduler.h"
+
+#include <algorithm>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/logging.h"
+
+#include "third_party/fmt/include/fmt/format.h"
+
+DEFINE_int32(task_scheduler_threads, -1,
+             "Number of worker threads of the task scheduler shared by the "
+             "host subsystems. -1 to use the host logical processors not "
+             "reserved with task_scheduler_guest_cores.",
+             "General");
+DEFINE_int32(task_scheduler_guest_cores, 3,
+             "Host logical processors left for the guest threads when the "
+             "task scheduler size is chosen automatically.",
+             "General");
+
+namespace xe {
+namespace threading {
+
+namespace {
+
+struct CurrentWorker {
+  const TaskScheduler* scheduler = nullptr;
+  uint32_t index = TaskScheduler::kAnyWorker;
+};
+thread_local CurrentWorker current_worker_;
+
+}  // namespace
+
+TaskScheduler& TaskScheduler::Get() {
+  static TaskScheduler scheduler([]() {
+    if (cvars::task_scheduler_threads >= 0) {
+      return uint32_t(cvars::task_scheduler_threads);
+    }
+    int32_t worker_count = int32_t(logical_processor_count()) -
+                           std::max(cvars::task_scheduler_guest_cores, 0);
+    return uint32_t(std::max(worker_count, 1));
+  }());
+  return scheduler;
+}
+
+TaskScheduler::TaskScheduler(uint32_t worker_count) {
+  worker_count = std::max(worker_count, uint32_t(1));
+  workers_.reserve(worker_count);
+  for (uint32_t i = 0; i < worker_count; ++i) {
+    workers_.push_back(std::make_unique<Worker>());
+  }
+  // Start the threads after all the workers have been created as they steal
+  // from each other.
+  for (uint32_t i = 0; i < worker_count; ++i) {
+    auto thread = Thread::Create({}, [this, i]() { WorkerThread(i); });
+    if (!thread) {
+      XELOGE("TaskScheduler: Failed to create worker thread {}", i);
+      continue;
+    }
+    thread->set_name(fmt::format("Task Worker {}", i));
+    workers_[i]->thread = std::move(thread);
+  }
+}
+
+TaskScheduler::~TaskScheduler() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    shutdown_ = true;
+  }
+  sleep_cond_.notify_all();
+  for (auto& worker : workers_) {
+    if (worker->thread) {
+      Wait(worker->thread.get(), false);
+    }
+  }
+}
+
+uint32_t TaskScheduler::current_worker_index() const {
+  return current_worker_.scheduler == this ? current_worker_.index
+                                           : kAnyWorker;
+}
+
+void TaskScheduler::Submit(std::function<void()> task, Priority priority,
+                           uint32_t preferred_worker) {
+  if (preferred_worker != kAnyWorker) {
+    Worker& worker = *workers_[preferred_worker % workers_.size()];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.tasks.push_back(std::move(task));
+  } else {
+    std::lock_guard<std::mutex> lock(shared_mutex_);
+    shared_tasks_[size_t(priority)].push_back(std::move(task));
+  }
+  NotifyTaskQueued();
+}
+
+void TaskScheduler::NotifyTaskQueued() {
+  queued_task_count_.fetch_add(1, std::memory_order_release);
+  // Taking the lock so a worker going to sleep doesn't miss the task.
+  { std::lock_guard<std::mutex> lock(sleep_mutex_); }
+  sleep_cond_.notify_one();
+}
+
+bool TaskScheduler::RunQueuedTask(uint32_t worker_index) {
+  std::function<void()> task;
+  // The own queue, newest first for locality.
+  if (worker_index != kAnyWorker) {
+    Worker& worker = *workers_[worker_index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (!worker.tasks.empty()) {
+      task = std::move(worker.tasks.back());
+      worker.tasks.pop_back();
+    }
+  }
+  if (!task) {
+    std::lock_guard<std::mutex> lock(shared_mutex_);
+    for (auto& shared_tasks : shared_tasks_) {
+      if (!shared_tasks.empty()) {
+        task = std::move(shared_tasks.front());
+        shared_tasks.pop_front();
+        break;
+      }
+    }
+  }
+  if (!task) {
+    // Steal the oldest task of another worker, starting from the next one so
+    // the workers don't all go to the same victim.
+    size_t worker_count = workers_.size();
+    size_t start = worker_index != kAnyWorker ? worker_index + 1 : 0;
+    for (size_t i = 0; i < worker_count && !task; ++i) {
+      size_t victim_index = (start + i) % worker_count;
+      if (victim_index == worker_index) {
+        continue;
+      }
+      Worker& victim = *workers_[victim_index];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.tasks.empty()) {
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+      }
+    }
+  }
+  if (!task) {
+    return false;
+  }
+  queued_task_count_.fetch_sub(1, std::memory_order_relaxed);
+  task();
+  return true;
+}
+
+void TaskScheduler::WorkerThread(uint32_t worker_index) {
+  current_worker_.scheduler = this;
+  current_worker_.index = worker_index;
+  while (true) {
+    if (RunQueuedTask(worker_index)) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    sleep_cond_.wait(lock, [this]() {
+      return shutdown_ ||
+             queued_task_count_.load(std::memory_order_acquire) != 0;
+    });
+    if (shutdown_) {
+      break;
+    }
+  }
+}
+
+void TaskScheduler::ParallelFor(size_t count,
+                                const std::function<void(size_t index)>& fn,
+                                size_t grain_size, Priority priority) {
+  if (!count) {
+    return;
+  }
+  grain_size = std::max(grain_size, size_t(1));
+  size_t chunk_count = (count + grain_size - 1) / grain_size;
+  if (chunk_count == 1) {
+    for (size_t i = 0; i < count; ++i) {
+      fn(i);
+    }
+    return;
+  }
+
+  // Helpers may start after all the chunks have been taken and the call has
+  // returned, so they keep the state alive, but don't access fn then.
+  struct State {
+    const std::function<void(size_t index)>* fn;
+    size_t count;
+    size_t grain_size;
+    size_t chunk_count;
+    std::atomic<size_t> next_chunk{0};
+    std::atomic<size_t> completed_chunks{0};
+    std::mutex completion_mutex;
+    std::condition_variable completion_cond;
+  };
+  auto state = std::make_shared<State>();
+  state->fn = &fn;
+  state->count = count;
+  state->grain_size = grain_size;
+  state->chunk_count = chunk_count;
+  auto run_chunks = [](State& state) {
+    while (true) {
+      size_t chunk = state.next_chunk.fetch_add(1, std::memory_order_relaxed);
+      if (chunk >= state.chunk_count) {
+        break;
+      }
+      size_t begin = chunk * state.grain_size;
+      size_t end = std::min(begin + state.grain_size, state.count);
+      for (size_t i = begin; i < end; ++i) {
+        (*state.fn)(i);
+      }
+      size_t completed_chunks =
+          state.completed_chunks.fetch_add(1, std::memory_order_acq_rel) + 1;
+      if (completed_chunks == state.chunk_count) {
+        { std::lock_guard<std::mutex> lock(state.completion_mutex); }
+        state.completion_cond.notify_all();
+      }
+    }
+  };
+
+  // The calling thread takes chunks too.
+  size_t helper_count = std::min(chunk_count - 1, size_t(worker_count()));
+  for (size_t i = 0; i < helper_count; ++i) {
+    Submit([state, run_chunks]() { run_chunks(*state); }, priority);
+  }
+  run_chunks(*state);
+
+  uint32_t worker_index = current_worker_index();
+  if (worker_index != kAnyWorker) {
+    // Waiting on a worker would deadlock if all the workers are waiting, so
+    // keep running other tasks.
+    while (state->completed_chunks.load(std::memory_order_acquire) !=
+           chunk_count) {
+      if (!RunQueuedTask(worker_index)) {
+        MaybeYield();
+      }
+    }
+  } else {
+    std::unique_lock<std::mutex> lock(state->completion_mutex);
+    state->completion_cond.wait(lock, [&state, chunk_count]() {
+      return state->completed_chunks.load(std::memory_order_acquire) ==
+             chunk_count;
+    });
+  }
+}
+
+}  // namespace threading
+}  // namespace xe
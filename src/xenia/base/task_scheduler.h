@@ -0,0 +1,106 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_BASE_TASK_SCHEDULER_H_
+#define XENIA_BASE_TASK_SCHEDULER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace threading {
+
+// Pool of worker threads shared by the host-side subsystems for background and
+// data-parallel work, sized to the host logical processors not reserved for
+// the guest threads (task_scheduler_threads), so the subsystems don't
+// oversubscribe the host with their own threads.
+//
+// Every worker takes the most recently added task from its own queue first,
+// and when it's empty, a task from the shared queues in the order of the
+// priority, or the oldest task from the queue of another worker.
+class TaskScheduler {
+ public:
+  enum class Priority {
+    // Work something is waiting for.
+    kHigh,
+    kNormal,
+    // Speculative work like read-ahead or precompilation.
+    kLow,
+
+    kCount,
+  };
+
+  static constexpr uint32_t kAnyWorker = UINT32_MAX;
+
+  // Creates the worker threads on the first call.
+  static TaskScheduler& Get();
+
+  explicit TaskScheduler(uint32_t worker_count);
+  TaskScheduler(const TaskScheduler& scheduler) = delete;
+  TaskScheduler& operator=(const TaskScheduler& scheduler) = delete;
+  // Waits for the tasks already started, dropping the queued ones.
+  ~TaskScheduler();
+
+  uint32_t worker_count() const { return uint32_t(workers_.size()); }
+  // Index of the worker running on the calling thread, or kAnyWorker if called
+  // not from a worker of this scheduler.
+  uint32_t current_worker_index() const;
+
+  // The preferred worker is a hint for keeping related tasks on the same
+  // thread, for instance, for the locality of the data in the caches - other
+  // workers may still take the task if they are idle, regardless of its
+  // priority. Tasks without a preferred worker go to the shared queues.
+  void Submit(std::function<void()> task, Priority priority = Priority::kNormal,
+              uint32_t preferred_worker = kAnyWorker);
+
+  // Calls the function for every index in [0, count) in chunks of up to
+  // grain_size indices, on the workers and the calling thread, and returns
+  // once all the calls have completed. May be called from tasks.
+  void ParallelFor(size_t count, const std::function<void(size_t index)>& fn,
+                   size_t grain_size = 1,
+                   Priority priority = Priority::kNormal);
+
+ private:
+  struct Worker {
+    std::mutex mutex;
+    // Taken by the worker itself from the back, stolen from the front.
+    std::deque<std::function<void()>> tasks;
+    std::unique_ptr<Thread> thread;
+  };
+
+  void WorkerThread(uint32_t worker_index);
+  // Returns false if there are no tasks queued.
+  bool RunQueuedTask(uint32_t worker_index);
+  void NotifyTaskQueued();
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  std::mutex shared_mutex_;
+  std::deque<std::function<void()>> shared_tasks_[size_t(Priority::kCount)];
+
+  // Tasks queued in all the queues, for waking up the workers.
+  std::atomic<size_t> queued_task_count_{0};
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cond_;
+  bool shutdown_ = false;
+};
+
+}  // namespace threading
+}  // namespace xe
+
+#endif  // XENIA_BASE_TASK_SCHEDULER_H_
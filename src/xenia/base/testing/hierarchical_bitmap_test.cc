@@ -0,0 +1,78 @@
+/**
+******************************************************************************
+* Xenia : Xbox 360 Emulator Research Project                                 *
+******************************************************************************
+* Copyright 2022 Ben Vanik. All rights reserved.                             *
+* Released under the BSD license - see LICENSE in the root for more details. *
+******************************************************************************
+*/
+
+#include <random>
+#include <vector>
+
+#include "xenia/base/hierarchical_bitmap.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe {
+namespace base {
+namespace test {
+
+TEST_CASE("HierarchicalBitmap find across words") {
+  HierarchicalBitmap bitmap;
+  bitmap.Reset(64 * 64 * 3 + 5, true);
+  REQUIRE(bitmap.FindNext(0, false) == HierarchicalBitmap::kNotFound);
+  REQUIRE(bitmap.FindPrevious(bitmap.size(), false) ==
+          HierarchicalBitmap::kNotFound);
+  REQUIRE(bitmap.FindPrevious(bitmap.size(), true) == bitmap.size() - 1);
+  bitmap.SetRange(1, bitmap.size() - 2, false);
+  REQUIRE(bitmap.FindNext(1, true) == bitmap.size() - 1);
+  REQUIRE(bitmap.FindPrevious(bitmap.size() - 2, true) == 0);
+  bitmap.SetRange(5000, 3, true);
+  REQUIRE(bitmap.FindNext(1, true) == 5000);
+  REQUIRE(bitmap.FindNext(5001, false) == 5003);
+  REQUIRE(bitmap.FindPrevious(bitmap.size() - 2, true) == 5002);
+  REQUIRE(bitmap.FindPrevious(5002, false) == 4999);
+}
+
+TEST_CASE("HierarchicalBitmap random ranges") {
+  std::mt19937 random(0);
+  for (size_t size : {size_t(1), size_t(63), size_t(64), size_t(4097),
+                      size_t(64 * 64 * 4)}) {
+    HierarchicalBitmap bitmap;
+    bitmap.Reset(size, false);
+    std::vector<bool> reference(size, false);
+    for (uint32_t i = 0; i < 2000; ++i) {
+      size_t first = random() % size;
+      size_t count = random() % (std::min(size - first, size_t(300)) + 1);
+      bool value = random() & 1;
+      bitmap.SetRange(first, count, value);
+      for (size_t j = first; j < first + count; ++j) {
+        reference[j] = value;
+      }
+      size_t index = random() % size;
+      bool find_value = random() & 1;
+      size_t expected_next = HierarchicalBitmap::kNotFound;
+      for (size_t j = index; j < size; ++j) {
+        if (reference[j] == find_value) {
+          expected_next = j;
+          break;
+        }
+      }
+      REQUIRE(bitmap.FindNext(index, find_value) == expected_next);
+      size_t expected_previous = HierarchicalBitmap::kNotFound;
+      for (size_t j = index + 1; j-- > 0;) {
+        if (reference[j] == find_value) {
+          expected_previous = j;
+          break;
+        }
+      }
+      REQUIRE(bitmap.FindPrevious(index, find_value) == expected_previous);
+      REQUIRE(bitmap.Test(index) == reference[index]);
+    }
+  }
+}
+
+}  // namespace test
+}  // namespace base
+}  // namespace xe
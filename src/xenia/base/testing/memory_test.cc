@@ -14,7 +14,10 @@
 
 #include "xenia/base/clock.h"
 
+#include <algorithm>
 #include <array>
+#include <cstring>
+#include <vector>
 
 namespace xe {
 namespace base {
@@ -506,6 +509,190 @@ TEST_CASE("copy_and_swap_16_in_32_unaligned", "[copy_and_swap]") {
   }
 }
 
+// Lengths and offsets covering the alignment head, the 256-bit and 512-bit
+// loops and the residual elements of the wide paths.
+TEST_CASE("copy_and_swap_wide", "[copy_and_swap]") {
+  std::vector<uint8_t> src(65536 + 64), dst(65536 + 128);
+  for (size_t i = 0; i < src.size(); ++i) {
+    src[i] = static_cast<uint8_t>(i * 7 + 1);
+  }
+  auto check = [&](auto element, auto&& fn, const char* name) {
+    using T = decltype(element);
+    for (size_t dst_offset : {0, 1, 8, 24}) {
+      for (size_t count : {size_t(255), size_t(4096 / sizeof(T) + 3),
+                           size_t(65536 / sizeof(T))}) {
+        INFO(name << " at offset " << dst_offset << ", count " << count);
+        std::fill(dst.begin(), dst.end(), uint8_t(0xCD));
+        fn(dst.data() + dst_offset, src.data() + 5, count);
+        for (size_t i = 0; i < count; ++i) {
+          REQUIRE(load<T>(dst.data() + dst_offset + i * sizeof(T)) ==
+                  byte_swap(load<T>(src.data() + 5 + i * sizeof(T))));
+        }
+        REQUIRE(dst[dst_offset + count * sizeof(T)] == 0xCD);
+      }
+    }
+  };
+  check(uint16_t(), copy_and_swap_16_unaligned, "copy_and_swap_16_unaligned");
+  check(uint32_t(), copy_and_swap_32_unaligned, "copy_and_swap_32_unaligned");
+  check(uint64_t(), copy_and_swap_64_unaligned, "copy_and_swap_64_unaligned");
+  check(uint16_t(), copy_and_swap_16_streaming, "copy_and_swap_16_streaming");
+  check(uint32_t(), copy_and_swap_32_streaming, "copy_and_swap_32_streaming");
+  check(uint64_t(), copy_and_swap_64_streaming, "copy_and_swap_64_streaming");
+}
+
+TEST_CASE("copy_and_swap_benchmark", "[.][benchmark]") {
+  auto measure = [](const char* name, size_t length, auto&& fn) {
+    uint32_t iterations = uint32_t(std::max(size_t(64 * 1024 * 1024) / length,
+                                            size_t(16)));
+    uint64_t start = Clock::QueryHostTickCount();
+    for (uint32_t i = 0; i < iterations; ++i) {
+      fn();
+    }
+    double seconds = double(Clock::QueryHostTickCount() - start) /
+                     double(Clock::QueryHostTickFrequency());
+    fmt::print("{:<28} {:>9} bytes {:>8.2f} GB/s\n", name, length,
+               double(length) * iterations / seconds / 1e9);
+  };
+  for (size_t length : {size_t(4096), size_t(256 * 1024),
+                        size_t(16 * 1024 * 1024)}) {
+    std::vector<uint8_t> src(length + 64, 0x5A), dst(length + 64);
+    // Aligned to 16 bytes by the allocator.
+    measure("copy_and_swap_16_aligned", length, [&] {
+      copy_and_swap_16_aligned(dst.data(), src.data(), length / 2);
+    });
+    measure("copy_and_swap_32_aligned", length, [&] {
+      copy_and_swap_32_aligned(dst.data(), src.data(), length / 4);
+    });
+    measure("copy_and_swap_32_unaligned", length, [&] {
+      copy_and_swap_32_unaligned(dst.data() + 4, src.data() + 1, length / 4);
+    });
+    measure("copy_and_swap_32_streaming", length, [&] {
+      copy_and_swap_32_streaming(dst.data(), src.data(), length / 4);
+    });
+    measure("copy_and_swap_64_aligned", length, [&] {
+      copy_and_swap_64_aligned(dst.data(), src.data(), length / 8);
+    });
+    measure("memcpy", length,
+            [&] { std::memcpy(dst.data(), src.data(), length); });
+  }
+}
+
+TEST_CASE("find_first_mismatch", "[rtl_helpers]") {
+  std::array<uint8_t, 77> a{}, b{};
+  for (size_t i = 0; i < a.size(); ++i) {
+    a[i] = b[i] = static_cast<uint8_t>(i * 7);
+  }
+  REQUIRE(find_first_mismatch(a.data(), b.data(), a.size()) == a.size());
+  REQUIRE(find_first_mismatch(a.data(), b.data(), 0) == 0);
+  for (size_t i : {size_t(0), size_t(15), size_t(16), size_t(40), size_t(76)}) {
+    INFO(i);
+    b[i] ^= 0x80;
+    REQUIRE(find_first_mismatch(a.data(), b.data(), a.size()) == i);
+    REQUIRE(find_first_mismatch(a.data() + 1, b.data() + 1, a.size() - 1) ==
+            (i ? i - 1 : 0));
+    REQUIRE(find_first_mismatch(a.data(), b.data(), i) == i);
+    b[i] ^= 0x80;
+  }
+}
+
+TEST_CASE("find_first_mismatch_32", "[rtl_helpers]") {
+  std::array<uint32_t, 19> data;
+  data.fill(0x12345678);
+  REQUIRE(find_first_mismatch_32(data.data(), 0x12345678, data.size()) ==
+          data.size());
+  REQUIRE(find_first_mismatch_32(data.data(), 0x78563412, data.size()) == 0);
+  data[17] = 0x12345679;
+  REQUIRE(find_first_mismatch_32(data.data(), 0x12345678, data.size()) == 17);
+  data[5] = 0;
+  REQUIRE(find_first_mismatch_32(data.data(), 0x12345678, data.size()) == 5);
+}
+
+TEST_CASE("fill_32", "[rtl_helpers]") {
+  std::array<uint32_t, 21> data{};
+  fill_32(data.data() + 1, 0xAABBCCDD, 19);
+  REQUIRE(data[0] == 0);
+  for (size_t i = 1; i < 20; ++i) {
+    REQUIRE(data[i] == 0xAABBCCDD);
+  }
+  REQUIRE(data[20] == 0);
+}
+
+TEST_CASE("widen_and_swap_8_to_16", "[rtl_helpers]") {
+  constexpr size_t count = 37;
+  std::array<uint8_t, count> src;
+  std::array<uint16_t, count + 1> dst{};
+  for (size_t i = 0; i < count; ++i) {
+    src[i] = static_cast<uint8_t>(0xF0 + i);
+  }
+  widen_and_swap_8_to_16(dst.data(), src.data(), count);
+  for (size_t i = 0; i < count; ++i) {
+    REQUIRE(dst[i] == byte_swap(uint16_t(src[i])));
+  }
+  REQUIRE(dst[count] == 0);
+}
+
+TEST_CASE("narrow_and_swap_16_to_8", "[rtl_helpers]") {
+  constexpr size_t count = 37;
+  std::array<uint16_t, count> src;
+  std::array<uint8_t, count + 1> dst{};
+  for (size_t i = 0; i < count; ++i) {
+    uint16_t c = i % 3 ? static_cast<uint16_t>(0xF0 + i)
+                       : static_cast<uint16_t>(0x100 * i + 0x41);
+    src[i] = byte_swap(c);
+  }
+  narrow_and_swap_16_to_8(dst.data(), src.data(), count, '?');
+  for (size_t i = 0; i < count; ++i) {
+    uint16_t c = byte_swap(src[i]);
+    REQUIRE(dst[i] == (c < 0x100 ? c : '?'));
+  }
+  REQUIRE(dst[count] == 0);
+}
+
+// Not run by default, select with [benchmark].
+TEST_CASE("rtl_helpers_benchmark", "[.][benchmark]") {
+  constexpr size_t kLength = 4096;
+  constexpr uint32_t kIterations = 20000;
+  std::vector<uint8_t> a(kLength, 0x5A), b(kLength, 0x5A);
+  std::vector<uint16_t> wide(kLength);
+  auto measure = [](const char* name, auto&& fn) {
+    uint64_t start = Clock::QueryHostTickCount();
+    for (uint32_t i = 0; i < kIterations; ++i) {
+      fn();
+    }
+    double ns = double(Clock::QueryHostTickCount() - start) * 1000000000.0 /
+                double(Clock::QueryHostTickFrequency()) / kIterations;
+    fmt::print("{:<32} {:>10.1f} ns\n", name, ns);
+  };
+  volatile size_t sink = 0;
+  measure("find_first_mismatch", [&] {
+    sink = find_first_mismatch(a.data(), b.data(), kLength);
+  });
+  measure("find_first_mismatch (scalar)", [&] {
+    size_t i = 0;
+    for (; i < kLength && a[i] == b[i]; ++i) {
+      sink = i;
+    }
+    sink = i;
+  });
+  measure("find_first_mismatch_32", [&] {
+    sink = find_first_mismatch_32(a.data(), 0x5A5A5A5A, kLength / 4);
+  });
+  measure("fill_32", [&] { fill_32(a.data(), 0x5A5A5A5A, kLength / 4); });
+  measure("widen_and_swap_8_to_16", [&] {
+    widen_and_swap_8_to_16(wide.data(), a.data(), kLength);
+  });
+  measure("widen_and_swap_8_to_16 (scalar)", [&] {
+    for (size_t i = 0; i < kLength; ++i) {
+      wide[i] = byte_swap(uint16_t(a[i]));
+      sink = i;
+    }
+  });
+  measure("narrow_and_swap_16_to_8", [&] {
+    narrow_and_swap_16_to_8(b.data(), wide.data(), kLength, '?');
+  });
+  REQUIRE(a == b);
+}
+
 TEST_CASE("create_and_close_file_mapping", "Virtual Memory Mapping") {
   auto path = fmt::format("xenia_test_{}", Clock::QueryHostTickCount());
   auto memory = xe::memory::CreateFileMappingHandle(
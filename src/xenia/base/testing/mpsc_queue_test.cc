@@ -0,0 +1,74 @@
+/**
+******************************************************************************
+* Xenia : Xbox 360 Emulator Research Project                                 *
+******************************************************************************
+* Copyright 2022 Ben Vanik. All rights reserved.                             *
+* Released under the BSD license - see LICENSE in the root for more details. *
+******************************************************************************
+*/
+
+#include <thread>
+#include <vector>
+
+#include "xenia/base/mpsc_queue.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe {
+namespace base {
+namespace test {
+
+TEST_CASE("BoundedMpscQueue full and empty") {
+  BoundedMpscQueue<uint32_t, 4> queue;
+  uint32_t value;
+  REQUIRE(!queue.Pop(value));
+  for (uint32_t lap = 0; lap < 3; ++lap) {
+    for (uint32_t i = 0; i < 4; ++i) {
+      REQUIRE(queue.Push(lap * 4 + i));
+    }
+    REQUIRE(!queue.Push(0));
+    for (uint32_t i = 0; i < 4; ++i) {
+      REQUIRE(queue.Pop(value));
+      REQUIRE(value == lap * 4 + i);
+    }
+    REQUIRE(!queue.Pop(value));
+  }
+}
+
+TEST_CASE("BoundedMpscQueue multiple producers") {
+  constexpr uint32_t kProducerCount = 4;
+  constexpr uint32_t kValuesPerProducer = 100000;
+  BoundedMpscQueue<uint32_t, 64> queue;
+  std::vector<std::thread> producers;
+  for (uint32_t i = 0; i < kProducerCount; ++i) {
+    producers.emplace_back([&queue, i]() {
+      for (uint32_t j = 0; j < kValuesPerProducer; ++j) {
+        while (!queue.Push(i * kValuesPerProducer + j)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  // Every producer's values must arrive in order and exactly once.
+  std::vector<uint32_t> next_values(kProducerCount, 0);
+  uint32_t value;
+  for (uint32_t received = 0; received < kProducerCount * kValuesPerProducer;) {
+    if (!queue.Pop(value)) {
+      std::this_thread::yield();
+      continue;
+    }
+    uint32_t producer = value / kValuesPerProducer;
+    REQUIRE(producer < kProducerCount);
+    REQUIRE(value % kValuesPerProducer == next_values[producer]);
+    ++next_values[producer];
+    ++received;
+  }
+  for (std::thread& producer : producers) {
+    producer.join();
+  }
+  REQUIRE(!queue.Pop(value));
+}
+
+}  // namespace test
+}  // namespace base
+}  // namespace xe
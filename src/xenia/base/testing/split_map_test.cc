@@ -0,0 +1,107 @@
+/**
+******************************************************************************
+* Xenia : Xbox 360 Emulator Research Project                                 *
+******************************************************************************
+* Copyright 2022 Ben Vanik. All rights reserved.                             *
+* Released under the BSD license - see LICENSE in the root for more details. *
+******************************************************************************
+*/
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/split_map.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe {
+namespace base {
+namespace test {
+
+namespace {
+
+template <template <typename> class TSearch>
+void FillRandom(split_map<uint32_t, uint32_t, TSearch>& map, uint32_t count,
+                uint32_t seed) {
+  std::mt19937 random(seed);
+  while (map.size() < count) {
+    // Covering the sign bit for the SIMD comparison.
+    uint32_t key = uint32_t(random());
+    uint32_t index = map.IndexForKey(key);
+    if (index != map.size() && *map.KeyAt(index) == key) {
+      continue;
+    }
+    map.InsertAt(key, map.size(), index);
+  }
+}
+
+}  // namespace
+
+TEST_CASE("split_map_blocked_search", "[split_map]") {
+  for (uint32_t count : {0, 1, 15, 16, 17, 100, 1000, 4099}) {
+    split_map<uint32_t, uint32_t> reference;
+    split_map<uint32_t, uint32_t, split_map_blocked_search> blocked;
+    FillRandom(reference, count, count);
+    FillRandom(blocked, count, count);
+    REQUIRE(blocked.Keys() == reference.Keys());
+    for (uint32_t key : reference.Keys()) {
+      REQUIRE(blocked.IndexForKey(key) == reference.IndexForKey(key));
+      REQUIRE(blocked.IndexForKey(key - 1) == reference.IndexForKey(key - 1));
+      REQUIRE(blocked.IndexForKey(key + 1) == reference.IndexForKey(key + 1));
+    }
+    REQUIRE(blocked.IndexForKey(0) == reference.IndexForKey(0));
+    REQUIRE(blocked.IndexForKey(UINT32_MAX) ==
+            reference.IndexForKey(UINT32_MAX));
+
+    // The block vector must follow erasure.
+    while (blocked.size() > count / 2) {
+      blocked.EraseAt(blocked.size() / 3);
+      reference.EraseAt(reference.size() / 3);
+    }
+    for (uint32_t key : reference.Keys()) {
+      REQUIRE(blocked.IndexForKey(key) == reference.IndexForKey(key));
+      REQUIRE(blocked.IndexForKey(key + 1) == reference.IndexForKey(key + 1));
+    }
+  }
+}
+
+// Lookup time of both policies with key counts of the function entry table of
+// typical titles.
+TEST_CASE("split_map_search_benchmark", "[.][benchmark]") {
+  constexpr uint32_t kLookupCount = 1 << 20;
+  for (uint32_t count : {256, 4096, 32768, 131072}) {
+    split_map<uint32_t, uint32_t> binary;
+    split_map<uint32_t, uint32_t, split_map_blocked_search> blocked;
+    FillRandom(binary, count, count);
+    FillRandom(blocked, count, count);
+    std::vector<uint32_t> lookup_keys(kLookupCount);
+    std::mt19937 random(count + 1);
+    for (uint32_t& key : lookup_keys) {
+      key = binary.Keys()[random() % count];
+    }
+    uint64_t binary_index_sum = 0, blocked_index_sum = 0;
+    uint64_t binary_start = Clock::QueryHostTickCount();
+    for (uint32_t key : lookup_keys) {
+      binary_index_sum += binary.IndexForKey(key);
+    }
+    uint64_t blocked_start = Clock::QueryHostTickCount();
+    for (uint32_t key : lookup_keys) {
+      blocked_index_sum += blocked.IndexForKey(key);
+    }
+    uint64_t blocked_end = Clock::QueryHostTickCount();
+    REQUIRE(blocked_index_sum == binary_index_sum);
+    double ns_per_tick = 1000000000.0 / double(Clock::QueryHostTickFrequency());
+    std::printf(
+        "split_map with %u keys: binary search %.1f ns, blocked search %.1f "
+        "ns per lookup\n",
+        count,
+        double(blocked_start - binary_start) * ns_per_tick / kLookupCount,
+        double(blocked_end - blocked_start) * ns_per_tick / kLookupCount);
+  }
+}
+
+}  // namespace test
+}  // namespace base
+}  // namespace xe
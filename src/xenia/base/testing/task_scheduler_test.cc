@@ -0,0 +1,66 @@
+/**
+******************************************************************************
+* Xenia : Xbox 360 Emulator Research Project                                 *
+******************************************************************************
+* Copyright 2022 Ben Vanik. All rights reserved.                             *
+* Released under the BSD license - see LICENSE in the root for more details. *
+******************************************************************************
+*/
+
+#include <atomic>
+#include <vector>
+
+#include "xenia/base/task_scheduler.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+namespace xe {
+namespace base {
+namespace test {
+using namespace threading;
+
+TEST_CASE("TaskScheduler Submit") {
+  TaskScheduler scheduler(4);
+  REQUIRE(scheduler.worker_count() == 4);
+  REQUIRE(scheduler.current_worker_index() == TaskScheduler::kAnyWorker);
+
+  std::atomic<uint32_t> run_count(0);
+  Fence fence;
+  constexpr uint32_t kTaskCount = 64;
+  for (uint32_t i = 0; i < kTaskCount; ++i) {
+    scheduler.Submit(
+        [&]() {
+          if (run_count.fetch_add(1) + 1 == kTaskCount) {
+            fence.Signal();
+          }
+        },
+        TaskScheduler::Priority(i % uint32_t(TaskScheduler::Priority::kCount)),
+        (i & 1) ? i : TaskScheduler::kAnyWorker);
+  }
+  fence.Wait();
+  REQUIRE(run_count == kTaskCount);
+}
+
+TEST_CASE("TaskScheduler ParallelFor") {
+  TaskScheduler scheduler(3);
+
+  std::vector<std::atomic<uint32_t>> visits(1000);
+  scheduler.ParallelFor(
+      visits.size(), [&](size_t i) { visits[i].fetch_add(1); }, 7);
+  for (const auto& visit_count : visits) {
+    REQUIRE(visit_count == 1);
+  }
+
+  // Nested in tasks, with the workers waiting for each other.
+  std::atomic<uint32_t> inner_count(0);
+  scheduler.ParallelFor(8, [&](size_t i) {
+    scheduler.ParallelFor(16, [&](size_t j) { inner_count.fetch_add(1); });
+  });
+  REQUIRE(inner_count == 8 * 16);
+
+  scheduler.ParallelFor(0, [](size_t i) { REQUIRE(false); });
+}
+
+}  // namespace test
+}  // namespace base
+}  // namespace xe
@@ -884,6 +884,22 @@ TEST_CASE("Wait on Multiple Timers", "[timer]") {
   REQUIRE(any_result.second == 1);
 }
 
+TEST_CASE("Wait on Many Timers", "[timer]") {
+  // Spread over several wheel levels, set in reverse order of expiry.
+  std::vector<std::unique_ptr<Timer>> timers;
+  for (int i = 0; i < 64; ++i) {
+    timers.emplace_back(Timer::CreateManualResetTimer());
+    REQUIRE(timers.back());
+  }
+  for (int i = int(timers.size()) - 1; i >= 0; --i) {
+    REQUIRE(timers[i]->SetOnceAfter(std::chrono::microseconds(i * i * 50)));
+  }
+  for (size_t i = 0; i < timers.size(); ++i) {
+    INFO(i);
+    REQUIRE(Wait(timers[i].get(), false, 1s) == WaitResult::kSuccess);
+  }
+}
+
 TEST_CASE("Create and Trigger Timer Callbacks", "[timer]") {
   // TODO(bwrsandman): Check which thread performs callback and timing of
   // callback
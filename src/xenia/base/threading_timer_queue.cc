@@ -8,7 +8,7 @@
  */
 
 #include <algorithm>
-#include <forward_list>
+#include <vector>
 
 #include "third_party/disruptorplus/include/disruptorplus/blocking_wait_strategy.hpp"
 #include "third_party/disruptorplus/include/disruptorplus/multi_threaded_claim_strategy.hpp"
@@ -17,9 +17,17 @@
 #include "third_party/disruptorplus/include/disruptorplus/spin_wait.hpp"
 #include "third_party/disruptorplus/include/disruptorplus/spin_wait_strategy.hpp"
 #include "xenia/base/assert.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/math.h"
 #include "xenia/base/threading.h"
 #include "xenia/base/threading_timer_queue.h"
 
+DEFINE_uint32(timer_coalescing_slack_us, 0,
+              "Microseconds the timer thread may wait past the earliest due "
+              "timer, so timers due close to each other are handled in one "
+              "wakeup.",
+              "General");
+
 namespace dp = disruptorplus;
 
 namespace xe {
@@ -38,6 +46,148 @@ using WaitItem = TimerQueueWaitItem;
 */
 using WaitStrat = dp::blocking_wait_strategy;
 
+// Hierarchical timing wheel: kLevelCount levels of kSlotCount slots, with each
+// slot of a level spanning a whole rotation of the level below. Timers are put
+// in the lowest level that can hold their due tick relative to the current
+// one, and moved down when the current tick enters their slot, so insertion
+// and expiration don't depend on the number of timers.
+class TimerWheel {
+ public:
+  using clock = WaitItem::clock;
+  // Timers are due at the end of the tick they're in, never early.
+  static constexpr clock::duration kTickDuration =
+      std::chrono::microseconds(64);
+
+  explicit TimerWheel(clock::time_point start) : start_(start) {}
+
+  void Insert(std::shared_ptr<WaitItem> wait_item) {
+    ++count_;
+    uint64_t tick = current_tick_;
+    if (wait_item->due_ > start_) {
+      tick = std::max(
+          tick, uint64_t((wait_item->due_ - start_ + kTickDuration -
+                          clock::duration(1)) /
+                         kTickDuration));
+    }
+    for (uint32_t level = 0; level < kLevelCount; ++level) {
+      uint32_t rotation_shift = kSlotBits * (level + 1);
+      if ((tick >> rotation_shift) == (current_tick_ >> rotation_shift)) {
+        uint32_t slot = uint32_t(tick >> (kSlotBits * level)) & kSlotMask;
+        slots_[level][slot].push_back(std::move(wait_item));
+        occupied_[level] |= uint64_t(1) << slot;
+        return;
+      }
+    }
+    overflow_.push_back(std::move(wait_item));
+  }
+
+  // Moves the timers due at or before now to due_items.
+  void Advance(clock::time_point now,
+               std::vector<std::shared_ptr<WaitItem>>& due_items) {
+    if (now < start_) {
+      return;
+    }
+    uint64_t target_tick = uint64_t((now - start_) / kTickDuration);
+    while (count_ && current_tick_ <= target_tick) {
+      uint32_t slot = uint32_t(current_tick_) & kSlotMask;
+      if (occupied_[0] & (uint64_t(1) << slot)) {
+        auto& slot_items = slots_[0][slot];
+        count_ -= slot_items.size();
+        for (auto& wait_item : slot_items) {
+          due_items.push_back(std::move(wait_item));
+        }
+        slot_items.clear();
+        occupied_[0] &= ~(uint64_t(1) << slot);
+      }
+      // Skip to the next occupied slot in the rotation, or to its end, where
+      // the slots of the upper levels that have been entered are moved down.
+      uint64_t later_slots = occupied_[0] & ~((uint64_t(2) << slot) - 1);
+      uint64_t rotation_start = current_tick_ & ~uint64_t(kSlotMask);
+      uint64_t next_tick =
+          rotation_start + (later_slots ? xe::tzcnt(later_slots) : kSlotCount);
+      current_tick_ = std::min(next_tick, target_tick + 1);
+      if (current_tick_ == rotation_start + kSlotCount) {
+        Cascade();
+      }
+    }
+    if (!count_) {
+      current_tick_ = std::max(current_tick_, target_tick + 1);
+    }
+  }
+
+  // The earliest time a timer may be due, or max if there are none.
+  clock::time_point NextDue() const {
+    if (!count_) {
+      return clock::time_point::max();
+    }
+    for (uint32_t level = 0; level < kLevelCount; ++level) {
+      uint32_t level_shift = kSlotBits * level;
+      uint32_t slot = uint32_t(current_tick_ >> level_shift) & kSlotMask;
+      // The current slot of the upper levels has already been moved down.
+      uint64_t ahead_slots =
+          occupied_[level] & ~((uint64_t(level ? 2 : 1) << slot) - 1);
+      if (ahead_slots) {
+        uint32_t rotation_shift = level_shift + kSlotBits;
+        uint64_t tick =
+            ((current_tick_ >> rotation_shift) << rotation_shift) +
+            (uint64_t(xe::tzcnt(ahead_slots)) << level_shift);
+        return start_ + std::max(tick, current_tick_) * kTickDuration;
+      }
+    }
+    // Only overflowing timers, wake up when they're moved into the wheel.
+    uint32_t overflow_shift = kSlotBits * kLevelCount;
+    uint64_t tick = ((current_tick_ >> overflow_shift) + 1) << overflow_shift;
+    return start_ + tick * kTickDuration;
+  }
+
+ private:
+  static constexpr uint32_t kSlotBits = 6;
+  static constexpr uint32_t kSlotCount = 1 << kSlotBits;
+  static constexpr uint32_t kSlotMask = kSlotCount - 1;
+  static constexpr uint32_t kLevelCount = 4;
+
+  // Called when current_tick_ enters a new rotation of level 0, moves down the
+  // timers in the slots of the upper levels that it has entered, from the
+  // highest so their timers can be moved down further.
+  void Cascade() {
+    uint32_t level_count = 1;
+    while (level_count < kLevelCount &&
+           !((current_tick_ >> (kSlotBits * level_count)) & kSlotMask)) {
+      ++level_count;
+    }
+    std::vector<std::shared_ptr<WaitItem>> wait_items;
+    if (level_count == kLevelCount) {
+      wait_items.swap(overflow_);
+      Reinsert(wait_items);
+    }
+    for (uint32_t level = std::min(level_count, kLevelCount - 1); level >= 1;
+         --level) {
+      uint32_t slot =
+          uint32_t(current_tick_ >> (kSlotBits * level)) & kSlotMask;
+      if (occupied_[level] & (uint64_t(1) << slot)) {
+        wait_items.swap(slots_[level][slot]);
+        occupied_[level] &= ~(uint64_t(1) << slot);
+        Reinsert(wait_items);
+      }
+    }
+  }
+
+  void Reinsert(std::vector<std::shared_ptr<WaitItem>>& wait_items) {
+    count_ -= wait_items.size();
+    for (auto& wait_item : wait_items) {
+      Insert(std::move(wait_item));
+    }
+    wait_items.clear();
+  }
+
+  clock::time_point start_;
+  uint64_t current_tick_ = 0;
+  size_t count_ = 0;
+  uint64_t occupied_[kLevelCount] = {};
+  std::vector<std::shared_ptr<WaitItem>> slots_[kLevelCount][kSlotCount];
+  std::vector<std::shared_ptr<WaitItem>> overflow_;
+};
+
 class TimerQueue {
  public:
   using clock = WaitItem::clock;
@@ -49,6 +199,7 @@ class TimerQueue {
         wait_strategy_(),
         claim_strategy_(kWaitCount, wait_strategy_),
         consumed_(wait_strategy_),
+        wait_wheel_(clock::now()),
         shutdown_(false) {
     claim_strategy_.add_claim_barrier(consumed_);
     dispatch_thread_ = std::thread(&TimerQueue::TimerThreadMain, this);
@@ -69,43 +220,36 @@ class TimerQueue {
 
   void TimerThreadMain() {
     dp::sequence_t next_sequence = 0;
-    const auto comp = [](const std::shared_ptr<WaitItem>& left,
-                         const std::shared_ptr<WaitItem>& right) {
-      return left->due_ < right->due_;
-    };
+    std::vector<std::shared_ptr<WaitItem>> due_items;
 
     xe::threading::set_name("xe::threading::TimerQueue");
 
     while (!shutdown_.load(std::memory_order_relaxed)) {
       {
-        // Consume new wait items and add them to sorted wait queue
+        // Consume new wait items and add them to the wheel, waking up late by
+        // the coalescing slack to handle timers due close together at once.
+        auto next_due = wait_wheel_.NextDue();
+        if (next_due != clock::time_point::max()) {
+          next_due += std::chrono::microseconds(
+              cvars::timer_coalescing_slack_us);
+        }
         dp::sequence_t available = claim_strategy_.wait_until_published(
-            next_sequence, next_sequence - 1,
-            wait_queue_.empty() ? clock::time_point::max()
-                                : wait_queue_.front()->due_);
+            next_sequence, next_sequence - 1, next_due);
 
         // Check for timeout
         if (available != next_sequence - 1) {
-          std::forward_list<std::shared_ptr<WaitItem>> wait_items;
           do {
-            wait_items.push_front(std::move(buffer_[next_sequence]));
+            wait_wheel_.Insert(std::move(buffer_[next_sequence]));
           } while (next_sequence++ != available);
 
           consumed_.publish(available);
-
-          wait_items.sort(comp);
-          wait_queue_.merge(wait_items, comp);
         }
       }
 
       {
-        // Check wait queue, invoke callbacks and reschedule
-        std::forward_list<std::shared_ptr<WaitItem>> wait_items;
-        while (!wait_queue_.empty() &&
-               wait_queue_.front()->due_ <= clock::now()) {
-          auto wait_item = std::move(wait_queue_.front());
-          wait_queue_.pop_front();
-
+        // Check the wheel, invoke callbacks and reschedule
+        wait_wheel_.Advance(clock::now(), due_items);
+        for (auto& wait_item : due_items) {
           // Ensure that it isn't disarmed
           auto state = WaitItem::State::kIdle;
           if (wait_item->state_.compare_exchange_strong(
@@ -122,7 +266,7 @@ class TimerQueue {
               wait_item->due_ += wait_item->interval_;
               wait_item->state_.store(WaitItem::State::kIdle,
                                       std::memory_order_release);
-              wait_items.push_front(std::move(wait_item));
+              wait_wheel_.Insert(std::move(wait_item));
             } else {
               wait_item->state_.store(WaitItem::State::kDisarmed,
                                       std::memory_order_release);
@@ -132,8 +276,7 @@ class TimerQueue {
             assert_true(WaitItem::State::kDisarmed == state);
           }
         }
-        wait_items.sort(comp);
-        wait_queue_.merge(wait_items, comp);
+        due_items.clear();
       }
     }
   }
@@ -163,9 +306,8 @@ class TimerQueue {
   dp::multi_threaded_claim_strategy<WaitStrat> claim_strategy_;
   dp::sequence_barrier<WaitStrat> consumed_;
 
-  // This is a _sorted_ (ascending due_) list of active timers managed by a
-  // dedicated thread
-  std::forward_list<std::shared_ptr<WaitItem>> wait_queue_;
+  // Active timers managed by a dedicated thread
+  TimerWheel wait_wheel_;
   std::atomic_bool shutdown_;
   std::thread dispatch_thread_;
 };
@@ -10,7 +10,9 @@
 #ifndef XENIA_CPU_BACKEND_BACKEND_H_
 #define XENIA_CPU_BACKEND_BACKEND_H_
 
+#include <cstddef>
 #include <memory>
+#include <vector>
 
 #include "xenia/cpu/backend/machine_info.h"
 #include "xenia/cpu/thread_debug_info.h"
@@ -63,6 +65,22 @@ class Backend {
   virtual std::unique_ptr<GuestFunction> CreateGuestFunction(
       Module* module, uint32_t address) = 0;
 
+  // Defines the function using previously generated machine code (such as
+  // from a persistent cache) if it's available, skipping translation.
+  virtual bool LoadCachedFunction(GuestFunction* function) { return false; }
+
+  // Called when the function at the address is removed from the processor, so
+  // code referring to it directly must not call its machine code anymore.
+  virtual void OnFunctionRemoved(uint32_t guest_address) {}
+
+  // Size of the machine code of removed functions that is waiting to be
+  // reclaimed.
+  virtual size_t retired_code_size() const { return 0; }
+  // Called with all threads that may be executing guest code suspended, with
+  // the return addresses in their stacks and the values of their registers.
+  // Reuses the memory of removed functions that none of them point into.
+  virtual void ReclaimRetiredCode(std::vector<uint64_t> live_addresses) {}
+
   // Calculates the next host instruction based on the current thread state and
   // current PC. This will look for branches and other control flow
   // instructions.
@@ -72,6 +90,9 @@ class Backend {
   virtual void InstallBreakpoint(Breakpoint* breakpoint) {}
   virtual void InstallBreakpoint(Breakpoint* breakpoint, Function* fn) {}
   virtual void UninstallBreakpoint(Breakpoint* breakpoint) {}
+  // Removes the breakpoint only from the code of the function, before the
+  // code is retired.
+  virtual void UninstallBreakpoint(Breakpoint* breakpoint, Function* fn) {}
   // ctx points to the start of a ppccontext, ctx - page_allocation_granularity
   // up until the start of ctx may be used by the backend to store whatever data
   // they want
@@ -0,0 +1,569 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/backend/hir_interpreter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <unordered_map>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/memory.h"
+#include "xenia/cpu/hir/block.h"
+#include "xenia/cpu/hir/instr.h"
+#include "xenia/cpu/hir/label.h"
+#include "xenia/cpu/mmio_handler.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/thread_state.h"
+#include "xenia/memory.h"
+
+namespace xe {
+namespace cpu {
+namespace backend {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::Value;
+using ConstantValue = xe::cpu::hir::Value::ConstantValue;
+
+static bool IsSupported(const Instr* instr) {
+  auto is_integer = [](const Value* value) {
+    return !value || IsScalarIntegralType(value->type);
+  };
+  switch (instr->opcode->num) {
+    // Moves of any type.
+    case OPCODE_ASSIGN:
+    case OPCODE_CAST:
+    case OPCODE_LOAD_LOCAL:
+    case OPCODE_STORE_LOCAL:
+    case OPCODE_LOAD_CONTEXT:
+    case OPCODE_STORE_CONTEXT:
+    case OPCODE_LOAD:
+    case OPCODE_STORE:
+    case OPCODE_LOAD_OFFSET:
+    case OPCODE_STORE_OFFSET:
+    case OPCODE_LOAD_MMIO:
+    case OPCODE_STORE_MMIO:
+    case OPCODE_MEMSET:
+    case OPCODE_MEMORY_BARRIER:
+      return true;
+
+    case OPCODE_SELECT:
+      return is_integer(instr->src1.value) &&
+             instr->dest->type != VEC128_TYPE;
+
+    case OPCODE_ADD:
+    case OPCODE_ADD_CARRY:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+    case OPCODE_MUL_HI:
+    case OPCODE_DIV:
+    case OPCODE_NEG:
+    case OPCODE_ABS:
+    case OPCODE_AND:
+    case OPCODE_AND_NOT:
+    case OPCODE_OR:
+    case OPCODE_XOR:
+    case OPCODE_NOT:
+    case OPCODE_SHL:
+    case OPCODE_SHR:
+    case OPCODE_SHA:
+    case OPCODE_ROTATE_LEFT:
+    case OPCODE_BYTE_SWAP:
+    case OPCODE_CNTLZ:
+    case OPCODE_ZERO_EXTEND:
+    case OPCODE_SIGN_EXTEND:
+    case OPCODE_TRUNCATE:
+      return is_integer(instr->dest) && is_integer(instr->src1.value) &&
+             is_integer(instr->src2.value) && is_integer(instr->src3.value);
+
+    case OPCODE_COMPARE_EQ:
+    case OPCODE_COMPARE_NE:
+    case OPCODE_COMPARE_SLT:
+    case OPCODE_COMPARE_SLE:
+    case OPCODE_COMPARE_SGT:
+    case OPCODE_COMPARE_SGE:
+    case OPCODE_COMPARE_ULT:
+    case OPCODE_COMPARE_ULE:
+    case OPCODE_COMPARE_UGT:
+    case OPCODE_COMPARE_UGE:
+      return is_integer(instr->src1.value) && is_integer(instr->src2.value);
+
+    case OPCODE_BRANCH:
+    case OPCODE_RETURN:
+    case OPCODE_SET_RETURN_ADDRESS:
+    case OPCODE_CALL_INDIRECT:
+      return true;
+    case OPCODE_BRANCH_TRUE:
+    case OPCODE_BRANCH_FALSE:
+    case OPCODE_RETURN_TRUE:
+    case OPCODE_CALL_TRUE:
+    case OPCODE_CALL_INDIRECT_TRUE:
+      return is_integer(instr->src1.value);
+    case OPCODE_CALL:
+      return instr->src1.symbol != nullptr;
+
+    case OPCODE_CALL_EXTERN: {
+      const Function* function = instr->src1.symbol;
+      if (function->behavior() == Function::Behavior::kBuiltin) {
+        return static_cast<const BuiltinFunction*>(function)->handler() !=
+               nullptr;
+      }
+      // Undefined externs are reported by the compiled code.
+      return function->behavior() == Function::Behavior::kExtern &&
+             static_cast<const GuestFunction*>(function)->extern_handler();
+    }
+
+    default:
+      return false;
+  }
+}
+
+std::unique_ptr<InterpretedFunction> InterpretedFunction::Create(
+    HIRBuilder* builder) {
+  std::unique_ptr<InterpretedFunction> function(new InterpretedFunction());
+  // Ops without a destination write to the first value, keep it even if there
+  // are no values.
+  function->initial_frame_.resize(
+      std::max(builder->max_value_ordinal(), uint32_t(1)));
+
+  // Blocks are laid out in order, so falling through to the next block is
+  // just continuing with the next op.
+  std::unordered_map<const Block*, size_t> block_starts;
+  std::vector<std::pair<size_t, const Block*>> branches;
+  for (auto block = builder->first_block(); block; block = block->next) {
+    block_starts.emplace(block, function->ops_.size());
+    for (auto instr = block->instr_head; instr; instr = instr->next) {
+      if (!function->AddOp(instr)) {
+        return nullptr;
+      }
+      uint32_t signature = instr->opcode->signature;
+      for (uint32_t n = 0; n < 3; ++n) {
+        if (GET_OPCODE_SIG_TYPE_SRCN(signature, n) == OPCODE_SIG_TYPE_L) {
+          branches.emplace_back(function->ops_.size() - 1,
+                                instr->srcs[n].label->block);
+        }
+      }
+    }
+  }
+  for (auto& branch : branches) {
+    function->ops_[branch.first].target = block_starts[branch.second];
+  }
+
+  return function;
+}
+
+bool InterpretedFunction::AddOp(const Instr* instr) {
+  switch (instr->opcode->num) {
+    case OPCODE_COMMENT:
+    case OPCODE_NOP:
+    case OPCODE_SOURCE_OFFSET:
+    case OPCODE_CONTEXT_BARRIER:
+    case OPCODE_CACHE_CONTROL:
+    case OPCODE_DELAY_EXECUTION:
+      return true;
+    default:
+      break;
+  }
+  if (!IsSupported(instr)) {
+    return false;
+  }
+
+  Op op = {};
+  op.opcode = instr->opcode->num;
+  op.flags = instr->flags;
+  uint32_t signature = instr->opcode->signature;
+  if (GET_OPCODE_SIG_TYPE_DEST(signature) == OPCODE_SIG_TYPE_V) {
+    op.dest = instr->dest->ordinal;
+    op.dest_type = instr->dest->type;
+  }
+  for (uint32_t n = 0; n < 3; ++n) {
+    const Instr::Op& src = instr->srcs[n];
+    switch (GET_OPCODE_SIG_TYPE_SRCN(signature, n)) {
+      case OPCODE_SIG_TYPE_V:
+        op.src[n] = {src.value->ordinal, src.value->type};
+        if (src.value->IsConstant()) {
+          initial_frame_[src.value->ordinal] = src.value->constant;
+        }
+        break;
+      case OPCODE_SIG_TYPE_O:
+        op.offset = src.offset;
+        break;
+      case OPCODE_SIG_TYPE_S:
+        op.symbol = src.symbol;
+        break;
+      default:
+        break;
+    }
+  }
+  ops_.push_back(op);
+  return true;
+}
+
+static void SwapBytes(TypeName type, ConstantValue& value) {
+  switch (GetTypeSize(type)) {
+    case 2:
+      value.u16 = xe::byte_swap(value.u16);
+      break;
+    case 4:
+      value.u32 = xe::byte_swap(value.u32);
+      break;
+    case 8:
+      value.u64 = xe::byte_swap(value.u64);
+      break;
+    case 16:
+      // Like the vector loads, by 32-bit words.
+      for (uint32_t i = 0; i < 4; ++i) {
+        value.v128.u32[i] = xe::byte_swap(value.v128.u32[i]);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+// MMIO ranges are not accessible from the host directly, and only 32-bit
+// accesses are done to them. The values are in host byte order in the
+// callbacks.
+static void LoadGuest(ppc::PPCContext* context, uint32_t address,
+                      TypeName type, bool byte_swap, ConstantValue& value) {
+  MMIORange* mmio_range =
+      context->processor->memory()->LookupVirtualMappedRange(address);
+  if (mmio_range) {
+    assert_true(GetTypeSize(type) == 4);
+    value.u32 = xe::byte_swap(
+        mmio_range->read(context, mmio_range->callback_context, address));
+  } else {
+    std::memcpy(&value, context->TranslateVirtual<uint8_t*>(address),
+                GetTypeSize(type));
+  }
+  if (byte_swap) {
+    SwapBytes(type, value);
+  }
+}
+
+static void StoreGuest(ppc::PPCContext* context, uint32_t address,
+                       TypeName type, bool byte_swap, ConstantValue value) {
+  if (byte_swap) {
+    SwapBytes(type, value);
+  }
+  MMIORange* mmio_range =
+      context->processor->memory()->LookupVirtualMappedRange(address);
+  if (mmio_range) {
+    assert_true(GetTypeSize(type) == 4);
+    mmio_range->write(context, mmio_range->callback_context, address,
+                      xe::byte_swap(value.u32));
+  } else {
+    std::memcpy(context->TranslateVirtual<uint8_t*>(address), &value,
+                GetTypeSize(type));
+  }
+}
+
+static void CallGuest(ppc::PPCContext* context, uint32_t address,
+                      uint32_t return_address) {
+  Function* function = context->processor->ResolveFunction(address);
+  if (!function) {
+    XELOGE("Interpreter failed to resolve call to {:08X}", address);
+    assert_always();
+    return;
+  }
+  function->Call(context->thread_state, return_address);
+}
+
+void InterpretedFunction::Execute(ppc::PPCContext* context,
+                                  uint32_t return_address) const {
+  std::vector<ConstantValue> frame(initial_frame_);
+  // Set by SET_RETURN_ADDRESS for the next call.
+  uint32_t call_return_address = 0;
+
+  auto get = [&frame](const Operand& operand) {
+    Value value;
+    value.type = operand.type;
+    value.flags = VALUE_IS_CONSTANT;
+    value.constant = frame[operand.value];
+    return value;
+  };
+  auto is_true = [&get](const Operand& operand) {
+    Value value = get(operand);
+    return value.IsConstantTrue();
+  };
+  auto address_of = [&frame](const Operand& operand) {
+    return frame[operand.value].u32;
+  };
+
+  size_t index = 0;
+  while (index < ops_.size()) {
+    const Op& op = ops_[index++];
+    ConstantValue& dest = frame[op.dest];
+    switch (op.opcode) {
+      case OPCODE_ASSIGN:
+      case OPCODE_CAST:
+      case OPCODE_LOAD_LOCAL:
+        // Locals are values of their own in the frame.
+        dest = frame[op.src[0].value];
+        break;
+      case OPCODE_STORE_LOCAL:
+        frame[op.src[0].value] = frame[op.src[1].value];
+        break;
+      case OPCODE_LOAD_CONTEXT:
+        std::memcpy(&dest, reinterpret_cast<uint8_t*>(context) + op.offset,
+                    GetTypeSize(op.dest_type));
+        break;
+      case OPCODE_STORE_CONTEXT:
+        std::memcpy(reinterpret_cast<uint8_t*>(context) + op.offset,
+                    &frame[op.src[1].value], GetTypeSize(op.src[1].type));
+        break;
+      case OPCODE_LOAD:
+        LoadGuest(context, address_of(op.src[0]), op.dest_type,
+                  (op.flags & LOAD_STORE_BYTE_SWAP) != 0, dest);
+        break;
+      case OPCODE_LOAD_OFFSET:
+        LoadGuest(context, address_of(op.src[0]) + address_of(op.src[1]),
+                  op.dest_type, (op.flags & LOAD_STORE_BYTE_SWAP) != 0, dest);
+        break;
+      case OPCODE_STORE:
+        StoreGuest(context, address_of(op.src[0]), op.src[1].type,
+                   (op.flags & LOAD_STORE_BYTE_SWAP) != 0,
+                   frame[op.src[1].value]);
+        break;
+      case OPCODE_STORE_OFFSET:
+        StoreGuest(context, address_of(op.src[0]) + address_of(op.src[1]),
+                   op.src[2].type, (op.flags & LOAD_STORE_BYTE_SWAP) != 0,
+                   frame[op.src[2].value]);
+        break;
+      case OPCODE_LOAD_MMIO:
+        // Of the range and the address offset operands, only the address is
+        // kept.
+        LoadGuest(context, uint32_t(op.offset), INT32_TYPE, false, dest);
+        break;
+      case OPCODE_STORE_MMIO:
+        StoreGuest(context, uint32_t(op.offset), INT32_TYPE, false,
+                   frame[op.src[2].value]);
+        break;
+      case OPCODE_MEMSET: {
+        uint32_t address = address_of(op.src[0]);
+        uint32_t length = address_of(op.src[2]);
+        std::memset(context->TranslateVirtual<uint8_t*>(address),
+                    frame[op.src[1].value].u8, length);
+      } break;
+      case OPCODE_MEMORY_BARRIER:
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        break;
+
+      case OPCODE_SELECT:
+        dest = frame[is_true(op.src[0]) ? op.src[1].value : op.src[2].value];
+        break;
+
+      case OPCODE_ADD:
+      case OPCODE_SUB:
+      case OPCODE_MUL:
+      case OPCODE_MUL_HI:
+      case OPCODE_DIV:
+      case OPCODE_AND:
+      case OPCODE_AND_NOT:
+      case OPCODE_OR:
+      case OPCODE_XOR:
+      case OPCODE_SHL:
+      case OPCODE_SHR:
+      case OPCODE_SHA:
+      case OPCODE_ROTATE_LEFT: {
+        Value value = get(op.src[0]);
+        Value other = get(op.src[1]);
+        bool is_unsigned = (op.flags & ARITHMETIC_UNSIGNED) != 0;
+        switch (op.opcode) {
+          case OPCODE_ADD:
+            value.Add(&other);
+            break;
+          case OPCODE_SUB:
+            value.Sub(&other);
+            break;
+          case OPCODE_MUL:
+            value.Mul(&other);
+            break;
+          case OPCODE_MUL_HI:
+            value.MulHi(&other, is_unsigned);
+            break;
+          case OPCODE_DIV:
+            value.Div(&other, is_unsigned);
+            break;
+          case OPCODE_AND:
+            value.And(&other);
+            break;
+          case OPCODE_AND_NOT:
+            value.AndNot(&other);
+            break;
+          case OPCODE_OR:
+            value.Or(&other);
+            break;
+          case OPCODE_XOR:
+            value.Xor(&other);
+            break;
+          default: {
+            // Counts are masked like by the host instructions.
+            uint8_t bit_count = uint8_t(GetTypeSize(value.type) * 8);
+            other.constant.u8 &= bit_count > 32 ? 63 : 31;
+            if (op.opcode == OPCODE_SHL) {
+              value.Shl(&other);
+            } else if (op.opcode == OPCODE_SHR) {
+              value.Shr(&other);
+            } else if (op.opcode == OPCODE_SHA) {
+              value.Sha(&other);
+            } else {
+              other.constant.u8 &= bit_count - 1;
+              if (other.constant.u8) {
+                value.RotateLeft(&other);
+              }
+            }
+          } break;
+        }
+        dest = value.constant;
+      } break;
+      case OPCODE_ADD_CARRY: {
+        Value value = get(op.src[0]);
+        Value other = get(op.src[1]);
+        value.Add(&other);
+        if (frame[op.src[2].value].u8 & 1) {
+          Value carry;
+          carry.set_zero(value.type);
+          carry.constant.u8 = 1;
+          value.Add(&carry);
+        }
+        dest = value.constant;
+      } break;
+      case OPCODE_NEG:
+      case OPCODE_ABS:
+      case OPCODE_NOT:
+      case OPCODE_BYTE_SWAP:
+      case OPCODE_ZERO_EXTEND:
+      case OPCODE_SIGN_EXTEND:
+      case OPCODE_TRUNCATE: {
+        Value value = get(op.src[0]);
+        switch (op.opcode) {
+          case OPCODE_NEG:
+            value.Neg();
+            break;
+          case OPCODE_ABS:
+            value.Abs();
+            break;
+          case OPCODE_NOT:
+            value.Not();
+            break;
+          case OPCODE_BYTE_SWAP:
+            value.ByteSwap();
+            break;
+          case OPCODE_ZERO_EXTEND:
+            value.ZeroExtend(op.dest_type);
+            break;
+          case OPCODE_SIGN_EXTEND:
+            value.SignExtend(op.dest_type);
+            break;
+          default:
+            value.Truncate(op.dest_type);
+            break;
+        }
+        dest = value.constant;
+      } break;
+      case OPCODE_CNTLZ: {
+        Value value;
+        value.set_zero(op.dest_type);
+        Value other = get(op.src[0]);
+        value.CountLeadingZeros(&other);
+        dest = value.constant;
+      } break;
+      case OPCODE_COMPARE_EQ:
+      case OPCODE_COMPARE_NE:
+      case OPCODE_COMPARE_SLT:
+      case OPCODE_COMPARE_SLE:
+      case OPCODE_COMPARE_SGT:
+      case OPCODE_COMPARE_SGE:
+      case OPCODE_COMPARE_ULT:
+      case OPCODE_COMPARE_ULE:
+      case OPCODE_COMPARE_UGT:
+      case OPCODE_COMPARE_UGE: {
+        Value value = get(op.src[0]);
+        Value other = get(op.src[1]);
+        dest.u64 = value.Compare(op.opcode, &other) ? 1 : 0;
+      } break;
+
+      case OPCODE_BRANCH:
+        index = op.target;
+        break;
+      case OPCODE_BRANCH_TRUE:
+        if (is_true(op.src[0])) {
+          index = op.target;
+        }
+        break;
+      case OPCODE_BRANCH_FALSE:
+        if (!is_true(op.src[0])) {
+          index = op.target;
+        }
+        break;
+      case OPCODE_RETURN:
+        return;
+      case OPCODE_RETURN_TRUE:
+        if (is_true(op.src[0])) {
+          return;
+        }
+        break;
+      case OPCODE_SET_RETURN_ADDRESS:
+        call_return_address = address_of(op.src[0]);
+        break;
+      case OPCODE_CALL:
+      case OPCODE_CALL_TRUE:
+      case OPCODE_CALL_INDIRECT:
+      case OPCODE_CALL_INDIRECT_TRUE: {
+        uint32_t address;
+        if (op.opcode == OPCODE_CALL_TRUE ||
+            op.opcode == OPCODE_CALL_INDIRECT_TRUE) {
+          if (!is_true(op.src[0])) {
+            break;
+          }
+          address = op.opcode == OPCODE_CALL_TRUE ? op.symbol->address()
+                                                  : address_of(op.src[1]);
+        } else {
+          address = op.opcode == OPCODE_CALL ? op.symbol->address()
+                                             : address_of(op.src[0]);
+        }
+        if ((op.flags & CALL_POSSIBLE_RETURN) && address == return_address) {
+          return;
+        }
+        if (op.flags & CALL_TAIL) {
+          CallGuest(context, address, return_address);
+          return;
+        }
+        CallGuest(context, address, call_return_address);
+      } break;
+      case OPCODE_CALL_EXTERN:
+        if (op.symbol->behavior() == Function::Behavior::kBuiltin) {
+          auto builtin_function = static_cast<BuiltinFunction*>(op.symbol);
+          builtin_function->handler()(context, builtin_function->arg0(),
+                                      builtin_function->arg1());
+        } else {
+          static_cast<GuestFunction*>(op.symbol)->extern_handler()(
+              context, context->kernel_state);
+        }
+        break;
+
+      default:
+        assert_unhandled_case(op.opcode);
+        return;
+    }
+  }
+}
+
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
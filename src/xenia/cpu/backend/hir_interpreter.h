@@ -0,0 +1,73 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_BACKEND_HIR_INTERPRETER_H_
+#define XENIA_CPU_BACKEND_HIR_INTERPRETER_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "xenia/cpu/function.h"
+#include "xenia/cpu/hir/hir_builder.h"
+#include "xenia/cpu/hir/opcodes.h"
+#include "xenia/cpu/hir/value.h"
+#include "xenia/cpu/ppc/ppc_context.h"
+
+namespace xe {
+namespace cpu {
+namespace backend {
+
+// HIR of a function flattened for executing it without generating machine
+// code for it, for functions that are likely to be called only a few times,
+// where the translation would take longer than running them. Only integer
+// and memory operations are supported, functions using anything else must be
+// compiled.
+class InterpretedFunction {
+ public:
+  // Returns nullptr if the function uses anything that can't be interpreted.
+  // The builder must have been finalized.
+  static std::unique_ptr<InterpretedFunction> Create(hir::HIRBuilder* builder);
+
+  // Calls made by the function go through Function::Call.
+  void Execute(ppc::PPCContext* context, uint32_t return_address) const;
+
+ private:
+  struct Operand {
+    // Ordinal of the value in the frame.
+    uint32_t value;
+    hir::TypeName type;
+  };
+  struct Op {
+    hir::Opcode opcode;
+    uint16_t flags;
+    uint32_t dest;
+    hir::TypeName dest_type;
+    Operand src[3];
+    // The offset or symbol operand, if any.
+    uint64_t offset;
+    Function* symbol;
+    // Index of the op to continue at for a branch.
+    size_t target;
+  };
+
+  InterpretedFunction() = default;
+
+  bool AddOp(const hir::Instr* instr);
+
+  std::vector<Op> ops_;
+  // Values of the constants, indexed by the value ordinal.
+  std::vector<hir::Value::ConstantValue> initial_frame_;
+};
+
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_BACKEND_HIR_INTERPRETER_H_
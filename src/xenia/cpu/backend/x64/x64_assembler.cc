@@ -75,25 +75,44 @@ bool X64Assembler::Assemble(GuestFunction* function, HIRBuilder* builder,
   // Reset when we leave.
   xe::make_reset_scope(this);
 
+  // Code of a baseline function being optimized may still be running, so its
+  // source map must stay intact.
+  auto x64_function = static_cast<X64Function*>(function);
+  bool recompiling = x64_function->machine_code() != nullptr;
+  std::vector<SourceMapEntry> optimized_source_map;
+  std::vector<SourceMapEntry>& source_map =
+      recompiling ? optimized_source_map : function->source_map();
+
+  // Cold code may be interpreted until it's optimized, the baseline code is
+  // still generated for calling the interpreter and the tier up.
+  if (!recompiling && function->is_baseline() && !debug_info_flags &&
+      cvars::interpret_cold_functions) {
+    x64_function->set_interpreted_function(
+        InterpretedFunction::Create(builder));
+  }
+
   // Lower HIR -> x64.
   void* machine_code = nullptr;
   size_t code_size = 0;
   if (!emitter_->Emit(function, builder, debug_info_flags, debug_info.get(),
-                      &machine_code, &code_size, &function->source_map())) {
+                      &machine_code, &code_size, &source_map)) {
     return false;
   }
 
   // Stash generated machine code.
   if (debug_info_flags & DebugInfoFlags::kDebugInfoDisasmMachineCode) {
-    DumpMachineCode(machine_code, code_size, function->source_map(),
-                    &string_buffer_);
+    DumpMachineCode(machine_code, code_size, source_map, &string_buffer_);
     debug_info->set_machine_code_disasm(xe_strdup(string_buffer_.buffer()));
     string_buffer_.Reset();
   }
 
-  function->set_debug_info(std::move(debug_info));
-  static_cast<X64Function*>(function)->Setup(
-      reinterpret_cast<uint8_t*>(machine_code), code_size);
+  if (recompiling) {
+    x64_function->SetupOptimized(reinterpret_cast<uint8_t*>(machine_code),
+                                 code_size, std::move(optimized_source_map));
+  } else {
+    function->set_debug_info(std::move(debug_info));
+    x64_function->Setup(reinterpret_cast<uint8_t*>(machine_code), code_size);
+  }
 
   // Install into indirection table.
   uint64_t host_address = reinterpret_cast<uint64_t>(machine_code);
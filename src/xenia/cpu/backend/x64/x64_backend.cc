@@ -20,6 +20,7 @@
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
 #include "xenia/cpu/backend/x64/x64_emitter.h"
 #include "xenia/cpu/backend/x64/x64_function.h"
+#include "xenia/cpu/backend/x64/x64_persistent_code_cache.h"
 #include "xenia/cpu/backend/x64/x64_sequences.h"
 #include "xenia/cpu/backend/x64/x64_stack_layout.h"
 #include "xenia/cpu/breakpoint.h"
@@ -37,9 +38,10 @@ DEFINE_int64(max_stackpoints, 65536,
              "Max number of host->guest stack mappings we can record.", "x64");
 
 DEFINE_bool(enable_host_guest_stack_synchronization, true,
-            "Records entries for guest/host stack mappings at function starts "
-            "and checks for reentry at return sites. Has slight performance "
-            "impact, but fixes crashes in games that use setjmp/longjmp.",
+            "Records entries for guest/host stack mappings at the starts of "
+            "functions that make calls and checks for reentry at return "
+            "sites. Has slight performance impact, but fixes crashes in games "
+            "that use setjmp/longjmp.",
             "x64");
 #if XE_X64_PROFILER_AVAILABLE == 1
 DECLARE_bool(instrument_call_times);
@@ -70,9 +72,6 @@ class X64HelperEmitter : public X64Emitter {
   void* EmitGuestAndHostSynchronizeStackSizeLoadThunk(
       void* sync_func, unsigned stack_element_size);
 
-  void* EmitTryAcquireReservationHelper();
-  void* EmitReservedStoreHelper(bool bit64 = false);
-
   void* EmitScalarVRsqrteHelper();
   void* EmitVectorVRsqrteHelper(void* scalar_helper);
 
@@ -282,10 +281,6 @@ bool X64Backend::Initialize(Processor* processor) {
         thunk_emitter.EmitGuestAndHostSynchronizeStackSizeLoadThunk(
             synchronize_guest_and_host_stack_helper_, 4);
   }
-  try_acquire_reservation_helper_ =
-      thunk_emitter.EmitTryAcquireReservationHelper();
-  reserved_store_32_helper = thunk_emitter.EmitReservedStoreHelper(false);
-  reserved_store_64_helper = thunk_emitter.EmitReservedStoreHelper(true);
   vrsqrtefp_scalar_helper = thunk_emitter.EmitScalarVRsqrteHelper();
   vrsqrtefp_vector_helper =
       thunk_emitter.EmitVectorVRsqrteHelper(vrsqrtefp_scalar_helper);
@@ -299,6 +294,12 @@ bool X64Backend::Initialize(Processor* processor) {
   // Allocate some special indirections.
   code_cache_->CommitExecutableRange(0x9FFF0000, 0x9FFFFFFF);
 
+  // Must be created after all the helpers have been placed in the code cache,
+  // since stored code refers to them by their offsets.
+  if (cvars::x64_persistent_code_cache) {
+    persistent_code_cache_ = std::make_unique<X64PersistentCodeCache>(this);
+  }
+
   // Setup exception callback
   ExceptionHandler::Install(&ExceptionCallbackThunk, this);
   if (cvars::record_mmio_access_exceptions) {
@@ -337,6 +338,28 @@ std::unique_ptr<GuestFunction> X64Backend::CreateGuestFunction(
   return std::make_unique<X64Function>(module, address);
 }
 
+bool X64Backend::LoadCachedFunction(GuestFunction* function) {
+  if (!persistent_code_cache_) {
+    return false;
+  }
+  return persistent_code_cache_->LoadFunction(
+      static_cast<X64Function*>(function));
+}
+
+void X64Backend::OnFunctionRemoved(uint32_t guest_address) {
+  uint32_t host_address = code_cache_->GetIndirection(guest_address);
+  code_cache_->RemoveIndirection(guest_address);
+  code_cache_->RetireCode(host_address);
+}
+
+size_t X64Backend::retired_code_size() const {
+  return code_cache_->retired_code_size();
+}
+
+void X64Backend::ReclaimRetiredCode(std::vector<uint64_t> live_addresses) {
+  code_cache_->ReclaimRetiredCode(std::move(live_addresses));
+}
+
 uint64_t ReadCapstoneReg(HostThreadContext* context, x86_reg reg) {
   switch (reg) {
     case X86_REG_RAX:
@@ -521,13 +544,34 @@ uint64_t X64Backend::CalculateNextHostInstruction(ThreadDebugInfo* thread_info,
   }
 }
 
+void X64Backend::PatchBreakpoint(Breakpoint* breakpoint,
+                                 uint64_t host_address) {
+  uint8_t* write_address = code_cache_->LookupWriteAddress(host_address);
+  if (!write_address) {
+    // Host breakpoints may be outside the generated code.
+    write_address = reinterpret_cast<uint8_t*>(host_address);
+  }
+  // Assume we haven't already installed a breakpoint in this spot.
+  auto original_bytes = xe::load_and_swap<uint16_t>(write_address);
+  assert_true(original_bytes != 0x0F0B);
+  xe::store_and_swap<uint16_t>(write_address, 0x0F0B);
+  breakpoint->backend_data().emplace_back(host_address, original_bytes);
+}
+
+void X64Backend::UnpatchBreakpoint(uint64_t host_address,
+                                   uint16_t original_bytes) {
+  uint8_t* write_address = code_cache_->LookupWriteAddress(host_address);
+  if (!write_address) {
+    write_address = reinterpret_cast<uint8_t*>(host_address);
+  }
+  auto instruction_bytes = xe::load_and_swap<uint16_t>(write_address);
+  assert_true(instruction_bytes == 0x0F0B);
+  xe::store_and_swap<uint16_t>(write_address, original_bytes);
+}
+
 void X64Backend::InstallBreakpoint(Breakpoint* breakpoint) {
-  breakpoint->ForEachHostAddress([breakpoint](uint64_t host_address) {
-    auto ptr = reinterpret_cast<void*>(host_address);
-    auto original_bytes = xe::load_and_swap<uint16_t>(ptr);
-    assert_true(original_bytes != 0x0F0B);
-    xe::store_and_swap<uint16_t>(ptr, 0x0F0B);
-    breakpoint->backend_data().emplace_back(host_address, original_bytes);
+  breakpoint->ForEachHostAddress([this, breakpoint](uint64_t host_address) {
+    PatchBreakpoint(breakpoint, host_address);
   });
 }
 
@@ -541,25 +585,33 @@ void X64Backend::InstallBreakpoint(Breakpoint* breakpoint, Function* fn) {
     assert_always();
     return;
   }
-
-  // Assume we haven't already installed a breakpoint in this spot.
-  auto ptr = reinterpret_cast<void*>(host_address);
-  auto original_bytes = xe::load_and_swap<uint16_t>(ptr);
-  assert_true(original_bytes != 0x0F0B);
-  xe::store_and_swap<uint16_t>(ptr, 0x0F0B);
-  breakpoint->backend_data().emplace_back(host_address, original_bytes);
+  PatchBreakpoint(breakpoint, host_address);
 }
 
 void X64Backend::UninstallBreakpoint(Breakpoint* breakpoint) {
   for (auto& pair : breakpoint->backend_data()) {
-    auto ptr = reinterpret_cast<uint8_t*>(pair.first);
-    auto instruction_bytes = xe::load_and_swap<uint16_t>(ptr);
-    assert_true(instruction_bytes == 0x0F0B);
-    xe::store_and_swap<uint16_t>(ptr, static_cast<uint16_t>(pair.second));
+    UnpatchBreakpoint(pair.first, static_cast<uint16_t>(pair.second));
   }
   breakpoint->backend_data().clear();
 }
 
+void X64Backend::UninstallBreakpoint(Breakpoint* breakpoint, Function* fn) {
+  // The memory of the code will be reused, the breakpoint must not be restored
+  // there later.
+  auto& backend_data = breakpoint->backend_data();
+  backend_data.erase(
+      std::remove_if(backend_data.begin(), backend_data.end(),
+                     [this, fn](const std::pair<uint64_t, uint64_t>& pair) {
+                       if (code_cache_->LookupFunction(pair.first) != fn) {
+                         return false;
+                       }
+                       UnpatchBreakpoint(pair.first,
+                                         static_cast<uint16_t>(pair.second));
+                       return true;
+                     }),
+      backend_data.end());
+}
+
 bool X64Backend::ExceptionCallbackThunk(Exception* ex, void* data) {
   auto backend = reinterpret_cast<X64Backend*>(data);
   return backend->ExceptionCallback(ex);
@@ -1342,124 +1394,6 @@ void* X64HelperEmitter::EmitFrsqrteHelper() {
   return EmitCurrentForOffsets(code_offsets);
 }
 
-void* X64HelperEmitter::EmitTryAcquireReservationHelper() {
-  _code_offsets code_offsets = {};
-  code_offsets.prolog = getSize();
-
-  Xbyak::Label already_has_a_reservation;
-  Xbyak::Label acquire_new_reservation;
-
-  btr(GetBackendFlagsPtr(), kX64BackendHasReserveBit);
-  mov(r8, GetBackendCtxPtr(offsetof(X64BackendContext, reserve_helper_)));
-  jc(already_has_a_reservation);
-
-  shr(ecx, RESERVE_BLOCK_SHIFT);
-  xor_(r9d, r9d);
-  mov(edx, ecx);
-  shr(edx, 6);  // divide by 64
-  lea(rdx, ptr[r8 + rdx * 8]);
-  and_(ecx, 64 - 1);
-
-  lock();
-  bts(qword[rdx], rcx);
-  // set flag on local backend context for thread to indicate our previous
-  // attempt to get the reservation succeeded
-  setnc(r9b);  // success = bitmap did not have a set bit at the idx
-  shl(r9b, kX64BackendHasReserveBit);
-
-  mov(GetBackendCtxPtr(offsetof(X64BackendContext, cached_reserve_offset)),
-      rdx);
-  mov(GetBackendCtxPtr(offsetof(X64BackendContext, cached_reserve_bit)), ecx);
-
-  or_(GetBackendCtxPtr(offsetof(X64BackendContext, flags)), r9d);
-  ret();
-  L(already_has_a_reservation);
-  DebugBreak();
-
-  code_offsets.prolog_stack_alloc = getSize();
-  code_offsets.body = getSize();
-  code_offsets.epilog = getSize();
-  code_offsets.tail = getSize();
-  return EmitCurrentForOffsets(code_offsets);
-}
-// ecx=guest addr
-// r9 = host addr
-// r8 = value
-// if ZF is set and CF is set, we succeeded
-void* X64HelperEmitter::EmitReservedStoreHelper(bool bit64) {
-  _code_offsets code_offsets = {};
-  code_offsets.prolog = getSize();
-  Xbyak::Label done;
-  Xbyak::Label reservation_isnt_for_our_addr;
-  Xbyak::Label somehow_double_cleared;
-  // carry must be set + zero flag must be set
-
-  btr(GetBackendFlagsPtr(), kX64BackendHasReserveBit);
-
-  jnc(done);
-
-  mov(rax, GetBackendCtxPtr(offsetof(X64BackendContext, reserve_helper_)));
-
-  shr(ecx, RESERVE_BLOCK_SHIFT);
-  mov(edx, ecx);
-  shr(edx, 6);  // divide by 64
-  lea(rdx, ptr[rax + rdx * 8]);
-  // begin acquiring exclusive access to cacheline containing our bit
-  prefetchw(ptr[rdx]);
-
-  cmp(GetBackendCtxPtr(offsetof(X64BackendContext, cached_reserve_offset)),
-      rdx);
-  jnz(reservation_isnt_for_our_addr);
-
-  mov(rax,
-      GetBackendCtxPtr(offsetof(X64BackendContext, cached_reserve_value_)));
-
-  // we need modulo bitsize, it turns out bittests' modulus behavior for the
-  // bitoffset only applies for register operands, for memory ones we bug out
-  // todo: actually, the above note may not be true, double check it
-  and_(ecx, 64 - 1);
-  cmp(GetBackendCtxPtr(offsetof(X64BackendContext, cached_reserve_bit)), ecx);
-  jnz(reservation_isnt_for_our_addr);
-
-  // was our memory modified by kernel code or something?
-  lock();
-  if (bit64) {
-    cmpxchg(ptr[r9], r8);
-
-  } else {
-    cmpxchg(ptr[r9], r8d);
-  }
-  // the ZF flag is unaffected by BTR! we exploit this for the retval
-
-  // cancel our lock on the 65k block
-  lock();
-  btr(qword[rdx], rcx);
-
-  jnc(somehow_double_cleared);
-
-  L(done);
-  // i don't care that theres a dependency on the prev value of rax atm
-  // sadly theres no CF&ZF condition code
-  setz(al);
-  setc(ah);
-  cmp(ax, 0x0101);
-  ret();
-
-  // could be the same label, but otherwise we don't know where we came from
-  // when one gets triggered
-  L(reservation_isnt_for_our_addr);
-  DebugBreak();
-
-  L(somehow_double_cleared);  // somehow, something else cleared our reserve??
-  DebugBreak();
-
-  code_offsets.prolog_stack_alloc = getSize();
-  code_offsets.body = getSize();
-  code_offsets.epilog = getSize();
-  code_offsets.tail = getSize();
-  return EmitCurrentForOffsets(code_offsets);
-}
-
 void X64HelperEmitter::EmitSaveVolatileRegs() {
   // Save off volatile registers.
   // mov(qword[rsp + offsetof(StackLayout::Thunk, r[0])], rax);
@@ -38,6 +38,7 @@ namespace x64 {
 using GuestProfilerData = std::map<uint32_t, uint64_t>;
 
 class X64CodeCache;
+class X64PersistentCodeCache;
 
 typedef void* (*HostToGuestThunk)(void* target, void* arg0, void* arg1);
 typedef void* (*GuestToHostThunk)(void* target, void* arg0, void* arg1);
@@ -56,15 +57,21 @@ static constexpr uint32_t GUEST_TRAMPOLINE_MIN_LEN = 8;
 static constexpr uint32_t MAX_GUEST_TRAMPOLINES =
     (GUEST_TRAMPOLINE_END - GUEST_TRAMPOLINE_BASE) / GUEST_TRAMPOLINE_MIN_LEN;
 
-#define RESERVE_BLOCK_SHIFT 16
+// Reservations are tracked per guest cache line (128 bytes).
+#define RESERVE_BLOCK_SHIFT 7
 
-#define RESERVE_NUM_ENTRIES \
-  ((1024ULL * 1024ULL * 1024ULL * 4ULL) >> RESERVE_BLOCK_SHIFT)
+// Lines are hashed into the table, so unrelated lines may share a version,
+// that only causes a spurious stwcx. failure, which is allowed.
+#define RESERVE_NUM_ENTRIES (1ULL << 16)
 // https://codalogic.com/blog/2022/12/06/Exploring-PowerPCs-read-modify-write-operations
+// A reserved load records the version of the line, a reserved store first
+// advances the version with a CAS, which fails if any other reserved store
+// to the line succeeded since the load, and then writes the value with a CAS
+// against the loaded value to catch plain stores. None of this takes a lock.
 struct ReserveHelper {
-  uint64_t blocks[RESERVE_NUM_ENTRIES / 64];
+  uint32_t versions[RESERVE_NUM_ENTRIES];
 
-  ReserveHelper() { memset(blocks, 0, sizeof(blocks)); }
+  ReserveHelper() { memset(versions, 0, sizeof(versions)); }
 };
 
 struct X64BackendStackpoint {
@@ -97,8 +104,9 @@ struct X64BackendContext {
   uint64_t* guest_tick_count;
   // records mapping of host_stack to guest_stack
   X64BackendStackpoint* stackpoints;
-  uint64_t cached_reserve_offset;
-  uint32_t cached_reserve_bit;
+  // host address of the reserved data
+  uint64_t cached_reserve_address;
+  uint32_t cached_reserve_version;
   unsigned int current_stackpoint_depth;
   unsigned int mxcsr_fpu;  // currently, the way we implement rounding mode
                            // affects both vmx and the fpu
@@ -123,6 +131,10 @@ class X64Backend : public Backend {
   ~X64Backend() override;
 
   X64CodeCache* code_cache() const { return code_cache_.get(); }
+  // nullptr if generated code is not stored between runs.
+  X64PersistentCodeCache* persistent_code_cache() const {
+    return persistent_code_cache_.get();
+  }
   uintptr_t emitter_data() const { return emitter_data_; }
 
   // Call a generated function, saving all stack parameters.
@@ -156,12 +168,18 @@ class X64Backend : public Backend {
   std::unique_ptr<GuestFunction> CreateGuestFunction(Module* module,
                                                      uint32_t address) override;
 
+  bool LoadCachedFunction(GuestFunction* function) override;
+  void OnFunctionRemoved(uint32_t guest_address) override;
+  size_t retired_code_size() const override;
+  void ReclaimRetiredCode(std::vector<uint64_t> live_addresses) override;
+
   uint64_t CalculateNextHostInstruction(ThreadDebugInfo* thread_info,
                                         uint64_t current_pc) override;
 
   void InstallBreakpoint(Breakpoint* breakpoint) override;
   void InstallBreakpoint(Breakpoint* breakpoint, Function* fn) override;
   void UninstallBreakpoint(Breakpoint* breakpoint) override;
+  void UninstallBreakpoint(Breakpoint* breakpoint, Function* fn) override;
   virtual void InitializeBackendContext(void* ctx) override;
   virtual void DeinitializeBackendContext(void* ctx) override;
   virtual void PrepareForReentry(void* ctx) override;
@@ -191,9 +209,16 @@ class X64Backend : public Backend {
   static bool ExceptionCallbackThunk(Exception* ex, void* data);
   bool ExceptionCallback(Exception* ex);
 
+  // Breakpoints replace the first host instruction of the guest instruction
+  // with ud2 through the writable view of the code cache, so functions don't
+  // need to be translated again to add or remove them.
+  void PatchBreakpoint(Breakpoint* breakpoint, uint64_t host_address);
+  void UnpatchBreakpoint(uint64_t host_address, uint16_t original_bytes);
+
   uintptr_t capstone_handle_ = 0;
 
   std::unique_ptr<X64CodeCache> code_cache_;
+  std::unique_ptr<X64PersistentCodeCache> persistent_code_cache_;
   uintptr_t emitter_data_ = 0;
 
   HostToGuestThunk host_to_guest_thunk_;
@@ -207,9 +232,6 @@ class X64Backend : public Backend {
   void* synchronize_guest_and_host_stack_helper_size32_ = nullptr;
 
  public:
-  void* try_acquire_reservation_helper_ = nullptr;
-  void* reserved_store_32_helper = nullptr;
-  void* reserved_store_64_helper = nullptr;
   void* vrsqrtefp_vector_helper = nullptr;
   void* vrsqrtefp_scalar_helper = nullptr;
   void* frsqrtefp_helper = nullptr;
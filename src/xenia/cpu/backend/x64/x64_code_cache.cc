@@ -9,8 +9,11 @@
 
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
 
+#include <algorithm>
+#include <climits>
 #include <cstdlib>
 #include <cstring>
+#include <iterator>
 
 #if ENABLE_VTUNE
 #include "third_party/vtune/include/jitprofiling.h"
@@ -19,6 +22,7 @@
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/assert.h"
+#include "xenia/base/atomic.h"
 #include "xenia/base/clock.h"
 #include "xenia/base/literals.h"
 #include "xenia/base/logging.h"
@@ -138,7 +142,148 @@ void X64CodeCache::AddIndirection(uint32_t guest_address,
 
   uint32_t* indirection_slot = reinterpret_cast<uint32_t*>(
       indirection_table_base_ + (guest_address - kIndirectionTableBase));
+  std::lock_guard<xe_mutex> lock(call_sites_lock_);
   *indirection_slot = host_address;
+  auto it = call_sites_.find(guest_address);
+  if (it != call_sites_.end()) {
+    for (const CallSite& call_site : it->second) {
+      LinkCallSite(call_site, guest_address, host_address);
+    }
+  }
+}
+
+void X64CodeCache::RemoveIndirection(uint32_t guest_address) {
+  AddIndirection(guest_address, indirection_default_value_);
+}
+
+uint32_t X64CodeCache::GetIndirection(uint32_t guest_address) const {
+  if (!indirection_table_base_) {
+    return indirection_default_value_;
+  }
+  return *reinterpret_cast<const uint32_t*>(
+      indirection_table_base_ + (guest_address - kIndirectionTableBase));
+}
+
+void X64CodeCache::RetireCode(uint32_t host_address) {
+  auto cpu_lock = cpu_critical_region_.Acquire();
+  uintptr_t execute_base = uintptr_t(generated_code_execute_base_);
+  if (host_address == indirection_default_value_ ||
+      host_address < execute_base ||
+      host_address >= execute_base + generated_code_offset_) {
+    return;
+  }
+  uint64_t offset = host_address - execute_base;
+  auto it = std::lower_bound(
+      generated_code_map_.begin(), generated_code_map_.end(), offset,
+      [](const std::pair<uint64_t, GuestFunction*>& entry, uint64_t offset) {
+        return (entry.first >> 32) < offset;
+      });
+  // Only guest code placed at the start of a block is retired, host code and
+  // data are kept forever.
+  if (it == generated_code_map_.end() || (it->first >> 32) != offset ||
+      !it->second) {
+    return;
+  }
+  // The function is being destroyed, the code must not be attributed to it.
+  it->second = nullptr;
+  size_t index = size_t(it - generated_code_map_.begin());
+  retired_code_blocks_.push_back(index);
+  retired_code_size_ += uint32_t(it->first) - offset;
+}
+
+void X64CodeCache::ReclaimRetiredCode(std::vector<uint64_t> live_addresses) {
+  std::sort(live_addresses.begin(), live_addresses.end());
+  auto cpu_lock = cpu_critical_region_.Acquire();
+  uintptr_t execute_base = uintptr_t(generated_code_execute_base_);
+  // Execute offset ranges of the reclaimed blocks.
+  std::vector<std::pair<uint32_t, uint32_t>> reclaimed_ranges;
+  auto retired_it = retired_code_blocks_.begin();
+  while (retired_it != retired_code_blocks_.end()) {
+    size_t index = *retired_it;
+    uint32_t start = uint32_t(generated_code_map_[index].first >> 32);
+    uint32_t end = uint32_t(generated_code_map_[index].first);
+    auto live_it = std::lower_bound(live_addresses.begin(),
+                                    live_addresses.end(), execute_base + start);
+    if (live_it != live_addresses.end() && *live_it < execute_base + end) {
+      ++retired_it;
+      continue;
+    }
+    reclaimed_ranges.emplace_back(start, end);
+    // Make stale jumps into the memory trap until it's reused.
+    std::memset(generated_code_write_base_ + start, 0xCC, end - start);
+    free_code_blocks_.emplace(end - start, index);
+    retired_code_size_ -= end - start;
+    retired_it = retired_code_blocks_.erase(retired_it);
+  }
+  if (reclaimed_ranges.empty()) {
+    return;
+  }
+  std::sort(reclaimed_ranges.begin(), reclaimed_ranges.end());
+  // Forget the call sites in the reclaimed code so they aren't patched with
+  // links anymore.
+  std::lock_guard<xe_mutex> lock(call_sites_lock_);
+  for (auto& call_sites_entry : call_sites_) {
+    std::vector<CallSite>& call_sites = call_sites_entry.second;
+    call_sites.erase(
+        std::remove_if(
+            call_sites.begin(), call_sites.end(),
+            [&](const CallSite& call_site) {
+              uint32_t offset = uint32_t(call_site.execute_address -
+                                         generated_code_execute_base_);
+              auto range_it = std::upper_bound(
+                  reclaimed_ranges.begin(), reclaimed_ranges.end(),
+                  std::make_pair(offset, UINT32_MAX));
+              return range_it != reclaimed_ranges.begin() &&
+                     offset < std::prev(range_it)->second;
+            }),
+        call_sites.end());
+  }
+}
+
+void X64CodeCache::WriteUnlinkedCallSite(uint8_t* call_site,
+                                         uint32_t guest_address) {
+  // mov ebx, guest_address
+  call_site[0] = 0xBB;
+  xe::store(call_site + 1, guest_address);
+  // mov eax, dword [ebx]
+  call_site[5] = 0x67;
+  call_site[6] = 0x8B;
+  call_site[7] = 0x03;
+}
+
+void X64CodeCache::LinkCallSite(const CallSite& call_site,
+                                uint32_t guest_address, uint32_t host_address) {
+  uint8_t code[kCallSiteSize];
+  if (host_address == indirection_default_value_) {
+    WriteUnlinkedCallSite(code, guest_address);
+  } else {
+    int64_t displacement =
+        int64_t(host_address) -
+        int64_t(reinterpret_cast<uintptr_t>(call_site.execute_address) + 5);
+    assert_true(displacement >= INT32_MIN && displacement <= INT32_MAX);
+    // call or jmp rel32
+    code[0] = call_site.is_tail_call ? 0xE9 : 0xE8;
+    xe::store(code + 1, int32_t(displacement));
+    if (call_site.is_tail_call) {
+      // Not reached.
+      code[5] = 0xCC;
+      code[6] = 0xCC;
+      code[7] = 0xCC;
+    } else {
+      // jmp over the padding and the call rax following the sequence.
+      code[5] = 0xEB;
+      code[6] = 0x03;
+      code[7] = 0xCC;
+    }
+  }
+  // Other threads may be executing the code, replace all the instructions in
+  // a single aligned store so they only see either version.
+  uint8_t* write_address = generated_code_write_base_ +
+                           (call_site.execute_address -
+                            generated_code_execute_base_);
+  assert_zero(reinterpret_cast<uintptr_t>(write_address) % kCallSiteSize);
+  xe::atomic_exchange(xe::load<uint64_t>(code),
+                      reinterpret_cast<volatile uint64_t*>(write_address));
 }
 
 void X64CodeCache::CommitExecutableRange(uint32_t guest_low,
@@ -174,7 +319,9 @@ void X64CodeCache::PlaceGuestCode(uint32_t guest_address, void* machine_code,
                                   const EmitFunctionInfo& func_info,
                                   GuestFunction* function_info,
                                   void*& code_execute_address_out,
-                                  void*& code_write_address_out) {
+                                  void*& code_write_address_out,
+                                  const X64CodeRelocation* relocations,
+                                  size_t relocation_count) {
   // Hold a lock while we bump the pointers up. This is important as the
   // unwind table requires entries AND code to be sorted in order.
   size_t low_mark;
@@ -182,73 +329,140 @@ void X64CodeCache::PlaceGuestCode(uint32_t guest_address, void* machine_code,
   uint8_t* code_execute_address;
   UnwindReservation unwind_reservation;
   {
-    auto global_lock = global_critical_region_.Acquire();
-
-    low_mark = generated_code_offset_;
-
-    // Reserve code.
-    // Always move the code to land on 16b alignment.
-    code_execute_address =
-        generated_code_execute_base_ + generated_code_offset_;
-    code_execute_address_out = code_execute_address;
-    uint8_t* code_write_address =
-        generated_code_write_base_ + generated_code_offset_;
-    code_write_address_out = code_write_address;
-    generated_code_offset_ += xe::round_up(func_info.code_size.total, 16);
-
-    auto tail_write_address =
-        generated_code_write_base_ + generated_code_offset_;
-
-    // Reserve unwind info.
-    // We go on the high size of the unwind info as we don't know how big we
-    // need it, and a few extra bytes of padding isn't the worst thing.
-    unwind_reservation = RequestUnwindReservation(generated_code_write_base_ +
-                                                  generated_code_offset_);
-    generated_code_offset_ += xe::round_up(unwind_reservation.data_size, 16);
-
-    auto end_write_address =
-        generated_code_write_base_ + generated_code_offset_;
-
-    high_mark = generated_code_offset_;
-
-    // Store in map. It is maintained in sorted order of host PC dependent on
-    // us also being append-only.
-    generated_code_map_.emplace_back(
-        (uint64_t(code_execute_address - generated_code_execute_base_) << 32) |
-            generated_code_offset_,
-        function_info);
-
-    // TODO(DrChat): The following code doesn't really need to be under the
-    // global lock except for PlaceCode (but it depends on the previous code
-    // already being ran)
-
-    // If we are going above the high water mark of committed memory, commit
-    // some more. It's ok if multiple threads do this, as redundant commits
-    // aren't harmful.
-    size_t old_commit_mark, new_commit_mark;
-    do {
-      old_commit_mark = generated_code_commit_mark_;
-      if (high_mark <= old_commit_mark) break;
-
-      new_commit_mark = old_commit_mark + 16_MiB;
-      if (generated_code_execute_base_ == generated_code_write_base_) {
-        xe::memory::AllocFixed(generated_code_execute_base_, new_commit_mark,
-                               xe::memory::AllocationType::kCommit,
-                               xe::memory::PageAccess::kExecuteReadWrite);
-      } else {
-        xe::memory::AllocFixed(generated_code_execute_base_, new_commit_mark,
-                               xe::memory::AllocationType::kCommit,
-                               xe::memory::PageAccess::kExecuteReadOnly);
-        xe::memory::AllocFixed(generated_code_write_base_, new_commit_mark,
-                               xe::memory::AllocationType::kCommit,
-                               xe::memory::PageAccess::kReadWrite);
-      }
-    } while (generated_code_commit_mark_.compare_exchange_weak(
-        old_commit_mark, new_commit_mark));
+    auto cpu_lock = cpu_critical_region_.Acquire();
+
+    size_t code_size = xe::round_up(func_info.code_size.total, 16);
+    uint8_t* code_write_address;
+    uint8_t* tail_write_address;
+    uint8_t* end_write_address;
+    // Place the code over retired code that has been reclaimed if there's a
+    // large enough block, reusing its position in the tables.
+    auto free_block_it = function_info
+                             ? free_code_blocks_.lower_bound(
+                                   code_size + unwind_reservation_size())
+                             : free_code_blocks_.end();
+    if (free_block_it != free_code_blocks_.end()) {
+      size_t index = free_block_it->second;
+      free_code_blocks_.erase(free_block_it);
+      size_t block_offset = size_t(generated_code_map_[index].first >> 32);
+      code_execute_address = generated_code_execute_base_ + block_offset;
+      code_execute_address_out = code_execute_address;
+      code_write_address = generated_code_write_base_ + block_offset;
+      code_write_address_out = code_write_address;
+      tail_write_address = code_write_address + code_size;
+      unwind_reservation = ReuseUnwindReservation(
+          tail_write_address, generated_code_unwind_slots_[index]);
+      end_write_address =
+          tail_write_address + xe::round_up(unwind_reservation.data_size, 16);
+      // The block keeps covering the entire memory that was reclaimed.
+      generated_code_map_[index].second = function_info;
+    } else {
+      low_mark = generated_code_offset_;
+
+      // Reserve code.
+      // Always move the code to land on 16b alignment.
+      code_execute_address =
+          generated_code_execute_base_ + generated_code_offset_;
+      code_execute_address_out = code_execute_address;
+      code_write_address = generated_code_write_base_ + generated_code_offset_;
+      code_write_address_out = code_write_address;
+      generated_code_offset_ += code_size;
+
+      tail_write_address = generated_code_write_base_ + generated_code_offset_;
+
+      // Reserve unwind info.
+      // We go on the high size of the unwind info as we don't know how big we
+      // need it, and a few extra bytes of padding isn't the worst thing.
+      unwind_reservation = RequestUnwindReservation(generated_code_write_base_ +
+                                                    generated_code_offset_);
+      generated_code_offset_ += xe::round_up(unwind_reservation.data_size, 16);
+
+      end_write_address = generated_code_write_base_ + generated_code_offset_;
+
+      high_mark = generated_code_offset_;
+
+      // Store in map. It is maintained in sorted order of host PC dependent on
+      // us also being append-only.
+      generated_code_map_.emplace_back(
+          (uint64_t(code_execute_address - generated_code_execute_base_)
+           << 32) |
+              generated_code_offset_,
+          function_info);
+      generated_code_unwind_slots_.push_back(
+          uint32_t(unwind_reservation.table_slot));
+
+      // TODO(DrChat): The following code doesn't really need to be under the
+      // global lock except for PlaceCode (but it depends on the previous code
+      // already being ran)
+
+      // If we are going above the high water mark of committed memory, commit
+      // some more. It's ok if multiple threads do this, as redundant commits
+      // aren't harmful.
+      size_t old_commit_mark, new_commit_mark;
+      do {
+        old_commit_mark = generated_code_commit_mark_;
+        if (high_mark <= old_commit_mark) break;
+
+        new_commit_mark = old_commit_mark + 16_MiB;
+        if (generated_code_execute_base_ == generated_code_write_base_) {
+          xe::memory::AllocFixed(generated_code_execute_base_, new_commit_mark,
+                                 xe::memory::AllocationType::kCommit,
+                                 xe::memory::PageAccess::kExecuteReadWrite);
+        } else {
+          xe::memory::AllocFixed(generated_code_execute_base_, new_commit_mark,
+                                 xe::memory::AllocationType::kCommit,
+                                 xe::memory::PageAccess::kExecuteReadOnly);
+          xe::memory::AllocFixed(generated_code_write_base_, new_commit_mark,
+                                 xe::memory::AllocationType::kCommit,
+                                 xe::memory::PageAccess::kReadWrite);
+        }
+      } while (generated_code_commit_mark_.compare_exchange_weak(
+          old_commit_mark, new_commit_mark));
+    }
 
     // Copy code.
     std::memcpy(code_write_address, machine_code, func_info.code_size.total);
 
+    // Fix up references to things outside of the function now that its final
+    // location is known.
+    for (size_t i = 0; i < relocation_count; ++i) {
+      const X64CodeRelocation& relocation = relocations[i];
+      assert_true(relocation.code_offset < func_info.code_size.total);
+      switch (relocation.type) {
+        case X64CodeRelocation::Type::kRel32: {
+          int64_t displacement =
+              int64_t(relocation.target) -
+              int64_t(reinterpret_cast<uintptr_t>(code_execute_address) +
+                      relocation.code_offset + sizeof(int32_t));
+          assert_true(displacement >= INT32_MIN && displacement <= INT32_MAX);
+          xe::store(code_write_address + relocation.code_offset,
+                    int32_t(displacement));
+        } break;
+        case X64CodeRelocation::Type::kAbs64:
+          xe::store(code_write_address + relocation.code_offset,
+                    relocation.target);
+          break;
+        case X64CodeRelocation::Type::kGuestCall:
+        case X64CodeRelocation::Type::kGuestTailCall: {
+          CallSite call_site;
+          call_site.execute_address =
+              code_execute_address + relocation.code_offset;
+          call_site.is_tail_call =
+              relocation.type == X64CodeRelocation::Type::kGuestTailCall;
+          uint32_t target_guest_address = uint32_t(relocation.target);
+          std::lock_guard<xe_mutex> lock(call_sites_lock_);
+          call_sites_[target_guest_address].push_back(call_site);
+          // Link right away if the target has already been placed.
+          uint32_t target_host_address = *reinterpret_cast<uint32_t*>(
+              indirection_table_base_ +
+              (target_guest_address - kIndirectionTableBase));
+          if (target_host_address != indirection_default_value_) {
+            LinkCallSite(call_site, target_guest_address, target_host_address);
+          }
+        } break;
+      }
+    }
+
     // Fill unused slots with 0xCC
     std::memset(tail_write_address, 0xCC,
                 static_cast<size_t>(end_write_address - tail_write_address));
@@ -295,7 +509,7 @@ uint32_t X64CodeCache::PlaceData(const void* data, size_t length) {
   size_t high_mark;
   uint8_t* data_address = nullptr;
   {
-    auto global_lock = global_critical_region_.Acquire();
+    auto cpu_lock = cpu_critical_region_.Acquire();
 
     // Reserve code.
     // Always move the code to land on 16b alignment.
@@ -335,6 +549,15 @@ uint32_t X64CodeCache::PlaceData(const void* data, size_t length) {
   return uint32_t(uintptr_t(data_address));
 }
 
+uint8_t* X64CodeCache::LookupWriteAddress(uint64_t execute_address) const {
+  uint64_t execute_base = uint64_t(generated_code_execute_base_);
+  if (execute_address < execute_base ||
+      execute_address >= execute_base + generated_code_commit_mark_) {
+    return nullptr;
+  }
+  return generated_code_write_base_ + (execute_address - execute_base);
+}
+
 GuestFunction* X64CodeCache::LookupFunction(uint64_t host_pc) {
   uint32_t key = uint32_t(host_pc - kGeneratedCodeExecuteBase);
   void* fn_entry = std::bsearch(
@@ -13,8 +13,10 @@
 #include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -39,6 +41,26 @@ struct EmitFunctionInfo {
   size_t stack_size;
 };
 
+// Fixup applied to machine code as it is copied into the code cache, for code
+// that was generated for a different location (for instance, loaded from
+// X64PersistentCodeCache).
+struct X64CodeRelocation {
+  enum class Type : uint8_t {
+    // 4 byte displacement relative to the end of the field.
+    kRel32,
+    // 8 byte absolute address.
+    kAbs64,
+    // Linkable call site (see X64CodeCache::kCallSiteSize) calling the guest
+    // function at the target address, followed by call rax.
+    kGuestCall,
+    // Same as kGuestCall, but followed by jmp rax.
+    kGuestTailCall,
+  };
+  uint32_t code_offset;
+  Type type;
+  uint64_t target;
+};
+
 class X64CodeCache : public CodeCache {
  public:
   ~X64CodeCache() override;
@@ -57,9 +79,35 @@ class X64CodeCache : public CodeCache {
   // TODO(benvanik): keep track of code blocks
   // TODO(benvanik): padding/guards/etc
 
+  // Calls to guest functions from generated code load the target from the
+  // indirection table with an 8 byte sequence, placed at an 8 byte aligned
+  // address:
+  //   mov ebx, guest_address
+  //   mov eax, dword [ebx]
+  // followed by call rax or jmp rax. In code placed with kGuestCall or
+  // kGuestTailCall relocations, the sequence is atomically replaced with a
+  // direct call or jump when the target has machine code in the table, and
+  // restored when the target is removed.
+  static constexpr size_t kCallSiteSize = 8;
+  static void WriteUnlinkedCallSite(uint8_t* call_site, uint32_t guest_address);
+
   bool has_indirection_table() { return indirection_table_base_ != nullptr; }
   void set_indirection_default(uint32_t default_value);
   void AddIndirection(uint32_t guest_address, uint32_t host_address);
+  // Resets the indirection to the default value and unlinks call sites
+  // referring to the function.
+  void RemoveIndirection(uint32_t guest_address);
+  uint32_t GetIndirection(uint32_t guest_address) const;
+
+  // Marks the guest code placed at the host address as unreachable, after the
+  // indirection referring to it has been removed. Its memory is reused once
+  // ReclaimRetiredCode confirms that no thread is executing it anymore.
+  void RetireCode(uint32_t host_address);
+  size_t retired_code_size() const { return retired_code_size_; }
+  // Called with all threads that may be executing generated code suspended,
+  // with the addresses in their stacks and registers. Retired code that none
+  // of them point into is made available for placing new code.
+  void ReclaimRetiredCode(std::vector<uint64_t> live_addresses);
 
   void CommitExecutableRange(uint32_t guest_low, uint32_t guest_high);
 
@@ -71,9 +119,15 @@ class X64CodeCache : public CodeCache {
                       const EmitFunctionInfo& func_info,
                       GuestFunction* function_info,
                       void*& code_execute_address_out,
-                      void*& code_write_address_out);
+                      void*& code_write_address_out,
+                      const X64CodeRelocation* relocations = nullptr,
+                      size_t relocation_count = 0);
   uint32_t PlaceData(const void* data, size_t length);
 
+  // Writable view of already placed code, for patching it in place (such as
+  // for breakpoints), or nullptr if the address is outside the generated code.
+  uint8_t* LookupWriteAddress(uint64_t execute_address) const;
+
   GuestFunction* LookupFunction(uint64_t host_pc) override;
 
  protected:
@@ -107,6 +161,15 @@ class X64CodeCache : public CodeCache {
   virtual UnwindReservation RequestUnwindReservation(uint8_t* entry_address) {
     return UnwindReservation();
   }
+  // For placing code over retired code, returns the reservation of the
+  // retired code moved to the new entry address, which must have the same
+  // position relative to the other entries.
+  virtual UnwindReservation ReuseUnwindReservation(uint8_t* entry_address,
+                                                   size_t table_slot) {
+    return UnwindReservation();
+  }
+  // Size of the unwind data placed after the code of every function.
+  virtual size_t unwind_reservation_size() const { return 0; }
   virtual void PlaceCode(uint32_t guest_address, void* machine_code,
                          const EmitFunctionInfo& func_info,
                          void* code_execute_address,
@@ -118,11 +181,25 @@ class X64CodeCache : public CodeCache {
 
   // NOTE: the global critical region must be held when manipulating the offsets
   // or counts of anything, to keep the tables consistent and ordered.
-  xe::global_critical_region global_critical_region_;
+  xe::cpu_critical_region cpu_critical_region_;
+
+  struct CallSite {
+    uint8_t* execute_address;
+    bool is_tail_call;
+  };
+
+  // Called with call_sites_lock_ held.
+  void LinkCallSite(const CallSite& call_site, uint32_t guest_address,
+                    uint32_t host_address);
 
   // Value that the indirection table will be initialized with upon commit.
   uint32_t indirection_default_value_ = 0xFEEDF00D;
 
+  // Linkable call sites in the placed code by the guest address they call.
+  // Sites in code of removed functions are kept until its memory is reused.
+  xe_mutex call_sites_lock_;
+  std::unordered_map<uint32_t, std::vector<CallSite>> call_sites_;
+
   // Fixed at kIndirectionTableBase in host space, holding 4 byte pointers into
   // the generated code table that correspond to the PPC functions in guest
   // space.
@@ -140,8 +217,18 @@ class X64CodeCache : public CodeCache {
   std::atomic<size_t> generated_code_commit_mark_ = {0};
   // Sorted map by host PC base offsets to source function info.
   // This can be used to bsearch on host PC to find the guest function.
-  // The key is [start address | end address].
+  // The key is [start address | end address], the end includes the unwind
+  // data. The function is null for host code and retired code.
   std::vector<std::pair<uint64_t, GuestFunction*>> generated_code_map_;
+
+  // Parallel to generated_code_map_, for placing code over retired code.
+  std::vector<uint32_t> generated_code_unwind_slots_;
+  // Indices of the blocks of code that has been retired but may still be
+  // executing.
+  std::vector<size_t> retired_code_blocks_;
+  std::atomic<size_t> retired_code_size_ = {0};
+  // Indices of the blocks that new code can be placed in by their size.
+  std::multimap<size_t, size_t> free_code_blocks_;
 };
 
 }  // namespace x64
@@ -106,6 +106,11 @@ class Win32X64CodeCache : public X64CodeCache {
 
  private:
   UnwindReservation RequestUnwindReservation(uint8_t* entry_address) override;
+  UnwindReservation ReuseUnwindReservation(uint8_t* entry_address,
+                                           size_t table_slot) override;
+  size_t unwind_reservation_size() const override {
+    return xe::round_up(kUnwindInfoSize, 16);
+  }
   void PlaceCode(uint32_t guest_address, void* machine_code,
                  const EmitFunctionInfo& func_info, void* code_execute_address,
                  UnwindReservation unwind_reservation) override;
@@ -226,6 +231,17 @@ Win32X64CodeCache::RequestUnwindReservation(uint8_t* entry_address) {
   return unwind_reservation;
 }
 
+Win32X64CodeCache::UnwindReservation
+Win32X64CodeCache::ReuseUnwindReservation(uint8_t* entry_address,
+                                          size_t table_slot) {
+  // The reused block starts at the same address, so the table stays sorted.
+  UnwindReservation unwind_reservation;
+  unwind_reservation.data_size = xe::round_up(kUnwindInfoSize, 16);
+  unwind_reservation.table_slot = table_slot;
+  unwind_reservation.entry_address = entry_address;
+  return unwind_reservation;
+}
+
 void Win32X64CodeCache::PlaceCode(uint32_t guest_address, void* machine_code,
                                   const EmitFunctionInfo& func_info,
                                   void* code_execute_address,
@@ -13,6 +13,7 @@
 
 #include <climits>
 #include <cstring>
+#include <unordered_map>
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/assert.h"
@@ -27,10 +28,12 @@
 #include "xenia/cpu/backend/x64/x64_backend.h"
 #include "xenia/cpu/backend/x64/x64_code_cache.h"
 #include "xenia/cpu/backend/x64/x64_function.h"
+#include "xenia/cpu/backend/x64/x64_persistent_code_cache.h"
 #include "xenia/cpu/backend/x64/x64_sequences.h"
 #include "xenia/cpu/backend/x64/x64_stack_layout.h"
 #include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/function.h"
+#include "xenia/cpu/function_call_tracer.h"
 #include "xenia/cpu/function_debug_info.h"
 #include "xenia/cpu/hir/instr.h"
 #include "xenia/cpu/hir/opcodes.h"
@@ -58,11 +61,18 @@ DEFINE_uint32(align_all_basic_blocks, 0,
               "power of 2, 16 is the recommended value. Results in larger "
               "icache usage, but potentially faster loops",
               "x64");
+DEFINE_bool(link_guest_calls, true,
+            "Replace calls to guest functions through the indirection table "
+            "with direct calls once the target function is translated.",
+            "x64");
 #if XE_X64_PROFILER_AVAILABLE == 1
 DEFINE_bool(instrument_call_times, false,
             "Compute time taken for functions, for profiling guest code",
             "x64");
 #endif
+
+DECLARE_bool(writable_code_segments);
+
 namespace xe {
 namespace cpu {
 namespace backend {
@@ -115,11 +125,15 @@ bool X64Emitter::Emit(GuestFunction* function, HIRBuilder* builder,
   SCOPE_profile_cpu_f("cpu");
   guest_module_ = dynamic_cast<XexModule*>(function->module());
   current_guest_function_ = function->address();
+  baseline_function_ =
+      function->is_baseline() ? static_cast<X64Function*>(function) : nullptr;
   // Reset.
   debug_info_ = debug_info;
   debug_info_flags_ = debug_info_flags;
   trace_data_ = &function->trace_data();
   source_map_arena_.Reset();
+  relocations_.clear();
+  persistable_ = true;
 
   // Fill the generator with code.
   EmitFunctionInfo func_info = {};
@@ -134,6 +148,17 @@ bool X64Emitter::Emit(GuestFunction* function, HIRBuilder* builder,
   // Stash source map.
   source_map_arena_.CloneContents(out_source_map);
 
+  // Save the code for the next run if it doesn't depend on anything that may
+  // change between runs.
+  // Baseline code is not persisted, only its optimized replacement.
+  auto persistent_code_cache = backend_->persistent_code_cache();
+  if (persistent_code_cache && persistable_ && !debug_info_flags &&
+      !baseline_function_) {
+    persistent_code_cache->StoreFunction(
+        function, func_info, reinterpret_cast<uint8_t*>(*out_code_address),
+        relocations_, *out_source_map);
+  }
+
   return true;
 }
 void* X64Emitter::Emplace(const EmitFunctionInfo& func_info,
@@ -151,8 +176,18 @@ void* X64Emitter::Emplace(const EmitFunctionInfo& func_info,
   void* new_write_address;
   assert_true(func_info.code_size.total == size_);
   if (function) {
+    // The code is generated for its final location, only the call sites need
+    // to be registered by the code cache.
+    std::vector<X64CodeRelocation> call_sites;
+    for (const X64CodeRelocation& relocation : relocations_) {
+      if (relocation.type == X64CodeRelocation::Type::kGuestCall ||
+          relocation.type == X64CodeRelocation::Type::kGuestTailCall) {
+        call_sites.push_back(relocation);
+      }
+    }
     code_cache_->PlaceGuestCode(function->address(), top_, func_info, function,
-                                new_execute_address, new_write_address);
+                                new_execute_address, new_write_address,
+                                call_sites.data(), call_sites.size());
   } else {
     code_cache_->PlaceHostCode(0, top_, func_info, new_execute_address,
                                new_write_address);
@@ -169,6 +204,64 @@ void* X64Emitter::Emplace(const EmitFunctionInfo& func_info,
   return new_execute_address;
 }
 
+// Called by baseline code once it has been called tier_up_call_count times.
+static uint64_t RequestFunctionTierUp(void* raw_context,
+                                      uint64_t function_ptr) {
+  auto function = reinterpret_cast<X64Function*>(function_ptr);
+  if (function->BeginTierUp()) {
+    auto guest_context = reinterpret_cast<ppc::PPCContext_s*>(raw_context);
+    guest_context->thread_state->processor()->RecompileFunction(function);
+  }
+  return 0;
+}
+
+static void RecordFunctionCallEvent(void* raw_context, uint64_t guest_address,
+                                    FunctionCallTracer::EventType type) {
+  auto guest_context = reinterpret_cast<ppc::PPCContext_s*>(raw_context);
+  FunctionCallTracer* tracer =
+      guest_context->thread_state->processor()->function_call_tracer();
+  if (tracer) {
+    tracer->RecordEvent(guest_context->thread_id, uint32_t(guest_address),
+                        type);
+  }
+}
+static uint64_t TraceFunctionCall(void* raw_context, uint64_t guest_address) {
+  RecordFunctionCallEvent(raw_context, guest_address,
+                          FunctionCallTracer::EventType::kCall);
+  return 0;
+}
+static uint64_t TraceFunctionReturn(void* raw_context,
+                                    uint64_t guest_address) {
+  RecordFunctionCallEvent(raw_context, guest_address,
+                          FunctionCallTracer::EventType::kReturn);
+  return 0;
+}
+
+// Calls, direct or through kernel code, may longjmp out of the callee back into
+// the function, which needs its stackpoint to restore its host stack frame.
+static bool IsStackpointNeeded(const Instr* i) {
+  switch (i->GetOpcodeNum()) {
+    case hir::OPCODE_CALL:
+    case hir::OPCODE_CALL_TRUE:
+    case hir::OPCODE_CALL_INDIRECT:
+    case hir::OPCODE_CALL_INDIRECT_TRUE:
+    case hir::OPCODE_CALL_EXTERN:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Body of baseline code of functions that are interpreted.
+static uint64_t InterpretFunction(void* raw_context, uint64_t function_ptr,
+                                  uint64_t return_address) {
+  auto function = reinterpret_cast<X64Function*>(function_ptr);
+  function->interpreted_function()->Execute(
+      reinterpret_cast<ppc::PPCContext*>(raw_context),
+      uint32_t(return_address));
+  return 0;
+}
+
 bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
   Xbyak::Label epilog_label;
   epilog_label_ = &epilog_label;
@@ -232,6 +325,19 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
   func_info.stack_size = stack_size;
   stack_size_ = stack_size;
 
+  emit_stackpoints_ = false;
+  if (cvars::enable_host_guest_stack_synchronization) {
+    for (auto b = builder->first_block(); b && !emit_stackpoints_;
+         b = b->next) {
+      for (auto i = b->instr_head; i; i = i->next) {
+        if (IsStackpointNeeded(i)) {
+          emit_stackpoints_ = true;
+          break;
+        }
+      }
+    }
+  }
+
   PushStackpoint();
   sub(rsp, (uint32_t)stack_size);
 
@@ -282,6 +388,29 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
     lock();
     bts(qword[low_address(&trace_header->function_thread_use)], rax);
   }
+  if (debug_info_flags_ & DebugInfoFlags::kDebugInfoTraceFunctionCalls) {
+    CallNative(TraceFunctionCall, current_guest_function_);
+    MarkNotPersistable();
+  }
+
+  if (baseline_function_) {
+    // The countdown is not atomic, missing some calls when multiple threads
+    // run the function doesn't matter.
+    Xbyak::Label& tier_up_return = NewCachedLabel();
+    uint64_t function_ptr = reinterpret_cast<uint64_t>(baseline_function_);
+    Xbyak::Label& tier_up = AddToTail(
+        [&tier_up_return, function_ptr](X64Emitter& e, Xbyak::Label& label) {
+          e.L(label);
+          e.CallNative(RequestFunctionTierUp, function_ptr);
+          e.jmp(tier_up_return, e.T_NEAR);
+        });
+    mov(rax,
+        reinterpret_cast<uint64_t>(baseline_function_->tier_up_countdown()));
+    sub(dword[rax], 1);
+    js(tier_up, T_NEAR);
+    L(tier_up_return);
+    MarkNotPersistable();
+  }
 
   // Load membase.
   /*
@@ -289,11 +418,132 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
   count on no other code modifying it. mov(GetMembaseReg(),
       qword[GetContextReg() + offsetof(ppc::PPCContext, virtual_membase)]);
   */
-  // Body.
-  auto block = builder->first_block();
+  // Baseline code counts how often the conditional branches ending blocks are
+  // reached and fall through, for superblock formation when the function is
+  // optimized. The counters are keyed by the guest address of the branch, and
+  // are allocated up front so they don't move while the code uses them.
+  bool interpreted =
+      baseline_function_ && baseline_function_->interpreted_function();
+  std::unordered_map<const hir::Block*, BranchProfile*> branch_profiles;
+  if (baseline_function_ && !interpreted && cvars::superblock_formation &&
+      baseline_function_->branch_profiles().empty()) {
+    std::unordered_map<uint32_t, const hir::Block*> branch_blocks;
+    for (auto b = builder->first_block(); b; b = b->next) {
+      const Instr* tail = b->instr_tail;
+      if (!tail || (tail->opcode != &hir::OPCODE_BRANCH_TRUE_info &&
+                    tail->opcode != &hir::OPCODE_BRANCH_FALSE_info)) {
+        continue;
+      }
+      uint32_t guest_address = tail->GuestAddressFor();
+      if (!guest_address) {
+        continue;
+      }
+      auto it = branch_blocks.emplace(guest_address, b);
+      if (!it.second) {
+        it.first->second = nullptr;
+      }
+    }
+    auto& profiles = baseline_function_->branch_profiles();
+    profiles.reserve(branch_blocks.size());
+    for (auto& it : branch_blocks) {
+      if (it.second) {
+        profiles.push_back({it.first, 0, 0});
+        branch_profiles.emplace(it.second, &profiles.back());
+      }
+    }
+  }
+  // The targets of indirect calls are counted the same way, for guarded direct
+  // calls to the hot ones when the function is optimized.
+  indirect_call_profiles_.clear();
+  if (baseline_function_ && !interpreted &&
+      cvars::devirtualize_indirect_calls &&
+      baseline_function_->indirect_call_profiles().empty()) {
+    std::unordered_map<uint32_t, const Instr*> call_instrs;
+    for (auto b = builder->first_block(); b; b = b->next) {
+      for (const Instr* i = b->instr_head; i; i = i->next) {
+        if ((i->opcode != &hir::OPCODE_CALL_INDIRECT_info &&
+             i->opcode != &hir::OPCODE_CALL_INDIRECT_TRUE_info) ||
+            (i->flags & hir::CALL_POSSIBLE_RETURN)) {
+          continue;
+        }
+        uint32_t guest_address = i->GuestAddressFor();
+        if (!guest_address) {
+          continue;
+        }
+        auto it = call_instrs.emplace(guest_address, i);
+        if (!it.second) {
+          it.first->second = nullptr;
+        }
+      }
+    }
+    auto& profiles = baseline_function_->indirect_call_profiles();
+    profiles.reserve(call_instrs.size());
+    for (auto& it : call_instrs) {
+      if (it.second) {
+        profiles.push_back({it.first, {}, {}, 0});
+        indirect_call_profiles_.emplace(it.second, &profiles.back());
+      }
+    }
+  }
+
+  // The MXCSR mode is known at the start of a block if all the blocks that may
+  // jump or fall through to it were emitted before it and left the same mode,
+  // otherwise it's checked dynamically by the first instruction needing it.
+  // Branches that aren't at the end of a block leave their target undefined as
+  // the mode at them isn't tracked.
+  std::unordered_map<const hir::Block*, std::vector<const hir::Block*>>
+      mxcsr_mode_predecessors;
+  std::unordered_map<const hir::Block*, MXCSRMode> mxcsr_mode_exits;
+  for (auto b = builder->first_block(); b; b = b->next) {
+    for (auto i = b->instr_head; i; i = i->next) {
+      hir::Label* target = nullptr;
+      if (i->opcode == &hir::OPCODE_BRANCH_info) {
+        target = i->src1.label;
+      } else if (i->opcode == &hir::OPCODE_BRANCH_TRUE_info ||
+                 i->opcode == &hir::OPCODE_BRANCH_FALSE_info) {
+        target = i->src2.label;
+      }
+      if (target) {
+        // nullptr never has an exit mode.
+        mxcsr_mode_predecessors[target->block].push_back(
+            i == b->instr_tail ? b : nullptr);
+      }
+    }
+    const Instr* tail = b->instr_tail;
+    if (b->next && (!tail || (tail->opcode != &hir::OPCODE_BRANCH_info &&
+                              tail->opcode != &hir::OPCODE_RETURN_info))) {
+      mxcsr_mode_predecessors[b->next].push_back(b);
+    }
+  }
+
+  // Body, or the call of the interpreter instead of it.
+  if (interpreted) {
+    mov(GetNativeParam(0), reinterpret_cast<uint64_t>(baseline_function_));
+    mov(GetNativeParam(1), qword[rsp + StackLayout::GUEST_RET_ADDR]);
+    CallNativeSafe(reinterpret_cast<void*>(InterpretFunction));
+  }
+  auto block = interpreted ? nullptr : builder->first_block();
   synchronize_stack_on_next_instruction_ = false;
   while (block) {
-    ForgetMxcsrMode();  // at start of block, mxcsr mode is undefined
+    // at start of block, mxcsr mode is undefined unless all paths agree
+    ForgetMxcsrMode();
+    auto predecessors_it = mxcsr_mode_predecessors.find(block);
+    if (block != builder->first_block() &&
+        predecessors_it != mxcsr_mode_predecessors.end()) {
+      MXCSRMode entry_mode = MXCSRMode::Unknown;
+      for (const hir::Block* predecessor : predecessors_it->second) {
+        auto exit_it = mxcsr_mode_exits.find(predecessor);
+        if (exit_it == mxcsr_mode_exits.end() ||
+            exit_it->second == MXCSRMode::Unknown ||
+            (entry_mode != MXCSRMode::Unknown &&
+             exit_it->second != entry_mode)) {
+          entry_mode = MXCSRMode::Unknown;
+          break;
+        }
+        entry_mode = exit_it->second;
+      }
+      mxcsr_mode_ = entry_mode;
+    }
 
     // Mark block labels.
     auto label = block->label_head;
@@ -305,6 +555,16 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
     if (cvars::align_all_basic_blocks) {
       align(cvars::align_all_basic_blocks, true);
     }
+
+    // Nothing is allocated to rax across blocks. Not atomic, like the tier up
+    // countdown.
+    BranchProfile* branch_profile = nullptr;
+    auto branch_profile_it = branch_profiles.find(block);
+    if (branch_profile_it != branch_profiles.end()) {
+      branch_profile = branch_profile_it->second;
+      mov(rax, reinterpret_cast<uint64_t>(&branch_profile->executed_count));
+      inc(dword[rax]);
+    }
     // Process instructions.
     const Instr* instr = block->instr_head;
     while (instr) {
@@ -326,6 +586,12 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
       instr = new_tail;
     }
 
+    if (branch_profile) {
+      mov(rax, reinterpret_cast<uint64_t>(&branch_profile->fallthrough_count));
+      inc(dword[rax]);
+    }
+
+    mxcsr_mode_exits[block] = mxcsr_mode_;
     block = block->next;
   }
 
@@ -333,6 +599,9 @@ bool X64Emitter::Emit(HIRBuilder* builder, EmitFunctionInfo& func_info) {
   L(epilog_label);
   epilog_label_ = nullptr;
   EmitTraceUserCallReturn();
+  if (debug_info_flags_ & DebugInfoFlags::kDebugInfoTraceFunctionCalls) {
+    CallNative(TraceFunctionReturn, current_guest_function_);
+  }
   /*
   * chrispy: removed this, it serves no purpose
   mov(GetContextReg(), qword[rsp + StackLayout::GUEST_CTX_HOME]);
@@ -378,6 +647,7 @@ void X64Emitter::EmitProfilerEpilogue() {
     mov(ecx, 0x7ffe0014);
     mov(rdx, qword[rcx]);
     mov(r10, (uintptr_t)profiler_entry);
+    MarkNotPersistable();
     sub(rdx, qword[rsp + StackLayout::GUEST_PROFILER_START]);
 
     // atomic add our time to the profiler entry
@@ -699,7 +969,41 @@ void X64Emitter::Call(const hir::Instr* instr, GuestFunction* function) {
   auto fn = static_cast<X64Function*>(function);
   // Resolve address to the function to call and store in rax.
 
-  if (fn->machine_code()) {
+  if (code_cache_->has_indirection_table() && cvars::link_guest_calls &&
+      !cvars::writable_code_segments) {
+    // X64CodeCache turns this into a direct call or jump once the function is
+    // placed, and keeps it up to date when the function is replaced or
+    // removed.
+    bool is_tail_call = (instr->flags & hir::CALL_TAIL) != 0;
+    if (is_tail_call) {
+      // Since we skip the prolog we need to mark the return here.
+      EmitTraceUserCallReturn();
+      EmitProfilerEpilogue();
+      // Pass the callers return address over.
+      mov(rcx, qword[rsp + StackLayout::GUEST_RET_ADDR]);
+
+      add(rsp, static_cast<uint32_t>(stack_size()));
+      PopStackpoint();
+    } else {
+      // Return address is from the previous SET_RETURN_ADDRESS.
+      mov(rcx, qword[rsp + StackLayout::GUEST_CALL_RET_ADDR]);
+    }
+    EmitLinkableCallSite(function->address(), is_tail_call);
+    if (is_tail_call) {
+      jmp(rax);
+    } else {
+      call(rax);
+      synchronize_stack_on_next_instruction_ = true;
+    }
+    return;
+  }
+
+  // Code that may be persisted must not depend on where other functions were
+  // placed in this run, so always go through the indirection table for it.
+  // Baseline code is going to be replaced, and the indirection table is where
+  // the optimized code is installed.
+  if (fn->machine_code() && !fn->is_baseline() &&
+      !backend_->persistent_code_cache()) {
     if (!(instr->flags & hir::CALL_TAIL)) {
       mov(rcx, qword[rsp + StackLayout::GUEST_CALL_RET_ADDR]);
 
@@ -751,6 +1055,26 @@ void X64Emitter::Call(const hir::Instr* instr, GuestFunction* function) {
   }
 }
 
+void X64Emitter::EmitLinkableCallSite(uint32_t guest_address,
+                                      bool is_tail_call) {
+  // Must be aligned to be replaced with a single store, functions are placed
+  // at aligned addresses.
+  size_t misalignment = getSize() % X64CodeCache::kCallSiteSize;
+  if (misalignment) {
+    nop(X64CodeCache::kCallSiteSize - misalignment);
+  }
+  size_t call_site_offset = getSize();
+  // Same as X64CodeCache::WriteUnlinkedCallSite.
+  mov(ebx, guest_address);
+  mov(eax, dword[ebx]);
+  assert_true(getSize() - call_site_offset == X64CodeCache::kCallSiteSize);
+  relocations_.push_back({uint32_t(call_site_offset),
+                          is_tail_call
+                              ? X64CodeRelocation::Type::kGuestTailCall
+                              : X64CodeRelocation::Type::kGuestCall,
+                          guest_address});
+}
+
 void X64Emitter::CallIndirect(const hir::Instr* instr,
                               const Xbyak::Reg64& reg) {
   ForgetMxcsrMode();
@@ -760,6 +1084,35 @@ void X64Emitter::CallIndirect(const hir::Instr* instr,
     je(epilog_label(), CodeGenerator::T_NEAR);
   }
 
+  // Count the target in baseline code, claiming a free slot for a new one.
+  // Guest functions are never at address 0. rax isn't allocated to values.
+  auto profile_it = indirect_call_profiles_.find(instr);
+  if (profile_it != indirect_call_profiles_.end()) {
+    static_assert(IndirectCallProfile::kTargetCount == 2);
+    Xbyak::Label claim_0, count_0, claim_1, count_1, counted;
+    mov(rax, reinterpret_cast<uint64_t>(profile_it->second));
+    cmp(dword[rax + offsetof(IndirectCallProfile, targets[0])], reg.cvt32());
+    je(count_0);
+    cmp(dword[rax + offsetof(IndirectCallProfile, targets[0])], 0);
+    je(claim_0);
+    cmp(dword[rax + offsetof(IndirectCallProfile, targets[1])], reg.cvt32());
+    je(count_1);
+    cmp(dword[rax + offsetof(IndirectCallProfile, targets[1])], 0);
+    je(claim_1);
+    inc(dword[rax + offsetof(IndirectCallProfile, other_count)]);
+    jmp(counted);
+    L(claim_0);
+    mov(dword[rax + offsetof(IndirectCallProfile, targets[0])], reg.cvt32());
+    L(count_0);
+    inc(dword[rax + offsetof(IndirectCallProfile, target_counts[0])]);
+    jmp(counted);
+    L(claim_1);
+    mov(dword[rax + offsetof(IndirectCallProfile, targets[1])], reg.cvt32());
+    L(count_1);
+    inc(dword[rax + offsetof(IndirectCallProfile, target_counts[1])]);
+    L(counted);
+  }
+
   // Load the pointer to the indirection table maintained in X64CodeCache.
   // The target dword will either contain the address of the generated code
   // or a thunk to ResolveAddress.
@@ -772,7 +1125,7 @@ void X64Emitter::CallIndirect(const hir::Instr* instr,
     // Old-style resolve.
     // Not too important because indirection table is almost always available.
     mov(edx, reg.cvt32());
-    mov(rax, reinterpret_cast<uint64_t>(ResolveFunction));
+    MovHostAddress(rax, reinterpret_cast<void*>(ResolveFunction));
     mov(rcx, GetContextReg());
     call(rax);
   }
@@ -823,6 +1176,8 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
       mov(rdx, reinterpret_cast<uint64_t>(builtin_function->arg0()));
       mov(r8, reinterpret_cast<uint64_t>(builtin_function->arg1()));
       call(backend()->guest_to_host_thunk());
+      // The arguments are heap pointers.
+      MarkNotPersistable();
       // rax = host return
     }
   } else if (function->behavior() == Function::Behavior::kExtern) {
@@ -833,7 +1188,8 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
       // rdx = arg0
       // r8  = arg1
       // r9  = arg2
-      mov(rcx, reinterpret_cast<uint64_t>(extern_function->extern_handler()));
+      MovHostAddress(
+          rcx, reinterpret_cast<void*>(extern_function->extern_handler()));
       mov(rdx,
           qword[GetContextReg() + offsetof(ppc::PPCContext, kernel_state)]);
       call(backend()->guest_to_host_thunk());
@@ -842,6 +1198,7 @@ void X64Emitter::CallExtern(const hir::Instr* instr, const Function* function) {
   }
   if (undefined) {
     CallNative(UndefinedCallExtern, reinterpret_cast<uint64_t>(function));
+    MarkNotPersistable();
   }
 }
 
@@ -866,11 +1223,40 @@ void X64Emitter::CallNativeSafe(void* fn) {
   // rdx = arg0
   // r8  = arg1
   // r9  = arg2
-  mov(rcx, reinterpret_cast<uint64_t>(fn));
+  MovHostAddress(rcx, fn);
   call(backend()->guest_to_host_thunk());
   // rax = host return
 }
 
+void X64Emitter::call(const void* addr) {
+  CodeGenerator::call(addr);
+  // The rel32 displacement is the last field of the instruction.
+  relocations_.push_back({uint32_t(getSize() - sizeof(int32_t)),
+                          X64CodeRelocation::Type::kRel32,
+                          reinterpret_cast<uint64_t>(addr)});
+}
+
+void X64Emitter::jmp(const void* addr, LabelType type) {
+  CodeGenerator::jmp(addr, type);
+  relocations_.push_back({uint32_t(getSize() - sizeof(int32_t)),
+                          X64CodeRelocation::Type::kRel32,
+                          reinterpret_cast<uint64_t>(addr)});
+}
+
+void X64Emitter::MovHostAddress(const Xbyak::Reg64& reg, const void* address) {
+  size_t start = getSize();
+  mov(reg, reinterpret_cast<uint64_t>(address));
+  if (getSize() - start == 10) {
+    // mov r64, imm64.
+    relocations_.push_back({uint32_t(getSize() - sizeof(uint64_t)),
+                            X64CodeRelocation::Type::kAbs64,
+                            reinterpret_cast<uint64_t>(address)});
+  } else {
+    // Encoded as a 32-bit immediate, which can't be safely relocated.
+    MarkNotPersistable();
+  }
+}
+
 void X64Emitter::SetReturnAddress(uint64_t value) {
   mov(rax, value);
   mov(qword[rsp + StackLayout::GUEST_CALL_RET_ADDR], rax);
@@ -1710,6 +2096,15 @@ bool X64Emitter::ChangeMxcsrMode(MXCSRMode new_mode, bool already_set) {
       } else {
         assert_unhandled_case(new_mode);
       }
+    } else {
+      // The flags are relied on by the dynamic checks in later blocks.
+      if (new_mode == MXCSRMode::Fpu) {
+        btr(GetBackendFlagsPtr(), kX64BackendMXCSRModeBit);
+      } else if (new_mode == MXCSRMode::Vmx) {
+        bts(GetBackendFlagsPtr(), kX64BackendMXCSRModeBit);
+      } else {
+        assert_unhandled_case(new_mode);
+      }
     }
   }
   return false;
@@ -1738,7 +2133,7 @@ void X64Emitter::HandleStackpointOverflowError(ppc::PPCContext* context) {
 }
 
 void X64Emitter::PushStackpoint() {
-  if (!cvars::enable_host_guest_stack_synchronization) {
+  if (!emit_stackpoints_) {
     return;
   }
   // push the current host and guest stack pointers
@@ -1755,8 +2150,9 @@ void X64Emitter::PushStackpoint() {
 
   mov(qword[rbx + offsetof(X64BackendStackpoint, host_stack_)], rsp);
   mov(dword[rbx + offsetof(X64BackendStackpoint, guest_stack_)], r8d);
-  mov(r8d, qword[GetContextReg() + offsetof(ppc::PPCContext, lr)]);
-  mov(dword[rbx + offsetof(X64BackendStackpoint, guest_return_address_)], r8d);
+  // Take the return address from rcx rather than loading lr, it's what the
+  // caller set lr to.
+  mov(dword[rbx + offsetof(X64BackendStackpoint, guest_return_address_)], ecx);
 
   if (IsFeatureEnabled(kX64FlagsIndependentVars)) {
     inc(eax);
@@ -1782,7 +2178,7 @@ void X64Emitter::PushStackpoint() {
   jge(overflowed_stackpoints, T_NEAR);
 }
 void X64Emitter::PopStackpoint() {
-  if (!cvars::enable_host_guest_stack_synchronization) {
+  if (!emit_stackpoints_) {
     return;
   }
   // todo: maybe verify that rsp and r1 == the stackpoint?
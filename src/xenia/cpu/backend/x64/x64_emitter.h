@@ -10,9 +10,11 @@
 #ifndef XENIA_CPU_BACKEND_X64_X64_EMITTER_H_
 #define XENIA_CPU_BACKEND_X64_X64_EMITTER_H_
 
+#include <unordered_map>
 #include <vector>
 
 #include "xenia/base/arena.h"
+#include "xenia/cpu/backend/x64/x64_code_cache.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/function_trace_data.h"
 #include "xenia/cpu/hir/hir_builder.h"
@@ -37,8 +39,7 @@ namespace x64 {
 using namespace amd64;
 class X64Backend;
 class X64CodeCache;
-
-struct EmitFunctionInfo;
+class X64Function;
 
 enum RegisterFlags {
   REG_DEST = (1 << 0),
@@ -267,6 +268,21 @@ class X64Emitter : public Xbyak::CodeGenerator {
   void CallNativeSafe(void* fn);
   void SetReturnAddress(uint64_t value);
 
+  // Direct calls and jumps to absolute addresses and host addresses loaded
+  // into registers are recorded as relocations, so the generated code can be
+  // moved by X64PersistentCodeCache. Anything embedding a pointer that is not
+  // stable across runs must call MarkNotPersistable instead.
+  using CodeGenerator::call;
+  using CodeGenerator::jmp;
+  void call(const void* addr);
+  void jmp(const void* addr, LabelType type = T_AUTO);
+  void MovHostAddress(const Xbyak::Reg64& reg, const void* address);
+  void MarkNotPersistable() { persistable_ = false; }
+  bool is_persistable() const { return persistable_; }
+  const std::vector<X64CodeRelocation>& relocations() const {
+    return relocations_;
+  }
+
   Xbyak::Reg64 GetNativeParam(uint32_t param);
 
   Xbyak::Reg64 GetContextReg() const;
@@ -389,6 +405,9 @@ class X64Emitter : public Xbyak::CodeGenerator {
   bool Emit(hir::HIRBuilder* builder, EmitFunctionInfo& func_info);
   void EmitGetCurrentThreadId();
   void EmitTraceUserCallReturn();
+  // Loads the code address of the guest function from the indirection table
+  // into rax, with a sequence that X64CodeCache can link to the function.
+  void EmitLinkableCallSite(uint32_t guest_address, bool is_tail_call);
   static void HandleStackpointOverflowError(ppc::PPCContext* context);
  protected:
   Processor* processor_ = nullptr;
@@ -397,10 +416,18 @@ class X64Emitter : public Xbyak::CodeGenerator {
   XbyakAllocator* allocator_ = nullptr;
   XexModule* guest_module_ = nullptr;
   bool synchronize_stack_on_next_instruction_ = false;
+  // Stackpoints are only needed while a function may be reentered from a
+  // callee unwinding the guest stack, so not for leaf functions.
+  bool emit_stackpoints_ = false;
   int locals_page_delta_ = 0;
   Xbyak::util::Cpu cpu_;
   uint64_t feature_flags_ = 0;
   uint32_t current_guest_function_ = 0;
+  // Set while emitting baseline code, which counts its calls.
+  X64Function* baseline_function_ = nullptr;
+  // Target counters of the indirect calls in the baseline code being emitted.
+  std::unordered_map<const hir::Instr*, IndirectCallProfile*>
+      indirect_call_profiles_;
   Xbyak::Label* epilog_label_ = nullptr;
 
   hir::Instr* current_instr_ = nullptr;
@@ -425,6 +452,9 @@ class X64Emitter : public Xbyak::CodeGenerator {
       label_cache_;  // for creating labels that need to be referenced much
                      // later by tail emitters
   MXCSRMode mxcsr_mode_ = MXCSRMode::Unknown;
+
+  std::vector<X64CodeRelocation> relocations_;
+  bool persistable_ = true;
 };
 
 }  // namespace x64
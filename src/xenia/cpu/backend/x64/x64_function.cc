@@ -9,7 +9,12 @@
 
 #include "xenia/cpu/backend/x64/x64_function.h"
 
+#include <algorithm>
+#include <climits>
+
+#include "xenia/base/assert.h"
 #include "xenia/cpu/backend/x64/x64_backend.h"
+#include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/cpu/thread_state.h"
 
@@ -19,22 +24,97 @@ namespace backend {
 namespace x64 {
 
 X64Function::X64Function(Module* module, uint32_t address)
-    : GuestFunction(module, address) {}
+    : GuestFunction(module, address),
+      tier_up_countdown_(std::max(cvars::tier_up_call_count, int32_t(0))) {}
 
 X64Function::~X64Function() {
   // machine_code_ is freed by code cache.
 }
 
+uint8_t* X64Function::machine_code() const {
+  uint8_t* optimized_machine_code =
+      optimized_machine_code_.load(std::memory_order_acquire);
+  return optimized_machine_code ? optimized_machine_code : machine_code_;
+}
+
+size_t X64Function::machine_code_length() const {
+  return optimized_machine_code_.load(std::memory_order_acquire)
+             ? optimized_machine_code_length_
+             : machine_code_length_;
+}
+
 void X64Function::Setup(uint8_t* machine_code, size_t machine_code_length) {
   machine_code_ = machine_code;
   machine_code_length_ = machine_code_length;
 }
 
+void X64Function::SetupOptimized(uint8_t* machine_code,
+                                 size_t machine_code_length,
+                                 std::vector<SourceMapEntry> source_map) {
+  assert_null(optimized_machine_code_.load(std::memory_order_relaxed));
+  optimized_machine_code_length_ = machine_code_length;
+  optimized_source_map_ = std::move(source_map);
+  optimized_machine_code_.store(machine_code, std::memory_order_release);
+}
+
+uintptr_t X64Function::MapGuestAddressToMachineCode(
+    uint32_t guest_address) const {
+  uint8_t* optimized_machine_code =
+      optimized_machine_code_.load(std::memory_order_acquire);
+  if (!optimized_machine_code) {
+    return GuestFunction::MapGuestAddressToMachineCode(guest_address);
+  }
+  for (const SourceMapEntry& entry : optimized_source_map_) {
+    if (entry.guest_address == guest_address) {
+      return reinterpret_cast<uintptr_t>(optimized_machine_code) +
+             entry.code_offset;
+    }
+  }
+  return 0;
+}
+
+uint32_t X64Function::MapMachineCodeToGuestAddress(
+    uintptr_t host_address) const {
+  uintptr_t optimized_machine_code = reinterpret_cast<uintptr_t>(
+      optimized_machine_code_.load(std::memory_order_acquire));
+  if (!optimized_machine_code || host_address < optimized_machine_code ||
+      host_address >= optimized_machine_code + optimized_machine_code_length_) {
+    // Possibly still in the baseline code.
+    if (host_address >= reinterpret_cast<uintptr_t>(machine_code_) &&
+        host_address <
+            reinterpret_cast<uintptr_t>(machine_code_) + machine_code_length_) {
+      auto entry = LookupMachineCodeOffset(static_cast<uint32_t>(
+          host_address - reinterpret_cast<uintptr_t>(machine_code_)));
+      return entry ? entry->guest_address : address();
+    }
+    if (!optimized_machine_code) {
+      return GuestFunction::MapMachineCodeToGuestAddress(host_address);
+    }
+  }
+  uint32_t offset =
+      static_cast<uint32_t>(host_address - optimized_machine_code);
+  for (auto it = optimized_source_map_.crbegin();
+       it != optimized_source_map_.crend(); ++it) {
+    if (it->code_offset <= offset) {
+      return it->guest_address;
+    }
+  }
+  return optimized_source_map_.empty()
+             ? address()
+             : optimized_source_map_.front().guest_address;
+}
+
+bool X64Function::BeginTierUp() {
+  // Calls until the optimized code is installed shouldn't get here again.
+  tier_up_countdown_ = INT32_MAX;
+  return !tier_up_requested_.exchange(true, std::memory_order_relaxed);
+}
+
 bool X64Function::CallImpl(ThreadState* thread_state, uint32_t return_address) {
   auto backend =
       reinterpret_cast<X64Backend*>(thread_state->processor()->backend());
   auto thunk = backend->host_to_guest_thunk();
-  thunk(machine_code_, thread_state->context(),
+  thunk(machine_code(), thread_state->context(),
         reinterpret_cast<void*>(uintptr_t(return_address)));
   return true;
 }
@@ -10,6 +10,11 @@
 #ifndef XENIA_CPU_BACKEND_X64_X64_FUNCTION_H_
 #define XENIA_CPU_BACKEND_X64_X64_FUNCTION_H_
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "xenia/cpu/backend/hir_interpreter.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/thread_state.h"
 
@@ -23,10 +28,36 @@ class X64Function : public GuestFunction {
   X64Function(Module* module, uint32_t address);
   ~X64Function() override;
 
-  uint8_t* machine_code() const override { return machine_code_; }
-  size_t machine_code_length() const override { return machine_code_length_; }
+  uint8_t* machine_code() const override;
+  size_t machine_code_length() const override;
 
   void Setup(uint8_t* machine_code, size_t machine_code_length);
+  // Replaces the baseline machine code with the optimized version. The
+  // baseline code may still be running on other threads, so it's kept along
+  // with its source map (in source_map()) for mapping its addresses.
+  void SetupOptimized(uint8_t* machine_code, size_t machine_code_length,
+                      std::vector<SourceMapEntry> source_map);
+
+  uintptr_t MapGuestAddressToMachineCode(uint32_t guest_address) const override;
+  uint32_t MapMachineCodeToGuestAddress(uintptr_t host_address) const override;
+
+  // Decremented on every call of the baseline code, optimization is requested
+  // when it becomes negative.
+  int32_t* tier_up_countdown() { return &tier_up_countdown_; }
+  // Returns true only for the first call, the caller must then request the
+  // recompilation.
+  bool BeginTierUp();
+
+  // Set for baseline functions that are interpreted, the baseline machine code
+  // then only calls Execute. Kept after the optimized code is installed as
+  // other threads may still be interpreting the function.
+  const InterpretedFunction* interpreted_function() const {
+    return interpreted_function_.get();
+  }
+  void set_interpreted_function(
+      std::unique_ptr<InterpretedFunction> interpreted_function) {
+    interpreted_function_ = std::move(interpreted_function);
+  }
 
  protected:
   bool CallImpl(ThreadState* thread_state, uint32_t return_address) override;
@@ -34,6 +65,14 @@ class X64Function : public GuestFunction {
  private:
   uint8_t* machine_code_ = nullptr;
   size_t machine_code_length_ = 0;
+
+  int32_t tier_up_countdown_;
+  std::atomic<bool> tier_up_requested_ = false;
+  // Published after the length and the source map have been written.
+  std::atomic<uint8_t*> optimized_machine_code_ = nullptr;
+  size_t optimized_machine_code_length_ = 0;
+  std::vector<SourceMapEntry> optimized_source_map_;
+  std::unique_ptr<InterpretedFunction> interpreted_function_;
 };
 
 }  // namespace x64
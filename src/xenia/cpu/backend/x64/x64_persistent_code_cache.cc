@@ -0,0 +1,477 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/backend/x64/x64_persistent_code_cache.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include "build/version.h"
+#include "xenia/base/assert.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/memory.h"
+#include "xenia/base/platform_amd64.h"
+#include "xenia/base/xxhash.h"
+#include "xenia/cpu/backend/x64/x64_backend.h"
+#include "xenia/cpu/backend/x64/x64_function.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/xex_module.h"
+
+DEFINE_bool(x64_persistent_code_cache, false,
+            "Store machine code generated for guest functions on disk and "
+            "reuse it on subsequent launches of the same title instead of "
+            "translating the functions again.",
+            "x64");
+
+DECLARE_bool(emit_mmio_aware_stores_for_recorded_exception_addresses);
+DECLARE_bool(writable_code_segments);
+
+namespace xe {
+namespace cpu {
+namespace backend {
+namespace x64 {
+
+// Host addresses are stored relative to this function, so the code can still
+// be used if the emulator executable is loaded at a different base address.
+static void HostImageAnchor() {}
+
+static uint64_t GetHostImageAnchor() {
+  return reinterpret_cast<uint64_t>(&HostImageAnchor);
+}
+
+X64PersistentCodeCache::X64PersistentCodeCache(X64Backend* backend)
+    : backend_(backend), key_(CalculateKey()) {}
+
+X64PersistentCodeCache::~X64PersistentCodeCache() {
+  for (auto& module_storage : module_storages_) {
+    if (module_storage.second->file) {
+      fclose(module_storage.second->file);
+    }
+  }
+}
+
+uint64_t X64PersistentCodeCache::CalculateKey() const {
+  XXH3_state_t hash_state;
+  XXH3_64bits_reset(&hash_state);
+  XXH3_64bits_update(&hash_state, XE_BUILD_COMMIT, sizeof(XE_BUILD_COMMIT));
+  // Host CPU features used by the emitter, after x64_extension_mask.
+  uint64_t feature_flags = amd64::GetFeatureFlags();
+  XXH3_64bits_update(&hash_state, &feature_flags, sizeof(feature_flags));
+  // Fixed host mappings referenced directly by the generated code.
+  uint64_t host_addresses[] = {
+      uint64_t(backend_->emitter_data()),
+      uint64_t(backend_->code_cache()->execute_base_address()),
+      reinterpret_cast<uint64_t>(
+          backend_->processor()->memory()->virtual_membase()),
+  };
+  XXH3_64bits_update(&hash_state, host_addresses, sizeof(host_addresses));
+  // Everything configurable about the JIT.
+  if (cvar::ConfigVars) {
+    for (auto& it : *cvar::ConfigVars) {
+      const cvar::IConfigVar* config_var = it.second;
+      const std::string& category = config_var->category();
+      if (category != "CPU" && category != "x64") {
+        continue;
+      }
+      std::string value =
+          config_var->name() + "=" + config_var->config_value();
+      XXH3_64bits_update(&hash_state, value.data(), value.size());
+    }
+  }
+  return XXH3_64bits_digest(&hash_state);
+}
+
+uint64_t X64PersistentCodeCache::HashGuestCode(
+    uint32_t guest_address, uint32_t guest_end_address,
+    const std::vector<SourceMapEntry>& source_map) const {
+  Memory* memory = backend_->processor()->memory();
+  uint64_t hash = XXH3_64bits(memory->TranslateVirtual(guest_address),
+                              guest_end_address - guest_address + 4);
+  // Instructions of inlined functions are outside the range of the function.
+  std::vector<uint32_t> inlined_code;
+  for (const SourceMapEntry& entry : source_map) {
+    if (entry.guest_address < guest_address ||
+        entry.guest_address > guest_end_address) {
+      inlined_code.push_back(
+          xe::load<uint32_t>(memory->TranslateVirtual(entry.guest_address)));
+    }
+  }
+  if (!inlined_code.empty()) {
+    hash = XXH3_64bits_withSeed(inlined_code.data(),
+                                sizeof(uint32_t) * inlined_code.size(), hash);
+  }
+  return hash;
+}
+
+uint32_t X64PersistentCodeCache::CountMMIOInstructions(
+    Module* module, const std::vector<SourceMapEntry>& source_map) {
+  // Recorded with record_mmio_access_exceptions in the info cache, which is
+  // persistent itself.
+  auto xex_module = dynamic_cast<XexModule*>(module);
+  if (!xex_module) {
+    return 0;
+  }
+  uint32_t mmio_instruction_count = 0;
+  for (const SourceMapEntry& entry : source_map) {
+    InfoCacheFlags* flags =
+        xex_module->GetInstructionAddressFlags(entry.guest_address);
+    if (flags && flags->accessed_mmio) {
+      ++mmio_instruction_count;
+    }
+  }
+  return mmio_instruction_count;
+}
+
+X64PersistentCodeCache::ModuleStorage* X64PersistentCodeCache::GetModuleStorage(
+    Module* module) {
+  auto it = module_storages_.find(module);
+  if (it != module_storages_.end()) {
+    return it->second->file ? it->second.get() : nullptr;
+  }
+  auto& storage = module_storages_[module];
+  storage = std::make_unique<ModuleStorage>();
+
+  // Self-modifying code can't be cached.
+  XexModule* xex_module = dynamic_cast<XexModule*>(module);
+  if (!xex_module || cvars::writable_code_segments) {
+    return nullptr;
+  }
+  std::filesystem::path cache_path = xex_module->GetModuleCachePath();
+  if (cache_path.empty()) {
+    return nullptr;
+  }
+  std::filesystem::create_directories(cache_path);
+  cache_path /= "x64_code_cache.bin";
+  storage->file = xe::filesystem::OpenFile(cache_path, "a+b");
+  if (!storage->file) {
+    XELOGE("Failed to open the persistent code cache file for writing: {}",
+           xe::path_to_utf8(cache_path));
+    return nullptr;
+  }
+  bool storage_read;
+  {
+    // Other emulator instances may be using the same file, don't let them
+    // append while validating or resetting it.
+    xe::filesystem::ScopedStdioFileLock file_lock(storage->file);
+    storage_read = ReadModuleStorage(*storage, cache_path);
+  }
+  if (!storage_read) {
+    fclose(storage->file);
+    storage->file = nullptr;
+    XELOGE("Failed to reset the persistent code cache file: {}",
+           xe::path_to_utf8(cache_path));
+    return nullptr;
+  }
+  XELOGI("Persistent code cache: {} functions available for {}",
+         storage->functions.size(), module->name());
+  return storage.get();
+}
+
+bool X64PersistentCodeCache::ReadModuleStorage(
+    ModuleStorage& storage, const std::filesystem::path& path) {
+  FileHeader header;
+  bool header_valid = false;
+  int64_t file_size = 0;
+  xe::filesystem::Seek(storage.file, 0, SEEK_SET);
+  if (fread(&header, sizeof(header), 1, storage.file) &&
+      header.magic == kMagic && header.version == kVersion &&
+      header.key == key_) {
+    header_valid = true;
+    xe::filesystem::Seek(storage.file, 0, SEEK_END);
+    file_size = xe::filesystem::Tell(storage.file);
+    if (file_size > int64_t(sizeof(header))) {
+      storage.mapping = MappedMemory::Open(path, MappedMemory::Mode::kRead, 0,
+                                           size_t(file_size));
+      if (storage.mapping) {
+        storage.data = storage.mapping->data() + sizeof(header);
+        storage.data_size = size_t(file_size) - sizeof(header);
+      }
+    }
+  }
+
+  // Validate and index the functions, stop at the first corrupted one.
+  size_t offset = 0;
+  while (offset + sizeof(StoredFunctionHeader) <= storage.data_size) {
+    StoredFunctionHeader function_header;
+    std::memcpy(&function_header, storage.data + offset,
+                sizeof(function_header));
+    size_t data_size =
+        size_t(function_header.code_size) +
+        sizeof(StoredRelocation) * function_header.relocation_count +
+        sizeof(SourceMapEntry) * function_header.source_map_count;
+    size_t data_offset = offset + sizeof(StoredFunctionHeader);
+    if (data_size > storage.data_size - data_offset ||
+        XXH3_64bits(storage.data + data_offset, data_size) !=
+            function_header.data_hash) {
+      break;
+    }
+    storage.functions[function_header.guest_address] = offset;
+    offset = data_offset + data_size;
+  }
+  if (header_valid) {
+    if (offset != storage.data_size) {
+      // Drop the incomplete function at the end left if an instance has been
+      // terminated while writing it, keeping the ones before it. The mapping
+      // must be released for truncation on Windows.
+      XELOGI("Persistent code cache: discarding corrupted data at the end");
+      storage.mapping.reset();
+      storage.data = nullptr;
+      storage.data_size = 0;
+      if (!xe::filesystem::TruncateStdioFile(storage.file,
+                                             sizeof(header) + offset)) {
+        storage.functions.clear();
+        return false;
+      }
+      if (offset) {
+        storage.mapping = MappedMemory::Open(
+            path, MappedMemory::Mode::kRead, 0, sizeof(header) + offset);
+      }
+      if (storage.mapping) {
+        storage.data = storage.mapping->data() + sizeof(header);
+        storage.data_size = offset;
+      } else {
+        storage.functions.clear();
+      }
+    }
+    // Switching from reading to writing requires repositioning.
+    xe::filesystem::Seek(storage.file, 0, SEEK_END);
+    return true;
+  }
+
+  // Either created just now, outdated or corrupted - start from scratch.
+  XELOGI("Persistent code cache: discarding outdated or corrupted data");
+  storage.functions.clear();
+  storage.mapping.reset();
+  storage.data = nullptr;
+  storage.data_size = 0;
+  if (!xe::filesystem::TruncateStdioFile(storage.file, 0)) {
+    return false;
+  }
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.key = key_;
+  fwrite(&header, sizeof(header), 1, storage.file);
+  fflush(storage.file);
+  return true;
+}
+
+bool X64PersistentCodeCache::LoadFunction(X64Function* function) {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  ModuleStorage* storage = GetModuleStorage(function->module());
+  if (!storage) {
+    return false;
+  }
+  auto it = storage->functions.find(function->address());
+  if (it == storage->functions.end() || it->second == SIZE_MAX) {
+    return false;
+  }
+  const uint8_t* stored_function = storage->data + it->second;
+  StoredFunctionHeader header;
+  std::memcpy(&header, stored_function, sizeof(header));
+  const uint8_t* code = stored_function + sizeof(header);
+  const uint8_t* stored_relocations = code + header.code_size;
+  const uint8_t* stored_source_map =
+      stored_relocations + sizeof(StoredRelocation) * header.relocation_count;
+
+  std::vector<SourceMapEntry> source_map(header.source_map_count);
+  std::memcpy(source_map.data(), stored_source_map,
+              sizeof(SourceMapEntry) * header.source_map_count);
+  if (HashGuestCode(header.guest_address, header.guest_end_address,
+                    source_map) != header.guest_code_hash) {
+    return false;
+  }
+  // Stores to addresses found to be MMIO after the code was generated would
+  // keep causing access violations.
+  if (cvars::emit_mmio_aware_stores_for_recorded_exception_addresses &&
+      CountMMIOInstructions(function->module(), source_map) !=
+          header.mmio_instruction_count) {
+    return false;
+  }
+
+  std::vector<X64CodeRelocation> relocations;
+  relocations.reserve(header.relocation_count);
+  for (uint32_t i = 0; i < header.relocation_count; ++i) {
+    StoredRelocation stored_relocation;
+    std::memcpy(&stored_relocation,
+                stored_relocations + sizeof(StoredRelocation) * i,
+                sizeof(stored_relocation));
+    X64CodeRelocation& relocation = relocations.emplace_back();
+    relocation.code_offset = stored_relocation.code_offset;
+    switch (stored_relocation.type) {
+      case StoredRelocationType::kCodeCacheRel32:
+        relocation.type = X64CodeRelocation::Type::kRel32;
+        relocation.target =
+            backend_->code_cache()->execute_base_address() +
+            stored_relocation.target;
+        break;
+      case StoredRelocationType::kHostImageAbs64:
+        relocation.type = X64CodeRelocation::Type::kAbs64;
+        relocation.target = GetHostImageAnchor() + stored_relocation.target;
+        break;
+      case StoredRelocationType::kGuestCall:
+        relocation.type = X64CodeRelocation::Type::kGuestCall;
+        relocation.target = stored_relocation.target;
+        break;
+      case StoredRelocationType::kGuestTailCall:
+        relocation.type = X64CodeRelocation::Type::kGuestTailCall;
+        relocation.target = stored_relocation.target;
+        break;
+      default:
+        return false;
+    }
+  }
+
+  EmitFunctionInfo func_info = {};
+  func_info.code_size.prolog = header.code_size_prolog;
+  func_info.code_size.body = header.code_size_body;
+  func_info.code_size.epilog = header.code_size_epilog;
+  func_info.code_size.tail = header.code_size_tail;
+  func_info.code_size.total = header.code_size;
+  func_info.prolog_stack_alloc_offset = header.prolog_stack_alloc_offset;
+  func_info.stack_size = header.stack_size;
+
+  function->set_end_address(header.guest_end_address);
+  function->source_map() = std::move(source_map);
+
+  // The code cache only reads the machine code and fixes up its own copy.
+  void* code_execute_address;
+  void* code_write_address;
+  backend_->code_cache()->PlaceGuestCode(
+      function->address(), const_cast<uint8_t*>(code), func_info, function,
+      code_execute_address, code_write_address, relocations.data(),
+      relocations.size());
+  function->Setup(reinterpret_cast<uint8_t*>(code_execute_address),
+                  header.code_size);
+  return true;
+}
+
+void X64PersistentCodeCache::StoreFunction(
+    GuestFunction* function, const EmitFunctionInfo& func_info,
+    const uint8_t* machine_code,
+    const std::vector<X64CodeRelocation>& relocations,
+    const std::vector<SourceMapEntry>& source_map) {
+  X64CodeCache* code_cache = backend_->code_cache();
+  uint64_t code_cache_base = code_cache->execute_base_address();
+  uint64_t code_cache_end = code_cache_base + code_cache->total_size();
+  uint64_t host_image_anchor = GetHostImageAnchor();
+
+  std::vector<StoredRelocation> stored_relocations;
+  stored_relocations.reserve(relocations.size());
+  for (const X64CodeRelocation& relocation : relocations) {
+    StoredRelocation& stored_relocation = stored_relocations.emplace_back();
+    stored_relocation.code_offset = relocation.code_offset;
+    switch (relocation.type) {
+      case X64CodeRelocation::Type::kRel32:
+        // Only helpers are placed at the same location on every run, not
+        // guest functions.
+        if (relocation.target < code_cache_base ||
+            relocation.target >= code_cache_end ||
+            code_cache->LookupFunction(relocation.target)) {
+          return;
+        }
+        stored_relocation.type = StoredRelocationType::kCodeCacheRel32;
+        stored_relocation.target = relocation.target - code_cache_base;
+        break;
+      case X64CodeRelocation::Type::kAbs64:
+        stored_relocation.type = StoredRelocationType::kHostImageAbs64;
+        stored_relocation.target = relocation.target - host_image_anchor;
+        break;
+      case X64CodeRelocation::Type::kGuestCall:
+        stored_relocation.type = StoredRelocationType::kGuestCall;
+        stored_relocation.target = relocation.target;
+        break;
+      case X64CodeRelocation::Type::kGuestTailCall:
+        stored_relocation.type = StoredRelocationType::kGuestTailCall;
+        stored_relocation.target = relocation.target;
+        break;
+    }
+  }
+
+  StoredFunctionHeader header = {};
+  header.guest_address = function->address();
+  header.guest_end_address = function->end_address();
+  header.guest_code_hash =
+      HashGuestCode(header.guest_address, header.guest_end_address, source_map);
+  header.code_size = uint32_t(func_info.code_size.total);
+  header.relocation_count = uint32_t(stored_relocations.size());
+  header.source_map_count = uint32_t(source_map.size());
+  header.code_size_prolog = uint32_t(func_info.code_size.prolog);
+  header.code_size_body = uint32_t(func_info.code_size.body);
+  header.code_size_epilog = uint32_t(func_info.code_size.epilog);
+  header.code_size_tail = uint32_t(func_info.code_size.tail);
+  header.prolog_stack_alloc_offset =
+      uint32_t(func_info.prolog_stack_alloc_offset);
+  header.stack_size = uint32_t(func_info.stack_size);
+  header.mmio_instruction_count =
+      CountMMIOInstructions(function->module(), source_map);
+
+  std::vector<uint8_t> data(
+      size_t(header.code_size) +
+      sizeof(StoredRelocation) * stored_relocations.size() +
+      sizeof(SourceMapEntry) * source_map.size());
+  uint8_t* data_ptr = data.data();
+  std::memcpy(data_ptr, machine_code, header.code_size);
+  data_ptr += header.code_size;
+  std::memcpy(data_ptr, stored_relocations.data(),
+              sizeof(StoredRelocation) * stored_relocations.size());
+  data_ptr += sizeof(StoredRelocation) * stored_relocations.size();
+  std::memcpy(data_ptr, source_map.data(),
+              sizeof(SourceMapEntry) * source_map.size());
+  // The stored code must not contain the fixups for this run, undo them.
+  for (const StoredRelocation& stored_relocation : stored_relocations) {
+    uint8_t* field = data.data() + stored_relocation.code_offset;
+    switch (stored_relocation.type) {
+      case StoredRelocationType::kCodeCacheRel32:
+        std::memset(field, 0, sizeof(int32_t));
+        break;
+      case StoredRelocationType::kHostImageAbs64:
+        std::memset(field, 0, sizeof(uint64_t));
+        break;
+      case StoredRelocationType::kGuestCall:
+      case StoredRelocationType::kGuestTailCall:
+        // May have been linked already.
+        X64CodeCache::WriteUnlinkedCallSite(
+            field, uint32_t(stored_relocation.target));
+        break;
+    }
+  }
+  header.data_hash = XXH3_64bits(data.data(), data.size());
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  ModuleStorage* storage = GetModuleStorage(function->module());
+  if (!storage ||
+      storage->functions.find(header.guest_address) !=
+          storage->functions.end()) {
+    return;
+  }
+  {
+    // Written with the file locked so the function from this instance isn't
+    // interleaved with one from another instance appending to the same file.
+    xe::filesystem::ScopedStdioFileLock file_lock(storage->file);
+    bool written =
+        fwrite(&header, sizeof(header), 1, storage->file) &&
+        (data.empty() || fwrite(data.data(), data.size(), 1, storage->file));
+    fflush(storage->file);
+    if (!written) {
+      return;
+    }
+  }
+  // Don't keep the data in memory, it's only needed on the next run, just
+  // prevent storing the function twice if it's translated again.
+  storage->functions.emplace(header.guest_address, SIZE_MAX);
+}
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
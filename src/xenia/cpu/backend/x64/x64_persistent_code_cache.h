@@ -0,0 +1,150 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_BACKEND_X64_X64_PERSISTENT_CODE_CACHE_H_
+#define XENIA_CPU_BACKEND_X64_X64_PERSISTENT_CODE_CACHE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/mapped_memory.h"
+#include "xenia/cpu/backend/x64/x64_code_cache.h"
+#include "xenia/cpu/function.h"
+
+DECLARE_bool(x64_persistent_code_cache);
+
+namespace xe {
+namespace cpu {
+class XexModule;
+namespace backend {
+namespace x64 {
+
+class X64Backend;
+class X64Function;
+
+// Stores machine code generated for guest functions on disk, next to the
+// instruction info cache of the module (keyed by the image hash), so it can be
+// placed in the code cache directly on subsequent runs instead of going
+// through translation again.
+//
+// Only code that X64Emitter could fully describe with relocations is stored.
+// The storage of a module is discarded entirely if anything that may affect
+// code generation (build, codegen cvars, host CPU features, fixed host
+// mappings) differs from when it was written.
+class X64PersistentCodeCache {
+ public:
+  explicit X64PersistentCodeCache(X64Backend* backend);
+  ~X64PersistentCodeCache();
+
+  // Places previously generated machine code for the function, returns false
+  // if it needs to be translated.
+  bool LoadFunction(X64Function* function);
+
+  void StoreFunction(GuestFunction* function, const EmitFunctionInfo& func_info,
+                     const uint8_t* machine_code,
+                     const std::vector<X64CodeRelocation>& relocations,
+                     const std::vector<SourceMapEntry>& source_map);
+
+ private:
+  // 'XJIT'.
+  static constexpr uint32_t kMagic = 0x54494A58;
+  // Increment this when anything about the emitted code or the format changes.
+  static constexpr uint32_t kVersion = 7;
+
+  struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+  };
+
+  enum class StoredRelocationType : uint32_t {
+    // Call or jump to a helper placed in the code cache during backend
+    // initialization, target is the offset from the code cache base.
+    kCodeCacheRel32,
+    // Address of a function or data in the emulator executable, target is
+    // the offset from an anchor in the executable.
+    kHostImageAbs64,
+    // Linkable call site, stored unlinked, target is the guest address.
+    kGuestCall,
+    kGuestTailCall,
+  };
+
+  struct StoredRelocation {
+    uint32_t code_offset;
+    StoredRelocationType type;
+    uint64_t target;
+  };
+
+  struct StoredFunctionHeader {
+    uint32_t guest_address;
+    uint32_t guest_end_address;
+    // Hash of the guest instructions to reject functions that were patched.
+    uint64_t guest_code_hash;
+    uint32_t code_size;
+    uint32_t relocation_count;
+    uint32_t source_map_count;
+    uint32_t code_size_prolog;
+    uint32_t code_size_body;
+    uint32_t code_size_epilog;
+    uint32_t code_size_tail;
+    uint32_t prolog_stack_alloc_offset;
+    uint32_t stack_size;
+    // Instructions recorded as accessing MMIO in the info cache of the module
+    // when the code was generated, to regenerate it with MMIO-aware stores if
+    // more have been recorded since then.
+    uint32_t mmio_instruction_count;
+    // Hash of the data following the header.
+    uint64_t data_hash;
+  };
+  static_assert_size(StoredFunctionHeader, 64);
+
+  struct ModuleStorage {
+    FILE* file = nullptr;
+    // Contents of the file valid on open, mapped read-only so multiple
+    // emulator instances using the same cache share the pages.
+    std::unique_ptr<MappedMemory> mapping;
+    const uint8_t* data = nullptr;
+    size_t data_size = 0;
+    // Guest address to the offset of StoredFunctionHeader in data.
+    std::unordered_map<uint32_t, size_t> functions;
+  };
+
+  // Called with the lock held, returns nullptr if the module can't have a
+  // storage.
+  ModuleStorage* GetModuleStorage(Module* module);
+  // Returns false if the file couldn't be reset.
+  bool ReadModuleStorage(ModuleStorage& storage,
+                         const std::filesystem::path& path);
+  uint64_t CalculateKey() const;
+  // Covers the instructions of inlined functions too.
+  uint64_t HashGuestCode(uint32_t guest_address, uint32_t guest_end_address,
+                         const std::vector<SourceMapEntry>& source_map) const;
+  static uint32_t CountMMIOInstructions(
+      Module* module, const std::vector<SourceMapEntry>& source_map);
+
+  X64Backend* backend_;
+  uint64_t key_;
+
+  std::mutex mutex_;
+  std::map<Module*, std::unique_ptr<ModuleStorage>> module_storages_;
+};
+
+}  // namespace x64
+}  // namespace backend
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_BACKEND_X64_X64_PERSISTENT_CODE_CACHE_H_
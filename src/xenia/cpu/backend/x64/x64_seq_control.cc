@@ -13,6 +13,7 @@
 #include <cstring>
 
 #include "xenia/cpu/backend/x64/x64_op.h"
+#include "xenia/cpu/backend/x64/x64_tracers.h"
 
 namespace xe {
 namespace cpu {
@@ -20,10 +21,105 @@ namespace backend {
 namespace x64 {
 
 volatile int anchor_control = 0;
+// Integer compares with a constant first operand are emitted with the
+// operands swapped.
+static Opcode SwapCompareOperands(Opcode opcode) {
+  switch (opcode) {
+    case OPCODE_COMPARE_SLT:
+      return OPCODE_COMPARE_SGT;
+    case OPCODE_COMPARE_SLE:
+      return OPCODE_COMPARE_SGE;
+    case OPCODE_COMPARE_SGT:
+      return OPCODE_COMPARE_SLT;
+    case OPCODE_COMPARE_SGE:
+      return OPCODE_COMPARE_SLE;
+    case OPCODE_COMPARE_ULT:
+      return OPCODE_COMPARE_UGT;
+    case OPCODE_COMPARE_ULE:
+      return OPCODE_COMPARE_UGE;
+    case OPCODE_COMPARE_UGT:
+      return OPCODE_COMPARE_ULT;
+    case OPCODE_COMPARE_UGE:
+      return OPCODE_COMPARE_ULE;
+    default:
+      return opcode;
+  }
+}
+static Opcode InvertCompare(Opcode opcode) {
+  switch (opcode) {
+    case OPCODE_COMPARE_EQ:
+      return OPCODE_COMPARE_NE;
+    case OPCODE_COMPARE_NE:
+      return OPCODE_COMPARE_EQ;
+    case OPCODE_COMPARE_SLT:
+      return OPCODE_COMPARE_SGE;
+    case OPCODE_COMPARE_SLE:
+      return OPCODE_COMPARE_SGT;
+    case OPCODE_COMPARE_SGT:
+      return OPCODE_COMPARE_SLE;
+    case OPCODE_COMPARE_SGE:
+      return OPCODE_COMPARE_SLT;
+    case OPCODE_COMPARE_ULT:
+      return OPCODE_COMPARE_UGE;
+    case OPCODE_COMPARE_ULE:
+      return OPCODE_COMPARE_UGT;
+    case OPCODE_COMPARE_UGT:
+      return OPCODE_COMPARE_ULE;
+    case OPCODE_COMPARE_UGE:
+      return OPCODE_COMPARE_ULT;
+    default:
+      assert_unhandled_case(opcode);
+      return opcode;
+  }
+}
+static bool IsIntegerCompare(const Instr* i) {
+  return i->opcode->num >= OPCODE_COMPARE_EQ &&
+         i->opcode->num <= OPCODE_COMPARE_UGE &&
+         IsScalarIntegralType(i->src1.value->type);
+}
+
+// The condition of a branch is usually the result of a compare done by the
+// same guest instruction, like the lt/gt/eq bits of an updated CR field, which
+// is stored in the context as well. The host flags are still those of that
+// compare if only compares of the same values and movs are in between, and
+// the branch can use them instead of testing the materialized result.
+static bool AreFlagsFromCompare(const Instr* branch, const Instr* compare) {
+  if (IsTracingData() || compare->block != branch->block ||
+      !IsIntegerCompare(compare)) {
+    return false;
+  }
+  const Instr* flags_source =
+      GetFirstPrecedingInstrWithPossibleFlagEffects(branch);
+  while (flags_source && flags_source != compare) {
+    if (!IsIntegerCompare(flags_source) ||
+        !flags_source->src1.value->IsEqual(compare->src1.value) ||
+        !flags_source->src2.value->IsEqual(compare->src2.value)) {
+      return false;
+    }
+    flags_source = GetFirstPrecedingInstrWithPossibleFlagEffects(flags_source);
+  }
+  return flags_source == compare;
+}
+
+// Branches on false are only fused with integer compares, as float compares
+// can't be inverted with NaNs.
 template <typename T>
-static void EmitFusedBranch(X64Emitter& e, const T& i) {
-  bool valid = i.instr->prev && i.instr->prev->dest == i.src1.value;
-  auto opcode = valid ? i.instr->prev->opcode->num : -1;
+static void EmitFusedBranch(X64Emitter& e, const T& i,
+                            bool branch_if_true = true) {
+  const Instr* compare = i.src1.value->def;
+  bool valid = compare &&
+               (branch_if_true || IsIntegerCompare(compare)) &&
+               (i.instr->prev == compare ||
+                AreFlagsFromCompare(i.instr, compare));
+  auto opcode = valid ? compare->opcode->num : -1;
+  if (valid && IsIntegerCompare(compare)) {
+    if (compare->src1.value->IsConstant()) {
+      opcode = SwapCompareOperands(Opcode(opcode));
+    }
+    if (!branch_if_true) {
+      opcode = InvertCompare(Opcode(opcode));
+    }
+  }
   if (valid) {
     std::string name = i.src2.value->GetIdString();
     switch (opcode) {
@@ -59,14 +155,23 @@ static void EmitFusedBranch(X64Emitter& e, const T& i) {
         break;
       default:
         e.test(i.src1, i.src1);
-        e.jnz(std::move(name), e.T_NEAR);
+        if (branch_if_true) {
+          e.jnz(std::move(name), e.T_NEAR);
+        } else {
+          e.jz(std::move(name), e.T_NEAR);
+        }
         break;
     }
   } else {
     e.test(i.src1, i.src1);
-    e.jnz(i.src2.value->GetIdString(), e.T_NEAR);
+    if (branch_if_true) {
+      e.jnz(i.src2.value->GetIdString(), e.T_NEAR);
+    } else {
+      e.jz(i.src2.value->GetIdString(), e.T_NEAR);
+    }
   }
 }
+
 // ============================================================================
 // OPCODE_DEBUG_BREAK
 // ============================================================================
@@ -556,32 +661,28 @@ EMITTER_OPCODE_TABLE(OPCODE_BRANCH_TRUE, BRANCH_TRUE_I8, BRANCH_TRUE_I16,
 struct BRANCH_FALSE_I8
     : Sequence<BRANCH_FALSE_I8, I<OPCODE_BRANCH_FALSE, VoidOp, I8Op, LabelOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    e.test(i.src1, i.src1);
-    e.jz(i.src2.value->GetIdString(), e.T_NEAR);
+    EmitFusedBranch(e, i, false);
   }
 };
 struct BRANCH_FALSE_I16
     : Sequence<BRANCH_FALSE_I16,
                I<OPCODE_BRANCH_FALSE, VoidOp, I16Op, LabelOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    e.test(i.src1, i.src1);
-    e.jz(i.src2.value->GetIdString(), e.T_NEAR);
+    EmitFusedBranch(e, i, false);
   }
 };
 struct BRANCH_FALSE_I32
     : Sequence<BRANCH_FALSE_I32,
                I<OPCODE_BRANCH_FALSE, VoidOp, I32Op, LabelOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    e.test(i.src1, i.src1);
-    e.jz(i.src2.value->GetIdString(), e.T_NEAR);
+    EmitFusedBranch(e, i, false);
   }
 };
 struct BRANCH_FALSE_I64
     : Sequence<BRANCH_FALSE_I64,
                I<OPCODE_BRANCH_FALSE, VoidOp, I64Op, LabelOp>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    e.test(i.src1, i.src1);
-    e.jz(i.src2.value->GetIdString(), e.T_NEAR);
+    EmitFusedBranch(e, i, false);
   }
 };
 struct BRANCH_FALSE_F32
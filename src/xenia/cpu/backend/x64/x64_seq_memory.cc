@@ -20,6 +20,8 @@
 #include "xenia/cpu/backend/x64/x64_tracers.h"
 #include "xenia/cpu/ppc/ppc_context.h"
 #include "xenia/cpu/processor.h"
+#include "xenia/memory.h"
+
 DEFINE_bool(
     elide_e0_check, false,
     "Eliminate e0 check on some memory accesses, like to r13(tls) or r1(sp)",
@@ -190,6 +192,49 @@ static bool is_definitely_not_eo(const T& v) {
 
   return is_eo_def(v.value);
 }
+
+// Gets the maximum of the low 32 bits of the value where it's known from how
+// it's computed, such as for masked or zero-extended addresses, which can't be
+// in 0xE0000000+ if the maximum is below it.
+static bool get_address_upper_bound(const hir::Value* v, uint32_t* bound_out) {
+  const hir::Instr* df = v->def;
+  if (!df) {
+    return false;
+  }
+  if (df->opcode == &OPCODE_ASSIGN_info) {
+    return get_address_upper_bound(df->src1.value, bound_out);
+  }
+  if (df->opcode == &OPCODE_AND_info) {
+    for (const hir::Value* src : {df->src1.value, df->src2.value}) {
+      if (src->IsConstant()) {
+        // The low 32 bits of the union are the same for all integer types.
+        *bound_out = uint32_t(src->constant.u64);
+        return true;
+      }
+    }
+    return false;
+  }
+  if (df->opcode == &OPCODE_ZERO_EXTEND_info) {
+    switch (df->src1.value->type) {
+      case hir::INT8_TYPE:
+        *bound_out = UINT8_MAX;
+        return true;
+      case hir::INT16_TYPE:
+        *bound_out = UINT16_MAX;
+        return true;
+      default:
+        return false;
+    }
+  }
+  return false;
+}
+
+template <typename T>
+static bool is_below_e0(const T& v, int32_t offset = 0) {
+  uint32_t bound;
+  return offset >= 0 && get_address_upper_bound(v.value, &bound) &&
+         uint64_t(bound) + uint32_t(offset) < 0xE0000000;
+}
 // Note: most *should* be aligned, but needs to be checked!
 template <typename T>
 RegExp ComputeMemoryAddress(X64Emitter& e, const T& guest) {
@@ -202,7 +247,7 @@ RegExp ComputeMemoryAddress(X64Emitter& e, const T& guest) {
       return e.GetMembaseReg() + address;
     } else {
       if (address >= 0xE0000000 &&
-          xe::memory::allocation_granularity() > 0x1000) {
+          xe::memory::file_view_granularity() > 0x1000) {
         e.mov(e.eax, address + 0x1000);
       } else {
         e.mov(e.eax, address);
@@ -210,8 +255,8 @@ RegExp ComputeMemoryAddress(X64Emitter& e, const T& guest) {
       return e.GetMembaseReg() + e.rax;
     }
   } else {
-    if (xe::memory::allocation_granularity() > 0x1000 &&
-        !is_definitely_not_eo(guest)) {
+    if (xe::memory::file_view_granularity() > 0x1000 &&
+        !is_definitely_not_eo(guest) && !is_below_e0(guest)) {
       // Emulate the 4 KB physical address offset in 0xE0000000+ when can't do
       // it via memory mapping.
       Xbyak::Label& jmpback = e.NewCachedLabel();
@@ -254,7 +299,7 @@ RegExp ComputeMemoryAddressOffset(X64Emitter& e, const T& guest,
       return e.GetMembaseReg() + address;
     } else {
       if (address >= 0xE0000000 &&
-          xe::memory::allocation_granularity() > 0x1000) {
+          xe::memory::file_view_granularity() > 0x1000) {
         e.mov(e.eax, address + 0x1000);
       } else {
         e.mov(e.eax, address);
@@ -262,8 +307,8 @@ RegExp ComputeMemoryAddressOffset(X64Emitter& e, const T& guest,
       return e.GetMembaseReg() + e.rax;
     }
   } else {
-    if (xe::memory::allocation_granularity() > 0x1000 &&
-        !is_definitely_not_eo(guest)) {
+    if (xe::memory::file_view_granularity() > 0x1000 &&
+        !is_definitely_not_eo(guest) && !is_below_e0(guest, offset_const)) {
       // Emulate the 4 KB physical address offset in 0xE0000000+ when can't do
       // it via memory mapping.
 
@@ -483,21 +528,51 @@ struct STVR_V128 : Sequence<STVR_V128, I<OPCODE_STVR, VoidOp, I64Op, V128Op>> {
 };
 EMITTER_OPCODE_TABLE(OPCODE_STVR, STVR_V128);
 
+// ============================================================================
+// OPCODE_RESERVED_LOAD / OPCODE_RESERVED_STORE
+// ============================================================================
+// See ReserveHelper for how reservations work.
+
+// rdx = address of the version of the line containing the guest address,
+// clobbers ecx.
+template <typename T>
+static void EmitReserveVersionAddress(X64Emitter& e, const T& guest) {
+  if (guest.is_constant) {
+    e.mov(e.ecx, static_cast<uint32_t>(guest.constant()));
+  } else {
+    e.mov(e.ecx, guest.reg().cvt32());
+  }
+  e.shr(e.ecx, RESERVE_BLOCK_SHIFT);
+  e.and_(e.ecx, static_cast<uint32_t>(RESERVE_NUM_ENTRIES - 1));
+  e.mov(e.rdx,
+        e.GetBackendCtxPtr(offsetof(X64BackendContext, reserve_helper_)));
+  e.lea(e.rdx, e.ptr[e.rdx + e.rcx * 4]);
+}
+
+template <typename T>
+static void EmitReservedLoad(X64Emitter& e, const T& i) {
+  // should use phys addrs, not virtual addrs!
+  e.lea(e.rax, e.ptr[ComputeMemoryAddress(e, i.src1)]);
+  // begin acquiring exclusive access to the location
+  // we will do a load first, but we'll need exclusive access once we do our
+  // atomic op in the store
+  e.prefetchw(e.ptr[e.rax]);
+  EmitReserveVersionAddress(e, i.src1);
+  // The version must be read before the value, x86 doesn't reorder loads.
+  e.mov(e.ecx, e.dword[e.rdx]);
+  e.mov(e.GetBackendCtxPtr(offsetof(X64BackendContext, cached_reserve_version)),
+        e.ecx);
+  e.mov(e.GetBackendCtxPtr(offsetof(X64BackendContext, cached_reserve_address)),
+        e.rax);
+  // A previous reservation that wasn't used by a store is simply replaced.
+  e.bts(e.GetBackendFlagsPtr(), kX64BackendHasReserveBit);
+}
+
 struct RESERVED_LOAD_INT32
     : Sequence<RESERVED_LOAD_INT32, I<OPCODE_RESERVED_LOAD, I32Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    // should use phys addrs, not virtual addrs!
-
-    // try_acquire_reservation_helper_ doesnt spoil rax
-    e.lea(e.rax, e.ptr[ComputeMemoryAddress(e, i.src1)]);
-    // begin acquiring exclusive access to the location
-    // we will do a load first, but we'll need exclusive access once we do our
-    // atomic op in the store
-    e.prefetchw(e.ptr[e.rax]);
-    e.mov(e.ecx, i.src1.reg().cvt32());
-    e.call(e.backend()->try_acquire_reservation_helper_);
+    EmitReservedLoad(e, i);
     e.mov(i.dest, e.dword[e.rax]);
-
     e.mov(
         e.GetBackendCtxPtr(offsetof(X64BackendContext, cached_reserve_value_)),
         i.dest.reg().cvt64());
@@ -507,17 +582,8 @@ struct RESERVED_LOAD_INT32
 struct RESERVED_LOAD_INT64
     : Sequence<RESERVED_LOAD_INT64, I<OPCODE_RESERVED_LOAD, I64Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    // try_acquire_reservation_helper_ doesnt spoil rax
-    e.lea(e.rax, e.ptr[ComputeMemoryAddress(e, i.src1)]);
-    e.mov(e.ecx, i.src1.reg().cvt32());
-    // begin acquiring exclusive access to the location
-    // we will do a load first, but we'll need exclusive access once we do our
-    // atomic op in the store
-    e.prefetchw(e.ptr[e.rax]);
-
-    e.call(e.backend()->try_acquire_reservation_helper_);
-    e.mov(i.dest, e.qword[ComputeMemoryAddress(e, i.src1)]);
-
+    EmitReservedLoad(e, i);
+    e.mov(i.dest, e.qword[e.rax]);
     e.mov(
         e.GetBackendCtxPtr(offsetof(X64BackendContext, cached_reserve_value_)),
         i.dest.reg());
@@ -527,21 +593,48 @@ struct RESERVED_LOAD_INT64
 EMITTER_OPCODE_TABLE(OPCODE_RESERVED_LOAD, RESERVED_LOAD_INT32,
                      RESERVED_LOAD_INT64);
 
+// Leaves r9 = host address, rax = the value loaded with the reservation,
+// jumps to fail if the reservation is gone. The reservation is cleared either
+// way.
+template <typename T>
+static void EmitReservedStoreClaim(X64Emitter& e, const T& i,
+                                   Xbyak::Label& fail) {
+  e.lea(e.r9, e.ptr[ComputeMemoryAddress(e, i.src1)]);
+  e.btr(e.GetBackendFlagsPtr(), kX64BackendHasReserveBit);
+  e.jnc(fail, e.T_NEAR);
+  e.cmp(e.GetBackendCtxPtr(offsetof(X64BackendContext, cached_reserve_address)),
+        e.r9);
+  e.jnz(fail, e.T_NEAR);
+  EmitReserveVersionAddress(e, i.src1);
+  // Advance the version of the line, fails if another reserved store to it
+  // succeeded since our load.
+  e.mov(e.eax, e.GetBackendCtxPtr(
+                   offsetof(X64BackendContext, cached_reserve_version)));
+  e.lea(e.ecx, e.ptr[e.rax + 1]);
+  e.lock();
+  e.cmpxchg(e.dword[e.rdx], e.ecx);
+  e.jnz(fail, e.T_NEAR);
+  e.mov(e.rax,
+        e.GetBackendCtxPtr(offsetof(X64BackendContext, cached_reserve_value_)));
+}
+
 // address, value
 
 struct RESERVED_STORE_INT32
     : Sequence<RESERVED_STORE_INT32,
                I<OPCODE_RESERVED_STORE, I8Op, I64Op, I32Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    // edx=guest addr
-    // r9 = host addr
-    // r8 = value
-    // if ZF is set and CF is set, we succeeded
-    e.mov(e.ecx, i.src1.reg().cvt32());
-    e.lea(e.r9, e.ptr[ComputeMemoryAddress(e, i.src1)]);
+    Xbyak::Label fail, done;
+    EmitReservedStoreClaim(e, i, fail);
     e.mov(e.r8d, i.src2);
-    e.call(e.backend()->reserved_store_32_helper);
+    // was our memory modified by kernel code or something?
+    e.lock();
+    e.cmpxchg(e.dword[e.r9], e.r8d);
     e.setz(i.dest);
+    e.jmp(done);
+    e.L(fail);
+    e.xor_(i.dest, i.dest);
+    e.L(done);
   }
 };
 
@@ -549,11 +642,16 @@ struct RESERVED_STORE_INT64
     : Sequence<RESERVED_STORE_INT64,
                I<OPCODE_RESERVED_STORE, I8Op, I64Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    e.mov(e.ecx, i.src1.reg().cvt32());
-    e.lea(e.r9, e.ptr[ComputeMemoryAddress(e, i.src1)]);
+    Xbyak::Label fail, done;
+    EmitReservedStoreClaim(e, i, fail);
     e.mov(e.r8, i.src2);
-    e.call(e.backend()->reserved_store_64_helper);
+    e.lock();
+    e.cmpxchg(e.qword[e.r9], e.r8);
     e.setz(i.dest);
+    e.jmp(done);
+    e.L(fail);
+    e.xor_(i.dest, i.dest);
+    e.L(done);
   }
 };
 
@@ -568,7 +666,7 @@ struct ATOMIC_COMPARE_EXCHANGE_I32
                I<OPCODE_ATOMIC_COMPARE_EXCHANGE, I8Op, I64Op, I32Op, I32Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     e.mov(e.eax, i.src2);
-    if (xe::memory::allocation_granularity() > 0x1000) {
+    if (xe::memory::file_view_granularity() > 0x1000) {
       // Emulate the 4 KB physical address offset in 0xE0000000+ when can't do
       // it via memory mapping.
       e.mov(e.ecx, i.src1.reg().cvt32());
@@ -598,7 +696,7 @@ struct ATOMIC_COMPARE_EXCHANGE_I64
                I<OPCODE_ATOMIC_COMPARE_EXCHANGE, I8Op, I64Op, I64Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     e.mov(e.rax, i.src2);
-    if (xe::memory::allocation_granularity() > 0x1000) {
+    if (xe::memory::file_view_granularity() > 0x1000) {
       // Emulate the 4 KB physical address offset in 0xE0000000+ when can't do
       // it via memory mapping.
       e.mov(e.ecx, i.src1.reg().cvt32());
@@ -691,7 +789,11 @@ struct STORE_LOCAL_I8
     : Sequence<STORE_LOCAL_I8, I<OPCODE_STORE_LOCAL, VoidOp, I32Op, I8Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     // e.TraceStoreI8(DATA_LOCAL, i.src1.constant, i.src2);
-    e.mov(e.byte[e.GetLocalsBase() + i.src1.constant()], i.src2);
+    if (i.src2.is_constant) {
+      e.mov(e.byte[e.GetLocalsBase() + i.src1.constant()], i.src2.constant());
+    } else {
+      e.mov(e.byte[e.GetLocalsBase() + i.src1.constant()], i.src2);
+    }
   }
 };
 
@@ -706,6 +808,8 @@ struct STORE_LOCAL_I16
     // e.TraceStoreI16(DATA_LOCAL, i.src1.constant, i.src2);
     if (LocalStoreMayUseMembaseLow(e, i)) {
       e.mov(e.word[e.GetLocalsBase() + i.src1.constant()], e.GetMembaseReg().cvt16());
+    } else if (i.src2.is_constant) {
+      e.mov(e.word[e.GetLocalsBase() + i.src1.constant()], i.src2.constant());
     } else {
       e.mov(e.word[e.GetLocalsBase() + i.src1.constant()], i.src2);
     }
@@ -717,6 +821,8 @@ struct STORE_LOCAL_I32
     // e.TraceStoreI32(DATA_LOCAL, i.src1.constant, i.src2);
     if (LocalStoreMayUseMembaseLow(e, i)) {
       e.mov(e.dword[e.GetLocalsBase() + i.src1.constant()], e.GetMembaseReg().cvt32());
+    } else if (i.src2.is_constant) {
+      e.mov(e.dword[e.GetLocalsBase() + i.src1.constant()], i.src2.constant());
     } else {
       e.mov(e.dword[e.GetLocalsBase() + i.src1.constant()], i.src2);
     }
@@ -729,6 +835,8 @@ struct STORE_LOCAL_I64
     if (i.src2.is_constant && i.src2.constant() == 0) {
       e.xor_(e.eax, e.eax);
       e.mov(e.qword[e.GetLocalsBase() + i.src1.constant()], e.rax);
+    } else if (i.src2.is_constant) {
+      e.MovMem64(e.GetLocalsBase() + i.src1.constant(), i.src2.constant());
     } else {
       e.mov(e.qword[e.GetLocalsBase() + i.src1.constant()], i.src2);
     }
@@ -738,21 +846,36 @@ struct STORE_LOCAL_F32
     : Sequence<STORE_LOCAL_F32, I<OPCODE_STORE_LOCAL, VoidOp, I32Op, F32Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     // e.TraceStoreF32(DATA_LOCAL, i.src1.constant, i.src2);
-    e.vmovss(e.dword[e.GetLocalsBase() + i.src1.constant()], i.src2);
+    if (i.src2.is_constant) {
+      e.mov(e.dword[e.GetLocalsBase() + i.src1.constant()],
+            i.src2.value->constant.i32);
+    } else {
+      e.vmovss(e.dword[e.GetLocalsBase() + i.src1.constant()], i.src2);
+    }
   }
 };
 struct STORE_LOCAL_F64
     : Sequence<STORE_LOCAL_F64, I<OPCODE_STORE_LOCAL, VoidOp, I32Op, F64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     // e.TraceStoreF64(DATA_LOCAL, i.src1.constant, i.src2);
-    e.vmovsd(e.qword[e.GetLocalsBase() + i.src1.constant()], i.src2);
+    if (i.src2.is_constant) {
+      e.MovMem64(e.GetLocalsBase() + i.src1.constant(),
+                 i.src2.value->constant.i64);
+    } else {
+      e.vmovsd(e.qword[e.GetLocalsBase() + i.src1.constant()], i.src2);
+    }
   }
 };
 struct STORE_LOCAL_V128
     : Sequence<STORE_LOCAL_V128, I<OPCODE_STORE_LOCAL, VoidOp, I32Op, V128Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     // e.TraceStoreV128(DATA_LOCAL, i.src1.constant, i.src2);
-    e.vmovaps(e.ptr[e.GetLocalsBase() + i.src1.constant()], i.src2);
+    if (i.src2.is_constant) {
+      e.LoadConstantXmm(e.xmm0, i.src2.constant());
+      e.vmovaps(e.ptr[e.GetLocalsBase() + i.src1.constant()], e.xmm0);
+    } else {
+      e.vmovaps(e.ptr[e.GetLocalsBase() + i.src1.constant()], i.src2);
+    }
   }
 };
 EMITTER_OPCODE_TABLE(OPCODE_STORE_LOCAL, STORE_LOCAL_I8, STORE_LOCAL_I16,
@@ -1125,6 +1248,7 @@ struct LOAD_MMIO_I32
     auto mmio_range = reinterpret_cast<MMIORange*>(i.src1.value);
     auto read_address = uint32_t(i.src2.value);
     e.mov(e.GetNativeParam(0), uint64_t(mmio_range->callback_context));
+    e.MarkNotPersistable();
     e.mov(e.GetNativeParam(1).cvt32(), read_address);
     e.CallNativeSafe(reinterpret_cast<void*>(mmio_range->read));
     e.bswap(e.eax);
@@ -1150,6 +1274,7 @@ struct STORE_MMIO_I32
     auto mmio_range = reinterpret_cast<MMIORange*>(i.src1.value);
     auto write_address = uint32_t(i.src2.value);
     e.mov(e.GetNativeParam(0), uint64_t(mmio_range->callback_context));
+    e.MarkNotPersistable();
     e.mov(e.GetNativeParam(1).cvt32(), write_address);
     if (i.src3.is_constant) {
       e.mov(e.GetNativeParam(2).cvt32(), xe::byte_swap(i.src3.constant()));
@@ -1562,7 +1687,11 @@ struct LOAD_V128 : Sequence<LOAD_V128, I<OPCODE_LOAD, V128Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddress(e, i.src1);
     // TODO(benvanik): we should try to stick to movaps if possible.
-    e.vmovdqa(i.dest, e.ptr[addr]);
+    if (i.instr->flags & LoadStoreFlags::LOAD_STORE_UNALIGNED) {
+      e.vmovdqu(i.dest, e.ptr[addr]);
+    } else {
+      e.vmovdqa(i.dest, e.ptr[addr]);
+    }
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       // TODO(benvanik): find a way to do this without the memory load.
       e.vpshufb(i.dest, i.dest, e.GetXmmConstPtr(XMMByteSwapMask));
@@ -1737,19 +1866,23 @@ struct STORE_V128
     : Sequence<STORE_V128, I<OPCODE_STORE, VoidOp, I64Op, V128Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
     auto addr = ComputeMemoryAddress(e, i.src1);
+    Xmm src;
     if (i.instr->flags & LoadStoreFlags::LOAD_STORE_BYTE_SWAP) {
       assert_false(i.src2.is_constant);
       e.vpshufb(e.xmm0, i.src2, e.GetXmmConstPtr(XMMByteSwapMask));
       // changed from vmovaps, the penalty on the vpshufb is unavoidable but
       // we dont need to incur another here too
-      e.vmovdqa(e.ptr[addr], e.xmm0);
+      src = e.xmm0;
+    } else if (i.src2.is_constant) {
+      e.LoadConstantXmm(e.xmm0, i.src2.constant());
+      src = e.xmm0;
     } else {
-      if (i.src2.is_constant) {
-        e.LoadConstantXmm(e.xmm0, i.src2.constant());
-        e.vmovdqa(e.ptr[addr], e.xmm0);
-      } else {
-        e.vmovdqa(e.ptr[addr], i.src2);
-      }
+      src = i.src2;
+    }
+    if (i.instr->flags & LoadStoreFlags::LOAD_STORE_UNALIGNED) {
+      e.vmovdqu(e.ptr[addr], src);
+    } else {
+      e.vmovdqa(e.ptr[addr], src);
     }
     if (IsTracingData()) {
       addr = ComputeMemoryAddress(e, i.src1);
@@ -1803,7 +1936,7 @@ struct CACHE_CONTROL
         addr = e.GetMembaseReg() + address_constant;
       } else {
         if (address_constant >= 0xE0000000 &&
-            xe::memory::allocation_granularity() > 0x1000) {
+            xe::memory::file_view_granularity() > 0x1000) {
           e.mov(e.eax, address_constant + 0x1000);
         } else {
           e.mov(e.eax, address_constant);
@@ -1811,7 +1944,7 @@ struct CACHE_CONTROL
         addr = e.GetMembaseReg() + e.rax;
       }
     } else {
-      if (xe::memory::allocation_granularity() > 0x1000) {
+      if (xe::memory::file_view_granularity() > 0x1000) {
         // Emulate the 4 KB physical address offset in 0xE0000000+ when can't
         // do it via memory mapping.
         e.mov(e.eax, i.src1.reg().cvt32());
@@ -1883,48 +2016,107 @@ EMITTER_OPCODE_TABLE(OPCODE_MEMORY_BARRIER, MEMORY_BARRIER);
 // ============================================================================
 // OPCODE_MEMSET
 // ============================================================================
+// Lets the physical memory watches know about the whole range at once instead
+// of taking an access violation for every watched page.
+static void TriggerWriteWatches(ppc::PPCContext* context, uint32_t address,
+                                uint32_t length) {
+  Memory* memory = context->processor->memory();
+  if (memory->LookupHeap(address)->heap_type() != HeapType::kGuestPhysical) {
+    return;
+  }
+  memory->TriggerPhysicalMemoryCallbacks(
+      global_critical_region::AcquireDirect(), address, length, true, false);
+}
+
+static void MemsetHelper(void* raw_context, uint64_t address, uint64_t value,
+                         uint64_t length) {
+  auto context = reinterpret_cast<ppc::PPCContext*>(raw_context);
+  TriggerWriteWatches(context, uint32_t(address), uint32_t(length));
+  std::memset(context->TranslateVirtual(uint32_t(address)), int(value & 0xFF),
+              size_t(length));
+}
+
 struct MEMSET_I64_I8_I64
     : Sequence<MEMSET_I64_I8_I64,
                I<OPCODE_MEMSET, VoidOp, I64Op, I8Op, I64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    assert_true(i.src2.is_constant);
-    assert_true(i.src3.is_constant);
-    assert_true(i.src2.constant() == 0);
-    e.vpxor(e.xmm0, e.xmm0);
-    auto addr = ComputeMemoryAddress(e, i.src1);
-    /*
-        chrispy: changed to vmovdqa, the mismatch between vpxor and vmovaps
-       was causing a 1 cycle stall before the first store
-    */
-    switch (i.src3.constant()) {
-      case 32:
-
-        e.vmovdqa(e.ptr[addr], e.ymm0);
-        break;
-      case 128:
-        // probably should lea the address beforehand
-        e.vmovdqa(e.ptr[addr + 0 * 16], e.ymm0);
-
-        e.vmovdqa(e.ptr[addr + 2 * 16], e.ymm0);
+    if (i.src2.is_constant && i.src2.constant() == 0 && i.src3.is_constant &&
+        !(i.src3.constant() & 31) && i.src3.constant() <= 512) {
+      // Zeroing of cache blocks, possibly several combined.
+      e.vpxor(e.xmm0, e.xmm0);
+      auto addr = ComputeMemoryAddress(e, i.src1);
+      /*
+          chrispy: changed to vmovdqa, the mismatch between vpxor and vmovaps
+         was causing a 1 cycle stall before the first store
+      */
+      for (int64_t offset = 0; offset < i.src3.constant(); offset += 32) {
+        e.vmovdqa(e.ptr[addr + uint32_t(offset)], e.ymm0);
+      }
+      if (IsTracingData()) {
+        addr = ComputeMemoryAddress(e, i.src1);
+        e.mov(e.GetNativeParam(2), i.src3.constant());
+        e.mov(e.GetNativeParam(1), i.src2.constant());
+        e.lea(e.GetNativeParam(0), e.ptr[addr]);
+        e.CallNative(reinterpret_cast<void*>(TraceMemset));
+      }
+      return;
+    }
+    // Fills lowered from guest loops, of any length.
+    if (i.src1.is_constant) {
+      e.mov(e.GetNativeParam(0), uint32_t(i.src1.constant()));
+    } else {
+      e.mov(e.GetNativeParam(0).cvt32(), i.src1.reg().cvt32());
+    }
+    if (i.src2.is_constant) {
+      e.mov(e.GetNativeParam(1), uint8_t(i.src2.constant()));
+    } else {
+      e.movzx(e.GetNativeParam(1).cvt32(), i.src2.reg());
+    }
+    if (i.src3.is_constant) {
+      e.mov(e.GetNativeParam(2), i.src3.constant());
+    } else {
+      e.mov(e.GetNativeParam(2), i.src3.reg());
+    }
+    e.CallNative(reinterpret_cast<void*>(MemsetHelper));
+  }
+};
+EMITTER_OPCODE_TABLE(OPCODE_MEMSET, MEMSET_I64_I8_I64);
 
-        e.vmovdqa(e.ptr[addr + 4 * 16], e.ymm0);
+// ============================================================================
+// OPCODE_MEMCPY
+// ============================================================================
+static void MemcpyHelper(void* raw_context, uint64_t dest_address,
+                         uint64_t src_address, uint64_t length) {
+  auto context = reinterpret_cast<ppc::PPCContext*>(raw_context);
+  TriggerWriteWatches(context, uint32_t(dest_address), uint32_t(length));
+  std::memcpy(context->TranslateVirtual(uint32_t(dest_address)),
+              context->TranslateVirtual(uint32_t(src_address)),
+              size_t(length));
+}
 
-        e.vmovdqa(e.ptr[addr + 6 * 16], e.ymm0);
-        break;
-      default:
-        assert_unhandled_case(i.src3.constant());
-        break;
+struct MEMCPY_I64_I64_I64
+    : Sequence<MEMCPY_I64_I64_I64,
+               I<OPCODE_MEMCPY, VoidOp, I64Op, I64Op, I64Op>> {
+  static void Emit(X64Emitter& e, const EmitArgType& i) {
+    if (i.src1.is_constant) {
+      e.mov(e.GetNativeParam(0), uint32_t(i.src1.constant()));
+    } else {
+      e.mov(e.GetNativeParam(0).cvt32(), i.src1.reg().cvt32());
     }
-    if (IsTracingData()) {
-      addr = ComputeMemoryAddress(e, i.src1);
+    if (i.src2.is_constant) {
+      e.mov(e.GetNativeParam(1), uint32_t(i.src2.constant()));
+    } else {
+      e.mov(e.GetNativeParam(1).cvt32(), i.src2.reg().cvt32());
+    }
+    if (i.src3.is_constant) {
       e.mov(e.GetNativeParam(2), i.src3.constant());
-      e.mov(e.GetNativeParam(1), i.src2.constant());
-      e.lea(e.GetNativeParam(0), e.ptr[addr]);
-      e.CallNative(reinterpret_cast<void*>(TraceMemset));
+    } else {
+      e.mov(e.GetNativeParam(2), i.src3.reg());
     }
+    e.CallNative(reinterpret_cast<void*>(MemcpyHelper));
   }
 };
-EMITTER_OPCODE_TABLE(OPCODE_MEMSET, MEMSET_I64_I8_I64);
+EMITTER_OPCODE_TABLE(OPCODE_MEMCPY, MEMCPY_I64_I64_I64);
 
 }  // namespace x64
 }  // namespace backend
@@ -880,6 +880,62 @@ static XmmConst GetShiftmaskForType(unsigned typ) {
     return XMMXOPDwordShiftMask;
   }
 }
+
+enum class VectorShiftKind { kLeft, kRightLogical, kRightArithmetic };
+
+// Per-element byte and word shifts with AVX-512BW, which has variable word
+// shift instructions, bytes are widened to words and narrowed back with
+// vpmovwb. Counts are masked the same way VMX does it.
+template <typename T>
+static bool EmitAVX512VectorShift(X64Emitter& e, const T& i,
+                                  VectorShiftKind kind) {
+  if (!e.IsFeatureEnabled(kX64EmitAVX512Ortho | kX64EmitAVX512BW)) {
+    return false;
+  }
+  unsigned type = i.instr->flags;
+  if (type != INT8_TYPE && type != INT16_TYPE) {
+    return false;
+  }
+  const Xmm& dest = i.dest;
+  Xmm src1 = GetInputRegOrConstant(e, i.src1, e.xmm0);
+  Xmm src2 = GetInputRegOrConstant(e, i.src2, e.xmm1);
+  e.vpand(e.xmm1, src2, e.GetXmmConstPtr(GetShiftmaskForType(type)));
+  if (type == INT16_TYPE) {
+    switch (kind) {
+      case VectorShiftKind::kLeft:
+        e.vpsllvw(dest, src1, e.xmm1);
+        break;
+      case VectorShiftKind::kRightLogical:
+        e.vpsrlvw(dest, src1, e.xmm1);
+        break;
+      case VectorShiftKind::kRightArithmetic:
+        e.vpsravw(dest, src1, e.xmm1);
+        break;
+    }
+    return true;
+  }
+  if (kind == VectorShiftKind::kRightArithmetic) {
+    e.vpmovsxbw(e.ymm0, src1);
+  } else {
+    e.vpmovzxbw(e.ymm0, src1);
+  }
+  e.vpmovzxbw(e.ymm1, e.xmm1);
+  switch (kind) {
+    case VectorShiftKind::kLeft:
+      e.vpsllvw(e.ymm0, e.ymm0, e.ymm1);
+      break;
+    case VectorShiftKind::kRightLogical:
+      e.vpsrlvw(e.ymm0, e.ymm0, e.ymm1);
+      break;
+    case VectorShiftKind::kRightArithmetic:
+      e.vpsravw(e.ymm0, e.ymm0, e.ymm1);
+      break;
+  }
+  // Truncation, the results of arithmetic shifts fit in a byte too.
+  e.vpmovwb(dest, e.ymm0);
+  return true;
+}
+
 struct VECTOR_SHL_V128
     : Sequence<VECTOR_SHL_V128, I<OPCODE_VECTOR_SHL, V128Op, V128Op, V128Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
@@ -921,7 +977,9 @@ struct VECTOR_SHL_V128
   }
 
   static void EmitInt8(X64Emitter& e, const EmitArgType& i) {
-    // TODO(benvanik): native version (with shift magic).
+    if (EmitAVX512VectorShift(e, i, VectorShiftKind::kLeft)) {
+      return;
+    }
 
     if (e.IsFeatureEnabled(kX64EmitAVX2)) {
       if (!i.src2.is_constant) {
@@ -1063,6 +1121,10 @@ struct VECTOR_SHL_V128
       }
     }
 
+    if (EmitAVX512VectorShift(e, i, VectorShiftKind::kLeft)) {
+      return;
+    }
+
     // Shift 8 words in src1 by amount specified in src2.
     Xbyak::Label emu, end;
 
@@ -1281,6 +1343,9 @@ struct VECTOR_SHR_V128
         return;
       }
     }
+    if (EmitAVX512VectorShift(e, i, VectorShiftKind::kRightLogical)) {
+      return;
+    }
     unsigned stack_offset_src1 = StackLayout::GUEST_SCRATCH;
     unsigned stack_offset_src2 = StackLayout::GUEST_SCRATCH + 16;
 
@@ -1338,6 +1403,10 @@ struct VECTOR_SHR_V128
       }
     }
 
+    if (EmitAVX512VectorShift(e, i, VectorShiftKind::kRightLogical)) {
+      return;
+    }
+
     // Shift 8 words in src1 by amount specified in src2.
     Xbyak::Label emu, end;
 
@@ -1582,7 +1651,13 @@ struct VECTOR_SHA_V128
         e.vpacksswb(i.dest, e.xmm0, e.xmm1);
         return;
       }
+    }
 
+    if (EmitAVX512VectorShift(e, i, VectorShiftKind::kRightArithmetic)) {
+      return;
+    }
+
+    if (i.src2.is_constant) {
       e.StashConstantXmm(1, i.src2.constant());
       stack_offset_src2 = X64Emitter::kStashOffset + 16;
     } else {
@@ -1637,6 +1712,10 @@ struct VECTOR_SHA_V128
       }
     }
 
+    if (EmitAVX512VectorShift(e, i, VectorShiftKind::kRightArithmetic)) {
+      return;
+    }
+
     // Shift 8 words in src1 by amount specified in src2.
     Xbyak::Label emu, end;
 
@@ -2171,7 +2250,7 @@ struct EXTRACT_I32
       e.mov(e.al, i.src2);
       e.and_(e.al, 0x03);
       e.shl(e.al, 4);
-      e.mov(e.rdx, reinterpret_cast<uint64_t>(extract_table_32));
+      e.MovHostAddress(e.rdx, extract_table_32);
       e.vmovaps(e.xmm0, e.ptr[e.rdx + e.rax]);
       e.vpshufb(e.xmm0, src1, e.xmm0);
       e.vpextrd(i.dest, e.xmm0, 0);
@@ -87,6 +87,7 @@ struct COMMENT : Sequence<COMMENT, I<OPCODE_COMMENT, VoidOp, OffsetOp>> {
       auto str_copy = strdup(str);
       e.mov(e.rdx, reinterpret_cast<uint64_t>(str_copy));
       e.CallNative(reinterpret_cast<void*>(TraceString));
+      e.MarkNotPersistable();
     }
   }
 };
@@ -496,6 +497,8 @@ struct LOAD_CLOCK : Sequence<LOAD_CLOCK, I<OPCODE_LOAD_CLOCK, I64Op>> {
       // frame overhead.
       if (cvars::clock_no_scaling && cvars::clock_source_raw) {
         auto ratio = Clock::guest_tick_ratio();
+        // The ratio depends on the host clock frequency.
+        e.MarkNotPersistable();
         // The 360 CPU is an in-order CPU, AMD64 usually isn't. Without
         // mfence/lfence magic the rdtsc instruction can be executed sooner or
         // later in the cache window. Since it's resolution however is much
@@ -831,7 +834,7 @@ EMITTER_OPCODE_TABLE(OPCODE_SELECT, SELECT_I8, SELECT_I16, SELECT_I32,
                      SELECT_I64, SELECT_F32, SELECT_F64, SELECT_V128_I8,
                      SELECT_V128_V128);
 
-static const hir::Instr* GetFirstPrecedingInstrWithPossibleFlagEffects(
+const hir::Instr* GetFirstPrecedingInstrWithPossibleFlagEffects(
     const hir::Instr* i) {
   Opcode iop;
 
@@ -1328,7 +1331,8 @@ struct ADD_F64 : Sequence<ADD_F64, I<OPCODE_ADD, F64Op, F64Op, F64Op>> {
 };
 struct ADD_V128 : Sequence<ADD_V128, I<OPCODE_ADD, V128Op, V128Op, V128Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    e.ChangeMxcsrMode(MXCSRMode::Vmx);
+    e.ChangeMxcsrMode(i.instr->flags & ARITHMETIC_FPU_MODE ? MXCSRMode::Fpu
+                                                           : MXCSRMode::Vmx);
 
     Xmm src1 = GetInputRegOrConstant(e, i.src1, e.xmm0);
     Xmm src2 = GetInputRegOrConstant(e, i.src2, e.xmm1);
@@ -1446,8 +1450,9 @@ struct SUB_F64 : Sequence<SUB_F64, I<OPCODE_SUB, F64Op, F64Op, F64Op>> {
 };
 struct SUB_V128 : Sequence<SUB_V128, I<OPCODE_SUB, V128Op, V128Op, V128Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    assert_true(!i.instr->flags);
-    e.ChangeMxcsrMode(MXCSRMode::Vmx);
+    assert_true(!(i.instr->flags & ~ARITHMETIC_FPU_MODE));
+    e.ChangeMxcsrMode(i.instr->flags & ARITHMETIC_FPU_MODE ? MXCSRMode::Fpu
+                                                           : MXCSRMode::Vmx);
     Xmm src1 = GetInputRegOrConstant(e, i.src1, e.xmm0);
     Xmm src2 = GetInputRegOrConstant(e, i.src2, e.xmm1);
     e.vsubps(i.dest, src1, src2);
@@ -1588,8 +1593,9 @@ struct MUL_F64 : Sequence<MUL_F64, I<OPCODE_MUL, F64Op, F64Op, F64Op>> {
 };
 struct MUL_V128 : Sequence<MUL_V128, I<OPCODE_MUL, V128Op, V128Op, V128Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
-    assert_true(!i.instr->flags);
-    e.ChangeMxcsrMode(MXCSRMode::Vmx);
+    assert_true(!(i.instr->flags & ~ARITHMETIC_FPU_MODE));
+    e.ChangeMxcsrMode(i.instr->flags & ARITHMETIC_FPU_MODE ? MXCSRMode::Fpu
+                                                           : MXCSRMode::Vmx);
     Xmm src1 = GetInputRegOrConstant(e, i.src1, e.xmm0);
     Xmm src2 = GetInputRegOrConstant(e, i.src2, e.xmm1);
     e.vmulps(i.dest, src1, src2);
@@ -1877,11 +1883,44 @@ EMITTER_OPCODE_TABLE(OPCODE_DIV, DIV_I8, DIV_I16, DIV_I32, DIV_I64, DIV_F32,
 // OPCODE_MUL_ADD
 // ============================================================================
 // d = 1 * 2 + 3
-// $0 = $1x$0 + $2
-// Forms of vfmadd/vfmsub:
+// Forms of vfmadd/vfmsub/vfnmadd/vfnmsub:
 // - 132 -> $1 = $1 * $3 + $2
 // - 213 -> $1 = $2 * $1 + $3
 // - 231 -> $1 = $2 * $3 + $1
+using FusedMulAddFn = void (Xbyak::CodeGenerator::*)(const Xbyak::Xmm&,
+                                                     const Xbyak::Xmm&,
+                                                     const Xbyak::Operand&);
+// Picks the form which doesn't need a copy when the destination is one of the
+// sources - the multiplication is commutative, so either multiplicand can be
+// the one overwritten with the 213 form.
+static void EmitFusedMulAdd(X64Emitter& e, const Xmm& dest, const Xmm& src1,
+                            const Xmm& src2, const Xmm& src3,
+                            FusedMulAddFn fn213, FusedMulAddFn fn231) {
+  if (dest.getIdx() == src1.getIdx()) {
+    (e.*fn213)(dest, src2, src3);
+  } else if (dest.getIdx() == src2.getIdx()) {
+    (e.*fn213)(dest, src1, src3);
+  } else if (dest.getIdx() == src3.getIdx()) {
+    (e.*fn231)(dest, src1, src2);
+  } else {
+    e.vmovaps(dest, src1);
+    (e.*fn213)(dest, src2, src3);
+  }
+}
+// Negation of the result of a vector MUL_ADD or MUL_SUB immediately following
+// it, as emitted for vnmsubfp. VMX always rounds to nearest, which is
+// symmetric, so negating the fused result is the same as the negated fused
+// forms (vfnmadd and vfnmsub), and the negation can be merged into them.
+static Instr* GetFusibleVectorNegation(const Instr* i) {
+  if (!i->dest->HasSingleUse()) {
+    return nullptr;
+  }
+  Instr* use = i->dest->use_head->instr;
+  if (use->opcode != &OPCODE_NEG_info || use->GetNonFakePrev() != i) {
+    return nullptr;
+  }
+  return use;
+}
 struct MUL_ADD_F32
     : Sequence<MUL_ADD_F32, I<OPCODE_MUL_ADD, F32Op, F32Op, F32Op, F32Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
@@ -1899,10 +1938,9 @@ struct MUL_ADD_F64
     Xmm src2 = GetInputRegOrConstant(e, i.src2, e.xmm1);
     Xmm src3 = GetInputRegOrConstant(e, i.src3, e.xmm2);
     if (e.IsFeatureEnabled(kX64EmitFMA)) {
-      // todo: this is garbage
-      e.vmovapd(e.xmm3, src1);
-      e.vfmadd213sd(e.xmm3, src2, src3);
-      e.vmovapd(i.dest, e.xmm3);
+      EmitFusedMulAdd(e, i.dest, src1, src2, src3,
+                      &Xbyak::CodeGenerator::vfmadd213sd,
+                      &Xbyak::CodeGenerator::vfmadd231sd);
     } else {
       // todo: might need to use x87 in this case...
       e.vmulsd(e.xmm3, src1, src2);
@@ -1920,10 +1958,19 @@ struct MUL_ADD_V128
     Xmm src2 = GetInputRegOrConstant(e, i.src2, e.xmm1);
     Xmm src3 = GetInputRegOrConstant(e, i.src3, e.xmm2);
     if (e.IsFeatureEnabled(kX64EmitFMA)) {
-      // todo: this is garbage
-      e.vmovaps(e.xmm3, src1);
-      e.vfmadd213ps(e.xmm3, src2, src3);
-      e.vmovaps(i.dest, e.xmm3);
+      if (Instr* negation = GetFusibleVectorNegation(i.instr)) {
+        // -(1 * 2 + 3) = -(1 * 2) - 3
+        Xmm dest;
+        X64Emitter::SetupReg(negation->dest, dest);
+        negation->backend_flags |= INSTR_X64_FLAGS_ELIMINATED;
+        EmitFusedMulAdd(e, dest, src1, src2, src3,
+                        &Xbyak::CodeGenerator::vfnmsub213ps,
+                        &Xbyak::CodeGenerator::vfnmsub231ps);
+      } else {
+        EmitFusedMulAdd(e, i.dest, src1, src2, src3,
+                        &Xbyak::CodeGenerator::vfmadd213ps,
+                        &Xbyak::CodeGenerator::vfmadd231ps);
+      }
     } else {
       // todo: might need to use x87 in this case...
       e.vmulps(e.xmm3, src1, src2);
@@ -1937,15 +1984,7 @@ EMITTER_OPCODE_TABLE(OPCODE_MUL_ADD, MUL_ADD_F32, MUL_ADD_F64, MUL_ADD_V128);
 // OPCODE_MUL_SUB
 // ============================================================================
 // d = 1 * 2 - 3
-// $0 = $2x$0 - $3
-// TODO(benvanik): use other forms (132/213/etc) to avoid register shuffling.
-// dest could be src2 or src3 - need to ensure it's not before overwriting dest
-// perhaps use other 132/213/etc
-// Forms:
-// - 132 -> $1 = $1 * $3 - $2
-// - 213 -> $1 = $2 * $1 - $3
-// - 231 -> $1 = $2 * $3 - $1
-
+// Forms as for OPCODE_MUL_ADD.
 struct MUL_SUB_F64
     : Sequence<MUL_SUB_F64, I<OPCODE_MUL_SUB, F64Op, F64Op, F64Op, F64Op>> {
   static void Emit(X64Emitter& e, const EmitArgType& i) {
@@ -1955,10 +1994,9 @@ struct MUL_SUB_F64
     Xmm src2 = GetInputRegOrConstant(e, i.src2, e.xmm1);
     Xmm src3 = GetInputRegOrConstant(e, i.src3, e.xmm2);
     if (e.IsFeatureEnabled(kX64EmitFMA)) {
-      // todo: this is garbage
-      e.vmovapd(e.xmm3, src1);
-      e.vfmsub213sd(e.xmm3, src2, src3);
-      e.vmovapd(i.dest, e.xmm3);
+      EmitFusedMulAdd(e, i.dest, src1, src2, src3,
+                      &Xbyak::CodeGenerator::vfmsub213sd,
+                      &Xbyak::CodeGenerator::vfmsub231sd);
     } else {
       // todo: might need to use x87 in this case...
       e.vmulsd(e.xmm3, src1, src2);
@@ -1976,10 +2014,19 @@ struct MUL_SUB_V128
     Xmm src2 = GetInputRegOrConstant(e, i.src2, e.xmm1);
     Xmm src3 = GetInputRegOrConstant(e, i.src3, e.xmm2);
     if (e.IsFeatureEnabled(kX64EmitFMA)) {
-      // todo: this is garbage
-      e.vmovaps(e.xmm3, src1);
-      e.vfmsub213ps(e.xmm3, src2, src3);
-      e.vmovaps(i.dest, e.xmm3);
+      if (Instr* negation = GetFusibleVectorNegation(i.instr)) {
+        // vnmsubfp: -(1 * 2 - 3) = -(1 * 2) + 3
+        Xmm dest;
+        X64Emitter::SetupReg(negation->dest, dest);
+        negation->backend_flags |= INSTR_X64_FLAGS_ELIMINATED;
+        EmitFusedMulAdd(e, dest, src1, src2, src3,
+                        &Xbyak::CodeGenerator::vfnmadd213ps,
+                        &Xbyak::CodeGenerator::vfnmadd231ps);
+      } else {
+        EmitFusedMulAdd(e, i.dest, src1, src2, src3,
+                        &Xbyak::CodeGenerator::vfmsub213ps,
+                        &Xbyak::CodeGenerator::vfmsub231ps);
+      }
     } else {
       // todo: might need to use x87 in this case...
       e.vmulps(e.xmm3, src1, src2);
@@ -3215,7 +3262,7 @@ struct SET_ROUNDING_MODE_I32
 
       e.mov(e.ecx, i.src1);
       e.cmovc(e.edx, e.eax);
-      e.mov(e.rax, uintptr_t(mxcsr_table));
+      e.MovHostAddress(e.rax, mxcsr_table);
       e.mov(flags_ptr, e.edx);
       e.mov(e.edx, e.ptr[e.rax + e.rcx * 4]);
       // this was not here
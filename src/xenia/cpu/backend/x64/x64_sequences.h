@@ -47,6 +47,11 @@ static bool Register() {
 bool SelectSequence(X64Emitter* e, const hir::Instr* i,
                     const hir::Instr** new_tail);
 
+// Skips the instructions before i that are known to leave the host flags
+// alone, returns nullptr at the start of the block.
+const hir::Instr* GetFirstPrecedingInstrWithPossibleFlagEffects(
+    const hir::Instr* i);
+
 }  // namespace x64
 }  // namespace backend
 }  // namespace cpu
@@ -9,6 +9,7 @@
 
 #include "xenia/cpu/compiler/compiler.h"
 
+#include "xenia/base/clock.h"
 #include "xenia/base/profiling.h"
 #include "xenia/cpu/compiler/compiler_pass.h"
 
@@ -22,23 +23,61 @@ Compiler::~Compiler() { Reset(); }
 
 void Compiler::AddPass(std::unique_ptr<CompilerPass> pass) {
   pass->Initialize(this);
+#if XE_OPTION_PROFILING
+  pass_profile_tokens_.push_back(
+      MicroProfileGetToken("jit", pass->name(),
+                           xe::Profiler::GetColor(pass->name()),
+                           MicroProfileTokenTypeCpu));
+#endif  // XE_OPTION_PROFILING
   passes_.push_back(std::move(pass));
 }
 
 void Compiler::Reset() {}
 
-bool Compiler::Compile(xe::cpu::hir::HIRBuilder* builder) {
+bool Compiler::Compile(xe::cpu::hir::HIRBuilder* builder,
+                       FunctionStatistics* statistics,
+                       GuestFunction* function) {
   // TODO(benvanik): sophisticated stuff. Run passes in parallel, run until they
   //                 stop changing things, etc.
+  statistics_ = statistics;
+  function_ = function;
+  bool succeeded = true;
+  uint32_t instr_count = statistics ? CountInstructions(builder) : 0;
   for (size_t i = 0; i < passes_.size(); ++i) {
     auto& pass = passes_[i];
+#if XE_OPTION_PROFILING
+    MICROPROFILE_SCOPE_TOKEN(pass_profile_tokens_[i]);
+#endif  // XE_OPTION_PROFILING
     scratch_arena_.Reset();
+    uint64_t start_ticks = statistics ? Clock::QueryHostTickCount() : 0;
     if (!pass->Run(builder)) {
-      return false;
+      succeeded = false;
+      break;
+    }
+    if (statistics) {
+      PassStatistics pass_statistics;
+      pass_statistics.name = pass->name();
+      pass_statistics.host_ticks = Clock::QueryHostTickCount() - start_ticks;
+      pass_statistics.instr_count_before = instr_count;
+      instr_count = CountInstructions(builder);
+      pass_statistics.instr_count_after = instr_count;
+      statistics->passes.push_back(pass_statistics);
     }
   }
+  statistics_ = nullptr;
+  function_ = nullptr;
+
+  return succeeded;
+}
 
-  return true;
+uint32_t Compiler::CountInstructions(hir::HIRBuilder* builder) {
+  uint32_t count = 0;
+  for (auto block = builder->first_block(); block; block = block->next) {
+    for (auto instr = block->instr_head; instr; instr = instr->next) {
+      ++count;
+    }
+  }
+  return count;
 }
 
 }  // namespace compiler
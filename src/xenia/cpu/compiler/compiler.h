@@ -14,10 +14,13 @@
 #include <vector>
 
 #include "xenia/base/arena.h"
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compiler_statistics.h"
 #include "xenia/cpu/hir/hir_builder.h"
 
 namespace xe {
 namespace cpu {
+class GuestFunction;
 class Processor;
 }  // namespace cpu
 }  // namespace xe
@@ -40,13 +43,29 @@ class Compiler {
 
   void Reset();
 
-  bool Compile(hir::HIRBuilder* builder);
+  // Fills statistics with the times and instruction counts of the passes if
+  // it's not null. The function is what the HIR was built from, if any.
+  bool Compile(hir::HIRBuilder* builder,
+               FunctionStatistics* statistics = nullptr,
+               GuestFunction* function = nullptr);
+
+  // Statistics of the current compilation for the passes to add to, or null.
+  FunctionStatistics* statistics() const { return statistics_; }
+  // Guest function being compiled, or null.
+  GuestFunction* function() const { return function_; }
 
  private:
+  static uint32_t CountInstructions(hir::HIRBuilder* builder);
+
   Processor* processor_;
   Arena scratch_arena_;
 
   std::vector<std::unique_ptr<CompilerPass>> passes_;
+#if XE_OPTION_PROFILING
+  std::vector<MicroProfileToken> pass_profile_tokens_;
+#endif  // XE_OPTION_PROFILING
+  FunctionStatistics* statistics_ = nullptr;
+  GuestFunction* function_ = nullptr;
 };
 
 }  // namespace compiler
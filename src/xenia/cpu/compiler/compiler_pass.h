@@ -34,6 +34,9 @@ class CompilerPass {
 
   virtual bool Run(hir::HIRBuilder* builder) = 0;
 
+  // Used for profiling and statistics.
+  virtual const char* name() const = 0;
+
  protected:
   Arena* scratch_arena() const;
 
@@ -0,0 +1,117 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/compiler_statistics.h"
+
+#include <cstdio>
+#include <mutex>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/cpu/cpu_flags.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+
+static std::mutex statistics_mutex_;
+static std::vector<FunctionStatistics> statistics_;
+
+bool CompilerStatistics::enabled() {
+  return !cvars::jit_statistics_path.empty();
+}
+
+void CompilerStatistics::Record(FunctionStatistics statistics) {
+  std::lock_guard<std::mutex> lock(statistics_mutex_);
+  statistics_.push_back(std::move(statistics));
+}
+
+static void WriteJsonString(FILE* file, const std::string& str) {
+  fputc('"', file);
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      fputc('\\', file);
+      fputc(c, file);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      fprintf(file, "\\u%04X", c);
+    } else {
+      fputc(c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+bool CompilerStatistics::Dump(const std::filesystem::path& path) {
+  std::lock_guard<std::mutex> lock(statistics_mutex_);
+  FILE* file = xe::filesystem::OpenFile(path, "w");
+  if (!file) {
+    XELOGE("Failed to open {} for writing JIT statistics",
+           xe::path_to_utf8(path));
+    return false;
+  }
+  double ticks_to_us = 1000000.0 / double(Clock::QueryHostTickFrequency());
+  if (path.extension() == ".csv") {
+    fputs(
+        "guest_address,name,baseline,code_size,spill_count,"
+        "byte_swaps_eliminated,byte_swaps_fused,hir_bytes,"
+        "hir_reserved_bytes,pass,time_us,instr_count_before,"
+        "instr_count_after\n",
+        file);
+    for (const FunctionStatistics& function : statistics_) {
+      for (const PassStatistics& pass : function.passes) {
+        fprintf(file, "%08X,\"%s\",%d,%u,%u,%u,%u,%u,%u,%s,%.3f,%u,%u\n",
+                function.guest_address, function.name.c_str(),
+                function.baseline ? 1 : 0, function.code_size,
+                function.spill_count, function.byte_swaps_eliminated,
+                function.byte_swaps_fused, function.hir_bytes,
+                function.hir_reserved_bytes, pass.name,
+                double(pass.host_ticks) * ticks_to_us, pass.instr_count_before,
+                pass.instr_count_after);
+      }
+    }
+  } else {
+    fputs("[\n", file);
+    for (size_t i = 0; i < statistics_.size(); ++i) {
+      const FunctionStatistics& function = statistics_[i];
+      fprintf(file, "  {\"guest_address\": \"%08X\", \"name\": ",
+              function.guest_address);
+      WriteJsonString(file, function.name);
+      fprintf(file,
+              ", \"guest_end_address\": \"%08X\", \"baseline\": %s, "
+              "\"code_size\": %u, \"spill_count\": %u, "
+              "\"byte_swaps_eliminated\": %u, \"byte_swaps_fused\": %u, "
+              "\"hir_bytes\": %u, \"hir_reserved_bytes\": %u, \"passes\": [",
+              function.guest_end_address,
+              function.baseline ? "true" : "false", function.code_size,
+              function.spill_count, function.byte_swaps_eliminated,
+              function.byte_swaps_fused, function.hir_bytes,
+              function.hir_reserved_bytes);
+      for (size_t j = 0; j < function.passes.size(); ++j) {
+        const PassStatistics& pass = function.passes[j];
+        fprintf(file,
+                "%s\n    {\"pass\": \"%s\", \"time_us\": %.3f, "
+                "\"instr_count_before\": %u, \"instr_count_after\": %u}",
+                j ? "," : "", pass.name,
+                double(pass.host_ticks) * ticks_to_us, pass.instr_count_before,
+                pass.instr_count_after);
+      }
+      fprintf(file, "]}%s\n", i + 1 < statistics_.size() ? "," : "");
+    }
+    fputs("]\n", file);
+  }
+  fclose(file);
+  XELOGI("Wrote JIT statistics of {} functions to {}", statistics_.size(),
+         xe::path_to_utf8(path));
+  return true;
+}
+
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,64 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_COMPILER_STATISTICS_H_
+#define XENIA_CPU_COMPILER_COMPILER_STATISTICS_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+
+struct PassStatistics {
+  const char* name;
+  uint64_t host_ticks;
+  uint32_t instr_count_before;
+  uint32_t instr_count_after;
+};
+
+struct FunctionStatistics {
+  uint32_t guest_address = 0;
+  uint32_t guest_end_address = 0;
+  std::string name;
+  bool baseline = false;
+  std::vector<PassStatistics> passes;
+  uint32_t spill_count = 0;
+  // Byte swaps removed by cancelling them or moving them out of operations,
+  // and merged into loads and stores.
+  uint32_t byte_swaps_eliminated = 0;
+  uint32_t byte_swaps_fused = 0;
+  uint32_t code_size = 0;
+  // HIR arena memory used by the function after the compiler passes, and
+  // reserved by the builder in total, which is reused by the next functions.
+  uint32_t hir_bytes = 0;
+  uint32_t hir_reserved_bytes = 0;
+};
+
+// Statistics of every function translated while jit_statistics_path is set,
+// to find out which compiler passes translation time is spent in.
+class CompilerStatistics {
+ public:
+  static bool enabled();
+
+  static void Record(FunctionStatistics statistics);
+
+  // Writes CSV (one row per pass of each function) if the extension is .csv,
+  // JSON otherwise.
+  static bool Dump(const std::filesystem::path& path);
+};
+
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_COMPILER_STATISTICS_H_
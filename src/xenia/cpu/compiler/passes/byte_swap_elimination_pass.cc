@@ -0,0 +1,327 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/byte_swap_elimination_pass.h"
+
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compiler.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::Value;
+
+static bool IsSwappableType(TypeName type) {
+  return type == INT16_TYPE || type == INT32_TYPE || type == INT64_TYPE ||
+         type == VEC128_TYPE;
+}
+
+static Value* SkipAssigns(Value* value) {
+  while (value->def && value->def->opcode == &OPCODE_ASSIGN_info) {
+    value = value->def->src1.value;
+  }
+  return value;
+}
+
+// Skips copies which don't change the value, including a truncation of a
+// value extended from the same type.
+static Value* SkipCopies(Value* value) {
+  while (true) {
+    value = SkipAssigns(value);
+    Instr* def = value->def;
+    if (!def || def->opcode != &OPCODE_TRUNCATE_info) {
+      return value;
+    }
+    Value* extended = SkipAssigns(def->src1.value);
+    if (!extended->def ||
+        (extended->def->opcode != &OPCODE_ZERO_EXTEND_info &&
+         extended->def->opcode != &OPCODE_SIGN_EXTEND_info) ||
+        extended->def->src1.value->type != value->type) {
+      return value;
+    }
+    value = extended->def->src1.value;
+  }
+}
+
+// Whether the value can be used in the other byte order without an extra
+// swap: either it's a byte swap itself (whose source is returned), or it's a
+// constant which can be swapped at compile time. freed is set if the swap
+// will become dead once its result isn't used directly anymore.
+static bool GetUnswapped(Value* value, Value** out_source, bool* out_freed) {
+  *out_freed = false;
+  if (!IsSwappableType(value->type)) {
+    return false;
+  }
+  if (value->IsConstant()) {
+    *out_source = value;
+    return true;
+  }
+  Instr* def = SkipCopies(value)->def;
+  if (!def || def->opcode != &OPCODE_BYTE_SWAP_info ||
+      def->src1.value->type != value->type) {
+    return false;
+  }
+  *out_source = def->src1.value;
+  *out_freed = def->dest == value && value->HasSingleUse();
+  return true;
+}
+
+static Value* Unswap(HIRBuilder* builder, Value* source) {
+  if (!source->IsConstant()) {
+    return source;
+  }
+  Value* swapped = builder->CloneValue(source);
+  swapped->ByteSwap();
+  return swapped;
+}
+
+ByteSwapEliminationPass::ByteSwapEliminationPass() : CompilerPass() {}
+
+ByteSwapEliminationPass::~ByteSwapEliminationPass() = default;
+
+bool ByteSwapEliminationPass::Run(HIRBuilder* builder) {
+  // Guest memory is big-endian, so most values loaded from it and stored to
+  // it are byte swapped, and with flags and masks swaps often end up around
+  // operations which don't depend on the byte order:
+  //   v1.i32 = byte_swap v0.i32
+  //   v2.i32 = and v1.i32, 0xFF000000
+  //   v3.i32 = byte_swap v2.i32
+  // becomes:
+  //   v3.i32 = and v0.i32, 0x000000FF
+  //
+  // Swaps which remain are later merged into loads and stores by the
+  // MemorySequenceCombinationPass where the backend supports it.
+  SCOPE_profile_cpu_f("cpu");
+
+  uint32_t swap_count_before = CountByteSwaps(builder);
+
+  auto block = builder->first_block();
+  while (block) {
+    auto i = block->instr_head;
+    while (i) {
+      switch (i->opcode->num) {
+        case OPCODE_BYTE_SWAP:
+          CancelByteSwap(i);
+          break;
+        case OPCODE_TRUNCATE:
+          if (NarrowTruncate(builder, i)) {
+            SinkByteSwap(builder, i);
+          }
+          break;
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_NOT:
+          SinkByteSwap(builder, i);
+          break;
+        case OPCODE_COMPARE_EQ:
+        case OPCODE_COMPARE_NE:
+          CompareSwapped(builder, i);
+          break;
+        default:
+          break;
+      }
+      i = i->next;
+    }
+    block = block->next;
+  }
+
+  uint32_t swap_count_after = CountByteSwaps(builder);
+  auto statistics = compiler_->statistics();
+  if (statistics && swap_count_after < swap_count_before) {
+    statistics->byte_swaps_eliminated += swap_count_before - swap_count_after;
+  }
+  return true;
+}
+
+uint32_t ByteSwapEliminationPass::CountByteSwaps(HIRBuilder* builder) {
+  // Swaps with no uses are left for DCE, don't count them.
+  uint32_t count = 0;
+  auto block = builder->first_block();
+  while (block) {
+    auto i = block->instr_head;
+    while (i) {
+      if (i->opcode == &OPCODE_BYTE_SWAP_info && i->dest->use_head) {
+        ++count;
+      }
+      i = i->next;
+    }
+    block = block->next;
+  }
+  return count;
+}
+
+bool ByteSwapEliminationPass::CancelByteSwap(Instr* i) {
+  // Swap of a swapped value, possibly through assigns or an extension and a
+  // truncation back:
+  //   v1.i32 = byte_swap v0.i32
+  //   v2.i64 = zero_extend v1.i32
+  //   v3.i32 = truncate v2.i64
+  //   v4.i32 = byte_swap v3.i32
+  // becomes:
+  //   v4.i32 = assign v0.i32
+  Value* source = SkipCopies(i->src1.value);
+  Instr* def = source->def;
+  if (!def || def->opcode != &OPCODE_BYTE_SWAP_info ||
+      def->src1.value->type != i->dest->type) {
+    return false;
+  }
+  Value* value = def->src1.value;
+  i->Replace(&OPCODE_ASSIGN_info, 0);
+  i->set_src1(value);
+  return true;
+}
+
+bool ByteSwapEliminationPass::NarrowTruncate(HIRBuilder* builder, Instr* i) {
+  // Bitwise operation done in 64 bits on 32-bit values only to be truncated
+  // back, which hides the swaps of the operands:
+  //   v1.i32 = byte_swap v0.i32
+  //   v2.i64 = zero_extend v1.i32
+  //   v3.i64 = and v2.i64, 0xFF
+  //   v4.i32 = truncate v3.i64
+  // becomes:
+  //   v4.i32 = and v1.i32, 0xFF
+  Value* value = i->src1.value;
+  Instr* op = value->def;
+  if (!op || !value->HasSingleUse()) {
+    return false;
+  }
+  if (op->opcode != &OPCODE_AND_info && op->opcode != &OPCODE_OR_info &&
+      op->opcode != &OPCODE_XOR_info && op->opcode != &OPCODE_NOT_info) {
+    return false;
+  }
+  TypeName type = i->dest->type;
+  bool has_src2 = op->opcode != &OPCODE_NOT_info;
+  Value* sources[2] = {op->src1.value, has_src2 ? op->src2.value : nullptr};
+  for (size_t n = 0; n < (has_src2 ? 2 : 1); ++n) {
+    if (sources[n]->IsConstant()) {
+      continue;
+    }
+    Value* extended = SkipAssigns(sources[n]);
+    if (!extended->def ||
+        (extended->def->opcode != &OPCODE_ZERO_EXTEND_info &&
+         extended->def->opcode != &OPCODE_SIGN_EXTEND_info) ||
+        extended->def->src1.value->type != type) {
+      return false;
+    }
+    sources[n] = extended->def->src1.value;
+  }
+  if (sources[0]->IsConstant() && (!has_src2 || sources[1]->IsConstant())) {
+    // Left for constant propagation.
+    return false;
+  }
+  for (size_t n = 0; n < (has_src2 ? 2 : 1); ++n) {
+    if (sources[n]->IsConstant()) {
+      sources[n] = builder->CloneValue(sources[n]);
+      sources[n]->Truncate(type);
+    }
+  }
+  // The wider operation is only used here and will be removed by DCE.
+  i->Replace(op->opcode, op->flags);
+  i->set_src1(sources[0]);
+  if (has_src2) {
+    i->set_src2(sources[1]);
+  }
+  return true;
+}
+
+bool ByteSwapEliminationPass::SinkByteSwap(HIRBuilder* builder, Instr* i) {
+  // Bitwise operation on swapped values, with constants swapped at compile
+  // time, is the swap of the operation on the original values:
+  //   v1.i32 = byte_swap v0.i32
+  //   v2.i32 = or v1.i32, 0x00000080
+  // becomes:
+  //   v3.i32 = or v0.i32, 0x80000000
+  //   v2.i32 = byte_swap v3.i32
+  // That only pays off if fewer swaps remain - if the operand swaps are only
+  // used here, or if the result is only swapped back (and the new swap will
+  // cancel with those).
+  if (!IsSwappableType(i->dest->type)) {
+    return false;
+  }
+  bool has_src2 = i->opcode != &OPCODE_NOT_info;
+  Value* source1;
+  Value* source2 = nullptr;
+  bool freed1, freed2 = false;
+  if (!GetUnswapped(i->src1.value, &source1, &freed1)) {
+    return false;
+  }
+  if (has_src2) {
+    if (!GetUnswapped(i->src2.value, &source2, &freed2)) {
+      return false;
+    }
+    if (source1->IsConstant() && source2->IsConstant()) {
+      return false;
+    }
+  } else if (source1->IsConstant()) {
+    return false;
+  }
+
+  uint32_t swaps_removed = (freed1 ? 1 : 0) + (freed2 ? 1 : 0);
+  uint32_t swaps_added = 1;
+  uint32_t swap_use_count = 0;
+  bool only_swap_uses = true;
+  for (auto use = i->dest->use_head; use; use = use->next) {
+    if (use->instr->opcode == &OPCODE_BYTE_SWAP_info) {
+      ++swap_use_count;
+    } else {
+      only_swap_uses = false;
+    }
+  }
+  if (only_swap_uses && swap_use_count) {
+    swaps_removed += swap_use_count;
+    swaps_added = 0;
+  }
+  if (swaps_removed <= swaps_added) {
+    return false;
+  }
+
+  Instr* op = builder->CloneInstr(i);
+  op->MoveBefore(i);
+  op->set_src1(Unswap(builder, source1));
+  if (has_src2) {
+    op->set_src2(Unswap(builder, source2));
+  }
+  i->Replace(&OPCODE_BYTE_SWAP_info, 0);
+  i->set_src1(op->dest);
+  return true;
+}
+
+bool ByteSwapEliminationPass::CompareSwapped(HIRBuilder* builder, Instr* i) {
+  // Equality doesn't depend on the byte order:
+  //   v1.i32 = byte_swap v0.i32
+  //   v2.i8 = compare_eq v1.i32, 0x00000001
+  // becomes:
+  //   v2.i8 = compare_eq v0.i32, 0x01000000
+  Value* source1;
+  Value* source2;
+  bool freed1, freed2;
+  if (!GetUnswapped(i->src1.value, &source1, &freed1) ||
+      !GetUnswapped(i->src2.value, &source2, &freed2)) {
+    return false;
+  }
+  if (!freed1 && !freed2) {
+    return false;
+  }
+  i->set_src1(Unswap(builder, source1));
+  i->set_src2(Unswap(builder, source2));
+  return true;
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,41 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_BYTE_SWAP_ELIMINATION_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_BYTE_SWAP_ELIMINATION_PASS_H_
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+class ByteSwapEliminationPass : public CompilerPass {
+ public:
+  ByteSwapEliminationPass();
+  ~ByteSwapEliminationPass() override;
+
+  bool Run(hir::HIRBuilder* builder) override;
+  const char* name() const override { return "byte_swap_elimination"; }
+
+ private:
+  static uint32_t CountByteSwaps(hir::HIRBuilder* builder);
+  bool CancelByteSwap(hir::Instr* i);
+  bool NarrowTruncate(hir::HIRBuilder* builder, hir::Instr* i);
+  bool SinkByteSwap(hir::HIRBuilder* builder, hir::Instr* i);
+  bool CompareSwapped(hir::HIRBuilder* builder, hir::Instr* i);
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_BYTE_SWAP_ELIMINATION_PASS_H_
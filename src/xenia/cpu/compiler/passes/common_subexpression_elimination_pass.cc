@@ -0,0 +1,231 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/common_subexpression_elimination_pass.h"
+
+#include "xenia/base/profiling.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::Value;
+
+CommonSubexpressionEliminationPass::CommonSubexpressionEliminationPass()
+    : CompilerPass() {}
+
+CommonSubexpressionEliminationPass::~CommonSubexpressionEliminationPass() {}
+
+bool CommonSubexpressionEliminationPass::Run(HIRBuilder* builder) {
+  // Local value numbering - replaces instructions calculating the same thing
+  // as an earlier one with an assignment of the earlier result:
+  //   v0 = shl v10, 2
+  //   v1 = add v0, v11
+  //   v2 = shl v10, 2      <-- replace with v2 = v0
+  //   v3 = add v2, v11     <-- replace with v3 = v1 (v2 is numbered as v0)
+  // The assignments are removed by the following SimplificationPass.
+  //
+  // Values don't live across blocks before register allocation, and reusing a
+  // value from another block would require spilling it to a local, which is
+  // more expensive than recalculating anything that's eliminated here, so
+  // each block is processed independently.
+  auto block = builder->first_block();
+  while (block) {
+    EliminateBlock(block);
+    block = block->next;
+  }
+  return true;
+}
+
+void CommonSubexpressionEliminationPass::EliminateBlock(Block* block) {
+  available_.clear();
+  for (Instr* i = block->instr_head; i; i = i->next) {
+    const OpcodeInfo* info = i->opcode;
+    if ((info->flags & OPCODE_FLAG_VOLATILE) ||
+        info == &OPCODE_SET_ROUNDING_MODE_info ||
+        info == &OPCODE_SET_NJM_info) {
+      // May change the host floating-point state calculations depend on.
+      available_.clear();
+      continue;
+    }
+    if (!IsEliminable(i)) {
+      continue;
+    }
+    uint64_t hash = HashInstr(i);
+    Instr* match = nullptr;
+    auto range = available_.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (AreEquivalent(it->second, i)) {
+        match = it->second;
+        break;
+      }
+    }
+    // Instructions paired with the next one (like saturating arithmetic
+    // followed by did_saturate) must stay, but can still be reused.
+    if (match && !(i->next && (i->next->opcode->flags &
+                               OPCODE_FLAG_PAIRED_PREV))) {
+      i->Replace(&OPCODE_ASSIGN_info, 0);
+      i->set_src1(match->dest);
+    } else if (!match) {
+      available_.emplace(hash, i);
+    }
+  }
+}
+
+bool CommonSubexpressionEliminationPass::IsEliminable(const Instr* i) {
+  if (!i->dest) {
+    return false;
+  }
+  const OpcodeInfo* info = i->opcode;
+  if (info->flags & (OPCODE_FLAG_BRANCH | OPCODE_FLAG_MEMORY |
+                     OPCODE_FLAG_VOLATILE | OPCODE_FLAG_PAIRED_PREV)) {
+    return false;
+  }
+  switch (info->num) {
+    // Handled by SimplificationPass.
+    case OPCODE_ASSIGN:
+    // Not pure.
+    case OPCODE_LOAD_CLOCK:
+    // Depend on stores, handled by ContextPromotionPass for the context.
+    case OPCODE_LOAD_LOCAL:
+    case OPCODE_LOAD_CONTEXT:
+      return false;
+    default:
+      break;
+  }
+  for (uint32_t n = 0; n < 3; ++n) {
+    OpcodeSignatureType src_type = GET_OPCODE_SIG_TYPE_SRCN(info->signature, n);
+    if (src_type != OPCODE_SIG_TYPE_X && src_type != OPCODE_SIG_TYPE_V &&
+        src_type != OPCODE_SIG_TYPE_O) {
+      return false;
+    }
+  }
+  return true;
+}
+
+Value* CommonSubexpressionEliminationPass::GetValueNumber(Value* value) {
+  // Assignments (including those of eliminated instructions) are copies.
+  while (!value->IsConstant() && value->def &&
+         value->def->opcode == &OPCODE_ASSIGN_info) {
+    value = value->def->src1.value;
+  }
+  return value;
+}
+
+uint64_t CommonSubexpressionEliminationPass::HashSource(const Instr* i,
+                                                        uint32_t n) {
+  switch (GET_OPCODE_SIG_TYPE_SRCN(i->opcode->signature, n)) {
+    case OPCODE_SIG_TYPE_V: {
+      Value* value = GetValueNumber(i->srcs[n].value);
+      if (!value->IsConstant()) {
+        return uint64_t(uintptr_t(value));
+      }
+      uint64_t type_hash = uint64_t(value->type) << 56;
+      switch (value->type) {
+        case INT8_TYPE:
+          return type_hash ^ value->constant.u8;
+        case INT16_TYPE:
+          return type_hash ^ value->constant.u16;
+        case INT32_TYPE:
+        case FLOAT32_TYPE:
+          return type_hash ^ value->constant.u32;
+        case VEC128_TYPE:
+          return type_hash ^ value->constant.v128.low ^
+                 (value->constant.v128.high * 31);
+        default:
+          return type_hash ^ value->constant.u64;
+      }
+    }
+    case OPCODE_SIG_TYPE_O:
+      return i->srcs[n].offset;
+    default:
+      return 0;
+  }
+}
+
+uint64_t CommonSubexpressionEliminationPass::HashInstr(const Instr* i) {
+  uint64_t hash = uint64_t(i->opcode->num) | (uint64_t(i->flags) << 16) |
+                  (uint64_t(i->dest->type) << 32);
+  uint64_t src1_hash = HashSource(i, 0);
+  uint64_t src2_hash = HashSource(i, 1);
+  if (i->opcode->flags & OPCODE_FLAG_COMMUNATIVE) {
+    hash ^= (src1_hash + src2_hash) * 0x9E3779B97F4A7C15ull;
+  } else {
+    hash ^= (src1_hash * 0x9E3779B97F4A7C15ull) ^
+            (src2_hash * 0xC2B2AE3D27D4EB4Full);
+  }
+  hash ^= HashSource(i, 2) * 0x165667B19E3779F9ull;
+  return hash;
+}
+
+bool CommonSubexpressionEliminationPass::AreSourcesEquivalent(const Instr* a,
+                                                              uint32_t a_n,
+                                                              const Instr* b,
+                                                              uint32_t b_n) {
+  switch (GET_OPCODE_SIG_TYPE_SRCN(a->opcode->signature, a_n)) {
+    case OPCODE_SIG_TYPE_V: {
+      Value* a_value = GetValueNumber(a->srcs[a_n].value);
+      Value* b_value = GetValueNumber(b->srcs[b_n].value);
+      if (a_value == b_value) {
+        return true;
+      }
+      if (!a_value->IsConstant() || !b_value->IsConstant() ||
+          a_value->type != b_value->type) {
+        return false;
+      }
+      // Bitwise, not numeric (+0.0 and -0.0 are different).
+      switch (a_value->type) {
+        case INT8_TYPE:
+          return a_value->constant.u8 == b_value->constant.u8;
+        case INT16_TYPE:
+          return a_value->constant.u16 == b_value->constant.u16;
+        case INT32_TYPE:
+        case FLOAT32_TYPE:
+          return a_value->constant.u32 == b_value->constant.u32;
+        case INT64_TYPE:
+        case FLOAT64_TYPE:
+          return a_value->constant.u64 == b_value->constant.u64;
+        case VEC128_TYPE:
+          return a_value->constant.v128 == b_value->constant.v128;
+        default:
+          return false;
+      }
+    }
+    case OPCODE_SIG_TYPE_O:
+      return a->srcs[a_n].offset == b->srcs[b_n].offset;
+    default:
+      return true;
+  }
+}
+
+bool CommonSubexpressionEliminationPass::AreEquivalent(const Instr* a,
+                                                       const Instr* b) {
+  if (a->opcode != b->opcode || a->flags != b->flags ||
+      a->dest->type != b->dest->type ||
+      !AreSourcesEquivalent(a, 2, b, 2)) {
+    return false;
+  }
+  if (AreSourcesEquivalent(a, 0, b, 0) && AreSourcesEquivalent(a, 1, b, 1)) {
+    return true;
+  }
+  return (a->opcode->flags & OPCODE_FLAG_COMMUNATIVE) &&
+         AreSourcesEquivalent(a, 0, b, 1) && AreSourcesEquivalent(a, 1, b, 0);
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
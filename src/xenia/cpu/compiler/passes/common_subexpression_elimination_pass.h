@@ -0,0 +1,52 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_COMMON_SUBEXPRESSION_ELIMINATION_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_COMMON_SUBEXPRESSION_ELIMINATION_PASS_H_
+
+#include <cstdint>
+#include <unordered_map>
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+class CommonSubexpressionEliminationPass : public CompilerPass {
+ public:
+  CommonSubexpressionEliminationPass();
+  ~CommonSubexpressionEliminationPass() override;
+
+  bool Run(hir::HIRBuilder* builder) override;
+  const char* name() const override {
+    return "common_subexpression_elimination";
+  }
+
+ private:
+  void EliminateBlock(hir::Block* block);
+  static bool IsEliminable(const hir::Instr* i);
+  static hir::Value* GetValueNumber(hir::Value* value);
+  static uint64_t HashSource(const hir::Instr* i, uint32_t n);
+  static uint64_t HashInstr(const hir::Instr* i);
+  static bool AreSourcesEquivalent(const hir::Instr* a, uint32_t a_n,
+                                   const hir::Instr* b, uint32_t b_n);
+  static bool AreEquivalent(const hir::Instr* a, const hir::Instr* b);
+
+  // Instructions available for reuse in the current block by hash.
+  std::unordered_multimap<uint64_t, hir::Instr*> available_;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_COMMON_SUBEXPRESSION_ELIMINATION_PASS_H_
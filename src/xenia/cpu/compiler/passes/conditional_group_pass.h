@@ -30,6 +30,7 @@ class ConditionalGroupPass : public CompilerPass {
   bool Initialize(Compiler* compiler) override;
 
   bool Run(hir::HIRBuilder* builder) override;
+  const char* name() const override { return "conditional_group"; }
 
   void AddPass(std::unique_ptr<CompilerPass> pass);
 
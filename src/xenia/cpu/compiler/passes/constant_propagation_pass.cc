@@ -16,6 +16,7 @@
 #include "xenia/base/profiling.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/processor.h"
+#include "xenia/cpu/xex_module.h"
 
 DEFINE_bool(inline_mmio_access, true, "Inline constant MMIO loads and stores.",
             "CPU");
@@ -42,6 +43,20 @@ ConstantPropagationPass::ConstantPropagationPass()
 
 ConstantPropagationPass::~ConstantPropagationPass() {}
 
+bool ConstantPropagationPass::IsReadOnlyImageData(uint32_t address,
+                                                  size_t size) {
+  // Any other guest memory may be made writable, or written by the kernel or
+  // the GPU, at any time.
+  for (Module* module : processor_->GetModules()) {
+    auto xex_module = dynamic_cast<XexModule*>(module);
+    if (xex_module &&
+        xex_module->IsReadOnlyImageData(address, uint32_t(size))) {
+      return true;
+    }
+  }
+  return false;
+}
+
 bool ConstantPropagationPass::Run(HIRBuilder* builder, bool& result) {
   // Once ContextPromotion has run there will likely be a whole slew of
   // constants that can be pushed through the function.
@@ -265,18 +280,18 @@ bool ConstantPropagationPass::Run(HIRBuilder* builder, bool& result) {
 
             auto mmio_range =
                 processor_->memory()->LookupVirtualMappedRange(address);
-            if (cvars::inline_mmio_access && mmio_range) {
+            if (mmio_range && mmio_range->IsReadShadowed(address)) {
+              // Kept up to date in memory, a normal load is enough.
+            } else if (cvars::inline_mmio_access && mmio_range) {
               i->Replace(&OPCODE_LOAD_MMIO_info, 0);
               i->src1.offset = reinterpret_cast<uint64_t>(mmio_range);
               i->src2.offset = address;
               result = true;
-            } else {
-              auto heap = memory->LookupHeap(address);
-              uint32_t protect;
-              if (heap && heap->QueryProtect(address, &protect) &&
-                  !(protect & kMemoryProtectWrite) &&
-                  (protect & kMemoryProtectRead)) {
-                // Memory is readonly - can just return the value.
+            } else if ((v->type != FLOAT32_TYPE && v->type != FLOAT64_TYPE) ||
+                       cvars::permit_float_constant_evaluation) {
+              if (IsReadOnlyImageData(address, GetTypeSize(v->type))) {
+                // Jump tables, constant pools and vtables in the image can't
+                // change - can just return the value.
                 auto host_addr = memory->TranslateVirtual(address);
                 switch (v->type) {
                   case INT8_TYPE:
@@ -299,6 +314,16 @@ bool ConstantPropagationPass::Run(HIRBuilder* builder, bool& result) {
                     i->UnlinkAndNOP();
                     result = true;
                     break;
+                  case FLOAT32_TYPE:
+                    v->set_constant(xe::load<float>(host_addr));
+                    i->UnlinkAndNOP();
+                    result = true;
+                    break;
+                  case FLOAT64_TYPE:
+                    v->set_constant(xe::load<double>(host_addr));
+                    i->UnlinkAndNOP();
+                    result = true;
+                    break;
                   case VEC128_TYPE:
                     vec128_t val;
                     val.low = xe::load<uint64_t>(host_addr);
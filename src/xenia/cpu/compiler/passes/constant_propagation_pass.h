@@ -23,8 +23,10 @@ class ConstantPropagationPass : public ConditionalGroupSubpass {
   ~ConstantPropagationPass() override;
 
   bool Run(hir::HIRBuilder* builder, bool& result) override;
+  const char* name() const override { return "constant_propagation"; }
 
  private:
+  bool IsReadOnlyImageData(uint32_t address, size_t size);
 };
 
 }  // namespace passes
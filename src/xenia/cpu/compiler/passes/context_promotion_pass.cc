@@ -84,11 +84,7 @@ bool ContextPromotionPass::Run(HIRBuilder* builder) {
   // trying to extract stack traces/register values, so we don't do that.
   if (cvars::full_optimization_even_with_debug ||
       (!cvars::debug && !cvars::store_all_context_values)) {
-    block = builder->first_block();
-    while (block) {
-      RemoveDeadStoresBlock(block);
-      block = block->next;
-    }
+    RemoveDeadStores(builder);
   }
 
   return true;
@@ -127,27 +123,96 @@ void ContextPromotionPass::PromoteBlock(Block* block) {
   }
 }
 
-void ContextPromotionPass::RemoveDeadStoresBlock(Block* block) {
-  auto& validity = context_validity_;
-  validity.reset();
+void ContextPromotionPass::RemoveDeadStores(HIRBuilder* builder) {
+  // A store is dead if the field is stored again on every path from it before
+  // anything may read it. The context is read by loads and can be accessed by
+  // anything outside the function at volatile instructions (calls, returns,
+  // traps), so this is a backwards liveness analysis of the context bytes
+  // across the whole function:
+  //   store_context +100, v0  <-- removed, not read on any path
+  //   branch_true v1, loc_a
+  //   store_context +100, v2
+  //   ...
+  // loc_a:
+  //   store_context +100, v3
+  uint32_t block_count = 0;
+  auto block = builder->first_block();
+  while (block) {
+    block->ordinal = block_count++;
+    block = block->next;
+  }
+  block_live_in_.resize(block_count);
+  for (auto& live_in : block_live_in_) {
+    live_in.resize(uint32_t(sizeof(ppc::PPCContext)));
+    live_in.reset();
+  }
+
+  // Iterate until the liveness of loops settles.
+  auto& live = context_validity_;
+  bool changed;
+  do {
+    changed = false;
+    block = builder->last_block();
+    while (block) {
+      ComputeBlockLiveness(block, live, false);
+      if (live != block_live_in_[block->ordinal]) {
+        block_live_in_[block->ordinal] = live;
+        changed = true;
+      }
+      block = block->prev;
+    }
+  } while (changed);
 
-  // Walk backwards and mark offsets that are written to.
-  // If the offset was written to earlier, ignore the store.
-  Instr* i = block->instr_tail;
+  block = builder->first_block();
+  while (block) {
+    ComputeBlockLiveness(block, live, true);
+    block = block->next;
+  }
+}
+
+void ContextPromotionPass::ComputeBlockLiveness(Block* block,
+                                                llvm::BitVector& live,
+                                                bool remove_dead_stores) {
+  // Start with what's read after falling through to the next block.
+  Instr* tail = block->instr_tail;
+  if (tail && tail->opcode == &OPCODE_BRANCH_info) {
+    live.reset();
+  } else if (block->next) {
+    live = block_live_in_[block->next->ordinal];
+  } else {
+    live.set();
+  }
+
+  Instr* i = tail;
   while (i) {
     Instr* prev = i->prev;
-    if (i->opcode->flags & (OPCODE_FLAG_VOLATILE | OPCODE_FLAG_BRANCH)) {
+    if (i->opcode == &OPCODE_BRANCH_info) {
+      live |= block_live_in_[i->src1.label->block->ordinal];
+    } else if (i->opcode == &OPCODE_BRANCH_TRUE_info ||
+               i->opcode == &OPCODE_BRANCH_FALSE_info) {
+      live |= block_live_in_[i->src2.label->block->ordinal];
+    } else if (i->opcode->flags & OPCODE_FLAG_VOLATILE) {
       // Volatile instruction - requires all context values be flushed.
-      validity.reset();
+      live.set();
+    } else if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
+      uint32_t offset = uint32_t(i->src1.offset);
+      live.set(offset, offset + uint32_t(GetTypeSize(i->dest->type)));
     } else if (i->opcode == &OPCODE_STORE_CONTEXT_info) {
-      size_t offset = i->src1.offset;
-      if (!validity.test(static_cast<uint32_t>(offset))) {
-        // Offset not yet written, mark and continue.
-        validity.set(static_cast<uint32_t>(offset));
-      } else {
-        // Already written to. Remove this store.
-        i->UnlinkAndNOP();
+      uint32_t offset = uint32_t(i->src1.offset);
+      uint32_t end = offset + uint32_t(GetTypeSize(i->src2.value->type));
+      if (remove_dead_stores) {
+        bool is_read = false;
+        for (uint32_t n = offset; n < end; ++n) {
+          if (live.test(n)) {
+            is_read = true;
+            break;
+          }
+        }
+        if (!is_read) {
+          i->UnlinkAndNOP();
+        }
       }
+      live.reset(offset, end);
     }
     i = prev;
   }
@@ -39,14 +39,21 @@ class ContextPromotionPass : public CompilerPass {
   bool Initialize(Compiler* compiler) override;
 
   bool Run(hir::HIRBuilder* builder) override;
+  const char* name() const override { return "context_promotion"; }
 
  private:
   void PromoteBlock(hir::Block* block);
-  void RemoveDeadStoresBlock(hir::Block* block);
+  void RemoveDeadStores(hir::HIRBuilder* builder);
+  // Calculates the context bytes that may be read at the beginning of the
+  // block from those read at the beginning of its successors.
+  void ComputeBlockLiveness(hir::Block* block, llvm::BitVector& live,
+                            bool remove_dead_stores);
 
  private:
   std::vector<hir::Value*> context_values_;
   llvm::BitVector context_validity_;
+  // Context bytes that may be read at the beginning of each block by ordinal.
+  std::vector<llvm::BitVector> block_live_in_;
 };
 
 }  // namespace passes
@@ -23,6 +23,7 @@ class ControlFlowSimplificationPass : public CompilerPass {
   ~ControlFlowSimplificationPass() override;
 
   bool Run(hir::HIRBuilder* builder) override;
+  const char* name() const override { return "control_flow_simplification"; }
 
  private:
 };
@@ -23,6 +23,7 @@ class DataFlowAnalysisPass : public CompilerPass {
   ~DataFlowAnalysisPass() override;
 
   bool Run(hir::HIRBuilder* builder) override;
+  const char* name() const override { return "data_flow_analysis"; }
 
  private:
   uint32_t LinearizeBlocks(hir::HIRBuilder* builder);
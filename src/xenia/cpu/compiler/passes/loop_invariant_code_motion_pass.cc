@@ -0,0 +1,323 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/loop_invariant_code_motion_pass.h"
+
+#include <algorithm>
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/profiling.h"
+
+DECLARE_bool(dump_translated_hir_functions);
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::Value;
+
+LoopInvariantCodeMotionPass::LoopInvariantCodeMotionPass() : CompilerPass() {}
+
+LoopInvariantCodeMotionPass::~LoopInvariantCodeMotionPass() {}
+
+bool LoopInvariantCodeMotionPass::Run(HIRBuilder* builder) {
+  // Moves calculations that give the same result on every iteration of a loop
+  // (from constants and context fields not stored in the loop) to the end of
+  // the block preceding the loop:
+  //   loc_a:
+  //     v0 = load_context +r4
+  //     v1 = shl v0, 2
+  //     v2 = add v1, 0x1000
+  //     v3 = load_offset v2, v10
+  //     ...
+  //     branch_true v20, loc_a
+  // Values don't live across blocks, so the hoisted results are passed to the
+  // loop through locals, and only trees of invariant instructions larger than
+  // the number of locals they need are hoisted:
+  //     v0 = load_context +r4
+  //     v1 = shl v0, 2
+  //     v2 = add v1, 0x1000
+  //     store_local l0, v2
+  //   loc_a:
+  //     v21 = load_local l0
+  //     v3 = load_offset v21, v10
+  //     ...
+  //     branch_true v20, loc_a
+  // Loops are found through the back edges of the CFG, which must be up to
+  // date, and only single-entry loops laid out contiguously are handled.
+
+  uint16_t block_ordinal = 0;
+  auto block = builder->first_block();
+  while (block) {
+    block->ordinal = block_ordinal++;
+    block = block->next;
+  }
+
+  uint32_t loop_count = 0;
+  uint32_t hoisted_count = 0;
+  block = builder->first_block();
+  while (block) {
+    auto edge = block->outgoing_edge_head;
+    while (edge) {
+      if (edge->dest->ordinal <= block->ordinal) {
+        uint32_t loop_hoisted_count = HoistLoop(builder, edge->dest, block);
+        if (loop_hoisted_count) {
+          ++loop_count;
+          hoisted_count += loop_hoisted_count;
+        }
+      }
+      edge = edge->outgoing_next;
+    }
+    block = block->next;
+  }
+
+  if (cvars::dump_translated_hir_functions && loop_count &&
+      builder->first_block()->instr_head) {
+    builder->CommentFormat("licm: hoisted {} instructions out of {} loops",
+                           hoisted_count, loop_count);
+    builder->last_instr()->MoveBefore(builder->first_block()->instr_head);
+  }
+
+  return true;
+}
+
+uint32_t LoopInvariantCodeMotionPass::HoistLoop(HIRBuilder* builder,
+                                                Block* header, Block* latch) {
+  Block* preheader = header->prev;
+  if (!preheader) {
+    return 0;
+  }
+
+  stored_context_.clear();
+  for (Block* block = header;; block = block->next) {
+    // Everything entering the loop must go through the preheader.
+    auto edge = block->incoming_edge_head;
+    while (edge) {
+      if ((edge->src->ordinal < header->ordinal ||
+           edge->src->ordinal > latch->ordinal) &&
+          (block != header || edge->src != preheader)) {
+        return 0;
+      }
+      edge = edge->incoming_next;
+    }
+    for (Instr* i = block->instr_head; i; i = i->next) {
+      // Calls and other volatile instructions may change the context, and,
+      // like the rounding mode, the host floating-point state.
+      if ((i->opcode->flags & OPCODE_FLAG_VOLATILE) ||
+          i->opcode == &OPCODE_SET_ROUNDING_MODE_info ||
+          i->opcode == &OPCODE_SET_NJM_info) {
+        return 0;
+      }
+      if (i->opcode == &OPCODE_STORE_CONTEXT_info) {
+        stored_context_.emplace_back(
+            uint32_t(i->src1.offset),
+            uint32_t(GetTypeSize(i->src2.value->type)));
+      }
+    }
+    if (block == latch) {
+      break;
+    }
+  }
+
+  // Insert before the branches at the end of the preheader.
+  Instr* insert_before = nullptr;
+  for (Instr* i = preheader->instr_tail;
+       i && (i->opcode->flags & OPCODE_FLAG_BRANCH); i = i->prev) {
+    insert_before = i;
+  }
+
+  uint32_t hoisted_count = 0;
+  for (Block* block = header;; block = block->next) {
+    hoisted_count += HoistBlock(builder, block, preheader, insert_before);
+    if (block == latch) {
+      break;
+    }
+  }
+  return hoisted_count;
+}
+
+uint32_t LoopInvariantCodeMotionPass::HoistBlock(HIRBuilder* builder,
+                                                 Block* block,
+                                                 Block* preheader,
+                                                 Instr* insert_before) {
+  invariant_.clear();
+  for (Instr* i = block->instr_head; i; i = i->next) {
+    if (IsInvariant(i)) {
+      invariant_.insert(i);
+    }
+  }
+  if (invariant_.empty()) {
+    return 0;
+  }
+
+  // Take the trees of the invariant values used by the rest of the loop if
+  // that removes more than one instruction per value.
+  hoisted_.clear();
+  for (Instr* i = block->instr_head; i; i = i->next) {
+    if (invariant_.count(i)) {
+      continue;
+    }
+    uint32_t signature = i->opcode->signature;
+    for (uint32_t n = 0; n < 3; ++n) {
+      if (GET_OPCODE_SIG_TYPE_SRCN(signature, n) != OPCODE_SIG_TYPE_V) {
+        continue;
+      }
+      Instr* def = i->srcs[n].value->def;
+      if (!def || !invariant_.count(def) || hoisted_.count(def)) {
+        continue;
+      }
+      tree_.clear();
+      AddToTree(def);
+      if (tree_.size() >= 2) {
+        hoisted_.insert(tree_.cbegin(), tree_.cend());
+      }
+    }
+  }
+
+  // Values needed by the instructions left in the loop.
+  std::vector<Value*> exits;
+  for (Instr* i = block->instr_head; i; i = i->next) {
+    if (!hoisted_.count(i)) {
+      continue;
+    }
+    for (auto use = i->dest->use_head; use; use = use->next) {
+      if (!hoisted_.count(use->instr)) {
+        exits.push_back(i->dest);
+        break;
+      }
+    }
+  }
+  if (hoisted_.size() <= exits.size()) {
+    return 0;
+  }
+
+  // Move in order to keep the sources before the users.
+  Instr* i = block->instr_head;
+  while (i) {
+    Instr* next = i->next;
+    if (hoisted_.count(i)) {
+      if (insert_before) {
+        i->MoveBefore(insert_before);
+      } else {
+        i->MoveToEnd(preheader);
+      }
+    }
+    i = next;
+  }
+
+  for (Value* value : exits) {
+    Value* local_slot = builder->AllocLocal(value->type);
+    builder->StoreLocal(local_slot, value);
+    if (insert_before) {
+      builder->last_instr()->MoveBefore(insert_before);
+    } else {
+      builder->last_instr()->MoveToEnd(preheader);
+    }
+    Value* local_value = builder->LoadLocal(local_slot);
+    builder->last_instr()->MoveBefore(block->instr_head);
+
+    // Rename the uses in the loop.
+    auto use = value->use_head;
+    while (use) {
+      auto next_use = use->next;
+      Instr* use_instr = use->instr;
+      if (use_instr->block == block) {
+        uint32_t signature = use_instr->opcode->signature;
+        for (uint32_t n = 0; n < 3; ++n) {
+          if (GET_OPCODE_SIG_TYPE_SRCN(signature, n) == OPCODE_SIG_TYPE_V &&
+              use_instr->srcs[n].value == value) {
+            use_instr->set_srcN(local_value, n);
+          }
+        }
+      }
+      use = next_use;
+    }
+  }
+
+  return uint32_t(hoisted_.size());
+}
+
+bool LoopInvariantCodeMotionPass::IsInvariant(const Instr* i) const {
+  if (!i->dest) {
+    return false;
+  }
+  const OpcodeInfo* info = i->opcode;
+  if (info->flags & (OPCODE_FLAG_BRANCH | OPCODE_FLAG_MEMORY |
+                     OPCODE_FLAG_VOLATILE | OPCODE_FLAG_PAIRED_PREV)) {
+    return false;
+  }
+  if (i->next && (i->next->opcode->flags & OPCODE_FLAG_PAIRED_PREV)) {
+    return false;
+  }
+  switch (info->num) {
+    // Not pure.
+    case OPCODE_LOAD_CLOCK:
+    case OPCODE_LOAD_LOCAL:
+    // May be executed speculatively, and could fault on a zero divisor.
+    case OPCODE_DIV:
+      return false;
+    case OPCODE_LOAD_CONTEXT: {
+      uint32_t offset = uint32_t(i->src1.offset);
+      uint32_t size = uint32_t(GetTypeSize(i->dest->type));
+      for (auto& stored : stored_context_) {
+        if (offset < stored.first + stored.second &&
+            stored.first < offset + size) {
+          return false;
+        }
+      }
+      return true;
+    }
+    default:
+      break;
+  }
+  for (uint32_t n = 0; n < 3; ++n) {
+    switch (GET_OPCODE_SIG_TYPE_SRCN(info->signature, n)) {
+      case OPCODE_SIG_TYPE_X:
+      case OPCODE_SIG_TYPE_O:
+        break;
+      case OPCODE_SIG_TYPE_V: {
+        const Value* value = i->srcs[n].value;
+        if (!value->IsConstant() &&
+            (!value->def || !invariant_.count(value->def))) {
+          return false;
+        }
+      } break;
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+void LoopInvariantCodeMotionPass::AddToTree(Instr* i) {
+  tree_.push_back(i);
+  uint32_t signature = i->opcode->signature;
+  for (uint32_t n = 0; n < 3; ++n) {
+    if (GET_OPCODE_SIG_TYPE_SRCN(signature, n) != OPCODE_SIG_TYPE_V) {
+      continue;
+    }
+    Instr* def = i->srcs[n].value->def;
+    if (def && !hoisted_.count(def) &&
+        std::find(tree_.cbegin(), tree_.cend(), def) == tree_.cend()) {
+      AddToTree(def);
+    }
+  }
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
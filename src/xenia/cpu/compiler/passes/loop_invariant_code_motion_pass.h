@@ -0,0 +1,57 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_LOOP_INVARIANT_CODE_MOTION_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_LOOP_INVARIANT_CODE_MOTION_PASS_H_
+
+#include <cstdint>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+class LoopInvariantCodeMotionPass : public CompilerPass {
+ public:
+  LoopInvariantCodeMotionPass();
+  ~LoopInvariantCodeMotionPass() override;
+
+  bool Run(hir::HIRBuilder* builder) override;
+  const char* name() const override { return "loop_invariant_code_motion"; }
+
+ private:
+  // Returns the number of instructions hoisted out of the loop made of the
+  // blocks from header to latch.
+  uint32_t HoistLoop(hir::HIRBuilder* builder, hir::Block* header,
+                     hir::Block* latch);
+  uint32_t HoistBlock(hir::HIRBuilder* builder, hir::Block* block,
+                      hir::Block* preheader, hir::Instr* insert_before);
+  bool IsInvariant(const hir::Instr* i) const;
+  void AddToTree(hir::Instr* i);
+
+  // Context ranges (offset, size) stored within the current loop.
+  std::vector<std::pair<uint32_t, uint32_t>> stored_context_;
+  // Invariant instructions of the current block.
+  std::unordered_set<const hir::Instr*> invariant_;
+  // Instructions chosen to be hoisted from the current block.
+  std::unordered_set<const hir::Instr*> hoisted_;
+  std::vector<hir::Instr*> tree_;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_LOOP_INVARIANT_CODE_MOTION_PASS_H_
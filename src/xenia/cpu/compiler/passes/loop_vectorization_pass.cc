@@ -0,0 +1,739 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/loop_vectorization_pass.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/profiling.h"
+#include "xenia/base/vec128.h"
+
+DECLARE_bool(dump_translated_hir_functions);
+DECLARE_bool(no_round_to_single);
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::Edge;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::Label;
+using xe::cpu::hir::Value;
+
+static bool GetConstantInt(const Value* value, int64_t* out_value) {
+  if (!value->IsConstant()) {
+    return false;
+  }
+  switch (value->type) {
+    case INT8_TYPE:
+      *out_value = value->constant.i8;
+      return true;
+    case INT16_TYPE:
+      *out_value = value->constant.i16;
+      return true;
+    case INT32_TYPE:
+      *out_value = value->constant.i32;
+      return true;
+    case INT64_TYPE:
+      *out_value = value->constant.i64;
+      return true;
+    default:
+      return false;
+  }
+}
+
+static bool IsExactSingle(double value) {
+  // NaNs fail the comparison as well.
+  return std::abs(value) <= double(std::numeric_limits<float>::max()) &&
+         double(float(value)) == value;
+}
+
+static Value* SkipAssigns(Value* value) {
+  while (value->def && value->def->opcode == &OPCODE_ASSIGN_info) {
+    value = value->def->src1.value;
+  }
+  return value;
+}
+
+static Value* GetStoredValue(const Instr* i) {
+  return i->opcode == &OPCODE_STORE_OFFSET_info ? i->src3.value
+                                                : i->src2.value;
+}
+
+static bool Overlaps(const std::vector<std::pair<uint32_t, uint32_t>>& ranges,
+                     uint32_t offset, uint32_t size) {
+  for (auto& range : ranges) {
+    if (offset < range.first + range.second && range.first < offset + size) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool EndsWithJump(const Block* block) {
+  const Instr* i = block->instr_tail;
+  if (!i) {
+    return false;
+  }
+  if (i->opcode == &OPCODE_BRANCH_info || i->opcode == &OPCODE_RETURN_info) {
+    return true;
+  }
+  return (i->opcode == &OPCODE_CALL_info ||
+          i->opcode == &OPCODE_CALL_INDIRECT_info) &&
+         (i->flags & CALL_TAIL);
+}
+
+static Value* EmitRemaining(HIRBuilder* builder, uint32_t counter_offset) {
+  // bdnz only looks at the lower 32 bits.
+  return builder->And(builder->LoadContext(counter_offset, INT64_TYPE),
+                      builder->LoadConstantUint64(0xFFFFFFFF));
+}
+
+LoopVectorizationPass::LoopVectorizationPass() : CompilerPass() {}
+
+LoopVectorizationPass::~LoopVectorizationPass() {}
+
+bool LoopVectorizationPass::Run(HIRBuilder* builder) {
+  // Does 4 iterations at once of loops made of a single block counted down
+  // with bdnz which process arrays of floats with single-precision
+  // arithmetic, one float of each array per iteration:
+  //   loc_a:
+  //     v0 = load_context +r3
+  //     v1 = add v0, 4
+  //     v2 = load v1, i32
+  //     v3 = byte_swap v2.i32
+  //     v4 = cast v3.f32
+  //     v5 = convert v4.f64
+  //     v6 = load_local l0.f64
+  //     v7 = mul v5, v6
+  //     v8 = to_single v7
+  //     store_context +f1, v8
+  //     ...
+  //     store_context +r3, v1
+  //     ...
+  //     branch_true v20, loc_a
+  //
+  // Adding, subtracting or multiplying floats in double precision and rounding
+  // the result to single precision gives the same result as doing it in
+  // single precision since the double has more than twice as many bits, so
+  // this is done with the vector instructions under the rounding mode and the
+  // denormal handling of the FPU. The fused multiply-adds are excluded as they
+  // can round differently, and with no_round_to_single the scalar code keeps
+  // the double precision, so nothing is vectorized then.
+  //
+  // Like with the MemoryIdiomRecognitionPass, after the first iteration the
+  // loop branches to a fast path appended to the end of the function, which
+  // checks that at least 5 iterations are left, that the arrays written don't
+  // overlap the others except for reading and writing the same floats in
+  // place, that the arrays don't cross a 512 MB boundary, and that the doubles
+  // used with all floats are exactly representable as floats. Then a vector
+  // loop advances the induction registers by 4 iterations at a time as long
+  // as more than 4 iterations are left, and the remaining 1 to 4 iterations
+  // are done by the scalar loop, so everything else it leaves in the context
+  // is still correct:
+  //   loc_a:
+  //     ...
+  //     branch_true v20, loc_b
+  //     ...
+  //   loc_b:
+  //     v30 = load_context +ctr
+  //     ...
+  //     branch_false v40, loc_a
+  //   loc_c:
+  //     v50 = load_context +r3
+  //     v51 = add v50, 4
+  //     v52 = and v51, 0xFFFFFFFF
+  //     v53 = load v52, v128, [unaligned]
+  //     ...
+  //     branch_true v60, loc_c
+  //     branch loc_a
+  SCOPE_profile_cpu_f("cpu");
+
+  if (cvars::no_round_to_single) {
+    return true;
+  }
+
+  uint32_t loop_count = 0;
+  Block* last_block = builder->last_block();
+  if (last_block && EndsWithJump(last_block)) {
+    auto block = builder->first_block();
+    while (block) {
+      if (VectorizeLoop(builder, block)) {
+        ++loop_count;
+      }
+      if (block == last_block) {
+        break;
+      }
+      block = block->next;
+    }
+  }
+
+  if (cvars::dump_translated_hir_functions && loop_count &&
+      builder->first_block()->instr_head) {
+    builder->CommentFormat("loop vectorization: vectorized {} loops",
+                           loop_count);
+    builder->last_instr()->MoveBefore(builder->first_block()->instr_head);
+  }
+
+  return true;
+}
+
+bool LoopVectorizationPass::VectorizeLoop(HIRBuilder* builder, Block* block) {
+  Instr* branch = block->instr_tail;
+  if (!branch || branch->opcode != &OPCODE_BRANCH_TRUE_info ||
+      branch->src2.label->block != block || !ScanLoop(block)) {
+    return false;
+  }
+
+  // Must be counted down with bdnz.
+  Instr* test = SkipAssigns(branch->src1.value)->def;
+  Affine counter;
+  if (!test || test->opcode != &OPCODE_IS_TRUE_info ||
+      test->src1.value->type != INT32_TYPE ||
+      !EvaluateAffine(test->src1.value, &counter) || counter.addend != -1 ||
+      GetStride(counter.offset) != -1) {
+    return false;
+  }
+  counter_offset_ = counter.offset;
+
+  // Each float must be written only by its own iteration, and read before
+  // being written only by it.
+  bool has_store = false;
+  for (auto& store_it : accesses_) {
+    const Access& store = store_it.second;
+    if (!store.store) {
+      continue;
+    }
+    has_store = true;
+    for (auto& access_it : accesses_) {
+      const Access& access = access_it.second;
+      if (access.base == store.base && access.addend != store.addend) {
+        return false;
+      }
+    }
+  }
+  if (!has_store) {
+    return false;
+  }
+  for (auto& access_it : accesses_) {
+    if (GetStride(access_it.second.base) != int64_t(sizeof(float))) {
+      return false;
+    }
+  }
+
+  Label* loop_label = branch->src2.label;
+  Label* fast_label = builder->NewLabel();
+  builder->MarkLabel(fast_label);
+  Block* fast_block = fast_label->block;
+
+  // Check whether the vector loop can be used for the remaining iterations.
+  Value* remaining = EmitRemaining(builder, counter_offset_);
+  Value* ok =
+      builder->CompareUGT(remaining, builder->LoadConstantUint64(kLaneCount));
+  Value* length =
+      builder->Mul(remaining, builder->LoadConstantUint64(sizeof(float)));
+  std::vector<std::pair<const Access*, Value*>> starts;
+  for (auto& access_it : accesses_) {
+    Value* start = EmitStart(builder, access_it.second);
+    Value* last = builder->Add(
+        start, builder->Sub(length, builder->LoadConstantUint64(1)));
+    ok = builder->And(ok, builder->CompareEQ(builder->Shr(start, int8_t(29)),
+                                             builder->Shr(last, int8_t(29))));
+    starts.emplace_back(&access_it.second, start);
+  }
+  for (size_t n = 0; n < starts.size(); ++n) {
+    if (!starts[n].first->store) {
+      continue;
+    }
+    for (size_t m = 0; m < starts.size(); ++m) {
+      if (starts[m].first->base == starts[n].first->base ||
+          (starts[m].first->store && m < n)) {
+        continue;
+      }
+      Value* start1 = starts[n].second;
+      Value* start2 = starts[m].second;
+      ok = builder->And(
+          ok, builder->Or(
+                  builder->CompareULE(builder->Add(start1, length), start2),
+                  builder->CompareULE(builder->Add(start2, length), start1)));
+    }
+  }
+  for (const Value* invariant : invariants_) {
+    if (invariant->IsConstant()) {
+      // Checked during the scan.
+      continue;
+    }
+    Value* value = EmitInvariant(builder, invariant);
+    Value* single = builder->Convert(
+        builder->Convert(value, FLOAT32_TYPE), FLOAT64_TYPE);
+    ok = builder->And(ok,
+                      builder->CompareEQ(builder->Cast(single, INT64_TYPE),
+                                         builder->Cast(value, INT64_TYPE)));
+  }
+  builder->BranchFalse(ok, loop_label);
+
+  // 4 iterations at once while leaving at least one for the scalar loop.
+  Label* vector_label = builder->NewLabel();
+  builder->MarkLabel(vector_label);
+  Block* vector_block = vector_label->block;
+  EmitVectorBody(builder, block);
+  for (auto& induction : inductions_) {
+    if (!induction.second) {
+      continue;
+    }
+    builder->StoreContext(
+        induction.first,
+        builder->Add(builder->LoadContext(induction.first, INT64_TYPE),
+                     builder->LoadConstantInt64(induction.second *
+                                                int64_t(kLaneCount))));
+  }
+  remaining = EmitRemaining(builder, counter_offset_);
+  builder->BranchTrue(
+      builder->CompareUGT(remaining, builder->LoadConstantUint64(kLaneCount)),
+      vector_label);
+  builder->Branch(loop_label);
+  Block* exit_block = builder->last_block();
+
+  branch->src2.label = fast_label;
+  builder->RemoveEdge(block, block);
+  builder->AddEdge(block, fast_block, 0);
+  builder->AddEdge(fast_block, block, 0);
+  builder->AddEdge(fast_block, vector_block, 0);
+  builder->AddEdge(vector_block, vector_block, 0);
+  builder->AddEdge(vector_block, exit_block, 0);
+  builder->AddEdge(exit_block, block, Edge::UNCONDITIONAL);
+  return true;
+}
+
+bool LoopVectorizationPass::ScanLoop(Block* block) {
+  inductions_.clear();
+  loaded_context_.clear();
+  stored_context_.clear();
+  accesses_.clear();
+  lanes_.clear();
+  unrounded_.clear();
+  invariants_.clear();
+  std::vector<std::pair<uint32_t, uint32_t>> temporaries;
+  for (Instr* i = block->instr_head; i != block->instr_tail; i = i->next) {
+    if (!ScanLanes(i)) {
+      return false;
+    }
+    switch (i->opcode->num) {
+      case OPCODE_COMMENT:
+      case OPCODE_NOP:
+      case OPCODE_SOURCE_OFFSET:
+      case OPCODE_CONTEXT_BARRIER:
+      case OPCODE_CACHE_CONTROL:
+      case OPCODE_LOAD_LOCAL:
+      // Only the floats, checked by ScanLanes.
+      case OPCODE_LOAD:
+      case OPCODE_LOAD_OFFSET:
+      case OPCODE_STORE:
+      case OPCODE_STORE_OFFSET:
+        break;
+      case OPCODE_LOAD_CONTEXT: {
+        uint32_t offset = uint32_t(i->src1.offset);
+        uint32_t size = uint32_t(GetTypeSize(i->dest->type));
+        if (Overlaps(stored_context_, offset, size)) {
+          return false;
+        }
+        loaded_context_.emplace_back(offset, size);
+      } break;
+      case OPCODE_STORE_CONTEXT: {
+        uint32_t offset = uint32_t(i->src1.offset);
+        uint32_t size = uint32_t(GetTypeSize(i->src2.value->type));
+        if (Overlaps(stored_context_, offset, size)) {
+          return false;
+        }
+        stored_context_.emplace_back(offset, size);
+        Affine affine;
+        if (i->src2.value->type == INT64_TYPE &&
+            EvaluateAffine(i->src2.value, &affine) && affine.exact &&
+            affine.offset == offset) {
+          inductions_.emplace_back(offset, affine.addend);
+        } else if (!IsIdempotentUpdate(i->src2.value, offset)) {
+          temporaries.emplace_back(offset, size);
+        }
+      } break;
+      case OPCODE_STORE_LOCAL:
+        return false;
+      default:
+        if (i->opcode->flags &
+            (OPCODE_FLAG_BRANCH | OPCODE_FLAG_MEMORY | OPCODE_FLAG_VOLATILE)) {
+          return false;
+        }
+        break;
+    }
+  }
+  // Values from the previous iteration may only come through the inductions.
+  for (auto& temporary : temporaries) {
+    if (Overlaps(loaded_context_, temporary.first, temporary.second)) {
+      return false;
+    }
+  }
+  for (const Value* invariant : invariants_) {
+    const Instr* def = invariant->def;
+    if (def && def->opcode == &OPCODE_LOAD_CONTEXT_info &&
+        Overlaps(stored_context_, uint32_t(def->src1.offset),
+                 uint32_t(sizeof(double)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool LoopVectorizationPass::ScanLanes(Instr* i) {
+  const OpcodeInfo* opcode = i->opcode;
+  bool lane_sources = false;
+  for (uint32_t n = 0; n < 3; ++n) {
+    if (GET_OPCODE_SIG_TYPE_SRCN(opcode->signature, n) != OPCODE_SIG_TYPE_V) {
+      continue;
+    }
+    const Value* value = i->srcs[n].value;
+    if (lanes_.count(value)) {
+      lane_sources = true;
+    }
+    if (unrounded_.count(value) && opcode != &OPCODE_ASSIGN_info &&
+        opcode != &OPCODE_TO_SINGLE_info) {
+      return false;
+    }
+  }
+
+  Access access;
+  switch (opcode->num) {
+    case OPCODE_LOAD:
+    case OPCODE_LOAD_OFFSET:
+      if ((i->flags & ~LOAD_STORE_BYTE_SWAP) ||
+          GetTypeSize(i->dest->type) != sizeof(float) ||
+          !EvaluateAddress(i, &access)) {
+        return false;
+      }
+      access.store = false;
+      accesses_.emplace(i, access);
+      lanes_.insert(i->dest);
+      return true;
+    case OPCODE_STORE:
+    case OPCODE_STORE_OFFSET: {
+      const Value* value = GetStoredValue(i);
+      if ((i->flags & ~LOAD_STORE_BYTE_SWAP) || !lanes_.count(value) ||
+          GetTypeSize(value->type) != sizeof(float) ||
+          !EvaluateAddress(i, &access)) {
+        return false;
+      }
+      access.store = true;
+      accesses_.emplace(i, access);
+      return true;
+    }
+    default:
+      break;
+  }
+  if (!lane_sources) {
+    return true;
+  }
+
+  switch (opcode->num) {
+    case OPCODE_ASSIGN:
+      if (unrounded_.count(i->src1.value)) {
+        unrounded_.insert(i->dest);
+      }
+      break;
+    case OPCODE_CAST:
+      if (GetTypeSize(i->dest->type) != sizeof(float)) {
+        return false;
+      }
+      break;
+    case OPCODE_BYTE_SWAP:
+      if (i->dest->type != INT32_TYPE) {
+        return false;
+      }
+      break;
+    case OPCODE_CONVERT: {
+      TypeName source_type = i->src1.value->type;
+      if (!(source_type == FLOAT32_TYPE && i->dest->type == FLOAT64_TYPE) &&
+          !(source_type == FLOAT64_TYPE && i->dest->type == FLOAT32_TYPE)) {
+        return false;
+      }
+    } break;
+    case OPCODE_TO_SINGLE:
+      break;
+    case OPCODE_NEG:
+    case OPCODE_ABS:
+      if (i->dest->type != FLOAT64_TYPE) {
+        return false;
+      }
+      break;
+    case OPCODE_ADD:
+    case OPCODE_SUB:
+    case OPCODE_MUL:
+      if (i->dest->type != FLOAT64_TYPE || i->flags) {
+        return false;
+      }
+      for (uint32_t n = 0; n < 2; ++n) {
+        if (!lanes_.count(i->srcs[n].value) &&
+            !IsSingleInvariant(i->srcs[n].value)) {
+          return false;
+        }
+      }
+      unrounded_.insert(i->dest);
+      break;
+    case OPCODE_STORE_CONTEXT:
+      // Stored again by the last iteration done by the scalar loop.
+      return true;
+    default:
+      return false;
+  }
+  lanes_.insert(i->dest);
+  return true;
+}
+
+bool LoopVectorizationPass::IsSingleInvariant(Value* value) {
+  value = SkipAssigns(value);
+  if (value->type != FLOAT64_TYPE) {
+    return false;
+  }
+  if (value->IsConstant()) {
+    if (!IsExactSingle(value->constant.f64)) {
+      return false;
+    }
+  } else {
+    // Context fields not stored in the loop are checked after the scan, and
+    // locals aren't stored in the loop.
+    const Instr* def = value->def;
+    if (!def || (def->opcode != &OPCODE_LOAD_CONTEXT_info &&
+                 def->opcode != &OPCODE_LOAD_LOCAL_info)) {
+      return false;
+    }
+  }
+  if (std::find(invariants_.begin(), invariants_.end(), value) ==
+      invariants_.end()) {
+    invariants_.push_back(value);
+  }
+  return true;
+}
+
+bool LoopVectorizationPass::IsIdempotentUpdate(Value* value,
+                                               uint32_t offset) const {
+  // Only setting and clearing constant bits of the value at the start of the
+  // iteration, like the FPSCR updates of the arithmetic, so doing it once,
+  // which the scalar loop always does, is the same as doing it on every
+  // iteration.
+  while (true) {
+    value = SkipAssigns(value);
+    if (value->IsConstant()) {
+      return true;
+    }
+    const Instr* def = value->def;
+    if (!def) {
+      return false;
+    }
+    if (def->opcode == &OPCODE_LOAD_CONTEXT_info) {
+      return def->src1.offset == offset;
+    }
+    if (def->opcode != &OPCODE_AND_info && def->opcode != &OPCODE_OR_info) {
+      return false;
+    }
+    if (def->src2.value->IsConstant()) {
+      value = def->src1.value;
+    } else if (def->src1.value->IsConstant()) {
+      value = def->src2.value;
+    } else {
+      return false;
+    }
+  }
+}
+
+bool LoopVectorizationPass::EvaluateAffine(Value* value,
+                                           Affine* affine) const {
+  affine->addend = 0;
+  affine->exact = true;
+  while (true) {
+    if (value->type != INT64_TYPE) {
+      if (value->type != INT32_TYPE) {
+        return false;
+      }
+      affine->exact = false;
+    }
+    const Instr* def = value->def;
+    if (!def) {
+      return false;
+    }
+    int64_t constant;
+    switch (def->opcode->num) {
+      case OPCODE_ASSIGN:
+        break;
+      case OPCODE_TRUNCATE:
+      case OPCODE_ZERO_EXTEND:
+      case OPCODE_SIGN_EXTEND:
+        affine->exact = false;
+        break;
+      case OPCODE_ADD:
+        if (GetConstantInt(def->src2.value, &constant)) {
+          affine->addend += constant;
+          break;
+        }
+        if (GetConstantInt(def->src1.value, &constant)) {
+          affine->addend += constant;
+          value = def->src2.value;
+          continue;
+        }
+        return false;
+      case OPCODE_SUB:
+        if (!GetConstantInt(def->src2.value, &constant)) {
+          return false;
+        }
+        affine->addend -= constant;
+        break;
+      case OPCODE_LOAD_CONTEXT:
+        if (value->type != INT64_TYPE) {
+          return false;
+        }
+        affine->offset = uint32_t(def->src1.offset);
+        return true;
+      default:
+        return false;
+    }
+    value = def->src1.value;
+  }
+}
+
+bool LoopVectorizationPass::EvaluateAddress(Instr* i, Access* access) const {
+  // The stride of the base is checked once all inductions are known.
+  Affine affine;
+  if (!EvaluateAffine(SkipAssigns(i->src1.value), &affine)) {
+    return false;
+  }
+  access->base = affine.offset;
+  access->addend = affine.addend;
+  if (i->opcode == &OPCODE_LOAD_OFFSET_info ||
+      i->opcode == &OPCODE_STORE_OFFSET_info) {
+    int64_t offset;
+    if (!GetConstantInt(i->src2.value, &offset)) {
+      return false;
+    }
+    access->addend += offset;
+  }
+  return true;
+}
+
+int64_t LoopVectorizationPass::GetStride(uint32_t offset) const {
+  for (auto& induction : inductions_) {
+    if (induction.first == offset) {
+      return induction.second;
+    }
+  }
+  return 0;
+}
+
+Value* LoopVectorizationPass::EmitStart(HIRBuilder* builder,
+                                        const Access& access) const {
+  Value* start = builder->LoadContext(access.base, INT64_TYPE);
+  if (access.addend) {
+    start = builder->Add(start, builder->LoadConstantInt64(access.addend));
+  }
+  // Zero-extended from the 32-bit guest address.
+  return builder->And(start, builder->LoadConstantUint64(0xFFFFFFFF));
+}
+
+Value* LoopVectorizationPass::EmitInvariant(HIRBuilder* builder,
+                                            const Value* value) const {
+  if (value->IsConstant()) {
+    return builder->LoadConstantFloat64(value->constant.f64);
+  }
+  const Instr* def = value->def;
+  if (def->opcode == &OPCODE_LOAD_CONTEXT_info) {
+    return builder->LoadContext(def->src1.offset, FLOAT64_TYPE);
+  }
+  return builder->LoadLocal(def->src1.value);
+}
+
+void LoopVectorizationPass::EmitVectorBody(HIRBuilder* builder,
+                                           Block* block) {
+  // The floats are kept in the vector lanes in single precision, which the
+  // conversions and the rounding of the scalar code don't change.
+  std::unordered_map<const Value*, Value*> vectors;
+  auto get_vector = [&](Value* value) {
+    auto vector_it = vectors.find(value);
+    if (vector_it != vectors.end()) {
+      return vector_it->second;
+    }
+    // Invariant used with all lanes.
+    Value* invariant = SkipAssigns(value);
+    Value* vector;
+    if (invariant->IsConstant()) {
+      vector = builder->LoadConstantVec128(
+          vec128f(float(invariant->constant.f64)));
+    } else {
+      vector = builder->Splat(
+          builder->Convert(EmitInvariant(builder, invariant), FLOAT32_TYPE),
+          VEC128_TYPE);
+    }
+    vectors.emplace(value, vector);
+    return vector;
+  };
+  for (Instr* i = block->instr_head; i != block->instr_tail; i = i->next) {
+    auto access_it = accesses_.find(i);
+    if (access_it != accesses_.end()) {
+      Value* address = EmitStart(builder, access_it->second);
+      uint32_t flags = i->flags | LOAD_STORE_UNALIGNED;
+      if (access_it->second.store) {
+        builder->Store(address, get_vector(GetStoredValue(i)), flags);
+      } else {
+        vectors.emplace(i->dest,
+                        builder->Load(address, VEC128_TYPE, flags));
+      }
+      continue;
+    }
+    if (!i->dest || !lanes_.count(i->dest)) {
+      continue;
+    }
+    Value* vector;
+    switch (i->opcode->num) {
+      case OPCODE_BYTE_SWAP:
+        vector = builder->ByteSwap(get_vector(i->src1.value));
+        break;
+      case OPCODE_NEG:
+        vector = builder->Neg(get_vector(i->src1.value));
+        break;
+      case OPCODE_ABS:
+        vector = builder->Abs(get_vector(i->src1.value));
+        break;
+      case OPCODE_ADD:
+        vector = builder->Add(get_vector(i->src1.value),
+                              get_vector(i->src2.value), ARITHMETIC_FPU_MODE);
+        break;
+      case OPCODE_SUB:
+        vector = builder->Sub(get_vector(i->src1.value),
+                              get_vector(i->src2.value), ARITHMETIC_FPU_MODE);
+        break;
+      case OPCODE_MUL:
+        vector = builder->Mul(get_vector(i->src1.value),
+                              get_vector(i->src2.value), ARITHMETIC_FPU_MODE);
+        break;
+      default:
+        // Copies, conversions and roundings of the floats.
+        vector = get_vector(i->src1.value);
+        break;
+    }
+    vectors.emplace(i->dest, vector);
+  }
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
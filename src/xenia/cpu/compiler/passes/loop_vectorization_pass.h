@@ -0,0 +1,88 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_LOOP_VECTORIZATION_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_LOOP_VECTORIZATION_PASS_H_
+
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+class LoopVectorizationPass : public CompilerPass {
+ public:
+  LoopVectorizationPass();
+  ~LoopVectorizationPass() override;
+
+  bool Run(hir::HIRBuilder* builder) override;
+  const char* name() const override { return "loop_vectorization"; }
+
+ private:
+  // Number of iterations done by one iteration of the vector loop.
+  static constexpr uint32_t kLaneCount = 4;
+
+  // Context field (a guest register) at the start of the loop iteration plus
+  // a constant, modulo 2^32 like guest addresses unless exact.
+  struct Affine {
+    uint32_t offset;
+    int64_t addend;
+    bool exact;
+  };
+  // Float in guest memory accessed on every iteration, the address of the
+  // next iteration advances by the size of the float.
+  struct Access {
+    uint32_t base;
+    int64_t addend;
+    bool store;
+  };
+
+  bool VectorizeLoop(hir::HIRBuilder* builder, hir::Block* block);
+  bool ScanLoop(hir::Block* block);
+  bool ScanLanes(hir::Instr* i);
+  bool IsSingleInvariant(hir::Value* value);
+  bool IsIdempotentUpdate(hir::Value* value, uint32_t offset) const;
+  bool EvaluateAffine(hir::Value* value, Affine* affine) const;
+  bool EvaluateAddress(hir::Instr* i, Access* access) const;
+  int64_t GetStride(uint32_t offset) const;
+  hir::Value* EmitStart(hir::HIRBuilder* builder, const Access& access) const;
+  hir::Value* EmitInvariant(hir::HIRBuilder* builder,
+                            const hir::Value* value) const;
+  void EmitVectorBody(hir::HIRBuilder* builder, hir::Block* block);
+
+  // Registers advanced by a constant on every iteration, with the stride.
+  std::vector<std::pair<uint32_t, int64_t>> inductions_;
+  // Context ranges (offset, size) loaded and stored in the loop.
+  std::vector<std::pair<uint32_t, uint32_t>> loaded_context_;
+  std::vector<std::pair<uint32_t, uint32_t>> stored_context_;
+  std::unordered_map<const hir::Instr*, Access> accesses_;
+  // Values with one float per iteration, computed for 4 iterations at once
+  // by the vector loop.
+  std::unordered_set<const hir::Value*> lanes_;
+  // Lanes which are results of double-precision arithmetic, only usable by
+  // the rounding to single precision.
+  std::unordered_set<const hir::Value*> unrounded_;
+  // Doubles not changing in the loop used by the arithmetic, if they're
+  // exactly representable as floats they're used with all lanes.
+  std::vector<const hir::Value*> invariants_;
+  uint32_t counter_offset_;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_LOOP_VECTORIZATION_PASS_H_
@@ -0,0 +1,790 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/memory_idiom_recognition_pass.h"
+
+#include <algorithm>
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/profiling.h"
+
+DECLARE_bool(dump_translated_hir_functions);
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::Edge;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::Label;
+using xe::cpu::hir::Value;
+
+static bool GetConstantInt(const Value* value, int64_t* out_value) {
+  if (!value->IsConstant()) {
+    return false;
+  }
+  switch (value->type) {
+    case INT8_TYPE:
+      *out_value = value->constant.i8;
+      return true;
+    case INT16_TYPE:
+      *out_value = value->constant.i16;
+      return true;
+    case INT32_TYPE:
+      *out_value = value->constant.i32;
+      return true;
+    case INT64_TYPE:
+      *out_value = value->constant.i64;
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Whether the constant is the same byte repeated.
+static bool GetConstantSplatByte(const Value* value, uint8_t* out_byte) {
+  auto bytes = reinterpret_cast<const uint8_t*>(&value->constant);
+  size_t size = GetTypeSize(value->type);
+  for (size_t i = 1; i < size; ++i) {
+    if (bytes[i] != bytes[0]) {
+      return false;
+    }
+  }
+  *out_byte = bytes[0];
+  return true;
+}
+
+static Value* SkipAssigns(Value* value) {
+  while (value->def && value->def->opcode == &OPCODE_ASSIGN_info) {
+    value = value->def->src1.value;
+  }
+  return value;
+}
+
+static Value* GetStoredValue(const Instr* i) {
+  return i->opcode == &OPCODE_STORE_OFFSET_info ? i->src3.value
+                                                : i->src2.value;
+}
+
+static bool Overlaps(const std::vector<std::pair<uint32_t, uint32_t>>& ranges,
+                     uint32_t offset, uint32_t size) {
+  for (auto& range : ranges) {
+    if (offset < range.first + range.second && range.first < offset + size) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool EndsWithJump(const Block* block) {
+  const Instr* i = block->instr_tail;
+  if (!i) {
+    return false;
+  }
+  if (i->opcode == &OPCODE_BRANCH_info || i->opcode == &OPCODE_RETURN_info) {
+    return true;
+  }
+  return (i->opcode == &OPCODE_CALL_info ||
+          i->opcode == &OPCODE_CALL_INDIRECT_info) &&
+         (i->flags & CALL_TAIL);
+}
+
+// Parses memset(and(base + offset, ~(length - 1)), 0, length) of dcbz.
+static bool ParseClear(const Instr* i, Value** out_base, int64_t* out_offset,
+                       int64_t* out_length) {
+  if (i->opcode != &OPCODE_MEMSET_info || !i->src2.value->IsConstantZero() ||
+      !GetConstantInt(i->src3.value, out_length) ||
+      (*out_length != 32 && *out_length != 128)) {
+    return false;
+  }
+  const Instr* mask = SkipAssigns(i->src1.value)->def;
+  int64_t mask_value;
+  if (!mask || mask->opcode != &OPCODE_AND_info ||
+      !GetConstantInt(mask->src2.value, &mask_value) ||
+      uint32_t(mask_value) != uint32_t(-*out_length)) {
+    return false;
+  }
+  Value* address = SkipAssigns(mask->src1.value);
+  const Instr* add = address->def;
+  if (add && add->opcode == &OPCODE_ADD_info &&
+      GetConstantInt(add->src2.value, out_offset)) {
+    *out_base = SkipAssigns(add->src1.value);
+  } else {
+    *out_base = address;
+    *out_offset = 0;
+  }
+  return true;
+}
+
+MemoryIdiomRecognitionPass::MemoryIdiomRecognitionPass() : CompilerPass() {}
+
+MemoryIdiomRecognitionPass::~MemoryIdiomRecognitionPass() {}
+
+bool MemoryIdiomRecognitionPass::Run(HIRBuilder* builder) {
+  // Replaces guest code clearing or copying memory piece by piece with single
+  // memset and memcpy operations done by the host.
+  //
+  // dcbz/dcbz128 of adjacent cache blocks in a block are combined into one
+  // memset (see CombineClears).
+  //
+  // Loops made of a single block counted down with bdnz that store to
+  // contiguous ranges advancing by a constant every iteration, with values
+  // that don't change or are loaded from another such range:
+  //   loc_a:
+  //     v0 = load_context +r3
+  //     v1 = load_context +r4
+  //     v2 = truncate v1.i64
+  //     v3 = byte_swap v2.i32
+  //     store v0, v3.i32
+  //     v4 = add v0, 4
+  //     store_context +r3, v4
+  //     v5 = load_context +ctr
+  //     v6 = sub v5, 1
+  //     store_context +ctr, v6
+  //     v7 = truncate v6.i64
+  //     v8 = is_true v7.i32
+  //     branch_true v8, loc_a
+  // get a fast path taken after the first iteration, appended to the end of
+  // the function. If the ranges don't overlap, don't cross a 512 MB boundary
+  // (where the host mapping may not be contiguous) and the value is a byte
+  // repeated, it does all iterations but the last one at once and advances
+  // the induction registers. The last iteration is then done by the loop
+  // itself, so everything else it leaves in the context is still correct:
+  //   loc_a:
+  //     ...
+  //     branch_true v8, loc_b
+  //     ...
+  //   loc_b:
+  //     v10 = load_context +ctr
+  //     ...
+  //     branch_false v20, loc_a
+  //     memset v30, v31.i8, v32
+  //     ...
+  //     branch loc_a
+
+  uint32_t clear_count = 0;
+  auto block = builder->first_block();
+  while (block) {
+    clear_count += CombineClears(builder, block);
+    block = block->next;
+  }
+
+  uint32_t loop_count = 0;
+  Block* last_block = builder->last_block();
+  if (last_block && EndsWithJump(last_block)) {
+    block = builder->first_block();
+    while (block) {
+      if (LowerLoop(builder, block)) {
+        ++loop_count;
+      }
+      if (block == last_block) {
+        break;
+      }
+      block = block->next;
+    }
+  }
+
+  if (cvars::dump_translated_hir_functions && (clear_count || loop_count) &&
+      builder->first_block()->instr_head) {
+    builder->CommentFormat(
+        "memory idioms: combined {} cache block clears, lowered {} loops",
+        clear_count, loop_count);
+    builder->last_instr()->MoveBefore(builder->first_block()->instr_head);
+  }
+
+  return true;
+}
+
+uint32_t MemoryIdiomRecognitionPass::CombineClears(HIRBuilder* builder,
+                                                   Block* block) {
+  // Clears of adjacent cache blocks with only non-memory instructions in
+  // between:
+  //   v1 = and v0, ~31
+  //   memset v1, 0, 32
+  //   v2 = add v0, 32
+  //   v3 = and v2, ~31
+  //   memset v3, 0, 32
+  // become one at the position of the last one:
+  //   v1 = and v0, ~31
+  //   v2 = add v0, 32
+  //   v3 = and v2, ~31
+  //   memset v1, 0, 64
+  uint32_t combined_count = 0;
+  std::vector<Instr*> group;
+  Value* group_base = nullptr;
+  int64_t group_length = 0;
+  int64_t group_min = 0;
+  int64_t group_max = 0;
+  Instr* group_min_instr = nullptr;
+  auto flush = [&]() {
+    if (group.size() >= 2) {
+      Instr* last = group.back();
+      last->set_src1(group_min_instr->src1.value);
+      last->set_src3(builder->LoadConstantInt64(group_max - group_min +
+                                                group_length));
+      for (Instr* i : group) {
+        if (i != last) {
+          i->UnlinkAndNOP();
+        }
+      }
+      combined_count += uint32_t(group.size() - 1);
+    }
+    group.clear();
+  };
+  for (Instr* i = block->instr_head; i; i = i->next) {
+    Value* base;
+    int64_t offset, length;
+    if (ParseClear(i, &base, &offset, &length)) {
+      if (!group.empty() && base == group_base && length == group_length &&
+          (offset == group_max + length || offset == group_min - length)) {
+        if (offset < group_min) {
+          group_min = offset;
+          group_min_instr = i;
+        } else {
+          group_max = offset;
+        }
+        group.push_back(i);
+        continue;
+      }
+      flush();
+      group_base = base;
+      group_length = length;
+      group_min = group_max = offset;
+      group_min_instr = i;
+      group.push_back(i);
+      continue;
+    }
+    if (i->opcode->flags &
+        (OPCODE_FLAG_BRANCH | OPCODE_FLAG_MEMORY | OPCODE_FLAG_VOLATILE)) {
+      flush();
+    }
+  }
+  flush();
+  return combined_count;
+}
+
+bool MemoryIdiomRecognitionPass::LowerLoop(HIRBuilder* builder, Block* block) {
+  Instr* branch = block->instr_tail;
+  if (!branch || branch->opcode != &OPCODE_BRANCH_TRUE_info ||
+      branch->src2.label->block != block || !ScanLoop(block)) {
+    return false;
+  }
+
+  // Must be counted down with bdnz, which only looks at the lower 32 bits.
+  Instr* test = SkipAssigns(branch->src1.value)->def;
+  Affine counter;
+  if (!test || test->opcode != &OPCODE_IS_TRUE_info ||
+      test->src1.value->type != INT32_TYPE ||
+      !EvaluateAffine(test->src1.value, &counter) || counter.addend != -1 ||
+      GetStride(counter.offset) != -1) {
+    return false;
+  }
+  counter_offset_ = counter.offset;
+
+  Access dest;
+  Access source;
+  bool copy = false;
+  Value* fill_value = nullptr;
+  uint8_t fill_byte = 0;
+  if (clears_.size() == 1 && stores_.empty()) {
+    dest = clears_[0];
+    if (GetStride(dest.base) != int64_t(dest.size)) {
+      return false;
+    }
+  } else if (!stores_.empty() && clears_.empty()) {
+    std::sort(stores_.begin(), stores_.end(),
+              [](const Access& a, const Access& b) {
+                return a.addend < b.addend;
+              });
+    int64_t stride = GetStride(stores_[0].base);
+    int64_t next_addend = stores_[0].addend;
+    for (const Access& store : stores_) {
+      if (store.base != stores_[0].base || store.addend != next_addend ||
+          (store.alignment != 1 && stores_.size() != 1)) {
+        return false;
+      }
+      next_addend += store.size;
+    }
+    if (stride <= 0 || next_addend - stores_[0].addend != stride ||
+        (stores_[0].alignment != 1 &&
+         int64_t(stores_[0].alignment) != stride)) {
+      return false;
+    }
+    dest = stores_[0];
+    dest.size = uint32_t(stride);
+
+    Value* first_value = SkipAssigns(GetStoredValue(stores_[0].instr));
+    if (FindCopySource(first_value, stores_[0].size,
+                       !!(stores_[0].instr->flags & LOAD_STORE_BYTE_SWAP))) {
+      // Each store must get the value loaded at the same position in the
+      // source range.
+      for (size_t n = 0; n < stores_.size(); ++n) {
+        const Access& store = stores_[n];
+        Instr* load =
+            FindCopySource(GetStoredValue(store.instr), store.size,
+                           !!(store.instr->flags & LOAD_STORE_BYTE_SWAP));
+        auto load_it = load ? loads_.find(load) : loads_.end();
+        if (load_it == loads_.end()) {
+          return false;
+        }
+        const Access& load_access = load_it->second;
+        if (load_access.base == dest.base ||
+            GetStride(load_access.base) != stride ||
+            load_access.alignment != store.alignment ||
+            load_access.size != store.size) {
+          return false;
+        }
+        if (!n) {
+          source = load_access;
+        } else if (load_access.base != source.base ||
+                   load_access.addend - store.addend !=
+                       source.addend - stores_[0].addend) {
+          return false;
+        }
+      }
+      source.size = uint32_t(stride);
+      copy = true;
+    } else if (first_value->IsConstant()) {
+      if (!GetConstantSplatByte(first_value, &fill_byte)) {
+        return false;
+      }
+      for (const Access& store : stores_) {
+        Value* value = SkipAssigns(GetStoredValue(store.instr));
+        uint8_t byte;
+        if (!value->IsConstant() || !GetConstantSplatByte(value, &byte) ||
+            byte != fill_byte) {
+          return false;
+        }
+      }
+    } else {
+      // Checked to be a byte repeated in the fast path.
+      if (!IsScalarIntegralType(first_value->type) ||
+          !IsInvariant(first_value)) {
+        return false;
+      }
+      for (const Access& store : stores_) {
+        if (SkipAssigns(GetStoredValue(store.instr)) != first_value) {
+          return false;
+        }
+      }
+      fill_value = first_value;
+    }
+  } else {
+    return false;
+  }
+
+  Label* loop_label = branch->src2.label;
+  Label* fast_label = builder->NewLabel();
+  builder->MarkLabel(fast_label);
+  Block* fast_block = fast_label->block;
+
+  Value* fill_slot = nullptr;
+  if (fill_value) {
+    fill_slot = builder->AllocLocal(fill_value->type);
+    builder->StoreLocal(fill_slot, fill_value);
+    builder->last_instr()->MoveBefore(branch);
+  }
+
+  // Check whether the remaining iterations can be done at once.
+  Value* remaining;
+  Value* count;
+  Value* length;
+  EmitLength(builder, dest.size, &remaining, &count, &length);
+  Value* ok = builder->CompareUGT(remaining, builder->LoadConstantUint64(1));
+  auto check_range = [&](Value* start) {
+    Value* last = builder->Add(
+        start, builder->Sub(length, builder->LoadConstantInt64(1)));
+    ok = builder->And(ok, builder->CompareEQ(builder->Shr(start, int8_t(29)),
+                                             builder->Shr(last, int8_t(29))));
+  };
+  Value* dest_start = EmitStart(builder, dest);
+  check_range(dest_start);
+  if (copy) {
+    Value* source_start = EmitStart(builder, source);
+    check_range(source_start);
+    ok = builder->And(
+        ok, builder->Or(builder->CompareULE(builder->Add(dest_start, length),
+                                            source_start),
+                        builder->CompareULE(builder->Add(source_start, length),
+                                            dest_start)));
+  }
+  if (fill_slot && fill_value->type != INT8_TYPE) {
+    Value* value = builder->LoadLocal(fill_slot);
+    Value* splat;
+    switch (value->type) {
+      case INT16_TYPE:
+        splat = builder->LoadConstantUint16(0x0101);
+        break;
+      case INT32_TYPE:
+        splat = builder->LoadConstantUint32(0x01010101);
+        break;
+      default:
+        splat = builder->LoadConstantUint64(0x0101010101010101);
+        break;
+    }
+    splat = builder->Mul(
+        builder->ZeroExtend(builder->Truncate(value, INT8_TYPE), value->type),
+        splat);
+    ok = builder->And(ok, builder->CompareEQ(splat, value));
+  }
+  builder->BranchFalse(ok, loop_label);
+
+  // All iterations but the last one.
+  EmitLength(builder, dest.size, &remaining, &count, &length);
+  dest_start = EmitStart(builder, dest);
+  if (copy) {
+    builder->Memcpy(dest_start, EmitStart(builder, source), length);
+  } else {
+    Value* value;
+    if (!fill_slot) {
+      value = builder->LoadConstantUint8(fill_byte);
+    } else if (fill_value->type == INT8_TYPE) {
+      value = builder->LoadLocal(fill_slot);
+    } else {
+      value = builder->Truncate(builder->LoadLocal(fill_slot), INT8_TYPE);
+    }
+    builder->Memset(dest_start, value, length);
+  }
+  for (auto& induction : inductions_) {
+    if (!induction.second) {
+      continue;
+    }
+    Value* delta =
+        builder->Mul(count, builder->LoadConstantInt64(induction.second));
+    builder->StoreContext(
+        induction.first,
+        builder->Add(builder->LoadContext(induction.first, INT64_TYPE),
+                     delta));
+  }
+  builder->Branch(loop_label);
+  Block* bulk_block = builder->last_block();
+
+  branch->src2.label = fast_label;
+  builder->RemoveEdge(block, block);
+  builder->AddEdge(block, fast_block, 0);
+  builder->AddEdge(fast_block, block, 0);
+  builder->AddEdge(fast_block, bulk_block, 0);
+  builder->AddEdge(bulk_block, block, Edge::UNCONDITIONAL);
+  return true;
+}
+
+bool MemoryIdiomRecognitionPass::ScanLoop(Block* block) {
+  inductions_.clear();
+  loaded_context_.clear();
+  stored_context_.clear();
+  loads_.clear();
+  stores_.clear();
+  clears_.clear();
+  std::vector<std::pair<uint32_t, uint32_t>> temporaries;
+  for (Instr* i = block->instr_head; i != block->instr_tail; i = i->next) {
+    switch (i->opcode->num) {
+      case OPCODE_COMMENT:
+      case OPCODE_NOP:
+      case OPCODE_SOURCE_OFFSET:
+      case OPCODE_CONTEXT_BARRIER:
+      case OPCODE_CACHE_CONTROL:
+      case OPCODE_LOAD_LOCAL:
+        break;
+      case OPCODE_LOAD_CONTEXT: {
+        uint32_t offset = uint32_t(i->src1.offset);
+        uint32_t size = uint32_t(GetTypeSize(i->dest->type));
+        if (Overlaps(stored_context_, offset, size)) {
+          return false;
+        }
+        loaded_context_.emplace_back(offset, size);
+      } break;
+      case OPCODE_STORE_CONTEXT: {
+        uint32_t offset = uint32_t(i->src1.offset);
+        uint32_t size = uint32_t(GetTypeSize(i->src2.value->type));
+        if (Overlaps(stored_context_, offset, size)) {
+          return false;
+        }
+        stored_context_.emplace_back(offset, size);
+        Affine affine;
+        if (i->src2.value->type == INT64_TYPE &&
+            EvaluateAffine(i->src2.value, &affine) && affine.exact &&
+            affine.offset == offset) {
+          inductions_.emplace_back(offset, affine.addend);
+        } else {
+          temporaries.emplace_back(offset, size);
+        }
+      } break;
+      case OPCODE_LOAD:
+      case OPCODE_LOAD_OFFSET: {
+        if (i->flags & ~LOAD_STORE_BYTE_SWAP) {
+          return false;
+        }
+        // Loads not feeding stores don't matter.
+        Access access;
+        if (EvaluateAddress(i->src1.value,
+                            i->opcode == &OPCODE_LOAD_OFFSET_info
+                                ? i->src2.value
+                                : nullptr,
+                            &access)) {
+          access.instr = i;
+          access.size = uint32_t(GetTypeSize(i->dest->type));
+          loads_.emplace(i, access);
+        }
+      } break;
+      case OPCODE_STORE:
+      case OPCODE_STORE_OFFSET: {
+        if (i->flags & ~LOAD_STORE_BYTE_SWAP) {
+          return false;
+        }
+        Access access;
+        if (!EvaluateAddress(i->src1.value,
+                             i->opcode == &OPCODE_STORE_OFFSET_info
+                                 ? i->src2.value
+                                 : nullptr,
+                             &access)) {
+          return false;
+        }
+        access.instr = i;
+        access.size = uint32_t(GetTypeSize(GetStoredValue(i)->type));
+        stores_.push_back(access);
+      } break;
+      case OPCODE_MEMSET: {
+        int64_t length;
+        Access access;
+        if (!i->src2.value->IsConstantZero() ||
+            !GetConstantInt(i->src3.value, &length) ||
+            !EvaluateAddress(i->src1.value, nullptr, &access) ||
+            access.alignment == 1 || (length & (access.alignment - 1))) {
+          return false;
+        }
+        access.instr = i;
+        access.size = uint32_t(length);
+        clears_.push_back(access);
+      } break;
+      case OPCODE_STORE_LOCAL:
+        return false;
+      default:
+        if (i->opcode->flags &
+            (OPCODE_FLAG_BRANCH | OPCODE_FLAG_MEMORY | OPCODE_FLAG_VOLATILE)) {
+          return false;
+        }
+        break;
+    }
+  }
+  // Values from the previous iteration may only come through the inductions.
+  for (auto& temporary : temporaries) {
+    if (Overlaps(loaded_context_, temporary.first, temporary.second)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool MemoryIdiomRecognitionPass::EvaluateAffine(Value* value,
+                                                Affine* affine) const {
+  affine->addend = 0;
+  affine->exact = true;
+  while (true) {
+    if (value->type != INT64_TYPE) {
+      if (value->type != INT32_TYPE) {
+        return false;
+      }
+      affine->exact = false;
+    }
+    const Instr* def = value->def;
+    if (!def) {
+      return false;
+    }
+    int64_t constant;
+    switch (def->opcode->num) {
+      case OPCODE_ASSIGN:
+        break;
+      case OPCODE_TRUNCATE:
+      case OPCODE_ZERO_EXTEND:
+      case OPCODE_SIGN_EXTEND:
+        affine->exact = false;
+        break;
+      case OPCODE_ADD:
+        if (GetConstantInt(def->src2.value, &constant)) {
+          affine->addend += constant;
+          break;
+        }
+        if (GetConstantInt(def->src1.value, &constant)) {
+          affine->addend += constant;
+          value = def->src2.value;
+          continue;
+        }
+        return false;
+      case OPCODE_SUB:
+        if (!GetConstantInt(def->src2.value, &constant)) {
+          return false;
+        }
+        affine->addend -= constant;
+        break;
+      case OPCODE_LOAD_CONTEXT:
+        if (value->type != INT64_TYPE) {
+          return false;
+        }
+        affine->offset = uint32_t(def->src1.offset);
+        return true;
+      default:
+        return false;
+    }
+    value = def->src1.value;
+  }
+}
+
+bool MemoryIdiomRecognitionPass::EvaluateAddress(Value* address,
+                                                 Value* offset,
+                                                 Access* access) const {
+  access->alignment = 1;
+  address = SkipAssigns(address);
+  const Instr* def = address->def;
+  int64_t mask;
+  if (def && def->opcode == &OPCODE_AND_info &&
+      GetConstantInt(def->src2.value, &mask)) {
+    uint32_t alignment = uint32_t(0) - uint32_t(mask);
+    if (!alignment || (alignment & (alignment - 1)) ||
+        (alignment != 1 && offset)) {
+      return false;
+    }
+    access->alignment = alignment;
+    address = def->src1.value;
+  }
+  Affine affine;
+  if (!EvaluateAffine(address, &affine)) {
+    return false;
+  }
+  access->base = affine.offset;
+  access->addend = affine.addend;
+  if (offset) {
+    int64_t offset_value;
+    if (!GetConstantInt(offset, &offset_value)) {
+      return false;
+    }
+    access->addend += offset_value;
+  }
+  return true;
+}
+
+Instr* MemoryIdiomRecognitionPass::FindCopySource(Value* value, uint32_t size,
+                                                  bool swapped) const {
+  // The bytes must reach the store unchanged, possibly swapped twice.
+  while (true) {
+    Instr* def = value->def;
+    if (!def) {
+      return nullptr;
+    }
+    uint32_t value_size = uint32_t(GetTypeSize(value->type));
+    switch (def->opcode->num) {
+      case OPCODE_ASSIGN:
+        break;
+      case OPCODE_CAST:
+      case OPCODE_TRUNCATE:
+        if (value_size != size) {
+          return nullptr;
+        }
+        break;
+      case OPCODE_BYTE_SWAP:
+        if (value_size != size) {
+          return nullptr;
+        }
+        swapped = !swapped;
+        break;
+      case OPCODE_ZERO_EXTEND:
+      case OPCODE_SIGN_EXTEND:
+        if (GetTypeSize(def->src1.value->type) != size) {
+          return nullptr;
+        }
+        break;
+      case OPCODE_LOAD:
+      case OPCODE_LOAD_OFFSET:
+        if (value_size != size ||
+            swapped != !!(def->flags & LOAD_STORE_BYTE_SWAP)) {
+          return nullptr;
+        }
+        return def;
+      default:
+        return nullptr;
+    }
+    value = def->src1.value;
+  }
+}
+
+bool MemoryIdiomRecognitionPass::IsInvariant(const Value* value,
+                                             uint32_t depth) const {
+  if (value->IsConstant()) {
+    return true;
+  }
+  const Instr* def = value->def;
+  if (!def || depth >= 8) {
+    return false;
+  }
+  switch (def->opcode->num) {
+    case OPCODE_LOAD_CONTEXT:
+      return !Overlaps(stored_context_, uint32_t(def->src1.offset),
+                       uint32_t(GetTypeSize(value->type)));
+    case OPCODE_LOAD_LOCAL:
+      // Locals aren't stored in the loop.
+      return true;
+    case OPCODE_LOAD_CLOCK:
+      return false;
+    default:
+      break;
+  }
+  if (def->opcode->flags &
+      (OPCODE_FLAG_BRANCH | OPCODE_FLAG_MEMORY | OPCODE_FLAG_VOLATILE)) {
+    return false;
+  }
+  uint32_t signature = def->opcode->signature;
+  for (uint32_t n = 0; n < 3; ++n) {
+    if (GET_OPCODE_SIG_TYPE_SRCN(signature, n) == OPCODE_SIG_TYPE_V &&
+        !IsInvariant(def->srcs[n].value, depth + 1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int64_t MemoryIdiomRecognitionPass::GetStride(uint32_t offset) const {
+  for (auto& induction : inductions_) {
+    if (induction.first == offset) {
+      return induction.second;
+    }
+  }
+  return 0;
+}
+
+void MemoryIdiomRecognitionPass::EmitLength(HIRBuilder* builder,
+                                            uint32_t stride, Value** remaining,
+                                            Value** count,
+                                            Value** length) const {
+  *remaining = builder->And(
+      builder->LoadContext(counter_offset_, INT64_TYPE),
+      builder->LoadConstantUint64(0xFFFFFFFF));
+  *count = builder->Sub(*remaining, builder->LoadConstantUint64(1));
+  *length = builder->Mul(*count, builder->LoadConstantUint64(stride));
+}
+
+Value* MemoryIdiomRecognitionPass::EmitStart(HIRBuilder* builder,
+                                             const Access& access) const {
+  Value* start = builder->LoadContext(access.base, INT64_TYPE);
+  if (access.addend) {
+    start = builder->Add(start, builder->LoadConstantInt64(access.addend));
+  }
+  // Zero-extended from the 32-bit guest address.
+  return builder->And(start, builder->LoadConstantUint64(uint32_t(0) -
+                                                         access.alignment));
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
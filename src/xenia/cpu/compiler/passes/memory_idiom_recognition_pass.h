@@ -0,0 +1,84 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_MEMORY_IDIOM_RECOGNITION_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_MEMORY_IDIOM_RECOGNITION_PASS_H_
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+class MemoryIdiomRecognitionPass : public CompilerPass {
+ public:
+  MemoryIdiomRecognitionPass();
+  ~MemoryIdiomRecognitionPass() override;
+
+  bool Run(hir::HIRBuilder* builder) override;
+  const char* name() const override { return "memory_idiom_recognition"; }
+
+ private:
+  // Context field (a guest register) at the start of the loop iteration plus
+  // a constant, modulo 2^32 like guest addresses unless exact.
+  struct Affine {
+    uint32_t offset;
+    int64_t addend;
+    bool exact;
+  };
+  // Guest memory range accessed on every iteration, the address of the next
+  // iteration advances by the stride of the base register.
+  struct Access {
+    hir::Instr* instr;
+    uint32_t base;
+    int64_t addend;
+    // Power of two the address is rounded down to (for dcbz and vectors).
+    uint32_t alignment;
+    uint32_t size;
+  };
+
+  uint32_t CombineClears(hir::HIRBuilder* builder, hir::Block* block);
+  bool LowerLoop(hir::HIRBuilder* builder, hir::Block* block);
+  bool ScanLoop(hir::Block* block);
+  bool EvaluateAffine(hir::Value* value, Affine* affine) const;
+  bool EvaluateAddress(hir::Value* address, hir::Value* offset,
+                       Access* access) const;
+  hir::Instr* FindCopySource(hir::Value* value, uint32_t size,
+                             bool swapped) const;
+  bool IsInvariant(const hir::Value* value, uint32_t depth = 0) const;
+  int64_t GetStride(uint32_t offset) const;
+  // Emits the number of iterations left, the number of iterations done with
+  // one operation (all but the last one), and the size of their range.
+  void EmitLength(hir::HIRBuilder* builder, uint32_t stride,
+                  hir::Value** remaining, hir::Value** count,
+                  hir::Value** length) const;
+  hir::Value* EmitStart(hir::HIRBuilder* builder, const Access& access) const;
+
+  // Registers advanced by a constant on every iteration, with the stride.
+  std::vector<std::pair<uint32_t, int64_t>> inductions_;
+  // Context ranges (offset, size) loaded and stored in the loop.
+  std::vector<std::pair<uint32_t, uint32_t>> loaded_context_;
+  std::vector<std::pair<uint32_t, uint32_t>> stored_context_;
+  std::unordered_map<const hir::Instr*, Access> loads_;
+  std::vector<Access> stores_;
+  std::vector<Access> clears_;
+  uint32_t counter_offset_;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_MEMORY_IDIOM_RECOGNITION_PASS_H_
@@ -10,6 +10,7 @@
 #include "xenia/cpu/compiler/passes/memory_sequence_combination_pass.h"
 
 #include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compiler.h"
 
 namespace xe {
 namespace cpu {
@@ -23,14 +24,16 @@ using xe::cpu::hir::HIRBuilder;
 using xe::cpu::hir::Instr;
 using xe::cpu::hir::Value;
 
-MemorySequenceCombinationPass::MemorySequenceCombinationPass()
-    : CompilerPass() {}
+MemorySequenceCombinationPass::MemorySequenceCombinationPass(
+    bool combine_scalar)
+    : CompilerPass(), combine_scalar_(combine_scalar) {}
 
 MemorySequenceCombinationPass::~MemorySequenceCombinationPass() = default;
 
 bool MemorySequenceCombinationPass::Run(HIRBuilder* builder) {
   // Run over all loads and stores and see if we can collapse sequences into the
   // fat opcodes. See the respective utility functions for examples.
+  fused_count_ = 0;
   auto block = builder->first_block();
   while (block) {
     auto i = block->instr_head;
@@ -46,9 +49,23 @@ bool MemorySequenceCombinationPass::Run(HIRBuilder* builder) {
     }
     block = block->next;
   }
+  if (auto statistics = compiler_->statistics()) {
+    statistics->byte_swaps_fused += fused_count_;
+  }
   return true;
 }
 
+bool MemorySequenceCombinationPass::CanCombine(Instr* i,
+                                               TypeName type) const {
+  if (combine_scalar_) {
+    return true;
+  }
+  // Swapped vectors are shuffled after loading or before storing, which
+  // doesn't need MOVBE, but only the plain vector load and store support it.
+  return type == VEC128_TYPE && (i->opcode == &OPCODE_LOAD_info ||
+                                 i->opcode == &OPCODE_STORE_info);
+}
+
 void MemorySequenceCombinationPass::CombineLoadSequence(Instr* i) {
   // Load with swap:
   //   v1.i32 = load v0
@@ -67,6 +84,9 @@ void MemorySequenceCombinationPass::CombineLoadSequence(Instr* i) {
     // No uses of the load result - ignore. Will be killed by DCE.
     return;
   }
+  if (!CanCombine(i, i->dest->type)) {
+    return;
+  }
 
   // Ensure all uses of the load result are BYTE_SWAP - if it's mixed we
   // shouldn't transform as we'd have to introduce new swaps!
@@ -91,6 +111,7 @@ void MemorySequenceCombinationPass::CombineLoadSequence(Instr* i) {
     auto next_use = use->next;
     use->instr->opcode = &OPCODE_ASSIGN_info;
     use->instr->flags = 0;
+    ++fused_count_;
     use = next_use;
   }
 
@@ -122,6 +143,9 @@ void MemorySequenceCombinationPass::CombineStoreSequence(Instr* i) {
     // Constant value write - ignore.
     return;
   }
+  if (!CanCombine(i, src->type)) {
+    return;
+  }
 
   // Find source and ensure it is a byte swap.
   auto def = src->def;
@@ -138,6 +162,7 @@ void MemorySequenceCombinationPass::CombineStoreSequence(Instr* i) {
   // Note that we may have already been a swapped operation - this inverts
   // that.
   i->flags ^= LoadStoreFlags::LOAD_STORE_BYTE_SWAP;
+  ++fused_count_;
 
   // Pull the original value (from before the byte swap).
   // The byte swap itself will go away in DCE.
@@ -19,15 +19,22 @@ namespace passes {
 
 class MemorySequenceCombinationPass : public CompilerPass {
  public:
-  MemorySequenceCombinationPass();
+  // Scalar swaps are only merged if the backend can load and store swapped
+  // integers natively, vector ones always are.
+  explicit MemorySequenceCombinationPass(bool combine_scalar = true);
   ~MemorySequenceCombinationPass() override;
 
   bool Run(hir::HIRBuilder* builder) override;
+  const char* name() const override { return "memory_sequence_combination"; }
 
  private:
   void CombineMemorySequences(hir::HIRBuilder* builder);
   void CombineLoadSequence(hir::Instr* i);
   void CombineStoreSequence(hir::Instr* i);
+  bool CanCombine(hir::Instr* i, hir::TypeName type) const;
+
+  bool combine_scalar_;
+  uint32_t fused_count_ = 0;
 };
 
 }  // namespace passes
@@ -16,6 +16,7 @@
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compiler.h"
 
 namespace xe {
 namespace cpu {
@@ -76,6 +77,10 @@ bool RegisterAllocationPass::Run(HIRBuilder* builder) {
   // optimized with some intra-block analysis (dominators/etc).
   // Really, it'd just be nice to have someone who knew what they
   // were doing lower SSA and do this right.
+  // Within a block this is a linear scan over the live ranges of the values:
+  // when out of registers, the range with the furthest next use is split
+  // there, and the value is either rematerialized (if it's calculated from
+  // constants) or spilled to a local and loaded back as a new value.
 
   uint16_t block_ordinal = 0;
   uint32_t instr_ordinal = 0;
@@ -118,7 +123,7 @@ bool RegisterAllocationPass::Run(HIRBuilder* builder) {
           // Pull off preferred register. We will try to reuse this for the
           // dest.
           // NOTE: set may be null if this is a store local.
-          if (preferred_reg.set) {
+          if (instr->src1.value->reg.set) {
             has_preferred_reg = true;
             preferred_reg = instr->src1.value->reg;
           }
@@ -345,11 +350,17 @@ bool RegisterAllocationPass::SpillOneRegister(HIRBuilder* builder, Block* block,
   }
 
   DumpUsage("SpillOneRegister (pre)");
-  // Pick the one with the furthest next use.
+  // Pick the one with the furthest next use, preferring values that are
+  // cheaper to bring back if there are multiple.
   assert_true(!usage_set->upcoming_uses.empty());
-  auto furthest_usage =
-      std::max_element(usage_set->upcoming_uses.begin(),
-                       usage_set->upcoming_uses.end(), &RegisterUsage::Compare);
+  auto furthest_usage = std::max_element(
+      usage_set->upcoming_uses.begin(), usage_set->upcoming_uses.end(),
+      [](const RegisterUsage& a, const RegisterUsage& b) {
+        if (a.use->instr->ordinal != b.use->instr->ordinal) {
+          return a.use->instr->ordinal < b.use->instr->ordinal;
+        }
+        return GetSpillCost(a.value) > GetSpillCost(b.value);
+      });
   assert_true(furthest_usage->value->def->block == block);
   assert_true(furthest_usage->use->instr->block == block);
   auto spill_value = furthest_usage->value;
@@ -364,6 +375,64 @@ bool RegisterAllocationPass::SpillOneRegister(HIRBuilder* builder, Block* block,
   // This makes it easier down below.
   auto new_head_use = next_use;
 
+  Value* new_value;
+  if (IsRematerializable(spill_value)) {
+    // Recalculate the value from its constant sources right before the next
+    // use instead of going through the stack.
+    auto remat_instr = builder->CloneInstr(spill_value->def);
+    remat_instr->MoveBefore(next_use->instr);
+    new_value = remat_instr->dest;
+    spill_value->last_use = prev_use ? prev_use->instr : spill_value->def;
+  } else {
+    new_value = SpillValue(builder, spill_value, prev_use, next_use);
+    if (auto statistics = compiler_->statistics()) {
+      ++statistics->spill_count;
+    }
+  }
+
+  // Rename all future uses of the SSA value to the new value.
+  // We can quickly do this by walking the use list. Because the list is
+  // already sorted we know we are going to end up with a sorted list.
+  auto walk_use = new_head_use;
+  auto new_use_tail = walk_use;
+  while (walk_use) {
+    auto next_walk_use = walk_use->next;
+    auto instr = walk_use->instr;
+
+    uint32_t signature = instr->opcode->signature;
+    if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
+      if (instr->src1.value == spill_value) {
+        instr->set_src1(new_value);
+      }
+    }
+    if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V) {
+      if (instr->src2.value == spill_value) {
+        instr->set_src2(new_value);
+      }
+    }
+    if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V) {
+      if (instr->src3.value == spill_value) {
+        instr->set_src3(new_value);
+      }
+    }
+
+    walk_use = next_walk_use;
+    if (walk_use) {
+      new_use_tail = walk_use;
+    }
+  }
+  new_value->last_use = new_use_tail->instr;
+
+  // Update tracking.
+  MarkRegAvailable(reg);
+
+  return true;
+}
+
+Value* RegisterAllocationPass::SpillValue(HIRBuilder* builder,
+                                          Value* spill_value,
+                                          Value::Use* prev_use,
+                                          Value::Use* next_use) {
   // Allocate local.
   if (spill_value->HasLocalSlot()) {
     // Value is already assigned a slot. Since we allocate in order and this is
@@ -430,47 +499,49 @@ bool RegisterAllocationPass::SpillOneRegister(HIRBuilder* builder, Block* block,
   // Set the local slot of the new value to our existing one. This way we will
   // reuse that same memory if needed.
   new_value->SetLocalSlot( spill_value->GetLocalSlot());
+  return new_value;
+}
 
-  // Rename all future uses of the SSA value to the new value as loaded
-  // from the local.
-  // We can quickly do this by walking the use list. Because the list is
-  // already sorted we know we are going to end up with a sorted list.
-  auto walk_use = new_head_use;
-  auto new_use_tail = walk_use;
-  while (walk_use) {
-    auto next_walk_use = walk_use->next;
-    auto instr = walk_use->instr;
-
-    uint32_t signature = instr->opcode->signature;
-    if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
-      if (instr->src1.value == spill_value) {
-        instr->set_src1(new_value);
-      }
-    }
-    if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V) {
-      if (instr->src2.value == spill_value) {
-        instr->set_src2(new_value);
-      }
-    }
-    if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V) {
-      if (instr->src3.value == spill_value) {
-        instr->set_src3(new_value);
-      }
-    }
-
-    walk_use = next_walk_use;
-    if (walk_use) {
-      new_use_tail = walk_use;
+bool RegisterAllocationPass::IsRematerializable(const Value* value) {
+  const Instr* def = value->def;
+  switch (def->opcode->num) {
+    case OPCODE_ASSIGN:
+    case OPCODE_CAST:
+    case OPCODE_ZERO_EXTEND:
+    case OPCODE_SIGN_EXTEND:
+    case OPCODE_TRUNCATE:
+    case OPCODE_LOAD_VECTOR_SHL:
+    case OPCODE_LOAD_VECTOR_SHR:
+    case OPCODE_SPLAT:
+    case OPCODE_PERMUTE:
+    case OPCODE_SWIZZLE:
+      break;
+    default:
+      return false;
+  }
+  uint32_t signature = def->opcode->signature;
+  OpcodeSignatureType src_types[] = {
+      GET_OPCODE_SIG_TYPE_SRC1(signature),
+      GET_OPCODE_SIG_TYPE_SRC2(signature),
+      GET_OPCODE_SIG_TYPE_SRC3(signature),
+  };
+  for (uint32_t n = 0; n < 3; ++n) {
+    if (src_types[n] == OPCODE_SIG_TYPE_V &&
+        !def->srcs[n].value->IsConstant()) {
+      return false;
     }
   }
-  new_value->last_use = new_use_tail->instr;
-
-  // Update tracking.
-  MarkRegAvailable(reg);
-
   return true;
 }
 
+uint32_t RegisterAllocationPass::GetSpillCost(const Value* value) {
+  if (IsRematerializable(value)) {
+    return 0;
+  }
+  // Only a reload is needed if the value was already spilled once.
+  return value->HasLocalSlot() ? 1 : 2;
+}
+
 RegisterAllocationPass::RegisterSetUsage*
 RegisterAllocationPass::RegisterSetForValue(const Value* value) {
   if (value->type <= INT64_TYPE) {
@@ -29,6 +29,7 @@ class RegisterAllocationPass : public CompilerPass {
   ~RegisterAllocationPass() override;
 
   bool Run(hir::HIRBuilder* builder) override;
+  const char* name() const override { return "register_allocation"; }
 
  private:
   // TODO(benvanik): rewrite all this set shit -- too much indirection, the
@@ -64,6 +65,14 @@ class RegisterAllocationPass : public CompilerPass {
   bool TryAllocateRegister(hir::Value* value);
   bool SpillOneRegister(hir::HIRBuilder* builder, hir::Block* block,
                         hir::TypeName required_type);
+  // Stores the value to a local if needed and loads it before the next use,
+  // returns the loaded value.
+  hir::Value* SpillValue(hir::HIRBuilder* builder, hir::Value* spill_value,
+                         hir::Value::Use* prev_use, hir::Value::Use* next_use);
+  // Whether the value can be recalculated from constants at any point instead
+  // of being spilled.
+  static bool IsRematerializable(const hir::Value* value);
+  static uint32_t GetSpillCost(const hir::Value* value);
 
   RegisterSetUsage* RegisterSetForValue(const hir::Value* value);
 
@@ -0,0 +1,538 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/stack_promotion_pass.h"
+
+#include <algorithm>
+#include <cstddef>
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/ppc/ppc_context.h"
+
+DECLARE_bool(debug);
+DECLARE_bool(full_optimization_even_with_debug);
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::Value;
+
+static constexpr size_t kStackPointerOffset = offsetof(ppc::PPCContext, r[1]);
+
+static bool GetConstantInt(const Value* value, int64_t* out_value) {
+  if (!value->IsConstant()) {
+    return false;
+  }
+  switch (value->type) {
+    case INT8_TYPE:
+      *out_value = value->constant.i8;
+      return true;
+    case INT16_TYPE:
+      *out_value = value->constant.i16;
+      return true;
+    case INT32_TYPE:
+      *out_value = value->constant.i32;
+      return true;
+    case INT64_TYPE:
+      *out_value = value->constant.i64;
+      return true;
+    default:
+      return false;
+  }
+}
+
+static Value* SkipAssigns(Value* value) {
+  while (value->def && value->def->opcode == &OPCODE_ASSIGN_info) {
+    value = value->def->src1.value;
+  }
+  return value;
+}
+
+static Value* GetStoredValue(const Instr* i) {
+  return i->opcode == &OPCODE_STORE_OFFSET_info ? i->src3.value
+                                                : i->src2.value;
+}
+
+static bool OverlapsStackPointer(size_t offset, TypeName type) {
+  return offset < kStackPointerOffset + sizeof(uint64_t) &&
+         offset + GetTypeSize(type) > kStackPointerOffset;
+}
+
+StackPromotionPass::StackPromotionPass() : CompilerPass() {}
+
+StackPromotionPass::~StackPromotionPass() {}
+
+bool StackPromotionPass::Run(HIRBuilder* builder) {
+  // Guest compilers spill and keep locals in the stack frame, and each access
+  // is a byte swapped guest memory access. If the function never lets the
+  // address of its frame out, nothing but the function itself can access the
+  // frame below the stack pointer it was called with, so those slots are
+  // converted to HIR locals:
+  //   v0 = load_context +r1
+  //   v1 = add v0, -96
+  //   store_context +r1, v1
+  //   store_offset v1, 80, v2  <-- store_local l0, v2
+  //   ...
+  //   v3 = load_offset v1, 80  <-- v3 = load_local l0
+  //
+  // Conservatively, nothing is done in functions making calls (the callee may
+  // read the frame through the back chain, like __restgprlr does with the
+  // saved registers), trapping, or using the stack pointer in any other way
+  // than as the base of loads and stores with constant offsets. Inlined
+  // __savegprlr helpers are just stores relative to the stack pointer.
+  if (cvars::debug && !cvars::full_optimization_even_with_debug) {
+    // The debugger reads the frames.
+    return true;
+  }
+  SCOPE_profile_cpu_f("cpu");
+
+  block_states_.clear();
+  stack_addresses_.clear();
+  stack_address_data_.clear();
+  accesses_.clear();
+  promoted_locals_.clear();
+
+  if (!ScanFunction(builder)) {
+    return true;
+  }
+  if (PromoteSlots(builder)) {
+    ForwardLocals(builder);
+  }
+  return true;
+}
+
+bool StackPromotionPass::ScanFunction(HIRBuilder* builder) {
+  uint32_t block_count = 0;
+  auto block = builder->first_block();
+  while (block) {
+    block->ordinal = block_count++;
+    block = block->next;
+  }
+  if (!block_count) {
+    return false;
+  }
+  block_states_.resize(block_count, BlockState{false, false, 0});
+
+  // The stack pointer on entry is the base of the offsets, it must be known
+  // the same way on every path wherever it's loaded.
+  std::vector<Block*> worklist;
+  ReachBlock(builder->first_block(), true, 0, worklist);
+  while (!worklist.empty()) {
+    block = worklist.back();
+    worklist.pop_back();
+    if (!ScanBlock(block, worklist)) {
+      return false;
+    }
+  }
+
+  // Not reached through the branches, but make sure no path was missed.
+  block = builder->first_block();
+  while (block) {
+    if (!block_states_[block->ordinal].reached) {
+      for (Instr* i = block->instr_head; i; i = i->next) {
+        if (i->opcode == &OPCODE_LOAD_CONTEXT_info &&
+            OverlapsStackPointer(i->src1.offset, i->dest->type)) {
+          return false;
+        }
+      }
+    }
+    block = block->next;
+  }
+  return !accesses_.empty();
+}
+
+bool StackPromotionPass::ReachBlock(Block* block, bool stack_pointer_known,
+                                    int64_t stack_pointer,
+                                    std::vector<Block*>& worklist) {
+  BlockState& state = block_states_[block->ordinal];
+  if (state.reached) {
+    return state.stack_pointer_known == stack_pointer_known &&
+           (!stack_pointer_known || state.stack_pointer == stack_pointer);
+  }
+  state.reached = true;
+  state.stack_pointer_known = stack_pointer_known;
+  state.stack_pointer = stack_pointer;
+  worklist.push_back(block);
+  return true;
+}
+
+bool StackPromotionPass::ScanBlock(Block* block,
+                                   std::vector<Block*>& worklist) {
+  const BlockState& state = block_states_[block->ordinal];
+  bool stack_pointer_known = state.stack_pointer_known;
+  int64_t stack_pointer = state.stack_pointer;
+
+  auto is_stack_value = [this](const Value* value) {
+    return value && (stack_addresses_.count(value) ||
+                     stack_address_data_.count(value));
+  };
+
+  Instr* i = block->instr_head;
+  for (; i; i = i->next) {
+    switch (i->opcode->num) {
+      case OPCODE_CALL:
+      case OPCODE_CALL_TRUE:
+      case OPCODE_CALL_INDIRECT:
+      case OPCODE_CALL_INDIRECT_TRUE:
+      case OPCODE_CALL_EXTERN:
+      case OPCODE_TRAP:
+      case OPCODE_TRAP_TRUE:
+      case OPCODE_DEBUG_BREAK:
+      case OPCODE_DEBUG_BREAK_TRUE:
+        return false;
+      case OPCODE_BRANCH:
+        if (!ReachBlock(i->src1.label->block, stack_pointer_known,
+                        stack_pointer, worklist)) {
+          return false;
+        }
+        continue;
+      case OPCODE_BRANCH_TRUE:
+      case OPCODE_BRANCH_FALSE:
+        if (is_stack_value(i->src1.value) ||
+            !ReachBlock(i->src2.label->block, stack_pointer_known,
+                        stack_pointer, worklist)) {
+          return false;
+        }
+        continue;
+      case OPCODE_LOAD_CONTEXT:
+        if (OverlapsStackPointer(i->src1.offset, i->dest->type)) {
+          if (i->src1.offset != kStackPointerOffset ||
+              i->dest->type != INT64_TYPE || !stack_pointer_known) {
+            // Reloaded from memory or otherwise unknown, may alias any
+            // slot.
+            return false;
+          }
+          stack_addresses_[i->dest] = stack_pointer;
+        }
+        continue;
+      case OPCODE_STORE_CONTEXT:
+        if (OverlapsStackPointer(i->src1.offset, i->src2.value->type)) {
+          if (i->src1.offset != kStackPointerOffset ||
+              i->src2.value->type != INT64_TYPE) {
+            return false;
+          }
+          auto it = stack_addresses_.find(i->src2.value);
+          stack_pointer_known = it != stack_addresses_.end();
+          if (stack_pointer_known) {
+            stack_pointer = it->second;
+          }
+        } else if (is_stack_value(i->src2.value)) {
+          // Copied to another register, like a frame pointer.
+          return false;
+        }
+        continue;
+      case OPCODE_LOAD:
+      case OPCODE_LOAD_OFFSET:
+      case OPCODE_STORE:
+      case OPCODE_STORE_OFFSET:
+        if (!AddAccess(i)) {
+          return false;
+        }
+        continue;
+      default:
+        break;
+    }
+
+    uint32_t signature = i->opcode->signature;
+    bool uses_stack_value =
+        (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V &&
+         is_stack_value(i->src1.value)) ||
+        (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V &&
+         is_stack_value(i->src2.value)) ||
+        (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V &&
+         is_stack_value(i->src3.value));
+    if (!uses_stack_value) {
+      continue;
+    }
+    // Only constant offsets of the stack addresses are followed, anything
+    // else may let the address of the frame out of the function.
+    auto it = stack_addresses_.find(i->src1.value);
+    int64_t constant;
+    switch (i->opcode->num) {
+      case OPCODE_ASSIGN:
+        if (it != stack_addresses_.end()) {
+          stack_addresses_[i->dest] = it->second;
+        } else {
+          stack_address_data_[i->dest] =
+              stack_address_data_.find(i->src1.value)->second;
+        }
+        continue;
+      case OPCODE_ADD: {
+        Value* other = i->src2.value;
+        if (it == stack_addresses_.end()) {
+          it = stack_addresses_.find(i->src2.value);
+          other = i->src1.value;
+        }
+        if (it == stack_addresses_.end() ||
+            !GetConstantInt(other, &constant)) {
+          return false;
+        }
+        stack_addresses_[i->dest] = it->second + constant;
+        continue;
+      }
+      case OPCODE_SUB:
+        if (it == stack_addresses_.end() ||
+            !GetConstantInt(i->src2.value, &constant)) {
+          return false;
+        }
+        stack_addresses_[i->dest] = it->second - constant;
+        continue;
+      case OPCODE_TRUNCATE:
+      case OPCODE_ZERO_EXTEND:
+        // Between 32 and 64 bits for guest addresses.
+        if (it == stack_addresses_.end() ||
+            (i->dest->type != INT32_TYPE && i->dest->type != INT64_TYPE) ||
+            (i->src1.value->type != INT32_TYPE &&
+             i->src1.value->type != INT64_TYPE)) {
+          return false;
+        }
+        stack_addresses_[i->dest] = it->second;
+        continue;
+      case OPCODE_BYTE_SWAP:
+        // Stored as a guest pointer, like the back chain by stwu.
+        if (it == stack_addresses_.end()) {
+          return false;
+        }
+        stack_address_data_[i->dest] = it->second;
+        continue;
+      default:
+        return false;
+    }
+  }
+
+  Instr* tail = block->instr_tail;
+  if (block->next &&
+      (!tail || (tail->opcode != &OPCODE_BRANCH_info &&
+                 tail->opcode != &OPCODE_RETURN_info))) {
+    return ReachBlock(block->next, stack_pointer_known, stack_pointer,
+                      worklist);
+  }
+  return true;
+}
+
+bool StackPromotionPass::AddAccess(Instr* i) {
+  bool is_store = i->opcode == &OPCODE_STORE_info ||
+                  i->opcode == &OPCODE_STORE_OFFSET_info;
+  bool has_offset = i->opcode == &OPCODE_LOAD_OFFSET_info ||
+                    i->opcode == &OPCODE_STORE_OFFSET_info;
+  Value* base = i->src1.value;
+  Value* offset = has_offset ? i->src2.value : nullptr;
+  Value* value = is_store ? GetStoredValue(i) : nullptr;
+  if (stack_address_data_.count(base) ||
+      (offset && stack_address_data_.count(offset))) {
+    return false;
+  }
+  bool stores_stack_address =
+      value &&
+      (stack_addresses_.count(value) || stack_address_data_.count(value));
+
+  auto base_it = stack_addresses_.find(base);
+  auto offset_it = offset ? stack_addresses_.find(offset)
+                          : stack_addresses_.end();
+  Value* constant_value;
+  int64_t address;
+  if (base_it != stack_addresses_.end()) {
+    if (offset_it != stack_addresses_.end()) {
+      return false;
+    }
+    address = base_it->second;
+    constant_value = offset;
+  } else if (offset_it != stack_addresses_.end()) {
+    address = offset_it->second;
+    constant_value = base;
+  } else {
+    // Not a stack access, but the address of the frame mustn't be let out.
+    return !stores_stack_address;
+  }
+  if (constant_value) {
+    int64_t constant;
+    if (!GetConstantInt(constant_value, &constant)) {
+      return false;
+    }
+    address += constant;
+  }
+
+  Access access;
+  access.instr = i;
+  access.offset = address;
+  access.type = is_store ? value->type : i->dest->type;
+  access.size = uint32_t(GetTypeSize(access.type));
+  access.is_store = is_store;
+  access.stores_stack_address = stores_stack_address;
+  accesses_.push_back(access);
+  return true;
+}
+
+uint32_t StackPromotionPass::PromoteSlots(HIRBuilder* builder) {
+  std::sort(accesses_.begin(), accesses_.end(),
+            [](const Access& a, const Access& b) {
+              return a.offset < b.offset ||
+                     (a.offset == b.offset && a.size < b.size);
+            });
+
+  // Group the accesses to overlapping ranges, a slot is promoted if all of
+  // them access the same bytes as the same type.
+  struct Slot {
+    size_t first_access;
+    size_t access_count;
+    bool promote;
+    bool loaded;
+  };
+  std::vector<Slot> slots;
+  for (size_t first = 0; first < accesses_.size();) {
+    const Access& head = accesses_[first];
+    int64_t end = head.offset + head.size;
+    Slot slot = {first, 0, true, false};
+    bool stored = false;
+    bool stores_stack_address = false;
+    size_t last = first;
+    for (; last < accesses_.size() && accesses_[last].offset < end; ++last) {
+      const Access& access = accesses_[last];
+      end = std::max(end, access.offset + int64_t(access.size));
+      if (access.offset != head.offset || access.type != head.type ||
+          access.instr->flags) {
+        slot.promote = false;
+      }
+      if (access.is_store) {
+        stored = true;
+      } else {
+        slot.loaded = true;
+      }
+      stores_stack_address |= access.stores_stack_address;
+    }
+    slot.access_count = last - first;
+    // The frame of the caller is above the stack pointer on entry.
+    if (end > 0 || !stored) {
+      slot.promote = false;
+    }
+    if (stores_stack_address && (slot.loaded || !slot.promote)) {
+      // A pointer to the frame read back or left in memory may be used to
+      // access any slot.
+      return 0;
+    }
+    if (slot.promote) {
+      slots.push_back(slot);
+    }
+    first = last;
+  }
+
+  for (const Slot& slot : slots) {
+    const Access& head = accesses_[slot.first_access];
+    if (!slot.loaded) {
+      // Dead when the function returns.
+      for (size_t j = 0; j < slot.access_count; ++j) {
+        Instr* i = accesses_[slot.first_access + j].instr;
+        i->UnlinkAndNOP();
+        i->Deallocate();
+      }
+      continue;
+    }
+    Value* local = builder->AllocLocal(head.type);
+    // Keep the value byte swapped in the local so the swaps of the loads and
+    // the stores cancel out.
+    bool swapped = head.type == INT16_TYPE || head.type == INT32_TYPE ||
+                   head.type == INT64_TYPE || head.type == VEC128_TYPE;
+    for (size_t j = 0; j < slot.access_count; ++j) {
+      PromoteAccess(builder, accesses_[slot.first_access + j], local, swapped);
+    }
+    promoted_locals_.push_back(local);
+  }
+  return uint32_t(slots.size());
+}
+
+void StackPromotionPass::PromoteAccess(HIRBuilder* builder,
+                                       const Access& access, Value* local,
+                                       bool swapped) {
+  Instr* i = access.instr;
+  if (access.is_store) {
+    Value* value = GetStoredValue(i);
+    if (swapped) {
+      Value* source = SkipAssigns(value);
+      if (source->def && source->def->opcode == &OPCODE_BYTE_SWAP_info &&
+          source->def->src1.value->type == value->type) {
+        value = source->def->src1.value;
+      } else {
+        value = builder->ByteSwap(value);
+        builder->last_instr()->MoveBefore(i);
+      }
+    }
+    i->Replace(&OPCODE_STORE_LOCAL_info, 0);
+    i->set_src1(local);
+    i->set_src2(value);
+  } else if (swapped) {
+    Value* value = builder->LoadLocal(local);
+    builder->last_instr()->MoveBefore(i);
+    i->Replace(&OPCODE_BYTE_SWAP_info, 0);
+    i->set_src1(value);
+  } else {
+    i->Replace(&OPCODE_LOAD_LOCAL_info, 0);
+    i->set_src1(local);
+  }
+}
+
+void StackPromotionPass::ForwardLocals(HIRBuilder* builder) {
+  // Within a block, loads of the promoted locals after stores become the
+  // stored values, the byte swaps around them are then removed by the
+  // simplification pass.
+  std::unordered_map<const Value*, Value*> stored_values;
+  auto block = builder->first_block();
+  while (block) {
+    stored_values.clear();
+    Instr* i = block->instr_head;
+    while (i) {
+      if (i->opcode == &OPCODE_STORE_LOCAL_info) {
+        stored_values[i->src1.value] = i->src2.value;
+      } else if (i->opcode == &OPCODE_LOAD_LOCAL_info) {
+        auto it = stored_values.find(i->src1.value);
+        if (it != stored_values.end()) {
+          Value* value = it->second;
+          i->Replace(&OPCODE_ASSIGN_info, 0);
+          i->set_src1(value);
+        }
+      }
+      i = i->next;
+    }
+    block = block->next;
+  }
+
+  // Stores of the locals not loaded in any other block are dead.
+  std::vector<Instr*> stores;
+  for (Value* local : promoted_locals_) {
+    stores.clear();
+    bool loaded = false;
+    for (auto use = local->use_head; use; use = use->next) {
+      if (use->instr->opcode != &OPCODE_STORE_LOCAL_info) {
+        loaded = true;
+        break;
+      }
+      stores.push_back(use->instr);
+    }
+    if (loaded) {
+      continue;
+    }
+    for (Instr* i : stores) {
+      i->UnlinkAndNOP();
+      i->Deallocate();
+    }
+  }
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,74 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_STACK_PROMOTION_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_STACK_PROMOTION_PASS_H_
+
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+class StackPromotionPass : public CompilerPass {
+ public:
+  StackPromotionPass();
+  ~StackPromotionPass() override;
+
+  bool Run(hir::HIRBuilder* builder) override;
+  const char* name() const override { return "stack_promotion"; }
+
+ private:
+  // Guest memory access at the stack pointer on entry to the function plus a
+  // constant.
+  struct Access {
+    hir::Instr* instr;
+    int64_t offset;
+    hir::TypeName type;
+    uint32_t size;
+    bool is_store;
+    // Stores a stack address (the back chain), can't be loaded back.
+    bool stores_stack_address;
+  };
+  // Stack pointer offset from the one on entry at the beginning of a block.
+  struct BlockState {
+    bool reached;
+    bool stack_pointer_known;
+    int64_t stack_pointer;
+  };
+
+  bool ScanFunction(hir::HIRBuilder* builder);
+  bool ScanBlock(hir::Block* block, std::vector<hir::Block*>& worklist);
+  bool ReachBlock(hir::Block* block, bool stack_pointer_known,
+                  int64_t stack_pointer, std::vector<hir::Block*>& worklist);
+  bool AddAccess(hir::Instr* i);
+  uint32_t PromoteSlots(hir::HIRBuilder* builder);
+  void PromoteAccess(hir::HIRBuilder* builder, const Access& access,
+                     hir::Value* local, bool swapped);
+  void ForwardLocals(hir::HIRBuilder* builder);
+
+  std::vector<BlockState> block_states_;
+  // Values containing the stack pointer on entry plus a constant.
+  std::unordered_map<const hir::Value*, int64_t> stack_addresses_;
+  // Byte swapped stack addresses, may only be stored.
+  std::unordered_map<const hir::Value*, int64_t> stack_address_data_;
+  std::vector<Access> accesses_;
+  std::vector<hir::Value*> promoted_locals_;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_STACK_PROMOTION_PASS_H_
@@ -0,0 +1,346 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/compiler/passes/superblock_formation_pass.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/profiling.h"
+#include "xenia/cpu/compiler/compiler.h"
+#include "xenia/cpu/function.h"
+
+DECLARE_bool(dump_translated_hir_functions);
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+// TODO(benvanik): remove when enums redefined.
+using namespace xe::cpu::hir;
+
+using xe::cpu::hir::Block;
+using xe::cpu::hir::HIRBuilder;
+using xe::cpu::hir::Instr;
+using xe::cpu::hir::Label;
+using xe::cpu::hir::Value;
+
+// Branches executed fewer times than this in the baseline code are left alone
+// as the counts say little about them.
+constexpr uint32_t kMinExecutedCount = 64;
+constexpr uint32_t kMinTakenPercentage = 90;
+
+SuperblockFormationPass::SuperblockFormationPass() : CompilerPass() {}
+
+SuperblockFormationPass::~SuperblockFormationPass() {}
+
+static bool IsConditionalBranch(const Instr* i) {
+  return i && (i->opcode == &OPCODE_BRANCH_TRUE_info ||
+               i->opcode == &OPCODE_BRANCH_FALSE_info);
+}
+
+static bool CanFallThrough(const Block* block) {
+  const Instr* i = block->instr_tail;
+  if (!i) {
+    return true;
+  }
+  if (i->opcode == &OPCODE_BRANCH_info || i->opcode == &OPCODE_RETURN_info) {
+    return false;
+  }
+  return !((i->opcode == &OPCODE_CALL_info ||
+            i->opcode == &OPCODE_CALL_INDIRECT_info) &&
+           (i->flags & CALL_TAIL));
+}
+
+bool SuperblockFormationPass::Run(HIRBuilder* builder) {
+  // Lays out the paths through almost always taken conditional branches as
+  // straight lines, with the rarely used paths as side exits. For if/else
+  // where the else is hot, or loops exited on the first check:
+  //     branch_true v0, loc_else
+  //     (then, jumps to loc_end)
+  //   loc_else:
+  //     (falls through to loc_end)
+  // the branch is inverted and the target chain is moved after it:
+  //     branch_false v0, loc_then
+  //   loc_else:
+  //     branch loc_end
+  //   loc_then:
+  //     ...
+  // Blocks only reached through edges never followed are moved to the end, out
+  // of the way of the hot code.
+  // The counts come from the baseline code of the function, which is only
+  // replaced once the function is hot, so they are representative enough, or
+  // from the baseline code of a previous run. Blocks aren't duplicated, so
+  // paths joining other paths stay jumps.
+  GuestFunction* function = compiler_->function();
+  if (!function || function->branch_profiles().empty() ||
+      !builder->first_block() || CanFallThrough(builder->last_block())) {
+    return true;
+  }
+
+  FindHotBranches(builder);
+  FindColdBlocks(builder);
+  if (hot_targets_.empty() && cold_blocks_.empty()) {
+    return true;
+  }
+
+  // Build traces greedily in the original order, following the hot targets or
+  // the fallthroughs, first through the hot blocks, then through the cold
+  // ones.
+  original_next_.clear();
+  order_.clear();
+  for (Block* block = builder->first_block(); block; block = block->next) {
+    original_next_[block] = block->next;
+  }
+  std::unordered_set<const Block*> placed;
+  for (bool cold : {false, true}) {
+    for (Block* start = builder->first_block(); start; start = start->next) {
+      Block* block = start;
+      while (block && cold_blocks_.count(block) == size_t(cold) &&
+             placed.insert(block).second) {
+        order_.push_back(block);
+        auto hot_it = hot_targets_.find(block);
+        if (hot_it != hot_targets_.end()) {
+          block = hot_it->second;
+        } else {
+          block = CanFallThrough(block) ? block->next : nullptr;
+        }
+      }
+    }
+  }
+
+  // Keep the control flow of the blocks now followed by something else.
+  uint32_t inverted_count = 0;
+  for (size_t i = 0; i < order_.size(); ++i) {
+    Block* block = order_[i];
+    Block* next = i + 1 < order_.size() ? order_[i + 1] : nullptr;
+    Block* original_next = original_next_[block];
+    if (!CanFallThrough(block) || next == original_next) {
+      continue;
+    }
+    auto hot_it = hot_targets_.find(block);
+    if (hot_it != hot_targets_.end() && hot_it->second == next) {
+      InvertBranch(builder, block->instr_tail, original_next);
+      ++inverted_count;
+    } else {
+      AppendBranch(builder, block, original_next);
+    }
+  }
+  for (size_t i = 1; i < order_.size(); ++i) {
+    builder->MoveBlockAfter(order_[i], order_[i - 1]);
+  }
+
+  if (cvars::dump_translated_hir_functions &&
+      builder->first_block()->instr_head) {
+    builder->CommentFormat(
+        "superblock formation: inverted {} hot branches, {} cold blocks",
+        inverted_count, cold_blocks_.size());
+    builder->last_instr()->MoveBefore(builder->first_block()->instr_head);
+  }
+
+  return true;
+}
+
+void SuperblockFormationPass::FindHotBranches(HIRBuilder* builder) {
+  branch_profiles_.clear();
+  hot_targets_.clear();
+
+  std::unordered_map<uint32_t, const BranchProfile*> profiles;
+  for (const BranchProfile& profile :
+       compiler_->function()->branch_profiles()) {
+    profiles.emplace(profile.guest_address, &profile);
+  }
+
+  // The profile is only usable for guest instructions still emitting a single
+  // conditional branch.
+  std::unordered_map<uint32_t, Block*> branch_blocks;
+  for (Block* block = builder->first_block(); block; block = block->next) {
+    if (!IsConditionalBranch(block->instr_tail)) {
+      continue;
+    }
+    uint32_t guest_address = block->instr_tail->GuestAddressFor();
+    if (!guest_address) {
+      continue;
+    }
+    auto it = branch_blocks.emplace(guest_address, block);
+    if (!it.second) {
+      it.first->second = nullptr;
+    }
+  }
+
+  for (auto& it : branch_blocks) {
+    Block* block = it.second;
+    auto profile_it = profiles.find(it.first);
+    if (!block || profile_it == profiles.end()) {
+      continue;
+    }
+    uint32_t executed_count = profile_it->second->executed_count;
+    uint32_t fallthrough_count =
+        std::min(profile_it->second->fallthrough_count, executed_count);
+    if (executed_count < kMinExecutedCount) {
+      continue;
+    }
+    branch_profiles_[block] = profile_it->second;
+    if (uint64_t(executed_count - fallthrough_count) * 100 <
+        uint64_t(executed_count) * kMinTakenPercentage) {
+      continue;
+    }
+    Block* target = block->instr_tail->src2.label->block;
+    // The entry block must stay first.
+    if (!block->next || target == block->next || target == block ||
+        target == builder->first_block()) {
+      continue;
+    }
+    hot_targets_[block] = target;
+  }
+}
+
+void SuperblockFormationPass::FindColdBlocks(HIRBuilder* builder) {
+  cold_blocks_.clear();
+
+  struct Edge {
+    const Block* source;
+    const Block* target;
+    bool never_followed;
+  };
+  std::vector<Edge> edges;
+  for (Block* block = builder->first_block(); block; block = block->next) {
+    const BranchProfile* profile = nullptr;
+    auto profile_it = branch_profiles_.find(block);
+    if (profile_it != branch_profiles_.end()) {
+      profile = profile_it->second;
+    }
+    for (const Instr* i = block->instr_head; i; i = i->next) {
+      const Label* label = nullptr;
+      if (i->opcode == &OPCODE_BRANCH_info) {
+        label = i->src1.label;
+      } else if (IsConditionalBranch(i)) {
+        label = i->src2.label;
+      } else {
+        // Anything else referencing labels keeps its targets where they are.
+        uint32_t signature = i->opcode->signature;
+        if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_L ||
+            GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_L ||
+            GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_L) {
+          return;
+        }
+        continue;
+      }
+      bool never_taken = profile && i == block->instr_tail &&
+                         IsConditionalBranch(i) &&
+                         profile->fallthrough_count >= profile->executed_count;
+      edges.push_back({block, label->block, never_taken});
+    }
+    if (block->next && CanFallThrough(block)) {
+      bool never_fallen_through = profile && !profile->fallthrough_count;
+      edges.push_back({block, block->next, never_fallen_through});
+    }
+  }
+
+  // Whatever is reached from a cold block is cold too unless also reached
+  // otherwise.
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    std::unordered_set<const Block*> hot_entered;
+    for (const Edge& edge : edges) {
+      if (!edge.never_followed && !cold_blocks_.count(edge.source)) {
+        hot_entered.insert(edge.target);
+      }
+    }
+    for (const Edge& edge : edges) {
+      if (edge.target != builder->first_block() &&
+          !hot_entered.count(edge.target) &&
+          cold_blocks_.insert(edge.target).second) {
+        changed = true;
+      }
+    }
+  }
+}
+
+void SuperblockFormationPass::AppendBranch(HIRBuilder* builder, Block* block,
+                                           Block* target) {
+  // The builder appends to its current block, or to a new one at the end if
+  // there's none, which is removed again.
+  Block* current_block = builder->current_block();
+  builder->Branch(target);
+  Block* append_block = current_block ? current_block : builder->last_block();
+  append_block->instr_tail->MoveToEnd(block);
+  if (!current_block && !append_block->instr_head &&
+      !append_block->label_head) {
+    builder->RemoveBlock(append_block);
+  }
+}
+
+void SuperblockFormationPass::InvertBranch(HIRBuilder* builder, Instr* branch,
+                                           Block* target) {
+  if (!target->label_head) {
+    builder->MarkLabel(builder->NewLabel(), target);
+  }
+  branch->src2.label = target->label_head;
+
+  // Prefer inverting a compare only used by the branch, so it can still be
+  // fused with it.
+  Value* cond = branch->src1.value;
+  Instr* def = cond->def;
+  if (branch->opcode == &OPCODE_BRANCH_TRUE_info && def &&
+      def->block == branch->block && cond->use_head &&
+      !cond->use_head->next &&
+      IsScalarIntegralType(def->src1.value->type)) {
+    const OpcodeInfo* inverse = nullptr;
+    switch (def->opcode->num) {
+      case OPCODE_COMPARE_EQ:
+        inverse = &OPCODE_COMPARE_NE_info;
+        break;
+      case OPCODE_COMPARE_NE:
+        inverse = &OPCODE_COMPARE_EQ_info;
+        break;
+      case OPCODE_COMPARE_SLT:
+        inverse = &OPCODE_COMPARE_SGE_info;
+        break;
+      case OPCODE_COMPARE_SLE:
+        inverse = &OPCODE_COMPARE_SGT_info;
+        break;
+      case OPCODE_COMPARE_SGT:
+        inverse = &OPCODE_COMPARE_SLE_info;
+        break;
+      case OPCODE_COMPARE_SGE:
+        inverse = &OPCODE_COMPARE_SLT_info;
+        break;
+      case OPCODE_COMPARE_ULT:
+        inverse = &OPCODE_COMPARE_UGE_info;
+        break;
+      case OPCODE_COMPARE_ULE:
+        inverse = &OPCODE_COMPARE_UGT_info;
+        break;
+      case OPCODE_COMPARE_UGT:
+        inverse = &OPCODE_COMPARE_ULE_info;
+        break;
+      case OPCODE_COMPARE_UGE:
+        inverse = &OPCODE_COMPARE_ULT_info;
+        break;
+      default:
+        break;
+    }
+    if (inverse) {
+      def->opcode = inverse;
+      return;
+    }
+  }
+  branch->opcode = branch->opcode == &OPCODE_BRANCH_TRUE_info
+                       ? &OPCODE_BRANCH_FALSE_info
+                       : &OPCODE_BRANCH_TRUE_info;
+}
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
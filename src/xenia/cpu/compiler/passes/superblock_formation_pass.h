@@ -0,0 +1,60 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_COMPILER_PASSES_SUPERBLOCK_FORMATION_PASS_H_
+#define XENIA_CPU_COMPILER_PASSES_SUPERBLOCK_FORMATION_PASS_H_
+
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "xenia/cpu/compiler/compiler_pass.h"
+#include "xenia/cpu/function.h"
+
+namespace xe {
+namespace cpu {
+namespace compiler {
+namespace passes {
+
+class SuperblockFormationPass : public CompilerPass {
+ public:
+  SuperblockFormationPass();
+  ~SuperblockFormationPass() override;
+
+  bool Run(hir::HIRBuilder* builder) override;
+  const char* name() const override { return "superblock_formation"; }
+
+ private:
+  // Blocks ending with a conditional branch that's almost always taken, to the
+  // target of the branch.
+  void FindHotBranches(hir::HIRBuilder* builder);
+  // Blocks only entered through edges never followed by the baseline code, and
+  // from other such blocks.
+  void FindColdBlocks(hir::HIRBuilder* builder);
+  void AppendBranch(hir::HIRBuilder* builder, hir::Block* block,
+                    hir::Block* target);
+  void InvertBranch(hir::HIRBuilder* builder, hir::Instr* branch,
+                    hir::Block* target);
+
+  // Counts of the branches ending blocks, if executed enough to be usable.
+  std::unordered_map<const hir::Block*, const BranchProfile*>
+      branch_profiles_;
+  std::unordered_map<const hir::Block*, hir::Block*> hot_targets_;
+  std::unordered_set<const hir::Block*> cold_blocks_;
+  std::unordered_map<const hir::Block*, hir::Block*> original_next_;
+  std::vector<hir::Block*> order_;
+};
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_COMPILER_PASSES_SUPERBLOCK_FORMATION_PASS_H_
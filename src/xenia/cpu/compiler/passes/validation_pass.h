@@ -23,6 +23,7 @@ class ValidationPass : public CompilerPass {
   ~ValidationPass() override;
 
   bool Run(hir::HIRBuilder* builder) override;
+  const char* name() const override { return "validation"; }
 
  private:
   bool ValidateInstruction(hir::Block* block, hir::Instr* instr);
@@ -23,6 +23,7 @@ class ValueReductionPass : public CompilerPass {
   ~ValueReductionPass() override;
 
   bool Run(hir::HIRBuilder* builder) override;
+  const char* name() const override { return "value_reduction"; }
 
  private:
   void ComputeLastUse(hir::Value* value);
@@ -33,6 +33,80 @@ DEFINE_bool(trace_function_data, false,
 DEFINE_bool(validate_hir, false,
             "Perform validation checks on the HIR during compilation.", "CPU");
 
+DEFINE_bool(eliminate_common_subexpressions, false,
+            "Replace repeated calculations of the same values within a block "
+            "with the first result during compilation.",
+            "CPU");
+DEFINE_bool(hoist_loop_invariants, true,
+            "Move calculations giving the same result on every iteration of "
+            "guest loops out of them during compilation.",
+            "CPU");
+DEFINE_bool(recognize_memory_idioms, true,
+            "Replace guest loops filling or copying memory and clears of "
+            "adjacent cache blocks with host memset and memcpy.",
+            "CPU");
+DEFINE_bool(vectorize_loops, true,
+            "Do 4 iterations at once of guest loops processing arrays of "
+            "floats with single-precision arithmetic using host vectors.",
+            "CPU");
+DEFINE_bool(promote_stack_slots, true,
+            "Keep the stack frame slots of guest functions not making calls "
+            "and not letting the address of the frame out in host locals "
+            "rather than in guest memory.",
+            "CPU");
+DEFINE_bool(eliminate_byte_swaps, true,
+            "Cancel out paired byte swaps and move byte swaps out of bitwise "
+            "operations and equality comparisons during compilation.",
+            "CPU");
+
+DEFINE_bool(tiered_compilation, false,
+            "Translate functions with a reduced set of optimization passes "
+            "first, and translate them again with all passes once they have "
+            "been called tier_up_call_count times.",
+            "CPU");
+DEFINE_int32(tier_up_call_count, 1000,
+             "Number of calls of a function translated with the reduced set of "
+             "optimization passes after which it's optimized with all passes "
+             "(with tiered_compilation).",
+             "CPU");
+DEFINE_bool(superblock_formation, true,
+            "Count how often conditional branches are taken in the code "
+            "translated with the reduced set of passes, and lay out the hot "
+            "paths of the optimized code as straight lines with the rarely "
+            "taken paths as side exits (with tiered_compilation).",
+            "CPU");
+DEFINE_bool(persistent_guest_profile, true,
+            "Store the branch and indirect call counts of the functions that "
+            "became hot in the cache of the title, and translate those "
+            "functions with all passes using the counts right away on "
+            "subsequent launches (with tiered_compilation).",
+            "CPU");
+DEFINE_bool(devirtualize_indirect_calls, true,
+            "Count the targets of indirect calls in the code translated with "
+            "the reduced set of passes, and call the one or two targets "
+            "mostly seen directly in the optimized code after comparing the "
+            "address (with tiered_compilation).",
+            "CPU");
+DEFINE_bool(interpret_cold_functions, false,
+            "Interpret the HIR of functions instead of generating machine code "
+            "for them until they have been called tier_up_call_count times, "
+            "when they only use integer operations (with "
+            "tiered_compilation).",
+            "CPU");
+
+DEFINE_bool(reclaim_removed_code, true,
+            "Reuse the code cache memory of functions of unloaded modules "
+            "once no thread is executing them anymore (checked with all "
+            "threads briefly suspended).",
+            "CPU");
+
+DEFINE_path(jit_statistics_path, "",
+            "If set, per-pass translation times, HIR instruction counts, "
+            "emitted code sizes and register spill counts are collected for "
+            "every translated function and written to this file on shutdown, "
+            "as CSV if the extension is .csv, otherwise as JSON.",
+            "CPU");
+
 DEFINE_uint64(
     pvr, 0x710700,
     "Processor version and revision number.\nBits 0 to 15 are the version "
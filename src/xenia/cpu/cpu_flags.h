@@ -24,6 +24,24 @@ DECLARE_bool(trace_function_data);
 
 DECLARE_bool(validate_hir);
 
+DECLARE_bool(eliminate_common_subexpressions);
+DECLARE_bool(hoist_loop_invariants);
+DECLARE_bool(recognize_memory_idioms);
+DECLARE_bool(vectorize_loops);
+DECLARE_bool(promote_stack_slots);
+DECLARE_bool(eliminate_byte_swaps);
+
+DECLARE_bool(tiered_compilation);
+DECLARE_int32(tier_up_call_count);
+DECLARE_bool(superblock_formation);
+DECLARE_bool(devirtualize_indirect_calls);
+DECLARE_bool(persistent_guest_profile);
+DECLARE_bool(interpret_cold_functions);
+
+DECLARE_bool(reclaim_removed_code);
+
+DECLARE_path(jit_statistics_path);
+
 DECLARE_uint64(pvr);
 
 // Breakpoints:
@@ -18,7 +18,7 @@ namespace cpu {
 EntryTable::EntryTable() = default;
 
 EntryTable::~EntryTable() {
-  auto global_lock = global_critical_region_.Acquire();
+  auto cpu_lock = cpu_critical_region_.Acquire();
   for (auto it : map_.Values()) {
     Entry* entry = it;
     delete entry;
@@ -26,7 +26,7 @@ EntryTable::~EntryTable() {
 }
 
 Entry* EntryTable::Get(uint32_t address) {
-  auto global_lock = global_critical_region_.Acquire();
+  auto cpu_lock = cpu_critical_region_.Acquire();
   uint32_t idx = map_.IndexForKey(address);
   if (idx == map_.size() || *map_.KeyAt(idx) != address) {
     return nullptr;
@@ -45,7 +45,7 @@ Entry::Status EntryTable::GetOrCreate(uint32_t address, Entry** out_entry) {
   // TODO(benvanik): replace with a map with wait-free for find.
   // https://github.com/facebook/folly/blob/master/folly/AtomicHashMap.h
 
-  auto global_lock = global_critical_region_.Acquire();
+  auto cpu_lock = cpu_critical_region_.Acquire();
 
   uint32_t idx = map_.IndexForKey(address);
 
@@ -56,14 +56,13 @@ Entry::Status EntryTable::GetOrCreate(uint32_t address, Entry** out_entry) {
   if (entry) {
     // If we aren't ready yet spin and wait.
     if (entry->status == Entry::STATUS_COMPILING) {
-      // chrispy: i think this is dead code, if we are compiling we're holding
-      // the global lock, arent we? so we wouldnt be executing here
-      // Still compiling, so spin.
+      // Still compiling on another thread, which doesn't hold the lock of the
+      // table while compiling, so spin.
       do {
-        global_lock.unlock();
+        cpu_lock.unlock();
         // TODO(benvanik): sleep for less time?
         xe::threading::Sleep(std::chrono::microseconds(10));
-        global_lock.lock();
+        cpu_lock.lock();
       } while (entry->status == Entry::STATUS_COMPILING);
     }
     status = entry->status;
@@ -78,13 +77,13 @@ Entry::Status EntryTable::GetOrCreate(uint32_t address, Entry** out_entry) {
     // map_[address] = entry;
     status = Entry::STATUS_NEW;
   }
-  global_lock.unlock();
+  cpu_lock.unlock();
   *out_entry = entry;
   return status;
 }
 
 void EntryTable::Delete(uint32_t address) {
-  auto global_lock = global_critical_region_.Acquire();
+  auto cpu_lock = cpu_critical_region_.Acquire();
   // doesnt this leak memory by not deleting the entry?
   uint32_t idx = map_.IndexForKey(address);
   if (idx != map_.size() && *map_.KeyAt(idx) == address) {
@@ -93,7 +92,7 @@ void EntryTable::Delete(uint32_t address) {
 }
 
 std::vector<Function*> EntryTable::FindWithAddress(uint32_t address) {
-  auto global_lock = global_critical_region_.Acquire();
+  auto cpu_lock = cpu_critical_region_.Acquire();
   std::vector<Function*> fns;
   for (auto& it : map_.Values()) {
     Entry* entry = it;
@@ -46,9 +46,9 @@ class EntryTable {
   std::vector<Function*> FindWithAddress(uint32_t address);
 
  private:
-  xe::global_critical_region global_critical_region_;
+  xe::cpu_critical_region cpu_critical_region_;
   // TODO(benvanik): replace with a better data structure.
-  xe::split_map<uint32_t, Entry*> map_;
+  xe::split_map<uint32_t, Entry*, xe::split_map_blocked_search> map_;
   //std::unordered_map<uint32_t, Entry*> map_;
 };
 
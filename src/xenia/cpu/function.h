@@ -114,6 +114,27 @@ class BuiltinFunction : public Function {
   void* arg1_ = nullptr;
 };
 
+// Execution counts of a conditional branch in baseline code, identified by the
+// guest address of the instruction it was emitted for. Updated by the
+// generated code without synchronization, so only approximate.
+struct BranchProfile {
+  uint32_t guest_address;
+  uint32_t executed_count;
+  uint32_t fallthrough_count;
+};
+
+// Targets of an indirect call in baseline code, identified by the guest
+// address of the instruction it was emitted for. The calls to the first two
+// targets seen are counted separately, the rest only in other_count. Updated
+// by the generated code without synchronization, so only approximate.
+struct IndirectCallProfile {
+  static constexpr size_t kTargetCount = 2;
+  uint32_t guest_address;
+  uint32_t targets[kTargetCount];
+  uint32_t target_counts[kTargetCount];
+  uint32_t other_count;
+};
+
 class GuestFunction : public Function {
  public:
   typedef void (*ExternHandler)(ppc::PPCContext* ppc_context,
@@ -130,12 +151,24 @@ class GuestFunction : public Function {
   virtual uint8_t* machine_code() const = 0;
   virtual size_t machine_code_length() const = 0;
 
+  // Whether the machine code was generated with the reduced set of passes and
+  // will be replaced with optimized code once the function becomes hot.
+  bool is_baseline() const { return is_baseline_; }
+  void set_baseline(bool value) { is_baseline_ = value; }
+
   FunctionDebugInfo* debug_info() const { return debug_info_.get(); }
   void set_debug_info(std::unique_ptr<FunctionDebugInfo> debug_info) {
     debug_info_ = std::move(debug_info);
   }
   FunctionTraceData& trace_data() { return trace_data_; }
   std::vector<SourceMapEntry>& source_map() { return source_map_; }
+  // Written when the baseline code is generated and kept for the lifetime of
+  // the function, as the baseline code may still be running after being
+  // replaced.
+  std::vector<BranchProfile>& branch_profiles() { return branch_profiles_; }
+  std::vector<IndirectCallProfile>& indirect_call_profiles() {
+    return indirect_call_profiles_;
+  }
 
   ExternHandler extern_handler() const { return extern_handler_; }
   Export* export_data() const { return export_data_; }
@@ -146,8 +179,8 @@ class GuestFunction : public Function {
   const SourceMapEntry* LookupMachineCodeOffset(uint32_t offset) const;
 
   uint32_t MapGuestAddressToMachineCodeOffset(uint32_t guest_address) const;
-  uintptr_t MapGuestAddressToMachineCode(uint32_t guest_address) const;
-  uint32_t MapMachineCodeToGuestAddress(uintptr_t host_address) const;
+  virtual uintptr_t MapGuestAddressToMachineCode(uint32_t guest_address) const;
+  virtual uint32_t MapMachineCodeToGuestAddress(uintptr_t host_address) const;
 
   bool Call(ThreadState* thread_state, uint32_t return_address) override;
 
@@ -158,8 +191,11 @@ class GuestFunction : public Function {
   std::unique_ptr<FunctionDebugInfo> debug_info_;
   FunctionTraceData trace_data_;
   std::vector<SourceMapEntry> source_map_;
+  std::vector<BranchProfile> branch_profiles_;
+  std::vector<IndirectCallProfile> indirect_call_profiles_;
   ExternHandler extern_handler_ = nullptr;
   Export* export_data_ = nullptr;
+  bool is_baseline_ = false;
 };
 
 }  // namespace cpu
@@ -0,0 +1,157 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/function_call_tracer.h"
+
+#include <algorithm>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+
+namespace xe {
+namespace cpu {
+
+namespace {
+// A host thread runs a single guest thread, and there's a single tracer, but
+// the tracer is checked too in case it has been recreated.
+thread_local FunctionCallTracer* thread_tracer_ = nullptr;
+thread_local void* thread_ring_ = nullptr;
+}  // namespace
+
+std::unique_ptr<FunctionCallTracer> FunctionCallTracer::Create(
+    const std::filesystem::path& path) {
+  FILE* file = xe::filesystem::OpenFile(path, "wb");
+  if (!file) {
+    XELOGE("Failed to open the function call trace file {}",
+           xe::path_to_utf8(path));
+    return nullptr;
+  }
+  FileHeader header;
+  header.magic = FileHeader::kMagic;
+  header.version = FileHeader::kVersion;
+  header.tick_frequency = Clock::QueryHostTickFrequency();
+  if (fwrite(&header, sizeof(header), 1, file) != 1) {
+    XELOGE("Failed to write the function call trace file {}",
+           xe::path_to_utf8(path));
+    fclose(file);
+    return nullptr;
+  }
+  auto tracer =
+      std::unique_ptr<FunctionCallTracer>(new FunctionCallTracer(file));
+  tracer->wake_event_ = threading::Event::CreateAutoResetEvent(false);
+  if (tracer->wake_event_) {
+    tracer->writer_thread_ = threading::Thread::Create(
+        {}, [tracer_ptr = tracer.get()]() { tracer_ptr->WriterThread(); });
+  }
+  if (!tracer->writer_thread_) {
+    XELOGE("Failed to create the function call trace writer thread");
+    return nullptr;
+  }
+  tracer->writer_thread_->set_name("Function Call Trace Writer");
+  return tracer;
+}
+
+FunctionCallTracer::FunctionCallTracer(FILE* file) : file_(file) {}
+
+FunctionCallTracer::~FunctionCallTracer() {
+  if (writer_thread_) {
+    shutting_down_.store(true, std::memory_order_release);
+    wake_event_->Set();
+    threading::Wait(writer_thread_.get(), false);
+    writer_thread_.reset();
+  }
+  DrainRings();
+  fclose(file_);
+}
+
+FunctionCallTracer::Ring* FunctionCallTracer::GetThreadRing(
+    uint32_t thread_id) {
+  if (thread_tracer_ == this) {
+    return static_cast<Ring*>(thread_ring_);
+  }
+  auto ring = std::make_unique<Ring>();
+  ring->thread_id = thread_id;
+  Ring* ring_ptr = ring.get();
+  {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    rings_.push_back(std::move(ring));
+  }
+  thread_tracer_ = this;
+  thread_ring_ = ring_ptr;
+  return ring_ptr;
+}
+
+void FunctionCallTracer::RecordEvent(uint32_t thread_id,
+                                     uint32_t guest_address, EventType type) {
+  Ring* ring = GetThreadRing(thread_id);
+  uint64_t write_position =
+      ring->write_position.load(std::memory_order_relaxed);
+  if (write_position - ring->read_position.load(std::memory_order_acquire) >=
+      kRingCapacity) {
+    ring->dropped_event_count.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  Event& event = ring->events[write_position & (kRingCapacity - 1)];
+  event.ticks = Clock::QueryHostTickCount();
+  event.guest_address = guest_address;
+  event.type = type;
+  ring->write_position.store(write_position + 1, std::memory_order_release);
+}
+
+void FunctionCallTracer::WriterThread() {
+  while (!shutting_down_.load(std::memory_order_acquire)) {
+    threading::Wait(wake_event_.get(), false, std::chrono::milliseconds(100));
+    DrainRings();
+  }
+}
+
+void FunctionCallTracer::DrainRings() {
+  // Threads only add rings, so the ones copied stay valid.
+  std::vector<Ring*> rings;
+  {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    rings.reserve(rings_.size());
+    for (const auto& ring : rings_) {
+      rings.push_back(ring.get());
+    }
+  }
+  for (Ring* ring : rings) {
+    uint64_t read_position =
+        ring->read_position.load(std::memory_order_relaxed);
+    uint64_t write_position =
+        ring->write_position.load(std::memory_order_acquire);
+    uint64_t dropped_event_count =
+        ring->dropped_event_count.load(std::memory_order_relaxed);
+    if (read_position == write_position &&
+        dropped_event_count == ring->reported_dropped_event_count) {
+      continue;
+    }
+    BlockHeader block_header;
+    block_header.thread_id = ring->thread_id;
+    block_header.event_count = uint32_t(write_position - read_position);
+    block_header.dropped_event_count =
+        dropped_event_count - ring->reported_dropped_event_count;
+    fwrite(&block_header, sizeof(block_header), 1, file_);
+    // The events may wrap around the end of the ring.
+    while (read_position != write_position) {
+      size_t index = size_t(read_position & (kRingCapacity - 1));
+      size_t count = size_t(std::min<uint64_t>(write_position - read_position,
+                                               kRingCapacity - index));
+      fwrite(&ring->events[index], sizeof(Event), count, file_);
+      read_position += count;
+    }
+    ring->reported_dropped_event_count = dropped_event_count;
+    ring->read_position.store(read_position, std::memory_order_release);
+  }
+  fflush(file_);
+}
+
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,113 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_FUNCTION_CALL_TRACER_H_
+#define XENIA_CPU_FUNCTION_CALL_TRACER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "xenia/base/threading.h"
+
+namespace xe {
+namespace cpu {
+
+// Records the calls and returns of guest functions, from the code translated
+// with trace_function_calls, into a ring per thread without any locking. A
+// background thread drains the rings into the file, which
+// tools/function-trace/function_trace.py turns into reports.
+//
+// File format (host byte order):
+// FileHeader
+// Repeated until the end of the file:
+//   BlockHeader
+//   Event[event_count]
+class FunctionCallTracer {
+ public:
+  enum class EventType : uint32_t {
+    kCall = 0,
+    kReturn = 1,
+  };
+
+  struct FileHeader {
+    static constexpr uint32_t kMagic = 0x54434658;  // 'XFCT'
+    static constexpr uint32_t kVersion = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    // Ticks per second of the event timestamps.
+    uint64_t tick_frequency;
+  };
+
+  struct BlockHeader {
+    uint32_t thread_id;
+    uint32_t event_count;
+    // Events lost since the previous block of the thread because the ring was
+    // full.
+    uint64_t dropped_event_count;
+  };
+
+  struct Event {
+    uint64_t ticks;
+    uint32_t guest_address;
+    EventType type;
+  };
+  static_assert(sizeof(Event) == 16, "Events must stay compact");
+
+  static std::unique_ptr<FunctionCallTracer> Create(
+      const std::filesystem::path& path);
+  FunctionCallTracer(const FunctionCallTracer& tracer) = delete;
+  FunctionCallTracer& operator=(const FunctionCallTracer& tracer) = delete;
+  // Writes the remaining events and closes the file.
+  ~FunctionCallTracer();
+
+  // Called by the guest threads.
+  void RecordEvent(uint32_t thread_id, uint32_t guest_address,
+                   EventType type);
+
+ private:
+  static constexpr size_t kRingCapacity = size_t(1) << 16;
+
+  struct Ring {
+    uint32_t thread_id;
+    // Written only by the thread of the ring.
+    alignas(64) std::atomic<uint64_t> write_position{0};
+    std::atomic<uint64_t> dropped_event_count{0};
+    // Written only by the writer thread.
+    alignas(64) std::atomic<uint64_t> read_position{0};
+    uint64_t reported_dropped_event_count = 0;
+    Event events[kRingCapacity];
+  };
+
+  explicit FunctionCallTracer(FILE* file);
+
+  Ring* GetThreadRing(uint32_t thread_id);
+  void WriterThread();
+  void DrainRings();
+
+  FILE* file_;
+
+  std::mutex rings_mutex_;
+  // Rings of exited threads are kept until they're drained at shutdown.
+  std::vector<std::unique_ptr<Ring>> rings_;
+
+  std::atomic<bool> shutting_down_{false};
+  std::unique_ptr<threading::Event> wake_event_;
+  std::unique_ptr<threading::Thread> writer_thread_;
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_FUNCTION_CALL_TRACER_H_
@@ -28,10 +28,13 @@ enum DebugInfoFlags : uint32_t {
   kDebugInfoTraceFunctionCoverage = (1 << 7) | kDebugInfoTraceFunctions,
   kDebugInfoTraceFunctionReferences = (1 << 8) | kDebugInfoTraceFunctions,
   kDebugInfoTraceFunctionData = (1 << 9) | kDebugInfoTraceFunctions,
+  // Calls and returns recorded by the FunctionCallTracer.
+  kDebugInfoTraceFunctionCalls = (1 << 10),
 
   kDebugInfoAllTracing =
       kDebugInfoTraceFunctions | kDebugInfoTraceFunctionCoverage |
-      kDebugInfoTraceFunctionReferences | kDebugInfoTraceFunctionData,
+      kDebugInfoTraceFunctionReferences | kDebugInfoTraceFunctionData |
+      kDebugInfoTraceFunctionCalls,
   kDebugInfoAll = 0xFFFFFFFF,
 };
 
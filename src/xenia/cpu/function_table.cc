@@ -0,0 +1,58 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/function_table.h"
+
+#include "xenia/base/assert.h"
+#include "xenia/base/memory.h"
+
+namespace xe {
+namespace cpu {
+
+FunctionTable::FunctionTable() {
+  chunks_ = reinterpret_cast<std::atomic<Chunk*>*>(memory::AllocFixed(
+      nullptr, sizeof(std::atomic<Chunk*>) * kChunkCount,
+      memory::AllocationType::kReserveCommit, memory::PageAccess::kReadWrite));
+  assert_not_null(chunks_);
+}
+
+FunctionTable::~FunctionTable() {
+  for (size_t i = 0; i < kChunkCount; ++i) {
+    delete chunks_[i].load(std::memory_order_relaxed);
+  }
+  memory::DeallocFixed(chunks_, sizeof(std::atomic<Chunk*>) * kChunkCount,
+                       memory::DeallocationType::kRelease);
+}
+
+void FunctionTable::Set(uint32_t address, Function* function) {
+  if (address & 3) {
+    return;
+  }
+  std::atomic<Chunk*>& chunk_ref = chunks_[address >> kChunkShift];
+  Chunk* chunk = chunk_ref.load(std::memory_order_acquire);
+  if (!chunk) {
+    if (!function) {
+      return;
+    }
+    Chunk* new_chunk = new Chunk();
+    if (chunk_ref.compare_exchange_strong(chunk, new_chunk,
+                                          std::memory_order_acq_rel,
+                                          std::memory_order_acquire)) {
+      chunk = new_chunk;
+    } else {
+      // Another thread has added the chunk first.
+      delete new_chunk;
+    }
+  }
+  chunk->functions[(address >> 2) & (kChunkEntryCount - 1)].store(
+      function, std::memory_order_release);
+}
+
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,70 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_FUNCTION_TABLE_H_
+#define XENIA_CPU_FUNCTION_TABLE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace xe {
+namespace cpu {
+
+class Function;
+
+// Resolved functions indexed by their guest address, for lookups without
+// taking any lock. The guest address space is split into chunks of entries
+// allocated when the first function in them is added, so only the pages of
+// the table covering code are ever touched.
+class FunctionTable {
+ public:
+  FunctionTable();
+  FunctionTable(const FunctionTable& table) = delete;
+  FunctionTable& operator=(const FunctionTable& table) = delete;
+  ~FunctionTable();
+
+  // Wait-free, may be called from any thread.
+  Function* Lookup(uint32_t address) const {
+    if (address & 3) {
+      return nullptr;
+    }
+    const Chunk* chunk =
+        chunks_[address >> kChunkShift].load(std::memory_order_acquire);
+    if (!chunk) {
+      return nullptr;
+    }
+    return chunk->functions[(address >> 2) & (kChunkEntryCount - 1)].load(
+        std::memory_order_acquire);
+  }
+
+  // The function must stay alive until it's replaced or removed, and any
+  // thread that may have looked it up is done with it.
+  void Set(uint32_t address, Function* function);
+  void Remove(uint32_t address) { Set(address, nullptr); }
+
+ private:
+  // 16 KB of guest code per chunk.
+  static constexpr uint32_t kChunkShift = 14;
+  static constexpr uint32_t kChunkEntryCount = uint32_t(1)
+                                               << (kChunkShift - 2);
+  static constexpr size_t kChunkCount = size_t(1) << (32 - kChunkShift);
+
+  struct Chunk {
+    std::atomic<Function*> functions[kChunkEntryCount] = {};
+  };
+
+  // kChunkCount pointers in zeroed pages committed by the OS on first access.
+  std::atomic<Chunk*>* chunks_;
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_FUNCTION_TABLE_H_
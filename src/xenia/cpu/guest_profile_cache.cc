@@ -0,0 +1,203 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/guest_profile_cache.h"
+
+#include <cstring>
+
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/xxhash.h"
+
+namespace xe {
+namespace cpu {
+
+GuestProfileCache::GuestProfileCache(Memory* memory) : memory_(memory) {}
+
+GuestProfileCache::~GuestProfileCache() {
+  if (file_) {
+    fclose(file_);
+  }
+}
+
+bool GuestProfileCache::Open(const std::filesystem::path& path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  assert_null(file_);
+  std::filesystem::create_directories(path.parent_path());
+  file_ = xe::filesystem::OpenFile(path, "a+b");
+  if (!file_) {
+    XELOGE("Failed to open the guest profile cache file for writing: {}",
+           xe::path_to_utf8(path));
+    return false;
+  }
+  bool file_read;
+  {
+    // Other emulator instances may be using the same file, don't let them
+    // append while validating or resetting it.
+    xe::filesystem::ScopedStdioFileLock file_lock(file_);
+    file_read = ReadFile();
+  }
+  if (!file_read) {
+    fclose(file_);
+    file_ = nullptr;
+    XELOGE("Failed to reset the guest profile cache file: {}",
+           xe::path_to_utf8(path));
+    return false;
+  }
+  XELOGI("Guest profile cache: {} hot functions from previous runs",
+         functions_.size());
+  return true;
+}
+
+bool GuestProfileCache::ReadFile() {
+  FileHeader header;
+  bool header_valid = false;
+  xe::filesystem::Seek(file_, 0, SEEK_SET);
+  if (fread(&header, sizeof(header), 1, file_) && header.magic == kMagic &&
+      header.version == kVersion) {
+    header_valid = true;
+    xe::filesystem::Seek(file_, 0, SEEK_END);
+    int64_t file_size = xe::filesystem::Tell(file_);
+    if (file_size > int64_t(sizeof(header)) &&
+        xe::filesystem::Seek(file_, int64_t(sizeof(header)), SEEK_SET)) {
+      data_.resize(size_t(file_size) - sizeof(header));
+      data_.resize(fread(data_.data(), 1, data_.size(), file_));
+    }
+  }
+
+  // Validate and index the functions, stop at the first corrupted one.
+  size_t offset = 0;
+  while (offset + sizeof(StoredFunctionHeader) <= data_.size()) {
+    StoredFunctionHeader function_header;
+    std::memcpy(&function_header, data_.data() + offset,
+                sizeof(function_header));
+    size_t data_size =
+        sizeof(BranchProfile) * size_t(function_header.branch_profile_count) +
+        sizeof(IndirectCallProfile) *
+            size_t(function_header.indirect_call_profile_count);
+    size_t data_offset = offset + sizeof(StoredFunctionHeader);
+    if (data_size > data_.size() - data_offset ||
+        XXH3_64bits(data_.data() + data_offset, data_size) !=
+            function_header.data_hash) {
+      break;
+    }
+    functions_[function_header.guest_address] = offset;
+    offset = data_offset + data_size;
+  }
+  if (header_valid && offset == data_.size()) {
+    // Switching from reading to writing requires repositioning.
+    xe::filesystem::Seek(file_, 0, SEEK_END);
+    return true;
+  }
+
+  // Either created just now, outdated or corrupted - start from scratch.
+  functions_.clear();
+  data_.clear();
+  data_.shrink_to_fit();
+  if (!xe::filesystem::TruncateStdioFile(file_, 0)) {
+    return false;
+  }
+  header.magic = kMagic;
+  header.version = kVersion;
+  fwrite(&header, sizeof(header), 1, file_);
+  fflush(file_);
+  return true;
+}
+
+uint64_t GuestProfileCache::HashGuestCode(uint32_t guest_address,
+                                          uint32_t guest_end_address) const {
+  return XXH3_64bits(memory_->TranslateVirtual(guest_address),
+                     guest_end_address - guest_address + 4);
+}
+
+std::vector<uint32_t> GuestProfileCache::GetFunctionAddresses() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<uint32_t> addresses;
+  addresses.reserve(functions_.size());
+  for (auto& it : functions_) {
+    addresses.push_back(it.first);
+  }
+  return addresses;
+}
+
+bool GuestProfileCache::LoadFunction(GuestFunction* function) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = functions_.find(function->address());
+  if (it == functions_.end()) {
+    return false;
+  }
+  const uint8_t* stored_function = data_.data() + it->second;
+  StoredFunctionHeader header;
+  std::memcpy(&header, stored_function, sizeof(header));
+  if (header.guest_end_address < header.guest_address ||
+      HashGuestCode(header.guest_address, header.guest_end_address) !=
+          header.guest_code_hash) {
+    return false;
+  }
+  const uint8_t* stored_branch_profiles = stored_function + sizeof(header);
+  const uint8_t* stored_indirect_call_profiles =
+      stored_branch_profiles +
+      sizeof(BranchProfile) * header.branch_profile_count;
+  auto& branch_profiles = function->branch_profiles();
+  branch_profiles.resize(header.branch_profile_count);
+  std::memcpy(branch_profiles.data(), stored_branch_profiles,
+              sizeof(BranchProfile) * header.branch_profile_count);
+  auto& indirect_call_profiles = function->indirect_call_profiles();
+  indirect_call_profiles.resize(header.indirect_call_profile_count);
+  std::memcpy(indirect_call_profiles.data(), stored_indirect_call_profiles,
+              sizeof(IndirectCallProfile) * header.indirect_call_profile_count);
+  return true;
+}
+
+void GuestProfileCache::StoreFunction(GuestFunction* function) {
+  if (!function->has_end_address()) {
+    return;
+  }
+  // The baseline code may still be updating the counts, they're approximate
+  // anyway.
+  const auto& branch_profiles = function->branch_profiles();
+  const auto& indirect_call_profiles = function->indirect_call_profiles();
+  std::vector<uint8_t> data(
+      sizeof(BranchProfile) * branch_profiles.size() +
+      sizeof(IndirectCallProfile) * indirect_call_profiles.size());
+  if (!branch_profiles.empty()) {
+    std::memcpy(data.data(), branch_profiles.data(),
+                sizeof(BranchProfile) * branch_profiles.size());
+  }
+  if (!indirect_call_profiles.empty()) {
+    std::memcpy(data.data() + sizeof(BranchProfile) * branch_profiles.size(),
+                indirect_call_profiles.data(),
+                sizeof(IndirectCallProfile) * indirect_call_profiles.size());
+  }
+
+  StoredFunctionHeader header = {};
+  header.guest_address = function->address();
+  header.guest_end_address = function->end_address();
+  header.guest_code_hash =
+      HashGuestCode(header.guest_address, header.guest_end_address);
+  header.branch_profile_count = uint32_t(branch_profiles.size());
+  header.indirect_call_profile_count = uint32_t(indirect_call_profiles.size());
+  header.data_hash = XXH3_64bits(data.data(), data.size());
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!file_) {
+    return;
+  }
+  // Not interleaving with profiles appended by other instances.
+  xe::filesystem::ScopedStdioFileLock file_lock(file_);
+  if (!fwrite(&header, sizeof(header), 1, file_) ||
+      (!data.empty() && !fwrite(data.data(), data.size(), 1, file_))) {
+    XELOGE("Failed to write the profile of {:08X} to the guest profile cache",
+           header.guest_address);
+  }
+  fflush(file_);
+}
+
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,95 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_GUEST_PROFILE_CACHE_H_
+#define XENIA_CPU_GUEST_PROFILE_CACHE_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/assert.h"
+#include "xenia/cpu/function.h"
+#include "xenia/memory.h"
+
+namespace xe {
+namespace cpu {
+
+// Stores the branch and indirect call profiles collected by the baseline code
+// of the functions of a module that became hot, next to the instruction info
+// cache of the module (keyed by the image hash). On subsequent runs those
+// functions are optimized right away, with the stored profiles for the block
+// layout and the devirtualization.
+//
+// Records of functions that became hot again are appended, the last one wins.
+class GuestProfileCache {
+ public:
+  explicit GuestProfileCache(Memory* memory);
+  ~GuestProfileCache();
+
+  // Reads the profiles stored by previous runs, the file is kept open to
+  // append new ones.
+  bool Open(const std::filesystem::path& path);
+
+  // Addresses of the functions that became hot in previous runs.
+  std::vector<uint32_t> GetFunctionAddresses();
+
+  // Fills in the profiles of the function if it became hot in a previous run
+  // and its code hasn't changed since then.
+  bool LoadFunction(GuestFunction* function);
+
+  // Stores the profiles collected by the baseline code of a function that has
+  // just become hot.
+  void StoreFunction(GuestFunction* function);
+
+ private:
+  // 'XPRF'.
+  static constexpr uint32_t kMagic = 0x46525058;
+  // Increment this when the format or the meaning of the counts changes.
+  static constexpr uint32_t kVersion = 1;
+
+  struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+  };
+
+  struct StoredFunctionHeader {
+    uint32_t guest_address;
+    uint32_t guest_end_address;
+    // Hash of the guest instructions to reject functions that were patched.
+    uint64_t guest_code_hash;
+    uint32_t branch_profile_count;
+    uint32_t indirect_call_profile_count;
+    // Hash of the data following the header.
+    uint64_t data_hash;
+  };
+  static_assert_size(StoredFunctionHeader, 32);
+
+  uint64_t HashGuestCode(uint32_t guest_address,
+                         uint32_t guest_end_address) const;
+  // Returns false if the file couldn't be reset.
+  bool ReadFile();
+
+  Memory* memory_;
+
+  std::mutex mutex_;
+  FILE* file_ = nullptr;
+  // Contents of the file read on open.
+  std::vector<uint8_t> data_;
+  // Guest address to the offset of the latest StoredFunctionHeader in data_.
+  std::unordered_map<uint32_t, size_t> functions_;
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_GUEST_PROFILE_CACHE_H_
@@ -0,0 +1,175 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/guest_sampler.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "third_party/fmt/include/fmt/format.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+#include "xenia/cpu/function.h"
+#include "xenia/cpu/processor.h"
+
+namespace xe {
+namespace cpu {
+
+std::unique_ptr<GuestSampler> GuestSampler::Create(
+    Processor* processor, const std::filesystem::path& path,
+    std::chrono::milliseconds interval) {
+  if (!processor->stack_walker()) {
+    XELOGE("Guest sampling requires a stack walker");
+    return nullptr;
+  }
+  auto sampler = std::unique_ptr<GuestSampler>(
+      new GuestSampler(processor, path, interval));
+  sampler->wake_event_ = threading::Event::CreateAutoResetEvent(false);
+  if (sampler->wake_event_) {
+    sampler->sampler_thread_ = threading::Thread::Create(
+        {}, [sampler_ptr = sampler.get()]() { sampler_ptr->SamplerThread(); });
+  }
+  if (!sampler->sampler_thread_) {
+    XELOGE("Failed to create the guest sampler thread");
+    return nullptr;
+  }
+  sampler->sampler_thread_->set_name("Guest Sampler");
+  return sampler;
+}
+
+GuestSampler::GuestSampler(Processor* processor,
+                           const std::filesystem::path& path,
+                           std::chrono::milliseconds interval)
+    : processor_(processor),
+      stack_walker_(processor->stack_walker()),
+      path_(path),
+      interval_(std::max(interval, std::chrono::milliseconds(1))) {}
+
+GuestSampler::~GuestSampler() {
+  if (sampler_thread_) {
+    shutting_down_.store(true, std::memory_order_release);
+    wake_event_->Set();
+    threading::Wait(sampler_thread_.get(), false);
+    sampler_thread_.reset();
+  }
+  WriteStacks();
+}
+
+void GuestSampler::SamplerThread() {
+  std::vector<Processor::ThreadStackSample> samples;
+  while (true) {
+    threading::Wait(wake_event_.get(), false, interval_);
+    if (shutting_down_.load(std::memory_order_acquire)) {
+      break;
+    }
+    processor_->CaptureThreadStacks(samples);
+    for (auto& sample : samples) {
+      size_t frame_count = sample.frame_host_pcs.size();
+      if (!frame_count) {
+        continue;
+      }
+      if (frames_.size() < frame_count) {
+        frames_.resize(frame_count);
+      }
+      if (stack_walker_->ResolveStack(sample.frame_host_pcs.data(),
+                                      frames_.data(), frame_count)) {
+        AddSample(sample.thread_id, frames_.data(), frame_count);
+      }
+    }
+  }
+}
+
+void GuestSampler::AddSample(uint32_t thread_id, const StackFrame* frames,
+                             size_t frame_count) {
+  ++sample_count_;
+  // Frames are innermost first. Host frames below the guest ones are the
+  // thread entry and the thunks, only the innermost host frame above them
+  // (the export or the emulator code the guest is waiting for) is kept.
+  size_t innermost_guest = frame_count;
+  for (size_t i = 0; i < frame_count; ++i) {
+    if (frames[i].type == StackFrame::Type::kGuest) {
+      innermost_guest = i;
+      break;
+    }
+  }
+  if (innermost_guest == frame_count) {
+    // Not running guest code at all.
+    return;
+  }
+  ++guest_sample_count_;
+  ++guest_pc_counts_[frames[innermost_guest].guest_pc];
+
+  stack_.clear();
+  fmt::format_to(std::back_inserter(stack_), "thread_{:08X}", thread_id);
+  for (size_t i = frame_count; i-- > innermost_guest;) {
+    const StackFrame& frame = frames[i];
+    if (frame.type != StackFrame::Type::kGuest) {
+      continue;
+    }
+    Function* function = frame.guest_symbol.function;
+    if (function && !function->name().empty()) {
+      fmt::format_to(std::back_inserter(stack_), ";{}", function->name());
+    } else if (function) {
+      fmt::format_to(std::back_inserter(stack_), ";sub_{:08X}",
+                     function->address());
+    } else {
+      fmt::format_to(std::back_inserter(stack_), ";unknown_{:08X}",
+                     frame.guest_pc);
+    }
+  }
+  if (innermost_guest) {
+    const char* host_name = frames[0].host_symbol.name;
+    if (host_name[0]) {
+      fmt::format_to(std::back_inserter(stack_), ";[host] {}", host_name);
+    } else {
+      stack_ += ";[host]";
+    }
+  }
+  // Semicolons separate the frames and the count follows a space.
+  std::replace(stack_.begin(), stack_.end(), ' ', '_');
+  ++stack_counts_[stack_];
+}
+
+void GuestSampler::WriteStacks() {
+  FILE* file = xe::filesystem::OpenFile(path_, "wb");
+  if (!file) {
+    XELOGE("Failed to open the guest sampling profile file {}",
+           xe::path_to_utf8(path_));
+    return;
+  }
+  std::vector<const std::pair<const std::string, uint64_t>*> stacks;
+  stacks.reserve(stack_counts_.size());
+  for (const auto& it : stack_counts_) {
+    stacks.push_back(&it);
+  }
+  std::sort(stacks.begin(), stacks.end(),
+            [](auto a, auto b) { return a->first < b->first; });
+  for (auto stack : stacks) {
+    fmt::print(file, "{} {}\n", stack->first, stack->second);
+  }
+  fclose(file);
+
+  XELOGI("Guest sampler: {} samples, {} in guest code, written to {}",
+         sample_count_, guest_sample_count_, xe::path_to_utf8(path_));
+  std::vector<std::pair<uint32_t, uint64_t>> guest_pcs(guest_pc_counts_.begin(),
+                                                       guest_pc_counts_.end());
+  size_t hot_spot_count = std::min(guest_pcs.size(), size_t(16));
+  std::partial_sort(guest_pcs.begin(), guest_pcs.begin() + hot_spot_count,
+                    guest_pcs.end(), [](const auto& a, const auto& b) {
+                      return a.second > b.second;
+                    });
+  for (size_t i = 0; i < hot_spot_count; ++i) {
+    XELOGI("  {:08X}: {} samples ({:.2f}%)", guest_pcs[i].first,
+           guest_pcs[i].second,
+           100.0 * double(guest_pcs[i].second) / double(guest_sample_count_));
+  }
+}
+
+}  // namespace cpu
+}  // namespace xe
@@ -0,0 +1,77 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_GUEST_SAMPLER_H_
+#define XENIA_CPU_GUEST_SAMPLER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "xenia/base/threading.h"
+#include "xenia/cpu/stack_walker.h"
+
+namespace xe {
+namespace cpu {
+
+class Processor;
+
+// Statistical profiler which periodically interrupts the guest threads and
+// walks their stacks, mapping the host frames back to guest functions through
+// the code cache, without the timing distortion of instrumented code. The
+// samples are written at shutdown as folded stacks (one line per unique stack,
+// "thread;outermost;...;innermost count"), which flamegraph.pl, speedscope
+// and similar tools turn into flame graphs.
+class GuestSampler {
+ public:
+  static std::unique_ptr<GuestSampler> Create(
+      Processor* processor, const std::filesystem::path& path,
+      std::chrono::milliseconds interval);
+  GuestSampler(const GuestSampler& sampler) = delete;
+  GuestSampler& operator=(const GuestSampler& sampler) = delete;
+  // Stops sampling and writes the collected stacks.
+  ~GuestSampler();
+
+ private:
+  GuestSampler(Processor* processor, const std::filesystem::path& path,
+               std::chrono::milliseconds interval);
+
+  void SamplerThread();
+  void AddSample(uint32_t thread_id, const StackFrame* frames,
+                 size_t frame_count);
+  void WriteStacks();
+
+  Processor* processor_;
+  StackWalker* stack_walker_;
+  std::filesystem::path path_;
+  std::chrono::milliseconds interval_;
+
+  // Accessed only by the sampler thread until it's stopped.
+  std::vector<StackFrame> frames_;
+  std::string stack_;
+  std::unordered_map<std::string, uint64_t> stack_counts_;
+  // Innermost guest instruction of the samples, for the hot spot summary.
+  std::unordered_map<uint32_t, uint64_t> guest_pc_counts_;
+  uint64_t sample_count_ = 0;
+  uint64_t guest_sample_count_ = 0;
+
+  std::atomic<bool> shutting_down_{false};
+  std::unique_ptr<threading::Event> wake_event_;
+  std::unique_ptr<threading::Thread> sampler_thread_;
+};
+
+}  // namespace cpu
+}  // namespace xe
+
+#endif  // XENIA_CPU_GUEST_SAMPLER_H_
@@ -576,6 +576,30 @@ void HIRBuilder::RemoveBlock(Block* block) {
   block->next = block->prev = nullptr;
 }
 
+void HIRBuilder::MoveBlockAfter(Block* block, Block* prev_block) {
+  if (block == prev_block || prev_block->next == block) {
+    return;
+  }
+  if (block->prev) {
+    block->prev->next = block->next;
+  } else {
+    block_head_ = block->next;
+  }
+  if (block->next) {
+    block->next->prev = block->prev;
+  } else {
+    block_tail_ = block->prev;
+  }
+  block->prev = prev_block;
+  block->next = prev_block->next;
+  if (block->next) {
+    block->next->prev = block;
+  } else {
+    block_tail_ = block;
+  }
+  prev_block->next = block;
+}
+
 void HIRBuilder::MergeAdjacentBlocks(Block* left, Block* right) {
   assert_true(left->next == right && right->prev == left);
   assert_true(!right->incoming_edge_head ||
@@ -775,6 +799,25 @@ Value* HIRBuilder::CloneValue(Value* source) {
   return value;
 }
 
+Instr* HIRBuilder::CloneInstr(Instr* source) {
+  Instr* instr = AppendInstr(*source->opcode, source->flags,
+                             source->dest ? CloneValue(source->dest) : nullptr);
+  uint32_t signature = source->opcode->signature;
+  OpcodeSignatureType src_types[] = {
+      GET_OPCODE_SIG_TYPE_SRC1(signature),
+      GET_OPCODE_SIG_TYPE_SRC2(signature),
+      GET_OPCODE_SIG_TYPE_SRC3(signature),
+  };
+  for (uint32_t n = 0; n < 3; ++n) {
+    if (src_types[n] == OPCODE_SIG_TYPE_V) {
+      instr->set_srcN(source->srcs[n].value, n);
+    } else {
+      instr->srcs[n] = source->srcs[n];
+    }
+  }
+  return instr;
+}
+
 void HIRBuilder::Comment(std::string_view value) {
   if (value.empty()) {
     return;
@@ -1345,6 +1388,17 @@ void HIRBuilder::Memset(Value* address, Value* value, Value* length) {
   i->set_src3(length);
 }
 
+void HIRBuilder::Memcpy(Value* dest_address, Value* src_address,
+                        Value* length) {
+  ASSERT_ADDRESS_TYPE(dest_address);
+  ASSERT_ADDRESS_TYPE(src_address);
+  ASSERT_TYPES_EQUAL(dest_address, length);
+  Instr* i = AppendInstr(OPCODE_MEMCPY_info, 0);
+  i->set_src1(dest_address);
+  i->set_src2(src_address);
+  i->set_src3(length);
+}
+
 void HIRBuilder::CacheControl(Value* address, size_t cache_line_size,
                               CacheControlType type) {
   ASSERT_ADDRESS_TYPE(address);
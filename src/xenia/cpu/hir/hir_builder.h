@@ -76,6 +76,9 @@ class HIRBuilder {
   void RemoveEdge(Edge* edge);
   void RemoveBlock(Block* block);
   void MergeAdjacentBlocks(Block* left, Block* right);
+  // Only relinks the block list, blocks falling through into or out of the
+  // moved block need explicit branches added by the caller.
+  void MoveBlockAfter(Block* block, Block* prev_block);
 
   Instr* AllocateInstruction();
 
@@ -133,6 +136,9 @@ class HIRBuilder {
 
   Value* AllocValue(TypeName type = INT64_TYPE);
   Value* CloneValue(Value* source);
+  // Appends a copy of the instruction with the same sources, defining a clone
+  // of its dest value.
+  Instr* CloneInstr(Instr* source);
 
   // phi type_name, Block* b1, Value* v1, Block* b2, Value* v2, etc
   Value* Assign(Value* value);
@@ -198,7 +204,11 @@ class HIRBuilder {
   void StoreVectorLeft(Value* address, Value* value);
   void StoreVectorRight(Value* address, Value* value);
   void Store(Value* address, Value* value, uint32_t store_flags = 0);
+  // Fills length bytes with the byte value. With a constant length, the
+  // address must be aligned to 32 bytes (like the result of dcbz).
   void Memset(Value* address, Value* value, Value* length);
+  // Copies length bytes between ranges that must not overlap.
+  void Memcpy(Value* dest_address, Value* src_address, Value* length);
   void CacheControl(Value* address, size_t cache_line_size,
                     CacheControlType type);
   void MemoryBarrier();
@@ -55,6 +55,35 @@ void Instr::MoveBefore(Instr* other) {
   }
 }
 
+void Instr::MoveToEnd(Block* other_block) {
+  if (block == other_block && !next) {
+    return;
+  }
+
+  // Remove from current location.
+  if (prev) {
+    prev->next = next;
+  } else {
+    block->instr_head = next;
+  }
+  if (next) {
+    next->prev = prev;
+  } else {
+    block->instr_tail = prev;
+  }
+
+  // Append to the new block.
+  block = other_block;
+  next = nullptr;
+  prev = block->instr_tail;
+  if (prev) {
+    prev->next = this;
+  } else {
+    block->instr_head = this;
+  }
+  block->instr_tail = this;
+}
+
 void Instr::Replace(const OpcodeInfo* new_opcode, uint16_t new_flags) {
   opcode = new_opcode;
   flags = new_flags;
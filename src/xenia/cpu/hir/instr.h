@@ -77,6 +77,7 @@ class Instr {
   void set_src3(Value* value) { set_srcN(value, 2); }
 
   void MoveBefore(Instr* other);
+  void MoveToEnd(Block* other_block);
   void Replace(const OpcodeInfo* new_opcode, uint16_t new_flags);
   void UnlinkAndNOP();
   //chrispy: wanted to change this one to Remove, but i changed Remove's name to UnlinkAndNOP,
@@ -37,6 +37,8 @@ enum RoundMode {
 
 enum LoadStoreFlags {
   LOAD_STORE_BYTE_SWAP = 1 << 0,
+  // Vectors not necessarily aligned to 16 bytes.
+  LOAD_STORE_UNALIGNED = 1 << 1,
 };
 
 enum CacheControlType {
@@ -49,6 +51,9 @@ enum CacheControlType {
 enum ArithmeticFlags {
   ARITHMETIC_UNSIGNED = (1 << 2),
   ARITHMETIC_SATURATE = (1 << 3),
+  // Vector floating-point arithmetic done on behalf of the FPU, with its
+  // rounding mode and denormal handling instead of the ones of VMX.
+  ARITHMETIC_FPU_MODE = (1 << 4),
 };
 
 constexpr uint32_t MakePermuteMask(uint32_t sel_x, uint32_t x, uint32_t sel_y,
@@ -215,6 +220,7 @@ enum Opcode {
   OPCODE_STVL,
   OPCODE_STVR,
   OPCODE_MEMSET,
+  OPCODE_MEMCPY,
   OPCODE_CACHE_CONTROL,
   OPCODE_MEMORY_BARRIER,
   OPCODE_MAX,
@@ -362,6 +368,9 @@ enum OpcodeSignature {
 #define GET_OPCODE_SIG_TYPE_SRC1(sig) (OpcodeSignatureType)((sig >> 3) & 0x7)
 #define GET_OPCODE_SIG_TYPE_SRC2(sig) (OpcodeSignatureType)((sig >> 6) & 0x7)
 #define GET_OPCODE_SIG_TYPE_SRC3(sig) (OpcodeSignatureType)((sig >> 9) & 0x7)
+// Source index n from 0 to 2.
+#define GET_OPCODE_SIG_TYPE_SRCN(sig, n) \
+  (OpcodeSignatureType)((sig >> (3 + 3 * (n))) & 0x7)
 XE_MAYBE_UNUSED
 static bool IsOpcodeBinaryValue(uint32_t signature) {
   return (signature & ~(0x7)) ==
@@ -266,6 +266,12 @@ DEFINE_OPCODE(
     OPCODE_SIG_X_V_V_V,
     OPCODE_FLAG_MEMORY)
 
+DEFINE_OPCODE(
+    OPCODE_MEMCPY,
+    "memcpy",
+    OPCODE_SIG_X_V_V_V,
+    OPCODE_FLAG_MEMORY)
+
 DEFINE_OPCODE(
     OPCODE_CACHE_CONTROL,
     "cache_control",
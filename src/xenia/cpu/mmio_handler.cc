@@ -100,6 +100,17 @@ MMIORange* MMIOHandler::LookupRange(uint32_t virtual_address) {
   return nullptr;
 }
 
+bool MMIOHandler::SetRangeReadShadow(uint32_t virtual_address, uint32_t size) {
+  MMIORange* range = LookupRange(virtual_address);
+  if (!range || (virtual_address + size - 1) < virtual_address ||
+      LookupRange(virtual_address + size - 1) != range) {
+    return false;
+  }
+  range->read_shadow_address = virtual_address;
+  range->read_shadow_size = size;
+  return true;
+}
+
 bool MMIOHandler::CheckLoad(uint32_t virtual_address, uint32_t* out_value) {
   for (const auto& range : mapped_ranges_) {
     if ((virtual_address & range.mask) == range.address) {
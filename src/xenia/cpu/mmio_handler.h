@@ -38,6 +38,14 @@ struct MMIORange {
   void* callback_context;
   MMIOReadCallback read;
   MMIOWriteCallback write;
+  // Part of the range that is readable as normal memory, kept up to date by
+  // the owner of the range, so reads don't need to go through the callback.
+  uint32_t read_shadow_address = 0;
+  uint32_t read_shadow_size = 0;
+
+  bool IsReadShadowed(uint32_t virtual_address) const {
+    return virtual_address - read_shadow_address < read_shadow_size;
+  }
 };
 
 // NOTE: only one can exist at a time!
@@ -67,6 +75,7 @@ class MMIOHandler {
                      void* context, MMIOReadCallback read_callback,
                      MMIOWriteCallback write_callback);
   MMIORange* LookupRange(uint32_t virtual_address);
+  bool SetRangeReadShadow(uint32_t virtual_address, uint32_t size);
 
   bool CheckLoad(uint32_t virtual_address, uint32_t* out_value);
   bool CheckStore(uint32_t virtual_address, uint32_t value);
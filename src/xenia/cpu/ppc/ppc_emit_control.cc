@@ -38,6 +38,16 @@ int InstrEmit_branch(PPCHIRBuilder& f, const char* src, uint64_t cia,
                      bool expect_true = true, bool nia_is_lr = false) {
   uint32_t call_flags = 0;
 
+  // Unconditional direct calls to small leaf functions and to the TLS exports
+  // are emitted in place, falling through to the return address.
+  if (lk && !cond && nia->IsConstant()) {
+    uint32_t target_address = uint32_t(nia->AsUint64() & 0xFFFFFFFF);
+    if (f.TryInlineTlsCall(uint32_t(cia + 4), target_address) ||
+        f.TryInlineCall(uint32_t(cia + 4), target_address)) {
+      return 0;
+    }
+  }
+
   // TODO(benvanik): this may be wrong and overwrite LRs when not desired!
   // The docs say always, though...
   // Note that we do the update before we branch/call as we need it to
@@ -137,13 +147,18 @@ int InstrEmit_branch(PPCHIRBuilder& f, const char* src, uint64_t cia,
     if (likely_return) {
       call_flags |= CALL_POSSIBLE_RETURN;
     }
-    if (cond) {
-      if (!expect_true) {
-        cond = f.IsFalse(cond);
+    if (cond && !expect_true) {
+      cond = f.IsFalse(cond);
+    }
+    // Virtual calls to the same targets most of the time in the baseline
+    // code become guarded direct calls once the function is optimized.
+    if (likely_return ||
+        !f.TryDevirtualizeCall(uint32_t(cia), cond, nia, call_flags)) {
+      if (cond) {
+        f.CallIndirectTrue(cond, nia, call_flags);
+      } else {
+        f.CallIndirect(nia, call_flags);
       }
-      f.CallIndirectTrue(cond, nia, call_flags);
-    } else {
-      f.CallIndirect(nia, call_flags);
     }
   }
 }
@@ -773,19 +773,15 @@ int InstrEmit_ldarx(PPCHIRBuilder& f, const InstrData& i) {
   // RESERVE_ADDR <- real_addr(EA)
   // RT <- MEM(EA, 8)
 
-  // NOTE: we assume we are within a global lock.
-  // We could assert here that the block (or its parent) has taken a global lock
-  // already, but I haven't see anything but interrupt callbacks (which are
-  // always under a global lock) do that yet.
-  // We issue a memory barrier here to make sure that we get good values.
+  // NOTE: reservations are tracked by the backend without any global lock.
+  // No barrier is needed, guest code issues its own sync/lwsync around
+  // atomic sequences and the host doesn't reorder loads with other loads.
   Value* ea = CalculateEA_0(f, i.X.RA, i.X.RB);
 
   if (cvars::no_reserved_ops) {
     f.StoreGPR(i.X.RT, f.ByteSwap(f.Load(ea, INT64_TYPE)));
 
   } else {
-    f.MemoryBarrier();
-
     Value* rt = f.ByteSwap(f.LoadWithReserve(ea, INT64_TYPE));
     f.StoreGPR(i.X.RT, rt);
   }
@@ -803,11 +799,9 @@ int InstrEmit_lwarx(PPCHIRBuilder& f, const InstrData& i) {
   // RESERVE_ADDR <- real_addr(EA)
   // RT <- i32.0 || MEM(EA, 4)
 
-  // NOTE: we assume we are within a global lock.
-  // We could assert here that the block (or its parent) has taken a global lock
-  // already, but I haven't see anything but interrupt callbacks (which are
-  // always under a global lock) do that yet.
-  // We issue a memory barrier here to make sure that we get good values.
+  // NOTE: reservations are tracked by the backend without any global lock.
+  // No barrier is needed, guest code issues its own sync/lwsync around
+  // atomic sequences and the host doesn't reorder loads with other loads.
 
   Value* ea = CalculateEA_0(f, i.X.RA, i.X.RB);
   if (cvars::no_reserved_ops) {
@@ -815,8 +809,6 @@ int InstrEmit_lwarx(PPCHIRBuilder& f, const InstrData& i) {
                f.ZeroExtend(f.ByteSwap(f.Load(ea, INT32_TYPE)), INT64_TYPE));
 
   } else {
-    f.MemoryBarrier();
-
     Value* rt =
         f.ZeroExtend(f.ByteSwap(f.LoadWithReserve(ea, INT32_TYPE)), INT64_TYPE);
     f.StoreGPR(i.X.RT, rt);
@@ -835,12 +827,10 @@ int InstrEmit_stdcx(PPCHIRBuilder& f, const InstrData& i) {
   // n <- 1 if store performed
   // CR0[LT GT EQ SO] = 0b00 || n || XER[SO]
 
-  // NOTE: we assume we are within a global lock.
-  // As we have been exclusively executing this entire time, we assume that no
-  // one else could have possibly touched the memory and must always succeed.
-  // We use atomic compare exchange here to support reserved load/store without
-  // being under the global lock (flag disable_global_lock - see mtmsr/mtmsrd).
-  // This will always succeed if under the global lock, however.
+  // NOTE: the store fails if another reserved store to the same cache line
+  // succeeded since the reserved load, or if the memory doesn't contain the
+  // loaded value anymore. The backend uses atomic compare exchanges for this,
+  // which also act as the barrier for other threads to see our update.
 
   Value* ea = CalculateEA_0(f, i.X.RA, i.X.RB);
   Value* rt = f.ByteSwap(f.LoadGPR(i.X.RT));
@@ -856,12 +846,6 @@ int InstrEmit_stdcx(PPCHIRBuilder& f, const InstrData& i) {
   }
   f.StoreContext(offsetof(PPCContext, cr0.cr0_lt), f.LoadZeroInt8());
   f.StoreContext(offsetof(PPCContext, cr0.cr0_gt), f.LoadZeroInt8());
-
-  // Issue memory barrier for when we go out of lock and want others to see our
-  // updates.
-  if (!cvars::no_reserved_ops) {
-    f.MemoryBarrier();
-  }
   return 0;
 }
 
@@ -876,12 +860,10 @@ int InstrEmit_stwcx(PPCHIRBuilder& f, const InstrData& i) {
   // n <- 1 if store performed
   // CR0[LT GT EQ SO] = 0b00 || n || XER[SO]
 
-  // NOTE: we assume we are within a global lock.
-  // As we have been exclusively executing this entire time, we assume that no
-  // one else could have possibly touched the memory and must always succeed.
-  // We use atomic compare exchange here to support reserved load/store without
-  // being under the global lock (flag disable_global_lock - see mtmsr/mtmsrd).
-  // This will always succeed if under the global lock, however.
+  // NOTE: the store fails if another reserved store to the same cache line
+  // succeeded since the reserved load, or if the memory doesn't contain the
+  // loaded value anymore. The backend uses atomic compare exchanges for this,
+  // which also act as the barrier for other threads to see our update.
 
   Value* ea = CalculateEA_0(f, i.X.RA, i.X.RB);
 
@@ -899,12 +881,6 @@ int InstrEmit_stwcx(PPCHIRBuilder& f, const InstrData& i) {
   f.StoreContext(offsetof(PPCContext, cr0.cr0_lt), f.LoadZeroInt8());
   f.StoreContext(offsetof(PPCContext, cr0.cr0_gt), f.LoadZeroInt8());
 
-  // Issue memory barrier for when we go out of lock and want others to see our
-  // updates.
-  if (!cvars::no_reserved_ops) {
-    f.MemoryBarrier();
-  }
-
   return 0;
 }
 // Floating-point load (A-19)
@@ -10,6 +10,8 @@
 #ifndef XENIA_CPU_PPC_PPC_FRONTEND_H_
 #define XENIA_CPU_PPC_PPC_FRONTEND_H_
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 
 #include "xenia/base/type_pool.h"
@@ -47,12 +49,28 @@ class PPCFrontend {
   Memory* memory() const;
   PPCBuiltins* builtins() { return &builtins_; }
 
+  static constexpr uint32_t kTlsSlotsOffsetUnknown = UINT32_MAX;
+  // Offset of the KeTlsGetValue/KeTlsSetValue slots of the threads of the
+  // title from the TLS block the PCR points to, set by the kernel when the
+  // executable is loaded, so calls to the exports can be translated to direct
+  // accesses.
+  uint32_t tls_slots_offset() const {
+    return tls_slots_offset_.load(std::memory_order_relaxed);
+  }
+  void set_tls_slots_offset(uint32_t offset) {
+    tls_slots_offset_.store(offset, std::memory_order_relaxed);
+  }
+
   bool DeclareFunction(GuestFunction* function);
   bool DefineFunction(GuestFunction* function, uint32_t debug_info_flags);
+  // Translates a baseline function again with all optimization passes and
+  // replaces its machine code.
+  bool RecompileFunction(GuestFunction* function);
 
  private:
   Processor* processor_;
   PPCBuiltins builtins_ = {0};
+  std::atomic<uint32_t> tls_slots_offset_{kTlsSlotsOffsetUnknown};
   TypePool<PPCTranslator, PPCFrontend*> translator_pool_;
 };
 // Checks the state of the global lock and sets scratch to the current MSR
@@ -10,6 +10,7 @@
 #include "xenia/cpu/ppc/ppc_hir_builder.h"
 
 #include <stddef.h>
+#include <algorithm>
 #include <cstring>
 
 #include "third_party/fmt/include/fmt/format.h"
@@ -21,6 +22,7 @@
 #include "xenia/base/profiling.h"
 #include "xenia/base/string.h"
 #include "xenia/cpu/cpu_flags.h"
+#include "xenia/cpu/export_resolver.h"
 #include "xenia/cpu/hir/label.h"
 #include "xenia/cpu/ppc/ppc_context.h"
 #include "xenia/cpu/ppc/ppc_decode_data.h"
@@ -33,6 +35,19 @@ DEFINE_bool(
     "Break to the host debugger (or crash if no debugger attached) if an "
     "unimplemented PowerPC instruction is encountered.",
     "CPU");
+DEFINE_bool(inline_leaf_functions, true,
+            "Emit the bodies of small straight-line guest functions in place "
+            "of direct calls to them.",
+            "CPU");
+DEFINE_int32(inline_max_instructions, 16,
+             "Maximum number of instructions in a guest function for it to be "
+             "inlined with inline_leaf_functions.",
+             "CPU");
+DEFINE_bool(inline_tls_exports, true,
+            "Translate direct calls to KeTlsGetValue and KeTlsSetValue to "
+            "accesses to the TLS slots of the current thread instead of "
+            "calling the kernel.",
+            "CPU");
 
 namespace xe {
 namespace cpu {
@@ -125,7 +140,6 @@ bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
     uint32_t code =
         xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address));
     auto opcode = LookupOpcode(code);
-    auto& opcode_info = GetOpcodeInfo(opcode);
 
     // Mark label, if we were assigned one earlier on in the walk.
     // We may still get a label, but it'll be inserted by LookupLabel
@@ -163,40 +177,263 @@ bool PPCHIRBuilder::Emit(GuestFunction* function, uint32_t flags) {
       // TraceInvalidInstruction(i);
       continue;
     }
-    ++opcode_translation_counts[static_cast<int>(opcode)];
+    EmitInstruction(address, code, opcode);
+  }
+
+  if (false) {
+    DumpAllOpcodeCounts();
+  }
+
+  return Finalize();
+}
+
+void PPCHIRBuilder::EmitInstruction(uint32_t address, uint32_t code,
+                                    PPCOpcode opcode) {
+  auto& opcode_info = GetOpcodeInfo(opcode);
+  ++opcode_translation_counts[static_cast<int>(opcode)];
 
-    // Synchronize the PPC context as required.
-    // This will ensure all registers are saved to the PPC context before this
-    // instruction executes.
-    if (opcode_info.type == PPCOpcodeType::kSync) {
-      ContextBarrier();
+  // Synchronize the PPC context as required.
+  // This will ensure all registers are saved to the PPC context before this
+  // instruction executes.
+  if (opcode_info.type == PPCOpcodeType::kSync) {
+    ContextBarrier();
+  }
+
+  MaybeBreakOnInstruction(address);
+
+  InstrData i;
+  i.address = address;
+  i.code = code;
+  i.opcode = opcode;
+  i.opcode_info = &opcode_info;
+  if (!opcode_info.emit || opcode_info.emit(*this, i)) {
+    auto& disasm_info = GetOpcodeDisasmInfo(opcode);
+    XELOGE(
+        "Unimplemented instr {:08X} {:08X} {} - report the game to Xenia "
+        "developers; to skip, disable break_on_unimplemented_instructions",
+        address, code, disasm_info.name);
+    Comment("UNIMPLEMENTED!");
+    if (cvars::break_on_unimplemented_instructions) {
+      DebugBreak();
     }
+  }
+}
 
-    MaybeBreakOnInstruction(address);
-
-    InstrData i;
-    i.address = address;
-    i.code = code;
-    i.opcode = opcode;
-    i.opcode_info = &opcode_info;
-    if (!opcode_info.emit || opcode_info.emit(*this, i)) {
-      auto& disasm_info = GetOpcodeDisasmInfo(opcode);
-      XELOGE(
-          "Unimplemented instr {:08X} {:08X} {} - report the game to Xenia "
-          "developers; to skip, disable break_on_unimplemented_instructions",
-          address, code, disasm_info.name);
-      Comment("UNIMPLEMENTED!");
-      if (cvars::break_on_unimplemented_instructions) {
-        DebugBreak();
-      }
+bool PPCHIRBuilder::TryInlineTlsCall(uint32_t return_address,
+                                     uint32_t target_address) {
+  if (!cvars::inline_tls_exports) {
+    return false;
+  }
+  uint32_t tls_slots_offset = frontend_->tls_slots_offset();
+  if (tls_slots_offset == PPCFrontend::kTlsSlotsOffsetUnknown) {
+    return false;
+  }
+  Function* target = LookupFunction(target_address);
+  if (!target || target->behavior() != Function::Behavior::kExtern) {
+    return false;
+  }
+  Export* export_data = static_cast<GuestFunction*>(target)->export_data();
+  if (!export_data) {
+    return false;
+  }
+  bool is_set;
+  if (!std::strcmp(export_data->name, "KeTlsGetValue")) {
+    is_set = false;
+  } else if (!std::strcmp(export_data->name, "KeTlsSetValue")) {
+    is_set = true;
+  } else {
+    return false;
+  }
+
+  StoreLR(LoadConstantUint64(return_address));
+  if (with_debug_info_) {
+    CommentFormat("inlined {:08X} {}", target_address, export_data->name);
+  }
+  // Like xboxkrnl, not checking the index against the slot count. The TLS
+  // block pointer is at 0 in the PCR, which is in r13.
+  Value* tls_block = ZeroExtend(
+      ByteSwap(LoadOffset(LoadGPR(13), LoadZeroInt64(), INT32_TYPE)),
+      INT64_TYPE);
+  Value* slot_offset = Add(
+      Shl(ZeroExtend(Truncate(LoadGPR(3), INT32_TYPE), INT64_TYPE), int8_t(2)),
+      LoadConstantUint64(tls_slots_offset));
+  if (is_set) {
+    StoreOffset(tls_block, slot_offset,
+                ByteSwap(Truncate(LoadGPR(4), INT32_TYPE)));
+    StoreGPR(3, LoadConstantUint64(1));
+  } else {
+    StoreGPR(3, ZeroExtend(ByteSwap(LoadOffset(tls_block, slot_offset,
+                                               INT32_TYPE)),
+                           INT64_TYPE));
+  }
+  return true;
+}
+
+bool PPCHIRBuilder::TryInlineCall(uint32_t return_address,
+                                  uint32_t target_address) {
+  if (!cvars::inline_leaf_functions) {
+    return false;
+  }
+  // Calls within the function (including recursion) are branches to labels.
+  if (target_address >= function_->address() &&
+      target_address <= function_->end_address()) {
+    return false;
+  }
+  Function* target = LookupFunction(target_address);
+  if (!target || !target->is_guest() ||
+      target->module() != function_->module()) {
+    return false;
+  }
+  auto guest_target = static_cast<GuestFunction*>(target);
+  // The save/restore helpers found by FindSaveRest are sequences of stores or
+  // loads ending with blr that are called from nearly every non-leaf function,
+  // inline them regardless of the size budget. __restgprlr returns to the
+  // caller's caller via mtlr and is jumped to rather than called, so it's
+  // rejected by the checks below.
+  uint32_t max_instructions;
+  if (guest_target->IsSaverest()) {
+    max_instructions = kMaxInlinedSaverestInstructions;
+  } else if (guest_target->behavior() == Function::Behavior::kDefault) {
+    max_instructions = uint32_t(std::max(cvars::inline_max_instructions, 0));
+  } else {
+    return false;
+  }
+
+  // Only straight-line functions that return with a plain blr, don't touch LR
+  // and don't branch or trap anywhere else.
+  Module* module = function_->module();
+  Memory* memory = frontend_->memory();
+  uint32_t instruction_count = 0;
+  for (;; ++instruction_count) {
+    uint32_t address = target_address + instruction_count * 4;
+    if (instruction_count > max_instructions ||
+        !module->ContainsAddress(address)) {
+      return false;
+    }
+    uint32_t code =
+        xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address));
+    // blr.
+    if (code == 0x4E800020) {
+      break;
+    }
+    auto opcode = LookupOpcode(code);
+    if (opcode == PPCOpcode::kInvalid) {
+      return false;
+    }
+    auto& opcode_info = GetOpcodeInfo(opcode);
+    if (!opcode_info.emit || opcode_info.group == PPCOpcodeGroup::kB) {
+      return false;
+    }
+    // mflr/mtlr.
+    if ((code & 0xFC1FFFFF) == 0x7C0802A6 ||
+        (code & 0xFC1FFFFF) == 0x7C0803A6) {
+      return false;
     }
   }
 
-  if (false) {
-    DumpAllOpcodeCounts();
+  // The callee may still read LR (as the return address), keep it correct.
+  StoreLR(LoadConstantUint64(return_address));
+  if (with_debug_info_) {
+    CommentFormat("inlined {:08X} {}", target_address, target->name().c_str());
   }
+  for (uint32_t n = 0; n < instruction_count; ++n) {
+    trace_info_.dest_count = 0;
+    uint32_t address = target_address + n * 4;
+    uint32_t code =
+        xe::load_and_swap<uint32_t>(memory->TranslateVirtual(address));
+    if (with_debug_info_) {
+      comment_buffer_.Reset();
+      comment_buffer_.AppendFormat("{:08X} {:08X} ", address, code);
+      DisasmPPC(address, code, &comment_buffer_);
+      Comment(comment_buffer_);
+    }
+    SourceOffset(address);
+    EmitInstruction(address, code, LookupOpcode(code));
+  }
+  return true;
+}
 
-  return Finalize();
+bool PPCHIRBuilder::TryDevirtualizeCall(uint32_t call_address, Value* cond,
+                                        Value* target, uint16_t call_flags) {
+  if (!cvars::devirtualize_indirect_calls) {
+    return false;
+  }
+  const IndirectCallProfile* profile = nullptr;
+  for (const IndirectCallProfile& call_profile :
+       function_->indirect_call_profiles()) {
+    if (call_profile.guest_address == call_address) {
+      profile = &call_profile;
+      break;
+    }
+  }
+  if (!profile) {
+    return false;
+  }
+
+  // Guard the hottest targets first, as few as needed to cover most calls.
+  constexpr size_t kTargetCount = IndirectCallProfile::kTargetCount;
+  uint64_t total_count = profile->other_count;
+  size_t order[kTargetCount];
+  for (size_t n = 0; n < kTargetCount; ++n) {
+    total_count += profile->target_counts[n];
+    order[n] = n;
+  }
+  if (total_count < kMinDevirtualizedCallCount) {
+    return false;
+  }
+  std::sort(order, order + kTargetCount, [profile](size_t a, size_t b) {
+    return profile->target_counts[a] > profile->target_counts[b];
+  });
+  uint32_t target_addresses[kTargetCount];
+  Function* target_functions[kTargetCount];
+  size_t guarded_count = 0;
+  uint64_t guarded_call_count = 0;
+  while (guarded_call_count * 100 <
+         total_count * kMinDevirtualizedTargetPercentage) {
+    if (guarded_count >= kTargetCount) {
+      return false;
+    }
+    size_t n = order[guarded_count];
+    // The profile isn't synchronized, lookup failures cover torn addresses.
+    Function* function = profile->targets[n] && profile->target_counts[n]
+                             ? LookupFunction(profile->targets[n])
+                             : nullptr;
+    if (!function) {
+      return false;
+    }
+    target_addresses[guarded_count] = profile->targets[n];
+    target_functions[guarded_count] = function;
+    ++guarded_count;
+    guarded_call_count += profile->target_counts[n];
+  }
+
+  // Values are local to blocks, the target is kept in a local across the
+  // guards.
+  Label* end_label = NewLabel();
+  if (cond) {
+    BranchFalse(cond, end_label);
+  }
+  Value* target_local = AllocLocal(target->type);
+  StoreLocal(target_local, target);
+  uint32_t return_address = call_address + 4;
+  for (size_t n = 0; n < guarded_count; ++n) {
+    Label* next_label = NewLabel();
+    BranchFalse(CompareEQ(Truncate(LoadLocal(target_local), INT32_TYPE),
+                          LoadConstantUint32(target_addresses[n])),
+                next_label);
+    if (with_debug_info_) {
+      CommentFormat("devirtualized call to {:08X}", target_addresses[n]);
+    }
+    if ((call_flags & CALL_TAIL) ||
+        !TryInlineCall(return_address, target_addresses[n])) {
+      Call(target_functions[n], call_flags);
+    }
+    Branch(end_label);
+    MarkLabel(next_label);
+  }
+  CallIndirect(LoadLocal(target_local), call_flags);
+  MarkLabel(end_label);
+  return true;
 }
 
 void PPCHIRBuilder::MaybeBreakOnInstruction(uint32_t address) {
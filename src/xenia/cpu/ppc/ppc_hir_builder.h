@@ -13,6 +13,7 @@
 #include "xenia/base/string_buffer.h"
 #include "xenia/cpu/function.h"
 #include "xenia/cpu/hir/hir_builder.h"
+#include "xenia/cpu/ppc/ppc_opcode.h"
 
 namespace xe {
 namespace cpu {
@@ -43,6 +44,19 @@ class PPCHIRBuilder : public hir::HIRBuilder {
   GuestFunction* function() const { return function_; }
   Function* LookupFunction(uint32_t address);
   Label* LookupLabel(uint32_t address);
+  // Emits the body of a small leaf function in place of a direct call to it,
+  // returns false if the call must be emitted instead.
+  bool TryInlineCall(uint32_t return_address, uint32_t target_address);
+  // Emits a direct access to the TLS slot in place of a direct call to the
+  // import thunk of KeTlsGetValue or KeTlsSetValue, returns false if the call
+  // must be emitted instead.
+  bool TryInlineTlsCall(uint32_t return_address, uint32_t target_address);
+  // Emits the indirect call at the address as direct calls (or inlined
+  // bodies) of the targets mostly seen by the baseline code, guarded by
+  // comparisons of the target, and the indirect call for the other ones.
+  // Returns false if the call must be emitted normally instead.
+  bool TryDevirtualizeCall(uint32_t call_address, Value* cond, Value* target,
+                           uint16_t call_flags);
 
   Value* LoadLR();
   void StoreLR(Value* value);
@@ -83,6 +97,14 @@ class PPCHIRBuilder : public hir::HIRBuilder {
   //calls original impl in hirbuilder, but also records the is_return_site bit into flags in the guestmodule
   void SetReturnAddress(Value* value);
  private:
+  // Longest save/restore helper (__savevmx_64 and __restvmx_64).
+  static constexpr uint32_t kMaxInlinedSaverestInstructions = 64 * 2;
+  // Indirect calls are only devirtualized if they were made often enough by
+  // the baseline code, and mostly to the targets counted separately.
+  static constexpr uint32_t kMinDevirtualizedCallCount = 64;
+  static constexpr uint32_t kMinDevirtualizedTargetPercentage = 90;
+
+  void EmitInstruction(uint32_t address, uint32_t code, PPCOpcode opcode);
   void MaybeBreakOnInstruction(uint32_t address);
   void AnnotateLabel(uint32_t address, Label* label);
 
@@ -34,6 +34,8 @@ namespace ppc {
 
 using xe::cpu::backend::Backend;
 using xe::cpu::compiler::Compiler;
+using xe::cpu::compiler::CompilerStatistics;
+using xe::cpu::compiler::FunctionStatistics;
 namespace passes = xe::cpu::compiler::passes;
 
 PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
@@ -67,14 +69,58 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
   if (validate) sap->AddPass(std::make_unique<passes::ValidationPass>());
   compiler_->AddPass(std::move(sap));
 
-  if (backend->machine_info()->supports_extended_load_store) {
-    // Backend supports the advanced LOAD/STORE instructions.
-    // These will save us a lot of HIR opcodes.
+  if (cvars::promote_stack_slots) {
+    // Needs the stack pointer offsets folded into constants. The byte swaps
+    // left around the locals are removed by the simplification below.
+    compiler_->AddPass(std::make_unique<passes::StackPromotionPass>());
+    if (validate)
+      compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+
+  if (cvars::eliminate_byte_swaps) {
+    // After the stack promotion so the swaps around the promoted slots
+    // cancel too.
+    compiler_->AddPass(std::make_unique<passes::ByteSwapEliminationPass>());
+    if (validate)
+      compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+
+  if (cvars::eliminate_common_subexpressions) {
+    // Leaves assignments for the SimplificationPass below.
     compiler_->AddPass(
-        std::make_unique<passes::MemorySequenceCombinationPass>());
+        std::make_unique<passes::CommonSubexpressionEliminationPass>());
+    if (validate)
+      compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+
+  if (cvars::hoist_loop_invariants) {
+    // The CFG was dirtied by the simplification above.
+    compiler_->AddPass(std::make_unique<passes::ControlFlowAnalysisPass>());
+    compiler_->AddPass(std::make_unique<passes::LoopInvariantCodeMotionPass>());
     if (validate)
       compiler_->AddPass(std::make_unique<passes::ValidationPass>());
   }
+
+  if (cvars::recognize_memory_idioms) {
+    compiler_->AddPass(std::make_unique<passes::MemoryIdiomRecognitionPass>());
+    if (validate)
+      compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+
+  if (cvars::vectorize_loops) {
+    // After the memory idioms, which take the loops they can do entirely,
+    // and before the byte swaps get merged into the loads and stores.
+    compiler_->AddPass(std::make_unique<passes::LoopVectorizationPass>());
+    if (validate)
+      compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+
+  // Backend may support the advanced LOAD/STORE instructions for scalars,
+  // swapped vector loads and stores are always supported.
+  // These will save us a lot of HIR opcodes.
+  compiler_->AddPass(std::make_unique<passes::MemorySequenceCombinationPass>(
+      backend->machine_info()->supports_extended_load_store));
+  if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
   compiler_->AddPass(std::make_unique<passes::SimplificationPass>());
   if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
   // compiler_->AddPass(std::make_unique<passes::DeadStoreEliminationPass>());
@@ -83,6 +129,14 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
   compiler_->AddPass(std::make_unique<passes::DeadCodeEliminationPass>());
   if (validate) compiler_->AddPass(std::make_unique<passes::ValidationPass>());
 
+  if (cvars::tiered_compilation && cvars::superblock_formation) {
+    // Uses the branch counts of the baseline code. Last as it only changes the
+    // layout, which nothing else should have to care about.
+    compiler_->AddPass(std::make_unique<passes::SuperblockFormationPass>());
+    if (validate)
+      compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+  }
+
   //// Removes all unneeded variables. Try not to add new ones after this.
   // compiler_->AddPass(new passes::ValueReductionPass());
   // if (validate) compiler_->AddPass(new passes::ValidationPass());
@@ -97,6 +151,30 @@ PPCTranslator::PPCTranslator(PPCFrontend* frontend) : frontend_(frontend) {
 
   // Must come last. The HIR is not really HIR after this.
   compiler_->AddPass(std::make_unique<passes::FinalizationPass>());
+
+  if (cvars::tiered_compilation) {
+    // Only what's needed to make code quick to generate and acceptable to run
+    // until the function becomes hot and is translated again with compiler_.
+    // Constant propagation is required since the backend doesn't handle
+    // operations with only constant operands.
+    baseline_compiler_.reset(new Compiler(frontend->processor()));
+    baseline_compiler_->AddPass(
+        std::make_unique<passes::ControlFlowAnalysisPass>());
+    baseline_compiler_->AddPass(
+        std::make_unique<passes::ConstantPropagationPass>());
+    if (validate) {
+      baseline_compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+    }
+    baseline_compiler_->AddPass(
+        std::make_unique<passes::DeadCodeEliminationPass>());
+    baseline_compiler_->AddPass(
+        std::make_unique<passes::RegisterAllocationPass>(
+            backend->machine_info()));
+    if (validate) {
+      baseline_compiler_->AddPass(std::make_unique<passes::ValidationPass>());
+    }
+    baseline_compiler_->AddPass(std::make_unique<passes::FinalizationPass>());
+  }
 }
 
 PPCTranslator::~PPCTranslator() = default;
@@ -157,6 +235,7 @@ bool PPCTranslator::Translate(GuestFunction* function,
   // Reset() all caching when we leave.
   xe::make_reset_scope(builder_);
   xe::make_reset_scope(compiler_);
+  xe::make_reset_scope(baseline_compiler_);
   xe::make_reset_scope(assembler_);
   xe::make_reset_scope(&string_buffer_);
 
@@ -176,9 +255,31 @@ bool PPCTranslator::Translate(GuestFunction* function,
   if (cvars::trace_function_data) {
     debug_info_flags |= DebugInfoFlags::kDebugInfoTraceFunctionData;
   }
+  if (frontend_->processor()->function_call_tracer()) {
+    debug_info_flags |= DebugInfoFlags::kDebugInfoTraceFunctionCalls;
+  }
+  // Baseline functions are translated again to replace their code.
+  bool recompiling = function->machine_code() != nullptr;
   std::unique_ptr<FunctionDebugInfo> debug_info;
   if (debug_info_flags) {
     debug_info.reset(new FunctionDebugInfo());
+  } else if (!recompiling &&
+             frontend_->processor()->backend()->LoadCachedFunction(function)) {
+    return true;
+  }
+  bool baseline = baseline_compiler_ && !recompiling && !debug_info_flags &&
+                  !cvars::debug;
+  // The counts of the baseline code of functions becoming hot are kept for
+  // the next runs, which optimize those functions right away.
+  auto xex_module = dynamic_cast<XexModule*>(function->module());
+  GuestProfileCache* profile_cache =
+      xex_module ? xex_module->profile_cache() : nullptr;
+  if (profile_cache) {
+    if (recompiling && function->is_baseline()) {
+      profile_cache->StoreFunction(function);
+    } else if (baseline && profile_cache->LoadFunction(function)) {
+      baseline = false;
+    }
   }
 
   // Scan the function to find its extents and gather debug data.
@@ -231,7 +332,12 @@ bool PPCTranslator::Translate(GuestFunction* function,
   }
 
   // Compile/optimize/etc.
-  if (!compiler_->Compile(builder_.get())) {
+  Compiler* compiler = baseline ? baseline_compiler_.get() : compiler_.get();
+  bool collect_statistics = CompilerStatistics::enabled();
+  FunctionStatistics statistics;
+  if (!compiler->Compile(builder_.get(),
+                         collect_statistics ? &statistics : nullptr,
+                         function)) {
     return false;
   }
 
@@ -245,11 +351,24 @@ bool PPCTranslator::Translate(GuestFunction* function,
   DumpHIR(function, builder_.get());
 
   // Assemble to backend machine code.
+  function->set_baseline(baseline);
   if (!assembler_->Assemble(function, builder_.get(), debug_info_flags,
                             std::move(debug_info))) {
     return false;
   }
 
+  if (collect_statistics) {
+    statistics.guest_address = function->address();
+    statistics.guest_end_address = function->end_address();
+    statistics.name = function->name();
+    statistics.baseline = baseline;
+    statistics.code_size = uint32_t(function->machine_code_length());
+    statistics.hir_bytes = uint32_t(builder_->arena()->CalculateSize());
+    statistics.hir_reserved_bytes =
+        uint32_t(builder_->arena()->reserved_size());
+    CompilerStatistics::Record(std::move(statistics));
+  }
+
   return true;
 }
 void PPCTranslator::Reset() { builder_->ResetPools(); }
@@ -0,0 +1,34 @@
+test_byte_swap_1:
+  #_ MEMORY_IN 10001000 11 22 33 44 55 66 77 88
+  #_ REGISTER_IN r4 0x10001000
+  lwz r5, 0(r4)
+  ori r5, r5, 0x80
+  andis. r6, r5, 0xFF00
+  xoris r5, r5, 0x0100
+  stw r5, 4(r4)
+  blr
+  #_ REGISTER_OUT r4 0x10001000
+  #_ REGISTER_OUT r5 0x102233C4
+  #_ REGISTER_OUT r6 0x11000000
+  #_ MEMORY_OUT 10001000 11223344 102233C4
+
+test_byte_swap_2:
+  #_ MEMORY_IN 10001000 00 00 12 34 00 00 56 78
+  #_ REGISTER_IN r4 0x10001000
+  li r5, 0
+  li r6, 0
+  lwz r7, 0(r4)
+  cmpwi r7, 0x1234
+  bne byte_swap_2_skip
+  li r5, 1
+  lwz r8, 4(r4)
+  cmplwi r8, 0x1234
+  beq byte_swap_2_skip
+  li r6, 1
+byte_swap_2_skip:
+  blr
+  #_ REGISTER_OUT r4 0x10001000
+  #_ REGISTER_OUT r5 1
+  #_ REGISTER_OUT r6 1
+  #_ REGISTER_OUT r7 0x1234
+  #_ REGISTER_OUT r8 0x5678
@@ -0,0 +1,41 @@
+test_stack_slots_1:
+  #_ REGISTER_IN r3 0x1234
+  #_ REGISTER_IN r4 0x5678
+  stwu r1, -32(r1)
+  stw r3, 8(r1)
+  std r4, 16(r1)
+  cmpwi r3, 0
+  beq stack_slots_1_skip
+  lwz r5, 8(r1)
+  ld r6, 16(r1)
+  addi r5, r5, 1
+  stw r5, 8(r1)
+stack_slots_1_skip:
+  lwz r7, 8(r1)
+  addi r1, r1, 32
+  blr
+  #_ REGISTER_OUT r3 0x1234
+  #_ REGISTER_OUT r4 0x5678
+  #_ REGISTER_OUT r5 0x1235
+  #_ REGISTER_OUT r6 0x5678
+  #_ REGISTER_OUT r7 0x1235
+
+test_stack_slots_2:
+  #_ REGISTER_IN r3 0x11223344
+  stwu r1, -16(r1)
+  stw r3, 8(r1)
+  lbz r4, 8(r1)
+  lhz r5, 10(r1)
+  addi r1, r1, 16
+  blr
+  #_ REGISTER_OUT r3 0x11223344
+  #_ REGISTER_OUT r4 0x11
+  #_ REGISTER_OUT r5 0x3344
+
+test_stack_slots_3:
+  stwu r1, -16(r1)
+  lwz r4, 0(r1)
+  subf r5, r4, r1
+  addi r1, r1, 16
+  blr
+  #_ REGISTER_OUT r5 0xfffffffffffffff0
@@ -0,0 +1,57 @@
+test_vectorize_loop_1:
+  #_ MEMORY_IN 10001000 3F800000 40000000 40400000 40800000 40A00000 40C00000 40E00000
+  #_ REGISTER_IN r4 0x10000FFC
+  #_ REGISTER_IN r5 0x10001FFC
+  #_ REGISTER_IN f1 2.0
+  #_ REGISTER_IN f4 1.0
+  li r6, 7
+  mtctr r6
+vectorize_loop_1_loop:
+  lfsu f2, 4(r4)
+  fmuls f2, f2, f1
+  fsubs f3, f2, f4
+  stfsu f3, 4(r5)
+  bdnz vectorize_loop_1_loop
+  blr
+  #_ REGISTER_OUT r4 0x10001018
+  #_ REGISTER_OUT r5 0x10002018
+  #_ REGISTER_OUT f2 14.0
+  #_ REGISTER_OUT f3 13.0
+  #_ MEMORY_OUT 10002000 3F800000 40400000 40A00000 40E00000 41100000 41300000 41500000
+
+# Overlapping source and destination, must stay scalar.
+test_vectorize_loop_2:
+  #_ MEMORY_IN 10001000 3F800000 41100000 41100000 41100000 41100000 41100000
+  #_ REGISTER_IN r4 0x10001000
+  #_ REGISTER_IN r5 0x10001004
+  #_ REGISTER_IN f1 1.0
+  li r6, 5
+  mtctr r6
+vectorize_loop_2_loop:
+  lfs f2, 0(r4)
+  fadds f2, f2, f1
+  stfs f2, 0(r5)
+  addi r4, r4, 4
+  addi r5, r5, 4
+  bdnz vectorize_loop_2_loop
+  blr
+  #_ REGISTER_OUT r4 0x10001014
+  #_ REGISTER_OUT r5 0x10001018
+  #_ REGISTER_OUT f2 6.0
+  #_ MEMORY_OUT 10001000 3F800000 40000000 40400000 40800000 40A00000 40C00000
+
+test_vectorize_loop_3:
+  #_ MEMORY_IN 10001000 3F800000 C0000000 40400000 C0800000 40A00000 C0C00000
+  #_ REGISTER_IN r4 0x10001000
+  li r6, 6
+  mtctr r6
+vectorize_loop_3_loop:
+  lfs f1, 0(r4)
+  fnabs f1, f1
+  stfs f1, 0(r4)
+  addi r4, r4, 4
+  bdnz vectorize_loop_3_loop
+  blr
+  #_ REGISTER_OUT r4 0x10001018
+  #_ REGISTER_OUT f1 -6.0
+  #_ MEMORY_OUT 10001000 BF800000 C0000000 C0400000 C0800000 C0A00000 C0C00000
@@ -23,6 +23,7 @@ project("xenia-cpu")
 
 include("testing")
 include("ppc/testing")
+include("testing/benchmark")
 filter({"configurations:Release", "platforms:Windows"})
 buildoptions({
   "/Os",
@@ -9,10 +9,15 @@
 
 #include "xenia/cpu/processor.h"
 
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+
 #include "xenia/base/assert.h"
 #include "xenia/base/atomic.h"
 #include "xenia/base/byte_order.h"
 #include "xenia/base/byte_stream.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/debugging.h"
 #include "xenia/base/exception_handler.h"
@@ -23,8 +28,10 @@
 #include "xenia/base/profiling.h"
 #include "xenia/base/threading.h"
 #include "xenia/cpu/breakpoint.h"
+#include "xenia/cpu/compiler/compiler_statistics.h"
 #include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/export_resolver.h"
+#include "xenia/cpu/guest_sampler.h"
 #include "xenia/cpu/module.h"
 #include "xenia/cpu/ppc/ppc_decode_data.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
@@ -46,8 +53,30 @@ DEFINE_bool(debug, DEFAULT_DEBUG_FLAG,
             "Allow debugging and retain debug information.", "General");
 DEFINE_path(trace_function_data_path, "", "File to write trace data to.",
             "CPU");
+DEFINE_path(trace_function_calls_path, "",
+            "File to record the calls and returns of all guest functions to, "
+            "for tools/function-trace/function_trace.py. Disables the "
+            "persistent code cache.",
+            "CPU");
+DEFINE_path(guest_sampling_profile_path, "",
+            "File to write the stacks of the guest threads sampled "
+            "periodically to at exit, as folded stacks for flame graph tools "
+            "such as flamegraph.pl or speedscope.",
+            "CPU");
+DEFINE_int32(guest_sampling_interval_ms, 1,
+             "Interval between the samples of guest_sampling_profile_path, in "
+             "milliseconds.",
+             "CPU");
 DEFINE_bool(break_on_start, false, "Break into the debugger on startup.",
             "CPU");
+DEFINE_int32(
+    precompilation_threads, -1,
+    "Number of threads used for ahead-of-time translation of guest functions "
+    "(such as with enable_early_precompilation). -1 to calculate automatically "
+    "(75% of logical CPU cores), a positive number to specify the number of "
+    "threads explicitly (up to the number of logical CPU cores), 0 to "
+    "translate on the thread requesting precompilation.",
+    "CPU");
 
 namespace xe {
 namespace kernel {
@@ -86,6 +115,11 @@ Processor::Processor(xe::Memory* memory, ExportResolver* export_resolver)
     : memory_(memory), export_resolver_(export_resolver) {}
 
 Processor::~Processor() {
+  // The precompilation threads may be translating functions of the modules.
+  ShutdownPrecompilationThreads();
+  // Resolves the stacks to the functions of the modules.
+  guest_sampler_.reset();
+
   {
     auto global_lock = global_critical_region_.Acquire();
     modules_.clear();
@@ -94,10 +128,15 @@ Processor::~Processor() {
   frontend_.reset();
   backend_.reset();
 
+  if (compiler::CompilerStatistics::enabled()) {
+    compiler::CompilerStatistics::Dump(cvars::jit_statistics_path);
+  }
+
   if (functions_trace_file_) {
     functions_trace_file_->Flush();
     functions_trace_file_.reset();
   }
+  function_call_tracer_.reset();
 }
 
 bool Processor::Setup(std::unique_ptr<backend::Backend> backend) {
@@ -153,6 +192,15 @@ bool Processor::Setup(std::unique_ptr<backend::Backend> backend) {
     functions_trace_file_ =
         ChunkedMappedMemoryWriter::Open(functions_trace_path_, 32_MiB, true);
   }
+  if (!cvars::trace_function_calls_path.empty()) {
+    function_call_tracer_ =
+        FunctionCallTracer::Create(cvars::trace_function_calls_path);
+  }
+  if (!cvars::guest_sampling_profile_path.empty() && stack_walker_) {
+    guest_sampler_ = GuestSampler::Create(
+        this, cvars::guest_sampling_profile_path,
+        std::chrono::milliseconds(cvars::guest_sampling_interval_ms));
+  }
 
   return true;
 }
@@ -176,6 +224,10 @@ bool Processor::AddModule(std::unique_ptr<Module> module) {
 }
 
 void Processor::RemoveModule(const std::string_view name) {
+  // Translation of the functions of the module may be in progress, and the
+  // precompilation threads take the global lock themselves.
+  CancelPrecompilation();
+
   auto global_lock = global_critical_region_.Acquire();
 
   auto itr =
@@ -188,14 +240,140 @@ void Processor::RemoveModule(const std::string_view name) {
     const std::vector<uint32_t> addressed_functions =
         (*itr)->GetAddressedFunctions();
 
-    modules_.erase(itr);
-
+    // The backend still looks at the functions while retiring their code, so
+    // remove them before they're destroyed with the module.
     for (const uint32_t entry : addressed_functions) {
       RemoveFunctionByAddress(entry);
     }
+
+    modules_.erase(itr);
+
+    if (cvars::reclaim_removed_code) {
+      ReclaimRetiredCode();
+    }
   }
 }
 
+void Processor::ReclaimRetiredCode() {
+  if (!backend_ || !stack_walker_ || !backend_->retired_code_size()) {
+    return;
+  }
+  auto global_lock = global_critical_region_.Acquire();
+
+  // Everything that may be allocated is allocated before suspending, as the
+  // suspended threads may be holding the heap lock. Every thread contributes
+  // its frames, rip and the general-purpose registers.
+  constexpr size_t kMaxFrames = 256;
+  std::vector<uint64_t> live_addresses;
+  live_addresses.reserve((thread_debug_infos_.size() + 1) *
+                         (kMaxFrames + 1 + 16));
+  std::vector<Thread*> suspended_threads;
+  suspended_threads.reserve(thread_debug_infos_.size());
+
+  // Host threads may be calling into guest code as well, so they're suspended
+  // too, unlike for the debugger.
+  bool complete = true;
+  uint64_t frame_host_pcs[kMaxFrames];
+  for (auto& it : thread_debug_infos_) {
+    auto thread_info = it.second.get();
+    auto thread = thread_info->thread;
+    if (!thread || thread_info->state == ThreadDebugInfo::State::kZombie ||
+        thread_info->state == ThreadDebugInfo::State::kExited ||
+        (Thread::IsInThread() &&
+         thread_info->thread_id == Thread::GetCurrentThreadId())) {
+      continue;
+    }
+    if (!thread_info->suspended) {
+      if (!thread->thread()->Suspend(nullptr)) {
+        complete = false;
+        break;
+      }
+      suspended_threads.push_back(thread);
+    }
+    HostThreadContext host_context;
+    size_t count = stack_walker_->CaptureStackTrace(
+        thread->thread()->native_handle(), frame_host_pcs, 0, kMaxFrames,
+        nullptr, &host_context);
+    if (!count || count >= kMaxFrames) {
+      // The stack may point into code beyond what could be walked.
+      complete = false;
+      break;
+    }
+    live_addresses.insert(live_addresses.end(), frame_host_pcs,
+                          frame_host_pcs + count);
+    live_addresses.push_back(host_context.rip);
+    live_addresses.insert(live_addresses.end(),
+                          std::begin(host_context.int_registers),
+                          std::end(host_context.int_registers));
+  }
+  if (complete) {
+    size_t count =
+        stack_walker_->CaptureStackTrace(frame_host_pcs, 0, kMaxFrames);
+    if (count && count < kMaxFrames) {
+      live_addresses.insert(live_addresses.end(), frame_host_pcs,
+                            frame_host_pcs + count);
+    } else {
+      complete = false;
+    }
+  }
+
+  for (Thread* thread : suspended_threads) {
+    bool did_resume = thread->thread()->Resume();
+    assert_true(did_resume);
+  }
+
+  // Retired code can't be entered anymore, so code that no thread was in
+  // while they were suspended stays unused after they're resumed.
+  if (complete) {
+    backend_->ReclaimRetiredCode(std::move(live_addresses));
+  }
+}
+
+void Processor::CaptureThreadStacks(std::vector<ThreadStackSample>& samples) {
+  constexpr size_t kMaxFrames = 128;
+  if (!stack_walker_) {
+    samples.clear();
+    return;
+  }
+  auto global_lock = global_critical_region_.Acquire();
+
+  // The buffers are allocated before suspending, as the suspended thread may
+  // be holding the heap lock, and each thread is only suspended for as long
+  // as its stack is walked to keep the distortion low.
+  size_t sample_count = 0;
+  if (samples.size() < thread_debug_infos_.size()) {
+    samples.resize(thread_debug_infos_.size());
+  }
+  for (auto& it : thread_debug_infos_) {
+    auto thread_info = it.second.get();
+    auto thread = thread_info->thread;
+    if (!thread || thread_info->suspended ||
+        thread_info->state == ThreadDebugInfo::State::kZombie ||
+        thread_info->state == ThreadDebugInfo::State::kExited ||
+        (Thread::IsInThread() &&
+         thread_info->thread_id == Thread::GetCurrentThreadId())) {
+      continue;
+    }
+    ThreadStackSample& sample = samples[sample_count];
+    sample.thread_id = thread_info->thread_id;
+    sample.frame_host_pcs.resize(kMaxFrames);
+    if (!thread->thread()->Suspend(nullptr)) {
+      continue;
+    }
+    HostThreadContext host_context;
+    size_t count = stack_walker_->CaptureStackTrace(
+        thread->thread()->native_handle(), sample.frame_host_pcs.data(), 0,
+        kMaxFrames, nullptr, &host_context);
+    bool did_resume = thread->thread()->Resume();
+    assert_true(did_resume);
+    if (count) {
+      sample.frame_host_pcs.resize(count);
+      ++sample_count;
+    }
+  }
+  samples.resize(sample_count);
+}
+
 Module* Processor::GetModule(const std::string_view name) {
   auto global_lock = global_critical_region_.Acquire();
   for (const auto& module : modules_) {
@@ -234,6 +412,9 @@ Function* Processor::DefineBuiltin(const std::string_view name,
 }
 
 Function* Processor::QueryFunction(uint32_t address) {
+  if (Function* function = function_table_.Lookup(address)) {
+    return function;
+  }
   auto entry = entry_table_.Get(address);
   if (!entry) {
     return nullptr;
@@ -246,10 +427,30 @@ std::vector<Function*> Processor::FindFunctionsWithAddress(uint32_t address) {
 }
 
 void Processor::RemoveFunctionByAddress(uint32_t address) {
+  if (backend_) {
+    auto global_lock = global_critical_region_.Acquire();
+    Function* function = QueryFunction(address);
+    if (function) {
+      for (auto breakpoint : breakpoints_) {
+        if (breakpoint->is_installed()) {
+          backend_->UninstallBreakpoint(breakpoint, function);
+        }
+      }
+    }
+  }
+  function_table_.Remove(address);
   entry_table_.Delete(address);
+  if (backend_) {
+    backend_->OnFunctionRemoved(address);
+  }
 }
 
 Function* Processor::ResolveFunction(uint32_t address) {
+  // Already resolved functions don't need the lock of the entry table.
+  if (Function* function = function_table_.Lookup(address)) {
+    return function;
+  }
+
   Entry* entry;
   Entry::Status status = entry_table_.GetOrCreate(address, &entry);
   if (status == Entry::STATUS_NEW) {
@@ -281,6 +482,7 @@ Function* Processor::ResolveFunction(uint32_t address) {
     entry->function = function;
     entry->end_address = function->end_address();
     status = entry->status = Entry::STATUS_READY;
+    function_table_.Set(address, function);
   }
   if (status == Entry::STATUS_READY) {
     // Ready to use.
@@ -290,6 +492,154 @@ Function* Processor::ResolveFunction(uint32_t address) {
     return nullptr;
   }
 }
+
+void Processor::PrecompileFunctions(const std::vector<uint32_t>& addresses,
+                                    bool prioritize) {
+  if (addresses.empty()) {
+    return;
+  }
+  bool addresses_queued = false;
+  {
+    std::lock_guard<xe_mutex> lock(precompilation_request_lock_);
+    if (EnsurePrecompilationThreads()) {
+      if (prioritize) {
+        precompilation_queue_.insert(precompilation_queue_.cbegin(),
+                                     addresses.cbegin(), addresses.cend());
+      } else {
+        precompilation_queue_.insert(precompilation_queue_.cend(),
+                                     addresses.cbegin(), addresses.cend());
+      }
+      addresses_queued = true;
+    }
+  }
+  if (addresses_queued) {
+    precompilation_request_cond_.notify_all();
+    return;
+  }
+  for (uint32_t address : addresses) {
+    ResolveFunction(address);
+  }
+}
+
+void Processor::RecompileFunction(GuestFunction* function) {
+  {
+    std::lock_guard<xe_mutex> lock(precompilation_request_lock_);
+    if (EnsurePrecompilationThreads()) {
+      recompilation_queue_.push_back(function);
+      function = nullptr;
+    }
+  }
+  if (!function) {
+    precompilation_request_cond_.notify_one();
+    return;
+  }
+  if (!frontend_->RecompileFunction(function)) {
+    XELOGE("Failed to optimize function {:08X}", function->address());
+    return;
+  }
+  OnFunctionDefined(function);
+}
+
+bool Processor::EnsurePrecompilationThreads() {
+  if (precompilation_threads_shutdown_) {
+    return false;
+  }
+  if (precompilation_threads_.empty()) {
+    uint32_t logical_processor_count = xe::threading::logical_processor_count();
+    if (!logical_processor_count) {
+      // Pick some reasonable amount if couldn't determine the number of cores.
+      logical_processor_count = 6;
+    }
+    size_t thread_count = 0;
+    if (cvars::precompilation_threads < 0) {
+      thread_count = std::max(logical_processor_count * 3 / 4, uint32_t(1));
+    } else {
+      thread_count = std::min(uint32_t(cvars::precompilation_threads),
+                              logical_processor_count);
+    }
+    for (size_t i = 0; i < thread_count; ++i) {
+      std::unique_ptr<xe::threading::Thread> thread =
+          xe::threading::Thread::Create({},
+                                        [this]() { PrecompilationThread(); });
+      assert_not_null(thread);
+      thread->set_name("CPU Precompilation");
+      precompilation_threads_.push_back(std::move(thread));
+    }
+  }
+  return !precompilation_threads_.empty();
+}
+
+void Processor::CancelPrecompilation() {
+  std::unique_lock<xe_mutex> lock(precompilation_request_lock_);
+  precompilation_queue_.clear();
+  recompilation_queue_.clear();
+  while (precompilation_threads_busy_) {
+    precompilation_request_cond_.wait(lock);
+  }
+}
+
+void Processor::ShutdownPrecompilationThreads() {
+  {
+    std::lock_guard<xe_mutex> lock(precompilation_request_lock_);
+    precompilation_queue_.clear();
+    recompilation_queue_.clear();
+    precompilation_threads_shutdown_ = true;
+  }
+  precompilation_request_cond_.notify_all();
+  for (auto& thread : precompilation_threads_) {
+    xe::threading::Wait(thread.get(), false);
+  }
+  precompilation_threads_.clear();
+}
+
+void Processor::PrecompilationThread() {
+  while (true) {
+    uint32_t address = 0;
+    GuestFunction* function_to_optimize = nullptr;
+    {
+      std::unique_lock<xe_mutex> lock(precompilation_request_lock_);
+      if (precompilation_threads_shutdown_) {
+        return;
+      }
+      // Hot functions go first, they're already being executed.
+      if (!recompilation_queue_.empty()) {
+        function_to_optimize = recompilation_queue_.front();
+        recompilation_queue_.pop_front();
+      } else if (!precompilation_queue_.empty()) {
+        address = precompilation_queue_.front();
+        precompilation_queue_.pop_front();
+      } else {
+        precompilation_request_cond_.wait(lock);
+        continue;
+      }
+      ++precompilation_threads_busy_;
+    }
+
+    if (function_to_optimize) {
+      if (frontend_->RecompileFunction(function_to_optimize)) {
+        // Breakpoints are patched into the optimized code too.
+        OnFunctionDefined(function_to_optimize);
+      } else {
+        XELOGE("Failed to optimize function {:08X}",
+               function_to_optimize->address());
+      }
+    } else {
+      // If a guest thread has requested the function already, this either
+      // returns the existing function or waits for the thread translating it.
+      // Similarly, a guest thread needing a function still in the queue will
+      // translate it immediately by itself rather than waiting for its turn.
+      ResolveFunction(address);
+    }
+
+    {
+      std::lock_guard<xe_mutex> lock(precompilation_request_lock_);
+      --precompilation_threads_busy_;
+    }
+    // CancelPrecompilation may be waiting for the threads to become idle.
+    precompilation_request_cond_.notify_all();
+  }
+}
+
 Module* Processor::LookupModule(uint32_t address) {
   auto global_lock = global_critical_region_.Acquire();
   // TODO(benvanik): sort by code address (if contiguous) so can bsearch.
@@ -340,11 +690,16 @@ bool Processor::DemandFunction(Function* function) {
   if (symbol_status == Symbol::Status::kNew) {
     // Symbol is undefined, so define now.
     assert_true(function->is_guest());
+    uint64_t definition_start = Clock::QueryHostTickCount();
     if (!frontend_->DefineFunction(static_cast<GuestFunction*>(function),
                                    debug_info_flags_)) {
       function->set_status(Symbol::Status::kFailed);
       return false;
     }
+    function_definition_count_.fetch_add(1, std::memory_order_relaxed);
+    function_definition_host_ticks_.fetch_add(
+        Clock::QueryHostTickCount() - definition_start,
+        std::memory_order_relaxed);
 
     // Before we give the symbol back to the rest, let the debugger know.
     OnFunctionDefined(function);
@@ -361,6 +716,14 @@ bool Processor::DemandFunction(Function* function) {
   return true;
 }
 
+void Processor::GetStatistics(ProcessorStatistics& statistics_out) const {
+  statistics_out.function_definition_count =
+      function_definition_count_.load(std::memory_order_relaxed);
+  statistics_out.function_definition_microseconds =
+      function_definition_host_ticks_.load(std::memory_order_relaxed) *
+      1000000 / Clock::QueryHostTickFrequency();
+}
+
 bool Processor::Execute(ThreadState* thread_state, uint32_t address) {
   SCOPE_profile_cpu_f("cpu");
 
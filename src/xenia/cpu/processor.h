@@ -10,6 +10,9 @@
 #ifndef XENIA_CPU_PROCESSOR_H_
 #define XENIA_CPU_PROCESSOR_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <map>
 #include <memory>
 #include <string>
@@ -18,11 +21,14 @@
 #include "xenia/base/cvar.h"
 #include "xenia/base/mapped_memory.h"
 #include "xenia/base/mutex.h"
+#include "xenia/base/threading.h"
 #include "xenia/cpu/backend/backend.h"
 #include "xenia/cpu/debug_listener.h"
 #include "xenia/cpu/entry_table.h"
 #include "xenia/cpu/export_resolver.h"
 #include "xenia/cpu/function.h"
+#include "xenia/cpu/function_call_tracer.h"
+#include "xenia/cpu/function_table.h"
 #include "xenia/cpu/module.h"
 #include "xenia/cpu/ppc/ppc_frontend.h"
 #include "xenia/cpu/thread_debug_info.h"
@@ -37,6 +43,7 @@ namespace cpu {
 constexpr fourcc_t kProcessorSaveSignature = make_fourcc("PROC");
 
 class Breakpoint;
+class GuestSampler;
 class StackWalker;
 class XexModule;
 
@@ -61,6 +68,14 @@ enum class ExecutionState {
   kEnded,
 };
 
+// Counters for benchmarking, sampled without synchronization between them.
+struct ProcessorStatistics {
+  // Guest functions translated on demand or precompiled, and the host time
+  // spent translating them.
+  uint64_t function_definition_count;
+  uint64_t function_definition_microseconds;
+};
+
 class Processor {
  public:
   Processor(Memory* memory, ExportResolver* export_resolver);
@@ -119,6 +134,22 @@ class Processor {
   Function* LookupFunction(Module* module, uint32_t address);
   Function* ResolveFunction(uint32_t address);
 
+  // Translates the functions at the addresses on the precompilation threads in
+  // the background, or on the calling thread if precompilation threads are
+  // disabled. Functions the guest requests before their turn comes are
+  // translated immediately on the requesting thread. Prioritized addresses are
+  // placed in the front of the queue.
+  void PrecompileFunctions(const std::vector<uint32_t>& addresses,
+                           bool prioritize = false);
+  // Translates a function translated with the baseline pass set again with
+  // all optimizations, on the precompilation threads if they're enabled.
+  void RecompileFunction(GuestFunction* function);
+  // Drops the functions not translated yet and waits for the ones currently
+  // being translated.
+  void CancelPrecompilation();
+
+  void GetStatistics(ProcessorStatistics& statistics_out) const;
+
   bool Execute(ThreadState* thread_state, uint32_t address);
   bool ExecuteRaw(ThreadState* thread_state, uint32_t address);
   uint64_t Execute(ThreadState* thread_state, uint32_t address, uint64_t args[],
@@ -210,11 +241,29 @@ class Processor {
   bool OnThreadBreakpointHit(Exception* ex);
 
   uint8_t* AllocateFunctionTraceData(size_t size);
+  // Null unless trace_function_calls_path is set.
+  FunctionCallTracer* function_call_tracer() const {
+    return function_call_tracer_.get();
+  }
+
+  struct ThreadStackSample {
+    uint32_t thread_id;
+    // Innermost first.
+    std::vector<uint64_t> frame_host_pcs;
+  };
+  // Suspends the threads one at a time to capture their host stacks, for
+  // sampling profilers. Threads suspended by the debugger are skipped.
+  void CaptureThreadStacks(std::vector<ThreadStackSample>& samples);
 
  private:
   // Synchronously demands a debug listener.
   void DemandDebugListener();
 
+  // Reuses the code cache memory of removed functions that no thread is
+  // executing, with all the other threads suspended while their stacks are
+  // scanned.
+  void ReclaimRetiredCode();
+
   // Suspends all known threads (except the caller).
   bool SuspendAllThreads();
   // Resumes the given thread.
@@ -249,6 +298,12 @@ class Processor {
 
   bool DemandFunction(Function* function);
 
+  // Called with precompilation_request_lock_ held, returns false if
+  // translation must be done on the calling thread.
+  bool EnsurePrecompilationThreads();
+  void ShutdownPrecompilationThreads();
+  void PrecompilationThread();
+
   Memory* memory_ = nullptr;
   std::unique_ptr<StackWalker> stack_walker_;
 
@@ -260,12 +315,20 @@ class Processor {
   // If specified, the file trace data gets written to when running.
   std::filesystem::path functions_trace_path_;
   std::unique_ptr<ChunkedMappedMemoryWriter> functions_trace_file_;
+  std::unique_ptr<FunctionCallTracer> function_call_tracer_;
+  std::unique_ptr<GuestSampler> guest_sampler_;
+
+  std::atomic<uint64_t> function_definition_count_{0};
+  std::atomic<uint64_t> function_definition_host_ticks_{0};
 
   std::unique_ptr<ppc::PPCFrontend> frontend_;
   std::unique_ptr<backend::Backend> backend_;
   ExportResolver* export_resolver_ = nullptr;
 
   EntryTable entry_table_;
+  // Functions in the ready entries of entry_table_, for lookups without the
+  // lock of the table.
+  FunctionTable function_table_;
   xe::global_critical_region global_critical_region_;
   ExecutionState execution_state_ = ExecutionState::kPaused;
   std::vector<std::unique_ptr<Module>> modules_;
@@ -279,6 +342,25 @@ class Processor {
   // TODO(benvanik): cleanup/change structures.
   std::vector<Breakpoint*> breakpoints_;
 
+  // Translation itself is synchronized by the entry table, only code placement
+  // is serialized within the code cache.
+  xe_mutex precompilation_request_lock_;
+  // Notified when addresses are queued, on shutdown, and when a thread becomes
+  // idle.
+  std::condition_variable_any precompilation_request_cond_;
+  // Protected with precompilation_request_lock_.
+  std::deque<uint32_t> precompilation_queue_;
+  // Baseline functions to optimize. Protected with
+  // precompilation_request_lock_.
+  std::deque<GuestFunction*> recompilation_queue_;
+  // Number of threads translating a function currently. Protected with
+  // precompilation_request_lock_.
+  size_t precompilation_threads_busy_ = 0;
+  // Protected with precompilation_request_lock_.
+  bool precompilation_threads_shutdown_ = false;
+  // Created on the first PrecompileFunctions call.
+  std::vector<std::unique_ptr<xe::threading::Thread>> precompilation_threads_;
+
   Irql irql_;
 };
 
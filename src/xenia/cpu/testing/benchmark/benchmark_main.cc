@@ -0,0 +1,482 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/console_app_main.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/literals.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+#include "xenia/base/platform.h"
+#include "xenia/base/utf8.h"
+#include "xenia/cpu/cpu_flags.h"
+#include "xenia/cpu/ppc/ppc_context.h"
+#include "xenia/cpu/processor.h"
+#include "xenia/cpu/raw_module.h"
+#include "xenia/memory.h"
+
+#if XE_ARCH_AMD64
+#include "xenia/base/platform_amd64.h"
+#include "xenia/cpu/backend/x64/x64_backend.h"
+#endif  // XE_ARCH
+
+DEFINE_transient_string(benchmark_name, "",
+                        "Only run the benchmark with this name.", "General");
+DEFINE_string(benchmark_extension_masks, "0,-1",
+              "Comma-separated x64_extension_mask values to compare every "
+              "benchmark with.",
+              "Other");
+DEFINE_uint32(benchmark_iterations, 1000000,
+              "Loop iterations of a benchmark in one measurement.", "Other");
+DEFINE_uint32(benchmark_repeat, 5,
+              "Measurements of every benchmark, the fastest one is reported.",
+              "Other");
+DEFINE_path(benchmark_output_path, "",
+            "CSV file to write the results to, to be used as the baseline of "
+            "later runs.",
+            "Other");
+DEFINE_path(benchmark_baseline_path, "",
+            "CSV file written by an earlier run. The run fails if the code of "
+            "any benchmark got larger than in it.",
+            "Other");
+DEFINE_double(benchmark_time_tolerance, 0.0,
+              "When comparing with the baseline, also fail if a benchmark got "
+              "slower by more than this fraction (0 to only compare code "
+              "sizes, as timings are noisy on shared machines).",
+              "Other");
+
+namespace xe {
+namespace cpu {
+namespace benchmark {
+
+using xe::cpu::ppc::PPCContext;
+using namespace xe::literals;
+
+constexpr uint32_t kCodeAddress = 0x80000000;
+// Every snippet gets its own guest function at this distance.
+constexpr uint32_t kSnippetStride = 0x1000;
+constexpr uint32_t kDataAddress = 0x10000000;
+constexpr uint32_t kDataSize = 64_KiB;
+
+// Instruction encoders, named after the instruction forms.
+constexpr uint32_t D(uint32_t op, uint32_t d, uint32_t a, int32_t imm) {
+  return (op << 26) | (d << 21) | (a << 16) | (uint32_t(imm) & 0xFFFF);
+}
+constexpr uint32_t X(uint32_t op, uint32_t d, uint32_t a, uint32_t b,
+                     uint32_t xo, uint32_t rc = 0) {
+  return (op << 26) | (d << 21) | (a << 16) | (b << 11) | (xo << 1) | rc;
+}
+constexpr uint32_t A(uint32_t d, uint32_t a, uint32_t b, uint32_t c,
+                     uint32_t xo) {
+  return (63 << 26) | (d << 21) | (a << 16) | (b << 11) | (c << 6) | (xo << 1);
+}
+constexpr uint32_t VX(uint32_t d, uint32_t a, uint32_t b, uint32_t xo) {
+  return (4 << 26) | (d << 21) | (a << 16) | (b << 11) | xo;
+}
+constexpr uint32_t VA(uint32_t d, uint32_t a, uint32_t b, uint32_t c,
+                      uint32_t xo) {
+  return (4 << 26) | (d << 21) | (a << 16) | (b << 11) | (c << 6) | xo;
+}
+constexpr uint32_t M(uint32_t s, uint32_t a, uint32_t sh, uint32_t mb,
+                     uint32_t me, uint32_t rc) {
+  return (21 << 26) | (s << 21) | (a << 16) | (sh << 11) | (mb << 6) |
+         (me << 1) | rc;
+}
+constexpr uint32_t BC(uint32_t bo, uint32_t bi, int32_t bd) {
+  return (16 << 26) | (bo << 21) | (bi << 16) | (uint32_t(bd) & 0xFFFC);
+}
+constexpr uint32_t B(int32_t li) {
+  return (18 << 26) | (uint32_t(li) & 0x03FFFFFC);
+}
+constexpr uint32_t kBlr = 0x4E800020;
+
+struct Snippet {
+  const char* name;
+  // Loop body, followed by bdnz back to its start and blr when placed.
+  std::vector<uint32_t> body;
+  void (*setup)(PPCContext* ctx);
+};
+
+// Kept small so iterations are dominated by the emitted sequences rather than
+// by the loop overhead, but with dependency chains like in real game code.
+const Snippet kSnippets[] = {
+    {"vmx_math",
+     {
+         VA(3, 1, 3, 2, 46),  // vmaddfp v3, v1, v2, v3
+         VX(4, 3, 1, 10),     // vaddfp v4, v3, v1
+         VX(5, 4, 2, 74),     // vsubfp v5, v4, v2
+         VX(3, 5, 3, 1034),   // vmaxfp v3, v5, v3
+         VX(6, 6, 3, 1220),   // vxor v6, v6, v3
+         VA(7, 6, 3, 8, 43),  // vperm v7, v6, v3, v8
+     },
+     [](PPCContext* ctx) {
+       ctx->v[1] = vec128f(1.0f, 0.5f, 0.25f, 2.0f);
+       ctx->v[2] = vec128f(0.5f);
+       ctx->v[3] = vec128f(0.0f);
+       ctx->v[6] = vec128f(0.0f);
+       ctx->v[8] = vec128i(0x1F0E1D0C, 0x1B0A1908, 0x17061504, 0x13021100);
+     }},
+    {"fpu",
+     {
+         A(3, 1, 3, 2, 29),  // fmadd f3, f1, f2, f3
+         A(4, 3, 1, 0, 21),  // fadd f4, f3, f1
+         A(5, 4, 0, 2, 25),  // fmul f5, f4, f2
+         A(6, 5, 1, 0, 20),  // fsub f6, f5, f1
+         A(7, 6, 2, 0, 18),  // fdiv f7, f6, f2
+     },
+     [](PPCContext* ctx) {
+       ctx->f[1] = 1.5;
+       ctx->f[2] = 0.75;
+       ctx->f[3] = 0.0;
+     }},
+    {"fused_multiply_add",
+     {
+         A(3, 1, 3, 2, 29),   // fmadd f3, f1, f2, f3
+         A(4, 3, 1, 2, 28),   // fmsub f4, f3, f2, f1
+         A(5, 4, 3, 1, 31),   // fnmadd f5, f4, f1, f3
+         A(3, 5, 4, 2, 30),   // fnmsub f3, f5, f2, f4
+         VA(3, 1, 3, 2, 46),  // vmaddfp v3, v1, v2, v3
+         VA(4, 3, 1, 2, 47),  // vnmsubfp v4, v3, v2, v1
+         VA(3, 4, 3, 1, 46),  // vmaddfp v3, v4, v1, v3
+     },
+     [](PPCContext* ctx) {
+       // Converging, so no infinities or denormals are reached.
+       ctx->f[1] = 0.5;
+       ctx->f[2] = 0.25;
+       ctx->f[3] = 0.0;
+       ctx->v[1] = vec128f(0.5f);
+       ctx->v[2] = vec128f(0.25f);
+       ctx->v[3] = vec128f(0.0f);
+     }},
+    {"load_store_byteswap",
+     {
+         D(32, 5, 3, 0),        // lwz r5, 0(r3)
+         X(31, 6, 3, 4, 534),   // lwbrx r6, r3, r4
+         X(31, 5, 5, 6, 266),   // add r5, r5, r6
+         D(36, 5, 3, 8),        // stw r5, 8(r3)
+         X(31, 6, 3, 7, 662),   // stwbrx r6, r3, r7
+         D(40, 8, 3, 16),       // lhz r8, 16(r3)
+         D(44, 8, 3, 18),       // sth r8, 18(r3)
+         D(50, 1, 3, 24),       // lfd f1, 24(r3)
+         D(54, 1, 3, 32),       // stfd f1, 32(r3)
+         X(31, 1, 3, 9, 103),   // lvx v1, r3, r9
+         X(31, 1, 3, 10, 231),  // stvx v1, r3, r10
+     },
+     [](PPCContext* ctx) {
+       ctx->r[3] = kDataAddress;
+       ctx->r[4] = 4;
+       ctx->r[7] = 12;
+       ctx->r[9] = 48;
+       ctx->r[10] = 64;
+     }},
+    {"cr_branches",
+     {
+         M(5, 7, 0, 31, 31, 1),   // rlwinm. r7, r5, 0, 31, 31
+         BC(12, 2, 12),           // beq cr0, +12
+         D(14, 6, 6, 3),          // addi r6, r6, 3
+         B(8),                    // b +8
+         D(14, 6, 6, -1),         // addi r6, r6, -1
+         X(31, 1 << 2, 6, 8, 0),  // cmpw cr1, r6, r8
+         X(19, 2, 5, 4, 257),     // crand 4*cr0+eq, 4*cr1+gt, 4*cr1+lt
+         X(19, 3, 2, 6, 193),     // crxor 4*cr0+so, 4*cr0+eq, 4*cr1+eq
+         X(31, 9, 0, 0, 19),      // mfcr r9
+         BC(4, 6, 8),             // bne cr1, +8
+         X(31, 6, 6, 9, 316),     // xor r6, r6, r9
+         D(14, 5, 5, 1),          // addi r5, r5, 1
+     },
+     [](PPCContext* ctx) {
+       ctx->r[5] = 0;
+       ctx->r[6] = 0;
+       ctx->r[8] = 1000;
+     }},
+};
+
+struct Result {
+  double ns_per_iteration;
+  size_t code_size;
+};
+// (snippet name, extension mask) to the result.
+using ResultMap = std::map<std::pair<std::string, int64_t>, Result>;
+
+class BenchmarkRunner {
+ public:
+  ~BenchmarkRunner() {
+    thread_state_.reset();
+    processor_.reset();
+    memory_.reset();
+  }
+
+  bool Setup() {
+    memory_ = std::make_unique<Memory>();
+    if (!memory_->Initialize()) {
+      XELOGE("Unable to initialize guest memory");
+      return false;
+    }
+
+    std::unique_ptr<xe::cpu::backend::Backend> backend;
+#if XE_ARCH_AMD64
+    backend.reset(new xe::cpu::backend::x64::X64Backend());
+#endif  // XE_ARCH
+    if (!backend) {
+      XELOGE("No JIT backend for this architecture");
+      return false;
+    }
+
+    processor_ = std::make_unique<Processor>(memory_.get(), nullptr);
+    if (!processor_->Setup(std::move(backend))) {
+      XELOGE("Unable to set up the processor");
+      return false;
+    }
+
+    // Place all snippets as one module.
+    uint32_t code_size = uint32_t(xe::countof(kSnippets)) * kSnippetStride;
+    auto code_heap = memory_->LookupHeap(kCodeAddress);
+    if (!code_heap ||
+        !code_heap->AllocFixed(
+            kCodeAddress, code_size, 0,
+            kMemoryAllocationReserve | kMemoryAllocationCommit,
+            kMemoryProtectRead | kMemoryProtectWrite)) {
+      XELOGE("Unable to allocate guest code memory");
+      return false;
+    }
+    for (size_t i = 0; i < xe::countof(kSnippets); ++i) {
+      const Snippet& snippet = kSnippets[i];
+      auto p = memory_->TranslateVirtual<uint32_t*>(
+          kCodeAddress + uint32_t(i) * kSnippetStride);
+      for (uint32_t instr : snippet.body) {
+        xe::store_and_swap<uint32_t>(p++, instr);
+      }
+      // bdnz to the start of the body.
+      xe::store_and_swap<uint32_t>(
+          p++, BC(16, 0, -int32_t(snippet.body.size() * 4)));
+      xe::store_and_swap<uint32_t>(p++, kBlr);
+    }
+    auto module = std::make_unique<xe::cpu::RawModule>(processor_.get());
+    module->set_name("benchmarks");
+    module->SetAddressRange(kCodeAddress, code_size);
+    processor_->AddModule(std::move(module));
+
+    auto data_heap = memory_->LookupHeap(kDataAddress);
+    if (!data_heap ||
+        !data_heap->AllocFixed(
+            kDataAddress, kDataSize, 0,
+            kMemoryAllocationReserve | kMemoryAllocationCommit,
+            kMemoryProtectRead | kMemoryProtectWrite)) {
+      XELOGE("Unable to allocate guest data memory");
+      return false;
+    }
+
+    uint32_t stack_size = 64 * 1024;
+    uint32_t stack_address = kCodeAddress - stack_size;
+    uint32_t pcr_address = stack_address - 0x1000;
+    thread_state_ = std::make_unique<ThreadState>(processor_.get(), 0x100,
+                                                  stack_address, pcr_address);
+    return true;
+  }
+
+  bool Run(size_t index, Result* out_result) {
+    const Snippet& snippet = kSnippets[index];
+    auto fn = processor_->ResolveFunction(kCodeAddress +
+                                          uint32_t(index) * kSnippetStride);
+    if (!fn || !fn->is_guest()) {
+      XELOGE("Unable to translate benchmark {}", snippet.name);
+      return false;
+    }
+
+    // Translated already, so this only warms up the host caches.
+    Call(fn, snippet, 1000);
+
+    uint64_t best_ticks = UINT64_MAX;
+    for (uint32_t i = 0; i < std::max(cvars::benchmark_repeat, 1u); ++i) {
+      uint64_t start = Clock::QueryHostTickCount();
+      Call(fn, snippet, cvars::benchmark_iterations);
+      best_ticks = std::min(best_ticks, Clock::QueryHostTickCount() - start);
+    }
+
+    out_result->ns_per_iteration =
+        double(best_ticks) * 1000000000.0 /
+        double(Clock::QueryHostTickFrequency()) /
+        double(std::max(cvars::benchmark_iterations, 1u));
+    out_result->code_size =
+        static_cast<GuestFunction*>(fn)->machine_code_length();
+    return true;
+  }
+
+ private:
+  void Call(Function* fn, const Snippet& snippet, uint32_t iterations) {
+    auto ctx = thread_state_->context();
+    snippet.setup(ctx);
+    std::memset(memory_->TranslateVirtual(kDataAddress), 0, kDataSize);
+    ctx->ctr = std::max(iterations, 1u);
+    ctx->lr = 0xBCBCBCBC;
+    fn->Call(thread_state_.get(), uint32_t(ctx->lr));
+  }
+
+  std::unique_ptr<Memory> memory_;
+  std::unique_ptr<Processor> processor_;
+  std::unique_ptr<ThreadState> thread_state_;
+};
+
+bool WriteResults(const std::filesystem::path& path,
+                  const ResultMap& results) {
+  FILE* file = xe::filesystem::OpenFile(path, "w");
+  if (!file) {
+    XELOGE("Unable to open {} for writing", xe::path_to_utf8(path));
+    return false;
+  }
+  fputs("name,extension_mask,ns_per_iteration,code_size\n", file);
+  for (auto& it : results) {
+    fprintf(file, "%s,%lld,%.4f,%zu\n", it.first.first.c_str(),
+            static_cast<long long>(it.first.second),
+            it.second.ns_per_iteration, it.second.code_size);
+  }
+  fclose(file);
+  return true;
+}
+
+bool ReadResults(const std::filesystem::path& path, ResultMap& results) {
+  FILE* file = xe::filesystem::OpenFile(path, "r");
+  if (!file) {
+    return false;
+  }
+  char line_buffer[BUFSIZ];
+  while (fgets(line_buffer, sizeof(line_buffer), file)) {
+    auto parts = xe::utf8::split(line_buffer, ",\r\n", true);
+    if (parts.size() != 4 || parts[0] == "name") {
+      continue;
+    }
+    Result result;
+    result.ns_per_iteration = std::strtod(std::string(parts[2]).c_str(), 0);
+    result.code_size = std::strtoull(std::string(parts[3]).c_str(), 0, 10);
+    results[{std::string(parts[0]),
+             std::strtoll(std::string(parts[1]).c_str(), 0, 10)}] = result;
+  }
+  fclose(file);
+  return true;
+}
+
+// Returns the number of regressions relative to the baseline.
+int CompareResults(const ResultMap& results, const ResultMap& baseline) {
+  int regression_count = 0;
+  for (auto& it : results) {
+    auto baseline_it = baseline.find(it.first);
+    if (baseline_it == baseline.end()) {
+      continue;
+    }
+    const Result& result = it.second;
+    const Result& old_result = baseline_it->second;
+    if (result.code_size > old_result.code_size) {
+      XELOGE("{} (mask {}): code size regressed from {} to {} bytes",
+             it.first.first, it.first.second, old_result.code_size,
+             result.code_size);
+      ++regression_count;
+    }
+    if (cvars::benchmark_time_tolerance > 0.0 &&
+        result.ns_per_iteration > old_result.ns_per_iteration *
+                                      (1.0 + cvars::benchmark_time_tolerance)) {
+      XELOGE("{} (mask {}): time regressed from {:.3f} to {:.3f} ns/iteration",
+             it.first.first, it.first.second, old_result.ns_per_iteration,
+             result.ns_per_iteration);
+      ++regression_count;
+    }
+  }
+  return regression_count;
+}
+
+bool RunBenchmarks(const std::string_view benchmark_name) {
+  std::vector<int64_t> masks;
+  for (auto mask : xe::utf8::split(cvars::benchmark_extension_masks, ", ",
+                                   true)) {
+    masks.push_back(std::strtoll(std::string(mask).c_str(), nullptr, 0));
+  }
+#if XE_ARCH_AMD64
+  if (masks.empty()) {
+    masks.push_back(cvars::x64_extension_mask);
+  }
+  int64_t original_mask = cvars::x64_extension_mask;
+#endif  // XE_ARCH_AMD64
+
+  ResultMap results;
+  bool any_failed = false;
+  for (int64_t mask : masks) {
+#if XE_ARCH_AMD64
+    // The emitter picks up the features when the backend is created.
+    cvars::x64_extension_mask = mask;
+    amd64::InitFeatureFlags();
+    XELOGI("x64_extension_mask {} (features {:X}):", mask,
+           amd64::GetFeatureFlags());
+#endif  // XE_ARCH_AMD64
+
+    BenchmarkRunner runner;
+    if (!runner.Setup()) {
+      any_failed = true;
+      break;
+    }
+    for (size_t i = 0; i < xe::countof(kSnippets); ++i) {
+      if (!benchmark_name.empty() && benchmark_name != kSnippets[i].name) {
+        continue;
+      }
+      Result result;
+      if (!runner.Run(i, &result)) {
+        any_failed = true;
+        continue;
+      }
+      XELOGI("  {:<24} {:>10.3f} ns/iteration {:>6} bytes", kSnippets[i].name,
+             result.ns_per_iteration, result.code_size);
+      results[{kSnippets[i].name, mask}] = result;
+    }
+  }
+#if XE_ARCH_AMD64
+  cvars::x64_extension_mask = original_mask;
+  amd64::InitFeatureFlags();
+#endif  // XE_ARCH_AMD64
+
+  if (!cvars::benchmark_output_path.empty() &&
+      !WriteResults(cvars::benchmark_output_path, results)) {
+    any_failed = true;
+  }
+  if (!cvars::benchmark_baseline_path.empty()) {
+    ResultMap baseline;
+    if (!ReadResults(cvars::benchmark_baseline_path, baseline)) {
+      XELOGE("Unable to read baseline {}",
+             xe::path_to_utf8(cvars::benchmark_baseline_path));
+      return false;
+    }
+    int regression_count = CompareResults(results, baseline);
+    XELOGI("{} regressions relative to the baseline", regression_count);
+    if (regression_count) {
+      any_failed = true;
+    }
+  }
+  return !any_failed;
+}
+
+int main(const std::vector<std::string>& args) {
+  return RunBenchmarks(cvars::benchmark_name) ? 0 : 1;
+}
+
+}  // namespace benchmark
+}  // namespace cpu
+}  // namespace xe
+
+XE_DEFINE_CONSOLE_APP("xenia-cpu-benchmarks", xe::cpu::benchmark::main,
+                      "[benchmark name]", "benchmark_name");
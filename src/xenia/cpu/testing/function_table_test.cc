@@ -0,0 +1,66 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <thread>
+#include <vector>
+
+#include "xenia/cpu/function_table.h"
+
+#include "third_party/catch/include/catch.hpp"
+
+using namespace xe::cpu;
+
+namespace {
+// The table only stores the pointers.
+Function* FakeFunction(uint32_t address) {
+  return reinterpret_cast<Function*>(uintptr_t(address) | 1);
+}
+}  // namespace
+
+TEST_CASE("FunctionTable lookup", "[function_table]") {
+  FunctionTable table;
+  REQUIRE(table.Lookup(0x82000000) == nullptr);
+  table.Set(0x82000000, FakeFunction(0x82000000));
+  table.Set(0x82004000, FakeFunction(0x82004000));
+  table.Set(0xFFFFFFFC, FakeFunction(0xFFFFFFFC));
+  REQUIRE(table.Lookup(0x82000000) == FakeFunction(0x82000000));
+  REQUIRE(table.Lookup(0x82000004) == nullptr);
+  REQUIRE(table.Lookup(0x82000002) == nullptr);
+  REQUIRE(table.Lookup(0x82004000) == FakeFunction(0x82004000));
+  REQUIRE(table.Lookup(0xFFFFFFFC) == FakeFunction(0xFFFFFFFC));
+  table.Set(0x82000001, FakeFunction(0x82000001));
+  REQUIRE(table.Lookup(0x82000001) == nullptr);
+  table.Remove(0x82000000);
+  REQUIRE(table.Lookup(0x82000000) == nullptr);
+  REQUIRE(table.Lookup(0x82004000) == FakeFunction(0x82004000));
+  table.Remove(0x90000000);
+  REQUIRE(table.Lookup(0x90000000) == nullptr);
+}
+
+TEST_CASE("FunctionTable concurrent chunk creation", "[function_table]") {
+  constexpr uint32_t kThreadCount = 4;
+  constexpr uint32_t kFunctionsPerThread = 4096;
+  FunctionTable table;
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < kThreadCount; ++i) {
+    threads.emplace_back([&table, i]() {
+      for (uint32_t j = 0; j < kFunctionsPerThread; ++j) {
+        uint32_t address = 0x82000000 + (j * kThreadCount + i) * 4;
+        table.Set(address, FakeFunction(address));
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (uint32_t i = 0; i < kThreadCount * kFunctionsPerThread; ++i) {
+    uint32_t address = 0x82000000 + i * 4;
+    REQUIRE(table.Lookup(address) == FakeFunction(address));
+  }
+}
@@ -0,0 +1,88 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/backend/hir_interpreter.h"
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe::cpu::hir;
+using namespace xe::cpu;
+using namespace xe::cpu::testing;
+using xe::cpu::backend::InterpretedFunction;
+using xe::cpu::ppc::PPCContext;
+
+static std::unique_ptr<InterpretedFunction> Interpret(
+    std::function<void(HIRBuilder& b)> generator) {
+  HIRBuilder b;
+  generator(b);
+  b.Finalize();
+  return InterpretedFunction::Create(&b);
+}
+
+TEST_CASE("INTERPRET_ADD", "[interpreter]") {
+  auto fn = Interpret([](HIRBuilder& b) {
+    StoreGPR(b, 3, b.Add(LoadGPR(b, 4), LoadGPR(b, 5)));
+    b.Return();
+  });
+  REQUIRE(fn);
+  auto ctx = std::make_unique<PPCContext>();
+  ctx->r[4] = 10;
+  ctx->r[5] = 25;
+  fn->Execute(ctx.get(), 0);
+  REQUIRE(ctx->r[3] == 35);
+}
+
+TEST_CASE("INTERPRET_LOOP", "[interpreter]") {
+  // r3 = sum of the numbers below r4.
+  auto fn = Interpret([](HIRBuilder& b) {
+    auto loop_label = b.NewLabel();
+    auto end_label = b.NewLabel();
+    StoreGPR(b, 3, b.LoadZeroInt64());
+    StoreGPR(b, 5, b.LoadZeroInt64());
+    b.MarkLabel(loop_label);
+    b.BranchFalse(b.CompareSLT(LoadGPR(b, 5), LoadGPR(b, 4)), end_label);
+    StoreGPR(b, 3, b.Add(LoadGPR(b, 3), LoadGPR(b, 5)));
+    StoreGPR(b, 5, b.Add(LoadGPR(b, 5), b.LoadConstantInt64(1)));
+    b.Branch(loop_label);
+    b.MarkLabel(end_label);
+    b.Return();
+  });
+  REQUIRE(fn);
+  auto ctx = std::make_unique<PPCContext>();
+  ctx->r[4] = 10;
+  fn->Execute(ctx.get(), 0);
+  REQUIRE(ctx->r[3] == 45);
+  ctx->r[4] = 0;
+  fn->Execute(ctx.get(), 0);
+  REQUIRE(ctx->r[3] == 0);
+}
+
+TEST_CASE("INTERPRET_SHIFT_COUNT", "[interpreter]") {
+  // Counts are masked like by the host.
+  auto fn = Interpret([](HIRBuilder& b) {
+    StoreGPR(b, 3,
+             b.ZeroExtend(b.Shl(b.Truncate(LoadGPR(b, 4), INT32_TYPE),
+                                b.Truncate(LoadGPR(b, 5), INT8_TYPE)),
+                          INT64_TYPE));
+    b.Return();
+  });
+  REQUIRE(fn);
+  auto ctx = std::make_unique<PPCContext>();
+  ctx->r[4] = 1;
+  ctx->r[5] = 33;
+  fn->Execute(ctx.get(), 0);
+  REQUIRE(ctx->r[3] == 2);
+}
+
+TEST_CASE("INTERPRET_UNSUPPORTED", "[interpreter]") {
+  auto fn = Interpret([](HIRBuilder& b) {
+    StoreFPR(b, 1, b.Add(LoadFPR(b, 2), LoadFPR(b, 3)));
+    b.Return();
+  });
+  REQUIRE(!fn);
+}
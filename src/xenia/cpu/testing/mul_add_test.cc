@@ -0,0 +1,186 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/cpu/testing/util.h"
+
+using namespace xe;
+using namespace xe::cpu;
+using namespace xe::cpu::hir;
+using namespace xe::cpu::testing;
+using xe::cpu::ppc::PPCContext;
+
+TEST_CASE("MUL_ADD_F64", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreFPR(b, 3, b.MulAdd(LoadFPR(b, 4), LoadFPR(b, 5), LoadFPR(b, 6)));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->f[4] = 2.0;
+        ctx->f[5] = 3.0;
+        ctx->f[6] = 4.0;
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->f[3];
+        REQUIRE(result == 10.0);
+      });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->f[4] = -1.5;
+        ctx->f[5] = 4.0;
+        ctx->f[6] = 0.5;
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->f[3];
+        REQUIRE(result == -5.5);
+      });
+}
+
+TEST_CASE("MUL_ADD_F64_SAME_SOURCES", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    auto v = LoadFPR(b, 4);
+    StoreFPR(b, 3, b.MulAdd(v, v, v));
+    b.Return();
+  });
+  test.Run([](PPCContext* ctx) { ctx->f[4] = 3.0; },
+           [](PPCContext* ctx) {
+             auto result = ctx->f[3];
+             REQUIRE(result == 12.0);
+           });
+}
+
+TEST_CASE("MUL_SUB_F64", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreFPR(b, 3, b.MulSub(LoadFPR(b, 4), LoadFPR(b, 5), LoadFPR(b, 6)));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->f[4] = 2.0;
+        ctx->f[5] = 3.0;
+        ctx->f[6] = 4.0;
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->f[3];
+        REQUIRE(result == 2.0);
+      });
+}
+
+TEST_CASE("MUL_ADD_V128", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.MulAdd(LoadVR(b, 4), LoadVR(b, 5), LoadVR(b, 6)));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128f(1.0f, 2.0f, 3.0f, 4.0f);
+        ctx->v[5] = vec128f(2.0f);
+        ctx->v[6] = vec128f(10.0f, 20.0f, -30.0f, 0.5f);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128f(12.0f, 24.0f, -24.0f, 8.5f));
+      });
+}
+
+TEST_CASE("MUL_ADD_V128_ACCUMULATE", "[instr]") {
+  // The accumulator is both an addend and the result, as in vmaddfp loops.
+  TestFunction test([](HIRBuilder& b) {
+    auto a = LoadVR(b, 4);
+    auto c = LoadVR(b, 5);
+    auto acc = b.MulAdd(a, c, LoadVR(b, 3));
+    acc = b.MulAdd(a, c, acc);
+    StoreVR(b, 3, acc);
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[3] = vec128f(1.0f);
+        ctx->v[4] = vec128f(1.0f, 2.0f, 3.0f, 4.0f);
+        ctx->v[5] = vec128f(0.5f);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128f(2.0f, 3.0f, 4.0f, 5.0f));
+      });
+}
+
+TEST_CASE("MUL_SUB_V128", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.MulSub(LoadVR(b, 4), LoadVR(b, 5), LoadVR(b, 6)));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128f(1.0f, 2.0f, 3.0f, 4.0f);
+        ctx->v[5] = vec128f(2.0f);
+        ctx->v[6] = vec128f(10.0f);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128f(-8.0f, -6.0f, -4.0f, -2.0f));
+      });
+}
+
+TEST_CASE("NEG_MUL_ADD_V128", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3,
+            b.Neg(b.MulAdd(LoadVR(b, 4), LoadVR(b, 5), LoadVR(b, 6))));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128f(1.0f, 2.0f, 3.0f, 4.0f);
+        ctx->v[5] = vec128f(2.0f);
+        ctx->v[6] = vec128f(10.0f);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128f(-12.0f, -14.0f, -16.0f, -18.0f));
+      });
+}
+
+TEST_CASE("NEG_MUL_SUB_V128", "[instr]") {
+  // vnmsubfp.
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3,
+            b.Neg(b.MulSub(LoadVR(b, 4), LoadVR(b, 5), LoadVR(b, 6))));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128f(1.0f, 2.0f, 3.0f, 4.0f);
+        ctx->v[5] = vec128f(2.0f);
+        ctx->v[6] = vec128f(10.0f);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128f(8.0f, 6.0f, 4.0f, 2.0f));
+      });
+}
+
+TEST_CASE("NEG_MUL_SUB_V128_MULTIPLE_USES", "[instr]") {
+  // The product is still needed, so the negation stays separate.
+  TestFunction test([](HIRBuilder& b) {
+    auto v = b.MulSub(LoadVR(b, 4), LoadVR(b, 5), LoadVR(b, 6));
+    StoreVR(b, 3, b.Neg(v));
+    StoreVR(b, 7, v);
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128f(1.0f, 2.0f, 3.0f, 4.0f);
+        ctx->v[5] = vec128f(2.0f);
+        ctx->v[6] = vec128f(10.0f);
+      },
+      [](PPCContext* ctx) {
+        REQUIRE(ctx->v[3] == vec128f(8.0f, 6.0f, 4.0f, 2.0f));
+        REQUIRE(ctx->v[7] == vec128f(-8.0f, -6.0f, -4.0f, -2.0f));
+      });
+}
@@ -80,6 +80,28 @@ TEST_CASE("VECTOR_SHA_I8_SAME_CONSTANT", "[instr]") {
       });
 }
 
+// Every count differs and needs to be masked, this targets the variable shift
+// paths rather than the uniform count shortcuts.
+TEST_CASE("VECTOR_SHA_I8_MASKED_AMOUNTS", "[instr]") {
+  TestFunction test([](HIRBuilder& b) {
+    StoreVR(b, 3, b.VectorSha(LoadVR(b, 4), LoadVR(b, 5), INT8_TYPE));
+    b.Return();
+  });
+  test.Run(
+      [](PPCContext* ctx) {
+        ctx->v[4] = vec128b(0x81, 0x7F, 0xFF, 0x01, 0x80, 0x55, 0xAA, 0x0F,
+                            0xF0, 0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC, 0xDE);
+        ctx->v[5] = vec128b(9, 10, 15, 16, 255, 3, 4, 7, 8, 13, 17, 1, 2, 3,
+                            4, 5);
+      },
+      [](PPCContext* ctx) {
+        auto result = ctx->v[3];
+        REQUIRE(result == vec128b(0xC0, 0x1F, 0xFF, 0x01, 0xFF, 0x0A, 0xFA,
+                                  0x00, 0xF0, 0x00, 0x1A, 0x2B, 0x1E, 0xF3,
+                                  0xFB, 0xFE));
+      });
+}
+
 TEST_CASE("VECTOR_SHA_I16", "[instr]") {
   TestFunction test([](HIRBuilder& b) {
     StoreVR(b, 3, b.VectorSha(LoadVR(b, 4), LoadVR(b, 5), INT16_TYPE));
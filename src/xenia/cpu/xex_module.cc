@@ -10,14 +10,18 @@
 #include "xenia/cpu/xex_module.h"
 
 #include <algorithm>
+#include <memory>
+#include <vector>
 
 #include "third_party/fmt/include/fmt/format.h"
 
 #include "xenia/base/byte_order.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
+#include "xenia/base/threading.h"
 
 #include "xenia/cpu/cpu_flags.h"
 #include "xenia/cpu/export_resolver.h"
@@ -48,6 +52,16 @@ DEFINE_bool(
     "finding/stress testing with the JIT",
     "CPU");
 
+DEFINE_int32(preanalysis_threads, -1,
+             "Number of threads scanning the executable for functions to "
+             "precompile (-1 for one per logical processor).",
+             "CPU");
+
+DEFINE_bool(xex_image_cache, true,
+            "Store the decompressed and patched images of the titles in the "
+            "cache root to skip decompressing and patching them the next time.",
+            "CPU");
+
 DECLARE_bool(allow_plugins);
 
 static const uint8_t xe_xex2_retail_key[16] = {
@@ -230,6 +244,15 @@ int XexModule::ApplyPatch(XexModule* module) {
                reinterpret_cast<void**>(&patch_header));
   assert_not_null(patch_header);
 
+  std::filesystem::path image_cache_path =
+      GetImageCachePath(module->xex_security_info()->rsa_signature,
+                        xex_security_info()->rsa_signature);
+  if (!image_cache_path.empty() &&
+      module->ReadCachedImage(image_cache_path, module->image_size())) {
+    XELOGI("XEX patch applied from the image cache");
+    return 0;
+  }
+
   // Compare hash inside delta descriptor to base XEX signature
   uint8_t digest[0x14];
   sha1::SHA1 s;
@@ -477,6 +500,9 @@ int XexModule::ApplyPatch(XexModule* module) {
         "version: {}.{}.{}.{}",
         source_ver.major, source_ver.minor, source_ver.build, source_ver.qfe,
         target_ver.major, target_ver.minor, target_ver.build, target_ver.qfe);
+    if (!image_cache_path.empty()) {
+      module->WriteCachedImage(image_cache_path);
+    }
   } else {
     XELOGE("XEX patch application failed, error code {}", result_code);
   }
@@ -507,6 +533,19 @@ int XexModule::ReadImage(const void* xex_addr, size_t xex_length,
 
   memory()->LookupHeap(base_address_)->Reset();
 
+  // Only LZX decompression is slow enough to be worth caching.
+  std::filesystem::path image_cache_path;
+  if (opt_file_format_info()->compression_type == XEX_COMPRESSION_NORMAL) {
+    image_cache_path =
+        GetImageCachePath(xex_security_info()->rsa_signature, nullptr);
+    if (!image_cache_path.empty() && ReadCachedImage(image_cache_path, 0)) {
+      if (is_valid_executable()) {
+        return 0;
+      }
+      memory()->LookupHeap(base_address_)->Release(base_address_);
+    }
+  }
+
   aes_decrypt_buffer(
       use_dev_key ? xe_xex2_devkit_key : xe_xex2_retail_key,
       reinterpret_cast<const uint8_t*>(xex_security_info()->aes_key), 16,
@@ -533,6 +572,9 @@ int XexModule::ReadImage(const void* xex_addr, size_t xex_length,
   }
 
   if (is_patch() || is_valid_executable()) {
+    if (!image_cache_path.empty()) {
+      WriteCachedImage(image_cache_path);
+    }
     return 0;
   }
 
@@ -794,6 +836,131 @@ int XexModule::ReadImageCompressed(const void* xex_addr, size_t xex_length) {
   return result_code;
 }
 
+namespace {
+struct ImageCacheHeader {
+  static constexpr uint32_t kMagic = 0x474D4958;  // 'XIMG'
+  static constexpr uint32_t kVersion = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t image_size;
+  uint8_t session_key[0x10];
+  uint32_t is_dev_kit;
+};
+}  // namespace
+
+std::filesystem::path XexModule::GetImageCachePath(
+    const char* rsa_signature, const char* patch_rsa_signature) const {
+  if (!cvars::xex_image_cache) {
+    return std::filesystem::path();
+  }
+  sha1::SHA1 s;
+  s.processBytes(rsa_signature, 0x100);
+  if (patch_rsa_signature) {
+    s.processBytes(patch_rsa_signature, 0x100);
+  }
+  uint8_t digest[0x14];
+  s.finalize(digest);
+  std::string name;
+  for (uint8_t byte : digest) {
+    name += fmt::format("{:02X}", byte);
+  }
+  return kernel_state_->emulator()->cache_root() / "xex_images" /
+         (name + ".bin");
+}
+
+bool XexModule::ReadCachedImage(const std::filesystem::path& path,
+                                uint32_t committed_size) {
+  FILE* file = xe::filesystem::OpenFile(path, "rb");
+  if (!file) {
+    return false;
+  }
+  // Read everything before touching the module, so it's left as it was if
+  // the file is damaged.
+  ImageCacheHeader cache_header;
+  std::vector<uint8_t> header_data;
+  std::vector<uint8_t> image_data;
+  bool read_result =
+      fread(&cache_header, sizeof(cache_header), 1, file) == 1 &&
+      cache_header.magic == ImageCacheHeader::kMagic &&
+      cache_header.version == ImageCacheHeader::kVersion &&
+      cache_header.header_size >= sizeof(xex2_header) &&
+      cache_header.image_size;
+  if (read_result) {
+    header_data.resize(cache_header.header_size);
+    image_data.resize(cache_header.image_size);
+    read_result =
+        fread(header_data.data(), header_data.size(), 1, file) == 1 &&
+        fread(image_data.data(), image_data.size(), 1, file) == 1;
+  }
+  fclose(file);
+  if (!read_result) {
+    XELOGW("Ignoring the damaged XEX image cache file {}",
+           xe::path_to_utf8(path));
+    return false;
+  }
+
+  auto heap = memory()->LookupHeap(base_address_);
+  uint32_t image_size = cache_header.image_size;
+  if (image_size > committed_size) {
+    if (!heap->AllocFixed(
+            base_address_ + committed_size, image_size - committed_size, 4096,
+            xe::kMemoryAllocationReserve | xe::kMemoryAllocationCommit,
+            xe::kMemoryProtectRead | xe::kMemoryProtectWrite)) {
+      XELOGE("Unable to allocate XEX memory at {:08X}-{:08X}.",
+             base_address_ + committed_size, image_size - committed_size);
+      return false;
+    }
+  } else if (image_size < committed_size) {
+    heap->Decommit(base_address_ + image_size, committed_size - image_size);
+  }
+  std::memcpy(memory()->TranslateVirtual(base_address_), image_data.data(),
+              image_size);
+
+  xex_header_mem_ = std::move(header_data);
+  ReadSecurityInfo();
+  std::memcpy(session_key_, cache_header.session_key, sizeof(session_key_));
+  is_dev_kit_ = cache_header.is_dev_kit != 0;
+  return true;
+}
+
+void XexModule::WriteCachedImage(const std::filesystem::path& path) {
+  ImageCacheHeader cache_header = {};
+  cache_header.magic = ImageCacheHeader::kMagic;
+  cache_header.version = ImageCacheHeader::kVersion;
+  cache_header.header_size = uint32_t(xex_header_mem_.size());
+  cache_header.image_size = image_size();
+  std::memcpy(cache_header.session_key, session_key_, sizeof(session_key_));
+  cache_header.is_dev_kit = is_dev_kit_ ? 1 : 0;
+
+  // Written under a temporary name so an interrupted write is never read.
+  std::filesystem::path temp_path = path;
+  temp_path += ".tmp";
+  if (!xe::filesystem::CreateParentFolder(temp_path)) {
+    return;
+  }
+  FILE* file = xe::filesystem::OpenFile(temp_path, "wb");
+  if (!file) {
+    return;
+  }
+  bool write_result =
+      fwrite(&cache_header, sizeof(cache_header), 1, file) == 1 &&
+      fwrite(xex_header_mem_.data(), xex_header_mem_.size(), 1, file) == 1 &&
+      fwrite(memory()->TranslateVirtual(base_address_),
+             cache_header.image_size, 1, file) == 1;
+  write_result = !fclose(file) && write_result;
+  std::error_code error;
+  if (write_result) {
+    std::filesystem::rename(temp_path, path, error);
+  }
+  if (!write_result || error) {
+    XELOGW("Failed to write the XEX image cache file {}",
+           xe::path_to_utf8(path));
+    std::filesystem::remove(temp_path, error);
+  }
+}
+
 int XexModule::ReadPEHeaders() {
   const uint8_t* p = memory()->TranslateVirtual(base_address_);
 
@@ -1081,6 +1248,7 @@ bool XexModule::LoadContinue() {
   }
 
   // Setup memory protection.
+  read_only_ranges_.clear();
   for (uint32_t i = 0, page = 0; i < sec_header->page_descriptor_count; i++) {
     // Byteswap the bitfield manually.
     xex2_page_descriptor desc;
@@ -1095,6 +1263,14 @@ bool XexModule::LoadContinue() {
                       cvars::writable_code_segments
                           ? kMemoryProtectRead | kMemoryProtectWrite
                           : kMemoryProtectRead);
+        if (!cvars::writable_code_segments && size) {
+          if (!read_only_ranges_.empty() &&
+              read_only_ranges_.back().second == address) {
+            read_only_ranges_.back().second = address + size;
+          } else {
+            read_only_ranges_.emplace_back(address, address + size);
+          }
+        }
         break;
       case XEX_SECTION_DATA:
         heap->Protect(address, size, kMemoryProtectRead | kMemoryProtectWrite);
@@ -1108,15 +1284,33 @@ bool XexModule::LoadContinue() {
 }
 
 void XexModule::Precompile() {
-  sha1::SHA1 final_image_sha_;
+  // The hash of the code only names the module cache, so calculate it while
+  // the code is being scanned for the save/restore functions.
+  auto hash_code = [this]() {
+    sha1::SHA1 final_image_sha_;
 
-  final_image_sha_.reset();
+    final_image_sha_.reset();
 
-  unsigned high_code = this->high_address_ - this->low_address_;
+    unsigned high_code = this->high_address_ - this->low_address_;
 
-  final_image_sha_.processBytes(memory()->TranslateVirtual(this->low_address_),
-                                high_code);
-  final_image_sha_.finalize(image_sha_bytes_);
+    final_image_sha_.processBytes(
+        memory()->TranslateVirtual(this->low_address_), high_code);
+    final_image_sha_.finalize(image_sha_bytes_);
+  };
+  auto hash_thread = xe::threading::Thread::Create({}, hash_code);
+  if (hash_thread) {
+    hash_thread->set_name("XEX Image Hash");
+  } else {
+    hash_code();
+  }
+
+  // Find __savegprlr_* and __restgprlr_* and the others.
+  // We can flag these for special handling (inlining/etc).
+  bool found_save_rest = FindSaveRest();
+
+  if (hash_thread) {
+    xe::threading::Wait(hash_thread.get(), false);
+  }
 
   char fmtbuf[16];
 
@@ -1125,20 +1319,33 @@ void XexModule::Precompile() {
     image_sha_str_ += &fmtbuf[0];
   }
 
-  // Find __savegprlr_* and __restgprlr_* and the others.
-  // We can flag these for special handling (inlining/etc).
-  if (!FindSaveRest()) {
+  // The functions that became hot in previous runs are likely to be hot again,
+  // translate them with all optimizations first. Self-modifying code is
+  // checked against the stored hashes.
+  if (cvars::tiered_compilation && cvars::persistent_guest_profile) {
+    profile_cache_ = std::make_unique<GuestProfileCache>(memory());
+    if (profile_cache_->Open(GetModuleCachePath() / "guest_profile.bin")) {
+      processor_->PrecompileFunctions(profile_cache_->GetFunctionAddresses(),
+                                      true);
+    } else {
+      profile_cache_.reset();
+    }
+  }
+
+  if (!found_save_rest) {
     return;
   }
 
   info_cache_.Init(this);
   PrecompileDiscoveredFunctions();
+  PrecompileKnownFunctions();
 }
 bool XexModule::Unload() {
   if (!loaded_) {
     return true;
   }
   loaded_ = false;
+  read_only_ranges_.clear();
 
   // If this isn't a patch, just deallocate the memory occupied by the exe
   if (!is_patch()) {
@@ -1336,6 +1543,25 @@ bool XexModule::ContainsAddress(uint32_t address) {
   return address >= low_address_ && address < high_address_;
 }
 
+bool XexModule::IsReadOnlyImageData(uint32_t address, uint32_t size) {
+  if (!size || uint64_t(address) + size > UINT32_MAX) {
+    return false;
+  }
+  uint32_t end = address + size;
+  auto range_it = std::find_if(
+      read_only_ranges_.cbegin(), read_only_ranges_.cend(),
+      [address, end](const std::pair<uint32_t, uint32_t>& range) {
+        return address >= range.first && end <= range.second;
+      });
+  if (range_it == read_only_ranges_.cend()) {
+    return false;
+  }
+  // The title may still change the protection later.
+  auto heap = memory()->LookupHeap(address);
+  return heap && heap->QueryRangeAccess(address, end - 1) ==
+                     xe::memory::PageAccess::kReadOnly;
+}
+
 std::unique_ptr<Function> XexModule::CreateFunction(uint32_t address) {
   return std::unique_ptr<Function>(
       processor_->backend()->CreateGuestFunction(this, address));
@@ -1345,12 +1571,7 @@ void XexInfoCache::Init(XexModule* xexmod) {
     return;
   }
 
-  auto emu = xexmod->kernel_state_->emulator();
-  std::filesystem::path infocache_path = emu->cache_root();
-
-  infocache_path.append(L"modules");
-
-  infocache_path.append(xexmod->image_sha_str_);
+  std::filesystem::path infocache_path = xexmod->GetModuleCachePath();
 
   std::filesystem::create_directories(infocache_path);
   infocache_path.append("executable_addr_flags.bin");
@@ -1390,6 +1611,12 @@ void XexInfoCache::Init(XexModule* xexmod) {
     }
   }
 }
+std::filesystem::path XexModule::GetModuleCachePath() const {
+  if (image_sha_str_.empty()) {
+    return std::filesystem::path();
+  }
+  return kernel_state_->emulator()->cache_root() / "modules" / image_sha_str_;
+}
 InfoCacheFlags* XexModule::GetInstructionAddressFlags(uint32_t guest_addr) {
   if (guest_addr < low_address_ || guest_addr > high_address_) {
     return nullptr;
@@ -1405,6 +1632,7 @@ void XexModule::PrecompileDiscoveredFunctions() {
   }
   auto others = PreanalyzeCode();
 
+  std::vector<uint32_t> to_precompile;
   for (auto&& other : others) {
     if (other < low_address_ || other >= high_address_) {
       continue;
@@ -1412,9 +1640,10 @@ void XexModule::PrecompileDiscoveredFunctions() {
     auto sym = processor_->LookupFunction(other);
 
     if (!sym || sym->status() != Symbol::Status::kDefined) {
-      processor_->ResolveFunction(other);
+      to_precompile.push_back(other);
     }
   }
+  processor_->PrecompileFunctions(to_precompile);
 }
 void XexModule::PrecompileKnownFunctions() {
   if (!cvars::enable_early_precompilation) {
@@ -1426,17 +1655,19 @@ void XexModule::PrecompileKnownFunctions() {
   if (!flags) {
     return;
   }
-  // maybe should pre-acquire global crit?
+  std::vector<uint32_t> to_precompile;
   for (uint32_t i = 0; i < end; i++) {
     if (flags[i].was_resolved) {
       uint32_t addr = low_address_ + (i * 4);
       auto sym = processor_->LookupFunction(addr);
 
       if (!sym || sym->status() != Symbol::Status::kDefined) {
-        processor_->ResolveFunction(addr);
+        to_precompile.push_back(addr);
       }
     }
   }
+  // Functions resolved during previous runs are likely to be needed soon.
+  processor_->PrecompileFunctions(to_precompile, true);
 }
 
 static uint32_t GetBLCalledFunction(XexModule* xexmod, uint32_t current_base,
@@ -1453,6 +1684,79 @@ static bool IsOpcodeBL(unsigned w) {
   return (w >> (32 - 6)) == 18 && ppc::PPCOpcodeBits{w}.I.LK;
 }
 
+// Collects likely function starts in [scan_start, scan_end), which must be
+// 8 byte aligned. Only reads memory, so ranges can be scanned concurrently.
+static void ScanFunctionStarts(const uint32_t* range_start,
+                               const uint32_t* scan_start,
+                               const uint32_t* scan_end, uint32_t low_8_aligned,
+                               uint32_t low_address, uint32_t high_address,
+                               XexModule* xexmod,
+                               std::vector<uint32_t>& out_addresses) {
+  const uint8_t mfspr_r12_lr[4] = {0x7D, 0x88, 0x02, 0xA6};
+
+  // a blr instruction, with 4 zero bytes afterwards to pad the next address
+  // to 8 byte alignment
+  // if we see this prior to our address, we can assume we are a function
+  // start
+  const uint8_t blr[4] = {0x4E, 0x80, 0x0, 0x20};
+
+  uint32_t blr32 = *reinterpret_cast<const uint32_t*>(&blr[0]);
+
+  uint32_t mfspr_r12_lr32 =
+      *reinterpret_cast<const uint32_t*>(&mfspr_r12_lr[0]);
+
+  auto guest_address = [range_start, low_8_aligned](const uint32_t* p) {
+    return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(p) -
+                                 reinterpret_cast<uintptr_t>(range_start)) +
+           low_8_aligned;
+  };
+  /*
+              First pass: detect save of the link register at an eight byte
+     aligned address
+      */
+  for (const uint32_t* first_pass = scan_start; first_pass < scan_end;
+       first_pass += 2) {
+    if (*first_pass == mfspr_r12_lr32) {
+      // Push our newly discovered function start into our list
+      out_addresses.push_back(guest_address(first_pass));
+    } else if (first_pass[-1] == 0 && *first_pass != 0) {
+      // originally i checked for blr followed by 0, but some functions are
+      // actually aligned to greater boundaries. something that appears to be
+      // longjmp (it occurs in most games, so standard library, and loads ctx,
+      // so longjmp) is aligned to 16 bytes in most games
+      // (this may look into the previous range, which is fine - the memory
+      // isn't modified by anyone while scanning)
+      const uint32_t* check_iter = &first_pass[-2];
+
+      while (!*check_iter) {
+        --check_iter;
+      }
+
+      XE_LIKELY_IF(*check_iter == blr32) {
+        out_addresses.push_back(guest_address(first_pass));
+      }
+    }
+  }
+  uint32_t current_guestaddr = guest_address(scan_start);
+  // Second pass: detect branch with link instructions and decode the target
+  // address. We can safely assume that if bl is to address, that address is
+  // the start of the function
+  for (const uint32_t* second_pass = scan_start; second_pass < scan_end;
+       second_pass++, current_guestaddr += 4) {
+    uint32_t current_call = xe::byte_swap(*second_pass);
+
+    if (IsOpcodeBL(current_call)) {
+      uint32_t called_function = GetBLCalledFunction(
+          xexmod, current_guestaddr, ppc::PPCOpcodeBits{current_call});
+      // must be 8 byte aligned and in range
+      if ((called_function & (8 - 1)) == 0 && called_function >= low_address &&
+          called_function < high_address) {
+        out_addresses.push_back(called_function);
+      }
+    }
+  }
+}
+
 std::vector<uint32_t> XexModule::PreanalyzeCode() {
   uint32_t low_8_aligned = xe::align<uint32_t>(low_address_, 8);
 
@@ -1465,137 +1769,90 @@ std::vector<uint32_t> XexModule::PreanalyzeCode() {
     }
   }
   uint32_t high_8_aligned = highest_exec_addr & ~(8U - 1);
+  if (high_8_aligned <= low_8_aligned) {
+    return {};
+  }
   uint32_t n_possible_8byte_addresses = (high_8_aligned - low_8_aligned) / 8;
-  uint32_t* funcstart_candidate_stack =
-      new uint32_t[n_possible_8byte_addresses];
-  uint32_t* funcstart_candstack2 = new uint32_t[n_possible_8byte_addresses];
-
-  uint32_t stack_pos = 0;
-  {
-    // all functions seem to start on 8 byte boundaries, except for obvious ones
-    // like the save/rest funcs
-    uint32_t* range_start =
-        (uint32_t*)memory()->TranslateVirtual(low_8_aligned);
-    uint32_t* range_end = (uint32_t*)memory()->TranslateVirtual(
-        high_8_aligned);  // align down to multiple of 8
-
-    const uint8_t mfspr_r12_lr[4] = {0x7D, 0x88, 0x02, 0xA6};
-
-    // a blr instruction, with 4 zero bytes afterwards to pad the next address
-    // to 8 byte alignment
-    // if we see this prior to our address, we can assume we are a function
-    // start
-    const uint8_t blr[4] = {0x4E, 0x80, 0x0, 0x20};
-
-    uint32_t blr32 = *reinterpret_cast<const uint32_t*>(&blr[0]);
-
-    uint32_t mfspr_r12_lr32 =
-        *reinterpret_cast<const uint32_t*>(&mfspr_r12_lr[0]);
-
-    auto add_new_func = [funcstart_candidate_stack, &stack_pos](uint32_t addr) {
-      funcstart_candidate_stack[stack_pos++] = addr;
-    };
-    /*
-                First pass: detect save of the link register at an eight byte
-       aligned address
-        */
-    for (uint32_t* first_pass = range_start; first_pass < range_end;
-         first_pass += 2) {
-      if (*first_pass == mfspr_r12_lr32) {
-        // Push our newly discovered function start into our list
-        // All addresses in the list are sorted until the second pass
-        add_new_func(
-            static_cast<uint32_t>(reinterpret_cast<uintptr_t>(first_pass) -
-                                  reinterpret_cast<uintptr_t>(range_start)) +
-            low_8_aligned);
-      } else if (first_pass[-1] == 0 && *first_pass != 0) {
-        // originally i checked for blr followed by 0, but some functions are
-        // actually aligned to greater boundaries. something that appears to be
-        // longjmp (it occurs in most games, so standard library, and loads ctx,
-        // so longjmp) is aligned to 16 bytes in most games
-        uint32_t* check_iter = &first_pass[-2];
-
-        while (!*check_iter) {
-          --check_iter;
-        }
 
-        XE_LIKELY_IF(*check_iter == blr32) {
-          add_new_func(
-              static_cast<uint32_t>(reinterpret_cast<uintptr_t>(first_pass) -
-                                    reinterpret_cast<uintptr_t>(range_start)) +
-              low_8_aligned);
-        }
-      }
+  // all functions seem to start on 8 byte boundaries, except for obvious ones
+  // like the save/rest funcs
+  const uint32_t* range_start =
+      (const uint32_t*)memory()->TranslateVirtual(low_8_aligned);
+
+  // Split the image into chunks scanned in parallel, with a lower bound on the
+  // chunk size so small modules don't pay for creating threads.
+  constexpr uint32_t kMinChunkSize = 1 * 1024 * 1024;
+  uint32_t chunk_count = 1;
+  if (cvars::preanalysis_threads != 1) {
+    uint32_t max_chunk_count = cvars::preanalysis_threads > 0
+                                   ? uint32_t(cvars::preanalysis_threads)
+                                   : xe::threading::logical_processor_count();
+    chunk_count = std::clamp<uint32_t>(
+        (high_8_aligned - low_8_aligned) / kMinChunkSize, 1,
+        std::max(max_chunk_count, uint32_t(1)));
+  }
+  uint32_t chunk_8byte_addresses =
+      xe::round_up(n_possible_8byte_addresses, chunk_count) / chunk_count;
+  std::vector<std::vector<uint32_t>> chunk_addresses(chunk_count);
+  auto scan_chunk = [&, range_start](uint32_t chunk) {
+    uint32_t first = chunk * chunk_8byte_addresses;
+    uint32_t last = std::min(first + chunk_8byte_addresses,
+                             n_possible_8byte_addresses);
+    if (first < last) {
+      ScanFunctionStarts(range_start, range_start + first * 2,
+                         range_start + last * 2, low_8_aligned, low_address_,
+                         high_address_, this, chunk_addresses[chunk]);
     }
-    uint32_t current_guestaddr = low_8_aligned;
-    // Second pass: detect branch with link instructions and decode the target
-    // address. We can safely assume that if bl is to address, that address is
-    // the start of the function
-    for (uint32_t* second_pass = range_start; second_pass < range_end;
-         second_pass++, current_guestaddr += 4) {
-      uint32_t current_call = xe::byte_swap(*second_pass);
-
-      if (IsOpcodeBL(current_call)) {
-        uint32_t called_function = GetBLCalledFunction(
-            this, current_guestaddr, ppc::PPCOpcodeBits{current_call});
-        // must be 8 byte aligned and in range
-        if ((called_function & (8 - 1)) == 0 &&
-            called_function >= low_address_ &&
-            called_function < high_address_) {
-          add_new_func(called_function);
-        }
-      }
+  };
+  std::vector<std::unique_ptr<xe::threading::Thread>> threads;
+  for (uint32_t chunk = 1; chunk < chunk_count; ++chunk) {
+    auto thread = xe::threading::Thread::Create(
+        {}, [&scan_chunk, chunk]() { scan_chunk(chunk); });
+    if (thread) {
+      thread->set_name("CPU Preanalysis");
+      threads.push_back(std::move(thread));
+    } else {
+      scan_chunk(chunk);
     }
+  }
+  scan_chunk(0);
+  for (auto& thread : threads) {
+    xe::threading::Wait(thread.get(), false);
+  }
 
-    auto pdata = this->GetPESection(".pdata");
-
-    if (pdata) {
-      uint32_t* pdata_base =
-          (uint32_t*)this->memory()->TranslateVirtual(pdata->address);
-
-      uint32_t n_pdata_entries = pdata->raw_size / 8;
-
-      for (uint32_t i = 0; i < n_pdata_entries; ++i) {
-        uint32_t funcaddr = xe::load_and_swap<uint32_t>(&pdata_base[i * 2]);
-        if (funcaddr >= low_address_ && funcaddr <= highest_exec_addr) {
-          add_new_func(funcaddr);
-        } else {
-          // we hit 0 for func addr, that means we're done
-          break;
-        }
-      }
-    }
+  std::vector<uint32_t> result;
+  size_t n_candidates = 0;
+  for (auto& addresses : chunk_addresses) {
+    n_candidates += addresses.size();
+  }
+  result.reserve(n_candidates);
+  for (auto& addresses : chunk_addresses) {
+    result.insert(result.end(), addresses.cbegin(), addresses.cend());
   }
 
-  // Sort the list of function starts and then ensure that all addresses are
-  // unique
-  uint32_t n_known_funcaddrs = 0;
-  {
-    // make addresses unique
+  auto pdata = this->GetPESection(".pdata");
 
-    std::sort(funcstart_candidate_stack, funcstart_candidate_stack + stack_pos);
+  if (pdata) {
+    uint32_t* pdata_base =
+        (uint32_t*)this->memory()->TranslateVirtual(pdata->address);
 
-    uint32_t read_pos = 0;
-    uint32_t write_pos = 0;
-    uint32_t previous_addr = ~0u;
-    while (read_pos < stack_pos) {
-      uint32_t current_addr = funcstart_candidate_stack[read_pos++];
+    uint32_t n_pdata_entries = pdata->raw_size / 8;
 
-      if (current_addr != previous_addr) {
-        previous_addr = current_addr;
-        funcstart_candstack2[write_pos++] = current_addr;
+    for (uint32_t i = 0; i < n_pdata_entries; ++i) {
+      uint32_t funcaddr = xe::load_and_swap<uint32_t>(&pdata_base[i * 2]);
+      if (funcaddr >= low_address_ && funcaddr <= highest_exec_addr) {
+        result.push_back(funcaddr);
+      } else {
+        // we hit 0 for func addr, that means we're done
+        break;
       }
     }
-    n_known_funcaddrs = write_pos;
   }
 
-  delete[] funcstart_candidate_stack;
-
-  std::vector<uint32_t> result;
-  result.resize(n_known_funcaddrs);
-  memcpy(&result[0], funcstart_candstack2,
-         sizeof(uint32_t) * n_known_funcaddrs);
-  delete[] funcstart_candstack2;
+  // Sort the list of function starts and then ensure that all addresses are
+  // unique
+  std::sort(result.begin(), result.end());
+  result.erase(std::unique(result.begin(), result.end()), result.end());
   return result;
 }
 bool XexModule::FindSaveRest() {
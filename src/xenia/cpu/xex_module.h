@@ -10,9 +10,12 @@
 #ifndef XENIA_CPU_XEX_MODULE_H_
 #define XENIA_CPU_XEX_MODULE_H_
 
+#include <filesystem>
+#include <memory>
 #include <string>
 #include <vector>
 #include "xenia/base/mapped_memory.h"
+#include "xenia/cpu/guest_profile_cache.h"
 #include "xenia/cpu/module.h"
 #include "xenia/kernel/util/xex2_info.h"
 
@@ -205,6 +208,11 @@ class XexModule : public xe::cpu::Module {
   bool Unload();
 
   bool ContainsAddress(uint32_t address) override;
+  // Whether the size bytes at the address are in the code or read-only data
+  // sections protected from writing when the module was loaded, and haven't
+  // been made writable since, so loads from them may be folded into
+  // constants.
+  bool IsReadOnlyImageData(uint32_t address, uint32_t size);
 
   const std::string& name() const override { return name_; }
   bool is_executable() const override {
@@ -232,6 +240,14 @@ class XexModule : public xe::cpu::Module {
 
   InfoCacheFlags* GetInstructionAddressFlags(uint32_t guest_addr);
 
+  const std::string& image_sha_str() const { return image_sha_str_; }
+  // Directory for data cached between runs for this exact image, empty before
+  // the image hash is calculated in Precompile.
+  std::filesystem::path GetModuleCachePath() const;
+  // Profiles of the functions that became hot in previous runs, opened in
+  // Precompile, nullptr if not persisted.
+  GuestProfileCache* profile_cache() const { return profile_cache_.get(); }
+
   virtual void Precompile() override;
 
  protected:
@@ -249,6 +265,17 @@ class XexModule : public xe::cpu::Module {
   int ReadImageBasicCompressed(const void* xex_addr, size_t xex_length);
   int ReadImageCompressed(const void* xex_addr, size_t xex_length);
 
+  // Decompressed, and optionally patched, images stored in the cache root,
+  // keyed by the signatures of the XEX and the patch, so they're only
+  // decompressed and patched the first time the title is launched.
+  std::filesystem::path GetImageCachePath(
+      const char* rsa_signature, const char* patch_rsa_signature) const;
+  // Replaces the headers and the image, with the committed_size bytes already
+  // committed at the base address, with the cached ones.
+  bool ReadCachedImage(const std::filesystem::path& path,
+                       uint32_t committed_size);
+  void WriteCachedImage(const std::filesystem::path& path);
+
   int ReadPEHeaders();
 
   bool SetupLibraryImports(const std::string_view name,
@@ -278,6 +305,8 @@ class XexModule : public xe::cpu::Module {
   uint32_t base_address_ = 0;
   uint32_t low_address_ = 0;
   uint32_t high_address_ = 0;
+  // Start and end of the ranges of the image made read-only on load.
+  std::vector<std::pair<uint32_t, uint32_t>> read_only_ranges_;
 
   XexFormat xex_format_ = kFormatUnknown;
   SecurityInfoContext security_info_ = {};
@@ -285,6 +314,7 @@ class XexModule : public xe::cpu::Module {
   uint8_t image_sha_bytes_[20];
   std::string image_sha_str_;
   XexInfoCache info_cache_;
+  std::unique_ptr<GuestProfileCache> profile_cache_;
 };
 
 }  // namespace cpu
@@ -21,12 +21,15 @@
 #include "xenia/base/cvar.h"
 #include "xenia/base/debugging.h"
 #include "xenia/base/exception_handler.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/literals.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/mapped_memory.h"
+#include "xenia/base/memory.h"
 #include "xenia/base/platform.h"
 #include "xenia/base/string.h"
 #include "xenia/base/system.h"
+#include "xenia/base/threading.h"
 #include "xenia/cpu/backend/code_cache.h"
 #include "xenia/cpu/backend/null_backend.h"
 #include "xenia/cpu/cpu_flags.h"
@@ -49,6 +52,7 @@
 #include "xenia/ui/window.h"
 #include "xenia/ui/windowed_app_context.h"
 #include "xenia/vfs/device.h"
+#include "xenia/vfs/devices/disc_compressed_device.h"
 #include "xenia/vfs/devices/disc_image_device.h"
 #include "xenia/vfs/devices/disc_zarchive_device.h"
 #include "xenia/vfs/devices/host_path_device.h"
@@ -71,6 +75,17 @@ DEFINE_string(
     "module.",
     "General");
 
+namespace {
+// Startup latency breakdown - logs the time since step_start_tick and resets
+// it for the next step.
+void LogStartupStep(const char* name, uint64_t& step_start_tick) {
+  uint64_t tick = xe::Clock::QueryHostTickCount();
+  XELOGI("Startup: {} took {} ms", name,
+         (tick - step_start_tick) * 1000 / xe::Clock::QueryHostTickFrequency());
+  step_start_tick = tick;
+}
+}  // namespace
+
 DEFINE_bool(allow_game_relative_writes, false,
             "Not useful to non-developers. Allows code to write to paths "
             "relative to game://. Used for "
@@ -144,6 +159,11 @@ Emulator::Emulator(const std::filesystem::path& command_line,
 }
 
 Emulator::~Emulator() {
+  if (save_thread_) {
+    xe::threading::Wait(save_thread_.get(), false);
+    save_thread_.reset();
+  }
+
   // Note that we delete things in the reverse order they were initialized.
 
   // Give the systems time to shutdown before we delete them.
@@ -179,6 +199,9 @@ X_STATUS Emulator::Setup(
         input_driver_factory) {
   X_STATUS result = X_STATUS_UNSUCCESSFUL;
 
+  const uint64_t setup_start_tick = Clock::QueryHostTickCount();
+  uint64_t step_start_tick = setup_start_tick;
+
   display_window_ = display_window;
   imgui_drawer_ = imgui_drawer;
 
@@ -199,6 +222,29 @@ X_STATUS Emulator::Setup(
   if (!memory_->Initialize()) {
     return false;
   }
+  LogStartupStep("memory", step_start_tick);
+
+  // Parsing the patch files doesn't depend on any other subsystem, do it while
+  // the CPU, the GPU and the HID are being set up. Joined at the exit from
+  // this function in case of an early return.
+  std::unique_ptr<xe::patcher::Patcher> patcher;
+  struct PatcherThreadJoiner {
+    std::unique_ptr<xe::threading::Thread> thread;
+    void Join() {
+      if (thread) {
+        xe::threading::Wait(thread.get(), false);
+        thread.reset();
+      }
+    }
+    ~PatcherThreadJoiner() { Join(); }
+  } patcher_thread_joiner;
+  patcher_thread_joiner.thread =
+      xe::threading::Thread::Create({}, [this, &patcher]() {
+        patcher = std::make_unique<xe::patcher::Patcher>(storage_root_);
+      });
+  if (patcher_thread_joiner.thread) {
+    patcher_thread_joiner.thread->set_name("Patch Loader");
+  }
 
   // Shared export resolver used to attach and query for HLE exports.
   export_resolver_ = std::make_unique<xe::cpu::ExportResolver>();
@@ -216,8 +262,14 @@ X_STATUS Emulator::Setup(
 #endif  // XE_ARCH
     }
   }
-  if (!backend && !require_cpu_backend) {
-    backend.reset(new xe::cpu::backend::NullBackend());
+  if (!backend) {
+    if (require_cpu_backend) {
+      // Only the x64 JIT exists so far, guest code can't run on other hosts.
+      XELOGE("No CPU backend '{}' is available for the host architecture",
+             cvars::cpu);
+    } else {
+      backend.reset(new xe::cpu::backend::NullBackend());
+    }
   }
 
   // Initialize the CPU.
@@ -226,6 +278,7 @@ X_STATUS Emulator::Setup(
   if (!processor_->Setup(std::move(backend))) {
     return X_STATUS_UNSUCCESSFUL;
   }
+  LogStartupStep("processor", step_start_tick);
 
   // Initialize the APU.
   if (audio_system_factory) {
@@ -235,11 +288,14 @@ X_STATUS Emulator::Setup(
     }
   }
 
+  LogStartupStep("audio system creation", step_start_tick);
+
   // Initialize the GPU.
   graphics_system_ = graphics_system_factory();
   if (!graphics_system_) {
     return X_STATUS_NOT_IMPLEMENTED;
   }
+  LogStartupStep("graphics system creation", step_start_tick);
 
   // Initialize the HID.
   input_system_ = std::make_unique<xe::hid::InputSystem>(display_window_);
@@ -260,11 +316,18 @@ X_STATUS Emulator::Setup(
   if (result) {
     return result;
   }
+  LogStartupStep("input system", step_start_tick);
 
   // Bring up the virtual filesystem used by the kernel.
   file_system_ = std::make_unique<xe::vfs::VirtualFileSystem>();
 
-  patcher_ = std::make_unique<xe::patcher::Patcher>(storage_root_);
+  patcher_thread_joiner.Join();
+  if (!patcher) {
+    // Failed to create the thread.
+    patcher = std::make_unique<xe::patcher::Patcher>(storage_root_);
+  }
+  patcher_ = std::move(patcher);
+  LogStartupStep("waiting for the patches", step_start_tick);
 
   // Shared kernel state.
   kernel_state_ = std::make_unique<xe::kernel::KernelState>(this);
@@ -277,6 +340,7 @@ X_STATUS Emulator::Setup(
 #undef LOAD_KERNEL_MODULE
   plugin_loader_ = std::make_unique<xe::patcher::PluginLoader>(
       kernel_state_.get(), storage_root() / "plugins");
+  LogStartupStep("kernel", step_start_tick);
 
   // Setup the core components.
   result = graphics_system_->Setup(
@@ -286,6 +350,7 @@ X_STATUS Emulator::Setup(
   if (result) {
     return result;
   }
+  LogStartupStep("graphics system setup", step_start_tick);
 
   if (audio_system_) {
     result = audio_system_->Setup(kernel_state_.get());
@@ -293,7 +358,9 @@ X_STATUS Emulator::Setup(
       return result;
     }
   }
-
+  LogStartupStep("audio system setup", step_start_tick);
+  step_start_tick = setup_start_tick;
+  LogStartupStep("emulator setup in total", step_start_tick);
 
   // Initialize emulator fallback exception handling last.
   ExceptionHandler::Install(Emulator::ExceptionCallbackThunk, this);
@@ -306,6 +373,7 @@ X_STATUS Emulator::TerminateTitle() {
     return X_STATUS_UNSUCCESSFUL;
   }
 
+  file_system_->EndAccessProfile();
   kernel_state_->TerminateTitle();
   title_id_ = std::nullopt;
   title_name_ = "";
@@ -331,6 +399,8 @@ const std::unique_ptr<vfs::Device> Emulator::CreateVfsDeviceBasedOnPath(
         mount_path, parent_path, !cvars::allow_game_relative_writes);
   } else if (extension == ".zar") {
     return std::make_unique<vfs::DiscZarchiveDevice>(mount_path, path);
+  } else if (extension == ".xcz") {
+    return std::make_unique<vfs::DiscCompressedDevice>(mount_path, path);
   }
   else if (extension == ".7z" || extension == ".zip" || extension == ".rar" ||
              extension == ".tar" || extension == ".gz") {
@@ -581,22 +651,61 @@ void Emulator::Resume() {
   }
 }
 
-bool Emulator::SaveToFile(const std::filesystem::path& path) {
+bool Emulator::SaveToFile(const std::filesystem::path& path, bool delta,
+                          bool background) {
+  if (delta && save_base_path_.empty()) {
+    XELOGE("No save state to save a delta against");
+    return false;
+  }
+
+  // Only one save state may be written at a time.
+  if (save_thread_) {
+    xe::threading::Wait(save_thread_.get(), false);
+    save_thread_.reset();
+  }
+  // The state being saved may be overwriting the one still mapped for
+  // restoring the memory lazily.
+  memory_->FinishLazyRestore();
+
+  const size_t max_size = 2_GiB;
+  const uint64_t pause_start_tick = Clock::QueryHostTickCount();
   Pause();
 
-  filesystem::CreateEmptyFile(path);
-  auto map = MappedMemory::Open(path, MappedMemory::Mode::kReadWrite, 0, 2_GiB);
-  if (!map) {
-    return false;
+  std::unique_ptr<MappedMemory> map;
+  uint8_t* background_buffer = nullptr;
+  if (background) {
+    // Only the pages actually written to will be allocated by the host.
+    background_buffer = static_cast<uint8_t*>(xe::memory::AllocFixed(
+        nullptr, max_size, xe::memory::AllocationType::kReserveCommit,
+        xe::memory::PageAccess::kReadWrite));
+    if (!background_buffer) {
+      Resume();
+      return false;
+    }
+  } else {
+    filesystem::CreateEmptyFile(path);
+    map = MappedMemory::Open(path, MappedMemory::Mode::kReadWrite, 0, max_size);
+    if (!map) {
+      Resume();
+      return false;
+    }
   }
 
   // Save the emulator state to a file
-  ByteStream stream(map->data(), map->size());
+  ByteStream stream(background ? background_buffer : map->data(),
+                    background ? max_size : map->size());
   stream.Write(kEmulatorSaveSignature);
   stream.Write(title_id_.has_value());
   if (title_id_.has_value()) {
     stream.Write(title_id_.value());
   }
+  stream.Write(delta);
+  if (delta) {
+    stream.Write(std::string_view(xe::path_to_utf8(save_base_path_)));
+  }
+  // Location of the memory, for restoring it again from the base of a delta.
+  size_t memory_offset_offset = stream.offset();
+  stream.Write(uint64_t(0));
 
   // It's important we don't hold the global lock here! XThreads need to step
   // forward (possibly through guarded regions) without worry!
@@ -604,16 +713,65 @@ bool Emulator::SaveToFile(const std::filesystem::path& path) {
   graphics_system_->Save(&stream);
   audio_system_->Save(&stream);
   kernel_state_->Save(&stream);
-  memory_->Save(&stream);
-  map->Close(stream.offset());
+  uint64_t memory_offset = stream.offset();
+  stream.set_offset(memory_offset_offset);
+  stream.Write(memory_offset);
+  stream.set_offset(size_t(memory_offset));
+  bool saved = memory_->Save(&stream, delta);
+  if (map) {
+    map->Close(stream.offset());
+  }
+  if (saved && !delta) {
+    save_base_path_ = std::filesystem::absolute(path);
+  }
 
   Resume();
+  XELOGI("Save state: the title was paused for {} ms",
+         (Clock::QueryHostTickCount() - pause_start_tick) * 1000 /
+             Clock::QueryHostTickFrequency());
+  if (!background) {
+    return saved;
+  }
+
+  if (!saved) {
+    xe::memory::DeallocFixed(background_buffer, max_size,
+                             xe::memory::DeallocationType::kRelease);
+    return false;
+  }
+  auto write_file = [path, background_buffer, max_size,
+                     size = size_t(stream.offset())]() {
+    FILE* file = xe::filesystem::OpenFile(path, "wb");
+    if (!file || fwrite(background_buffer, 1, size, file) != size) {
+      XELOGE("Failed to write the save state to {}", xe::path_to_utf8(path));
+    } else {
+      XELOGI("Wrote the save state to {}", xe::path_to_utf8(path));
+    }
+    if (file) {
+      fclose(file);
+    }
+    xe::memory::DeallocFixed(background_buffer, max_size,
+                             xe::memory::DeallocationType::kRelease);
+  };
+  save_thread_ = xe::threading::Thread::Create({}, write_file);
+  if (save_thread_) {
+    save_thread_->set_name("Save State Writer");
+  } else {
+    write_file();
+  }
   return true;
 }
 
 bool Emulator::RestoreFromFile(const std::filesystem::path& path) {
-  // Restore the emulator state from a file
-  auto map = MappedMemory::Open(path, MappedMemory::Mode::kReadWrite);
+  // May be restoring the save state still being written.
+  if (save_thread_) {
+    xe::threading::Wait(save_thread_.get(), false);
+    save_thread_.reset();
+  }
+
+  // Restore the emulator state from a file, kept mapped while the memory is
+  // restored lazily.
+  std::shared_ptr<MappedMemory> map =
+      MappedMemory::Open(path, MappedMemory::Mode::kRead);
   if (!map) {
     return false;
   }
@@ -644,6 +802,13 @@ bool Emulator::RestoreFromFile(const std::filesystem::path& path) {
     return false;
   }
 
+  bool delta = stream.Read<bool>();
+  std::filesystem::path base_path;
+  if (delta) {
+    base_path = xe::to_path(stream.Read<std::string>());
+  }
+  stream.Advance(sizeof(uint64_t));
+
   if (!processor_->Restore(&stream)) {
     XELOGE("Could not restore processor!");
     return false;
@@ -660,10 +825,38 @@ bool Emulator::RestoreFromFile(const std::filesystem::path& path) {
     XELOGE("Could not restore kernel state!");
     return false;
   }
-  if (!memory_->Restore(&stream)) {
+  if (delta) {
+    // The delta only has the pages changed since the base.
+    std::shared_ptr<MappedMemory> base_map =
+        MappedMemory::Open(base_path, MappedMemory::Mode::kRead);
+    if (!base_map) {
+      XELOGE("Could not open the base save state {}!",
+             xe::path_to_utf8(base_path));
+      return false;
+    }
+    ByteStream base_stream(base_map->data(), base_map->size());
+    if (base_stream.Read<uint32_t>() != kEmulatorSaveSignature) {
+      return false;
+    }
+    if (base_stream.Read<bool>()) {
+      base_stream.Advance(sizeof(uint32_t));
+    }
+    if (base_stream.Read<bool>()) {
+      XELOGE("The base save state {} is a delta!",
+             xe::path_to_utf8(base_path));
+      return false;
+    }
+    base_stream.set_offset(size_t(base_stream.Read<uint64_t>()));
+    if (!memory_->Restore(&base_stream, base_map)) {
+      XELOGE("Could not restore memory from the base save state!");
+      return false;
+    }
+  }
+  if (!memory_->Restore(&stream, map)) {
     XELOGE("Could not restore memory!");
     return false;
   }
+  save_base_path_ = delta ? base_path : std::filesystem::absolute(path);
 
   // Update the main thread.
   auto threads =
@@ -1053,16 +1246,27 @@ X_STATUS Emulator::CompleteLaunch(const std::filesystem::path& path,
   // miss the initial seconds - for instance, sound from an intro video may
   // start playing before the video can be seen if doing this in parallel with
   // the main thread.
+  uint64_t shader_storage_start_tick = Clock::QueryHostTickCount();
   on_shader_storage_initialization(true);
   graphics_system_->InitializeShaderStorage(cache_root_, title_id_.value(),
                                             true);
   on_shader_storage_initialization(false);
+  LogStartupStep("shader storage initialization", shader_storage_start_tick);
+
+  if (title_id_.value()) {
+    file_system_->BeginAccessProfile(
+        cache_root_ / "vfs_profiles" /
+        fmt::format("{:08X}.txt", title_id_.value()));
+  }
 
   auto main_thread = kernel_state_->LaunchModule(module);
   if (!main_thread) {
     return X_STATUS_UNSUCCESSFUL;
   }
   main_thread_ = main_thread;
+  // Compared with the time of the first frame logged by the GPU.
+  XELOGI("Startup: title main thread launched at host uptime {} ms",
+         Clock::QueryHostUptimeMillis());
   on_launch(title_id_.value(), title_name_);
 
   // Plugins must be loaded after calling LaunchModule() and
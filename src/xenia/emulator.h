@@ -51,7 +51,7 @@ class Window;
 
 namespace xe {
 
-constexpr fourcc_t kEmulatorSaveSignature = make_fourcc("XSAV");
+constexpr fourcc_t kEmulatorSaveSignature = make_fourcc("XSV2");
 
 // The main type that runs the whole emulator.
 // This is responsible for initializing and managing all the various subsystems.
@@ -210,7 +210,14 @@ class Emulator {
   void Pause();
   void Resume();
   bool is_paused() const { return paused_; }
-  bool SaveToFile(const std::filesystem::path& path);
+  // A delta only stores the memory changed since the last full save state
+  // saved or restored, which is needed for restoring it.
+  // In the background mode, the state is copied to host memory while the
+  // title is paused, and the title is resumed before the copy is written to
+  // the file by a background thread - in this case, the result only tells
+  // whether the state was captured, and write errors are only logged.
+  bool SaveToFile(const std::filesystem::path& path, bool delta = false,
+                  bool background = false);
   bool RestoreFromFile(const std::filesystem::path& path);
 
   // The game can request another title to be loaded.
@@ -287,6 +294,10 @@ class Emulator {
   bool paused_;
   bool restoring_;
   threading::Fence restore_fence_;  // Fired on restore finish.
+  // Last full save state saved or restored, for deltas.
+  std::filesystem::path save_base_path_;
+  // Writing the last save state captured in the background mode.
+  std::unique_ptr<xe::threading::Thread> save_thread_;
 };
 
 }  // namespace xe
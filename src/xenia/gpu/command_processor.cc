@@ -9,13 +9,16 @@
 
 #include "xenia/gpu/command_processor.h"
 
+#include <algorithm>
 #include <cinttypes>
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/byte_stream.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/platform.h"
 #include "xenia/base/profiling.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/gpu/gpu_flags.h"
 #include "xenia/gpu/graphics_system.h"
 #include "xenia/gpu/packet_disassembler.h"
@@ -45,6 +48,29 @@ DEFINE_bool(
     "of the guest thread that wrote the new read position.",
     "GPU");
 
+DEFINE_int32(gpu_command_processor_host_processor, -1,
+             "Host logical processor to pin the GPU command processor thread "
+             "to, or -1 to let the host schedule it freely.",
+             "GPU");
+
+DEFINE_int32(gpu_command_wait_max_spin_us, 500,
+             "Longest time in microseconds the GPU command processor spins "
+             "waiting for new commands before sleeping, the actual time is "
+             "learned from the recent waits. 0 to always sleep.",
+             "GPU");
+
+DEFINE_bool(skip_redundant_indirect_buffers, true,
+            "Skip indirect buffers resubmitted unchanged which only write "
+            "registers that already have the values being written.",
+            "GPU");
+
+DEFINE_bool(gpu_pm4_statistics, false,
+            "Gather the number and the time of the PM4 packets executed by the "
+            "GPU command processor by the packet type, and the number of "
+            "writes of each register, for the profiler and the benchmark "
+            "results.",
+            "GPU");
+
 DEFINE_bool(clear_memory_page_state, false,
             "Refresh state of memory pages to enable gpu written data. (Use "
             "for 'Team Ninja' Games to fix missing character models)",
@@ -75,6 +101,10 @@ CommandProcessor::CommandProcessor(GraphicsSystem* graphics_system,
       write_ptr_index_event_(xe::threading::Event::CreateAutoResetEvent(false)),
       write_ptr_index_(0) {
   assert_not_null(write_ptr_index_event_);
+  pm4_statistics_enabled_ = cvars::gpu_pm4_statistics;
+  if (pm4_statistics_enabled_) {
+    pm4_statistics_.register_write_counts.resize(RegisterFile::kRegisterCount);
+  }
 }
 
 CommandProcessor::~CommandProcessor() = default;
@@ -106,11 +136,196 @@ bool CommandProcessor::Initialize() {
         return 0;
       }, kernel_state_->GetIdleProcess()));
   worker_thread_->set_name("GPU Commands");
+  if (cvars::gpu_command_processor_host_processor >= 0 &&
+      cvars::gpu_command_processor_host_processor < 64) {
+    worker_thread_->set_host_affinity_mask(
+        uint64_t(1) << cvars::gpu_command_processor_host_processor);
+  }
   worker_thread_->Create();
 
   return true;
 }
 
+bool CommandProcessor::IsSwapPresented() {
+  if (swaps_skipped_ >= cvars::fast_forward_frame_skip) {
+    swaps_skipped_ = 0;
+    return true;
+  }
+  ++swaps_skipped_;
+  return false;
+}
+
+void CommandProcessor::GetStatistics(Statistics& statistics_out) const {
+  statistics_out.swap_count = swap_count_.load(std::memory_order_relaxed);
+  statistics_out.shader_translation_count =
+      shader_translation_count_.load(std::memory_order_relaxed);
+  statistics_out.shader_translation_host_ticks =
+      shader_translation_host_ticks_.load(std::memory_order_relaxed);
+  statistics_out.pipeline_creation_count =
+      pipeline_creation_count_.load(std::memory_order_relaxed);
+  statistics_out.texture_load_count = GetTextureLoadCount();
+  statistics_out.idle_host_ticks =
+      idle_host_ticks_.load(std::memory_order_relaxed);
+  statistics_out.idle_spin_host_ticks =
+      idle_spin_host_ticks_.load(std::memory_order_relaxed);
+}
+
+const char* CommandProcessor::GetPm4PacketCategoryName(
+    Pm4PacketCategory category) {
+  switch (category) {
+    case Pm4PacketCategory::kRegisterWrite:
+      return "register_write";
+    case Pm4PacketCategory::kSetConstant:
+      return "set_constant";
+    case Pm4PacketCategory::kDrawIndx:
+      return "draw_indx";
+    case Pm4PacketCategory::kEventWrite:
+      return "event_write";
+    case Pm4PacketCategory::kWaitRegMem:
+      return "wait_reg_mem";
+    case Pm4PacketCategory::kImLoad:
+      return "im_load";
+    case Pm4PacketCategory::kIndirectBuffer:
+      return "indirect_buffer";
+    default:
+      return "other";
+  }
+}
+
+bool CommandProcessor::GetPm4Statistics(Pm4Statistics& statistics_out) const {
+  if (!pm4_statistics_enabled_) {
+    return false;
+  }
+  statistics_out = pm4_statistics_;
+  return true;
+}
+
+void CommandProcessor::CountPm4Packet(uint32_t packet, uint32_t first_data,
+                                      uint64_t host_ticks) {
+  Pm4PacketCategory category = Pm4PacketCategory::kOther;
+  uint32_t register_first = 0, register_count = 0;
+  uint64_t* register_write_counts =
+      pm4_statistics_.register_write_counts.data();
+  switch (packet >> 30) {
+    case 0x0: {
+      category = Pm4PacketCategory::kRegisterWrite;
+      register_first = packet & 0x7FFF;
+      uint32_t count = ((packet >> 16) & 0x3FFF) + 1;
+      if ((packet >> 15) & 0x1) {
+        if (register_first < RegisterFile::kRegisterCount) {
+          register_write_counts[register_first] += count;
+        }
+      } else {
+        register_count = count;
+      }
+    } break;
+    case 0x1:
+      category = Pm4PacketCategory::kRegisterWrite;
+      register_write_counts[packet & 0x7FF] += 1;
+      register_write_counts[(packet >> 11) & 0x7FF] += 1;
+      break;
+    case 0x3: {
+      uint32_t count = ((packet >> 16) & 0x3FFF) + 1;
+      switch ((packet >> 8) & 0x7F) {
+        case PM4_SET_CONSTANT: {
+          category = Pm4PacketCategory::kSetConstant;
+          static const uint32_t kSetConstantBases[] = {0x4000, 0x4800, 0x4900,
+                                                       0x4908, 0x2000};
+          uint32_t type = (first_data >> 16) & 0xFF;
+          if (type < xe::countof(kSetConstantBases)) {
+            register_first = kSetConstantBases[type] + (first_data & 0x7FF);
+            register_count = count - 1;
+          }
+        } break;
+        case PM4_SET_CONSTANT2:
+          category = Pm4PacketCategory::kSetConstant;
+          register_first = first_data & 0xFFFF;
+          register_count = count - 1;
+          break;
+        case PM4_DRAW_INDX:
+        case PM4_DRAW_INDX_2:
+          category = Pm4PacketCategory::kDrawIndx;
+          break;
+        case PM4_EVENT_WRITE:
+        case PM4_EVENT_WRITE_SHD:
+        case PM4_EVENT_WRITE_EXT:
+        case PM4_EVENT_WRITE_ZPD:
+          category = Pm4PacketCategory::kEventWrite;
+          break;
+        case PM4_WAIT_REG_MEM:
+          category = Pm4PacketCategory::kWaitRegMem;
+          break;
+        case PM4_IM_LOAD:
+        case PM4_IM_LOAD_IMMEDIATE:
+          category = Pm4PacketCategory::kImLoad;
+          break;
+        case PM4_INDIRECT_BUFFER:
+        case PM4_INDIRECT_BUFFER_PFD:
+          category = Pm4PacketCategory::kIndirectBuffer;
+          break;
+      }
+    } break;
+  }
+  ++pm4_statistics_.packet_counts[size_t(category)];
+  pm4_statistics_.packet_host_ticks[size_t(category)] += host_ticks;
+  register_count = std::min(
+      register_count,
+      uint32_t(RegisterFile::kRegisterCount) -
+          std::min(register_first, uint32_t(RegisterFile::kRegisterCount)));
+  for (uint32_t i = 0; i < register_count; ++i) {
+    ++register_write_counts[register_first + i];
+  }
+}
+
+void CommandProcessor::EndPm4StatisticsFrame() {
+  if (!pm4_statistics_enabled_) {
+    return;
+  }
+  auto& counts = pm4_statistics_.packet_counts;
+  auto& start_counts = pm4_frame_start_statistics_.packet_counts;
+  uint64_t frame_us[size_t(Pm4PacketCategory::kCount)];
+  uint64_t host_tick_frequency = Clock::QueryHostTickFrequency();
+  for (size_t i = 0; i < size_t(Pm4PacketCategory::kCount); ++i) {
+    frame_us[i] = (pm4_statistics_.packet_host_ticks[i] -
+                           pm4_frame_start_statistics_.packet_host_ticks[i]) *
+                          1000000 / host_tick_frequency;
+  }
+#define XE_GPU_PM4_COUNT_PROFILE(category, name)                      \
+  COUNT_profile_set("gpu/pm4/" name "_count",                         \
+                    int64_t(counts[size_t(category)] -                \
+                            start_counts[size_t(category)]));         \
+  COUNT_profile_set("gpu/pm4/" name "_us",                            \
+                    int64_t(frame_us[size_t(category)]));
+  XE_GPU_PM4_COUNT_PROFILE(Pm4PacketCategory::kRegisterWrite, "register_write")
+  XE_GPU_PM4_COUNT_PROFILE(Pm4PacketCategory::kSetConstant, "set_constant")
+  XE_GPU_PM4_COUNT_PROFILE(Pm4PacketCategory::kDrawIndx, "draw_indx")
+  XE_GPU_PM4_COUNT_PROFILE(Pm4PacketCategory::kEventWrite, "event_write")
+  XE_GPU_PM4_COUNT_PROFILE(Pm4PacketCategory::kWaitRegMem, "wait_reg_mem")
+  XE_GPU_PM4_COUNT_PROFILE(Pm4PacketCategory::kImLoad, "im_load")
+  XE_GPU_PM4_COUNT_PROFILE(Pm4PacketCategory::kIndirectBuffer,
+                           "indirect_buffer")
+  XE_GPU_PM4_COUNT_PROFILE(Pm4PacketCategory::kOther, "other")
+#undef XE_GPU_PM4_COUNT_PROFILE
+  // The register counts are only needed for the totals.
+  pm4_frame_start_statistics_.packet_counts = pm4_statistics_.packet_counts;
+  pm4_frame_start_statistics_.packet_host_ticks =
+      pm4_statistics_.packet_host_ticks;
+}
+
+size_t CommandProcessor::GetFrameTimeHistory(uint32_t* durations_out) const {
+  uint64_t swap_count = swap_count_.load(std::memory_order_relaxed);
+  // The first swap has no previous one to measure the duration from.
+  size_t count = size_t(std::min(swap_count ? swap_count - 1 : 0,
+                                 uint64_t(kFrameTimeHistoryLength)));
+  for (size_t i = 0; i < count; ++i) {
+    durations_out[i] =
+        frame_time_history_us_[(swap_count - count + i) %
+                               kFrameTimeHistoryLength]
+            .load(std::memory_order_relaxed);
+  }
+  return count;
+}
+
 void CommandProcessor::Shutdown() {
   EndTracing();
 
@@ -185,6 +400,7 @@ void CommandProcessor::RestoreRegisters(uint32_t first_register,
   } else {
     std::memcpy(register_file_->values + first_register, register_values,
                 sizeof(uint32_t) * register_count);
+    register_file_->MarkRegistersWritten(first_register, register_count);
   }
 }
 
@@ -240,24 +456,8 @@ void CommandProcessor::WorkerThreadMain() {
     if (write_ptr_index == 0xBAADF00D || read_ptr_index_ == write_ptr_index) {
       SCOPE_profile_cpu_i("gpu", "xe::gpu::CommandProcessor::Stall");
       // We've run out of commands to execute.
-      // We spin here waiting for new ones, as the overhead of waiting on our
-      // event is too high.
       PrepareForWait();
-      uint32_t loop_count = 0;
-      do {
-        // If we spin around too much, revert to a "low-power" state.
-        if (loop_count > 500) {
-          const int wait_time_ms = 2;
-          xe::threading::Wait(write_ptr_index_event_.get(), true,
-                              std::chrono::milliseconds(wait_time_ms));
-        } else {
-          xe::threading::MaybeYield();
-        }
-        loop_count++;
-        write_ptr_index = write_ptr_index_.load();
-      } while (worker_running_ && pending_fns_.empty() &&
-               (write_ptr_index == 0xBAADF00D ||
-                read_ptr_index_ == write_ptr_index));
+      write_ptr_index = WaitForCommands();
       ReturnFromWait();
       if (!worker_running_ || !pending_fns_.empty()) {
         continue;
@@ -283,6 +483,91 @@ void CommandProcessor::WorkerThreadMain() {
   ShutdownContext();
 }
 
+#if XE_ARCH_AMD64 == 1
+// Waits in a low-power state until the value is written or for a few
+// microseconds (the other reasons to wake up aren't monitored).
+static void WaitForWrite(const std::atomic<uint32_t>* value,
+                         uint32_t old_value) {
+  uint64_t deadline = __rdtsc() + 30000;
+#if XE_COMPILER_MSVC == 1 && XE_COMPILER_CLANG_CL == 0
+  _umonitor(const_cast<std::atomic<uint32_t>*>(value));
+  if (value->load(std::memory_order_relaxed) == old_value) {
+    // C0.1, faster to wake up from than C0.2.
+    _umwait(1, deadline);
+  }
+#else
+  __asm__ volatile("umonitor %0" : : "r"(value) : "memory");
+  if (value->load(std::memory_order_relaxed) == old_value) {
+    __asm__ volatile("umwait %0"
+                     :
+                     : "r"(uint32_t(1)), "a"(uint32_t(deadline)),
+                       "d"(uint32_t(deadline >> 32))
+                     : "memory", "cc");
+  }
+#endif
+}
+#endif
+
+uint32_t CommandProcessor::WaitForCommands() {
+  // Spinning reacts to new commands the fastest, but while the guest isn't
+  // submitting anything for long (like until the vertical sync) it only burns
+  // a host core. So spin only while most of the recent waits were short,
+  // for up to twice as long as they took in average, and then sleep on the
+  // event.
+  auto is_waiting = [this](uint32_t write_ptr_index) {
+    return worker_running_ && pending_fns_.empty() &&
+           (write_ptr_index == 0xBAADF00D ||
+            read_ptr_index_ == write_ptr_index);
+  };
+  uint64_t max_spin_host_ticks =
+      uint64_t(std::max(cvars::gpu_command_wait_max_spin_us, int32_t(0))) *
+      Clock::QueryHostTickFrequency() / 1000000;
+  uint64_t spin_host_ticks =
+      short_wait_ratio_ >= 128
+          ? std::min(short_wait_average_host_ticks_ * 2, max_spin_host_ticks)
+          : 0;
+
+  uint64_t wait_start = Clock::QueryHostTickCount();
+  uint64_t now = wait_start;
+  uint32_t write_ptr_index = write_ptr_index_.load();
+  while (is_waiting(write_ptr_index) && now - wait_start < spin_host_ticks) {
+#if XE_ARCH_AMD64 == 1
+    if (amd64::GetFeatureFlags() & amd64::kX64WaitPkg) {
+      WaitForWrite(&write_ptr_index_, write_ptr_index);
+    } else {
+      xe::threading::MaybeYield();
+    }
+#else
+    xe::threading::MaybeYield();
+#endif
+    write_ptr_index = write_ptr_index_.load();
+    now = Clock::QueryHostTickCount();
+  }
+  uint64_t spin_end = now;
+  while (is_waiting(write_ptr_index)) {
+    // Functions called in the thread don't signal the event.
+    xe::threading::Wait(write_ptr_index_event_.get(), true,
+                        std::chrono::milliseconds(2));
+    write_ptr_index = write_ptr_index_.load();
+  }
+  uint64_t wait_end = Clock::QueryHostTickCount();
+
+  idle_host_ticks_.fetch_add(wait_end - wait_start, std::memory_order_relaxed);
+  idle_spin_host_ticks_.fetch_add(spin_end - wait_start,
+                                  std::memory_order_relaxed);
+  if (worker_running_ && pending_fns_.empty()) {
+    // Ended by new commands, learn the interval between the submissions.
+    uint64_t wait_host_ticks = wait_end - wait_start;
+    bool is_short = wait_host_ticks <= max_spin_host_ticks;
+    short_wait_ratio_ = (short_wait_ratio_ * 7 + (is_short ? 256 : 0)) / 8;
+    if (is_short) {
+      short_wait_average_host_ticks_ =
+          (short_wait_average_host_ticks_ * 7 + wait_host_ticks) / 8;
+    }
+  }
+  return write_ptr_index;
+}
+
 void CommandProcessor::Pause() {
   if (paused_) {
     return;
@@ -333,7 +618,11 @@ bool CommandProcessor::Restore(ByteStream* stream) {
   return true;
 }
 
-bool CommandProcessor::SetupContext() { return true; }
+bool CommandProcessor::SetupContext() {
+  // The backend doesn't have any state derived from the registers yet.
+  register_file_->MarkAllDirtyGroups();
+  return true;
+}
 
 void CommandProcessor::ShutdownContext() {}
 
@@ -573,6 +862,9 @@ void CommandProcessor::HandleSpecialRegisterWrite(uint32_t index,
         }
       } break;
     }
+    // The gamma ramp registers may also be read by the guest directly.
+    graphics_system_->UpdateRegisterReadShadow(index);
+    graphics_system_->UpdateRegisterReadShadow(XE_GPU_REG_DC_LUT_RW_INDEX);
   }
 }
 void CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
@@ -580,6 +872,7 @@ void CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
 
   if (XE_LIKELY(index < RegisterFile::kRegisterCount)) {
     register_file_->values[index].u32 = value;
+    register_file_->MarkRegisterWritten(index);
 
     // quick pre-test
     // todo: figure out just how unlikely this is. if very (it ought to be,
@@ -606,6 +899,104 @@ void CommandProcessor::WriteRegister(uint32_t index, uint32_t value) {
     return;
   }
 }
+bool CommandProcessor::IsRedundantIndirectBuffer(uint32_t ptr,
+                                                 uint32_t count) {
+  if (!cvars::skip_redundant_indirect_buffers || trace_writer_.is_open()) {
+    return false;
+  }
+  auto it = indirect_buffer_records_.find(ptr);
+  if (it != indirect_buffer_records_.end() && it->second.count == count &&
+      !it->second.state_only) {
+    return false;
+  }
+  const uint32_t* dwords =
+      reinterpret_cast<const uint32_t*>(memory_->TranslatePhysical(ptr));
+  uint64_t hash = XXH3_64bits(dwords, sizeof(uint32_t) * count);
+  if (it == indirect_buffer_records_.end() || it->second.count != count ||
+      it->second.hash != hash) {
+    if (indirect_buffer_records_.size() >= 4096) {
+      // Likely buffers allocated dynamically every frame.
+      indirect_buffer_records_.clear();
+    }
+    IndirectBufferRecord& record = indirect_buffer_records_[ptr];
+    record.count = count;
+    record.hash = hash;
+    record.state_only = true;
+    record.register_values.clear();
+    auto add_write = [&record](uint32_t index, uint32_t value) {
+      // Special registers perform actions on every write.
+      if (index >= RegisterFile::kRegisterCount ||
+          index - XE_GPU_REG_SCRATCH_REG0 < 8 ||
+          index == XE_GPU_REG_COHER_STATUS_HOST ||
+          index - XE_GPU_REG_DC_LUT_RW_INDEX <=
+              XE_GPU_REG_DC_LUT_30_COLOR - XE_GPU_REG_DC_LUT_RW_INDEX) {
+        record.state_only = false;
+      }
+      record.register_values.emplace_back(index, value);
+    };
+    for (uint32_t i = 0; i < count && record.state_only;) {
+      uint32_t packet = xe::byte_swap(dwords[i++]);
+      switch (packet >> 30) {
+        case 0x0: {
+          uint32_t packet_count = ((packet >> 16) & 0x3FFF) + 1;
+          // Single register writes are for registers with special handling.
+          if ((packet >> 15) & 0x1 || packet_count > count - i) {
+            record.state_only = false;
+            break;
+          }
+          uint32_t base_index = packet & 0x7FFF;
+          for (uint32_t j = 0; j < packet_count; ++j) {
+            add_write(base_index + j, xe::byte_swap(dwords[i++]));
+          }
+        } break;
+        case 0x1:
+          if (count - i < 2) {
+            record.state_only = false;
+            break;
+          }
+          add_write(packet & 0x7FF, xe::byte_swap(dwords[i++]));
+          add_write((packet >> 11) & 0x7FF, xe::byte_swap(dwords[i++]));
+          break;
+        case 0x2:
+          break;
+        default:
+          record.state_only = false;
+          break;
+      }
+    }
+    if (!record.state_only) {
+      record.register_values.clear();
+      record.register_values.shrink_to_fit();
+      return false;
+    }
+    // Only the last write to every register matters, nothing in between
+    // observes the intermediate values.
+    std::stable_sort(
+        record.register_values.begin(), record.register_values.end(),
+        [](const std::pair<uint32_t, uint32_t>& a,
+           const std::pair<uint32_t, uint32_t>& b) {
+          return a.first < b.first;
+        });
+    auto& values = record.register_values;
+    size_t unique_count = 0;
+    for (size_t j = 0; j < values.size(); ++j) {
+      if (j + 1 < values.size() && values[j + 1].first == values[j].first) {
+        continue;
+      }
+      values[unique_count++] = values[j];
+    }
+    values.resize(unique_count);
+    it = indirect_buffer_records_.find(ptr);
+  }
+  for (const auto& register_value : it->second.register_values) {
+    if (register_file_->values[register_value.first].u32 !=
+        register_value.second) {
+      return false;
+    }
+  }
+  return true;
+}
+
 void CommandProcessor::WriteRegistersFromMem(uint32_t start_index,
                                              uint32_t* base,
                                              uint32_t num_registers) {
@@ -734,6 +1125,22 @@ void CommandProcessor::PrepareForWait() { trace_writer_.Flush(); }
 
 void CommandProcessor::ReturnFromWait() {}
 
+void CommandProcessor::OcclusionQueryResolved(uint64_t query, uint32_t address,
+                                              uint64_t sample_count) {
+  auto it = occlusion_query_results_.find(address);
+  if (it == occlusion_query_results_.end()) {
+    occlusion_query_results_.emplace(address,
+                                     OcclusionQueryResult{query, sample_count});
+    return;
+  }
+  OcclusionQueryResult& result = it->second;
+  if (result.query == query) {
+    result.sample_count += sample_count;
+  } else if (result.query < query) {
+    result.query = query;
+    result.sample_count = sample_count;
+  }
+}
 
 void CommandProcessor::InitializeTrace() {
   // Write the initial register values, to be loaded directly into the
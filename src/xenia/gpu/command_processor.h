@@ -10,6 +10,7 @@
 #ifndef XENIA_GPU_COMMAND_PROCESSOR_H_
 #define XENIA_GPU_COMMAND_PROCESSOR_H_
 
+#include <array>
 #include <atomic>
 #include <cstring>
 #include <functional>
@@ -17,8 +18,12 @@
 #include <mutex>
 #include <queue>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "xenia/base/clock.h"
+#include "xenia/base/delegate.h"
 #include "xenia/base/ring_buffer.h"
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/trace_writer.h"
@@ -110,6 +115,70 @@ class CommandProcessor {
   // for instance).
   virtual void IssueSwap(uint32_t frontbuffer_ptr, uint32_t frontbuffer_width,
                          uint32_t frontbuffer_height) {}
+  // Whether the current swap should refresh the guest output, or only end the
+  // frame because it's skipped for fast-forwarding. Call once per swap.
+  bool IsSwapPresented();
+
+  // Counters for benchmarking, sampled without synchronization between them.
+  struct Statistics {
+    uint64_t swap_count;
+    uint64_t shader_translation_count;
+    // Host time spent translating the shaders, on all threads.
+    uint64_t shader_translation_host_ticks;
+    uint64_t pipeline_creation_count;
+    uint64_t texture_load_count;
+    // Host time spent waiting for new commands from the guest.
+    uint64_t idle_host_ticks;
+    // Part of the waiting time spent spinning rather than sleeping.
+    uint64_t idle_spin_host_ticks;
+  };
+  void GetStatistics(Statistics& statistics_out) const;
+
+  // Groups of PM4 packets for the statistics gathered with gpu_pm4_statistics.
+  enum class Pm4PacketCategory : uint32_t {
+    // Type 0 and type 1 packets.
+    kRegisterWrite,
+    kSetConstant,
+    kDrawIndx,
+    kEventWrite,
+    kWaitRegMem,
+    kImLoad,
+    // Including the time of the packets in the indirect buffers, which are
+    // counted in their own categories too.
+    kIndirectBuffer,
+    kOther,
+
+    kCount,
+  };
+  static const char* GetPm4PacketCategoryName(Pm4PacketCategory category);
+  struct Pm4Statistics {
+    std::array<uint64_t, size_t(Pm4PacketCategory::kCount)> packet_counts;
+    std::array<uint64_t, size_t(Pm4PacketCategory::kCount)> packet_host_ticks;
+    // Number of writes of each register by PM4 packets.
+    std::vector<uint64_t> register_write_counts;
+  };
+  // Must be called on the command processor thread, such as from an on_swap
+  // listener. Returns false if gpu_pm4_statistics is disabled.
+  bool GetPm4Statistics(Pm4Statistics& statistics_out) const;
+  // May be called by the implementations from any thread, including shader
+  // translation and pipeline creation threads.
+  void CountShaderTranslation(uint64_t host_ticks) {
+    shader_translation_count_.fetch_add(1, std::memory_order_relaxed);
+    shader_translation_host_ticks_.fetch_add(host_ticks,
+                                             std::memory_order_relaxed);
+  }
+  void CountPipelineCreation() {
+    pipeline_creation_count_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Called on the command processor thread after every guest swap with the
+  // host tick count at the time of the swap.
+  xe::Delegate<uint64_t> on_swap;
+
+  // Durations of the most recent guest frames, in microseconds, for display.
+  // Returns the number of frames written to durations_out, oldest first.
+  static constexpr size_t kFrameTimeHistoryLength = 128;
+  size_t GetFrameTimeHistory(uint32_t* durations_out) const;
 
   // May be called not only from the command processor thread when the command
   // processor is paused, and the termination of this function may be explicitly
@@ -158,6 +227,9 @@ class CommandProcessor {
   };
 
   void WorkerThreadMain();
+  // Returns the write pointer after new commands have been written, or when
+  // the worker needs to stop or to call the pending functions.
+  uint32_t WaitForCommands();
   virtual bool SetupContext() = 0;
   virtual void ShutdownContext() = 0;
   // rarely needed, most register writes have no special logic here
@@ -221,6 +293,18 @@ class CommandProcessor {
   virtual void OnGammaRamp256EntryTableValueWritten() {}
   virtual void OnGammaRampPWLValueWritten() {}
 
+  // For gpu_pm4_statistics, with the header and the first data dword (or 0 if
+  // none) of the executed packet.
+  void CountPm4Packet(uint32_t packet, uint32_t first_data,
+                      uint64_t host_ticks);
+  // Publishes the PM4 statistics of the frame to the profiler.
+  void EndPm4StatisticsFrame();
+
+  // Whether the indirect buffer only writes registers without special
+  // handling, and all of them already have the values it would write, so
+  // executing it again wouldn't change anything.
+  bool IsRedundantIndirectBuffer(uint32_t ptr, uint32_t count);
+
   virtual void MakeCoherent();
   virtual void PrepareForWait();
   virtual void ReturnFromWait();
@@ -228,6 +312,8 @@ class CommandProcessor {
   
   virtual void OnPrimaryBufferEnd() {}
 
+  virtual uint64_t GetTextureLoadCount() const { return 0; }
+
 #include "pm4_command_processor_declare.h"
 
   virtual Shader* LoadShader(xenos::ShaderType shader_type,
@@ -252,6 +338,14 @@ class CommandProcessor {
 
   virtual void InitializeTrace();
 
+  // For the implementations supporting host occlusion queries - to be called
+  // when the host sample count for draws within the guest occlusion query with
+  // the index `query` (occlusion_query_current_ at the time of the draws) is
+  // available. May be called multiple times for one guest query if the draws
+  // were spread over multiple submissions, the counts are accumulated.
+  void OcclusionQueryResolved(uint64_t query, uint32_t address,
+                              uint64_t sample_count);
+
   Memory* memory_ = nullptr;
   kernel::KernelState* kernel_state_ = nullptr;
   GraphicsSystem* graphics_system_ = nullptr;
@@ -276,6 +370,45 @@ class CommandProcessor {
   std::vector<uint32_t> me_bin_;
 
   uint32_t counter_ = 0;
+  // For logging the time of the first frame for the startup latency breakdown.
+  bool swap_issued_ = false;
+  // Swaps not presented since the last presented one, for fast-forwarding.
+  uint32_t swaps_skipped_ = 0;
+
+  std::atomic<uint64_t> swap_count_{0};
+  std::atomic<uint64_t> shader_translation_count_{0};
+  std::atomic<uint64_t> shader_translation_host_ticks_{0};
+  std::atomic<uint64_t> pipeline_creation_count_{0};
+  std::atomic<uint64_t> idle_host_ticks_{0};
+  std::atomic<uint64_t> idle_spin_host_ticks_{0};
+  // Recent waits for new commands which were short enough to spin through,
+  // as a fraction out of 256, and their average duration.
+  uint32_t short_wait_ratio_ = 0;
+  uint64_t short_wait_average_host_ticks_ = 0;
+
+  // Contents of the indirect buffers executed before, by the guest physical
+  // address, so ones resubmitted unchanged every frame to set up the same
+  // state can be skipped.
+  struct IndirectBufferRecord {
+    uint32_t count;
+    uint64_t hash;
+    // False if the buffer does anything other than plain register writes,
+    // then it's not hashed again as long as the size is the same.
+    bool state_only;
+    // Final values of the registers written by the buffer.
+    std::vector<std::pair<uint32_t, uint32_t>> register_values;
+  };
+  std::unordered_map<uint32_t, IndirectBufferRecord> indirect_buffer_records_;
+
+  // Taken from the cvar once so the packet dispatch only checks a member.
+  bool pm4_statistics_enabled_ = false;
+  Pm4Statistics pm4_statistics_ = {};
+  // Totals at the end of the previous frame.
+  Pm4Statistics pm4_frame_start_statistics_ = {};
+  uint64_t last_swap_host_tick_ = 0;
+  // Indexed by the swap count modulo the length.
+  std::array<std::atomic<uint32_t>, kFrameTimeHistoryLength>
+      frame_time_history_us_{};
 
   uint32_t primary_buffer_ptr_ = 0;
   uint32_t primary_buffer_size_ = 0;
@@ -300,6 +433,22 @@ class CommandProcessor {
   SwapPostEffect swap_post_effect_desired_ = SwapPostEffect::kNone;
   SwapPostEffect swap_post_effect_actual_ = SwapPostEffect::kNone;
 
+  // Guest occlusion queries (between the begin and the end EVENT_WRITE_ZPD).
+  // With query_occlusion_host, the implementations count the samples passed by
+  // the draws done while occlusion_query_active_ is true. The guest doesn't
+  // wait for the GPU, so on the end of a query, the latest resolved result for
+  // the same sample count address is written.
+  bool occlusion_query_active_ = false;
+  // Index of the current (or the last if none is active) guest query.
+  uint64_t occlusion_query_current_ = 0;
+  uint32_t occlusion_query_address_ = 0;
+  struct OcclusionQueryResult {
+    uint64_t query;
+    uint64_t sample_count;
+  };
+  // Keyed by the guest address of the sample counts.
+  std::unordered_map<uint32_t, OcclusionQueryResult> occlusion_query_results_;
+
  private:
   reg::DC_LUT_30_COLOR gamma_ramp_256_entry_table_[256] = {};
   reg::DC_LUT_PWL_DATA gamma_ramp_pwl_rgb_[128][3] = {};
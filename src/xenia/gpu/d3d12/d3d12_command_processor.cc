@@ -45,6 +45,11 @@ DEFINE_bool(d3d12_readback_resolve, false,
             "causes mid-frame synchronization, so it has a huge performance "
             "impact.",
             "D3D12");
+DEFINE_bool(d3d12_enhanced_barriers, false,
+            "Use enhanced barriers for buffers where available, synchronizing "
+            "only the pipeline stages that actually access the buffers "
+            "instead of using legacy resource state transitions.",
+            "D3D12");
 DEFINE_bool(d3d12_submit_on_primary_buffer_end, true,
             "Submit the command list when a PM4 primary buffer ends if it's "
             "possible to submit immediately to try to reduce frame latency.",
@@ -152,7 +157,109 @@ void D3D12CommandProcessor::PushUAVBarrier(ID3D12Resource* resource) {
   barriers_.push_back(barrier);
 }
 
+// Synchronization scope and accesses of a buffer in a legacy resource state.
+static void GetBufferBarrierScope(D3D12_RESOURCE_STATES state,
+                                  D3D12_BARRIER_SYNC& sync_out,
+                                  D3D12_BARRIER_ACCESS& access_out) {
+  D3D12_BARRIER_SYNC sync = D3D12_BARRIER_SYNC_NONE;
+  D3D12_BARRIER_ACCESS access = D3D12_BARRIER_ACCESS_COMMON;
+  if (state & D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER) {
+    sync |= D3D12_BARRIER_SYNC_ALL_SHADING;
+    access |= D3D12_BARRIER_ACCESS_VERTEX_BUFFER |
+              D3D12_BARRIER_ACCESS_CONSTANT_BUFFER;
+  }
+  if (state & D3D12_RESOURCE_STATE_INDEX_BUFFER) {
+    sync |= D3D12_BARRIER_SYNC_INDEX_INPUT;
+    access |= D3D12_BARRIER_ACCESS_INDEX_BUFFER;
+  }
+  if (state & D3D12_RESOURCE_STATE_UNORDERED_ACCESS) {
+    sync |= D3D12_BARRIER_SYNC_ALL_SHADING |
+            D3D12_BARRIER_SYNC_CLEAR_UNORDERED_ACCESS_VIEW;
+    access |= D3D12_BARRIER_ACCESS_UNORDERED_ACCESS;
+  }
+  if (state & D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE) {
+    sync |= D3D12_BARRIER_SYNC_NON_PIXEL_SHADING;
+    access |= D3D12_BARRIER_ACCESS_SHADER_RESOURCE;
+  }
+  if (state & D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE) {
+    sync |= D3D12_BARRIER_SYNC_PIXEL_SHADING;
+    access |= D3D12_BARRIER_ACCESS_SHADER_RESOURCE;
+  }
+  if (state & D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT) {
+    sync |= D3D12_BARRIER_SYNC_EXECUTE_INDIRECT;
+    access |= D3D12_BARRIER_ACCESS_INDIRECT_ARGUMENT;
+  }
+  if (state & D3D12_RESOURCE_STATE_COPY_DEST) {
+    sync |= D3D12_BARRIER_SYNC_COPY;
+    access |= D3D12_BARRIER_ACCESS_COPY_DEST;
+  }
+  if (state & D3D12_RESOURCE_STATE_COPY_SOURCE) {
+    sync |= D3D12_BARRIER_SYNC_COPY;
+    access |= D3D12_BARRIER_ACCESS_COPY_SOURCE;
+  }
+  constexpr D3D12_RESOURCE_STATES kKnownStates =
+      D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER |
+      D3D12_RESOURCE_STATE_INDEX_BUFFER |
+      D3D12_RESOURCE_STATE_UNORDERED_ACCESS |
+      D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE |
+      D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE |
+      D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT |
+      D3D12_RESOURCE_STATE_COPY_DEST | D3D12_RESOURCE_STATE_COPY_SOURCE;
+  if (state == D3D12_RESOURCE_STATE_COMMON || (state & ~kKnownStates)) {
+    // Any access.
+    sync = D3D12_BARRIER_SYNC_ALL;
+    access = D3D12_BARRIER_ACCESS_COMMON;
+  }
+  sync_out = sync;
+  access_out = access;
+}
+
 void D3D12CommandProcessor::SubmitBarriers() {
+  if (command_list_7_ && !barriers_.empty()) {
+    // Buffers don't have layouts, so with enhanced barriers, only the
+    // synchronization between the work actually accessing them is needed,
+    // while legacy state transitions may make the driver wait for much more
+    // (like all pixel shaders for a transition from PIXEL_SHADER_RESOURCE).
+    // All barriers for buffers must go through this path so the legacy state
+    // of the buffers is never relied upon. Textures keep using legacy barriers.
+    buffer_barriers_.clear();
+    size_t legacy_barrier_count = 0;
+    for (size_t i = 0; i < barriers_.size(); ++i) {
+      const D3D12_RESOURCE_BARRIER& barrier = barriers_[i];
+      ID3D12Resource* resource = nullptr;
+      if (barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION) {
+        resource = barrier.Transition.pResource;
+      } else if (barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_UAV) {
+        resource = barrier.UAV.pResource;
+      }
+      if (!resource ||
+          resource->GetDesc().Dimension != D3D12_RESOURCE_DIMENSION_BUFFER) {
+        barriers_[legacy_barrier_count++] = barrier;
+        continue;
+      }
+      D3D12_BUFFER_BARRIER& buffer_barrier = buffer_barriers_.emplace_back();
+      if (barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION) {
+        GetBufferBarrierScope(barrier.Transition.StateBefore,
+                              buffer_barrier.SyncBefore,
+                              buffer_barrier.AccessBefore);
+        GetBufferBarrierScope(barrier.Transition.StateAfter,
+                              buffer_barrier.SyncAfter,
+                              buffer_barrier.AccessAfter);
+      } else {
+        GetBufferBarrierScope(D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+                              buffer_barrier.SyncBefore,
+                              buffer_barrier.AccessBefore);
+        buffer_barrier.SyncAfter = buffer_barrier.SyncBefore;
+        buffer_barrier.AccessAfter = buffer_barrier.AccessBefore;
+      }
+      buffer_barrier.pResource = resource;
+      buffer_barrier.Offset = 0;
+      buffer_barrier.Size = UINT64_MAX;
+    }
+    barriers_.resize(legacy_barrier_count);
+    deferred_command_list_.D3DBufferBarrier(UINT(buffer_barriers_.size()),
+                                            buffer_barriers_.data());
+  }
   UINT barrier_count = UINT(barriers_.size());
   if (barrier_count != 0) {
     deferred_command_list_.D3DResourceBarrier(barrier_count, barriers_.data());
@@ -874,6 +981,10 @@ bool D3D12CommandProcessor::SetupContext() {
   command_list_->Close();
   // Optional - added in Creators Update (SDK 10.0.15063.0).
   command_list_->QueryInterface(IID_PPV_ARGS(&command_list_1_));
+  if (cvars::d3d12_enhanced_barriers &&
+      provider.AreEnhancedBarriersSupported()) {
+    command_list_->QueryInterface(IID_PPV_ARGS(&command_list_7_));
+  }
 
   bindless_resources_used_ =
       cvars::d3d12_bindless &&
@@ -1631,6 +1742,7 @@ bool D3D12CommandProcessor::SetupContext() {
 
   // Just not to expose uninitialized memory.
   std::memset(&system_constants_, 0, sizeof(system_constants_));
+  last_system_constant_inputs_valid_ = false;
 
   return true;
 }
@@ -1641,6 +1753,22 @@ void D3D12CommandProcessor::ShutdownContext() {
   ui::d3d12::util::ReleaseAndNull(readback_buffer_);
   readback_buffer_size_ = 0;
 
+  ui::d3d12::util::ReleaseAndNull(occlusion_query_heap_current_.heap);
+  ui::d3d12::util::ReleaseAndNull(
+      occlusion_query_heap_current_.readback_buffer);
+  occlusion_query_heap_current_.guest_queries.clear();
+  for (const OcclusionQueryHeap& query_heap :
+       occlusion_query_heaps_submitted_) {
+    query_heap.heap->Release();
+    query_heap.readback_buffer->Release();
+  }
+  occlusion_query_heaps_submitted_.clear();
+  for (const OcclusionQueryHeap& query_heap : occlusion_query_heaps_free_) {
+    query_heap.heap->Release();
+    query_heap.readback_buffer->Release();
+  }
+  occlusion_query_heaps_free_.clear();
+
   ui::d3d12::util::ReleaseAndNull(scratch_buffer_);
   scratch_buffer_size_ = 0;
 
@@ -1708,6 +1836,7 @@ void D3D12CommandProcessor::ShutdownContext() {
   shared_memory_.reset();
 
   deferred_command_list_.Reset();
+  ui::d3d12::util::ReleaseAndNull(command_list_7_);
   ui::d3d12::util::ReleaseAndNull(command_list_1_);
   ui::d3d12::util::ReleaseAndNull(command_list_);
   ClearCommandAllocatorCache();
@@ -1770,6 +1899,7 @@ void D3D12CommandProcessor::WriteRegisterForceinline(uint32_t index,
   __m128i is_below_upper = _mm_cmplt_epi16(to_rangecheck, upper_bounds);
   __m128i is_within_range = _mm_and_si128(is_above_lower, is_below_upper);
   register_file_->values[index].u32 = value;
+  register_file_->MarkRegisterWritten(index);
 
   uint32_t movmask = static_cast<uint32_t>(_mm_movemask_epi8(is_within_range));
 
@@ -2049,6 +2179,7 @@ void D3D12CommandProcessor::WritePossiblySpecialRegistersFromMem(
     uint32_t value = xe::load_and_swap<uint32_t>(base);
 
     register_file_->values[index].u32 = value;
+    register_file_->MarkRegisterWritten(index);
 
     unsigned expr = 0;
 
@@ -2076,8 +2207,9 @@ D3D12CommandProcessor::WriteRegisterRangeFromMem_WithKnownBound(
   auto get_end_before_qty = [&end, current_index](uint32_t regnum) {
     return std::min<uint32_t>(regnum, end) - current_index;
   };
-#define REGULAR_WRITE_CALLBACK(s, e, i, b, n) \
-  copy_and_swap_32_unaligned(&register_file_->values[i], b, n)
+#define REGULAR_WRITE_CALLBACK(s, e, i, b, n)                     \
+  copy_and_swap_32_unaligned(&register_file_->values[i], b, n); \
+  register_file_->MarkRegistersWritten(i, n)
 #define WRITE_FETCH_CONSTANTS_CALLBACK(str, er, ind, b, n) \
   WriteFetchFromMem(ind, b, n)
 #define SPECIAL_REG_RANGE_CALLBACK(str, edr, ind, bs, n) \
@@ -2195,6 +2327,11 @@ void D3D12CommandProcessor::IssueSwap(uint32_t frontbuffer_ptr,
     return;
   }
 
+  if (!IsSwapPresented()) {
+    EndSubmission(true);
+    return;
+  }
+
   // Obtain the actual front buffer size to pass to RefreshGuestOutput,
   // resolution-scaled if it's a resolve destination, or not otherwise.
   D3D12_SHADER_RESOURCE_VIEW_DESC swap_texture_srv_desc;
@@ -2622,8 +2759,12 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
     return true;
   }
 
+  if (register_file_->ConsumeDirtyGroup(
+          RegisterDirtyGroup::kNormalizedDepthControl)) {
+    last_normalized_depth_control_ = draw_util::GetNormalizedDepthControl(regs);
+  }
   reg::RB_DEPTHCONTROL normalized_depth_control =
-      draw_util::GetNormalizedDepthControl(regs);
+      last_normalized_depth_control_;
 
   // Shader modifications.
   uint32_t ps_param_gen_pos = UINT32_MAX;
@@ -2642,6 +2783,10 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
                          *pixel_shader, interpolator_mask, ps_param_gen_pos,
                          normalized_depth_control)
                    : DxbcShaderTranslator::Modification(0);
+  if (pixel_shader) {
+    pipeline_cache_->SpecializePixelShaderModification(
+        *pixel_shader, pixel_shader_modification);
+  }
 
   // Set up the render targets - this may perform dispatches and draws.
   uint32_t normalized_color_mask =
@@ -2710,30 +2855,34 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
   // Get dynamic rasterizer state.
   uint32_t draw_resolution_scale_x = texture_cache_->draw_resolution_scale_x();
   uint32_t draw_resolution_scale_y = texture_cache_->draw_resolution_scale_y();
-  draw_util::ViewportInfo viewport_info;
-  draw_util::GetViewportInfoArgs gviargs{};
-
-  gviargs.Setup(
-      draw_resolution_scale_x, draw_resolution_scale_y,
-      texture_cache_->draw_resolution_scale_x_divisor(),
-      texture_cache_->draw_resolution_scale_y_divisor(), true,
-      D3D12_VIEWPORT_BOUNDS_MAX, D3D12_VIEWPORT_BOUNDS_MAX, false,
-      normalized_depth_control,
-      host_render_targets_used &&
-          render_target_cache_->depth_float24_convert_in_pixel_shader(),
-      host_render_targets_used, pixel_shader && pixel_shader->writes_depth());
-  gviargs.SetupRegisterValues(regs);
-
-  if (gviargs == previous_viewport_info_args_) {
-    viewport_info = previous_viewport_info_;
-  } else {
-    draw_util::GetHostViewportInfo(&gviargs, viewport_info);
-    previous_viewport_info_args_ = gviargs;
-    previous_viewport_info_ = viewport_info;
-  }
+  // Aside from the registers, only the depth control and the pixel shader
+  // depth output may change between draws.
+  bool pixel_shader_writes_depth = pixel_shader && pixel_shader->writes_depth();
+  if (register_file_->ConsumeDirtyGroup(RegisterDirtyGroup::kViewport) ||
+      normalized_depth_control.value !=
+          last_viewport_normalized_depth_control_.value ||
+      pixel_shader_writes_depth != last_viewport_pixel_shader_writes_depth_) {
+    draw_util::GetViewportInfoArgs gviargs{};
+    gviargs.Setup(
+        draw_resolution_scale_x, draw_resolution_scale_y,
+        texture_cache_->draw_resolution_scale_x_divisor(),
+        texture_cache_->draw_resolution_scale_y_divisor(), true,
+        D3D12_VIEWPORT_BOUNDS_MAX, D3D12_VIEWPORT_BOUNDS_MAX, false,
+        normalized_depth_control,
+        host_render_targets_used &&
+            render_target_cache_->depth_float24_convert_in_pixel_shader(),
+        host_render_targets_used, pixel_shader_writes_depth);
+    gviargs.SetupRegisterValues(regs);
+    draw_util::GetHostViewportInfo(&gviargs, previous_viewport_info_);
+    last_viewport_normalized_depth_control_ = normalized_depth_control;
+    last_viewport_pixel_shader_writes_depth_ = pixel_shader_writes_depth;
+  }
+  const draw_util::ViewportInfo& viewport_info = previous_viewport_info_;
   // todo: use SIMD for getscissor + scaling here, should reduce code size more
-  draw_util::Scissor scissor;
-  draw_util::GetScissor(regs, scissor);
+  if (register_file_->ConsumeDirtyGroup(RegisterDirtyGroup::kScissor)) {
+    draw_util::GetScissor(regs, last_scissor_);
+  }
+  draw_util::Scissor scissor = last_scissor_;
 #if XE_ARCH_AMD64 == 1
   __m128i* scisp = (__m128i*)&scissor;
   *scisp = _mm_mullo_epi32(
@@ -2915,6 +3064,13 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
   SetPrimitiveTopology(primitive_topology);
   // Must not call anything that may change the primitive topology from now on!
 
+  // Obtain the query for counting the samples for the guest occlusion query.
+  ID3D12QueryHeap* occlusion_query_heap = nullptr;
+  UINT occlusion_query = 0;
+  if (occlusion_query_active_) {
+    occlusion_query_heap = RequestOcclusionQuery(occlusion_query);
+  }
+
   // Draw.
   if (primitive_processing_result.index_buffer_type ==
       PrimitiveProcessor::ProcessedIndexBufferType::kNone) {
@@ -2925,6 +3081,10 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
       shared_memory_->UseForWriting();
     }
     SubmitBarriers();
+    if (occlusion_query_heap) {
+      deferred_command_list_.D3DBeginQuery(
+          occlusion_query_heap, D3D12_QUERY_TYPE_OCCLUSION, occlusion_query);
+    }
     deferred_command_list_.D3DDrawInstanced(
         primitive_processing_result.host_draw_vertex_count, 1, 0, 0);
   } else {
@@ -2990,6 +3150,10 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
       shared_memory_->UseForReading();
     }
     SubmitBarriers();
+    if (occlusion_query_heap) {
+      deferred_command_list_.D3DBeginQuery(
+          occlusion_query_heap, D3D12_QUERY_TYPE_OCCLUSION, occlusion_query);
+    }
     deferred_command_list_.D3DDrawIndexedInstanced(
         primitive_processing_result.host_draw_vertex_count, 1, 0, 0, 0);
     if (scratch_index_buffer != nullptr) {
@@ -2997,6 +3161,10 @@ bool D3D12CommandProcessor::IssueDraw(xenos::PrimitiveType primitive_type,
                               D3D12_RESOURCE_STATE_INDEX_BUFFER);
     }
   }
+  if (occlusion_query_heap) {
+    deferred_command_list_.D3DEndQuery(
+        occlusion_query_heap, D3D12_QUERY_TYPE_OCCLUSION, occlusion_query);
+  }
 
   if (memexport_used) {
     // Make sure this memexporting draw is ordered with other work using shared
@@ -3224,6 +3392,48 @@ void D3D12CommandProcessor::CheckSubmissionFence(uint64_t await_submission) {
     resources_for_deletion_.pop_front();
   }
 
+  // Report the sample counts of the completed occlusion queries and reclaim
+  // the query heaps.
+  while (!occlusion_query_heaps_submitted_.empty()) {
+    OcclusionQueryHeap& query_heap = occlusion_query_heaps_submitted_.front();
+    if (query_heap.submission > submission_completed_) {
+      break;
+    }
+    uint32_t query_count = uint32_t(query_heap.guest_queries.size());
+    D3D12_RANGE readback_range;
+    readback_range.Begin = 0;
+    readback_range.End = sizeof(uint64_t) * query_count;
+    void* readback_mapping;
+    if (SUCCEEDED(query_heap.readback_buffer->Map(0, &readback_range,
+                                                  &readback_mapping))) {
+      const uint64_t* results =
+          reinterpret_cast<const uint64_t*>(readback_mapping);
+      // Report the counts as if the draws were done at 1x resolution.
+      uint64_t resolution_scale =
+          uint64_t(texture_cache_->draw_resolution_scale_x()) *
+          texture_cache_->draw_resolution_scale_y();
+      uint64_t sample_count = 0;
+      for (uint32_t i = 0; i < query_count; ++i) {
+        sample_count += results[i];
+        const std::pair<uint64_t, uint32_t>& guest_query =
+            query_heap.guest_queries[i];
+        if (i + 1 >= query_count ||
+            query_heap.guest_queries[i + 1] != guest_query) {
+          OcclusionQueryResolved(guest_query.first, guest_query.second,
+                                 sample_count / resolution_scale);
+          sample_count = 0;
+        }
+      }
+      D3D12_RANGE readback_write_range = {};
+      query_heap.readback_buffer->Unmap(0, &readback_write_range);
+    } else {
+      XELOGE("Failed to map the occlusion query readback buffer");
+    }
+    query_heap.guest_queries.clear();
+    occlusion_query_heaps_free_.push_back(std::move(query_heap));
+    occlusion_query_heaps_submitted_.pop_front();
+  }
+
   shared_memory_->CompletedSubmissionUpdated();
 
   render_target_cache_->CompletedSubmissionUpdated();
@@ -3404,6 +3614,8 @@ bool D3D12CommandProcessor::EndSubmission(bool is_swap) {
 
     pipeline_cache_->EndSubmission();
 
+    SubmitOcclusionQueryHeap();
+
     // Submit barriers now because resources with the queued barriers may be
     // destroyed between frames.
     SubmitBarriers();
@@ -3419,7 +3631,8 @@ bool D3D12CommandProcessor::EndSubmission(bool is_swap) {
         command_allocator_writable_first_->command_allocator;
     command_allocator->Reset();
     command_list_->Reset(command_allocator, nullptr);
-    deferred_command_list_.Execute(command_list_, command_list_1_);
+    deferred_command_list_.Execute(command_list_, command_list_1_,
+                                   command_list_7_);
     command_list_->Close();
     ID3D12CommandList* execute_command_lists[] = {command_list_};
     direct_queue->ExecuteCommandLists(1, execute_command_lists);
@@ -3884,34 +4097,7 @@ XE_NOINLINE void D3D12CommandProcessor::UpdateSystemConstantValues_Impl(
   // Texture signedness / gamma.
   bool gamma_render_target_as_srgb =
       render_target_cache_->gamma_render_target_as_srgb();
-  uint32_t textures_resolved = 0;
-  uint32_t textures_remaining = used_texture_mask;
-  uint32_t texture_index;
-  while (xe::bit_scan_forward(textures_remaining, &texture_index)) {
-    textures_remaining = xe::clear_lowest_bit(textures_remaining);
-    uint32_t& texture_signs_uint =
-        system_constants_.texture_swizzled_signs[texture_index >> 2];
-    uint32_t texture_signs_shift = (texture_index & 3) * 8;
-    uint8_t texture_signs =
-        texture_cache_->GetActiveTextureSwizzledSigns(texture_index);
-    uint32_t texture_signs_shifted = uint32_t(texture_signs)
-                                     << texture_signs_shift;
-    uint32_t texture_signs_mask = uint32_t(0b11111111) << texture_signs_shift;
-
-    update_dirty_uint32_cmp((texture_signs_uint & texture_signs_mask),
-                            texture_signs_shifted);
-
-    texture_signs_uint =
-        (texture_signs_uint & ~texture_signs_mask) | texture_signs_shifted;
-    // cache misses here, we're accessing the texture bindings out of order
-    textures_resolved |=
-        uint32_t(texture_cache_->IsActiveTextureResolved(texture_index))
-        << texture_index;
-  }
-
-  update_dirty_uint32_cmp(system_constants_.textures_resolved,
-                          textures_resolved);
-  system_constants_.textures_resolved = textures_resolved;
+  dirty |= UpdateSystemConstantTextureValues(used_texture_mask);
 
   // Log2 of sample count, for alpha to mask and with ROV, for EDRAM address
   // calculation with MSAA.
@@ -4180,12 +4366,71 @@ XE_NOINLINE void D3D12CommandProcessor::UpdateSystemConstantValues_Impl(
   cbuffer_binding_system_.up_to_date &= !dirty;
 }
 
+uint32_t D3D12CommandProcessor::UpdateSystemConstantTextureValues(
+    uint32_t used_texture_mask) {
+  uint32_t dirty = 0;
+  uint32_t textures_resolved = 0;
+  uint32_t textures_remaining = used_texture_mask;
+  uint32_t texture_index;
+  while (xe::bit_scan_forward(textures_remaining, &texture_index)) {
+    textures_remaining = xe::clear_lowest_bit(textures_remaining);
+    uint32_t& texture_signs_uint =
+        system_constants_.texture_swizzled_signs[texture_index >> 2];
+    uint32_t texture_signs_shift = (texture_index & 3) * 8;
+    uint8_t texture_signs =
+        texture_cache_->GetActiveTextureSwizzledSigns(texture_index);
+    uint32_t texture_signs_shifted = uint32_t(texture_signs)
+                                     << texture_signs_shift;
+    uint32_t texture_signs_mask = uint32_t(0b11111111) << texture_signs_shift;
+
+    dirty |= (texture_signs_uint & texture_signs_mask) ^ texture_signs_shifted;
+
+    texture_signs_uint =
+        (texture_signs_uint & ~texture_signs_mask) | texture_signs_shifted;
+    // cache misses here, we're accessing the texture bindings out of order
+    textures_resolved |=
+        uint32_t(texture_cache_->IsActiveTextureResolved(texture_index))
+        << texture_index;
+  }
+
+  dirty |= system_constants_.textures_resolved ^ textures_resolved;
+  system_constants_.textures_resolved = textures_resolved;
+  return dirty;
+}
+
 void D3D12CommandProcessor::UpdateSystemConstantValues(
     bool shared_memory_is_uav, bool primitive_polygonal,
     uint32_t line_loop_closing_index, xenos::Endian index_endian,
     const draw_util::ViewportInfo& viewport_info, uint32_t used_texture_mask,
     reg::RB_DEPTHCONTROL normalized_depth_control,
     uint32_t normalized_color_mask) {
+  // Skip the derivation if neither the registers nor the other inputs have
+  // changed since the last draw - only the texture bindings may change without
+  // any register writes.
+  SystemConstantInputs inputs;
+  std::memset(&inputs, 0, sizeof(inputs));
+  inputs.shared_memory_is_uav = uint32_t(shared_memory_is_uav);
+  inputs.primitive_polygonal = uint32_t(primitive_polygonal);
+  inputs.line_loop_closing_index = line_loop_closing_index;
+  inputs.index_endian = uint32_t(index_endian);
+  inputs.used_texture_mask = used_texture_mask;
+  inputs.normalized_depth_control = normalized_depth_control.value;
+  inputs.normalized_color_mask = normalized_color_mask;
+  inputs.prim_type =
+      uint32_t(register_file_->Get<reg::VGT_DRAW_INITIATOR>().prim_type);
+  inputs.viewport_info = viewport_info;
+  if (!register_file_->ConsumeDirtyGroup(
+          RegisterDirtyGroup::kSystemConstants) &&
+      last_system_constant_inputs_valid_ &&
+      !std::memcmp(&inputs, &last_system_constant_inputs_, sizeof(inputs))) {
+    if (UpdateSystemConstantTextureValues(used_texture_mask)) {
+      cbuffer_binding_system_.up_to_date = false;
+    }
+    return;
+  }
+  last_system_constant_inputs_ = inputs;
+  last_system_constant_inputs_valid_ = true;
+
   bool edram_rov_used = render_target_cache_->GetPath() ==
                         RenderTargetCache::Path::kPixelShaderInterlock;
 
@@ -5125,6 +5370,72 @@ ID3D12Resource* D3D12CommandProcessor::RequestReadbackBuffer(uint32_t size) {
   return readback_buffer_;
 }
 
+ID3D12QueryHeap* D3D12CommandProcessor::RequestOcclusionQuery(
+    UINT& query_out) {
+  assert_true(submission_open_);
+  if (occlusion_query_heap_current_.heap &&
+      occlusion_query_heap_current_.guest_queries.size() >=
+          kOcclusionQueryHeapSize) {
+    SubmitOcclusionQueryHeap();
+  }
+  if (!occlusion_query_heap_current_.heap) {
+    if (!occlusion_query_heaps_free_.empty()) {
+      occlusion_query_heap_current_ =
+          std::move(occlusion_query_heaps_free_.back());
+      occlusion_query_heaps_free_.pop_back();
+    } else {
+      const ui::d3d12::D3D12Provider& provider = GetD3D12Provider();
+      ID3D12Device* device = provider.GetDevice();
+      D3D12_QUERY_HEAP_DESC query_heap_desc;
+      query_heap_desc.Type = D3D12_QUERY_HEAP_TYPE_OCCLUSION;
+      query_heap_desc.Count = kOcclusionQueryHeapSize;
+      query_heap_desc.NodeMask = 0;
+      ID3D12QueryHeap* query_heap;
+      if (FAILED(device->CreateQueryHeap(&query_heap_desc,
+                                         IID_PPV_ARGS(&query_heap)))) {
+        XELOGE("Failed to create an occlusion query heap");
+        return nullptr;
+      }
+      D3D12_RESOURCE_DESC buffer_desc;
+      ui::d3d12::util::FillBufferResourceDesc(
+          buffer_desc, sizeof(uint64_t) * kOcclusionQueryHeapSize,
+          D3D12_RESOURCE_FLAG_NONE);
+      ID3D12Resource* readback_buffer;
+      if (FAILED(device->CreateCommittedResource(
+              &ui::d3d12::util::kHeapPropertiesReadback,
+              provider.GetHeapFlagCreateNotZeroed(), &buffer_desc,
+              D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+              IID_PPV_ARGS(&readback_buffer)))) {
+        XELOGE("Failed to create an occlusion query readback buffer");
+        query_heap->Release();
+        return nullptr;
+      }
+      occlusion_query_heap_current_.heap = query_heap;
+      occlusion_query_heap_current_.readback_buffer = readback_buffer;
+    }
+  }
+  query_out = UINT(occlusion_query_heap_current_.guest_queries.size());
+  occlusion_query_heap_current_.guest_queries.emplace_back(
+      occlusion_query_current_, occlusion_query_address_);
+  return occlusion_query_heap_current_.heap;
+}
+
+void D3D12CommandProcessor::SubmitOcclusionQueryHeap() {
+  if (!occlusion_query_heap_current_.heap) {
+    return;
+  }
+  deferred_command_list_.D3DResolveQueryData(
+      occlusion_query_heap_current_.heap, D3D12_QUERY_TYPE_OCCLUSION, 0,
+      UINT(occlusion_query_heap_current_.guest_queries.size()),
+      occlusion_query_heap_current_.readback_buffer, 0);
+  occlusion_query_heap_current_.submission = submission_current_;
+  occlusion_query_heaps_submitted_.push_back(
+      std::move(occlusion_query_heap_current_));
+  occlusion_query_heap_current_.heap = nullptr;
+  occlusion_query_heap_current_.readback_buffer = nullptr;
+  occlusion_query_heap_current_.guest_queries.clear();
+}
+
 void D3D12CommandProcessor::WriteGammaRampSRV(
     bool is_pwl, D3D12_CPU_DESCRIPTOR_HANDLE handle) const {
   ID3D12Device* device = GetD3D12Provider().GetDevice();
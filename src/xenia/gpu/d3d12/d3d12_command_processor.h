@@ -311,6 +311,10 @@ class D3D12CommandProcessor final : public CommandProcessor {
   void IssueSwap(uint32_t frontbuffer_ptr, uint32_t frontbuffer_width,
                  uint32_t frontbuffer_height) override;
 
+  uint64_t GetTextureLoadCount() const override {
+    return texture_cache_ ? texture_cache_->texture_load_count() : 0;
+  }
+
   void OnPrimaryBufferEnd() override;
 
   Shader* LoadShader(xenos::ShaderType shader_type, uint32_t guest_address,
@@ -467,6 +471,8 @@ class D3D12CommandProcessor final : public CommandProcessor {
       uint32_t used_texture_mask, reg::RB_DEPTHCONTROL normalized_depth_control,
       uint32_t normalized_color_mask);
 
+  // Returns non-zero if the texture-dependent system constants have changed.
+  uint32_t UpdateSystemConstantTextureValues(uint32_t used_texture_mask);
   void UpdateSystemConstantValues(bool shared_memory_is_uav,
                                   bool primitive_polygonal,
                                   uint32_t line_loop_closing_index,
@@ -496,6 +502,15 @@ class D3D12CommandProcessor final : public CommandProcessor {
   // synchronizing immediately after use. Always in COPY_DEST state.
   ID3D12Resource* RequestReadbackBuffer(uint32_t size);
 
+  // Returns the heap and the index of a host occlusion query for counting the
+  // samples of a draw within the active guest occlusion query, or nullptr in
+  // case of a failure. Submission must be open.
+  ID3D12QueryHeap* RequestOcclusionQuery(UINT& query_out);
+  // Resolves the results of the queries in the current occlusion query heap,
+  // if there's one, and makes it pending completion of the current
+  // submission.
+  void SubmitOcclusionQueryHeap();
+
   void WriteGammaRampSRV(bool is_pwl, D3D12_CPU_DESCRIPTOR_HANDLE handle) const;
 
   bool device_removed_ = false;
@@ -537,6 +552,8 @@ class D3D12CommandProcessor final : public CommandProcessor {
   CommandAllocator* command_allocator_submitted_last_ = nullptr;
   ID3D12GraphicsCommandList* command_list_ = nullptr;
   ID3D12GraphicsCommandList1* command_list_1_ = nullptr;
+  // Only if enhanced barriers are used.
+  ID3D12GraphicsCommandList7* command_list_7_ = nullptr;
   DeferredCommandList deferred_command_list_;
 
   // Should bindless textures and samplers be used - many times faster
@@ -682,6 +699,8 @@ class D3D12CommandProcessor final : public CommandProcessor {
 
   // Unsubmitted barrier batch.
   std::vector<D3D12_RESOURCE_BARRIER> barriers_;
+  // Buffer barriers from the batch converted to enhanced barriers.
+  std::vector<D3D12_BUFFER_BARRIER> buffer_barriers_;
 
   // <Submission where requested, resource>, sorted by the submission number.
   std::deque<std::pair<uint64_t, ID3D12Resource*>> resources_for_deletion_;
@@ -696,6 +715,24 @@ class D3D12CommandProcessor final : public CommandProcessor {
   ID3D12Resource* readback_buffer_ = nullptr;
   uint32_t readback_buffer_size_ = 0;
 
+  // Host occlusion queries for the draws within guest occlusion queries - one
+  // per draw. The results are resolved to a readback buffer in the end of the
+  // submission, and read when it's completed, without waiting.
+  static constexpr uint32_t kOcclusionQueryHeapSize = 1024;
+  struct OcclusionQueryHeap {
+    ID3D12QueryHeap* heap = nullptr;
+    // kOcclusionQueryHeapSize UINT64 results, always in COPY_DEST state.
+    ID3D12Resource* readback_buffer = nullptr;
+    uint64_t submission = 0;
+    // The guest query index and sample count address for each used query.
+    std::vector<std::pair<uint64_t, uint32_t>> guest_queries;
+  };
+  // The guest_queries vectors are empty.
+  std::vector<OcclusionQueryHeap> occlusion_query_heaps_free_;
+  // Null heap if no queries have been used in the current submission yet.
+  OcclusionQueryHeap occlusion_query_heap_current_;
+  std::deque<OcclusionQueryHeap> occlusion_query_heaps_submitted_;
+
   // The current fixed-function drawing state.
   D3D12_VIEWPORT ff_viewport_;
   D3D12_RECT ff_scissor_;
@@ -792,9 +829,30 @@ class D3D12CommandProcessor final : public CommandProcessor {
   // Current primitive topology.
   D3D_PRIMITIVE_TOPOLOGY primitive_topology_;
 
-  draw_util::GetViewportInfoArgs previous_viewport_info_args_;
   draw_util::ViewportInfo previous_viewport_info_;
 
+  // State derived from the registers, updated when the registers are written
+  // (tracked via the dirty groups of the register file).
+  reg::RB_DEPTHCONTROL last_normalized_depth_control_ = {};
+  draw_util::Scissor last_scissor_ = {};
+  reg::RB_DEPTHCONTROL last_viewport_normalized_depth_control_ = {};
+  bool last_viewport_pixel_shader_writes_depth_ = false;
+  // Arguments of the latest system constant update other than the registers in
+  // RegisterDirtyGroup::kSystemConstants, compared as raw memory.
+  struct SystemConstantInputs {
+    uint32_t shared_memory_is_uav;
+    uint32_t primitive_polygonal;
+    uint32_t line_loop_closing_index;
+    uint32_t index_endian;
+    uint32_t used_texture_mask;
+    uint32_t normalized_depth_control;
+    uint32_t normalized_color_mask;
+    uint32_t prim_type;
+    draw_util::ViewportInfo viewport_info;
+  };
+  SystemConstantInputs last_system_constant_inputs_;
+  bool last_system_constant_inputs_valid_ = false;
+
 
   std::atomic<bool> pix_capture_requested_ = false;
   bool pix_capturing_;
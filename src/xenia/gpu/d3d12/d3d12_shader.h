@@ -11,6 +11,8 @@
 #define XENIA_GPU_D3D12_D3D12_SHADER_H_
 
 #include <atomic>
+#include <cstdint>
+#include <vector>
 
 #include "xenia/gpu/dxbc_shader.h"
 #include "xenia/ui/d3d12/d3d12_provider.h"
@@ -60,6 +62,19 @@ class D3D12Shader : public DxbcShader {
     sampler_binding_layout_user_uid_ = uid;
   }
 
+  // Tracking of the bool constant values used by a pixel shader for
+  // specializing it, only accessed by the command processor thread.
+  struct BoolConstantSpecialization {
+    uint32_t last_values = 0;
+    // Consecutive draws with last_values.
+    uint32_t stable_draw_count = 0;
+    // Values of the specialized modifications created so far.
+    std::vector<uint32_t> specialized_values;
+  };
+  BoolConstantSpecialization& bool_constant_specialization() {
+    return bool_constant_specialization_;
+  }
+
  protected:
   Translation* CreateTranslationInstance(uint64_t modification) override;
 
@@ -67,6 +82,7 @@ class D3D12Shader : public DxbcShader {
   std::atomic_flag binding_layout_user_uids_set_up_ = ATOMIC_FLAG_INIT;
   size_t texture_binding_layout_user_uid_ = 0;
   size_t sampler_binding_layout_user_uid_ = 0;
+  BoolConstantSpecialization bool_constant_specialization_;
 };
 
 }  // namespace d3d12
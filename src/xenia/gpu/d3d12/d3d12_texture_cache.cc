@@ -733,6 +733,12 @@ void D3D12TextureCache::PrefetchSamplerParameters(
     parameters.mip_linear = mip_filter == xenos::TextureFilter::kLinear;
   }
   parameters.mip_base_map = mip_filter == xenos::TextureFilter::kBaseMap;
+  if (AreActiveTextureMipsDeferred(binding.fetch_constant)) {
+    // Only the base level has been loaded so far (mips are deferred only when
+    // mip_min_level is 0).
+    parameters.mip_linear = 0;
+    parameters.mip_base_map = 1;
+  }
 
   return parameters;
 }
@@ -1234,6 +1240,11 @@ bool D3D12TextureCache::IsDecompressionNeeded(xenos::TextureFormat format,
           .AreUnalignedBlockTexturesSupported()) {
     return false;
   }
+  // TODO(Triang3l): Without UnalignedBlockTexturesSupported, the data could
+  // still be kept compressed by creating the resource with the size padded to
+  // whole blocks (the guest data already contains whole blocks) if the texture
+  // coordinates in the translated shaders were scaled by the ratio of the guest
+  // size to the padded host size for such textures.
   return true;
 }
 
@@ -1764,6 +1775,45 @@ bool D3D12TextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
   return true;
 }
 
+bool D3D12TextureCache::CopyTextureDataImpl(Texture& dest, Texture& source) {
+  D3D12Texture& d3d12_dest = static_cast<D3D12Texture&>(dest);
+  D3D12Texture& d3d12_source = static_cast<D3D12Texture&>(source);
+  d3d12_source.MarkAsUsed();
+  d3d12_dest.MarkAsUsed();
+  // The keys are the same other than the addresses, so the resources are
+  // created identically.
+  command_processor_.PushTransitionBarrier(
+      d3d12_source.resource(),
+      d3d12_source.SetResourceState(D3D12_RESOURCE_STATE_COPY_SOURCE),
+      D3D12_RESOURCE_STATE_COPY_SOURCE);
+  command_processor_.PushTransitionBarrier(
+      d3d12_dest.resource(),
+      d3d12_dest.SetResourceState(D3D12_RESOURCE_STATE_COPY_DEST),
+      D3D12_RESOURCE_STATE_COPY_DEST);
+  command_processor_.SubmitBarriers();
+  command_processor_.GetDeferredCommandList().D3DCopyResource(
+      d3d12_dest.resource(), d3d12_source.resource());
+  return true;
+}
+
+bool D3D12TextureCache::GetDeviceMemoryBudget(uint64_t& usage_out,
+                                              uint64_t& budget_out) {
+  IDXGIAdapter3* adapter =
+      command_processor_.GetD3D12Provider().GetDXGIAdapter3();
+  if (!adapter) {
+    return false;
+  }
+  DXGI_QUERY_VIDEO_MEMORY_INFO memory_info;
+  if (FAILED(adapter->QueryVideoMemoryInfo(
+          0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &memory_info)) ||
+      !memory_info.Budget) {
+    return false;
+  }
+  usage_out = memory_info.CurrentUsage;
+  budget_out = memory_info.Budget;
+  return true;
+}
+
 void D3D12TextureCache::UpdateTextureBindingsImpl(
     uint32_t fetch_constant_mask) {
   uint32_t bindings_remaining = fetch_constant_mask;
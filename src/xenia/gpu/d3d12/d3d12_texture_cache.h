@@ -541,6 +541,10 @@ class D3D12TextureCache final : public TextureCache {
   // This binds pipelines, allocates descriptors, and copies!
   bool LoadTextureDataFromResidentMemoryImpl(Texture& texture, bool load_base,
                                              bool load_mips) override;
+  bool CopyTextureDataImpl(Texture& dest, Texture& source) override;
+
+  bool GetDeviceMemoryBudget(uint64_t& usage_out,
+                             uint64_t& budget_out) override;
 
   void UpdateTextureBindingsImpl(uint32_t fetch_constant_mask) override;
 
@@ -27,7 +27,8 @@ DeferredCommandList::DeferredCommandList(
 void DeferredCommandList::Reset() { command_stream_.clear(); }
 
 void DeferredCommandList::Execute(ID3D12GraphicsCommandList* command_list,
-                                  ID3D12GraphicsCommandList1* command_list_1) {
+                                  ID3D12GraphicsCommandList1* command_list_1,
+                                  ID3D12GraphicsCommandList7* command_list_7) {
 #if XE_UI_D3D12_FINE_GRAINED_DRAW_SCOPES
   SCOPE_profile_cpu_f("gpu");
 #endif  // XE_UI_D3D12_FINE_GRAINED_DRAW_SCOPES
@@ -40,6 +41,10 @@ void DeferredCommandList::Execute(ID3D12GraphicsCommandList* command_list,
     stream += kCommandHeaderSizeElements;
     stream_remaining -= kCommandHeaderSizeElements;
     switch (header.command) {
+      case Command::kD3DBeginQuery: {
+        auto& args = *reinterpret_cast<const D3DQueryArguments*>(stream);
+        command_list->BeginQuery(args.query_heap, args.type, args.index);
+      } break;
       case Command::kD3DClearDepthStencilView: {
         auto& args =
             *reinterpret_cast<const ClearDepthStencilViewHeader*>(stream);
@@ -116,6 +121,10 @@ void DeferredCommandList::Execute(ID3D12GraphicsCommandList* command_list,
               args.start_vertex_location, args.start_instance_location);
         }
       } break;
+      case Command::kD3DEndQuery: {
+        auto& args = *reinterpret_cast<const D3DQueryArguments*>(stream);
+        command_list->EndQuery(args.query_heap, args.type, args.index);
+      } break;
       case Command::kD3DIASetIndexBuffer: {
         auto view = reinterpret_cast<const D3D12_INDEX_BUFFER_VIEW*>(stream);
         command_list->IASetIndexBuffer(
@@ -150,6 +159,13 @@ void DeferredCommandList::Execute(ID3D12GraphicsCommandList* command_list,
       case Command::kD3DOMSetStencilRef: {
         command_list->OMSetStencilRef(*reinterpret_cast<const UINT*>(stream));
       } break;
+      case Command::kD3DResolveQueryData: {
+        auto& args =
+            *reinterpret_cast<const D3DResolveQueryDataArguments*>(stream);
+        command_list->ResolveQueryData(
+            args.query_heap, args.type, args.start_index, args.num_queries,
+            args.destination_buffer, args.aligned_destination_buffer_offset);
+      } break;
       case Command::kD3DResourceBarrier: {
         static_assert(alignof(D3D12_RESOURCE_BARRIER) <= alignof(uintmax_t));
         command_list->ResourceBarrier(
@@ -158,6 +174,18 @@ void DeferredCommandList::Execute(ID3D12GraphicsCommandList* command_list,
                 reinterpret_cast<const uint8_t*>(stream) +
                 xe::align(sizeof(UINT), alignof(D3D12_RESOURCE_BARRIER))));
       } break;
+      case Command::kD3DBufferBarrier: {
+        static_assert(alignof(D3D12_BUFFER_BARRIER) <= alignof(uintmax_t));
+        assert_not_null(command_list_7);
+        D3D12_BARRIER_GROUP barrier_group;
+        barrier_group.Type = D3D12_BARRIER_TYPE_BUFFER;
+        barrier_group.NumBarriers = *reinterpret_cast<const UINT*>(stream);
+        barrier_group.pBufferBarriers =
+            reinterpret_cast<const D3D12_BUFFER_BARRIER*>(
+                reinterpret_cast<const uint8_t*>(stream) +
+                xe::align(sizeof(UINT), alignof(D3D12_BUFFER_BARRIER)));
+        command_list_7->Barrier(1, &barrier_group);
+      } break;
       case Command::kRSSetScissorRect: {
         command_list->RSSetScissorRects(
             1, reinterpret_cast<const D3D12_RECT*>(stream));
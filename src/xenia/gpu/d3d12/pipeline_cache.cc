@@ -40,6 +40,7 @@
 #include "xenia/gpu/dxbc_shader_translator.h"
 #include "xenia/gpu/gpu_flags.h"
 #include "xenia/gpu/registers.h"
+#include "xenia/gpu/shader_storage_import.h"
 #include "xenia/gpu/xenos.h"
 #include "xenia/ui/d3d12/d3d12_util.h"
 
@@ -58,6 +59,17 @@ DEFINE_int32(
     "the number of threads explicitly (up to the number of logical CPU cores), "
     "0 to disable multithreaded pipeline creation.",
     "D3D12");
+DEFINE_int32(
+    d3d12_bool_constant_specialization_variants, 0,
+    "Maximum number of variants of every pixel shader specialized for the "
+    "values of the bool constants it uses, with the branches depending on them "
+    "eliminated. 0 to disable the specialization.",
+    "D3D12");
+DEFINE_int32(d3d12_bool_constant_specialization_draws, 1024,
+             "Number of consecutive draws with a pixel shader with the same "
+             "bool constant values after which a variant specialized for "
+             "them is created.",
+             "D3D12");
 DEFINE_bool(d3d12_tessellation_wireframe, false,
             "Display tessellated surfaces as wireframe for debugging.",
             "D3D12");
@@ -255,10 +267,41 @@ void PipelineCache::InitializeShaderStorage(
   std::vector<PipelineStoredDescription> pipeline_stored_descriptions;
   // <Shader hash, modification bits>.
   std::set<std::pair<uint64_t, uint64_t>> shader_translations_needed;
+  auto pipeline_storage_file_name = fmt::format(
+      "{:08X}.{}.d3d12.xpso", title_id, edram_rov_used ? "rov" : "rtv");
   auto pipeline_storage_file_path =
-      shader_storage_shareable_root /
-      fmt::format("{:08X}.{}.d3d12.xpso", title_id,
-                  edram_rov_used ? "rov" : "rtv");
+      shader_storage_shareable_root / pipeline_storage_file_name;
+  // 'XEPS'.
+  const uint32_t pipeline_storage_magic = 0x53504558;
+  // 'DXRO' or 'DXRT'.
+  const uint32_t pipeline_storage_magic_api =
+      edram_rov_used ? 0x4F525844 : 0x54525844;
+  const uint32_t pipeline_storage_version_swapped =
+      xe::byte_swap(std::max(PipelineDescription::kVersion,
+                             DxbcShaderTranslator::Modification::kVersion));
+  {
+    const uint32_t pipeline_storage_import_header[] = {
+        pipeline_storage_magic, pipeline_storage_magic_api,
+        pipeline_storage_version_swapped};
+    ImportStorageRecords(
+        shader_storage_root,
+        std::filesystem::path("shareable") / pipeline_storage_file_name,
+        pipeline_storage_import_header, sizeof(pipeline_storage_import_header),
+        [](const uint8_t* data, size_t data_size) -> size_t {
+          PipelineStoredDescription pipeline_stored_description;
+          if (data_size < sizeof(pipeline_stored_description)) {
+            return 0;
+          }
+          std::memcpy(&pipeline_stored_description, data,
+                      sizeof(pipeline_stored_description));
+          if (XXH3_64bits(&pipeline_stored_description.description,
+                          sizeof(pipeline_stored_description.description)) !=
+              pipeline_stored_description.description_hash) {
+            return 0;
+          }
+          return sizeof(pipeline_stored_description);
+        });
+  }
   pipeline_storage_file_ =
       xe::filesystem::OpenFile(pipeline_storage_file_path, "a+b");
   if (!pipeline_storage_file_) {
@@ -269,19 +312,15 @@ void PipelineCache::InitializeShaderStorage(
     return;
   }
   pipeline_storage_file_flush_needed_ = false;
-  // 'XEPS'.
-  const uint32_t pipeline_storage_magic = 0x53504558;
-  // 'DXRO' or 'DXRT'.
-  const uint32_t pipeline_storage_magic_api =
-      edram_rov_used ? 0x4F525844 : 0x54525844;
-  const uint32_t pipeline_storage_version_swapped =
-      xe::byte_swap(std::max(PipelineDescription::kVersion,
-                             DxbcShaderTranslator::Modification::kVersion));
   struct {
     uint32_t magic;
     uint32_t magic_api;
     uint32_t version_swapped;
   } pipeline_storage_file_header;
+  // Other emulator instances may be appending to the same file - validate and
+  // truncate it with them locked out, and before creating the pipelines so
+  // descriptions appended by them meanwhile aren't dropped.
+  xe::filesystem::LockStdioFile(pipeline_storage_file_, true);
   if (fread(&pipeline_storage_file_header, sizeof(pipeline_storage_file_header),
             1, pipeline_storage_file_) &&
       pipeline_storage_file_header.magic == pipeline_storage_magic &&
@@ -335,6 +374,26 @@ void PipelineCache::InitializeShaderStorage(
       }
     }
   }
+  if (!pipeline_stored_descriptions.empty()) {
+    // If any pipeline descriptions were corrupted (or the whole file has
+    // excess bytes in the end), truncate to the last valid pipeline
+    // description.
+    xe::filesystem::TruncateStdioFile(
+        pipeline_storage_file_,
+        uint64_t(sizeof(pipeline_storage_file_header) +
+                 sizeof(PipelineStoredDescription) *
+                     pipeline_stored_descriptions.size()));
+  } else {
+    xe::filesystem::TruncateStdioFile(pipeline_storage_file_, 0);
+    pipeline_storage_file_header.magic = pipeline_storage_magic;
+    pipeline_storage_file_header.magic_api = pipeline_storage_magic_api;
+    pipeline_storage_file_header.version_swapped =
+        pipeline_storage_version_swapped;
+    fwrite(&pipeline_storage_file_header, sizeof(pipeline_storage_file_header),
+           1, pipeline_storage_file_);
+  }
+  fflush(pipeline_storage_file_);
+  xe::filesystem::UnlockStdioFile(pipeline_storage_file_);
 
   size_t logical_processor_count = xe::threading::logical_processor_count();
   if (!logical_processor_count) {
@@ -347,6 +406,32 @@ void PipelineCache::InitializeShaderStorage(
       xe::Clock::QueryHostTickCount();
   auto shader_storage_file_path =
       shader_storage_shareable_root / fmt::format("{:08X}.xsh", title_id);
+  // 'XESH'.
+  const uint32_t shader_storage_magic = 0x48534558;
+  {
+    const uint32_t shader_storage_import_header[] = {
+        shader_storage_magic, xe::byte_swap(ShaderStoredHeader::kVersion)};
+    ImportStorageRecords(
+        shader_storage_root,
+        std::filesystem::path("shareable") /
+            shader_storage_file_path.filename(),
+        shader_storage_import_header, sizeof(shader_storage_import_header),
+        [](const uint8_t* data, size_t data_size) -> size_t {
+          ShaderStoredHeader shader_header;
+          if (data_size < sizeof(shader_header)) {
+            return 0;
+          }
+          std::memcpy(&shader_header, data, sizeof(shader_header));
+          size_t ucode_byte_count =
+              shader_header.ucode_dword_count * sizeof(uint32_t);
+          if (data_size - sizeof(shader_header) < ucode_byte_count ||
+              XXH3_64bits(data + sizeof(shader_header), ucode_byte_count) !=
+                  shader_header.ucode_data_hash) {
+            return 0;
+          }
+          return sizeof(shader_header) + ucode_byte_count;
+        });
+  }
   shader_storage_file_ =
       xe::filesystem::OpenFile(shader_storage_file_path, "a+b");
   if (!shader_storage_file_) {
@@ -364,8 +449,9 @@ void PipelineCache::InitializeShaderStorage(
     uint32_t magic;
     uint32_t version_swapped;
   } shader_storage_file_header;
-  // 'XESH'.
-  const uint32_t shader_storage_magic = 0x48534558;
+  // Other emulator instances append with the file locked exclusively, so no
+  // partially written shaders are read.
+  xe::filesystem::LockStdioFile(shader_storage_file_, false);
   if (fread(&shader_storage_file_header, sizeof(shader_storage_file_header), 1,
             shader_storage_file_) &&
       shader_storage_file_header.magic == shader_storage_magic &&
@@ -554,9 +640,15 @@ void PipelineCache::InitializeShaderStorage(
              (xe::Clock::QueryHostTickCount() -
               shader_storage_initialization_start) *
                  1000 / xe::Clock::QueryHostTickFrequency());
+    // Anything after the valid shaders is corrupted regardless of what the
+    // other instances have appended since then.
+    xe::filesystem::UnlockStdioFile(shader_storage_file_);
+    xe::filesystem::LockStdioFile(shader_storage_file_, true);
     xe::filesystem::TruncateStdioFile(shader_storage_file_,
                                       shader_storage_valid_bytes);
   } else {
+    xe::filesystem::UnlockStdioFile(shader_storage_file_);
+    xe::filesystem::LockStdioFile(shader_storage_file_, true);
     xe::filesystem::TruncateStdioFile(shader_storage_file_, 0);
     shader_storage_file_header.magic = shader_storage_magic;
     shader_storage_file_header.version_swapped =
@@ -564,6 +656,8 @@ void PipelineCache::InitializeShaderStorage(
     fwrite(&shader_storage_file_header, sizeof(shader_storage_file_header), 1,
            shader_storage_file_);
   }
+  fflush(shader_storage_file_);
+  xe::filesystem::UnlockStdioFile(shader_storage_file_);
 
   // Create the pipelines.
   if (!pipeline_stored_descriptions.empty()) {
@@ -733,21 +827,6 @@ void PipelineCache::InitializeShaderStorage(
         pipelines_created,
         (xe::Clock::QueryHostTickCount() - pipeline_creation_start_) * 1000 /
             xe::Clock::QueryHostTickFrequency());
-    // If any pipeline descriptions were corrupted (or the whole file has excess
-    // bytes in the end), truncate to the last valid pipeline description.
-    xe::filesystem::TruncateStdioFile(
-        pipeline_storage_file_,
-        uint64_t(sizeof(pipeline_storage_file_header) +
-                 sizeof(PipelineStoredDescription) *
-                     pipeline_stored_descriptions.size()));
-  } else {
-    xe::filesystem::TruncateStdioFile(pipeline_storage_file_, 0);
-    pipeline_storage_file_header.magic = pipeline_storage_magic;
-    pipeline_storage_file_header.magic_api = pipeline_storage_magic_api;
-    pipeline_storage_file_header.version_swapped =
-        pipeline_storage_version_swapped;
-    fwrite(&pipeline_storage_file_header, sizeof(pipeline_storage_file_header),
-           1, pipeline_storage_file_);
   }
 
   shader_storage_cache_root_ = cache_root;
@@ -958,6 +1037,48 @@ PipelineCache::GetCurrentPixelShaderModification(
   return modification;
 }
 
+void PipelineCache::SpecializePixelShaderModification(
+    D3D12Shader& shader, DxbcShaderTranslator::Modification& modification) {
+  assert_true(shader.type() == xenos::ShaderType::kPixel);
+  if (cvars::d3d12_bool_constant_specialization_variants <= 0) {
+    return;
+  }
+  uint32_t values;
+  if (!DxbcShaderTranslator::GetSpecializedBoolConstantValues(
+          shader,
+          &register_file_.values[XE_GPU_REG_SHADER_CONSTANT_BOOL_000_031].u32,
+          values)) {
+    return;
+  }
+  D3D12Shader::BoolConstantSpecialization& specialization =
+      shader.bool_constant_specialization();
+  if (specialization.last_values == values) {
+    specialization.stable_draw_count =
+        std::min(specialization.stable_draw_count, UINT32_MAX - 1) + 1;
+  } else {
+    specialization.last_values = values;
+    specialization.stable_draw_count = 1;
+  }
+  std::vector<uint32_t>& specialized_values =
+      specialization.specialized_values;
+  if (std::find(specialized_values.cbegin(), specialized_values.cend(),
+                values) == specialized_values.cend()) {
+    // Translating and creating pipelines only for values which are stable for
+    // long, with a limited number of variants, otherwise keeping the generic
+    // shader reading the constants.
+    if (specialization.stable_draw_count <
+            uint32_t(std::max(
+                cvars::d3d12_bool_constant_specialization_draws, 1)) ||
+        specialized_values.size() >=
+            size_t(cvars::d3d12_bool_constant_specialization_variants)) {
+      return;
+    }
+    specialized_values.push_back(values);
+  }
+  modification.pixel.bool_constants_specialized = 1;
+  modification.pixel.bool_constant_values = values;
+}
+
 bool PipelineCache::ConfigurePipeline(
     D3D12Shader::D3D12Translation* vertex_shader,
     D3D12Shader::D3D12Translation* pixel_shader,
@@ -1110,6 +1231,7 @@ bool PipelineCache::TranslateAnalyzedShader(
     D3D12Shader::D3D12Translation& translation, IDxbcConverter* dxbc_converter,
     IDxcUtils* dxc_utils, IDxcCompiler* dxc_compiler) {
   D3D12Shader& shader = static_cast<D3D12Shader&>(translation.shader());
+  uint64_t translation_start = xe::Clock::QueryHostTickCount();
 
   // Perform translation.
   // If this fails the shader will be marked as invalid and ignored later.
@@ -1152,6 +1274,8 @@ bool PipelineCache::TranslateAnalyzedShader(
   XELOGGPU("Generated {} shader ({}b) - hash {:016X}:\n{}\n", host_shader_type,
            shader.ucode_dword_count() * sizeof(uint32_t),
            shader.ucode_data_hash(), shader.ucode_disassembly().c_str());
+  command_processor_.CountShaderTranslation(xe::Clock::QueryHostTickCount() -
+                                            translation_start);
 
   // Set up texture and sampler binding layouts.
   if (shader.EnterBindingLayoutUserUIDSetup()) {
@@ -3225,6 +3349,7 @@ ID3D12PipelineState* PipelineCache::CreateD3D12Pipeline(
         runtime_description.vertex_shader->shader().ucode_data_hash());
   }
   state->SetName(name.c_str());
+  command_processor_.CountPipelineCreation();
   return state;
 }
 
@@ -3287,23 +3412,31 @@ void PipelineCache::StorageWriteThread() {
       shader_header.ucode_dword_count = shader->ucode_dword_count();
       shader_header.type = shader->type();
       assert_not_null(shader_storage_file_);
-      fwrite(&shader_header, sizeof(shader_header), 1, shader_storage_file_);
       if (shader_header.ucode_dword_count) {
         ucode_guest_endian.resize(shader_header.ucode_dword_count);
         // Need to swap because the hash is calculated for the shader with guest
         // endianness.
         xe::copy_and_swap(ucode_guest_endian.data(), shader->ucode_dwords(),
                           shader_header.ucode_dword_count);
+      }
+      // Other emulator instances may be appending to the same file, write the
+      // whole shader at once while holding the lock.
+      xe::filesystem::ScopedStdioFileLock file_lock(shader_storage_file_);
+      fwrite(&shader_header, sizeof(shader_header), 1, shader_storage_file_);
+      if (shader_header.ucode_dword_count) {
         fwrite(ucode_guest_endian.data(),
                shader_header.ucode_dword_count * sizeof(uint32_t), 1,
                shader_storage_file_);
       }
+      fflush(shader_storage_file_);
     }
 
     if (write_pipeline) {
       assert_not_null(pipeline_storage_file_);
+      xe::filesystem::ScopedStdioFileLock file_lock(pipeline_storage_file_);
       fwrite(&pipeline_description, sizeof(pipeline_description), 1,
              pipeline_storage_file_);
+      fflush(pipeline_storage_file_);
     }
   }
 }
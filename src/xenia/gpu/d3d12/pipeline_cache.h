@@ -85,6 +85,10 @@ class PipelineCache {
   DxbcShaderTranslator::Modification GetCurrentPixelShaderModification(
       const Shader& shader, uint32_t interpolator_mask, uint32_t param_gen_pos,
       reg::RB_DEPTHCONTROL normalized_depth_control) const;
+  // Switches the pixel shader modification to one specialized for the current
+  // bool constant values if they haven't changed for many draws.
+  void SpecializePixelShaderModification(
+      D3D12Shader& shader, DxbcShaderTranslator::Modification& modification);
 
   // If draw_util::IsRasterizationPotentiallyDone is false, the pixel shader
   // MUST be made nullptr BEFORE calling this!
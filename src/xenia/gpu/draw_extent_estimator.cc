@@ -168,8 +168,13 @@ uint32_t DrawExtentEstimator::EstimateVertexMaxY(const Shader& vertex_shader) {
 
   shader_interpreter_.SetShader(vertex_shader);
 
-  PositionYExportSink position_y_export_sink;
-  shader_interpreter_.SetExportSink(&position_y_export_sink);
+  // The exports depend only on the vertex index, so execute the shader only
+  // once for each unique vertex - vertices are usually shared by multiple
+  // primitives in indexed draws. Sorting also makes the vertex fetches more
+  // coherent.
+  std::vector<uint32_t>& vertex_indices = vertex_indices_temp_;
+  vertex_indices.clear();
+  vertex_indices.reserve(vgt_draw_initiator.num_indices);
   for (uint32_t i = 0; i < vgt_draw_initiator.num_indices; ++i) {
     uint32_t vertex_index;
     if (vgt_draw_initiator.source_select == xenos::SourceSelect::kDMA) {
@@ -195,7 +200,19 @@ uint32_t DrawExtentEstimator::EstimateVertexMaxY(const Shader& vertex_shader) {
     vertex_index =
         std::min(max_index,
                  std::max(min_index, (vertex_index + index_offset) & 0xFFFFFF));
+    vertex_indices.push_back(vertex_index);
+  }
+  if (vgt_draw_initiator.source_select == xenos::SourceSelect::kDMA) {
+    std::sort(vertex_indices.begin(), vertex_indices.end());
+  }
+  // Auto-indexed vertices may be repeated only at the clamping bounds.
+  vertex_indices.erase(
+      std::unique(vertex_indices.begin(), vertex_indices.end()),
+      vertex_indices.end());
 
+  PositionYExportSink position_y_export_sink;
+  shader_interpreter_.SetExportSink(&position_y_export_sink);
+  for (uint32_t vertex_index : vertex_indices) {
     position_y_export_sink.Reset();
 
     shader_interpreter_.temp_registers()[0] = float(vertex_index);
@@ -12,6 +12,7 @@
 
 #include <cstdint>
 #include <optional>
+#include <vector>
 
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/shader.h"
@@ -68,6 +69,9 @@ class DrawExtentEstimator {
   TraceWriter* trace_writer_;
 
   ShaderInterpreter shader_interpreter_;
+
+  // Temporary storage for the unique vertex indices of a draw.
+  std::vector<uint32_t> vertex_indices_temp_;
 };
 
 }  // namespace gpu
@@ -127,6 +127,28 @@ uint64_t DxbcShaderTranslator::GetDefaultPixelShaderModification(
   return shader_modification.value;
 }
 
+uint32_t DxbcShaderTranslator::GetSpecializedBoolConstantValues(
+    const Shader& shader, const uint32_t* bool_constants,
+    uint32_t& values_out) {
+  const Shader::ConstantRegisterMap& constant_register_map =
+      shader.constant_register_map();
+  uint32_t count = 0;
+  values_out = 0;
+  for (uint32_t i = 0; i < xe::countof(constant_register_map.bool_bitmap) &&
+                       count < Modification::kSpecializedBoolConstantCount;
+       ++i) {
+    uint32_t bools_remaining = constant_register_map.bool_bitmap[i];
+    uint32_t bool_index;
+    while (count < Modification::kSpecializedBoolConstantCount &&
+           xe::bit_scan_forward(bools_remaining, &bool_index)) {
+      bools_remaining &= ~(UINT32_C(1) << bool_index);
+      values_out |= ((bool_constants[i] >> bool_index) & 1) << count;
+      ++count;
+    }
+  }
+  return count;
+}
+
 void DxbcShaderTranslator::Reset() {
   ShaderTranslator::Reset();
 
@@ -1666,9 +1688,47 @@ void DxbcShaderTranslator::StoreResult(const InstructionResult& result,
   }
 }
 
+bool DxbcShaderTranslator::GetSpecializedBoolConstant(
+    uint32_t bool_constant_index, bool& value_out) const {
+  if (!is_pixel_shader()) {
+    return false;
+  }
+  Modification shader_modification = GetDxbcShaderModification();
+  if (!shader_modification.pixel.bool_constants_specialized) {
+    return false;
+  }
+  // Only the first used bool constants are specialized, find the position of
+  // this one among them.
+  const uint32_t* bool_bitmap =
+      current_shader().constant_register_map().bool_bitmap;
+  uint32_t position = 0;
+  for (uint32_t i = 0; i < (bool_constant_index >> 5); ++i) {
+    position += xe::bit_count(bool_bitmap[i]);
+  }
+  position += xe::bit_count(bool_bitmap[bool_constant_index >> 5] &
+                            ((UINT32_C(1) << (bool_constant_index & 31)) - 1));
+  if (position >= Modification::kSpecializedBoolConstantCount) {
+    return false;
+  }
+  value_out = ((shader_modification.pixel.bool_constant_values >> position) &
+               1) != 0;
+  return true;
+}
+
 void DxbcShaderTranslator::UpdateExecConditionalsAndEmitDisassembly(
     ParsedExecInstruction::Type type, uint32_t bool_constant_index,
     bool condition) {
+  // With the bool constant known, the exec is either unconditional or never
+  // executed - for the latter, still emitting the `if` (with a literal that
+  // the driver eliminates) for simplicity.
+  bool bool_constant_value = false;
+  bool bool_constant_specialized =
+      type == ParsedExecInstruction::Type::kConditional &&
+      GetSpecializedBoolConstant(bool_constant_index, bool_constant_value);
+  if (bool_constant_specialized && bool_constant_value == condition) {
+    type = ParsedExecInstruction::Type::kUnconditional;
+  }
+
   // Check if we can merge the new exec with the previous one, or the jump with
   // the previous exec. The instruction-level predicate check is also merged in
   // this case.
@@ -1706,7 +1766,12 @@ void DxbcShaderTranslator::UpdateExecConditionalsAndEmitDisassembly(
   // Emit the disassembly for the new exec/jump.
   EmitInstructionDisassembly();
 
-  if (type == ParsedExecInstruction::Type::kConditional) {
+  if (type == ParsedExecInstruction::Type::kConditional &&
+      bool_constant_specialized) {
+    a_.OpIf(condition, dxbc::Src::LU(uint32_t(bool_constant_value)));
+    cf_exec_bool_constant_ = bool_constant_index;
+    cf_exec_bool_constant_condition_ = condition;
+  } else if (type == ParsedExecInstruction::Type::kConditional) {
     uint32_t bool_constant_test_temp = PushSystemTemp();
     // Check the bool constant value.
     if (cbuffer_index_bool_loop_constants_ == kBindingIndexUnallocated) {
@@ -28,6 +28,14 @@ namespace gpu {
 
 // Generates shader model 5_1 byte code (for Direct3D 12).
 //
+// DXIL (shader model 6) is not generated - that would require emitting LLVM
+// bitcode and signing the containers with the validator of the DirectX Shader
+// Compiler, which is not a dependency. The conversion of the DXBC to DXIL via
+// dxilconv is used only for disassembly (d3d12_dxbc_disasm_dxilconv) - its
+// result is not signed, so it can't be used for pipeline creation, and it
+// wouldn't make the shader model 6 features, such as wave operations, usable
+// anyway since the instructions are translated one to one.
+//
 // IMPORTANT CONTRIBUTION NOTES:
 //
 // While DXBC may look like a flexible and high-level representation with highly
@@ -142,6 +150,10 @@ class DxbcShaderTranslator : public ShaderTranslator {
       kFloat24Rounding,
     };
 
+    // Number of bool constants used by a pixel shader which can be folded into
+    // it when it's specialized for their values.
+    static constexpr uint32_t kSpecializedBoolConstantCount = 15;
+
     uint64_t value;
     struct VertexShaderModification {
       // uint32_t 0.
@@ -179,6 +191,11 @@ class DxbcShaderTranslator : public ShaderTranslator {
       uint32_t dynamic_addressable_register_count : 8;
       // Non-ROV - depth / stencil output mode.
       DepthStencilMode depth_stencil_mode : 2;
+      // If set, the values of the first kSpecializedBoolConstantCount bool
+      // constants used by the shader (in the order of their indices) are
+      // bool_constant_values rather than the ones from the constant buffer.
+      uint32_t bool_constants_specialized : 1;
+      uint32_t bool_constant_values : kSpecializedBoolConstantCount;
     } pixel;
 
     explicit Modification(uint64_t modification_value = 0)
@@ -519,6 +536,12 @@ class DxbcShaderTranslator : public ShaderTranslator {
           Shader::HostVertexShaderType::kVertex) const override;
   uint64_t GetDefaultPixelShaderModification(
       uint32_t dynamic_addressable_register_count) const override;
+  // Packs the values of the bool constants which can be folded into the
+  // pixel shader for Modification::PixelShaderModification::
+  // bool_constant_values, returns the number of the packed bools.
+  static uint32_t GetSpecializedBoolConstantValues(
+      const Shader& shader, const uint32_t* bool_constants,
+      uint32_t& values_out);
 
   // Creates a special pixel shader without color outputs - this resets the
   // state of the translator.
@@ -869,6 +892,10 @@ class DxbcShaderTranslator : public ShaderTranslator {
   void UpdateExecConditionalsAndEmitDisassembly(
       ParsedExecInstruction::Type type, uint32_t bool_constant_index,
       bool condition);
+  // Whether the value of the bool constant is known from the modification of
+  // a pixel shader specialized for the bool constant values.
+  bool GetSpecializedBoolConstant(uint32_t bool_constant_index,
+                                  bool& value_out) const;
   // Closes `if`s opened by exec and instructions within them (but not by
   // labels) and updates the state accordingly.
   void CloseExecConditionals();
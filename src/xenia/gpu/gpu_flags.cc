@@ -22,6 +22,15 @@ DEFINE_bool(vsync, true, "Enable VSYNC.", "GPU");
 
 DEFINE_uint64(vsync_fps, 60, "VSYNC frames per second", "GPU");
 
+DEFINE_uint32(
+    fast_forward_frame_skip, 0,
+    "For fast-forwarding, together with time_scalar above 1 (which makes the "
+    "vertical blanking and the timer interrupts happen more often in host "
+    "time), present only one of every N + 1 guest frames. The skipped frames "
+    "are still rendered, but not sent to the presenter, and their front "
+    "buffer is not loaded.",
+    "GPU");
+
 DEFINE_bool(
     gpu_allow_invalid_fetch_constants, true,
     "Allow texture and vertex fetch constants with invalid type - generally "
@@ -50,3 +59,12 @@ DEFINE_int32(query_occlusion_fake_sample_count, 1000,
              "EVENT_WRITE_ZPD by this number. Setting this to 0 means "
              "everything is reported as occluded.",
              "GPU");
+
+DEFINE_bool(
+    query_occlusion_host, false,
+    "Count the samples passed during occlusion queries using host GPU "
+    "queries, where supported by the GPU backend. The results are read "
+    "asynchronously without waiting for the GPU, so the guest receives the "
+    "sample count of the previous query using the same memory location, and "
+    "query_occlusion_fake_sample_count for the first query there.",
+    "GPU");
@@ -20,12 +20,16 @@ DECLARE_bool(vsync);
 
 DECLARE_uint64(vsync_fps);
 
+DECLARE_uint32(fast_forward_frame_skip);
+
 DECLARE_bool(gpu_allow_invalid_fetch_constants);
 
 DECLARE_bool(half_pixel_offset);
 
 DECLARE_int32(query_occlusion_fake_sample_count);
 
+DECLARE_bool(query_occlusion_host);
+
 DECLARE_bool(disassemble_pm4);
 
 #endif  // XENIA_GPU_GPU_FLAGS_H_
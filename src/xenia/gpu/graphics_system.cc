@@ -34,6 +34,22 @@ DEFINE_bool(
     "Store shaders persistently and load them when loading games to avoid "
     "runtime spikes and freezes when playing the game not for the first time.",
     "GPU");
+DEFINE_bool(gpu_interrupt_thread, false,
+            "Execute the guest GPU interrupt callbacks, including vblanks, on "
+            "a dedicated high-priority thread fed through a lock-free queue "
+            "instead of the vsync and the command processor threads, for "
+            "lower interrupt jitter.",
+            "GPU");
+DEFINE_int32(gpu_interrupt_thread_cpu, -1,
+             "Host logical processor to pin the GPU interrupt thread to, or -1 "
+             "to not pin it.",
+             "GPU");
+DEFINE_bool(gpu_register_read_shadow, false,
+            "Make the guest read the display controller GPU registers, such as "
+            "the vblank status polled in loops by many games, directly from "
+            "memory kept up to date by the emulator instead of taking an MMIO "
+            "access violation or a JIT callback for every read.",
+            "GPU");
 
 namespace xe {
 namespace gpu {
@@ -50,7 +66,10 @@ __declspec(dllexport) uint32_t AmdPowerXpressRequestHighPerformance = 1;
 }  // extern "C"
 #endif  // XE_PLATFORM_WIN32
 
-GraphicsSystem::GraphicsSystem() : vsync_worker_running_(false) {
+GraphicsSystem::GraphicsSystem()
+    : vsync_worker_running_(false),
+      interrupt_thread_running_(false),
+      interrupt_thread_waiting_(false) {
   register_file_ = reinterpret_cast<RegisterFile*>(memory::AllocFixed(
       nullptr, sizeof(RegisterFile), memory::AllocationType::kReserveCommit,
       memory::PageAccess::kReadWrite));
@@ -99,6 +118,70 @@ X_STATUS GraphicsSystem::Setup(cpu::Processor* processor,
       0x7FC80000, 0xFFFF0000, 0x0000FFFF, this,
       reinterpret_cast<cpu::MMIOReadCallback>(ReadRegisterThunk),
       reinterpret_cast<cpu::MMIOWriteCallback>(WriteRegisterThunk));
+  if (cvars::gpu_register_read_shadow) {
+    // The host page containing the display controller registers.
+    uint32_t page_size = uint32_t(xe::memory::page_size());
+    if (page_size <= 0x10000) {
+      uint32_t shadow_offset = (kRegisterReadShadowRegister * 4) &
+                               ~(page_size - 1);
+      register_read_shadow_ = memory_->SetVirtualMappedRangeReadShadow(
+          0x7FC80000 + shadow_offset, page_size);
+      if (register_read_shadow_) {
+        register_read_shadow_first_ = shadow_offset / 4;
+        register_read_shadow_count_ = page_size / 4;
+        RefreshRegisterReadShadow();
+      }
+    }
+    if (!register_read_shadow_) {
+      XELOGW("GPU: Failed to set up the register read shadow");
+    }
+  }
+
+  if (cvars::gpu_interrupt_thread) {
+    interrupt_event_ = threading::Event::CreateAutoResetEvent(false);
+    interrupt_thread_running_ = true;
+    interrupt_thread_ = kernel::object_ref<kernel::XHostThread>(
+        new kernel::XHostThread(
+            kernel_state_, 128 * 1024, 0,
+            [this]() {
+              InterruptRequest request;
+              while (true) {
+                if (interrupt_queue_.Pop(request)) {
+                  DeliverInterrupt(request);
+                  continue;
+                }
+                if (!interrupt_thread_running_) {
+                  break;
+                }
+                // Check the queue again after announcing the wait, as a
+                // request may have been pushed before the dispatching thread
+                // could see the flag.
+                interrupt_thread_waiting_.store(true,
+                                                std::memory_order_seq_cst);
+                if (!interrupt_queue_.Pop(request)) {
+                  threading::Wait(interrupt_event_.get(), false);
+                  interrupt_thread_waiting_.store(false,
+                                                  std::memory_order_relaxed);
+                  continue;
+                }
+                interrupt_thread_waiting_.store(false,
+                                                std::memory_order_relaxed);
+                DeliverInterrupt(request);
+              }
+              return 0;
+            },
+            kernel_state->GetIdleProcess()));
+    interrupt_thread_->set_can_debugger_suspend(true);
+    interrupt_thread_->set_name("GPU Interrupts");
+    interrupt_thread_->Create();
+    interrupt_thread_->thread()->set_priority(
+        threading::ThreadPriority::kHighest);
+    if (cvars::gpu_interrupt_thread_cpu >= 0 &&
+        cvars::gpu_interrupt_thread_cpu < 64) {
+      interrupt_thread_->thread()->set_affinity_mask(
+          uint64_t(1) << cvars::gpu_interrupt_thread_cpu);
+    }
+  }
 
   // 60hz vsync timer.
   vsync_worker_running_ = true;
@@ -165,6 +248,16 @@ void GraphicsSystem::Shutdown() {
     vsync_worker_thread_.reset();
   }
 
+  // Stopped after the dispatching threads, delivering the interrupts still in
+  // the queue.
+  if (interrupt_thread_) {
+    interrupt_thread_running_ = false;
+    interrupt_event_->Set();
+    interrupt_thread_->Wait(0, 0, 0, nullptr);
+    interrupt_thread_.reset();
+    interrupt_event_.reset();
+  }
+
   if (presenter_) {
     if (app_context_) {
       app_context_->CallInUIThreadSynchronous([this]() { presenter_.reset(); });
@@ -206,32 +299,64 @@ void GraphicsSystem::WriteRegisterThunk(void* ppc_context, GraphicsSystem* gs,
   gs->WriteRegister(addr, value);
 }
 
-uint32_t GraphicsSystem::ReadRegister(uint32_t addr) {
-  uint32_t r = (addr & 0xFFFF) / 4;
-
+bool GraphicsSystem::GetFixedRegisterValue(uint32_t r, uint32_t& value_out) {
   switch (r) {
     case 0x0F00:  // RB_EDRAM_TIMING
-      return 0x08100748;
+      value_out = 0x08100748;
+      return true;
     case 0x0F01:  // RB_BC_CONTROL
-      return 0x0000200E;
+      value_out = 0x0000200E;
+      return true;
     case 0x194C:  // R500_D1MODE_V_COUNTER
-      return 0x000002D0;
+      value_out = 0x000002D0;
+      return true;
     case 0x1951:  // interrupt status
-      return 1;   // vblank
+      value_out = 1;  // vblank
+      return true;
     case 0x1961:  // AVIVO_D1MODE_VIEWPORT_SIZE
                   // Screen res - 1280x720
                   // maximum [width(0x0FFF), height(0x0FFF)]
-      return 0x050002D0;
+      value_out = 0x050002D0;
+      return true;
     default:
-      if (!register_file()->IsValidRegister(r)) {
-        XELOGE("GPU: Read from unknown register ({:04X})", r);
-      }
+      return false;
+  }
+}
+
+uint32_t GraphicsSystem::ReadRegister(uint32_t addr) {
+  uint32_t r = (addr & 0xFFFF) / 4;
+
+  uint32_t value;
+  if (GetFixedRegisterValue(r, value)) {
+    return value;
+  }
+  if (!register_file()->IsValidRegister(r)) {
+    XELOGE("GPU: Read from unknown register ({:04X})", r);
   }
 
   assert_true(r < RegisterFile::kRegisterCount);
   return register_file()->values[r].u32;
 }
 
+void GraphicsSystem::UpdateRegisterReadShadow(uint32_t r) {
+  uint32_t shadow_index = r - register_read_shadow_first_;
+  if (shadow_index >= register_read_shadow_count_) {
+    return;
+  }
+  uint32_t value;
+  if (!GetFixedRegisterValue(r, value)) {
+    value = register_file()->values[r].u32;
+  }
+  xe::store_and_swap<uint32_t>(register_read_shadow_ + shadow_index * 4,
+                               value);
+}
+
+void GraphicsSystem::RefreshRegisterReadShadow() {
+  for (uint32_t i = 0; i < register_read_shadow_count_; ++i) {
+    UpdateRegisterReadShadow(register_read_shadow_first_ + i);
+  }
+}
+
 void GraphicsSystem::WriteRegister(uint32_t addr, uint32_t value) {
   uint32_t r = (addr & 0xFFFF) / 4;
 
@@ -248,6 +373,8 @@ void GraphicsSystem::WriteRegister(uint32_t addr, uint32_t value) {
 
   assert_true(r < RegisterFile::kRegisterCount);
   this->register_file()->values[r].u32 = value;
+  this->register_file()->MarkRegisterWritten(r);
+  UpdateRegisterReadShadow(r);
 }
 
 void GraphicsSystem::InitializeRingBuffer(uint32_t ptr, uint32_t size_log2) {
@@ -267,7 +394,41 @@ void GraphicsSystem::SetInterruptCallback(uint32_t callback,
 }
 
 void GraphicsSystem::DispatchInterruptCallback(uint32_t source, uint32_t cpu) {
-  kernel_state()->EmulateCPInterruptDPC(interrupt_callback_,interrupt_callback_data_, source, cpu);
+  InterruptRequest request = {source, cpu, Clock::QueryHostTickCount()};
+  if (interrupt_thread_running_.load(std::memory_order_relaxed) &&
+      interrupt_queue_.Push(request)) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (interrupt_thread_waiting_.load(std::memory_order_seq_cst)) {
+      interrupt_event_->Set();
+    }
+    return;
+  }
+  DeliverInterrupt(request);
+}
+
+void GraphicsSystem::DeliverInterrupt(const InterruptRequest& request) {
+  uint64_t latency = Clock::QueryHostTickCount() - request.dispatch_host_tick;
+  interrupt_count_.fetch_add(1, std::memory_order_relaxed);
+  interrupt_latency_host_ticks_.fetch_add(latency, std::memory_order_relaxed);
+  uint64_t max_latency =
+      interrupt_max_latency_host_ticks_.load(std::memory_order_relaxed);
+  while (latency > max_latency &&
+         !interrupt_max_latency_host_ticks_.compare_exchange_weak(
+             max_latency, latency, std::memory_order_relaxed)) {
+  }
+  kernel_state()->EmulateCPInterruptDPC(interrupt_callback_,
+                                        interrupt_callback_data_,
+                                        request.source, request.cpu);
+}
+
+void GraphicsSystem::GetInterruptStatistics(
+    InterruptStatistics& statistics_out) const {
+  statistics_out.interrupt_count =
+      interrupt_count_.load(std::memory_order_relaxed);
+  statistics_out.latency_host_ticks =
+      interrupt_latency_host_ticks_.load(std::memory_order_relaxed);
+  statistics_out.max_latency_host_ticks =
+      interrupt_max_latency_host_ticks_.load(std::memory_order_relaxed);
 }
 
 void GraphicsSystem::MarkVblank() {
@@ -276,6 +437,9 @@ void GraphicsSystem::MarkVblank() {
   // Increment vblank counter (so the game sees us making progress).
   command_processor_->increment_counter();
 
+  // Catch up with register writes not tracked individually.
+  RefreshRegisterReadShadow();
+
   // TODO(benvanik): we shouldn't need to do the dispatch here, but there's
   //     something wrong and the CP will block waiting for code that
   //     needs to be run in the interrupt.
@@ -345,7 +509,11 @@ bool GraphicsSystem::Restore(ByteStream* stream) {
   interrupt_callback_ = stream->Read<uint32_t>();
   interrupt_callback_data_ = stream->Read<uint32_t>();
 
-  return command_processor_->Restore(stream);
+  if (!command_processor_->Restore(stream)) {
+    return false;
+  }
+  RefreshRegisterReadShadow();
+  return true;
 }
 
 }  // namespace gpu
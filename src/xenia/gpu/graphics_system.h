@@ -18,6 +18,8 @@
 #include <string>
 #include <thread>
 
+#include "xenia/base/mpsc_queue.h"
+#include "xenia/base/threading.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/gpu/register_file.h"
 #include "xenia/kernel/xthread.h"
@@ -63,13 +65,29 @@ class GraphicsSystem {
     return command_processor_.get();
   }
 
+  // Updates the copy of the register readable by the guest as memory if it's
+  // shadowed.
+  void UpdateRegisterReadShadow(uint32_t r);
+
   virtual void InitializeRingBuffer(uint32_t ptr, uint32_t size_log2);
   virtual void EnableReadPointerWriteBack(uint32_t ptr,
                                           uint32_t block_size_log2);
 
   virtual void SetInterruptCallback(uint32_t callback, uint32_t user_data);
+  // Called by the vsync and the command processor threads. With
+  // gpu_interrupt_thread, the callback is executed on the interrupt thread
+  // without waiting for it, otherwise on the calling thread.
   void DispatchInterruptCallback(uint32_t source, uint32_t cpu);
 
+  // Counters of the interrupt callback deliveries, with the latency from the
+  // dispatch (the host vsync time for vblanks) to the start of the callback.
+  struct InterruptStatistics {
+    uint64_t interrupt_count;
+    uint64_t latency_host_ticks;
+    uint64_t max_latency_host_ticks;
+  };
+  void GetInterruptStatistics(InterruptStatistics& statistics_out) const;
+
   virtual void ClearCaches();
 
   void InitializeShaderStorage(const std::filesystem::path& cache_root,
@@ -95,11 +113,21 @@ class GraphicsSystem {
                                     uint32_t addr);
   static void WriteRegisterThunk(void* ppc_context, GraphicsSystem* gs,
                                  uint32_t addr, uint32_t value);
+  // Registers returning fixed values rather than the register file contents.
+  static bool GetFixedRegisterValue(uint32_t r, uint32_t& value_out);
   uint32_t ReadRegister(uint32_t addr);
   void WriteRegister(uint32_t addr, uint32_t value);
+  void RefreshRegisterReadShadow();
 
   void MarkVblank();
 
+  struct InterruptRequest {
+    uint32_t source;
+    uint32_t cpu;
+    uint64_t dispatch_host_tick;
+  };
+  void DeliverInterrupt(const InterruptRequest& request);
+
   Memory* memory_ = nullptr;
   cpu::Processor* processor_ = nullptr;
   kernel::KernelState* kernel_state_ = nullptr;
@@ -112,9 +140,29 @@ class GraphicsSystem {
   std::atomic<bool> vsync_worker_running_;
   kernel::object_ref<kernel::XHostThread> vsync_worker_thread_;
 
+  // Preallocated so dispatching doesn't allocate or take locks - if it's full,
+  // the interrupt is delivered on the dispatching thread.
+  BoundedMpscQueue<InterruptRequest, 64> interrupt_queue_;
+  std::atomic<bool> interrupt_thread_running_;
+  // Set by the interrupt thread before waiting for the event, so dispatching
+  // signals it only when needed.
+  std::atomic<bool> interrupt_thread_waiting_;
+  std::unique_ptr<threading::Event> interrupt_event_;
+  kernel::object_ref<kernel::XHostThread> interrupt_thread_;
+  std::atomic<uint64_t> interrupt_count_{0};
+  std::atomic<uint64_t> interrupt_latency_host_ticks_{0};
+  std::atomic<uint64_t> interrupt_max_latency_host_ticks_{0};
+
   RegisterFile* register_file_;
   std::unique_ptr<CommandProcessor> command_processor_;
 
+  // With --gpu_register_read_shadow, the guest reads the host page of the
+  // registers containing this one (the vblank interrupt status) from memory.
+  static constexpr uint32_t kRegisterReadShadowRegister = 0x1951;
+  uint8_t* register_read_shadow_ = nullptr;
+  uint32_t register_read_shadow_first_ = 0;
+  uint32_t register_read_shadow_count_ = 0;
+
   bool paused_ = false;
 
  private:
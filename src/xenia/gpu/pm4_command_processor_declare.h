@@ -16,6 +16,11 @@ void ExecutePacket(uint32_t ptr, uint32_t count);
 
 protected:
 XE_NOINLINE
+XE_COLD
+bool ExecutePacketWithStatistics();
+XE_FORCEINLINE
+bool ExecutePacketImpl();
+XE_NOINLINE
 void DisassembleCurrentPacket() XE_RESTRICT;
 XE_NOINLINE
 bool ExecutePacketType0( uint32_t packet) XE_RESTRICT;
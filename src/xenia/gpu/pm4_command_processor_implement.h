@@ -9,6 +9,10 @@ void COMMAND_PROCESSOR::ExecuteIndirectBuffer(uint32_t ptr,
                                               uint32_t count) XE_RESTRICT {
   SCOPE_profile_cpu_f("gpu");
 
+  if (count != 0 && IsRedundantIndirectBuffer(ptr, count)) {
+    return;
+  }
+
   trace_writer_.WriteIndirectBufferStart(ptr, count * sizeof(uint32_t));
   if (count != 0) {
     RingBuffer old_reader = reader_;
@@ -266,6 +270,29 @@ void COMMAND_PROCESSOR::DisassembleCurrentPacket() XE_RESTRICT {
   logger.submit('d');
 }
 bool COMMAND_PROCESSOR::ExecutePacket() {
+  XE_UNLIKELY_IF(pm4_statistics_enabled_) {
+    return COMMAND_PROCESSOR::ExecutePacketWithStatistics();
+  }
+  return COMMAND_PROCESSOR::ExecutePacketImpl();
+}
+XE_NOINLINE
+XE_COLD
+bool COMMAND_PROCESSOR::ExecutePacketWithStatistics() {
+  // Peek the header and the first data dword, which contains the register
+  // index for SET_CONSTANT.
+  RingBuffer peek_reader = reader_;
+  uint32_t packet = peek_reader.ReadAndSwap<uint32_t>();
+  uint32_t first_data = peek_reader.read_count() >= sizeof(uint32_t)
+                            ? peek_reader.ReadAndSwap<uint32_t>()
+                            : 0;
+  uint64_t start_host_tick = Clock::QueryHostTickCount();
+  bool result = COMMAND_PROCESSOR::ExecutePacketImpl();
+  CountPm4Packet(packet, first_data,
+                 Clock::QueryHostTickCount() - start_host_tick);
+  return result;
+}
+XE_FORCEINLINE
+bool COMMAND_PROCESSOR::ExecutePacketImpl() {
 #if XE_ENABLE_PM4_DISASM == 1
   if (cvars::disassemble_pm4 && logging::internal::ShouldLog(LogLevel::Debug)) {
     COMMAND_PROCESSOR::DisassembleCurrentPacket();
@@ -663,6 +690,26 @@ bool COMMAND_PROCESSOR::ExecutePacketType3_XE_SWAP(uint32_t packet,
   COMMAND_PROCESSOR::IssueSwap(frontbuffer_ptr, frontbuffer_width,
                                frontbuffer_height);
 
+  if (!swap_issued_) {
+    swap_issued_ = true;
+    XELOGI("Startup: first guest frame swapped at host uptime {} ms",
+           Clock::QueryHostUptimeMillis());
+  }
+
+  uint64_t swap_host_tick = Clock::QueryHostTickCount();
+  uint64_t swap_count = swap_count_.load(std::memory_order_relaxed);
+  if (swap_count) {
+    frame_time_history_us_[swap_count % kFrameTimeHistoryLength].store(
+        uint32_t(std::min((swap_host_tick - last_swap_host_tick_) * 1000000 /
+                              Clock::QueryHostTickFrequency(),
+                          uint64_t(UINT32_MAX))),
+        std::memory_order_relaxed);
+  }
+  last_swap_host_tick_ = swap_host_tick;
+  swap_count_.store(swap_count + 1, std::memory_order_relaxed);
+  EndPm4StatisticsFrame();
+  on_swap(swap_host_tick);
+
   ++counter_;
   return true;
 }
@@ -959,12 +1006,16 @@ bool COMMAND_PROCESSOR::ExecutePacketType3_EVENT_WRITE_ZPD(
 
   // Occlusion queries:
   // This command is send on query begin and end.
-  // As a workaround report some fixed amount of passed samples.
+  // With host queries, report the last available result of a query at the
+  // same address, otherwise (or if there's no result yet) report some fixed
+  // amount of passed samples as a workaround.
   auto fake_sample_count = cvars::query_occlusion_fake_sample_count;
-  if (fake_sample_count >= 0) {
+  if (fake_sample_count >= 0 || cvars::query_occlusion_host) {
+    uint32_t sample_counts_address =
+        register_file_->values[XE_GPU_REG_RB_SAMPLE_COUNT_ADDR].u32;
     auto* pSampleCounts =
         memory_->TranslatePhysical<xe_gpu_depth_sample_counts*>(
-            register_file_->values[XE_GPU_REG_RB_SAMPLE_COUNT_ADDR].u32);
+            sample_counts_address);
     // 0xFFFFFEED is written to this two locations by D3D only on D3DISSUE_END
     // and used to detect a finished query.
     bool is_end_via_z_pass = pSampleCounts->ZPass_A == kQueryFinished &&
@@ -972,10 +1023,27 @@ bool COMMAND_PROCESSOR::ExecutePacketType3_EVENT_WRITE_ZPD(
     // Older versions of D3D also checks for ZFail (4D5307D5).
     bool is_end_via_z_fail = pSampleCounts->ZFail_A == kQueryFinished &&
                              pSampleCounts->ZFail_B == kQueryFinished;
-    std::memset(pSampleCounts, 0, sizeof(xe_gpu_depth_sample_counts));
+    int64_t sample_count = fake_sample_count;
     if (is_end_via_z_pass || is_end_via_z_fail) {
-      pSampleCounts->ZPass_A = fake_sample_count;
-      pSampleCounts->Total_A = fake_sample_count;
+      occlusion_query_active_ = false;
+      if (cvars::query_occlusion_host) {
+        auto it = occlusion_query_results_.find(sample_counts_address);
+        if (it != occlusion_query_results_.end()) {
+          sample_count = int64_t(
+              std::min(it->second.sample_count, uint64_t(UINT32_MAX)));
+        }
+      }
+    } else if (cvars::query_occlusion_host) {
+      occlusion_query_active_ = true;
+      ++occlusion_query_current_;
+      occlusion_query_address_ = sample_counts_address;
+    }
+    if (sample_count >= 0) {
+      std::memset(pSampleCounts, 0, sizeof(xe_gpu_depth_sample_counts));
+      if (is_end_via_z_pass || is_end_via_z_fail) {
+        pSampleCounts->ZPass_A = uint32_t(sample_count);
+        pSampleCounts->Total_A = uint32_t(sample_count);
+      }
     }
   }
 
@@ -1077,6 +1145,9 @@ bool COMMAND_PROCESSOR::ExecutePacketType3Draw(
       // shader has memexport.
       // TODO(Triang3l || JoelLinn): Handle this properly in the render
       // backends.
+      // Invalidate the caches of the memory written without access violations
+      // before it's used by the draw.
+      memory_->PollPhysicalMemoryWrites();
       draw_succeeded = COMMAND_PROCESSOR::IssueDraw(
           vgt_draw_initiator.prim_type, vgt_draw_initiator.num_indices,
           is_indexed ? &index_buffer_info : nullptr,
@@ -14,6 +14,7 @@ project("xenia-gpu")
     "xenia-base",
     "xenia-ui",
     "xxhash",
+    "zstd",
   })
   includedirs({
     project_root.."/third_party/Vulkan-Headers/include",
@@ -34,6 +35,7 @@ project("xenia-gpu-shader-compiler")
     "xenia-gpu",
     "xenia-ui",
     "xenia-ui-vulkan",
+    "zstd",
   })
   includedirs({
     project_root.."/third_party/Vulkan-Headers/include",
@@ -53,3 +55,23 @@ project("xenia-gpu-shader-compiler")
         "1>scratch/stdout-shader-compiler.txt",
       })
     end
+
+group("tests")
+project("xenia-gpu-texture-conversion-benchmarks")
+  uuid("e821aca6-a6fc-4c18-a9a1-2bd466e6e30d")
+  kind("ConsoleApp")
+  language("C++")
+  links({
+    "fmt",
+    "xenia-base",
+    "xenia-gpu",
+    "xenia-ui",
+    "xxhash",
+  })
+  files({
+    "texture_conversion_benchmark_main.cc",
+    "../base/console_app_main_"..platform_suffix..".cc",
+  })
+
+  filter("platforms:Windows")
+    debugdir(project_root)
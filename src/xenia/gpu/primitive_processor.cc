@@ -68,6 +68,14 @@ DEFINE_int32(
     "while a very low value may result in excessive locking and lookups.\n"
     "Negative values disable caching.",
     "GPU");
+DEFINE_uint32(
+    primitive_processor_cache_across_frames_mb, 64,
+    "Maximum total size of the converted indices, in megabytes, to keep in the "
+    "primitive processor cache across frames for static geometry, so only a "
+    "copy needs to be made rather than the conversion in later frames. The "
+    "cache is reset when exceeded.\n"
+    "0 to cache converted indices only within one frame.",
+    "GPU");
 
 namespace xe {
 namespace gpu {
@@ -244,9 +252,14 @@ void PrimitiveProcessor::ShutdownCommon() {
   if (memory_invalidation_callback_handle_) {
     // Clear the cache if it has ever been used and unregister the invalidation
     // callback.
+    if (shared_memory_global_watch_handle_) {
+      shared_memory_.UnregisterGlobalWatch(shared_memory_global_watch_handle_);
+      shared_memory_global_watch_handle_ = nullptr;
+    }
     {
       auto global_lock = global_critical_region_.Acquire();
       cache_map_.clear();
+      cache_host_indices_bytes_ = 0;
       cache_bucket_free_first_entry_ = SIZE_MAX;
       std::memset(cache_buckets_non_empty_l1_, 0,
                   sizeof(cache_buckets_non_empty_l1_));
@@ -257,6 +270,7 @@ void PrimitiveProcessor::ShutdownCommon() {
         memory_invalidation_callback_handle_);
     memory_invalidation_callback_handle_ = nullptr;
     cache_entry_pool_.clear();
+    cache_host_indices_scratch_ = std::vector<uint8_t>();
   }
 }
 
@@ -266,12 +280,25 @@ void PrimitiveProcessor::ClearPerFrameCache() {
     return;
   }
   auto global_lock = global_critical_region_.Acquire();
+  ++cache_frame_;
+  if (cvars::primitive_processor_cache_across_frames_mb &&
+      cache_host_indices_bytes_ <=
+          (size_t(cvars::primitive_processor_cache_across_frames_mb) << 20)) {
+    // Keep the entries - kHostConverted results have frame != cache_frame_ now,
+    // and their indices will be copied to new buffers when they're used.
+    return;
+  }
   for (const std::pair<CacheKey, size_t>& cache_map_entry : cache_map_) {
-    cache_entry_pool_[cache_map_entry.second].free_next =
-        cache_bucket_free_first_entry_;
+    CacheEntry& cache_entry = cache_entry_pool_[cache_map_entry.second];
+    if (cache_entry.host_indices.capacity()) {
+      // Release the memory since the budget may have been exceeded.
+      cache_entry.host_indices = std::vector<uint8_t>();
+    }
+    cache_entry.free_next = cache_bucket_free_first_entry_;
     cache_bucket_free_first_entry_ = cache_map_entry.second;
   }
   cache_map_.clear();
+  cache_host_indices_bytes_ = 0;
   std::memset(cache_buckets_non_empty_l1_, 0,
               sizeof(cache_buckets_non_empty_l1_));
   std::memset(cache_buckets_non_empty_l2_, 0,
@@ -678,6 +705,15 @@ bool PrimitiveProcessor::Process(ProcessingResult& result_out) {
       // performed during conversion here. Also doing the endian swap here for
       // hosts not supporting 32-bit indices because indirection is only used
       // for the shared memory buffer.
+      // TODO(Triang3l): For large index buffers, convert on the GPU with a
+      // compute shader reading the indices from the shared memory and writing
+      // to a buffer for the current frame (a new ProcessedIndexBufferType with
+      // the dispatch requested by the backend before the draw) - for fans and
+      // quad lists without primitive reset, each host index depends only on
+      // its own position, and with primitive reset, the single primitive
+      // ranges would need a prefix sum first. That would avoid both the CPU
+      // conversion and the upload, but needs shaders for both Direct3D 12 and
+      // Vulkan.
       // Writing to the trace irrespective of the cache lookup result because
       // cache behavior depends on runtime configuration and state.
       trace_writer_.WriteMemoryRead(guest_index_base,
@@ -735,9 +771,9 @@ bool PrimitiveProcessor::Process(ProcessingResult& result_out) {
                 0, guest_draw_vertex_count, cacheable.host_draw_vertex_count);
           }
           auto host_indices = reinterpret_cast<uint16_t*>(
-              RequestHostConvertedIndexBufferForCurrentFrame(
+              cache_transaction.RequestHostIndices(
                   xenos::IndexFormat::kInt16, cacheable.host_draw_vertex_count,
-                  false, guest_index_base, cacheable.host_index_buffer_handle));
+                  false, guest_index_base));
           if (!host_indices) {
             return false;
           }
@@ -769,9 +805,9 @@ bool PrimitiveProcessor::Process(ProcessingResult& result_out) {
                 0, guest_draw_vertex_count, cacheable.host_draw_vertex_count);
           }
           auto host_indices = reinterpret_cast<uint32_t*>(
-              RequestHostConvertedIndexBufferForCurrentFrame(
+              cache_transaction.RequestHostIndices(
                   xenos::IndexFormat::kInt32, cacheable.host_draw_vertex_count,
-                  false, guest_index_base, cacheable.host_index_buffer_handle));
+                  false, guest_index_base));
           if (!host_indices) {
             return false;
           }
@@ -820,7 +856,9 @@ bool PrimitiveProcessor::Process(ProcessingResult& result_out) {
             cacheable.host_shader_index_endian = xenos::Endian::kNone;
           }
         }
-        cache_transaction.SetNewResult(cacheable);
+        if (!cache_transaction.SetNewResult(cacheable)) {
+          return false;
+        }
       }
     } else {
       // Using the same indices on the host as on the guest, either directly or
@@ -867,11 +905,9 @@ bool PrimitiveProcessor::Process(ProcessingResult& result_out) {
                 cacheable.host_index_format = is_ffff_used_as_vertex_index
                                                   ? xenos::IndexFormat::kInt32
                                                   : xenos::IndexFormat::kInt16;
-                void* host_indices_ptr =
-                    RequestHostConvertedIndexBufferForCurrentFrame(
-                        cacheable.host_index_format, guest_draw_vertex_count,
-                        true, guest_index_base,
-                        cacheable.host_index_buffer_handle);
+                void* host_indices_ptr = cache_transaction.RequestHostIndices(
+                    cacheable.host_index_format, guest_draw_vertex_count, true,
+                    guest_index_base);
                 if (!host_indices_ptr) {
                   return false;
                 }
@@ -887,7 +923,9 @@ bool PrimitiveProcessor::Process(ProcessingResult& result_out) {
                       guest_primitive_reset_index_guest_endian);
                 }
               }
-              cache_transaction.SetNewResult(cacheable);
+              if (!cache_transaction.SetNewResult(cacheable)) {
+                return false;
+              }
             }
           }
         } else {
@@ -920,9 +958,9 @@ bool PrimitiveProcessor::Process(ProcessingResult& result_out) {
               cacheable.index_buffer_type =
                   ProcessedIndexBufferType::kHostConverted;
               auto host_indices = reinterpret_cast<uint32_t*>(
-                  RequestHostConvertedIndexBufferForCurrentFrame(
+                  cache_transaction.RequestHostIndices(
                       xenos::IndexFormat::kInt32, guest_draw_vertex_count, true,
-                      guest_index_base, cacheable.host_index_buffer_handle));
+                      guest_index_base));
               if (!host_indices) {
                 return false;
               }
@@ -955,7 +993,9 @@ bool PrimitiveProcessor::Process(ProcessingResult& result_out) {
                   full_32bit_vertex_indices_used_ ? guest_index_endian
                                                   : xenos::Endian::kNone;
             }
-            cache_transaction.SetNewResult(cacheable);
+            if (!cache_transaction.SetNewResult(cacheable)) {
+              return false;
+            }
           }
         }
       }
@@ -1008,6 +1048,22 @@ bool PrimitiveProcessor::IsResetUsed(const uint16_t* source, uint32_t count,
   if (count >= kSimdVectorU16Elements) {
     SimdVectorU16 reset_index_guest_endian_simd =
         ReplicateU16(reset_index_guest_endian);
+#if XE_ARCH_AMD64
+    if (count >= kAvx2VectorU16Elements && IsAvx2Available()) {
+      __m256i reset_index_guest_endian_avx2 =
+          _mm256_broadcastsi128_si256(reset_index_guest_endian_simd);
+      while (count >= kAvx2VectorU16Elements) {
+        count -= kAvx2VectorU16Elements;
+        __m256i source_avx2 =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source));
+        source += kAvx2VectorU16Elements;
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi16(
+                source_avx2, reset_index_guest_endian_avx2))) {
+          return true;
+        }
+      }
+    }
+#endif  // XE_ARCH_AMD64
     while (count >= kSimdVectorU16Elements) {
       count -= kSimdVectorU16Elements;
       SimdVectorU16 source_simd = LoadAlignedVectorU16(source);
@@ -1070,6 +1126,31 @@ void PrimitiveProcessor::Get16BitResetIndexUsage(
     SimdVectorU16 ffff_simd = ReplicateU16(UINT16_MAX);
     SimdVectorU16 is_reset_simd = ReplicateU16(0);
     SimdVectorU16 is_ffff_simd = ReplicateU16(0);
+#if XE_ARCH_AMD64
+    if (count >= kAvx2VectorU16Elements && IsAvx2Available()) {
+      __m256i reset_index_guest_endian_avx2 =
+          _mm256_broadcastsi128_si256(reset_index_guest_endian_simd);
+      __m256i ffff_avx2 = _mm256_broadcastsi128_si256(ffff_simd);
+      __m256i is_reset_avx2 = _mm256_setzero_si256();
+      __m256i is_ffff_avx2 = _mm256_setzero_si256();
+      while (count >= kAvx2VectorU16Elements) {
+        count -= kAvx2VectorU16Elements;
+        __m256i source_avx2 =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source));
+        source += kAvx2VectorU16Elements;
+        is_reset_avx2 = _mm256_or_si256(
+            is_reset_avx2,
+            _mm256_cmpeq_epi16(source_avx2, reset_index_guest_endian_avx2));
+        is_ffff_avx2 = _mm256_or_si256(
+            is_ffff_avx2, _mm256_cmpeq_epi16(source_avx2, ffff_avx2));
+      }
+      // Merge with the 128-bit results checked after the tail.
+      is_reset_simd = _mm_or_si128(_mm256_castsi256_si128(is_reset_avx2),
+                                   _mm256_extracti128_si256(is_reset_avx2, 1));
+      is_ffff_simd = _mm_or_si128(_mm256_castsi256_si128(is_ffff_avx2),
+                                  _mm256_extracti128_si256(is_ffff_avx2, 1));
+    }
+#endif  // XE_ARCH_AMD64
     while (count >= kSimdVectorU16Elements) {
       count -= kSimdVectorU16Elements;
       SimdVectorU16 source_simd = LoadAlignedVectorU16(source);
@@ -1139,6 +1220,26 @@ bool PrimitiveProcessor::IsResetUsed(const uint32_t* source, uint32_t count,
   if (count >= kSimdVectorU32Elements) {
     SimdVectorU32 reset_index_guest_endian_simd =
         ReplicateU32(reset_index_guest_endian);
+#if XE_ARCH_AMD64
+    if (count >= kAvx2VectorU32Elements && IsAvx2Available()) {
+      __m256i reset_index_guest_endian_avx2 =
+          _mm256_broadcastsi128_si256(reset_index_guest_endian_simd);
+      __m256i low_bits_mask_guest_endian_avx2 =
+          _mm256_set1_epi32(int32_t(low_bits_mask_guest_endian));
+      while (count >= kAvx2VectorU32Elements) {
+        count -= kAvx2VectorU32Elements;
+        __m256i source_avx2 =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source));
+        source += kAvx2VectorU32Elements;
+        source_avx2 =
+            _mm256_and_si256(source_avx2, low_bits_mask_guest_endian_avx2);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(
+                source_avx2, reset_index_guest_endian_avx2))) {
+          return true;
+        }
+      }
+    }
+#endif  // XE_ARCH_AMD64
     while (count >= kSimdVectorU32Elements) {
       count -= kSimdVectorU32Elements;
       SimdVectorU32 source_simd = LoadAlignedVectorU32(source);
@@ -1186,6 +1287,24 @@ void PrimitiveProcessor::ReplaceResetIndex16To16(
   if (count >= kSimdVectorU16Elements) {
     SimdVectorU16 reset_index_guest_endian_simd =
         ReplicateU16(reset_index_guest_endian);
+#if XE_ARCH_AMD64
+    if (count >= kAvx2VectorU16Elements && IsAvx2Available()) {
+      __m256i reset_index_guest_endian_avx2 =
+          _mm256_broadcastsi128_si256(reset_index_guest_endian_simd);
+      while (count >= kAvx2VectorU16Elements) {
+        count -= kAvx2VectorU16Elements;
+        __m256i source_avx2 =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source));
+        source += kAvx2VectorU16Elements;
+        _mm256_storeu_si256(
+            reinterpret_cast<__m256i*>(dest),
+            _mm256_or_si256(source_avx2,
+                            _mm256_cmpeq_epi16(source_avx2,
+                                               reset_index_guest_endian_avx2)));
+        dest += kAvx2VectorU16Elements;
+      }
+    }
+#endif  // XE_ARCH_AMD64
     while (count >= kSimdVectorU16Elements) {
       count -= kSimdVectorU16Elements;
       // Comparison produces 0 or 0xFFFF on AVX and Neon - we need 0xFFFF as the
@@ -1228,6 +1347,33 @@ void PrimitiveProcessor::ReplaceResetIndex16To24(
   if (count >= kSimdVectorU16Elements) {
     SimdVectorU16 reset_index_guest_endian_simd =
         ReplicateU16(reset_index_guest_endian);
+#if XE_ARCH_AMD64
+    if (count >= kAvx2VectorU16Elements && IsAvx2Available()) {
+      __m256i reset_index_guest_endian_avx2 =
+          _mm256_broadcastsi128_si256(reset_index_guest_endian_simd);
+      while (count >= kAvx2VectorU16Elements) {
+        count -= kAvx2VectorU16Elements;
+        __m256i source_avx2 =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source));
+        source += kAvx2VectorU16Elements;
+        __m256i are_reset =
+            _mm256_cmpeq_epi16(source_avx2, reset_index_guest_endian_avx2);
+        // Zero-extending the indices, and sign-extending the comparison result
+        // to get 0xFFFFFFFF for primitive reset indices.
+        _mm256_storeu_si256(
+            reinterpret_cast<__m256i*>(dest),
+            _mm256_or_si256(
+                _mm256_cvtepu16_epi32(_mm256_castsi256_si128(source_avx2)),
+                _mm256_cvtepi16_epi32(_mm256_castsi256_si128(are_reset))));
+        _mm256_storeu_si256(
+            reinterpret_cast<__m256i*>(dest + kAvx2VectorU16Elements / 2),
+            _mm256_or_si256(
+                _mm256_cvtepu16_epi32(_mm256_extracti128_si256(source_avx2, 1)),
+                _mm256_cvtepi16_epi32(_mm256_extracti128_si256(are_reset, 1))));
+        dest += kAvx2VectorU16Elements;
+      }
+    }
+#endif  // XE_ARCH_AMD64
     while (count >= kSimdVectorU16Elements) {
       count -= kSimdVectorU16Elements;
       SimdVectorU16 source_simd = LoadAlignedVectorU16(source);
@@ -1431,9 +1577,25 @@ PrimitiveProcessor::CacheTransaction::CacheTransaction(
     auto global_lock = processor_.global_critical_region_.Acquire();
     auto cache_map_it = processor_.cache_map_.find(key_);
     if (cache_map_it != processor_.cache_map_.end()) {
-      result_ = processor_.cache_entry_pool_[cache_map_it->second].result;
-      result_type_ = ResultType::kExisting;
-    } else {
+      CacheEntry& entry = processor_.cache_entry_pool_[cache_map_it->second];
+      if (entry.result.index_buffer_type !=
+              ProcessedIndexBufferType::kHostConverted ||
+          entry.frame == processor_.cache_frame_) {
+        result_ = entry.result;
+        result_type_ = ResultType::kExisting;
+      } else if (!entry.host_indices.empty() &&
+                 processor_.UploadCachedHostIndices(
+                     entry.result,
+                     entry.host_indices.data() + entry.host_indices_offset,
+                     entry.result.host_index_buffer_handle)) {
+        // Converted in one of the previous frames - only copied to a buffer
+        // for the current frame.
+        entry.frame = processor_.cache_frame_;
+        result_ = entry.result;
+        result_type_ = ResultType::kExisting;
+      }
+    }
+    if (result_type_ != ResultType::kExisting) {
       // Inhibit writing the new result if the range happens to be modified
       // during the processing outside the lock.
       processor_.cache_currently_processing_base_ = key_.base;
@@ -1450,11 +1612,65 @@ PrimitiveProcessor::CacheTransaction::CacheTransaction(
           processor_.memory_.RegisterPhysicalMemoryInvalidationCallback(
               MemoryInvalidationCallbackThunk, &processor_);
     }
+    if (cvars::primitive_processor_cache_across_frames_mb &&
+        !processor_.shared_memory_global_watch_handle_) {
+      processor_.shared_memory_global_watch_handle_ =
+          processor_.shared_memory_.RegisterGlobalWatch(
+              SharedMemoryGlobalWatchCallbackThunk, &processor_);
+    }
     processor_.memory_.EnablePhysicalMemoryAccessCallbacks(
         key_.base, size_bytes, true, false);
   }
 }
 
+void* PrimitiveProcessor::CacheTransaction::RequestHostIndices(
+    xenos::IndexFormat format, uint32_t index_count, bool coalign_for_simd,
+    uint32_t coalignment_original_address) {
+  assert_true(result_type_ == ResultType::kNewUnset);
+  if (!key_.count || !cvars::primitive_processor_cache_across_frames_mb) {
+    // Not keeping the indices for the later frames.
+    host_indices_in_scratch_ = false;
+    return processor_.RequestHostConvertedIndexBufferForCurrentFrame(
+        format, index_count, coalign_for_simd, coalignment_original_address,
+        host_index_buffer_handle_);
+  }
+  std::vector<uint8_t>& scratch = processor_.cache_host_indices_scratch_;
+  // Same padding as required for the buffers for the current frame.
+  scratch.resize((format == xenos::IndexFormat::kInt16 ? sizeof(uint16_t)
+                                                       : sizeof(uint32_t)) *
+                     index_count +
+                 XE_GPU_PRIMITIVE_PROCESSOR_SIMD_SIZE);
+  processor_.cache_host_indices_scratch_offset_ =
+      coalign_for_simd ? size_t(GetSimdCoalignmentOffset(
+                             scratch.data(), coalignment_original_address))
+                       : 0;
+  host_indices_in_scratch_ = true;
+  return scratch.data() + processor_.cache_host_indices_scratch_offset_;
+}
+
+bool PrimitiveProcessor::CacheTransaction::SetNewResult(
+    CachedResult& new_result) {
+  // Replacement of an existing entry is not allowed.
+  assert_true(result_type_ != ResultType::kExisting);
+  if (new_result.index_buffer_type ==
+      ProcessedIndexBufferType::kHostConverted) {
+    if (host_indices_in_scratch_) {
+      if (!processor_.UploadCachedHostIndices(
+              new_result,
+              processor_.cache_host_indices_scratch_.data() +
+                  processor_.cache_host_indices_scratch_offset_,
+              new_result.host_index_buffer_handle)) {
+        return false;
+      }
+    } else {
+      new_result.host_index_buffer_handle = host_index_buffer_handle_;
+    }
+  }
+  result_ = new_result;
+  result_type_ = ResultType::kNewSet;
+  return true;
+}
+
 PrimitiveProcessor::CacheTransaction::~CacheTransaction() {
   if (!key_.count || result_type_ == ResultType::kExisting) {
     return;
@@ -1467,53 +1683,78 @@ PrimitiveProcessor::CacheTransaction::~CacheTransaction() {
 
   if (result_type_ == ResultType::kNewSet) {
     size_t new_entry_index;
-    if (processor_.cache_bucket_free_first_entry_ != SIZE_MAX) {
-      new_entry_index = processor_.cache_bucket_free_first_entry_;
-      processor_.cache_bucket_free_first_entry_ =
-          processor_.cache_entry_pool_[new_entry_index].free_next;
+    auto cache_map_it = processor_.cache_map_.find(key_);
+    if (cache_map_it != processor_.cache_map_.end()) {
+      // A cross-frame entry that has failed to be reused - replace its result.
+      new_entry_index = cache_map_it->second;
+      CacheEntry& entry = processor_.cache_entry_pool_[new_entry_index];
+      processor_.cache_host_indices_bytes_ -= entry.host_indices.size();
+      entry.host_indices.clear();
+      entry.result = result_;
     } else {
-      new_entry_index = processor_.cache_entry_pool_.size();
-      processor_.cache_entry_pool_.emplace_back();
+      new_entry_index =
+          processor_.AllocateCacheEntry(key_, result_, global_lock);
     }
     CacheEntry& new_entry = processor_.cache_entry_pool_[new_entry_index];
-
-    // Put the entry in 1 or 2 buckets.
-    uint32_t bucket_start_index = key_.base >> kCacheBucketSizeBytesLog2;
-    uint32_t bucket_count = CacheEntry::GetBucketCount(key_);
-    for (uint32_t link_index = 0; link_index < bucket_count; ++link_index) {
-      new_entry.buckets_prev[link_index] = SIZE_MAX;
-      uint32_t bucket_index = bucket_start_index + link_index;
-      uint64_t& bucket_non_empty_l1_ref =
-          processor_.cache_buckets_non_empty_l1_[bucket_index >> 6];
-      uint64_t bucket_non_empty_l1_bit = uint64_t(1) << (bucket_index & 63);
-      size_t& bucket_first_entry_ref =
-          processor_.cache_bucket_first_entries_[bucket_index];
-      if (bucket_non_empty_l1_ref & bucket_non_empty_l1_bit) {
-        // There is at least one entry already in the bucket - link to the
-        // first.
-        new_entry.buckets_next[link_index] = bucket_first_entry_ref;
-        CacheEntry& bucket_first_entry =
-            processor_.cache_entry_pool_[bucket_first_entry_ref];
-        // If the start ([0]) bucket of bucket_first_entry is bucket_index,
-        // update its link [0]. Otherwise, since a cache entry may belong only
-        // to at most 2 buckets, bucket_index must be its [1] bucket.
-        bucket_first_entry
-            .buckets_prev[size_t((bucket_first_entry.key.base >>
-                                  kCacheBucketSizeBytesLog2) != bucket_index)] =
-            new_entry_index;
-      } else {
-        new_entry.buckets_next[link_index] = SIZE_MAX;
-        bucket_non_empty_l1_ref |= bucket_non_empty_l1_bit;
-        processor_.UpdateCacheBucketsNonEmptyL2(bucket_index >> 6, global_lock);
-      }
-      bucket_first_entry_ref = new_entry_index;
+    new_entry.frame = processor_.cache_frame_;
+    if (host_indices_in_scratch_) {
+      std::swap(new_entry.host_indices, processor_.cache_host_indices_scratch_);
+      new_entry.host_indices_offset =
+          processor_.cache_host_indices_scratch_offset_;
+      processor_.cache_host_indices_bytes_ += new_entry.host_indices.size();
     }
+  }
+}
 
-    new_entry.key = key_;
-    new_entry.result = result_;
+size_t PrimitiveProcessor::AllocateCacheEntry(
+    CacheKey key, const CachedResult& result,
+    const global_unique_lock_type& global_lock) {
+  size_t new_entry_index;
+  if (cache_bucket_free_first_entry_ != SIZE_MAX) {
+    new_entry_index = cache_bucket_free_first_entry_;
+    cache_bucket_free_first_entry_ =
+        cache_entry_pool_[new_entry_index].free_next;
+  } else {
+    new_entry_index = cache_entry_pool_.size();
+    cache_entry_pool_.emplace_back();
+  }
+  CacheEntry& new_entry = cache_entry_pool_[new_entry_index];
 
-    processor_.cache_map_.emplace(key_, new_entry_index);
+  // Put the entry in 1 or 2 buckets.
+  uint32_t bucket_start_index = key.base >> kCacheBucketSizeBytesLog2;
+  uint32_t bucket_count = CacheEntry::GetBucketCount(key);
+  for (uint32_t link_index = 0; link_index < bucket_count; ++link_index) {
+    new_entry.buckets_prev[link_index] = SIZE_MAX;
+    uint32_t bucket_index = bucket_start_index + link_index;
+    uint64_t& bucket_non_empty_l1_ref =
+        cache_buckets_non_empty_l1_[bucket_index >> 6];
+    uint64_t bucket_non_empty_l1_bit = uint64_t(1) << (bucket_index & 63);
+    size_t& bucket_first_entry_ref = cache_bucket_first_entries_[bucket_index];
+    if (bucket_non_empty_l1_ref & bucket_non_empty_l1_bit) {
+      // There is at least one entry already in the bucket - link to the first.
+      new_entry.buckets_next[link_index] = bucket_first_entry_ref;
+      CacheEntry& bucket_first_entry =
+          cache_entry_pool_[bucket_first_entry_ref];
+      // If the start ([0]) bucket of bucket_first_entry is bucket_index,
+      // update its link [0]. Otherwise, since a cache entry may belong only
+      // to at most 2 buckets, bucket_index must be its [1] bucket.
+      bucket_first_entry
+          .buckets_prev[size_t((bucket_first_entry.key.base >>
+                                kCacheBucketSizeBytesLog2) != bucket_index)] =
+          new_entry_index;
+    } else {
+      new_entry.buckets_next[link_index] = SIZE_MAX;
+      bucket_non_empty_l1_ref |= bucket_non_empty_l1_bit;
+      UpdateCacheBucketsNonEmptyL2(bucket_index >> 6, global_lock);
+    }
+    bucket_first_entry_ref = new_entry_index;
   }
+
+  new_entry.key = key;
+  new_entry.result = result;
+
+  cache_map_.emplace(key, new_entry_index);
+  return new_entry_index;
 }
 
 std::pair<uint32_t, uint32_t> PrimitiveProcessor::MemoryInvalidationCallback(
@@ -1658,7 +1899,10 @@ std::pair<uint32_t, uint32_t> PrimitiveProcessor::MemoryInvalidationCallback(
                       entry_bucket_index)] = entry_link_prev;
                 }
               }
-              // Make the entry free for reuse.
+              // Make the entry free for reuse, keeping the memory allocated for
+              // the converted indices for the next entries.
+              cache_host_indices_bytes_ -= entry.host_indices.size();
+              entry.host_indices.clear();
               entry.free_next = cache_bucket_free_first_entry_;
               cache_bucket_free_first_entry_ = entry_index;
             }
@@ -1682,5 +1926,36 @@ PrimitiveProcessor::MemoryInvalidationCallbackThunk(
       ->MemoryInvalidationCallback(physical_address_start, length, exact_range);
 }
 
+bool PrimitiveProcessor::UploadCachedHostIndices(const CachedResult& result,
+                                                 const void* host_indices,
+                                                 size_t& backend_handle_out) {
+  size_t backend_handle;
+  void* host_indices_mapping = RequestHostConvertedIndexBufferForCurrentFrame(
+      result.host_index_format, result.host_draw_vertex_count, false, 0,
+      backend_handle);
+  if (!host_indices_mapping) {
+    return false;
+  }
+  std::memcpy(host_indices_mapping, host_indices,
+              (result.host_index_format == xenos::IndexFormat::kInt16
+                   ? sizeof(uint16_t)
+                   : sizeof(uint32_t)) *
+                  result.host_draw_vertex_count);
+  backend_handle_out = backend_handle;
+  return true;
+}
+
+void PrimitiveProcessor::SharedMemoryGlobalWatchCallbackThunk(
+    const global_unique_lock_type& global_lock, void* context,
+    uint32_t address_first, uint32_t address_last, bool invalidated_by_gpu) {
+  // CPU writes are handled by the physical memory invalidation callback, but
+  // entries kept across frames must also be dropped if the GPU has written to
+  // the indices.
+  if (invalidated_by_gpu) {
+    reinterpret_cast<PrimitiveProcessor*>(context)->MemoryInvalidationCallback(
+        address_first, address_last - address_first + 1, true);
+  }
+}
+
 }  // namespace gpu
 }  // namespace xe
@@ -20,6 +20,7 @@
 #include <mutex>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "xenia/base/assert.h"
 #include "xenia/base/cvar.h"
@@ -36,8 +37,10 @@
 #if XE_ARCH_AMD64
 // 128-bit SSSE3-level (SSE2+ for integer comparison, SSSE3 for pshufb) or AVX
 // (256-bit AVX only got integer operations such as comparison in AVX2, which is
-// above the minimum requirements of Xenia).
-#include <tmmintrin.h>
+// above the minimum requirements of Xenia, so 256-bit loops are only used in
+// the processing of the reset index if AVX2 is detected at runtime, with
+// XE_GPU_PRIMITIVE_PROCESSOR_SIMD_SIZE still being the guaranteed 128 bits).
+#include <immintrin.h>
 #define XE_GPU_PRIMITIVE_PROCESSOR_SIMD_SIZE 16
 #elif XE_ARCH_ARM64
 #include <arm_neon.h>
@@ -272,7 +275,9 @@ class PrimitiveProcessor {
 
   // Call at boundaries of lifespans of converted data (between frames,
   // preferably in the end of a frame so between the swap and the next draw,
-  // access violation handlers need to do less work).
+  // access violation handlers need to do less work). If the cross-frame cache
+  // is enabled, the entries are kept, and their converted indices are copied to
+  // new buffers when they're used in the next frames.
   void ClearPerFrameCache();
 
   static constexpr size_t GetBuiltinIndexBufferOffsetBytes(size_t handle) {
@@ -387,6 +392,15 @@ class PrimitiveProcessor {
       sizeof(SimdVectorU16) / sizeof(uint16_t);
   static constexpr uint32_t kSimdVectorU32Elements =
       sizeof(SimdVectorU32) / sizeof(uint32_t);
+#if XE_ARCH_AMD64
+  static bool IsAvx2Available() {
+    return (amd64::GetFeatureFlags() & amd64::kX64EmitAVX2) != 0;
+  }
+  static constexpr uint32_t kAvx2VectorU16Elements =
+      sizeof(__m256i) / sizeof(uint16_t);
+  static constexpr uint32_t kAvx2VectorU32Elements =
+      sizeof(__m256i) / sizeof(uint32_t);
+#endif  // XE_ARCH_AMD64
 #endif  // XE_GPU_PRIMITIVE_PROCESSOR_SIMD_SIZE
 
   static bool IsResetUsed(const uint16_t* source, uint32_t count,
@@ -447,6 +461,35 @@ class PrimitiveProcessor {
             int32_t(xenos::GpuSwapInline(uint32_t(0x07060504), HostSwap)),
             int32_t(xenos::GpuSwapInline(uint32_t(0x03020100), HostSwap)));
       }
+      if (count >= kAvx2VectorU32Elements && IsAvx2Available()) {
+        __m256i reset_index_guest_endian_avx2 =
+            _mm256_broadcastsi128_si256(reset_index_guest_endian_simd);
+        __m256i low_bits_mask_guest_endian_avx2 =
+            _mm256_broadcastsi128_si256(low_bits_mask_guest_endian_simd);
+        __m256i host_swap_shuffle_avx2;
+        if constexpr (HostSwap != xenos::Endian::kNone) {
+          // vpshufb works within each 128-bit lane.
+          host_swap_shuffle_avx2 =
+              _mm256_broadcastsi128_si256(host_swap_shuffle);
+        }
+        while (count >= kAvx2VectorU32Elements) {
+          count -= kAvx2VectorU32Elements;
+          __m256i source_avx2 =
+              _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source));
+          source += kAvx2VectorU32Elements;
+          source_avx2 =
+              _mm256_and_si256(source_avx2, low_bits_mask_guest_endian_avx2);
+          __m256i result_avx2 = _mm256_or_si256(
+              source_avx2,
+              _mm256_cmpeq_epi32(source_avx2, reset_index_guest_endian_avx2));
+          if constexpr (HostSwap != xenos::Endian::kNone) {
+            result_avx2 =
+                _mm256_shuffle_epi8(result_avx2, host_swap_shuffle_avx2);
+          }
+          _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest), result_avx2);
+          dest += kAvx2VectorU32Elements;
+        }
+      }
 #endif  // XE_ARCH_AMD64
       while (count >= kSimdVectorU32Elements) {
         count -= kSimdVectorU32Elements;
@@ -709,7 +752,8 @@ class PrimitiveProcessor {
 
   std::deque<SinglePrimitiveRange> single_primitive_ranges_;
 
-  // Caching for reuse of converted indices within a frame.
+  // Caching for reuse of converted indices within a frame, and, optionally,
+  // across frames.
 
   // 256 KB as the largest possible guest index buffer - 0xFFFF 32-bit indices -
   // is slightly smaller than 256 KB, thus cache entries need store links within
@@ -792,6 +836,14 @@ class PrimitiveProcessor {
     size_t buckets_next[2];
     CacheKey key;
     CachedResult result;
+    // cache_frame_ when result.host_index_buffer_handle was obtained - for
+    // kHostConverted results, the handle is valid only during that frame.
+    uint64_t frame;
+    // For kHostConverted results in the cross-frame cache, the converted
+    // indices (starting at host_indices_offset) to copy to the buffer of a new
+    // frame.
+    std::vector<uint8_t> host_indices;
+    size_t host_indices_offset;
     static uint32_t GetBucketCount(CacheKey key) {
       uint32_t count =
           ((key.base + (key.GetSizeBytes() - 1)) >> kCacheBucketSizeBytesLog2) -
@@ -817,8 +869,12 @@ class PrimitiveProcessor {
   //       stored as it will already be invalid at the time of the completion of
   //       the transaction.
   //     - Enabling an access callback for the range.
-  // - Setting the new result after processing (if not found in the cache
-  //   previously).
+  // - Requesting the location to write the converted indices to, and setting
+  //   the new result after processing (if not found in the cache previously).
+  //   With the cross-frame cache, the indices are written to CPU memory which
+  //   is kept in the cache entry, and copied to a buffer for the current frame
+  //   when the result is set. Copying is also done for the later frames when a
+  //   cross-frame entry is found.
   // - Transaction completion:
   //   - If the range wasn't invalidated during the transaction, storing the new
   //     entry in the cache.
@@ -831,12 +887,14 @@ class PrimitiveProcessor {
     const CachedResult* GetFoundResult() const {
       return result_type_ == ResultType::kExisting ? &result_ : nullptr;
     }
-    void SetNewResult(const CachedResult& new_result) {
-      // Replacement of an existing entry is not allowed.
-      assert_true(result_type_ != ResultType::kExisting);
-      result_ = new_result;
-      result_type_ = ResultType::kNewSet;
-    }
+    // Returns the location to write the converted indices to, or nullptr in
+    // case of failure. The handle is assigned to the result in SetNewResult.
+    void* RequestHostIndices(xenos::IndexFormat format, uint32_t index_count,
+                             bool coalign_for_simd,
+                             uint32_t coalignment_original_address);
+    // Sets host_index_buffer_handle of a kHostConverted result. Returns false
+    // if failed to copy the indices to the buffer for the current frame.
+    bool SetNewResult(CachedResult& new_result);
     ~CacheTransaction();
 
    private:
@@ -847,6 +905,9 @@ class PrimitiveProcessor {
     // vertex count below the cache usage threshold.
     CacheKey key_;
     CachedResult result_;
+    // Whether the indices are written to cache_host_indices_scratch_.
+    bool host_indices_in_scratch_ = false;
+    size_t host_index_buffer_handle_ = SIZE_MAX;
     enum class ResultType {
       kNewUnset,
       kNewSet,
@@ -855,9 +916,31 @@ class PrimitiveProcessor {
     ResultType result_type_ = ResultType::kNewUnset;
   };
 
+  // Links a new entry in the buckets and adds it to the cache map, returning
+  // its index in cache_entry_pool_.
+  size_t AllocateCacheEntry(CacheKey key, const CachedResult& result,
+                            const global_unique_lock_type& global_lock);
+  // Copies the converted indices to a new buffer for the current frame.
+  bool UploadCachedHostIndices(const CachedResult& result,
+                               const void* host_indices,
+                               size_t& backend_handle_out);
+
   std::deque<CacheEntry> cache_entry_pool_;
 
   void* memory_invalidation_callback_handle_ = nullptr;
+  // For invalidation of the cross-frame cache entries on GPU writes, such as
+  // resolves and memory export.
+  SharedMemory::GlobalWatchHandle shared_memory_global_watch_handle_ = nullptr;
+
+  // Incremented in ClearPerFrameCache.
+  uint64_t cache_frame_ = 0;
+  // Total size of the converted indices stored in the cache entries, modified
+  // by both the processor and the invalidation callback.
+  size_t cache_host_indices_bytes_ = 0;
+  // The indices are written here by the current transaction, and swapped with
+  // the storage of the cache entry when it's created.
+  std::vector<uint8_t> cache_host_indices_scratch_;
+  size_t cache_host_indices_scratch_offset_ = 0;
 
   xe::global_critical_region global_critical_region_;
   // Modified by both the processor and the invalidation callback.
@@ -904,6 +987,9 @@ class PrimitiveProcessor {
   static std::pair<uint32_t, uint32_t> MemoryInvalidationCallbackThunk(
       void* context_ptr, uint32_t physical_address_start, uint32_t length,
       bool exact_range);
+  static void SharedMemoryGlobalWatchCallbackThunk(
+      const global_unique_lock_type& global_lock, void* context,
+      uint32_t address_first, uint32_t address_last, bool invalidated_by_gpu);
 };
 
 }  // namespace gpu
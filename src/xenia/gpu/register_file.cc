@@ -10,13 +10,75 @@
 #include "xenia/gpu/register_file.h"
 #include <array>
 #include <cstring>
+#include <initializer_list>
 
 #include "xenia/base/math.h"
 
 namespace xe {
 namespace gpu {
 
-RegisterFile::RegisterFile() { std::memset(values, 0, sizeof(values)); }
+RegisterFile::RegisterFile() {
+  std::memset(values, 0, sizeof(values));
+  MarkAllDirtyGroups();
+}
+
+static constexpr std::array<uint8_t, RegisterFile::kRegisterCount>
+BuildDirtyGroupMasks() {
+  std::array<uint8_t, RegisterFile::kRegisterCount> masks{};
+  auto add = [&masks](uint32_t index, RegisterDirtyGroup group) {
+    masks[index] |= uint8_t(1) << uint32_t(group);
+  };
+  add(XE_GPU_REG_PA_SC_WINDOW_SCISSOR_TL, RegisterDirtyGroup::kScissor);
+  add(XE_GPU_REG_PA_SC_WINDOW_SCISSOR_BR, RegisterDirtyGroup::kScissor);
+  add(XE_GPU_REG_PA_SC_WINDOW_OFFSET, RegisterDirtyGroup::kScissor);
+  add(XE_GPU_REG_PA_SC_SCREEN_SCISSOR_TL, RegisterDirtyGroup::kScissor);
+  add(XE_GPU_REG_PA_SC_SCREEN_SCISSOR_BR, RegisterDirtyGroup::kScissor);
+  add(XE_GPU_REG_RB_SURFACE_INFO, RegisterDirtyGroup::kScissor);
+  add(XE_GPU_REG_RB_MODECONTROL, RegisterDirtyGroup::kNormalizedDepthControl);
+  add(XE_GPU_REG_RB_DEPTHCONTROL, RegisterDirtyGroup::kNormalizedDepthControl);
+  add(XE_GPU_REG_PA_CL_CLIP_CNTL, RegisterDirtyGroup::kViewport);
+  add(XE_GPU_REG_PA_CL_VTE_CNTL, RegisterDirtyGroup::kViewport);
+  add(XE_GPU_REG_PA_SU_SC_MODE_CNTL, RegisterDirtyGroup::kViewport);
+  add(XE_GPU_REG_PA_SU_VTX_CNTL, RegisterDirtyGroup::kViewport);
+  add(XE_GPU_REG_PA_CL_VPORT_XSCALE, RegisterDirtyGroup::kViewport);
+  add(XE_GPU_REG_PA_CL_VPORT_YSCALE, RegisterDirtyGroup::kViewport);
+  add(XE_GPU_REG_PA_CL_VPORT_ZSCALE, RegisterDirtyGroup::kViewport);
+  add(XE_GPU_REG_PA_CL_VPORT_XOFFSET, RegisterDirtyGroup::kViewport);
+  add(XE_GPU_REG_PA_CL_VPORT_YOFFSET, RegisterDirtyGroup::kViewport);
+  add(XE_GPU_REG_PA_CL_VPORT_ZOFFSET, RegisterDirtyGroup::kViewport);
+  add(XE_GPU_REG_PA_SC_WINDOW_OFFSET, RegisterDirtyGroup::kViewport);
+  add(XE_GPU_REG_RB_DEPTH_INFO, RegisterDirtyGroup::kViewport);
+  for (uint32_t index :
+       {XE_GPU_REG_PA_CL_CLIP_CNTL, XE_GPU_REG_PA_CL_VTE_CNTL,
+        XE_GPU_REG_PA_SU_SC_MODE_CNTL, XE_GPU_REG_PA_SU_POINT_MINMAX,
+        XE_GPU_REG_PA_SU_POINT_SIZE, XE_GPU_REG_PA_SU_POLY_OFFSET_FRONT_SCALE,
+        XE_GPU_REG_PA_SU_POLY_OFFSET_FRONT_OFFSET,
+        XE_GPU_REG_PA_SU_POLY_OFFSET_BACK_SCALE,
+        XE_GPU_REG_PA_SU_POLY_OFFSET_BACK_OFFSET, XE_GPU_REG_RB_ALPHA_REF,
+        XE_GPU_REG_RB_COLORCONTROL, XE_GPU_REG_RB_DEPTH_INFO,
+        XE_GPU_REG_RB_STENCILREFMASK, XE_GPU_REG_RB_STENCILREFMASK_BF,
+        XE_GPU_REG_RB_SURFACE_INFO, XE_GPU_REG_RB_COLOR_INFO,
+        XE_GPU_REG_RB_COLOR1_INFO, XE_GPU_REG_RB_COLOR2_INFO,
+        XE_GPU_REG_RB_COLOR3_INFO, XE_GPU_REG_RB_BLENDCONTROL0,
+        XE_GPU_REG_RB_BLENDCONTROL1, XE_GPU_REG_RB_BLENDCONTROL2,
+        XE_GPU_REG_RB_BLENDCONTROL3, XE_GPU_REG_RB_BLEND_RED,
+        XE_GPU_REG_RB_BLEND_GREEN, XE_GPU_REG_RB_BLEND_BLUE,
+        XE_GPU_REG_RB_BLEND_ALPHA, XE_GPU_REG_SQ_CONTEXT_MISC,
+        XE_GPU_REG_SQ_PROGRAM_CNTL, XE_GPU_REG_VGT_INDX_OFFSET,
+        XE_GPU_REG_VGT_MAX_VTX_INDX, XE_GPU_REG_VGT_MIN_VTX_INDX,
+        XE_GPU_REG_VGT_HOS_MAX_TESS_LEVEL, XE_GPU_REG_VGT_HOS_MIN_TESS_LEVEL,
+        XE_GPU_REG_VGT_OUTPUT_PATH_CNTL}) {
+    add(index, RegisterDirtyGroup::kSystemConstants);
+  }
+  for (uint32_t index = XE_GPU_REG_PA_CL_UCP_0_X;
+       index <= XE_GPU_REG_PA_CL_UCP_5_W; ++index) {
+    add(index, RegisterDirtyGroup::kSystemConstants);
+  }
+  return masks;
+}
+
+const std::array<uint8_t, RegisterFile::kRegisterCount>
+    RegisterFile::kDirtyGroupMasks = BuildDirtyGroupMasks();
 constexpr unsigned int GetHighestRegisterNumber() {
   uint32_t highest = 0;
 #define XE_GPU_REGISTER(index, type, name) \
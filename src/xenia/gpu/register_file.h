@@ -10,6 +10,7 @@
 #ifndef XENIA_GPU_REGISTER_FILE_H_
 #define XENIA_GPU_REGISTER_FILE_H_
 
+#include <array>
 #include <cstdint>
 #include <cstdlib>
 
@@ -27,6 +28,25 @@ struct RegisterInfo {
   const char* name;
 };
 
+// Groups of registers that host state derived from them depends on, for
+// skipping the derivation if none of the registers in the group have been
+// written since it was last done. A group must have only one user, which clears
+// the dirty state when deriving. Only registers below the shader constants can
+// be in the groups since constants are often written in bulk without tracking.
+enum class RegisterDirtyGroup : uint32_t {
+  // draw_util::GetScissor.
+  kScissor,
+  // draw_util::GetNormalizedDepthControl.
+  kNormalizedDepthControl,
+  // draw_util::GetViewportInfoArgs::SetupRegisterValues.
+  kViewport,
+  // D3D12CommandProcessor::UpdateSystemConstantValues, except for
+  // VGT_DRAW_INITIATOR, which is written for every draw.
+  kSystemConstants,
+
+  kCount,
+};
+
 class RegisterFile {
  public:
   RegisterFile();
@@ -40,6 +60,29 @@ class RegisterFile {
   };
   RegisterValue values[kRegisterCount];
 
+  // Must be called for all register writes not done via the command processor.
+  void MarkRegisterWritten(uint32_t index) {
+    up_to_date_dirty_groups_ &= ~uint32_t(kDirtyGroupMasks[index]);
+  }
+  void MarkRegistersWritten(uint32_t first_index, uint32_t count) {
+    // OR reduction over a contiguous range, vectorized by the compiler.
+    uint32_t written_groups = 0;
+    const uint8_t* masks = kDirtyGroupMasks.data() + first_index;
+    for (uint32_t i = 0; i < count; ++i) {
+      written_groups |= masks[i];
+    }
+    up_to_date_dirty_groups_ &= ~written_groups;
+  }
+  void MarkAllDirtyGroups() { up_to_date_dirty_groups_ = 0; }
+  // Returns whether the registers of the group have been written since the
+  // last call, and marks the group as up to date.
+  bool ConsumeDirtyGroup(RegisterDirtyGroup group) {
+    uint32_t group_bit = uint32_t(1) << uint32_t(group);
+    bool dirty = !(up_to_date_dirty_groups_ & group_bit);
+    up_to_date_dirty_groups_ |= group_bit;
+    return dirty;
+  }
+
   const RegisterValue& operator[](uint32_t reg) const { return values[reg]; }
   RegisterValue& operator[](uint32_t reg) { return values[reg]; }
   const RegisterValue& operator[](Register reg) const { return values[reg]; }
@@ -68,6 +111,15 @@ class RegisterFile {
   T& Get() {
     return *reinterpret_cast<T*>(&values[T::register_index]);
   }
+
+ private:
+  static_assert(size_t(RegisterDirtyGroup::kCount) <= 8);
+  // RegisterDirtyGroup bits for each register.
+  static const std::array<uint8_t, kRegisterCount> kDirtyGroupMasks;
+
+  // Inverted, so zero-initialized memory (the register file is allocated
+  // without construction) means that all groups are dirty.
+  uint32_t up_to_date_dirty_groups_;
 };
 
 }  // namespace gpu
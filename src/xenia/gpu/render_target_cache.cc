@@ -531,25 +531,31 @@ void RenderTargetCache::DestroyAllRenderTargets(bool shutting_down) {
 
 void RenderTargetCache::ShutdownCommon() { DestroyAllRenderTargets(true); }
 
+void RenderTargetCache::GetEdramOwningRenderTargets(
+    std::unordered_set<RenderTargetKey, RenderTargetKey::Hasher>&
+        render_targets_out) const {
+  for (const auto& ownership_range_pair : ownership_ranges_) {
+    const OwnershipRange& ownership_range = ownership_range_pair.second;
+    if (!ownership_range.render_target.IsEmpty()) {
+      render_targets_out.emplace(ownership_range.render_target);
+    }
+    if (!ownership_range.host_depth_render_target_unorm24.IsEmpty()) {
+      render_targets_out.emplace(
+          ownership_range.host_depth_render_target_unorm24);
+    }
+    if (!ownership_range.host_depth_render_target_float24.IsEmpty()) {
+      render_targets_out.emplace(
+          ownership_range.host_depth_render_target_float24);
+    }
+  }
+}
+
 void RenderTargetCache::ClearCache() {
   // Keep only render targets currently owning any EDRAM data.
   if (!render_targets_.empty()) {
     std::unordered_set<RenderTargetKey, RenderTargetKey::Hasher>
         used_render_targets;
-    for (const auto& ownership_range_pair : ownership_ranges_) {
-      const OwnershipRange& ownership_range = ownership_range_pair.second;
-      if (!ownership_range.render_target.IsEmpty()) {
-        used_render_targets.emplace(ownership_range.render_target);
-      }
-      if (!ownership_range.host_depth_render_target_unorm24.IsEmpty()) {
-        used_render_targets.emplace(
-            ownership_range.host_depth_render_target_unorm24);
-      }
-      if (!ownership_range.host_depth_render_target_float24.IsEmpty()) {
-        used_render_targets.emplace(
-            ownership_range.host_depth_render_target_float24);
-      }
-    }
+    GetEdramOwningRenderTargets(used_render_targets);
     if (render_targets_.size() != used_render_targets.size()) {
       typename decltype(render_targets_)::iterator it_next;
       for (auto it = render_targets_.begin(); it != render_targets_.end();
@@ -571,6 +577,46 @@ void RenderTargetCache::ClearCache() {
 
 void RenderTargetCache::BeginFrame() { ResetAccumulatedRenderTargets(); }
 
+void RenderTargetCache::TakeUnownedRenderTargets(
+    const std::function<bool(const RenderTarget& render_target)>& predicate,
+    std::vector<RenderTarget*>& render_targets_out) {
+  assert_true(GetPath() == Path::kHostRenderTargets);
+  if (render_targets_.empty()) {
+    return;
+  }
+  std::unordered_set<RenderTargetKey, RenderTargetKey::Hasher>
+      used_render_targets;
+  GetEdramOwningRenderTargets(used_render_targets);
+  if (render_targets_.size() == used_render_targets.size()) {
+    return;
+  }
+  // The bound render targets may be referenced by the implementation even if
+  // they don't own their EDRAM range anymore.
+  for (uint32_t i = 0; i < 1 + xenos::kMaxColorRenderTargets; ++i) {
+    if (last_update_used_render_targets_[i]) {
+      used_render_targets.emplace(last_update_used_render_targets_[i]->key());
+    }
+    if (last_update_accumulated_render_targets_[i]) {
+      used_render_targets.emplace(
+          last_update_accumulated_render_targets_[i]->key());
+    }
+  }
+  typename decltype(render_targets_)::iterator it_next;
+  for (auto it = render_targets_.begin(); it != render_targets_.end();
+       it = it_next) {
+    it_next = std::next(it);
+    // Also not removing the nullptr entries as they prevent attempting to
+    // create render targets that have already failed to be created.
+    if (!it->second ||
+        used_render_targets.find(it->first) != used_render_targets.end() ||
+        !predicate(*it->second)) {
+      continue;
+    }
+    render_targets_out.push_back(it->second);
+    render_targets_.erase(it);
+  }
+}
+
 bool RenderTargetCache::Update(bool is_rasterization_done,
                                reg::RB_DEPTHCONTROL normalized_depth_control,
                                uint32_t normalized_color_mask,
@@ -15,6 +15,7 @@
 #include <functional>
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -545,6 +546,13 @@ class RenderTargetCache {
   void ResetAccumulatedRenderTargets() {
     are_accumulated_render_targets_valid_ = false;
   }
+  // Removes host render targets for which the predicate returns true from the
+  // cache if they don't own any EDRAM data (thus their contents will never be
+  // needed again) and are not bound, passing their ownership to the caller,
+  // which must destroy them when the GPU has stopped using them.
+  void TakeUnownedRenderTargets(
+      const std::function<bool(const RenderTarget& render_target)>& predicate,
+      std::vector<RenderTarget*>& render_targets_out);
   RenderTarget* const* last_update_accumulated_render_targets() const {
     assert_true(GetPath() == Path::kHostRenderTargets);
     return last_update_accumulated_render_targets_;
@@ -710,6 +718,10 @@ class RenderTargetCache {
 
   RenderTarget* GetOrCreateRenderTarget(RenderTargetKey key);
 
+  void GetEdramOwningRenderTargets(
+      std::unordered_set<RenderTargetKey, RenderTargetKey::Hasher>&
+          render_targets_out) const;
+
   // Checks if changing ownership of the range to the specified render target
   // would require transferring data - primarily for barrier placement on the
   // pixel shader interlock path (where transfers do not involve copying, but
@@ -830,6 +830,12 @@ class Shader {
     // If there was some failure during preparation on the implementation side.
     void MakeInvalid() { is_valid_ = false; }
 
+    // For replacing the translated binary with a post-processed version on the
+    // implementation side.
+    void set_translated_binary(std::vector<uint8_t> translated_binary) {
+      translated_binary_ = std::move(translated_binary);
+    }
+
    private:
     friend class Shader;
     friend class ShaderTranslator;
@@ -863,6 +869,14 @@ class Shader {
   bool is_ucode_analyzed() const { return is_ucode_analyzed_; }
   // ucode_disasm_buffer is temporary storage for disassembly (provided
   // externally so it won't need to be reallocated for every shader).
+  // TODO(Triang3l): Store the analysis results along with the ucode in the
+  // shader storage to skip the analysis when loading it. The results include
+  // the parsed fetch instructions of the bindings, the label addresses and the
+  // memexport information, so they need a serialized form with its own
+  // version, invalidated whenever the analysis changes. Most of the analysis
+  // time is spent building the disassembly, which is needed only for dumping
+  // and the trace viewer, so generating it optionally would be a simpler first
+  // step.
   void AnalyzeUcode(StringBuffer& ucode_disasm_buffer);
 
   // The following parameters, until the translation, are valid if ucode
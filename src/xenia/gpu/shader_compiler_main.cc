@@ -7,21 +7,30 @@
  ******************************************************************************
  */
 
+#include <algorithm>
+#include <atomic>
 #include <cinttypes>
 #include <cstring>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "third_party/fmt/include/fmt/format.h"
 #include "third_party/glslang/SPIRV/disassemble.h"
 #include "xenia/base/assert.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/console_app_main.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/platform.h"
 #include "xenia/base/string.h"
 #include "xenia/base/string_buffer.h"
+#include "xenia/base/threading.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/gpu/dxbc_shader_translator.h"
 #include "xenia/gpu/shader_translator.h"
 #include "xenia/gpu/spirv_shader_translator.h"
@@ -59,11 +68,309 @@ DEFINE_bool(
     "Output host shader with a render backend implementation based on pixel "
     "shader interlock.",
     "GPU");
+DEFINE_path(
+    shader_input_batch, "",
+    "Batch mode: directory with .vs and .ps shader binary files, or a shader "
+    "storage file (.xsh) of a title, to translate all shaders from using "
+    "--shader_output_type (spirv or dxbc), reporting the total translation "
+    "time and output size. --shader_output, if specified, is the directory to "
+    "write the translated shaders to.",
+    "GPU");
+DEFINE_int32(shader_batch_threads, 0,
+             "Number of threads translating shaders in the batch mode, or 0 to "
+             "use all logical processors.",
+             "GPU");
+DEFINE_bool(shader_output_spirv_optimize, false,
+            "Run the SPIR-V optimizer on the shaders translated in the batch "
+            "mode.",
+            "GPU");
 
 namespace xe {
 namespace gpu {
 
+static Shader::HostVertexShaderType GetOutputHostVertexShaderType() {
+  if (cvars::vertex_shader_output_type == "linedomaincp") {
+    return Shader::HostVertexShaderType::kLineDomainCPIndexed;
+  }
+  if (cvars::vertex_shader_output_type == "linedomainpatch") {
+    return Shader::HostVertexShaderType::kLineDomainPatchIndexed;
+  }
+  if (cvars::vertex_shader_output_type == "triangledomaincp") {
+    return Shader::HostVertexShaderType::kTriangleDomainCPIndexed;
+  }
+  if (cvars::vertex_shader_output_type == "triangledomainpatch") {
+    return Shader::HostVertexShaderType::kTriangleDomainPatchIndexed;
+  }
+  if (cvars::vertex_shader_output_type == "quaddomaincp") {
+    return Shader::HostVertexShaderType::kQuadDomainCPIndexed;
+  }
+  if (cvars::vertex_shader_output_type == "quaddomainpatch") {
+    return Shader::HostVertexShaderType::kQuadDomainPatchIndexed;
+  }
+  return Shader::HostVertexShaderType::kVertex;
+}
+
+static uint64_t GetOutputModification(const ShaderTranslator& translator,
+                                      xenos::ShaderType shader_type) {
+  if (shader_type == xenos::ShaderType::kVertex) {
+    return translator.GetDefaultVertexShaderModification(
+        xenos::kMaxShaderTempRegisters, GetOutputHostVertexShaderType());
+  }
+  return translator.GetDefaultPixelShaderModification(
+      xenos::kMaxShaderTempRegisters);
+}
+
+// Same format as written by the pipeline caches of the host GPU backends.
+XEPACKEDSTRUCT(ShaderStoredHeader, {
+  uint64_t ucode_data_hash;
+
+  uint32_t ucode_dword_count : 31;
+  xenos::ShaderType type : 1;
+
+  static constexpr uint32_t kVersion = 0x20201219;
+});
+
+// Translates many shaders on multiple threads to measure the performance of
+// the translators, or to check that changes to them don't break any shaders
+// from a title.
+static int shader_compiler_batch() {
+  bool output_spirv = cvars::shader_output_type == "spirv";
+  if (!output_spirv && cvars::shader_output_type != "dxbc") {
+    XELOGE("Batch mode requires --shader_output_type=spirv|dxbc.");
+    return 1;
+  }
+
+  std::vector<std::unique_ptr<Shader>> shaders;
+  std::vector<uint32_t> ucode_dwords;
+  auto add_shader = [&](xenos::ShaderType shader_type, uint64_t ucode_data_hash,
+                        std::endian ucode_source_endian) {
+    shaders.push_back(std::make_unique<Shader>(
+        shader_type, ucode_data_hash, ucode_dwords.data(), ucode_dwords.size(),
+        ucode_source_endian));
+  };
+  if (std::filesystem::is_directory(cvars::shader_input_batch)) {
+    for (const xe::filesystem::FileInfo& file_info :
+         xe::filesystem::ListFiles(cvars::shader_input_batch)) {
+      if (file_info.type != xe::filesystem::FileInfo::Type::kFile) {
+        continue;
+      }
+      auto extension = file_info.name.extension();
+      xenos::ShaderType shader_type;
+      if (extension == ".vs") {
+        shader_type = xenos::ShaderType::kVertex;
+      } else if (extension == ".ps") {
+        shader_type = xenos::ShaderType::kPixel;
+      } else {
+        continue;
+      }
+      FILE* input_file =
+          filesystem::OpenFile(file_info.path / file_info.name, "rb");
+      if (!input_file) {
+        continue;
+      }
+      ucode_dwords.resize(file_info.total_size / sizeof(uint32_t));
+      ucode_dwords.resize(fread(ucode_dwords.data(), sizeof(uint32_t),
+                                ucode_dwords.size(), input_file));
+      fclose(input_file);
+      add_shader(shader_type,
+                 XXH3_64bits(ucode_dwords.data(),
+                             ucode_dwords.size() * sizeof(uint32_t)),
+                 cvars::shader_input_little_endian ? std::endian::little
+                                                   : std::endian::big);
+    }
+  } else {
+    struct {
+      uint32_t magic;
+      uint32_t version_swapped;
+    } shader_storage_file_header;
+    // 'XESH'.
+    const uint32_t shader_storage_magic = 0x48534558;
+    FILE* input_file = filesystem::OpenFile(cvars::shader_input_batch, "rb");
+    if (!input_file) {
+      XELOGE("Unable to open input file: {}",
+             xe::path_to_utf8(cvars::shader_input_batch));
+      return 1;
+    }
+    if (!fread(&shader_storage_file_header, sizeof(shader_storage_file_header),
+               1, input_file) ||
+        shader_storage_file_header.magic != shader_storage_magic ||
+        xe::byte_swap(shader_storage_file_header.version_swapped) !=
+            ShaderStoredHeader::kVersion) {
+      fclose(input_file);
+      XELOGE(
+          "{} is not a directory or a shader storage file of a supported "
+          "version",
+          xe::path_to_utf8(cvars::shader_input_batch));
+      return 1;
+    }
+    ShaderStoredHeader shader_header;
+    while (fread(&shader_header, sizeof(shader_header), 1, input_file)) {
+      size_t ucode_byte_count =
+          shader_header.ucode_dword_count * sizeof(uint32_t);
+      ucode_dwords.resize(shader_header.ucode_dword_count);
+      if (shader_header.ucode_dword_count &&
+          !fread(ucode_dwords.data(), ucode_byte_count, 1, input_file)) {
+        break;
+      }
+      if (XXH3_64bits(ucode_dwords.data(), ucode_byte_count) !=
+          shader_header.ucode_data_hash) {
+        XELOGW("Shader storage file is corrupted after {} shaders",
+               shaders.size());
+        break;
+      }
+      add_shader(shader_header.type, shader_header.ucode_data_hash,
+                 std::endian::big);
+    }
+    fclose(input_file);
+  }
+  if (shaders.empty()) {
+    XELOGE("No shaders found in {}",
+           xe::path_to_utf8(cvars::shader_input_batch));
+    return 1;
+  }
+
+  SpirvShaderTranslator::Features spirv_features(true);
+  ui::vulkan::SpirvToolsContext spirv_tools_context;
+  bool spirv_optimize = false;
+  if (output_spirv && cvars::shader_output_spirv_optimize) {
+    spirv_optimize =
+        spirv_tools_context.Initialize(spirv_features.spirv_version) &&
+        spirv_tools_context.IsOptimizerAvailable();
+    if (!spirv_optimize) {
+      XELOGW("SPIR-V optimizer is not available, not optimizing");
+    }
+  }
+  if (!cvars::shader_output.empty()) {
+    std::filesystem::create_directories(cvars::shader_output);
+  }
+
+  // Shaders are taken by the threads one by one, each translated fully by one
+  // thread, so the translations of a shader are not accessed concurrently.
+  std::atomic<size_t> next_shader_index(0);
+  std::mutex totals_mutex;
+  size_t shaders_failed = 0;
+  uint64_t translation_ticks = 0;
+  uint64_t output_size = 0;
+  uint64_t output_size_unoptimized = 0;
+  auto translation_thread_function = [&]() {
+    StringBuffer ucode_disasm_buffer;
+    std::unique_ptr<ShaderTranslator> translator;
+    if (output_spirv) {
+      translator = std::make_unique<SpirvShaderTranslator>(
+          spirv_features, true, true,
+          cvars::shader_output_pixel_shader_interlock);
+    } else {
+      translator = std::make_unique<DxbcShaderTranslator>(
+          ui::GraphicsProvider::GpuVendorID(0),
+          cvars::shader_output_bindless_resources,
+          cvars::shader_output_pixel_shader_interlock);
+    }
+    std::vector<uint32_t> optimized;
+    size_t thread_shaders_failed = 0;
+    uint64_t thread_translation_ticks = 0;
+    uint64_t thread_output_size = 0;
+    uint64_t thread_output_size_unoptimized = 0;
+    for (;;) {
+      size_t shader_index = next_shader_index.fetch_add(1);
+      if (shader_index >= shaders.size()) {
+        break;
+      }
+      Shader& shader = *shaders[shader_index];
+      uint64_t shader_start = xe::Clock::QueryHostTickCount();
+      shader.AnalyzeUcode(ucode_disasm_buffer);
+      Shader::Translation* translation = shader.GetOrCreateTranslation(
+          GetOutputModification(*translator, shader.type()));
+      bool translated = translator->TranslateAnalyzedShader(*translation);
+      const std::vector<uint8_t>& translated_binary =
+          translation->translated_binary();
+      const void* output_data = translated_binary.data();
+      size_t output_data_size = translated_binary.size();
+      if (translated && spirv_optimize) {
+        if (spirv_tools_context.Optimize(
+                reinterpret_cast<const uint32_t*>(translated_binary.data()),
+                translated_binary.size() / sizeof(uint32_t),
+                optimized) == SPV_SUCCESS) {
+          output_data = optimized.data();
+          output_data_size = optimized.size() * sizeof(uint32_t);
+        } else {
+          translated = false;
+        }
+      }
+      thread_translation_ticks +=
+          xe::Clock::QueryHostTickCount() - shader_start;
+      if (!translated) {
+        XELOGE("Failed to translate {} shader {:016X}",
+               shader.type() == xenos::ShaderType::kVertex ? "vertex" : "pixel",
+               shader.ucode_data_hash());
+        ++thread_shaders_failed;
+        continue;
+      }
+      thread_output_size += output_data_size;
+      thread_output_size_unoptimized += translated_binary.size();
+      if (!cvars::shader_output.empty()) {
+        auto output_path =
+            cvars::shader_output /
+            fmt::format(
+                "{:016X}.{}.{}", shader.ucode_data_hash(),
+                shader.type() == xenos::ShaderType::kVertex ? "vs" : "ps",
+                output_spirv ? "spv" : "dxbc");
+        FILE* output_file = filesystem::OpenFile(output_path, "wb");
+        if (output_file) {
+          fwrite(output_data, 1, output_data_size, output_file);
+          fclose(output_file);
+        }
+      }
+    }
+    std::lock_guard<std::mutex> lock(totals_mutex);
+    shaders_failed += thread_shaders_failed;
+    translation_ticks += thread_translation_ticks;
+    output_size += thread_output_size;
+    output_size_unoptimized += thread_output_size_unoptimized;
+  };
+
+  size_t thread_count =
+      cvars::shader_batch_threads > 0
+          ? size_t(cvars::shader_batch_threads)
+          : size_t(xe::threading::logical_processor_count());
+  thread_count = std::max(std::min(thread_count, shaders.size()), size_t(1));
+  uint64_t batch_start = xe::Clock::QueryHostTickCount();
+  std::vector<std::unique_ptr<xe::threading::Thread>> translation_threads;
+  translation_threads.reserve(thread_count);
+  for (size_t i = 0; i < thread_count; ++i) {
+    auto thread =
+        xe::threading::Thread::Create({}, translation_thread_function);
+    assert_not_null(thread);
+    thread->set_name("Shader Translation");
+    translation_threads.push_back(std::move(thread));
+  }
+  for (auto& translation_thread : translation_threads) {
+    xe::threading::Wait(translation_thread.get(), false);
+  }
+  uint64_t batch_ticks = xe::Clock::QueryHostTickCount() - batch_start;
+
+  uint64_t tick_frequency = xe::Clock::QueryHostTickFrequency();
+  size_t shaders_translated = shaders.size() - shaders_failed;
+  XELOGI(
+      "Translated {} of {} shaders on {} threads in {} ms ({} ms of thread "
+      "time, {} us per shader)",
+      shaders_translated, shaders.size(), thread_count,
+      batch_ticks * 1000 / tick_frequency,
+      translation_ticks * 1000 / tick_frequency,
+      translation_ticks * 1000000 / tick_frequency / shaders.size());
+  if (spirv_optimize) {
+    XELOGI("Output size: {} bytes, {} bytes before optimization", output_size,
+           output_size_unoptimized);
+  } else {
+    XELOGI("Output size: {} bytes", output_size);
+  }
+  return shaders_failed ? 1 : 0;
+}
+
 int shader_compiler_main(const std::vector<std::string>& args) {
+  if (!cvars::shader_input_batch.empty()) {
+    return shader_compiler_batch();
+  }
+
   xenos::ShaderType shader_type;
   if (!cvars::shader_input_type.empty()) {
     if (cvars::shader_input_type == "vs") {
@@ -147,46 +454,8 @@ int shader_compiler_main(const std::vector<std::string>& args) {
     return 0;
   }
 
-  Shader::HostVertexShaderType host_vertex_shader_type =
-      Shader::HostVertexShaderType::kVertex;
-  if (shader_type == xenos::ShaderType::kVertex) {
-    if (cvars::vertex_shader_output_type == "linedomaincp") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kLineDomainCPIndexed;
-    } else if (cvars::vertex_shader_output_type == "linedomainpatch") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kLineDomainPatchIndexed;
-    } else if (cvars::vertex_shader_output_type == "triangledomaincp") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kTriangleDomainCPIndexed;
-    } else if (cvars::vertex_shader_output_type == "triangledomainpatch") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kTriangleDomainPatchIndexed;
-    } else if (cvars::vertex_shader_output_type == "quaddomaincp") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kQuadDomainCPIndexed;
-    } else if (cvars::vertex_shader_output_type == "quaddomainpatch") {
-      host_vertex_shader_type =
-          Shader::HostVertexShaderType::kQuadDomainPatchIndexed;
-    }
-  }
-  uint64_t modification;
-  switch (shader_type) {
-    case xenos::ShaderType::kVertex:
-      modification = translator->GetDefaultVertexShaderModification(
-          xenos::kMaxShaderTempRegisters, host_vertex_shader_type);
-      break;
-    case xenos::ShaderType::kPixel:
-      modification = translator->GetDefaultPixelShaderModification(
-          xenos::kMaxShaderTempRegisters);
-      break;
-    default:
-      assert_unhandled_case(shader_type);
-      return 1;
-  }
-
-  Shader::Translation* translation =
-      shader->GetOrCreateTranslation(modification);
+  Shader::Translation* translation = shader->GetOrCreateTranslation(
+      GetOutputModification(*translator, shader_type));
   translator->TranslateAnalyzedShader(*translation);
 
   const void* source_data = translation->translated_binary().data();
@@ -22,6 +22,13 @@
 namespace xe {
 namespace gpu {
 
+// TODO(Triang3l): For the draw extent estimation, which executes the same
+// shader for many vertices, translate the ucode once per shader instead of
+// decoding it for every vertex. Either emit x86-64 code with Xbyak, like the
+// CPU backend, or emit a structure-of-arrays form executing multiple vertices
+// at once. Only the instructions that contribute to the exports needed by the
+// caller (the position, the point size and the vertex kill for the estimation)
+// would need to be kept.
 class ShaderInterpreter {
  public:
   ShaderInterpreter(const RegisterFile& register_file, const Memory& memory)
@@ -0,0 +1,167 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/gpu/shader_storage_import.h"
+
+#include <cstdio>
+#include <cstring>
+#include <system_error>
+#include <unordered_set>
+#include <vector>
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/logging.h"
+
+DEFINE_path(
+    shader_storage_import_root, "",
+    "Shader storage directory (with the same layout as cache_root/shaders) to "
+    "merge the guest shaders, the pipeline descriptions and the host driver "
+    "data for the title from into the local shader storage on startup, for "
+    "distributing pre-populated storage.",
+    "GPU");
+
+namespace xe {
+namespace gpu {
+
+static bool ReadStorageFile(const std::filesystem::path& path,
+                            std::vector<uint8_t>& data_out) {
+  data_out.clear();
+  FILE* file = xe::filesystem::OpenFile(path, "rb");
+  if (!file) {
+    return false;
+  }
+  if (xe::filesystem::Seek(file, 0, SEEK_END)) {
+    int64_t file_size = xe::filesystem::Tell(file);
+    if (file_size > 0 && xe::filesystem::Seek(file, 0, SEEK_SET)) {
+      data_out.resize(size_t(file_size));
+      data_out.resize(fread(data_out.data(), 1, data_out.size(), file));
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+size_t ImportStorageRecords(const std::filesystem::path& storage_root,
+                            const std::filesystem::path& relative_path,
+                            const void* header, size_t header_size,
+                            const StorageRecordSizeFunction& get_record_size) {
+  if (cvars::shader_storage_import_root.empty()) {
+    return 0;
+  }
+  std::vector<uint8_t> import_data;
+  if (!ReadStorageFile(cvars::shader_storage_import_root / relative_path,
+                       import_data)) {
+    return 0;
+  }
+  if (import_data.size() < header_size ||
+      std::memcmp(import_data.data(), header, header_size)) {
+    XELOGW(
+        "Not importing shader storage file {} as it's from a different version",
+        xe::path_to_utf8(relative_path));
+    return 0;
+  }
+
+  // Hashes of the records already stored locally. If the local file is
+  // missing, outdated or corrupted, it's recreated by the import.
+  auto local_path = storage_root / relative_path;
+  std::vector<uint8_t> local_data;
+  ReadStorageFile(local_path, local_data);
+  std::unordered_set<uint64_t> local_hashes;
+  size_t local_valid_size = 0;
+  if (local_data.size() >= header_size &&
+      !std::memcmp(local_data.data(), header, header_size)) {
+    local_valid_size = header_size;
+    while (local_valid_size < local_data.size()) {
+      size_t record_size =
+          get_record_size(local_data.data() + local_valid_size,
+                          local_data.size() - local_valid_size);
+      if (record_size < sizeof(uint64_t)) {
+        break;
+      }
+      uint64_t record_hash;
+      std::memcpy(&record_hash, local_data.data() + local_valid_size,
+                  sizeof(record_hash));
+      local_hashes.insert(record_hash);
+      local_valid_size += record_size;
+    }
+  }
+  local_data.resize(local_valid_size);
+  if (local_data.empty()) {
+    local_data.insert(local_data.end(), import_data.cbegin(),
+                      import_data.cbegin() + header_size);
+  }
+
+  size_t records_imported = 0;
+  size_t import_offset = header_size;
+  while (import_offset < import_data.size()) {
+    size_t record_size = get_record_size(import_data.data() + import_offset,
+                                         import_data.size() - import_offset);
+    if (record_size < sizeof(uint64_t)) {
+      break;
+    }
+    uint64_t record_hash;
+    std::memcpy(&record_hash, import_data.data() + import_offset,
+                sizeof(record_hash));
+    // Also skips duplicates within the imported file.
+    if (local_hashes.insert(record_hash).second) {
+      local_data.insert(local_data.end(),
+                        import_data.cbegin() + import_offset,
+                        import_data.cbegin() + import_offset + record_size);
+      ++records_imported;
+    }
+    import_offset += record_size;
+  }
+  if (!records_imported && local_valid_size) {
+    return 0;
+  }
+
+  FILE* local_file = xe::filesystem::OpenFile(local_path, "wb");
+  if (!local_file) {
+    XELOGE("Failed to open shader storage file {} for importing",
+           xe::path_to_utf8(local_path));
+    return 0;
+  }
+  bool written =
+      fwrite(local_data.data(), 1, local_data.size(), local_file) ==
+      local_data.size();
+  fclose(local_file);
+  if (!written) {
+    XELOGE("Failed to write shader storage file {} while importing",
+           xe::path_to_utf8(local_path));
+    return 0;
+  }
+  XELOGGPU("Imported {} shader storage records into {}", records_imported,
+           xe::path_to_utf8(relative_path));
+  return records_imported;
+}
+
+bool ImportStorageBlob(const std::filesystem::path& storage_root,
+                       const std::filesystem::path& relative_path) {
+  if (cvars::shader_storage_import_root.empty()) {
+    return false;
+  }
+  auto import_path = cvars::shader_storage_import_root / relative_path;
+  auto local_path = storage_root / relative_path;
+  if (!std::filesystem::exists(import_path) ||
+      std::filesystem::exists(local_path)) {
+    return false;
+  }
+  std::error_code error_code;
+  if (!std::filesystem::copy_file(import_path, local_path, error_code)) {
+    XELOGE("Failed to import shader storage file {}",
+           xe::path_to_utf8(relative_path));
+    return false;
+  }
+  XELOGGPU("Imported shader storage file {}", xe::path_to_utf8(relative_path));
+  return true;
+}
+
+}  // namespace gpu
+}  // namespace xe
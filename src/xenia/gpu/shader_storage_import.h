@@ -0,0 +1,53 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_GPU_SHADER_STORAGE_IMPORT_H_
+#define XENIA_GPU_SHADER_STORAGE_IMPORT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+
+namespace xe {
+namespace gpu {
+
+// The shader storage directory (cache_root/shaders) is itself the export
+// format: shareable/ contains the guest shaders and the pipeline descriptions
+// per title, which are independent from the host device, and local/ contains
+// the host driver data, keyed by the device and the driver version in the file
+// names. A directory with the same layout, such as one collected from other
+// machines, can be merged into the local storage on startup by specifying it
+// as --shader_storage_import_root.
+
+// Returns the size of the record at the beginning of the data, or 0 if there's
+// no complete valid record there.
+using StorageRecordSizeFunction =
+    std::function<size_t(const uint8_t* data, size_t data_size)>;
+
+// Appends the records from the file at the relative path in the import root,
+// beginning with a 64-bit hash, that the file at the same relative path in the
+// storage root doesn't contain yet. The files consist of the header, which must
+// be the same as the given one, followed by the records. Records after the
+// first corrupted one in the local file are dropped. Returns the number of
+// records imported.
+size_t ImportStorageRecords(const std::filesystem::path& storage_root,
+                            const std::filesystem::path& relative_path,
+                            const void* header, size_t header_size,
+                            const StorageRecordSizeFunction& get_record_size);
+
+// Copies a host driver data file from the import root if the storage root
+// doesn't have one at the same relative path yet. Such data can't be merged.
+bool ImportStorageBlob(const std::filesystem::path& storage_root,
+                       const std::filesystem::path& relative_path);
+
+}  // namespace gpu
+}  // namespace xe
+
+#endif  // XENIA_GPU_SHADER_STORAGE_IMPORT_H_
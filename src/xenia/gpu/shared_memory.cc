@@ -15,6 +15,7 @@
 #include "xenia/base/bit_range.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/profiling.h"
+#include "xenia/base/xxhash.h"
 
 namespace xe {
 namespace gpu {
@@ -197,6 +198,8 @@ SharedMemory::WatchHandle SharedMemory::WatchMemoryRange(
   range->callback_argument = callback_argument;
   range->page_first = watch_page_first;
   range->page_last = watch_page_last;
+  range->address_first = start;
+  range->address_last = start + length - 1;
 
   // Allocate and link the nodes.
   WatchNode* node_previous = nullptr;
@@ -236,11 +239,9 @@ void SharedMemory::UnwatchMemoryRange(WatchHandle handle) {
   UnlinkWatchRange(reinterpret_cast<WatchRange*>(handle));
 }
 
-void SharedMemory::FireWatches(uint32_t page_first, uint32_t page_last,
-                               bool invalidated_by_gpu) {
-  uint32_t address_first = page_first << page_size_log2_;
-  uint32_t address_last =
-      (page_last << page_size_log2_) + ((1 << page_size_log2_) - 1);
+void SharedMemory::FireWatchesInRange(uint32_t address_first,
+                                      uint32_t address_last,
+                                      bool invalidated_by_gpu) {
   uint32_t bucket_first = address_first >> kWatchBucketSizeLog2;
   uint32_t bucket_last = address_last >> kWatchBucketSizeLog2;
 
@@ -269,7 +270,8 @@ void SharedMemory::FireWatches(uint32_t page_first, uint32_t page_last,
       if (node) {
         swcache::PrefetchL1(node);
       }
-      if (page_first <= range->page_last && page_last >= range->page_first) {
+      if (address_first <= range->address_last &&
+          address_last >= range->address_first) {
         range->callback(global_lock, range->callback_context,
                         range->callback_data, range->callback_argument,
                         invalidated_by_gpu);
@@ -289,18 +291,54 @@ void SharedMemory::RangeWrittenByGpu(uint32_t start, uint32_t length,
   }
   length = std::min(length, kBufferSize - start);
   uint32_t end = start + length - 1;
-  uint32_t page_first = start >> page_size_log2_;
-  uint32_t page_last = end >> page_size_log2_;
 
   // Trigger modification callbacks so, for instance, resolved data is loaded to
-  // the texture.
-  FireWatches(page_first, page_last, true);
+  // the texture. Unlike with CPU writes, the exact range is known, so data
+  // that only shares pages with the written range (like textures placed right
+  // after a render target resolved every frame) stays valid - its bytes in the
+  // GPU copy are not modified, and the CPU data in the rest of the pages has
+  // been loaded by RequestRange before writing.
+  FireWatchesInRange(start, end, true);
 
   // Mark the range as valid (so pages are not reuploaded until modified by the
   // CPU) and watch it so the CPU can reuse it and this will be caught.
   MakeRangeValid(start, length, true, is_resolve);
 }
 
+bool SharedMemory::GetRangeHash(uint32_t start, uint32_t length,
+                                uint64_t seed, uint64_t& hash_out) {
+  if (!length) {
+    hash_out = seed;
+    return true;
+  }
+  if (start > kBufferSize || (kBufferSize - start) < length) {
+    return false;
+  }
+  uint32_t page_first = start >> page_size_log2_;
+  uint32_t page_last = (start + length - 1) >> page_size_log2_;
+  uint32_t block_first = page_first >> 6;
+  uint32_t block_last = page_last >> 6;
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    for (uint32_t i = block_first; i <= block_last; ++i) {
+      uint64_t range_bits = UINT64_MAX;
+      if (i == block_first) {
+        range_bits &= ~((uint64_t(1) << (page_first & 63)) - 1);
+      }
+      if (i == block_last && (page_last & 63) != 63) {
+        range_bits &= (uint64_t(1) << ((page_last & 63) + 1)) - 1;
+      }
+      if ((system_page_flags_valid_[i] & range_bits) != range_bits ||
+          (system_page_flags_valid_and_gpu_written_[i] & range_bits)) {
+        return false;
+      }
+    }
+  }
+  hash_out =
+      XXH3_64bits_withSeed(memory().TranslatePhysical(start), length, seed);
+  return true;
+}
+
 bool SharedMemory::AllocateSparseHostGpuMemoryRange(
     uint32_t offset_allocations, uint32_t length_allocations) {
   assert_always(
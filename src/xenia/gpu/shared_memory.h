@@ -102,6 +102,13 @@ class SharedMemory {
   // regions in those pages.
   void RangeWrittenByGpu(uint32_t start, uint32_t length, bool is_resolve);
 
+  // Hashes the data of a range requested previously from the guest memory,
+  // seeding the hash with the specified value. Returns false if the guest
+  // memory doesn't represent the contents of the range in the GPU buffer - if
+  // any of it is not valid or has been written on the GPU.
+  bool GetRangeHash(uint32_t start, uint32_t length, uint64_t seed,
+                    uint64_t& hash_out);
+
  protected:
   SharedMemory(Memory& memory);
   // Call in implementation-specific initialization.
@@ -239,6 +246,10 @@ class SharedMemory {
         WatchNode* node_first;
         uint32_t page_first;
         uint32_t page_last;
+        // Exact bounds of the watched range, for GPU writes which, unlike CPU
+        // writes caught via page protection, are known precisely.
+        uint32_t address_first;
+        uint32_t address_last;
       };
       WatchRange* next_free;
     };
@@ -282,7 +293,17 @@ class SharedMemory {
   // Triggers the watches (global and per-range), removing triggered range
   // watches.
   void FireWatches(uint32_t page_first, uint32_t page_last,
-                   bool invalidated_by_gpu);
+                   bool invalidated_by_gpu) {
+    FireWatchesInRange(
+        page_first << page_size_log2_,
+        (page_last << page_size_log2_) + ((uint32_t(1) << page_size_log2_) - 1),
+        invalidated_by_gpu);
+  }
+  // Triggers the watches overlapping the byte range. For CPU writes, this must
+  // be whole pages, as after a page is unprotected, anything in it may be
+  // modified without further notifications.
+  void FireWatchesInRange(uint32_t address_first, uint32_t address_last,
+                          bool invalidated_by_gpu);
   // Unlinks and frees the range and its nodes. Call this in the global critical
   // region.
   void UnlinkWatchRange(WatchRange* range);
@@ -12,6 +12,7 @@
 #include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <memory>
 #include <string>
 #include <utility>
@@ -744,14 +745,12 @@ std::vector<uint8_t> SpirvShaderTranslator::CompleteTranslation() {
   }
 
   // TODO(Triang3l): Avoid copy?
-  std::vector<unsigned int> module_uints;
-  builder_->dump(module_uints);
-  std::vector<uint8_t> module_bytes;
-  module_bytes.reserve(sizeof(unsigned int) * module_uints.size());
-  module_bytes.insert(module_bytes.cend(),
-                      reinterpret_cast<const uint8_t*>(module_uints.data()),
-                      reinterpret_cast<const uint8_t*>(module_uints.data()) +
-                          sizeof(unsigned int) * module_uints.size());
+  module_uints_temp_.clear();
+  builder_->dump(module_uints_temp_);
+  std::vector<uint8_t> module_bytes(sizeof(unsigned int) *
+                                    module_uints_temp_.size());
+  std::memcpy(module_bytes.data(), module_uints_temp_.data(),
+              module_bytes.size());
   return module_bytes;
 }
 
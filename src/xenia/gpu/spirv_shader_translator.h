@@ -27,6 +27,13 @@ namespace gpu {
 
 class SpirvShaderTranslator : public ShaderTranslator {
  public:
+  // Only what changes the interface of the shader (inputs, outputs, execution
+  // modes, the sizes of arrays indexed dynamically) is a part of the
+  // modification. Toggles that can be evaluated at runtime, such as the alpha
+  // test function, the sample count and the color gamma conversion, are passed
+  // via the kSysFlag system constant flags instead, so they don't cause
+  // additional translations and pipelines to be created (and thus wouldn't
+  // benefit from being specialization constants either).
   union Modification {
     // If anything in this is structure is changed in a way not compatible with
     // the previous layout, invalidate the pipeline storages by increasing this
@@ -41,6 +48,11 @@ class SpirvShaderTranslator : public ShaderTranslator {
       // Early fragment tests - enable if alpha test and alpha to coverage are
       // disabled; ignored if anything in the shader blocks early Z writing.
       kEarlyHint,
+      // Early fragment tests - enable if depth and stencil are not written by
+      // the draw, and the samples are not counted, so killing the pixel,
+      // including via the alpha test, doesn't change the results of the tests.
+      // Ignored if the shader writes the depth or exports memory.
+      kEarlyHintReadOnly,
       // TODO(Triang3l): Unorm24 (rounding) and float24 (truncating and
       // rounding) output modes.
     };
@@ -78,6 +90,14 @@ class SpirvShaderTranslator : public ShaderTranslator {
       uint32_t param_gen_point : 1;
       // For host render targets - depth / stencil output mode.
       DepthStencilMode depth_stencil_mode : 3;
+      // For the fragment shader interlock render backend - whether to begin
+      // the critical section and to do the depth / stencil test only after
+      // running the translated shader even if the test could be done before
+      // it. The early test allows skipping the shader for quads failing the
+      // test, but makes the whole shader, including the texture fetches, run
+      // with the interlock held, so it's not worth it if depth and stencil
+      // are disabled.
+      uint32_t fsi_depth_stencil_late : 1;
     } pixel;
     uint64_t value = 0;
 
@@ -470,11 +490,18 @@ class SpirvShaderTranslator : public ShaderTranslator {
   }
 
   bool IsExecutionModeEarlyFragmentTests() const {
-    return is_pixel_shader() &&
-           GetSpirvShaderModification().pixel.depth_stencil_mode ==
-               Modification::DepthStencilMode::kEarlyHint &&
-           !edram_fragment_shader_interlock_ &&
-           current_shader().implicit_early_z_write_allowed();
+    if (!is_pixel_shader() || edram_fragment_shader_interlock_) {
+      return false;
+    }
+    switch (GetSpirvShaderModification().pixel.depth_stencil_mode) {
+      case Modification::DepthStencilMode::kEarlyHint:
+        return current_shader().implicit_early_z_write_allowed();
+      case Modification::DepthStencilMode::kEarlyHintReadOnly:
+        return !current_shader().writes_depth() &&
+               !current_shader().memexport_eM_written();
+      default:
+        return false;
+    }
   }
 
   uint32_t GetModificationInterpolatorMask() const {
@@ -622,7 +649,8 @@ class SpirvShaderTranslator : public ShaderTranslator {
     assert_true(edram_fragment_shader_interlock_);
     return !is_depth_only_fragment_shader_ &&
            !current_shader().writes_depth() &&
-           !current_shader().memexport_eM_written();
+           !current_shader().memexport_eM_written() &&
+           !GetSpirvShaderModification().pixel.fsi_depth_stencil_late;
   }
   void FSI_LoadSampleMask(spv::Id msaa_samples);
   void FSI_LoadEdramOffsets(spv::Id msaa_samples);
@@ -690,6 +718,9 @@ class SpirvShaderTranslator : public ShaderTranslator {
   std::vector<spv::Id> id_vector_temp_util_;
   std::vector<unsigned int> uint_vector_temp_;
   std::vector<unsigned int> uint_vector_temp_util_;
+  // The module words, kept between translations so the dump doesn't need to
+  // grow a new vector every time.
+  std::vector<unsigned int> module_uints_temp_;
 
   spv::Id ext_inst_glsl_std_450_;
 
@@ -23,6 +23,13 @@
 namespace xe {
 namespace gpu {
 
+// TODO(Triang3l): Use fixed-function vertex input for vfetch_full instructions
+// unconditionally indexed by the unmodified vertex index, with formats that
+// have a direct host vertex attribute format equivalent, and endianness that
+// can be swapped ahead of time in a copy of the vertex buffer (invalidated via
+// the shared memory watches like textures). This requires a shader analysis
+// pass proving that the index register is only written with the vertex index,
+// and the pipeline vertex input state becoming a part of the pipeline key.
 void SpirvShaderTranslator::ProcessVertexFetchInstruction(
     const ParsedVertexFetchInstruction& instr) {
   UpdateInstructionPredication(instr.is_predicated, instr.predicate_condition);
@@ -479,7 +479,12 @@ void SpirvShaderTranslator::CompleteFragmentShaderInMain() {
 
   uint32_t color_targets_written = current_shader().writes_color_targets();
 
-  if ((color_targets_written & 0b1) && !IsExecutionModeEarlyFragmentTests()) {
+  // With the early hint that allows depth / stencil writing, the alpha test and
+  // alpha to coverage are known to be disabled.
+  if ((color_targets_written & 0b1) &&
+      !(IsExecutionModeEarlyFragmentTests() &&
+        GetSpirvShaderModification().pixel.depth_stencil_mode ==
+            Modification::DepthStencilMode::kEarlyHint)) {
     spv::Id fsi_sample_mask_in_rt_0_alpha_tests = spv::NoResult;
     spv::Block* block_fsi_rt_0_alpha_tests_rt_written_head = nullptr;
     spv::Block* block_fsi_rt_0_alpha_tests_rt_written_merge = nullptr;
@@ -9,10 +9,15 @@
 
 #include "xenia/gpu/texture_cache.h"
 
+#include "third_party/fmt/include/fmt/format.h"
+#include "third_party/zstd/lib/zstd.h"
+#include "xenia/base/byte_order.h"
 #include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/profiling.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/gpu/gpu_flags.h"
 
 DEFINE_int32(
@@ -59,6 +64,37 @@ DEFINE_uint32(
     "textures - so with 2x2 resolution scaling, the soft limit will be 360 + "
     "96 MB, and with 3x3, it will be 360 + 216 MB.",
     "GPU");
+DEFINE_uint32(
+    texture_cache_memory_budget_percent, 90,
+    "Percentage of the device memory budget reported by the host graphics API "
+    "(the memory the process can use without causing paging, taking other "
+    "applications into account) above which unused textures will be destroyed "
+    "until the usage is at least 10% below it, regardless of "
+    "texture_cache_memory_limit_soft and "
+    "texture_cache_memory_limit_soft_lifetime.\n"
+    "0 to disable budget-based eviction.",
+    "GPU");
+DEFINE_bool(
+    texture_cache_deduplication, false,
+    "Hash the guest data of textures when loading them, and copy the host data "
+    "from an already loaded texture with the same contents at a different "
+    "address instead of decoding it again if possible.",
+    "GPU");
+DEFINE_bool(
+    texture_cache_storage, false,
+    "Store the decoded host data of textures loaded from the CPU-written "
+    "memory persistently (compressed), and load it from the storage instead "
+    "of decoding the guest data when the same textures are used again in "
+    "later runs of the game.",
+    "GPU");
+DEFINE_bool(
+    texture_cache_deferred_mips, false,
+    "When a texture is loaded while its base level is sampled, load only the "
+    "base level, and the mips only when the texture is requested in a later "
+    "frame, sampling only the base level until then. Reduces the cost of "
+    "loading of many new textures at once, but textures loaded this way are "
+    "not deduplicated or stored persistently.",
+    "GPU");
 
 namespace xe {
 namespace gpu {
@@ -166,6 +202,8 @@ TextureCache::TextureCache(const RegisterFile& register_file,
 }
 
 TextureCache::~TextureCache() {
+  ShutdownTextureStorage();
+
   DestroyAllTextures(true);
 
   if (scaled_resolve_global_watch_handle_) {
@@ -205,11 +243,43 @@ void TextureCache::CompletedSubmissionUpdated(
       cvars::texture_cache_memory_limit_hard + limit_scaled_resolve_add_mb;
   uint32_t limit_soft_lifetime =
       cvars::texture_cache_memory_limit_soft_lifetime * 1000;
+  // The device memory usage also includes everything not owned by the texture
+  // cache, so rather than checking it after every destroyed texture, the amount
+  // of memory to free is calculated upfront. Once the high limit is exceeded,
+  // eviction continues until the usage is below the low limit, so it doesn't
+  // happen on every submission while the usage is hovering around the limit.
+  uint64_t budget_excess = 0;
+  uint64_t device_memory_usage, device_memory_budget;
+  if (GetDeviceMemoryBudget(device_memory_usage, device_memory_budget)) {
+    COUNT_profile_set("gpu/texture_cache/device_memory_usage_mb",
+                      device_memory_usage >> 20);
+    COUNT_profile_set("gpu/texture_cache/device_memory_budget_mb",
+                      device_memory_budget >> 20);
+    uint32_t budget_percent =
+        std::min(cvars::texture_cache_memory_budget_percent, uint32_t(100));
+    if (budget_percent) {
+      uint64_t budget_high = device_memory_budget / 100 * budget_percent;
+      uint64_t budget_low =
+          device_memory_budget / 100 *
+          (budget_percent - std::min(budget_percent, kMemoryBudgetHysteresis));
+      if (device_memory_usage > budget_high) {
+        budget_exceeded_ = true;
+      } else if (device_memory_usage <= budget_low) {
+        budget_exceeded_ = false;
+      }
+      if (budget_exceeded_) {
+        budget_excess = device_memory_usage - budget_low;
+      }
+    } else {
+      budget_exceeded_ = false;
+    }
+  }
   bool destroyed_any = false;
   while (texture_used_first_ != nullptr) {
     uint64_t total_host_memory_usage_mb =
         (textures_total_host_memory_usage_ + ((UINT32_C(1) << 20) - 1)) >> 20;
-    bool limit_hard_exceeded = total_host_memory_usage_mb > limit_hard_mb;
+    bool limit_hard_exceeded =
+        total_host_memory_usage_mb > limit_hard_mb || budget_excess;
     if (total_host_memory_usage_mb <= limit_soft_mb && !limit_hard_exceeded) {
       break;
     }
@@ -221,6 +291,7 @@ void TextureCache::CompletedSubmissionUpdated(
         (texture->last_usage_time() + limit_soft_lifetime) > current_time) {
       break;
     }
+    budget_excess -= std::min(budget_excess, texture->GetHostMemoryUsage());
     if (!destroyed_any) {
       destroyed_any = true;
       // The texture being destroyed might have been bound in the previous
@@ -326,6 +397,7 @@ void TextureCache::RequestTextures(uint32_t used_texture_mask) {
   Texture* textures_to_load[64];  // max bits = 32, can be unsigned + signed
                                   // means max array size = 64
   uint32_t num_textures_to_load = 0;
+  uint64_t textures_to_load_mips_deferrable = 0;
   while (xe::bit_scan_forward(textures_remaining, &index)) {
     uint32_t index_bit = UINT32_C(1) << index;
     textures_remaining = xe::clear_lowest_bit(textures_remaining);
@@ -399,15 +471,39 @@ void TextureCache::RequestTextures(uint32_t used_texture_mask) {
       }
       binding.texture_signed = nullptr;
     }
+    // The mips can be loaded later if only the base level is sampled from for
+    // now, otherwise if they have been deferred previously, they're needed.
+    bool mips_deferrable = false;
+    if (cvars::texture_cache_deferred_mips && !binding.key.scaled_resolve) {
+      uint32_t mip_min_level;
+      texture_util::GetSubresourcesFromFetchConstant(
+          fetch, nullptr, nullptr, nullptr, nullptr, nullptr, &mip_min_level,
+          nullptr);
+      mips_deferrable = !mip_min_level;
+    }
+    if (!mips_deferrable) {
+      if (binding.texture != nullptr && binding.texture->mips_deferred()) {
+        load_unsigned_data = true;
+      }
+      if (binding.texture_signed != nullptr &&
+          binding.texture_signed->mips_deferred()) {
+        load_signed_data = true;
+      }
+    }
     if (load_unsigned_data && binding.texture != nullptr) {
+      textures_to_load_mips_deferrable |= uint64_t(mips_deferrable)
+                                          << num_textures_to_load;
       textures_to_load[num_textures_to_load++] = binding.texture;
     }
     if (load_signed_data && binding.texture_signed != nullptr) {
+      textures_to_load_mips_deferrable |= uint64_t(mips_deferrable)
+                                          << num_textures_to_load;
       textures_to_load[num_textures_to_load++] = binding.texture_signed;
     }
   }
 
-  LoadTexturesData(textures_to_load, num_textures_to_load);
+  LoadTexturesData(textures_to_load, num_textures_to_load,
+                   textures_to_load_mips_deferrable);
 
   if (bindings_changed) {
     UpdateTextureBindingsImpl(bindings_changed);
@@ -503,9 +599,33 @@ TextureCache::Texture::~Texture() {
     texture_cache_.texture_used_last_ = used_previous_;
   }
 
+  ClearContentHash();
+
   texture_cache_.UpdateTexturesTotalHostMemoryUsage(0, host_memory_usage_);
 }
 
+void TextureCache::Texture::SetContentHash(uint64_t content_hash) {
+  ClearContentHash();
+  content_hash_ = content_hash;
+  has_content_hash_ = true;
+  texture_cache_.textures_by_content_hash_.emplace(content_hash, this);
+}
+
+void TextureCache::Texture::ClearContentHash() {
+  if (!has_content_hash_) {
+    return;
+  }
+  has_content_hash_ = false;
+  auto range =
+      texture_cache_.textures_by_content_hash_.equal_range(content_hash_);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second == this) {
+      texture_cache_.textures_by_content_hash_.erase(it);
+      break;
+    }
+  }
+}
+
 void TextureCache::Texture::MakeUpToDateAndWatch(
     const global_unique_lock_type& global_lock) {
   SharedMemory& shared_memory = texture_cache().shared_memory();
@@ -516,7 +636,7 @@ void TextureCache::Texture::MakeUpToDateAndWatch(
         key().base_page << 12, GetGuestBaseSize(), TextureCache::WatchCallback,
         this, nullptr, 0);
   }
-  if (mips_outdated_) {
+  if (mips_outdated_ && !mips_deferred_) {
     assert_not_zero(GetGuestMipsSize());
     mips_outdated_ = false;
     mips_watch_handle_ = shared_memory.WatchMemoryRange(
@@ -640,19 +760,21 @@ TextureCache::Texture* TextureCache::FindOrCreateTexture(TextureKey key) {
   texture->LogAction("Created");
   return texture;
 }
-void TextureCache::LoadTexturesData(Texture** textures, uint32_t n_textures) {
+void TextureCache::LoadTexturesData(Texture** textures, uint32_t n_textures,
+                                    uint64_t mips_deferrable_mask) {
   assert_true(n_textures <= 64);
   if (n_textures < 2) {
     if (!n_textures) {
       return;
     } else {
-      LoadTextureData(*textures[0]);
+      LoadTextureData(*textures[0], (mips_deferrable_mask & 1) != 0);
       return;
     }
   }
 
   uint64_t index_base_outdated = 0;
   uint64_t index_mips_outdated = 0;
+  uint64_t index_mips_deferred = 0;
   uint32_t nkept = 0;
   {
     auto global_lock = global_critical_region_.Acquire();
@@ -661,6 +783,11 @@ void TextureCache::LoadTexturesData(Texture** textures, uint32_t n_textures) {
 
       auto base_outdated = current->base_outdated(global_lock);
       auto mips_outdated = current->mips_outdated(global_lock);
+      if (base_outdated && mips_outdated &&
+          (mips_deferrable_mask & (1ULL << i))) {
+        mips_outdated = false;
+        index_mips_deferred |= 1ULL << i;
+      }
 
       index_base_outdated |= static_cast<uint64_t>(base_outdated) << i;
       index_mips_outdated |= static_cast<uint64_t>(mips_outdated) << i;
@@ -734,9 +861,10 @@ void TextureCache::LoadTexturesData(Texture** textures, uint32_t n_textures) {
     }
 
     // Actually load the texture data.
-    if (!LoadTextureDataFromResidentMemoryImpl(
+    if (!LoadTextureDataFromResidentMemory(
             texture, (index_base_outdated & (1ULL << i)) != 0,
-            (index_mips_outdated & (1ULL << i)) != 0)) {
+            (index_mips_outdated & (1ULL << i)) != 0,
+            base_resolved || mips_resolved)) {
       continue;
     }
 
@@ -747,6 +875,11 @@ void TextureCache::LoadTexturesData(Texture** textures, uint32_t n_textures) {
       texture.SetBaseResolved(base_resolved);
       texture.SetMipsResolved(mips_resolved);
     }
+    if (index_mips_deferred & (1ULL << i)) {
+      texture.SetMipsDeferred(true);
+    } else if (index_mips_outdated & (1ULL << i)) {
+      texture.SetMipsDeferred(false);
+    }
     // reque for makeuptodatandwatch
     textures[i] = &texture;
   }
@@ -768,7 +901,7 @@ void TextureCache::LoadTexturesData(Texture** textures, uint32_t n_textures) {
     }
   }
 }
-bool TextureCache::LoadTextureData(Texture& texture) {
+bool TextureCache::LoadTextureData(Texture& texture, bool mips_deferrable) {
   // Check what needs to be uploaded.
   bool base_outdated, mips_outdated;
   {
@@ -779,6 +912,12 @@ bool TextureCache::LoadTextureData(Texture& texture) {
   if (!base_outdated && !mips_outdated) {
     return true;
   }
+  bool mips_deferred = false;
+  if (base_outdated && mips_outdated && mips_deferrable) {
+    mips_outdated = false;
+    mips_deferred = true;
+  }
+  texture_load_count_.fetch_add(1, std::memory_order_relaxed);
 
   TextureKey texture_key = texture.key();
 
@@ -830,8 +969,8 @@ bool TextureCache::LoadTextureData(Texture& texture) {
   }
 
   // Actually load the texture data.
-  if (!LoadTextureDataFromResidentMemoryImpl(texture, base_outdated,
-                                             mips_outdated)) {
+  if (!LoadTextureDataFromResidentMemory(texture, base_outdated, mips_outdated,
+                                         base_resolved || mips_resolved)) {
     return false;
   }
 
@@ -842,6 +981,11 @@ bool TextureCache::LoadTextureData(Texture& texture) {
     texture.SetBaseResolved(base_resolved);
     texture.SetMipsResolved(mips_resolved);
   }
+  if (mips_deferred) {
+    texture.SetMipsDeferred(true);
+  } else if (mips_outdated) {
+    texture.SetMipsDeferred(false);
+  }
 
   // Mark the ranges as uploaded and watch them. This is needed for scaled
   // resolves as well to detect when the CPU wants to reuse the memory for a
@@ -966,6 +1110,324 @@ void TextureCache::ResetTextureBindings(bool from_destructor) {
   }
 }
 
+bool TextureCache::LoadTextureDataFromResidentMemory(Texture& texture,
+                                                     bool load_base,
+                                                     bool load_mips,
+                                                     bool data_resolved) {
+  // The previous contents are being replaced at least partially.
+  texture.ClearContentHash();
+
+  // Only whole textures with data coming entirely from the CPU can be compared,
+  // resolved data is available only in the GPU memory.
+  const TextureKey& texture_key = texture.key();
+  if ((!cvars::texture_cache_deduplication && !texture_storage_file_) ||
+      texture_key.scaled_resolve || data_resolved || !load_base ||
+      (!load_mips && texture.GetGuestMipsSize())) {
+    return LoadTextureDataFromResidentMemoryImpl(texture, load_base,
+                                                 load_mips);
+  }
+
+  // The key with the guest addresses excluded, while keeping whether the base
+  // and the mips are present as they affect the layout.
+  auto get_content_key = [](const TextureKey& key) {
+    TextureKey content_key = key;
+    content_key.base_page = key.base_page != 0;
+    content_key.mip_page = key.mip_page != 0;
+    return content_key;
+  };
+  TextureKey content_key = get_content_key(texture_key);
+  uint64_t content_hash = XXH3_64bits(&content_key, sizeof(content_key));
+  if (!shared_memory().GetRangeHash(texture_key.base_page << 12,
+                                    texture.GetGuestBaseSize(), content_hash,
+                                    content_hash) ||
+      !shared_memory().GetRangeHash(texture_key.mip_page << 12,
+                                    texture.GetGuestMipsSize(), content_hash,
+                                    content_hash)) {
+    return LoadTextureDataFromResidentMemoryImpl(texture, load_base,
+                                                 load_mips);
+  }
+
+  bool loaded = false;
+  if (cvars::texture_cache_deduplication) {
+    auto range = textures_by_content_hash_.equal_range(content_hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      Texture& source = *it->second;
+      if (get_content_key(source.key()) != content_key) {
+        continue;
+      }
+      {
+        auto global_lock = global_critical_region_.Acquire();
+        if (source.base_outdated(global_lock) ||
+            source.mips_outdated(global_lock)) {
+          continue;
+        }
+      }
+      if (CopyTextureDataImpl(texture, source)) {
+        source.MarkAsUsed();
+        texture.LogAction("Copied");
+        loaded = true;
+        break;
+      }
+    }
+  }
+  if (!loaded && texture_storage_file_) {
+    uint64_t storage_host_format = GetTextureStorageHostFormat(texture);
+    if (storage_host_format) {
+      uint64_t storage_hash = XXH3_64bits_withSeed(
+          &storage_host_format, sizeof(storage_host_format), content_hash);
+      if (texture_storage_known_hashes_.find(storage_hash) !=
+          texture_storage_known_hashes_.end()) {
+        loaded = LoadTextureDataFromStorage(texture, storage_hash);
+      } else {
+        // Requesting only once even if the implementation can't provide the
+        // data currently, not to store the same data multiple times.
+        texture_storage_known_hashes_.insert(storage_hash);
+        if (!LoadAndStoreTextureDataFromResidentMemoryImpl(
+                texture, load_base, load_mips, storage_hash)) {
+          return false;
+        }
+        loaded = true;
+      }
+    }
+  }
+  if (!loaded &&
+      !LoadTextureDataFromResidentMemoryImpl(texture, load_base, load_mips)) {
+    return false;
+  }
+  texture.SetContentHash(content_hash);
+  return true;
+}
+
+bool TextureCache::LoadTextureDataFromStorage(Texture& texture,
+                                              uint64_t storage_hash) {
+  TextureStorageEntry entry;
+  {
+    std::lock_guard<std::mutex> lock(texture_storage_mutex_);
+    auto it = texture_storage_entries_.find(storage_hash);
+    if (it == texture_storage_entries_.end()) {
+      // Not written yet.
+      return false;
+    }
+    entry = it->second;
+    texture_storage_compressed_buffer_.resize(entry.compressed_size);
+    if (!xe::filesystem::Seek(texture_storage_file_, int64_t(entry.offset),
+                              SEEK_SET) ||
+        !fread(texture_storage_compressed_buffer_.data(), entry.compressed_size,
+               1, texture_storage_file_)) {
+      return false;
+    }
+  }
+  texture_storage_data_buffer_.resize(entry.data_size);
+  size_t data_size = ZSTD_decompress(
+      texture_storage_data_buffer_.data(), texture_storage_data_buffer_.size(),
+      texture_storage_compressed_buffer_.data(), entry.compressed_size);
+  if (ZSTD_isError(data_size) || data_size != entry.data_size) {
+    return false;
+  }
+  if (!LoadTextureDataFromStorageImpl(
+          texture, texture_storage_data_buffer_.data(), data_size)) {
+    return false;
+  }
+  texture.LogAction("Loaded stored");
+  return true;
+}
+
+void TextureCache::InitializeTextureStorage(
+    const std::filesystem::path& cache_root, uint32_t title_id) {
+  ShutdownTextureStorage();
+
+  if (!cvars::texture_cache_storage) {
+    return;
+  }
+  const char* implementation_name = GetTextureStorageImplementationName();
+  if (!implementation_name) {
+    return;
+  }
+
+  // The host formats depend on the device, so the storage is not shareable.
+  auto texture_storage_root = cache_root / "textures" / "local";
+  if (!std::filesystem::exists(texture_storage_root)) {
+    if (!std::filesystem::create_directories(texture_storage_root)) {
+      XELOGE(
+          "Failed to create the texture storage directory, persistent texture "
+          "storage will be disabled: {}",
+          xe::path_to_utf8(texture_storage_root));
+      return;
+    }
+  }
+  auto texture_storage_file_path =
+      texture_storage_root /
+      fmt::format("{:08X}.{}.xtex", title_id, implementation_name);
+  texture_storage_file_ =
+      xe::filesystem::OpenFile(texture_storage_file_path, "a+b");
+  if (!texture_storage_file_) {
+    XELOGE(
+        "Failed to open the texture storage file for writing, persistent "
+        "texture storage will be disabled: {}",
+        xe::path_to_utf8(texture_storage_file_path));
+    return;
+  }
+
+  // Other emulator instances may be using the same file, don't let them
+  // append while validating or resetting it.
+  xe::filesystem::ScopedStdioFileLock texture_storage_file_lock(
+      texture_storage_file_);
+  int64_t texture_storage_file_size = -1;
+  if (xe::filesystem::Seek(texture_storage_file_, 0, SEEK_END)) {
+    texture_storage_file_size = xe::filesystem::Tell(texture_storage_file_);
+  }
+  struct {
+    uint32_t magic;
+    uint32_t version_swapped;
+  } texture_storage_file_header;
+  // 'XETX'.
+  const uint32_t texture_storage_magic = 0x58544558;
+  if (texture_storage_file_size > 0 &&
+      xe::filesystem::Seek(texture_storage_file_, 0, SEEK_SET) &&
+      fread(&texture_storage_file_header, sizeof(texture_storage_file_header),
+            1, texture_storage_file_) &&
+      texture_storage_file_header.magic == texture_storage_magic &&
+      xe::byte_swap(texture_storage_file_header.version_swapped) ==
+          TextureStoredHeader::kVersion) {
+    // Index the data written by previous Xenia executions until the end of the
+    // file or until a corrupted entry is detected.
+    uint64_t texture_storage_valid_bytes = sizeof(texture_storage_file_header);
+    TextureStoredHeader texture_header;
+    while (fread(&texture_header, sizeof(texture_header), 1,
+                 texture_storage_file_)) {
+      uint64_t data_offset =
+          texture_storage_valid_bytes + sizeof(texture_header);
+      uint64_t data_end = data_offset + texture_header.compressed_size;
+      if (!texture_header.compressed_size ||
+          data_end > uint64_t(texture_storage_file_size) ||
+          !xe::filesystem::Seek(texture_storage_file_, int64_t(data_end),
+                                SEEK_SET)) {
+        break;
+      }
+      TextureStorageEntry& entry =
+          texture_storage_entries_[texture_header.storage_hash];
+      entry.offset = data_offset;
+      entry.data_size = texture_header.data_size;
+      entry.compressed_size = texture_header.compressed_size;
+      texture_storage_known_hashes_.insert(texture_header.storage_hash);
+      texture_storage_valid_bytes = data_end;
+    }
+    xe::filesystem::TruncateStdioFile(texture_storage_file_,
+                                      texture_storage_valid_bytes);
+  } else {
+    xe::filesystem::TruncateStdioFile(texture_storage_file_, 0);
+    texture_storage_file_header.magic = texture_storage_magic;
+    texture_storage_file_header.version_swapped =
+        xe::byte_swap(TextureStoredHeader::kVersion);
+    fwrite(&texture_storage_file_header, sizeof(texture_storage_file_header),
+           1, texture_storage_file_);
+  }
+  fflush(texture_storage_file_);
+  XELOGGPU("Opened the texture storage with {} textures",
+           texture_storage_entries_.size());
+
+  texture_storage_write_thread_shutdown_ = false;
+  texture_storage_write_thread_ = xe::threading::Thread::Create(
+      {}, [this]() { TextureStorageWriteThread(); });
+  assert_not_null(texture_storage_write_thread_);
+  texture_storage_write_thread_->set_name("Texture storage writer");
+}
+
+void TextureCache::ShutdownTextureStorage() {
+  if (texture_storage_write_thread_) {
+    {
+      std::lock_guard<std::mutex> lock(texture_storage_mutex_);
+      texture_storage_write_thread_shutdown_ = true;
+    }
+    texture_storage_write_request_cond_.notify_all();
+    xe::threading::Wait(texture_storage_write_thread_.get(), false);
+    texture_storage_write_thread_.reset();
+  }
+  texture_storage_write_queue_.clear();
+  texture_storage_entries_.clear();
+  texture_storage_known_hashes_.clear();
+  if (texture_storage_file_) {
+    fclose(texture_storage_file_);
+    texture_storage_file_ = nullptr;
+  }
+}
+
+void TextureCache::StoreTextureData(uint64_t storage_hash, const void* data,
+                                    size_t data_size) {
+  if (!texture_storage_write_thread_ || !data_size ||
+      data_size > UINT32_MAX) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(texture_storage_mutex_);
+    texture_storage_write_queue_.emplace_back(
+        storage_hash,
+        std::vector<uint8_t>(reinterpret_cast<const uint8_t*>(data),
+                             reinterpret_cast<const uint8_t*>(data) +
+                                 data_size));
+  }
+  texture_storage_write_request_cond_.notify_one();
+}
+
+void TextureCache::TextureStorageWriteThread() {
+  std::pair<uint64_t, std::vector<uint8_t>> request;
+  std::vector<uint8_t> compressed;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(texture_storage_mutex_);
+      if (texture_storage_write_thread_shutdown_) {
+        return;
+      }
+      if (texture_storage_write_queue_.empty()) {
+        texture_storage_write_request_cond_.wait(lock);
+        continue;
+      }
+      request = std::move(texture_storage_write_queue_.front());
+      texture_storage_write_queue_.pop_front();
+    }
+
+    // Compressing without holding the lock.
+    compressed.resize(ZSTD_compressBound(request.second.size()));
+    size_t compressed_size =
+        ZSTD_compress(compressed.data(), compressed.size(),
+                      request.second.data(), request.second.size(),
+                      ZSTD_CLEVEL_DEFAULT);
+    if (ZSTD_isError(compressed_size)) {
+      continue;
+    }
+    TextureStoredHeader texture_header;
+    texture_header.storage_hash = request.first;
+    texture_header.data_size = uint32_t(request.second.size());
+    texture_header.compressed_size = uint32_t(compressed_size);
+
+    std::lock_guard<std::mutex> lock(texture_storage_mutex_);
+    // Other instances may be appending to the same file, the end must not
+    // change until the entry is written and flushed.
+    xe::filesystem::ScopedStdioFileLock file_lock(texture_storage_file_);
+    int64_t header_offset = -1;
+    if (xe::filesystem::Seek(texture_storage_file_, 0, SEEK_END)) {
+      header_offset = xe::filesystem::Tell(texture_storage_file_);
+    }
+    if (header_offset < 0) {
+      continue;
+    }
+    if (!fwrite(&texture_header, sizeof(texture_header), 1,
+                texture_storage_file_) ||
+        !fwrite(compressed.data(), compressed_size, 1,
+                texture_storage_file_) ||
+        fflush(texture_storage_file_)) {
+      // Don't leave a partial entry breaking the following ones.
+      xe::filesystem::TruncateStdioFile(texture_storage_file_,
+                                        uint64_t(header_offset));
+      continue;
+    }
+    TextureStorageEntry& entry = texture_storage_entries_[request.first];
+    entry.offset = uint64_t(header_offset) + sizeof(texture_header);
+    entry.data_size = texture_header.data_size;
+    entry.compressed_size = texture_header.compressed_size;
+  }
+}
+
 void TextureCache::UpdateTexturesTotalHostMemoryUsage(uint64_t add,
                                                       uint64_t subtract) {
   textures_total_host_memory_usage_ =
@@ -12,15 +12,24 @@
 
 #include <array>
 #include <atomic>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
+#include <deque>
+#include <filesystem>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "xenia/base/assert.h"
 #include "xenia/base/hash.h"
 #include "xenia/base/math.h"
 #include "xenia/base/mutex.h"
+#include "xenia/base/threading.h"
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/shared_memory.h"
 #include "xenia/gpu/texture_util.h"
@@ -68,6 +77,10 @@ class TextureCache {
   virtual ~TextureCache();
 
   // Returns whether the actual scale is not smaller than the requested one.
+  // The scale is the same for all render targets: EDRAM tiles, ownership
+  // transfers between render targets aliasing the same EDRAM, resolves and the
+  // scaled resolve memory that textures are loaded from are all laid out for
+  // one scale, so it can only be changed per title (via the game config).
   static bool GetConfigDrawResolutionScale(uint32_t& x_out, uint32_t& y_out);
   uint32_t draw_resolution_scale_x() const { return draw_resolution_scale_x_; }
   uint32_t draw_resolution_scale_y() const { return draw_resolution_scale_y_; }
@@ -116,6 +129,17 @@ class TextureCache {
 
   virtual void RequestTextures(uint32_t used_texture_mask);
 
+  // Number of times outdated texture data has been loaded, for statistics.
+  uint64_t texture_load_count() const {
+    return texture_load_count_.load(std::memory_order_relaxed);
+  }
+
+  // Opens the persistent storage of the host data of textures for the title if
+  // texture_cache_storage is enabled and the implementation supports it.
+  void InitializeTextureStorage(const std::filesystem::path& cache_root,
+                                uint32_t title_id);
+  void ShutdownTextureStorage();
+
   // "ActiveTexture" means as of the latest RequestTextures call.
 
   uint32_t GetActiveTextureHostSwizzle(uint32_t fetch_constant_index) const {
@@ -137,6 +161,18 @@ class TextureCache {
     return (binding->texture && binding->texture->IsResolved()) ||
            (binding->texture_signed && binding->texture_signed->IsResolved());
   }
+  // Whether sampling must be limited to the base level because the mips
+  // haven't been loaded yet with texture_cache_deferred_mips.
+  bool AreActiveTextureMipsDeferred(uint32_t fetch_constant_index) const {
+    const TextureBinding* binding =
+        GetValidTextureBinding(fetch_constant_index);
+    if (!binding) {
+      return false;
+    }
+    return (binding->texture && binding->texture->mips_deferred()) ||
+           (binding->texture_signed &&
+            binding->texture_signed->mips_deferred());
+  }
   template <swcache::PrefetchTag tag>
   void PrefetchTextureBinding(uint32_t fetch_constant_index) const {
     swcache::Prefetch<tag>(&texture_bindings_[fetch_constant_index]);
@@ -256,6 +292,20 @@ class TextureCache {
     }
     bool IsResolved() const { return base_resolved_ || mips_resolved_; }
 
+    // Whether only the base has been loaded with texture_cache_deferred_mips,
+    // and the mips have never been loaded since then, so only the base level
+    // can be sampled.
+    bool mips_deferred() const { return mips_deferred_; }
+    void SetMipsDeferred(bool mips_deferred) { mips_deferred_ = mips_deferred; }
+
+    // Hash of the guest data and of the properties of the texture as of the
+    // latest load if the whole texture was loaded from the guest memory, for
+    // reusing the data loaded into other textures with the same contents.
+    bool has_content_hash() const { return has_content_hash_; }
+    uint64_t content_hash() const { return content_hash_; }
+    void SetContentHash(uint64_t content_hash);
+    void ClearContentHash();
+
     bool base_outdated(const global_unique_lock_type& global_lock) const {
       return base_outdated_;
     }
@@ -304,6 +354,11 @@ class TextureCache {
     bool base_resolved_;
     bool mips_resolved_;
 
+    bool mips_deferred_ = false;
+
+    bool has_content_hash_ = false;
+    uint64_t content_hash_ = 0;
+
     // These are to be accessed within the global critical region to synchronize
     // with shared memory.
     // Whether the recent base level data needs reloading from the memory.
@@ -567,8 +622,11 @@ class TextureCache {
     assert_true(load_shader_index < kLoadShaderCount);
     return load_shader_info_[load_shader_index];
   }
-  bool LoadTextureData(Texture& texture);
-  void LoadTexturesData(Texture** textures, uint32_t n_textures);
+  // If mips_deferrable, and both the base and the mips are outdated, only the
+  // base is loaded, and the mips are left outdated until the next load.
+  bool LoadTextureData(Texture& texture, bool mips_deferrable = false);
+  void LoadTexturesData(Texture** textures, uint32_t n_textures,
+                        uint64_t mips_deferrable_mask = 0);
   // Writes the texture data (for base, mips or both - but not neither) from the
   // shared memory or the scaled resolve memory. The shared memory management is
   // done outside this function, the implementation just needs to load the data
@@ -576,6 +634,55 @@ class TextureCache {
   virtual bool LoadTextureDataFromResidentMemoryImpl(Texture& texture,
                                                      bool load_base,
                                                      bool load_mips) = 0;
+  // Copies the whole host data of a texture with the same properties other
+  // than the guest addresses, and the same contents, instead of loading it.
+  // Returns false if copying is not supported or not possible currently, in
+  // this case, the data will be loaded normally.
+  virtual bool CopyTextureDataImpl(Texture& dest, Texture& source) {
+    return false;
+  }
+
+  // Gets the current usage and the budget of the device-local memory by the
+  // whole process, in bytes, as reported by the host graphics API. Returns
+  // false if not available, in this case, only the texture cache memory limits
+  // are used for eviction.
+  virtual bool GetDeviceMemoryBudget(uint64_t& usage_out,
+                                     uint64_t& budget_out) {
+    return false;
+  }
+
+  // Persistent texture storage interface. The stored data is in an
+  // implementation-specific layout, so a separate file is used for every
+  // implementation, with the name returned by
+  // GetTextureStorageImplementationName, or nullptr if the storage is not
+  // supported.
+  virtual const char* GetTextureStorageImplementationName() const {
+    return nullptr;
+  }
+  // Returns a non-zero identifier of the host representation of the data of
+  // the texture (such as the host format and the load shader), or 0 if the data
+  // of the texture can't be stored.
+  virtual uint64_t GetTextureStorageHostFormat(const Texture& texture) const {
+    return 0;
+  }
+  // Loads the data of the whole texture from what the implementation has
+  // previously passed to StoreTextureData. Returns false if not possible, in
+  // this case, the data will be loaded normally.
+  virtual bool LoadTextureDataFromStorageImpl(Texture& texture,
+                                              const void* data,
+                                              size_t data_size) {
+    return false;
+  }
+  // Like LoadTextureDataFromResidentMemoryImpl, but also, if possible, gets the
+  // host data of the whole texture to pass it to StoreTextureData with the
+  // storage hash when it's available.
+  virtual bool LoadAndStoreTextureDataFromResidentMemoryImpl(
+      Texture& texture, bool load_base, bool load_mips, uint64_t storage_hash) {
+    return LoadTextureDataFromResidentMemoryImpl(texture, load_base,
+                                                 load_mips);
+  }
+  void StoreTextureData(uint64_t storage_hash, const void* data,
+                        size_t data_size);
 
   // Converts a texture fetch constant to a texture key, normalizing and
   // validating the values, or creating an invalid key, and also gets the
@@ -601,6 +708,16 @@ class TextureCache {
  private:
   void UpdateTexturesTotalHostMemoryUsage(uint64_t add, uint64_t subtract);
 
+  // Loads the texture data via LoadTextureDataFromResidentMemoryImpl, or, if
+  // deduplication is enabled, and another up-to-date texture has the same
+  // contents, via CopyTextureDataImpl. data_resolved is whether the data about
+  // to be loaded contains resolved pages.
+  bool LoadTextureDataFromResidentMemory(Texture& texture, bool load_base,
+                                         bool load_mips, bool data_resolved);
+  bool LoadTextureDataFromStorage(Texture& texture, uint64_t storage_hash);
+
+  void TextureStorageWriteThread();
+
   // Shared memory callback for texture data invalidation.
   static void WatchCallback(const global_unique_lock_type& global_lock,
                             void* context, void* data, uint64_t argument,
@@ -647,6 +764,48 @@ class TextureCache {
 
   uint64_t textures_total_host_memory_usage_ = 0;
 
+  // For texture_cache_memory_budget_percent, how far below the limit (in
+  // percent of the budget) the usage needs to go for budget-based eviction to
+  // stop.
+  static constexpr uint32_t kMemoryBudgetHysteresis = 10;
+  bool budget_exceeded_ = false;
+
+  // Textures with a content hash, for texture_cache_deduplication.
+  std::unordered_multimap<uint64_t, Texture*> textures_by_content_hash_;
+
+  struct TextureStoredHeader {
+    // Update if the layout of the file or of the content hash is changed.
+    static constexpr uint32_t kVersion = 0x20221201;
+
+    // Hash of the content hash and the host format.
+    uint64_t storage_hash;
+    uint32_t data_size;
+    uint32_t compressed_size;
+  };
+  struct TextureStorageEntry {
+    // Offset of the compressed data in the file.
+    uint64_t offset;
+    uint32_t data_size;
+    uint32_t compressed_size;
+  };
+  // Appended to by the write thread, read by the command processor thread,
+  // with texture_storage_mutex_ locked.
+  FILE* texture_storage_file_ = nullptr;
+  // Hashes of the data that has been stored or requested to be stored,
+  // accessed only by the command processor thread.
+  std::unordered_set<uint64_t> texture_storage_known_hashes_;
+  std::vector<uint8_t> texture_storage_compressed_buffer_;
+  std::vector<uint8_t> texture_storage_data_buffer_;
+  // Used by the command processor thread and the write thread.
+  std::mutex texture_storage_mutex_;
+  std::condition_variable texture_storage_write_request_cond_;
+  // Protected by texture_storage_mutex_.
+  std::unordered_map<uint64_t, TextureStorageEntry> texture_storage_entries_;
+  std::deque<std::pair<uint64_t, std::vector<uint8_t>>>
+      texture_storage_write_queue_;
+  bool texture_storage_write_thread_shutdown_ = false;
+  std::unique_ptr<xe::threading::Thread> texture_storage_write_thread_;
+
   Texture* texture_used_first_ = nullptr;
   Texture* texture_used_last_ = nullptr;
 
@@ -655,6 +814,8 @@ class TextureCache {
   // constants have been changed.
   std::atomic<bool> texture_became_outdated_{false};
 
+  std::atomic<uint64_t> texture_load_count_{0};
+
   std::array<TextureBinding, xenos::kTextureFetchConstantCount>
       texture_bindings_;
   // Bit vector with bits reset on fetch constant writes to avoid parsing fetch
@@ -17,6 +17,7 @@
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/memory.h"
+#include "xenia/base/platform.h"
 #include "xenia/base/profiling.h"
 #include "xenia/base/xxhash.h"
 
@@ -37,7 +38,7 @@ void CopySwapBlock(xenos::Endian endian, void* output, const void* input,
       break;
     case xenos::Endian::k16in32:  // Swap high and low 16 bits within a 32 bit
                                   // word
-      xe::copy_and_swap_16_in_32_unaligned(output, input, length);
+      xe::copy_and_swap_16_in_32_unaligned(output, input, length / 4);
       break;
     default:
     case xenos::Endian::kNone:
@@ -90,66 +91,174 @@ void ConvertTexelDXT3AToDXT3(xenos::Endian endian, void* output,
   std::memset(&output_bytes[8], 0, 8);
 }
 
-// https://github.com/BinomialLLC/crunch/blob/ea9b8d8c00c8329791256adafa8cf11e4e7942a2/inc/crn_decomp.h#L4108
-static uint32_t TiledOffset2DRow(uint32_t y, uint32_t width,
-                                 uint32_t log2_bpp) {
-  uint32_t macro = ((y / 32) * (width / 32)) << (log2_bpp + 7);
-  uint32_t micro = ((y & 6) << 2) << log2_bpp;
-  return macro + ((micro & ~0xF) << 1) + (micro & 0xF) +
-         ((y & 8) << (3 + log2_bpp)) + ((y & 1) << 4);
+void Untile(uint8_t* output_buffer, const uint8_t* input_buffer,
+            const UntileInfo* untile_info) {
+  SCOPE_profile_cpu_f("gpu");
+  assert_not_null(untile_info);
+  const UntileCopyBlockCallback& copy_callback = untile_info->copy_callback;
+  UntileBlocks(output_buffer, input_buffer, untile_info,
+               [&copy_callback](void* output, const void* input,
+                                size_t length) {
+                 copy_callback(output, input, length);
+               });
 }
 
-static uint32_t TiledOffset2DColumn(uint32_t x, uint32_t y, uint32_t log2_bpp,
-                                    uint32_t base_offset) {
-  uint32_t macro = (x / 32) << (log2_bpp + 7);
-  uint32_t micro = (x & 7) << log2_bpp;
-  uint32_t offset =
-      base_offset + (macro + ((micro & ~0xF) << 1) + (micro & 0xF));
-  return ((offset & ~0x1FF) << 3) + ((offset & 0x1C0) << 2) + (offset & 0x3F) +
-         ((y & 16) << 7) + (((((y & 8) >> 2) + (x >> 3)) & 3) << 6);
+namespace {
+
+// Swapping within aligned units is the same as flipping the low bits of the
+// byte addresses.
+constexpr uint32_t GetEndianByteXor(xenos::Endian endian) {
+  switch (endian) {
+    case xenos::Endian::k8in16:
+      return 1;
+    case xenos::Endian::k8in32:
+      return 3;
+    case xenos::Endian::k16in32:
+      return 2;
+    default:
+      return 0;
+  }
 }
 
-void Untile(uint8_t* output_buffer, const uint8_t* input_buffer,
-            const UntileInfo* untile_info) {
+template <xenos::Endian kEndian>
+inline void CopySwap8Bytes(uint8_t* output, const uint8_t* input) {
+  uint64_t value;
+  std::memcpy(&value, input, sizeof(value));
+  if (kEndian == xenos::Endian::k8in16 || kEndian == xenos::Endian::k8in32) {
+    value = ((value & 0x00FF00FF00FF00FFull) << 8) |
+            ((value >> 8) & 0x00FF00FF00FF00FFull);
+  }
+  if (kEndian == xenos::Endian::k8in32 || kEndian == xenos::Endian::k16in32) {
+    value = ((value & 0x0000FFFF0000FFFFull) << 16) |
+            ((value >> 16) & 0x0000FFFF0000FFFFull);
+  }
+  std::memcpy(output, &value, sizeof(value));
+}
+
+template <xenos::Endian kEndian>
+inline void CopySwap16Bytes(uint8_t* output, const uint8_t* input) {
+#if XE_ARCH_AMD64
+  constexpr char kXor = char(GetEndianByteXor(kEndian));
+  __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input));
+  if (kXor) {
+    value = _mm_shuffle_epi8(
+        value, _mm_setr_epi8(0 ^ kXor, 1 ^ kXor, 2 ^ kXor, 3 ^ kXor, 4 ^ kXor,
+                             5 ^ kXor, 6 ^ kXor, 7 ^ kXor, 8 ^ kXor, 9 ^ kXor,
+                             10 ^ kXor, 11 ^ kXor, 12 ^ kXor, 13 ^ kXor,
+                             14 ^ kXor, 15 ^ kXor));
+  }
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(output), value);
+#else
+  CopySwap8Bytes<kEndian>(output, input);
+  CopySwap8Bytes<kEndian>(output + 8, input + 8);
+#endif  // XE_ARCH_AMD64
+}
+
+template <uint32_t kLog2BytesPerBlock, xenos::Endian kEndian>
+void UntileCopySwapBlocks(uint8_t* output_buffer, const uint8_t* input_buffer,
+                          const UntileInfo* untile_info) {
+  constexpr uint32_t kBytesPerBlock = uint32_t(1) << kLog2BytesPerBlock;
+  // Blocks at the same tiled Y and neighboring X in the same 8 bytes (for
+  // 1-byte blocks) or 16 bytes are stored contiguously.
+  constexpr uint32_t kRunBlocks =
+      kLog2BytesPerBlock ? (16 >> kLog2BytesPerBlock) : 8;
+  constexpr uint32_t kRunBytes = kRunBlocks << kLog2BytesPerBlock;
+  constexpr uint32_t kXor = GetEndianByteXor(kEndian);
+  uint32_t output_pitch = untile_info->output_pitch << kLog2BytesPerBlock;
+  for (uint32_t y = 0; y < untile_info->height; ++y) {
+    uint32_t tiled_y = untile_info->offset_y + y;
+    uint32_t input_row_offset = TiledOffset2DRow(
+        tiled_y, untile_info->input_pitch, kLog2BytesPerBlock);
+    uint8_t* output = output_buffer + size_t(output_pitch) * y;
+    uint32_t x = 0;
+    while (x < untile_info->width) {
+      uint32_t tiled_x = untile_info->offset_x + x;
+      uint32_t input_offset =
+          (TiledOffset2DColumn(tiled_x, tiled_y, kLog2BytesPerBlock,
+                               input_row_offset) >>
+           kLog2BytesPerBlock)
+          << kLog2BytesPerBlock;
+      const uint8_t* input = input_buffer + input_offset;
+      if (!(tiled_x & (kRunBlocks - 1)) &&
+          untile_info->width - x >= kRunBlocks) {
+        if (kRunBytes == 16) {
+          CopySwap16Bytes<kEndian>(output, input);
+        } else {
+          CopySwap8Bytes<kEndian>(output, input);
+        }
+        x += kRunBlocks;
+        output += kRunBytes;
+        continue;
+      }
+      // A block at the left or the right edge of the region.
+      if (kBytesPerBlock == 8) {
+        CopySwap8Bytes<kEndian>(output, input);
+      } else if (!kXor) {
+        std::memcpy(output, input, kBytesPerBlock);
+      } else {
+        for (uint32_t i = 0; i < kBytesPerBlock; ++i) {
+          output[i] = input_buffer[(input_offset + i) ^ kXor];
+        }
+      }
+      ++x;
+      output += kBytesPerBlock;
+    }
+  }
+}
+
+template <uint32_t kLog2BytesPerBlock>
+void UntileCopySwapLog2(uint8_t* output_buffer, const uint8_t* input_buffer,
+                        const UntileInfo* untile_info, xenos::Endian endian) {
+  switch (endian) {
+    case xenos::Endian::k8in16:
+      UntileCopySwapBlocks<kLog2BytesPerBlock, xenos::Endian::k8in16>(
+          output_buffer, input_buffer, untile_info);
+      break;
+    case xenos::Endian::k8in32:
+      UntileCopySwapBlocks<kLog2BytesPerBlock, xenos::Endian::k8in32>(
+          output_buffer, input_buffer, untile_info);
+      break;
+    case xenos::Endian::k16in32:
+      UntileCopySwapBlocks<kLog2BytesPerBlock, xenos::Endian::k16in32>(
+          output_buffer, input_buffer, untile_info);
+      break;
+    default:
+      UntileCopySwapBlocks<kLog2BytesPerBlock, xenos::Endian::kNone>(
+          output_buffer, input_buffer, untile_info);
+      break;
+  }
+}
+
+}  // namespace
+
+void UntileCopySwap(uint8_t* output_buffer, const uint8_t* input_buffer,
+                    const UntileInfo* untile_info, xenos::Endian endian) {
   SCOPE_profile_cpu_f("gpu");
   assert_not_null(untile_info);
   assert_not_null(untile_info->input_format_info);
   assert_not_null(untile_info->output_format_info);
-
-  uint32_t input_bytes_per_block =
-      untile_info->input_format_info->bytes_per_block();
-  uint32_t output_bytes_per_block =
-      untile_info->output_format_info->bytes_per_block();
-  uint32_t output_pitch = untile_info->output_pitch * output_bytes_per_block;
-
-  // Bytes per pixel
-  auto log2_bpp = (input_bytes_per_block / 4) +
-                  ((input_bytes_per_block / 2) >> (input_bytes_per_block / 4));
-
-  // Offset to the current row, in bytes.
-  uint32_t output_row_offset = 0;
-  for (uint32_t y = 0; y < untile_info->height; y++) {
-    auto input_row_offset = TiledOffset2DRow(
-        untile_info->offset_y + y, untile_info->input_pitch, log2_bpp);
-
-    // Go block-by-block on this row.
-    uint32_t output_offset = output_row_offset;
-
-    for (uint32_t x = 0; x < untile_info->width; x++) {
-      auto input_offset = TiledOffset2DColumn(untile_info->offset_x + x,
-                                              untile_info->offset_y + y,
-                                              log2_bpp, input_row_offset);
-      input_offset >>= log2_bpp;
-
-      untile_info->copy_callback(
-          &output_buffer[output_offset],
-          &input_buffer[input_offset * input_bytes_per_block],
-          output_bytes_per_block);
-
-      output_offset += output_bytes_per_block;
-    }
-
-    output_row_offset += output_pitch;
+  uint32_t bytes_per_block = untile_info->input_format_info->bytes_per_block();
+  assert_true(untile_info->output_format_info->bytes_per_block() ==
+              bytes_per_block);
+  switch (bytes_per_block) {
+    case 1:
+      UntileCopySwapLog2<0>(output_buffer, input_buffer, untile_info, endian);
+      break;
+    case 2:
+      UntileCopySwapLog2<1>(output_buffer, input_buffer, untile_info, endian);
+      break;
+    case 4:
+      UntileCopySwapLog2<2>(output_buffer, input_buffer, untile_info, endian);
+      break;
+    case 8:
+      UntileCopySwapLog2<3>(output_buffer, input_buffer, untile_info, endian);
+      break;
+    case 16:
+      UntileCopySwapLog2<4>(output_buffer, input_buffer, untile_info, endian);
+      break;
+    default:
+      assert_unhandled_case(bytes_per_block);
+      break;
   }
 }
 
@@ -46,9 +46,85 @@ typedef struct UntileInfo {
   UntileCopyBlockCallback copy_callback;
 } UntileInfo;
 
+// https://github.com/BinomialLLC/crunch/blob/ea9b8d8c00c8329791256adafa8cf11e4e7942a2/inc/crn_decomp.h#L4108
+inline uint32_t TiledOffset2DRow(uint32_t y, uint32_t width,
+                                 uint32_t log2_bpp) {
+  uint32_t macro = ((y / 32) * (width / 32)) << (log2_bpp + 7);
+  uint32_t micro = ((y & 6) << 2) << log2_bpp;
+  return macro + ((micro & ~0xF) << 1) + (micro & 0xF) +
+         ((y & 8) << (3 + log2_bpp)) + ((y & 1) << 4);
+}
+
+inline uint32_t TiledOffset2DColumn(uint32_t x, uint32_t y, uint32_t log2_bpp,
+                                    uint32_t base_offset) {
+  uint32_t macro = (x / 32) << (log2_bpp + 7);
+  uint32_t micro = (x & 7) << log2_bpp;
+  uint32_t offset =
+      base_offset + (macro + ((micro & ~0xF) << 1) + (micro & 0xF));
+  return ((offset & ~0x1FF) << 3) + ((offset & 0x1C0) << 2) + (offset & 0x3F) +
+         ((y & 16) << 7) + (((((y & 8) >> 2) + (x >> 3)) & 3) << 6);
+}
+
+inline uint32_t GetUntileLog2BytesPerBlock(uint32_t bytes_per_block) {
+  return (bytes_per_block / 4) +
+         ((bytes_per_block / 2) >> (bytes_per_block / 4));
+}
+
+// Untiles the blocks calling copy_block(output, input, output_bytes_per_block)
+// for each of them - unlike UntileInfo::copy_callback, which is not used, it
+// can be inlined.
+template <typename CopyBlock>
+void UntileBlocks(uint8_t* output_buffer, const uint8_t* input_buffer,
+                  const UntileInfo* untile_info, CopyBlock&& copy_block) {
+  assert_not_null(untile_info);
+  assert_not_null(untile_info->input_format_info);
+  assert_not_null(untile_info->output_format_info);
+
+  uint32_t input_bytes_per_block =
+      untile_info->input_format_info->bytes_per_block();
+  uint32_t output_bytes_per_block =
+      untile_info->output_format_info->bytes_per_block();
+  uint32_t output_pitch = untile_info->output_pitch * output_bytes_per_block;
+  uint32_t log2_bpp = GetUntileLog2BytesPerBlock(input_bytes_per_block);
+
+  // Offset to the current row, in bytes.
+  uint32_t output_row_offset = 0;
+  for (uint32_t y = 0; y < untile_info->height; y++) {
+    auto input_row_offset = TiledOffset2DRow(
+        untile_info->offset_y + y, untile_info->input_pitch, log2_bpp);
+
+    // Go block-by-block on this row.
+    uint32_t output_offset = output_row_offset;
+
+    for (uint32_t x = 0; x < untile_info->width; x++) {
+      auto input_offset = TiledOffset2DColumn(untile_info->offset_x + x,
+                                              untile_info->offset_y + y,
+                                              log2_bpp, input_row_offset);
+      input_offset >>= log2_bpp;
+
+      copy_block(&output_buffer[output_offset],
+                 &input_buffer[input_offset * input_bytes_per_block],
+                 size_t(output_bytes_per_block));
+
+      output_offset += output_bytes_per_block;
+    }
+
+    output_row_offset += output_pitch;
+  }
+}
+
 void Untile(uint8_t* output_buffer, const uint8_t* input_buffer,
             const UntileInfo* untile_info);
 
+// Untiles the texture and swaps its endianness without converting the format,
+// so the output format must have the same block size as the input one. The
+// runs of blocks that are contiguous in the tiled layout (8 bytes for 1-byte
+// blocks, 16 bytes for larger ones) are copied at once using SIMD where
+// available. The input buffer must be aligned to 4 bytes. copy_callback is not
+// used.
+void UntileCopySwap(uint8_t* output_buffer, const uint8_t* input_buffer,
+                    const UntileInfo* untile_info, xenos::Endian endian);
+
 }  // namespace texture_conversion
 }  // namespace gpu
 }  // namespace xe
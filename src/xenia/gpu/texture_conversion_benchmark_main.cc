@@ -0,0 +1,142 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "xenia/base/clock.h"
+#include "xenia/base/console_app_main.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/gpu/texture_conversion.h"
+#include "xenia/gpu/texture_info.h"
+#include "xenia/gpu/xenos.h"
+
+DEFINE_transient_string(benchmark_name, "",
+                        "Only run the benchmark of the format with this name.",
+                        "General");
+DEFINE_uint32(benchmark_texture_size, 1024,
+              "Width and height of the benchmarked textures in texels.", "GPU");
+DEFINE_uint32(benchmark_repeat, 10,
+              "Measurements of every benchmark, the fastest one is reported.",
+              "GPU");
+
+namespace xe {
+namespace gpu {
+namespace texture_conversion {
+namespace benchmark {
+
+struct Benchmark {
+  xenos::TextureFormat format;
+  xenos::Endian endian;
+};
+
+// The block sizes of the Xenos tiled formats, with the endianness they're
+// usually stored with.
+const Benchmark kBenchmarks[] = {
+    {xenos::TextureFormat::k_8, xenos::Endian::kNone},
+    {xenos::TextureFormat::k_8_8, xenos::Endian::k8in16},
+    {xenos::TextureFormat::k_8_8_8_8, xenos::Endian::k8in32},
+    {xenos::TextureFormat::k_16_16, xenos::Endian::k16in32},
+    {xenos::TextureFormat::k_16_16_16_16, xenos::Endian::k8in16},
+    {xenos::TextureFormat::k_DXT1, xenos::Endian::k8in16},
+    {xenos::TextureFormat::k_DXT4_5, xenos::Endian::k8in16},
+    {xenos::TextureFormat::k_32_32_32_32_FLOAT, xenos::Endian::k8in32},
+};
+
+template <typename Function>
+double MeasureNanoseconds(Function&& function) {
+  uint64_t best_ticks = UINT64_MAX;
+  for (uint32_t i = 0; i < std::max(cvars::benchmark_repeat, uint32_t(1));
+       ++i) {
+    uint64_t start = Clock::QueryHostTickCount();
+    function();
+    best_ticks = std::min(best_ticks, Clock::QueryHostTickCount() - start);
+  }
+  return double(best_ticks) * 1000000000.0 /
+         double(Clock::QueryHostTickFrequency());
+}
+
+bool RunBenchmark(const Benchmark& benchmark) {
+  const FormatInfo* format_info = FormatInfo::Get(benchmark.format);
+  // The tiled pitch is aligned to 32 blocks.
+  uint32_t width_blocks = xe::align(
+      (cvars::benchmark_texture_size + format_info->block_width - 1) /
+          format_info->block_width,
+      uint32_t(32));
+  uint32_t height_blocks = xe::align(
+      (cvars::benchmark_texture_size + format_info->block_height - 1) /
+          format_info->block_height,
+      uint32_t(32));
+  uint32_t bytes_per_block = format_info->bytes_per_block();
+  size_t size = size_t(width_blocks) * height_blocks * bytes_per_block;
+
+  std::vector<uint8_t> input(size);
+  for (size_t i = 0; i < size; ++i) {
+    input[i] = uint8_t(i * 0x9E + (i >> 7));
+  }
+  std::vector<uint8_t> output_callback(size), output_copy_swap(size);
+
+  UntileInfo untile_info = {};
+  untile_info.width = width_blocks;
+  untile_info.height = height_blocks;
+  untile_info.input_pitch = width_blocks;
+  untile_info.output_pitch = width_blocks;
+  untile_info.input_format_info = format_info;
+  untile_info.output_format_info = format_info;
+  xenos::Endian endian = benchmark.endian;
+  untile_info.copy_callback = [endian](void* output, const void* input,
+                                       size_t length) {
+    CopySwapBlock(endian, output, input, length);
+  };
+
+  double callback_ns = MeasureNanoseconds([&]() {
+    Untile(output_callback.data(), input.data(), &untile_info);
+  });
+  double copy_swap_ns = MeasureNanoseconds([&]() {
+    UntileCopySwap(output_copy_swap.data(), input.data(), &untile_info,
+                   endian);
+  });
+
+  if (output_callback != output_copy_swap) {
+    XELOGE("  {:<24} UntileCopySwap result differs from Untile",
+           FormatInfo::GetName(benchmark.format));
+    return false;
+  }
+  XELOGI("  {:<24} Untile {:>8.3f} GB/s, UntileCopySwap {:>8.3f} GB/s",
+         FormatInfo::GetName(benchmark.format), double(size) / callback_ns,
+         double(size) / copy_swap_ns);
+  return true;
+}
+
+int main(const std::vector<std::string>& args) {
+  bool any_failed = false;
+  for (const Benchmark& benchmark : kBenchmarks) {
+    if (!cvars::benchmark_name.empty() &&
+        cvars::benchmark_name != FormatInfo::GetName(benchmark.format)) {
+      continue;
+    }
+    if (!RunBenchmark(benchmark)) {
+      any_failed = true;
+    }
+  }
+  return any_failed ? 1 : 0;
+}
+
+}  // namespace benchmark
+}  // namespace texture_conversion
+}  // namespace gpu
+}  // namespace xe
+
+XE_DEFINE_CONSOLE_APP("xenia-gpu-texture-conversion-benchmarks",
+                      xe::gpu::texture_conversion::benchmark::main,
+                      "[format name]", "benchmark_name");
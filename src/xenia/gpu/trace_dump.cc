@@ -9,7 +9,12 @@
 
 #include "xenia/gpu/trace_dump.h"
 
+#include <algorithm>
+#include <vector>
+
+#include "third_party/fmt/include/fmt/format.h"
 #include "third_party/stb/stb_image_write.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/profiling.h"
@@ -30,6 +35,11 @@
 
 DEFINE_path(target_trace_file, "", "Specifies the trace file to load.", "GPU");
 DEFINE_path(trace_dump_path, "", "Output path for dumped files.", "GPU");
+DEFINE_int32(trace_dump_benchmark_iterations, 0,
+             "If above 0, instead of dumping the output image, replay all the "
+             "frames of the trace this many times, and write the CPU playback "
+             "time and the draw count of each frame to a .json file.",
+             "GPU");
 
 namespace xe {
 namespace gpu {
@@ -119,6 +129,10 @@ bool TraceDump::Load(const std::filesystem::path& trace_file_path) {
 }
 
 int TraceDump::Run() {
+  if (cvars::trace_dump_benchmark_iterations > 0) {
+    return RunBenchmark();
+  }
+
   BeginHostCapture();
   player_->SeekFrame(0);
   player_->SeekCommand(
@@ -151,5 +165,75 @@ int TraceDump::Run() {
   return result;
 }
 
+int TraceDump::RunBenchmark() {
+  uint32_t iteration_count = uint32_t(cvars::trace_dump_benchmark_iterations);
+  int frame_count = player_->frame_count();
+  struct FrameStatistics {
+    uint32_t draw_count = 0;
+    uint64_t ticks_min = UINT64_MAX;
+    uint64_t ticks_max = 0;
+    uint64_t ticks_total = 0;
+  };
+  std::vector<FrameStatistics> frame_statistics(size_t(frame_count));
+  for (int i = 0; i < frame_count; ++i) {
+    for (const TraceReader::Frame::Command& command :
+         player_->frame(i)->commands) {
+      if (command.type == TraceReader::Frame::Command::Type::kDraw) {
+        ++frame_statistics[i].draw_count;
+      }
+    }
+  }
+
+  // The first iteration also includes pipeline creation and the initial
+  // texture loading, so the minimum is more representative than the average
+  // for the steady state.
+  uint64_t ticks_start = Clock::QueryHostTickCount();
+  for (uint32_t i = 0; i < iteration_count; ++i) {
+    for (int j = 0; j < frame_count; ++j) {
+      uint64_t frame_ticks_start = Clock::QueryHostTickCount();
+      player_->PlayFrame(j);
+      player_->WaitOnPlayback();
+      uint64_t frame_ticks = Clock::QueryHostTickCount() - frame_ticks_start;
+      FrameStatistics& frame = frame_statistics[j];
+      frame.ticks_min = std::min(frame.ticks_min, frame_ticks);
+      frame.ticks_max = std::max(frame.ticks_max, frame_ticks);
+      frame.ticks_total += frame_ticks;
+    }
+  }
+  uint64_t ticks_total = Clock::QueryHostTickCount() - ticks_start;
+
+  double us_per_tick = 1000000.0 / double(Clock::QueryHostTickFrequency());
+  std::string json = fmt::format(
+      "{{\n  \"iterations\": {},\n  \"total_us\": {:.0f},\n  \"frames\": [",
+      iteration_count, double(ticks_total) * us_per_tick);
+  for (int i = 0; i < frame_count; ++i) {
+    const FrameStatistics& frame = frame_statistics[i];
+    json += fmt::format(
+        "{}\n    {{\"draws\": {}, \"cpu_us_min\": {:.0f}, "
+        "\"cpu_us_avg\": {:.0f}, \"cpu_us_max\": {:.0f}}}",
+        i ? "," : "", frame.draw_count, double(frame.ticks_min) * us_per_tick,
+        double(frame.ticks_total) * us_per_tick / double(iteration_count),
+        double(frame.ticks_max) * us_per_tick);
+  }
+  json += "\n  ]\n}\n";
+
+  int result = 0;
+  auto json_path = base_output_path_.replace_extension(".json");
+  FILE* handle = filesystem::OpenFile(json_path, "wb");
+  if (handle) {
+    fwrite(json.data(), 1, json.size(), handle);
+    fclose(handle);
+    XELOGI("Benchmark results written to {}", xe::path_to_utf8(json_path));
+  } else {
+    XELOGE("Failed to open the benchmark output file {}",
+           xe::path_to_utf8(json_path));
+    result = 1;
+  }
+
+  player_.reset();
+  emulator_.reset();
+  return result;
+}
+
 }  //  namespace gpu
 }  //  namespace xe
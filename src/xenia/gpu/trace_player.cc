@@ -56,6 +56,16 @@ void TracePlayer::SeekFrame(int target_frame) {
             TracePlaybackMode::kBreakOnSwap, false);
 }
 
+void TracePlayer::PlayFrame(int target_frame) {
+  current_frame_index_ = target_frame;
+  auto frame = current_frame();
+  current_command_index_ = int(frame->commands.size()) - 1;
+
+  assert_true(frame->start_ptr <= frame->end_ptr);
+  PlayTrace(frame->start_ptr, frame->end_ptr - frame->start_ptr,
+            TracePlaybackMode::kBreakOnSwap, false);
+}
+
 void TracePlayer::SeekCommand(int target_command) {
   if (current_command_index_ == target_command) {
     return;
@@ -41,8 +41,21 @@ class TracePlayer : public TraceReader {
   // Scalar from 0-10000
   uint32_t playback_percent() const { return playback_percent_; }
 
+  // Seeking plays only the commands of the target frame, not everything from
+  // the beginning of the trace, so the state left by the preceding frames that
+  // haven't been played is whatever was there before.
+  // TODO(Triang3l): Checkpoints of the register file, the gamma ramp, the
+  // EDRAM and the shared memory at frame boundaries, to restore the exact
+  // state when seeking. This needs the EDRAM and shared memory readback from
+  // the host GPU that currently only the D3D12 trace initialization (for
+  // WriteEdramSnapshot) implements, and the shared memory can only be
+  // compared with the previous checkpoint, not tracked as deltas, since the
+  // GPU writes to it directly.
   void SeekFrame(int target_frame);
   void SeekCommand(int target_command);
+  // Plays the whole frame even if it's the current one, without clearing the
+  // caches, for benchmarking.
+  void PlayFrame(int target_frame);
 
   void WaitOnPlayback();
 
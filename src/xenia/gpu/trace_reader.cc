@@ -12,6 +12,7 @@
 #include <cinttypes>
 
 #include "third_party/snappy/snappy.h"
+#include "third_party/zstd/lib/zstd.h"
 #include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/mapped_memory.h"
@@ -248,6 +249,11 @@ bool TraceReader::DecompressMemory(MemoryEncodingFormat encoding_format,
     case MemoryEncodingFormat::kSnappy:
       return snappy::RawUncompress(reinterpret_cast<const char*>(src), src_size,
                                    reinterpret_cast<char*>(dest));
+    case MemoryEncodingFormat::kZstd: {
+      size_t decompressed_size =
+          ZSTD_decompress(dest, dest_size, src, src_size);
+      return !ZSTD_isError(decompressed_size) && decompressed_size == dest_size;
+    }
     default:
       assert_unhandled_case(encoding_format);
       return false;
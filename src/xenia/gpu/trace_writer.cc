@@ -10,16 +10,17 @@
 #include "xenia/gpu/trace_writer.h"
 
 #include <cstring>
+#include <iterator>
 #include <memory>
 
-#include "third_party/snappy/snappy-sinksource.h"
-#include "third_party/snappy/snappy.h"
+#include "third_party/zstd/lib/zstd.h"
 
 #include "build/version.h"
 #include "xenia/base/assert.h"
 #include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/string.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/gpu/registers.h"
 #include "xenia/gpu/xenos.h"
 
@@ -29,7 +30,7 @@ namespace gpu {
 TraceWriter::TraceWriter(uint8_t* membase)
     : membase_(membase), file_(nullptr) {}
 
-TraceWriter::~TraceWriter() = default;
+TraceWriter::~TraceWriter() { Close(); }
 
 bool TraceWriter::Open(const std::filesystem::path& path, uint32_t title_id) {
   Close();
@@ -54,18 +55,50 @@ bool TraceWriter::Open(const std::filesystem::path& path, uint32_t title_id) {
   fwrite(&header, sizeof(header), 1, file_);
 
   cached_memory_reads_.clear();
+  memory_read_hashes_.clear();
+
+  writer_shutdown_ = false;
+  writer_thread_ =
+      xe::threading::Thread::Create({}, [this]() { WriterThread(); });
+  if (writer_thread_) {
+    writer_thread_->set_name("GPU Trace Writer");
+  } else {
+    XELOGW(
+        "Failed to create the GPU trace writer thread, writing on the calling "
+        "thread");
+  }
   return true;
 }
 
 void TraceWriter::Flush() {
   if (file_) {
+    SubmitPendingJob();
+    if (writer_thread_) {
+      std::unique_lock<std::mutex> lock(writer_mutex_);
+      while (writer_pending_count_) {
+        writer_done_cond_.wait(lock);
+      }
+    }
     fflush(file_);
   }
 }
 
 void TraceWriter::Close() {
   if (file_) {
+    SubmitPendingJob();
+    if (writer_thread_) {
+      {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        writer_shutdown_ = true;
+      }
+      writer_request_cond_.notify_one();
+      xe::threading::Wait(writer_thread_.get(), false);
+      writer_thread_.reset();
+    }
+    assert_true(writer_queue_.empty());
+
     cached_memory_reads_.clear();
+    memory_read_hashes_.clear();
 
     fflush(file_);
     fclose(file_);
@@ -73,6 +106,126 @@ void TraceWriter::Close() {
   }
 }
 
+void TraceWriter::Write(const void* data, size_t size) {
+  std::vector<uint8_t>& job_data = pending_job_.data;
+  const uint8_t* data_bytes = reinterpret_cast<const uint8_t*>(data);
+  job_data.insert(job_data.end(), data_bytes, data_bytes + size);
+  if (job_data.size() >= kPendingJobMaxSize) {
+    SubmitPendingJob();
+  }
+}
+
+template <typename Command>
+void TraceWriter::WriteEncodedCommand(
+    Command& cmd, bool compress,
+    std::initializer_list<std::pair<const void*, size_t>> data_parts) {
+  size_t data_size = 0;
+  for (const std::pair<const void*, size_t>& data_part : data_parts) {
+    data_size += data_part.second;
+  }
+  cmd.encoding_format = MemoryEncodingFormat::kNone;
+  cmd.encoded_length = uint32_t(data_size);
+  if (!compress) {
+    Write(&cmd, sizeof(cmd));
+    for (const std::pair<const void*, size_t>& data_part : data_parts) {
+      Write(data_part.first, data_part.second);
+    }
+    return;
+  }
+  // Keep the order of the commands.
+  SubmitPendingJob();
+  WriteJob job;
+  job.data.resize(sizeof(cmd) + data_size);
+  std::memcpy(job.data.data(), &cmd, sizeof(cmd));
+  size_t data_offset = sizeof(cmd);
+  for (const std::pair<const void*, size_t>& data_part : data_parts) {
+    std::memcpy(job.data.data() + data_offset, data_part.first,
+                data_part.second);
+    data_offset += data_part.second;
+  }
+  job.compress = true;
+  job.header_size = sizeof(cmd);
+  job.encoding_format_offset = offsetof(Command, encoding_format);
+  job.encoded_length_offset = offsetof(Command, encoded_length);
+  SubmitJob(std::move(job));
+}
+
+void TraceWriter::SubmitPendingJob() {
+  if (pending_job_.data.empty()) {
+    return;
+  }
+  SubmitJob(std::move(pending_job_));
+  pending_job_ = WriteJob();
+}
+
+void TraceWriter::SubmitJob(WriteJob&& job) {
+  if (!writer_thread_) {
+    WriteJobToFile(job);
+    return;
+  }
+  {
+    std::unique_lock<std::mutex> lock(writer_mutex_);
+    // Don't let the queue grow indefinitely if the writer can't keep up.
+    while (writer_pending_size_ >= kQueuedJobsMaxSize) {
+      writer_done_cond_.wait(lock);
+    }
+    writer_pending_size_ += job.data.size();
+    writer_queue_.push_back(std::move(job));
+    ++writer_pending_count_;
+  }
+  writer_request_cond_.notify_one();
+}
+
+void TraceWriter::WriteJobToFile(WriteJob& job) {
+  if (job.compress) {
+    size_t uncompressed_size = job.data.size() - job.header_size;
+    compressed_temp_.resize(ZSTD_compressBound(uncompressed_size));
+    // Prefer speed over the ratio, the trace is written while playing.
+    size_t compressed_size = ZSTD_compress(
+        compressed_temp_.data(), compressed_temp_.size(),
+        job.data.data() + job.header_size, uncompressed_size, 1);
+    if (!ZSTD_isError(compressed_size) && compressed_size < uncompressed_size) {
+      MemoryEncodingFormat encoding_format = MemoryEncodingFormat::kZstd;
+      uint32_t encoded_length = uint32_t(compressed_size);
+      std::memcpy(job.data.data() + job.encoding_format_offset,
+                  &encoding_format, sizeof(encoding_format));
+      std::memcpy(job.data.data() + job.encoded_length_offset,
+                  &encoded_length, sizeof(encoded_length));
+      fwrite(job.data.data(), 1, job.header_size, file_);
+      fwrite(compressed_temp_.data(), 1, compressed_size, file_);
+      return;
+    }
+  }
+  fwrite(job.data.data(), 1, job.data.size(), file_);
+}
+
+void TraceWriter::WriterThread() {
+  while (true) {
+    WriteJob job;
+    {
+      std::unique_lock<std::mutex> lock(writer_mutex_);
+      while (writer_queue_.empty()) {
+        if (writer_shutdown_) {
+          return;
+        }
+        writer_request_cond_.wait(lock);
+      }
+      job = std::move(writer_queue_.front());
+      writer_queue_.pop_front();
+    }
+
+    // Compressing and writing without holding the lock.
+    WriteJobToFile(job);
+
+    {
+      std::lock_guard<std::mutex> lock(writer_mutex_);
+      writer_pending_size_ -= job.data.size();
+      --writer_pending_count_;
+    }
+    writer_done_cond_.notify_all();
+  }
+}
+
 void TraceWriter::WritePrimaryBufferStart(uint32_t base_ptr, uint32_t count) {
   if (!file_) {
     return;
@@ -82,7 +235,7 @@ void TraceWriter::WritePrimaryBufferStart(uint32_t base_ptr, uint32_t count) {
       base_ptr,
       0,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  Write(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WritePrimaryBufferEnd() {
@@ -92,7 +245,7 @@ void TraceWriter::WritePrimaryBufferEnd() {
   PrimaryBufferEndCommand cmd = {
       TraceCommandType::kPrimaryBufferEnd,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  Write(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WriteIndirectBufferStart(uint32_t base_ptr, uint32_t count) {
@@ -104,7 +257,7 @@ void TraceWriter::WriteIndirectBufferStart(uint32_t base_ptr, uint32_t count) {
       base_ptr,
       0,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  Write(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WriteIndirectBufferEnd() {
@@ -114,7 +267,7 @@ void TraceWriter::WriteIndirectBufferEnd() {
   IndirectBufferEndCommand cmd = {
       TraceCommandType::kIndirectBufferEnd,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  Write(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WritePacketStart(uint32_t base_ptr, uint32_t count) {
@@ -126,8 +279,8 @@ void TraceWriter::WritePacketStart(uint32_t base_ptr, uint32_t count) {
       base_ptr,
       count,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
-  fwrite(membase_ + base_ptr, 4, count, file_);
+  Write(&cmd, sizeof(cmd));
+  Write(membase_ + base_ptr, sizeof(uint32_t) * count);
 }
 
 void TraceWriter::WritePacketEnd() {
@@ -137,7 +290,7 @@ void TraceWriter::WritePacketEnd() {
   PacketEndCommand cmd = {
       TraceCommandType::kPacketEnd,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  Write(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WriteMemoryRead(uint32_t base_ptr, size_t length,
@@ -182,86 +335,68 @@ void TraceWriter::WriteMemoryWrite(uint32_t base_ptr, size_t length,
                      host_ptr);
 }
 
-class SnappySink : public snappy::Sink {
- public:
-  SnappySink(FILE* file) : file_(file) {}
-
-  void Append(const char* bytes, size_t n) override {
-    fwrite(bytes, 1, n, file_);
+void TraceWriter::WriteMemoryCommand(TraceCommandType type, uint32_t base_ptr,
+                                     size_t length, const void* host_ptr) {
+  if (!host_ptr) {
+    host_ptr = membase_ + base_ptr;
   }
 
- private:
-  FILE* file_ = nullptr;
-};
+  if (type == TraceCommandType::kMemoryRead) {
+    // Playback will still have the data in memory.
+    if (IsMemoryReadRedundant(base_ptr, length, host_ptr)) {
+      return;
+    }
+  } else {
+    // The playback will do the same write, which may change the contents.
+    InvalidateMemoryReadHashes(base_ptr, length);
+  }
 
-void TraceWriter::WriteMemoryCommand(TraceCommandType type, uint32_t base_ptr,
-                                     size_t length, const void* host_ptr) {
   MemoryCommand cmd = {};
   cmd.type = type;
   cmd.base_ptr = base_ptr;
-  cmd.encoding_format = MemoryEncodingFormat::kNone;
-  cmd.encoded_length = cmd.decoded_length = static_cast<uint32_t>(length);
+  cmd.decoded_length = static_cast<uint32_t>(length);
+  WriteEncodedCommand(cmd, compress_output_ && length > compression_threshold_,
+                      {{host_ptr, length}});
+}
 
-  if (!host_ptr) {
-    host_ptr = membase_ + cmd.base_ptr;
-  }
-
-  bool compress = compress_output_ && length > compression_threshold_;
-  if (compress) {
-    // Write the header now so we reserve space in the buffer.
-    long header_position = std::ftell(file_);
-    cmd.encoding_format = MemoryEncodingFormat::kSnappy;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-
-    // Stream the content right to the buffer.
-    snappy::ByteArraySource snappy_source(
-        reinterpret_cast<const char*>(host_ptr), cmd.decoded_length);
-    SnappySink snappy_sink(file_);
-    cmd.encoded_length =
-        static_cast<uint32_t>(snappy::Compress(&snappy_source, &snappy_sink));
-
-    // Seek back and overwrite the header with our final size.
-    std::fseek(file_, header_position, SEEK_SET);
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    std::fseek(file_, header_position + sizeof(cmd) + cmd.encoded_length,
-               SEEK_SET);
-  } else {
-    // Uncompressed - write buffer directly to the file.
-    cmd.encoding_format = MemoryEncodingFormat::kNone;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    fwrite(host_ptr, 1, cmd.decoded_length, file_);
+bool TraceWriter::IsMemoryReadRedundant(uint32_t base_ptr, size_t length,
+                                        const void* host_ptr) {
+  uint64_t hash = XXH3_64bits(host_ptr, length);
+  auto it = memory_read_hashes_.find(base_ptr);
+  if (it != memory_read_hashes_.end() && it->second.first == length &&
+      it->second.second == hash) {
+    return true;
+  }
+  InvalidateMemoryReadHashes(base_ptr, length);
+  memory_read_hashes_.emplace(base_ptr,
+                              std::make_pair(uint32_t(length), hash));
+  return false;
+}
+
+void TraceWriter::InvalidateMemoryReadHashes(uint32_t base_ptr,
+                                             size_t length) {
+  uint64_t end_ptr = uint64_t(base_ptr) + length;
+  auto it = memory_read_hashes_.upper_bound(base_ptr);
+  // The ranges don't overlap, so only the preceding one may contain the start.
+  if (it != memory_read_hashes_.begin()) {
+    auto it_previous = std::prev(it);
+    if (uint64_t(it_previous->first) + it_previous->second.first > base_ptr) {
+      it = it_previous;
+    }
+  }
+  while (it != memory_read_hashes_.end() && it->first < end_ptr) {
+    it = memory_read_hashes_.erase(it);
   }
 }
 
 void TraceWriter::WriteEdramSnapshot(const void* snapshot) {
+  if (!file_) {
+    return;
+  }
   EdramSnapshotCommand cmd = {};
   cmd.type = TraceCommandType::kEdramSnapshot;
-
-  if (compress_output_) {
-    // Write the header now so we reserve space in the buffer.
-    long header_position = std::ftell(file_);
-    cmd.encoding_format = MemoryEncodingFormat::kSnappy;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-
-    // Stream the content right to the buffer.
-    snappy::ByteArraySource snappy_source(
-        reinterpret_cast<const char*>(snapshot), xenos::kEdramSizeBytes);
-    SnappySink snappy_sink(file_);
-    cmd.encoded_length =
-        static_cast<uint32_t>(snappy::Compress(&snappy_source, &snappy_sink));
-
-    // Seek back and overwrite the header with our final size.
-    std::fseek(file_, header_position, SEEK_SET);
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    std::fseek(file_, header_position + sizeof(cmd) + cmd.encoded_length,
-               SEEK_SET);
-  } else {
-    // Uncompressed - write buffer directly to the file.
-    cmd.encoding_format = MemoryEncodingFormat::kNone;
-    cmd.encoded_length = xenos::kEdramSizeBytes;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    fwrite(snapshot, 1, xenos::kEdramSizeBytes, file_);
-  }
+  WriteEncodedCommand(cmd, compress_output_,
+                      {{snapshot, xenos::kEdramSizeBytes}});
 }
 
 void TraceWriter::WriteEvent(EventCommand::Type event_type) {
@@ -272,95 +407,39 @@ void TraceWriter::WriteEvent(EventCommand::Type event_type) {
       TraceCommandType::kEvent,
       event_type,
   };
-  fwrite(&cmd, 1, sizeof(cmd), file_);
+  Write(&cmd, sizeof(cmd));
 }
 
 void TraceWriter::WriteRegisters(uint32_t first_register,
                                  const uint32_t* register_values,
                                  uint32_t register_count,
                                  bool execute_callbacks_on_play) {
+  if (!file_) {
+    return;
+  }
   RegistersCommand cmd = {};
   cmd.type = TraceCommandType::kRegisters;
   cmd.first_register = first_register;
   cmd.register_count = register_count;
   cmd.execute_callbacks = execute_callbacks_on_play;
-
-  uint32_t uncompressed_length = uint32_t(sizeof(uint32_t) * register_count);
-  if (compress_output_) {
-    // Write the header now so we reserve space in the buffer.
-    long header_position = std::ftell(file_);
-    cmd.encoding_format = MemoryEncodingFormat::kSnappy;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-
-    // Stream the content right to the buffer.
-    snappy::ByteArraySource snappy_source(
-        reinterpret_cast<const char*>(register_values), uncompressed_length);
-    SnappySink snappy_sink(file_);
-    cmd.encoded_length =
-        static_cast<uint32_t>(snappy::Compress(&snappy_source, &snappy_sink));
-
-    // Seek back and overwrite the header with our final size.
-    std::fseek(file_, header_position, SEEK_SET);
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    std::fseek(file_, header_position + sizeof(cmd) + cmd.encoded_length,
-               SEEK_SET);
-  } else {
-    // Uncompressed - write the values directly to the file.
-    cmd.encoding_format = MemoryEncodingFormat::kNone;
-    cmd.encoded_length = uncompressed_length;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    fwrite(register_values, 1, uncompressed_length, file_);
-  }
+  WriteEncodedCommand(cmd, compress_output_,
+                      {{register_values, sizeof(uint32_t) * register_count}});
 }
 
 void TraceWriter::WriteGammaRamp(
     const reg::DC_LUT_30_COLOR* gamma_ramp_256_entry_table,
     const reg::DC_LUT_PWL_DATA* gamma_ramp_pwl_rgb,
     uint32_t gamma_ramp_rw_component) {
+  if (!file_) {
+    return;
+  }
   GammaRampCommand cmd = {};
   cmd.type = TraceCommandType::kGammaRamp;
   cmd.rw_component = uint8_t(gamma_ramp_rw_component);
-
-  constexpr uint32_t k256EntryTableUncompressedLength =
-      sizeof(reg::DC_LUT_30_COLOR) * 256;
-  constexpr uint32_t kPWLUncompressedLength =
-      sizeof(reg::DC_LUT_PWL_DATA) * 3 * 128;
-  constexpr uint32_t kUncompressedLength =
-      k256EntryTableUncompressedLength + kPWLUncompressedLength;
-  if (compress_output_) {
-    // Write the header now so we reserve space in the buffer.
-    long header_position = std::ftell(file_);
-    cmd.encoding_format = MemoryEncodingFormat::kSnappy;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-
-    // Stream the content right to the buffer.
-    {
-      std::unique_ptr<char[]> gamma_ramps(new char[kUncompressedLength]);
-      std::memcpy(gamma_ramps.get(), gamma_ramp_256_entry_table,
-                  k256EntryTableUncompressedLength);
-      std::memcpy(gamma_ramps.get() + k256EntryTableUncompressedLength,
-                  gamma_ramp_pwl_rgb, kPWLUncompressedLength);
-      snappy::ByteArraySource snappy_source(gamma_ramps.get(),
-                                            kUncompressedLength);
-      SnappySink snappy_sink(file_);
-      cmd.encoded_length =
-          static_cast<uint32_t>(snappy::Compress(&snappy_source, &snappy_sink));
-    }
-
-    // Seek back and overwrite the header with our final size.
-    std::fseek(file_, header_position, SEEK_SET);
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    std::fseek(file_, header_position + sizeof(cmd) + cmd.encoded_length,
-               SEEK_SET);
-  } else {
-    // Uncompressed - write the values directly to the file.
-    cmd.encoding_format = MemoryEncodingFormat::kNone;
-    cmd.encoded_length = kUncompressedLength;
-    fwrite(&cmd, 1, sizeof(cmd), file_);
-    fwrite(gamma_ramp_256_entry_table, 1, k256EntryTableUncompressedLength,
-           file_);
-    fwrite(gamma_ramp_pwl_rgb, 1, kPWLUncompressedLength, file_);
-  }
+  WriteEncodedCommand(
+      cmd, compress_output_,
+      {{gamma_ramp_256_entry_table, sizeof(reg::DC_LUT_30_COLOR) * 256},
+       {gamma_ramp_pwl_rgb, sizeof(reg::DC_LUT_PWL_DATA) * 3 * 128}});
 }
 #endif
 }  //  namespace gpu
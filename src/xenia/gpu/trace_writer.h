@@ -10,10 +10,21 @@
 #ifndef XENIA_GPU_TRACE_WRITER_H_
 #define XENIA_GPU_TRACE_WRITER_H_
 
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <filesystem>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "xenia/base/threading.h"
 #include "xenia/gpu/registers.h"
 #include "xenia/gpu/trace_protocol.h"
 
@@ -63,16 +74,72 @@ class TraceWriter {
                       uint32_t gamma_ramp_rw_component);
 
  private:
+  // Commands are serialized on the calling thread, and compressed and written
+  // to the file on the writer thread, so tracing doesn't slow down the command
+  // processor as much.
+  struct WriteJob {
+    // The serialized commands, or a single command header followed by the
+    // uncompressed data if compressing.
+    std::vector<uint8_t> data;
+    bool compress = false;
+    // For compressing - the header size and the offsets of the encoding format
+    // and the encoded length in it.
+    size_t header_size = 0;
+    size_t encoding_format_offset = 0;
+    size_t encoded_length_offset = 0;
+  };
+  // Flush the small commands to the writer thread after this many bytes.
+  static constexpr size_t kPendingJobMaxSize = 1024 * 1024;
+  // Block the calling thread if the writer thread falls behind by this many
+  // bytes.
+  static constexpr size_t kQueuedJobsMaxSize = 256 * 1024 * 1024;
+
+  void Write(const void* data, size_t size);
+  // The encoding format and the encoded length in the command are set by the
+  // writer.
+  template <typename Command>
+  void WriteEncodedCommand(
+      Command& cmd, bool compress,
+      std::initializer_list<std::pair<const void*, size_t>> data_parts);
+  void SubmitPendingJob();
+  void SubmitJob(WriteJob&& job);
+  void WriteJobToFile(WriteJob& job);
+  void WriterThread();
+
   void WriteMemoryCommand(TraceCommandType type, uint32_t base_ptr,
                           size_t length, const void* host_ptr = nullptr);
+  // Returns true if the same data has already been read from the range and not
+  // overwritten since then, otherwise remembers the hash of the data.
+  bool IsMemoryReadRedundant(uint32_t base_ptr, size_t length,
+                             const void* host_ptr);
+  void InvalidateMemoryReadHashes(uint32_t base_ptr, size_t length);
 
   std::set<uint64_t> cached_memory_reads_;
+  // Non-overlapping ranges of the last memory reads - base address to the
+  // length and the hash of the data.
+  std::map<uint32_t, std::pair<uint32_t, uint64_t>> memory_read_hashes_;
   uint8_t* membase_;
   FILE* file_;
 
   bool compress_output_ = true;
   size_t compression_threshold_ = 1024;  // Min. number of bytes to compress.
 
+  WriteJob pending_job_;
+  // Used only by the thread writing the jobs.
+  std::vector<uint8_t> compressed_temp_;
+  std::unique_ptr<xe::threading::Thread> writer_thread_;
+  std::mutex writer_mutex_;
+  // Notified when a job is queued or shutdown is requested.
+  std::condition_variable writer_request_cond_;
+  // Notified when a job has been written.
+  std::condition_variable writer_done_cond_;
+  // Protected with writer_mutex_.
+  std::deque<WriteJob> writer_queue_;
+  // Jobs queued or being written.
+  size_t writer_pending_count_ = 0;
+  size_t writer_pending_size_ = 0;
+  bool writer_shutdown_ = false;
+
 #else
   // this could be annoying to maintain if new methods are added or the
   // signatures change
@@ -28,7 +28,34 @@ DeferredCommandBuffer::DeferredCommandBuffer(
   command_stream_.reserve(initial_size / sizeof(uintmax_t));
 }
 
-void DeferredCommandBuffer::Reset() { command_stream_.clear(); }
+void DeferredCommandBuffer::Reset() {
+  command_stream_.clear();
+  last_command_offset_ = SIZE_MAX;
+}
+
+bool DeferredCommandBuffer::MergeDrawIndexedIntoLast(
+    uint32_t index_count, uint32_t first_index,
+    uint32_t primitive_index_count) {
+  if (last_command_offset_ == SIZE_MAX) {
+    return false;
+  }
+  const CommandHeader& header = *reinterpret_cast<const CommandHeader*>(
+      command_stream_.data() + last_command_offset_);
+  if (header.command != Command::kVkDrawIndexed) {
+    return false;
+  }
+  auto& args = *reinterpret_cast<ArgsVkDrawIndexed*>(
+      command_stream_.data() + last_command_offset_ +
+      kCommandHeaderSizeElements);
+  if (args.instance_count != 1 || args.vertex_offset || args.first_instance ||
+      args.index_count % primitive_index_count ||
+      uint64_t(args.first_index) + args.index_count != first_index ||
+      UINT32_MAX - args.index_count < index_count) {
+    return false;
+  }
+  args.index_count += index_count;
+  return true;
+}
 
 void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
 #if XE_UI_VULKAN_FINE_GRAINED_DRAW_SCOPES
@@ -39,6 +66,8 @@ void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
       command_processor_.GetVulkanProvider().dfn();
   const uintmax_t* stream = command_stream_.data();
   size_t stream_remaining = command_stream_.size();
+  // Draws with a guest pipeline that has failed to be created are dropped.
+  bool graphics_pipeline_null = false;
   while (stream_remaining) {
     const CommandHeader& header =
         *reinterpret_cast<const CommandHeader*>(stream);
@@ -46,6 +75,12 @@ void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
     stream_remaining -= kCommandHeaderSizeElements;
 
     switch (header.command) {
+      case Command::kVkBeginQuery: {
+        auto& args = *reinterpret_cast<const ArgsVkBeginQuery*>(stream);
+        dfn.vkCmdBeginQuery(command_buffer, args.query_pool, args.query,
+                            args.flags);
+      } break;
+
       case Command::kVkBeginRenderPass: {
         auto& args = *reinterpret_cast<const ArgsVkBeginRenderPass*>(stream);
         size_t offset_bytes = sizeof(ArgsVkBeginRenderPass);
@@ -101,6 +136,9 @@ void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
         auto& args = *reinterpret_cast<const ArgsVkBindPipeline*>(stream);
         dfn.vkCmdBindPipeline(command_buffer, args.pipeline_bind_point,
                               args.pipeline);
+        if (args.pipeline_bind_point == VK_PIPELINE_BIND_POINT_GRAPHICS) {
+          graphics_pipeline_null = false;
+        }
       } break;
 
       case Command::kVkBindVertexBuffers: {
@@ -165,6 +203,16 @@ void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
                           alignof(VkBufferImageCopy))));
       } break;
 
+      case Command::kVkCopyImage: {
+        auto& args = *reinterpret_cast<const ArgsVkCopyImage*>(stream);
+        dfn.vkCmdCopyImage(
+            command_buffer, args.src_image, args.src_image_layout,
+            args.dst_image, args.dst_image_layout, args.region_count,
+            reinterpret_cast<const VkImageCopy*>(
+                reinterpret_cast<const uint8_t*>(stream) +
+                xe::align(sizeof(ArgsVkCopyImage), alignof(VkImageCopy))));
+      } break;
+
       case Command::kVkDispatch: {
         auto& args = *reinterpret_cast<const ArgsVkDispatch*>(stream);
         dfn.vkCmdDispatch(command_buffer, args.group_count_x,
@@ -172,18 +220,29 @@ void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
       } break;
 
       case Command::kVkDraw: {
+        if (graphics_pipeline_null) {
+          break;
+        }
         auto& args = *reinterpret_cast<const ArgsVkDraw*>(stream);
         dfn.vkCmdDraw(command_buffer, args.vertex_count, args.instance_count,
                       args.first_vertex, args.first_instance);
       } break;
 
       case Command::kVkDrawIndexed: {
+        if (graphics_pipeline_null) {
+          break;
+        }
         auto& args = *reinterpret_cast<const ArgsVkDrawIndexed*>(stream);
         dfn.vkCmdDrawIndexed(command_buffer, args.index_count,
                              args.instance_count, args.first_index,
                              args.vertex_offset, args.first_instance);
       } break;
 
+      case Command::kVkEndQuery: {
+        auto& args = *reinterpret_cast<const ArgsVkEndQuery*>(stream);
+        dfn.vkCmdEndQuery(command_buffer, args.query_pool, args.query);
+      } break;
+
       case Command::kVkEndRenderPass:
         dfn.vkCmdEndRenderPass(command_buffer);
         break;
@@ -235,6 +294,12 @@ void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
                                    sizeof(ArgsVkPushConstants));
       } break;
 
+      case Command::kVkResetQueryPool: {
+        auto& args = *reinterpret_cast<const ArgsVkResetQueryPool*>(stream);
+        dfn.vkCmdResetQueryPool(command_buffer, args.query_pool,
+                                args.first_query, args.query_count);
+      } break;
+
       case Command::kVkSetBlendConstants: {
         auto& args = *reinterpret_cast<const ArgsVkSetBlendConstants*>(stream);
         dfn.vkCmdSetBlendConstants(command_buffer, args.blend_constants);
@@ -286,6 +351,68 @@ void DeferredCommandBuffer::Execute(VkCommandBuffer command_buffer) {
                 xe::align(sizeof(ArgsVkSetViewport), alignof(VkViewport))));
       } break;
 
+      case Command::kVkWriteTimestamp: {
+        auto& args = *reinterpret_cast<const ArgsVkWriteTimestamp*>(stream);
+        dfn.vkCmdWriteTimestamp(command_buffer, args.pipeline_stage,
+                                args.query_pool, args.query);
+      } break;
+
+      case Command::kBindGuestGraphicsPipelineHandle: {
+        auto& args =
+            *reinterpret_cast<const ArgsBindGuestGraphicsPipelineHandle*>(
+                stream);
+        VkPipeline pipeline =
+            command_processor_.GetVulkanPipelineByHandle(args.pipeline_handle);
+        graphics_pipeline_null = pipeline == VK_NULL_HANDLE;
+        if (!graphics_pipeline_null) {
+          dfn.vkCmdBindPipeline(command_buffer,
+                                VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        }
+      } break;
+
+      case Command::kPushTextureDescriptorSet: {
+        auto& args =
+            *reinterpret_cast<const ArgsPushTextureDescriptorSet*>(stream);
+        const VkDescriptorImageInfo* image_info =
+            reinterpret_cast<const VkDescriptorImageInfo*>(
+                reinterpret_cast<const uint8_t*>(stream) +
+                xe::align(sizeof(ArgsPushTextureDescriptorSet),
+                          alignof(VkDescriptorImageInfo)));
+        VkWriteDescriptorSet write_descriptor_sets[2];
+        uint32_t write_descriptor_set_count = 0;
+        if (args.texture_count) {
+          VkWriteDescriptorSet& write_textures =
+              write_descriptor_sets[write_descriptor_set_count++];
+          write_textures.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+          write_textures.pNext = nullptr;
+          write_textures.dstSet = VK_NULL_HANDLE;
+          write_textures.dstBinding = 0;
+          write_textures.dstArrayElement = 0;
+          write_textures.descriptorCount = args.texture_count;
+          write_textures.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+          write_textures.pImageInfo = image_info;
+          write_textures.pBufferInfo = nullptr;
+          write_textures.pTexelBufferView = nullptr;
+        }
+        if (args.sampler_count) {
+          VkWriteDescriptorSet& write_samplers =
+              write_descriptor_sets[write_descriptor_set_count++];
+          write_samplers.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+          write_samplers.pNext = nullptr;
+          write_samplers.dstSet = VK_NULL_HANDLE;
+          write_samplers.dstBinding = args.texture_count;
+          write_samplers.dstArrayElement = 0;
+          write_samplers.descriptorCount = args.sampler_count;
+          write_samplers.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+          write_samplers.pImageInfo = image_info + args.texture_count;
+          write_samplers.pBufferInfo = nullptr;
+          write_samplers.pTexelBufferView = nullptr;
+        }
+        dfn.vkCmdPushDescriptorSetKHR(
+            command_buffer, args.pipeline_bind_point, args.layout, args.set,
+            write_descriptor_set_count, write_descriptor_sets);
+      } break;
+
       default:
         assert_unhandled_case(header.command);
         break;
@@ -355,6 +482,7 @@ void* DeferredCommandBuffer::WriteCommand(Command command,
   size_t offset = command_stream_.size();
   command_stream_.resize(offset + kCommandHeaderSizeElements +
                          arguments_size_elements);
+  last_command_offset_ = offset;
   CommandHeader& header =
       *reinterpret_cast<CommandHeader*>(command_stream_.data() + offset);
   header.command = command;
@@ -13,6 +13,8 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <utility>
+#include <vector>
 
 #include "xenia/base/assert.h"
 #include "xenia/base/math.h"
@@ -30,7 +32,38 @@ class DeferredCommandBuffer {
                         size_t initial_size_bytes = 1024 * 1024);
 
   void Reset();
+  // TODO(Triang3l): Split the stream at render pass boundaries and replay the
+  // render passes into secondary command buffers on multiple threads if the
+  // recording on the submission thread becomes the bottleneck. Secondary
+  // command buffers don't inherit any bindings or dynamic state, so the state
+  // at the beginning of each render pass would need to be tracked while
+  // splitting and re-recorded in every secondary command buffer, and the render
+  // passes would need to be begun with
+  // VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS.
   void Execute(VkCommandBuffer command_buffer);
+  // Exchanges the recorded commands (and the allocated memory), for handing
+  // them over to another thread for execution.
+  void Swap(DeferredCommandBuffer& other) {
+    command_stream_.swap(other.command_stream_);
+    std::swap(last_command_offset_, other.last_command_offset_);
+  }
+
+  // If the last recorded command is a single-instance vkCmdDrawIndexed without
+  // a vertex offset, drawing whole primitives of primitive_index_count indices
+  // and ending exactly at first_index, extends it by index_count indices and
+  // returns true. This merges consecutive draws of list primitives from
+  // adjacent index ranges when no state has been changed between them.
+  bool MergeDrawIndexedIntoLast(uint32_t index_count, uint32_t first_index,
+                                uint32_t primitive_index_count);
+
+  void CmdVkBeginQuery(VkQueryPool query_pool, uint32_t query,
+                       VkQueryControlFlags flags) {
+    auto& args = *reinterpret_cast<ArgsVkBeginQuery*>(
+        WriteCommand(Command::kVkBeginQuery, sizeof(ArgsVkBeginQuery)));
+    args.query_pool = query_pool;
+    args.query = query;
+    args.flags = flags;
+  }
 
   // render_pass_begin->pNext of all barriers must be null.
   void CmdVkBeginRenderPass(const VkRenderPassBeginInfo* render_pass_begin,
@@ -100,6 +133,18 @@ class DeferredCommandBuffer {
     args.index_type = index_type;
   }
 
+  // The handle is resolved via VulkanPipelineCache when the command buffer is
+  // executed, since the pipeline may still be being created on the pipeline
+  // creation threads at the time of recording. If the pipeline couldn't be
+  // created, the draws are skipped until a different graphics pipeline is
+  // bound.
+  void CmdBindGuestGraphicsPipelineHandle(void* pipeline_handle) {
+    auto& args = *reinterpret_cast<ArgsBindGuestGraphicsPipelineHandle*>(
+        WriteCommand(Command::kBindGuestGraphicsPipelineHandle,
+                     sizeof(ArgsBindGuestGraphicsPipelineHandle)));
+    args.pipeline_handle = pipeline_handle;
+  }
+
   void CmdVkBindPipeline(VkPipelineBindPoint pipeline_bind_point,
                          VkPipeline pipeline) {
     auto& args = *reinterpret_cast<ArgsVkBindPipeline*>(
@@ -231,6 +276,32 @@ class DeferredCommandBuffer {
                 regions, sizeof(VkBufferImageCopy) * region_count);
   }
 
+  VkImageCopy* CmdCopyImageEmplace(VkImage src_image,
+                                   VkImageLayout src_image_layout,
+                                   VkImage dst_image,
+                                   VkImageLayout dst_image_layout,
+                                   uint32_t region_count) {
+    const size_t header_size =
+        xe::align(sizeof(ArgsVkCopyImage), alignof(VkImageCopy));
+    uint8_t* args_ptr = reinterpret_cast<uint8_t*>(
+        WriteCommand(Command::kVkCopyImage,
+                     header_size + sizeof(VkImageCopy) * region_count));
+    auto& args = *reinterpret_cast<ArgsVkCopyImage*>(args_ptr);
+    args.src_image = src_image;
+    args.src_image_layout = src_image_layout;
+    args.dst_image = dst_image;
+    args.dst_image_layout = dst_image_layout;
+    args.region_count = region_count;
+    return reinterpret_cast<VkImageCopy*>(args_ptr + header_size);
+  }
+  void CmdVkCopyImage(VkImage src_image, VkImageLayout src_image_layout,
+                      VkImage dst_image, VkImageLayout dst_image_layout,
+                      uint32_t region_count, const VkImageCopy* regions) {
+    std::memcpy(CmdCopyImageEmplace(src_image, src_image_layout, dst_image,
+                                    dst_image_layout, region_count),
+                regions, sizeof(VkImageCopy) * region_count);
+  }
+
   void CmdVkDispatch(uint32_t group_count_x, uint32_t group_count_y,
                      uint32_t group_count_z) {
     auto& args = *reinterpret_cast<ArgsVkDispatch*>(
@@ -262,6 +333,13 @@ class DeferredCommandBuffer {
     args.first_instance = first_instance;
   }
 
+  void CmdVkEndQuery(VkQueryPool query_pool, uint32_t query) {
+    auto& args = *reinterpret_cast<ArgsVkEndQuery*>(
+        WriteCommand(Command::kVkEndQuery, sizeof(ArgsVkEndQuery)));
+    args.query_pool = query_pool;
+    args.query = query;
+  }
+
   void CmdVkEndRenderPass() { WriteCommand(Command::kVkEndRenderPass, 0); }
 
   // pNext of all barriers must be null.
@@ -288,6 +366,49 @@ class DeferredCommandBuffer {
     std::memcpy(args_ptr + sizeof(ArgsVkPushConstants), values, size);
   }
 
+  // Pushes a guest shader texture descriptor set (the sampled images at
+  // bindings starting from 0, then the samplers) via vkCmdPushDescriptorSetKHR
+  // without allocating a descriptor set. The descriptor set layout must have
+  // been created with VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR.
+  void CmdPushTextureDescriptorSet(
+      VkPipelineBindPoint pipeline_bind_point, VkPipelineLayout layout,
+      uint32_t set, uint32_t texture_count,
+      const VkDescriptorImageInfo* texture_image_info, uint32_t sampler_count,
+      const VkDescriptorImageInfo* sampler_image_info) {
+    size_t arguments_size = xe::align(sizeof(ArgsPushTextureDescriptorSet),
+                                      alignof(VkDescriptorImageInfo));
+    size_t image_info_offset = arguments_size;
+    arguments_size +=
+        sizeof(VkDescriptorImageInfo) * (texture_count + sampler_count);
+    uint8_t* args_ptr = reinterpret_cast<uint8_t*>(
+        WriteCommand(Command::kPushTextureDescriptorSet, arguments_size));
+    auto& args = *reinterpret_cast<ArgsPushTextureDescriptorSet*>(args_ptr);
+    args.pipeline_bind_point = pipeline_bind_point;
+    args.layout = layout;
+    args.set = set;
+    args.texture_count = texture_count;
+    args.sampler_count = sampler_count;
+    auto image_info_out =
+        reinterpret_cast<VkDescriptorImageInfo*>(args_ptr + image_info_offset);
+    if (texture_count) {
+      std::memcpy(image_info_out, texture_image_info,
+                  sizeof(VkDescriptorImageInfo) * texture_count);
+    }
+    if (sampler_count) {
+      std::memcpy(image_info_out + texture_count, sampler_image_info,
+                  sizeof(VkDescriptorImageInfo) * sampler_count);
+    }
+  }
+
+  void CmdVkResetQueryPool(VkQueryPool query_pool, uint32_t first_query,
+                           uint32_t query_count) {
+    auto& args = *reinterpret_cast<ArgsVkResetQueryPool*>(
+        WriteCommand(Command::kVkResetQueryPool, sizeof(ArgsVkResetQueryPool)));
+    args.query_pool = query_pool;
+    args.first_query = first_query;
+    args.query_count = query_count;
+  }
+
   void CmdVkSetBlendConstants(const float* blend_constants) {
     auto& args = *reinterpret_cast<ArgsVkSetBlendConstants*>(WriteCommand(
         Command::kVkSetBlendConstants, sizeof(ArgsVkSetBlendConstants)));
@@ -357,8 +478,18 @@ class DeferredCommandBuffer {
                 sizeof(VkViewport) * viewport_count);
   }
 
+  void CmdVkWriteTimestamp(VkPipelineStageFlagBits pipeline_stage,
+                           VkQueryPool query_pool, uint32_t query) {
+    auto& args = *reinterpret_cast<ArgsVkWriteTimestamp*>(
+        WriteCommand(Command::kVkWriteTimestamp, sizeof(ArgsVkWriteTimestamp)));
+    args.pipeline_stage = pipeline_stage;
+    args.query_pool = query_pool;
+    args.query = query;
+  }
+
  private:
   enum class Command {
+    kVkBeginQuery,
     kVkBeginRenderPass,
     kVkBindDescriptorSets,
     kVkBindIndexBuffer,
@@ -368,12 +499,15 @@ class DeferredCommandBuffer {
     kVkClearColorImage,
     kVkCopyBuffer,
     kVkCopyBufferToImage,
+    kVkCopyImage,
     kVkDispatch,
     kVkDraw,
     kVkDrawIndexed,
+    kVkEndQuery,
     kVkEndRenderPass,
     kVkPipelineBarrier,
     kVkPushConstants,
+    kVkResetQueryPool,
     kVkSetBlendConstants,
     kVkSetDepthBias,
     kVkSetScissor,
@@ -381,6 +515,9 @@ class DeferredCommandBuffer {
     kVkSetStencilReference,
     kVkSetStencilWriteMask,
     kVkSetViewport,
+    kVkWriteTimestamp,
+    kBindGuestGraphicsPipelineHandle,
+    kPushTextureDescriptorSet,
   };
 
   struct CommandHeader {
@@ -390,6 +527,12 @@ class DeferredCommandBuffer {
   static constexpr size_t kCommandHeaderSizeElements =
       (sizeof(CommandHeader) + sizeof(uintmax_t) - 1) / sizeof(uintmax_t);
 
+  struct ArgsVkBeginQuery {
+    VkQueryPool query_pool;
+    uint32_t query;
+    VkQueryControlFlags flags;
+  };
+
   struct ArgsVkBeginRenderPass {
     VkRenderPass render_pass;
     VkFramebuffer framebuffer;
@@ -421,6 +564,10 @@ class DeferredCommandBuffer {
     VkPipeline pipeline;
   };
 
+  struct ArgsBindGuestGraphicsPipelineHandle {
+    void* pipeline_handle;
+  };
+
   struct ArgsVkBindVertexBuffers {
     uint32_t first_binding;
     uint32_t binding_count;
@@ -463,6 +610,16 @@ class DeferredCommandBuffer {
     static_assert(alignof(VkBufferImageCopy) <= alignof(uintmax_t));
   };
 
+  struct ArgsVkCopyImage {
+    VkImage src_image;
+    VkImageLayout src_image_layout;
+    VkImage dst_image;
+    VkImageLayout dst_image_layout;
+    uint32_t region_count;
+    // Followed by aligned VkImageCopy[].
+    static_assert(alignof(VkImageCopy) <= alignof(uintmax_t));
+  };
+
   struct ArgsVkDispatch {
     uint32_t group_count_x;
     uint32_t group_count_y;
@@ -484,6 +641,11 @@ class DeferredCommandBuffer {
     uint32_t first_instance;
   };
 
+  struct ArgsVkEndQuery {
+    VkQueryPool query_pool;
+    uint32_t query;
+  };
+
   struct ArgsVkPipelineBarrier {
     VkPipelineStageFlags src_stage_mask;
     VkPipelineStageFlags dst_stage_mask;
@@ -506,6 +668,22 @@ class DeferredCommandBuffer {
     // Followed by `size` bytes of values.
   };
 
+  struct ArgsPushTextureDescriptorSet {
+    VkPipelineBindPoint pipeline_bind_point;
+    VkPipelineLayout layout;
+    uint32_t set;
+    uint32_t texture_count;
+    uint32_t sampler_count;
+    // Followed by aligned VkDescriptorImageInfo[texture_count + sampler_count].
+    static_assert(alignof(VkDescriptorImageInfo) <= alignof(uintmax_t));
+  };
+
+  struct ArgsVkResetQueryPool {
+    VkQueryPool query_pool;
+    uint32_t first_query;
+    uint32_t query_count;
+  };
+
   struct ArgsVkSetBlendConstants {
     float blend_constants[4];
   };
@@ -535,12 +713,21 @@ class DeferredCommandBuffer {
     static_assert(alignof(VkViewport) <= alignof(uintmax_t));
   };
 
+  struct ArgsVkWriteTimestamp {
+    VkPipelineStageFlagBits pipeline_stage;
+    VkQueryPool query_pool;
+    uint32_t query;
+  };
+
   void* WriteCommand(Command command, size_t arguments_size_bytes);
 
   const VulkanCommandProcessor& command_processor_;
 
   // uintmax_t to ensure uint64_t and pointer alignment of all structures.
   std::vector<uintmax_t> command_stream_;
+  // Offset of the header of the last command in command_stream_, or SIZE_MAX
+  // if it's empty.
+  size_t last_command_offset_ = SIZE_MAX;
 };
 
 }  // namespace vulkan
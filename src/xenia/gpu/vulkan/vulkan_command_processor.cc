@@ -19,6 +19,7 @@
 
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_order.h"
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
@@ -39,6 +40,25 @@
 #include "xenia/ui/vulkan/vulkan_provider.h"
 #include "xenia/ui/vulkan/vulkan_util.h"
 
+DEFINE_bool(
+    vulkan_submission_thread, true,
+    "Record and submit the Vulkan command buffers on a separate thread, so "
+    "the processing of the guest GPU commands doesn't have to wait for the "
+    "driver.",
+    "Vulkan");
+DEFINE_bool(
+    vulkan_push_descriptors, true,
+    "Push the pixel shader texture descriptors directly into the command "
+    "buffer via VK_KHR_push_descriptor if supported instead of allocating and "
+    "writing a descriptor set for every draw.",
+    "Vulkan");
+DEFINE_bool(
+    vulkan_gpu_timestamps, false,
+    "Measure the GPU time of draws, render target transfers, resolves, texture "
+    "loads and presentation with timestamp queries, and report the totals for "
+    "each frame as profiler counters.",
+    "Vulkan");
+
 DECLARE_bool(clear_memory_page_state);
 
 namespace xe {
@@ -100,6 +120,13 @@ void VulkanCommandProcessor::ClearCaches() {
   cache_clear_requested_ = true;
 }
 
+void VulkanCommandProcessor::InitializeShaderStorage(
+    const std::filesystem::path& cache_root, uint32_t title_id, bool blocking) {
+  CommandProcessor::InitializeShaderStorage(cache_root, title_id, blocking);
+  pipeline_cache_->InitializeShaderStorage(cache_root, title_id, blocking);
+  texture_cache_->InitializeTextureStorage(cache_root, title_id);
+}
+
 void VulkanCommandProcessor::TracePlaybackWroteMemory(uint32_t base_ptr,
                                                       uint32_t length) {
   shared_memory_->MemoryInvalidationCallback(base_ptr, length, true);
@@ -163,6 +190,10 @@ bool VulkanCommandProcessor::SetupContext() {
     guest_shader_vertex_stages_ |= VK_SHADER_STAGE_COMPUTE_BIT;
   }
 
+  texture_descriptor_set_pixel_pushed_ =
+      cvars::vulkan_push_descriptors &&
+      provider.device_extensions().khr_push_descriptor;
+
   // 16384 is bigger than any single uniform buffer that Xenia needs, but is the
   // minimum maxUniformBufferRange, thus the safe minimum amount.
   VkDeviceSize uniform_buffer_alignment = std::max(
@@ -172,7 +203,8 @@ bool VulkanCommandProcessor::SetupContext() {
       provider, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
       xe::align(std::max(ui::GraphicsUploadBufferPool::kDefaultPageSize,
                          size_t(16384)),
-                size_t(uniform_buffer_alignment)));
+                size_t(uniform_buffer_alignment)),
+      true);
 
   // Descriptor set layouts that don't depend on the setup of other subsystems.
   VkShaderStageFlags guest_shader_stages =
@@ -1039,18 +1071,113 @@ bool VulkanCommandProcessor::SetupContext() {
   // Just not to expose uninitialized memory.
   std::memset(&system_constants_, 0, sizeof(system_constants_));
 
+  if (provider.device_extensions().khr_timeline_semaphore &&
+      provider.device_timeline_semaphore_features().timelineSemaphore) {
+    VkSemaphoreTypeCreateInfoKHR semaphore_type_create_info;
+    semaphore_type_create_info.sType =
+        VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+    semaphore_type_create_info.pNext = nullptr;
+    semaphore_type_create_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+    semaphore_type_create_info.initialValue = submission_completed_;
+    VkSemaphoreCreateInfo semaphore_create_info;
+    semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_create_info.pNext = &semaphore_type_create_info;
+    semaphore_create_info.flags = 0;
+    if (dfn.vkCreateSemaphore(device, &semaphore_create_info, nullptr,
+                              &submission_timeline_semaphore_) != VK_SUCCESS) {
+      XELOGW(
+          "Failed to create the Vulkan submission timeline semaphore, using "
+          "fences for submission tracking");
+      submission_timeline_semaphore_ = VK_NULL_HANDLE;
+    }
+  }
+
+  gpu_timestamp_period_ns_ = 0.0f;
+  std::memset(gpu_timestamp_phase_ticks_, 0,
+              sizeof(gpu_timestamp_phase_ticks_));
+  if (cvars::vulkan_gpu_timestamps) {
+    const VkPhysicalDeviceLimits& device_limits =
+        provider.device_properties().limits;
+    if (device_limits.timestampComputeAndGraphics) {
+      gpu_timestamp_period_ns_ = device_limits.timestampPeriod;
+    } else {
+      XELOGW(
+          "GPU timestamps are not supported by the Vulkan device, not "
+          "measuring the GPU time");
+    }
+  }
+
+  submission_thread_shutdown_ = false;
+  submission_thread_pending_count_ = 0;
+  submission_thread_device_lost_.store(false, std::memory_order_relaxed);
+  if (cvars::vulkan_submission_thread) {
+    submission_thread_ =
+        xe::threading::Thread::Create({}, [this]() { SubmissionThread(); });
+    if (submission_thread_) {
+      submission_thread_->set_name("Vulkan Submission");
+    } else {
+      XELOGW(
+          "Failed to create the Vulkan submission thread, submitting on the "
+          "command processor thread");
+    }
+  }
+
   return true;
 }
 
 void VulkanCommandProcessor::ShutdownContext() {
   AwaitAllQueueOperationsCompletion();
 
+  if (submission_thread_) {
+    {
+      std::lock_guard<std::mutex> lock(submission_thread_mutex_);
+      submission_thread_shutdown_ = true;
+    }
+    submission_thread_request_cond_.notify_one();
+    xe::threading::Wait(submission_thread_.get(), false);
+    submission_thread_.reset();
+  }
+  submission_thread_queue_.clear();
+  submission_thread_requests_free_.clear();
+
   const ui::vulkan::VulkanProvider& provider = GetVulkanProvider();
   const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
   VkDevice device = provider.device();
 
   DestroyScratchBuffer();
 
+  if (occlusion_query_pool_current_.pool != VK_NULL_HANDLE) {
+    dfn.vkDestroyQueryPool(device, occlusion_query_pool_current_.pool,
+                           nullptr);
+    occlusion_query_pool_current_.pool = VK_NULL_HANDLE;
+  }
+  occlusion_query_pool_current_.guest_queries.clear();
+  for (const OcclusionQueryPool& query_pool :
+       occlusion_query_pools_submitted_) {
+    dfn.vkDestroyQueryPool(device, query_pool.pool, nullptr);
+  }
+  occlusion_query_pools_submitted_.clear();
+  for (VkQueryPool query_pool : occlusion_query_pools_free_) {
+    dfn.vkDestroyQueryPool(device, query_pool, nullptr);
+  }
+  occlusion_query_pools_free_.clear();
+
+  if (gpu_timestamp_query_pool_current_.pool != VK_NULL_HANDLE) {
+    dfn.vkDestroyQueryPool(device, gpu_timestamp_query_pool_current_.pool,
+                           nullptr);
+    gpu_timestamp_query_pool_current_.pool = VK_NULL_HANDLE;
+  }
+  gpu_timestamp_query_pool_current_.phases.clear();
+  for (const GpuTimestampQueryPool& query_pool :
+       gpu_timestamp_query_pools_submitted_) {
+    dfn.vkDestroyQueryPool(device, query_pool.pool, nullptr);
+  }
+  gpu_timestamp_query_pools_submitted_.clear();
+  for (VkQueryPool query_pool : gpu_timestamp_query_pools_free_) {
+    dfn.vkDestroyQueryPool(device, query_pool, nullptr);
+  }
+  gpu_timestamp_query_pools_free_.clear();
+
   for (SwapFramebuffer& swap_framebuffer : swap_framebuffers_) {
     ui::vulkan::util::DestroyAndNullHandle(dfn.vkDestroyFramebuffer, device,
                                            swap_framebuffer.framebuffer);
@@ -1178,8 +1305,11 @@ void VulkanCommandProcessor::ShutdownContext() {
     dfn.vkDestroySemaphore(device, semaphore, nullptr);
   }
   current_submission_wait_semaphores_.clear();
+  submission_current_ = 1;
   submission_completed_ = 0;
   submission_open_ = false;
+  ui::vulkan::util::DestroyAndNullHandle(dfn.vkDestroySemaphore, device,
+                                         submission_timeline_semaphore_);
 
   for (VkSemaphore semaphore : semaphores_free_) {
     dfn.vkDestroySemaphore(device, semaphore, nullptr);
@@ -1246,13 +1376,35 @@ void VulkanCommandProcessor::SparseBindBuffer(
   if (!bind_count) {
     return;
   }
-  SparseBufferBind& buffer_bind = sparse_buffer_binds_.emplace_back();
-  buffer_bind.buffer = buffer;
-  buffer_bind.bind_offset = sparse_memory_binds_.size();
-  buffer_bind.bind_count = bind_count;
+  // Append to the binds of the same buffer if it was the last one bound, so
+  // there's one VkSparseBufferMemoryBindInfo per buffer in the common case of
+  // many separate requests for the same buffer (like shared memory pages
+  // allocated on demand) within one submission, and merge contiguous ranges of
+  // the same memory.
+  if (sparse_buffer_binds_.empty() ||
+      sparse_buffer_binds_.back().buffer != buffer) {
+    SparseBufferBind& buffer_bind = sparse_buffer_binds_.emplace_back();
+    buffer_bind.buffer = buffer;
+    buffer_bind.bind_offset = sparse_memory_binds_.size();
+    buffer_bind.bind_count = 0;
+  }
+  SparseBufferBind& buffer_bind = sparse_buffer_binds_.back();
   sparse_memory_binds_.reserve(sparse_memory_binds_.size() + bind_count);
-  sparse_memory_binds_.insert(sparse_memory_binds_.end(), binds,
-                              binds + bind_count);
+  for (uint32_t i = 0; i < bind_count; ++i) {
+    const VkSparseMemoryBind& bind = binds[i];
+    if (buffer_bind.bind_count) {
+      VkSparseMemoryBind& last_bind = sparse_memory_binds_.back();
+      if (last_bind.memory == bind.memory && last_bind.flags == bind.flags &&
+          last_bind.resourceOffset + last_bind.size == bind.resourceOffset &&
+          (bind.memory == VK_NULL_HANDLE ||
+           last_bind.memoryOffset + last_bind.size == bind.memoryOffset)) {
+        last_bind.size += bind.size;
+        continue;
+      }
+    }
+    sparse_memory_binds_.push_back(bind);
+    ++buffer_bind.bind_count;
+  }
   sparse_bind_wait_stage_mask_ |= wait_stage_mask;
 }
 
@@ -1279,6 +1431,11 @@ void VulkanCommandProcessor::IssueSwap(uint32_t frontbuffer_ptr,
     return;
   }
 
+  if (!IsSwapPresented()) {
+    EndSubmission(true);
+    return;
+  }
+
   // Obtaining the actual front buffer size to pass to RefreshGuestOutput,
   // resolution-scaled if it's a resolve destination, or not otherwise.
   uint32_t frontbuffer_width_scaled, frontbuffer_height_scaled;
@@ -1299,6 +1456,8 @@ void VulkanCommandProcessor::IssueSwap(uint32_t frontbuffer_ptr,
           return false;
         }
 
+        SetGpuTimestampPhase(GpuTimestampPhase::kPresentation);
+
         auto& vulkan_context = static_cast<
             ui::vulkan::VulkanPresenter::VulkanGuestOutputRefreshContext&>(
             context);
@@ -1786,7 +1945,11 @@ void VulkanCommandProcessor::SubmitBarriersAndEnterRenderTargetCacheRenderPass(
     VkRenderPass render_pass,
     const VulkanRenderTargetCache::Framebuffer* framebuffer) {
   SubmitBarriers(false);
-  if (current_render_pass_ == render_pass &&
+  // Framebuffers are specific to render pass keys, and render passes with the
+  // same key differ only in the load operations, and are compatible - the
+  // render pass may have been begun with the attachments with undefined
+  // contents not loaded, and can be continued with a variant loading them.
+  if (current_render_pass_ != VK_NULL_HANDLE &&
       current_framebuffer_ == framebuffer) {
     return;
   }
@@ -1821,6 +1984,92 @@ void VulkanCommandProcessor::EndRenderPass() {
   current_framebuffer_ = nullptr;
 }
 
+VkQueryPool VulkanCommandProcessor::RequestOcclusionQuery(
+    uint32_t& query_out) {
+  assert_true(submission_open_);
+  if (occlusion_query_pool_current_.pool != VK_NULL_HANDLE &&
+      occlusion_query_pool_current_.guest_queries.size() >=
+          kOcclusionQueryPoolSize) {
+    occlusion_query_pool_current_.submission = GetCurrentSubmission();
+    occlusion_query_pools_submitted_.push_back(
+        std::move(occlusion_query_pool_current_));
+    occlusion_query_pool_current_.pool = VK_NULL_HANDLE;
+    occlusion_query_pool_current_.guest_queries.clear();
+  }
+  if (occlusion_query_pool_current_.pool == VK_NULL_HANDLE) {
+    VkQueryPool query_pool;
+    if (!occlusion_query_pools_free_.empty()) {
+      query_pool = occlusion_query_pools_free_.back();
+      occlusion_query_pools_free_.pop_back();
+    } else {
+      const ui::vulkan::VulkanProvider& provider = GetVulkanProvider();
+      const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+      VkDevice device = provider.device();
+      VkQueryPoolCreateInfo query_pool_create_info;
+      query_pool_create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+      query_pool_create_info.pNext = nullptr;
+      query_pool_create_info.flags = 0;
+      query_pool_create_info.queryType = VK_QUERY_TYPE_OCCLUSION;
+      query_pool_create_info.queryCount = kOcclusionQueryPoolSize;
+      query_pool_create_info.pipelineStatistics = 0;
+      if (dfn.vkCreateQueryPool(device, &query_pool_create_info, nullptr,
+                                &query_pool) != VK_SUCCESS) {
+        XELOGE("Failed to create a Vulkan occlusion query pool");
+        return VK_NULL_HANDLE;
+      }
+    }
+    // Queries can't be reset within a render pass.
+    EndRenderPass();
+    deferred_command_buffer_.CmdVkResetQueryPool(query_pool, 0,
+                                                 kOcclusionQueryPoolSize);
+    occlusion_query_pool_current_.pool = query_pool;
+  }
+  query_out = uint32_t(occlusion_query_pool_current_.guest_queries.size());
+  occlusion_query_pool_current_.guest_queries.emplace_back(
+      occlusion_query_current_, occlusion_query_address_);
+  return occlusion_query_pool_current_.pool;
+}
+
+void VulkanCommandProcessor::SetGpuTimestampPhase(GpuTimestampPhase phase) {
+  assert_true(submission_open_);
+  VkQueryPool query_pool = gpu_timestamp_query_pool_current_.pool;
+  if (query_pool == VK_NULL_HANDLE) {
+    return;
+  }
+  std::vector<GpuTimestampPhase>& phases =
+      gpu_timestamp_query_pool_current_.phases;
+  // Keep the last query for the end of the submission.
+  if (phases.back() == phase ||
+      phases.size() + 1 >= kGpuTimestampQueryPoolSize) {
+    return;
+  }
+  deferred_command_buffer_.CmdVkWriteTimestamp(
+      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool,
+      uint32_t(phases.size()));
+  phases.push_back(phase);
+}
+
+VkSemaphore VulkanCommandProcessor::AcquireSemaphore() {
+  if (!semaphores_free_.empty()) {
+    VkSemaphore semaphore = semaphores_free_.back();
+    semaphores_free_.pop_back();
+    return semaphore;
+  }
+  const ui::vulkan::VulkanProvider& provider = GetVulkanProvider();
+  VkSemaphoreCreateInfo semaphore_create_info;
+  semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  semaphore_create_info.pNext = nullptr;
+  semaphore_create_info.flags = 0;
+  VkSemaphore semaphore;
+  if (provider.dfn().vkCreateSemaphore(provider.device(),
+                                       &semaphore_create_info, nullptr,
+                                       &semaphore) != VK_SUCCESS) {
+    XELOGE("Failed to create a Vulkan semaphore");
+    return VK_NULL_HANDLE;
+  }
+  return semaphore;
+}
+
 VkDescriptorSet VulkanCommandProcessor::AllocateSingleTransientDescriptor(
     SingleTransientDescriptorLayout transient_descriptor_layout) {
   assert_true(frame_open_);
@@ -1907,7 +2156,10 @@ VkDescriptorSetLayout VulkanCommandProcessor::GetTextureDescriptorSetLayout(
   descriptor_set_layout_create_info.sType =
       VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
   descriptor_set_layout_create_info.pNext = nullptr;
-  descriptor_set_layout_create_info.flags = 0;
+  descriptor_set_layout_create_info.flags =
+      IsTextureDescriptorSetPushed(is_vertex, binding_count)
+          ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR
+          : 0;
   descriptor_set_layout_create_info.bindingCount = uint32_t(binding_count);
   descriptor_set_layout_create_info.pBindings =
       descriptor_set_layout_bindings_.data();
@@ -2106,7 +2358,7 @@ void VulkanCommandProcessor::BindExternalGraphicsPipeline(
   deferred_command_buffer_.CmdVkBindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS,
                                              pipeline);
   current_external_graphics_pipeline_ = pipeline;
-  current_guest_graphics_pipeline_ = VK_NULL_HANDLE;
+  current_guest_graphics_pipeline_ = nullptr;
   current_guest_graphics_pipeline_layout_ = VK_NULL_HANDLE;
 }
 
@@ -2215,7 +2467,15 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
       return true;
     }
   }
-  // TODO(Triang3l): Memory export.
+  // TODO(Triang3l): Memory export. Needs eA / eM handling in the
+  // SpirvShaderTranslator (writing to the shared memory storage buffer, which
+  // is currently bound as read-only), like dxbc_shader_translator_memexport,
+  // and here, like on Direct3D 12, requesting the ranges from
+  // draw_util::AddMemExportRanges in the shared memory, and marking them as
+  // written by the GPU after the draw. Rather than reading back after every
+  // draw like d3d12_readback_memexport, the exported ranges may be tracked and
+  // read back only when the CPU accesses them. Vertex shader memexport without
+  // vertexPipelineStoresAndAtomics needs binding the descriptors to compute.
 
   uint32_t ps_param_gen_pos = UINT32_MAX;
   uint32_t interpolator_mask =
@@ -2266,7 +2526,8 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
             interpolator_mask, ps_param_gen_pos != UINT32_MAX);
     pixel_shader_modification =
         pixel_shader ? pipeline_cache_->GetCurrentPixelShaderModification(
-                           *pixel_shader, interpolator_mask, ps_param_gen_pos)
+                           *pixel_shader, interpolator_mask, ps_param_gen_pos,
+                           occlusion_query_active_)
                      : SpirvShaderTranslator::Modification(0);
 
     // Translate the shaders now to obtain the sampler bindings.
@@ -2355,8 +2616,12 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
   }
 
   // Set up the render targets - this may perform dispatches and draws.
+  if (register_file_->ConsumeDirtyGroup(
+          RegisterDirtyGroup::kNormalizedDepthControl)) {
+    last_normalized_depth_control_ = draw_util::GetNormalizedDepthControl(regs);
+  }
   reg::RB_DEPTHCONTROL normalized_depth_control =
-      draw_util::GetNormalizedDepthControl(regs);
+      last_normalized_depth_control_;
   uint32_t normalized_color_mask =
       pixel_shader ? draw_util::GetNormalizedColorMask(
                          regs, pixel_shader->writes_color_targets())
@@ -2370,13 +2635,13 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
   // Create the pipeline (for this, need the render pass from the render target
   // cache), translating the shaders - doing this now to obtain the used
   // textures.
-  VkPipeline pipeline;
+  void* pipeline_handle;
   const VulkanPipelineCache::PipelineLayoutProvider* pipeline_layout_provider;
   if (!pipeline_cache_->ConfigurePipeline(
           vertex_shader_translation, pixel_shader_translation,
           primitive_processing_result, normalized_depth_control,
           normalized_color_mask,
-          render_target_cache_->last_update_render_pass_key(), pipeline,
+          render_target_cache_->last_update_render_pass_key(), pipeline_handle,
           pipeline_layout_provider)) {
     return false;
   }
@@ -2394,10 +2659,10 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
   // Update the graphics pipeline, and if the new graphics pipeline has a
   // different layout, invalidate incompatible descriptor sets before updating
   // current_guest_graphics_pipeline_layout_.
-  if (current_guest_graphics_pipeline_ != pipeline) {
-    deferred_command_buffer_.CmdVkBindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                               pipeline);
-    current_guest_graphics_pipeline_ = pipeline;
+  if (current_guest_graphics_pipeline_ != pipeline_handle) {
+    deferred_command_buffer_.CmdBindGuestGraphicsPipelineHandle(
+        pipeline_handle);
+    current_guest_graphics_pipeline_ = pipeline_handle;
     current_external_graphics_pipeline_ = VK_NULL_HANDLE;
   }
   auto pipeline_layout =
@@ -2440,7 +2705,6 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
                                   RenderTargetCache::Path::kHostRenderTargets;
 
   // Get dynamic rasterizer state.
-  draw_util::ViewportInfo viewport_info;
 
   // Just handling maxViewportDimensions is enough - viewportBoundsRange[1] must
   // be at least 2 * max(maxViewportDimensions[0...1]) - 1, and
@@ -2458,16 +2722,27 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
   // life. Or even disregard the viewport bounds range in the fragment shader
   // interlocks case completely - apply the viewport and the scissor offset
   // directly to pixel address and to things like ps_param_gen.
-  draw_util::GetViewportInfoArgs gviargs{};
-  gviargs.Setup(1, 1, divisors::MagicDiv{1}, divisors::MagicDiv{1}, false,
-                device_limits.maxViewportDimensions[0],
-
-                device_limits.maxViewportDimensions[1], true,
-                normalized_depth_control, false, host_render_targets_used,
-                pixel_shader && pixel_shader->writes_depth());
-  gviargs.SetupRegisterValues(regs);
-
-  draw_util::GetHostViewportInfo(&gviargs, viewport_info);
+  // Aside from the registers, only the depth control and the pixel shader
+  // depth output may change between draws.
+  bool pixel_shader_writes_depth = pixel_shader && pixel_shader->writes_depth();
+  if (register_file_->ConsumeDirtyGroup(RegisterDirtyGroup::kViewport) ||
+      normalized_depth_control.value !=
+          last_viewport_normalized_depth_control_.value ||
+      pixel_shader_writes_depth != last_viewport_pixel_shader_writes_depth_) {
+    draw_util::GetViewportInfoArgs gviargs{};
+    gviargs.Setup(1, 1, divisors::MagicDiv{1}, divisors::MagicDiv{1}, false,
+                  device_limits.maxViewportDimensions[0],
+
+                  device_limits.maxViewportDimensions[1], true,
+                  normalized_depth_control, false, host_render_targets_used,
+                  pixel_shader_writes_depth);
+    gviargs.SetupRegisterValues(regs);
+
+    draw_util::GetHostViewportInfo(&gviargs, last_viewport_info_);
+    last_viewport_normalized_depth_control_ = normalized_depth_control;
+    last_viewport_pixel_shader_writes_depth_ = pixel_shader_writes_depth;
+  }
+  const draw_util::ViewportInfo& viewport_info = last_viewport_info_;
 
   // Update dynamic graphics pipeline state.
   UpdateDynamicState(viewport_info, primitive_polygonal,
@@ -2547,6 +2822,16 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
   // TODO(Triang3l): Memory export.
   shared_memory_->Use(VulkanSharedMemory::Usage::kRead);
 
+  // Obtain the query for counting the samples for the guest occlusion query
+  // (resetting the pool, if needed, must be done outside the render pass).
+  VkQueryPool occlusion_query_pool = VK_NULL_HANDLE;
+  uint32_t occlusion_query = 0;
+  if (occlusion_query_active_) {
+    occlusion_query_pool = RequestOcclusionQuery(occlusion_query);
+  }
+  VkQueryControlFlags occlusion_query_flags =
+      device_features.occlusionQueryPrecise ? VK_QUERY_CONTROL_PRECISE_BIT : 0;
+
   // After all commands that may dispatch, copy or insert barriers, submit the
   // barriers (may end the render pass), and (re)enter the render pass before
   // drawing.
@@ -2554,18 +2839,33 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
       render_target_cache_->last_update_render_pass(),
       render_target_cache_->last_update_framebuffer());
 
+  SetGpuTimestampPhase(GpuTimestampPhase::kDraws);
+
   // Draw.
   if (primitive_processing_result.index_buffer_type ==
           PrimitiveProcessor::ProcessedIndexBufferType::kNone ||
       shader_32bit_index_dma) {
+    if (occlusion_query_pool != VK_NULL_HANDLE) {
+      deferred_command_buffer_.CmdVkBeginQuery(
+          occlusion_query_pool, occlusion_query, occlusion_query_flags);
+    }
     deferred_command_buffer_.CmdVkDraw(
         primitive_processing_result.host_draw_vertex_count, 1, 0, 0);
   } else {
+    VkIndexType index_type = primitive_processing_result.host_index_format ==
+                                     xenos::IndexFormat::kInt16
+                                 ? VK_INDEX_TYPE_UINT16
+                                 : VK_INDEX_TYPE_UINT32;
     std::pair<VkBuffer, VkDeviceSize> index_buffer;
+    uint32_t first_index = 0;
     switch (primitive_processing_result.index_buffer_type) {
       case PrimitiveProcessor::ProcessedIndexBufferType::kGuestDMA:
+        // Binding the whole shared memory and offsetting via the first index
+        // so the binding can stay the same between guest DMA draws.
         index_buffer.first = shared_memory_->buffer();
-        index_buffer.second = primitive_processing_result.guest_index_base;
+        index_buffer.second = 0;
+        first_index = primitive_processing_result.guest_index_base >>
+                      (index_type == VK_INDEX_TYPE_UINT16 ? 1 : 2);
         break;
       case PrimitiveProcessor::ProcessedIndexBufferType::kHostConverted:
         index_buffer = primitive_processor_->GetConvertedIndexBuffer(
@@ -2580,14 +2880,53 @@ bool VulkanCommandProcessor::IssueDraw(xenos::PrimitiveType prim_type,
         assert_unhandled_case(primitive_processing_result.index_buffer_type);
         return false;
     }
-    deferred_command_buffer_.CmdVkBindIndexBuffer(
-        index_buffer.first, index_buffer.second,
-        primitive_processing_result.host_index_format ==
-                xenos::IndexFormat::kInt16
-            ? VK_INDEX_TYPE_UINT16
-            : VK_INDEX_TYPE_UINT32);
-    deferred_command_buffer_.CmdVkDrawIndexed(
-        primitive_processing_result.host_draw_vertex_count, 1, 0, 0, 0);
+    if (current_index_buffer_ != index_buffer.first ||
+        current_index_buffer_offset_ != index_buffer.second ||
+        current_index_type_ != index_type) {
+      deferred_command_buffer_.CmdVkBindIndexBuffer(
+          index_buffer.first, index_buffer.second, index_type);
+      current_index_buffer_ = index_buffer.first;
+      current_index_buffer_offset_ = index_buffer.second;
+      current_index_type_ = index_type;
+    }
+    if (occlusion_query_pool != VK_NULL_HANDLE) {
+      deferred_command_buffer_.CmdVkBeginQuery(
+          occlusion_query_pool, occlusion_query, occlusion_query_flags);
+    }
+    // If nothing has been recorded since the previous draw (the same state is
+    // used) and it's a list drawn from the indices immediately preceding the
+    // ones of this draw, extend the previous draw instead. Strips and fans
+    // can't be merged as their primitives are connected.
+    uint32_t primitive_index_count = 0;
+    switch (primitive_processing_result.host_primitive_type) {
+      case xenos::PrimitiveType::kPointList:
+        primitive_index_count = 1;
+        break;
+      case xenos::PrimitiveType::kLineList:
+        primitive_index_count = 2;
+        break;
+      case xenos::PrimitiveType::kTriangleList:
+      case xenos::PrimitiveType::kRectangleList:
+        primitive_index_count = 3;
+        break;
+      case xenos::PrimitiveType::kQuadList:
+        primitive_index_count = 4;
+        break;
+      default:
+        break;
+    }
+    if (!primitive_index_count ||
+        !deferred_command_buffer_.MergeDrawIndexedIntoLast(
+            primitive_processing_result.host_draw_vertex_count, first_index,
+            primitive_index_count)) {
+      deferred_command_buffer_.CmdVkDrawIndexed(
+          primitive_processing_result.host_draw_vertex_count, 1, first_index,
+          0, 0);
+    }
+  }
+  if (occlusion_query_pool != VK_NULL_HANDLE) {
+    deferred_command_buffer_.CmdVkEndQuery(occlusion_query_pool,
+                                           occlusion_query);
   }
 
   return true;
@@ -2637,6 +2976,11 @@ void VulkanCommandProcessor::CheckSubmissionFenceAndDeviceLoss(
   if (device_lost_) {
     return;
   }
+  if (submission_thread_device_lost_.load(std::memory_order_relaxed)) {
+    device_lost_ = true;
+    graphics_system_->OnHostGpuLossFromAnyThread(true);
+    return;
+  }
 
   if (await_submission >= GetCurrentSubmission()) {
     if (submission_open_) {
@@ -2651,59 +2995,105 @@ void VulkanCommandProcessor::CheckSubmissionFenceAndDeviceLoss(
   const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
   VkDevice device = provider.device();
 
-  size_t fences_total = submissions_in_flight_fences_.size();
-  size_t fences_awaited = 0;
+  uint64_t submission_completed_new = submission_completed_;
   if (await_submission > submission_completed_) {
-    // Await in a blocking way if requested.
-    // TODO(Triang3l): Await only one fence. "Fence signal operations that are
-    // defined by vkQueueSubmit additionally include in the first
-    // synchronization scope all commands that occur earlier in submission
-    // order."
-    VkResult wait_result = dfn.vkWaitForFences(
-        device, uint32_t(await_submission - submission_completed_),
-        submissions_in_flight_fences_.data(), VK_TRUE, UINT64_MAX);
-    if (wait_result == VK_SUCCESS) {
-      fences_awaited += await_submission - submission_completed_;
-    } else {
-      XELOGE("Failed to await submission completion Vulkan fences");
-      if (wait_result == VK_ERROR_DEVICE_LOST) {
+    // The fences and the timeline semaphore signal operations must be in the
+    // queue before waiting for them.
+    if (submission_thread_) {
+      AwaitSubmissionThreadIdle();
+      if (submission_thread_device_lost_.load(std::memory_order_relaxed)) {
         device_lost_ = true;
+        graphics_system_->OnHostGpuLossFromAnyThread(true);
+        return;
       }
     }
   }
-  // Check how far into the submissions the GPU currently is, in order because
-  // submission themselves can be executed out of order, but Xenia serializes
-  // that for simplicity.
-  while (fences_awaited < fences_total) {
-    VkResult fence_status = dfn.vkWaitForFences(
-        device, 1, &submissions_in_flight_fences_[fences_awaited], VK_TRUE, 0);
-    if (fence_status != VK_SUCCESS) {
-      if (fence_status == VK_ERROR_DEVICE_LOST) {
-        device_lost_ = true;
+  if (submission_timeline_semaphore_ != VK_NULL_HANDLE) {
+    if (await_submission > submission_completed_) {
+      VkSemaphoreWaitInfoKHR semaphore_wait_info;
+      semaphore_wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+      semaphore_wait_info.pNext = nullptr;
+      semaphore_wait_info.flags = 0;
+      semaphore_wait_info.semaphoreCount = 1;
+      semaphore_wait_info.pSemaphores = &submission_timeline_semaphore_;
+      semaphore_wait_info.pValues = &await_submission;
+      VkResult wait_result =
+          dfn.vkWaitSemaphoresKHR(device, &semaphore_wait_info, UINT64_MAX);
+      if (wait_result != VK_SUCCESS) {
+        XELOGE("Failed to await the Vulkan submission timeline semaphore");
+        if (wait_result == VK_ERROR_DEVICE_LOST) {
+          device_lost_ = true;
+        }
+      }
+    }
+    uint64_t semaphore_value;
+    VkResult semaphore_value_result = dfn.vkGetSemaphoreCounterValueKHR(
+        device, submission_timeline_semaphore_, &semaphore_value);
+    if (semaphore_value_result == VK_SUCCESS) {
+      submission_completed_new = std::max(
+          submission_completed_,
+          std::min(semaphore_value, GetCurrentSubmission() - 1));
+    } else if (semaphore_value_result == VK_ERROR_DEVICE_LOST) {
+      device_lost_ = true;
+    }
+  } else {
+    size_t fences_total = submissions_in_flight_fences_.size();
+    size_t fences_awaited = 0;
+    if (await_submission > submission_completed_) {
+      // Await in a blocking way if requested.
+      // TODO(Triang3l): Await only one fence. "Fence signal operations that
+      // are defined by vkQueueSubmit additionally include in the first
+      // synchronization scope all commands that occur earlier in submission
+      // order."
+      VkResult wait_result = dfn.vkWaitForFences(
+          device, uint32_t(await_submission - submission_completed_),
+          submissions_in_flight_fences_.data(), VK_TRUE, UINT64_MAX);
+      if (wait_result == VK_SUCCESS) {
+        fences_awaited += await_submission - submission_completed_;
+      } else {
+        XELOGE("Failed to await submission completion Vulkan fences");
+        if (wait_result == VK_ERROR_DEVICE_LOST) {
+          device_lost_ = true;
+        }
       }
-      break;
     }
-    ++fences_awaited;
+    // Check how far into the submissions the GPU currently is, in order
+    // because submission themselves can be executed out of order, but Xenia
+    // serializes that for simplicity.
+    while (fences_awaited < fences_total) {
+      VkResult fence_status = dfn.vkWaitForFences(
+          device, 1, &submissions_in_flight_fences_[fences_awaited], VK_TRUE,
+          0);
+      if (fence_status != VK_SUCCESS) {
+        if (fence_status == VK_ERROR_DEVICE_LOST) {
+          device_lost_ = true;
+        }
+        break;
+      }
+      ++fences_awaited;
+    }
+    // Reclaim fences.
+    fences_free_.reserve(fences_free_.size() + fences_awaited);
+    auto submissions_in_flight_fences_awaited_end =
+        submissions_in_flight_fences_.cbegin();
+    std::advance(submissions_in_flight_fences_awaited_end, fences_awaited);
+    fences_free_.insert(fences_free_.cend(),
+                        submissions_in_flight_fences_.cbegin(),
+                        submissions_in_flight_fences_awaited_end);
+    submissions_in_flight_fences_.erase(
+        submissions_in_flight_fences_.cbegin(),
+        submissions_in_flight_fences_awaited_end);
+    submission_completed_new += fences_awaited;
   }
   if (device_lost_) {
     graphics_system_->OnHostGpuLossFromAnyThread(true);
     return;
   }
-  if (!fences_awaited) {
+  if (submission_completed_new == submission_completed_) {
     // Not updated - no need to reclaim or download things.
     return;
   }
-  // Reclaim fences.
-  fences_free_.reserve(fences_free_.size() + fences_awaited);
-  auto submissions_in_flight_fences_awaited_end =
-      submissions_in_flight_fences_.cbegin();
-  std::advance(submissions_in_flight_fences_awaited_end, fences_awaited);
-  fences_free_.insert(fences_free_.cend(),
-                      submissions_in_flight_fences_.cbegin(),
-                      submissions_in_flight_fences_awaited_end);
-  submissions_in_flight_fences_.erase(submissions_in_flight_fences_.cbegin(),
-                                      submissions_in_flight_fences_awaited_end);
-  submission_completed_ += fences_awaited;
+  submission_completed_ = submission_completed_new;
 
   // Reclaim semaphores.
   while (!submissions_in_flight_semaphores_.empty()) {
@@ -2716,6 +3106,92 @@ void VulkanCommandProcessor::CheckSubmissionFenceAndDeviceLoss(
     submissions_in_flight_semaphores_.pop_front();
   }
 
+  // Report the sample counts of the completed occlusion queries and reclaim
+  // the query pools.
+  while (!occlusion_query_pools_submitted_.empty()) {
+    const OcclusionQueryPool& query_pool =
+        occlusion_query_pools_submitted_.front();
+    if (query_pool.submission > submission_completed_) {
+      break;
+    }
+    uint32_t query_count = uint32_t(query_pool.guest_queries.size());
+    occlusion_query_results_temp_.resize(query_count);
+    if (dfn.vkGetQueryPoolResults(
+            device, query_pool.pool, 0, query_count,
+            sizeof(uint64_t) * query_count,
+            occlusion_query_results_temp_.data(), sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+      // Report the counts as if the draws were done at 1x resolution.
+      uint64_t resolution_scale =
+          uint64_t(texture_cache_->draw_resolution_scale_x()) *
+          texture_cache_->draw_resolution_scale_y();
+      uint64_t sample_count = 0;
+      for (uint32_t i = 0; i < query_count; ++i) {
+        sample_count += occlusion_query_results_temp_[i];
+        const std::pair<uint64_t, uint32_t>& guest_query =
+            query_pool.guest_queries[i];
+        if (i + 1 >= query_count ||
+            query_pool.guest_queries[i + 1] != guest_query) {
+          OcclusionQueryResolved(guest_query.first, guest_query.second,
+                                 sample_count / resolution_scale);
+          sample_count = 0;
+        }
+      }
+    } else {
+      XELOGE("Failed to get the Vulkan occlusion query results");
+    }
+    occlusion_query_pools_free_.push_back(query_pool.pool);
+    occlusion_query_pools_submitted_.pop_front();
+  }
+
+  // Accumulate the GPU time of the phases of the completed submissions, and
+  // report the totals when a frame is completed.
+  while (!gpu_timestamp_query_pools_submitted_.empty()) {
+    const GpuTimestampQueryPool& query_pool =
+        gpu_timestamp_query_pools_submitted_.front();
+    if (query_pool.submission > submission_completed_) {
+      break;
+    }
+    uint32_t query_count = uint32_t(query_pool.phases.size());
+    gpu_timestamp_results_temp_.resize(query_count);
+    if (dfn.vkGetQueryPoolResults(
+            device, query_pool.pool, 0, query_count,
+            sizeof(uint64_t) * query_count, gpu_timestamp_results_temp_.data(),
+            sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+      for (uint32_t i = 0; i + 1 < query_count; ++i) {
+        uint64_t phase_start = gpu_timestamp_results_temp_[i];
+        uint64_t phase_end = gpu_timestamp_results_temp_[i + 1];
+        if (phase_end > phase_start) {
+          gpu_timestamp_phase_ticks_[size_t(query_pool.phases[i])] +=
+              phase_end - phase_start;
+        }
+      }
+    } else {
+      XELOGE("Failed to get the Vulkan GPU timestamp query results");
+    }
+    if (query_pool.is_closing_frame) {
+      COUNT_profile_set(
+          "gpu/vulkan/gpu_time_us/draws",
+          GetGpuTimestampPhaseMicroseconds(GpuTimestampPhase::kDraws));
+      COUNT_profile_set("gpu/vulkan/gpu_time_us/render_target_transfers",
+                        GetGpuTimestampPhaseMicroseconds(
+                            GpuTimestampPhase::kRenderTargetTransfers));
+      COUNT_profile_set(
+          "gpu/vulkan/gpu_time_us/resolves",
+          GetGpuTimestampPhaseMicroseconds(GpuTimestampPhase::kResolves));
+      COUNT_profile_set(
+          "gpu/vulkan/gpu_time_us/texture_loads",
+          GetGpuTimestampPhaseMicroseconds(GpuTimestampPhase::kTextureLoads));
+      COUNT_profile_set(
+          "gpu/vulkan/gpu_time_us/presentation",
+          GetGpuTimestampPhaseMicroseconds(GpuTimestampPhase::kPresentation));
+      std::memset(gpu_timestamp_phase_ticks_, 0,
+                  sizeof(gpu_timestamp_phase_ticks_));
+    }
+    gpu_timestamp_query_pools_free_.push_back(query_pool.pool);
+    gpu_timestamp_query_pools_submitted_.pop_front();
+  }
+
   // Reclaim command pools.
   while (!command_buffers_submitted_.empty()) {
     const auto& command_buffer_pair = command_buffers_submitted_.front();
@@ -2825,15 +3301,52 @@ bool VulkanCommandProcessor::BeginSubmission(bool is_guest_command) {
     dynamic_stencil_reference_back_update_needed_ = true;
     current_render_pass_ = VK_NULL_HANDLE;
     current_framebuffer_ = nullptr;
-    current_guest_graphics_pipeline_ = VK_NULL_HANDLE;
+    current_guest_graphics_pipeline_ = nullptr;
     current_external_graphics_pipeline_ = VK_NULL_HANDLE;
     current_external_compute_pipeline_ = VK_NULL_HANDLE;
+    current_index_buffer_ = VK_NULL_HANDLE;
     current_guest_graphics_pipeline_layout_ = nullptr;
     current_graphics_descriptor_sets_bound_up_to_date_ = 0;
 
     primitive_processor_->BeginSubmission();
 
     texture_cache_->BeginSubmission(GetCurrentSubmission());
+
+    if (gpu_timestamp_period_ns_ > 0.0f) {
+      VkQueryPool query_pool = VK_NULL_HANDLE;
+      if (!gpu_timestamp_query_pools_free_.empty()) {
+        query_pool = gpu_timestamp_query_pools_free_.back();
+        gpu_timestamp_query_pools_free_.pop_back();
+      } else {
+        const ui::vulkan::VulkanProvider& provider = GetVulkanProvider();
+        const ui::vulkan::VulkanProvider::DeviceFunctions& dfn =
+            provider.dfn();
+        VkDevice device = provider.device();
+        VkQueryPoolCreateInfo query_pool_create_info;
+        query_pool_create_info.sType =
+            VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        query_pool_create_info.pNext = nullptr;
+        query_pool_create_info.flags = 0;
+        query_pool_create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        query_pool_create_info.queryCount = kGpuTimestampQueryPoolSize;
+        query_pool_create_info.pipelineStatistics = 0;
+        if (dfn.vkCreateQueryPool(device, &query_pool_create_info, nullptr,
+                                  &query_pool) != VK_SUCCESS) {
+          XELOGE("Failed to create a Vulkan GPU timestamp query pool");
+          query_pool = VK_NULL_HANDLE;
+        }
+      }
+      if (query_pool != VK_NULL_HANDLE) {
+        // Outside a render pass in the beginning of the submission.
+        deferred_command_buffer_.CmdVkResetQueryPool(
+            query_pool, 0, kGpuTimestampQueryPoolSize);
+        deferred_command_buffer_.CmdVkWriteTimestamp(
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, 0);
+        gpu_timestamp_query_pool_current_.pool = query_pool;
+        gpu_timestamp_query_pool_current_.phases.push_back(
+            GpuTimestampPhase::kDraws);
+      }
+    }
   }
 
   if (is_opening_frame) {
@@ -2904,6 +3417,8 @@ bool VulkanCommandProcessor::BeginSubmission(bool is_guest_command) {
     primitive_processor_->BeginFrame();
 
     texture_cache_->BeginFrame();
+
+    render_target_cache_->ReleaseUnownedRenderTargets();
   }
 
   return true;
@@ -2916,7 +3431,8 @@ bool VulkanCommandProcessor::EndSubmission(bool is_swap) {
 
   // Make sure everything needed for submitting exist.
   if (submission_open_) {
-    if (fences_free_.empty()) {
+    if (submission_timeline_semaphore_ == VK_NULL_HANDLE &&
+        fences_free_.empty()) {
       VkFenceCreateInfo fence_create_info;
       fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
       fence_create_info.pNext = nullptr;
@@ -2986,12 +3502,38 @@ bool VulkanCommandProcessor::EndSubmission(bool is_swap) {
 
     EndRenderPass();
 
+    if (occlusion_query_pool_current_.pool != VK_NULL_HANDLE) {
+      occlusion_query_pool_current_.submission = GetCurrentSubmission();
+      occlusion_query_pools_submitted_.push_back(
+          std::move(occlusion_query_pool_current_));
+      occlusion_query_pool_current_.pool = VK_NULL_HANDLE;
+      occlusion_query_pool_current_.guest_queries.clear();
+    }
+
+    if (gpu_timestamp_query_pool_current_.pool != VK_NULL_HANDLE) {
+      std::vector<GpuTimestampPhase>& gpu_timestamp_phases =
+          gpu_timestamp_query_pool_current_.phases;
+      deferred_command_buffer_.CmdVkWriteTimestamp(
+          VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+          gpu_timestamp_query_pool_current_.pool,
+          uint32_t(gpu_timestamp_phases.size()));
+      gpu_timestamp_phases.push_back(GpuTimestampPhase::kCount);
+      gpu_timestamp_query_pool_current_.submission = GetCurrentSubmission();
+      gpu_timestamp_query_pool_current_.is_closing_frame = is_closing_frame;
+      gpu_timestamp_query_pools_submitted_.push_back(
+          std::move(gpu_timestamp_query_pool_current_));
+      gpu_timestamp_query_pool_current_.pool = VK_NULL_HANDLE;
+      gpu_timestamp_query_pool_current_.phases.clear();
+    }
+
     render_target_cache_->EndSubmission();
 
     primitive_processor_->EndSubmission();
 
     shared_memory_->EndSubmission();
 
+    pipeline_cache_->EndSubmission();
+
     uniform_buffer_pool_->FlushWrites();
 
     // Submit sparse binds earlier, before executing the deferred command
@@ -3050,68 +3592,62 @@ bool VulkanCommandProcessor::EndSubmission(bool is_swap) {
 
     assert_false(command_buffers_writable_.empty());
     CommandBuffer command_buffer = command_buffers_writable_.back();
-    if (dfn.vkResetCommandPool(device, command_buffer.pool, 0) != VK_SUCCESS) {
-      XELOGE("Failed to reset a Vulkan command pool");
-      return false;
-    }
-    VkCommandBufferBeginInfo command_buffer_begin_info;
-    command_buffer_begin_info.sType =
-        VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    command_buffer_begin_info.pNext = nullptr;
-    command_buffer_begin_info.flags =
-        VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    command_buffer_begin_info.pInheritanceInfo = nullptr;
-    if (dfn.vkBeginCommandBuffer(command_buffer.buffer,
-                                 &command_buffer_begin_info) != VK_SUCCESS) {
-      XELOGE("Failed to begin a Vulkan command buffer");
-      return false;
-    }
-    deferred_command_buffer_.Execute(command_buffer.buffer);
-    if (dfn.vkEndCommandBuffer(command_buffer.buffer) != VK_SUCCESS) {
-      XELOGE("Failed to end a Vulkan command buffer");
-      return false;
+    VkFence fence = VK_NULL_HANDLE;
+    if (submission_timeline_semaphore_ == VK_NULL_HANDLE) {
+      assert_false(fences_free_.empty());
+      fence = fences_free_.back();
+      if (dfn.vkResetFences(device, 1, &fence) != VK_SUCCESS) {
+        XELOGE("Failed to reset a Vulkan submission fence");
+        return false;
+      }
     }
-
-    VkSubmitInfo submit_info;
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.pNext = nullptr;
-    if (!current_submission_wait_semaphores_.empty()) {
-      submit_info.waitSemaphoreCount =
-          uint32_t(current_submission_wait_semaphores_.size());
-      submit_info.pWaitSemaphores = current_submission_wait_semaphores_.data();
-      submit_info.pWaitDstStageMask =
-          current_submission_wait_stage_masks_.data();
+    uint64_t submission_current = GetCurrentSubmission();
+    if (submission_thread_) {
+      std::unique_ptr<SubmissionThreadRequest> request;
+      {
+        std::lock_guard<std::mutex> lock(submission_thread_mutex_);
+        if (!submission_thread_requests_free_.empty()) {
+          request = std::move(submission_thread_requests_free_.back());
+          submission_thread_requests_free_.pop_back();
+        }
+      }
+      if (!request) {
+        request = std::make_unique<SubmissionThreadRequest>(*this);
+      }
+      // The request's deferred command buffer has been reset after the
+      // previous usage, so the current one will be empty after the swap.
+      request->deferred_command_buffer.Swap(deferred_command_buffer_);
+      request->command_buffer = command_buffer;
+      request->fence = fence;
+      request->submission = submission_current;
+      request->wait_semaphores = current_submission_wait_semaphores_;
+      request->wait_stage_masks = current_submission_wait_stage_masks_;
+      {
+        std::lock_guard<std::mutex> lock(submission_thread_mutex_);
+        submission_thread_queue_.push_back(std::move(request));
+        ++submission_thread_pending_count_;
+      }
+      submission_thread_request_cond_.notify_one();
+      if (is_swap) {
+        // The presenter submits its own commands using the guest output image
+        // to the queue after this.
+        AwaitSubmissionThreadIdle();
+      }
     } else {
-      submit_info.waitSemaphoreCount = 0;
-      submit_info.pWaitSemaphores = nullptr;
-      submit_info.pWaitDstStageMask = nullptr;
-    }
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &command_buffer.buffer;
-    submit_info.signalSemaphoreCount = 0;
-    submit_info.pSignalSemaphores = nullptr;
-    assert_false(fences_free_.empty());
-    VkFence fence = fences_free_.back();
-    if (dfn.vkResetFences(device, 1, &fence) != VK_SUCCESS) {
-      XELOGE("Failed to reset a Vulkan submission fence");
-      return false;
-    }
-    VkResult submit_result;
-    {
-      ui::vulkan::VulkanProvider::QueueAcquisition queue_acquisition(
-          provider.AcquireQueue(provider.queue_family_graphics_compute(), 0));
-      submit_result =
-          dfn.vkQueueSubmit(queue_acquisition.queue, 1, &submit_info, fence);
-    }
-    if (submit_result != VK_SUCCESS) {
-      XELOGE("Failed to submit a Vulkan command buffer");
-      if (submit_result == VK_ERROR_DEVICE_LOST && !device_lost_) {
-        device_lost_ = true;
-        graphics_system_->OnHostGpuLossFromAnyThread(true);
+      VkResult submit_result = RecordAndSubmitCommandBuffer(
+          deferred_command_buffer_, command_buffer, fence, submission_current,
+          uint32_t(current_submission_wait_semaphores_.size()),
+          current_submission_wait_semaphores_.data(),
+          current_submission_wait_stage_masks_.data());
+      if (submit_result != VK_SUCCESS) {
+        if (submit_result == VK_ERROR_DEVICE_LOST && !device_lost_) {
+          device_lost_ = true;
+          graphics_system_->OnHostGpuLossFromAnyThread(true);
+        }
+        return false;
       }
-      return false;
     }
-    uint64_t submission_current = GetCurrentSubmission();
+
     current_submission_wait_stage_masks_.clear();
     for (VkSemaphore semaphore : current_submission_wait_semaphores_) {
       submissions_in_flight_semaphores_.emplace_back(submission_current,
@@ -3120,9 +3656,11 @@ bool VulkanCommandProcessor::EndSubmission(bool is_swap) {
     current_submission_wait_semaphores_.clear();
     command_buffers_submitted_.emplace_back(submission_current, command_buffer);
     command_buffers_writable_.pop_back();
-    // Increments the current submission number, going to the next submission.
-    submissions_in_flight_fences_.push_back(fence);
-    fences_free_.pop_back();
+    if (fence != VK_NULL_HANDLE) {
+      submissions_in_flight_fences_.push_back(fence);
+      fences_free_.pop_back();
+    }
+    ++submission_current_;
 
     submission_open_ = false;
   }
@@ -3173,6 +3711,157 @@ bool VulkanCommandProcessor::EndSubmission(bool is_swap) {
   return true;
 }
 
+VkResult VulkanCommandProcessor::RecordAndSubmitCommandBuffer(
+    DeferredCommandBuffer& deferred_command_buffer,
+    const CommandBuffer& command_buffer, VkFence fence, uint64_t submission,
+    uint32_t wait_semaphore_count, const VkSemaphore* wait_semaphores,
+    const VkPipelineStageFlags* wait_stage_masks) {
+  const ui::vulkan::VulkanProvider& provider = GetVulkanProvider();
+  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+  VkDevice device = provider.device();
+
+  VkResult result = dfn.vkResetCommandPool(device, command_buffer.pool, 0);
+  if (result != VK_SUCCESS) {
+    XELOGE("Failed to reset a Vulkan command pool");
+    return result;
+  }
+  VkCommandBufferBeginInfo command_buffer_begin_info;
+  command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  command_buffer_begin_info.pNext = nullptr;
+  command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  command_buffer_begin_info.pInheritanceInfo = nullptr;
+  result = dfn.vkBeginCommandBuffer(command_buffer.buffer,
+                                    &command_buffer_begin_info);
+  if (result != VK_SUCCESS) {
+    XELOGE("Failed to begin a Vulkan command buffer");
+    return result;
+  }
+  deferred_command_buffer.Execute(command_buffer.buffer);
+  result = dfn.vkEndCommandBuffer(command_buffer.buffer);
+  if (result != VK_SUCCESS) {
+    XELOGE("Failed to end a Vulkan command buffer");
+    return result;
+  }
+
+  VkSubmitInfo submit_info;
+  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit_info.pNext = nullptr;
+  if (wait_semaphore_count) {
+    submit_info.waitSemaphoreCount = wait_semaphore_count;
+    submit_info.pWaitSemaphores = wait_semaphores;
+    submit_info.pWaitDstStageMask = wait_stage_masks;
+  } else {
+    submit_info.waitSemaphoreCount = 0;
+    submit_info.pWaitSemaphores = nullptr;
+    submit_info.pWaitDstStageMask = nullptr;
+  }
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &command_buffer.buffer;
+  result = SubmitToQueue(submit_info, fence, submission);
+  if (result != VK_SUCCESS) {
+    XELOGE("Failed to submit a Vulkan command buffer");
+  }
+  return result;
+}
+
+VkResult VulkanCommandProcessor::SubmitToQueue(VkSubmitInfo& submit_info,
+                                               VkFence fence,
+                                               uint64_t submission) {
+  const ui::vulkan::VulkanProvider& provider = GetVulkanProvider();
+  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+  VkTimelineSemaphoreSubmitInfoKHR timeline_semaphore_submit_info;
+  if (submission_timeline_semaphore_ != VK_NULL_HANDLE) {
+    assert_true(fence == VK_NULL_HANDLE);
+    // The wait semaphores are binary, no need for the wait values.
+    timeline_semaphore_submit_info.sType =
+        VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+    timeline_semaphore_submit_info.pNext = nullptr;
+    timeline_semaphore_submit_info.waitSemaphoreValueCount = 0;
+    timeline_semaphore_submit_info.pWaitSemaphoreValues = nullptr;
+    timeline_semaphore_submit_info.signalSemaphoreValueCount = 1;
+    timeline_semaphore_submit_info.pSignalSemaphoreValues = &submission;
+    submit_info.pNext = &timeline_semaphore_submit_info;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = &submission_timeline_semaphore_;
+  } else {
+    submit_info.pNext = nullptr;
+    submit_info.signalSemaphoreCount = 0;
+    submit_info.pSignalSemaphores = nullptr;
+  }
+  ui::vulkan::VulkanProvider::QueueAcquisition queue_acquisition(
+      provider.AcquireQueue(provider.queue_family_graphics_compute(), 0));
+  return dfn.vkQueueSubmit(queue_acquisition.queue, 1, &submit_info, fence);
+}
+
+void VulkanCommandProcessor::SubmissionThread() {
+  while (true) {
+    std::unique_ptr<SubmissionThreadRequest> request;
+    {
+      std::unique_lock<std::mutex> lock(submission_thread_mutex_);
+      while (submission_thread_queue_.empty()) {
+        if (submission_thread_shutdown_) {
+          return;
+        }
+        submission_thread_request_cond_.wait(lock);
+      }
+      request = std::move(submission_thread_queue_.front());
+      submission_thread_queue_.pop_front();
+    }
+
+    if (!submission_thread_device_lost_.load(std::memory_order_relaxed)) {
+      VkResult submit_result = RecordAndSubmitCommandBuffer(
+          request->deferred_command_buffer, request->command_buffer,
+          request->fence, request->submission,
+          uint32_t(request->wait_semaphores.size()),
+          request->wait_semaphores.data(), request->wait_stage_masks.data());
+      if (submit_result != VK_SUCCESS &&
+          submit_result != VK_ERROR_DEVICE_LOST) {
+        // Unlike on the processor thread, can't retry later as the submission
+        // is already considered done. Drop the commands, but still signal the
+        // fence or the timeline semaphore and wait for the semaphores, so the
+        // submission tracking stays consistent.
+        XELOGE(
+            "Dropping the commands of a Vulkan submission that couldn't be "
+            "submitted");
+        VkSubmitInfo submit_info = {};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.waitSemaphoreCount =
+            uint32_t(request->wait_semaphores.size());
+        if (submit_info.waitSemaphoreCount) {
+          submit_info.pWaitSemaphores = request->wait_semaphores.data();
+          submit_info.pWaitDstStageMask = request->wait_stage_masks.data();
+        }
+        submit_result =
+            SubmitToQueue(submit_info, request->fence, request->submission);
+      }
+      if (submit_result != VK_SUCCESS) {
+        // The fence or the timeline semaphore value will never be signaled -
+        // waiting for it is not possible anymore.
+        submission_thread_device_lost_.store(true, std::memory_order_relaxed);
+      }
+    }
+
+    request->deferred_command_buffer.Reset();
+    bool idle;
+    {
+      std::lock_guard<std::mutex> lock(submission_thread_mutex_);
+      submission_thread_requests_free_.push_back(std::move(request));
+      idle = !--submission_thread_pending_count_;
+    }
+    if (idle) {
+      submission_thread_idle_cond_.notify_all();
+    }
+  }
+}
+
+void VulkanCommandProcessor::AwaitSubmissionThreadIdle() {
+  assert_not_null(submission_thread_);
+  SCOPE_profile_cpu_f("gpu");
+  std::unique_lock<std::mutex> lock(submission_thread_mutex_);
+  submission_thread_idle_cond_.wait(
+      lock, [this]() { return !submission_thread_pending_count_; });
+}
+
 void VulkanCommandProcessor::ClearTransientDescriptorPools() {
   texture_transient_descriptor_sets_free_.clear();
   texture_transient_descriptor_sets_used_.clear();
@@ -3264,8 +3953,10 @@ void VulkanCommandProcessor::UpdateDynamicState(
   SetViewport(viewport);
 
   // Scissor.
-  draw_util::Scissor scissor;
-  draw_util::GetScissor(regs, scissor);
+  if (register_file_->ConsumeDirtyGroup(RegisterDirtyGroup::kScissor)) {
+    draw_util::GetScissor(regs, last_scissor_);
+  }
+  const draw_util::Scissor& scissor = last_scissor_;
   VkRect2D scissor_rect;
   scissor_rect.offset.x = int32_t(scissor.offset[0]);
   scissor_rect.offset.y = int32_t(scissor.offset[1]);
@@ -4289,7 +4980,13 @@ bool VulkanCommandProcessor::UpdateBindings(const VulkanShader* vertex_shader,
             write_textures[0].dstSet;
   }
   // Pixel shader textures and samplers.
-  if (write_pixel_textures) {
+  bool push_pixel_textures = IsTextureDescriptorSetPushed(
+      false, texture_count_pixel + sampler_count_pixel);
+  if (write_pixel_textures && push_pixel_textures) {
+    // Pushed to the command buffer after binding the rest of the sets.
+    write_descriptor_set_bits |=
+        UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetTexturesPixel;
+  } else if (write_pixel_textures) {
     VkWriteDescriptorSet* write_textures =
         write_descriptor_sets.data() + write_descriptor_set_count;
     uint32_t texture_descriptor_set_write_count = WriteTransientTextureBindings(
@@ -4333,6 +5030,10 @@ bool VulkanCommandProcessor::UpdateBindings(const VulkanShader* vertex_shader,
   uint32_t descriptor_sets_remaining =
       descriptor_sets_needed &
       ~current_graphics_descriptor_sets_bound_up_to_date_;
+  if (push_pixel_textures) {
+    descriptor_sets_remaining &=
+        ~(UINT32_C(1) << SpirvShaderTranslator::kDescriptorSetTexturesPixel);
+  }
   uint32_t descriptor_set_index;
   while (
       xe::bit_scan_forward(descriptor_sets_remaining, &descriptor_set_index)) {
@@ -4352,6 +5053,15 @@ bool VulkanCommandProcessor::UpdateBindings(const VulkanShader* vertex_shader,
     descriptor_sets_remaining &=
         ~((UINT32_C(1) << descriptor_set_mask_tzcnt) - 1);
   }
+  if (write_pixel_textures && push_pixel_textures) {
+    deferred_command_buffer_.CmdPushTextureDescriptorSet(
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        current_guest_graphics_pipeline_layout_->GetPipelineLayout(),
+        SpirvShaderTranslator::kDescriptorSetTexturesPixel, texture_count_pixel,
+        descriptor_write_image_info_.data() + pixel_texture_image_info_offset,
+        sampler_count_pixel,
+        descriptor_write_image_info_.data() + pixel_sampler_image_info_offset);
+  }
   current_graphics_descriptor_sets_bound_up_to_date_ |= descriptor_sets_needed;
 
   return true;
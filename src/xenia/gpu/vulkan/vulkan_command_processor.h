@@ -11,11 +11,14 @@
 #define XENIA_GPU_VULKAN_VULKAN_COMMAND_PROCESSOR_H_
 
 #include <array>
+#include <atomic>
 #include <climits>
+#include <condition_variable>
 #include <cstdint>
 #include <deque>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -23,6 +26,7 @@
 
 #include "xenia/base/assert.h"
 #include "xenia/base/hash.h"
+#include "xenia/base/threading.h"
 #include "xenia/gpu/command_processor.h"
 #include "xenia/gpu/draw_util.h"
 #include "xenia/gpu/registers.h"
@@ -143,6 +147,9 @@ class VulkanCommandProcessor final : public CommandProcessor {
 
   void ClearCaches() override;
 
+  void InitializeShaderStorage(const std::filesystem::path& cache_root,
+                               uint32_t title_id, bool blocking) override;
+
   void TracePlaybackWroteMemory(uint32_t base_ptr, uint32_t length) override;
 
   void RestoreEdramSnapshot(const void* snapshot) override;
@@ -160,10 +167,7 @@ class VulkanCommandProcessor final : public CommandProcessor {
   }
 
   bool submission_open() const { return submission_open_; }
-  uint64_t GetCurrentSubmission() const {
-    return submission_completed_ +
-           uint64_t(submissions_in_flight_fences_.size()) + 1;
-  }
+  uint64_t GetCurrentSubmission() const { return submission_current_; }
   uint64_t GetCompletedSubmission() const { return submission_completed_; }
 
   // Sparse binds are:
@@ -179,6 +183,20 @@ class VulkanCommandProcessor final : public CommandProcessor {
   uint64_t GetCurrentFrame() const { return frame_current_; }
   uint64_t GetCompletedFrame() const { return frame_completed_; }
 
+  // For synchronization with work submitted to other queues. Returns an
+  // unsignaled semaphore owned by the caller, or VK_NULL_HANDLE in case of a
+  // failure.
+  VkSemaphore AcquireSemaphore();
+  // Makes the current submission wait for the semaphore, which must have a
+  // signal operation pending, before the stages, taking the ownership of the
+  // semaphore back. Submission must be open.
+  void AwaitSemaphoreInCurrentSubmission(VkSemaphore semaphore,
+                                         VkPipelineStageFlags stage_mask) {
+    assert_true(submission_open_);
+    current_submission_wait_semaphores_.push_back(semaphore);
+    current_submission_wait_stage_masks_.push_back(stage_mask);
+  }
+
   // Submission must be open to insert barriers. If no pipeline stages access
   // the resource in a synchronization scope, the stage masks should be 0 (top /
   // bottom of pipe should be specified only if explicitly needed). Returning
@@ -212,6 +230,28 @@ class VulkanCommandProcessor final : public CommandProcessor {
   // scope. Submission must be open.
   void EndRenderPass();
 
+  // Returns the pool and the index of a host occlusion query, with the reset
+  // already done in the current submission, for counting the samples of a
+  // draw within the active guest occlusion query, or VK_NULL_HANDLE in case of
+  // a failure. May end the render pass. Submission must be open.
+  VkQueryPool RequestOcclusionQuery(uint32_t& query_out);
+
+  // Parts of the work of the command processor measured separately with GPU
+  // timestamps if vulkan_gpu_timestamps is enabled. The totals for each frame
+  // are reported as profiler counters when the frame is completed.
+  enum class GpuTimestampPhase : uint32_t {
+    kDraws,
+    kRenderTargetTransfers,
+    kResolves,
+    kTextureLoads,
+    kPresentation,
+
+    kCount,
+  };
+  // Attributes the GPU time of the commands recorded after this call, until
+  // the next phase change, to the phase. Submission must be open.
+  void SetGpuTimestampPhase(GpuTimestampPhase phase);
+
   VkDescriptorSetLayout GetSingleTransientDescriptorLayout(
       SingleTransientDescriptorLayout transient_descriptor_layout) const {
     return descriptor_set_layouts_single_transient_[size_t(
@@ -231,6 +271,13 @@ class VulkanCommandProcessor final : public CommandProcessor {
       size_t size, SingleTransientDescriptorLayout transient_descriptor_layout,
       VkDescriptorSet& descriptor_set_out);
 
+  // 32 is the minimum maxPushDescriptors.
+  static constexpr size_t kMaxPushedTextureDescriptorSetBindings = 32;
+  bool IsTextureDescriptorSetPushed(bool is_vertex,
+                                    size_t binding_count) const {
+    return !is_vertex && texture_descriptor_set_pixel_pushed_ &&
+           binding_count <= kMaxPushedTextureDescriptorSetBindings;
+  }
   // The returned reference is valid until a cache clear.
   VkDescriptorSetLayout GetTextureDescriptorSetLayout(bool is_vertex,
                                                       size_t texture_count,
@@ -239,6 +286,11 @@ class VulkanCommandProcessor final : public CommandProcessor {
   const VulkanPipelineCache::PipelineLayoutProvider* GetPipelineLayout(
       size_t texture_count_pixel, size_t sampler_count_pixel,
       size_t texture_count_vertex, size_t sampler_count_vertex);
+  // Returns the pipeline, possibly created on the pipeline creation threads, by
+  // a handle obtained from VulkanPipelineCache::ConfigurePipeline.
+  VkPipeline GetVulkanPipelineByHandle(void* handle) const {
+    return pipeline_cache_->GetVulkanPipelineByHandle(handle);
+  }
 
   // Returns a single temporary GPU-side buffer within a submission for tasks
   // like texture untiling and resolving. May push a buffer memory barrier into
@@ -279,6 +331,10 @@ class VulkanCommandProcessor final : public CommandProcessor {
   void IssueSwap(uint32_t frontbuffer_ptr, uint32_t frontbuffer_width,
                  uint32_t frontbuffer_height) override;
 
+  uint64_t GetTextureLoadCount() const override {
+    return texture_cache_ ? texture_cache_->texture_load_count() : 0;
+  }
+
   Shader* LoadShader(xenos::ShaderType shader_type, uint32_t guest_address,
                      const uint32_t* host_address,
                      uint32_t dword_count) override;
@@ -421,6 +477,10 @@ class VulkanCommandProcessor final : public CommandProcessor {
   // the submission to await to simply check status, or pass
   // GetCurrentSubmission() to wait for all queue operations to be completed.
   void CheckSubmissionFenceAndDeviceLoss(uint64_t await_submission);
+  int64_t GetGpuTimestampPhaseMicroseconds(GpuTimestampPhase phase) const {
+    return int64_t(double(gpu_timestamp_phase_ticks_[size_t(phase)]) *
+                   gpu_timestamp_period_ns_ * 0.001);
+  }
   // If is_guest_command is true, a new full frame - with full cleanup of
   // resources and, if needed, starting capturing - is opened if pending (as
   // opposed to simply resuming after mid-frame synchronization). Returns
@@ -432,9 +492,28 @@ class VulkanCommandProcessor final : public CommandProcessor {
   bool EndSubmission(bool is_swap);
   bool AwaitAllQueueOperationsCompletion() {
     CheckSubmissionFenceAndDeviceLoss(GetCurrentSubmission());
-    return !submission_open_ && submissions_in_flight_fences_.empty();
+    return !submission_open_ &&
+           submission_completed_ + 1 >= submission_current_;
   }
 
+  // Executes the deferred command buffer into the Vulkan command buffer and
+  // submits it, can be called from the submission thread. Returns the result
+  // of the failed operation, or VK_SUCCESS.
+  VkResult RecordAndSubmitCommandBuffer(
+      DeferredCommandBuffer& deferred_command_buffer,
+      const CommandBuffer& command_buffer, VkFence fence, uint64_t submission,
+      uint32_t wait_semaphore_count, const VkSemaphore* wait_semaphores,
+      const VkPipelineStageFlags* wait_stage_masks);
+  // Submits the command buffers in submit_info (may have none) to the graphics
+  // queue, signaling the completion of the submission via the fence or the
+  // timeline semaphore, whichever is used.
+  VkResult SubmitToQueue(VkSubmitInfo& submit_info, VkFence fence,
+                         uint64_t submission);
+  void SubmissionThread();
+  // Waits until all the submissions handed over to the submission thread are
+  // in the queue.
+  void AwaitSubmissionThreadIdle();
+
   void ClearTransientDescriptorPools();
 
   void SplitPendingBarrier();
@@ -477,19 +556,97 @@ class VulkanCommandProcessor final : public CommandProcessor {
   VkPipelineStageFlags guest_shader_pipeline_stages_ = 0;
   VkShaderStageFlags guest_shader_vertex_stages_ = 0;
 
+  // If VK_KHR_timeline_semaphore is supported, the completion of submissions is
+  // tracked via the values of a single timeline semaphore (equal to the index
+  // of the last completed submission) rather than via a fence per submission.
+  VkSemaphore submission_timeline_semaphore_ = VK_NULL_HANDLE;
   std::vector<VkFence> fences_free_;
   std::vector<VkSemaphore> semaphores_free_;
 
   bool submission_open_ = false;
+  uint64_t submission_current_ = 1;
   uint64_t submission_completed_ = 0;
   // In case vkQueueSubmit fails after something like a successful
   // vkQueueBindSparse, to wait correctly on the next attempt.
   std::vector<VkSemaphore> current_submission_wait_semaphores_;
   std::vector<VkPipelineStageFlags> current_submission_wait_stage_masks_;
+  // Only used if submission_timeline_semaphore_ is VK_NULL_HANDLE.
   std::vector<VkFence> submissions_in_flight_fences_;
   std::deque<std::pair<uint64_t, VkSemaphore>>
       submissions_in_flight_semaphores_;
 
+  // Host occlusion queries for the draws within guest occlusion queries - one
+  // per draw since a guest query may span multiple render passes. The results
+  // are read when the submission is completed, without waiting.
+  static constexpr uint32_t kOcclusionQueryPoolSize = 1024;
+  struct OcclusionQueryPool {
+    VkQueryPool pool = VK_NULL_HANDLE;
+    uint64_t submission = 0;
+    // The guest query index and sample count address for each used query.
+    std::vector<std::pair<uint64_t, uint32_t>> guest_queries;
+  };
+  std::vector<VkQueryPool> occlusion_query_pools_free_;
+  // VK_NULL_HANDLE pool if no queries have been used in the current submission
+  // yet.
+  OcclusionQueryPool occlusion_query_pool_current_;
+  std::deque<OcclusionQueryPool> occlusion_query_pools_submitted_;
+  std::vector<uint64_t> occlusion_query_results_temp_;
+
+  // A timestamp is written at the beginning and the end of every submission
+  // and at every phase change in between - one pool per submission. If the
+  // pool is full, further phase changes in the submission are ignored.
+  static constexpr uint32_t kGpuTimestampQueryPoolSize = 256;
+  struct GpuTimestampQueryPool {
+    VkQueryPool pool = VK_NULL_HANDLE;
+    uint64_t submission = 0;
+    bool is_closing_frame = false;
+    // The phase starting at each written timestamp, kCount for the end.
+    std::vector<GpuTimestampPhase> phases;
+  };
+  // Zero if GPU timestamps are disabled or not supported.
+  float gpu_timestamp_period_ns_ = 0.0f;
+  std::vector<VkQueryPool> gpu_timestamp_query_pools_free_;
+  // VK_NULL_HANDLE pool if not measuring the current submission.
+  GpuTimestampQueryPool gpu_timestamp_query_pool_current_;
+  std::deque<GpuTimestampQueryPool> gpu_timestamp_query_pools_submitted_;
+  std::vector<uint64_t> gpu_timestamp_results_temp_;
+  // Accumulated for the frame being completed.
+  uint64_t gpu_timestamp_phase_ticks_[size_t(GpuTimestampPhase::kCount)] = {};
+
+  // Recording of the Vulkan command buffers from the deferred command buffers
+  // and submitting them, done on a separate thread so the processing of the
+  // ring buffer (which only writes the deferred command buffers) doesn't have
+  // to wait for the driver. The submission index and the fence are assigned on
+  // the processor thread, so submission tracking works the same, but the fence
+  // may not be in the queue yet until the thread is awaited.
+  struct SubmissionThreadRequest {
+    explicit SubmissionThreadRequest(
+        const VulkanCommandProcessor& command_processor)
+        : deferred_command_buffer(command_processor) {}
+    DeferredCommandBuffer deferred_command_buffer;
+    CommandBuffer command_buffer;
+    VkFence fence;
+    uint64_t submission;
+    std::vector<VkSemaphore> wait_semaphores;
+    std::vector<VkPipelineStageFlags> wait_stage_masks;
+  };
+  std::unique_ptr<xe::threading::Thread> submission_thread_;
+  std::mutex submission_thread_mutex_;
+  // Notified when a request is added or shutdown is requested.
+  std::condition_variable submission_thread_request_cond_;
+  // Notified when submission_thread_pending_count_ becomes zero.
+  std::condition_variable submission_thread_idle_cond_;
+  // Protected with submission_thread_mutex_.
+  std::deque<std::unique_ptr<SubmissionThreadRequest>>
+      submission_thread_queue_;
+  std::vector<std::unique_ptr<SubmissionThreadRequest>>
+      submission_thread_requests_free_;
+  // Requests queued or being processed.
+  size_t submission_thread_pending_count_ = 0;
+  bool submission_thread_shutdown_ = false;
+  // Set on the submission thread, handled on the processor thread.
+  std::atomic<bool> submission_thread_device_lost_{false};
+
   static constexpr uint32_t kMaxFramesInFlight = 3;
   bool frame_open_ = false;
   // Guest frame index, since some transient resources can be reused across
@@ -533,6 +690,11 @@ class VulkanCommandProcessor final : public CommandProcessor {
   VkDescriptorSetLayout descriptor_set_layout_shared_memory_and_edram_ =
       VK_NULL_HANDLE;
 
+  // Whether the pixel shader texture descriptor set (the last one, thus the
+  // only one that can be a push descriptor set) is pushed via
+  // VK_KHR_push_descriptor instead of being allocated and written for every
+  // draw, if it has few enough bindings.
+  bool texture_descriptor_set_pixel_pushed_ = false;
   // Descriptor set layouts are referenced by pipeline_layouts_.
   std::unordered_map<TextureDescriptorSetLayoutKey, VkDescriptorSetLayout,
                      TextureDescriptorSetLayoutKey::Hasher>
@@ -661,6 +823,14 @@ class VulkanCommandProcessor final : public CommandProcessor {
   // declared as dynamic in the pipeline) invalidates such dynamic state.
   VkViewport dynamic_viewport_;
   VkRect2D dynamic_scissor_;
+
+  // State derived from the registers, updated when the registers are written
+  // (tracked via the dirty groups of the register file).
+  reg::RB_DEPTHCONTROL last_normalized_depth_control_ = {};
+  draw_util::ViewportInfo last_viewport_info_ = {};
+  reg::RB_DEPTHCONTROL last_viewport_normalized_depth_control_ = {};
+  bool last_viewport_pixel_shader_writes_depth_ = false;
+  draw_util::Scissor last_scissor_ = {};
   // Dynamic fixed-function depth bias, blend constants, stencil state are
   // applicable only to the render target implementations where they are
   // actually involved.
@@ -703,12 +873,17 @@ class VulkanCommandProcessor final : public CommandProcessor {
   // Currently bound graphics pipeline, either from the pipeline cache (with
   // potentially deferred creation - current_external_graphics_pipeline_ is
   // VK_NULL_HANDLE in this case) or a non-Xenos one
-  // (current_guest_graphics_pipeline_ is VK_NULL_HANDLE in this case).
-  // TODO(Triang3l): Change to a deferred compilation handle.
-  VkPipeline current_guest_graphics_pipeline_;
+  // (current_guest_graphics_pipeline_ is nullptr in this case).
+  void* current_guest_graphics_pipeline_;
   VkPipeline current_external_graphics_pipeline_;
   VkPipeline current_external_compute_pipeline_;
 
+  // Currently bound index buffer, to skip rebinding it for consecutive draws,
+  // so they can be merged.
+  VkBuffer current_index_buffer_;
+  VkDeviceSize current_index_buffer_offset_;
+  VkIndexType current_index_type_;
+
   // Pipeline layout of the current guest graphics pipeline.
   const PipelineLayout* current_guest_graphics_pipeline_layout_;
   VkDescriptorBufferInfo current_constant_buffer_infos_
@@ -11,22 +11,34 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cstdint>
 #include <cstring>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <tuple>
 #include <utility>
 #include <vector>
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/assert.h"
+#include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/memory.h"
 #include "xenia/base/profiling.h"
+#include "xenia/base/string_buffer.h"
 #include "xenia/base/xxhash.h"
 #include "xenia/gpu/draw_util.h"
 #include "xenia/gpu/gpu_flags.h"
 #include "xenia/gpu/register_file.h"
 #include "xenia/gpu/registers.h"
+#include "xenia/gpu/shader_storage_import.h"
 #include "xenia/gpu/spirv_builder.h"
 #include "xenia/gpu/spirv_shader_translator.h"
 #include "xenia/gpu/vulkan/vulkan_command_processor.h"
@@ -34,6 +46,37 @@
 #include "xenia/gpu/xenos.h"
 #include "xenia/ui/vulkan/vulkan_util.h"
 
+DEFINE_int32(
+    vulkan_pipeline_creation_threads, -1,
+    "Number of threads used for graphics pipeline creation and guest shader "
+    "translation. -1 to calculate "
+    "automatically (75% of logical CPU cores), a positive number to specify "
+    "the number of threads explicitly (up to the number of logical CPU cores), "
+    "0 to disable multithreaded pipeline creation.",
+    "Vulkan");
+DEFINE_bool(
+    vulkan_skip_draws_with_pending_pipelines, false,
+    "Skip draws whose shaders or graphics pipelines are still being translated "
+    "or created on the creation threads instead of waiting for them. Reduces "
+    "stuttering when new shaders and pipelines are encountered, at the cost of "
+    "objects missing for a few frames.",
+    "Vulkan");
+DEFINE_bool(
+    vulkan_spirv_optimize, false,
+    "Optimize the translated SPIR-V shaders with SPIRV-Tools (loaded from the "
+    "Vulkan SDK pointed to by the VULKAN_SDK environment variable) before "
+    "passing them to the driver. Makes translation slower, but may reduce the "
+    "pipeline creation time and improve the GPU performance of the shaders.",
+    "Vulkan");
+DEFINE_bool(
+    vulkan_pipeline_libraries, true,
+    "Use VK_EXT_graphics_pipeline_library, if supported, to quickly link new "
+    "graphics pipelines on the creation threads from separately compiled and "
+    "reused parts, with the pipelines linked with link-time optimizations "
+    "replacing them when they're ready. Requires multithreaded pipeline "
+    "creation.",
+    "Vulkan");
+
 namespace xe {
 namespace gpu {
 namespace vulkan {
@@ -64,6 +107,19 @@ bool VulkanPipelineCache::Initialize() {
       render_target_cache_.msaa_2x_no_attachments_supported(),
       edram_fragment_shader_interlock);
 
+  if (cvars::vulkan_spirv_optimize) {
+    if (spirv_tools_context_.Initialize(
+            SpirvShaderTranslator::Features(provider).spirv_version)) {
+      if (!spirv_tools_context_.IsOptimizerAvailable()) {
+        spirv_tools_context_.Shutdown();
+      }
+    } else {
+      XELOGW(
+          "VulkanPipelineCache: Failed to initialize SPIRV-Tools, translated "
+          "shaders will not be optimized");
+    }
+  }
+
   if (edram_fragment_shader_interlock) {
     std::vector<uint8_t> depth_only_fragment_shader_code =
         shader_translator_->CreateDepthOnlyFragmentShader();
@@ -81,6 +137,55 @@ bool VulkanPipelineCache::Initialize() {
     }
   }
 
+  // Initialize creation thread synchronization data even if not using creation
+  // threads because they may be used anyway to create pipelines from the
+  // storage.
+  creation_threads_busy_ = 0;
+  creation_completion_event_ =
+      xe::threading::Event::CreateManualResetEvent(true);
+  assert_not_null(creation_completion_event_);
+  creation_completion_set_event_ = false;
+  creation_threads_shutdown_from_ = SIZE_MAX;
+  if (cvars::vulkan_pipeline_creation_threads != 0) {
+    uint32_t logical_processor_count = xe::threading::logical_processor_count();
+    if (!logical_processor_count) {
+      // Pick some reasonable amount if couldn't determine the number of cores.
+      logical_processor_count = 6;
+    }
+    size_t creation_thread_count;
+    if (cvars::vulkan_pipeline_creation_threads < 0) {
+      creation_thread_count =
+          std::max(logical_processor_count * 3 / 4, uint32_t(1));
+    } else {
+      creation_thread_count =
+          std::min(uint32_t(cvars::vulkan_pipeline_creation_threads),
+                   logical_processor_count);
+    }
+    for (size_t i = 0; i < creation_thread_count; ++i) {
+      std::unique_ptr<xe::threading::Thread> creation_thread =
+          xe::threading::Thread::Create({}, [this, i]() { CreationThread(i); });
+      assert_not_null(creation_thread);
+      creation_thread->set_name("Vulkan Pipelines");
+      creation_threads_.push_back(std::move(creation_thread));
+    }
+  }
+
+  // Linking the optimized pipelines from the libraries is done in the
+  // background, so only use the libraries with the creation threads. Also, the
+  // SPIR-V shaders don't guarantee matching interpolation decorations between
+  // the stages.
+  const VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT&
+      graphics_pipeline_library_properties =
+          provider.device_graphics_pipeline_library_properties();
+  pipeline_libraries_used_ =
+      cvars::vulkan_pipeline_libraries && !creation_threads_.empty() &&
+      provider.device_extensions().ext_graphics_pipeline_library &&
+      provider.device_graphics_pipeline_library_features()
+          .graphicsPipelineLibrary &&
+      graphics_pipeline_library_properties.graphicsPipelineLibraryFastLinking &&
+      graphics_pipeline_library_properties
+          .graphicsPipelineLibraryIndependentInterpolationDecoration;
+
   return true;
 }
 
@@ -90,14 +195,53 @@ void VulkanPipelineCache::Shutdown() {
   const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
   VkDevice device = provider.device();
 
+  // Shut down all threads, before destroying the pipelines since they may be
+  // creating them.
+  if (!creation_threads_.empty()) {
+    {
+      std::lock_guard<xe_mutex> lock(creation_request_lock_);
+      creation_threads_shutdown_from_ = 0;
+    }
+    creation_request_cond_.notify_all();
+    for (size_t i = 0; i < creation_threads_.size(); ++i) {
+      xe::threading::Wait(creation_threads_[i].get(), false);
+    }
+    creation_threads_.clear();
+  }
+  creation_queue_.clear();
+  creation_optimized_link_queue_.clear();
+  creation_translation_queue_.clear();
+  creation_analysis_queue_.clear();
+  creation_completion_event_.reset();
+
+  // Shut down the persistent shader / pipeline storage.
+  ShutdownShaderStorage();
+
   // Destroy all pipelines.
   last_pipeline_ = nullptr;
   for (const auto& pipeline_pair : pipelines_) {
-    if (pipeline_pair.second.pipeline != VK_NULL_HANDLE) {
-      dfn.vkDestroyPipeline(device, pipeline_pair.second.pipeline, nullptr);
+    VkPipeline pipeline =
+        pipeline_pair.second.pipeline.load(std::memory_order_relaxed);
+    if (pipeline != VK_NULL_HANDLE) {
+      dfn.vkDestroyPipeline(device, pipeline, nullptr);
+    }
+    VkPipeline fast_linked_pipeline = pipeline_pair.second.fast_linked_pipeline;
+    if (fast_linked_pipeline != VK_NULL_HANDLE &&
+        fast_linked_pipeline != pipeline) {
+      dfn.vkDestroyPipeline(device, fast_linked_pipeline, nullptr);
     }
   }
   pipelines_.clear();
+  auto destroy_pipeline_libraries = [&](auto& libraries) {
+    for (const auto& library_pair : libraries) {
+      dfn.vkDestroyPipeline(device, library_pair.second, nullptr);
+    }
+    libraries.clear();
+  };
+  destroy_pipeline_libraries(pipeline_vertex_input_libraries_);
+  destroy_pipeline_libraries(pipeline_pre_rasterization_libraries_);
+  destroy_pipeline_libraries(pipeline_fragment_shader_libraries_);
+  destroy_pipeline_libraries(pipeline_fragment_output_libraries_);
 
   // Destroy all internal shaders.
   ui::vulkan::util::DestroyAndNullHandle(dfn.vkDestroyShaderModule, device,
@@ -116,9 +260,781 @@ void VulkanPipelineCache::Shutdown() {
   shaders_.clear();
   texture_binding_layout_map_.clear();
   texture_binding_layouts_.clear();
+  shader_storage_index_ = 0;
 
   // Shut down shader translation.
   shader_translator_.reset();
+
+  spirv_tools_context_.Shutdown();
+}
+
+void VulkanPipelineCache::InitializeShaderStorage(
+    const std::filesystem::path& cache_root, uint32_t title_id, bool blocking) {
+  ShutdownShaderStorage();
+
+  // The pipelines from the storage are always created before returning to
+  // drop the ones that have failed to be created, so blocking doesn't matter.
+
+  auto shader_storage_root = cache_root / "shaders";
+  auto shader_storage_shareable_root = shader_storage_root / "shareable";
+  if (!std::filesystem::exists(shader_storage_shareable_root)) {
+    if (!std::filesystem::create_directories(shader_storage_shareable_root)) {
+      XELOGE(
+          "Failed to create the shareable shader storage directory, persistent "
+          "shader storage will be disabled: {}",
+          xe::path_to_utf8(shader_storage_shareable_root));
+      return;
+    }
+  }
+
+  const ui::vulkan::VulkanProvider& provider =
+      command_processor_.GetVulkanProvider();
+  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+  VkDevice device = provider.device();
+  bool edram_fragment_shader_interlock =
+      render_target_cache_.GetPath() ==
+      RenderTargetCache::Path::kPixelShaderInterlock;
+
+  // Create the driver pipeline cache, with the data from the previous runs on
+  // the same device and driver version if available. The data is specific to
+  // the device, so it's not placed in the shareable directory.
+  {
+    const VkPhysicalDeviceProperties& device_properties =
+        provider.device_properties();
+    auto shader_storage_local_root = shader_storage_root / "local";
+    if (std::filesystem::exists(shader_storage_local_root) ||
+        std::filesystem::create_directories(shader_storage_local_root)) {
+      vulkan_pipeline_cache_file_path_ =
+          shader_storage_local_root /
+          fmt::format("{:08X}.{:04X}_{:04X}_{:08X}.vulkan.vkpc", title_id,
+                      device_properties.vendorID, device_properties.deviceID,
+                      device_properties.driverVersion);
+      ImportStorageBlob(
+          shader_storage_root,
+          std::filesystem::path("local") /
+              vulkan_pipeline_cache_file_path_.filename());
+    } else {
+      XELOGW(
+          "Failed to create the local shader storage directory, the Vulkan "
+          "pipeline cache will not be stored: {}",
+          xe::path_to_utf8(shader_storage_local_root));
+      vulkan_pipeline_cache_file_path_.clear();
+    }
+    std::vector<uint8_t> vulkan_pipeline_cache_data;
+    if (!vulkan_pipeline_cache_file_path_.empty()) {
+      FILE* vulkan_pipeline_cache_file =
+          xe::filesystem::OpenFile(vulkan_pipeline_cache_file_path_, "rb");
+      if (vulkan_pipeline_cache_file) {
+        if (xe::filesystem::Seek(vulkan_pipeline_cache_file, 0, SEEK_END)) {
+          int64_t vulkan_pipeline_cache_file_size =
+              xe::filesystem::Tell(vulkan_pipeline_cache_file);
+          if (vulkan_pipeline_cache_file_size > 0 &&
+              xe::filesystem::Seek(vulkan_pipeline_cache_file, 0, SEEK_SET)) {
+            vulkan_pipeline_cache_data.resize(
+                size_t(vulkan_pipeline_cache_file_size));
+            vulkan_pipeline_cache_data.resize(fread(
+                vulkan_pipeline_cache_data.data(), 1,
+                vulkan_pipeline_cache_data.size(), vulkan_pipeline_cache_file));
+          }
+        }
+        fclose(vulkan_pipeline_cache_file);
+      }
+    }
+    // Validate the header (VkPipelineCacheHeaderVersionOne) here as well, not
+    // all drivers handle data from a different device gracefully.
+    // Header size, version, vendor ID, device ID.
+    uint32_t vulkan_pipeline_cache_header[4];
+    if (vulkan_pipeline_cache_data.size() >=
+        sizeof(vulkan_pipeline_cache_header) + VK_UUID_SIZE) {
+      std::memcpy(vulkan_pipeline_cache_header,
+                  vulkan_pipeline_cache_data.data(),
+                  sizeof(vulkan_pipeline_cache_header));
+      if (vulkan_pipeline_cache_header[0] <
+              sizeof(vulkan_pipeline_cache_header) + VK_UUID_SIZE ||
+          vulkan_pipeline_cache_header[1] !=
+              VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+          vulkan_pipeline_cache_header[2] != device_properties.vendorID ||
+          vulkan_pipeline_cache_header[3] != device_properties.deviceID ||
+          std::memcmp(vulkan_pipeline_cache_data.data() +
+                          sizeof(vulkan_pipeline_cache_header),
+                      device_properties.pipelineCacheUUID, VK_UUID_SIZE)) {
+        vulkan_pipeline_cache_data.clear();
+      }
+    } else {
+      vulkan_pipeline_cache_data.clear();
+    }
+    VkPipelineCacheCreateInfo pipeline_cache_create_info;
+    pipeline_cache_create_info.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    pipeline_cache_create_info.pNext = nullptr;
+    pipeline_cache_create_info.flags = 0;
+    pipeline_cache_create_info.initialDataSize =
+        vulkan_pipeline_cache_data.size();
+    pipeline_cache_create_info.pInitialData = vulkan_pipeline_cache_data.data();
+    if (dfn.vkCreatePipelineCache(device, &pipeline_cache_create_info, nullptr,
+                                  &vulkan_pipeline_cache_) != VK_SUCCESS) {
+      vulkan_pipeline_cache_ = VK_NULL_HANDLE;
+      if (!vulkan_pipeline_cache_data.empty()) {
+        XELOGW(
+            "Failed to create the Vulkan pipeline cache from the stored data, "
+            "discarding it");
+        vulkan_pipeline_cache_data.clear();
+        pipeline_cache_create_info.initialDataSize = 0;
+        pipeline_cache_create_info.pInitialData = nullptr;
+        if (dfn.vkCreatePipelineCache(device, &pipeline_cache_create_info,
+                                      nullptr,
+                                      &vulkan_pipeline_cache_) != VK_SUCCESS) {
+          vulkan_pipeline_cache_ = VK_NULL_HANDLE;
+        }
+      }
+    }
+    if (vulkan_pipeline_cache_ == VK_NULL_HANDLE) {
+      XELOGE("Failed to create the Vulkan pipeline cache");
+    } else if (!vulkan_pipeline_cache_data.empty()) {
+      XELOGGPU("Loaded {} bytes of the Vulkan pipeline cache data",
+               vulkan_pipeline_cache_data.size());
+    }
+    vulkan_pipeline_cache_written_size_ = vulkan_pipeline_cache_data.size();
+    vulkan_pipeline_cache_write_host_tick_ = xe::Clock::QueryHostTickCount();
+  }
+
+  // Initialize the pipeline storage stream - read pipeline descriptions and
+  // collect used shader modifications to translate.
+  std::vector<PipelineStoredDescription> pipeline_stored_descriptions;
+  // <Shader hash, modification bits>.
+  std::set<std::pair<uint64_t, uint64_t>> shader_translations_needed;
+  auto pipeline_storage_file_name =
+      fmt::format("{:08X}.{}.vulkan.xpso", title_id,
+                  edram_fragment_shader_interlock ? "fsi" : "rtv");
+  auto pipeline_storage_file_path =
+      shader_storage_shareable_root / pipeline_storage_file_name;
+  // 'XEPS'.
+  const uint32_t pipeline_storage_magic = 0x53504558;
+  // 'VKFS' or 'VKRT'.
+  const uint32_t pipeline_storage_magic_api =
+      edram_fragment_shader_interlock ? 0x53464B56 : 0x54524B56;
+  const uint32_t pipeline_storage_version_swapped =
+      xe::byte_swap(std::max(PipelineDescription::kVersion,
+                             SpirvShaderTranslator::Modification::kVersion));
+  {
+    const uint32_t pipeline_storage_import_header[] = {
+        pipeline_storage_magic, pipeline_storage_magic_api,
+        pipeline_storage_version_swapped};
+    ImportStorageRecords(
+        shader_storage_root,
+        std::filesystem::path("shareable") / pipeline_storage_file_name,
+        pipeline_storage_import_header, sizeof(pipeline_storage_import_header),
+        [](const uint8_t* data, size_t data_size) -> size_t {
+          PipelineStoredDescription pipeline_stored_description;
+          if (data_size < sizeof(pipeline_stored_description)) {
+            return 0;
+          }
+          std::memcpy(&pipeline_stored_description, data,
+                      sizeof(pipeline_stored_description));
+          if (pipeline_stored_description.description.GetHash() !=
+              pipeline_stored_description.description_hash) {
+            return 0;
+          }
+          return sizeof(pipeline_stored_description);
+        });
+  }
+  pipeline_storage_file_ =
+      xe::filesystem::OpenFile(pipeline_storage_file_path, "a+b");
+  if (!pipeline_storage_file_) {
+    XELOGE(
+        "Failed to open the Vulkan pipeline description storage file for "
+        "writing, persistent shader storage will be disabled: {}",
+        xe::path_to_utf8(pipeline_storage_file_path));
+    return;
+  }
+  pipeline_storage_file_flush_needed_ = false;
+  struct {
+    uint32_t magic;
+    uint32_t magic_api;
+    uint32_t version_swapped;
+  } pipeline_storage_file_header;
+  // Other emulator instances may be appending to the same file - validate and
+  // truncate it with them locked out, and before creating the pipelines so
+  // descriptions appended by them meanwhile aren't dropped.
+  xe::filesystem::LockStdioFile(pipeline_storage_file_, true);
+  if (fread(&pipeline_storage_file_header, sizeof(pipeline_storage_file_header),
+            1, pipeline_storage_file_) &&
+      pipeline_storage_file_header.magic == pipeline_storage_magic &&
+      pipeline_storage_file_header.magic_api == pipeline_storage_magic_api &&
+      pipeline_storage_file_header.version_swapped ==
+          pipeline_storage_version_swapped) {
+    xe::filesystem::Seek(pipeline_storage_file_, 0, SEEK_END);
+    int64_t pipeline_storage_told_end =
+        xe::filesystem::Tell(pipeline_storage_file_);
+    size_t pipeline_storage_told_count =
+        size_t(pipeline_storage_told_end >=
+                       int64_t(sizeof(pipeline_storage_file_header))
+                   ? (uint64_t(pipeline_storage_told_end) -
+                      sizeof(pipeline_storage_file_header)) /
+                         sizeof(PipelineStoredDescription)
+                   : 0);
+    if (pipeline_storage_told_count &&
+        xe::filesystem::Seek(pipeline_storage_file_,
+                             int64_t(sizeof(pipeline_storage_file_header)),
+                             SEEK_SET)) {
+      pipeline_stored_descriptions.resize(pipeline_storage_told_count);
+      pipeline_stored_descriptions.resize(
+          fread(pipeline_stored_descriptions.data(),
+                sizeof(PipelineStoredDescription), pipeline_storage_told_count,
+                pipeline_storage_file_));
+      size_t pipeline_storage_read_count = pipeline_stored_descriptions.size();
+      for (size_t i = 0; i < pipeline_storage_read_count; ++i) {
+        const PipelineStoredDescription& pipeline_stored_description =
+            pipeline_stored_descriptions[i];
+        // Validate file integrity, stop and truncate the stream if data is
+        // corrupted.
+        if (pipeline_stored_description.description.GetHash() !=
+            pipeline_stored_description.description_hash) {
+          pipeline_stored_descriptions.resize(i);
+          break;
+        }
+        // Keep the pipelines requiring unsupported device features in the file
+        // so it stays shareable across devices, but don't translate shaders
+        // only used by them.
+        if (!ArePipelineRequirementsMet(
+                pipeline_stored_description.description)) {
+          continue;
+        }
+        // Mark the shader modifications as needed for translation.
+        shader_translations_needed.emplace(
+            pipeline_stored_description.description.vertex_shader_hash,
+            pipeline_stored_description.description.vertex_shader_modification);
+        if (pipeline_stored_description.description.pixel_shader_hash) {
+          shader_translations_needed.emplace(
+              pipeline_stored_description.description.pixel_shader_hash,
+              pipeline_stored_description.description
+                  .pixel_shader_modification);
+        }
+      }
+    }
+  }
+  if (!pipeline_stored_descriptions.empty()) {
+    // If any pipeline descriptions were corrupted (or the whole file has
+    // excess bytes in the end), truncate to the last valid pipeline
+    // description.
+    xe::filesystem::TruncateStdioFile(
+        pipeline_storage_file_,
+        uint64_t(sizeof(pipeline_storage_file_header) +
+                 sizeof(PipelineStoredDescription) *
+                     pipeline_stored_descriptions.size()));
+  } else {
+    xe::filesystem::TruncateStdioFile(pipeline_storage_file_, 0);
+    pipeline_storage_file_header.magic = pipeline_storage_magic;
+    pipeline_storage_file_header.magic_api = pipeline_storage_magic_api;
+    pipeline_storage_file_header.version_swapped =
+        pipeline_storage_version_swapped;
+    fwrite(&pipeline_storage_file_header, sizeof(pipeline_storage_file_header),
+           1, pipeline_storage_file_);
+  }
+  fflush(pipeline_storage_file_);
+  xe::filesystem::UnlockStdioFile(pipeline_storage_file_);
+
+  size_t logical_processor_count = xe::threading::logical_processor_count();
+  if (!logical_processor_count) {
+    // Pick some reasonable amount if couldn't determine the number of cores.
+    logical_processor_count = 6;
+  }
+
+  // Initialize the Xenos shader storage stream, shared with the Direct3D 12
+  // implementation.
+  uint64_t shader_storage_initialization_start =
+      xe::Clock::QueryHostTickCount();
+  auto shader_storage_file_path =
+      shader_storage_shareable_root / fmt::format("{:08X}.xsh", title_id);
+  // 'XESH'.
+  const uint32_t shader_storage_magic = 0x48534558;
+  {
+    const uint32_t shader_storage_import_header[] = {
+        shader_storage_magic, xe::byte_swap(ShaderStoredHeader::kVersion)};
+    ImportStorageRecords(
+        shader_storage_root,
+        std::filesystem::path("shareable") /
+            shader_storage_file_path.filename(),
+        shader_storage_import_header, sizeof(shader_storage_import_header),
+        [](const uint8_t* data, size_t data_size) -> size_t {
+          ShaderStoredHeader shader_header;
+          if (data_size < sizeof(shader_header)) {
+            return 0;
+          }
+          std::memcpy(&shader_header, data, sizeof(shader_header));
+          size_t ucode_byte_count =
+              shader_header.ucode_dword_count * sizeof(uint32_t);
+          if (data_size - sizeof(shader_header) < ucode_byte_count ||
+              XXH3_64bits(data + sizeof(shader_header), ucode_byte_count) !=
+                  shader_header.ucode_data_hash) {
+            return 0;
+          }
+          return sizeof(shader_header) + ucode_byte_count;
+        });
+  }
+  shader_storage_file_ =
+      xe::filesystem::OpenFile(shader_storage_file_path, "a+b");
+  if (!shader_storage_file_) {
+    XELOGE(
+        "Failed to open the guest shader storage file for writing, persistent "
+        "shader storage will be disabled: {}",
+        xe::path_to_utf8(shader_storage_file_path));
+    fclose(pipeline_storage_file_);
+    pipeline_storage_file_ = nullptr;
+    return;
+  }
+  ++shader_storage_index_;
+  shader_storage_file_flush_needed_ = false;
+  struct {
+    uint32_t magic;
+    uint32_t version_swapped;
+  } shader_storage_file_header;
+  // Other emulator instances append with the file locked exclusively, so no
+  // partially written shaders are read.
+  xe::filesystem::LockStdioFile(shader_storage_file_, false);
+  if (fread(&shader_storage_file_header, sizeof(shader_storage_file_header), 1,
+            shader_storage_file_) &&
+      shader_storage_file_header.magic == shader_storage_magic &&
+      xe::byte_swap(shader_storage_file_header.version_swapped) ==
+          ShaderStoredHeader::kVersion) {
+    uint64_t shader_storage_valid_bytes = sizeof(shader_storage_file_header);
+    // Load and translate shaders written by previous Xenia executions until the
+    // end of the file or until a corrupted one is detected.
+    ShaderStoredHeader shader_header;
+    std::vector<uint32_t> ucode_dwords;
+    ucode_dwords.reserve(0xFFFF);
+    size_t shaders_translated = 0;
+
+    // Threads overlapping file reading.
+    std::mutex shaders_translation_thread_mutex;
+    std::condition_variable shaders_translation_thread_cond;
+    std::deque<VulkanShader*> shaders_to_translate;
+    size_t shader_translation_threads_busy = 0;
+    bool shader_translation_threads_shutdown = false;
+    std::mutex shaders_failed_to_translate_mutex;
+    std::vector<VulkanShader::VulkanTranslation*> shaders_failed_to_translate;
+    auto shader_translation_thread_function = [&]() {
+      StringBuffer ucode_disasm_buffer;
+      SpirvShaderTranslator translator(
+          SpirvShaderTranslator::Features(provider),
+          render_target_cache_.msaa_2x_attachments_supported(),
+          render_target_cache_.msaa_2x_no_attachments_supported(),
+          edram_fragment_shader_interlock);
+      for (;;) {
+        VulkanShader* shader_to_translate;
+        for (;;) {
+          std::unique_lock<std::mutex> lock(shaders_translation_thread_mutex);
+          if (shaders_to_translate.empty()) {
+            if (shader_translation_threads_shutdown) {
+              return;
+            }
+            shaders_translation_thread_cond.wait(lock);
+            continue;
+          }
+          shader_to_translate = shaders_to_translate.front();
+          shaders_to_translate.pop_front();
+          ++shader_translation_threads_busy;
+          break;
+        }
+        if (!shader_to_translate->is_ucode_analyzed()) {
+          shader_to_translate->AnalyzeUcodeOnce(ucode_disasm_buffer);
+        }
+        // Translate each needed modification on this thread after performing
+        // modification-independent analysis of the whole shader.
+        uint64_t ucode_data_hash = shader_to_translate->ucode_data_hash();
+        for (auto modification_it = shader_translations_needed.lower_bound(
+                 std::make_pair(ucode_data_hash, uint64_t(0)));
+             modification_it != shader_translations_needed.end() &&
+             modification_it->first == ucode_data_hash;
+             ++modification_it) {
+          VulkanShader::VulkanTranslation* translation =
+              static_cast<VulkanShader::VulkanTranslation*>(
+                  shader_to_translate->GetOrCreateTranslation(
+                      modification_it->second));
+          // Only try (and delete in case of failure) if it's a new translation.
+          // If it's a shader previously encountered in the game, translation of
+          // which has failed, and the shader storage is loaded later, keep it
+          // this way not to try to translate it again.
+          if (!translation->is_translated() &&
+              !TranslateAnalyzedShader(translator, *translation)) {
+            std::lock_guard<std::mutex> lock(shaders_failed_to_translate_mutex);
+            shaders_failed_to_translate.push_back(translation);
+          }
+        }
+        {
+          std::lock_guard<std::mutex> lock(shaders_translation_thread_mutex);
+          --shader_translation_threads_busy;
+        }
+      }
+    };
+    std::vector<std::unique_ptr<xe::threading::Thread>>
+        shader_translation_threads;
+
+    while (true) {
+      if (!fread(&shader_header, sizeof(shader_header), 1,
+                 shader_storage_file_)) {
+        break;
+      }
+      size_t ucode_byte_count =
+          shader_header.ucode_dword_count * sizeof(uint32_t);
+      ucode_dwords.resize(shader_header.ucode_dword_count);
+      if (shader_header.ucode_dword_count &&
+          !fread(ucode_dwords.data(), ucode_byte_count, 1,
+                 shader_storage_file_)) {
+        break;
+      }
+      uint64_t ucode_data_hash =
+          XXH3_64bits(ucode_dwords.data(), ucode_byte_count);
+      if (shader_header.ucode_data_hash != ucode_data_hash) {
+        // Validation failed.
+        break;
+      }
+      shader_storage_valid_bytes += sizeof(shader_header) + ucode_byte_count;
+      VulkanShader* shader =
+          LoadShader(shader_header.type, ucode_dwords.data(),
+                     shader_header.ucode_dword_count, ucode_data_hash);
+      if (shader->ucode_storage_index() == shader_storage_index_) {
+        // Appeared twice in this file for some reason - skip, otherwise race
+        // condition will be caused by translating twice in parallel.
+        continue;
+      }
+      // Loaded from the current storage - don't write again.
+      shader->set_ucode_storage_index(shader_storage_index_);
+      // Shaders only used by unsupported pipelines, or by pipelines that
+      // weren't stored, are only loaded.
+      auto modification_it = shader_translations_needed.lower_bound(
+          std::make_pair(ucode_data_hash, uint64_t(0)));
+      if (modification_it == shader_translations_needed.end() ||
+          modification_it->first != ucode_data_hash) {
+        continue;
+      }
+      // Create new threads if the currently existing threads can't keep up
+      // with file reading, but not more than the number of logical processors
+      // minus one.
+      size_t shader_translation_threads_needed;
+      {
+        std::lock_guard<std::mutex> lock(shaders_translation_thread_mutex);
+        shader_translation_threads_needed =
+            std::min(shader_translation_threads_busy +
+                         shaders_to_translate.size() + size_t(1),
+                     logical_processor_count - size_t(1));
+      }
+      while (shader_translation_threads.size() <
+             shader_translation_threads_needed) {
+        auto thread = xe::threading::Thread::Create(
+            {}, shader_translation_thread_function);
+        assert_not_null(thread);
+        thread->set_name("Shader Translation");
+        shader_translation_threads.push_back(std::move(thread));
+      }
+      // Request ucode information gathering and translation of all the needed
+      // shaders.
+      {
+        std::lock_guard<std::mutex> lock(shaders_translation_thread_mutex);
+        shaders_to_translate.push_back(shader);
+      }
+      shaders_translation_thread_cond.notify_one();
+      ++shaders_translated;
+    }
+    if (!shader_translation_threads.empty()) {
+      {
+        std::lock_guard<std::mutex> lock(shaders_translation_thread_mutex);
+        shader_translation_threads_shutdown = true;
+      }
+      shaders_translation_thread_cond.notify_all();
+      for (auto& shader_translation_thread : shader_translation_threads) {
+        xe::threading::Wait(shader_translation_thread.get(), false);
+      }
+      shader_translation_threads.clear();
+      for (VulkanShader::VulkanTranslation* translation :
+           shaders_failed_to_translate) {
+        VulkanShader* shader =
+            static_cast<VulkanShader*>(&translation->shader());
+        shader->DestroyTranslation(translation->modification());
+        if (shader->translations().empty()) {
+          shaders_.erase(shader->ucode_data_hash());
+          delete shader;
+        }
+      }
+    }
+    XELOGGPU("Translated {} shaders from the storage in {} milliseconds",
+             shaders_translated,
+             (xe::Clock::QueryHostTickCount() -
+              shader_storage_initialization_start) *
+                 1000 / xe::Clock::QueryHostTickFrequency());
+    // Anything after the valid shaders is corrupted regardless of what the
+    // other instances have appended since then.
+    xe::filesystem::UnlockStdioFile(shader_storage_file_);
+    xe::filesystem::LockStdioFile(shader_storage_file_, true);
+    xe::filesystem::TruncateStdioFile(shader_storage_file_,
+                                      shader_storage_valid_bytes);
+  } else {
+    xe::filesystem::UnlockStdioFile(shader_storage_file_);
+    xe::filesystem::LockStdioFile(shader_storage_file_, true);
+    xe::filesystem::TruncateStdioFile(shader_storage_file_, 0);
+    shader_storage_file_header.magic = shader_storage_magic;
+    shader_storage_file_header.version_swapped =
+        xe::byte_swap(ShaderStoredHeader::kVersion);
+    fwrite(&shader_storage_file_header, sizeof(shader_storage_file_header), 1,
+           shader_storage_file_);
+  }
+  fflush(shader_storage_file_);
+  xe::filesystem::UnlockStdioFile(shader_storage_file_);
+
+  // Create the pipelines.
+  if (!pipeline_stored_descriptions.empty()) {
+    uint64_t pipeline_creation_start = xe::Clock::QueryHostTickCount();
+
+    // Look up everything needed for creation on this thread, then create the
+    // pipelines on all cores.
+    std::vector<PipelineCreationArguments> pipelines_to_create;
+    for (const PipelineStoredDescription& pipeline_stored_description :
+         pipeline_stored_descriptions) {
+      const PipelineDescription& pipeline_description =
+          pipeline_stored_description.description;
+      // Skip already known pipelines and pipelines that can't be created on
+      // this device.
+      if (pipelines_.find(pipeline_description) != pipelines_.end() ||
+          !ArePipelineRequirementsMet(pipeline_description)) {
+        continue;
+      }
+
+      auto vertex_shader_it =
+          shaders_.find(pipeline_description.vertex_shader_hash);
+      if (vertex_shader_it == shaders_.end()) {
+        continue;
+      }
+      VulkanShader* vertex_shader = vertex_shader_it->second;
+      auto vertex_shader_translation =
+          static_cast<VulkanShader::VulkanTranslation*>(
+              vertex_shader->GetTranslation(
+                  pipeline_description.vertex_shader_modification));
+      if (!vertex_shader_translation ||
+          !vertex_shader_translation->is_translated() ||
+          !vertex_shader_translation->is_valid()) {
+        continue;
+      }
+      VulkanShader* pixel_shader = nullptr;
+      VulkanShader::VulkanTranslation* pixel_shader_translation = nullptr;
+      if (pipeline_description.pixel_shader_hash) {
+        auto pixel_shader_it =
+            shaders_.find(pipeline_description.pixel_shader_hash);
+        if (pixel_shader_it == shaders_.end()) {
+          continue;
+        }
+        pixel_shader = pixel_shader_it->second;
+        pixel_shader_translation =
+            static_cast<VulkanShader::VulkanTranslation*>(
+                pixel_shader->GetTranslation(
+                    pipeline_description.pixel_shader_modification));
+        if (!pixel_shader_translation ||
+            !pixel_shader_translation->is_translated() ||
+            !pixel_shader_translation->is_valid()) {
+          continue;
+        }
+      }
+
+      const PipelineLayoutProvider* pipeline_layout =
+          command_processor_.GetPipelineLayout(
+              pixel_shader
+                  ? pixel_shader->GetTextureBindingsAfterTranslation().size()
+                  : 0,
+              pixel_shader
+                  ? pixel_shader->GetSamplerBindingsAfterTranslation().size()
+                  : 0,
+              vertex_shader->GetTextureBindingsAfterTranslation().size(),
+              vertex_shader->GetSamplerBindingsAfterTranslation().size());
+      if (!pipeline_layout) {
+        continue;
+      }
+      VkShaderModule geometry_shader = VK_NULL_HANDLE;
+      GeometryShaderKey geometry_shader_key;
+      if (GetGeometryShaderKey(
+              pipeline_description.geometry_shader,
+              SpirvShaderTranslator::Modification(
+                  pipeline_description.vertex_shader_modification),
+              SpirvShaderTranslator::Modification(
+                  pipeline_description.pixel_shader_modification),
+              geometry_shader_key)) {
+        geometry_shader = GetGeometryShader(geometry_shader_key);
+        if (geometry_shader == VK_NULL_HANDLE) {
+          continue;
+        }
+      }
+      VkRenderPass render_pass =
+          edram_fragment_shader_interlock
+              ? render_target_cache_.GetFragmentShaderInterlockRenderPass()
+              : render_target_cache_.GetHostRenderTargetsRenderPass(
+                    pipeline_description.render_pass_key);
+      if (render_pass == VK_NULL_HANDLE) {
+        continue;
+      }
+
+      pipelines_to_create.emplace_back();
+      PipelineCreationArguments& creation_arguments =
+          pipelines_to_create.back();
+      creation_arguments.pipeline =
+          &*pipelines_
+                .emplace(std::piecewise_construct,
+                         std::forward_as_tuple(pipeline_description),
+                         std::forward_as_tuple(pipeline_layout))
+                .first;
+      creation_arguments.vertex_shader = vertex_shader_translation;
+      creation_arguments.pixel_shader = pixel_shader_translation;
+      creation_arguments.geometry_shader = geometry_shader;
+      creation_arguments.render_pass = render_pass;
+      // Creating the pipelines from the storage before the emulation starts,
+      // so there's no need to link them quickly.
+      creation_arguments.use_pipeline_libraries = false;
+    }
+
+    // Launch additional creation threads to use all cores to create pipelines
+    // faster. Will also be using this thread, so minus 1.
+    size_t creation_thread_original_count = creation_threads_.size();
+    size_t creation_thread_needed_count = std::max(
+        std::min(pipelines_to_create.size(), logical_processor_count),
+        size_t(1)) - size_t(1);
+    creation_thread_needed_count =
+        std::max(creation_thread_needed_count, creation_thread_original_count);
+    while (creation_threads_.size() < creation_thread_needed_count) {
+      size_t creation_thread_index = creation_threads_.size();
+      std::unique_ptr<xe::threading::Thread> creation_thread =
+          xe::threading::Thread::Create({}, [this, creation_thread_index]() {
+            CreationThread(creation_thread_index);
+          });
+      assert_not_null(creation_thread);
+      creation_thread->set_name("Vulkan Pipelines");
+      creation_threads_.push_back(std::move(creation_thread));
+    }
+
+    for (const PipelineCreationArguments& creation_arguments :
+         pipelines_to_create) {
+      RequestPipelineCreation(creation_arguments);
+    }
+
+    if (!creation_threads_.empty()) {
+      CreateQueuedPipelinesOnProcessorThread();
+      if (creation_threads_.size() > creation_thread_original_count) {
+        {
+          std::lock_guard<xe_mutex> lock(creation_request_lock_);
+          creation_threads_shutdown_from_ = creation_thread_original_count;
+          // Assuming the queue is empty because of
+          // CreateQueuedPipelinesOnProcessorThread.
+        }
+        creation_request_cond_.notify_all();
+        while (creation_threads_.size() > creation_thread_original_count) {
+          xe::threading::Wait(creation_threads_.back().get(), false);
+          creation_threads_.pop_back();
+        }
+        // Cleanup so additional threads can be created later again.
+        std::lock_guard<xe_mutex> lock(creation_request_lock_);
+        creation_threads_shutdown_from_ = SIZE_MAX;
+      }
+      // Regardless of whether the invocation is blocking, the results are
+      // needed to remove the pipelines that have failed to be created.
+      AwaitPipelineCreationCompletion();
+    }
+
+    // Let the pipelines that have failed to be created be tried again when
+    // they're used.
+    size_t pipelines_created = 0;
+    for (const PipelineCreationArguments& creation_arguments :
+         pipelines_to_create) {
+      if (creation_arguments.pipeline->second.pipeline.load(
+              std::memory_order_relaxed) != VK_NULL_HANDLE) {
+        ++pipelines_created;
+      } else {
+        PipelineDescription failed_description(
+            creation_arguments.pipeline->first);
+        pipelines_.erase(failed_description);
+      }
+    }
+    COUNT_profile_set("gpu/pipeline_cache/pipelines", pipelines_.size());
+
+    XELOGGPU(
+        "Created {} graphics pipelines (not including reading the "
+        "descriptions) from the storage in {} milliseconds",
+        pipelines_created,
+        (xe::Clock::QueryHostTickCount() - pipeline_creation_start) * 1000 /
+            xe::Clock::QueryHostTickFrequency());
+  }
+
+  // Start the storage writing thread.
+  storage_write_flush_shaders_ = false;
+  storage_write_flush_pipelines_ = false;
+  storage_write_thread_shutdown_ = false;
+  storage_write_thread_ =
+      xe::threading::Thread::Create({}, [this]() { StorageWriteThread(); });
+  assert_not_null(storage_write_thread_);
+  storage_write_thread_->set_name("Vulkan Storage writer");
+}
+
+void VulkanPipelineCache::ShutdownShaderStorage() {
+  if (storage_write_thread_) {
+    {
+      std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+      storage_write_thread_shutdown_ = true;
+    }
+    storage_write_request_cond_.notify_all();
+    xe::threading::Wait(storage_write_thread_.get(), false);
+    storage_write_thread_.reset();
+  }
+  storage_write_shader_queue_.clear();
+  storage_write_pipeline_queue_.clear();
+
+  if (vulkan_pipeline_cache_ != VK_NULL_HANDLE) {
+    // The pipelines still being created are using the pipeline cache, and
+    // their data needs to be stored too.
+    if (!creation_threads_.empty()) {
+      CreateQueuedPipelinesOnProcessorThread();
+      AwaitPipelineCreationCompletion();
+    }
+    WriteVulkanPipelineCacheData();
+    const ui::vulkan::VulkanProvider& provider =
+        command_processor_.GetVulkanProvider();
+    const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+    VkDevice device = provider.device();
+    ui::vulkan::util::DestroyAndNullHandle(dfn.vkDestroyPipelineCache, device,
+                                           vulkan_pipeline_cache_);
+  }
+  vulkan_pipeline_cache_file_path_.clear();
+
+  if (pipeline_storage_file_) {
+    fclose(pipeline_storage_file_);
+    pipeline_storage_file_ = nullptr;
+    pipeline_storage_file_flush_needed_ = false;
+  }
+
+  if (shader_storage_file_) {
+    fclose(shader_storage_file_);
+    shader_storage_file_ = nullptr;
+    shader_storage_file_flush_needed_ = false;
+  }
+}
+
+void VulkanPipelineCache::EndSubmission() {
+  if (shader_storage_file_flush_needed_ ||
+      pipeline_storage_file_flush_needed_) {
+    {
+      std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+      if (shader_storage_file_flush_needed_) {
+        storage_write_flush_shaders_ = true;
+      }
+      if (pipeline_storage_file_flush_needed_) {
+        storage_write_flush_pipelines_ = true;
+      }
+    }
+    storage_write_request_cond_.notify_one();
+    shader_storage_file_flush_needed_ = false;
+    pipeline_storage_file_flush_needed_ = false;
+  }
+  // When skipping draws with pending pipelines, the command buffer may be
+  // submitted without them, and they will be picked up in later submissions.
+  if (!creation_threads_.empty() &&
+      !cvars::vulkan_skip_draws_with_pending_pipelines) {
+    CreateQueuedPipelinesOnProcessorThread();
+    AwaitPipelineCreationCompletion();
+  }
 }
 
 VulkanShader* VulkanPipelineCache::LoadShader(xenos::ShaderType shader_type,
@@ -128,6 +1044,28 @@ VulkanShader* VulkanPipelineCache::LoadShader(xenos::ShaderType shader_type,
   uint64_t data_hash =
       XXH3_64bits(host_address, dword_count * sizeof(uint32_t));
   auto it = shaders_.find(data_hash);
+  if (it != shaders_.end()) {
+    return it->second;
+  }
+  VulkanShader* shader =
+      LoadShader(shader_type, host_address, dword_count, data_hash);
+  if (!creation_threads_.empty()) {
+    // The microcode of a shader loaded by the guest will be analyzed for the
+    // draws using it anyway, do that in advance if the threads are idle.
+    {
+      std::lock_guard<xe_mutex> lock(creation_request_lock_);
+      creation_analysis_queue_.push_back(shader);
+    }
+    creation_request_cond_.notify_one();
+  }
+  return shader;
+}
+
+VulkanShader* VulkanPipelineCache::LoadShader(xenos::ShaderType shader_type,
+                                              const uint32_t* host_address,
+                                              uint32_t dword_count,
+                                              uint64_t data_hash) {
+  auto it = shaders_.find(data_hash);
   if (it != shaders_.end()) {
     // Shader has been previously loaded.
     return it->second;
@@ -176,7 +1114,7 @@ VulkanPipelineCache::GetCurrentVertexShaderModification(
 SpirvShaderTranslator::Modification
 VulkanPipelineCache::GetCurrentPixelShaderModification(
     const Shader& shader, uint32_t interpolator_mask,
-    uint32_t param_gen_pos) const {
+    uint32_t param_gen_pos, bool samples_counted) const {
   assert_true(shader.type() == xenos::ShaderType::kPixel);
   assert_true(shader.is_ucode_analyzed());
   const auto& regs = register_file_;
@@ -206,18 +1144,37 @@ VulkanPipelineCache::GetCurrentPixelShaderModification(
     modification.pixel.param_gen_point = 0;
   }
 
+  reg::RB_DEPTHCONTROL normalized_depth_control =
+      draw_util::GetNormalizedDepthControl(regs);
   if (render_target_cache_.GetPath() ==
       RenderTargetCache::Path::kHostRenderTargets) {
     using DepthStencilMode =
         SpirvShaderTranslator::Modification::DepthStencilMode;
+    auto rb_colorcontrol = regs.Get<reg::RB_COLORCONTROL>();
     if (shader.implicit_early_z_write_allowed() &&
         (!shader.writes_color_target(0) ||
-         !draw_util::DoesCoverageDependOnAlpha(
-             regs.Get<reg::RB_COLORCONTROL>()))) {
+         !draw_util::DoesCoverageDependOnAlpha(rb_colorcontrol))) {
       modification.pixel.depth_stencil_mode = DepthStencilMode::kEarlyHint;
+    } else if (!shader.writes_depth() && !shader.memexport_eM_written() &&
+               !samples_counted && !rb_colorcontrol.alpha_to_mask_enable &&
+               !(normalized_depth_control.z_enable &&
+                 normalized_depth_control.z_write_enable) &&
+               !normalized_depth_control.stencil_enable) {
+      // Pixels are killed or alpha-tested, but that can't affect anything the
+      // depth / stencil test does, so still let the host make sure the tests
+      // are done before shading - otherwise many drivers, especially on
+      // tile-based GPUs, do them after the shader.
+      modification.pixel.depth_stencil_mode =
+          DepthStencilMode::kEarlyHintReadOnly;
     } else {
       modification.pixel.depth_stencil_mode = DepthStencilMode::kNoModifiers;
     }
+  } else {
+    // Without depth and stencil, there's nothing to skip the shader based on,
+    // so don't run it within the critical section.
+    modification.pixel.fsi_depth_stencil_late =
+        !normalized_depth_control.z_enable &&
+        !normalized_depth_control.stencil_enable;
   }
 
   return modification;
@@ -232,12 +1189,53 @@ bool VulkanPipelineCache::EnsureShadersTranslated(
               register_file_.Get<reg::SQ_PROGRAM_CNTL>().vs_export_mode !=
                   xenos::VertexShaderExportMode::kPosition2VectorsEdgeKill);
   assert_false(register_file_.Get<reg::SQ_PROGRAM_CNTL>().gen_index_vtx);
+  if (!creation_threads_.empty()) {
+    // Translate the shaders on the creation threads, in parallel with each
+    // other and with the processor thread.
+    RequestShaderTranslation(*vertex_shader);
+    if (pixel_shader) {
+      RequestShaderTranslation(*pixel_shader);
+    }
+    auto is_translation_completed =
+        [](const VulkanShader::VulkanTranslation* translation) {
+          return !translation ||
+                 !translation->is_async_translation_requested() ||
+                 translation->is_async_translation_completed();
+        };
+    if (!is_translation_completed(vertex_shader) ||
+        !is_translation_completed(pixel_shader)) {
+      if (cvars::vulkan_skip_draws_with_pending_pipelines) {
+        return false;
+      }
+      // Help the creation threads with the translations instead of idling.
+      TranslateQueuedShadersOnProcessorThread();
+      std::unique_lock<xe_mutex> lock(creation_request_lock_);
+      creation_translation_completion_cond_.wait(lock, [&]() {
+        return is_translation_completed(vertex_shader) &&
+               is_translation_completed(pixel_shader);
+      });
+    }
+    auto is_translation_valid =
+        [](const VulkanShader::VulkanTranslation* translation) {
+          if (!translation) {
+            return true;
+          }
+          if (translation->is_async_translation_requested() &&
+              !translation->async_translation_succeeded()) {
+            return false;
+          }
+          return translation->is_valid();
+        };
+    return is_translation_valid(vertex_shader) &&
+           is_translation_valid(pixel_shader);
+  }
   if (!vertex_shader->is_translated()) {
     vertex_shader->shader().AnalyzeUcode(ucode_disasm_buffer_);
     if (!TranslateAnalyzedShader(*shader_translator_, *vertex_shader)) {
       XELOGE("Failed to translate the vertex shader!");
       return false;
     }
+    QueueShaderStorageWrite(vertex_shader->shader());
   }
   if (!vertex_shader->is_valid()) {
     // Translation attempted previously, but not valid.
@@ -250,6 +1248,7 @@ bool VulkanPipelineCache::EnsureShadersTranslated(
         XELOGE("Failed to translate the pixel shader!");
         return false;
       }
+      QueueShaderStorageWrite(pixel_shader->shader());
     }
     if (!pixel_shader->is_valid()) {
       // Translation attempted previously, but not valid.
@@ -266,7 +1265,7 @@ bool VulkanPipelineCache::ConfigurePipeline(
     reg::RB_DEPTHCONTROL normalized_depth_control,
     uint32_t normalized_color_mask,
     VulkanRenderTargetCache::RenderPassKey render_pass_key,
-    VkPipeline& pipeline_out,
+    void*& pipeline_handle_out,
     const PipelineLayoutProvider*& pipeline_layout_out) {
 #if XE_UI_VULKAN_FINE_GRAINED_DRAW_SCOPES
   SCOPE_profile_cpu_f("gpu");
@@ -285,16 +1284,13 @@ bool VulkanPipelineCache::ConfigurePipeline(
     return false;
   }
   if (last_pipeline_ && last_pipeline_->first == description) {
-    pipeline_out = last_pipeline_->second.pipeline;
-    pipeline_layout_out = last_pipeline_->second.pipeline_layout;
-    return true;
+    return ReturnPipeline(*last_pipeline_, pipeline_handle_out,
+                          pipeline_layout_out);
   }
   auto it = pipelines_.find(description);
   if (it != pipelines_.end()) {
     last_pipeline_ = &*it;
-    pipeline_out = it->second.pipeline;
-    pipeline_layout_out = it->second.pipeline_layout;
-    return true;
+    return ReturnPipeline(*it, pipeline_handle_out, pipeline_layout_out);
   }
 
   // Create the pipeline if not the latest and not already existing.
@@ -342,18 +1338,54 @@ bool VulkanPipelineCache::ConfigurePipeline(
     return false;
   }
   PipelineCreationArguments creation_arguments;
-  auto& pipeline =
-      *pipelines_.emplace(description, Pipeline(pipeline_layout)).first;
+  auto& pipeline = *pipelines_
+                        .emplace(std::piecewise_construct,
+                                 std::forward_as_tuple(description),
+                                 std::forward_as_tuple(pipeline_layout))
+                        .first;
+  COUNT_profile_set("gpu/pipeline_cache/pipelines", pipelines_.size());
+  last_pipeline_ = &pipeline;
   creation_arguments.pipeline = &pipeline;
   creation_arguments.vertex_shader = vertex_shader;
   creation_arguments.pixel_shader = pixel_shader;
   creation_arguments.geometry_shader = geometry_shader;
   creation_arguments.render_pass = render_pass;
-  if (!EnsurePipelineCreated(creation_arguments)) {
+  creation_arguments.use_pipeline_libraries = pipeline_libraries_used_;
+  RequestPipelineCreation(creation_arguments);
+
+  if (pipeline_storage_file_) {
+    assert_not_null(storage_write_thread_);
+    pipeline_storage_file_flush_needed_ = true;
+    {
+      std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+      storage_write_pipeline_queue_.emplace_back();
+      PipelineStoredDescription& stored_description =
+          storage_write_pipeline_queue_.back();
+      stored_description.description_hash = description.GetHash();
+      std::memcpy(&stored_description.description, &description,
+                  sizeof(description));
+    }
+    storage_write_request_cond_.notify_all();
+  }
+  return ReturnPipeline(pipeline, pipeline_handle_out, pipeline_layout_out);
+}
+
+bool VulkanPipelineCache::ReturnPipeline(
+    const std::pair<const PipelineDescription, Pipeline>& pipeline,
+    void*& pipeline_handle_out,
+    const PipelineLayoutProvider*& pipeline_layout_out) const {
+  // If the pipeline is being created asynchronously, it will be available by
+  // the time the command buffer is executed, unless draws with pending
+  // pipelines are skipped. If creation has failed previously, the draw is
+  // dropped when the command buffer is executed.
+  if (cvars::vulkan_skip_draws_with_pending_pipelines &&
+      pipeline.second.pipeline.load(std::memory_order_acquire) ==
+          VK_NULL_HANDLE) {
     return false;
   }
-  pipeline_out = pipeline.second.pipeline;
-  pipeline_layout_out = pipeline_layout;
+  pipeline_handle_out =
+      const_cast<void*>(static_cast<const void*>(&pipeline.second));
+  pipeline_layout_out = pipeline.second.pipeline_layout;
   return true;
 }
 
@@ -361,6 +1393,7 @@ bool VulkanPipelineCache::TranslateAnalyzedShader(
     SpirvShaderTranslator& translator,
     VulkanShader::VulkanTranslation& translation) {
   VulkanShader& shader = static_cast<VulkanShader&>(translation.shader());
+  uint64_t translation_start = xe::Clock::QueryHostTickCount();
 
   // Perform translation.
   // If this fails the shader will be marked as invalid and ignored later.
@@ -369,9 +1402,14 @@ bool VulkanPipelineCache::TranslateAnalyzedShader(
            shader.ucode_data_hash());
     return false;
   }
+  if (spirv_tools_context_.IsOptimizerAvailable()) {
+    translation.Optimize(spirv_tools_context_);
+  }
   if (translation.GetOrCreateShaderModule() == VK_NULL_HANDLE) {
     return false;
   }
+  command_processor_.CountShaderTranslation(xe::Clock::QueryHostTickCount() -
+                                            translation_start);
 
   // TODO(Triang3l): Log that the shader has been successfully translated in
   // common code.
@@ -389,6 +1427,7 @@ bool VulkanPipelineCache::TranslateAnalyzedShader(
           texture_binding_count * sizeof(*texture_bindings.data());
       uint64_t texture_binding_layout_hash =
           XXH3_64bits(texture_bindings.data(), texture_binding_layout_bytes);
+      std::lock_guard<std::mutex> layouts_lock(layouts_mutex_);
       auto found_range =
           texture_binding_layout_map_.equal_range(texture_binding_layout_hash);
       for (auto it = found_range.first; it != found_range.second; ++it) {
@@ -1883,6 +2922,38 @@ VkShaderModule VulkanPipelineCache::GetGeometryShader(GeometryShaderKey key) {
   return shader_module;
 }
 
+template <typename Key>
+VkPipeline VulkanPipelineCache::GetPipelineLibrary(
+    PipelineLibraryMap<Key>& libraries, const Key& key,
+    const VkGraphicsPipelineCreateInfo& library_create_info) {
+  {
+    std::lock_guard<std::mutex> lock(pipeline_libraries_mutex_);
+    auto it = libraries.find(key);
+    if (it != libraries.end()) {
+      return it->second;
+    }
+  }
+  // Not holding the lock while creating the library so other threads can link
+  // pipelines from the existing libraries meanwhile.
+  const ui::vulkan::VulkanProvider& provider =
+      command_processor_.GetVulkanProvider();
+  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+  VkDevice device = provider.device();
+  VkPipeline library;
+  if (dfn.vkCreateGraphicsPipelines(device, vulkan_pipeline_cache_, 1,
+                                    &library_create_info, nullptr,
+                                    &library) != VK_SUCCESS) {
+    return VK_NULL_HANDLE;
+  }
+  std::lock_guard<std::mutex> lock(pipeline_libraries_mutex_);
+  auto it_inserted = libraries.emplace(key, library);
+  if (!it_inserted.second) {
+    // Created by another thread at the same time.
+    dfn.vkDestroyPipeline(device, library, nullptr);
+  }
+  return it_inserted.first->second;
+}
+
 bool VulkanPipelineCache::EnsurePipelineCreated(
     const PipelineCreationArguments& creation_arguments) {
   if (creation_arguments.pipeline->second.pipeline != VK_NULL_HANDLE) {
@@ -2272,6 +3343,184 @@ bool VulkanPipelineCache::EnsurePipelineCreated(
         VK_DYNAMIC_STATE_STENCIL_REFERENCE;
   }
 
+  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+  VkDevice device = provider.device();
+  VkPipelineLayout pipeline_layout =
+      creation_arguments.pipeline->second.pipeline_layout->GetPipelineLayout();
+  VkPipeline pipeline;
+  if (creation_arguments.use_pipeline_libraries) {
+    // Get the parts of the pipeline, which are likely shared with many other
+    // pipelines, and link them quickly, without link-time optimizations.
+    VkGraphicsPipelineLibraryCreateInfoEXT library_info;
+    library_info.sType =
+        VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+    library_info.pNext = nullptr;
+    VkGraphicsPipelineCreateInfo library_create_info;
+    std::array<VkDynamicState, 3> library_dynamic_states;
+    VkPipelineDynamicStateCreateInfo library_dynamic_state;
+    library_dynamic_state.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    library_dynamic_state.pNext = nullptr;
+    library_dynamic_state.flags = 0;
+    library_dynamic_state.pDynamicStates = library_dynamic_states.data();
+    auto reset_library_create_info =
+        [&](VkGraphicsPipelineLibraryFlagsEXT library_flags) {
+          library_info.flags = library_flags;
+          library_create_info = {};
+          library_create_info.sType =
+              VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+          library_create_info.pNext = &library_info;
+          library_create_info.flags =
+              VK_PIPELINE_CREATE_LIBRARY_BIT_KHR |
+              VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+          library_create_info.basePipelineIndex = -1;
+          library_dynamic_state.dynamicStateCount = 0;
+          library_create_info.pDynamicState = &library_dynamic_state;
+        };
+    std::array<VkPipeline, 4> libraries;
+
+    PipelineVertexInputLibraryKey vertex_input_key;
+    vertex_input_key.topology = input_assembly_state.topology;
+    vertex_input_key.primitive_restart_enable =
+        input_assembly_state.primitiveRestartEnable;
+    reset_library_create_info(
+        VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT);
+    library_create_info.pVertexInputState = &vertex_input_state;
+    library_create_info.pInputAssemblyState = &input_assembly_state;
+    libraries[0] = GetPipelineLibrary(pipeline_vertex_input_libraries_,
+                                      vertex_input_key, library_create_info);
+
+    // The fragment shader, if used, is always the last stage.
+    bool fragment_shader_stage_used =
+        shader_stage_fragment.module != VK_NULL_HANDLE;
+    PipelinePreRasterizationLibraryKey pre_rasterization_key;
+    pre_rasterization_key.layout = pipeline_layout;
+    pre_rasterization_key.render_pass = creation_arguments.render_pass;
+    pre_rasterization_key.vertex_shader = shader_stage_vertex.module;
+    pre_rasterization_key.geometry_shader = creation_arguments.geometry_shader;
+    pre_rasterization_key.depth_clamp_enable =
+        rasterization_state.depthClampEnable;
+    pre_rasterization_key.polygon_mode = rasterization_state.polygonMode;
+    pre_rasterization_key.cull_mode = rasterization_state.cullMode;
+    pre_rasterization_key.front_face = rasterization_state.frontFace;
+    pre_rasterization_key.depth_bias_enable =
+        rasterization_state.depthBiasEnable;
+    reset_library_create_info(
+        VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT);
+    library_create_info.stageCount =
+        shader_stage_count - uint32_t(fragment_shader_stage_used);
+    library_create_info.pStages = shader_stages.data();
+    library_create_info.pViewportState = &viewport_state;
+    library_create_info.pRasterizationState = &rasterization_state;
+    library_create_info.layout = pipeline_layout;
+    library_create_info.renderPass = creation_arguments.render_pass;
+    library_dynamic_states[library_dynamic_state.dynamicStateCount++] =
+        VK_DYNAMIC_STATE_VIEWPORT;
+    library_dynamic_states[library_dynamic_state.dynamicStateCount++] =
+        VK_DYNAMIC_STATE_SCISSOR;
+    if (!edram_fragment_shader_interlock) {
+      library_dynamic_states[library_dynamic_state.dynamicStateCount++] =
+          VK_DYNAMIC_STATE_DEPTH_BIAS;
+    }
+    libraries[1] =
+        GetPipelineLibrary(pipeline_pre_rasterization_libraries_,
+                           pre_rasterization_key, library_create_info);
+
+    PipelineFragmentShaderLibraryKey fragment_shader_key;
+    fragment_shader_key.layout = pipeline_layout;
+    fragment_shader_key.render_pass = creation_arguments.render_pass;
+    fragment_shader_key.fragment_shader = shader_stage_fragment.module;
+    fragment_shader_key.rasterization_samples =
+        multisample_state.rasterizationSamples;
+    fragment_shader_key.sample_mask = sample_mask;
+    fragment_shader_key.depth_test_enable =
+        depth_stencil_state.depthTestEnable;
+    fragment_shader_key.depth_write_enable =
+        depth_stencil_state.depthWriteEnable;
+    fragment_shader_key.depth_compare_op = depth_stencil_state.depthCompareOp;
+    fragment_shader_key.stencil_test_enable =
+        depth_stencil_state.stencilTestEnable;
+    fragment_shader_key.stencil_front = depth_stencil_state.front;
+    fragment_shader_key.stencil_back = depth_stencil_state.back;
+    reset_library_create_info(
+        VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT);
+    library_create_info.stageCount = uint32_t(fragment_shader_stage_used);
+    library_create_info.pStages = &shader_stage_fragment;
+    library_create_info.pMultisampleState = &multisample_state;
+    library_create_info.pDepthStencilState = &depth_stencil_state;
+    library_create_info.layout = pipeline_layout;
+    library_create_info.renderPass = creation_arguments.render_pass;
+    if (!edram_fragment_shader_interlock) {
+      library_dynamic_states[library_dynamic_state.dynamicStateCount++] =
+          VK_DYNAMIC_STATE_STENCIL_COMPARE_MASK;
+      library_dynamic_states[library_dynamic_state.dynamicStateCount++] =
+          VK_DYNAMIC_STATE_STENCIL_WRITE_MASK;
+      library_dynamic_states[library_dynamic_state.dynamicStateCount++] =
+          VK_DYNAMIC_STATE_STENCIL_REFERENCE;
+    }
+    libraries[2] = GetPipelineLibrary(pipeline_fragment_shader_libraries_,
+                                      fragment_shader_key, library_create_info);
+
+    PipelineFragmentOutputLibraryKey fragment_output_key;
+    fragment_output_key.render_pass = creation_arguments.render_pass;
+    fragment_output_key.rasterization_samples =
+        multisample_state.rasterizationSamples;
+    fragment_output_key.sample_mask = sample_mask;
+    fragment_output_key.color_attachment_count =
+        color_blend_state.attachmentCount;
+    std::memcpy(fragment_output_key.color_attachments, color_blend_attachments,
+                sizeof(VkPipelineColorBlendAttachmentState) *
+                    color_blend_state.attachmentCount);
+    reset_library_create_info(
+        VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT);
+    library_create_info.pMultisampleState = &multisample_state;
+    library_create_info.pColorBlendState = &color_blend_state;
+    library_create_info.renderPass = creation_arguments.render_pass;
+    if (!edram_fragment_shader_interlock) {
+      library_dynamic_states[library_dynamic_state.dynamicStateCount++] =
+          VK_DYNAMIC_STATE_BLEND_CONSTANTS;
+    }
+    libraries[3] = GetPipelineLibrary(pipeline_fragment_output_libraries_,
+                                      fragment_output_key, library_create_info);
+
+    for (VkPipeline library : libraries) {
+      if (library == VK_NULL_HANDLE) {
+        return false;
+      }
+    }
+    VkPipelineLibraryCreateInfoKHR link_library_info;
+    link_library_info.sType =
+        VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+    link_library_info.pNext = nullptr;
+    link_library_info.libraryCount = uint32_t(libraries.size());
+    link_library_info.pLibraries = libraries.data();
+    VkGraphicsPipelineCreateInfo link_create_info = {};
+    link_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    link_create_info.pNext = &link_library_info;
+    link_create_info.layout = pipeline_layout;
+    link_create_info.basePipelineIndex = -1;
+    if (dfn.vkCreateGraphicsPipelines(device, vulkan_pipeline_cache_, 1,
+                                      &link_create_info, nullptr,
+                                      &pipeline) != VK_SUCCESS) {
+      return false;
+    }
+    creation_arguments.pipeline->second.fast_linked_pipeline = pipeline;
+    creation_arguments.pipeline->second.pipeline.store(
+        pipeline, std::memory_order_release);
+    command_processor_.CountPipelineCreation();
+
+    // Request the optimized pipeline.
+    {
+      std::lock_guard<xe_mutex> lock(creation_request_lock_);
+      PipelineOptimizedLinkArguments& optimized_link_arguments =
+          creation_optimized_link_queue_.emplace_back();
+      optimized_link_arguments.pipeline = creation_arguments.pipeline;
+      optimized_link_arguments.libraries = libraries;
+    }
+    creation_request_cond_.notify_one();
+    return true;
+  }
+
   VkGraphicsPipelineCreateInfo pipeline_create_info;
   pipeline_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipeline_create_info.pNext = nullptr;
@@ -2287,17 +3536,12 @@ bool VulkanPipelineCache::EnsurePipelineCreated(
   pipeline_create_info.pDepthStencilState = &depth_stencil_state;
   pipeline_create_info.pColorBlendState = &color_blend_state;
   pipeline_create_info.pDynamicState = &dynamic_state;
-  pipeline_create_info.layout =
-      creation_arguments.pipeline->second.pipeline_layout->GetPipelineLayout();
+  pipeline_create_info.layout = pipeline_layout;
   pipeline_create_info.renderPass = creation_arguments.render_pass;
   pipeline_create_info.subpass = 0;
   pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
   pipeline_create_info.basePipelineIndex = -1;
-
-  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
-  VkDevice device = provider.device();
-  VkPipeline pipeline;
-  if (dfn.vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1,
+  if (dfn.vkCreateGraphicsPipelines(device, vulkan_pipeline_cache_, 1,
                                     &pipeline_create_info, nullptr,
                                     &pipeline) != VK_SUCCESS) {
     // TODO(Triang3l): Move these error messages outside.
@@ -2312,10 +3556,377 @@ bool VulkanPipelineCache::EnsurePipelineCreated(
     } */
     return false;
   }
-  creation_arguments.pipeline->second.pipeline = pipeline;
+  creation_arguments.pipeline->second.pipeline.store(pipeline,
+                                                     std::memory_order_release);
+  command_processor_.CountPipelineCreation();
   return true;
 }
 
+void VulkanPipelineCache::StorageWriteThread() {
+  ShaderStoredHeader shader_header;
+  // Don't leak anything in unused bits.
+  std::memset(&shader_header, 0, sizeof(shader_header));
+
+  std::vector<uint32_t> ucode_guest_endian;
+  ucode_guest_endian.reserve(0xFFFF);
+
+  bool flush_shaders = false;
+  bool flush_pipelines = false;
+
+  while (true) {
+    if (flush_shaders) {
+      flush_shaders = false;
+      assert_not_null(shader_storage_file_);
+      fflush(shader_storage_file_);
+    }
+    if (flush_pipelines) {
+      flush_pipelines = false;
+      assert_not_null(pipeline_storage_file_);
+      fflush(pipeline_storage_file_);
+      // New pipelines have been created - also merge what the driver has
+      // compiled into the stored pipeline cache, but not too often as the
+      // whole cache is written every time.
+      if (xe::Clock::QueryHostTickCount() -
+              vulkan_pipeline_cache_write_host_tick_ >=
+          xe::Clock::QueryHostTickFrequency() *
+              kVulkanPipelineCacheWriteIntervalSeconds) {
+        WriteVulkanPipelineCacheData();
+      }
+    }
+
+    const Shader* shader = nullptr;
+    PipelineStoredDescription pipeline_description;
+    bool write_pipeline = false;
+    {
+      std::unique_lock<std::mutex> lock(storage_write_request_lock_);
+      if (storage_write_thread_shutdown_) {
+        return;
+      }
+      if (!storage_write_shader_queue_.empty()) {
+        shader = storage_write_shader_queue_.front();
+        storage_write_shader_queue_.pop_front();
+      } else if (storage_write_flush_shaders_) {
+        storage_write_flush_shaders_ = false;
+        flush_shaders = true;
+      }
+      if (!storage_write_pipeline_queue_.empty()) {
+        std::memcpy(&pipeline_description,
+                    &storage_write_pipeline_queue_.front(),
+                    sizeof(pipeline_description));
+        storage_write_pipeline_queue_.pop_front();
+        write_pipeline = true;
+      } else if (storage_write_flush_pipelines_) {
+        storage_write_flush_pipelines_ = false;
+        flush_pipelines = true;
+      }
+      if (!shader && !write_pipeline) {
+        storage_write_request_cond_.wait(lock);
+        continue;
+      }
+    }
+
+    if (shader) {
+      shader_header.ucode_data_hash = shader->ucode_data_hash();
+      shader_header.ucode_dword_count = shader->ucode_dword_count();
+      shader_header.type = shader->type();
+      assert_not_null(shader_storage_file_);
+      if (shader_header.ucode_dword_count) {
+        ucode_guest_endian.resize(shader_header.ucode_dword_count);
+        // Need to swap because the hash is calculated for the shader with guest
+        // endianness.
+        xe::copy_and_swap(ucode_guest_endian.data(), shader->ucode_dwords(),
+                          shader_header.ucode_dword_count);
+      }
+      // Other emulator instances may be appending to the same file, write the
+      // whole shader at once while holding the lock.
+      xe::filesystem::ScopedStdioFileLock file_lock(shader_storage_file_);
+      fwrite(&shader_header, sizeof(shader_header), 1, shader_storage_file_);
+      if (shader_header.ucode_dword_count) {
+        fwrite(ucode_guest_endian.data(),
+               shader_header.ucode_dword_count * sizeof(uint32_t), 1,
+               shader_storage_file_);
+      }
+      fflush(shader_storage_file_);
+    }
+
+    if (write_pipeline) {
+      assert_not_null(pipeline_storage_file_);
+      xe::filesystem::ScopedStdioFileLock file_lock(pipeline_storage_file_);
+      fwrite(&pipeline_description, sizeof(pipeline_description), 1,
+             pipeline_storage_file_);
+      fflush(pipeline_storage_file_);
+    }
+  }
+}
+
+void VulkanPipelineCache::WriteVulkanPipelineCacheData() {
+  if (vulkan_pipeline_cache_ == VK_NULL_HANDLE ||
+      vulkan_pipeline_cache_file_path_.empty()) {
+    return;
+  }
+  const ui::vulkan::VulkanProvider& provider =
+      command_processor_.GetVulkanProvider();
+  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+  VkDevice device = provider.device();
+  vulkan_pipeline_cache_write_host_tick_ = xe::Clock::QueryHostTickCount();
+  size_t data_size;
+  if (dfn.vkGetPipelineCacheData(device, vulkan_pipeline_cache_, &data_size,
+                                 nullptr) != VK_SUCCESS ||
+      data_size == vulkan_pipeline_cache_written_size_) {
+    // Either failed or assuming nothing has been added.
+    return;
+  }
+  std::vector<uint8_t> data(data_size);
+  if (dfn.vkGetPipelineCacheData(device, vulkan_pipeline_cache_, &data_size,
+                                 data.data()) != VK_SUCCESS) {
+    return;
+  }
+  FILE* file =
+      xe::filesystem::OpenFile(vulkan_pipeline_cache_file_path_, "wb");
+  if (!file) {
+    XELOGE("Failed to open the Vulkan pipeline cache file for writing: {}",
+           xe::path_to_utf8(vulkan_pipeline_cache_file_path_));
+    return;
+  }
+  bool written = fwrite(data.data(), 1, data_size, file) == data_size;
+  fclose(file);
+  if (written) {
+    vulkan_pipeline_cache_written_size_ = data_size;
+  }
+}
+
+void VulkanPipelineCache::LinkOptimizedPipeline(
+    const PipelineOptimizedLinkArguments& arguments) {
+  const ui::vulkan::VulkanProvider& provider =
+      command_processor_.GetVulkanProvider();
+  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+  VkDevice device = provider.device();
+  VkPipelineLibraryCreateInfoKHR link_library_info;
+  link_library_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+  link_library_info.pNext = nullptr;
+  link_library_info.libraryCount = uint32_t(arguments.libraries.size());
+  link_library_info.pLibraries = arguments.libraries.data();
+  VkGraphicsPipelineCreateInfo link_create_info = {};
+  link_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  link_create_info.pNext = &link_library_info;
+  link_create_info.flags = VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT;
+  link_create_info.layout =
+      arguments.pipeline->second.pipeline_layout->GetPipelineLayout();
+  link_create_info.basePipelineIndex = -1;
+  // Not using the pipeline cache as the shader storage may be switched while
+  // this is happening, and it would also need to be awaited at the end of
+  // submissions.
+  VkPipeline pipeline;
+  if (dfn.vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1,
+                                    &link_create_info, nullptr,
+                                    &pipeline) != VK_SUCCESS) {
+    // Keep using the fast-linked pipeline.
+    return;
+  }
+  // The fast-linked pipeline may still be used in submitted command buffers,
+  // it's kept in fast_linked_pipeline until shutdown.
+  arguments.pipeline->second.pipeline.store(pipeline,
+                                            std::memory_order_release);
+}
+
+void VulkanPipelineCache::QueueShaderStorageWrite(Shader& shader) {
+  if (!shader_storage_file_ ||
+      shader.ucode_storage_index() == shader_storage_index_) {
+    return;
+  }
+  shader.set_ucode_storage_index(shader_storage_index_);
+  assert_not_null(storage_write_thread_);
+  shader_storage_file_flush_needed_ = true;
+  {
+    std::lock_guard<std::mutex> lock(storage_write_request_lock_);
+    storage_write_shader_queue_.push_back(&shader);
+  }
+  storage_write_request_cond_.notify_all();
+}
+
+void VulkanPipelineCache::RequestShaderTranslation(
+    VulkanShader::VulkanTranslation& translation) {
+  assert_false(creation_threads_.empty());
+  // Not requested, but translated, if loaded from the shader storage.
+  if (translation.is_async_translation_requested() ||
+      translation.is_translated()) {
+    return;
+  }
+  translation.MarkAsyncTranslationRequested();
+  // The microcode doesn't depend on the result of the translation.
+  QueueShaderStorageWrite(translation.shader());
+  {
+    std::lock_guard<xe_mutex> lock(creation_request_lock_);
+    creation_translation_queue_.push_back(&translation);
+  }
+  creation_request_cond_.notify_one();
+}
+
+void VulkanPipelineCache::TranslateRequestedShader(
+    SpirvShaderTranslator& translator, StringBuffer& ucode_disasm_buffer,
+    VulkanShader::VulkanTranslation& translation) {
+  SCOPE_profile_cpu_f("gpu");
+  VulkanShader& shader = static_cast<VulkanShader&>(translation.shader());
+  shader.AnalyzeUcodeOnce(ucode_disasm_buffer);
+  bool succeeded = TranslateAnalyzedShader(translator, translation);
+  if (!succeeded) {
+    XELOGE("Failed to translate the {} shader {:016X}!",
+           shader.type() == xenos::ShaderType::kVertex ? "vertex" : "pixel",
+           shader.ucode_data_hash());
+  }
+  translation.CompleteAsyncTranslation(succeeded);
+  // Make sure the processor thread is either not checking the completion yet or
+  // already waiting, so it doesn't miss the notification.
+  { std::lock_guard<xe_mutex> lock(creation_request_lock_); }
+  creation_translation_completion_cond_.notify_all();
+}
+
+void VulkanPipelineCache::RequestPipelineCreation(
+    const PipelineCreationArguments& creation_arguments) {
+  if (creation_threads_.empty()) {
+    EnsurePipelineCreated(creation_arguments);
+    return;
+  }
+  // Submit the pipeline for creation to any available thread.
+  {
+    std::lock_guard<xe_mutex> lock(creation_request_lock_);
+    creation_queue_.push_back(creation_arguments);
+  }
+  creation_request_cond_.notify_one();
+}
+
+void VulkanPipelineCache::CreationThread(size_t thread_index) {
+  // Thread-local objects for shader translation.
+  StringBuffer ucode_disasm_buffer;
+  SpirvShaderTranslator translator(
+      SpirvShaderTranslator::Features(command_processor_.GetVulkanProvider()),
+      render_target_cache_.msaa_2x_attachments_supported(),
+      render_target_cache_.msaa_2x_no_attachments_supported(),
+      render_target_cache_.GetPath() ==
+          RenderTargetCache::Path::kPixelShaderInterlock);
+
+  while (true) {
+    PipelineCreationArguments pipeline_to_create;
+
+    // Check if need to shut down or set the completion event and dequeue the
+    // pipeline if there is any.
+    {
+      std::unique_lock<xe_mutex> lock(creation_request_lock_);
+      if (thread_index < creation_threads_shutdown_from_ &&
+          !creation_translation_queue_.empty()) {
+        // The processor thread may be waiting for the translation, and the
+        // pipelines can't be created without the shaders anyway.
+        VulkanShader::VulkanTranslation* translation =
+            creation_translation_queue_.front();
+        creation_translation_queue_.pop_front();
+        lock.unlock();
+        TranslateRequestedShader(translator, ucode_disasm_buffer, *translation);
+        continue;
+      }
+      if (thread_index >= creation_threads_shutdown_from_ ||
+          creation_queue_.empty()) {
+        if (creation_completion_set_event_ && creation_threads_busy_ == 0) {
+          // Last pipeline in the queue created - signal the event if requested.
+          creation_completion_set_event_ = false;
+          creation_completion_event_->Set();
+        }
+        if (thread_index >= creation_threads_shutdown_from_) {
+          return;
+        }
+        if (!creation_analysis_queue_.empty()) {
+          VulkanShader* shader = creation_analysis_queue_.front();
+          creation_analysis_queue_.pop_front();
+          lock.unlock();
+          shader->AnalyzeUcodeOnce(ucode_disasm_buffer);
+          continue;
+        }
+        if (creation_optimized_link_queue_.empty()) {
+          creation_request_cond_.wait(lock);
+          continue;
+        }
+        // Nothing to create urgently - link an optimized pipeline, without
+        // being counted as busy as this doesn't need to be awaited.
+        PipelineOptimizedLinkArguments optimized_link_arguments =
+            creation_optimized_link_queue_.front();
+        creation_optimized_link_queue_.pop_front();
+        lock.unlock();
+        LinkOptimizedPipeline(optimized_link_arguments);
+        continue;
+      }
+      // Take the pipeline from the queue and increment the busy thread count
+      // until the pipeline is created - other threads must be able to dequeue
+      // requests, but can't set the completion event until the pipelines are
+      // fully created (rather than just started creating).
+      pipeline_to_create = creation_queue_.front();
+      creation_queue_.pop_front();
+      ++creation_threads_busy_;
+    }
+
+    EnsurePipelineCreated(pipeline_to_create);
+
+    // Pipeline created - the thread is not busy anymore, safe to set the
+    // completion event if needed (at the next iteration, or in some other
+    // thread).
+    {
+      std::lock_guard<xe_mutex> lock(creation_request_lock_);
+      --creation_threads_busy_;
+    }
+  }
+}
+
+void VulkanPipelineCache::CreateQueuedPipelinesOnProcessorThread() {
+  assert_false(creation_threads_.empty());
+  while (true) {
+    PipelineCreationArguments pipeline_to_create;
+    {
+      std::lock_guard<xe_mutex> lock(creation_request_lock_);
+      if (creation_queue_.empty()) {
+        break;
+      }
+      pipeline_to_create = creation_queue_.front();
+      creation_queue_.pop_front();
+    }
+    EnsurePipelineCreated(pipeline_to_create);
+  }
+}
+
+void VulkanPipelineCache::TranslateQueuedShadersOnProcessorThread() {
+  assert_false(creation_threads_.empty());
+  while (true) {
+    VulkanShader::VulkanTranslation* translation;
+    {
+      std::lock_guard<xe_mutex> lock(creation_request_lock_);
+      if (creation_translation_queue_.empty()) {
+        break;
+      }
+      translation = creation_translation_queue_.front();
+      creation_translation_queue_.pop_front();
+    }
+    TranslateRequestedShader(*shader_translator_, ucode_disasm_buffer_,
+                             *translation);
+  }
+}
+
+void VulkanPipelineCache::AwaitPipelineCreationCompletion() {
+  assert_false(creation_threads_.empty());
+  bool await_creation_completion_event;
+  {
+    std::lock_guard<xe_mutex> lock(creation_request_lock_);
+    // Assuming the creation queue is already empty (because the processor
+    // thread also worked on creating the leftover pipelines), so only check if
+    // there are threads with pipelines currently being created.
+    await_creation_completion_event = creation_threads_busy_ != 0;
+    if (await_creation_completion_event) {
+      creation_completion_event_->Reset();
+      creation_completion_set_event_ = true;
+    }
+  }
+  if (await_creation_completion_event) {
+    creation_request_cond_.notify_one();
+    xe::threading::Wait(creation_completion_event_.get(), false);
+  }
+}
+
 }  // namespace vulkan
 }  // namespace gpu
 }  // namespace xe
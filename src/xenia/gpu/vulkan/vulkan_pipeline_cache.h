@@ -10,15 +10,25 @@
 #ifndef XENIA_GPU_VULKAN_VULKAN_PIPELINE_STATE_CACHE_H_
 #define XENIA_GPU_VULKAN_VULKAN_PIPELINE_STATE_CACHE_H_
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdio>
 #include <cstring>
+#include <deque>
+#include <filesystem>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "xenia/base/hash.h"
+#include "xenia/base/mutex.h"
 #include "xenia/base/platform.h"
+#include "xenia/base/threading.h"
 #include "xenia/base/xxhash.h"
 #include "xenia/gpu/primitive_processor.h"
 #include "xenia/gpu/register_file.h"
@@ -27,6 +37,7 @@
 #include "xenia/gpu/vulkan/vulkan_render_target_cache.h"
 #include "xenia/gpu/vulkan/vulkan_shader.h"
 #include "xenia/gpu/xenos.h"
+#include "xenia/ui/vulkan/spirv_tools_context.h"
 #include "xenia/ui/vulkan/vulkan_provider.h"
 
 namespace xe {
@@ -59,11 +70,18 @@ class VulkanPipelineCache {
   bool Initialize();
   void Shutdown();
 
+  void InitializeShaderStorage(const std::filesystem::path& cache_root,
+                               uint32_t title_id, bool blocking);
+  void ShutdownShaderStorage();
+
+  void EndSubmission();
+
   VulkanShader* LoadShader(xenos::ShaderType shader_type,
                            const uint32_t* host_address, uint32_t dword_count);
-  // Analyze shader microcode on the translator thread.
-  void AnalyzeShaderUcode(Shader& shader) {
-    shader.AnalyzeUcode(ucode_disasm_buffer_);
+  // Analyze shader microcode on the translator thread, or wait for the
+  // analysis if it's being done in advance on a creation thread.
+  void AnalyzeShaderUcode(VulkanShader& shader) {
+    shader.AnalyzeUcodeOnce(ucode_disasm_buffer_);
   }
 
   // Retrieves the shader modification for the current state. The shader must
@@ -72,13 +90,17 @@ class VulkanPipelineCache {
       const Shader& shader,
       Shader::HostVertexShaderType host_vertex_shader_type,
       uint32_t interpolator_mask, bool ps_param_gen_used) const;
+  // samples_counted is whether the draw is included in an occlusion query.
   SpirvShaderTranslator::Modification GetCurrentPixelShaderModification(
-      const Shader& shader, uint32_t interpolator_mask,
-      uint32_t param_gen_pos) const;
+      const Shader& shader, uint32_t interpolator_mask, uint32_t param_gen_pos,
+      bool samples_counted) const;
 
   bool EnsureShadersTranslated(VulkanShader::VulkanTranslation* vertex_shader,
                                VulkanShader::VulkanTranslation* pixel_shader);
-  // TODO(Triang3l): Return a deferred creation handle.
+  // Returns a handle of a pipeline that may still be created on the creation
+  // threads, which is done by the end of the submission, unless draws with
+  // pipelines not created yet are skipped, in which case this returns false for
+  // them.
   bool ConfigurePipeline(
       VulkanShader::VulkanTranslation* vertex_shader,
       VulkanShader::VulkanTranslation* pixel_shader,
@@ -86,10 +108,32 @@ class VulkanPipelineCache {
       reg::RB_DEPTHCONTROL normalized_depth_control,
       uint32_t normalized_color_mask,
       VulkanRenderTargetCache::RenderPassKey render_pass_key,
-      VkPipeline& pipeline_out,
+      void*& pipeline_handle_out,
       const PipelineLayoutProvider*& pipeline_layout_out);
 
+  // Returns a pipeline with deferred creation by its handle. May return
+  // VK_NULL_HANDLE if failed to create the pipeline.
+  VkPipeline GetVulkanPipelineByHandle(void* handle) const {
+    return reinterpret_cast<const Pipeline*>(handle)->pipeline.load(
+        std::memory_order_acquire);
+  }
+
  private:
+  // Same as in the Direct3D 12 shader storage, the guest shaders are
+  // independent from the host API.
+  XEPACKEDSTRUCT(ShaderStoredHeader, {
+    uint64_t ucode_data_hash;
+
+    uint32_t ucode_dword_count : 31;
+    xenos::ShaderType type : 1;
+
+    static constexpr uint32_t kVersion = 0x20201219;
+  });
+
+  VulkanShader* LoadShader(xenos::ShaderType shader_type,
+                           const uint32_t* host_address, uint32_t dword_count,
+                           uint64_t data_hash);
+
   enum class PipelineGeometryShader : uint32_t {
     kNone,
     kPointList,
@@ -198,14 +242,28 @@ class VulkanPipelineCache {
         return size_t(description.GetHash());
       }
     };
+
+    static constexpr uint32_t kVersion = 0x20221111;
+  });
+
+  XEPACKEDSTRUCT(PipelineStoredDescription, {
+    uint64_t description_hash;
+    PipelineDescription description;
   });
 
   struct Pipeline {
-    VkPipeline pipeline = VK_NULL_HANDLE;
+    // Set by the creation threads, VK_NULL_HANDLE if not created yet or if
+    // creation has failed.
+    std::atomic<VkPipeline> pipeline = {VK_NULL_HANDLE};
+    // If the pipeline has been linked from graphics pipeline libraries, the
+    // initial fast-linked pipeline, which may be replaced in `pipeline` by the
+    // one linked with link-time optimizations later, but must be kept until
+    // shutdown as it may be referenced by submitted command buffers.
+    VkPipeline fast_linked_pipeline = VK_NULL_HANDLE;
     // The layouts are owned by the VulkanCommandProcessor, and must not be
     // destroyed by it while the pipeline cache is active.
     const PipelineLayoutProvider* pipeline_layout;
-    Pipeline(const PipelineLayoutProvider* pipeline_layout_provider)
+    explicit Pipeline(const PipelineLayoutProvider* pipeline_layout_provider)
         : pipeline_layout(pipeline_layout_provider) {}
   };
 
@@ -217,6 +275,79 @@ class VulkanPipelineCache {
     const VulkanShader::VulkanTranslation* pixel_shader;
     VkShaderModule geometry_shader;
     VkRenderPass render_pass;
+    // Whether to fast-link the pipeline from graphics pipeline libraries, and
+    // to link the optimized version later.
+    bool use_pipeline_libraries;
+  };
+
+  // Keys of the parts of the pipelines that can be created as graphics
+  // pipeline libraries, hashed and compared as raw bytes, so they must be
+  // zeroed before filling.
+  struct PipelineVertexInputLibraryKey {
+    VkPrimitiveTopology topology;
+    VkBool32 primitive_restart_enable;
+    PipelineVertexInputLibraryKey() { Reset(); }
+    void Reset() { std::memset(this, 0, sizeof(*this)); }
+    bool operator==(const PipelineVertexInputLibraryKey& key) const {
+      return std::memcmp(this, &key, sizeof(*this)) == 0;
+    }
+  };
+  struct PipelinePreRasterizationLibraryKey {
+    VkPipelineLayout layout;
+    VkRenderPass render_pass;
+    VkShaderModule vertex_shader;
+    VkShaderModule geometry_shader;
+    VkBool32 depth_clamp_enable;
+    VkPolygonMode polygon_mode;
+    VkCullModeFlags cull_mode;
+    VkFrontFace front_face;
+    VkBool32 depth_bias_enable;
+    PipelinePreRasterizationLibraryKey() { Reset(); }
+    void Reset() { std::memset(this, 0, sizeof(*this)); }
+    bool operator==(const PipelinePreRasterizationLibraryKey& key) const {
+      return std::memcmp(this, &key, sizeof(*this)) == 0;
+    }
+  };
+  struct PipelineFragmentShaderLibraryKey {
+    VkPipelineLayout layout;
+    VkRenderPass render_pass;
+    VkShaderModule fragment_shader;
+    VkSampleCountFlagBits rasterization_samples;
+    VkSampleMask sample_mask;
+    VkBool32 depth_test_enable;
+    VkBool32 depth_write_enable;
+    VkCompareOp depth_compare_op;
+    VkBool32 stencil_test_enable;
+    VkStencilOpState stencil_front;
+    VkStencilOpState stencil_back;
+    PipelineFragmentShaderLibraryKey() { Reset(); }
+    void Reset() { std::memset(this, 0, sizeof(*this)); }
+    bool operator==(const PipelineFragmentShaderLibraryKey& key) const {
+      return std::memcmp(this, &key, sizeof(*this)) == 0;
+    }
+  };
+  struct PipelineFragmentOutputLibraryKey {
+    VkRenderPass render_pass;
+    VkSampleCountFlagBits rasterization_samples;
+    VkSampleMask sample_mask;
+    uint32_t color_attachment_count;
+    VkPipelineColorBlendAttachmentState
+        color_attachments[xenos::kMaxColorRenderTargets];
+    PipelineFragmentOutputLibraryKey() { Reset(); }
+    void Reset() { std::memset(this, 0, sizeof(*this)); }
+    bool operator==(const PipelineFragmentOutputLibraryKey& key) const {
+      return std::memcmp(this, &key, sizeof(*this)) == 0;
+    }
+  };
+  template <typename Key>
+  using PipelineLibraryMap =
+      std::unordered_map<Key, VkPipeline, xe::hash::XXHasher<Key>>;
+
+  // Request for linking a pipeline with link-time optimizations in the
+  // background after it has been fast-linked.
+  struct PipelineOptimizedLinkArguments {
+    std::pair<const PipelineDescription, Pipeline>* pipeline;
+    std::array<VkPipeline, 4> libraries;
   };
 
   union GeometryShaderKey {
@@ -277,6 +408,33 @@ class VulkanPipelineCache {
   // render pass objects must be available.
   bool EnsurePipelineCreated(
       const PipelineCreationArguments& creation_arguments);
+  // Returns the existing library or creates a new one - can be called from
+  // creation threads. Returns VK_NULL_HANDLE in case of a failure.
+  template <typename Key>
+  VkPipeline GetPipelineLibrary(
+      PipelineLibraryMap<Key>& libraries, const Key& key,
+      const VkGraphicsPipelineCreateInfo& library_create_info);
+  // Can be called from creation threads.
+  void LinkOptimizedPipeline(const PipelineOptimizedLinkArguments& arguments);
+  // Queues the shader storage write for the microcode of a newly translated
+  // shader.
+  void QueueShaderStorageWrite(Shader& shader);
+  // If not translated yet, queues the shader for translation on a creation
+  // thread. Only called when there are creation threads.
+  void RequestShaderTranslation(VulkanShader::VulkanTranslation& translation);
+  // Can be called from creation threads.
+  void TranslateRequestedShader(SpirvShaderTranslator& translator,
+                                StringBuffer& ucode_disasm_buffer,
+                                VulkanShader::VulkanTranslation& translation);
+  // Creates the pipeline on a creation thread if there are any, or immediately.
+  void RequestPipelineCreation(
+      const PipelineCreationArguments& creation_arguments);
+  // Returns whether the pipeline can be used for the draw, and if it can, its
+  // handle for the deferred command buffer.
+  bool ReturnPipeline(
+      const std::pair<const PipelineDescription, Pipeline>& pipeline,
+      void*& pipeline_handle_out,
+      const PipelineLayoutProvider*& pipeline_layout_out) const;
 
   VulkanCommandProcessor& command_processor_;
   const RegisterFile& register_file_;
@@ -287,6 +445,8 @@ class VulkanPipelineCache {
   StringBuffer ucode_disasm_buffer_;
   // Reusable shader translator on the command processor thread.
   std::unique_ptr<SpirvShaderTranslator> shader_translator_;
+  // Initialized only if the optimizer is available and enabled.
+  ui::vulkan::SpirvToolsContext spirv_tools_context_;
 
   struct LayoutUID {
     size_t uid;
@@ -321,9 +481,103 @@ class VulkanPipelineCache {
   std::unordered_map<PipelineDescription, Pipeline, PipelineDescription::Hasher>
       pipelines_;
 
+  // Whether new pipelines are fast-linked from graphics pipeline libraries on
+  // the creation threads.
+  bool pipeline_libraries_used_ = false;
+  // Graphics pipeline libraries, can be accessed by the creation threads.
+  std::mutex pipeline_libraries_mutex_;
+  PipelineLibraryMap<PipelineVertexInputLibraryKey>
+      pipeline_vertex_input_libraries_;
+  PipelineLibraryMap<PipelinePreRasterizationLibraryKey>
+      pipeline_pre_rasterization_libraries_;
+  PipelineLibraryMap<PipelineFragmentShaderLibraryKey>
+      pipeline_fragment_shader_libraries_;
+  PipelineLibraryMap<PipelineFragmentOutputLibraryKey>
+      pipeline_fragment_output_libraries_;
+
   // Previously used pipeline, to avoid lookups if the state wasn't changed.
   const std::pair<const PipelineDescription, Pipeline>* last_pipeline_ =
       nullptr;
+
+  // Shader storage output stream, for preload in the next emulator runs.
+  FILE* shader_storage_file_ = nullptr;
+  // For only writing shaders to the currently open storage once, incremented
+  // when switching the storage.
+  uint32_t shader_storage_index_ = 0;
+  bool shader_storage_file_flush_needed_ = false;
+
+  // Pipeline storage output stream, for preload in the next emulator runs.
+  FILE* pipeline_storage_file_ = nullptr;
+  bool pipeline_storage_file_flush_needed_ = false;
+
+  // Driver pipeline cache for the current title, shared by the creation
+  // threads (internally synchronized by the driver), stored in a file specific
+  // to the device and the driver version.
+  VkPipelineCache vulkan_pipeline_cache_ = VK_NULL_HANDLE;
+  std::filesystem::path vulkan_pipeline_cache_file_path_;
+  // Owned by the storage writing thread while it's running.
+  size_t vulkan_pipeline_cache_written_size_ = 0;
+  uint64_t vulkan_pipeline_cache_write_host_tick_ = 0;
+  static constexpr uint32_t kVulkanPipelineCacheWriteIntervalSeconds = 30;
+  // Safe to call from the storage writing thread.
+  void WriteVulkanPipelineCacheData();
+
+  // Thread for asynchronous writing to the storage streams.
+  void StorageWriteThread();
+  std::mutex storage_write_request_lock_;
+  std::condition_variable storage_write_request_cond_;
+  // Storage thread input is protected with storage_write_request_lock_, and the
+  // thread is notified about its change via storage_write_request_cond_.
+  std::deque<const Shader*> storage_write_shader_queue_;
+  std::deque<PipelineStoredDescription> storage_write_pipeline_queue_;
+  bool storage_write_flush_shaders_ = false;
+  bool storage_write_flush_pipelines_ = false;
+  bool storage_write_thread_shutdown_ = false;
+  std::unique_ptr<xe::threading::Thread> storage_write_thread_;
+
+  // Pipeline creation threads.
+  void CreationThread(size_t thread_index);
+  void CreateQueuedPipelinesOnProcessorThread();
+  void TranslateQueuedShadersOnProcessorThread();
+  // Waits for the pipelines being created on the creation threads.
+  void AwaitPipelineCreationCompletion();
+  xe_mutex creation_request_lock_;
+  std::condition_variable_any creation_request_cond_;
+  // Protected with creation_request_lock_, notify_one creation_request_cond_
+  // when set.
+  std::deque<PipelineCreationArguments> creation_queue_;
+  // Number of threads that are currently creating a pipeline - incremented when
+  // a pipeline is dequeued (the completion event can't be triggered before this
+  // is zero). Protected with creation_request_lock_.
+  size_t creation_threads_busy_ = 0;
+  // Manual-reset event set when the last queued pipeline is created and there
+  // are no more pipelines to create. This is triggered by the thread creating
+  // the last pipeline.
+  std::unique_ptr<xe::threading::Event> creation_completion_event_;
+  // Whether setting the event on completion is queued. Protected with
+  // creation_request_lock_, notify_one creation_request_cond_ when set.
+  bool creation_completion_set_event_ = false;
+  // Creation threads with this index or above need to be shut down as soon as
+  // possible. Protected with creation_request_lock_, notify_all
+  // creation_request_cond_ when set.
+  size_t creation_threads_shutdown_from_ = SIZE_MAX;
+  std::vector<std::unique_ptr<xe::threading::Thread>> creation_threads_;
+  // Pipelines to link with link-time optimizations, done by the creation
+  // threads when there are no pipelines to create, and not awaited at the end
+  // of submissions. Protected with creation_request_lock_, notify_one
+  // creation_request_cond_ when added.
+  std::deque<PipelineOptimizedLinkArguments> creation_optimized_link_queue_;
+  // Shaders needed by draws, translated with a higher priority than creating
+  // pipelines since the pipelines depend on them. Protected with
+  // creation_request_lock_, notify_one creation_request_cond_ when added.
+  std::deque<VulkanShader::VulkanTranslation*> creation_translation_queue_;
+  // Notified by the creation threads (with creation_request_lock_ having been
+  // acquired after the completion) when a requested translation is completed.
+  std::condition_variable_any creation_translation_completion_cond_;
+  // Newly loaded shaders to analyze the microcode of in advance when there's
+  // nothing else to do on the creation threads. Protected with
+  // creation_request_lock_, notify_one creation_request_cond_ when added.
+  std::deque<VulkanShader*> creation_analysis_queue_;
 };
 
 }  // namespace vulkan
@@ -47,7 +47,8 @@ bool VulkanPrimitiveProcessor::Initialize() {
           command_processor_.GetVulkanProvider(),
           VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
           std::max(size_t(kMinRequiredConvertedIndexBufferSize),
-                   ui::GraphicsUploadBufferPool::kDefaultPageSize));
+                   ui::GraphicsUploadBufferPool::kDefaultPageSize),
+          true);
   return true;
 }
 
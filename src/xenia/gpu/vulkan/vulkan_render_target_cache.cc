@@ -54,6 +54,15 @@ DEFINE_string(
     "  Choose what is considered the most optimal for the system (currently "
     "always FB because the FSI path is much slower now).",
     "GPU");
+DEFINE_uint32(
+    vulkan_unowned_render_target_release_frames, 0,
+    "Number of frames after which host render targets not bound anymore are "
+    "destroyed if none of the EDRAM contents is stored in them anymore, to "
+    "reduce the video memory usage in titles placing many render targets with "
+    "different layouts in the same EDRAM area, especially with resolution "
+    "scaling. 0 to keep all render targets (recreating them later may cause "
+    "stuttering).",
+    "Vulkan");
 
 namespace xe {
 namespace gpu {
@@ -598,7 +607,8 @@ bool VulkanRenderTargetCache::Initialize(uint32_t shared_memory_binding_count) {
             std::max(ui::vulkan::VulkanUploadBufferPool::kDefaultPageSize,
                      sizeof(float) * 2 * 6 *
                          Transfer::kMaxCutoutBorderRectangles *
-                         xenos::kEdramTileCount));
+                         xenos::kEdramTileCount),
+            true);
 
     // Transfer vertex shader.
     transfer_passthrough_vertex_shader_ = ui::vulkan::util::CreateShaderModule(
@@ -892,6 +902,7 @@ void VulkanRenderTargetCache::Shutdown(bool from_destructor) {
   // so ShutdownCommon is called by the RenderTargetCache destructor, when it's
   // already too late.
   DestroyAllRenderTargets(true);
+  DestroyReleasedObjects(UINT64_MAX);
 
   ui::vulkan::util::DestroyAndNullHandle(dfn.vkDestroyPipeline, device,
                                          resolve_fsi_clear_64bpp_pipeline_);
@@ -999,6 +1010,9 @@ void VulkanRenderTargetCache::ClearCache() {
   const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
   VkDevice device = provider.device();
 
+  // The GPU is idle when the cache is cleared.
+  DestroyReleasedObjects(UINT64_MAX);
+
   // Framebuffer objects must be destroyed because they reference views of
   // attachment images, which may be removed by the common ClearCache.
   last_update_framebuffer_ = VK_NULL_HANDLE;
@@ -1018,9 +1032,102 @@ void VulkanRenderTargetCache::ClearCache() {
 }
 
 void VulkanRenderTargetCache::CompletedSubmissionUpdated() {
+  uint64_t completed_submission = command_processor_.GetCompletedSubmission();
   if (transfer_vertex_buffer_pool_) {
-    transfer_vertex_buffer_pool_->Reclaim(
-        command_processor_.GetCompletedSubmission());
+    transfer_vertex_buffer_pool_->Reclaim(completed_submission);
+  }
+  DestroyReleasedObjects(completed_submission);
+}
+
+void VulkanRenderTargetCache::ReleaseUnownedRenderTargets() {
+  uint32_t release_frames = cvars::vulkan_unowned_render_target_release_frames;
+  if (!release_frames || GetPath() != Path::kHostRenderTargets) {
+    return;
+  }
+  uint64_t current_frame = command_processor_.GetCurrentFrame();
+  std::vector<RenderTarget*> released_render_targets;
+  TakeUnownedRenderTargets(
+      [current_frame, release_frames](const RenderTarget& render_target) {
+        return current_frame -
+                   static_cast<const VulkanRenderTarget&>(render_target)
+                       .last_usage_frame() >=
+               release_frames;
+      },
+      released_render_targets);
+  if (released_render_targets.empty()) {
+    return;
+  }
+
+  uint64_t current_submission = command_processor_.GetCurrentSubmission();
+
+  // Framebuffers are looked up by the EDRAM layout, not by the render target
+  // objects, the ones that may be referencing the released render targets
+  // must not be reused. The formats are not checked for simplicity - just
+  // recreating the others if needed.
+  for (RenderTarget* render_target : released_render_targets) {
+    RenderTargetKey rt_key = render_target->key();
+    XELOGGPU("Releasing the unused {}", rt_key.GetDebugName());
+    for (auto it = framebuffers_.begin(); it != framebuffers_.end();) {
+      const FramebufferKey& framebuffer_key = it->first;
+      uint32_t rts_used = framebuffer_key.render_pass_key.depth_and_color_used;
+      bool references_rt = false;
+      if (framebuffer_key.pitch_tiles_at_32bpp == rt_key.pitch_tiles_at_32bpp &&
+          framebuffer_key.render_pass_key.msaa_samples == rt_key.msaa_samples) {
+        if (rt_key.is_depth) {
+          references_rt = (rts_used & (1 << 0)) &&
+                          framebuffer_key.depth_base_tiles == rt_key.base_tiles;
+        } else {
+          references_rt =
+              ((rts_used & (1 << 1)) &&
+               framebuffer_key.color_0_base_tiles == rt_key.base_tiles) ||
+              ((rts_used & (1 << 2)) &&
+               framebuffer_key.color_1_base_tiles == rt_key.base_tiles) ||
+              ((rts_used & (1 << 3)) &&
+               framebuffer_key.color_2_base_tiles == rt_key.base_tiles) ||
+              ((rts_used & (1 << 4)) &&
+               framebuffer_key.color_3_base_tiles == rt_key.base_tiles);
+        }
+      }
+      if (!references_rt) {
+        ++it;
+        continue;
+      }
+      // May still be used by the submissions in flight.
+      released_framebuffers_.emplace_back(current_submission,
+                                          it->second.framebuffer);
+      it = framebuffers_.erase(it);
+    }
+    // The last usage may be in the current submission, in a transfer.
+    released_render_targets_.emplace_back(current_submission, render_target);
+  }
+  // The cached attachment pointers may be reused by new render targets.
+  last_update_framebuffer_ = nullptr;
+
+  // In case there's no outstanding work on the GPU.
+  DestroyReleasedObjects(command_processor_.GetCompletedSubmission());
+}
+
+void VulkanRenderTargetCache::DestroyReleasedObjects(
+    uint64_t completed_submission) {
+  const ui::vulkan::VulkanProvider& provider =
+      command_processor_.GetVulkanProvider();
+  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+  VkDevice device = provider.device();
+  while (!released_framebuffers_.empty()) {
+    const auto& released_pair = released_framebuffers_.front();
+    if (released_pair.first > completed_submission) {
+      break;
+    }
+    dfn.vkDestroyFramebuffer(device, released_pair.second, nullptr);
+    released_framebuffers_.pop_front();
+  }
+  while (!released_render_targets_.empty()) {
+    const auto& released_pair = released_render_targets_.front();
+    if (released_pair.first > completed_submission) {
+      break;
+    }
+    delete released_pair.second;
+    released_render_targets_.pop_front();
   }
 }
 
@@ -1053,6 +1160,9 @@ bool VulkanRenderTargetCache::Resolve(const Memory& memory,
     return true;
   }
 
+  command_processor_.SetGpuTimestampPhase(
+      VulkanCommandProcessor::GpuTimestampPhase::kResolves);
+
   const ui::vulkan::VulkanProvider& provider =
       command_processor_.GetVulkanProvider();
   const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
@@ -1135,6 +1245,11 @@ bool VulkanRenderTargetCache::Resolve(const Memory& memory,
                                      nullptr);
 
           // Submit the resolve.
+          // Recorded on the graphics queue rather than the asynchronous one
+          // used for texture loading, as the resolve reads what the preceding
+          // draws have written to the EDRAM, and the following draws usually
+          // sample the result, so there's nothing to overlap it with, while
+          // the cross-queue semaphores would only add latency.
           // TODO(Triang3l): Transition the scaled resolve buffer.
           shared_memory.Use(VulkanSharedMemory::Usage::kComputeWrite,
                             std::pair<uint32_t, uint32_t>(
@@ -1171,6 +1286,12 @@ bool VulkanRenderTargetCache::Resolve(const Memory& memory,
                                        1);
 
           // Invalidate textures and mark the range as scaled if needed.
+          // TODO(Triang3l): For resolves to a single tiled 2D surface with a
+          // host texture format matching the destination format, write to the
+          // host image of the texture directly (with separate copy shaders
+          // writing the host layout) instead of making the texture cache load
+          // the resolved data from the shared memory again, and write the
+          // shared memory lazily only when the CPU or memexport needs it.
           texture_cache.MarkRangeAsResolved(
               resolve_info.copy_dest_extent_start,
               resolve_info.copy_dest_extent_length);
@@ -1297,6 +1418,19 @@ bool VulkanRenderTargetCache::Update(
                                        depth_and_color_render_targets,
                                        last_update_transfers());
 
+      // Render targets not drawn to or transferred to since their creation
+      // have undefined contents, loading them is only a waste of bandwidth,
+      // which is especially costly on tile-based GPUs. Entering them requires
+      // a layout transition, so such a render pass is always begun anew.
+      uint32_t undefined_contents_attachments = 0;
+      for (uint32_t i = 0; i < 1 + xenos::kMaxColorRenderTargets; ++i) {
+        RenderTarget* rt = depth_and_color_render_targets[i];
+        if (rt && static_cast<VulkanRenderTarget*>(rt)->current_layout() ==
+                      VK_IMAGE_LAYOUT_UNDEFINED) {
+          undefined_contents_attachments |= uint32_t(1) << i;
+        }
+      }
+
       uint32_t render_targets_are_srgb =
           gamma_render_target_as_srgb_
               ? last_update_accumulated_color_targets_are_gamma()
@@ -1337,11 +1471,15 @@ bool VulkanRenderTargetCache::Update(
       }
 
       const Framebuffer* framebuffer = last_update_framebuffer_;
-      VkRenderPass render_pass = last_update_render_pass_key_ == render_pass_key
-                                     ? last_update_render_pass_
-                                     : VK_NULL_HANDLE;
+      VkRenderPass render_pass =
+          (last_update_render_pass_key_ == render_pass_key &&
+           last_update_render_pass_undefined_contents_attachments_ ==
+               undefined_contents_attachments)
+              ? last_update_render_pass_
+              : VK_NULL_HANDLE;
       if (render_pass == VK_NULL_HANDLE) {
-        render_pass = GetHostRenderTargetsRenderPass(render_pass_key);
+        render_pass = GetHostRenderTargetsRenderPass(
+            render_pass_key, undefined_contents_attachments);
         if (render_pass == VK_NULL_HANDLE) {
           return false;
         }
@@ -1375,6 +1513,8 @@ bool VulkanRenderTargetCache::Update(
       // Successful update - write the new configuration.
       last_update_render_pass_key_ = render_pass_key;
       last_update_render_pass_ = render_pass;
+      last_update_render_pass_undefined_contents_attachments_ =
+          undefined_contents_attachments;
       last_update_framebuffer_pitch_tiles_at_32bpp_ = pitch_tiles_at_32bpp;
       std::memcpy(last_update_framebuffer_attachments_,
                   depth_and_color_render_targets,
@@ -1388,6 +1528,7 @@ bool VulkanRenderTargetCache::Update(
           continue;
         }
         auto& vulkan_rt = *static_cast<VulkanRenderTarget*>(rt);
+        vulkan_rt.SetLastUsageFrame(command_processor_.GetCurrentFrame());
         VkPipelineStageFlags rt_dst_stage_mask;
         VkAccessFlags rt_dst_access_mask;
         VkImageLayout rt_new_layout;
@@ -1432,10 +1573,13 @@ bool VulkanRenderTargetCache::Update(
 }
 
 VkRenderPass VulkanRenderTargetCache::GetHostRenderTargetsRenderPass(
-    RenderPassKey key) {
+    RenderPassKey key, uint32_t undefined_contents_attachments) {
   assert_true(GetPath() == Path::kHostRenderTargets);
 
-  auto it = render_passes_.find(key);
+  undefined_contents_attachments &= key.depth_and_color_used;
+  uint64_t render_pass_map_key =
+      uint64_t(key.key) | (uint64_t(undefined_contents_attachments) << 32);
+  auto it = render_passes_.find(render_pass_map_key);
   if (it != render_passes_.end()) {
     return it->second;
   }
@@ -1463,9 +1607,12 @@ VkRenderPass VulkanRenderTargetCache::GetHostRenderTargetsRenderPass(
     attachment.flags = 0;
     attachment.format = GetDepthVulkanFormat(key.depth_format);
     attachment.samples = samples;
-    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    VkAttachmentLoadOp load_op = (undefined_contents_attachments & 0b1)
+                                     ? VK_ATTACHMENT_LOAD_OP_DONT_CARE
+                                     : VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachment.loadOp = load_op;
     attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachment.stencilLoadOp = load_op;
     attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_STORE;
     attachment.initialLayout = VulkanRenderTarget::kDepthDrawLayout;
     attachment.finalLayout = VulkanRenderTarget::kDepthDrawLayout;
@@ -1496,7 +1643,9 @@ VkRenderPass VulkanRenderTargetCache::GetHostRenderTargetsRenderPass(
             ? GetColorOwnershipTransferVulkanFormat(color_format)
             : GetColorVulkanFormat(color_format);
     attachment.samples = samples;
-    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    attachment.loadOp = (undefined_contents_attachments & attachment_bit)
+                            ? VK_ATTACHMENT_LOAD_OP_DONT_CARE
+                            : VK_ATTACHMENT_LOAD_OP_LOAD;
     attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
@@ -1571,10 +1720,10 @@ VkRenderPass VulkanRenderTargetCache::GetHostRenderTargetsRenderPass(
   if (dfn.vkCreateRenderPass(device, &render_pass_create_info, nullptr,
                              &render_pass) != VK_SUCCESS) {
     XELOGE("VulkanRenderTargetCache: Failed to create a render pass");
-    render_passes_.emplace(key, VK_NULL_HANDLE);
+    render_passes_.emplace(render_pass_map_key, VK_NULL_HANDLE);
     return VK_NULL_HANDLE;
   }
-  render_passes_.emplace(key, render_pass);
+  render_passes_.emplace(render_pass_map_key, render_pass);
   return render_pass;
 }
 
@@ -4499,6 +4648,9 @@ void VulkanRenderTargetCache::PerformTransfersAndResolveClears(
     const Transfer::Rectangle* resolve_clear_rectangle) {
   assert_true(GetPath() == Path::kHostRenderTargets);
 
+  command_processor_.SetGpuTimestampPhase(
+      VulkanCommandProcessor::GpuTimestampPhase::kRenderTargetTransfers);
+
   const ui::vulkan::VulkanProvider& provider =
       command_processor_.GetVulkanProvider();
   const VkPhysicalDeviceLimits& device_limits =
@@ -4631,6 +4783,9 @@ void VulkanRenderTargetCache::PerformTransfersAndResolveClears(
   // use, choose the destination state, otherwise the source state - to match
   // the order in which transfers will actually happen (otherwise there will be
   // just a useless switch back and forth).
+  // Destinations not used since their creation don't need to be loaded in the
+  // transfer render pass.
+  uint32_t undefined_contents_render_targets = 0;
   for (uint32_t i = 0; i < render_target_count; ++i) {
     RenderTarget* dest_rt = render_targets[i];
     if (!dest_rt) {
@@ -4640,6 +4795,10 @@ void VulkanRenderTargetCache::PerformTransfersAndResolveClears(
     if (!resolve_clear_needed && dest_transfers.empty()) {
       continue;
     }
+    if (static_cast<VulkanRenderTarget*>(dest_rt)->current_layout() ==
+        VK_IMAGE_LAYOUT_UNDEFINED) {
+      undefined_contents_render_targets |= uint32_t(1) << i;
+    }
     // Transition the destination, only if not going to be used as a source
     // earlier.
     bool dest_used_previously_as_source = false;
@@ -4800,6 +4959,18 @@ void VulkanRenderTargetCache::PerformTransfersAndResolveClears(
     if (transfer_render_pass == VK_NULL_HANDLE) {
       continue;
     }
+    // Only for beginning the render pass for the first time for the
+    // destination - if it's interrupted, the contents written so far must be
+    // loaded when the render pass is resumed.
+    VkRenderPass transfer_begin_render_pass = transfer_render_pass;
+    if (undefined_contents_render_targets & (uint32_t(1) << i)) {
+      transfer_begin_render_pass = GetHostRenderTargetsRenderPass(
+          transfer_render_pass_key,
+          transfer_render_pass_key.depth_and_color_used);
+      if (transfer_begin_render_pass == VK_NULL_HANDLE) {
+        transfer_begin_render_pass = transfer_render_pass;
+      }
+    }
     const RenderTarget*
         transfer_framebuffer_render_targets[1 + xenos::kMaxColorRenderTargets] =
             {};
@@ -4964,7 +5135,8 @@ void VulkanRenderTargetCache::PerformTransfersAndResolveClears(
       // Perform the transfers for the render target.
 
       command_processor_.SubmitBarriersAndEnterRenderTargetCacheRenderPass(
-          transfer_render_pass, transfer_framebuffer);
+          transfer_begin_render_pass, transfer_framebuffer);
+      transfer_begin_render_pass = transfer_render_pass;
 
       if (stencil_clear_rectangle_count) {
         VkClearAttachment* stencil_clear_attachment;
@@ -5027,31 +5199,124 @@ void VulkanRenderTargetCache::PerformTransfersAndResolveClears(
       transfer_scissor.extent = transfer_framebuffer->host_extent;
       command_processor_.SetScissor(transfer_scissor);
 
-      for (auto it = current_transfer_invocations_.cbegin();
-           it != current_transfer_invocations_.cend(); ++it) {
-        const TransferInvocation& transfer_invocation_first = *it;
-        // Will be merging transfers from the same source into one mesh.
-        auto it_merged_first = it, it_merged_last = it;
-        uint32_t transfer_rectangle_count =
-            transfer_invocation_first.transfer.GetRectangles(
+      // Gather the rectangles for all the draws to the render target into one
+      // vertex buffer. Transfers from the same source are merged into one draw,
+      // and within a draw, adjacent rectangles (such as the end of one tile
+      // range and the beginning of the next one in the same row, or full rows)
+      // are coalesced to draw fewer, larger triangles.
+      current_transfer_draws_.clear();
+      current_transfer_rectangles_.clear();
+      for (size_t j = 0; j < current_transfer_invocations_.size(); ++j) {
+        const TransferInvocation& transfer_invocation =
+            current_transfer_invocations_[j];
+        if (current_transfer_draws_.empty() ||
+            !current_transfer_invocations_[current_transfer_draws_.back()
+                                               .invocation_index]
+                 .CanBeMergedIntoOneDraw(transfer_invocation)) {
+          TransferDraw& new_transfer_draw =
+              current_transfer_draws_.emplace_back();
+          new_transfer_draw.invocation_index = j;
+          new_transfer_draw.first_rectangle =
+              uint32_t(current_transfer_rectangles_.size());
+          new_transfer_draw.rectangle_count = 0;
+        }
+        TransferDraw& transfer_draw = current_transfer_draws_.back();
+        Transfer::Rectangle
+            transfer_invocation_rectangles[Transfer::kMaxRectanglesWithCutout];
+        uint32_t transfer_invocation_rectangle_count =
+            transfer_invocation.transfer.GetRectangles(
                 dest_rt_key.base_tiles, dest_pitch_tiles,
-                dest_rt_key.msaa_samples, dest_is_64bpp, nullptr,
-                resolve_clear_rectangle);
-        for (auto it_merge = std::next(it_merged_first);
-             it_merge != current_transfer_invocations_.cend(); ++it_merge) {
-          if (!transfer_invocation_first.CanBeMergedIntoOneDraw(*it_merge)) {
-            break;
+                dest_rt_key.msaa_samples, dest_is_64bpp,
+                transfer_invocation_rectangles, resolve_clear_rectangle);
+        assert_not_zero(transfer_invocation_rectangle_count);
+        for (uint32_t k = 0; k < transfer_invocation_rectangle_count; ++k) {
+          const Transfer::Rectangle& transfer_rectangle =
+              transfer_invocation_rectangles[k];
+          if (transfer_draw.rectangle_count) {
+            Transfer::Rectangle& last_rectangle =
+                current_transfer_rectangles_.back();
+            if (last_rectangle.y_pixels == transfer_rectangle.y_pixels &&
+                last_rectangle.height_pixels ==
+                    transfer_rectangle.height_pixels &&
+                last_rectangle.x_pixels + last_rectangle.width_pixels ==
+                    transfer_rectangle.x_pixels) {
+              last_rectangle.width_pixels += transfer_rectangle.width_pixels;
+              continue;
+            }
+            if (last_rectangle.x_pixels == transfer_rectangle.x_pixels &&
+                last_rectangle.width_pixels ==
+                    transfer_rectangle.width_pixels &&
+                last_rectangle.y_pixels + last_rectangle.height_pixels ==
+                    transfer_rectangle.y_pixels) {
+              last_rectangle.height_pixels += transfer_rectangle.height_pixels;
+              continue;
+            }
           }
-          transfer_rectangle_count += it_merge->transfer.GetRectangles(
-              dest_rt_key.base_tiles, dest_pitch_tiles,
-              dest_rt_key.msaa_samples, dest_is_64bpp, nullptr,
-              resolve_clear_rectangle);
-          it_merged_last = it_merge;
+          current_transfer_rectangles_.push_back(transfer_rectangle);
+          ++transfer_draw.rectangle_count;
+        }
+      }
+      VkBuffer transfer_vertex_buffer;
+      VkDeviceSize transfer_vertex_buffer_offset;
+      float* transfer_rectangle_write_ptr =
+          reinterpret_cast<float*>(transfer_vertex_buffer_pool_->Request(
+              current_submission,
+              sizeof(float) * 2 * 6 * current_transfer_rectangles_.size(),
+              sizeof(float), transfer_vertex_buffer,
+              transfer_vertex_buffer_offset));
+      if (!transfer_rectangle_write_ptr) {
+        current_transfer_draws_.clear();
+      } else {
+        for (const Transfer::Rectangle& transfer_rectangle :
+             current_transfer_rectangles_) {
+          float transfer_rectangle_x0 =
+              -1.0f + transfer_rectangle.x_pixels * pixels_to_ndc_x;
+          float transfer_rectangle_y0 =
+              -1.0f + transfer_rectangle.y_pixels * pixels_to_ndc_y;
+          float transfer_rectangle_x1 =
+              transfer_rectangle_x0 +
+              transfer_rectangle.width_pixels * pixels_to_ndc_x;
+          float transfer_rectangle_y1 =
+              transfer_rectangle_y0 +
+              transfer_rectangle.height_pixels * pixels_to_ndc_y;
+          // O-*
+          // |/
+          // *
+          *(transfer_rectangle_write_ptr++) = transfer_rectangle_x0;
+          *(transfer_rectangle_write_ptr++) = transfer_rectangle_y0;
+          // *-*
+          // |/
+          // O
+          *(transfer_rectangle_write_ptr++) = transfer_rectangle_x0;
+          *(transfer_rectangle_write_ptr++) = transfer_rectangle_y1;
+          // *-O
+          // |/
+          // *
+          *(transfer_rectangle_write_ptr++) = transfer_rectangle_x1;
+          *(transfer_rectangle_write_ptr++) = transfer_rectangle_y0;
+          //   O
+          //  /|
+          // *-*
+          *(transfer_rectangle_write_ptr++) = transfer_rectangle_x1;
+          *(transfer_rectangle_write_ptr++) = transfer_rectangle_y0;
+          //   *
+          //  /|
+          // O-*
+          *(transfer_rectangle_write_ptr++) = transfer_rectangle_x0;
+          *(transfer_rectangle_write_ptr++) = transfer_rectangle_y1;
+          //   *
+          //  /|
+          // *-O
+          *(transfer_rectangle_write_ptr++) = transfer_rectangle_x1;
+          *(transfer_rectangle_write_ptr++) = transfer_rectangle_y1;
         }
-        assert_not_zero(transfer_rectangle_count);
-        // Skip the merged transfers in the subsequent iterations.
-        it = it_merged_last;
+        command_buffer.CmdVkBindVertexBuffers(0, 1, &transfer_vertex_buffer,
+                                              &transfer_vertex_buffer_offset);
+      }
 
+      for (const TransferDraw& transfer_draw : current_transfer_draws_) {
+        auto it = current_transfer_invocations_.cbegin() +
+                  transfer_draw.invocation_index;
         assert_not_null(it->transfer.source);
         auto& source_vulkan_rt =
             *static_cast<VulkanRenderTarget*>(it->transfer.source);
@@ -5073,75 +5338,6 @@ void VulkanRenderTargetCache::PerformTransfersAndResolveClears(
             (transfer_pipeline_layout_info.used_push_constant_dwords &
              kTransferUsedPushConstantDwordStencilMaskBit) != 0;
 
-        uint32_t transfer_vertex_count = 6 * transfer_rectangle_count;
-        VkBuffer transfer_vertex_buffer;
-        VkDeviceSize transfer_vertex_buffer_offset;
-        float* transfer_rectangle_write_ptr =
-            reinterpret_cast<float*>(transfer_vertex_buffer_pool_->Request(
-                current_submission, sizeof(float) * 2 * transfer_vertex_count,
-                sizeof(float), transfer_vertex_buffer,
-                transfer_vertex_buffer_offset));
-        if (!transfer_rectangle_write_ptr) {
-          continue;
-        }
-        for (auto it_merged = it_merged_first; it_merged <= it_merged_last;
-             ++it_merged) {
-          Transfer::Rectangle transfer_invocation_rectangles
-              [Transfer::kMaxRectanglesWithCutout];
-          uint32_t transfer_invocation_rectangle_count =
-              it_merged->transfer.GetRectangles(
-                  dest_rt_key.base_tiles, dest_pitch_tiles,
-                  dest_rt_key.msaa_samples, dest_is_64bpp,
-                  transfer_invocation_rectangles, resolve_clear_rectangle);
-          assert_not_zero(transfer_invocation_rectangle_count);
-          for (uint32_t j = 0; j < transfer_invocation_rectangle_count; ++j) {
-            const Transfer::Rectangle& transfer_rectangle =
-                transfer_invocation_rectangles[j];
-            float transfer_rectangle_x0 =
-                -1.0f + transfer_rectangle.x_pixels * pixels_to_ndc_x;
-            float transfer_rectangle_y0 =
-                -1.0f + transfer_rectangle.y_pixels * pixels_to_ndc_y;
-            float transfer_rectangle_x1 =
-                transfer_rectangle_x0 +
-                transfer_rectangle.width_pixels * pixels_to_ndc_x;
-            float transfer_rectangle_y1 =
-                transfer_rectangle_y0 +
-                transfer_rectangle.height_pixels * pixels_to_ndc_y;
-            // O-*
-            // |/
-            // *
-            *(transfer_rectangle_write_ptr++) = transfer_rectangle_x0;
-            *(transfer_rectangle_write_ptr++) = transfer_rectangle_y0;
-            // *-*
-            // |/
-            // O
-            *(transfer_rectangle_write_ptr++) = transfer_rectangle_x0;
-            *(transfer_rectangle_write_ptr++) = transfer_rectangle_y1;
-            // *-O
-            // |/
-            // *
-            *(transfer_rectangle_write_ptr++) = transfer_rectangle_x1;
-            *(transfer_rectangle_write_ptr++) = transfer_rectangle_y0;
-            //   O
-            //  /|
-            // *-*
-            *(transfer_rectangle_write_ptr++) = transfer_rectangle_x1;
-            *(transfer_rectangle_write_ptr++) = transfer_rectangle_y0;
-            //   *
-            //  /|
-            // O-*
-            *(transfer_rectangle_write_ptr++) = transfer_rectangle_x0;
-            *(transfer_rectangle_write_ptr++) = transfer_rectangle_y1;
-            //   *
-            //  /|
-            // *-O
-            *(transfer_rectangle_write_ptr++) = transfer_rectangle_x1;
-            *(transfer_rectangle_write_ptr++) = transfer_rectangle_y1;
-          }
-        }
-        command_buffer.CmdVkBindVertexBuffers(0, 1, &transfer_vertex_buffer,
-                                              &transfer_vertex_buffer_offset);
-
         const VkPipeline* transfer_pipelines = GetTransferPipelines(
             TransferPipelineKey(transfer_render_pass_key, transfer_shader_key));
         if (!transfer_pipelines) {
@@ -5322,7 +5518,8 @@ void VulkanRenderTargetCache::PerformTransfersAndResolveClears(
               command_buffer.CmdVkSetStencilWriteMask(
                   VK_STENCIL_FACE_FRONT_AND_BACK, transfer_stencil_bit);
             }
-            command_buffer.CmdVkDraw(transfer_vertex_count, 1, 0, 0);
+            command_buffer.CmdVkDraw(6 * transfer_draw.rectangle_count, 1,
+                                     6 * transfer_draw.first_rectangle, 0);
           }
         }
       }
@@ -5331,7 +5528,7 @@ void VulkanRenderTargetCache::PerformTransfersAndResolveClears(
     // Perform the clear.
     if (resolve_clear_needed) {
       command_processor_.SubmitBarriersAndEnterRenderTargetCacheRenderPass(
-          transfer_render_pass, transfer_framebuffer);
+          transfer_begin_render_pass, transfer_framebuffer);
       VkClearAttachment resolve_clear_attachment;
       resolve_clear_attachment.colorAttachment = 0;
       std::memset(&resolve_clear_attachment.clearValue, 0,
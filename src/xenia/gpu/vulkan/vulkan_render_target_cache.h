@@ -13,9 +13,11 @@
 #include <array>
 #include <cstdint>
 #include <cstring>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <unordered_map>
+#include <utility>
 
 #include "xenia/base/hash.h"
 #include "xenia/base/xxhash.h"
@@ -111,6 +113,10 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
 
   void CompletedSubmissionUpdated();
   void EndSubmission();
+  // Destroys the render targets with no EDRAM data that haven't been used for
+  // the configured number of frames. Call when opening a frame, not in the
+  // middle of an update.
+  void ReleaseUnownedRenderTargets();
 
   Path GetPath() const override { return path_; }
 
@@ -171,7 +177,12 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
   // Returns the render pass object, or VK_NULL_HANDLE if failed to create.
   // A render pass managed by the render target cache may be ended and resumed
   // at any time (to allow for things like copying and texture loading).
-  VkRenderPass GetHostRenderTargetsRenderPass(RenderPassKey key);
+  // The attachments in undefined_contents_attachments (same bits as
+  // depth_and_color_used) are not loaded when the render pass is begun - all
+  // variants of a render pass are compatible with each other, and its
+  // framebuffers and pipelines are created for the variant loading everything.
+  VkRenderPass GetHostRenderTargetsRenderPass(
+      RenderPassKey key, uint32_t undefined_contents_attachments = 0);
   VkRenderPass GetFragmentShaderInterlockRenderPass() const {
     assert_true(GetPath() == Path::kPixelShaderInterlock);
     return fsi_render_pass_;
@@ -299,6 +310,7 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
   // pass.
   RenderPassKey last_update_render_pass_key_;
   VkRenderPass last_update_render_pass_ = VK_NULL_HANDLE;
+  uint32_t last_update_render_pass_undefined_contents_attachments_ = 0;
   // The pitch is not used on the fragment shader interlock path.
   uint32_t last_update_framebuffer_pitch_tiles_at_32bpp_ = 0;
   // The attachments are not used on the fragment shader interlock path.
@@ -407,6 +419,9 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
       temporary_sort_index_ = index;
     }
 
+    uint64_t last_usage_frame() const { return last_usage_frame_; }
+    void SetLastUsageFrame(uint64_t frame) { last_usage_frame_ = frame; }
+
    private:
     VulkanRenderTargetCache& render_target_cache_;
 
@@ -431,6 +446,9 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
 
     // Temporary storage for indices in operations like transfers and dumps.
     uint32_t temporary_sort_index_ = 0;
+
+    // Last frame when the render target was bound for drawing.
+    uint64_t last_usage_frame_ = 0;
   };
 
   struct FramebufferKey {
@@ -703,6 +721,15 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
     }
   };
 
+  // Transfers from the same source merged into one draw, with the rectangles
+  // in current_transfer_rectangles_.
+  struct TransferDraw {
+    // Index of the first merged transfer in current_transfer_invocations_.
+    size_t invocation_index;
+    uint32_t first_rectangle;
+    uint32_t rectangle_count;
+  };
+
   union DumpPipelineKey {
     uint32_t key;
     struct {
@@ -840,6 +867,10 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
       RenderPassKey render_pass_key, uint32_t pitch_tiles_at_32bpp,
       const RenderTarget* const* depth_and_color_render_targets);
 
+  // Destroys the objects released by ReleaseUnownedRenderTargets that are not
+  // used by the GPU anymore.
+  void DestroyReleasedObjects(uint64_t completed_submission);
+
   VkShaderModule GetTransferShader(TransferShaderKey key);
   // With sample-rate shading, returns a pointer to one pipeline. Without
   // sample-rate shading, returns a pointer to as many pipelines as there are
@@ -873,12 +904,26 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
   bool msaa_2x_no_attachments_supported_ = false;
 
   // VK_NULL_HANDLE if failed to create.
-  std::unordered_map<RenderPassKey, VkRenderPass, RenderPassKey::Hasher>
-      render_passes_;
+  // TODO(Triang3l): With VK_KHR_dynamic_rendering, begin rendering directly on
+  // the image views, without creating render pass and framebuffer objects for
+  // every combination of host render targets, and create the guest and the
+  // transfer pipelines for the RenderPassKey formats rather than for render
+  // passes. The render pass layout transitions and the subpass dependencies
+  // would need to be replaced with explicit barriers, and
+  // VK_KHR_dynamic_rendering_local_read may be used for reading the
+  // attachments in the fragment shader interlock path.
+  // Keyed by the RenderPassKey in the lower 32 bits and the undefined contents
+  // attachments in the upper 32 bits.
+  std::unordered_map<uint64_t, VkRenderPass> render_passes_;
 
   std::unordered_map<FramebufferKey, Framebuffer, FramebufferKey::Hasher>
       framebuffers_;
 
+  // <Submission where last used, object> removed from the cache by
+  // ReleaseUnownedRenderTargets, sorted by the submission number.
+  std::deque<std::pair<uint64_t, VkFramebuffer>> released_framebuffers_;
+  std::deque<std::pair<uint64_t, RenderTarget*>> released_render_targets_;
+
   // Set 0 - EDRAM storage buffer, set 1 - source depth sampled image (and
   // unused stencil from the transfer descriptor set), HostDepthStoreConstants
   // passed via push constants.
@@ -914,6 +959,8 @@ class VulkanRenderTargetCache final : public RenderTargetCache {
 
   // Temporary storage for PerformTransfersAndResolveClears.
   std::vector<TransferInvocation> current_transfer_invocations_;
+  std::vector<TransferDraw> current_transfer_draws_;
+  std::vector<Transfer::Rectangle> current_transfer_rectangles_;
 
   // Temporary storage for DumpRenderTargets.
   std::vector<ResolveCopyDumpRectangle> dump_rectangles_;
@@ -10,7 +10,11 @@
 #include "xenia/gpu/vulkan/vulkan_shader.h"
 
 #include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
 
+#include "xenia/base/assert.h"
 #include "xenia/base/logging.h"
 #include "xenia/ui/vulkan/vulkan_provider.h"
 
@@ -27,6 +31,31 @@ VulkanShader::VulkanTranslation::~VulkanTranslation() {
   }
 }
 
+bool VulkanShader::VulkanTranslation::Optimize(
+    const ui::vulkan::SpirvToolsContext& spirv_tools_context) {
+  assert_true(shader_module_ == VK_NULL_HANDLE);
+  if (!is_valid()) {
+    return false;
+  }
+  const std::vector<uint8_t>& binary = translated_binary();
+  std::vector<uint32_t> optimized;
+  spv_result_t result = spirv_tools_context.Optimize(
+      reinterpret_cast<const uint32_t*>(binary.data()),
+      binary.size() / sizeof(uint32_t), optimized);
+  if (result != SPV_SUCCESS || optimized.empty()) {
+    XELOGW(
+        "VulkanShader::VulkanTranslation: Failed to optimize the SPIR-V for "
+        "shader {:016X} modification {:016X} (result {})",
+        shader().ucode_data_hash(), modification(), int(result));
+    return false;
+  }
+  std::vector<uint8_t> optimized_binary(optimized.size() * sizeof(uint32_t));
+  std::memcpy(optimized_binary.data(), optimized.data(),
+              optimized_binary.size());
+  set_translated_binary(std::move(optimized_binary));
+  return true;
+}
+
 VkShaderModule VulkanShader::VulkanTranslation::GetOrCreateShaderModule() {
   if (!is_valid()) {
     return VK_NULL_HANDLE;
@@ -10,10 +10,14 @@
 #ifndef XENIA_GPU_VULKAN_VULKAN_SHADER_H_
 #define XENIA_GPU_VULKAN_VULKAN_SHADER_H_
 
+#include <atomic>
 #include <cstdint>
+#include <mutex>
 
+#include "xenia/base/string_buffer.h"
 #include "xenia/gpu/spirv_shader.h"
 #include "xenia/gpu/xenos.h"
+#include "xenia/ui/vulkan/spirv_tools_context.h"
 #include "xenia/ui/vulkan/vulkan_provider.h"
 
 namespace xe {
@@ -28,11 +32,42 @@ class VulkanShader : public SpirvShader {
         : SpirvTranslation(shader, modification) {}
     ~VulkanTranslation() override;
 
+    // Replaces the translated SPIR-V with the optimized version, must be done
+    // before creating the shader module. In case of a failure, the original
+    // code is kept and false is returned.
+    bool Optimize(const ui::vulkan::SpirvToolsContext& spirv_tools_context);
     VkShaderModule GetOrCreateShaderModule();
     VkShaderModule shader_module() const { return shader_module_; }
 
+    // For translation on the pipeline creation threads. After requesting, the
+    // translation must not be accessed on the processor thread until
+    // is_async_translation_completed returns true.
+    void MarkAsyncTranslationRequested() {
+      async_translation_requested_ = true;
+    }
+    bool is_async_translation_requested() const {
+      return async_translation_requested_;
+    }
+    void CompleteAsyncTranslation(bool succeeded) {
+      async_translation_succeeded_ = succeeded;
+      async_translation_completed_.store(true, std::memory_order_release);
+    }
+    bool is_async_translation_completed() const {
+      return async_translation_completed_.load(std::memory_order_acquire);
+    }
+    // Only valid after is_async_translation_completed has returned true.
+    bool async_translation_succeeded() const {
+      return async_translation_succeeded_;
+    }
+
    private:
     VkShaderModule shader_module_ = VK_NULL_HANDLE;
+
+    // Only accessed on the processor thread.
+    bool async_translation_requested_ = false;
+    // Set on the thread that has translated the shader.
+    std::atomic<bool> async_translation_completed_{false};
+    bool async_translation_succeeded_ = false;
   };
 
   explicit VulkanShader(const ui::vulkan::VulkanProvider& provider,
@@ -63,12 +98,21 @@ class VulkanShader : public SpirvShader {
     sampler_binding_layout_user_uid_ = uid;
   }
 
+  // The microcode may be analyzed ahead of time on the pipeline creation
+  // threads, and the processor thread may need it at the same time.
+  void AnalyzeUcodeOnce(StringBuffer& ucode_disasm_buffer) {
+    std::lock_guard<std::mutex> lock(ucode_analysis_mutex_);
+    AnalyzeUcode(ucode_disasm_buffer);
+  }
+
  protected:
   Translation* CreateTranslationInstance(uint64_t modification) override;
 
  private:
   const ui::vulkan::VulkanProvider& provider_;
 
+  std::mutex ucode_analysis_mutex_;
+
   std::atomic_flag binding_layout_user_uids_set_up_ = ATOMIC_FLAG_INIT;
   size_t texture_binding_layout_user_uid_ = 0;
   size_t sampler_binding_layout_user_uid_ = 0;
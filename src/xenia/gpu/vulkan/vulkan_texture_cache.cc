@@ -14,6 +14,7 @@
 #include <utility>
 
 #include "xenia/base/assert.h"
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/base/profiling.h"
@@ -24,6 +25,23 @@
 #include "xenia/ui/vulkan/vulkan_mem_alloc.h"
 #include "xenia/ui/vulkan/vulkan_util.h"
 
+DEFINE_bool(
+    vulkan_async_texture_loading, false,
+    "Load textures used for the first time on a separate Vulkan queue, if the "
+    "device has one, so large loads don't delay the rendering. Until such a "
+    "texture has been loaded, usually for a frame or two, the null (black) "
+    "texture is used in its place.",
+    "GPU");
+DEFINE_uint32(
+    vulkan_texture_defragmentation_mb_per_frame, 0,
+    "Maximum amount of texture data in megabytes to move on the GPU per frame "
+    "to compact the texture memory fragmented by textures being created and "
+    "destroyed over long sessions, so large textures continue to fit without "
+    "evicting others or allocating more device memory. 0 to disable the "
+    "defragmentation.",
+    "GPU");
+DECLARE_bool(texture_cache_deduplication);
+
 namespace xe {
 namespace gpu {
 namespace vulkan {
@@ -427,6 +445,29 @@ VulkanTextureCache::~VulkanTextureCache() {
   const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
   VkDevice device = provider.device();
 
+  // The load batches use the pipelines, reference the textures, and own
+  // scratch buffers allocated using the Vulkan Memory Allocator.
+  AwaitAndDropAsyncLoadBatches();
+  for (const std::unique_ptr<AsyncLoadBatch>& batch :
+       async_load_batches_free_) {
+    if (batch->fence != VK_NULL_HANDLE) {
+      dfn.vkDestroyFence(device, batch->fence, nullptr);
+    }
+    if (batch->command_pool != VK_NULL_HANDLE) {
+      dfn.vkDestroyCommandPool(device, batch->command_pool, nullptr);
+    }
+  }
+  async_load_batches_free_.clear();
+  async_load_constants_pool_.reset();
+
+  // Dropping the data not read back yet.
+  for (const StorageTransferBuffer& transfer_buffer :
+       storage_transfer_buffers_) {
+    vmaDestroyBuffer(vma_allocator_, transfer_buffer.buffer,
+                     transfer_buffer.allocation);
+  }
+  storage_transfer_buffers_.clear();
+
   for (const std::pair<const SamplerParameters, Sampler>& sampler_pair :
        samplers_) {
     dfn.vkDestroySampler(device, sampler_pair.second.sampler, nullptr);
@@ -472,16 +513,92 @@ VulkanTextureCache::~VulkanTextureCache() {
 
   // Textures memory is allocated using the Vulkan Memory Allocator, destroy all
   // textures before destroying VMA.
+  if (texture_defragmentation_pass_submission_) {
+    EndTextureDefragmentationPass();
+  }
+  if (texture_defragmentation_context_ != VK_NULL_HANDLE) {
+    EndTextureDefragmentation();
+  }
   DestroyAllTextures(true);
 
+  if (texture_pool_ != VK_NULL_HANDLE) {
+    vmaDestroyPool(vma_allocator_, texture_pool_);
+  }
   if (vma_allocator_ != VK_NULL_HANDLE) {
     vmaDestroyAllocator(vma_allocator_);
   }
 }
 
+void VulkanTextureCache::ClearCache() {
+  // The load batches reference the textures.
+  AwaitAndDropAsyncLoadBatches();
+
+  // The GPU is idle when the cache is cleared, and the textures being moved
+  // are about to be destroyed.
+  if (texture_defragmentation_pass_submission_) {
+    EndTextureDefragmentationPass();
+  }
+  if (texture_defragmentation_context_ != VK_NULL_HANDLE) {
+    EndTextureDefragmentation();
+  }
+
+  TextureCache::ClearCache();
+}
+
+void VulkanTextureCache::CompletedSubmissionUpdated(
+    uint64_t completed_submission_index) {
+  // Before the common code may destroy the textures that have been moved.
+  if (texture_defragmentation_pass_submission_ &&
+      texture_defragmentation_pass_submission_ <= completed_submission_index) {
+    EndTextureDefragmentationPass();
+  }
+
+  TextureCache::CompletedSubmissionUpdated(completed_submission_index);
+
+  ReleaseStorageTransferBuffers(completed_submission_index);
+  SubmitAsyncLoadBatches(completed_submission_index);
+}
+
+bool VulkanTextureCache::GetDeviceMemoryBudget(uint64_t& usage_out,
+                                               uint64_t& budget_out) {
+  // Without VK_EXT_memory_budget, VMA only estimates the usage by this
+  // allocator, not by the whole process.
+  if (!command_processor_.GetVulkanProvider()
+           .device_extensions()
+           .ext_memory_budget) {
+    return false;
+  }
+  const VkPhysicalDeviceMemoryProperties* memory_properties;
+  vmaGetMemoryProperties(vma_allocator_, &memory_properties);
+  VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+  vmaGetHeapBudgets(vma_allocator_, budgets);
+  uint64_t usage = 0, budget = 0;
+  for (uint32_t i = 0; i < memory_properties->memoryHeapCount; ++i) {
+    if (memory_properties->memoryHeaps[i].flags &
+        VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+      usage += budgets[i].usage;
+      budget += budgets[i].budget;
+    }
+  }
+  if (!budget) {
+    return false;
+  }
+  usage_out = usage;
+  budget_out = budget;
+  return true;
+}
+
 void VulkanTextureCache::BeginSubmission(uint64_t new_submission_index) {
   TextureCache::BeginSubmission(new_submission_index);
 
+  if (async_load_batch_open_) {
+    // The loads have been recorded in the previous submission, which uploads
+    // their data to the shared memory.
+    CloseAsyncLoadBatch(new_submission_index - 1);
+  }
+  SubmitAsyncLoadBatches(command_processor_.GetCompletedSubmission());
+  CompleteAsyncLoadBatches();
+
   if (!null_images_cleared_) {
     VkImage null_images[] = {null_image_2d_array_cube_, null_image_3d_};
     VkImageSubresourceRange null_image_subresource_range(
@@ -521,14 +638,25 @@ void VulkanTextureCache::BeginSubmission(uint64_t new_submission_index) {
   }
 }
 
+void VulkanTextureCache::BeginFrame() {
+  // Before the bindings are reset by the common code, so the views of the
+  // moved textures are taken again.
+  DefragmentTextures();
+
+  TextureCache::BeginFrame();
+}
+
 void VulkanTextureCache::RequestTextures(uint32_t used_texture_mask) {
 #if XE_UI_VULKAN_FINE_GRAINED_DRAW_SCOPES
   SCOPE_profile_cpu_f("gpu");
 #endif  // XE_UI_VULKAN_FINE_GRAINED_DRAW_SCOPES
 
+  async_loading_allowed_ = async_loading_enabled_;
   TextureCache::RequestTextures(used_texture_mask);
+  async_loading_allowed_ = false;
 
-  // Transition the textures into the needed usage.
+  // Transition the textures into the needed usage. Textures being loaded
+  // asynchronously are not accessed by the submission until they're loaded.
   VkPipelineStageFlags dst_stage_mask;
   VkAccessFlags dst_access_mask;
   VkImageLayout new_layout;
@@ -544,7 +672,7 @@ void VulkanTextureCache::RequestTextures(uint32_t used_texture_mask) {
     }
     VulkanTexture* binding_texture =
         static_cast<VulkanTexture*>(binding->texture);
-    if (binding_texture != nullptr) {
+    if (binding_texture != nullptr && !binding_texture->async_load_batch()) {
       // Will be referenced by the command buffer, so mark as used.
       binding_texture->MarkAsUsed();
       VulkanTexture::Usage old_usage =
@@ -564,7 +692,8 @@ void VulkanTextureCache::RequestTextures(uint32_t used_texture_mask) {
     }
     VulkanTexture* binding_texture_signed =
         static_cast<VulkanTexture*>(binding->texture_signed);
-    if (binding_texture_signed != nullptr) {
+    if (binding_texture_signed != nullptr &&
+        !binding_texture_signed->async_load_batch()) {
       binding_texture_signed->MarkAsUsed();
       VulkanTexture::Usage old_usage = binding_texture_signed->SetUsage(
           VulkanTexture::Usage::kGuestShaderSampled);
@@ -674,6 +803,12 @@ VulkanTextureCache::SamplerParameters VulkanTextureCache::GetSamplerParameters(
           : binding.aniso_filter;
   parameters.aniso_filter = std::min(aniso_filter, max_anisotropy_);
   parameters.mip_base_map = mip_filter == xenos::TextureFilter::kBaseMap;
+  if (AreActiveTextureMipsDeferred(binding.fetch_constant)) {
+    // Only the base level has been loaded so far (mips are deferred only when
+    // mip_min_level is 0).
+    parameters.mip_linear = 0;
+    parameters.mip_base_map = 1;
+  }
 
   uint32_t mip_min_level;
   texture_util::GetSubresourcesFromFetchConstant(fetch, nullptr, nullptr,
@@ -891,7 +1026,7 @@ VkImageView VulkanTextureCache::RequestSwapTexture(
   if (texture_view == VK_NULL_HANDLE) {
     return VK_NULL_HANDLE;
   }
-  if (!LoadTextureData(*texture)) {
+  if (!LoadTextureData(*texture) || texture->async_load_batch()) {
     return VK_NULL_HANDLE;
   }
   texture->MarkAsUsed();
@@ -980,9 +1115,11 @@ uint32_t VulkanTextureCache::GetMaxHostTextureDepthOrArraySize(
   }
 }
 
-std::unique_ptr<TextureCache::Texture> VulkanTextureCache::CreateTexture(
-    TextureKey key) {
-  VkFormat formats[] = {VK_FORMAT_UNDEFINED, VK_FORMAT_UNDEFINED};
+bool VulkanTextureCache::GetTextureImageCreateInfo(
+    const TextureKey& key, TextureImageCreateInfo& create_info_out) const {
+  VkFormat* formats = create_info_out.formats;
+  formats[0] = VK_FORMAT_UNDEFINED;
+  formats[1] = VK_FORMAT_UNDEFINED;
   const HostFormatPair& host_format = GetHostFormatPair(key);
   if (host_format.format_signed.format == VK_FORMAT_UNDEFINED) {
     // Only the unsigned format may be available, if at all.
@@ -1008,18 +1145,16 @@ std::unique_ptr<TextureCache::Texture> VulkanTextureCache::CreateTexture(
   if (formats[0] == VK_FORMAT_UNDEFINED) {
     // TODO(Triang3l): If there's no best format, set that a format unsupported
     // by the emulator completely is used to report at the end of the frame.
-    return nullptr;
+    return false;
   }
 
   const ui::vulkan::VulkanProvider& provider =
       command_processor_.GetVulkanProvider();
-  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
-  VkDevice device = provider.device();
 
   bool is_3d = key.dimension == xenos::DataDimension::k3D;
   uint32_t depth_or_array_size = key.GetDepthOrArraySize();
 
-  VkImageCreateInfo image_create_info;
+  VkImageCreateInfo& image_create_info = create_info_out.image_create_info;
   VkImageCreateInfo* image_create_info_last = &image_create_info;
   image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
   image_create_info.pNext = nullptr;
@@ -1045,11 +1180,18 @@ std::unique_ptr<TextureCache::Texture> VulkanTextureCache::CreateTexture(
   image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
   image_create_info.usage =
       VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  if ((cvars::texture_cache_deduplication && !key.scaled_resolve) ||
+      texture_pool_ != VK_NULL_HANDLE) {
+    // For copying the data to other textures with the same contents, or to the
+    // new location when defragmenting.
+    image_create_info.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  }
   image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
   image_create_info.queueFamilyIndexCount = 0;
   image_create_info.pQueueFamilyIndices = nullptr;
   image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  VkImageFormatListCreateInfoKHR image_format_list_create_info;
+  VkImageFormatListCreateInfoKHR& image_format_list_create_info =
+      create_info_out.image_format_list_create_info;
   if (formats[1] != VK_FORMAT_UNDEFINED &&
       provider.device_extensions().khr_image_format_list) {
     image_create_info_last->pNext = &image_format_list_create_info;
@@ -1061,15 +1203,36 @@ std::unique_ptr<TextureCache::Texture> VulkanTextureCache::CreateTexture(
     image_format_list_create_info.viewFormatCount = 2;
     image_format_list_create_info.pViewFormats = formats;
   }
+  return true;
+}
+
+std::unique_ptr<TextureCache::Texture> VulkanTextureCache::CreateTexture(
+    TextureKey key) {
+  TextureImageCreateInfo create_info;
+  if (!GetTextureImageCreateInfo(key, create_info)) {
+    return nullptr;
+  }
 
   VmaAllocationCreateInfo allocation_create_info = {};
   allocation_create_info.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+  allocation_create_info.pool = texture_pool_;
 
   VkImage image;
   VmaAllocation allocation;
-  if (vmaCreateImage(vma_allocator_, &image_create_info,
+  if (vmaCreateImage(vma_allocator_, &create_info.image_create_info,
                      &allocation_create_info, &image, &allocation, nullptr)) {
-    return nullptr;
+    if (allocation_create_info.pool == VK_NULL_HANDLE) {
+      return nullptr;
+    }
+    // The memory type of the pool may be unsuitable for the image, or the
+    // pool may be out of memory - place it outside the pool, it just won't be
+    // defragmented.
+    allocation_create_info.pool = VK_NULL_HANDLE;
+    if (vmaCreateImage(vma_allocator_, &create_info.image_create_info,
+                       &allocation_create_info, &image, &allocation,
+                       nullptr)) {
+      return nullptr;
+    }
   }
 
   return std::unique_ptr<Texture>(
@@ -1079,21 +1242,117 @@ std::unique_ptr<TextureCache::Texture> VulkanTextureCache::CreateTexture(
 bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
                                                                bool load_base,
                                                                bool load_mips) {
-  VulkanTexture& vulkan_texture = static_cast<VulkanTexture&>(texture);
-  TextureKey texture_key = vulkan_texture.key();
+  return LoadTextureDataImpl(static_cast<VulkanTexture&>(texture), load_base,
+                             load_mips, nullptr, 0, false, 0);
+}
 
-  // Get the pipeline.
-  const HostFormatPair& host_format_pair = GetHostFormatPair(texture_key);
+uint64_t VulkanTextureCache::GetTextureStorageHostFormat(
+    const Texture& texture) const {
+  const HostFormat& host_format = GetLoadHostFormat(texture.key());
+  if (host_format.load_shader == kLoadShaderIndexUnknown) {
+    return 0;
+  }
+  return (uint64_t(host_format.format) << 32) |
+         (uint32_t(host_format.load_shader) + 1);
+}
+
+bool VulkanTextureCache::LoadTextureDataFromStorageImpl(Texture& texture,
+                                                        const void* data,
+                                                        size_t data_size) {
+  // The whole texture is stored, like when it's loaded for the first time.
+  return LoadTextureDataImpl(static_cast<VulkanTexture&>(texture), true,
+                             texture.GetGuestMipsSize() != 0, data, data_size,
+                             false, 0);
+}
+
+bool VulkanTextureCache::LoadAndStoreTextureDataFromResidentMemoryImpl(
+    Texture& texture, bool load_base, bool load_mips, uint64_t storage_hash) {
+  return LoadTextureDataImpl(static_cast<VulkanTexture&>(texture), load_base,
+                             load_mips, nullptr, 0, true, storage_hash);
+}
+
+const VulkanTextureCache::HostFormat& VulkanTextureCache::GetLoadHostFormat(
+    const TextureKey& key) const {
+  const HostFormatPair& host_format_pair = GetHostFormatPair(key);
   bool host_format_is_signed;
-  if (IsSignedVersionSeparateForFormat(texture_key)) {
-    host_format_is_signed = bool(texture_key.signed_separate);
+  if (IsSignedVersionSeparateForFormat(key)) {
+    host_format_is_signed = bool(key.signed_separate);
   } else {
     host_format_is_signed =
         host_format_pair.format_unsigned.load_shader == kLoadShaderIndexUnknown;
   }
-  const HostFormat& host_format = host_format_is_signed
-                                      ? host_format_pair.format_signed
-                                      : host_format_pair.format_unsigned;
+  return host_format_is_signed ? host_format_pair.format_signed
+                               : host_format_pair.format_unsigned;
+}
+
+bool VulkanTextureCache::CreateStorageTransferBuffer(
+    size_t size, bool readback, uint64_t storage_hash, VkBuffer& buffer_out,
+    void*& mapping_out) {
+  VkBufferCreateInfo buffer_create_info;
+  buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_create_info.pNext = nullptr;
+  buffer_create_info.flags = 0;
+  buffer_create_info.size = VkDeviceSize(size);
+  buffer_create_info.usage = readback ? VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                                      : VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  buffer_create_info.queueFamilyIndexCount = 0;
+  buffer_create_info.pQueueFamilyIndices = nullptr;
+  VmaAllocationCreateInfo allocation_create_info = {};
+  allocation_create_info.flags =
+      VMA_ALLOCATION_CREATE_MAPPED_BIT |
+      (readback ? VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT
+                : VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+  allocation_create_info.usage = VMA_MEMORY_USAGE_AUTO;
+  StorageTransferBuffer transfer_buffer;
+  VmaAllocationInfo allocation_info;
+  if (vmaCreateBuffer(vma_allocator_, &buffer_create_info,
+                      &allocation_create_info, &transfer_buffer.buffer,
+                      &transfer_buffer.allocation,
+                      &allocation_info) != VK_SUCCESS) {
+    return false;
+  }
+  transfer_buffer.submission_index = command_processor_.GetCurrentSubmission();
+  transfer_buffer.mapping = allocation_info.pMappedData;
+  transfer_buffer.size = size;
+  transfer_buffer.readback = readback;
+  transfer_buffer.storage_hash = storage_hash;
+  storage_transfer_buffers_.push_back(transfer_buffer);
+  buffer_out = transfer_buffer.buffer;
+  mapping_out = transfer_buffer.mapping;
+  return true;
+}
+
+void VulkanTextureCache::ReleaseStorageTransferBuffers(
+    uint64_t completed_submission_index) {
+  while (!storage_transfer_buffers_.empty()) {
+    const StorageTransferBuffer& transfer_buffer =
+        storage_transfer_buffers_.front();
+    if (transfer_buffer.submission_index > completed_submission_index) {
+      break;
+    }
+    if (transfer_buffer.readback) {
+      vmaInvalidateAllocation(vma_allocator_, transfer_buffer.allocation, 0,
+                              VK_WHOLE_SIZE);
+      StoreTextureData(transfer_buffer.storage_hash, transfer_buffer.mapping,
+                       transfer_buffer.size);
+    }
+    vmaDestroyBuffer(vma_allocator_, transfer_buffer.buffer,
+                     transfer_buffer.allocation);
+    storage_transfer_buffers_.pop_front();
+  }
+}
+
+bool VulkanTextureCache::LoadTextureDataImpl(VulkanTexture& vulkan_texture,
+                                             bool load_base, bool load_mips,
+                                             const void* stored_data,
+                                             size_t stored_data_size,
+                                             bool store,
+                                             uint64_t storage_hash) {
+  TextureKey texture_key = vulkan_texture.key();
+
+  // Get the pipeline.
+  const HostFormat& host_format = GetLoadHostFormat(texture_key);
   LoadShaderIndex load_shader = host_format.load_shader;
   if (load_shader == kLoadShaderIndexUnknown) {
     return false;
@@ -1106,6 +1365,30 @@ bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
   }
   const LoadShaderInfo& load_shader_info = GetLoadShaderInfo(load_shader);
 
+  // Textures not used by any submission yet may be loaded asynchronously, while
+  // textures being loaded asynchronously must not be accessed by the
+  // submissions until the loading is completed. The transfers for the texture
+  // storage are done in the submissions.
+  if (vulkan_texture.async_load_batch()) {
+    if (stored_data) {
+      return false;
+    }
+    store = false;
+  }
+  AsyncLoadBatch* async_batch = nullptr;
+  if (vulkan_texture.async_load_batch() ||
+      (async_loading_allowed_ && !stored_data && !store &&
+       !texture_key.scaled_resolve &&
+       vulkan_texture.usage() == VulkanTexture::Usage::kUndefined)) {
+    if (!async_loading_allowed_) {
+      return false;
+    }
+    async_batch = &GetCurrentAsyncLoadBatch();
+  } else {
+    command_processor_.SetGpuTimestampPhase(
+        VulkanCommandProcessor::GpuTimestampPhase::kTextureLoads);
+  }
+
   // Get the guest layout.
   const texture_util::TextureGuestLayout& guest_layout =
       vulkan_texture.guest_layout();
@@ -1214,279 +1497,377 @@ bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
         level_guest_z_extent_texels;
     host_buffer_size += level_host_layout.slice_size_bytes * array_size;
   }
-  VulkanCommandProcessor::ScratchBufferAcquisition scratch_buffer_acquisition(
-      command_processor_.AcquireScratchGpuBuffer(
-          host_buffer_size, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-          VK_ACCESS_SHADER_WRITE_BIT));
-  VkBuffer scratch_buffer = scratch_buffer_acquisition.buffer();
-  if (scratch_buffer == VK_NULL_HANDLE) {
-    return false;
-  }
-
-  // Begin loading.
-  // TODO(Triang3l): Going from one descriptor to another on per-array-layer
-  // or even per-8-depth-slices level to stay within maxStorageBufferRange.
-  const ui::vulkan::VulkanProvider& provider =
-      command_processor_.GetVulkanProvider();
-  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
-  VkDevice device = provider.device();
-  VulkanSharedMemory& vulkan_shared_memory =
-      static_cast<VulkanSharedMemory&>(shared_memory());
-  std::array<VkWriteDescriptorSet, 3> write_descriptor_sets;
-  uint32_t write_descriptor_set_count = 0;
-  VkDescriptorSet descriptor_set_dest =
-      command_processor_.AllocateSingleTransientDescriptor(
-          VulkanCommandProcessor::SingleTransientDescriptorLayout ::
-              kStorageBufferCompute);
-  if (!descriptor_set_dest) {
-    return false;
-  }
-  VkDescriptorBufferInfo write_descriptor_set_dest_buffer_info;
-  {
-    write_descriptor_set_dest_buffer_info.buffer = scratch_buffer;
-    write_descriptor_set_dest_buffer_info.offset = 0;
-    write_descriptor_set_dest_buffer_info.range = host_buffer_size;
-    VkWriteDescriptorSet& write_descriptor_set_dest =
-        write_descriptor_sets[write_descriptor_set_count++];
-    write_descriptor_set_dest.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write_descriptor_set_dest.pNext = nullptr;
-    write_descriptor_set_dest.dstSet = descriptor_set_dest;
-    write_descriptor_set_dest.dstBinding = 0;
-    write_descriptor_set_dest.dstArrayElement = 0;
-    write_descriptor_set_dest.descriptorCount = 1;
-    write_descriptor_set_dest.descriptorType =
-        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    write_descriptor_set_dest.pImageInfo = nullptr;
-    write_descriptor_set_dest.pBufferInfo =
-        &write_descriptor_set_dest_buffer_info;
-    write_descriptor_set_dest.pTexelBufferView = nullptr;
-  }
-  // TODO(Triang3l): Use a single 512 MB shared memory binding if possible.
-  // TODO(Triang3l): Scaled resolve buffer bindings.
-  // Aligning because if the data for a vector in a storage buffer is provided
-  // partially, the value read may still be (0, 0, 0, 0), and small (especially
-  // linear) textures won't be loaded correctly.
-  uint32_t source_length_alignment = UINT32_C(1)
-                                     << load_shader_info.source_bpe_log2;
-  VkDescriptorSet descriptor_set_source_base = VK_NULL_HANDLE;
-  VkDescriptorSet descriptor_set_source_mips = VK_NULL_HANDLE;
-  VkDescriptorBufferInfo write_descriptor_set_source_base_buffer_info;
-  VkDescriptorBufferInfo write_descriptor_set_source_mips_buffer_info;
-  if (level_first == 0) {
-    descriptor_set_source_base =
-        command_processor_.AllocateSingleTransientDescriptor(
-            VulkanCommandProcessor::SingleTransientDescriptorLayout ::
-                kStorageBufferCompute);
-    if (!descriptor_set_source_base) {
+  VulkanCommandProcessor::ScratchBufferAcquisition scratch_buffer_acquisition;
+  VkBuffer scratch_buffer;
+  if (stored_data) {
+    // The stored data is what the load shaders have written previously.
+    if (stored_data_size != host_buffer_size) {
+      return false;
+    }
+    void* upload_mapping;
+    if (!CreateStorageTransferBuffer(stored_data_size, false, 0,
+                                     scratch_buffer, upload_mapping)) {
+      return false;
+    }
+    std::memcpy(upload_mapping, stored_data, stored_data_size);
+    vmaFlushAllocation(vma_allocator_,
+                       storage_transfer_buffers_.back().allocation, 0,
+                       VK_WHOLE_SIZE);
+  } else if (async_batch) {
+    // The command processor's scratch buffer may be reused before the batch is
+    // executed, using a separate buffer owned by the batch.
+    VkBufferCreateInfo scratch_buffer_create_info;
+    scratch_buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    scratch_buffer_create_info.pNext = nullptr;
+    scratch_buffer_create_info.flags = 0;
+    scratch_buffer_create_info.size = host_buffer_size;
+    scratch_buffer_create_info.usage =
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    scratch_buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    scratch_buffer_create_info.queueFamilyIndexCount = 0;
+    scratch_buffer_create_info.pQueueFamilyIndices = nullptr;
+    VmaAllocationCreateInfo scratch_allocation_create_info = {};
+    scratch_allocation_create_info.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+    VmaAllocation scratch_allocation;
+    if (vmaCreateBuffer(vma_allocator_, &scratch_buffer_create_info,
+                        &scratch_allocation_create_info, &scratch_buffer,
+                        &scratch_allocation, nullptr) != VK_SUCCESS) {
       return false;
     }
-    write_descriptor_set_source_base_buffer_info.buffer =
-        vulkan_shared_memory.buffer();
-    write_descriptor_set_source_base_buffer_info.offset = texture_key.base_page
-                                                          << 12;
-    write_descriptor_set_source_base_buffer_info.range =
-        xe::align(vulkan_texture.GetGuestBaseSize(), source_length_alignment);
-    VkWriteDescriptorSet& write_descriptor_set_source_base =
-        write_descriptor_sets[write_descriptor_set_count++];
-    write_descriptor_set_source_base.sType =
-        VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write_descriptor_set_source_base.pNext = nullptr;
-    write_descriptor_set_source_base.dstSet = descriptor_set_source_base;
-    write_descriptor_set_source_base.dstBinding = 0;
-    write_descriptor_set_source_base.dstArrayElement = 0;
-    write_descriptor_set_source_base.descriptorCount = 1;
-    write_descriptor_set_source_base.descriptorType =
-        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    write_descriptor_set_source_base.pImageInfo = nullptr;
-    write_descriptor_set_source_base.pBufferInfo =
-        &write_descriptor_set_source_base_buffer_info;
-    write_descriptor_set_source_base.pTexelBufferView = nullptr;
-  }
-  if (level_last != 0) {
-    descriptor_set_source_mips =
-        command_processor_.AllocateSingleTransientDescriptor(
-            VulkanCommandProcessor::SingleTransientDescriptorLayout ::
-                kStorageBufferCompute);
-    if (!descriptor_set_source_mips) {
+    async_batch->scratch_buffers.emplace_back(scratch_buffer,
+                                              scratch_allocation);
+  } else {
+    scratch_buffer_acquisition = command_processor_.AcquireScratchGpuBuffer(
+        host_buffer_size, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_ACCESS_SHADER_WRITE_BIT);
+    scratch_buffer = scratch_buffer_acquisition.buffer();
+    if (scratch_buffer == VK_NULL_HANDLE) {
       return false;
     }
-    write_descriptor_set_source_mips_buffer_info.buffer =
-        vulkan_shared_memory.buffer();
-    write_descriptor_set_source_mips_buffer_info.offset = texture_key.mip_page
-                                                          << 12;
-    write_descriptor_set_source_mips_buffer_info.range =
-        xe::align(vulkan_texture.GetGuestMipsSize(), source_length_alignment);
-    VkWriteDescriptorSet& write_descriptor_set_source_mips =
-        write_descriptor_sets[write_descriptor_set_count++];
-    write_descriptor_set_source_mips.sType =
-        VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write_descriptor_set_source_mips.pNext = nullptr;
-    write_descriptor_set_source_mips.dstSet = descriptor_set_source_mips;
-    write_descriptor_set_source_mips.dstBinding = 0;
-    write_descriptor_set_source_mips.dstArrayElement = 0;
-    write_descriptor_set_source_mips.descriptorCount = 1;
-    write_descriptor_set_source_mips.descriptorType =
-        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    write_descriptor_set_source_mips.pImageInfo = nullptr;
-    write_descriptor_set_source_mips.pBufferInfo =
-        &write_descriptor_set_source_mips_buffer_info;
-    write_descriptor_set_source_mips.pTexelBufferView = nullptr;
-  }
-  if (write_descriptor_set_count) {
-    dfn.vkUpdateDescriptorSets(device, write_descriptor_set_count,
-                               write_descriptor_sets.data(), 0, nullptr);
-  }
-  vulkan_shared_memory.Use(VulkanSharedMemory::Usage::kRead);
-
-  // Submit the copy buffer population commands.
+  }
 
   DeferredCommandBuffer& command_buffer =
-      command_processor_.deferred_command_buffer();
-
-  command_processor_.BindExternalComputePipeline(pipeline);
-
-  command_buffer.CmdVkBindDescriptorSets(
-      VK_PIPELINE_BIND_POINT_COMPUTE, load_pipeline_layout_,
-      kLoadDescriptorSetIndexDestination, 1, &descriptor_set_dest, 0, nullptr);
-
-  VkDescriptorSet descriptor_set_source_current = VK_NULL_HANDLE;
-
-  LoadConstants load_constants;
-  // 3 bits for each.
-  assert_true(texture_resolution_scale_x <= 7);
-  assert_true(texture_resolution_scale_y <= 7);
-  load_constants.is_tiled_3d_endian_scale =
-      uint32_t(texture_key.tiled) | (uint32_t(is_3d) << 1) |
-      (uint32_t(texture_key.endianness) << 2) |
-      (texture_resolution_scale_x << 4) | (texture_resolution_scale_y << 7);
-
-  uint32_t guest_x_blocks_per_group_log2 =
-      load_shader_info.GetGuestXBlocksPerGroupLog2();
-  for (uint32_t loop_level = loop_level_first; loop_level <= loop_level_last;
-       ++loop_level) {
-    bool is_base = loop_level == 0;
-    uint32_t level = (level_packed == 0) ? 0 : loop_level;
-
-    VkDescriptorSet descriptor_set_source =
-        is_base ? descriptor_set_source_base : descriptor_set_source_mips;
-    if (descriptor_set_source_current != descriptor_set_source) {
-      descriptor_set_source_current = descriptor_set_source;
-      command_buffer.CmdVkBindDescriptorSets(
-          VK_PIPELINE_BIND_POINT_COMPUTE, load_pipeline_layout_,
-          kLoadDescriptorSetIndexSource, 1, &descriptor_set_source, 0, nullptr);
+      async_batch ? async_batch->deferred_command_buffer
+                  : command_processor_.deferred_command_buffer();
+
+  // Run the load shaders unless the data is already available from the
+  // storage.
+  if (!stored_data) {
+    // Begin loading.
+    // TODO(Triang3l): Going from one descriptor to another on per-array-layer
+    // or even per-8-depth-slices level to stay within maxStorageBufferRange.
+    const ui::vulkan::VulkanProvider& provider =
+        command_processor_.GetVulkanProvider();
+    const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+    VkDevice device = provider.device();
+    VulkanSharedMemory& vulkan_shared_memory =
+        static_cast<VulkanSharedMemory&>(shared_memory());
+    std::array<VkWriteDescriptorSet, 3> write_descriptor_sets;
+    uint32_t write_descriptor_set_count = 0;
+    VkDescriptorSet descriptor_set_dest =
+        AllocateLoadDescriptor(async_batch, true);
+    if (!descriptor_set_dest) {
+      return false;
     }
-
-    // TODO(Triang3l): guest_offset relative to the storage buffer origin.
-    load_constants.guest_offset = 0;
-    if (!is_base) {
-      load_constants.guest_offset +=
-          guest_layout.mip_offsets_bytes[level] *
-          (texture_resolution_scale_x * texture_resolution_scale_y);
+    VkDescriptorBufferInfo write_descriptor_set_dest_buffer_info;
+    {
+      write_descriptor_set_dest_buffer_info.buffer = scratch_buffer;
+      write_descriptor_set_dest_buffer_info.offset = 0;
+      write_descriptor_set_dest_buffer_info.range = host_buffer_size;
+      VkWriteDescriptorSet& write_descriptor_set_dest =
+          write_descriptor_sets[write_descriptor_set_count++];
+      write_descriptor_set_dest.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      write_descriptor_set_dest.pNext = nullptr;
+      write_descriptor_set_dest.dstSet = descriptor_set_dest;
+      write_descriptor_set_dest.dstBinding = 0;
+      write_descriptor_set_dest.dstArrayElement = 0;
+      write_descriptor_set_dest.descriptorCount = 1;
+      write_descriptor_set_dest.descriptorType =
+          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      write_descriptor_set_dest.pImageInfo = nullptr;
+      write_descriptor_set_dest.pBufferInfo =
+          &write_descriptor_set_dest_buffer_info;
+      write_descriptor_set_dest.pTexelBufferView = nullptr;
     }
-    const texture_util::TextureGuestLayout::Level& level_guest_layout =
-        is_base ? guest_layout.base : guest_layout.mips[level];
-    uint32_t level_guest_pitch = level_guest_layout.row_pitch_bytes;
-    if (texture_key.tiled) {
-      // Shaders expect pitch in blocks for tiled textures.
-      level_guest_pitch /= bytes_per_block;
-      assert_zero(level_guest_pitch & (xenos::kTextureTileWidthHeight - 1));
-    }
-    load_constants.guest_pitch_aligned = level_guest_pitch;
-    load_constants.guest_z_stride_block_rows_aligned =
-        level_guest_layout.z_slice_stride_block_rows;
-    assert_true(dimension != xenos::DataDimension::k3D ||
-                !(load_constants.guest_z_stride_block_rows_aligned &
-                  (xenos::kTextureTileWidthHeight - 1)));
-
-    uint32_t level_width, level_height, level_depth;
-    if (level == level_packed) {
-      // This is the packed mip tail, containing not only the specified level,
-      // but also other levels at different offsets - load the entire needed
-      // extents.
-      level_width = level_guest_layout.x_extent_blocks * block_width;
-      level_height = level_guest_layout.y_extent_blocks * block_height;
-      level_depth = level_guest_layout.z_extent;
-    } else {
-      level_width = std::max(width >> level, UINT32_C(1));
-      level_height = std::max(height >> level, UINT32_C(1));
-      level_depth = std::max(depth >> level, UINT32_C(1));
-    }
-    load_constants.size_blocks[0] = (level_width + (block_width - 1)) /
-                                    block_width * texture_resolution_scale_x;
-    load_constants.size_blocks[1] = (level_height + (block_height - 1)) /
-                                    block_height * texture_resolution_scale_y;
-    load_constants.size_blocks[2] = level_depth;
-    load_constants.height_texels = level_height;
-
-    uint32_t group_count_x =
-        (load_constants.size_blocks[0] +
-         ((UINT32_C(1) << guest_x_blocks_per_group_log2) - 1)) >>
-        guest_x_blocks_per_group_log2;
-    uint32_t group_count_y =
-        (load_constants.size_blocks[1] +
-         ((UINT32_C(1) << kLoadGuestYBlocksPerGroupLog2) - 1)) >>
-        kLoadGuestYBlocksPerGroupLog2;
-
-    // TODO(Triang3l): host_offset relative to the storage buffer origin.
-    const HostLayout& level_host_layout =
-        is_base ? host_layout_base : host_layout_mips[level];
-    load_constants.host_offset = uint32_t(level_host_layout.offset_bytes);
-    load_constants.host_pitch = load_shader_info.bytes_per_host_block *
-                                level_host_layout.x_pitch_blocks;
-
-    uint32_t level_array_slice_stride_bytes_scaled =
-        level_guest_layout.array_slice_stride_bytes *
-        (texture_resolution_scale_x * texture_resolution_scale_y);
-    for (uint32_t slice = 0; slice < array_size; ++slice) {
-      VkDescriptorSet descriptor_set_constants;
-      void* constants_mapping =
-          command_processor_.WriteTransientUniformBufferBinding(
-              sizeof(load_constants),
-              VulkanCommandProcessor::SingleTransientDescriptorLayout ::
-                  kUniformBufferCompute,
-              descriptor_set_constants);
-      if (!constants_mapping) {
+    // TODO(Triang3l): Use a single 512 MB shared memory binding if possible.
+    // TODO(Triang3l): Scaled resolve buffer bindings.
+    // Aligning because if the data for a vector in a storage buffer is
+    // provided partially, the value read may still be (0, 0, 0, 0), and small
+    // (especially linear) textures won't be loaded correctly.
+    uint32_t source_length_alignment = UINT32_C(1)
+                                       << load_shader_info.source_bpe_log2;
+    VkDescriptorSet descriptor_set_source_base = VK_NULL_HANDLE;
+    VkDescriptorSet descriptor_set_source_mips = VK_NULL_HANDLE;
+    VkDescriptorBufferInfo write_descriptor_set_source_base_buffer_info;
+    VkDescriptorBufferInfo write_descriptor_set_source_mips_buffer_info;
+    if (level_first == 0) {
+      descriptor_set_source_base = AllocateLoadDescriptor(async_batch, true);
+      if (!descriptor_set_source_base) {
         return false;
       }
-      std::memcpy(constants_mapping, &load_constants, sizeof(load_constants));
-      command_buffer.CmdVkBindDescriptorSets(
-          VK_PIPELINE_BIND_POINT_COMPUTE, load_pipeline_layout_,
-          kLoadDescriptorSetIndexConstants, 1, &descriptor_set_constants, 0,
-          nullptr);
-      command_processor_.SubmitBarriers(true);
-      command_buffer.CmdVkDispatch(group_count_x, group_count_y,
-                                   load_constants.size_blocks[2]);
-      load_constants.guest_offset += level_array_slice_stride_bytes_scaled;
-      load_constants.host_offset +=
-          uint32_t(level_host_layout.slice_size_bytes);
+      write_descriptor_set_source_base_buffer_info.buffer =
+          vulkan_shared_memory.buffer();
+      write_descriptor_set_source_base_buffer_info.offset =
+          texture_key.base_page << 12;
+      write_descriptor_set_source_base_buffer_info.range =
+          xe::align(vulkan_texture.GetGuestBaseSize(), source_length_alignment);
+      VkWriteDescriptorSet& write_descriptor_set_source_base =
+          write_descriptor_sets[write_descriptor_set_count++];
+      write_descriptor_set_source_base.sType =
+          VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      write_descriptor_set_source_base.pNext = nullptr;
+      write_descriptor_set_source_base.dstSet = descriptor_set_source_base;
+      write_descriptor_set_source_base.dstBinding = 0;
+      write_descriptor_set_source_base.dstArrayElement = 0;
+      write_descriptor_set_source_base.descriptorCount = 1;
+      write_descriptor_set_source_base.descriptorType =
+          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      write_descriptor_set_source_base.pImageInfo = nullptr;
+      write_descriptor_set_source_base.pBufferInfo =
+          &write_descriptor_set_source_base_buffer_info;
+      write_descriptor_set_source_base.pTexelBufferView = nullptr;
+    }
+    if (level_last != 0) {
+      descriptor_set_source_mips = AllocateLoadDescriptor(async_batch, true);
+      if (!descriptor_set_source_mips) {
+        return false;
+      }
+      write_descriptor_set_source_mips_buffer_info.buffer =
+          vulkan_shared_memory.buffer();
+      write_descriptor_set_source_mips_buffer_info.offset =
+          texture_key.mip_page << 12;
+      write_descriptor_set_source_mips_buffer_info.range =
+          xe::align(vulkan_texture.GetGuestMipsSize(), source_length_alignment);
+      VkWriteDescriptorSet& write_descriptor_set_source_mips =
+          write_descriptor_sets[write_descriptor_set_count++];
+      write_descriptor_set_source_mips.sType =
+          VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      write_descriptor_set_source_mips.pNext = nullptr;
+      write_descriptor_set_source_mips.dstSet = descriptor_set_source_mips;
+      write_descriptor_set_source_mips.dstBinding = 0;
+      write_descriptor_set_source_mips.dstArrayElement = 0;
+      write_descriptor_set_source_mips.descriptorCount = 1;
+      write_descriptor_set_source_mips.descriptorType =
+          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      write_descriptor_set_source_mips.pImageInfo = nullptr;
+      write_descriptor_set_source_mips.pBufferInfo =
+          &write_descriptor_set_source_mips_buffer_info;
+      write_descriptor_set_source_mips.pTexelBufferView = nullptr;
+    }
+    if (write_descriptor_set_count) {
+      dfn.vkUpdateDescriptorSets(device, write_descriptor_set_count,
+                                 write_descriptor_sets.data(), 0, nullptr);
+    }
+    vulkan_shared_memory.Use(VulkanSharedMemory::Usage::kRead);
+
+    // Submit the copy buffer population commands.
+    if (async_batch) {
+      if (async_batch->current_pipeline != pipeline) {
+        command_buffer.CmdVkBindPipeline(VK_PIPELINE_BIND_POINT_COMPUTE,
+                                         pipeline);
+        async_batch->current_pipeline = pipeline;
+      }
+    } else {
+      command_processor_.BindExternalComputePipeline(pipeline);
+    }
+
+    command_buffer.CmdVkBindDescriptorSets(VK_PIPELINE_BIND_POINT_COMPUTE,
+                                           load_pipeline_layout_,
+                                           kLoadDescriptorSetIndexDestination,
+                                           1, &descriptor_set_dest, 0, nullptr);
+
+    VkDescriptorSet descriptor_set_source_current = VK_NULL_HANDLE;
+
+    LoadConstants load_constants;
+    // 3 bits for each.
+    assert_true(texture_resolution_scale_x <= 7);
+    assert_true(texture_resolution_scale_y <= 7);
+    load_constants.is_tiled_3d_endian_scale =
+        uint32_t(texture_key.tiled) | (uint32_t(is_3d) << 1) |
+        (uint32_t(texture_key.endianness) << 2) |
+        (texture_resolution_scale_x << 4) | (texture_resolution_scale_y << 7);
+
+    uint32_t guest_x_blocks_per_group_log2 =
+        load_shader_info.GetGuestXBlocksPerGroupLog2();
+    for (uint32_t loop_level = loop_level_first; loop_level <= loop_level_last;
+         ++loop_level) {
+      bool is_base = loop_level == 0;
+      uint32_t level = (level_packed == 0) ? 0 : loop_level;
+
+      VkDescriptorSet descriptor_set_source =
+          is_base ? descriptor_set_source_base : descriptor_set_source_mips;
+      if (descriptor_set_source_current != descriptor_set_source) {
+        descriptor_set_source_current = descriptor_set_source;
+        command_buffer.CmdVkBindDescriptorSets(
+            VK_PIPELINE_BIND_POINT_COMPUTE, load_pipeline_layout_,
+            kLoadDescriptorSetIndexSource, 1, &descriptor_set_source, 0,
+            nullptr);
+      }
+
+      // TODO(Triang3l): guest_offset relative to the storage buffer origin.
+      load_constants.guest_offset = 0;
+      if (!is_base) {
+        load_constants.guest_offset +=
+            guest_layout.mip_offsets_bytes[level] *
+            (texture_resolution_scale_x * texture_resolution_scale_y);
+      }
+      const texture_util::TextureGuestLayout::Level& level_guest_layout =
+          is_base ? guest_layout.base : guest_layout.mips[level];
+      uint32_t level_guest_pitch = level_guest_layout.row_pitch_bytes;
+      if (texture_key.tiled) {
+        // Shaders expect pitch in blocks for tiled textures.
+        level_guest_pitch /= bytes_per_block;
+        assert_zero(level_guest_pitch & (xenos::kTextureTileWidthHeight - 1));
+      }
+      load_constants.guest_pitch_aligned = level_guest_pitch;
+      load_constants.guest_z_stride_block_rows_aligned =
+          level_guest_layout.z_slice_stride_block_rows;
+      assert_true(dimension != xenos::DataDimension::k3D ||
+                  !(load_constants.guest_z_stride_block_rows_aligned &
+                    (xenos::kTextureTileWidthHeight - 1)));
+
+      uint32_t level_width, level_height, level_depth;
+      if (level == level_packed) {
+        // This is the packed mip tail, containing not only the specified level,
+        // but also other levels at different offsets - load the entire needed
+        // extents.
+        level_width = level_guest_layout.x_extent_blocks * block_width;
+        level_height = level_guest_layout.y_extent_blocks * block_height;
+        level_depth = level_guest_layout.z_extent;
+      } else {
+        level_width = std::max(width >> level, UINT32_C(1));
+        level_height = std::max(height >> level, UINT32_C(1));
+        level_depth = std::max(depth >> level, UINT32_C(1));
+      }
+      load_constants.size_blocks[0] = (level_width + (block_width - 1)) /
+                                      block_width * texture_resolution_scale_x;
+      load_constants.size_blocks[1] = (level_height + (block_height - 1)) /
+                                      block_height * texture_resolution_scale_y;
+      load_constants.size_blocks[2] = level_depth;
+      load_constants.height_texels = level_height;
+
+      uint32_t group_count_x =
+          (load_constants.size_blocks[0] +
+           ((UINT32_C(1) << guest_x_blocks_per_group_log2) - 1)) >>
+          guest_x_blocks_per_group_log2;
+      uint32_t group_count_y =
+          (load_constants.size_blocks[1] +
+           ((UINT32_C(1) << kLoadGuestYBlocksPerGroupLog2) - 1)) >>
+          kLoadGuestYBlocksPerGroupLog2;
+
+      // TODO(Triang3l): host_offset relative to the storage buffer origin.
+      const HostLayout& level_host_layout =
+          is_base ? host_layout_base : host_layout_mips[level];
+      load_constants.host_offset = uint32_t(level_host_layout.offset_bytes);
+      load_constants.host_pitch = load_shader_info.bytes_per_host_block *
+                                  level_host_layout.x_pitch_blocks;
+
+      uint32_t level_array_slice_stride_bytes_scaled =
+          level_guest_layout.array_slice_stride_bytes *
+          (texture_resolution_scale_x * texture_resolution_scale_y);
+      for (uint32_t slice = 0; slice < array_size; ++slice) {
+        VkDescriptorSet descriptor_set_constants;
+        void* constants_mapping =
+            async_batch
+                ? WriteAsyncLoadUniformBufferBinding(
+                      *async_batch, sizeof(load_constants),
+                      descriptor_set_constants)
+                : command_processor_.WriteTransientUniformBufferBinding(
+                      sizeof(load_constants),
+                      VulkanCommandProcessor::SingleTransientDescriptorLayout ::
+                          kUniformBufferCompute,
+                      descriptor_set_constants);
+        if (!constants_mapping) {
+          return false;
+        }
+        std::memcpy(constants_mapping, &load_constants, sizeof(load_constants));
+        command_buffer.CmdVkBindDescriptorSets(
+            VK_PIPELINE_BIND_POINT_COMPUTE, load_pipeline_layout_,
+            kLoadDescriptorSetIndexConstants, 1, &descriptor_set_constants, 0,
+            nullptr);
+        if (!async_batch) {
+          command_processor_.SubmitBarriers(true);
+        }
+        command_buffer.CmdVkDispatch(group_count_x, group_count_y,
+                                     load_constants.size_blocks[2]);
+        load_constants.guest_offset += level_array_slice_stride_bytes_scaled;
+        load_constants.host_offset +=
+            uint32_t(level_host_layout.slice_size_bytes);
+      }
     }
   }
 
   // Submit copying from the copy buffer to the host texture.
-  command_processor_.PushBufferMemoryBarrier(
-      scratch_buffer, 0, VK_WHOLE_SIZE,
-      scratch_buffer_acquisition.SetStageMask(VK_PIPELINE_STAGE_TRANSFER_BIT),
-      VK_PIPELINE_STAGE_TRANSFER_BIT,
-      scratch_buffer_acquisition.SetAccessMask(VK_ACCESS_TRANSFER_READ_BIT),
-      VK_ACCESS_TRANSFER_READ_BIT);
   vulkan_texture.MarkAsUsed();
   VulkanTexture::Usage texture_old_usage =
       vulkan_texture.SetUsage(VulkanTexture::Usage::kTransferDestination);
-  if (texture_old_usage != VulkanTexture::Usage::kTransferDestination) {
-    VkPipelineStageFlags texture_src_stage_mask, texture_dst_stage_mask;
-    VkAccessFlags texture_src_access_mask, texture_dst_access_mask;
-    VkImageLayout texture_old_layout, texture_new_layout;
-    GetTextureUsageMasks(texture_old_usage, texture_src_stage_mask,
-                         texture_src_access_mask, texture_old_layout);
-    GetTextureUsageMasks(VulkanTexture::Usage::kTransferDestination,
-                         texture_dst_stage_mask, texture_dst_access_mask,
-                         texture_new_layout);
-    command_processor_.PushImageMemoryBarrier(
-        vulkan_texture.image(), ui::vulkan::util::InitializeSubresourceRange(),
-        texture_src_stage_mask, texture_dst_stage_mask, texture_src_access_mask,
-        texture_dst_access_mask, texture_old_layout, texture_new_layout);
+  if (async_batch) {
+    VkBufferMemoryBarrier scratch_buffer_barrier;
+    scratch_buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    scratch_buffer_barrier.pNext = nullptr;
+    scratch_buffer_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    scratch_buffer_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    scratch_buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    scratch_buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    scratch_buffer_barrier.buffer = scratch_buffer;
+    scratch_buffer_barrier.offset = 0;
+    scratch_buffer_barrier.size = VK_WHOLE_SIZE;
+    VkPipelineStageFlags src_stage_mask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    VkImageMemoryBarrier image_barrier;
+    uint32_t image_barrier_count = 0;
+    if (texture_old_usage != VulkanTexture::Usage::kTransferDestination) {
+      VkPipelineStageFlags texture_src_stage_mask, texture_dst_stage_mask;
+      GetTextureUsageMasks(texture_old_usage, texture_src_stage_mask,
+                           image_barrier.srcAccessMask,
+                           image_barrier.oldLayout);
+      GetTextureUsageMasks(VulkanTexture::Usage::kTransferDestination,
+                           texture_dst_stage_mask, image_barrier.dstAccessMask,
+                           image_barrier.newLayout);
+      src_stage_mask |= texture_src_stage_mask;
+      image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+      image_barrier.pNext = nullptr;
+      image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      image_barrier.image = vulkan_texture.image();
+      image_barrier.subresourceRange =
+          ui::vulkan::util::InitializeSubresourceRange();
+      image_barrier_count = 1;
+    }
+    command_buffer.CmdVkPipelineBarrier(
+        src_stage_mask, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1,
+        &scratch_buffer_barrier, image_barrier_count, &image_barrier);
+    vulkan_texture.set_async_load_batch(async_batch->index);
+    async_batch->textures.push_back(&vulkan_texture);
+  } else {
+    // Host writes are visible to the submission without a barrier.
+    if (!stored_data) {
+      command_processor_.PushBufferMemoryBarrier(
+          scratch_buffer, 0, VK_WHOLE_SIZE,
+          scratch_buffer_acquisition.SetStageMask(
+              VK_PIPELINE_STAGE_TRANSFER_BIT),
+          VK_PIPELINE_STAGE_TRANSFER_BIT,
+          scratch_buffer_acquisition.SetAccessMask(
+              VK_ACCESS_TRANSFER_READ_BIT),
+          VK_ACCESS_TRANSFER_READ_BIT);
+    }
+    if (texture_old_usage != VulkanTexture::Usage::kTransferDestination) {
+      VkPipelineStageFlags texture_src_stage_mask, texture_dst_stage_mask;
+      VkAccessFlags texture_src_access_mask, texture_dst_access_mask;
+      VkImageLayout texture_old_layout, texture_new_layout;
+      GetTextureUsageMasks(texture_old_usage, texture_src_stage_mask,
+                           texture_src_access_mask, texture_old_layout);
+      GetTextureUsageMasks(VulkanTexture::Usage::kTransferDestination,
+                           texture_dst_stage_mask, texture_dst_access_mask,
+                           texture_new_layout);
+      command_processor_.PushImageMemoryBarrier(
+          vulkan_texture.image(),
+          ui::vulkan::util::InitializeSubresourceRange(),
+          texture_src_stage_mask, texture_dst_stage_mask,
+          texture_src_access_mask, texture_dst_access_mask, texture_old_layout,
+          texture_new_layout);
+    }
+    command_processor_.SubmitBarriers(true);
   }
-  command_processor_.SubmitBarriers(true);
   VkBufferImageCopy* copy_regions = command_buffer.CmdCopyBufferToImageEmplace(
       scratch_buffer, vulkan_texture.image(),
       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, level_last - level_first + 1);
@@ -1534,9 +1915,270 @@ bool VulkanTextureCache::LoadTextureDataFromResidentMemoryImpl(Texture& texture,
     copy_region.imageExtent.depth = std::max(depth >> level, UINT32_C(1));
   }
 
+  // Read the data written by the load shaders back for the storage, to pass it
+  // to the storage when the submission is completed.
+  if (store && !stored_data) {
+    VkBuffer readback_buffer;
+    void* readback_mapping;
+    if (CreateStorageTransferBuffer(size_t(host_buffer_size), true,
+                                    storage_hash, readback_buffer,
+                                    readback_mapping)) {
+      VkBufferCopy readback_region;
+      readback_region.srcOffset = 0;
+      readback_region.dstOffset = 0;
+      readback_region.size = host_buffer_size;
+      command_buffer.CmdVkCopyBuffer(scratch_buffer, readback_buffer, 1,
+                                     &readback_region);
+      VkBufferMemoryBarrier readback_barrier;
+      readback_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+      readback_barrier.pNext = nullptr;
+      readback_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      readback_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+      readback_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      readback_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      readback_barrier.buffer = readback_buffer;
+      readback_barrier.offset = 0;
+      readback_barrier.size = VK_WHOLE_SIZE;
+      command_buffer.CmdVkPipelineBarrier(
+          VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0,
+          nullptr, 1, &readback_barrier, 0, nullptr);
+    }
+  }
+
   return true;
 }
 
+bool VulkanTextureCache::CopyTextureDataImpl(Texture& dest, Texture& source) {
+  VulkanTexture& vulkan_dest = static_cast<VulkanTexture&>(dest);
+  VulkanTexture& vulkan_source = static_cast<VulkanTexture&>(source);
+  // The source data may be not available yet if it's being loaded
+  // asynchronously, and the destination must not be written on the main queue
+  // while the asynchronous loading queue may be accessing it.
+  if (vulkan_source.async_load_batch() || vulkan_dest.async_load_batch()) {
+    return false;
+  }
+
+  vulkan_source.MarkAsUsed();
+  vulkan_dest.MarkAsUsed();
+  VulkanTexture* textures[] = {&vulkan_source, &vulkan_dest};
+  VulkanTexture::Usage new_usages[] = {
+      VulkanTexture::Usage::kTransferSource,
+      VulkanTexture::Usage::kTransferDestination};
+  for (size_t i = 0; i < xe::countof(textures); ++i) {
+    VulkanTexture::Usage old_usage = textures[i]->SetUsage(new_usages[i]);
+    if (old_usage == new_usages[i]) {
+      continue;
+    }
+    VkPipelineStageFlags src_stage_mask, dst_stage_mask;
+    VkAccessFlags src_access_mask, dst_access_mask;
+    VkImageLayout old_layout, new_layout;
+    GetTextureUsageMasks(old_usage, src_stage_mask, src_access_mask,
+                         old_layout);
+    GetTextureUsageMasks(new_usages[i], dst_stage_mask, dst_access_mask,
+                         new_layout);
+    command_processor_.PushImageMemoryBarrier(
+        textures[i]->image(), ui::vulkan::util::InitializeSubresourceRange(),
+        src_stage_mask, dst_stage_mask, src_access_mask, dst_access_mask,
+        old_layout, new_layout);
+  }
+  command_processor_.SubmitBarriers(true);
+
+  // The keys are the same other than the addresses, so the images are created
+  // identically.
+  RecordTextureImageCopy(dest.key(), vulkan_source.image(),
+                         vulkan_dest.image());
+  return true;
+}
+
+void VulkanTextureCache::RecordTextureImageCopy(const TextureKey& key,
+                                                VkImage source, VkImage dest) {
+  bool is_3d = key.dimension == xenos::DataDimension::k3D;
+  uint32_t width = key.GetWidth();
+  uint32_t height = key.GetHeight();
+  if (key.scaled_resolve) {
+    width *= draw_resolution_scale_x();
+    height *= draw_resolution_scale_y();
+  }
+  uint32_t depth_or_array_size = key.GetDepthOrArraySize();
+  uint32_t level_count = key.mip_max_level + 1;
+  VkImageCopy* copy_regions =
+      command_processor_.deferred_command_buffer().CmdCopyImageEmplace(
+          source, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dest,
+          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, level_count);
+  for (uint32_t level = 0; level < level_count; ++level) {
+    VkImageCopy& copy_region = copy_regions[level];
+    copy_region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    copy_region.srcSubresource.mipLevel = level;
+    copy_region.srcSubresource.baseArrayLayer = 0;
+    copy_region.srcSubresource.layerCount = is_3d ? 1 : depth_or_array_size;
+    copy_region.srcOffset.x = 0;
+    copy_region.srcOffset.y = 0;
+    copy_region.srcOffset.z = 0;
+    copy_region.dstSubresource = copy_region.srcSubresource;
+    copy_region.dstOffset = copy_region.srcOffset;
+    copy_region.extent.width = std::max(width >> level, UINT32_C(1));
+    copy_region.extent.height = std::max(height >> level, UINT32_C(1));
+    copy_region.extent.depth =
+        is_3d ? std::max(depth_or_array_size >> level, UINT32_C(1)) : 1;
+  }
+}
+
+void VulkanTextureCache::DefragmentTextures() {
+  uint32_t mb_per_frame = cvars::vulkan_texture_defragmentation_mb_per_frame;
+  if (!mb_per_frame || texture_pool_ == VK_NULL_HANDLE ||
+      texture_defragmentation_pass_submission_) {
+    // Disabled, or the moves of the previous pass are still being copied.
+    return;
+  }
+  uint64_t current_frame = command_processor_.GetCurrentFrame();
+  if (current_frame < texture_defragmentation_next_frame_) {
+    return;
+  }
+
+  // A single pass per defragmentation so the allocations are not freed in the
+  // middle of it by the eviction of textures while the GPU is copying.
+  VmaDefragmentationInfo defragmentation_info = {};
+  defragmentation_info.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT;
+  defragmentation_info.pool = texture_pool_;
+  defragmentation_info.maxBytesPerPass = VkDeviceSize(mb_per_frame) << 20;
+  if (vmaBeginDefragmentation(vma_allocator_, &defragmentation_info,
+                              &texture_defragmentation_context_) !=
+      VK_SUCCESS) {
+    texture_defragmentation_context_ = VK_NULL_HANDLE;
+    texture_defragmentation_next_frame_ =
+        current_frame + kTextureDefragmentationIntervalFrames;
+    return;
+  }
+  if (vmaBeginDefragmentationPass(vma_allocator_,
+                                  texture_defragmentation_context_,
+                                  &texture_defragmentation_pass_) !=
+      VK_INCOMPLETE) {
+    // Nothing to move.
+    EndTextureDefragmentation();
+    return;
+  }
+
+  const ui::vulkan::VulkanProvider& provider =
+      command_processor_.GetVulkanProvider();
+  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+  VkDevice device = provider.device();
+  for (uint32_t i = 0; i < texture_defragmentation_pass_.moveCount; ++i) {
+    VmaDefragmentationMove& move = texture_defragmentation_pass_.pMoves[i];
+    VmaAllocationInfo allocation_info;
+    vmaGetAllocationInfo(vma_allocator_, move.srcAllocation, &allocation_info);
+    auto texture = static_cast<VulkanTexture*>(allocation_info.pUserData);
+    // The asynchronous loading queue may be accessing the textures being
+    // loaded.
+    if (!texture || texture->async_load_batch()) {
+      move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+      continue;
+    }
+    TextureImageCreateInfo create_info;
+    VkImage new_image;
+    if (!GetTextureImageCreateInfo(texture->key(), create_info) ||
+        dfn.vkCreateImage(device, &create_info.image_create_info, nullptr,
+                          &new_image) != VK_SUCCESS) {
+      move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+      continue;
+    }
+    if (vmaBindImageMemory(vma_allocator_, move.dstTmpAllocation, new_image) !=
+        VK_SUCCESS) {
+      dfn.vkDestroyImage(device, new_image, nullptr);
+      move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+      continue;
+    }
+
+    VkImage old_image = texture->image();
+    VulkanTexture::Usage usage = texture->usage();
+    // If the texture has never been written, there's nothing to copy.
+    if (usage != VulkanTexture::Usage::kUndefined) {
+      VkPipelineStageFlags usage_stage_mask, transfer_src_stage_mask,
+          transfer_dst_stage_mask;
+      VkAccessFlags usage_access_mask, transfer_src_access_mask,
+          transfer_dst_access_mask;
+      VkImageLayout usage_layout, transfer_src_layout, transfer_dst_layout;
+      GetTextureUsageMasks(usage, usage_stage_mask, usage_access_mask,
+                           usage_layout);
+      GetTextureUsageMasks(VulkanTexture::Usage::kTransferSource,
+                           transfer_src_stage_mask, transfer_src_access_mask,
+                           transfer_src_layout);
+      GetTextureUsageMasks(VulkanTexture::Usage::kTransferDestination,
+                           transfer_dst_stage_mask, transfer_dst_access_mask,
+                           transfer_dst_layout);
+      if (usage != VulkanTexture::Usage::kTransferSource) {
+        command_processor_.PushImageMemoryBarrier(
+            old_image, ui::vulkan::util::InitializeSubresourceRange(),
+            usage_stage_mask, transfer_src_stage_mask, usage_access_mask,
+            transfer_src_access_mask, usage_layout, transfer_src_layout);
+      }
+      command_processor_.PushImageMemoryBarrier(
+          new_image, ui::vulkan::util::InitializeSubresourceRange(), 0,
+          transfer_dst_stage_mask, 0, transfer_dst_access_mask,
+          VK_IMAGE_LAYOUT_UNDEFINED, transfer_dst_layout);
+      command_processor_.SubmitBarriers(true);
+      RecordTextureImageCopy(texture->key(), old_image, new_image);
+      if (usage != VulkanTexture::Usage::kTransferDestination) {
+        command_processor_.PushImageMemoryBarrier(
+            new_image, ui::vulkan::util::InitializeSubresourceRange(),
+            transfer_dst_stage_mask, usage_stage_mask,
+            transfer_dst_access_mask, usage_access_mask, transfer_dst_layout,
+            usage_layout);
+      }
+    }
+
+    // The old image and its views may still be used by the submissions in
+    // flight, and the eviction of the texture must wait for the copying.
+    texture_defragmentation_old_images_.push_back(
+        texture->ReplaceImage(new_image, texture_defragmentation_old_views_));
+    texture->MarkAsUsed();
+  }
+  texture_defragmentation_pass_submission_ =
+      command_processor_.GetCurrentSubmission();
+}
+
+void VulkanTextureCache::EndTextureDefragmentationPass() {
+  assert_not_zero(texture_defragmentation_pass_submission_);
+  const ui::vulkan::VulkanProvider& provider =
+      command_processor_.GetVulkanProvider();
+  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+  VkDevice device = provider.device();
+  for (VkImageView view : texture_defragmentation_old_views_) {
+    dfn.vkDestroyImageView(device, view, nullptr);
+  }
+  texture_defragmentation_old_views_.clear();
+  for (VkImage image : texture_defragmentation_old_images_) {
+    dfn.vkDestroyImage(device, image, nullptr);
+  }
+  texture_defragmentation_old_images_.clear();
+  texture_defragmentation_pass_submission_ = 0;
+  // Frees the old memory, and makes the allocations refer to the new memory.
+  vmaEndDefragmentationPass(vma_allocator_, texture_defragmentation_context_,
+                            &texture_defragmentation_pass_);
+  EndTextureDefragmentation();
+}
+
+void VulkanTextureCache::EndTextureDefragmentation() {
+  VmaDefragmentationStats defragmentation_stats;
+  vmaEndDefragmentation(vma_allocator_, texture_defragmentation_context_,
+                        &defragmentation_stats);
+  texture_defragmentation_context_ = VK_NULL_HANDLE;
+  if (defragmentation_stats.allocationsMoved) {
+    XELOGGPU(
+        "Vulkan texture defragmentation: moved {} textures ({} KB), freed {} "
+        "device memory blocks ({} KB)",
+        defragmentation_stats.allocationsMoved,
+        defragmentation_stats.bytesMoved >> 10,
+        defragmentation_stats.deviceMemoryBlocksFreed,
+        defragmentation_stats.bytesFreed >> 10);
+    // Continue on the next frame while there's something to move.
+    texture_defragmentation_next_frame_ = 0;
+  } else {
+    texture_defragmentation_next_frame_ =
+        command_processor_.GetCurrentFrame() +
+        kTextureDefragmentationIntervalFrames;
+  }
+}
+
 void VulkanTextureCache::UpdateTextureBindingsImpl(
     uint32_t fetch_constant_mask) {
   uint32_t bindings_remaining = fetch_constant_mask;
@@ -1550,21 +2192,29 @@ void VulkanTextureCache::UpdateTextureBindingsImpl(
     if (!binding) {
       continue;
     }
+    // Textures still being loaded asynchronously are replaced with the null
+    // texture, the bindings are updated when the loading is completed.
+    VulkanTexture* texture = static_cast<VulkanTexture*>(binding->texture);
+    if (texture && texture->async_load_batch()) {
+      texture = nullptr;
+    }
     if (IsSignedVersionSeparateForFormat(binding->key)) {
-      if (binding->texture &&
+      VulkanTexture* texture_signed =
+          static_cast<VulkanTexture*>(binding->texture_signed);
+      if (texture_signed && texture_signed->async_load_batch()) {
+        texture_signed = nullptr;
+      }
+      if (texture &&
           texture_util::IsAnySignNotSigned(binding->swizzled_signs)) {
         vulkan_binding.image_view_unsigned =
-            static_cast<VulkanTexture*>(binding->texture)
-                ->GetView(false, binding->host_swizzle);
+            texture->GetView(false, binding->host_swizzle);
       }
-      if (binding->texture_signed &&
+      if (texture_signed &&
           texture_util::IsAnySignSigned(binding->swizzled_signs)) {
         vulkan_binding.image_view_signed =
-            static_cast<VulkanTexture*>(binding->texture_signed)
-                ->GetView(true, binding->host_swizzle);
+            texture_signed->GetView(true, binding->host_swizzle);
       }
     } else {
-      VulkanTexture* texture = static_cast<VulkanTexture*>(binding->texture);
       if (texture) {
         if (texture_util::IsAnySignNotSigned(binding->swizzled_signs)) {
           vulkan_binding.image_view_unsigned =
@@ -1583,6 +2233,9 @@ VulkanTextureCache::VulkanTexture::VulkanTexture(
     VulkanTextureCache& texture_cache, const TextureKey& key, VkImage image,
     VmaAllocation allocation)
     : Texture(texture_cache, key), image_(image), allocation_(allocation) {
+  // For finding the texture when its allocation is moved by the
+  // defragmentation.
+  vmaSetAllocationUserData(texture_cache.vma_allocator_, allocation_, this);
   VmaAllocationInfo allocation_info;
   vmaGetAllocationInfo(texture_cache.vma_allocator_, allocation_,
                        &allocation_info);
@@ -1602,6 +2255,17 @@ VulkanTextureCache::VulkanTexture::~VulkanTexture() {
   vmaDestroyImage(vulkan_texture_cache.vma_allocator_, image_, allocation_);
 }
 
+VkImage VulkanTextureCache::VulkanTexture::ReplaceImage(
+    VkImage new_image, std::vector<VkImageView>& old_views_out) {
+  for (const auto& view_pair : views_) {
+    old_views_out.push_back(view_pair.second);
+  }
+  views_.clear();
+  VkImage old_image = image_;
+  image_ = new_image;
+  return old_image;
+}
+
 VkImageView VulkanTextureCache::VulkanTexture::GetView(bool is_signed,
                                                        uint32_t host_swizzle,
                                                        bool is_array) {
@@ -1727,6 +2391,42 @@ bool VulkanTextureCache::Initialize() {
     return false;
   }
 
+  if (cvars::vulkan_texture_defragmentation_mb_per_frame) {
+    // Only the textures compatible with the memory type of the pool, which is
+    // chosen for a typical texture, can be defragmented, others are placed in
+    // the default pools.
+    VkImageCreateInfo pool_image_create_info = {};
+    pool_image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    pool_image_create_info.imageType = VK_IMAGE_TYPE_2D;
+    pool_image_create_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+    pool_image_create_info.extent.width = 256;
+    pool_image_create_info.extent.height = 256;
+    pool_image_create_info.extent.depth = 1;
+    pool_image_create_info.mipLevels = 1;
+    pool_image_create_info.arrayLayers = 1;
+    pool_image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    pool_image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    pool_image_create_info.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                                   VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                                   VK_IMAGE_USAGE_SAMPLED_BIT;
+    pool_image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    pool_image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VmaAllocationCreateInfo pool_allocation_create_info = {};
+    pool_allocation_create_info.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+    VmaPoolCreateInfo pool_create_info = {};
+    if (vmaFindMemoryTypeIndexForImageInfo(
+            vma_allocator_, &pool_image_create_info,
+            &pool_allocation_create_info,
+            &pool_create_info.memoryTypeIndex) != VK_SUCCESS ||
+        vmaCreatePool(vma_allocator_, &pool_create_info, &texture_pool_) !=
+            VK_SUCCESS) {
+      XELOGW(
+          "Failed to create the Vulkan texture memory pool, texture "
+          "defragmentation is disabled");
+      texture_pool_ = VK_NULL_HANDLE;
+    }
+  }
+
   // Image formats.
 
   // Initialize to the best formats.
@@ -2598,6 +3298,16 @@ bool VulkanTextureCache::Initialize() {
     max_anisotropy_ = xenos::AnisoFilter::kDisabled;
   }
 
+  // Asynchronous loading.
+
+  async_loading_enabled_ = cvars::vulkan_async_texture_loading &&
+                           provider.IsGraphicsComputeAsyncQueueAvailable();
+  if (async_loading_enabled_) {
+    async_load_constants_pool_ =
+        std::make_unique<ui::vulkan::VulkanUploadBufferPool>(
+            provider, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+  }
+
   return true;
 }
 
@@ -2624,6 +3334,11 @@ void VulkanTextureCache::GetTextureUsageMasks(VulkanTexture::Usage usage,
   switch (usage) {
     case VulkanTexture::Usage::kUndefined:
       break;
+    case VulkanTexture::Usage::kTransferSource:
+      stage_mask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+      access_mask = VK_ACCESS_TRANSFER_READ_BIT;
+      layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+      break;
     case VulkanTexture::Usage::kTransferDestination:
       stage_mask = VK_PIPELINE_STAGE_TRANSFER_BIT;
       access_mask = VK_ACCESS_TRANSFER_WRITE_BIT;
@@ -2664,6 +3379,396 @@ xenos::ClampMode VulkanTextureCache::NormalizeClampMode(
   return clamp_mode;
 }
 
+namespace {
+constexpr uint32_t kAsyncLoadDescriptorPoolSetCount = 256;
+constexpr VkDescriptorPoolSize kAsyncLoadDescriptorPoolSizes[] = {
+    {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, kAsyncLoadDescriptorPoolSetCount},
+    {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, kAsyncLoadDescriptorPoolSetCount},
+};
+}  // namespace
+
+VulkanTextureCache::AsyncLoadBatch::AsyncLoadBatch(
+    VulkanCommandProcessor& command_processor)
+    : deferred_command_buffer(command_processor, 64 * 1024),
+      descriptor_allocator(command_processor.GetVulkanProvider(),
+                           kAsyncLoadDescriptorPoolSizes,
+                           uint32_t(xe::countof(kAsyncLoadDescriptorPoolSizes)),
+                           kAsyncLoadDescriptorPoolSetCount) {}
+
+VkDescriptorSet VulkanTextureCache::AllocateLoadDescriptor(
+    AsyncLoadBatch* async_batch, bool is_storage_buffer) {
+  using SingleTransientDescriptorLayout =
+      VulkanCommandProcessor::SingleTransientDescriptorLayout;
+  SingleTransientDescriptorLayout layout =
+      is_storage_buffer
+          ? SingleTransientDescriptorLayout::kStorageBufferCompute
+          : SingleTransientDescriptorLayout::kUniformBufferCompute;
+  if (!async_batch) {
+    return command_processor_.AllocateSingleTransientDescriptor(layout);
+  }
+  VkDescriptorPoolSize descriptor_count;
+  descriptor_count.type = is_storage_buffer ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+                                            : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  descriptor_count.descriptorCount = 1;
+  return async_batch->descriptor_allocator.Allocate(
+      command_processor_.GetSingleTransientDescriptorLayout(layout),
+      &descriptor_count, 1);
+}
+
+uint8_t* VulkanTextureCache::WriteAsyncLoadUniformBufferBinding(
+    AsyncLoadBatch& batch, size_t size, VkDescriptorSet& descriptor_set_out) {
+  const ui::vulkan::VulkanProvider& provider =
+      command_processor_.GetVulkanProvider();
+  VkDescriptorSet descriptor_set = AllocateLoadDescriptor(&batch, false);
+  if (descriptor_set == VK_NULL_HANDLE) {
+    return nullptr;
+  }
+  VkDescriptorBufferInfo descriptor_buffer_info;
+  uint8_t* mapping = async_load_constants_pool_->Request(
+      batch.index, size,
+      size_t(std::max(
+          provider.device_properties().limits.minUniformBufferOffsetAlignment,
+          VkDeviceSize(1))),
+      descriptor_buffer_info.buffer, descriptor_buffer_info.offset);
+  if (!mapping) {
+    return nullptr;
+  }
+  descriptor_buffer_info.range = VkDeviceSize(size);
+  VkWriteDescriptorSet write_descriptor_set;
+  write_descriptor_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write_descriptor_set.pNext = nullptr;
+  write_descriptor_set.dstSet = descriptor_set;
+  write_descriptor_set.dstBinding = 0;
+  write_descriptor_set.dstArrayElement = 0;
+  write_descriptor_set.descriptorCount = 1;
+  write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  write_descriptor_set.pImageInfo = nullptr;
+  write_descriptor_set.pBufferInfo = &descriptor_buffer_info;
+  write_descriptor_set.pTexelBufferView = nullptr;
+  provider.dfn().vkUpdateDescriptorSets(provider.device(), 1,
+                                        &write_descriptor_set, 0, nullptr);
+  descriptor_set_out = descriptor_set;
+  return mapping;
+}
+
+VulkanTextureCache::AsyncLoadBatch&
+VulkanTextureCache::GetCurrentAsyncLoadBatch() {
+  if (!async_load_batch_open_) {
+    if (!async_load_batches_free_.empty()) {
+      async_load_batch_open_ = std::move(async_load_batches_free_.back());
+      async_load_batches_free_.pop_back();
+    } else {
+      async_load_batch_open_ =
+          std::make_unique<AsyncLoadBatch>(command_processor_);
+    }
+    async_load_batch_open_->index = async_load_batch_current_;
+  }
+  return *async_load_batch_open_;
+}
+
+void VulkanTextureCache::CloseAsyncLoadBatch(uint64_t source_submission) {
+  assert_not_null(async_load_batch_open_);
+  AsyncLoadBatch& batch = *async_load_batch_open_;
+  if (batch.textures.empty()) {
+    // All the loads have failed, nothing useful to execute.
+    ReleaseAsyncLoadBatchResources(batch);
+    async_load_batches_free_.push_back(std::move(async_load_batch_open_));
+    return;
+  }
+  batch.source_submission = source_submission;
+
+  // Transition at the end of the batch rather than when submitting it, as
+  // later batches may have been recorded with this usage already.
+  // The command processor submissions await the whole batch via the
+  // semaphore, so only the layout transition is needed here.
+  VkPipelineStageFlags dst_stage_mask;
+  VkAccessFlags dst_access_mask;
+  VkImageLayout new_layout;
+  GetTextureUsageMasks(VulkanTexture::Usage::kGuestShaderSampled,
+                       dst_stage_mask, dst_access_mask, new_layout);
+  VkPipelineStageFlags src_stage_mask = 0;
+  std::vector<VkImageMemoryBarrier> image_barriers;
+  for (VulkanTexture* texture : batch.textures) {
+    VulkanTexture::Usage old_usage =
+        texture->SetUsage(VulkanTexture::Usage::kGuestShaderSampled);
+    if (old_usage == VulkanTexture::Usage::kGuestShaderSampled) {
+      continue;
+    }
+    VkImageMemoryBarrier& image_barrier = image_barriers.emplace_back();
+    VkPipelineStageFlags texture_src_stage_mask;
+    GetTextureUsageMasks(old_usage, texture_src_stage_mask,
+                         image_barrier.srcAccessMask, image_barrier.oldLayout);
+    src_stage_mask |= texture_src_stage_mask;
+    image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    image_barrier.pNext = nullptr;
+    image_barrier.dstAccessMask = 0;
+    image_barrier.newLayout = new_layout;
+    image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_barrier.image = texture->image();
+    image_barrier.subresourceRange =
+        ui::vulkan::util::InitializeSubresourceRange();
+  }
+  if (!image_barriers.empty()) {
+    batch.deferred_command_buffer.CmdVkPipelineBarrier(
+        src_stage_mask ? src_stage_mask : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr,
+        uint32_t(image_barriers.size()), image_barriers.data());
+  }
+
+  async_load_batches_closed_.push_back(std::move(async_load_batch_open_));
+  ++async_load_batch_current_;
+}
+
+void VulkanTextureCache::ReleaseAsyncLoadBatchResources(AsyncLoadBatch& batch) {
+  for (const std::pair<VkBuffer, VmaAllocation>& scratch_buffer :
+       batch.scratch_buffers) {
+    vmaDestroyBuffer(vma_allocator_, scratch_buffer.first,
+                     scratch_buffer.second);
+  }
+  batch.scratch_buffers.clear();
+  batch.textures.clear();
+  batch.current_pipeline = VK_NULL_HANDLE;
+  batch.deferred_command_buffer.Reset();
+  batch.descriptor_allocator.Reset();
+}
+
+void VulkanTextureCache::SubmitAsyncLoadBatches(
+    uint64_t completed_submission_index) {
+  bool any_failed = false;
+  while (!async_load_batches_closed_.empty()) {
+    AsyncLoadBatch& batch = *async_load_batches_closed_.front();
+    if (batch.source_submission > completed_submission_index) {
+      break;
+    }
+    if (SubmitAsyncLoadBatch(batch)) {
+      async_load_batches_submitted_.push_back(
+          std::move(async_load_batches_closed_.front()));
+    } else {
+      // Let the textures be used, with undefined contents, rather than leaving
+      // them pending indefinitely.
+      for (VulkanTexture* texture : batch.textures) {
+        if (texture->async_load_batch() == batch.index) {
+          texture->set_async_load_batch(0);
+          texture->SetUsage(VulkanTexture::Usage::kUndefined);
+        }
+      }
+      ReleaseAsyncLoadBatchResources(batch);
+      async_load_batches_free_.push_back(
+          std::move(async_load_batches_closed_.front()));
+      any_failed = true;
+    }
+    async_load_batches_closed_.pop_front();
+  }
+  if (any_failed) {
+    TextureFetchConstantsWritten(0, xenos::kTextureFetchConstantCount - 1);
+  }
+}
+
+bool VulkanTextureCache::SubmitAsyncLoadBatch(AsyncLoadBatch& batch) {
+  const ui::vulkan::VulkanProvider& provider =
+      command_processor_.GetVulkanProvider();
+  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+  VkDevice device = provider.device();
+
+  if (batch.command_pool == VK_NULL_HANDLE) {
+    VkCommandPoolCreateInfo command_pool_create_info;
+    command_pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    command_pool_create_info.pNext = nullptr;
+    command_pool_create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    command_pool_create_info.queueFamilyIndex =
+        provider.queue_family_graphics_compute();
+    if (dfn.vkCreateCommandPool(device, &command_pool_create_info, nullptr,
+                                &batch.command_pool) != VK_SUCCESS) {
+      XELOGE(
+          "VulkanTextureCache: Failed to create an asynchronous load command "
+          "pool");
+      return false;
+    }
+    VkCommandBufferAllocateInfo command_buffer_allocate_info;
+    command_buffer_allocate_info.sType =
+        VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    command_buffer_allocate_info.pNext = nullptr;
+    command_buffer_allocate_info.commandPool = batch.command_pool;
+    command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    command_buffer_allocate_info.commandBufferCount = 1;
+    if (dfn.vkAllocateCommandBuffers(device, &command_buffer_allocate_info,
+                                     &batch.command_buffer) != VK_SUCCESS) {
+      XELOGE(
+          "VulkanTextureCache: Failed to allocate an asynchronous load command "
+          "buffer");
+      dfn.vkDestroyCommandPool(device, batch.command_pool, nullptr);
+      batch.command_pool = VK_NULL_HANDLE;
+      return false;
+    }
+  } else if (dfn.vkResetCommandPool(device, batch.command_pool, 0) !=
+             VK_SUCCESS) {
+    XELOGE(
+        "VulkanTextureCache: Failed to reset an asynchronous load command "
+        "pool");
+    return false;
+  }
+  if (batch.fence == VK_NULL_HANDLE) {
+    VkFenceCreateInfo fence_create_info;
+    fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fence_create_info.pNext = nullptr;
+    fence_create_info.flags = 0;
+    if (dfn.vkCreateFence(device, &fence_create_info, nullptr, &batch.fence) !=
+        VK_SUCCESS) {
+      XELOGE("VulkanTextureCache: Failed to create an asynchronous load fence");
+      return false;
+    }
+  } else if (dfn.vkResetFences(device, 1, &batch.fence) != VK_SUCCESS) {
+    XELOGE("VulkanTextureCache: Failed to reset an asynchronous load fence");
+    return false;
+  }
+
+  VkCommandBufferBeginInfo command_buffer_begin_info;
+  command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  command_buffer_begin_info.pNext = nullptr;
+  command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  command_buffer_begin_info.pInheritanceInfo = nullptr;
+  if (dfn.vkBeginCommandBuffer(batch.command_buffer,
+                               &command_buffer_begin_info) != VK_SUCCESS) {
+    XELOGE(
+        "VulkanTextureCache: Failed to begin an asynchronous load command "
+        "buffer");
+    return false;
+  }
+  batch.deferred_command_buffer.Execute(batch.command_buffer);
+  if (dfn.vkEndCommandBuffer(batch.command_buffer) != VK_SUCCESS) {
+    XELOGE(
+        "VulkanTextureCache: Failed to end an asynchronous load command "
+        "buffer");
+    return false;
+  }
+  async_load_constants_pool_->FlushWrites();
+
+  VkSemaphore semaphore = command_processor_.AcquireSemaphore();
+  if (semaphore == VK_NULL_HANDLE) {
+    return false;
+  }
+  VkSubmitInfo submit_info;
+  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit_info.pNext = nullptr;
+  submit_info.waitSemaphoreCount = 0;
+  submit_info.pWaitSemaphores = nullptr;
+  submit_info.pWaitDstStageMask = nullptr;
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &batch.command_buffer;
+  submit_info.signalSemaphoreCount = 1;
+  submit_info.pSignalSemaphores = &semaphore;
+  VkResult submit_result;
+  {
+    ui::vulkan::VulkanProvider::QueueAcquisition queue_acquisition(
+        provider.AcquireQueue(provider.queue_family_graphics_compute(), 1));
+    submit_result = dfn.vkQueueSubmit(queue_acquisition.queue, 1,
+                                      &submit_info, batch.fence);
+  }
+  if (submit_result != VK_SUCCESS) {
+    XELOGE("VulkanTextureCache: Failed to submit asynchronous texture loads");
+    dfn.vkDestroySemaphore(device, semaphore, nullptr);
+    return false;
+  }
+  batch.semaphore = semaphore;
+  return true;
+}
+
+void VulkanTextureCache::CompleteAsyncLoadBatches() {
+  const ui::vulkan::VulkanProvider& provider =
+      command_processor_.GetVulkanProvider();
+  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+  VkDevice device = provider.device();
+
+  bool any_completed = false;
+  while (!async_load_batches_submitted_.empty()) {
+    AsyncLoadBatch& batch = *async_load_batches_submitted_.front();
+    VkResult fence_status = dfn.vkGetFenceStatus(device, batch.fence);
+    if (fence_status == VK_NOT_READY) {
+      break;
+    }
+    if (fence_status == VK_SUCCESS) {
+      // Already signaled, so not actually delaying the submission, but needed
+      // to make the results visible to it.
+      command_processor_.AwaitSemaphoreInCurrentSubmission(
+          batch.semaphore, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    } else {
+      // Device lost - the command processor won't be able to use the textures
+      // anyway.
+      dfn.vkDestroySemaphore(device, batch.semaphore, nullptr);
+    }
+    batch.semaphore = VK_NULL_HANDLE;
+    for (VulkanTexture* texture : batch.textures) {
+      if (texture->async_load_batch() == batch.index) {
+        texture->set_async_load_batch(0);
+      }
+    }
+    async_load_constants_pool_->Reclaim(batch.index);
+    ReleaseAsyncLoadBatchResources(batch);
+    async_load_batches_free_.push_back(
+        std::move(async_load_batches_submitted_.front()));
+    async_load_batches_submitted_.pop_front();
+    any_completed = true;
+  }
+  if (any_completed) {
+    // Replace the null textures in the bindings.
+    TextureFetchConstantsWritten(0, xenos::kTextureFetchConstantCount - 1);
+  }
+
+  // Keep the textures still being loaded from being destroyed.
+  for (const std::unique_ptr<AsyncLoadBatch>& batch :
+       async_load_batches_closed_) {
+    for (VulkanTexture* texture : batch->textures) {
+      texture->MarkAsUsed();
+    }
+  }
+  for (const std::unique_ptr<AsyncLoadBatch>& batch :
+       async_load_batches_submitted_) {
+    for (VulkanTexture* texture : batch->textures) {
+      texture->MarkAsUsed();
+    }
+  }
+}
+
+void VulkanTextureCache::AwaitAndDropAsyncLoadBatches() {
+  const ui::vulkan::VulkanProvider& provider =
+      command_processor_.GetVulkanProvider();
+  const ui::vulkan::VulkanProvider::DeviceFunctions& dfn = provider.dfn();
+  VkDevice device = provider.device();
+
+  if (async_load_batch_open_) {
+    async_load_batches_closed_.push_back(std::move(async_load_batch_open_));
+    ++async_load_batch_current_;
+  }
+  for (std::unique_ptr<AsyncLoadBatch>& batch : async_load_batches_submitted_) {
+    dfn.vkWaitForFences(device, 1, &batch->fence, VK_TRUE, UINT64_MAX);
+    dfn.vkDestroySemaphore(device, batch->semaphore, nullptr);
+    batch->semaphore = VK_NULL_HANDLE;
+    async_load_constants_pool_->Reclaim(batch->index);
+    // The textures have been transitioned to the guest shader usage by the
+    // batch.
+    for (VulkanTexture* texture : batch->textures) {
+      texture->set_async_load_batch(0);
+    }
+    ReleaseAsyncLoadBatchResources(*batch);
+    async_load_batches_free_.push_back(std::move(batch));
+  }
+  async_load_batches_submitted_.clear();
+  for (std::unique_ptr<AsyncLoadBatch>& batch : async_load_batches_closed_) {
+    // Not executed, the usage tracking is not valid anymore.
+    for (VulkanTexture* texture : batch->textures) {
+      texture->set_async_load_batch(0);
+      texture->SetUsage(VulkanTexture::Usage::kUndefined);
+    }
+    ReleaseAsyncLoadBatchResources(*batch);
+    async_load_batches_free_.push_back(std::move(batch));
+  }
+  async_load_batches_closed_.clear();
+  if (async_load_constants_pool_) {
+    async_load_constants_pool_->ClearCache();
+  }
+}
+
 }  // namespace vulkan
 }  // namespace gpu
 }  // namespace xe
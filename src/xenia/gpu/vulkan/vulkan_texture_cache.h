@@ -11,16 +11,21 @@
 #define XENIA_GPU_VULKAN_VULKAN_TEXTURE_CACHE_H_
 
 #include <array>
+#include <deque>
 #include <memory>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "xenia/base/hash.h"
 #include "xenia/gpu/texture_cache.h"
+#include "xenia/gpu/vulkan/deferred_command_buffer.h"
 #include "xenia/gpu/vulkan/vulkan_shader.h"
 #include "xenia/gpu/vulkan/vulkan_shared_memory.h"
+#include "xenia/ui/vulkan/linked_type_descriptor_set_allocator.h"
 #include "xenia/ui/vulkan/vulkan_mem_alloc.h"
 #include "xenia/ui/vulkan/vulkan_provider.h"
+#include "xenia/ui/vulkan/vulkan_upload_buffer_pool.h"
 
 namespace xe {
 namespace gpu {
@@ -82,7 +87,11 @@ class VulkanTextureCache final : public TextureCache {
 
   ~VulkanTextureCache();
 
+  void ClearCache() override;
+
+  void CompletedSubmissionUpdated(uint64_t completed_submission_index) override;
   void BeginSubmission(uint64_t new_submission_index) override;
+  void BeginFrame() override;
 
   // Must be called within a frame - creates and untiles textures needed by
   // shaders, and enqueues transitioning them into the sampled usage. This may
@@ -135,6 +144,20 @@ class VulkanTextureCache final : public TextureCache {
 
   bool LoadTextureDataFromResidentMemoryImpl(Texture& texture, bool load_base,
                                              bool load_mips) override;
+  bool CopyTextureDataImpl(Texture& dest, Texture& source) override;
+
+  bool GetDeviceMemoryBudget(uint64_t& usage_out,
+                             uint64_t& budget_out) override;
+
+  const char* GetTextureStorageImplementationName() const override {
+    return "vulkan";
+  }
+  uint64_t GetTextureStorageHostFormat(const Texture& texture) const override;
+  bool LoadTextureDataFromStorageImpl(Texture& texture, const void* data,
+                                      size_t data_size) override;
+  bool LoadAndStoreTextureDataFromResidentMemoryImpl(
+      Texture& texture, bool load_base, bool load_mips,
+      uint64_t storage_hash) override;
 
   void UpdateTextureBindingsImpl(uint32_t fetch_constant_mask) override;
 
@@ -178,6 +201,7 @@ class VulkanTextureCache final : public TextureCache {
    public:
     enum class Usage {
       kUndefined,
+      kTransferSource,
       kTransferDestination,
       kGuestShaderSampled,
       kSwapSampled,
@@ -191,6 +215,7 @@ class VulkanTextureCache final : public TextureCache {
 
     VkImage image() const { return image_; }
 
+    Usage usage() const { return usage_; }
     // Doesn't transition (the caller must insert the barrier).
     Usage SetUsage(Usage new_usage) {
       Usage old_usage = usage_;
@@ -201,6 +226,20 @@ class VulkanTextureCache final : public TextureCache {
     VkImageView GetView(bool is_signed, uint32_t host_swizzle,
                         bool is_array = true);
 
+    // Switches to an image in a different location, for the defragmentation.
+    // The old views are appended to old_views_out, and the old image is
+    // returned, for destruction when the GPU is not using them anymore.
+    VkImage ReplaceImage(VkImage new_image,
+                         std::vector<VkImageView>& old_views_out);
+
+    // The latest asynchronous load batch writing to the texture, or 0 if the
+    // texture can be used in the command processor's submissions. While it's
+    // being loaded asynchronously, the usage is that in the load batches.
+    uint64_t async_load_batch() const { return async_load_batch_; }
+    void set_async_load_batch(uint64_t async_load_batch) {
+      async_load_batch_ = async_load_batch;
+    }
+
    private:
     union ViewKey {
       uint32_t key;
@@ -260,9 +299,36 @@ class VulkanTextureCache final : public TextureCache {
 
     Usage usage_ = Usage::kUndefined;
 
+    uint64_t async_load_batch_ = 0;
+
     std::unordered_map<ViewKey, VkImageView, ViewKey::Hasher> views_;
   };
 
+  // Loads of textures that have never been used before, executed on a separate
+  // queue after the command processor submission uploading their data to the
+  // shared memory has been completed, so large loads don't delay the guest
+  // rendering. Until a texture is loaded, the null texture is bound instead.
+  struct AsyncLoadBatch {
+    explicit AsyncLoadBatch(VulkanCommandProcessor& command_processor);
+
+    uint64_t index = 0;
+    // The command processor submission that must be completed before
+    // submitting the batch.
+    uint64_t source_submission = 0;
+    DeferredCommandBuffer deferred_command_buffer;
+    ui::vulkan::LinkedTypeDescriptorSetAllocator descriptor_allocator;
+    VkCommandPool command_pool = VK_NULL_HANDLE;
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    // Signaled by the batch, awaited by the first command processor submission
+    // after the batch has been completed. Owned by the batch only while it's
+    // being executed.
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    std::vector<std::pair<VkBuffer, VmaAllocation>> scratch_buffers;
+    VkPipeline current_pipeline = VK_NULL_HANDLE;
+    std::vector<VulkanTexture*> textures;
+  };
+
   struct VulkanTextureBinding {
     VkImageView image_view_unsigned;
     VkImageView image_view_signed;
@@ -305,16 +371,77 @@ class VulkanTextureCache final : public TextureCache {
       VulkanCommandProcessor& command_processor,
       VkPipelineStageFlags guest_shader_pipeline_stages);
 
+  // Image parameters for a texture, with the pNext chain pointing to the
+  // members of the structure itself.
+  struct TextureImageCreateInfo {
+    VkImageCreateInfo image_create_info;
+    VkImageFormatListCreateInfoKHR image_format_list_create_info;
+    VkFormat formats[2];
+  };
+
+  // Frames to wait before trying to defragment again after nothing was moved.
+  static constexpr uint64_t kTextureDefragmentationIntervalFrames = 600;
+
   bool Initialize();
 
   const HostFormatPair& GetHostFormatPair(TextureKey key) const;
+  // The format of the host data written by the load shader for the texture.
+  const HostFormat& GetLoadHostFormat(const TextureKey& key) const;
+
+  // Loads the data via the load shaders, or, if stored_data is not null, from
+  // the data of the whole texture previously read back for the storage. If
+  // store is true, the data written by the load shaders is read back for
+  // passing it to StoreTextureData.
+  bool LoadTextureDataImpl(VulkanTexture& vulkan_texture, bool load_base,
+                           bool load_mips, const void* stored_data,
+                           size_t stored_data_size, bool store,
+                           uint64_t storage_hash);
+  bool CreateStorageTransferBuffer(size_t size, bool readback,
+                                   uint64_t storage_hash, VkBuffer& buffer_out,
+                                   void*& mapping_out);
+  void ReleaseStorageTransferBuffers(uint64_t completed_submission_index);
 
   void GetTextureUsageMasks(VulkanTexture::Usage usage,
                             VkPipelineStageFlags& stage_mask,
                             VkAccessFlags& access_mask, VkImageLayout& layout);
 
+  bool GetTextureImageCreateInfo(const TextureKey& key,
+                                 TextureImageCreateInfo& create_info_out) const;
+  // Copies all the subresources of an image of the texture with the key, the
+  // images must be in the transfer usages already.
+  void RecordTextureImageCopy(const TextureKey& key, VkImage source,
+                              VkImage dest);
+
+  // Moves up to vulkan_texture_defragmentation_mb_per_frame of textures in the
+  // texture pool to compact it, the old memory is freed when the copying is
+  // completed.
+  void DefragmentTextures();
+  void EndTextureDefragmentationPass();
+  void EndTextureDefragmentation();
+
   xenos::ClampMode NormalizeClampMode(xenos::ClampMode clamp_mode) const;
 
+  // Allocates a single compute storage or uniform buffer descriptor for a
+  // texture load, from the asynchronous load batch if not null, or from the
+  // command processor otherwise.
+  VkDescriptorSet AllocateLoadDescriptor(AsyncLoadBatch* async_batch,
+                                         bool is_storage_buffer);
+  uint8_t* WriteAsyncLoadUniformBufferBinding(
+      AsyncLoadBatch& batch, size_t size, VkDescriptorSet& descriptor_set_out);
+  AsyncLoadBatch& GetCurrentAsyncLoadBatch();
+  // Transitions the textures loaded by the open batch to the guest shader
+  // usage and queues the batch for submission.
+  void CloseAsyncLoadBatch(uint64_t source_submission);
+  void ReleaseAsyncLoadBatchResources(AsyncLoadBatch& batch);
+  // Submits the closed batches whose source data is ready.
+  void SubmitAsyncLoadBatches(uint64_t completed_submission_index);
+  bool SubmitAsyncLoadBatch(AsyncLoadBatch& batch);
+  // Makes the textures loaded by the completed batches usable in the current
+  // submission.
+  void CompleteAsyncLoadBatches();
+  // Waits for the batches submitted to the queue, and drops the rest.
+  void AwaitAndDropAsyncLoadBatches();
+
   VulkanCommandProcessor& command_processor_;
   VkPipelineStageFlags guest_shader_pipeline_stages_;
 
@@ -323,6 +450,17 @@ class VulkanTextureCache final : public TextureCache {
   // on Windows versions before 10, may have an allocation count limit as low as
   // 4096.
   VmaAllocator vma_allocator_ = VK_NULL_HANDLE;
+  // The textures are placed in their own pool, separately from the temporary
+  // buffers allocated with VMA, if the defragmentation is enabled.
+  VmaPool texture_pool_ = VK_NULL_HANDLE;
+  VmaDefragmentationContext texture_defragmentation_context_ = VK_NULL_HANDLE;
+  VmaDefragmentationPassMoveInfo texture_defragmentation_pass_ = {};
+  // The submission copying the data of the current defragmentation pass, 0 if
+  // not in a pass.
+  uint64_t texture_defragmentation_pass_submission_ = 0;
+  std::vector<VkImage> texture_defragmentation_old_images_;
+  std::vector<VkImageView> texture_defragmentation_old_views_;
+  uint64_t texture_defragmentation_next_frame_ = 0;
 
   static const HostFormatPair kBestHostFormats[64];
   static const HostFormatPair kHostFormatGBGRUnaligned;
@@ -346,6 +484,34 @@ class VulkanTextureCache final : public TextureCache {
   std::array<VulkanTextureBinding, xenos::kTextureFetchConstantCount>
       vulkan_texture_bindings_;
 
+  bool async_loading_enabled_ = false;
+  // Whether LoadTextureDataFromResidentMemoryImpl may load textures
+  // asynchronously - when called for the guest shader bindings.
+  bool async_loading_allowed_ = false;
+  uint64_t async_load_batch_current_ = 1;
+  std::unique_ptr<AsyncLoadBatch> async_load_batch_open_;
+  // Waiting for the source submission.
+  std::deque<std::unique_ptr<AsyncLoadBatch>> async_load_batches_closed_;
+  std::deque<std::unique_ptr<AsyncLoadBatch>> async_load_batches_submitted_;
+  std::vector<std::unique_ptr<AsyncLoadBatch>> async_load_batches_free_;
+  // Load constants, with batch indices instead of submission indices.
+  std::unique_ptr<ui::vulkan::VulkanUploadBufferPool>
+      async_load_constants_pool_;
+
+  // Host-visible buffers for uploading the data from the texture storage or
+  // reading the loaded data back for storing it, destroyed (and, for readback,
+  // passed to the storage) when the submission using them is completed.
+  struct StorageTransferBuffer {
+    uint64_t submission_index;
+    VkBuffer buffer;
+    VmaAllocation allocation;
+    void* mapping;
+    size_t size;
+    bool readback;
+    uint64_t storage_hash;
+  };
+  std::deque<StorageTransferBuffer> storage_transfer_buffers_;
+
   uint32_t sampler_max_count_;
 
   xenos::AnisoFilter max_anisotropy_;
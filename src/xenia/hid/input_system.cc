@@ -9,6 +9,12 @@
 
 #include "xenia/hid/input_system.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/profiling.h"
 #include "xenia/hid/hid_flags.h"
 #include "xenia/hid/input_driver.h"
@@ -17,12 +23,46 @@ namespace xe {
 namespace hid {
 
 DEFINE_bool(vibration, true, "Toggle controller vibration.", "HID");
+DEFINE_uint32(
+    input_sampling_rate, 0,
+    "Rate (in Hz) at which the controller state is polled from the input "
+    "drivers on a separate thread, with the guest reading the latest sample "
+    "without locking, or 0 to poll the drivers on every guest request.",
+    "HID");
 
 InputSystem::InputSystem(xe::ui::Window* window) : window_(window) {}
 
-InputSystem::~InputSystem() = default;
+InputSystem::~InputSystem() {
+  if (sampling_thread_) {
+    sampling_thread_shutdown_.store(true, std::memory_order_relaxed);
+    xe::threading::Wait(sampling_thread_.get(), false);
+    sampling_thread_.reset();
+  }
+}
 
-X_STATUS InputSystem::Setup() { return X_STATUS_SUCCESS; }
+X_STATUS InputSystem::Setup() {
+  if (cvars::input_sampling_rate && !sampling_thread_) {
+    // Take the first samples before the guest may request the state.
+    for (uint32_t user_index = 0; user_index < kMaxUsers; ++user_index) {
+      X_INPUT_STATE state = {};
+      X_RESULT result = PollState(user_index, &state);
+      SampledState& sampled_state = sampled_states_[user_index];
+      uint32_t state_words[sizeof(X_INPUT_STATE) / sizeof(uint32_t)];
+      std::memcpy(state_words, &state, sizeof(state));
+      for (size_t i = 0; i < sampled_state.state.size(); ++i) {
+        sampled_state.state[i].store(state_words[i], std::memory_order_relaxed);
+      }
+      sampled_state.result.store(result, std::memory_order_relaxed);
+      sampled_state.change_host_tick.store(xe::Clock::QueryHostTickCount(),
+                                           std::memory_order_relaxed);
+    }
+    sampling_thread_ =
+        xe::threading::Thread::Create({}, [this]() { SamplingThread(); });
+    assert_not_null(sampling_thread_);
+    sampling_thread_->set_name("Input Sampling");
+  }
+  return X_STATUS_SUCCESS;
+}
 
 void InputSystem::AddDriver(std::unique_ptr<InputDriver> driver) {
   drivers_.push_back(std::move(driver));
@@ -60,6 +100,46 @@ X_RESULT InputSystem::GetCapabilities(uint32_t user_index, uint32_t flags,
 }
 
 X_RESULT InputSystem::GetState(uint32_t user_index, X_INPUT_STATE* out_state) {
+  if (!sampling_thread_) {
+    return PollState(user_index, out_state);
+  }
+  if (user_index >= kMaxUsers) {
+    return X_ERROR_DEVICE_NOT_CONNECTED;
+  }
+  const SampledState& sampled_state = sampled_states_[user_index];
+  uint32_t state_words[sizeof(X_INPUT_STATE) / sizeof(uint32_t)];
+  X_RESULT result;
+  for (;;) {
+    uint32_t sequence = sampled_state.sequence.load(std::memory_order_acquire);
+    if (sequence & 1) {
+      xe::threading::MaybeYield();
+      continue;
+    }
+    result = sampled_state.result.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < sampled_state.state.size(); ++i) {
+      state_words[i] = sampled_state.state[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (sampled_state.sequence.load(std::memory_order_relaxed) == sequence) {
+      break;
+    }
+  }
+  if (out_state && result == X_ERROR_SUCCESS) {
+    std::memcpy(out_state, state_words, sizeof(X_INPUT_STATE));
+  }
+  return result;
+}
+
+uint64_t InputSystem::GetStateChangeHostTick(uint32_t user_index) const {
+  if (!sampling_thread_ || user_index >= kMaxUsers) {
+    return 0;
+  }
+  return sampled_states_[user_index].change_host_tick.load(
+      std::memory_order_relaxed);
+}
+
+X_RESULT InputSystem::PollState(uint32_t user_index,
+                                X_INPUT_STATE* out_state) {
   SCOPE_profile_cpu_f("hid");
 
   bool any_connected = false;
@@ -140,5 +220,45 @@ X_INPUT_VIBRATION InputSystem::ModifyVibrationLevel(
 std::unique_lock<xe_unlikely_mutex> InputSystem::lock() {
   return std::unique_lock<xe_unlikely_mutex>{lock_};
 }
+
+void InputSystem::SamplingThread() {
+  auto interval = std::chrono::microseconds(
+      1000000 / std::max(cvars::input_sampling_rate, uint32_t(1)));
+  while (!sampling_thread_shutdown_.load(std::memory_order_relaxed)) {
+    for (uint32_t user_index = 0; user_index < kMaxUsers; ++user_index) {
+      X_INPUT_STATE state = {};
+      X_RESULT result;
+      {
+        auto input_lock = lock();
+        result = PollState(user_index, &state);
+      }
+      uint32_t state_words[sizeof(X_INPUT_STATE) / sizeof(uint32_t)];
+      std::memcpy(state_words, &state, sizeof(state));
+      SampledState& sampled_state = sampled_states_[user_index];
+      // Only this thread writes, no need to read the sample in a loop.
+      bool changed =
+          sampled_state.result.load(std::memory_order_relaxed) != result;
+      for (size_t i = 0; !changed && i < sampled_state.state.size(); ++i) {
+        changed = sampled_state.state[i].load(std::memory_order_relaxed) !=
+                  state_words[i];
+      }
+      if (!changed) {
+        continue;
+      }
+      uint32_t sequence =
+          sampled_state.sequence.load(std::memory_order_relaxed);
+      sampled_state.sequence.store(sequence + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      sampled_state.result.store(result, std::memory_order_relaxed);
+      for (size_t i = 0; i < sampled_state.state.size(); ++i) {
+        sampled_state.state[i].store(state_words[i], std::memory_order_relaxed);
+      }
+      sampled_state.change_host_tick.store(xe::Clock::QueryHostTickCount(),
+                                           std::memory_order_relaxed);
+      sampled_state.sequence.store(sequence + 2, std::memory_order_release);
+    }
+    xe::threading::Sleep(interval);
+  }
+}
 }  // namespace hid
 }  // namespace xe
@@ -10,9 +10,12 @@
 #ifndef XENIA_HID_INPUT_SYSTEM_H_
 #define XENIA_HID_INPUT_SYSTEM_H_
 
+#include <array>
+#include <atomic>
 #include <memory>
 #include <vector>
 #include "xenia/base/mutex.h"
+#include "xenia/base/threading.h"
 #include "xenia/hid/input.h"
 #include "xenia/hid/input_driver.h"
 #include "xenia/xbox.h"
@@ -39,7 +42,15 @@ class InputSystem {
 
   X_RESULT GetCapabilities(uint32_t user_index, uint32_t flags,
                            X_INPUT_CAPABILITIES* out_caps);
+  // If the state is sampled (input_sampling_rate is not 0), returns the latest
+  // sample without locking, otherwise polls the drivers and must be called
+  // with the lock held.
   X_RESULT GetState(uint32_t user_index, X_INPUT_STATE* out_state);
+  bool is_state_sampled() const { return sampling_thread_ != nullptr; }
+  // Host tick count of the sample in which the state currently returned by
+  // GetState for the user first appeared, for measuring the latency from the
+  // input to its effect. 0 if the state isn't sampled.
+  uint64_t GetStateChangeHostTick(uint32_t user_index) const;
   X_RESULT SetState(uint32_t user_index, X_INPUT_VIBRATION* vibration);
   X_RESULT GetKeystroke(uint32_t user_index, uint32_t flags,
                         X_INPUT_KEYSTROKE* out_keystroke);
@@ -51,10 +62,30 @@ class InputSystem {
   std::unique_lock<xe_unlikely_mutex> lock();
 
  private:
+  static constexpr uint32_t kMaxUsers = 4;
+
+  // Latest state of a user polled by the sampling thread, written with a
+  // sequence lock so it can be read by guest threads without waiting.
+  struct SampledState {
+    // Odd while being written.
+    std::atomic<uint32_t> sequence{0};
+    std::atomic<uint32_t> result{X_ERROR_DEVICE_NOT_CONNECTED};
+    std::array<std::atomic<uint32_t>, sizeof(X_INPUT_STATE) / sizeof(uint32_t)>
+        state{};
+    std::atomic<uint64_t> change_host_tick{0};
+  };
+
+  X_RESULT PollState(uint32_t user_index, X_INPUT_STATE* out_state);
+  void SamplingThread();
+
   xe::ui::Window* window_ = nullptr;
 
   std::vector<std::unique_ptr<InputDriver>> drivers_;
 
+  std::array<SampledState, kMaxUsers> sampled_states_;
+  std::atomic<bool> sampling_thread_shutdown_{false};
+  std::unique_ptr<xe::threading::Thread> sampling_thread_;
+
   X_INPUT_VIBRATION ModifyVibrationLevel(X_INPUT_VIBRATION* vibration);
   uint8_t connected_slot = 0b0001;
   xe_unlikely_mutex lock_;
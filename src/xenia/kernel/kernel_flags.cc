@@ -14,3 +14,7 @@ DEFINE_bool(headless, false,
             "UI");
 DEFINE_bool(log_high_frequency_kernel_calls, false,
             "Log kernel calls with the kHighFrequency tag.", "Kernel");
+DEFINE_bool(profile_kernel_calls, false,
+            "Measure the time spent in each kernel export, shown in the "
+            "profiler and logged on exit.",
+            "Kernel");
@@ -16,10 +16,13 @@
 #include "xenia/base/byte_stream.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/string.h"
+#include "xenia/cpu/ppc/ppc_frontend.h"
 #include "xenia/cpu/processor.h"
 #include "xenia/emulator.h"
 #include "xenia/hid/input_system.h"
+#include "xenia/kernel/socket_reactor.h"
 #include "xenia/kernel/user_module.h"
+#include "xenia/kernel/util/guest_stack_pool.h"
 #include "xenia/kernel/util/shim_utils.h"
 #include "xenia/kernel/xam/xam_module.h"
 #include "xenia/kernel/xboxkrnl/xboxkrnl_memory.h"
@@ -33,6 +36,11 @@
 #include "xenia/kernel/xthread.h"
 
 DEFINE_bool(apply_title_update, true, "Apply title updates.", "Kernel");
+DEFINE_int32(async_file_io_threads, 0,
+             "Number of threads completing overlapped file reads in the "
+             "background, so several can be in flight at once. With 0, they're "
+             "completed on the calling thread before returning.",
+             "Kernel");
 
 namespace xe {
 namespace kernel {
@@ -50,6 +58,7 @@ KernelState::KernelState(Emulator* emulator)
     : emulator_(emulator),
       memory_(emulator->memory()),
       dispatch_thread_running_(false),
+      file_io_threads_running_(false),
       dpc_list_(emulator->memory()),
       kernel_trampoline_group_(emulator->processor()->backend()) {
   assert_null(shared_kernel_state_);
@@ -59,6 +68,10 @@ KernelState::KernelState(Emulator* emulator)
 
   app_manager_ = std::make_unique<xam::AppManager>();
   achievement_manager_ = std::make_unique<AchievementManager>();
+  socket_reactor_ = std::make_unique<SocketReactor>();
+  guest_stack_pool_ = std::make_unique<util::GuestStackPool>(
+      memory_, XThread::kStackAddressRangeBegin,
+      XThread::kStackAddressRangeEnd);
   user_profiles_.emplace(0, std::make_unique<xam::UserProfile>(0));
 
   InitializeKernelGuestGlobals();
@@ -84,6 +97,10 @@ KernelState::KernelState(Emulator* emulator)
 }
 
 KernelState::~KernelState() {
+  if (cvars::profile_kernel_calls) {
+    shim::DumpKernelCallProfiles();
+  }
+
   SetExecutableModule(nullptr);
 
   if (dispatch_thread_running_) {
@@ -92,6 +109,22 @@ KernelState::~KernelState() {
     dispatch_thread_->Wait(0, 0, 0, nullptr);
   }
 
+  if (file_io_threads_running_) {
+    {
+      auto global_lock = global_critical_region_.Acquire();
+      file_io_threads_running_ = false;
+      file_io_cond_.notify_all();
+    }
+    for (auto& file_io_thread : file_io_threads_) {
+      file_io_thread->Wait(0, 0, 0, nullptr);
+    }
+    file_io_threads_.clear();
+    file_io_queue_.clear();
+  }
+
+  // The pending socket operations reference the sockets and the guest memory.
+  socket_reactor_.reset();
+
   executable_module_.reset();
   user_modules_.clear();
   kernel_modules_.clear();
@@ -324,6 +357,10 @@ void KernelState::SetExecutableModule(object_ref<UserModule> module) {
 
   xex2_opt_tls_info* tls_header = nullptr;
   executable_module_->GetOptHeader(XEX_HEADER_TLS_INFO, &tls_header);
+  // Same layout as allocated by XThread, the slots follow the extended data.
+  processor()->frontend()->set_tls_slots_offset(
+      tls_header && tls_header->slot_count ? uint32_t(tls_header->data_size)
+                                           : 0);
   if (tls_header) {
     title_process->tls_static_data_address = tls_header->raw_data_address;
     title_process->tls_data_size = tls_header->data_size;
@@ -399,6 +436,47 @@ void KernelState::SetExecutableModule(object_ref<UserModule> module) {
     dispatch_thread_->set_name("Kernel Dispatch");
     dispatch_thread_->Create();
   }
+
+  if (!file_io_threads_running_ && cvars::async_file_io_threads > 0) {
+    file_io_threads_running_ = true;
+    for (int32_t i = 0; i < cvars::async_file_io_threads; ++i) {
+      auto file_io_thread = object_ref<XHostThread>(new XHostThread(
+          this, 128 * 1024, 0,
+          [this]() {
+            auto global_lock = global_critical_region_.AcquireDeferred();
+            while (true) {
+              global_lock.lock();
+              while (file_io_threads_running_ && file_io_queue_.empty()) {
+                file_io_cond_.wait(global_lock);
+              }
+              if (!file_io_threads_running_) {
+                global_lock.unlock();
+                break;
+              }
+              auto fn = std::move(file_io_queue_.front());
+              file_io_queue_.pop_front();
+              global_lock.unlock();
+
+              fn();
+            }
+            return 0;
+          },
+          GetSystemProcess()));
+      file_io_thread->set_name(fmt::format("Kernel File I/O {}", i));
+      file_io_thread->Create();
+      file_io_threads_.push_back(std::move(file_io_thread));
+    }
+  }
+}
+
+bool KernelState::QueueFileIO(std::function<void()> fn) {
+  auto global_lock = global_critical_region_.Acquire();
+  if (!file_io_threads_running_) {
+    return false;
+  }
+  file_io_queue_.push_back(std::move(fn));
+  file_io_cond_.notify_one();
+  return true;
 }
 
 void KernelState::LoadKernelModule(object_ref<KernelModule> kernel_module) {
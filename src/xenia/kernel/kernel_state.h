@@ -264,6 +264,9 @@ class KernelState {
   void BroadcastNotification(XNotificationID id, uint32_t data);
 
   util::NativeList* dpc_list() { return &dpc_list_; }
+  util::GuestStackPool* guest_stack_pool() const {
+    return guest_stack_pool_.get();
+  }
 
   void CompleteOverlapped(uint32_t overlapped_ptr, X_RESULT result);
   void CompleteOverlappedEx(uint32_t overlapped_ptr, X_RESULT result,
@@ -292,6 +295,14 @@ class KernelState {
       uint32_t overlapped_ptr, std::function<void()> pre_callback = nullptr,
       std::function<void()> post_callback = nullptr);
 
+  // Runs a file I/O request on one of the file I/O threads, which can call
+  // guest-facing kernel functions. Returns false without calling it if there
+  // are no file I/O threads.
+  bool QueueFileIO(std::function<void()> fn);
+
+  // Completes the overlapped socket operations.
+  SocketReactor* socket_reactor() const { return socket_reactor_.get(); }
+
   bool Save(ByteStream* stream);
   bool Restore(ByteStream* stream);
 
@@ -327,6 +338,8 @@ class KernelState {
   std::unique_ptr<xam::ContentManager> content_manager_;
   std::map<uint8_t, std::unique_ptr<xam::UserProfile>> user_profiles_;
   std::unique_ptr<AchievementManager> achievement_manager_;
+  // Declared before the objects so it outlives the threads.
+  std::unique_ptr<util::GuestStackPool> guest_stack_pool_;
 
   xe::global_critical_region global_critical_region_;
 
@@ -349,6 +362,14 @@ class KernelState {
   std::condition_variable_any dispatch_cond_;
   std::list<std::function<void()>> dispatch_queue_;
 
+  std::atomic<bool> file_io_threads_running_;
+  std::vector<object_ref<XHostThread>> file_io_threads_;
+  // Must be guarded by the global critical region.
+  std::condition_variable_any file_io_cond_;
+  std::list<std::function<void()>> file_io_queue_;
+
+  std::unique_ptr<SocketReactor> socket_reactor_;
+
   BitMap tls_bitmap_;
   uint32_t ke_timestamp_bundle_ptr_ = 0;
   std::unique_ptr<xe::threading::HighResolutionTimer> timestamp_timer_;
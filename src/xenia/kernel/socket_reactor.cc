@@ -0,0 +1,262 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/socket_reactor.h"
+
+#include <unordered_set>
+
+#include "xenia/base/logging.h"
+#include "xenia/base/platform.h"
+
+#ifdef XE_PLATFORM_WIN32
+// clang-format off
+#include "xenia/base/platform_win.h"
+#include <WS2tcpip.h>
+#include <WinSock2.h>
+// clang-format on
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace xe {
+namespace kernel {
+
+namespace {
+
+#ifdef XE_PLATFORM_WIN32
+using PollFd = WSAPOLLFD;
+using NativeSocket = SOCKET;
+int PollSockets(PollFd* fds, size_t count, int timeout_ms) {
+  return WSAPoll(fds, ULONG(count), timeout_ms);
+}
+bool IsPollInterrupted() { return false; }
+void CloseNativeSocket(uint64_t handle) { closesocket(SOCKET(handle)); }
+bool SetNonBlocking(uint64_t handle) {
+  u_long non_blocking = 1;
+  return ioctlsocket(SOCKET(handle), FIONBIO, &non_blocking) == 0;
+}
+#else
+using PollFd = pollfd;
+using NativeSocket = int;
+int PollSockets(PollFd* fds, size_t count, int timeout_ms) {
+  return poll(fds, nfds_t(count), timeout_ms);
+}
+bool IsPollInterrupted() { return errno == EINTR; }
+void CloseNativeSocket(uint64_t handle) { close(int(handle)); }
+bool SetNonBlocking(uint64_t handle) {
+  int flags = fcntl(int(handle), F_GETFL, 0);
+  return flags != -1 && fcntl(int(handle), F_SETFL, flags | O_NONBLOCK) == 0;
+}
+#endif
+
+PollFd MakePollFd(uint64_t handle, bool write) {
+  PollFd fd = {};
+  fd.fd = NativeSocket(handle);
+  fd.events = write ? POLLOUT : POLLIN;
+  return fd;
+}
+
+// Errors and hangups complete the operation too so it can report them.
+bool IsPollFdReady(const PollFd& fd) {
+  return (fd.revents & (fd.events | POLLERR | POLLHUP | POLLNVAL)) != 0;
+}
+
+uint64_t GetOperationKey(uint64_t handle, bool write) {
+  return (handle << 1) | uint64_t(write);
+}
+
+}  // namespace
+
+SocketReactor::SocketReactor() = default;
+
+SocketReactor::~SocketReactor() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  if (thread_) {
+    Wake();
+    threading::Wait(thread_.get(), false);
+    thread_.reset();
+  }
+  if (wake_handle_ != uint64_t(-1)) {
+    CloseNativeSocket(wake_handle_);
+  }
+  operations_.clear();
+}
+
+bool SocketReactor::IsReady(const XSocket& socket, bool write) {
+  PollFd fd = MakePollFd(socket.native_handle(), write);
+  return PollSockets(&fd, 1, 0) > 0 && IsPollFdReady(fd);
+}
+
+bool SocketReactor::EnsureThread() {
+  if (thread_) {
+    return true;
+  }
+  uint64_t wake_handle = uint64_t(socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+  if (wake_handle == uint64_t(NativeSocket(-1))) {
+    XELOGE("SocketReactor: Failed to create the wake socket");
+    return false;
+  }
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t address_length = sizeof(address);
+  if (bind(NativeSocket(wake_handle), reinterpret_cast<sockaddr*>(&address),
+           sizeof(address)) != 0 ||
+      getsockname(NativeSocket(wake_handle),
+                  reinterpret_cast<sockaddr*>(&address),
+                  &address_length) != 0 ||
+      connect(NativeSocket(wake_handle), reinterpret_cast<sockaddr*>(&address),
+              address_length) != 0 ||
+      !SetNonBlocking(wake_handle)) {
+    XELOGE("SocketReactor: Failed to set up the loopback wake socket");
+    CloseNativeSocket(wake_handle);
+    return false;
+  }
+  wake_handle_ = wake_handle;
+  thread_ = threading::Thread::Create({}, [this]() { ReactorThread(); });
+  if (!thread_) {
+    XELOGE("SocketReactor: Failed to create the reactor thread");
+    CloseNativeSocket(wake_handle_);
+    wake_handle_ = uint64_t(-1);
+    return false;
+  }
+  thread_->set_name("Socket Reactor");
+  return true;
+}
+
+void SocketReactor::Wake() {
+  char signal = 0;
+  send(NativeSocket(wake_handle_), &signal, 1, 0);
+}
+
+bool SocketReactor::Submit(object_ref<XSocket> socket, bool write,
+                           Completion completion) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (shutdown_ || !EnsureThread()) {
+      return false;
+    }
+    operations_.push_back({std::move(socket), write, std::move(completion)});
+  }
+  Wake();
+  return true;
+}
+
+void SocketReactor::CancelSocket(const XSocket* socket) {
+  std::vector<Operation> cancelled;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = operations_.begin();
+    while (it != operations_.end()) {
+      if (it->socket.get() == socket) {
+        cancelled.push_back(std::move(*it));
+        it = operations_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  if (cancelled.empty()) {
+    return;
+  }
+  // Stop waiting for the socket before it's closed and its handle is reused.
+  Wake();
+  for (Operation& operation : cancelled) {
+    operation.completion(true);
+  }
+}
+
+void SocketReactor::ReactorThread() {
+  std::vector<PollFd> fds;
+  std::unordered_set<uint64_t> ready_keys;
+  std::vector<Operation> ready_operations;
+  while (true) {
+    fds.clear();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (shutdown_) {
+        break;
+      }
+      fds.push_back(MakePollFd(wake_handle_, false));
+      for (const Operation& operation : operations_) {
+        fds.push_back(
+            MakePollFd(operation.socket->native_handle(), operation.write));
+      }
+    }
+
+    if (PollSockets(fds.data(), fds.size(), -1) < 0) {
+      if (!IsPollInterrupted()) {
+        XELOGE("SocketReactor: Waiting for the sockets has failed");
+        threading::MaybeYield();
+      }
+      continue;
+    }
+    if (fds[0].revents) {
+      char signals[64];
+      while (recv(NativeSocket(wake_handle_), signals, sizeof(signals), 0) >
+             0) {
+      }
+    }
+
+    // The operations may have been submitted or cancelled while waiting, so
+    // match them by the socket rather than by the index.
+    ready_keys.clear();
+    for (size_t i = 1; i < fds.size(); ++i) {
+      if (IsPollFdReady(fds[i])) {
+        ready_keys.insert(GetOperationKey(uint64_t(fds[i].fd),
+                                          (fds[i].events & POLLOUT) != 0));
+      }
+    }
+    if (ready_keys.empty()) {
+      continue;
+    }
+    ready_operations.clear();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = operations_.begin();
+      while (it != operations_.end()) {
+        if (ready_keys.count(
+                GetOperationKey(it->socket->native_handle(), it->write))) {
+          ready_operations.push_back(std::move(*it));
+          it = operations_.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+
+    // Completions write guest memory and signal guest events, which may take
+    // the global critical region, so they're called without the lock. If
+    // there are multiple operations on a socket, the earlier ones may have
+    // consumed the readiness, and the guest sockets are blocking, so check
+    // again before the later ones.
+    for (Operation& operation : ready_operations) {
+      uint64_t key =
+          GetOperationKey(operation.socket->native_handle(), operation.write);
+      bool ready = ready_keys.erase(key) ||
+                   IsReady(*operation.socket, operation.write);
+      if (!ready || !operation.completion(false)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        operations_.push_back(std::move(operation));
+      }
+    }
+  }
+}
+
+}  // namespace kernel
+}  // namespace xe
@@ -0,0 +1,79 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_KERNEL_SOCKET_REACTOR_H_
+#define XENIA_KERNEL_SOCKET_REACTOR_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "xenia/base/threading.h"
+#include "xenia/kernel/xobject.h"
+#include "xenia/kernel/xsocket.h"
+
+namespace xe {
+namespace kernel {
+
+// Completes the overlapped socket operations of the guest on a single host
+// thread waiting for the readiness of all the sockets with pending operations
+// at once, instead of a blocked host thread per socket.
+class SocketReactor {
+ public:
+  // Called on the reactor thread when the socket is ready, or on the thread
+  // cancelling the operation with cancelled set. Returns whether the operation
+  // has been completed - if it would still block, it stays pending (ignored
+  // when cancelled).
+  using Completion = std::function<bool(bool cancelled)>;
+
+  SocketReactor();
+  SocketReactor(const SocketReactor& reactor) = delete;
+  SocketReactor& operator=(const SocketReactor& reactor) = delete;
+  // Drops the pending operations without calling them.
+  ~SocketReactor();
+
+  // Whether a receive (or a send if write is true) on the socket can be done
+  // without blocking right now.
+  static bool IsReady(const XSocket& socket, bool write);
+
+  // Calls completion once the socket becomes ready for receiving (or sending
+  // if write is true). Starts the reactor thread on the first call, returns
+  // false without taking the operation if it couldn't be started.
+  bool Submit(object_ref<XSocket> socket, bool write, Completion completion);
+
+  // Cancels the pending operations of the socket, for instance, when it's
+  // closed.
+  void CancelSocket(const XSocket* socket);
+
+ private:
+  struct Operation {
+    object_ref<XSocket> socket;
+    bool write;
+    Completion completion;
+  };
+
+  bool EnsureThread();
+  void Wake();
+  void ReactorThread();
+
+  std::mutex mutex_;
+  std::vector<Operation> operations_;
+  bool shutdown_ = false;
+  // Loopback datagram socket connected to itself for interrupting the wait
+  // when operations are submitted or cancelled.
+  uint64_t wake_handle_ = uint64_t(-1);
+  std::unique_ptr<threading::Thread> thread_;
+};
+
+}  // namespace kernel
+}  // namespace xe
+
+#endif  // XENIA_KERNEL_SOCKET_REACTOR_H_
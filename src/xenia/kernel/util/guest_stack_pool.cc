@@ -0,0 +1,109 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/kernel/util/guest_stack_pool.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/math.h"
+
+DEFINE_uint32(guest_stack_pool_size, 16,
+              "Maximum number of guest stacks of exited threads to keep for "
+              "reuse by new threads. 0 to free the stacks immediately.",
+              "Kernel");
+
+namespace xe {
+namespace kernel {
+namespace util {
+
+GuestStackPool::GuestStackPool(Memory* memory, uint32_t range_begin,
+                               uint32_t range_end)
+    : memory_(memory), range_begin_(range_begin), range_end_(range_end) {}
+
+GuestStackPool::~GuestStackPool() {
+  auto heap = memory_->LookupHeap(range_begin_);
+  for (const Stack& stack : free_stacks_) {
+    heap->Release(stack.alloc_base);
+  }
+}
+
+bool GuestStackPool::Acquire(uint32_t size, Stack& stack_out) {
+  auto heap = memory_->LookupHeap(range_begin_);
+
+  auto alignment = heap->page_size();
+  auto padding = heap->page_size() * 2;  // Guard page size * 2
+  size = xe::round_up(size, alignment);
+  auto actual_size = size + padding;
+
+  bool reused = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Most recently freed first, likely still in the host caches.
+    for (auto it = free_stacks_.rbegin(); it != free_stacks_.rend(); ++it) {
+      if (it->alloc_size == actual_size) {
+        stack_out = *it;
+        free_stacks_.erase(std::next(it).base());
+        reused = true;
+        break;
+      }
+    }
+    ++used_stack_count_;
+    max_used_stack_count_ = std::max(max_used_stack_count_, used_stack_count_);
+  }
+
+  if (!reused) {
+    uint32_t address = 0;
+    if (!heap->AllocRange(
+            range_begin_, range_end_, actual_size, alignment,
+            kMemoryAllocationReserve | kMemoryAllocationCommit,
+            kMemoryProtectRead | kMemoryProtectWrite, false, &address)) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --used_stack_count_;
+      return false;
+    }
+    stack_out.alloc_base = address;
+    stack_out.alloc_size = actual_size;
+    stack_out.limit = address + (padding / 2);
+    stack_out.base = stack_out.limit + size;
+  }
+
+  // Initialize the stack with junk, also when reused so threads don't see
+  // what the previous one has left.
+  memory_->Fill(stack_out.limit, size, 0xBE);
+
+  if (!reused) {
+    // Setup the guard pages
+    heap->Protect(stack_out.alloc_base, padding / 2, kMemoryProtectNoAccess);
+    heap->Protect(stack_out.base, padding / 2, kMemoryProtectNoAccess);
+  }
+
+  return true;
+}
+
+void GuestStackPool::Release(const Stack& stack) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Stacks of threads restored from a saved state have not been acquired.
+    if (used_stack_count_) {
+      --used_stack_count_;
+    }
+    if (free_stacks_.size() < cvars::guest_stack_pool_size &&
+        used_stack_count_ + free_stacks_.size() < max_used_stack_count_) {
+      free_stacks_.push_back(stack);
+      return;
+    }
+  }
+  memory_->LookupHeap(range_begin_)->Release(stack.alloc_base);
+}
+
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
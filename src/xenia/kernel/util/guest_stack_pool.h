@@ -0,0 +1,63 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_KERNEL_UTIL_GUEST_STACK_POOL_H_
+#define XENIA_KERNEL_UTIL_GUEST_STACK_POOL_H_
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "xenia/memory.h"
+
+namespace xe {
+namespace kernel {
+namespace util {
+
+// Allocates the guest stacks of the threads with guard pages at both ends, and
+// keeps the stacks of exited threads for reuse by new threads, so titles
+// creating short-lived threads don't allocate and protect memory for every
+// thread. No more stacks are kept than have been in use at the same time.
+class GuestStackPool {
+ public:
+  struct Stack {
+    uint32_t alloc_base;
+    uint32_t alloc_size;
+    // Lowest address usable by the thread.
+    uint32_t limit;
+    // Address the stack grows down from.
+    uint32_t base;
+  };
+
+  GuestStackPool(Memory* memory, uint32_t range_begin, uint32_t range_end);
+  GuestStackPool(const GuestStackPool& pool) = delete;
+  GuestStackPool& operator=(const GuestStackPool& pool) = delete;
+  // Releases the kept stacks.
+  ~GuestStackPool();
+
+  // Returns false if the memory couldn't be allocated.
+  bool Acquire(uint32_t size, Stack& stack_out);
+  void Release(const Stack& stack);
+
+ private:
+  Memory* memory_;
+  uint32_t range_begin_;
+  uint32_t range_end_;
+
+  std::mutex mutex_;
+  std::vector<Stack> free_stacks_;
+  uint32_t used_stack_count_ = 0;
+  uint32_t max_used_stack_count_ = 0;
+};
+
+}  // namespace util
+}  // namespace kernel
+}  // namespace xe
+
+#endif  // XENIA_KERNEL_UTIL_GUEST_STACK_POOL_H_
@@ -13,6 +13,7 @@ struct X_KPROCESS;
 struct TerminateNotification;
 struct X_TIME_STAMP_BUNDLE;
 class KernelState;
+class SocketReactor;
 struct XAPC;
 
 struct X_KPCR;
@@ -22,6 +23,7 @@ struct X_OBJECT_CREATE_INFORMATION;
 }  // namespace xe::kernel
 
 namespace xe::kernel::util {
+class GuestStackPool;
 class NativeList;
 class ObjectTable;
 }
@@ -10,10 +10,11 @@
 #include "xenia/kernel/util/object_table.h"
 
 #include <algorithm>
-#include <cstring>
+#include <new>
 
 #include "xenia/base/byte_stream.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/threading.h"
 #include "xenia/kernel/xobject.h"
 #include "xenia/kernel/xthread.h"
 
@@ -28,28 +29,35 @@ ObjectTable::~ObjectTable() { Reset(); }
 void ObjectTable::Reset() {
   auto global_lock = global_critical_region_.Acquire();
 
-  // Release all objects.
-  for (uint32_t n = 0; n < table_capacity_; n++) {
-    ObjectTableEntry& entry = table_[n];
-    if (entry.object) {
-      entry.object->Release();
-    }
-  }
-  for (uint32_t n = 0; n < host_table_capacity_; n++) {
-    ObjectTableEntry& entry = host_table_[n];
-    if (entry.object) {
-      entry.object->Release();
-    }
-  }
-
+  ObjectTableEntry* table = table_;
+  ObjectTableEntry* host_table = host_table_;
+  uint32_t table_capacity = table_capacity_;
+  uint32_t host_table_capacity = host_table_capacity_;
   table_capacity_ = 0;
   host_table_capacity_ = 0;
   last_free_entry_ = 0;
   last_free_host_entry_ = 0;
-  free(table_);
   table_ = nullptr;
-  free(host_table_);
   host_table_ = nullptr;
+  PublishTables();
+  WaitForLookups();
+
+  // Release all objects.
+  for (uint32_t n = 0; n < table_capacity; n++) {
+    XObject* object = table[n].object;
+    if (object) {
+      object->Release();
+    }
+  }
+  for (uint32_t n = 0; n < host_table_capacity; n++) {
+    XObject* object = host_table[n].object;
+    if (object) {
+      object->Release();
+    }
+  }
+
+  delete[] table;
+  delete[] host_table;
 }
 
 X_STATUS ObjectTable::FindFreeSlot(uint32_t* out_slot, bool host) {
@@ -87,18 +95,17 @@ X_STATUS ObjectTable::FindFreeSlot(uint32_t* out_slot, bool host) {
 
 bool ObjectTable::Resize(uint32_t new_capacity, bool host) {
   uint32_t capacity = host ? host_table_capacity_ : table_capacity_;
-  uint32_t new_size = new_capacity * sizeof(ObjectTableEntry);
-  uint32_t old_size = capacity * sizeof(ObjectTableEntry);
-  auto new_table = reinterpret_cast<ObjectTableEntry*>(
-      realloc(host ? host_table_ : table_, new_size));
+  ObjectTableEntry* old_table = host ? host_table_ : table_;
+  // Lookups may still be reading the old table, so it's replaced rather than
+  // reallocated in place.
+  auto new_table = new (std::nothrow) ObjectTableEntry[new_capacity];
   if (!new_table) {
     return false;
   }
-
-  // Zero out new entries.
-  if (new_size > old_size) {
-    std::memset(reinterpret_cast<uint8_t*>(new_table) + old_size, 0,
-                new_size - old_size);
+  for (uint32_t i = 0; i < std::min(capacity, new_capacity); ++i) {
+    new_table[i].handle_ref_count = old_table[i].handle_ref_count;
+    new_table[i].object.store(old_table[i].object.load(),
+                              std::memory_order_relaxed);
   }
 
   if (host) {
@@ -110,10 +117,41 @@ bool ObjectTable::Resize(uint32_t new_capacity, bool host) {
     table_capacity_ = new_capacity;
     table_ = new_table;
   }
+  PublishTables();
+
+  if (old_table) {
+    WaitForLookups();
+    delete[] old_table;
+  }
 
   return true;
 }
 
+void ObjectTable::PublishTables() {
+  auto publish = [](std::atomic<ObjectTableEntry*>& lookup_table,
+                    std::atomic<uint32_t>& lookup_capacity,
+                    ObjectTableEntry* table, uint32_t capacity) {
+    if (capacity >= lookup_capacity.load(std::memory_order_relaxed)) {
+      lookup_table.store(table, std::memory_order_release);
+      lookup_capacity.store(capacity, std::memory_order_release);
+    } else {
+      lookup_capacity.store(capacity, std::memory_order_release);
+      lookup_table.store(table, std::memory_order_release);
+    }
+  };
+  publish(lookup_table_, lookup_table_capacity_, table_, table_capacity_);
+  publish(lookup_host_table_, lookup_host_table_capacity_, host_table_,
+          host_table_capacity_);
+}
+
+void ObjectTable::WaitForLookups() {
+  // Lookups entering after this only see the tables as they are now.
+  uint32_t epoch = lookup_epoch_.fetch_add(1);
+  while (lookup_readers_[epoch & 1].load()) {
+    xe::threading::MaybeYield();
+  }
+}
+
 X_STATUS ObjectTable::AddHandle(XObject* object, X_HANDLE* out_handle) {
   X_STATUS result = X_STATUS_SUCCESS;
 
@@ -219,7 +257,7 @@ X_STATUS ObjectTable::RemoveHandle(X_HANDLE handle) {
   }
 
   if (entry->object) {
-    auto object = entry->object;
+    XObject* object = entry->object;
     entry->object = nullptr;
     assert_zero(entry->handle_ref_count);
     entry->handle_ref_count = 0;
@@ -237,7 +275,9 @@ X_STATUS ObjectTable::RemoveHandle(X_HANDLE handle) {
     if (!object->name().empty()) {
       RemoveNameMapping(object->name());
     }
-    // Release now that the object has been removed from the table.
+    // Release now that the object has been removed from the table, and no
+    // lookup can retain it anymore.
+    WaitForLookups();
     object->Release();
   }
 
@@ -249,19 +289,19 @@ std::vector<object_ref<XObject>> ObjectTable::GetAllObjects() {
   std::vector<object_ref<XObject>> results;
 
   for (uint32_t slot = 0; slot < host_table_capacity_; slot++) {
-    auto& entry = host_table_[slot];
-    if (entry.object && std::find(results.begin(), results.end(),
-                                  entry.object) == results.end()) {
-      entry.object->Retain();
-      results.push_back(object_ref<XObject>(entry.object));
+    XObject* object = host_table_[slot].object;
+    if (object && std::find(results.begin(), results.end(), object) ==
+                      results.end()) {
+      object->Retain();
+      results.push_back(object_ref<XObject>(object));
     }
   }
   for (uint32_t slot = 0; slot < table_capacity_; slot++) {
-    auto& entry = table_[slot];
-    if (entry.object && std::find(results.begin(), results.end(),
-                                  entry.object) == results.end()) {
-      entry.object->Retain();
-      results.push_back(object_ref<XObject>(entry.object));
+    XObject* object = table_[slot].object;
+    if (object && std::find(results.begin(), results.end(), object) ==
+                      results.end()) {
+      object->Retain();
+      results.push_back(object_ref<XObject>(object));
     }
   }
 
@@ -270,15 +310,22 @@ std::vector<object_ref<XObject>> ObjectTable::GetAllObjects() {
 
 void ObjectTable::PurgeAllObjects() {
   auto lock = global_critical_region_.Acquire();
+  std::vector<XObject*> purged_objects;
   for (uint32_t slot = 0; slot < table_capacity_; slot++) {
     auto& entry = table_[slot];
     if (entry.object) {
       entry.handle_ref_count = 0;
-      entry.object->Release();
+      purged_objects.push_back(entry.object);
 
       entry.object = nullptr;
     }
   }
+  if (!purged_objects.empty()) {
+    WaitForLookups();
+    for (XObject* object : purged_objects) {
+      object->Release();
+    }
+  }
 }
 
 ObjectTable::ObjectTableEntry* ObjectTable::LookupTable(X_HANDLE handle) {
@@ -315,32 +362,40 @@ object_ref<XObject> ObjectTable::LookupObject<XObject>(X_HANDLE handle,
 }
 
 XObject* ObjectTable::LookupObject(X_HANDLE handle, bool already_locked) {
+  // Doesn't take the lock, objects and tables are only released by the
+  // writers after WaitForLookups, so the lock state of the caller doesn't
+  // matter.
   handle = TranslateHandle(handle);
   if (!handle) {
     return nullptr;
   }
 
-  XObject* object = nullptr;
-  if (!already_locked) {
-    global_critical_region_.mutex().lock();
+  std::atomic<uint32_t>* readers;
+  for (;;) {
+    uint32_t epoch = lookup_epoch_.load();
+    readers = &lookup_readers_[epoch & 1];
+    readers->fetch_add(1);
+    // If the epoch has been advanced in between, the writer may not be waiting
+    // for this reader.
+    if (lookup_epoch_.load() == epoch) {
+      break;
+    }
+    readers->fetch_sub(1);
   }
 
   const bool is_host_object = XObject::is_handle_host_object(handle);
   uint32_t slot = GetHandleSlot(handle, is_host_object);
 
   // Verify slot.
-  if (is_host_object) {
-    if (slot < host_table_capacity_) {
-      ObjectTableEntry& entry = host_table_[slot];
-      if (entry.object) {
-        object = entry.object;
-      }
-    }
-  } else if (slot < table_capacity_) {
-    ObjectTableEntry& entry = table_[slot];
-    if (entry.object) {
-      object = entry.object;
-    }
+  uint32_t capacity = (is_host_object ? lookup_host_table_capacity_
+                                      : lookup_table_capacity_)
+                          .load(std::memory_order_acquire);
+  ObjectTableEntry* table =
+      (is_host_object ? lookup_host_table_ : lookup_table_)
+          .load(std::memory_order_acquire);
+  XObject* object = nullptr;
+  if (table && slot < capacity) {
+    object = table[slot].object.load(std::memory_order_acquire);
   }
 
   // Retain the object pointer.
@@ -348,9 +403,7 @@ XObject* ObjectTable::LookupObject(X_HANDLE handle, bool already_locked) {
     object->Retain();
   }
 
-  if (!already_locked) {
-    global_critical_region_.mutex().unlock();
-  }
+  readers->fetch_sub(1, std::memory_order_release);
 
   return object;
 }
@@ -359,20 +412,20 @@ void ObjectTable::GetObjectsByType(XObject::Type type,
                                    std::vector<object_ref<XObject>>* results) {
   auto global_lock = global_critical_region_.Acquire();
   for (uint32_t slot = 0; slot < host_table_capacity_; ++slot) {
-    auto& entry = host_table_[slot];
-    if (entry.object) {
-      if (entry.object->type() == type) {
-        entry.object->Retain();
-        results->push_back(object_ref<XObject>(entry.object));
+    XObject* object = host_table_[slot].object;
+    if (object) {
+      if (object->type() == type) {
+        object->Retain();
+        results->push_back(object_ref<XObject>(object));
       }
     }
   }
   for (uint32_t slot = 0; slot < table_capacity_; ++slot) {
-    auto& entry = table_[slot];
-    if (entry.object) {
-      if (entry.object->type() == type) {
-        entry.object->Retain();
-        results->push_back(object_ref<XObject>(entry.object));
+    XObject* object = table_[slot].object;
+    if (object) {
+      if (object->type() == type) {
+        object->Retain();
+        results->push_back(object_ref<XObject>(object));
       }
     }
   }
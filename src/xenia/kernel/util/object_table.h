@@ -10,6 +10,7 @@
 #ifndef XENIA_KERNEL_UTIL_OBJECT_TABLE_H_
 #define XENIA_KERNEL_UTIL_OBJECT_TABLE_H_
 
+#include <atomic>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -87,7 +88,8 @@ class ObjectTable {
  private:
   struct ObjectTableEntry {
     int handle_ref_count = 0;
-    XObject* object = nullptr;
+    // Written only with the lock held, read by lookups also without it.
+    std::atomic<XObject*> object{nullptr};
   };
   ObjectTableEntry* LookupTableInLock(X_HANDLE handle);
   ObjectTableEntry* LookupTable(X_HANDLE handle);
@@ -102,6 +104,11 @@ class ObjectTable {
   }
   X_STATUS FindFreeSlot(uint32_t* out_slot, bool host);
   bool Resize(uint32_t new_capacity, bool host);
+  // Makes the current tables visible to the lookups done without the lock.
+  void PublishTables();
+  // Waits until no lookup done without the lock may still be using anything
+  // removed from the tables before the call. Must be called with the lock.
+  void WaitForLookups();
 
   xe::global_critical_region global_critical_region_;
   uint32_t table_capacity_ = 0;
@@ -110,6 +117,17 @@ class ObjectTable {
   ObjectTableEntry* host_table_ = nullptr;
   uint32_t last_free_entry_ = 0;
   uint32_t last_free_host_entry_ = 0;
+  // Copies of the table pointers and capacities for the lookups done without
+  // the lock. The capacity is published after the pointer when growing and
+  // before it when shrinking, so it never exceeds that of the table read.
+  std::atomic<ObjectTableEntry*> lookup_table_{nullptr};
+  std::atomic<ObjectTableEntry*> lookup_host_table_{nullptr};
+  std::atomic<uint32_t> lookup_table_capacity_{0};
+  std::atomic<uint32_t> lookup_host_table_capacity_{0};
+  // Lookups count themselves as readers of the current epoch, which removals
+  // advance before waiting for the readers of the previous one to leave.
+  std::atomic<uint32_t> lookup_epoch_{0};
+  std::atomic<uint32_t> lookup_readers_[2] = {0, 0};
   std::unordered_map<string_key_case, X_HANDLE> name_table_;
   std::map<uint32_t, X_HANDLE> guest_to_host_handle_;
 };
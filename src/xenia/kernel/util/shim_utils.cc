@@ -8,11 +8,93 @@
  */
 
 #include "xenia/kernel/util/shim_utils.h"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
 #include "xenia/kernel/xthread.h"
 namespace xe {
 namespace kernel {
 namespace shim {
 
+// Function-local, as exports are registered during static initialization.
+static std::mutex& kernel_call_profiles_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+static std::vector<KernelCallProfile*>& kernel_call_profiles() {
+  static std::vector<KernelCallProfile*> profiles;
+  return profiles;
+}
+
+void RegisterKernelCallProfile(KernelCallProfile* profile) {
+  std::lock_guard<std::mutex> lock(kernel_call_profiles_mutex());
+  kernel_call_profiles().push_back(profile);
+}
+
+ApcDeliveryProfile& apc_delivery_profile() {
+  static ApcDeliveryProfile profile;
+  return profile;
+}
+
+void DumpKernelCallProfiles() {
+  const ApcDeliveryProfile& apc_profile = apc_delivery_profile();
+  uint64_t apc_count = apc_profile.apc_count.load(std::memory_order_relaxed);
+  if (apc_count) {
+    XELOGI("User APCs: {} delivered in {} batches", apc_count,
+           apc_profile.batch_count.load(std::memory_order_relaxed));
+  }
+
+  std::vector<KernelCallProfile*> profiles;
+  {
+    std::lock_guard<std::mutex> lock(kernel_call_profiles_mutex());
+    profiles = kernel_call_profiles();
+  }
+  profiles.erase(std::remove_if(profiles.begin(), profiles.end(),
+                                [](const KernelCallProfile* profile) {
+                                  return !profile->call_count.load(
+                                      std::memory_order_relaxed);
+                                }),
+                 profiles.end());
+  if (profiles.empty()) {
+    return;
+  }
+  std::sort(profiles.begin(), profiles.end(),
+            [](const KernelCallProfile* a, const KernelCallProfile* b) {
+              return a->total_ticks.load(std::memory_order_relaxed) >
+                     b->total_ticks.load(std::memory_order_relaxed);
+            });
+
+  double microseconds_per_tick = 1000000.0 / Clock::QueryHostTickFrequency();
+  XELOGI("Kernel calls: name, calls, total ms, mean us, p50/p90/p99 us");
+  for (const KernelCallProfile* profile : profiles) {
+    uint64_t call_count = profile->call_count.load(std::memory_order_relaxed);
+    uint64_t total_ticks = profile->total_ticks.load(std::memory_order_relaxed);
+    // Upper bounds of the buckets containing the percentiles.
+    double percentiles[] = {0.5, 0.9, 0.99};
+    double percentile_microseconds[3] = {};
+    size_t percentile_index = 0;
+    uint64_t counted_calls = 0;
+    for (size_t i = 0; i < KernelCallProfile::kHistogramBucketCount &&
+                       percentile_index < xe::countof(percentiles);
+         ++i) {
+      counted_calls += profile->histogram[i].load(std::memory_order_relaxed);
+      while (percentile_index < xe::countof(percentiles) &&
+             counted_calls >= percentiles[percentile_index] * call_count) {
+        percentile_microseconds[percentile_index++] =
+            double(uint64_t(1) << i) * microseconds_per_tick;
+      }
+    }
+    XELOGI("  {}: {}, {:.3f}, {:.3f}, {:.3f}/{:.3f}/{:.3f}",
+           profile->export_entry->name, call_count,
+           total_ticks * microseconds_per_tick / 1000.0,
+           total_ticks * microseconds_per_tick / call_count,
+           percentile_microseconds[0], percentile_microseconds[1],
+           percentile_microseconds[2]);
+  }
+}
+
 thread_local StringBuffer string_buffer_;
 
 StringBuffer* thread_local_string_buffer() { return &string_buffer_; }
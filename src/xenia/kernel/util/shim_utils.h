@@ -10,14 +10,18 @@
 #ifndef XENIA_KERNEL_UTIL_SHIM_UTILS_H_
 #define XENIA_KERNEL_UTIL_SHIM_UTILS_H_
 
+#include <atomic>
 #include <cstring>
 #include <string>
 #include <type_traits>
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/byte_order.h"
+#include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/math.h"
 #include "xenia/base/memory.h"
+#include "xenia/base/profiling.h"
 #include "xenia/base/string_buffer.h"
 #include "xenia/cpu/export_resolver.h"
 #include "xenia/cpu/ppc/ppc_context.h"
@@ -540,6 +544,53 @@ XE_NOALIAS void PrintKernelCall(cpu::Export* export_entry,
                                string_buffer.to_string_view(), LogSrc::Kernel);
   }
 }
+// Calls of an export and the time spent in them, gathered with
+// profile_kernel_calls.
+struct KernelCallProfile {
+  // Calls by the bit width of their duration in host ticks.
+  static constexpr size_t kHistogramBucketCount = 48;
+
+  explicit KernelCallProfile(const cpu::Export* export_entry)
+      : export_entry(export_entry) {}
+
+  const cpu::Export* export_entry;
+  std::atomic<uint64_t> call_count{0};
+  std::atomic<uint64_t> total_ticks{0};
+  std::atomic<uint64_t> histogram[kHistogramBucketCount] = {};
+};
+
+void RegisterKernelCallProfile(KernelCallProfile* profile);
+
+// User APCs delivered and the batches they have been taken off the queue in
+// with one acquisition of the APC lock, gathered with profile_kernel_calls.
+struct ApcDeliveryProfile {
+  std::atomic<uint64_t> apc_count{0};
+  std::atomic<uint64_t> batch_count{0};
+};
+ApcDeliveryProfile& apc_delivery_profile();
+
+// Logs the statistics of the exports that have been called, most expensive
+// first.
+void DumpKernelCallProfiles();
+
+class KernelCallProfileScope {
+ public:
+  explicit KernelCallProfileScope(KernelCallProfile& profile)
+      : profile_(profile), start_ticks_(Clock::QueryHostTickCount()) {}
+  ~KernelCallProfileScope() {
+    uint64_t ticks = Clock::QueryHostTickCount() - start_ticks_;
+    profile_.call_count.fetch_add(1, std::memory_order_relaxed);
+    profile_.total_ticks.fetch_add(ticks, std::memory_order_relaxed);
+    size_t bucket = std::min(size_t(64 - xe::lzcnt(ticks)),
+                             KernelCallProfile::kHistogramBucketCount - 1);
+    profile_.histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+  }
+
+ private:
+  KernelCallProfile& profile_;
+  uint64_t start_ticks_;
+};
+
 /*
         todo: need faster string formatting/concatenation (all arguments are
    always turned into strings except if kHighFrequency)
@@ -565,8 +616,18 @@ struct ExportRegistrerHelper {
 
     static const auto export_entry =
         new cpu::Export(ORDINAL, xe::cpu::Export::Type::kFunction, name, TAGS);
+    static KernelCallProfile profile(export_entry);
     struct X {
       static void Trampoline(PPCContext* ppc_context) {
+        if (cvars::profile_kernel_calls) {
+          SCOPE_profile_cpu_i("kernel", export_entry->name);
+          KernelCallProfileScope profile_scope(profile);
+          Call(ppc_context);
+        } else {
+          Call(ppc_context);
+        }
+      }
+      static void Call(PPCContext* ppc_context) {
         Param::Init init = {
             ppc_context,
             0,
@@ -615,6 +676,7 @@ struct ExportRegistrerHelper {
       }
     };
     export_entry->function_data.trampoline = &X::Trampoline;
+    RegisterKernelCallProfile(&profile);
     return export_entry;
   }
 };
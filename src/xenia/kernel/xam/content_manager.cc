@@ -11,6 +11,7 @@
 
 #include <array>
 #include <string>
+#include <system_error>
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/filesystem.h"
@@ -88,6 +89,22 @@ std::filesystem::path ContentManager::ResolvePackagePath(
   return package_path;
 }
 
+std::filesystem::path ContentManager::ResolveHeaderRoot(
+    XContentType content_type, uint32_t title_id) {
+  if (title_id == kCurrentlyRunningTitleId) {
+    title_id = kernel_state_->title_id();
+  }
+  // Header root path:
+  // content_root/title_id/Headers/content_type/
+  return root_path_ / fmt::format("{:08X}", title_id) /
+         kGameContentHeaderDirName / fmt::format("{:08X}", content_type);
+}
+
+void ContentManager::InvalidateContentListCache() {
+  std::lock_guard<std::mutex> lock(content_list_cache_mutex_);
+  content_list_cache_.clear();
+}
+
 std::vector<XCONTENT_AGGREGATE_DATA> ContentManager::ListContent(
     uint32_t device_id, XContentType content_type, uint32_t title_id) {
   std::vector<XCONTENT_AGGREGATE_DATA> result;
@@ -99,6 +116,26 @@ std::vector<XCONTENT_AGGREGATE_DATA> ContentManager::ListContent(
   // Search path:
   // content_root/title_id/type_name/*
   auto package_root = ResolvePackageRoot(content_type, title_id);
+
+  // Error codes are ignored - nonexistent directories have the same time every
+  // time.
+  std::error_code write_time_error;
+  auto package_root_write_time =
+      std::filesystem::last_write_time(package_root, write_time_error);
+  auto header_root_write_time = std::filesystem::last_write_time(
+      ResolveHeaderRoot(content_type, title_id), write_time_error);
+  auto cache_key =
+      std::make_tuple(device_id, uint32_t(content_type), title_id);
+  {
+    std::lock_guard<std::mutex> lock(content_list_cache_mutex_);
+    auto cache_it = content_list_cache_.find(cache_key);
+    if (cache_it != content_list_cache_.end() &&
+        cache_it->second.package_root_write_time == package_root_write_time &&
+        cache_it->second.header_root_write_time == header_root_write_time) {
+      return cache_it->second.content;
+    }
+  }
+
   auto file_infos = xe::filesystem::ListFiles(package_root);
   for (const auto& file_info : file_infos) {
     if (file_info.type != xe::filesystem::FileInfo::Type::kDirectory) {
@@ -120,6 +157,14 @@ std::vector<XCONTENT_AGGREGATE_DATA> ContentManager::ListContent(
       result.emplace_back(std::move(content_data));
     }
   }
+
+  {
+    std::lock_guard<std::mutex> lock(content_list_cache_mutex_);
+    ContentListCacheEntry& cache_entry = content_list_cache_[cache_key];
+    cache_entry.package_root_write_time = package_root_write_time;
+    cache_entry.header_root_write_time = header_root_write_time;
+    cache_entry.content = result;
+  }
   return result;
 }
 
@@ -158,6 +203,10 @@ X_RESULT ContentManager::WriteContentHeaderFile(
   }
   auto header_filename = data->file_name() + ".header";
 
+  // Overwriting a header doesn't change the modification time of the
+  // directory.
+  InvalidateContentListCache();
+
   xe::filesystem::CreateEmptyFile(header_path / header_filename);
 
   if (std::filesystem::exists(header_path / header_filename)) {
@@ -230,6 +279,7 @@ X_RESULT ContentManager::CreateContent(const std::string_view root_name,
   if (!std::filesystem::create_directories(package_path)) {
     return X_ERROR_ACCESS_DENIED;
   }
+  InvalidateContentListCache();
 
   auto package = ResolvePackage(root_name, data);
   assert_not_null(package);
@@ -324,6 +374,7 @@ X_RESULT ContentManager::DeleteContent(const XCONTENT_AGGREGATE_DATA& data) {
   }
 
   auto package_path = ResolvePackagePath(data);
+  InvalidateContentListCache();
   if (std::filesystem::remove_all(package_path) > 0) {
     return X_ERROR_SUCCESS;
   } else {
@@ -10,8 +10,12 @@
 #ifndef XENIA_KERNEL_XAM_CONTENT_MANAGER_H_
 #define XENIA_KERNEL_XAM_CONTENT_MANAGER_H_
 
+#include <filesystem>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
 
@@ -175,10 +179,28 @@ class ContentManager {
                                            uint32_t title_id = -1);
   std::filesystem::path ResolvePackagePath(const XCONTENT_AGGREGATE_DATA& data,
                                            const uint32_t disc_number = -1);
+  std::filesystem::path ResolveHeaderRoot(XContentType content_type,
+                                          uint32_t title_id);
+  void InvalidateContentListCache();
 
   KernelState* kernel_state_;
   std::filesystem::path root_path_;
 
+  // Results of ListContent, which reads the headers of all packages, with the
+  // modification times of the package and the header directories to detect
+  // changes done outside the emulator (adding or removing packages changes the
+  // modification time of the directory), while changes done via the content
+  // manager clear the cache.
+  struct ContentListCacheEntry {
+    std::filesystem::file_time_type package_root_write_time;
+    std::filesystem::file_time_type header_root_write_time;
+    std::vector<XCONTENT_AGGREGATE_DATA> content;
+  };
+  std::mutex content_list_cache_mutex_;
+  // <device ID, content type, title ID>.
+  std::map<std::tuple<uint32_t, uint32_t, uint32_t>, ContentListCacheEntry>
+      content_list_cache_;
+
   // TODO(benvanik): remove use of global lock, it's bad here!
   xe::global_critical_region global_critical_region_;
   std::unordered_map<string_key, ContentPackage*> open_packages_;
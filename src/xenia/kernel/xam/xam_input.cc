@@ -115,6 +115,9 @@ dword_result_t XamInputGetState_entry(dword_t user_index, dword_t flags,
   }
 
   auto input_system = kernel_state()->emulator()->input_system();
+  if (input_system->is_state_sampled()) {
+    return input_system->GetState(user_index, input_state);
+  }
   auto lock = input_system->lock();
   return input_system->GetState(user_index, input_state);
 }
@@ -7,11 +7,15 @@
  ******************************************************************************
  */
 
+#include <algorithm>
+#include <atomic>
 #include <cstring>
+#include <vector>
 
 #include "xenia/base/clock.h"
 #include "xenia/base/logging.h"
 #include "xenia/kernel/kernel_state.h"
+#include "xenia/kernel/socket_reactor.h"
 #include "xenia/kernel/util/shim_utils.h"
 #include "xenia/kernel/xam/xam_module.h"
 #include "xenia/kernel/xam/xam_private.h"
@@ -316,25 +320,147 @@ dword_result_t NetDll_WSAGetLastError_entry() {
 }
 DECLARE_XAM_EXPORT1(NetDll_WSAGetLastError, kNetworking, kImplemented);
 
+// Writes the result of an overlapped socket operation and signals its event.
+void CompleteWSAOverlapped(uint32_t overlapped_ptr, X_STATUS status,
+                           uint32_t length) {
+  auto overlapped =
+      kernel_memory()->TranslateVirtual<XWSAOVERLAPPED*>(overlapped_ptr);
+  overlapped->internal_high = length;
+  // Guests may poll the status instead of waiting for the event.
+  std::atomic_thread_fence(std::memory_order_release);
+  overlapped->internal = status;
+  uint32_t event_handle = overlapped->event_handle;
+  if (event_handle) {
+    auto ev =
+        kernel_state()->object_table()->LookupObject<XEvent>(event_handle);
+    if (ev) {
+      ev->Set(0, false);
+    }
+  }
+}
+
+// Receives into the guest buffers, returning the received length or -1.
+int RecvFromIntoBuffers(XSocket* socket, const std::vector<XWSABUF>& buffers,
+                        uint32_t flags, uint32_t from_ptr,
+                        uint32_t from_len_ptr) {
+  uint32_t total_length = 0;
+  for (const XWSABUF& buffer : buffers) {
+    total_length += buffer.len;
+  }
+  std::vector<uint8_t> data(total_length);
+  N_XSOCKADDR_IN native_from;
+  uint32_t native_from_len =
+      from_len_ptr ? xe::load_and_swap<uint32_t>(
+                         kernel_memory()->TranslateVirtual(from_len_ptr))
+                   : 0;
+  int ret = socket->RecvFrom(data.data(), total_length, flags,
+                             from_ptr ? &native_from : nullptr,
+                             from_len_ptr ? &native_from_len : nullptr);
+  if (ret < 0) {
+    return ret;
+  }
+
+  uint32_t offset = 0;
+  for (const XWSABUF& buffer : buffers) {
+    uint32_t length = std::min(uint32_t(buffer.len), uint32_t(ret) - offset);
+    if (!length) {
+      break;
+    }
+    std::memcpy(kernel_memory()->TranslateVirtual(buffer.buf_ptr),
+                data.data() + offset, length);
+    offset += length;
+  }
+  if (from_ptr) {
+    auto from = kernel_memory()->TranslateVirtual<XSOCKADDR_IN*>(from_ptr);
+    from->sin_family = native_from.sin_family;
+    from->sin_port = native_from.sin_port;
+    from->sin_addr = native_from.sin_addr;
+    std::memset(from->x_sin_zero, 0, sizeof(from->x_sin_zero));
+  }
+  if (from_len_ptr) {
+    xe::store_and_swap<uint32_t>(
+        kernel_memory()->TranslateVirtual(from_len_ptr), native_from_len);
+  }
+  return ret;
+}
+
+// Overlapped receives that would block are completed by the socket reactor,
+// which signals the event of the overlapped structure.
 dword_result_t NetDll_WSARecvFrom_entry(
-    dword_t caller, dword_t socket, pointer_t<XWSABUF> buffers_ptr,
+    dword_t caller, dword_t socket_handle, pointer_t<XWSABUF> buffers_ptr,
     dword_t buffer_count, lpdword_t num_bytes_recv, lpdword_t flags_ptr,
-    pointer_t<XSOCKADDR_IN> from_addr, pointer_t<XWSAOVERLAPPED> overlapped_ptr,
-    lpvoid_t completion_routine_ptr) {
-  if (overlapped_ptr) {
-    // auto evt = kernel_state()->object_table()->LookupObject<XEvent>(
-    //    overlapped_ptr->event_handle);
+    pointer_t<XSOCKADDR_IN> from_addr, lpdword_t from_len_ptr,
+    pointer_t<XWSAOVERLAPPED> overlapped_ptr, lpvoid_t completion_routine_ptr) {
+  assert(!completion_routine_ptr);
+
+  auto socket =
+      kernel_state()->object_table()->LookupObject<XSocket>(socket_handle);
+  if (!socket) {
+    XThread::SetLastError(uint32_t(X_WSAError::X_WSAENOTSOCK));
+    return -1;
+  }
 
-    // if (evt) {
-    //  //evt->Set(0, false);
-    //}
+  // The buffer array doesn't need to stay valid while the operation is
+  // pending, unlike the buffers themselves.
+  std::vector<XWSABUF> buffers(buffer_count);
+  for (uint32_t i = 0; i < buffer_count; i++) {
+    buffers[i] = buffers_ptr[i];
+  }
+  uint32_t flags = flags_ptr ? flags_ptr.value() : 0;
+  uint32_t from_address = from_addr.guest_address();
+  uint32_t from_len_address = from_len_ptr.guest_address();
+  uint32_t overlapped_address = overlapped_ptr.guest_address();
+
+  if (overlapped_ptr && !SocketReactor::IsReady(*socket, false)) {
+    overlapped_ptr->internal = X_STATUS_PENDING;
+    overlapped_ptr->internal_high = 0;
+    XSocket* socket_ptr = socket.get();
+    bool submitted = kernel_state()->socket_reactor()->Submit(
+        socket, false,
+        [socket_ptr, buffers, flags, from_address, from_len_address,
+         overlapped_address](bool cancelled) {
+          if (cancelled) {
+            CompleteWSAOverlapped(overlapped_address, X_STATUS_CANCELLED, 0);
+            return true;
+          }
+          int ret = RecvFromIntoBuffers(socket_ptr, buffers, flags,
+                                        from_address, from_len_address);
+          CompleteWSAOverlapped(
+              overlapped_address,
+              ret < 0 ? X_STATUS_UNSUCCESSFUL : X_STATUS_SUCCESS,
+              ret < 0 ? 0 : uint32_t(ret));
+          return true;
+        });
+    if (submitted) {
+      XThread::SetLastError(uint32_t(X_WSAError::X_WSA_IO_PENDING));
+      return -1;
+    }
+    // Receive synchronously if the reactor is not available.
   }
 
-  // we're not going to be receiving packets any time soon
-  // return error so we don't wait on that - Cancerous
-  return -1;
+  int ret = RecvFromIntoBuffers(socket.get(), buffers, flags, from_address,
+                                from_len_address);
+  if (ret < 0) {
+    uint32_t error = socket->GetLastWSAError();
+    if (overlapped_ptr) {
+      CompleteWSAOverlapped(overlapped_address, X_STATUS_UNSUCCESSFUL, 0);
+    }
+    XThread::SetLastError(error);
+    return -1;
+  }
+  if (overlapped_ptr) {
+    CompleteWSAOverlapped(overlapped_address, X_STATUS_SUCCESS, uint32_t(ret));
+  }
+  if (num_bytes_recv) {
+    *num_bytes_recv = uint32_t(ret);
+  }
+  if (flags_ptr) {
+    *flags_ptr = 0;
+  }
+  return 0;
 }
-DECLARE_XAM_EXPORT2(NetDll_WSARecvFrom, kNetworking, kStub, kHighFrequency);
+DECLARE_XAM_EXPORT2(NetDll_WSARecvFrom, kNetworking, kImplemented,
+                    kHighFrequency);
 
 // If the socket is a VDP socket, buffer 0 is the game data length, and buffer 1
 // is the unencrypted game data.
@@ -343,7 +469,6 @@ dword_result_t NetDll_WSASendTo_entry(
     dword_t num_buffers, lpdword_t num_bytes_sent, dword_t flags,
     pointer_t<XSOCKADDR_IN> to_ptr, dword_t to_len,
     pointer_t<XWSAOVERLAPPED> overlapped, lpvoid_t completion_routine) {
-  assert(!overlapped);
   assert(!completion_routine);
 
   auto socket =
@@ -370,15 +495,100 @@ dword_result_t NetDll_WSASendTo_entry(
   }
 
   N_XSOCKADDR_IN native_to(to_ptr);
-  socket->SendTo(combined_buffer_mem.data(), combined_buffer_size, flags,
-                 &native_to, to_len);
+  uint32_t overlapped_address = overlapped.guest_address();
+
+  // The data has already been combined into host memory, so a send that would
+  // block can be completed later by the reactor.
+  if (overlapped && !SocketReactor::IsReady(*socket, true)) {
+    overlapped->internal = X_STATUS_PENDING;
+    overlapped->internal_high = 0;
+    XSocket* socket_ptr = socket.get();
+    uint32_t native_flags = flags;
+    uint32_t native_to_len = to_len;
+    bool submitted = kernel_state()->socket_reactor()->Submit(
+        socket, true,
+        [socket_ptr, combined_buffer_mem, native_flags, native_to,
+         native_to_len, overlapped_address](bool cancelled) mutable {
+          if (cancelled) {
+            CompleteWSAOverlapped(overlapped_address, X_STATUS_CANCELLED, 0);
+            return true;
+          }
+          int ret = socket_ptr->SendTo(
+              combined_buffer_mem.data(), uint32_t(combined_buffer_mem.size()),
+              native_flags, &native_to, native_to_len);
+          CompleteWSAOverlapped(
+              overlapped_address,
+              ret < 0 ? X_STATUS_UNSUCCESSFUL : X_STATUS_SUCCESS,
+              ret < 0 ? 0 : uint32_t(ret));
+          return true;
+        });
+    if (submitted) {
+      XThread::SetLastError(uint32_t(X_WSAError::X_WSA_IO_PENDING));
+      return -1;
+    }
+  }
 
-  // TODO: Instantly complete overlapped
+  int ret = socket->SendTo(combined_buffer_mem.data(), combined_buffer_size,
+                           flags, &native_to, to_len);
+  if (ret < 0) {
+    uint32_t error = socket->GetLastWSAError();
+    if (overlapped) {
+      CompleteWSAOverlapped(overlapped_address, X_STATUS_UNSUCCESSFUL, 0);
+    }
+    XThread::SetLastError(error);
+    return -1;
+  }
+  if (overlapped) {
+    CompleteWSAOverlapped(overlapped_address, X_STATUS_SUCCESS, uint32_t(ret));
+  }
+  if (num_bytes_sent) {
+    *num_bytes_sent = uint32_t(ret);
+  }
 
   return 0;
 }
 DECLARE_XAM_EXPORT1(NetDll_WSASendTo, kNetworking, kImplemented);
 
+dword_result_t NetDll_WSAGetOverlappedResult_entry(
+    dword_t caller, dword_t socket_handle,
+    pointer_t<XWSAOVERLAPPED> overlapped_ptr, lpdword_t bytes_transferred_ptr,
+    dword_t wait, lpdword_t flags_ptr) {
+  if (!overlapped_ptr) {
+    XThread::SetLastError(uint32_t(X_WSAError::X_WSAEFAULT));
+    return 0;
+  }
+
+  if (overlapped_ptr->internal == X_STATUS_PENDING && wait) {
+    auto ev = kernel_state()->object_table()->LookupObject<XEvent>(
+        overlapped_ptr->event_handle);
+    if (ev) {
+      ev->Wait(0, 0, false, nullptr);
+    }
+  }
+  X_STATUS status = overlapped_ptr->internal;
+  if (status == X_STATUS_PENDING) {
+    XThread::SetLastError(uint32_t(X_WSAError::X_WSA_IO_INCOMPLETE));
+    return 0;
+  }
+
+  if (bytes_transferred_ptr) {
+    *bytes_transferred_ptr = overlapped_ptr->internal_high;
+  }
+  if (flags_ptr) {
+    *flags_ptr = 0;
+  }
+  if (XFAILED(status)) {
+    XThread::SetLastError(
+        status == X_STATUS_CANCELLED
+            ? uint32_t(X_WSAError::X_WSA_OPERATION_ABORTED)
+            : xboxkrnl::xeRtlNtStatusToDosError(status));
+    return 0;
+  }
+  return 1;
+}
+DECLARE_XAM_EXPORT2(NetDll_WSAGetOverlappedResult, kNetworking, kImplemented,
+                    kBlocking);
+
 dword_result_t NetDll_WSAWaitForMultipleEvents_entry(dword_t num_events,
                                                      lpdword_t events,
                                                      dword_t wait_all,
@@ -673,6 +883,7 @@ dword_result_t NetDll_closesocket_entry(dword_t caller, dword_t socket_handle) {
 
   // TODO: Absolutely delete this object. It is no longer valid after calling
   // closesocket.
+  kernel_state()->socket_reactor()->CancelSocket(socket.get());
   socket->Close();
   socket->ReleaseHandle();
   return 0;
@@ -199,6 +199,48 @@ dword_result_t NtReadFile_entry(dword_t file_handle, dword_t event_handle,
     result = X_STATUS_INVALID_HANDLE;
   }
 
+  // Overlapped reads completed on the file I/O threads, same as below, but with
+  // the guest thread only waiting for them when it wants to.
+  if (XSUCCEEDED(result) && !file->is_synchronous()) {
+    uint32_t io_status_block_address = io_status_block.guest_address();
+    uint32_t apc_routine = static_cast<uint32_t>(apc_routine_ptr) & ~1u;
+    uint32_t apc_context_address = apc_context.guest_address();
+    object_ref<XThread> thread =
+        apc_routine && apc_context_address
+            ? retain_object(XThread::GetCurrentThread())
+            : object_ref<XThread>();
+    if (io_status_block) {
+      io_status_block->status = X_STATUS_PENDING;
+      io_status_block->information = 0;
+    }
+    if (ev) {
+      ev->Reset();
+    }
+    if (file->ReadAsync(
+            buffer.guest_address(), buffer_length,
+            byte_offset_ptr ? static_cast<uint64_t>(*byte_offset_ptr) : -1,
+            apc_context_address,
+            [io_status_block_address, ev, thread, apc_routine,
+             apc_context_address](X_STATUS read_result, uint32_t bytes_read) {
+              if (io_status_block_address) {
+                auto status_block =
+                    kernel_memory()->TranslateVirtual<X_IO_STATUS_BLOCK*>(
+                        io_status_block_address);
+                status_block->status = read_result;
+                status_block->information = bytes_read;
+              }
+              if (ev) {
+                ev->Set(0, false);
+              }
+              if (thread) {
+                thread->EnqueueApc(apc_routine, apc_context_address,
+                                   io_status_block_address, 0);
+              }
+            })) {
+      return X_STATUS_PENDING;
+    }
+  }
+
   if (XSUCCEEDED(result)) {
     if (true || file->is_synchronous()) {
       // Synchronous.
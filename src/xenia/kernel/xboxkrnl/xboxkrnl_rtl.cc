@@ -10,12 +10,14 @@
 #include "xenia/kernel/xboxkrnl/xboxkrnl_rtl.h"
 
 #include <algorithm>
+#include <cstring>
 #include <string>
 
 #include "third_party/pe/pe_image.h"
 #include "xenia/base/atomic.h"
 #include "xenia/base/chrono.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/memory.h"
 #include "xenia/base/string.h"
 #include "xenia/base/threading.h"
 #include "xenia/kernel/kernel_state.h"
@@ -36,41 +38,18 @@ struct X_STRING {
 // https://msdn.microsoft.com/en-us/library/ff561778
 dword_result_t RtlCompareMemory_entry(lpvoid_t source1, lpvoid_t source2,
                                       dword_t length) {
-  uint8_t* p1 = source1;
-  uint8_t* p2 = source2;
-
-  // Note that the return value is the number of bytes that match, so it's best
-  // we just do this ourselves vs. using memcmp.
-  // On Windows we could use the builtin function.
-
-  uint32_t c = 0;
-  for (uint32_t n = 0; n < length; n++, p1++, p2++) {
-    if (*p1 == *p2) {
-      c++;
-    }
-  }
-
-  return c;
+  // The return value is the number of bytes before the first mismatch, which
+  // memcmp doesn't give.
+  return uint32_t(xe::find_first_mismatch(source1, source2, length));
 }
 DECLARE_XBOXKRNL_EXPORT1(RtlCompareMemory, kMemory, kImplemented);
 
 // https://msdn.microsoft.com/en-us/library/ff552123
 dword_result_t RtlCompareMemoryUlong_entry(lpvoid_t source, dword_t length,
                                            dword_t pattern) {
-  uint32_t num_compared_bytes = 0;
-
-  uint32_t swapped_pattern = xe::byte_swap(pattern.value());
-
-  char* host_source = (char*)source.host_address();
-
-  for (uint32_t aligned_length = length & 0xFFFFFFFCU; aligned_length;
-       num_compared_bytes += 4) {
-    if (*(uint32_t*)(host_source + num_compared_bytes) != swapped_pattern) {
-      break;
-    }
-    aligned_length = aligned_length - 4;
-  }
-  return num_compared_bytes;
+  return uint32_t(xe::find_first_mismatch_32(
+             source, xe::byte_swap(pattern.value()), length >> 2)) *
+         4;
 }
 DECLARE_XBOXKRNL_EXPORT1(RtlCompareMemoryUlong, kMemory, kImplemented);
 
@@ -78,13 +57,7 @@ DECLARE_XBOXKRNL_EXPORT1(RtlCompareMemoryUlong, kMemory, kImplemented);
 void RtlFillMemoryUlong_entry(lpvoid_t destination, dword_t length,
                               dword_t pattern) {
   // NOTE: length must be % 4, so we can work on uint32s.
-  uint32_t count = length >> 2;
-
-  uint32_t* p = destination.as<uint32_t*>();
-  uint32_t swapped_pattern = xe::byte_swap(pattern.value());
-  for (uint32_t n = 0; n < count; n++, p++) {
-    *p = swapped_pattern;
-  }
+  xe::fill_32(destination, xe::byte_swap(pattern.value()), length >> 2);
 }
 DECLARE_XBOXKRNL_EXPORT1(RtlFillMemoryUlong, kMemory, kImplemented);
 
@@ -150,40 +123,32 @@ static int RtlCompareStringN_impl(uint8_t* string_1, unsigned int string_1_len,
                                   uint8_t* string_2, unsigned int string_2_len,
                                   int case_insensitive) {
   if (string_1_len == 0xFFFFFFFF) {
-    uint8_t* string1_strlen_iter = string_1;
-    while (*string1_strlen_iter++)
-      ;
-    string_1_len =
-        static_cast<unsigned int>(string1_strlen_iter - string_1 - 1);
+    string_1_len = static_cast<unsigned int>(
+        std::strlen(reinterpret_cast<const char*>(string_1)));
   }
   if (string_2_len == 0xFFFFFFFF) {
-    uint8_t* string2_strlen_iter = string_2;
-    while (*string2_strlen_iter++)
-      ;
-    string_2_len =
-        static_cast<unsigned int>(string2_strlen_iter - string_2 - 1);
-  }
-  uint8_t* string1_end = &string_1[std::min(string_2_len, string_1_len)];
-  if (case_insensitive) {
-    while (string_1 < string1_end) {
-      unsigned c1 = *string_1++;
-      unsigned c2 = *string_2++;
-      if (c1 != c2) {
-        unsigned cu1 = rtl_upper_table[c1];
-        unsigned cu2 = rtl_upper_table[c2];
-        if (cu1 != cu2) {
-          return cu1 - cu2;
-        }
-      }
+    string_2_len = static_cast<unsigned int>(
+        std::strlen(reinterpret_cast<const char*>(string_2)));
+  }
+  // Skip the identical runs, only the differing characters may still be equal
+  // ignoring the case.
+  size_t length = std::min(string_2_len, string_1_len);
+  size_t i = 0;
+  while (true) {
+    i += xe::find_first_mismatch(string_1 + i, string_2 + i, length - i);
+    if (i >= length) {
+      break;
     }
-  } else {
-    while (string_1 < string1_end) {
-      unsigned c1 = *string_1++;
-      unsigned c2 = *string_2++;
-      if (c1 != c2) {
-        return c1 - c2;
-      }
+    unsigned c1 = string_1[i];
+    unsigned c2 = string_2[i];
+    if (case_insensitive) {
+      c1 = rtl_upper_table[c1];
+      c2 = rtl_upper_table[c2];
     }
+    if (c1 != c2) {
+      return c1 - c2;
+    }
+    ++i;
   }
   // why? not sure, but its the original logic
   return string_1_len - string_2_len;
@@ -364,10 +329,7 @@ dword_result_t RtlMultiByteToUnicodeN_entry(lpword_t destination_ptr,
 
   // TODO(benvanik): maybe use MultiByteToUnicode on Win32? would require
   // swapping.
-
-  for (uint32_t i = 0; i < copy_len; i++) {
-    destination_ptr[i] = source_ptr[i];
-  }
+  xe::widen_and_swap_8_to_16(destination_ptr, source_ptr, copy_len);
 
   if (written_ptr.guest_address() != 0) {
     *written_ptr = copy_len << 1;
@@ -388,10 +350,7 @@ dword_result_t RtlUnicodeToMultiByteN_entry(pointer_t<uint8_t> destination_ptr,
   copy_len = copy_len < destination_len ? copy_len : destination_len.value();
 
   // TODO(benvanik): maybe use UnicodeToMultiByte on Win32?
-  for (uint32_t i = 0; i < copy_len; i++) {
-    uint16_t c = source_ptr[i];
-    destination_ptr[i] = c < 256 ? (uint8_t)c : '?';
-  }
+  xe::narrow_and_swap_16_to_8(destination_ptr, source_ptr, copy_len, '?');
 
   if (written_ptr.guest_address() != 0) {
     *written_ptr = copy_len;
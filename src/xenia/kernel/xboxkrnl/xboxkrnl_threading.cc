@@ -408,7 +408,7 @@ uint32_t KeDelayExecutionThread(uint32_t processor_mode, uint32_t alertable,
   XThread* thread = XThread::GetCurrentThread();
 
   if (alertable) {
-    X_STATUS stat = xeProcessUserApcs(ctx);
+    X_STATUS stat = xeProcessPendingUserApcs(ctx);
     if (stat == X_STATUS_USER_APC) {
       return stat;
     }
@@ -916,6 +916,30 @@ dword_result_t NtCancelTimer_entry(dword_t timer_handle,
 }
 DECLARE_XBOXKRNL_EXPORT1(NtCancelTimer, kThreading, kImplemented);
 
+// Runs the user APCs already pending for an alertable wait without waiting on
+// the host. The wakeup queued on the host thread for them is still pending
+// though, so if it interrupts the host wait later with nothing left to
+// deliver, the wait is resumed rather than completed.
+template <typename F>
+static X_STATUS AlertableWait(uint32_t alertable, F&& wait) {
+  if (alertable) {
+    X_STATUS result = xeProcessPendingUserApcs(nullptr);
+    if (result == X_STATUS_USER_APC) {
+      return result;
+    }
+  }
+  while (true) {
+    X_STATUS result = wait();
+    if (!alertable || result != X_STATUS_USER_APC) {
+      return result;
+    }
+    result = xeProcessUserApcs(nullptr);
+    if (result == X_STATUS_USER_APC) {
+      return result;
+    }
+  }
+}
+
 uint32_t xeKeWaitForSingleObject(void* object_ptr, uint32_t wait_reason,
                                  uint32_t processor_mode, uint32_t alertable,
                                  uint64_t* timeout_ptr) {
@@ -927,14 +951,9 @@ uint32_t xeKeWaitForSingleObject(void* object_ptr, uint32_t wait_reason,
     return X_STATUS_ABANDONED_WAIT_0;
   }
 
-  X_STATUS result =
-      object->Wait(wait_reason, processor_mode, alertable, timeout_ptr);
-  if (alertable) {
-    if (result == X_STATUS_USER_APC) {
-      result = xeProcessUserApcs(nullptr);
-    }
-  }
-  return result;
+  return AlertableWait(alertable, [&]() {
+    return object->Wait(wait_reason, processor_mode, alertable, timeout_ptr);
+  });
 }
 
 dword_result_t KeWaitForSingleObject_entry(lpvoid_t object_ptr,
@@ -957,13 +976,10 @@ uint32_t NtWaitForSingleObjectEx(uint32_t object_handle, uint32_t wait_mode,
       kernel_state()->object_table()->LookupObject<XObject>(object_handle);
   if (object) {
     uint64_t timeout = timeout_ptr ? static_cast<uint64_t>(*timeout_ptr) : 0u;
-    result =
-        object->Wait(3, wait_mode, alertable, timeout_ptr ? &timeout : nullptr);
-    if (alertable) {
-      if (result == X_STATUS_USER_APC) {
-        result = xeProcessUserApcs(nullptr);
-      }
-    }
+    result = AlertableWait(alertable, [&]() {
+      return object->Wait(3, wait_mode, alertable,
+                          timeout_ptr ? &timeout : nullptr);
+    });
   } else {
     result = X_STATUS_INVALID_HANDLE;
   }
@@ -1004,15 +1020,12 @@ dword_result_t KeWaitForMultipleObjects_entry(
     }
   }
   uint64_t timeout = timeout_ptr ? static_cast<uint64_t>(*timeout_ptr) : 0u;
-  X_STATUS result = XObject::WaitMultiple(
-      uint32_t(count), reinterpret_cast<XObject**>(&objects[0]), wait_type,
-      wait_reason, processor_mode, alertable, timeout_ptr ? &timeout : nullptr);
-  if (alertable) {
-    if (result == X_STATUS_USER_APC) {
-      result = xeProcessUserApcs(nullptr);
-    }
-  }
-  return result;
+  return AlertableWait(alertable, [&]() {
+    return XObject::WaitMultiple(
+        uint32_t(count), reinterpret_cast<XObject**>(&objects[0]), wait_type,
+        wait_reason, processor_mode, alertable,
+        timeout_ptr ? &timeout : nullptr);
+  });
 }
 DECLARE_XBOXKRNL_EXPORT3(KeWaitForMultipleObjects, kThreading, kImplemented,
                          kBlocking, kHighFrequency);
@@ -1048,15 +1061,12 @@ uint32_t xeNtWaitForMultipleObjectsEx(uint32_t count, xe::be<uint32_t>* handles,
     }
   }
 
-  auto result =
-      XObject::WaitMultiple(count, reinterpret_cast<XObject**>(&objects[0]),
-                            wait_type, 6, wait_mode, alertable, timeout_ptr);
-  if (alertable) {
-    if (result == X_STATUS_USER_APC) {
-      result = xeProcessUserApcs(nullptr);
-    }
-  }
-  return result;
+  return AlertableWait(alertable, [&]() {
+    return XObject::WaitMultiple(count,
+                                 reinterpret_cast<XObject**>(&objects[0]),
+                                 wait_type, 6, wait_mode, alertable,
+                                 timeout_ptr);
+  });
 }
 
 dword_result_t NtWaitForMultipleObjectsEx_entry(
@@ -1301,9 +1311,6 @@ X_STATUS xeProcessUserApcs(PPCContext* ctx) {
 
   auto current_thread = ctx->TranslateVirtual(kpcr->prcb_data.current_thread);
 
-  uint32_t unlocked_irql =
-      xeKeKfAcquireSpinLock(ctx, &current_thread->apc_lock);
-
   auto& user_apc_queue = current_thread->apc_lists[1];
 
   // use guest stack for temporaries
@@ -1312,56 +1319,105 @@ X_STATUS xeProcessUserApcs(PPCContext* ctx) {
   uint32_t scratch_address = old_stack_pointer - 16;
   ctx->r[1] = old_stack_pointer - 32;
 
-  while (!user_apc_queue.empty(ctx)) {
-    uint32_t apc_ptr = user_apc_queue.flink_ptr;
-
-    XAPC* apc = user_apc_queue.ListEntryObject(
-        ctx->TranslateVirtual<X_LIST_ENTRY*>(apc_ptr));
+  // Take as many APCs as fit off the queue with one acquisition of the lock,
+  // copying what is needed to run them, as the routines may free or requeue
+  // the APC objects.
+  struct PendingApc {
+    uint32_t apc_ptr;
+    uint32_t kernel_routine;
+    uint32_t normal_routine;
+    uint32_t normal_context;
+    uint32_t arg1;
+    uint32_t arg2;
+  };
+  constexpr uint32_t kMaxBatchSize = 16;
+  PendingApc batch[kMaxBatchSize];
+
+  while (true) {
+    uint32_t unlocked_irql =
+        xeKeKfAcquireSpinLock(ctx, &current_thread->apc_lock);
+    uint32_t batch_size = 0;
+    while (batch_size < kMaxBatchSize && !user_apc_queue.empty(ctx)) {
+      uint32_t apc_ptr = user_apc_queue.flink_ptr;
+      XAPC* apc = user_apc_queue.ListEntryObject(
+          ctx->TranslateVirtual<X_LIST_ENTRY*>(apc_ptr));
+      PendingApc& pending_apc = batch[batch_size++];
+      pending_apc.apc_ptr = apc_ptr;
+      pending_apc.kernel_routine = apc->kernel_routine;
+      pending_apc.normal_routine = apc->normal_routine;
+      pending_apc.normal_context = apc->normal_context;
+      pending_apc.arg1 = apc->arg1;
+      pending_apc.arg2 = apc->arg2;
+      util::XeRemoveEntryList(&apc->list_entry, ctx);
+      apc->enqueued = 0;
+    }
+    xeKeKfReleaseSpinLock(ctx, &current_thread->apc_lock, unlocked_irql);
+    if (!batch_size) {
+      break;
+    }
 
-    uint8_t* scratch_ptr = ctx->TranslateVirtual(scratch_address);
-    xe::store_and_swap<uint32_t>(scratch_ptr + 0, apc->normal_routine);
-    xe::store_and_swap<uint32_t>(scratch_ptr + 4, apc->normal_context);
-    xe::store_and_swap<uint32_t>(scratch_ptr + 8, apc->arg1);
-    xe::store_and_swap<uint32_t>(scratch_ptr + 12, apc->arg2);
-    util::XeRemoveEntryList(&apc->list_entry, ctx);
-    apc->enqueued = 0;
+    if (cvars::profile_kernel_calls) {
+      auto& profile = shim::apc_delivery_profile();
+      profile.apc_count.fetch_add(batch_size, std::memory_order_relaxed);
+      profile.batch_count.fetch_add(1, std::memory_order_relaxed);
+    }
 
-    xeKeKfReleaseSpinLock(ctx, &current_thread->apc_lock, unlocked_irql);
     alert_status = X_STATUS_USER_APC;
-    if (apc->kernel_routine != XAPC::kDummyKernelRoutine) {
-      uint64_t kernel_args[] = {
-          apc_ptr,
-          scratch_address + 0,
-          scratch_address + 4,
-          scratch_address + 8,
-          scratch_address + 12,
-      };
-      ctx->processor->Execute(ctx->thread_state, apc->kernel_routine,
-                              kernel_args, xe::countof(kernel_args));
-    } else {
-      ctx->kernel_state->memory()->SystemHeapFree(apc_ptr);
-    }
+    uint8_t* scratch_ptr = ctx->TranslateVirtual(scratch_address);
+    for (uint32_t i = 0; i < batch_size; ++i) {
+      const PendingApc& pending_apc = batch[i];
+      xe::store_and_swap<uint32_t>(scratch_ptr + 0,
+                                   pending_apc.normal_routine);
+      xe::store_and_swap<uint32_t>(scratch_ptr + 4,
+                                   pending_apc.normal_context);
+      xe::store_and_swap<uint32_t>(scratch_ptr + 8, pending_apc.arg1);
+      xe::store_and_swap<uint32_t>(scratch_ptr + 12, pending_apc.arg2);
+      if (pending_apc.kernel_routine != XAPC::kDummyKernelRoutine) {
+        uint64_t kernel_args[] = {
+            pending_apc.apc_ptr,
+            scratch_address + 0,
+            scratch_address + 4,
+            scratch_address + 8,
+            scratch_address + 12,
+        };
+        ctx->processor->Execute(ctx->thread_state, pending_apc.kernel_routine,
+                                kernel_args, xe::countof(kernel_args));
+      } else {
+        ctx->kernel_state->memory()->SystemHeapFree(pending_apc.apc_ptr);
+      }
 
-    uint32_t normal_routine = xe::load_and_swap<uint32_t>(scratch_ptr + 0);
-    uint32_t normal_context = xe::load_and_swap<uint32_t>(scratch_ptr + 4);
-    uint32_t arg1 = xe::load_and_swap<uint32_t>(scratch_ptr + 8);
-    uint32_t arg2 = xe::load_and_swap<uint32_t>(scratch_ptr + 12);
+      uint32_t normal_routine = xe::load_and_swap<uint32_t>(scratch_ptr + 0);
+      uint32_t normal_context = xe::load_and_swap<uint32_t>(scratch_ptr + 4);
+      uint32_t arg1 = xe::load_and_swap<uint32_t>(scratch_ptr + 8);
+      uint32_t arg2 = xe::load_and_swap<uint32_t>(scratch_ptr + 12);
 
-    if (normal_routine) {
-      uint64_t normal_args[] = {normal_context, arg1, arg2};
-      ctx->processor->Execute(ctx->thread_state, normal_routine, normal_args,
-                              xe::countof(normal_args));
+      if (normal_routine) {
+        uint64_t normal_args[] = {normal_context, arg1, arg2};
+        ctx->processor->Execute(ctx->thread_state, normal_routine, normal_args,
+                                xe::countof(normal_args));
+      }
     }
-
-    unlocked_irql = xeKeKfAcquireSpinLock(ctx, &current_thread->apc_lock);
   }
 
   ctx->r[1] = old_stack_pointer;
-
-  xeKeKfReleaseSpinLock(ctx, &current_thread->apc_lock, unlocked_irql);
   return alert_status;
 }
 
+X_STATUS xeProcessPendingUserApcs(PPCContext* ctx) {
+  if (!ctx) {
+    ctx = cpu::ThreadState::Get()->context();
+  }
+  auto kpcr = ctx->TranslateVirtualGPR<X_KPCR*>(ctx->r[13]);
+  auto current_thread = ctx->TranslateVirtual(kpcr->prcb_data.current_thread);
+  // Only the current thread removes its user APCs, so if one is seen without
+  // the lock it's still there, and an APC queued right after this is missed
+  // only as if it had been queued once the wait has begun.
+  if (current_thread->apc_lists[1].empty(ctx)) {
+    return X_STATUS_SUCCESS;
+  }
+  return xeProcessUserApcs(ctx);
+}
+
 static void YankApcList(PPCContext* ctx, X_KTHREAD* current_thread,
                         unsigned apc_mode, bool rundown) {
   uint32_t unlocked_irql =
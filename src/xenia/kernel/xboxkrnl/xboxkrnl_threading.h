@@ -68,6 +68,8 @@ uint32_t xeKeKfAcquireSpinLock(PPCContext* ctx, X_KSPINLOCK* lock,
                                bool change_irql = true);
 
 X_STATUS xeProcessUserApcs(PPCContext* ctx);
+// Like xeProcessUserApcs, but doesn't take the APC lock if there are none.
+X_STATUS xeProcessPendingUserApcs(PPCContext* ctx);
 
 void xeRundownApcs(PPCContext* ctx);
 uint32_t xeKeGetCurrentProcessType(PPCContext* context);
@@ -25,12 +25,8 @@ void XEvent::Initialize(bool manual_reset, bool initial_state) {
 
   this->CreateNative<X_KEVENT>();
 
-  if (manual_reset) {
-    event_ = xe::threading::Event::CreateManualResetEvent(initial_state);
-  } else {
-    event_ = xe::threading::Event::CreateAutoResetEvent(initial_state);
-  }
-  assert_not_null(event_);
+  manual_reset_ = manual_reset;
+  InitializeEvent(initial_state);
 }
 
 void XEvent::InitializeNative(void* native_ptr, X_DISPATCH_HEADER* header) {
@@ -48,9 +44,13 @@ void XEvent::InitializeNative(void* native_ptr, X_DISPATCH_HEADER* header) {
       return;
   }
 
-  bool initial_state = header->signal_state ? true : false;
+  InitializeEvent(header->signal_state ? true : false);
+}
+
+void XEvent::InitializeEvent(bool initial_state) {
   if (manual_reset_) {
     event_ = xe::threading::Event::CreateManualResetEvent(initial_state);
+    manual_signaled_.store(initial_state, std::memory_order_release);
   } else {
     event_ = xe::threading::Event::CreateAutoResetEvent(initial_state);
   }
@@ -58,26 +58,58 @@ void XEvent::InitializeNative(void* native_ptr, X_DISPATCH_HEADER* header) {
 }
 
 int32_t XEvent::Set(uint32_t priority_increment, bool wait) {
-  event_->Set();
+  if (!manual_reset_) {
+    event_->Set();
+    return 1;
+  }
+  if (manual_signaled_.load(std::memory_order_acquire)) {
+    return 1;
+  }
+  std::lock_guard<xe_mutex> lock(manual_state_mutex_);
+  if (!manual_signaled_.load(std::memory_order_relaxed)) {
+    event_->Set();
+    manual_signaled_.store(true, std::memory_order_release);
+  }
   return 1;
 }
 
 int32_t XEvent::Pulse(uint32_t priority_increment, bool wait) {
+  if (!manual_reset_) {
+    event_->Pulse();
+    return 1;
+  }
+  std::lock_guard<xe_mutex> lock(manual_state_mutex_);
   event_->Pulse();
+  manual_signaled_.store(false, std::memory_order_release);
   return 1;
 }
 
 int32_t XEvent::Reset() {
-  event_->Reset();
+  if (!manual_reset_) {
+    event_->Reset();
+    return 1;
+  }
+  if (!manual_signaled_.load(std::memory_order_acquire)) {
+    return 1;
+  }
+  std::lock_guard<xe_mutex> lock(manual_state_mutex_);
+  if (manual_signaled_.load(std::memory_order_relaxed)) {
+    event_->Reset();
+    manual_signaled_.store(false, std::memory_order_release);
+  }
   return 1;
 }
+
+bool XEvent::TryWaitWithoutBlocking() {
+  return manual_reset_ && manual_signaled_.load(std::memory_order_acquire);
+}
 void XEvent::Query(uint32_t* out_type, uint32_t* out_state) {
   auto [type, state] = event_->Query();
 
   *out_type = type;
   *out_state = state;
 }
-void XEvent::Clear() { event_->Reset(); }
+void XEvent::Clear() { Reset(); }
 
 bool XEvent::Save(ByteStream* stream) {
   XELOGD("XEvent {:08X} ({})", handle(), manual_reset_ ? "manual" : "auto");
@@ -114,16 +146,7 @@ object_ref<XEvent> XEvent::Restore(KernelState* kernel_state,
   bool signaled = stream->Read<bool>();
   evt->manual_reset_ = stream->Read<bool>();
 
-  if (evt->manual_reset_) {
-    evt->event_ = xe::threading::Event::CreateManualResetEvent(false);
-  } else {
-    evt->event_ = xe::threading::Event::CreateAutoResetEvent(false);
-  }
-  assert_not_null(evt->event_);
-
-  if (signaled) {
-    evt->event_->Set();
-  }
+  evt->InitializeEvent(signaled);
 
   return object_ref<XEvent>(evt);
 }
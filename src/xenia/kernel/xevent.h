@@ -10,6 +10,9 @@
 #ifndef XENIA_KERNEL_XEVENT_H_
 #define XENIA_KERNEL_XEVENT_H_
 
+#include <atomic>
+
+#include "xenia/base/mutex.h"
 #include "xenia/base/threading.h"
 #include "xenia/kernel/xobject.h"
 #include "xenia/xbox.h"
@@ -45,10 +48,20 @@ class XEvent : public XObject {
 
  protected:
   xe::threading::WaitHandle* GetWaitHandle() override { return event_.get(); }
+  bool TryWaitWithoutBlocking() override;
 
  private:
+  void InitializeEvent(bool initial_state);
+
   bool manual_reset_ = false;
   std::unique_ptr<xe::threading::Event> event_;
+  // State of a manual reset event, only changed by Set, Pulse and Reset, which
+  // update it after the host event under the lock, so when it already matches
+  // the requested state, the call can be skipped without racing. Waits on auto
+  // reset events consume the host state, possibly through WaitAny where it
+  // can't be mirrored, so these always use the host event.
+  std::atomic<bool> manual_signaled_{false};
+  xe_mutex manual_state_mutex_;
 };
 
 }  // namespace kernel
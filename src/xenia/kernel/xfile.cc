@@ -51,11 +51,15 @@ X_STATUS XFile::QueryDirectory(X_FILE_DIRECTORY_INFORMATION* out_info,
     // Only queries in the current directory are supported for now.
     assert_true(utf8::find_any_of(file_name, "\\") == std::string_view::npos);
 
-    find_engine_.SetRule(file_name);
+    if (!find_matches_valid_ || file_name != find_pattern_) {
+      find_engine_.SetRule(file_name);
+      find_pattern_ = file_name;
+      find_matches_valid_ = false;
+    }
 
     // Always restart the search?
     find_index_ = 0;
-    entry = file_->entry()->IterateChildren(find_engine_, &find_index_);
+    entry = FindNextDirectoryMatch();
     if (!entry) {
       return X_STATUS_NO_SUCH_FILE;
     }
@@ -64,7 +68,7 @@ X_STATUS XFile::QueryDirectory(X_FILE_DIRECTORY_INFORMATION* out_info,
       find_index_ = 0;
     }
 
-    entry = file_->entry()->IterateChildren(find_engine_, &find_index_);
+    entry = FindNextDirectoryMatch();
     if (!entry) {
       return X_STATUS_NO_MORE_FILES;
     }
@@ -93,6 +97,29 @@ X_STATUS XFile::QueryDirectory(X_FILE_DIRECTORY_INFORMATION* out_info,
   return X_STATUS_SUCCESS;
 }
 
+vfs::Entry* XFile::FindNextDirectoryMatch() {
+  // The tree version and the entries are protected by the global critical
+  // region.
+  auto global_lock = xe::global_critical_region::AcquireDirect();
+  if (!find_matches_valid_ ||
+      find_matches_tree_version_ != vfs::Entry::tree_version()) {
+    // Rescanning after entries have been created or deleted, continuing from
+    // the same match index like previously from the same child index.
+    find_matches_.clear();
+    size_t child_index = 0;
+    while (vfs::Entry* child =
+               file_->entry()->IterateChildren(find_engine_, &child_index)) {
+      find_matches_.push_back(child);
+    }
+    find_matches_valid_ = true;
+    find_matches_tree_version_ = vfs::Entry::tree_version();
+  }
+  if (find_index_ >= find_matches_.size()) {
+    return nullptr;
+  }
+  return find_matches_[find_index_++];
+}
+
 X_STATUS XFile::Read(uint32_t buffer_guest_address, uint32_t buffer_length,
                      uint64_t byte_offset, uint32_t* out_bytes_read,
                      uint32_t apc_context, bool notify_completion) {
@@ -142,6 +169,10 @@ X_STATUS XFile::Read(uint32_t buffer_guest_address, uint32_t buffer_length,
                 memory::PageAccess::kReadWrite) {
           result = X_STATUS_ACCESS_VIOLATION;
         } else {
+          if (!buffer_physical_heap) {
+            // The host OS can't take the fault of the first access.
+            memory()->RestoreLazyPages(buffer_guest_address, buffer_length);
+          }
           result = file_->ReadSync(
               buffer_physical_heap
                   ? memory()->TranslatePhysical(
@@ -156,6 +187,8 @@ X_STATUS XFile::Read(uint32_t buffer_guest_address, uint32_t buffer_length,
                   buffer_guest_address, buffer_length, true, true);
             }
             position_ += bytes_read;
+            kernel_state()->file_system()->RecordFileRead(
+                file_->entry(), byte_offset, bytes_read);
           }
         }
       }
@@ -180,6 +213,41 @@ X_STATUS XFile::Read(uint32_t buffer_guest_address, uint32_t buffer_length,
   return result;
 }
 
+bool XFile::ReadAsync(
+    uint32_t buffer_guest_address, uint32_t buffer_length, uint64_t byte_offset,
+    uint32_t apc_context,
+    std::function<void(X_STATUS result, uint32_t bytes_read)> on_complete) {
+  // Reads from the current position would need it to be updated before the
+  // next request, and ones past the end must fail immediately.
+  if (byte_offset == uint64_t(-1) || !buffer_length ||
+      byte_offset >= file_->entry()->size()) {
+    return false;
+  }
+  async_event_->Reset();
+  object_ref<XFile> self = retain_object(this);
+  bool queued = kernel_state()->QueueFileIO(
+      [self, buffer_guest_address, buffer_length, byte_offset, apc_context,
+       on_complete = std::move(on_complete)]() {
+        uint32_t bytes_read = 0;
+        X_STATUS result =
+            self->Read(buffer_guest_address, buffer_length, byte_offset,
+                       &bytes_read, apc_context, false);
+        on_complete(result, bytes_read);
+
+        XIOCompletion::IONotification notify;
+        notify.apc_context = apc_context;
+        notify.num_bytes = bytes_read;
+        notify.status = result;
+        self->NotifyIOCompletionPorts(notify);
+
+        self->async_event_->Set();
+      });
+  if (!queued) {
+    async_event_->Set();
+  }
+  return queued;
+}
+
 X_STATUS XFile::ReadScatter(uint32_t segments_guest_address, uint32_t length,
                             uint64_t byte_offset, uint32_t* out_bytes_read,
                             uint32_t apc_context) {
@@ -245,6 +313,7 @@ X_STATUS XFile::Write(uint32_t buffer_guest_address, uint32_t buffer_length,
   }
 
   size_t bytes_written = 0;
+  memory()->RestoreLazyPages(buffer_guest_address, buffer_length);
   X_STATUS result =
       file_->WriteSync(memory()->TranslateVirtual(buffer_guest_address),
                        buffer_length, size_t(byte_offset), &bytes_written);
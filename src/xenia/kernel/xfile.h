@@ -10,7 +10,9 @@
 #ifndef XENIA_KERNEL_XFILE_H_
 #define XENIA_KERNEL_XFILE_H_
 
+#include <functional>
 #include <string>
+#include <vector>
 
 #include "xenia/kernel/xevent.h"
 #include "xenia/kernel/xiocompletion.h"
@@ -101,6 +103,15 @@ class XFile : public XObject {
                 uint64_t byte_offset, uint32_t* out_bytes_read,
                 uint32_t apc_context, bool notify_completion = true);
 
+  // Reads on a kernel file I/O thread if there are any and the read can't be
+  // known to fail. on_complete is called there before the completion ports and
+  // the file object are notified. Returns false without doing anything if the
+  // read must be done synchronously.
+  bool ReadAsync(uint32_t buffer_guest_address, uint32_t buffer_length,
+                 uint64_t byte_offset, uint32_t apc_context,
+                 std::function<void(X_STATUS result, uint32_t bytes_read)>
+                     on_complete);
+
   X_STATUS ReadScatter(uint32_t segments_guest_address, uint32_t length,
                        uint64_t byte_offset, uint32_t* out_bytes_read,
                        uint32_t apc_context);
@@ -140,7 +151,17 @@ class XFile : public XObject {
 
   uint64_t position_ = 0;
 
+  vfs::Entry* FindNextDirectoryMatch();
+
   xe::filesystem::WildcardEngine find_engine_;
+  std::string find_pattern_;
+  // Children matching find_engine_, gathered once per pattern rather than
+  // testing the children after the previous match on every query, valid while
+  // the entry tree version is find_matches_tree_version_.
+  std::vector<vfs::Entry*> find_matches_;
+  bool find_matches_valid_ = false;
+  uint64_t find_matches_tree_version_ = 0;
+  // Index of the next match in find_matches_.
   size_t find_index_ = 0;
 
   bool is_synchronous_ = false;
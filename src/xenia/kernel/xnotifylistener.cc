@@ -45,11 +45,32 @@ void XNotifyListener::EnqueueNotification(XNotificationID id, uint32_t data) {
   }
   auto global_lock = global_critical_region_.Acquire();
   notifications_.push_back(std::pair<XNotificationID, uint32_t>(id, data));
-  wait_handle_->Set();
+  uint64_t pending_mask =
+      pending_mask_.fetch_or(uint64_t(1) << key.mask_index,
+                             std::memory_order_release);
+  // The event is manual-reset and stays set while the queue is not empty.
+  if (!pending_mask) {
+    wait_handle_->Set();
+  }
+}
+
+void XNotifyListener::UpdatePendingMask() {
+  uint64_t pending_mask = 0;
+  for (const auto& notification : notifications_) {
+    pending_mask |= uint64_t(1)
+                    << XNotificationKey(notification.first).mask_index;
+  }
+  pending_mask_.store(pending_mask, std::memory_order_release);
+  if (!pending_mask) {
+    wait_handle_->Reset();
+  }
 }
 
 bool XNotifyListener::DequeueNotification(XNotificationID* out_id,
                                           uint32_t* out_data) {
+  if (!has_notifications()) {
+    return false;
+  }
   auto global_lock = global_critical_region_.Acquire();
   bool dequeued = false;
   if (notifications_.size()) {
@@ -58,15 +79,17 @@ bool XNotifyListener::DequeueNotification(XNotificationID* out_id,
     *out_id = it->first;
     *out_data = it->second;
     notifications_.erase(it);
-    if (!notifications_.size()) {
-      wait_handle_->Reset();
-    }
+    UpdatePendingMask();
   }
   return dequeued;
 }
 
 bool XNotifyListener::DequeueNotification(XNotificationID id,
                                           uint32_t* out_data) {
+  uint64_t id_mask = uint64_t(1) << XNotificationKey(id).mask_index;
+  if (!(pending_mask_.load(std::memory_order_acquire) & id_mask)) {
+    return false;
+  }
   auto global_lock = global_critical_region_.Acquire();
   if (!notifications_.size()) {
     return false;
@@ -79,9 +102,7 @@ bool XNotifyListener::DequeueNotification(XNotificationID id,
     dequeued = true;
     *out_data = it->second;
     notifications_.erase(it);
-    if (!notifications_.size()) {
-      wait_handle_->Reset();
-    }
+    UpdatePendingMask();
     break;
   }
   return dequeued;
@@ -119,6 +140,10 @@ object_ref<XNotifyListener> XNotifyListener::Restore(KernelState* kernel_state,
     pair.second = stream->Read<uint32_t>();
     notify->notifications_.push_back(pair);
   }
+  notify->UpdatePendingMask();
+  if (!notify->notifications_.empty()) {
+    notify->wait_handle_->Set();
+  }
 
   return object_ref<XNotifyListener>(notify);
 }
@@ -10,6 +10,7 @@
 #ifndef XENIA_KERNEL_XNOTIFYLISTENER_H_
 #define XENIA_KERNEL_XNOTIFYLISTENER_H_
 
+#include <atomic>
 #include <memory>
 #include <unordered_map>
 
@@ -56,6 +57,10 @@ class XNotifyListener : public XObject {
   bool DequeueNotification(XNotificationID* out_id, uint32_t* out_data);
   bool DequeueNotification(XNotificationID id, uint32_t* out_data);
 
+  bool has_notifications() const {
+    return pending_mask_.load(std::memory_order_acquire) != 0;
+  }
+
   bool Save(ByteStream* stream) override;
   static object_ref<XNotifyListener> Restore(KernelState* kernel_state,
                                              ByteStream* stream);
@@ -67,8 +72,14 @@ class XNotifyListener : public XObject {
 
  private:
   std::unique_ptr<xe::threading::Event> wait_handle_;
+  void UpdatePendingMask();
+
   xe::global_critical_region global_critical_region_;
   std::vector<std::pair<XNotificationID, uint32_t>> notifications_;
+  // Bit for every mask index with notifications in the queue, updated under
+  // the lock, so polling an empty queue, which titles often do every frame,
+  // doesn't need to take the lock.
+  std::atomic<uint64_t> pending_mask_ = 0;
   uint64_t mask_ = 0;
   uint32_t max_version_ = 0;
 };
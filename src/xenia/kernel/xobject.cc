@@ -195,6 +195,11 @@ X_STATUS XObject::Wait(uint32_t wait_reason, uint32_t processor_mode,
     return X_STATUS_SUCCESS;
   }
 
+  if (!alertable && TryWaitWithoutBlocking()) {
+    WaitCallback();
+    return X_STATUS_SUCCESS;
+  }
+
   auto timeout_ms =
       opt_timeout ? std::chrono::milliseconds(Clock::ScaleGuestDurationMillis(
                         TimeoutTicksToMs(*opt_timeout)))
@@ -209,6 +209,9 @@ class XObject {
   // Called on successful wait.
   virtual void WaitCallback() {}
   virtual xe::threading::WaitHandle* GetWaitHandle() { return nullptr; }
+  // Satisfies a non-alertable wait without calling into the host if the object
+  // is known to be signaled. Returns false if the wait handle must be used.
+  virtual bool TryWaitWithoutBlocking() { return false; }
 
   // Creates the kernel object for guest code to use. Typically not needed.
   uint8_t* CreateNative(uint32_t size);
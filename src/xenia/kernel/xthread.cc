@@ -9,7 +9,12 @@
 
 #include "xenia/kernel/xthread.h"
 
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
 #include <cstring>
+#include <string_view>
 
 #include "third_party/fmt/include/fmt/format.h"
 #include "xenia/base/byte_stream.h"
@@ -25,6 +30,7 @@
 #include "xenia/emulator.h"
 #include "xenia/kernel/kernel_state.h"
 #include "xenia/kernel/user_module.h"
+#include "xenia/kernel/util/guest_stack_pool.h"
 #include "xenia/kernel/xboxkrnl/xboxkrnl_threading.h"
 #include "xenia/kernel/xevent.h"
 #include "xenia/kernel/xmutant.h"
@@ -32,6 +38,20 @@ DEFINE_bool(ignore_thread_priorities, true,
             "Ignores game-specified thread priorities.", "Kernel");
 DEFINE_bool(ignore_thread_affinities, true,
             "Ignores game-specified thread affinities.", "Kernel");
+DEFINE_string(
+    guest_cpu_host_processors, "",
+    "Host logical processors to run the threads of each of the 6 guest "
+    "hardware threads on when game-specified affinities aren't ignored, "
+    "separated by commas, with + to allow several, such as an SMT pair (for "
+    "example, 0+1,2+3,4+5,6+7,8+9,10+11). If empty, guest hardware thread N "
+    "runs on host logical processor N.",
+    "Kernel");
+DEFINE_uint32(delay_spin_us, 0,
+              "Microseconds at the end of non-alertable "
+              "KeDelayExecutionThread delays to spin through instead of "
+              "sleeping, for games pacing frames with short delays that the "
+              "host scheduler would overshoot. 0 to always sleep.",
+              "Kernel");
 
 #if 0
 DEFINE_int64(stack_size_multiplier_hack, 1,
@@ -248,40 +268,23 @@ void XThread::InitializeGuestObject() {
 }
 
 bool XThread::AllocateStack(uint32_t size) {
-  auto heap = memory()->LookupHeap(kStackAddressRangeBegin);
-
-  auto alignment = heap->page_size();
-  auto padding = heap->page_size() * 2;  // Guard page size * 2
-  size = xe::round_up(size, alignment);
-  auto actual_size = size + padding;
-
-  uint32_t address = 0;
-  if (!heap->AllocRange(
-          kStackAddressRangeBegin, kStackAddressRangeEnd, actual_size,
-          alignment, kMemoryAllocationReserve | kMemoryAllocationCommit,
-          kMemoryProtectRead | kMemoryProtectWrite, false, &address)) {
+  util::GuestStackPool::Stack stack;
+  if (!kernel_state()->guest_stack_pool()->Acquire(size, stack)) {
     return false;
   }
 
-  stack_alloc_base_ = address;
-  stack_alloc_size_ = actual_size;
-  stack_limit_ = address + (padding / 2);
-  stack_base_ = stack_limit_ + size;
-
-  // Initialize the stack with junk
-  memory()->Fill(stack_alloc_base_, actual_size, 0xBE);
-
-  // Setup the guard pages
-  heap->Protect(stack_alloc_base_, padding / 2, kMemoryProtectNoAccess);
-  heap->Protect(stack_base_, padding / 2, kMemoryProtectNoAccess);
+  stack_alloc_base_ = stack.alloc_base;
+  stack_alloc_size_ = stack.alloc_size;
+  stack_limit_ = stack.limit;
+  stack_base_ = stack.base;
 
   return true;
 }
 
 void XThread::FreeStack() {
   if (stack_alloc_base_) {
-    auto heap = memory()->LookupHeap(kStackAddressRangeBegin);
-    heap->Release(stack_alloc_base_);
+    kernel_state()->guest_stack_pool()->Release(
+        {stack_alloc_base_, stack_alloc_size_, stack_limit_, stack_base_});
 
     stack_alloc_base_ = 0;
     stack_alloc_size_ = 0;
@@ -625,7 +628,7 @@ void XThread::SetCurrentThread() { current_xthread_tls_ = this; }
 void XThread::DeliverAPCs() {
   // https://www.drdobbs.com/inside-nts-asynchronous-procedure-call/184416590?pgno=1
   // https://www.drdobbs.com/inside-nts-asynchronous-procedure-call/184416590?pgno=7
-  xboxkrnl::xeProcessUserApcs(thread_state_->context());
+  xboxkrnl::xeProcessPendingUserApcs(thread_state_->context());
 }
 
 void XThread::RundownAPCs() {
@@ -656,6 +659,40 @@ void XThread::SetPriority(int32_t increment) {
   }
 }
 
+// Host logical processors mask for threads on a guest hardware thread, from
+// guest_cpu_host_processors.
+static uint64_t GetGuestCpuHostAffinityMask(uint8_t cpu_index) {
+  static const std::array<uint64_t, 6> masks = []() {
+    std::array<uint64_t, 6> result;
+    for (size_t i = 0; i < result.size(); ++i) {
+      result[i] = uint64_t(1) << i;
+    }
+    std::string_view list = cvars::guest_cpu_host_processors;
+    for (size_t i = 0; i < result.size() && !list.empty(); ++i) {
+      size_t entry_end = std::min(list.find(','), list.size());
+      std::string_view entry = list.substr(0, entry_end);
+      list.remove_prefix(std::min(entry_end + 1, list.size()));
+      uint64_t mask = 0;
+      while (!entry.empty()) {
+        size_t processor_end = std::min(entry.find('+'), entry.size());
+        uint32_t processor = 64;
+        std::from_chars(entry.data(), entry.data() + processor_end, processor);
+        if (processor < 64) {
+          mask |= uint64_t(1) << processor;
+        }
+        entry.remove_prefix(std::min(processor_end + 1, entry.size()));
+      }
+      if (mask) {
+        result[i] = mask;
+      } else {
+        XELOGW("Invalid host processors for guest hardware thread {}", i);
+      }
+    }
+    return result;
+  }();
+  return masks[cpu_index];
+}
+
 void XThread::SetAffinity(uint32_t affinity) {
   SetActiveCpu(GetFakeCpuNumber(affinity));
 }
@@ -679,9 +716,18 @@ void XThread::SetActiveCpu(uint8_t cpu_index) {
     thread_object.current_cpu = cpu_index;
   }
 
-  if (xe::threading::logical_processor_count() >= 6) {
-    if (!cvars::ignore_thread_affinities) {
-      thread_->set_affinity_mask(uint64_t(1) << cpu_index);
+  uint64_t host_mask = host_affinity_mask_;
+  if (!host_mask && !cvars::ignore_thread_affinities) {
+    host_mask = GetGuestCpuHostAffinityMask(cpu_index);
+  }
+  uint32_t host_processor_count = xe::threading::logical_processor_count();
+  if (host_processor_count < 64) {
+    host_mask &= (uint64_t(1) << host_processor_count) - 1;
+  }
+  if (host_mask && (host_affinity_mask_ || host_processor_count >= 6)) {
+    if (host_mask != applied_host_affinity_mask_) {
+      thread_->set_affinity_mask(host_mask);
+      applied_host_affinity_mask_ = host_mask;
     }
   } else {
     // there no good reason why we need to log this... we don't perfectly
@@ -755,22 +801,24 @@ X_STATUS XThread::Suspend(uint32_t* out_suspend_count) {
 X_STATUS XThread::Delay(uint32_t processor_mode, uint32_t alertable,
                         uint64_t interval) {
   int64_t timeout_ticks = interval;
-  uint32_t timeout_ms;
+  uint64_t timeout_us;
   if (timeout_ticks > 0) {
     // Absolute time, based on January 1, 1601.
     // TODO(benvanik): convert time to relative time.
     assert_always();
-    timeout_ms = 0;
+    timeout_us = 0;
   } else if (timeout_ticks < 0) {
     // Relative time.
-    timeout_ms = uint32_t(-timeout_ticks / 10000);  // Ticks -> MS
+    timeout_us = uint64_t(-timeout_ticks) / 10;  // Ticks -> us
   } else {
-    timeout_ms = 0;
+    timeout_us = 0;
+  }
+  if (timeout_us && !cvars::clock_no_scaling) {
+    timeout_us = uint64_t(timeout_us * Clock::guest_time_scalar());
   }
-  timeout_ms = Clock::ScaleGuestDurationMillis(timeout_ms);
   if (alertable) {
     auto result =
-        xe::threading::AlertableSleep(std::chrono::milliseconds(timeout_ms));
+        xe::threading::AlertableSleep(std::chrono::microseconds(timeout_us));
     switch (result) {
       default:
       case xe::threading::SleepResult::kSuccess:
@@ -778,10 +826,24 @@ X_STATUS XThread::Delay(uint32_t processor_mode, uint32_t alertable,
       case xe::threading::SleepResult::kAlerted:
         return X_STATUS_USER_APC;
     }
-  } else {
-    xe::threading::Sleep(std::chrono::milliseconds(timeout_ms));
+  }
+  // Host sleeps usually overshoot by up to the scheduler granularity, so the
+  // end of short delays is spun through instead to keep frame pacing loops
+  // accurate.
+  uint64_t spin_us = std::min(timeout_us, uint64_t(cvars::delay_spin_us));
+  if (!spin_us) {
+    xe::threading::Sleep(std::chrono::microseconds(timeout_us));
     return X_STATUS_SUCCESS;
   }
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::microseconds(timeout_us);
+  if (timeout_us > spin_us) {
+    xe::threading::Sleep(std::chrono::microseconds(timeout_us - spin_us));
+  }
+  while (std::chrono::steady_clock::now() < deadline) {
+    xe::threading::MaybeYield();
+  }
+  return X_STATUS_SUCCESS;
 }
 
 struct ThreadSavedState {
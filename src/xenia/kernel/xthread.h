@@ -337,6 +337,9 @@ class XThread : public XObject, public cpu::Thread {
   void SetAffinity(uint32_t affinity);
   uint8_t active_cpu() const;
   void SetActiveCpu(uint8_t cpu_index);
+  // Pins the host thread to the given host logical processors instead of the
+  // ones of its guest processor. Must be set before Create, 0 to not pin.
+  void set_host_affinity_mask(uint64_t mask) { host_affinity_mask_ = mask; }
 
   bool GetTLSValue(uint32_t slot, uint32_t* value_out);
   bool SetTLSValue(uint32_t slot, uint32_t value);
@@ -386,6 +389,10 @@ class XThread : public XObject, public cpu::Thread {
   bool running_ = false;
 
   int32_t priority_ = 0;
+
+  uint64_t host_affinity_mask_ = 0;
+  // The last mask given to the host thread, to skip redundant system calls.
+  uint64_t applied_host_affinity_mask_ = 0;
 };
 
 class XHostThread : public XThread {
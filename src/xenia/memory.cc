@@ -10,17 +10,23 @@
 #include "xenia/memory.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstring>
+#include <functional>
 #include <utility>
 
 #include "third_party/fmt/include/fmt/format.h"
+#include "third_party/zstd/lib/zstd.h"
 #include "xenia/base/assert.h"
 #include "xenia/base/byte_stream.h"
 #include "xenia/base/clock.h"
 #include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/mapped_memory.h"
 #include "xenia/base/math.h"
+#include "xenia/base/profiling.h"
 #include "xenia/base/threading.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/cpu/mmio_handler.h"
 
 // TODO(benvanik): move xbox.h out
@@ -32,6 +38,24 @@ DEFINE_bool(protect_on_release, false,
             "Protect released memory to prevent accesses.", "Memory");
 DEFINE_bool(scribble_heap, false,
             "Scribble 0xCD into all allocated heap memory.", "Memory");
+DEFINE_bool(guest_memory_huge_pages, false,
+            "Ask the host to back the guest memory views with huge pages, "
+            "reducing the TLB misses of guest memory accesses, where "
+            "supported (transparent huge pages on Linux). Falls back to "
+            "regular pages otherwise.",
+            "Memory");
+DEFINE_bool(poll_physical_memory_writes, false,
+            "Track writes to the watched guest physical memory (such as GPU "
+            "resources) in the host kernel and check them before draws, "
+            "instead of taking an access violation on the first write to "
+            "every watched page. Where supported (Linux 6.7+), regular "
+            "watches are used otherwise.",
+            "Memory");
+DEFINE_bool(lazy_save_state_restore, true,
+            "Decompress the guest virtual memory pages from a save state on "
+            "the first access to them and in the background instead of before "
+            "resuming the title, making restoring faster.",
+            "Memory");
 
 namespace xe {
 uint32_t get_page_count(uint32_t value, uint32_t page_size) {
@@ -87,6 +111,9 @@ Memory::Memory() {
   system_page_size_ = uint32_t(xe::memory::page_size());
   system_allocation_granularity_ =
       uint32_t(xe::memory::allocation_granularity());
+  system_heap_slab_classes_.reset(
+      new std::atomic<uint8_t>[size_t(1) << (32 - kSystemHeapSlabSizeLog2)]());
+  ResetSystemHeapSlabs();
   assert_zero(active_memory_);
   active_memory_ = this;
 }
@@ -95,6 +122,12 @@ Memory::~Memory() {
   assert_true(active_memory_ == this);
   active_memory_ = nullptr;
 
+  if (lazy_restore_thread_) {
+    lazy_restore_thread_shutdown_ = true;
+    xe::threading::Wait(lazy_restore_thread_.get(), false);
+    lazy_restore_thread_.reset();
+  }
+
   // Uninstall the MMIO handler, as we won't be able to service more
   // requests.
   mmio_handler_.reset();
@@ -157,6 +190,23 @@ bool Memory::Initialize() {
   virtual_membase_ = mapping_base_;
   physical_membase_ = mapping_base_ + 0x100000000ull;
 
+  if (cvars::guest_memory_huge_pages) {
+    size_t advised_count = 0;
+    for (size_t n = 0; n < xe::countof(map_info); n++) {
+      size_t length = map_info[n].virtual_address_end -
+                      map_info[n].virtual_address_start + 1;
+      if (xe::memory::AdviseHugePages(views_.all_views[n], length)) {
+        ++advised_count;
+      }
+    }
+    if (advised_count != xe::countof(map_info)) {
+      XELOGW(
+          "Huge pages are used for {} of {} guest memory views, the rest uses "
+          "regular pages.",
+          advised_count, xe::countof(map_info));
+    }
+  }
+
   // Prepare virtual heaps.
   heaps_.v00000000.Initialize(this, virtual_membase_, HeapType::kGuestVirtual,
                               0x00000000, 0x40000000, 4096);
@@ -282,14 +332,22 @@ static const struct {
 int Memory::MapViews(uint8_t* mapping_base) {
   assert_true(xe::countof(map_info) == xe::countof(views_.all_views));
   // 0xE0000000 4 KB offset is emulated via host_address_offset and on the CPU
-  // side if system allocation granularity is bigger than 4 KB.
-  uint64_t granularity_mask = ~uint64_t(system_allocation_granularity_ - 1);
+  // side if the host can't map views at 4 KB granularity.
+  uint64_t granularity_mask =
+      ~uint64_t(xe::memory::file_view_granularity() - 1);
+  // The raw physical view ends at the end of the mapping.
+  uint64_t mapping_end =
+      map_info[xe::countof(map_info) - 1].virtual_address_end + 1;
   for (size_t n = 0; n < xe::countof(map_info); n++) {
+    uint64_t target_address = map_info[n].target_address & granularity_mask;
+    // The last page of the 0xE0000000 view with the 4 KB offset would be past
+    // the end, which the host may not allow - it's not a part of the heap.
+    uint64_t length = std::min(
+        map_info[n].virtual_address_end - map_info[n].virtual_address_start + 1,
+        mapping_end - target_address);
     views_.all_views[n] = reinterpret_cast<uint8_t*>(xe::memory::MapFileView(
         mapping_, mapping_base + map_info[n].virtual_address_start,
-        map_info[n].virtual_address_end - map_info[n].virtual_address_start + 1,
-        xe::memory::PageAccess::kReadWrite,
-        map_info[n].target_address & granularity_mask));
+        size_t(length), xe::memory::PageAccess::kReadWrite, target_address));
     if (!views_.all_views[n]) {
       // Failed, so bail and try again.
       UnmapViews();
@@ -315,6 +373,7 @@ void Memory::Reset() {
   heaps_.v80000000.Reset();
   heaps_.v90000000.Reset();
   heaps_.physical.Reset();
+  ResetSystemHeapSlabs();
 }
 // clang does not like non-standard layout offsetof
 #if XE_COMPILER_MSVC == 1 && XE_COMPILER_CLANG_CL == 0
@@ -449,18 +508,45 @@ uint32_t Memory::GetPhysicalAddress(uint32_t address) const {
   return static_cast<const PhysicalHeap*>(heap)->GetPhysicalAddress(address);
 }
 
+// Above this, bulk writes likely don't fit in the cache anyway, and are done
+// with non-temporal stores not to evict everything else from it.
+constexpr uint32_t kStreamingTransferThreshold = 4 * 1024 * 1024;
+
+// Lets the physical memory watches know about the whole range at once instead
+// of taking an access violation for every watched page.
+static void TriggerBulkWriteWatches(Memory* memory, uint32_t address,
+                                    uint32_t length) {
+  const BaseHeap* heap = memory->LookupHeap(address);
+  if (!length || !heap || heap->heap_type() != HeapType::kGuestPhysical) {
+    return;
+  }
+  memory->TriggerPhysicalMemoryCallbacks(
+      global_critical_region::AcquireDirect(), address, length, true, false);
+}
+
 void Memory::Zero(uint32_t address, uint32_t size) {
-  std::memset(TranslateVirtual(address), 0, size);
+  Fill(address, size, 0);
 }
 
 void Memory::Fill(uint32_t address, uint32_t size, uint8_t value) {
-  std::memset(TranslateVirtual(address), value, size);
+  TriggerBulkWriteWatches(this, address, size);
+  uint8_t* pdest = TranslateVirtual(address);
+  if (size >= kStreamingTransferThreshold) {
+    xe::memory::streaming_memset(pdest, value, size);
+  } else {
+    std::memset(pdest, value, size);
+  }
 }
 
 void Memory::Copy(uint32_t dest, uint32_t src, uint32_t size) {
+  TriggerBulkWriteWatches(this, dest, size);
   uint8_t* pdest = TranslateVirtual(dest);
   const uint8_t* psrc = TranslateVirtual(src);
-  std::memcpy(pdest, psrc, size);
+  if (size >= kStreamingTransferThreshold) {
+    xe::memory::streaming_memcpy(pdest, psrc, size);
+  } else {
+    std::memcpy(pdest, psrc, size);
+  }
 }
 
 uint32_t Memory::SearchAligned(uint32_t start, uint32_t end,
@@ -505,6 +591,50 @@ cpu::MMIORange* Memory::LookupVirtualMappedRange(uint32_t virtual_address) {
   return mmio_handler_->LookupRange(virtual_address);
 }
 
+uint8_t* Memory::SetVirtualMappedRangeReadShadow(uint32_t virtual_address,
+                                                 uint32_t size) {
+  size_t page_size = xe::memory::page_size();
+  if (!size || (virtual_address & (page_size - 1)) ||
+      (size & (page_size - 1))) {
+    return nullptr;
+  }
+  // The view of the range must be an alias of the raw physical memory, which
+  // is writable regardless of the protection of the range.
+  uint8_t* shadow = nullptr;
+  for (size_t n = 0; n < xe::countof(map_info); ++n) {
+    if (virtual_address < map_info[n].virtual_address_start ||
+        uint64_t(virtual_address) + size - 1 >
+            map_info[n].virtual_address_end) {
+      continue;
+    }
+    uint64_t target_address =
+        map_info[n].target_address +
+        (virtual_address - map_info[n].virtual_address_start);
+    if (target_address >= 0x100000000ull &&
+        target_address + size <= 0x120000000ull) {
+      shadow = physical_membase_ + (target_address - 0x100000000ull);
+    }
+    break;
+  }
+  if (!shadow) {
+    return nullptr;
+  }
+  if (!LookupVirtualMappedRange(virtual_address)) {
+    return nullptr;
+  }
+  if (!xe::memory::Protect(TranslateVirtual(virtual_address), size,
+                           xe::memory::PageAccess::kReadOnly, nullptr)) {
+    XELOGE("Unable to make MMIO range {:08X} readable", virtual_address);
+    return nullptr;
+  }
+  if (!mmio_handler_->SetRangeReadShadow(virtual_address, size)) {
+    xe::memory::Protect(TranslateVirtual(virtual_address), size,
+                        xe::memory::PageAccess::kNoAccess, nullptr);
+    return nullptr;
+  }
+  return shadow;
+}
+
 bool Memory::AccessViolationCallback(
     global_unique_lock_type global_lock_locked_once, void* host_address,
     bool is_write) {
@@ -519,6 +649,10 @@ bool Memory::AccessViolationCallback(
   }
   uint32_t virtual_address = HostToGuestVirtual(host_address);
   BaseHeap* heap = LookupHeap(virtual_address);
+  if (heap && heap->RestoreLazyPages(virtual_address, 1)) {
+    // The first access to a page from a lazily restored save state.
+    return true;
+  }
   if (heap->heap_type() != HeapType::kGuestPhysical) {
     return false;
   }
@@ -529,8 +663,19 @@ bool Memory::AccessViolationCallback(
   // Will be rounded to physical page boundaries internally, so just pass 1 as
   // the length - guranteed not to cross page boundaries also.
   auto physical_heap = static_cast<PhysicalHeap*>(heap);
-  return physical_heap->TriggerCallbacks(std::move(global_lock_locked_once),
-                                         virtual_address, 1, is_write, false);
+  uint32_t unprotected_page_count = 0;
+  if (!physical_heap->TriggerCallbacks(std::move(global_lock_locked_once),
+                                       virtual_address, 1, is_write, false,
+                                       true, &unprotected_page_count)) {
+    return false;
+  }
+  write_watch_fault_count_.fetch_add(1, std::memory_order_relaxed);
+  write_watch_fault_unprotected_page_count_.fetch_add(
+      unprotected_page_count, std::memory_order_relaxed);
+  COUNT_profile_add("memory/write_watch_faults", 1);
+  COUNT_profile_add("memory/write_watch_fault_unprotected_pages",
+                    unprotected_page_count);
+  return true;
 }
 
 bool Memory::AccessViolationCallbackThunk(
@@ -579,6 +724,12 @@ void Memory::UnregisterPhysicalMemoryInvalidationCallback(
   delete entry;
 }
 
+void Memory::PollPhysicalMemoryWrites() {
+  heaps_.vA0000000.PollWrites();
+  heaps_.vC0000000.PollWrites();
+  heaps_.vE0000000.PollWrites();
+}
+
 void Memory::EnablePhysicalMemoryAccessCallbacks(
     uint32_t physical_address, uint32_t length,
     bool enable_invalidation_notifications, bool enable_data_providers) {
@@ -595,8 +746,20 @@ void Memory::EnablePhysicalMemoryAccessCallbacks(
 
 uint32_t Memory::SystemHeapAlloc(uint32_t size, uint32_t alignment,
                                  uint32_t system_heap_flags) {
-  // TODO(benvanik): lightweight pool.
   bool is_physical = !!(system_heap_flags & kSystemHeapPhysical);
+  uint32_t slab_block_size = std::max(size, alignment);
+  if (!is_physical && size &&
+      slab_block_size <= (uint32_t(1) << kSystemHeapSlabMaxBlockSizeLog2)) {
+    uint32_t size_class =
+        std::max(xe::log2_ceil(slab_block_size),
+                 kSystemHeapSlabMinBlockSizeLog2) -
+        kSystemHeapSlabMinBlockSizeLog2;
+    uint32_t address = SystemHeapSlabAlloc(size_class);
+    if (address) {
+      Zero(address, size);
+      return address;
+    }
+  }
   auto heap = LookupHeapByType(is_physical, 4096);
   uint32_t address;
   if (!heap->AllocSystemHeap(
@@ -612,11 +775,115 @@ void Memory::SystemHeapFree(uint32_t address, uint32_t* out_region_size) {
   if (!address) {
     return;
   }
-  // TODO(benvanik): lightweight pool.
+  if (SystemHeapSlabFree(address, out_region_size)) {
+    return;
+  }
   auto heap = LookupHeap(address);
   heap->Release(address, out_region_size);
 }
 
+// Blocks moved between a thread cache and the shared lists at once.
+constexpr size_t kSystemHeapSlabThreadCacheBatch = 16;
+
+struct Memory::SystemHeapSlabThreadCache {
+  uint64_t generation = 0;
+  std::vector<uint32_t> free_blocks[kSystemHeapSlabClassCount];
+};
+
+Memory::SystemHeapSlabThreadCache& Memory::GetSystemHeapSlabThreadCache() {
+  // The blocks cached by a thread when it exits are not reused.
+  thread_local SystemHeapSlabThreadCache cache;
+  uint64_t generation =
+      system_heap_slab_generation_.load(std::memory_order_acquire);
+  if (cache.generation != generation) {
+    for (std::vector<uint32_t>& free_blocks : cache.free_blocks) {
+      free_blocks.clear();
+    }
+    cache.generation = generation;
+  }
+  return cache;
+}
+
+uint32_t Memory::SystemHeapSlabAlloc(uint32_t size_class) {
+  std::vector<uint32_t>& cached_blocks =
+      GetSystemHeapSlabThreadCache().free_blocks[size_class];
+  if (cached_blocks.empty()) {
+    std::lock_guard<xe_mutex> lock(system_heap_slab_mutex_);
+    std::vector<uint32_t>& free_blocks =
+        system_heap_slab_free_blocks_[size_class];
+    if (free_blocks.empty()) {
+      uint32_t slab_size = uint32_t(1) << kSystemHeapSlabSizeLog2;
+      uint32_t slab_address;
+      if (!LookupHeapByType(false, 4096)
+               ->AllocSystemHeap(
+                   slab_size, slab_size,
+                   kMemoryAllocationReserve | kMemoryAllocationCommit,
+                   kMemoryProtectRead | kMemoryProtectWrite, false,
+                   &slab_address)) {
+        return 0;
+      }
+      system_heap_slab_classes_[slab_address >> kSystemHeapSlabSizeLog2]
+          .store(uint8_t(size_class + 1), std::memory_order_relaxed);
+      // Hand out the lower addresses first.
+      uint32_t block_size = uint32_t(1)
+                            << (size_class + kSystemHeapSlabMinBlockSizeLog2);
+      for (uint32_t offset = slab_size; offset; offset -= block_size) {
+        free_blocks.push_back(slab_address + offset - block_size);
+      }
+    }
+    size_t batch_size =
+        std::min(free_blocks.size(), kSystemHeapSlabThreadCacheBatch);
+    cached_blocks.insert(cached_blocks.end(), free_blocks.end() - batch_size,
+                         free_blocks.end());
+    free_blocks.resize(free_blocks.size() - batch_size);
+  }
+  uint32_t address = cached_blocks.back();
+  cached_blocks.pop_back();
+  return address;
+}
+
+bool Memory::SystemHeapSlabFree(uint32_t address, uint32_t* out_region_size) {
+  uint8_t slab_class =
+      system_heap_slab_classes_[address >> kSystemHeapSlabSizeLog2].load(
+          std::memory_order_relaxed);
+  if (!slab_class) {
+    return false;
+  }
+  uint32_t size_class = slab_class - 1;
+  if (out_region_size) {
+    *out_region_size = uint32_t(1)
+                       << (size_class + kSystemHeapSlabMinBlockSizeLog2);
+  }
+  std::vector<uint32_t>& cached_blocks =
+      GetSystemHeapSlabThreadCache().free_blocks[size_class];
+  cached_blocks.push_back(address);
+  if (cached_blocks.size() >= kSystemHeapSlabThreadCacheBatch * 2) {
+    std::lock_guard<xe_mutex> lock(system_heap_slab_mutex_);
+    std::vector<uint32_t>& free_blocks =
+        system_heap_slab_free_blocks_[size_class];
+    free_blocks.insert(free_blocks.end(),
+                       cached_blocks.end() - kSystemHeapSlabThreadCacheBatch,
+                       cached_blocks.end());
+    cached_blocks.resize(cached_blocks.size() -
+                         kSystemHeapSlabThreadCacheBatch);
+  }
+  return true;
+}
+
+void Memory::ResetSystemHeapSlabs() {
+  // Unique across Memory instances too, as the thread caches are global.
+  static std::atomic<uint64_t> next_generation{1};
+  std::lock_guard<xe_mutex> lock(system_heap_slab_mutex_);
+  for (std::vector<uint32_t>& free_blocks : system_heap_slab_free_blocks_) {
+    free_blocks.clear();
+  }
+  for (size_t i = 0; i < (size_t(1) << (32 - kSystemHeapSlabSizeLog2)); ++i) {
+    system_heap_slab_classes_[i].store(0, std::memory_order_relaxed);
+  }
+  system_heap_slab_generation_.store(next_generation++,
+                                     std::memory_order_release);
+}
+
 void Memory::DumpMap() {
   XELOGE("==================================================================");
   XELOGE("Memory Dump");
@@ -647,28 +914,155 @@ void Memory::DumpMap() {
   XELOGE("");
 }
 
-bool Memory::Save(ByteStream* stream) {
+void Memory::GetStatistics(MemoryStatistics& statistics_out) const {
+  std::memset(&statistics_out, 0, sizeof(statistics_out));
+  // The physical memory is counted once, through its own heap, rather than
+  // through every view of it.
+  const BaseHeap* commit_heaps[] = {&heaps_.v00000000, &heaps_.v40000000,
+                                    &heaps_.v80000000, &heaps_.v90000000,
+                                    &heaps_.physical};
+  for (const BaseHeap* heap : commit_heaps) {
+    statistics_out.committed_bytes[size_t(heap->heap_type())] +=
+        uint64_t(heap->committed_page_count()) * heap->page_size();
+  }
+  const BaseHeap* allocation_heaps[] = {
+      &heaps_.v00000000, &heaps_.v40000000, &heaps_.v80000000,
+      &heaps_.v90000000, &heaps_.vA0000000, &heaps_.vC0000000,
+      &heaps_.vE0000000};
+  for (const BaseHeap* heap : allocation_heaps) {
+    size_t heap_type_index = size_t(heap->heap_type());
+    statistics_out.allocation_count[heap_type_index] +=
+        heap->allocation_count();
+    statistics_out.release_count[heap_type_index] += heap->release_count();
+  }
+  statistics_out.write_watch_fault_count =
+      write_watch_fault_count_.load(std::memory_order_relaxed);
+  statistics_out.write_watch_fault_unprotected_page_count =
+      write_watch_fault_unprotected_page_count_.load(
+          std::memory_order_relaxed);
+  statistics_out.trigger_callbacks_count =
+      trigger_callbacks_count_.load(std::memory_order_relaxed);
+  statistics_out.trigger_callbacks_microseconds =
+      trigger_callbacks_host_ticks_.load(std::memory_order_relaxed) *
+      1000000 / Clock::QueryHostTickFrequency();
+}
+
+bool Memory::Save(ByteStream* stream, bool delta) {
   XELOGD("Serializing memory...");
-  heaps_.v00000000.Save(stream);
-  heaps_.v40000000.Save(stream);
-  heaps_.v80000000.Save(stream);
-  heaps_.v90000000.Save(stream);
-  heaps_.physical.Save(stream);
+  if (delta && !has_save_base_) {
+    XELOGE("Memory::Save: no base to save a delta against");
+    return false;
+  }
+  stream->Write(uint32_t(delta));
+  // Both the full contents and the hashes for the deltas are needed.
+  RestoreLazyPages(0, 0x7F000000);
+  BaseHeap* heaps[] = {&heaps_.v00000000, &heaps_.v40000000,
+                       &heaps_.v80000000, &heaps_.v90000000, &heaps_.physical};
+  for (BaseHeap* heap : heaps) {
+    if (!heap->Save(stream, delta)) {
+      return false;
+    }
+  }
+  if (!delta) {
+    has_save_base_ = true;
+  }
 
   return true;
 }
 
-bool Memory::Restore(ByteStream* stream) {
+bool Memory::Restore(ByteStream* stream,
+                     std::shared_ptr<MappedMemory> lazy_source) {
   XELOGD("Restoring memory...");
-  heaps_.v00000000.Restore(stream);
-  heaps_.v40000000.Restore(stream);
-  heaps_.v80000000.Restore(stream);
-  heaps_.v90000000.Restore(stream);
-  heaps_.physical.Restore(stream);
+  bool delta = stream->Read<uint32_t>() != 0;
+  if (delta && !has_save_base_) {
+    XELOGE("Memory::Restore: a delta must be restored on top of its base");
+    return false;
+  }
+  if (!cvars::lazy_save_state_restore) {
+    lazy_source.reset();
+  }
+  BaseHeap* heaps[] = {&heaps_.v00000000, &heaps_.v40000000,
+                       &heaps_.v80000000, &heaps_.v90000000, &heaps_.physical};
+  for (BaseHeap* heap : heaps) {
+    // The other heaps share their memory with other views, with different
+    // protection, so they're always restored right away.
+    bool lazy = heap == &heaps_.v00000000 || heap == &heaps_.v40000000;
+    if (!heap->Restore(stream, delta, lazy ? lazy_source : nullptr)) {
+      return false;
+    }
+  }
+  if (!delta) {
+    has_save_base_ = true;
+  }
+
+  if (heaps_.v00000000.has_lazy_restore_pages() ||
+      heaps_.v40000000.has_lazy_restore_pages()) {
+    auto global_lock = global_critical_region_.Acquire();
+    if (!lazy_restore_thread_running_) {
+      if (lazy_restore_thread_) {
+        // Already exiting without needing the lock.
+        xe::threading::Wait(lazy_restore_thread_.get(), false);
+        lazy_restore_thread_.reset();
+      }
+      lazy_restore_thread_shutdown_ = false;
+      lazy_restore_thread_ =
+          xe::threading::Thread::Create({}, [this]() { LazyRestoreThread(); });
+      if (lazy_restore_thread_) {
+        lazy_restore_thread_->set_name("Lazy Save State Restore");
+        lazy_restore_thread_->set_priority(
+            xe::threading::ThreadPriority::kBelowNormal);
+        lazy_restore_thread_running_ = true;
+      }
+    }
+  }
 
   return true;
 }
 
+void Memory::LazyRestoreThread() {
+  while (!lazy_restore_thread_shutdown_) {
+    // One chunk at a time not to hold the lock for long.
+    bool restored = heaps_.v00000000.RestoreNextLazyChunk();
+    restored |= heaps_.v40000000.RestoreNextLazyChunk();
+    if (!restored) {
+      auto global_lock = global_critical_region_.Acquire();
+      // More may have been added by restoring a delta meanwhile.
+      if (!heaps_.v00000000.has_lazy_restore_pages() &&
+          !heaps_.v40000000.has_lazy_restore_pages()) {
+        break;
+      }
+    }
+  }
+  auto global_lock = global_critical_region_.Acquire();
+  lazy_restore_thread_running_ = false;
+}
+
+void Memory::RestoreLazyPages(uint32_t address, uint32_t length) {
+  if (!length) {
+    return;
+  }
+  uint32_t high_address = uint32_t(
+      std::min(uint64_t(address) + (length - 1), uint64_t(UINT32_MAX)));
+  BaseHeap* heaps[] = {&heaps_.v00000000, &heaps_.v40000000};
+  for (BaseHeap* heap : heaps) {
+    uint32_t heap_low = std::max(address, heap->heap_base());
+    uint32_t heap_high =
+        std::min(high_address, heap->heap_base() + (heap->heap_size() - 1));
+    if (heap_low <= heap_high) {
+      heap->RestoreLazyPages(heap_low, heap_high - heap_low + 1);
+    }
+  }
+}
+
+void Memory::FinishLazyRestore() {
+  if (lazy_restore_thread_) {
+    lazy_restore_thread_shutdown_ = true;
+    xe::threading::Wait(lazy_restore_thread_.get(), false);
+    lazy_restore_thread_.reset();
+  }
+  RestoreLazyPages(0, 0x7F000000);
+}
+
 xe::memory::PageAccess ToPageAccess(uint32_t protect) {
   if ((protect & kMemoryProtectRead) && !(protect & kMemoryProtectWrite)) {
     return xe::memory::PageAccess::kReadOnly;
@@ -719,9 +1113,24 @@ void BaseHeap::Initialize(Memory* memory, uint8_t* membase, HeapType heap_type,
   page_size_shift_ = xe::log2_floor(page_size_);
   host_address_offset_ = host_address_offset;
   page_table_.resize(heap_size / page_size);
+  free_pages_.Reset(page_table_.size(), true);
   unreserved_page_count_ = uint32_t(page_table_.size());
 }
 
+BaseHeap::PageTableWriteScope::PageTableWriteScope(BaseHeap* heap)
+    : heap_(heap) {
+  if (!heap_->page_table_write_depth_++) {
+    heap_->page_table_sequence_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+}
+
+BaseHeap::PageTableWriteScope::~PageTableWriteScope() {
+  if (!--heap_->page_table_write_depth_) {
+    heap_->page_table_sequence_.fetch_add(1, std::memory_order_release);
+  }
+}
+
 void BaseHeap::Dispose() {
   // Walk table and release all regions.
   for (uint32_t page_number = 0; page_number < page_table_.size();
@@ -786,81 +1195,405 @@ void BaseHeap::DumpMap() {
   }
 }
 
-bool BaseHeap::Save(ByteStream* stream) {
-  XELOGD("Heap {:08X}-{:08X}", heap_base_, heap_base_ + (heap_size_ - 1));
+// Calls function for every index on up to as many threads as there are logical
+// processors.
+static void ParallelFor(size_t count,
+                        const std::function<void(size_t index)>& function) {
+  std::atomic<size_t> next_index{0};
+  auto run = [&]() {
+    for (size_t i = next_index++; i < count; i = next_index++) {
+      function(i);
+    }
+  };
+  std::vector<std::unique_ptr<xe::threading::Thread>> threads;
+  size_t thread_count =
+      std::min(size_t(xe::threading::logical_processor_count()), count);
+  for (size_t i = 1; i < thread_count; ++i) {
+    auto thread = xe::threading::Thread::Create({}, run);
+    if (!thread) {
+      break;
+    }
+    thread->set_name("Memory Save State");
+    threads.push_back(std::move(thread));
+  }
+  run();
+  for (auto& thread : threads) {
+    xe::threading::Wait(thread.get(), false);
+  }
+}
 
-  for (size_t i = 0; i < page_table_.size(); i++) {
-    auto& page = page_table_[i];
-    stream->Write(page.qword);
-    if (!page.state) {
-      // Unallocated.
+// Fast compression, as save states may be made often.
+constexpr int kSaveCompressionLevel = 1;
+constexpr uint32_t kSaveChunkMaxPages = 256;
+constexpr uint32_t kSaveChunkMaxSize = 1 * 1024 * 1024;
+
+struct BaseHeap::SaveChunk {
+  uint32_t first_page;
+  uint32_t page_count;
+  // Pages stored in the chunk - in a delta, the others are unchanged since
+  // the base.
+  uint64_t present_pages[kSaveChunkMaxPages / 64];
+  uint32_t uncompressed_size;
+  uint32_t compressed_size;
+  std::vector<uint8_t> compressed_data;
+};
+
+struct BaseHeap::LazyRestoreChunk {
+  SaveChunk chunk;
+  const uint8_t* compressed_data;
+  // The hashes for saving deltas are of the base contents.
+  bool delta;
+};
+
+std::vector<BaseHeap::SaveChunk> BaseHeap::GetCommittedChunks() const {
+  uint32_t chunk_max_pages = std::clamp(kSaveChunkMaxSize >> page_size_shift_,
+                                        uint32_t(1), kSaveChunkMaxPages);
+  std::vector<SaveChunk> chunks;
+  SaveChunk* chunk = nullptr;
+  for (uint32_t i = 0; i < uint32_t(page_table_.size()); ++i) {
+    if (!(page_table_[i].state & kMemoryAllocationCommit)) {
+      chunk = nullptr;
       continue;
     }
+    if (!chunk || chunk->page_count >= chunk_max_pages) {
+      chunk = &chunks.emplace_back();
+      chunk->first_page = i;
+      chunk->page_count = 0;
+      std::memset(chunk->present_pages, 0, sizeof(chunk->present_pages));
+      chunk->uncompressed_size = 0;
+      chunk->compressed_size = 0;
+    }
+    ++chunk->page_count;
+  }
+  return chunks;
+}
 
-    // TODO(DrChat): write compressed with snappy.
-    if (page.state & kMemoryAllocationCommit) {
-      void* addr = TranslateRelative(i * page_size_);
+bool BaseHeap::Save(ByteStream* stream, bool delta) {
+  XELOGD("Heap {:08X}-{:08X}", heap_base_, heap_base_ + (heap_size_ - 1));
 
+  stream->Write(page_table_.data(), page_table_.size() * sizeof(PageEntry));
+
+  // The pages are hashed to find the changed ones when saving a delta later.
+  if (!delta) {
+    saved_page_hashes_.assign(page_table_.size(), 0);
+  }
+  std::vector<SaveChunk> chunks = GetCommittedChunks();
+  std::atomic<bool> failed{false};
+  ParallelFor(chunks.size(), [&](size_t chunk_index) {
+    SaveChunk& chunk = chunks[chunk_index];
+    std::vector<uint8_t> pages;
+    pages.reserve(size_t(chunk.page_count) << page_size_shift_);
+    for (uint32_t i = 0; i < chunk.page_count; ++i) {
+      uint32_t page_number = chunk.first_page + i;
+      auto addr = TranslateRelative<const uint8_t*>(page_number * page_size_);
       memory::PageAccess old_access;
-      memory::Protect(addr, page_size_, memory::PageAccess::kReadWrite,
-                      &old_access);
-
-      stream->Write(addr, page_size_);
-
-      memory::Protect(addr, page_size_, old_access, nullptr);
+      memory::Protect(const_cast<uint8_t*>(addr), page_size_,
+                      memory::PageAccess::kReadWrite, &old_access);
+      uint64_t hash = XXH3_64bits(addr, page_size_);
+      if (!delta || saved_page_hashes_[page_number] != hash) {
+        pages.insert(pages.end(), addr, addr + page_size_);
+        chunk.present_pages[i >> 6] |= uint64_t(1) << (i & 63);
+      }
+      if (!delta) {
+        saved_page_hashes_[page_number] = hash;
+      }
+      memory::Protect(const_cast<uint8_t*>(addr), page_size_, old_access,
+                      nullptr);
     }
+    chunk.uncompressed_size = uint32_t(pages.size());
+    if (pages.empty()) {
+      return;
+    }
+    chunk.compressed_data.resize(ZSTD_compressBound(pages.size()));
+    size_t compressed_size =
+        ZSTD_compress(chunk.compressed_data.data(),
+                      chunk.compressed_data.size(), pages.data(), pages.size(),
+                      kSaveCompressionLevel);
+    if (ZSTD_isError(compressed_size)) {
+      failed = true;
+      return;
+    }
+    chunk.compressed_size = uint32_t(compressed_size);
+  });
+  if (failed) {
+    XELOGE("BaseHeap::Save failed to compress the pages");
+    return false;
+  }
+
+  stream->Write(uint32_t(chunks.size()));
+  for (const SaveChunk& chunk : chunks) {
+    stream->Write(chunk.first_page);
+    stream->Write(chunk.page_count);
+    stream->Write(chunk.present_pages, sizeof(chunk.present_pages));
+    stream->Write(chunk.uncompressed_size);
+    stream->Write(chunk.compressed_size);
+    stream->Write(chunk.compressed_data.data(), chunk.compressed_size);
   }
 
   return true;
 }
 
-bool BaseHeap::Restore(ByteStream* stream) {
+bool BaseHeap::Restore(ByteStream* stream, bool delta,
+                       std::shared_ptr<MappedMemory> lazy_source) {
   XELOGD("Heap {:08X}-{:08X}", heap_base_, heap_base_ + (heap_size_ - 1));
 
-  for (size_t i = 0; i < page_table_.size(); i++) {
-    auto& page = page_table_[i];
-    page.qword = stream->Read<uint64_t>();
+  auto global_lock = global_critical_region_.Acquire();
+  if (!delta) {
+    // All the pages are overwritten.
+    ClearLazyRestore();
+  } else if (!lazy_source) {
+    // The pages missing from the delta must have the contents of the base.
+    RestoreLazyPages(heap_base_, heap_size_);
+  }
+  PageTableWriteScope page_table_write_scope(this);
+
+  stream->Read(page_table_.data(), page_table_.size() * sizeof(PageEntry));
+  uint32_t committed_page_count = 0;
+  free_pages_.Reset(page_table_.size(), false);
+  for (uint32_t page_number = 0; page_number < page_table_.size();
+       ++page_number) {
+    const PageEntry& page = page_table_[page_number];
+    if (page.state & kMemoryAllocationCommit) {
+      ++committed_page_count;
+    }
     if (!page.state) {
-      // Unallocated.
-      continue;
+      free_pages_.SetRange(page_number, 1, true);
+    }
+    if (!(page.state & kMemoryAllocationCommit) &&
+        lazy_restore_page_count_.load(std::memory_order_relaxed) &&
+        lazy_restore_page_chunks_[page_number]) {
+      // Decommitted in the delta, the contents of the base aren't needed.
+      lazy_restore_page_chunks_[page_number] = 0;
+      lazy_restore_page_count_.fetch_sub(1, std::memory_order_relaxed);
     }
+  }
+  committed_page_count_.store(committed_page_count, std::memory_order_relaxed);
+
+  // The compressed data is decompressed directly from the stream.
+  std::vector<SaveChunk> chunks(stream->Read<uint32_t>());
+  std::vector<const uint8_t*> chunk_data(chunks.size());
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    SaveChunk& chunk = chunks[i];
+    chunk.first_page = stream->Read<uint32_t>();
+    chunk.page_count = stream->Read<uint32_t>();
+    stream->Read(chunk.present_pages, sizeof(chunk.present_pages));
+    chunk.uncompressed_size = stream->Read<uint32_t>();
+    chunk.compressed_size = stream->Read<uint32_t>();
+    if (chunk.page_count > kSaveChunkMaxPages ||
+        chunk.first_page + chunk.page_count > page_table_.size()) {
+      XELOGE("BaseHeap::Restore: invalid chunk of pages");
+      return false;
+    }
+    chunk_data[i] = stream->data() + stream->offset();
+    stream->Advance(chunk.compressed_size);
+  }
 
-    memory::PageAccess page_access = memory::PageAccess::kNoAccess;
-    if ((page.current_protect & kMemoryProtectRead) &&
-        (page.current_protect & kMemoryProtectWrite)) {
-      page_access = memory::PageAccess::kReadWrite;
-    } else if (page.current_protect & kMemoryProtectRead) {
-      page_access = memory::PageAccess::kReadOnly;
+  if (!delta) {
+    saved_page_hashes_.assign(page_table_.size(), 0);
+  }
+
+  if (lazy_source) {
+    if (lazy_restore_page_chunks_.empty()) {
+      lazy_restore_page_chunks_.resize(page_table_.size(), 0);
+    }
+    for (size_t i = 0; i < chunks.size(); ++i) {
+      const SaveChunk& chunk = chunks[i];
+      uint32_t present_page_count = 0;
+      for (uint32_t j = 0; j < chunk.page_count; ++j) {
+        if (chunk.present_pages[j >> 6] & (uint64_t(1) << (j & 63))) {
+          ++present_page_count;
+        }
+      }
+      // Only the header of the compressed data can be validated in advance.
+      if (size_t(present_page_count) << page_size_shift_ !=
+              chunk.uncompressed_size ||
+          (chunk.uncompressed_size &&
+           ZSTD_getFrameContentSize(chunk_data[i], chunk.compressed_size) !=
+               chunk.uncompressed_size)) {
+        XELOGE("BaseHeap::Restore: invalid chunk of pages");
+        return false;
+      }
+      uint32_t chunk_index = uint32_t(lazy_restore_chunks_.size());
+      if (chunk.uncompressed_size) {
+        lazy_restore_chunks_.push_back({chunk, chunk_data[i], delta});
+      }
+      for (uint32_t j = 0; j < chunk.page_count; ++j) {
+        uint32_t page_number = chunk.first_page + j;
+        void* addr = TranslateRelative(page_number * page_size_);
+        xe::memory::AllocFixed(addr, page_size_,
+                               memory::AllocationType::kCommit,
+                               memory::PageAccess::kNoAccess);
+        uint32_t& page_chunk = lazy_restore_page_chunks_[page_number];
+        if (chunk.present_pages[j >> 6] & (uint64_t(1) << (j & 63))) {
+          if (!page_chunk) {
+            lazy_restore_page_count_.fetch_add(1, std::memory_order_relaxed);
+          }
+          page_chunk = chunk_index + 1;
+          xe::memory::Protect(addr, page_size_, memory::PageAccess::kNoAccess,
+                              nullptr);
+        } else if (!page_chunk) {
+          // Unchanged since the base, which has already been restored.
+          xe::memory::Protect(
+              addr, page_size_,
+              ToPageAccess(page_table_[page_number].current_protect), nullptr);
+        }
+      }
+    }
+    if (lazy_restore_page_count_.load(std::memory_order_relaxed)) {
+      lazy_restore_sources_.push_back(std::move(lazy_source));
+    } else {
+      ClearLazyRestore();
     }
+    return true;
+  }
 
-    // Commit the memory if it isn't already. We do not need to reserve any
-    // memory, as the mapping has already taken care of that.
-    if (page.state & kMemoryAllocationCommit) {
-      xe::memory::AllocFixed(TranslateRelative(i * page_size_), page_size_,
-                             memory::AllocationType::kCommit,
+  std::atomic<bool> failed{false};
+  ParallelFor(chunks.size(), [&](size_t chunk_index) {
+    const SaveChunk& chunk = chunks[chunk_index];
+    std::vector<uint8_t> pages(chunk.uncompressed_size);
+    if (chunk.uncompressed_size &&
+        ZSTD_decompress(pages.data(), pages.size(), chunk_data[chunk_index],
+                        chunk.compressed_size) != pages.size()) {
+      failed = true;
+      return;
+    }
+    const uint8_t* page_data = pages.data();
+    for (uint32_t i = 0; i < chunk.page_count; ++i) {
+      uint32_t page_number = chunk.first_page + i;
+      const PageEntry& page = page_table_[page_number];
+      void* addr = TranslateRelative(page_number * page_size_);
+      // Commit the memory if it isn't already. We do not need to reserve any
+      // memory, as the mapping has already taken care of that.
+      xe::memory::AllocFixed(addr, page_size_, memory::AllocationType::kCommit,
                              memory::PageAccess::kReadWrite);
+      if (chunk.present_pages[i >> 6] & (uint64_t(1) << (i & 63))) {
+        if (page_data + page_size_ > pages.data() + pages.size()) {
+          failed = true;
+          return;
+        }
+        xe::memory::Protect(addr, page_size_, memory::PageAccess::kReadWrite,
+                            nullptr);
+        std::memcpy(addr, page_data, page_size_);
+        if (!delta) {
+          saved_page_hashes_[page_number] = XXH3_64bits(page_data, page_size_);
+        }
+        page_data += page_size_;
+      }
+      // Pages missing from a delta still have the contents of the base.
+      xe::memory::Protect(addr, page_size_, ToPageAccess(page.current_protect),
+                          nullptr);
     }
+  });
+  if (failed) {
+    XELOGE("BaseHeap::Restore failed to decompress the pages");
+    return false;
+  }
 
-    // Now read into memory. We'll set R/W protection first, then set the
-    // protection back to its previous state.
-    // TODO(DrChat): read compressed with snappy.
-    if (page.state & kMemoryAllocationCommit) {
-      void* addr = TranslateRelative(i * page_size_);
+  return true;
+}
+
+bool BaseHeap::RestoreLazyChunk(uint32_t chunk_index) {
+  const LazyRestoreChunk& lazy_chunk = lazy_restore_chunks_[chunk_index];
+  const SaveChunk& chunk = lazy_chunk.chunk;
+  bool needed = false;
+  for (uint32_t i = 0; i < chunk.page_count; ++i) {
+    if (lazy_restore_page_chunks_[chunk.first_page + i] == chunk_index + 1) {
+      needed = true;
+      break;
+    }
+  }
+  if (!needed) {
+    return false;
+  }
+  std::vector<uint8_t> pages(chunk.uncompressed_size);
+  if (ZSTD_decompress(pages.data(), pages.size(), lazy_chunk.compressed_data,
+                      chunk.compressed_size) != pages.size()) {
+    // Too late to fail the restore, the header has been validated though.
+    XELOGE("BaseHeap: failed to decompress the restored pages at {:08X}",
+           heap_base_ + chunk.first_page * page_size_);
+    std::memset(pages.data(), 0, pages.size());
+  }
+  const uint8_t* page_data = pages.data();
+  for (uint32_t i = 0; i < chunk.page_count; ++i) {
+    if (!(chunk.present_pages[i >> 6] & (uint64_t(1) << (i & 63)))) {
+      continue;
+    }
+    uint32_t page_number = chunk.first_page + i;
+    if (lazy_restore_page_chunks_[page_number] == chunk_index + 1) {
+      void* addr = TranslateRelative(page_number * page_size_);
       xe::memory::Protect(addr, page_size_, memory::PageAccess::kReadWrite,
                           nullptr);
+      std::memcpy(addr, page_data, page_size_);
+      if (!lazy_chunk.delta) {
+        saved_page_hashes_[page_number] = XXH3_64bits(page_data, page_size_);
+      }
+      xe::memory::Protect(
+          addr, page_size_,
+          ToPageAccess(page_table_[page_number].current_protect), nullptr);
+      lazy_restore_page_chunks_[page_number] = 0;
+      lazy_restore_page_count_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    page_data += page_size_;
+  }
+  if (!lazy_restore_page_count_.load(std::memory_order_relaxed)) {
+    ClearLazyRestore();
+  }
+  return true;
+}
 
-      stream->Read(addr, page_size_);
+void BaseHeap::ClearLazyRestore() {
+  lazy_restore_chunks_.clear();
+  lazy_restore_chunks_.shrink_to_fit();
+  lazy_restore_page_chunks_.clear();
+  lazy_restore_page_chunks_.shrink_to_fit();
+  lazy_restore_page_count_.store(0, std::memory_order_relaxed);
+  lazy_restore_next_chunk_ = 0;
+  lazy_restore_sources_.clear();
+}
 
-      xe::memory::Protect(addr, page_size_, page_access, nullptr);
+bool BaseHeap::RestoreLazyPages(uint32_t address, uint32_t length) {
+  if (!length || !lazy_restore_page_count_.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  uint32_t start_page_number = (address - heap_base_) >> page_size_shift_;
+  uint32_t end_page_number = uint32_t(
+      (uint64_t(address) + (length - 1) - heap_base_) >> page_size_shift_);
+  auto global_lock = global_critical_region_.Acquire();
+  bool restored = false;
+  for (uint32_t page_number = start_page_number;
+       page_number <= end_page_number &&
+       page_number < lazy_restore_page_chunks_.size();
+       ++page_number) {
+    uint32_t page_chunk = lazy_restore_page_chunks_[page_number];
+    if (page_chunk) {
+      // May clear the lazy restore state, ending the loop.
+      restored |= RestoreLazyChunk(page_chunk - 1);
     }
   }
+  return restored;
+}
 
-  return true;
+bool BaseHeap::RestoreNextLazyChunk() {
+  if (!lazy_restore_page_count_.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  auto global_lock = global_critical_region_.Acquire();
+  while (lazy_restore_next_chunk_ < lazy_restore_chunks_.size()) {
+    if (RestoreLazyChunk(uint32_t(lazy_restore_next_chunk_++))) {
+      return true;
+    }
+  }
+  return false;
 }
 
 void BaseHeap::Reset() {
   // TODO(DrChat): protect pages.
+  auto global_lock = global_critical_region_.Acquire();
+  PageTableWriteScope page_table_write_scope(this);
   std::memset(page_table_.data(), 0, sizeof(PageEntry) * page_table_.size());
+  free_pages_.Reset(page_table_.size(), true);
+  committed_page_count_.store(0, std::memory_order_relaxed);
+  ClearLazyRestore();
   // TODO(Triang3l): Remove access callbacks from pages if this is a physical
   // memory heap.
 }
@@ -909,6 +1642,10 @@ bool BaseHeap::AllocFixed(uint32_t base_address, uint32_t size,
 
   auto global_lock = global_critical_region_.Acquire();
 
+  // Changing the host protection, committed pages keep their contents.
+  RestoreLazyPages(heap_base_ + start_page_number * page_size_,
+                   page_count * page_size_);
+
   // - If we are reserving the entire range requested must not be already
   //   reserved.
   // - If we are committing it's ok for pages within the range to already be
@@ -954,6 +1691,8 @@ bool BaseHeap::AllocFixed(uint32_t base_address, uint32_t size,
   }
 
   // Set page state.
+  PageTableWriteScope page_table_write_scope(this);
+  int32_t committed_page_count_change = 0;
   for (uint32_t page_number = start_page_number; page_number <= end_page_number;
        ++page_number) {
     auto& page_entry = page_table_[page_number];
@@ -967,7 +1706,17 @@ bool BaseHeap::AllocFixed(uint32_t base_address, uint32_t size,
     if (!(page_entry.state & kMemoryAllocationReserve)) {
       unreserved_page_count_--;
     }
+    committed_page_count_change -=
+        int32_t(bool(page_entry.state & kMemoryAllocationCommit));
     page_entry.state = kMemoryAllocationReserve | allocation_type;
+    committed_page_count_change +=
+        int32_t(bool(page_entry.state & kMemoryAllocationCommit));
+  }
+  free_pages_.SetRange(start_page_number, page_count, false);
+  committed_page_count_.fetch_add(uint32_t(committed_page_count_change),
+                                  std::memory_order_relaxed);
+  if (allocation_type & kMemoryAllocationReserve) {
+    allocation_count_.fetch_add(1, std::memory_order_relaxed);
   }
 
   return true;
@@ -1007,9 +1756,9 @@ bool BaseHeap::AllocRange(uint32_t low_address, uint32_t high_address,
   auto global_lock = global_critical_region_.Acquire();
 
   // Find a free page range.
-  // The base page must match the requested alignment, so we first scan for
-  // a free aligned page and only then check for continuous free pages.
-  // TODO(benvanik): optimized searching (free list buckets, bitmap, etc).
+  // The base page must match the requested alignment. Free pages are found
+  // with bit scans in free_pages_, skipping whole allocated and free ranges at
+  // once rather than checking every page.
   uint32_t start_page_number = UINT_MAX;
   uint32_t end_page_number = UINT_MAX;
   // chrispy:todo, page_scan_stride is probably always a power of two...
@@ -1017,75 +1766,59 @@ bool BaseHeap::AllocRange(uint32_t low_address, uint32_t high_address,
   high_page_number =
       high_page_number - QuickMod(high_page_number, page_scan_stride);
   if (top_down) {
-    for (int64_t base_page_number =
-             high_page_number - xe::round_up(page_count, page_scan_stride);
-         base_page_number >= low_page_number;
-         base_page_number -= page_scan_stride) {
-      if (page_table_[base_page_number].state != 0) {
-        // Base page not free, skip to next usable page.
-        continue;
-      }
-      // Check requested range to ensure free.
-      start_page_number = uint32_t(base_page_number);
-      end_page_number = uint32_t(base_page_number) + page_count - 1;
-      assert_true(end_page_number < page_table_.size());
-      bool any_taken = false;
-      for (uint32_t page_number = uint32_t(base_page_number);
-           !any_taken && page_number <= end_page_number; ++page_number) {
-        bool is_free = page_table_[page_number].state == 0;
-        if (!is_free) {
-          // At least one page in the range is used, skip to next.
-          // We know we'll be starting at least before this page.
-          any_taken = true;
-          if (page_count > page_number) {
-            // Not enough space left to fit entire page range. Breaks outer
-            // loop.
-            base_page_number = -1;
-          } else {
-            base_page_number = page_number - page_count;
-            base_page_number -= QuickMod(base_page_number, page_scan_stride);
-            base_page_number += page_scan_stride;  // cancel out loop logic
-          }
-          break;
-        }
+    int64_t base_page_number =
+        int64_t(high_page_number) - xe::round_up(page_count, page_scan_stride);
+    while (base_page_number >= int64_t(low_page_number)) {
+      uint32_t range_end_page_number =
+          uint32_t(base_page_number) + page_count - 1;
+      // The highest allocated page in the range, if any.
+      size_t taken_page_number =
+          free_pages_.FindPrevious(range_end_page_number, false);
+      if (taken_page_number == HierarchicalBitmap::kNotFound ||
+          taken_page_number < uint64_t(base_page_number)) {
+        start_page_number = uint32_t(base_page_number);
+        end_page_number = range_end_page_number;
+        break;
       }
-      if (!any_taken) {
-        // Found our place.
+      // End the range at the highest free page below.
+      size_t free_page_number =
+          taken_page_number
+              ? free_pages_.FindPrevious(taken_page_number - 1, true)
+              : HierarchicalBitmap::kNotFound;
+      if (free_page_number == HierarchicalBitmap::kNotFound ||
+          free_page_number + 1 < page_count) {
         break;
       }
-      // Retry.
-      start_page_number = end_page_number = UINT_MAX;
+      uint32_t last_base_page_number =
+          uint32_t(free_page_number + 1 - page_count);
+      base_page_number = last_base_page_number -
+                         QuickMod(last_base_page_number, page_scan_stride);
     }
   } else {
-    for (uint32_t base_page_number = low_page_number;
-         base_page_number <= high_page_number - page_count;
-         base_page_number += page_scan_stride) {
-      if (page_table_[base_page_number].state != 0) {
-        // Base page not free, skip to next usable page.
-        continue;
-      }
-      // Check requested range to ensure free.
-      start_page_number = base_page_number;
-      end_page_number = base_page_number + page_count - 1;
-      bool any_taken = false;
-      for (uint32_t page_number = base_page_number;
-           !any_taken && page_number <= end_page_number; ++page_number) {
-        bool is_free = page_table_[page_number].state == 0;
-        if (!is_free) {
-          // At least one page in the range is used, skip to next.
-          // We know we'll be starting at least after this page.
-          any_taken = true;
-          base_page_number = xe::round_up(page_number + 1, page_scan_stride);
-          base_page_number -= page_scan_stride;  // cancel out loop logic
+    uint32_t base_page_number =
+        xe::round_up(low_page_number, page_scan_stride, false);
+    while (uint64_t(base_page_number) + page_count <= high_page_number) {
+      if (!free_pages_.Test(base_page_number)) {
+        // Start the range at the lowest free page above.
+        size_t free_page_number =
+            free_pages_.FindNext(base_page_number, true);
+        if (free_page_number == HierarchicalBitmap::kNotFound) {
           break;
         }
+        base_page_number =
+            xe::round_up(uint32_t(free_page_number), page_scan_stride, false);
+        continue;
       }
-      if (!any_taken) {
-        // Found our place.
+      // The lowest allocated page in the range, if any.
+      size_t taken_page_number = free_pages_.FindNext(base_page_number, false);
+      if (taken_page_number == HierarchicalBitmap::kNotFound ||
+          taken_page_number >= base_page_number + page_count) {
+        start_page_number = base_page_number;
+        end_page_number = base_page_number + page_count - 1;
         break;
       }
-      // Retry.
-      start_page_number = end_page_number = UINT_MAX;
+      base_page_number = xe::round_up(uint32_t(taken_page_number) + 1,
+                                      page_scan_stride, false);
     }
   }
   if (start_page_number == UINT_MAX || end_page_number == UINT_MAX) {
@@ -1116,6 +1849,7 @@ bool BaseHeap::AllocRange(uint32_t low_address, uint32_t high_address,
   }
 
   // Set page state.
+  PageTableWriteScope page_table_write_scope(this);
   for (uint32_t page_number = start_page_number; page_number <= end_page_number;
        ++page_number) {
     auto& page_entry = page_table_[page_number];
@@ -1126,6 +1860,11 @@ bool BaseHeap::AllocRange(uint32_t low_address, uint32_t high_address,
     page_entry.state = kMemoryAllocationReserve | allocation_type;
     unreserved_page_count_--;
   }
+  free_pages_.SetRange(start_page_number, page_count, false);
+  if (allocation_type & kMemoryAllocationCommit) {
+    committed_page_count_.fetch_add(page_count, std::memory_order_relaxed);
+  }
+  allocation_count_.fetch_add(1, std::memory_order_relaxed);
 
   *out_address = heap_base_ + (start_page_number << page_size_shift_);
   return true;
@@ -1159,6 +1898,10 @@ bool BaseHeap::Decommit(uint32_t address, uint32_t size) {
 
   auto global_lock = global_critical_region_.Acquire();
 
+  // The contents stay on the host, and may be committed again.
+  RestoreLazyPages(heap_base_ + start_page_number * page_size_,
+                   (end_page_number - start_page_number + 1) * page_size_);
+
   // Release from host.
   // TODO(benvanik): find a way to actually decommit memory;
   //     mapped memory cannot be decommitted.
@@ -1171,9 +1914,13 @@ bool BaseHeap::Decommit(uint32_t address, uint32_t size) {
   }*/
 
   // Perform table change.
+  PageTableWriteScope page_table_write_scope(this);
   for (uint32_t page_number = start_page_number; page_number <= end_page_number;
        ++page_number) {
     auto& page_entry = page_table_[page_number];
+    if (page_entry.state & kMemoryAllocationCommit) {
+      committed_page_count_.fetch_sub(1, std::memory_order_relaxed);
+    }
     page_entry.state &= ~kMemoryAllocationCommit;
   }
 
@@ -1200,6 +1947,10 @@ bool BaseHeap::Release(uint32_t base_address, uint32_t* out_region_size) {
     *out_region_size = (base_page_entry.region_page_count * page_size_);
   }
 
+  // Not protected from accesses after releasing by default.
+  RestoreLazyPages(base_address,
+                   base_page_entry.region_page_count * page_size_);
+
   // Release from host not needed as mapping reserves the range for us.
   // TODO(benvanik): protect with NOACCESS?
   /*BOOL result = VirtualFree(
@@ -1227,14 +1978,21 @@ bool BaseHeap::Release(uint32_t base_address, uint32_t* out_region_size) {
   }
 
   // Perform table change.
+  PageTableWriteScope page_table_write_scope(this);
   uint32_t end_page_number =
       base_page_number + base_page_entry.region_page_count - 1;
   for (uint32_t page_number = base_page_number; page_number <= end_page_number;
        ++page_number) {
     auto& page_entry = page_table_[page_number];
+    if (page_entry.state & kMemoryAllocationCommit) {
+      committed_page_count_.fetch_sub(1, std::memory_order_relaxed);
+    }
     page_entry.qword = 0;
     unreserved_page_count_++;
   }
+  free_pages_.SetRange(base_page_number, base_page_entry.region_page_count,
+                       true);
+  release_count_.fetch_add(1, std::memory_order_relaxed);
 
   return true;
 }
@@ -1276,6 +2034,9 @@ bool BaseHeap::Protect(uint32_t address, uint32_t size, uint32_t protect,
 
   auto global_lock = global_critical_region_.Acquire();
 
+  // The old protection must be the one of the restored page.
+  RestoreLazyPages(address, size);
+
   // Ensure all pages are in the same reserved region and all are committed.
   uint32_t first_base_address = UINT_MAX;
   for (uint32_t page_number = start_page_number; page_number <= end_page_number;
@@ -1320,6 +2081,7 @@ bool BaseHeap::Protect(uint32_t address, uint32_t size, uint32_t protect,
   }
 
   // Perform table change.
+  PageTableWriteScope page_table_write_scope(this);
   for (uint32_t page_number = start_page_number; page_number <= end_page_number;
        ++page_number) {
     auto& page_entry = page_table_[page_number];
@@ -1337,52 +2099,56 @@ bool BaseHeap::QueryRegionInfo(uint32_t base_address,
     return false;
   }
 
-  auto global_lock = global_critical_region_.Acquire();
-
-  auto start_page_entry = page_table_[start_page_number];
-  out_info->base_address = base_address;
-  out_info->allocation_base = 0;
-  out_info->allocation_protect = 0;
-  out_info->region_size = 0;
-  out_info->state = 0;
-  out_info->protect = 0;
-  if (start_page_entry.state) {
-    // Committed/reserved region.
-    out_info->allocation_base =
-        heap_base_ + (start_page_entry.base_address << page_size_shift_);
-    out_info->allocation_protect = start_page_entry.allocation_protect;
-    out_info->allocation_size = start_page_entry.region_page_count
-                                << page_size_shift_;
-    out_info->state = start_page_entry.state;
-    out_info->protect = start_page_entry.current_protect;
-
-    // Scan forward and report the size of the region matching the initial
-    // base address's attributes.
-    for (uint32_t page_number = start_page_number;
-         page_number <
-         start_page_entry.base_address + start_page_entry.region_page_count;
-         ++page_number) {
-      auto page_entry = page_table_[page_number];
-      if (page_entry.base_address != start_page_entry.base_address ||
-          page_entry.state != start_page_entry.state ||
-          page_entry.current_protect != start_page_entry.current_protect) {
-        // Different region or different properties within the region; done.
-        break;
+  ReadPageTable([&]() {
+    auto start_page_entry = LoadPageEntry(start_page_number);
+    out_info->base_address = base_address;
+    out_info->allocation_base = 0;
+    out_info->allocation_protect = 0;
+    out_info->region_size = 0;
+    out_info->state = 0;
+    out_info->protect = 0;
+    if (start_page_entry.state) {
+      // Committed/reserved region.
+      out_info->allocation_base =
+          heap_base_ + (start_page_entry.base_address << page_size_shift_);
+      out_info->allocation_protect = start_page_entry.allocation_protect;
+      out_info->allocation_size = start_page_entry.region_page_count
+                                  << page_size_shift_;
+      out_info->state = start_page_entry.state;
+      out_info->protect = start_page_entry.current_protect;
+
+      // Scan forward and report the size of the region matching the initial
+      // base address's attributes. The end is clamped in case a concurrent
+      // change made the start entry inconsistent, the result is discarded
+      // then.
+      uint32_t end_page_number =
+          std::min(uint32_t(page_table_.size()),
+                   start_page_entry.base_address +
+                       start_page_entry.region_page_count);
+      for (uint32_t page_number = start_page_number;
+           page_number < end_page_number; ++page_number) {
+        auto page_entry = LoadPageEntry(page_number);
+        if (page_entry.base_address != start_page_entry.base_address ||
+            page_entry.state != start_page_entry.state ||
+            page_entry.current_protect != start_page_entry.current_protect) {
+          // Different region or different properties within the region; done.
+          break;
+        }
+        out_info->region_size += page_size_;
       }
-      out_info->region_size += page_size_;
-    }
-  } else {
-    // Free region.
-    for (uint32_t page_number = start_page_number;
-         page_number < page_table_.size(); ++page_number) {
-      auto page_entry = page_table_[page_number];
-      if (page_entry.state) {
-        // First non-free page; done with region.
-        break;
+    } else {
+      // Free region.
+      for (uint32_t page_number = start_page_number;
+           page_number < page_table_.size(); ++page_number) {
+        auto page_entry = LoadPageEntry(page_number);
+        if (page_entry.state) {
+          // First non-free page; done with region.
+          break;
+        }
+        out_info->region_size += page_size_;
       }
-      out_info->region_size += page_size_;
     }
-  }
+  });
   return true;
 }
 
@@ -1393,9 +2159,12 @@ bool BaseHeap::QuerySize(uint32_t address, uint32_t* out_size) {
     *out_size = 0;
     return false;
   }
-  auto global_lock = global_critical_region_.Acquire();
-  auto page_entry = page_table_[page_number];
-  *out_size = (page_entry.region_page_count << page_size_shift_);
+  // The fields of an entry are changed separately, so even single entries
+  // are read through ReadPageTable.
+  ReadPageTable([&]() {
+    *out_size = LoadPageEntry(page_number).region_page_count
+                << page_size_shift_;
+  });
   return true;
 }
 
@@ -1406,8 +2175,8 @@ bool BaseHeap::QueryBaseAndSize(uint32_t* in_out_address, uint32_t* out_size) {
     *out_size = 0;
     return false;
   }
-  auto global_lock = global_critical_region_.Acquire();
-  auto page_entry = page_table_[page_number];
+  PageEntry page_entry;
+  ReadPageTable([&]() { page_entry = LoadPageEntry(page_number); });
   *in_out_address = (page_entry.base_address << page_size_shift_);
   *out_size = (page_entry.region_page_count << page_size_shift_);
   return true;
@@ -1420,9 +2189,8 @@ bool BaseHeap::QueryProtect(uint32_t address, uint32_t* out_protect) {
     *out_protect = 0;
     return false;
   }
-  auto global_lock = global_critical_region_.Acquire();
-  auto page_entry = page_table_[page_number];
-  *out_protect = page_entry.current_protect;
+  ReadPageTable(
+      [&]() { *out_protect = LoadPageEntry(page_number).current_protect; });
   return true;
 }
 
@@ -1434,13 +2202,13 @@ xe::memory::PageAccess BaseHeap::QueryRangeAccess(uint32_t low_address,
   }
   uint32_t low_page_number = (low_address - heap_base_) >> page_size_shift_;
   uint32_t high_page_number = (high_address - heap_base_) >> page_size_shift_;
-  uint32_t protect = kMemoryProtectRead | kMemoryProtectWrite;
-  {
-    auto global_lock = global_critical_region_.Acquire();
+  uint32_t protect;
+  ReadPageTable([&]() {
+    protect = kMemoryProtectRead | kMemoryProtectWrite;
     for (uint32_t i = low_page_number; protect && i <= high_page_number; ++i) {
-      protect &= page_table_[i].current_protect;
+      protect &= LoadPageEntry(i).current_protect;
     }
-  }
+  });
   return ToPageAccess(protect);
 }
 
@@ -1465,7 +2233,7 @@ void PhysicalHeap::Initialize(Memory* memory, uint8_t* membase,
                               VirtualHeap* parent_heap) {
   uint32_t host_address_offset;
   if (heap_base >= 0xE0000000 &&
-      xe::memory::allocation_granularity() > 0x1000) {
+      xe::memory::file_view_granularity() > 0x1000) {
     host_address_offset = 0x1000;
   } else {
     host_address_offset = 0;
@@ -1482,6 +2250,19 @@ void PhysicalHeap::Initialize(Memory* memory, uint8_t* membase,
       (size_t(heap_size_) + host_address_offset + (system_page_size_ - 1)) /
       system_page_size_;
   system_page_flags_.resize((system_page_count_ + 63) / 64);
+
+  write_tracking_ = false;
+  if (cvars::poll_physical_memory_writes && parent_heap_) {
+    write_tracking_ = xe::memory::EnableWriteTracking(
+        membase_ + heap_base_, size_t(system_page_count_)
+                                   << system_page_shift_);
+    if (!write_tracking_) {
+      XELOGW(
+          "Write tracking is not supported for {:08X}, protecting the watched "
+          "pages instead",
+          heap_base_);
+    }
+  }
 }
 
 bool PhysicalHeap::Alloc(uint32_t size, uint32_t alignment,
@@ -1793,7 +2574,8 @@ XE_NOINLINE void PhysicalHeap::EnableAccessCallbacksInner(
         }
       }
     }
-    if (protect_system_page) {
+    // With write tracking, the writes are found by PollWrites instead.
+    if (protect_system_page && !write_tracking_) {
       if (protect_system_page_first == UINT32_MAX) {
         protect_system_page_first = i;
       }
@@ -1818,7 +2600,9 @@ XE_NOINLINE void PhysicalHeap::EnableAccessCallbacksInner(
 }
 bool PhysicalHeap::TriggerCallbacks(
     global_unique_lock_type global_lock_locked_once, uint32_t virtual_address,
-    uint32_t length, bool is_write, bool unwatch_exact_range, bool unprotect) {
+    uint32_t length, bool is_write, bool unwatch_exact_range, bool unprotect,
+    uint32_t* unprotected_page_count_out) {
+  SCOPE_profile_cpu_f("memory");
   // TODO(Triang3l): Support read watches.
   assert_true(is_write);
   if (!is_write) {
@@ -1869,8 +2653,13 @@ bool PhysicalHeap::TriggerCallbacks(
   if (!any_watched) {
     return false;
   }
+  uint64_t start_host_ticks = Clock::QueryHostTickCount();
 
   // Trigger callbacks.
+  if (write_tracking_) {
+    // The watched pages haven't been protected.
+    unprotect = false;
+  }
   if (!unprotect) {
     // If not doing anything with protection, no point in unwatching excess
     // pages.
@@ -1933,6 +2722,7 @@ bool PhysicalHeap::TriggerCallbacks(
   }
 
   // Unprotect ranges that need unprotection.
+  uint32_t unprotected_page_count = 0;
   if (unprotect) {
     uint8_t* protect_base = membase_ + heap_base_;
     uint32_t unprotect_system_page_first = UINT32_MAX;
@@ -1950,6 +2740,7 @@ bool PhysicalHeap::TriggerCallbacks(
         }
       }
       if (unprotect_page) {
+        ++unprotected_page_count;
         if (unprotect_system_page_first == UINT32_MAX) {
           unprotect_system_page_first = i;
         }
@@ -1985,9 +2776,63 @@ bool PhysicalHeap::TriggerCallbacks(
     system_page_flags_[i].notify_on_invalidation &= mask;
   }
 
+  if (unprotected_page_count_out) {
+    *unprotected_page_count_out = unprotected_page_count;
+  }
+  memory_->trigger_callbacks_count_.fetch_add(1, std::memory_order_relaxed);
+  memory_->trigger_callbacks_host_ticks_.fetch_add(
+      Clock::QueryHostTickCount() - start_host_ticks,
+      std::memory_order_relaxed);
   return true;
 }
 
+void PhysicalHeap::PollWrites() {
+  if (!write_tracking_) {
+    return;
+  }
+  uint8_t* tracking_base = membase_ + heap_base_;
+  // Heap-relative addresses and lengths of the written system pages.
+  std::vector<std::pair<uint32_t, uint32_t>> written_ranges;
+  {
+    auto global_lock = global_critical_region_.Acquire();
+    // Only check the runs of blocks containing watched pages, also resetting
+    // the state of the pages written before they were watched.
+    uint32_t block_count = uint32_t(system_page_flags_.size());
+    uint32_t run_block_first = UINT32_MAX;
+    for (uint32_t i = 0; i <= block_count; ++i) {
+      if (i < block_count && system_page_flags_[i].notify_on_invalidation) {
+        if (run_block_first == UINT32_MAX) {
+          run_block_first = i;
+        }
+        continue;
+      }
+      if (run_block_first == UINT32_MAX) {
+        continue;
+      }
+      uint32_t run_page_first = run_block_first << 6;
+      uint32_t run_page_end = std::min(i << 6, system_page_count_);
+      xe::memory::GetAndResetWrittenRanges(
+          tracking_base + (size_t(run_page_first) << system_page_shift_),
+          size_t(run_page_end - run_page_first) << system_page_shift_,
+          [&](void* base_address, size_t length) {
+            written_ranges.emplace_back(
+                uint32_t(static_cast<uint8_t*>(base_address) - tracking_base),
+                uint32_t(length));
+          });
+      run_block_first = UINT32_MAX;
+    }
+  }
+  for (const std::pair<uint32_t, uint32_t>& written_range : written_ranges) {
+    uint32_t heap_relative_address =
+        xe::sat_sub(written_range.first, host_address_offset());
+    TriggerCallbacks(global_critical_region::AcquireDirect(),
+                     heap_base_ + heap_relative_address,
+                     written_range.first + written_range.second -
+                         host_address_offset() - heap_relative_address,
+                     true, true, false);
+  }
+}
+
 uint32_t PhysicalHeap::GetPhysicalAddress(uint32_t address) const {
   assert_true(address >= heap_base_);
   address -= heap_base_;
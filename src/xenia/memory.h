@@ -10,6 +10,7 @@
 #ifndef XENIA_MEMORY_H_
 #define XENIA_MEMORY_H_
 
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <mutex>
@@ -17,12 +18,15 @@
 #include <utility>
 #include <vector>
 
+#include "xenia/base/hierarchical_bitmap.h"
 #include "xenia/base/memory.h"
 #include "xenia/base/mutex.h"
+#include "xenia/base/threading.h"
 #include "xenia/cpu/mmio_handler.h"
 #include "xenia/guest_pointers.h"
 namespace xe {
 class ByteStream;
+class MappedMemory;
 }  // namespace xe
 
 namespace xe {
@@ -78,6 +82,25 @@ struct HeapAllocationInfo {
   uint32_t protect;
 };
 
+// Counters for seeing how the guest uses memory, sampled without
+// synchronization between them.
+struct MemoryStatistics {
+  static constexpr size_t kHeapTypeCount = size_t(HeapType::kHostPhysical) + 1;
+  // Indexed by HeapType. For physical memory, the bytes are those of the
+  // physical memory itself, and the allocations are those of its views.
+  uint64_t committed_bytes[kHeapTypeCount];
+  uint64_t allocation_count[kHeapTypeCount];
+  uint64_t release_count[kHeapTypeCount];
+  // Write access violations on watched physical memory pages.
+  uint64_t write_watch_fault_count;
+  // System pages unprotected as a result of them.
+  uint64_t write_watch_fault_unprotected_page_count;
+  // Physical memory callback triggers that found watched pages, for any
+  // reason, and the host time spent in them.
+  uint64_t trigger_callbacks_count;
+  uint64_t trigger_callbacks_microseconds;
+};
+
 // Describes a single page in the page table.
 union PageEntry {
   uint64_t qword;
@@ -127,6 +150,17 @@ class BaseHeap {
   // Type of specified heap
   HeapType heap_type() const { return heap_type_; }
 
+  uint32_t committed_page_count() const {
+    return committed_page_count_.load(std::memory_order_relaxed);
+  }
+  // Regions allocated and released since the heap was created.
+  uint64_t allocation_count() const {
+    return allocation_count_.load(std::memory_order_relaxed);
+  }
+  uint64_t release_count() const {
+    return release_count_.load(std::memory_order_relaxed);
+  }
+
   // Offset added to the virtual addresses to convert them to host addresses
   // (not including membase).
   uint32_t host_address_offset() const { return host_address_offset_; }
@@ -198,8 +232,24 @@ class BaseHeap {
   xe::memory::PageAccess QueryRangeAccess(uint32_t low_address,
                                           uint32_t high_address);
 
-  bool Save(ByteStream* stream);
-  bool Restore(ByteStream* stream);
+  // Stores the page table and the compressed contents of the committed pages.
+  // A delta only contains the pages changed since the last full save or
+  // restore, and is restored on top of that.
+  bool Save(ByteStream* stream, bool delta = false);
+  // If the stream data is in lazy_source, the pages are only decompressed on
+  // the first access to them, with the source kept alive until then. The heap
+  // must not be aliased by other views then.
+  bool Restore(ByteStream* stream, bool delta = false,
+               std::shared_ptr<MappedMemory> lazy_source = nullptr);
+  bool has_lazy_restore_pages() const {
+    return lazy_restore_page_count_.load(std::memory_order_relaxed) != 0;
+  }
+  // Decompresses the pages in the range which haven't been accessed since a
+  // lazy restore yet. Returns whether there were any.
+  bool RestoreLazyPages(uint32_t address, uint32_t length);
+  // Decompresses the next chunk of pages of a lazy restore which are still
+  // needed, returns false if there are none left.
+  bool RestoreNextLazyChunk();
 
   void Reset();
 
@@ -210,6 +260,52 @@ class BaseHeap {
                   uint32_t heap_base, uint32_t heap_size, uint32_t page_size,
                   uint32_t host_address_offset = 0);
 
+  // Makes the lock-free queries retry or wait for the lock while page_table_
+  // is being changed. Must be created with global_critical_region_ held.
+  class PageTableWriteScope {
+   public:
+    explicit PageTableWriteScope(BaseHeap* heap);
+    ~PageTableWriteScope();
+
+   private:
+    BaseHeap* heap_;
+  };
+
+  // Loads a page table entry with a single access.
+  PageEntry LoadPageEntry(uint32_t page_number) const {
+    PageEntry page_entry;
+    page_entry.qword = *reinterpret_cast<const volatile uint64_t*>(
+        &page_table_[page_number].qword);
+    return page_entry;
+  }
+
+  // Calls read (which must only read page_table_, with LoadPageEntry, and
+  // fully overwrite its results) without the lock, and again with the lock if
+  // the page table was changed meanwhile.
+  template <typename F>
+  void ReadPageTable(F&& read) {
+    uint32_t sequence = page_table_sequence_.load(std::memory_order_acquire);
+    if (!(sequence & 1)) {
+      read();
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (page_table_sequence_.load(std::memory_order_relaxed) == sequence) {
+        return;
+      }
+    }
+    auto global_lock = global_critical_region_.Acquire();
+    read();
+  }
+
+  struct SaveChunk;
+  // Runs of committed pages, compressed independently.
+  std::vector<SaveChunk> GetCommittedChunks() const;
+
+  struct LazyRestoreChunk;
+  // With global_critical_region_ held. Returns whether any pages were still
+  // waiting for the chunk.
+  bool RestoreLazyChunk(uint32_t chunk_index);
+  void ClearLazyRestore();
+
   Memory* memory_;
   uint8_t* membase_;
   HeapType heap_type_;
@@ -219,8 +315,30 @@ class BaseHeap {
   uint32_t page_size_shift_;
   uint32_t host_address_offset_;
   uint32_t unreserved_page_count_;
+  // Changed with global_critical_region_ held.
+  std::atomic<uint32_t> committed_page_count_{0};
+  std::atomic<uint64_t> allocation_count_{0};
+  std::atomic<uint64_t> release_count_{0};
   xe::global_critical_region global_critical_region_;
   std::vector<PageEntry> page_table_;
+  // Odd while page_table_ is being changed, seqlock-style.
+  std::atomic<uint32_t> page_table_sequence_{0};
+  uint32_t page_table_write_depth_ = 0;
+  // Set for the pages with a zero state in page_table_, changed together with
+  // it, for finding free ranges without scanning the page table.
+  HierarchicalBitmap free_pages_;
+  // Hashes of the pages as of the last full save or restore.
+  std::vector<uint64_t> saved_page_hashes_;
+  // Chunks of the save states restored lazily, and for every page, the index
+  // of the chunk plus 1 to decompress it from on the first access, or 0. The
+  // pages waiting for their chunk are inaccessible on the host. Changed with
+  // global_critical_region_ held.
+  std::vector<LazyRestoreChunk> lazy_restore_chunks_;
+  std::vector<uint32_t> lazy_restore_page_chunks_;
+  std::atomic<uint32_t> lazy_restore_page_count_{0};
+  size_t lazy_restore_next_chunk_ = 0;
+  // Mappings of the save state files, until all the pages are restored.
+  std::vector<std::shared_ptr<MappedMemory>> lazy_restore_sources_;
 };
 
 // Normal heap allowing allocations from guest virtual address ranges.
@@ -280,7 +398,12 @@ class PhysicalHeap : public BaseHeap {
   bool TriggerCallbacks(global_unique_lock_type global_lock_locked_once,
                         uint32_t virtual_address, uint32_t length,
                         bool is_write, bool unwatch_exact_range,
-                        bool unprotect = true);
+                        bool unprotect = true,
+                        uint32_t* unprotected_page_count_out = nullptr);
+
+  // Triggers the callbacks for the watched pages written to since the last
+  // poll, if their writes are tracked instead of protecting them.
+  void PollWrites();
 
   uint32_t GetPhysicalAddress(uint32_t address) const;
 
@@ -302,7 +425,8 @@ class PhysicalHeap : public BaseHeap {
   uint32_t system_page_size_;
   uint32_t system_page_count_;
   uint32_t system_page_shift_;
-  uint32_t padding1_;
+  // Whether writes are found by PollWrites rather than access violations.
+  bool write_tracking_ = false;
 
   struct SystemPageFlagsBlock {
     // Whether writing to each page should result trigger invalidation
@@ -426,6 +550,13 @@ class Memory {
   // Gets the defined MMIO range for the given virtual address, if any.
   cpu::MMIORange* LookupVirtualMappedRange(uint32_t virtual_address);
 
+  // Makes host pages within an MMIO range readable by the guest as normal
+  // memory, while writes still trigger the write callback. Returns the host
+  // address where the contents (big-endian) of the pages must be written to,
+  // or nullptr if the pages can't be shadowed.
+  uint8_t* SetVirtualMappedRangeReadShadow(uint32_t virtual_address,
+                                           uint32_t size);
+
   // Physical memory access callbacks, two types of them.
   //
   // This is simple per-system-page protection without reference counting or
@@ -493,6 +624,10 @@ class Memory {
       uint32_t physical_address, uint32_t length,
       bool enable_invalidation_notifications, bool enable_data_providers);
 
+  // With write tracking, triggers the callbacks for the watched physical memory
+  // written to since the last poll. Does nothing otherwise.
+  void PollPhysicalMemoryWrites();
+
   // Forces triggering of watch callbacks for a virtual address range if pages
   // are watched there and unwatching them. Returns whether any page was
   // watched. Must be called with global critical region locking depth of 1.
@@ -536,8 +671,25 @@ class Memory {
   // Dumps a map of all allocated memory to the log.
   void DumpMap();
 
-  bool Save(ByteStream* stream);
-  bool Restore(ByteStream* stream);
+  void GetStatistics(MemoryStatistics& statistics_out) const;
+
+  // A delta only contains the pages changed since the last full save or
+  // restore, which must be restored again before restoring the delta.
+  bool Save(ByteStream* stream, bool delta = false);
+  // With the source of the stream, the contents of the virtual heaps are
+  // decompressed on the first access and in the background instead of right
+  // away, so restoring scales with the size of the rest of the state.
+  bool Restore(ByteStream* stream,
+               std::shared_ptr<MappedMemory> lazy_source = nullptr);
+  // Whether there's a full save or restore to save deltas against.
+  bool has_save_base() const { return has_save_base_; }
+  // Decompresses the pages in the range not accessed since a lazy restore yet,
+  // for host accesses to guest memory not going through the access violation
+  // handler, such as file I/O done by the host OS.
+  void RestoreLazyPages(uint32_t address, uint32_t length);
+  // Decompresses all the pages remaining from a lazy restore, releasing the
+  // save state files. Must not be called with the global lock held.
+  void FinishLazyRestore();
 
   void SetMMIOExceptionRecordingCallback(cpu::MmioAccessRecordCallback callback,
                                          void* context);
@@ -546,6 +698,22 @@ class Memory {
   int MapViews(uint8_t* mapping_base);
   void UnmapViews();
 
+  // Small virtual system heap allocations, such as kernel objects, are carved
+  // out of 64 KB slabs of power of two sized blocks, with the freed blocks
+  // cached per thread, instead of each taking pages from the heap.
+  static constexpr uint32_t kSystemHeapSlabSizeLog2 = 16;
+  static constexpr uint32_t kSystemHeapSlabMinBlockSizeLog2 = 5;
+  static constexpr uint32_t kSystemHeapSlabMaxBlockSizeLog2 = 11;
+  static constexpr uint32_t kSystemHeapSlabClassCount =
+      kSystemHeapSlabMaxBlockSizeLog2 - kSystemHeapSlabMinBlockSizeLog2 + 1;
+  struct SystemHeapSlabThreadCache;
+  SystemHeapSlabThreadCache& GetSystemHeapSlabThreadCache();
+  uint32_t SystemHeapSlabAlloc(uint32_t size_class);
+  // Returns false if the address is not in a slab.
+  bool SystemHeapSlabFree(uint32_t address, uint32_t* out_region_size);
+  // Forgets all the slabs, when the heaps are reset.
+  void ResetSystemHeapSlabs();
+
   static uint32_t HostToGuestVirtualThunk(const void* context,
                                           const void* host_address);
 
@@ -599,6 +767,29 @@ class Memory {
   xe::global_critical_region global_critical_region_;
   std::vector<std::pair<PhysicalMemoryInvalidationCallback, void*>*>
       physical_memory_invalidation_callbacks_;
+
+  bool has_save_base_ = false;
+
+  void LazyRestoreThread();
+  // Decompresses the pages of a lazy restore in the background. Whether it's
+  // running is changed with global_critical_region_ held.
+  std::unique_ptr<xe::threading::Thread> lazy_restore_thread_;
+  bool lazy_restore_thread_running_ = false;
+  std::atomic<bool> lazy_restore_thread_shutdown_{false};
+
+  // Changes when the slabs are reset, invalidating the thread caches.
+  std::atomic<uint64_t> system_heap_slab_generation_{0};
+  xe_mutex system_heap_slab_mutex_;
+  // Free blocks not cached by any thread, per size class.
+  std::vector<uint32_t>
+      system_heap_slab_free_blocks_[kSystemHeapSlabClassCount];
+  // Size class + 1 of the slab at each 64 KB of the address space, or 0.
+  std::unique_ptr<std::atomic<uint8_t>[]> system_heap_slab_classes_;
+
+  std::atomic<uint64_t> write_watch_fault_count_{0};
+  std::atomic<uint64_t> write_watch_fault_unprotected_page_count_{0};
+  std::atomic<uint64_t> trigger_callbacks_count_{0};
+  std::atomic<uint64_t> trigger_callbacks_host_ticks_{0};
 };
 
 }  // namespace xe
@@ -12,6 +12,7 @@
 #include "xenia/base/cvar.h"
 #include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/mapped_memory.h"
 #include "xenia/memory.h"
 
 #include "xenia/patcher/patch_db.h"
@@ -22,6 +23,36 @@ DEFINE_bool(apply_patches, true, "Enables custom patching functionality",
 namespace xe {
 namespace patcher {
 
+// Index of the patch files, all little-endian:
+//   PatchIndexHeader
+//   file_count x {
+//     PatchIndexFileHeader
+//     name_length bytes of the UTF-8 file name
+//     hash_count x uint64_t
+//   }
+// Entries are reused for files with the same name, size and write time.
+namespace {
+// 'XPDB'.
+constexpr uint32_t kPatchIndexMagic = 0x42445058;
+constexpr uint32_t kPatchIndexVersion = 1;
+constexpr char kPatchIndexFileName[] = "patches.index";
+
+struct PatchIndexHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t file_count;
+  uint32_t reserved;
+};
+
+struct PatchIndexFileHeader {
+  uint64_t write_timestamp;
+  uint64_t file_size;
+  uint32_t title_id;
+  uint16_t name_length;
+  uint16_t hash_count;
+};
+}  // namespace
+
 PatchDB::PatchDB(const std::filesystem::path patches_root) {
   patches_root_ = patches_root;
   LoadPatches();
@@ -38,6 +69,11 @@ void PatchDB::LoadPatches() {
   const std::vector<xe::filesystem::FileInfo> patch_files =
       filesystem::ListFiles(patches_directory);
 
+  std::map<std::string, PatchFileIndexEntry> index = ReadPatchIndex();
+  // Removed files need the index to be rewritten too.
+  bool index_changed = false;
+  size_t indexed_file_count = 0;
+  uint32_t title_count = 0;
   for (const xe::filesystem::FileInfo& patch_file : patch_files) {
     // Skip files that doesn't have only title_id as name and .patch as
     // extension
@@ -48,13 +84,101 @@ void PatchDB::LoadPatches() {
       continue;
     }
 
-    const PatchFileEntry loaded_title_patches =
-        ReadPatchFile(patch_file.path / patch_file.name);
-    if (loaded_title_patches.title_id != -1) {
-      loaded_patches_.push_back(loaded_title_patches);
+    auto index_it = index.find(path_to_utf8(patch_file.name));
+    if (index_it != index.end() &&
+        index_it->second.write_timestamp == patch_file.write_timestamp &&
+        index_it->second.file_size == patch_file.total_size) {
+      index_it->second.path = patch_file.path / patch_file.name;
+      patch_files_.push_back(std::move(index_it->second));
+      ++indexed_file_count;
+    } else {
+      PatchFileIndexEntry entry;
+      entry.path = patch_file.path / patch_file.name;
+      entry.write_timestamp = patch_file.write_timestamp;
+      entry.file_size = patch_file.total_size;
+      const PatchFileEntry loaded_title_patches = ReadPatchFile(entry.path);
+      entry.title_id = loaded_title_patches.title_id;
+      entry.hashes = loaded_title_patches.hashes;
+      patch_files_.push_back(std::move(entry));
+      index_changed = true;
+    }
+    if (patch_files_.back().title_id != -1) {
+      ++title_count;
+    }
+  }
+  if (index_changed || indexed_file_count != index.size()) {
+    WritePatchIndex();
+  }
+  XELOGI("PatchDB: Found patches for {} titles", title_count);
+}
+
+std::map<std::string, PatchDB::PatchFileIndexEntry> PatchDB::ReadPatchIndex()
+    const {
+  std::map<std::string, PatchFileIndexEntry> index;
+  auto mapping = MappedMemory::Open(patches_root_ / kPatchIndexFileName,
+                                    MappedMemory::Mode::kRead);
+  if (!mapping || mapping->size() < sizeof(PatchIndexHeader)) {
+    return index;
+  }
+  const uint8_t* data = mapping->data();
+  size_t size = mapping->size();
+  PatchIndexHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  if (header.magic != kPatchIndexMagic ||
+      header.version != kPatchIndexVersion) {
+    return index;
+  }
+  size_t offset = sizeof(header);
+  for (uint32_t i = 0; i < header.file_count; ++i) {
+    PatchIndexFileHeader file_header;
+    if (size - offset < sizeof(file_header)) {
+      break;
     }
+    std::memcpy(&file_header, data + offset, sizeof(file_header));
+    offset += sizeof(file_header);
+    size_t hashes_size = sizeof(uint64_t) * file_header.hash_count;
+    if (size - offset < file_header.name_length + hashes_size) {
+      break;
+    }
+    std::string name(reinterpret_cast<const char*>(data + offset),
+                     file_header.name_length);
+    offset += file_header.name_length;
+    PatchFileIndexEntry& entry = index[name];
+    entry.write_timestamp = file_header.write_timestamp;
+    entry.file_size = file_header.file_size;
+    entry.title_id = file_header.title_id;
+    entry.hashes.resize(file_header.hash_count);
+    std::memcpy(entry.hashes.data(), data + offset, hashes_size);
+    offset += hashes_size;
+  }
+  return index;
+}
+
+void PatchDB::WritePatchIndex() const {
+  FILE* file = filesystem::OpenFile(patches_root_ / kPatchIndexFileName, "wb");
+  if (!file) {
+    XELOGW("PatchDB: Cannot write the patch index");
+    return;
   }
-  XELOGI("PatchDB: Loaded patches for {} titles", loaded_patches_.size());
+  PatchIndexHeader header = {};
+  header.magic = kPatchIndexMagic;
+  header.version = kPatchIndexVersion;
+  header.file_count = uint32_t(patch_files_.size());
+  fwrite(&header, sizeof(header), 1, file);
+  for (const PatchFileIndexEntry& entry : patch_files_) {
+    std::string name = path_to_utf8(entry.path.filename());
+    PatchIndexFileHeader file_header = {};
+    file_header.write_timestamp = entry.write_timestamp;
+    file_header.file_size = entry.file_size;
+    file_header.title_id = entry.title_id;
+    file_header.name_length = uint16_t(name.size());
+    file_header.hash_count = uint16_t(entry.hashes.size());
+    fwrite(&file_header, sizeof(file_header), 1, file);
+    fwrite(name.data(), 1, file_header.name_length, file);
+    fwrite(entry.hashes.data(), sizeof(uint64_t), file_header.hash_count,
+           file);
+  }
+  fclose(file);
 }
 
 PatchFileEntry PatchDB::ReadPatchFile(const std::filesystem::path& file_path) {
@@ -195,18 +319,37 @@ std::vector<PatchFileEntry> PatchDB::GetTitlePatches(
     const uint32_t title_id, const std::optional<uint64_t> hash) {
   std::vector<PatchFileEntry> title_patches;
 
-  std::copy_if(
-      loaded_patches_.cbegin(), loaded_patches_.cend(),
-      std::back_inserter(title_patches), [=](const PatchFileEntry entry) {
-        bool hash_exist = std::find(entry.hashes.cbegin(), entry.hashes.cend(),
-                                    hash) != entry.hashes.cend();
-
-        return entry.title_id == title_id && hash_exist;
-      });
+  for (const PatchFileIndexEntry& entry : patch_files_) {
+    bool hash_exist = std::find(entry.hashes.cbegin(), entry.hashes.cend(),
+                                hash) != entry.hashes.cend();
+    if (entry.title_id != title_id || !hash_exist) {
+      continue;
+    }
+    PatchFileEntry patch_file = ReadPatchFile(entry.path);
+    if (patch_file.title_id != -1) {
+      title_patches.push_back(std::move(patch_file));
+    }
+  }
 
   return title_patches;
 }
 
+std::vector<PatchFileEntry>& PatchDB::GetAllPatches() {
+  if (!all_patches_loaded_) {
+    all_patches_loaded_ = true;
+    for (const PatchFileIndexEntry& entry : patch_files_) {
+      if (entry.title_id == -1) {
+        continue;
+      }
+      PatchFileEntry patch_file = ReadPatchFile(entry.path);
+      if (patch_file.title_id != -1) {
+        loaded_patches_.push_back(std::move(patch_file));
+      }
+    }
+  }
+  return loaded_patches_;
+}
+
 void PatchDB::ReadHashes(PatchFileEntry& patch_entry,
                          std::shared_ptr<cpptoml::table> patch_toml_fields) {
   auto title_hashes = patch_toml_fields->get_array_of<std::string>("hash");
@@ -11,9 +11,11 @@
 #define XENIA_PATCH_DB_H_
 
 #include <cstring>
+#include <filesystem>
 #include <map>
 #include <optional>
 #include <regex>
+#include <vector>
 
 #include "third_party/cpptoml/include/cpptoml.h"
 
@@ -101,14 +103,31 @@ class PatchDB {
                      const std::pair<std::string, PatchData> data_type,
                      const std::shared_ptr<cpptoml::table>& patch_table);
 
+  // Only the files for the title are parsed.
   std::vector<PatchFileEntry> GetTitlePatches(
       const uint32_t title_id, const std::optional<uint64_t> hash);
-  std::vector<PatchFileEntry>& GetAllPatches() { return loaded_patches_; }
+  // Parses all the files on the first call.
+  std::vector<PatchFileEntry>& GetAllPatches();
 
  private:
+  // What's needed to find the patch files for a title without parsing them,
+  // kept in an index file between runs.
+  struct PatchFileIndexEntry {
+    std::filesystem::path path;
+    uint64_t write_timestamp;
+    uint64_t file_size;
+    // -1 if the file can't be loaded.
+    uint32_t title_id;
+    std::vector<uint64_t> hashes;
+  };
+
   void ReadHashes(PatchFileEntry& patch_entry,
                   std::shared_ptr<cpptoml::table> patch_toml_fields);
 
+  // Returns the entries of the index file by the file name.
+  std::map<std::string, PatchFileIndexEntry> ReadPatchIndex() const;
+  void WritePatchIndex() const;
+
   inline static const std::regex patch_filename_regex_ =
       std::regex("^[A-Fa-f0-9]{8}.*\\.patch\\.toml$");
 
@@ -123,7 +142,9 @@ class PatchDB {
       {"be16", PatchData(sizeof(uint16_t), PatchDataType::kBE16)},
       {"be8", PatchData(sizeof(uint8_t), PatchDataType::kBE8)}};
 
+  std::vector<PatchFileIndexEntry> patch_files_;
   std::vector<PatchFileEntry> loaded_patches_;
+  bool all_patches_loaded_ = false;
   std::filesystem::path patches_root_;
 };
 }  // namespace patcher
@@ -234,13 +234,18 @@ D3D12Presenter::ConnectOrReconnectPaintingToSurfaceFromUIThread(
          paint_context_.swap_chain_buffers) {
       swap_chain_buffer_ref.Reset();
     }
+    // The same applies to the frame latency waitable object flag.
+    UINT swap_chain_flags = 0;
+    if (paint_context_.swap_chain_allows_tearing) {
+      swap_chain_flags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+    }
+    if (paint_context_.swap_chain_frame_latency_waitable_object) {
+      swap_chain_flags |= DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+    }
     bool swap_chain_resized =
         SUCCEEDED(paint_context_.swap_chain->ResizeBuffers(
             0, UINT(new_swap_chain_width), UINT(new_swap_chain_height),
-            DXGI_FORMAT_UNKNOWN,
-            paint_context_.swap_chain_allows_tearing
-                ? DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING
-                : 0));
+            DXGI_FORMAT_UNKNOWN, swap_chain_flags));
     if (swap_chain_resized) {
       for (uint32_t i = 0; i < PaintContext::kSwapChainBufferCount; ++i) {
         if (FAILED(paint_context_.swap_chain->GetBuffer(
@@ -291,6 +296,10 @@ D3D12Presenter::ConnectOrReconnectPaintingToSurfaceFromUIThread(
       // rate.
       swap_chain_desc.Flags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
     }
+    if (cvars::present_low_latency) {
+      swap_chain_desc.Flags |=
+          DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+    }
     IDXGIFactory2* dxgi_factory = provider_.GetDXGIFactory();
     ID3D12CommandQueue* direct_queue = provider_.GetDirectQueue();
     Microsoft::WRL::ComPtr<IDXGISwapChain1> swap_chain_1;
@@ -333,6 +342,14 @@ D3D12Presenter::ConnectOrReconnectPaintingToSurfaceFromUIThread(
     paint_context_.swap_chain_height = new_swap_chain_height;
     paint_context_.swap_chain_allows_tearing =
         (swap_chain_desc.Flags & DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING) != 0;
+    if (swap_chain_desc.Flags &
+        DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT) {
+      // Don't queue more than one frame for presentation.
+      if (SUCCEEDED(paint_context_.swap_chain->SetMaximumFrameLatency(1))) {
+        paint_context_.swap_chain_frame_latency_waitable_object =
+            paint_context_.swap_chain->GetFrameLatencyWaitableObject();
+      }
+    }
     for (uint32_t i = 0; i < PaintContext::kSwapChainBufferCount; ++i) {
       if (FAILED(paint_context_.swap_chain->GetBuffer(
               i, IID_PPV_ARGS(&paint_context_.swap_chain_buffers[i])))) {
@@ -442,6 +459,10 @@ void D3D12Presenter::PaintContext::DestroySwapChain() {
        swap_chain_buffers) {
     swap_chain_buffer_ref.Reset();
   }
+  if (swap_chain_frame_latency_waitable_object) {
+    CloseHandle(swap_chain_frame_latency_waitable_object);
+    swap_chain_frame_latency_waitable_object = nullptr;
+  }
   swap_chain.Reset();
   swap_chain_allows_tearing = false;
   swap_chain_height = 0;
@@ -450,6 +471,14 @@ void D3D12Presenter::PaintContext::DestroySwapChain() {
 
 Presenter::PaintResult D3D12Presenter::PaintAndPresentImpl(
     bool execute_ui_drawers) {
+  // In the low-latency mode, wait until the previous frame has been taken by
+  // the presentation engine. Not waiting indefinitely in case the frame isn't
+  // displayed for some reason, such as the window being minimized.
+  if (paint_context_.swap_chain_frame_latency_waitable_object) {
+    WaitForSingleObjectEx(
+        paint_context_.swap_chain_frame_latency_waitable_object, 100, TRUE);
+  }
+
   // Begin the command list with the command allocator not currently potentially
   // used on the GPU.
   UINT64 current_paint_submission =
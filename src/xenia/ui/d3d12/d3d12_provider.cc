@@ -77,6 +77,9 @@ D3D12Provider::~D3D12Provider() {
   if (device_ != nullptr) {
     device_->Release();
   }
+  if (dxgi_adapter3_ != nullptr) {
+    dxgi_adapter3_->Release();
+  }
   if (dxgi_factory_ != nullptr) {
     dxgi_factory_->Release();
   }
@@ -315,6 +318,9 @@ bool D3D12Provider::Initialize() {
     dxgi_factory->Release();
     return false;
   }
+  if (FAILED(adapter->QueryInterface(IID_PPV_ARGS(&dxgi_adapter3_)))) {
+    dxgi_adapter3_ = nullptr;
+  }
   adapter->Release();
 
   // Configure the Direct3D 12 debug info queue.
@@ -449,6 +455,12 @@ bool D3D12Provider::Initialize() {
     unaligned_block_textures_supported_ =
         bool(options8.UnalignedBlockTexturesSupported);
   }
+  enhanced_barriers_supported_ = false;
+  D3D12_FEATURE_DATA_D3D12_OPTIONS12 options12;
+  if (SUCCEEDED(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS12,
+                                            &options12, sizeof(options12)))) {
+    enhanced_barriers_supported_ = bool(options12.EnhancedBarriersSupported);
+  }
   virtual_address_bits_per_resource_ = 0;
   D3D12_FEATURE_DATA_GPU_VIRTUAL_ADDRESS_SUPPORT virtual_address_support;
   if (SUCCEEDED(device->CheckFeatureSupport(
@@ -466,7 +478,8 @@ bool D3D12Provider::Initialize() {
       "* Rasterizer-ordered views: {}\n"
       "* Resource binding: tier {}\n"
       "* Tiled resources: tier {}\n"
-      "* Unaligned block-compressed textures: {}",
+      "* Unaligned block-compressed textures: {}\n"
+      "* Enhanced barriers: {}",
       virtual_address_bits_per_resource_,
       (heap_flag_create_not_zeroed_ & D3D12_HEAP_FLAG_CREATE_NOT_ZEROED) ? "yes"
                                                                          : "no",
@@ -474,7 +487,8 @@ bool D3D12Provider::Initialize() {
       uint32_t(programmable_sample_positions_tier_),
       rasterizer_ordered_views_supported_ ? "yes" : "no",
       uint32_t(resource_binding_tier_), uint32_t(tiled_resources_tier_),
-      unaligned_block_textures_supported_ ? "yes" : "no");
+      unaligned_block_textures_supported_ ? "yes" : "no",
+      enhanced_barriers_supported_ ? "yes" : "no");
 
   // Get the graphics analysis interface, will silently fail if PIX is not
   // attached.
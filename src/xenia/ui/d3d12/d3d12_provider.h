@@ -100,6 +100,8 @@ class D3D12Provider : public GraphicsProvider {
 
   // Adapter info.
   GpuVendorID GetAdapterVendorID() const { return adapter_vendor_id_; }
+  // nullptr if the video memory budget can't be queried.
+  IDXGIAdapter3* GetDXGIAdapter3() const { return dxgi_adapter3_; }
 
   // Device features.
   D3D12_HEAP_FLAGS GetHeapFlagCreateNotZeroed() const {
@@ -124,6 +126,9 @@ class D3D12Provider : public GraphicsProvider {
   bool AreUnalignedBlockTexturesSupported() const {
     return unaligned_block_textures_supported_;
   }
+  bool AreEnhancedBarriersSupported() const {
+    return enhanced_barriers_supported_;
+  }
   uint32_t GetVirtualAddressBitsPerResource() const {
     return virtual_address_bits_per_resource_;
   }
@@ -197,6 +202,7 @@ class D3D12Provider : public GraphicsProvider {
   uint32_t descriptor_sizes_[D3D12_DESCRIPTOR_HEAP_TYPE_NUM_TYPES];
 
   GpuVendorID adapter_vendor_id_;
+  IDXGIAdapter3* dxgi_adapter3_ = nullptr;
 
   D3D12_HEAP_FLAGS heap_flag_create_not_zeroed_;
   D3D12_PROGRAMMABLE_SAMPLE_POSITIONS_TIER programmable_sample_positions_tier_;
@@ -206,6 +212,7 @@ class D3D12Provider : public GraphicsProvider {
   bool ps_specified_stencil_reference_supported_;
   bool rasterizer_ordered_views_supported_;
   bool unaligned_block_textures_supported_;
+  bool enhanced_barriers_supported_;
 
   lightweight_nvapi::nvapi_state_t* nvapi_;
   lightweight_nvapi::cb_NvAPI_D3D12_CreateCommittedResource
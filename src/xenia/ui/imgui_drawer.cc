@@ -504,35 +504,74 @@ void ImGuiDrawer::RenderDrawLists(ImDrawData* data,
                                   UIDrawContext& ui_draw_context) {
   ImGuiIO& io = ImGui::GetIO();
 
-  immediate_drawer_->Begin(ui_draw_context, io.DisplaySize.x, io.DisplaySize.y);
-
+  // Gather the geometry of all the draw lists so it's uploaded and bound once
+  // per frame rather than once per list, with the indices of each list
+  // relative to its base vertex, and merge consecutive commands using the same
+  // texture and clipping rectangle, which are common with overlays made of
+  // many windows and widgets, into one draw.
+  frame_vertices_.clear();
+  frame_indices_.clear();
+  frame_draws_.clear();
   for (int i = 0; i < data->CmdListsCount; ++i) {
     const auto cmd_list = data->CmdLists[i];
-
-    ImmediateDrawBatch batch;
-    batch.vertices =
-        reinterpret_cast<ImmediateVertex*>(cmd_list->VtxBuffer.Data);
-    batch.vertex_count = cmd_list->VtxBuffer.size();
-    batch.indices = cmd_list->IdxBuffer.Data;
-    batch.index_count = cmd_list->IdxBuffer.size();
-    immediate_drawer_->BeginDrawBatch(batch);
+    int list_base_vertex = int(frame_vertices_.size());
+    int list_index_offset = int(frame_indices_.size());
+    const auto list_vertices =
+        reinterpret_cast<const ImmediateVertex*>(cmd_list->VtxBuffer.Data);
+    frame_vertices_.insert(frame_vertices_.end(), list_vertices,
+                           list_vertices + cmd_list->VtxBuffer.size());
+    const uint16_t* list_indices = cmd_list->IdxBuffer.Data;
+    frame_indices_.insert(frame_indices_.end(), list_indices,
+                          list_indices + cmd_list->IdxBuffer.size());
 
     for (int j = 0; j < cmd_list->CmdBuffer.size(); ++j) {
       const auto& cmd = cmd_list->CmdBuffer[j];
+      if (!cmd.ElemCount) {
+        continue;
+      }
+      int base_vertex = list_base_vertex + int(cmd.VtxOffset);
+      int index_offset = list_index_offset + int(cmd.IdxOffset);
+      auto texture = reinterpret_cast<ImmediateTexture*>(cmd.TextureId);
+      if (!frame_draws_.empty()) {
+        ImmediateDraw& last_draw = frame_draws_.back();
+        if (last_draw.base_vertex == base_vertex &&
+            last_draw.index_offset + last_draw.count == index_offset &&
+            last_draw.texture == texture &&
+            last_draw.scissor_left == cmd.ClipRect.x &&
+            last_draw.scissor_top == cmd.ClipRect.y &&
+            last_draw.scissor_right == cmd.ClipRect.z &&
+            last_draw.scissor_bottom == cmd.ClipRect.w) {
+          last_draw.count += int(cmd.ElemCount);
+          continue;
+        }
+      }
 
-      ImmediateDraw draw;
+      ImmediateDraw& draw = frame_draws_.emplace_back();
       draw.primitive_type = ImmediatePrimitiveType::kTriangles;
-      draw.count = cmd.ElemCount;
-      draw.index_offset = cmd.IdxOffset;
-      draw.texture = reinterpret_cast<ImmediateTexture*>(cmd.TextureId);
+      draw.count = int(cmd.ElemCount);
+      draw.index_offset = index_offset;
+      draw.base_vertex = base_vertex;
+      draw.texture = texture;
       draw.scissor = true;
       draw.scissor_left = cmd.ClipRect.x;
       draw.scissor_top = cmd.ClipRect.y;
       draw.scissor_right = cmd.ClipRect.z;
       draw.scissor_bottom = cmd.ClipRect.w;
-      immediate_drawer_->Draw(draw);
     }
+  }
+
+  immediate_drawer_->Begin(ui_draw_context, io.DisplaySize.x, io.DisplaySize.y);
 
+  if (!frame_draws_.empty()) {
+    ImmediateDrawBatch batch;
+    batch.vertices = frame_vertices_.data();
+    batch.vertex_count = int(frame_vertices_.size());
+    batch.indices = frame_indices_.data();
+    batch.index_count = int(frame_indices_.size());
+    immediate_drawer_->BeginDrawBatch(batch);
+    for (const ImmediateDraw& draw : frame_draws_) {
+      immediate_drawer_->Draw(draw);
+    }
     immediate_drawer_->EndDrawBatch();
   }
 
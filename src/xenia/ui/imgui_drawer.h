@@ -137,6 +137,12 @@ class ImGuiDrawer : public WindowInputListener, public UIDrawer {
 
   double frame_time_tick_frequency_;
   uint64_t last_frame_time_ticks_;
+
+  // Geometry of all the draw lists of the frame, uploaded as one batch, kept
+  // across frames to avoid reallocation.
+  std::vector<ImmediateVertex> frame_vertices_;
+  std::vector<uint16_t> frame_indices_;
+  std::vector<ImmediateDraw> frame_draws_;
 };
 
 }  // namespace ui
@@ -40,6 +40,14 @@ DEFINE_bool(
     "host window system.",
     "Display");
 
+DEFINE_bool(
+    present_low_latency, false,
+    "On graphics backends where this is supported, wait for the previous frame "
+    "to be displayed before drawing the next one, so no more than one frame is "
+    "queued for presentation, reducing the input latency at the cost of "
+    "potentially lower frame rate.",
+    "Display");
+
 DEFINE_bool(
     present_render_pass_clear, true,
     "On graphics backends where this is supported, use the clear render pass "
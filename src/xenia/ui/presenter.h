@@ -44,6 +44,7 @@
 #endif  // XE_PLATFORM
 
 // For implementation use.
+DECLARE_bool(present_low_latency);
 DECLARE_bool(present_render_pass_clear);
 
 namespace xe {
@@ -314,6 +315,12 @@ class Presenter {
   // returned true. The callback must submit all updating work to the host GPU
   // before successfully returning, and also signal all the GPU synchronization
   // primitives required by the GuestOutputRefreshContext implementation.
+  // The refresher should write the final guest output, with conversions such
+  // as the gamma ramp applied, directly to the image of the context rather
+  // than copy an intermediate image there. The guest's front buffer itself
+  // can't be painted in place of the mailbox image because the guest may
+  // overwrite it while it's still being painted, possibly on a different
+  // thread.
   bool RefreshGuestOutput(
       uint32_t frontbuffer_width, uint32_t frontbuffer_height,
       uint32_t display_aspect_ratio_x, uint32_t display_aspect_ratio_y,
@@ -385,6 +392,12 @@ class Presenter {
     }
   };
 
+  // The gamma ramp (fused with the FXAA luma calculation when needed) and FXAA
+  // are applied by the GPU emulation when refreshing the guest output, while
+  // these effects are applied when painting, which may be done multiple times
+  // for one guest output image (such as when resizing the window, or when the
+  // host refresh rate is higher than the guest one), or not at all, so they
+  // can't be fused with the guest output refresh passes.
   enum class GuestOutputPaintEffect {
     kBilinear,
     kBilinearDither,
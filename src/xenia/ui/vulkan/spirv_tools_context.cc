@@ -12,6 +12,7 @@
 #include <cstdlib>
 #include <filesystem>
 #include <string>
+#include <vector>
 
 #include "xenia/base/logging.h"
 #include "xenia/base/platform.h"
@@ -63,17 +64,31 @@ bool SpirvToolsContext::Initialize(unsigned int spirv_version) {
     Shutdown();
     return false;
   }
-  spv_target_env target_env;
+  if (!LoadLibraryFunction(fn_spvBinaryDestroy_, "spvBinaryDestroy") ||
+      !LoadLibraryFunction(fn_spvOptimizerCreate_, "spvOptimizerCreate") ||
+      !LoadLibraryFunction(fn_spvOptimizerDestroy_, "spvOptimizerDestroy") ||
+      !LoadLibraryFunction(fn_spvOptimizerRegisterPassFromFlag_,
+                           "spvOptimizerRegisterPassFromFlag") ||
+      !LoadLibraryFunction(fn_spvOptimizerRun_, "spvOptimizerRun") ||
+      !LoadLibraryFunction(fn_spvOptimizerOptionsCreate_,
+                           "spvOptimizerOptionsCreate") ||
+      !LoadLibraryFunction(fn_spvOptimizerOptionsDestroy_,
+                           "spvOptimizerOptionsDestroy")) {
+    XELOGW(
+        "SPIRV-Tools: The library doesn't provide the optimizer interface, "
+        "SPIR-V optimization is not available");
+    fn_spvOptimizerCreate_ = nullptr;
+  }
   if (spirv_version >= 0x10500) {
-    target_env = SPV_ENV_VULKAN_1_2;
+    target_env_ = SPV_ENV_VULKAN_1_2;
   } else if (spirv_version >= 0x10400) {
-    target_env = SPV_ENV_VULKAN_1_1_SPIRV_1_4;
+    target_env_ = SPV_ENV_VULKAN_1_1_SPIRV_1_4;
   } else if (spirv_version >= 0x10300) {
-    target_env = SPV_ENV_VULKAN_1_1;
+    target_env_ = SPV_ENV_VULKAN_1_1;
   } else {
-    target_env = SPV_ENV_VULKAN_1_0;
+    target_env_ = SPV_ENV_VULKAN_1_0;
   }
-  context_ = fn_spvContextCreate_(target_env);
+  context_ = fn_spvContextCreate_(target_env_);
   if (!context_) {
     XELOGE("SPIRV-Tools: Failed to create a Vulkan 1.0 context");
     Shutdown();
@@ -95,6 +110,7 @@ void SpirvToolsContext::Shutdown() {
 #endif
     library_ = nullptr;
   }
+  fn_spvOptimizerCreate_ = nullptr;
 }
 
 spv_result_t SpirvToolsContext::Validate(const uint32_t* words,
@@ -118,6 +134,55 @@ spv_result_t SpirvToolsContext::Validate(const uint32_t* words,
   return result;
 }
 
+spv_result_t SpirvToolsContext::Optimize(
+    const uint32_t* words, size_t num_words,
+    std::vector<uint32_t>& optimized_out) const {
+  optimized_out.clear();
+  if (!context_ || !IsOptimizerAvailable()) {
+    return SPV_UNSUPPORTED;
+  }
+  // The optimizer keeps state in the passes, so a separate one is needed for
+  // every thread.
+  spv_optimizer_t* optimizer = fn_spvOptimizerCreate_(target_env_);
+  if (!optimizer) {
+    return SPV_ERROR_OUT_OF_MEMORY;
+  }
+  static const char* const kPassFlags[] = {
+      "--ssa-rewrite",
+      "--ccp",
+      "--eliminate-dead-branches",
+      "--merge-blocks",
+      "--simplify-instructions",
+      "--eliminate-dead-code-aggressive",
+  };
+  for (const char* pass_flag : kPassFlags) {
+    if (!fn_spvOptimizerRegisterPassFromFlag_(optimizer, pass_flag)) {
+      XELOGE("SPIRV-Tools: Failed to register the {} optimization pass",
+             pass_flag);
+      fn_spvOptimizerDestroy_(optimizer);
+      return SPV_ERROR_INTERNAL;
+    }
+  }
+  spv_optimizer_options options = fn_spvOptimizerOptionsCreate_();
+  if (!options) {
+    fn_spvOptimizerDestroy_(optimizer);
+    return SPV_ERROR_OUT_OF_MEMORY;
+  }
+  spv_binary optimized_binary = nullptr;
+  spv_result_t result = fn_spvOptimizerRun_(optimizer, words, num_words,
+                                            &optimized_binary, options);
+  if (result == SPV_SUCCESS && optimized_binary) {
+    optimized_out.assign(optimized_binary->code,
+                         optimized_binary->code + optimized_binary->wordCount);
+  }
+  if (optimized_binary) {
+    fn_spvBinaryDestroy_(optimized_binary);
+  }
+  fn_spvOptimizerOptionsDestroy_(options);
+  fn_spvOptimizerDestroy_(optimizer);
+  return result;
+}
+
 }  // namespace vulkan
 }  // namespace ui
 }  // namespace xe
@@ -1260,6 +1260,7 @@ VkSwapchainKHR VulkanPresenter::PaintContext::PrepareForSwapchainRetirement() {
   swapchain_images.clear();
   swapchain_extent.width = 0;
   swapchain_extent.height = 0;
+  swapchain_present_id_last = 0;
   // The old swapchain must be destroyed externally.
   VkSwapchainKHR old_swapchain = swapchain;
   swapchain = nullptr;
@@ -1395,6 +1396,26 @@ Presenter::PaintResult VulkanPresenter::PaintAndPresentImpl(
   // vkResetCommandPool resets from both initial and recording states, still
   // safe to return early from this function in case of an error.
 
+  // In the low-latency mode, don't queue more than one frame for presentation.
+  bool present_wait =
+      cvars::present_low_latency &&
+      provider_.device_extensions().khr_present_wait &&
+      provider_.device_present_id_features().presentId &&
+      provider_.device_present_wait_features().presentWait;
+  if (present_wait && paint_context_.swapchain_present_id_last) {
+    // Not waiting indefinitely in case the presentation engine doesn't
+    // display the image for some reason, such as the window being minimized.
+    VkResult present_wait_result = dfn.vkWaitForPresentKHR(
+        device, paint_context_.swapchain,
+        paint_context_.swapchain_present_id_last, UINT64_C(100000000));
+    if (present_wait_result == VK_ERROR_DEVICE_LOST) {
+      XELOGE(
+          "VulkanPresenter: Failed to await the presentation as the device has "
+          "been lost");
+      return PaintResult::kGpuLostResponsible;
+    }
+  }
+
   VkSemaphore acquire_semaphore = paint_submission.acquire_semaphore();
   uint32_t swapchain_image_index;
   VkResult acquire_result = dfn.vkAcquireNextImageKHR(
@@ -2064,6 +2085,15 @@ Presenter::PaintResult VulkanPresenter::PaintAndPresentImpl(
   VkPresentInfoKHR present_info;
   present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
   present_info.pNext = nullptr;
+  VkPresentIdKHR present_id;
+  if (present_wait) {
+    present_id.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+    present_id.pNext = nullptr;
+    present_id.swapchainCount = 1;
+    present_id.pPresentIds = &paint_context_.swapchain_present_id_last;
+    ++paint_context_.swapchain_present_id_last;
+    present_info.pNext = &present_id;
+  }
   present_info.waitSemaphoreCount = 1;
   present_info.pWaitSemaphores = &present_semaphore;
   present_info.swapchainCount = 1;
@@ -455,6 +455,9 @@ class VulkanPresenter final : public Presenter {
     VkSwapchainKHR swapchain = VK_NULL_HANDLE;
     VkExtent2D swapchain_extent = {};
     bool swapchain_is_fifo = false;
+    // For VK_KHR_present_wait, 0 if nothing has been presented to the current
+    // swapchain yet.
+    uint64_t swapchain_present_id_last = 0;
     std::vector<VkImage> swapchain_images;
     std::vector<SwapchainFramebuffer> swapchain_framebuffers;
   };
@@ -9,6 +9,7 @@
 
 #include "xenia/ui/vulkan/vulkan_provider.h"
 
+#include <algorithm>
 #include <cfloat>
 #include <cstddef>
 #include <cstring>
@@ -605,6 +606,12 @@ bool VulkanProvider::Initialize() {
     queue_families_[queue_family_graphics_compute_].queue_count =
         std::max(queue_families_[queue_family_graphics_compute_].queue_count,
                  uint32_t(1));
+    // Request a second graphics and compute queue, if available, for work that
+    // may be done asynchronously with the main emulation work.
+    if (queue_families_properties[queue_family_graphics_compute_].queueCount >=
+        2) {
+      queue_families_[queue_family_graphics_compute_].queue_count = 2;
+    }
     // Request a separate sparse binding queue if needed.
     queue_family_sparse_binding_ = UINT32_MAX;
     if (device_features_.sparseBinding) {
@@ -695,6 +702,7 @@ bool VulkanProvider::Initialize() {
         device_extensions_.khr_image_format_list = true;
         device_extensions_.khr_shader_float_controls = true;
         device_extensions_.khr_spirv_1_4 = true;
+        device_extensions_.khr_timeline_semaphore = true;
         if (device_properties_.apiVersion >= VK_MAKE_API_VERSION(0, 1, 3, 0)) {
           device_extensions_.ext_shader_demote_to_helper_invocation = true;
           device_extensions_.khr_maintenance4 = true;
@@ -709,6 +717,8 @@ bool VulkanProvider::Initialize() {
     static const std::pair<const char*, size_t> kUsedDeviceExtensions[] = {
         {"VK_EXT_fragment_shader_interlock",
          offsetof(DeviceExtensions, ext_fragment_shader_interlock)},
+        {"VK_EXT_graphics_pipeline_library",
+         offsetof(DeviceExtensions, ext_graphics_pipeline_library)},
         {"VK_EXT_memory_budget", offsetof(DeviceExtensions, ext_memory_budget)},
         {"VK_EXT_shader_demote_to_helper_invocation",
          offsetof(DeviceExtensions, ext_shader_demote_to_helper_invocation)},
@@ -722,8 +732,14 @@ bool VulkanProvider::Initialize() {
         {"VK_KHR_image_format_list",
          offsetof(DeviceExtensions, khr_image_format_list)},
         {"VK_KHR_maintenance4", offsetof(DeviceExtensions, khr_maintenance4)},
+        {"VK_KHR_pipeline_library",
+         offsetof(DeviceExtensions, khr_pipeline_library)},
         {"VK_KHR_portability_subset",
          offsetof(DeviceExtensions, khr_portability_subset)},
+        {"VK_KHR_present_id", offsetof(DeviceExtensions, khr_present_id)},
+        {"VK_KHR_present_wait", offsetof(DeviceExtensions, khr_present_wait)},
+        {"VK_KHR_push_descriptor",
+         offsetof(DeviceExtensions, khr_push_descriptor)},
         // While vkGetPhysicalDeviceFormatProperties should be used to check the
         // format support (device support for Y'CbCr formats is not required by
         // this extension or by Vulkan 1.1), still adding
@@ -735,6 +751,8 @@ bool VulkanProvider::Initialize() {
          offsetof(DeviceExtensions, khr_shader_float_controls)},
         {"VK_KHR_spirv_1_4", offsetof(DeviceExtensions, khr_spirv_1_4)},
         {"VK_KHR_swapchain", offsetof(DeviceExtensions, khr_swapchain)},
+        {"VK_KHR_timeline_semaphore",
+         offsetof(DeviceExtensions, khr_timeline_semaphore)},
     };
     for (const VkExtensionProperties& device_extension :
          device_extension_properties) {
@@ -754,6 +772,55 @@ bool VulkanProvider::Initialize() {
     if (is_surface_required_ && !device_extensions_.khr_swapchain) {
       continue;
     }
+    // VK_EXT_graphics_pipeline_library requires VK_KHR_pipeline_library and
+    // VK_KHR_get_physical_device_properties2.
+    if (device_extensions_.ext_graphics_pipeline_library &&
+        (!device_extensions_.khr_pipeline_library ||
+         !instance_extensions_.khr_get_physical_device_properties2)) {
+      device_extensions_.ext_graphics_pipeline_library = false;
+      device_extensions_enabled.erase(
+          std::remove_if(device_extensions_enabled.begin(),
+                         device_extensions_enabled.end(),
+                         [](const char* extension_name) {
+                           return !std::strcmp(
+                               extension_name,
+                               "VK_EXT_graphics_pipeline_library");
+                         }),
+          device_extensions_enabled.end());
+    }
+    // VK_KHR_present_wait requires VK_KHR_present_id and VK_KHR_swapchain, both
+    // requiring VK_KHR_get_physical_device_properties2 (for the features).
+    if (!instance_extensions_.khr_get_physical_device_properties2) {
+      device_extensions_.khr_present_id = false;
+    }
+    if (device_extensions_.khr_present_wait &&
+        (!device_extensions_.khr_present_id ||
+         !device_extensions_.khr_swapchain)) {
+      device_extensions_.khr_present_wait = false;
+    }
+    device_extensions_enabled.erase(
+        std::remove_if(
+            device_extensions_enabled.begin(), device_extensions_enabled.end(),
+            [this](const char* extension_name) {
+              return (!device_extensions_.khr_present_id &&
+                      !std::strcmp(extension_name, "VK_KHR_present_id")) ||
+                     (!device_extensions_.khr_present_wait &&
+                      !std::strcmp(extension_name, "VK_KHR_present_wait"));
+            }),
+        device_extensions_enabled.end());
+    // VK_KHR_push_descriptor requires VK_KHR_get_physical_device_properties2.
+    if (device_extensions_.khr_push_descriptor &&
+        !instance_extensions_.khr_get_physical_device_properties2) {
+      device_extensions_.khr_push_descriptor = false;
+      device_extensions_enabled.erase(
+          std::remove_if(device_extensions_enabled.begin(),
+                         device_extensions_enabled.end(),
+                         [](const char* extension_name) {
+                           return !std::strcmp(extension_name,
+                                               "VK_KHR_push_descriptor");
+                         }),
+          device_extensions_enabled.end());
+    }
 
     // Get portability subset features.
     // VK_KHR_portability_subset reduces, not increases, the capabilities, skip
@@ -829,6 +896,26 @@ bool VulkanProvider::Initialize() {
               sizeof(device_shader_demote_to_helper_invocation_features_));
   device_shader_demote_to_helper_invocation_features_.sType =
       VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_DEMOTE_TO_HELPER_INVOCATION_FEATURES_EXT;
+  std::memset(&device_graphics_pipeline_library_features_, 0,
+              sizeof(device_graphics_pipeline_library_features_));
+  device_graphics_pipeline_library_features_.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+  std::memset(&device_graphics_pipeline_library_properties_, 0,
+              sizeof(device_graphics_pipeline_library_properties_));
+  device_graphics_pipeline_library_properties_.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT;
+  std::memset(&device_timeline_semaphore_features_, 0,
+              sizeof(device_timeline_semaphore_features_));
+  device_timeline_semaphore_features_.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+  std::memset(&device_present_id_features_, 0,
+              sizeof(device_present_id_features_));
+  device_present_id_features_.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+  std::memset(&device_present_wait_features_, 0,
+              sizeof(device_present_wait_features_));
+  device_present_wait_features_.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
   if (instance_extensions_.khr_get_physical_device_properties2) {
     VkPhysicalDeviceProperties2KHR device_properties_2;
     device_properties_2.sType =
@@ -843,6 +930,14 @@ bool VulkanProvider::Initialize() {
           reinterpret_cast<VkPhysicalDeviceProperties2KHR*>(
               &device_float_controls_properties_);
     }
+    if (device_extensions_.ext_graphics_pipeline_library) {
+      device_graphics_pipeline_library_properties_.pNext = nullptr;
+      device_properties_2_last->pNext =
+          &device_graphics_pipeline_library_properties_;
+      device_properties_2_last =
+          reinterpret_cast<VkPhysicalDeviceProperties2KHR*>(
+              &device_graphics_pipeline_library_properties_);
+    }
     if (device_properties_2_last != &device_properties_2) {
       ifn_.vkGetPhysicalDeviceProperties2KHR(physical_device_,
                                              &device_properties_2);
@@ -865,6 +960,31 @@ bool VulkanProvider::Initialize() {
       device_features_2_last = reinterpret_cast<VkPhysicalDeviceFeatures2KHR*>(
           &device_shader_demote_to_helper_invocation_features_);
     }
+    if (device_extensions_.ext_graphics_pipeline_library) {
+      device_graphics_pipeline_library_features_.pNext = nullptr;
+      device_features_2_last->pNext =
+          &device_graphics_pipeline_library_features_;
+      device_features_2_last = reinterpret_cast<VkPhysicalDeviceFeatures2KHR*>(
+          &device_graphics_pipeline_library_features_);
+    }
+    if (device_extensions_.khr_timeline_semaphore) {
+      device_timeline_semaphore_features_.pNext = nullptr;
+      device_features_2_last->pNext = &device_timeline_semaphore_features_;
+      device_features_2_last = reinterpret_cast<VkPhysicalDeviceFeatures2KHR*>(
+          &device_timeline_semaphore_features_);
+    }
+    if (device_extensions_.khr_present_id) {
+      device_present_id_features_.pNext = nullptr;
+      device_features_2_last->pNext = &device_present_id_features_;
+      device_features_2_last = reinterpret_cast<VkPhysicalDeviceFeatures2KHR*>(
+          &device_present_id_features_);
+    }
+    if (device_extensions_.khr_present_wait) {
+      device_present_wait_features_.pNext = nullptr;
+      device_features_2_last->pNext = &device_present_wait_features_;
+      device_features_2_last = reinterpret_cast<VkPhysicalDeviceFeatures2KHR*>(
+          &device_present_wait_features_);
+    }
     if (device_features_2_last != &device_features_2) {
       ifn_.vkGetPhysicalDeviceFeatures2KHR(physical_device_,
                                            &device_features_2);
@@ -936,6 +1056,31 @@ bool VulkanProvider::Initialize() {
     device_create_info_last = reinterpret_cast<VkDeviceCreateInfo*>(
         &device_shader_demote_to_helper_invocation_features_);
   }
+  if (device_extensions_.ext_graphics_pipeline_library) {
+    device_graphics_pipeline_library_features_.pNext = nullptr;
+    device_create_info_last->pNext =
+        &device_graphics_pipeline_library_features_;
+    device_create_info_last = reinterpret_cast<VkDeviceCreateInfo*>(
+        &device_graphics_pipeline_library_features_);
+  }
+  if (device_extensions_.khr_timeline_semaphore) {
+    device_timeline_semaphore_features_.pNext = nullptr;
+    device_create_info_last->pNext = &device_timeline_semaphore_features_;
+    device_create_info_last = reinterpret_cast<VkDeviceCreateInfo*>(
+        &device_timeline_semaphore_features_);
+  }
+  if (device_extensions_.khr_present_id) {
+    device_present_id_features_.pNext = nullptr;
+    device_create_info_last->pNext = &device_present_id_features_;
+    device_create_info_last = reinterpret_cast<VkDeviceCreateInfo*>(
+        &device_present_id_features_);
+  }
+  if (device_extensions_.khr_present_wait) {
+    device_present_wait_features_.pNext = nullptr;
+    device_create_info_last->pNext = &device_present_wait_features_;
+    device_create_info_last = reinterpret_cast<VkDeviceCreateInfo*>(
+        &device_present_wait_features_);
+  }
   if (ifn_.vkCreateDevice(physical_device_, &device_create_info, nullptr,
                           &device_) != VK_SUCCESS) {
     XELOGE("Failed to create a Vulkan device");
@@ -1009,6 +1154,16 @@ bool VulkanProvider::Initialize() {
     }
     device_extensions_.khr_maintenance4 = functions_loaded;
   }
+  if (device_extensions_.khr_present_wait) {
+    bool functions_loaded = true;
+#include "xenia/ui/vulkan/functions/device_khr_present_wait.inc"
+    device_extensions_.khr_present_wait = functions_loaded;
+  }
+  if (device_extensions_.khr_push_descriptor) {
+    bool functions_loaded = true;
+#include "xenia/ui/vulkan/functions/device_khr_push_descriptor.inc"
+    device_extensions_.khr_push_descriptor = functions_loaded;
+  }
   if (device_extensions_.khr_swapchain) {
     bool functions_loaded = true;
 #include "xenia/ui/vulkan/functions/device_khr_swapchain.inc"
@@ -1022,6 +1177,19 @@ bool VulkanProvider::Initialize() {
     }
     device_extensions_.khr_swapchain = functions_loaded;
   }
+  if (device_extensions_.khr_timeline_semaphore) {
+    bool functions_loaded = true;
+    if (device_properties_.apiVersion >= VK_MAKE_API_VERSION(0, 1, 2, 0)) {
+#define XE_UI_VULKAN_FUNCTION_PROMOTED XE_UI_VULKAN_FUNCTION_PROMOTE
+#include "xenia/ui/vulkan/functions/device_khr_timeline_semaphore.inc"
+#undef XE_UI_VULKAN_FUNCTION_PROMOTED
+    } else {
+#define XE_UI_VULKAN_FUNCTION_PROMOTED XE_UI_VULKAN_FUNCTION_DONT_PROMOTE
+#include "xenia/ui/vulkan/functions/device_khr_timeline_semaphore.inc"
+#undef XE_UI_VULKAN_FUNCTION_PROMOTED
+    }
+    device_extensions_.khr_timeline_semaphore = functions_loaded;
+  }
 #undef XE_UI_VULKAN_FUNCTION_PROMOTE
 #undef XE_UI_VULKAN_FUNCTION_DONT_PROMOTE
 #undef XE_UI_VULKAN_FUNCTION
@@ -1055,6 +1223,24 @@ bool VulkanProvider::Initialize() {
             ? "yes"
             : "no");
   }
+  XELOGVK("* VK_EXT_graphics_pipeline_library: {}",
+          device_extensions_.ext_graphics_pipeline_library ? "yes" : "no");
+  if (device_extensions_.ext_graphics_pipeline_library) {
+    XELOGVK("  * Graphics pipeline library: {}",
+            device_graphics_pipeline_library_features_.graphicsPipelineLibrary
+                ? "yes"
+                : "no");
+    XELOGVK("  * Fast linking: {}",
+            device_graphics_pipeline_library_properties_
+                    .graphicsPipelineLibraryFastLinking
+                ? "yes"
+                : "no");
+    XELOGVK("  * Independent interpolation decoration: {}",
+            device_graphics_pipeline_library_properties_
+                    .graphicsPipelineLibraryIndependentInterpolationDecoration
+                ? "yes"
+                : "no");
+  }
   XELOGVK("* VK_EXT_memory_budget: {}",
           device_extensions_.ext_memory_budget ? "yes" : "no");
   XELOGVK(
@@ -1079,6 +1265,8 @@ bool VulkanProvider::Initialize() {
           device_extensions_.khr_image_format_list ? "yes" : "no");
   XELOGVK("* VK_KHR_maintenance4: {}",
           device_extensions_.khr_maintenance4 ? "yes" : "no");
+  XELOGVK("* VK_KHR_pipeline_library: {}",
+          device_extensions_.khr_pipeline_library ? "yes" : "no");
   XELOGVK("* VK_KHR_portability_subset: {}",
           device_extensions_.khr_portability_subset ? "yes" : "no");
   if (device_extensions_.khr_portability_subset) {
@@ -1107,6 +1295,20 @@ bool VulkanProvider::Initialize() {
     XELOGVK("  * Triangle fans: {}",
             device_portability_subset_features_.triangleFans ? "yes" : "no");
   }
+  XELOGVK("* VK_KHR_present_id: {}",
+          device_extensions_.khr_present_id ? "yes" : "no");
+  if (device_extensions_.khr_present_id) {
+    XELOGVK("  * Present ID: {}",
+            device_present_id_features_.presentId ? "yes" : "no");
+  }
+  XELOGVK("* VK_KHR_present_wait: {}",
+          device_extensions_.khr_present_wait ? "yes" : "no");
+  if (device_extensions_.khr_present_wait) {
+    XELOGVK("  * Present wait: {}",
+            device_present_wait_features_.presentWait ? "yes" : "no");
+  }
+  XELOGVK("* VK_KHR_push_descriptor: {}",
+          device_extensions_.khr_push_descriptor ? "yes" : "no");
   XELOGVK("* VK_KHR_sampler_ycbcr_conversion: {}",
           device_extensions_.khr_sampler_ycbcr_conversion ? "yes" : "no");
   XELOGVK("* VK_KHR_shader_float_controls: {}",
@@ -1126,6 +1328,13 @@ bool VulkanProvider::Initialize() {
     XELOGVK("* VK_KHR_swapchain: {}",
             device_extensions_.khr_swapchain ? "yes" : "no");
   }
+  XELOGVK("* VK_KHR_timeline_semaphore: {}",
+          device_extensions_.khr_timeline_semaphore ? "yes" : "no");
+  if (device_extensions_.khr_timeline_semaphore) {
+    XELOGVK("  * Timeline semaphore: {}",
+            device_timeline_semaphore_features_.timelineSemaphore ? "yes"
+                                                                  : "no");
+  }
   // TODO(Triang3l): Report properties, features.
 
   // Get the queues.
@@ -132,6 +132,8 @@ class VulkanProvider : public GraphicsProvider {
   }
   struct DeviceExtensions {
     bool ext_fragment_shader_interlock;
+    // Requires VK_KHR_pipeline_library.
+    bool ext_graphics_pipeline_library;
     bool ext_memory_budget;
     // Core since 1.3.0.
     bool ext_shader_demote_to_helper_invocation;
@@ -146,8 +148,15 @@ class VulkanProvider : public GraphicsProvider {
     bool khr_image_format_list;
     // Core since 1.3.0.
     bool khr_maintenance4;
+    bool khr_pipeline_library;
     // Requires the VK_KHR_get_physical_device_properties2 instance extension.
     bool khr_portability_subset;
+    // Requires the VK_KHR_get_physical_device_properties2 instance extension.
+    bool khr_present_id;
+    // Requires VK_KHR_present_id and VK_KHR_swapchain.
+    bool khr_present_wait;
+    // Requires the VK_KHR_get_physical_device_properties2 instance extension.
+    bool khr_push_descriptor;
     // Core since 1.1.0.
     bool khr_sampler_ycbcr_conversion;
     // Core since 1.2.0.
@@ -155,6 +164,8 @@ class VulkanProvider : public GraphicsProvider {
     // Core since 1.2.0.
     bool khr_spirv_1_4;
     bool khr_swapchain;
+    // Core since 1.2.0.
+    bool khr_timeline_semaphore;
   };
   const DeviceExtensions& device_extensions() const {
     return device_extensions_;
@@ -191,6 +202,12 @@ class VulkanProvider : public GraphicsProvider {
   uint32_t queue_family_graphics_compute() const {
     return queue_family_graphics_compute_;
   }
+  // Whether a second queue (with the index 1) is available in the graphics and
+  // compute queue family for asynchronous work. Queues in the same family don't
+  // need ownership transfers of exclusive resources.
+  bool IsGraphicsComputeAsyncQueueAvailable() const {
+    return queue_families_[queue_family_graphics_compute_].queue_count >= 2;
+  }
   // Optional, if sparse binding is supported (UINT32_MAX otherwise). May be the
   // same as queue_family_graphics_compute_.
   uint32_t queue_family_sparse_binding() const {
@@ -208,6 +225,26 @@ class VulkanProvider : public GraphicsProvider {
   device_shader_demote_to_helper_invocation_features() const {
     return device_shader_demote_to_helper_invocation_features_;
   }
+  const VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT&
+  device_graphics_pipeline_library_features() const {
+    return device_graphics_pipeline_library_features_;
+  }
+  const VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT&
+  device_graphics_pipeline_library_properties() const {
+    return device_graphics_pipeline_library_properties_;
+  }
+  const VkPhysicalDeviceTimelineSemaphoreFeaturesKHR&
+  device_timeline_semaphore_features() const {
+    return device_timeline_semaphore_features_;
+  }
+  const VkPhysicalDevicePresentIdFeaturesKHR& device_present_id_features()
+      const {
+    return device_present_id_features_;
+  }
+  const VkPhysicalDevicePresentWaitFeaturesKHR& device_present_wait_features()
+      const {
+    return device_present_wait_features_;
+  }
 
   struct Queue {
     VkQueue queue = VK_NULL_HANDLE;
@@ -240,7 +277,10 @@ class VulkanProvider : public GraphicsProvider {
 #include "xenia/ui/vulkan/functions/device_khr_bind_memory2.inc"
 #include "xenia/ui/vulkan/functions/device_khr_get_memory_requirements2.inc"
 #include "xenia/ui/vulkan/functions/device_khr_maintenance4.inc"
+#include "xenia/ui/vulkan/functions/device_khr_present_wait.inc"
+#include "xenia/ui/vulkan/functions/device_khr_push_descriptor.inc"
 #include "xenia/ui/vulkan/functions/device_khr_swapchain.inc"
+#include "xenia/ui/vulkan/functions/device_khr_timeline_semaphore.inc"
 #undef XE_UI_VULKAN_FUNCTION_PROMOTED
 #undef XE_UI_VULKAN_FUNCTION
   };
@@ -334,6 +374,14 @@ class VulkanProvider : public GraphicsProvider {
       device_fragment_shader_interlock_features_;
   VkPhysicalDeviceShaderDemoteToHelperInvocationFeaturesEXT
       device_shader_demote_to_helper_invocation_features_;
+  VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT
+      device_graphics_pipeline_library_features_;
+  VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT
+      device_graphics_pipeline_library_properties_;
+  VkPhysicalDeviceTimelineSemaphoreFeaturesKHR
+      device_timeline_semaphore_features_;
+  VkPhysicalDevicePresentIdFeaturesKHR device_present_id_features_;
+  VkPhysicalDevicePresentWaitFeaturesKHR device_present_wait_features_;
 
   VkDevice device_ = VK_NULL_HANDLE;
   DeviceFunctions dfn_ = {};
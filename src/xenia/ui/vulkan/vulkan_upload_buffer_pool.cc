@@ -11,10 +11,19 @@
 
 #include <algorithm>
 
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
 #include "xenia/ui/vulkan/vulkan_util.h"
 
+DEFINE_bool(
+    vulkan_upload_device_local, true,
+    "Place the upload buffers that the GPU reads directly (uniform, index and "
+    "vertex data) in host-visible device-local memory if the device has it "
+    "(such as with resizable BAR), falling back to host memory if it's "
+    "exhausted.",
+    "Vulkan");
+
 namespace xe {
 namespace ui {
 namespace vulkan {
@@ -26,11 +35,14 @@ namespace vulkan {
 // try not to waste that padding.
 VulkanUploadBufferPool::VulkanUploadBufferPool(const VulkanProvider& provider,
                                                VkBufferUsageFlags usage,
-                                               size_t page_size)
+                                               size_t page_size,
+                                               bool prefer_device_local)
     : GraphicsUploadBufferPool(size_t(
           util::GetMappableMemorySize(provider, VkDeviceSize(page_size)))),
       provider_(provider),
-      usage_(usage) {}
+      usage_(usage),
+      prefer_device_local_(prefer_device_local &&
+                           cvars::vulkan_upload_device_local) {}
 
 uint8_t* VulkanUploadBufferPool::Request(uint64_t submission_index, size_t size,
                                          size_t alignment, VkBuffer& buffer_out,
@@ -95,7 +107,8 @@ VulkanUploadBufferPool::CreatePageImplementation() {
     VkMemoryRequirements memory_requirements;
     dfn.vkGetBufferMemoryRequirements(device, buffer, &memory_requirements);
     memory_type_ = util::ChooseHostMemoryType(
-        provider_, memory_requirements.memoryTypeBits, false);
+        provider_, memory_requirements.memoryTypeBits, false,
+        prefer_device_local_);
     if (memory_type_ == UINT32_MAX) {
       XELOGE(
           "No host-visible memory types can store an Vulkan upload buffer with "
@@ -117,7 +130,8 @@ VulkanUploadBufferPool::CreatePageImplementation() {
         dfn.vkGetBufferMemoryRequirements(device, buffer_expanded,
                                           &memory_requirements_expanded);
         uint32_t memory_type_expanded = util::ChooseHostMemoryType(
-            provider_, memory_requirements.memoryTypeBits, false);
+            provider_, memory_requirements.memoryTypeBits, false,
+            prefer_device_local_);
         if (memory_requirements_expanded.size <= allocation_size_ &&
             memory_type_expanded != UINT32_MAX) {
           page_size_ = size_t(allocation_size_);
@@ -150,8 +164,27 @@ VulkanUploadBufferPool::CreatePageImplementation() {
     memory_dedicated_allocate_info.buffer = buffer;
   }
   VkDeviceMemory memory;
-  if (dfn.vkAllocateMemory(device, &memory_allocate_info, nullptr, &memory) !=
-      VK_SUCCESS) {
+  VkResult allocate_result =
+      dfn.vkAllocateMemory(device, &memory_allocate_info, nullptr, &memory);
+  if (allocate_result != VK_SUCCESS && prefer_device_local_) {
+    // Host-visible device-local memory is often small - if it's exhausted, use
+    // host memory for this and all new pages.
+    prefer_device_local_ = false;
+    VkMemoryRequirements memory_requirements;
+    dfn.vkGetBufferMemoryRequirements(device, buffer, &memory_requirements);
+    uint32_t memory_type_host = util::ChooseHostMemoryType(
+        provider_, memory_requirements.memoryTypeBits, false);
+    if (memory_type_host != UINT32_MAX && memory_type_host != memory_type_) {
+      XELOGW(
+          "Vulkan upload buffer pool: host-visible device-local memory "
+          "exhausted, using host memory");
+      memory_type_ = memory_type_host;
+      memory_allocate_info.memoryTypeIndex = memory_type_;
+      allocate_result =
+          dfn.vkAllocateMemory(device, &memory_allocate_info, nullptr, &memory);
+    }
+  }
+  if (allocate_result != VK_SUCCESS) {
     XELOGE("Failed to allocate {} bytes of Vulkan upload buffer memory",
            allocation_size_);
     dfn.vkDestroyBuffer(device, buffer, nullptr);
@@ -176,14 +209,15 @@ VulkanUploadBufferPool::CreatePageImplementation() {
     return nullptr;
   }
 
-  return new VulkanPage(provider_, buffer, memory, mapping);
+  return new VulkanPage(provider_, buffer, memory, memory_type_, mapping);
 }
 
 void VulkanUploadBufferPool::FlushPageWrites(Page* page, size_t offset,
                                              size_t size) {
-  util::FlushMappedMemoryRange(
-      provider_, static_cast<const VulkanPage*>(page)->memory_, memory_type_,
-      VkDeviceSize(offset), allocation_size_, VkDeviceSize(size));
+  const VulkanPage& vulkan_page = *static_cast<const VulkanPage*>(page);
+  util::FlushMappedMemoryRange(provider_, vulkan_page.memory_,
+                               vulkan_page.memory_type_, VkDeviceSize(offset),
+                               allocation_size_, VkDeviceSize(size));
 }
 
 VulkanUploadBufferPool::VulkanPage::~VulkanPage() {
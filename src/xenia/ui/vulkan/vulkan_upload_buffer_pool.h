@@ -19,9 +19,12 @@ namespace vulkan {
 
 class VulkanUploadBufferPool : public GraphicsUploadBufferPool {
  public:
+  // prefer_device_local is for buffers read by the GPU directly, such as
+  // uniform, index and vertex buffers, rather than copy sources.
   VulkanUploadBufferPool(const VulkanProvider& provider,
                          VkBufferUsageFlags usage,
-                         size_t page_size = kDefaultPageSize);
+                         size_t page_size = kDefaultPageSize,
+                         bool prefer_device_local = false);
 
   uint8_t* Request(uint64_t submission_index, size_t size, size_t alignment,
                    VkBuffer& buffer_out, VkDeviceSize& offset_out);
@@ -38,15 +41,18 @@ class VulkanUploadBufferPool : public GraphicsUploadBufferPool {
   struct VulkanPage : public Page {
     // Takes ownership of the buffer and its memory and mapping.
     VulkanPage(const VulkanProvider& provider, VkBuffer buffer,
-               VkDeviceMemory memory, void* mapping)
+               VkDeviceMemory memory, uint32_t memory_type, void* mapping)
         : provider_(provider),
           buffer_(buffer),
           memory_(memory),
+          memory_type_(memory_type),
           mapping_(mapping) {}
     ~VulkanPage() override;
     const VulkanProvider& provider_;
     VkBuffer buffer_;
     VkDeviceMemory memory_;
+    // May be different between pages if falling back to host memory.
+    uint32_t memory_type_;
     void* mapping_;
   };
 
@@ -58,6 +64,7 @@ class VulkanUploadBufferPool : public GraphicsUploadBufferPool {
   uint32_t memory_type_ = UINT32_MAX;
 
   VkBufferUsageFlags usage_;
+  bool prefer_device_local_;
 };
 
 }  // namespace vulkan
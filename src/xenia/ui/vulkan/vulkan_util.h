@@ -60,10 +60,23 @@ inline VkDeviceSize GetMappableMemorySize(const VulkanProvider& provider,
 
 inline uint32_t ChooseHostMemoryType(const VulkanProvider& provider,
                                      uint32_t supported_types,
-                                     bool is_readback) {
+                                     bool is_readback,
+                                     bool prefer_device_local = false) {
   supported_types &= provider.memory_types_host_visible();
   uint32_t host_cached = provider.memory_types_host_cached();
   uint32_t memory_type;
+  // For data read by the GPU directly rather than copied, host-visible
+  // device-local memory (small on discrete GPUs unless resizable BAR is
+  // enabled) avoids reading it over the bus on every access.
+  if (prefer_device_local && !is_readback) {
+    uint32_t device_local_types =
+        supported_types & provider.memory_types_device_local();
+    if (xe::bit_scan_forward(device_local_types & ~host_cached,
+                             &memory_type) ||
+        xe::bit_scan_forward(device_local_types, &memory_type)) {
+      return memory_type;
+    }
+  }
   // For upload, uncached is preferred so writes do not pollute the CPU cache.
   // For readback, cached is preferred so multiple CPU reads are fast.
   // If the preferred caching behavior is not available, pick any host-visible.
@@ -0,0 +1,467 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/devices/disc_compressed_device.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
+#include "xenia/base/literals.h"
+#include "xenia/base/logging.h"
+#include "xenia/base/math.h"
+#include "xenia/base/memory.h"
+#include "xenia/vfs/devices/disc_compressed_entry.h"
+
+#include "third_party/zstd/lib/zstd.h"
+
+DEFINE_int32(disc_compressed_cache_size_mb, 64,
+             "Size of the cache of decompressed chunks of a mounted .xcz disc "
+             "image in megabytes.",
+             "Storage");
+DEFINE_int32(disc_compressed_worker_threads, -1,
+             "Number of threads decompressing the chunks of a mounted .xcz "
+             "disc image in parallel. -1 to choose based on the number of "
+             "logical processors, 0 to decompress only on the reading thread.",
+             "Storage");
+
+namespace xe {
+namespace vfs {
+
+using namespace xe::literals;
+
+namespace {
+constexpr uint64_t kXESectorSize = 2_KiB;
+// Number of chunks after a sequential read to decompress in advance.
+constexpr uint64_t kReadAheadChunks = 4;
+// Maximum directory nesting, for rejecting cyclic directory tables.
+constexpr uint32_t kMaxDirectoryDepth = 64;
+}  // namespace
+
+DiscCompressedDevice::DiscCompressedDevice(
+    const std::string_view mount_path, const std::filesystem::path& host_path)
+    : Device(mount_path), name_("GDFX"), host_path_(host_path) {}
+
+DiscCompressedDevice::~DiscCompressedDevice() {
+  {
+    std::lock_guard<std::mutex> lock(chunks_mutex_);
+    workers_shutdown_ = true;
+  }
+  chunk_requested_cond_.notify_all();
+  for (auto& worker_thread : worker_threads_) {
+    xe::threading::Wait(worker_thread.get(), false);
+  }
+  worker_threads_.clear();
+}
+
+bool DiscCompressedDevice::CreateImage(
+    const std::filesystem::path& source_path,
+    const std::filesystem::path& target_path, uint32_t chunk_size,
+    int compression_level) {
+  if (!chunk_size || chunk_size % kXESectorSize) {
+    XELOGE("Compressed disc image chunk size must be a multiple of {}",
+           kXESectorSize);
+    return false;
+  }
+  auto source = MappedMemory::Open(source_path, MappedMemory::Mode::kRead);
+  if (!source) {
+    XELOGE("Failed to map the source disc image");
+    return false;
+  }
+  FILE* target = xe::filesystem::OpenFile(target_path, "wb");
+  if (!target) {
+    XELOGE("Failed to create the compressed disc image");
+    return false;
+  }
+
+  Header header = {};
+  header.magic = Header::kMagic;
+  header.version = Header::kVersion;
+  header.chunk_size = chunk_size;
+  header.uncompressed_size = source->size();
+  header.chunk_count = xe::round_up(uint64_t(source->size()),
+                                    uint64_t(chunk_size)) /
+                       chunk_size;
+  std::vector<uint64_t> chunk_offsets(size_t(header.chunk_count + 1));
+  // Written again with the offsets once all the chunks are compressed.
+  bool succeeded =
+      fwrite(&header, sizeof(header), 1, target) == 1 &&
+      fwrite(chunk_offsets.data(), sizeof(uint64_t), chunk_offsets.size(),
+             target) == chunk_offsets.size();
+  uint64_t offset = sizeof(header) + sizeof(uint64_t) * chunk_offsets.size();
+  std::vector<uint8_t> compressed(ZSTD_compressBound(chunk_size));
+  for (uint64_t i = 0; succeeded && i < header.chunk_count; ++i) {
+    const uint8_t* chunk = source->data() + i * chunk_size;
+    size_t chunk_length =
+        size_t(std::min(uint64_t(chunk_size), source->size() - i * chunk_size));
+    size_t compressed_size =
+        ZSTD_compress(compressed.data(), compressed.size(), chunk,
+                      chunk_length, compression_level);
+    const void* chunk_data = compressed.data();
+    if (ZSTD_isError(compressed_size) || compressed_size >= chunk_length) {
+      // Incompressible (or failed to compress), store as is.
+      chunk_data = chunk;
+      compressed_size = chunk_length;
+    }
+    chunk_offsets[size_t(i)] = offset;
+    succeeded =
+        fwrite(chunk_data, 1, compressed_size, target) == compressed_size;
+    offset += compressed_size;
+  }
+  chunk_offsets.back() = offset;
+  if (succeeded) {
+    xe::filesystem::Seek(target, sizeof(header), SEEK_SET);
+    succeeded = fwrite(chunk_offsets.data(), sizeof(uint64_t),
+                       chunk_offsets.size(),
+                       target) == chunk_offsets.size();
+  }
+  fclose(target);
+  if (!succeeded) {
+    XELOGE("Failed to write the compressed disc image");
+    return false;
+  }
+  XELOGI("Compressed the disc image from {} to {} bytes", source->size(),
+         offset);
+  return true;
+}
+
+bool DiscCompressedDevice::Initialize() {
+  mmap_ = MappedMemory::Open(host_path_, MappedMemory::Mode::kRead);
+  if (!mmap_) {
+    XELOGE("Compressed disc image could not be mapped");
+    return false;
+  }
+
+  Header header;
+  if (mmap_->size() < sizeof(header)) {
+    XELOGE("Compressed disc image is too small");
+    return false;
+  }
+  std::memcpy(&header, mmap_->data(), sizeof(header));
+  if (header.magic != Header::kMagic || header.version != Header::kVersion ||
+      !header.chunk_size || header.chunk_size % kXESectorSize ||
+      header.chunk_count !=
+          xe::round_up(header.uncompressed_size, uint64_t(header.chunk_size)) /
+              header.chunk_size ||
+      (mmap_->size() - sizeof(header)) / sizeof(uint64_t) <=
+          header.chunk_count) {
+    XELOGE("Invalid compressed disc image header");
+    return false;
+  }
+  chunk_size_ = header.chunk_size;
+  uncompressed_size_ = header.uncompressed_size;
+  chunk_count_ = header.chunk_count;
+  chunk_offsets_ =
+      reinterpret_cast<const uint64_t*>(mmap_->data() + sizeof(header));
+  for (uint64_t i = 0; i < chunk_count_; ++i) {
+    if (chunk_offsets_[i] > chunk_offsets_[i + 1] ||
+        chunk_offsets_[i + 1] > mmap_->size()) {
+      XELOGE("Invalid compressed disc image chunk offsets");
+      return false;
+    }
+  }
+
+  cache_max_chunks_ = std::max(
+      size_t(std::max(cvars::disc_compressed_cache_size_mb, int32_t(0))) *
+          1_MiB / chunk_size_,
+      // Enough for the chunks of a read and the read-ahead after it.
+      size_t(kReadAheadChunks + 2));
+
+  uint32_t worker_count;
+  if (cvars::disc_compressed_worker_threads < 0) {
+    // Leaving a processor for the reading thread, which also decompresses.
+    worker_count = std::min(
+        std::max(xe::threading::logical_processor_count(), uint32_t(2)) - 1,
+        uint32_t(4));
+  } else {
+    worker_count = uint32_t(cvars::disc_compressed_worker_threads);
+  }
+  for (uint32_t i = 0; i < worker_count; ++i) {
+    auto worker_thread =
+        xe::threading::Thread::Create({}, [this]() { WorkerThread(); });
+    if (!worker_thread) {
+      XELOGW("Failed to create a compressed disc image decompression thread");
+      break;
+    }
+    worker_thread->set_name(fmt::format("Disc Image Decompression {}", i));
+    worker_threads_.push_back(std::move(worker_thread));
+  }
+
+  Error result = ReadAllEntries();
+  if (result != Error::kSuccess) {
+    XELOGE("Failed to read all GDFX entries: {}", result);
+    return false;
+  }
+
+  return true;
+}
+
+void DiscCompressedDevice::Dump(StringBuffer* string_buffer) {
+  auto global_lock = global_critical_region_.Acquire();
+  root_entry_->Dump(string_buffer, 0);
+}
+
+Entry* DiscCompressedDevice::ResolvePath(const std::string_view path) {
+  // The filesystem will have stripped our prefix off already, so the path will
+  // be in the form:
+  // some\PATH.foo
+  XELOGFS("DiscCompressedDevice::ResolvePath({})", path);
+  return root_entry_->ResolvePath(path);
+}
+
+DiscCompressedDevice::Error DiscCompressedDevice::ReadAllEntries() {
+  // Find sector 32 of the game partition - try at a few points, like
+  // DiscImageDevice.
+  static const uint64_t likely_offsets[] = {
+      0x00000000, 0x0000FB20, 0x00020600, 0x02080000, 0x0FD90000,
+  };
+  uint8_t fs_header[28];
+  bool magic_found = false;
+  for (size_t n = 0; n < xe::countof(likely_offsets); n++) {
+    game_offset_ = likely_offsets[n];
+    if (ReadData(game_offset_ + 32 * kXESectorSize, sizeof(fs_header),
+                 fs_header, false) == sizeof(fs_header) &&
+        !std::memcmp(fs_header, "MICROSOFT*XBOX*MEDIA", 20)) {
+      magic_found = true;
+      break;
+    }
+  }
+  if (!magic_found) {
+    // File doesn't have the magic values - likely not a real GDFX source.
+    return Error::kErrorFileMismatch;
+  }
+  uint32_t root_sector = xe::load<uint32_t>(fs_header + 20);
+  uint32_t root_size = xe::load<uint32_t>(fs_header + 24);
+  if (root_size < 13 || root_size > 32_MiB) {
+    return Error::kErrorDamagedFile;
+  }
+  std::vector<uint8_t> root_buffer(root_size);
+  if (ReadData(game_offset_ + root_sector * kXESectorSize, root_size,
+               root_buffer.data(), false) != root_size) {
+    return Error::kErrorReadError;
+  }
+
+  auto root_entry = new DiscCompressedEntry(this, nullptr, "");
+  root_entry->attributes_ = kFileAttributeDirectory;
+  root_entry_ = std::unique_ptr<Entry>(root_entry);
+
+  if (!ReadEntry(root_buffer, 0, root_entry, 0)) {
+    return Error::kErrorDamagedFile;
+  }
+
+  return Error::kSuccess;
+}
+
+bool DiscCompressedDevice::ReadEntry(const std::vector<uint8_t>& buffer,
+                                     uint16_t entry_ordinal,
+                                     DiscCompressedEntry* parent,
+                                     uint32_t depth) {
+  size_t entry_offset = size_t(entry_ordinal) * 4;
+  if (entry_offset + 14 > buffer.size()) {
+    return false;
+  }
+  const uint8_t* p = buffer.data() + entry_offset;
+
+  uint16_t node_l = xe::load<uint16_t>(p + 0);
+  uint16_t node_r = xe::load<uint16_t>(p + 2);
+  uint64_t sector = xe::load<uint32_t>(p + 4);
+  uint32_t length = xe::load<uint32_t>(p + 8);
+  uint8_t attributes = xe::load<uint8_t>(p + 12);
+  uint8_t name_length = xe::load<uint8_t>(p + 13);
+  if (entry_offset + 14 + name_length > buffer.size()) {
+    return false;
+  }
+  auto name_buffer = reinterpret_cast<const char*>(p + 14);
+
+  if (node_l && !ReadEntry(buffer, node_l, parent, depth)) {
+    return false;
+  }
+
+  auto name = std::string(name_buffer, name_length);
+
+  auto entry = DiscCompressedEntry::Create(this, parent, name);
+  entry->attributes_ = attributes | kFileAttributeReadOnly;
+  entry->size_ = length;
+  entry->allocation_size_ = xe::round_up(length, bytes_per_sector());
+
+  // Set to January 1, 1970 (UTC) in 100-nanosecond intervals
+  entry->create_timestamp_ = 10000 * 11644473600000LL;
+  entry->access_timestamp_ = 10000 * 11644473600000LL;
+  entry->write_timestamp_ = 10000 * 11644473600000LL;
+
+  if (attributes & kFileAttributeDirectory) {
+    // Folder.
+    entry->data_offset_ = 0;
+    entry->data_size_ = 0;
+    if (length) {
+      // Not a leaf - read in children.
+      if (depth >= kMaxDirectoryDepth) {
+        return false;
+      }
+      std::vector<uint8_t> folder_buffer(length);
+      if (ReadData(game_offset_ + sector * kXESectorSize, length,
+                   folder_buffer.data(), false) != length) {
+        // Out of bounds read.
+        return false;
+      }
+      if (!ReadEntry(folder_buffer, 0, entry.get(), depth + 1)) {
+        return false;
+      }
+    }
+  } else {
+    // File.
+    entry->data_offset_ = size_t(game_offset_ + sector * kXESectorSize);
+    entry->data_size_ = length;
+  }
+
+  // Add to parent.
+  parent->children_.emplace_back(std::move(entry));
+
+  // Read next file in the list.
+  if (node_r && !ReadEntry(buffer, node_r, parent, depth)) {
+    return false;
+  }
+
+  return true;
+}
+
+uint64_t DiscCompressedDevice::ReadData(uint64_t offset, uint64_t length,
+                                        void* buffer, bool is_sequential) {
+  if (offset >= uncompressed_size_) {
+    return 0;
+  }
+  length = std::min(length, uncompressed_size_ - offset);
+  if (!length) {
+    return 0;
+  }
+  uint64_t first_chunk = offset / chunk_size_;
+  uint64_t last_chunk = (offset + length - 1) / chunk_size_;
+
+  std::unique_lock<std::mutex> lock(chunks_mutex_);
+  // Requesting all the chunks at once so the workers decompress them in
+  // parallel while this thread is waiting for the first one.
+  for (uint64_t i = first_chunk; i <= last_chunk; ++i) {
+    RequestChunk(i, false);
+  }
+  if (is_sequential) {
+    for (uint64_t i = last_chunk + 1;
+         i < std::min(last_chunk + 1 + kReadAheadChunks, chunk_count_); ++i) {
+      RequestChunk(i, false);
+    }
+  }
+  chunk_requested_cond_.notify_all();
+
+  uint64_t bytes_read = 0;
+  for (uint64_t i = first_chunk; i <= last_chunk; ++i) {
+    std::shared_ptr<const std::vector<uint8_t>> chunk;
+    while (true) {
+      auto it = cached_chunks_.find(i);
+      if (it != cached_chunks_.end()) {
+        chunk = it->second.data;
+        chunk_lru_.splice(chunk_lru_.begin(), chunk_lru_,
+                          it->second.lru_iterator);
+        break;
+      }
+      // May have been evicted by other reads since it was requested.
+      RequestChunk(i, true);
+      if (!decompression_queue_.empty()) {
+        // Help the workers rather than waiting idly.
+        uint64_t request = decompression_queue_.front();
+        decompression_queue_.pop_front();
+        lock.unlock();
+        auto data = DecompressChunk(request);
+        lock.lock();
+        AddCachedChunk(request, std::move(data));
+        continue;
+      }
+      chunk_added_cond_.wait(lock);
+    }
+    if (!chunk) {
+      break;
+    }
+    lock.unlock();
+    uint64_t chunk_offset = std::max(offset, i * chunk_size_) - i * chunk_size_;
+    uint64_t copy_length = std::min(uint64_t(chunk->size()) - chunk_offset,
+                                    length - bytes_read);
+    std::memcpy(static_cast<uint8_t*>(buffer) + bytes_read,
+                chunk->data() + chunk_offset, size_t(copy_length));
+    bytes_read += copy_length;
+    lock.lock();
+  }
+  return bytes_read;
+}
+
+std::shared_ptr<const std::vector<uint8_t>>
+DiscCompressedDevice::DecompressChunk(uint64_t chunk_index) const {
+  const uint8_t* compressed = mmap_->data() + chunk_offsets_[chunk_index];
+  size_t compressed_size =
+      size_t(chunk_offsets_[chunk_index + 1] - chunk_offsets_[chunk_index]);
+  size_t chunk_length = size_t(std::min(
+      uint64_t(chunk_size_), uncompressed_size_ - chunk_index * chunk_size_));
+  auto data = std::make_shared<std::vector<uint8_t>>(chunk_length);
+  if (compressed_size == chunk_length) {
+    std::memcpy(data->data(), compressed, chunk_length);
+    return data;
+  }
+  size_t decompressed_size = ZSTD_decompress(data->data(), chunk_length,
+                                             compressed, compressed_size);
+  if (ZSTD_isError(decompressed_size) || decompressed_size != chunk_length) {
+    XELOGE("Failed to decompress chunk {} of the compressed disc image",
+           chunk_index);
+    return nullptr;
+  }
+  return data;
+}
+
+void DiscCompressedDevice::RequestChunk(uint64_t chunk_index, bool is_urgent) {
+  if (cached_chunks_.find(chunk_index) != cached_chunks_.end() ||
+      !pending_chunks_.insert(chunk_index).second) {
+    return;
+  }
+  if (is_urgent) {
+    decompression_queue_.push_front(chunk_index);
+  } else {
+    decompression_queue_.push_back(chunk_index);
+  }
+}
+
+void DiscCompressedDevice::AddCachedChunk(
+    uint64_t chunk_index, std::shared_ptr<const std::vector<uint8_t>> data) {
+  pending_chunks_.erase(chunk_index);
+  chunk_lru_.push_front(chunk_index);
+  cached_chunks_[chunk_index] =
+      CachedChunk{std::move(data), chunk_lru_.begin()};
+  while (cached_chunks_.size() > cache_max_chunks_) {
+    cached_chunks_.erase(chunk_lru_.back());
+    chunk_lru_.pop_back();
+  }
+  chunk_added_cond_.notify_all();
+}
+
+void DiscCompressedDevice::WorkerThread() {
+  std::unique_lock<std::mutex> lock(chunks_mutex_);
+  while (true) {
+    chunk_requested_cond_.wait(lock, [this]() {
+      return workers_shutdown_ || !decompression_queue_.empty();
+    });
+    if (workers_shutdown_) {
+      break;
+    }
+    uint64_t chunk_index = decompression_queue_.front();
+    decompression_queue_.pop_front();
+    lock.unlock();
+    auto data = DecompressChunk(chunk_index);
+    lock.lock();
+    AddCachedChunk(chunk_index, std::move(data));
+  }
+}
+
+}  // namespace vfs
+}  // namespace xe
@@ -0,0 +1,146 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_VFS_DEVICES_DISC_COMPRESSED_DEVICE_H_
+#define XENIA_VFS_DEVICES_DISC_COMPRESSED_DEVICE_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "xenia/base/assert.h"
+#include "xenia/base/mapped_memory.h"
+#include "xenia/base/threading.h"
+#include "xenia/vfs/device.h"
+
+namespace xe {
+namespace vfs {
+
+class DiscCompressedEntry;
+
+// GDFX disc image split into fixed-size chunks compressed independently with
+// zstd (.xcz), created by xenia-vfs-dump. The chunks are decompressed on
+// demand by a pool of worker threads into a shared cache, so reads spanning
+// multiple chunks are decompressed in parallel.
+class DiscCompressedDevice : public Device {
+ public:
+  // Followed by chunk_count + 1 uint64_t offsets of the chunks in the file,
+  // the last being the end of the last chunk. A chunk with the compressed size
+  // equal to its uncompressed size is stored without compression.
+  struct Header {
+    static constexpr uint32_t kMagic = 0x315A4358;  // 'XCZ1'
+    static constexpr uint32_t kVersion = 1;
+    uint32_t magic;
+    uint32_t version;
+    uint32_t chunk_size;
+    uint32_t reserved;
+    uint64_t uncompressed_size;
+    uint64_t chunk_count;
+  };
+  static_assert_size(Header, 32);
+
+  DiscCompressedDevice(const std::string_view mount_path,
+                       const std::filesystem::path& host_path);
+  ~DiscCompressedDevice() override;
+
+  // Compresses a GDFX disc image into the chunked format.
+  static bool CreateImage(const std::filesystem::path& source_path,
+                          const std::filesystem::path& target_path,
+                          uint32_t chunk_size, int compression_level);
+
+  bool Initialize() override;
+  void Dump(StringBuffer* string_buffer) override;
+  Entry* ResolvePath(const std::string_view path) override;
+
+  const std::string& name() const override { return name_; }
+  uint32_t attributes() const override { return 0; }
+  uint32_t component_name_max_length() const override { return 255; }
+
+  uint32_t total_allocation_units() const override {
+    return uint32_t(uncompressed_size_ / sectors_per_allocation_unit() /
+                    bytes_per_sector());
+  }
+  uint32_t available_allocation_units() const override { return 0; }
+  uint32_t sectors_per_allocation_unit() const override { return 1; }
+  uint32_t bytes_per_sector() const override { return 0x200; }
+
+  // Reads the uncompressed image data, returning the number of bytes read. If
+  // the read continues the previous one, the following chunks are
+  // decompressed in the background. Thread-safe.
+  uint64_t ReadData(uint64_t offset, uint64_t length, void* buffer,
+                    bool is_sequential);
+
+ private:
+  enum class Error {
+    kSuccess = 0,
+    kErrorOutOfMemory = -1,
+    kErrorReadError = -10,
+    kErrorFileMismatch = -30,
+    kErrorDamagedFile = -31,
+  };
+
+  struct CachedChunk {
+    // nullptr if failed to decompress.
+    std::shared_ptr<const std::vector<uint8_t>> data;
+    std::list<uint64_t>::iterator lru_iterator;
+  };
+
+  Error ReadAllEntries();
+  bool ReadEntry(const std::vector<uint8_t>& buffer, uint16_t entry_ordinal,
+                 DiscCompressedEntry* parent, uint32_t depth);
+
+  std::shared_ptr<const std::vector<uint8_t>> DecompressChunk(
+      uint64_t chunk_index) const;
+  // Must be called with chunks_mutex_ locked.
+  void RequestChunk(uint64_t chunk_index, bool is_urgent);
+  // Must be called with chunks_mutex_ locked.
+  void AddCachedChunk(uint64_t chunk_index,
+                      std::shared_ptr<const std::vector<uint8_t>> data);
+  void WorkerThread();
+
+  std::string name_;
+  std::filesystem::path host_path_;
+  std::unique_ptr<Entry> root_entry_;
+  std::unique_ptr<MappedMemory> mmap_;
+  uint32_t chunk_size_ = 0;
+  uint64_t uncompressed_size_ = 0;
+  uint64_t chunk_count_ = 0;
+  const uint64_t* chunk_offsets_ = nullptr;
+  // Offset of the game partition in the uncompressed image.
+  uint64_t game_offset_ = 0;
+
+  size_t cache_max_chunks_ = 0;
+  std::mutex chunks_mutex_;
+  // Notified when a chunk is added to the cache.
+  std::condition_variable chunk_added_cond_;
+  // Notified when a decompression request is added or shutdown is requested.
+  std::condition_variable chunk_requested_cond_;
+  // Protected with chunks_mutex_.
+  std::unordered_map<uint64_t, CachedChunk> cached_chunks_;
+  // Most recently used first.
+  std::list<uint64_t> chunk_lru_;
+  // The chunks queued for decompression or being decompressed.
+  std::unordered_set<uint64_t> pending_chunks_;
+  std::deque<uint64_t> decompression_queue_;
+  bool workers_shutdown_ = false;
+
+  std::vector<std::unique_ptr<xe::threading::Thread>> worker_threads_;
+};
+
+}  // namespace vfs
+}  // namespace xe
+
+#endif  // XENIA_VFS_DEVICES_DISC_COMPRESSED_DEVICE_H_
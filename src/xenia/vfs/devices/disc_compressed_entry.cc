@@ -0,0 +1,36 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/devices/disc_compressed_entry.h"
+
+#include "xenia/base/string.h"
+#include "xenia/vfs/devices/disc_compressed_file.h"
+
+namespace xe {
+namespace vfs {
+
+DiscCompressedEntry::DiscCompressedEntry(Device* device, Entry* parent,
+                                         const std::string_view path)
+    : Entry(device, parent, path), data_offset_(0), data_size_(0) {}
+
+DiscCompressedEntry::~DiscCompressedEntry() = default;
+
+std::unique_ptr<DiscCompressedEntry> DiscCompressedEntry::Create(
+    Device* device, Entry* parent, const std::string_view name) {
+  auto path = xe::utf8::join_guest_paths(parent->path(), name);
+  return std::make_unique<DiscCompressedEntry>(device, parent, path);
+}
+
+X_STATUS DiscCompressedEntry::Open(uint32_t desired_access, File** out_file) {
+  *out_file = new DiscCompressedFile(desired_access, this);
+  return X_STATUS_SUCCESS;
+}
+
+}  // namespace vfs
+}  // namespace xe
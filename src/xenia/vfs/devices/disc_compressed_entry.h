@@ -0,0 +1,50 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_VFS_DEVICES_DISC_COMPRESSED_ENTRY_H_
+#define XENIA_VFS_DEVICES_DISC_COMPRESSED_ENTRY_H_
+
+#include <memory>
+#include <string>
+
+#include "xenia/vfs/entry.h"
+
+namespace xe {
+namespace vfs {
+
+class DiscCompressedDevice;
+
+class DiscCompressedEntry : public Entry {
+ public:
+  DiscCompressedEntry(Device* device, Entry* parent,
+                      const std::string_view path);
+  ~DiscCompressedEntry() override;
+
+  static std::unique_ptr<DiscCompressedEntry> Create(
+      Device* device, Entry* parent, const std::string_view name);
+
+  size_t data_offset() const { return data_offset_; }
+  size_t data_size() const { return data_size_; }
+
+  X_STATUS Open(uint32_t desired_access, File** out_file) override;
+
+  // The data is compressed, can't be mapped as is.
+  bool can_map() const override { return false; }
+
+ private:
+  friend class DiscCompressedDevice;
+
+  size_t data_offset_;
+  size_t data_size_;
+};
+
+}  // namespace vfs
+}  // namespace xe
+
+#endif  // XENIA_VFS_DEVICES_DISC_COMPRESSED_ENTRY_H_
@@ -0,0 +1,47 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2022 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include "xenia/vfs/devices/disc_compressed_file.h"
+
+#include <algorithm>
+
+#include "xenia/vfs/devices/disc_compressed_device.h"
+#include "xenia/vfs/devices/disc_compressed_entry.h"
+
+namespace xe {
+namespace vfs {
+
+DiscCompressedFile::DiscCompressedFile(uint32_t file_access,
+                                       DiscCompressedEntry* entry)
+    : File(file_access, entry), entry_(entry) {}
+
+DiscCompressedFile::~DiscCompressedFile() = default;
+
+void DiscCompressedFile::Destroy() { delete this; }
+
+X_STATUS DiscCompressedFile::ReadSync(void* buffer, size_t buffer_length,
+                                      size_t byte_offset,
+                                      size_t* out_bytes_read) {
+  if (byte_offset >= entry_->size()) {
+    return X_STATUS_END_OF_FILE;
+  }
+  bool is_sequential = byte_offset == next_sequential_offset_;
+  size_t real_length =
+      std::min(buffer_length, entry_->data_size() - byte_offset);
+  size_t bytes_read = size_t(
+      static_cast<DiscCompressedDevice*>(entry_->device())
+          ->ReadData(entry_->data_offset() + byte_offset, real_length, buffer,
+                     is_sequential));
+  next_sequential_offset_ = byte_offset + bytes_read;
+  *out_bytes_read = bytes_read;
+  return X_STATUS_SUCCESS;
+}
+
+}  // namespace vfs
+}  // namespace xe
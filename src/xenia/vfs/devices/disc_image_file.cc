@@ -11,8 +11,17 @@
 
 #include <algorithm>
 
+#include "xenia/base/cvar.h"
 #include "xenia/base/logging.h"
+#include "xenia/base/memory.h"
 #include "xenia/vfs/devices/disc_image_entry.h"
+
+DEFINE_int32(disc_image_prefetch_size_kb, 2048,
+             "Amount of data after sequential reads from a disc image file to "
+             "ask the system to read from the storage in advance, in "
+             "kilobytes. 0 to disable prefetching.",
+             "Storage");
+
 namespace xe {
 namespace vfs {
 
@@ -39,6 +48,30 @@ X_STATUS DiscImageFile::ReadSync(void* buffer, size_t buffer_length,
       std::min(buffer_length, entry_->data_size() - byte_offset);
   std::memcpy(buffer, entry_->mmap()->data() + real_offset, real_length);
   *out_bytes_read = real_length;
+
+  // For sequential reads, prefetch the following data, once half of the
+  // previously prefetched data has been read.
+  size_t read_end = byte_offset + real_length;
+  if (byte_offset != next_sequential_offset_) {
+    prefetched_end_ = 0;
+  } else if (cvars::disc_image_prefetch_size_kb > 0) {
+    size_t prefetch_size = size_t(cvars::disc_image_prefetch_size_kb) * 1024;
+    if (read_end + prefetch_size / 2 >= prefetched_end_) {
+      size_t prefetch_start = std::max(read_end, prefetched_end_);
+      size_t prefetch_end = std::min(read_end + prefetch_size,
+                                     std::min(entry_->data_size(),
+                                              entry_->mmap()->size() -
+                                                  entry_->data_offset()));
+      if (prefetch_start < prefetch_end) {
+        xe::memory::PrefetchFileView(
+            entry_->mmap()->data() + entry_->data_offset() + prefetch_start,
+            prefetch_end - prefetch_start);
+        prefetched_end_ = prefetch_end;
+      }
+    }
+  }
+  next_sequential_offset_ = read_end;
+
   return X_STATUS_SUCCESS;
 }
 
@@ -34,6 +34,9 @@ class DiscImageFile : public File {
 
  private:
   DiscImageEntry* entry_;
+  // For detecting sequential reads to prefetch the following data.
+  size_t next_sequential_offset_ = 0;
+  size_t prefetched_end_ = 0;
 };
 
 }  // namespace vfs
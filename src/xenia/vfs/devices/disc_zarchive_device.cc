@@ -9,6 +9,10 @@
 
 #include "xenia/vfs/devices/disc_zarchive_device.h"
 
+#include <algorithm>
+#include <cstring>
+
+#include "xenia/base/cvar.h"
 #include "xenia/base/literals.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
@@ -16,6 +20,11 @@
 
 #include "third_party/zarchive/include/zarchive/zarchivereader.h"
 
+DEFINE_int32(zarchive_cache_size_mb, 32,
+             "Size of the cache of decompressed data of a mounted ZArchive "
+             "disc image in megabytes. 0 to disable caching and read-ahead.",
+             "Storage");
+
 namespace xe {
 namespace vfs {
 
@@ -23,7 +32,17 @@ DiscZarchiveDevice::DiscZarchiveDevice(const std::string_view mount_path,
                                        const std::filesystem::path& host_path)
     : Device(mount_path), name_("GDFX"), host_path_(host_path), reader_() {}
 
-DiscZarchiveDevice::~DiscZarchiveDevice(){};
+DiscZarchiveDevice::~DiscZarchiveDevice() {
+  if (read_ahead_thread_) {
+    {
+      std::lock_guard<std::mutex> lock(read_ahead_mutex_);
+      read_ahead_shutdown_ = true;
+    }
+    read_ahead_request_cond_.notify_one();
+    xe::threading::Wait(read_ahead_thread_.get(), false);
+    read_ahead_thread_.reset();
+  }
+}
 
 bool DiscZarchiveDevice::Initialize() {
   reader_ =
@@ -43,7 +62,132 @@ bool DiscZarchiveDevice::Initialize() {
   root_entry->absolute_path_ = root_path;
   root_entry_ = std::unique_ptr<Entry>(root_entry);
 
-  return ReadAllEntries("", root_entry, nullptr);
+  if (!ReadAllEntries("", root_entry, nullptr)) {
+    return false;
+  }
+
+  cache_max_blocks_ =
+      size_t(std::max(cvars::zarchive_cache_size_mb, int32_t(0))) *
+      (1024 * 1024 / kCacheBlockSize);
+  if (cache_max_blocks_) {
+    read_ahead_thread_ =
+        xe::threading::Thread::Create({}, [this]() { ReadAheadThread(); });
+    if (read_ahead_thread_) {
+      read_ahead_thread_->set_name("ZArchive Read-Ahead");
+    } else {
+      XELOGW("Failed to create the ZArchive read-ahead thread");
+    }
+  }
+
+  return true;
+}
+
+uint64_t DiscZarchiveDevice::ReadFile(uint32_t handle, uint64_t file_size,
+                                      uint64_t offset, uint64_t length,
+                                      void* buffer, bool is_sequential) {
+  if (offset >= file_size) {
+    return 0;
+  }
+  length = std::min(length, file_size - offset);
+  if (!cache_max_blocks_) {
+    std::lock_guard<std::mutex> lock(reader_mutex_);
+    return reader_->ReadFromFile(handle, offset, length, buffer);
+  }
+
+  uint8_t* buffer_bytes = static_cast<uint8_t*>(buffer);
+  uint64_t end = offset + length;
+  uint64_t position = offset;
+  while (position < end) {
+    uint64_t block_index = position / kCacheBlockSize;
+    std::shared_ptr<const std::vector<uint8_t>> block =
+        GetCacheBlock(handle, file_size, block_index);
+    if (!block) {
+      break;
+    }
+    uint64_t block_offset = position - block_index * kCacheBlockSize;
+    uint64_t copy_length =
+        std::min(end - position, uint64_t(block->size()) - block_offset);
+    std::memcpy(buffer_bytes + (position - offset),
+                block->data() + block_offset, copy_length);
+    position += copy_length;
+  }
+
+  if (is_sequential && read_ahead_thread_) {
+    uint64_t next_block_index = (end + kCacheBlockSize - 1) / kCacheBlockSize;
+    if (next_block_index * kCacheBlockSize < file_size) {
+      {
+        std::lock_guard<std::mutex> lock(read_ahead_mutex_);
+        if (read_ahead_queue_.size() >= kReadAheadQueueMaxSize) {
+          read_ahead_queue_.pop_front();
+        }
+        read_ahead_queue_.push_back({handle, file_size, next_block_index});
+      }
+      read_ahead_request_cond_.notify_one();
+    }
+  }
+
+  return position - offset;
+}
+
+std::shared_ptr<const std::vector<uint8_t>> DiscZarchiveDevice::GetCacheBlock(
+    uint32_t handle, uint64_t file_size, uint64_t block_index) {
+  uint64_t key = GetCacheBlockKey(handle, block_index);
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    auto it = cache_blocks_.find(key);
+    if (it != cache_blocks_.end()) {
+      cache_lru_.splice(cache_lru_.begin(), cache_lru_,
+                        it->second.lru_iterator);
+      return it->second.data;
+    }
+  }
+
+  // Decompressing without holding the cache lock.
+  uint64_t block_start = block_index * kCacheBlockSize;
+  uint64_t block_size = std::min(kCacheBlockSize, file_size - block_start);
+  auto data = std::make_shared<std::vector<uint8_t>>(size_t(block_size));
+  {
+    std::lock_guard<std::mutex> lock(reader_mutex_);
+    if (reader_->ReadFromFile(handle, block_start, block_size, data->data()) !=
+        block_size) {
+      return nullptr;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(cache_mutex_);
+  auto it = cache_blocks_.find(key);
+  if (it != cache_blocks_.end()) {
+    // Loaded by another thread in the meantime.
+    cache_lru_.splice(cache_lru_.begin(), cache_lru_, it->second.lru_iterator);
+    return it->second.data;
+  }
+  while (cache_blocks_.size() >= cache_max_blocks_) {
+    cache_blocks_.erase(cache_lru_.back());
+    cache_lru_.pop_back();
+  }
+  cache_lru_.push_front(key);
+  CacheBlock& block = cache_blocks_[key];
+  block.data = std::move(data);
+  block.lru_iterator = cache_lru_.begin();
+  return block.data;
+}
+
+void DiscZarchiveDevice::ReadAheadThread() {
+  while (true) {
+    ReadAheadRequest request;
+    {
+      std::unique_lock<std::mutex> lock(read_ahead_mutex_);
+      while (read_ahead_queue_.empty()) {
+        if (read_ahead_shutdown_) {
+          return;
+        }
+        read_ahead_request_cond_.wait(lock);
+      }
+      request = read_ahead_queue_.front();
+      read_ahead_queue_.pop_front();
+    }
+    GetCacheBlock(request.handle, request.file_size, request.block_index);
+  }
 }
 
 void DiscZarchiveDevice::Dump(StringBuffer* string_buffer) {
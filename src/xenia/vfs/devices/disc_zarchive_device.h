@@ -10,10 +10,19 @@
 #ifndef XENIA_VFS_DEVICES_DISC_ZARCHIVE_DEVICE_H_
 #define XENIA_VFS_DEVICES_DISC_ZARCHIVE_DEVICE_H_
 
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "xenia/base/mapped_memory.h"
+#include "xenia/base/threading.h"
 #include "xenia/vfs/device.h"
 
 #include "third_party/zarchive/include/zarchive/zarchivereader.h"
@@ -44,14 +53,61 @@ class DiscZarchiveDevice : public Device {
 
   ZArchiveReader* reader() const { return reader_.get(); }
 
+  // Reads the uncompressed data of a file through the block cache, returning
+  // the number of bytes read. If the read continues the previous one,
+  // requests the next block to be loaded in the background. Thread-safe.
+  uint64_t ReadFile(uint32_t handle, uint64_t file_size, uint64_t offset,
+                    uint64_t length, void* buffer, bool is_sequential);
+
  private:
+  // Same as the size of the compressed blocks in ZArchive.
+  static constexpr uint64_t kCacheBlockSize = 64 * 1024;
+  // Maximum read-ahead requests not processed yet, older ones are dropped.
+  static constexpr size_t kReadAheadQueueMaxSize = 4;
+
+  struct CacheBlock {
+    std::shared_ptr<const std::vector<uint8_t>> data;
+    std::list<uint64_t>::iterator lru_iterator;
+  };
+  struct ReadAheadRequest {
+    uint32_t handle;
+    uint64_t file_size;
+    uint64_t block_index;
+  };
+
   bool ReadAllEntries(const std::string& path, DiscZarchiveEntry* node,
                       DiscZarchiveEntry* parent);
 
+  static uint64_t GetCacheBlockKey(uint32_t handle, uint64_t block_index) {
+    return (uint64_t(handle) << 32) | block_index;
+  }
+  // Returns nullptr if failed to read the block.
+  std::shared_ptr<const std::vector<uint8_t>> GetCacheBlock(
+      uint32_t handle, uint64_t file_size, uint64_t block_index);
+  void ReadAheadThread();
+
   std::string name_;
   std::filesystem::path host_path_;
   std::unique_ptr<Entry> root_entry_;
   std::unique_ptr<ZArchiveReader> reader_;
+  // Serializes the reads from the archive between the guest threads and the
+  // read-ahead thread.
+  std::mutex reader_mutex_;
+
+  size_t cache_max_blocks_ = 0;
+  std::mutex cache_mutex_;
+  // Protected with cache_mutex_.
+  std::unordered_map<uint64_t, CacheBlock> cache_blocks_;
+  // Most recently used first.
+  std::list<uint64_t> cache_lru_;
+
+  std::unique_ptr<xe::threading::Thread> read_ahead_thread_;
+  std::mutex read_ahead_mutex_;
+  // Notified when a request is added or shutdown is requested.
+  std::condition_variable read_ahead_request_cond_;
+  // Protected with read_ahead_mutex_.
+  std::deque<ReadAheadRequest> read_ahead_queue_;
+  bool read_ahead_shutdown_ = false;
 };
 
 }  // namespace vfs
@@ -34,6 +34,8 @@ class DiscZarchiveFile : public File {
 
  private:
   DiscZarchiveEntry* entry_;
+  // For detecting sequential reads to load the following data in advance.
+  size_t next_sequential_offset_ = 0;
 };
 
 }  // namespace vfs
@@ -9,6 +9,7 @@
 
 #include "xenia/vfs/devices/host_path_entry.h"
 
+#include "xenia/base/clock.h"
 #include "xenia/base/filesystem.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/mapped_memory.h"
@@ -40,6 +41,7 @@ HostPathEntry* HostPathEntry::Create(Device* device, Entry* parent,
   if (file_info.type == xe::filesystem::FileInfo::Type::kDirectory) {
     entry->attributes_ = kFileAttributeDirectory;
   } else {
+    entry->children_populated_ = true;
     entry->attributes_ = kFileAttributeNormal;
     if (device->is_read_only()) {
       entry->attributes_ |= kFileAttributeReadOnly;
@@ -91,8 +93,11 @@ std::unique_ptr<Entry> HostPathEntry::CreateEntryInternal(
   if (!xe::filesystem::GetInfo(full_path, &file_info)) {
     return nullptr;
   }
-  return std::unique_ptr<Entry>(
+  auto entry = std::unique_ptr<HostPathEntry>(
       HostPathEntry::Create(device_, this, full_path, file_info));
+  // Just created, nothing to enumerate.
+  entry->children_populated_ = true;
+  return entry;
 }
 
 bool HostPathEntry::DeleteEntryInternal(Entry* entry) {
@@ -110,6 +115,32 @@ bool HostPathEntry::DeleteEntryInternal(Entry* entry) {
   }
 }
 
+void HostPathEntry::EnsureChildrenPopulated() {
+  if (children_populated_) {
+    return;
+  }
+  children_populated_ = true;
+  auto child_infos = xe::filesystem::ListFiles(host_path_);
+  children_.reserve(children_.size() + child_infos.size());
+  for (auto& child_info : child_infos) {
+    children_.emplace_back(HostPathEntry::Create(
+        device_, this, host_path_ / child_info.name, child_info));
+  }
+}
+
+bool HostPathEntry::IsPresentOnHost() {
+  // Long enough to skip the checks for bursts of opens of the same file, short
+  // enough to notice files deleted on the host while the game is running.
+  constexpr uint64_t kCheckIntervalMs = 1000;
+  uint64_t time_ms = Clock::QueryHostUptimeMillis();
+  if (!present_on_host_check_time_ms_ ||
+      time_ms - present_on_host_check_time_ms_ >= kCheckIntervalMs) {
+    present_on_host_ = std::filesystem::exists(host_path_);
+    present_on_host_check_time_ms_ = time_ms;
+  }
+  return present_on_host_;
+}
+
 void HostPathEntry::update() {
   xe::filesystem::FileInfo file_info;
   if (!xe::filesystem::GetInfo(host_path_, &file_info)) {
@@ -40,14 +40,25 @@ class HostPathEntry : public Entry {
                                            size_t length) override;
   void update() override;
 
+  // Whether the file still exists on the host, with the result of the check
+  // reused for a short time so repeated opens don't all stat the file.
+  bool IsPresentOnHost();
+
  private:
   friend class HostPathDevice;
 
   std::unique_ptr<Entry> CreateEntryInternal(const std::string_view name,
                                              uint32_t attributes) override;
   bool DeleteEntryInternal(Entry* entry) override;
+  // Directories are enumerated on the first access to their children rather
+  // than when the device is mounted, as extracted games may contain tens of
+  // thousands of files.
+  void EnsureChildrenPopulated() override;
 
   std::filesystem::path host_path_;
+  bool children_populated_ = false;
+  bool present_on_host_ = true;
+  uint64_t present_on_host_check_time_ms_ = 0;
 };
 
 }  // namespace vfs
@@ -12,8 +12,11 @@
 
 #include <filesystem>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string_view>
 
+#include "xenia/base/mapped_memory.h"
 #include "xenia/base/math.h"
 #include "xenia/kernel/util/xex2_info.h"
 #include "xenia/vfs/device.h"
@@ -58,6 +61,16 @@ class XContentContainerDevice : public Device {
 
   kernel::xam::XCONTENT_AGGREGATE_DATA content_header() const;
 
+  // Read-only mapping of the host file, or nullptr if it couldn't be mapped,
+  // in which case the data must be read through the handle in files_.
+  const MappedMemory* mapped_file(size_t file_index) const {
+    auto it = mapped_files_.find(file_index);
+    return it != mapped_files_.end() ? it->second.get() : nullptr;
+  }
+  // Serializes seeking and reading through the handles in files_, which may
+  // be done by multiple threads.
+  std::mutex& files_mutex() { return files_mutex_; }
+
  protected:
   XContentContainerDevice(const std::string_view mount_path,
                           const std::filesystem::path& host_path);
@@ -77,6 +90,9 @@ class XContentContainerDevice : public Device {
   virtual void SetupContainer() { };
 
   Entry* ResolvePath(const std::string_view path);
+  // Maps the host file so reads of the data in it don't need seeking and
+  // buffered reading. Failure to map is not an error.
+  void MapHostFile(size_t file_index, const std::filesystem::path& path);
   void CloseFiles();
   void Dump(StringBuffer* string_buffer);
   Result ReadHeaderAndVerify(FILE* header_file);
@@ -95,6 +111,8 @@ class XContentContainerDevice : public Device {
   std::filesystem::path host_path_;
 
   std::map<size_t, FILE*> files_;
+  std::map<size_t, std::unique_ptr<MappedMemory>> mapped_files_;
+  std::mutex files_mutex_;
   size_t files_total_size_;
   std::unique_ptr<Entry> root_entry_;
   std::unique_ptr<XContentContainerHeader> header_;
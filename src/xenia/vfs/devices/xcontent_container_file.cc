@@ -9,8 +9,10 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 
 #include "xenia/base/math.h"
+#include "xenia/vfs/devices/xcontent_container_device.h"
 #include "xenia/vfs/devices/xcontent_container_entry.h"
 #include "xenia/vfs/devices/xcontent_container_file.h"
 
@@ -37,6 +39,8 @@ X_STATUS XContentContainerFile::ReadSync(void* buffer, size_t buffer_length,
   size_t remaining_length =
       std::min(buffer_length, entry_->size() - byte_offset);
 
+  auto device = static_cast<XContentContainerDevice*>(entry_->device());
+
   *out_bytes_read = 0;
   for (size_t i = 0; i < entry_->block_list().size(); i++) {
     auto& record = entry_->block_list()[i];
@@ -51,9 +55,18 @@ X_STATUS XContentContainerFile::ReadSync(void* buffer, size_t buffer_length,
     size_t read_length =
         std::min(record.length - read_offset, remaining_length);
 
-    auto& file = entry_->files()->at(record.file);
-    xe::filesystem::Seek(file, record.offset + read_offset, SEEK_SET);
-    auto num_read = fread(p, 1, read_length, file);
+    size_t num_read;
+    const MappedMemory* mapping = device->mapped_file(record.file);
+    size_t host_offset = record.offset + read_offset;
+    if (mapping && host_offset <= mapping->size()) {
+      num_read = std::min(read_length, mapping->size() - host_offset);
+      std::memcpy(p, mapping->data() + host_offset, num_read);
+    } else {
+      std::lock_guard<std::mutex> lock(device->files_mutex());
+      auto& file = entry_->files()->at(record.file);
+      xe::filesystem::Seek(file, host_offset, SEEK_SET);
+      num_read = fread(p, 1, read_length, file);
+    }
 
     *out_bytes_read += num_read;
     p += num_read;
@@ -47,6 +47,7 @@ XContentContainerDevice::Result StfsContainerDevice::LoadHostFiles(
   }
 
   files_.emplace(std::make_pair(0, header_file));
+  MapHostFile(0, host_path_);
   return Result::kSuccess;
 }
 
@@ -141,11 +142,21 @@ std::unique_ptr<XContentContainerEntry> StfsContainerDevice::ReadEntry(
   if (entry->attributes() & X_FILE_ATTRIBUTE_NORMAL) {
     uint32_t block_index = dir_entry->start_block_number();
     size_t remaining_size = dir_entry->length;
+    size_t block_count = 0;
     while (remaining_size && block_index != kEndOfChain) {
       size_t block_size =
           std::min(static_cast<size_t>(kBlockSize), remaining_size);
       size_t offset = BlockToOffset(block_index);
-      entry->block_list_.push_back({0, offset, block_size});
+      // Merge blocks that are physically consecutive (not separated by a hash
+      // table) so reading a contiguous range is a single copy.
+      if (!entry->block_list_.empty() &&
+          entry->block_list_.back().offset + entry->block_list_.back().length ==
+              offset) {
+        entry->block_list_.back().length += block_size;
+      } else {
+        entry->block_list_.push_back({0, offset, block_size});
+      }
+      ++block_count;
       remaining_size -= block_size;
       auto block_hash = GetBlockHash(block_index);
       block_index = block_hash->level0_next_block();
@@ -163,11 +174,11 @@ std::unique_ptr<XContentContainerEntry> StfsContainerDevice::ReadEntry(
 
     // Check that the number of blocks retrieved from hash entries matches
     // the block count read from the file entry
-    if (entry->block_list_.size() != dir_entry->allocated_data_blocks()) {
+    if (block_count != dir_entry->allocated_data_blocks()) {
       XELOGW(
           "STFS failed to read correct block-chain for entry {}, read {} "
           "blocks, expected {}",
-          entry->name_, entry->block_list_.size(),
+          entry->name_, block_count,
           dir_entry->allocated_data_blocks());
       assert_always();
     }
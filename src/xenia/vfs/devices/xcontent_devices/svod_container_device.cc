@@ -65,6 +65,7 @@ SvodContainerDevice::Result SvodContainerDevice::LoadHostFiles(
     files_total_size_ += xe::filesystem::Tell(file);
     // no need to seek back, any reads from this file will seek first anyway
     files_.emplace(std::make_pair(i, file));
+    MapHostFile(i, path);
   }
   XELOGI("SVOD successfully mapped {} files.", fragment_files.size());
   return Result::kSuccess;
@@ -16,6 +16,8 @@
 namespace xe {
 namespace vfs {
 
+uint64_t Entry::tree_version_ = 0;
+
 Entry::Entry(Device* device, Entry* parent, const std::string_view path)
     : device_(device),
       parent_(parent),
@@ -39,6 +41,8 @@ void Entry::Dump(xe::StringBuffer* string_buffer, int indent) {
   }
   string_buffer->Append(name());
   string_buffer->Append('\n');
+  auto global_lock = global_critical_region_.Acquire();
+  EnsureChildrenPopulated();
   for (auto& child : children_) {
     child->Dump(string_buffer, indent + 2);
   }
@@ -48,6 +52,7 @@ bool Entry::is_read_only() const { return device_->is_read_only(); }
 
 Entry* Entry::GetChild(const std::string_view name) {
   auto global_lock = global_critical_region_.Acquire();
+  EnsureChildrenPopulated();
   auto it = std::find_if(children_.cbegin(), children_.cend(),
                          [&](const auto& child) {
                            return xe::utf8::equal_case(child->name(), name);
@@ -74,6 +79,7 @@ Entry* Entry::ResolvePath(const std::string_view path) {
 Entry* Entry::IterateChildren(const xe::filesystem::WildcardEngine& engine,
                               size_t* current_index) {
   auto global_lock = global_critical_region_.Acquire();
+  EnsureChildrenPopulated();
   while (*current_index < children_.size()) {
     auto& child = children_[*current_index];
     *current_index = *current_index + 1;
@@ -98,6 +104,7 @@ Entry* Entry::CreateEntry(const std::string_view name, uint32_t attributes) {
     return nullptr;
   }
   children_.push_back(std::move(entry));
+  ++tree_version_;
   // TODO(benvanik): resort? would break iteration?
   Touch();
   return children_.back().get();
@@ -120,6 +127,7 @@ bool Entry::Delete(Entry* entry) {
       break;
     }
   }
+  ++tree_version_;
   Touch();
   return true;
 }
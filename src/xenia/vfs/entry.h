@@ -99,6 +99,7 @@ class Entry {
   Entry* GetChild(const std::string_view name);
   Entry* ResolvePath(const std::string_view path);
 
+  // Doesn't populate the children of entries that are populated lazily.
   const std::vector<std::unique_ptr<Entry>>& children() const {
     return children_;
   }
@@ -111,6 +112,11 @@ class Entry {
   bool Delete();
   void Touch();
 
+  // Incremented whenever entries are created or deleted after the devices
+  // have been initialized, for invalidating cached path resolution results.
+  // Guarded by the global critical region.
+  static uint64_t tree_version() { return tree_version_; }
+
   // If successful, out_file points to a new file. When finished, call
   // file->Destroy()
   virtual X_STATUS Open(uint32_t desired_access, File** out_file) = 0;
@@ -131,6 +137,11 @@ class Entry {
     return nullptr;
   }
   virtual bool DeleteEntryInternal(Entry* entry) { return false; }
+  // Called with the global critical region locked before the children are
+  // accessed, for devices that enumerate the directories on demand.
+  virtual void EnsureChildrenPopulated() {}
+
+  static uint64_t tree_version_;
 
   xe::global_critical_region global_critical_region_;
   Device* device_;
@@ -7,6 +7,7 @@
  ******************************************************************************
  */
 
+#include <algorithm>
 #include <queue>
 #include <string>
 #include <vector>
@@ -16,7 +17,11 @@
 #include "xenia/base/literals.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/math.h"
+#include "xenia/base/string.h"
 
+#include "xenia/vfs/devices/disc_compressed_device.h"
+#include "xenia/vfs/devices/disc_image_device.h"
+#include "xenia/vfs/devices/disc_zarchive_device.h"
 #include "xenia/vfs/devices/xcontent_container_device.h"
 #include "xenia/vfs/file.h"
 #include "xenia/vfs/virtual_file_system.h"
@@ -30,21 +35,70 @@ DEFINE_transient_path(source, "", "Specifies the file to dump from.",
 DEFINE_transient_path(dump_path, "",
                       "Specifies the directory to dump files to.", "General");
 
+DEFINE_transient_bool(compress_disc_image, false,
+                      "Instead of extracting the files, compress the source "
+                      "GDFX disc image into a .xcz image at dump_path.",
+                      "General");
+
+DEFINE_int32(compress_chunk_size_kb, 256,
+             "Size of the independently compressed chunks of the .xcz image "
+             "in kilobytes, a multiple of 2.",
+             "General");
+
+DEFINE_int32(compress_level, 19, "zstd compression level for the .xcz image.",
+             "General");
+
+DEFINE_int32(dump_threads, 0,
+             "Number of threads extracting files, 0 to choose based on the "
+             "number of logical processors.",
+             "General");
+
+DEFINE_transient_bool(dump_verify, false,
+                      "Read the extracted files back and compare their hashes "
+                      "to the source data.",
+                      "General");
+
 int vfs_dump_main(const std::vector<std::string>& args) {
   if (cvars::source.empty() || cvars::dump_path.empty()) {
     XELOGE("Usage: {} [source] [dump_path]", xe::path_to_utf8(args[0]));
     return 1;
   }
 
+  if (cvars::compress_disc_image) {
+    if (cvars::compress_chunk_size_kb <= 0) {
+      XELOGE("Invalid chunk size");
+      return 1;
+    }
+    return DiscCompressedDevice::CreateImage(
+               cvars::source, cvars::dump_path,
+               uint32_t(cvars::compress_chunk_size_kb) * 1024,
+               cvars::compress_level)
+               ? 0
+               : 1;
+  }
+
   std::filesystem::path base_path = cvars::dump_path;
-  std::unique_ptr<vfs::Device> device =
-      vfs::XContentContainerDevice::CreateContentDevice("", cvars::source);
+  std::unique_ptr<vfs::Device> device;
+  std::string extension =
+      xe::utf8::lower_ascii(xe::path_to_utf8(cvars::source.extension()));
+  if (extension == ".iso") {
+    device = std::make_unique<DiscImageDevice>("", cvars::source);
+  } else if (extension == ".zar") {
+    device = std::make_unique<DiscZarchiveDevice>("", cvars::source);
+  } else if (extension == ".xcz") {
+    device = std::make_unique<DiscCompressedDevice>("", cvars::source);
+  } else {
+    device =
+        vfs::XContentContainerDevice::CreateContentDevice("", cvars::source);
+  }
 
-  if (!device->Initialize()) {
+  if (!device || !device->Initialize()) {
     XELOGE("Failed to initialize device");
     return 1;
   }
-  return VirtualFileSystem::ExtractContentFiles(device.get(), base_path);
+  return VirtualFileSystem::ExtractContentFiles(
+      device.get(), base_path, uint32_t(std::max(cvars::dump_threads, 0)),
+      cvars::dump_verify);
 }
 
 }  // namespace vfs
@@ -11,12 +11,28 @@
 #include "xenia/kernel/xam/content_manager.h"
 #include "xenia/vfs/devices/xcontent_container_device.h"
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <queue>
+
 #include "devices/host_path_entry.h"
+#include "xenia/base/clock.h"
+#include "xenia/base/cvar.h"
+#include "xenia/base/filesystem.h"
 #include "xenia/base/literals.h"
 #include "xenia/base/logging.h"
 #include "xenia/base/string.h"
+#include "xenia/base/xxhash.h"
 #include "xenia/kernel/xfile.h"
 
+DEFINE_uint32(
+    vfs_access_profile_seconds, 30,
+    "Number of seconds after the launch of a title during which its file reads "
+    "are recorded to a profile in the cache root, so on the next launches the "
+    "same data can be preloaded on a background thread. 0 to disable.",
+    "Storage");
+
 namespace xe {
 namespace vfs {
 
@@ -25,6 +41,8 @@ using namespace xe::literals;
 VirtualFileSystem::VirtualFileSystem() {}
 
 VirtualFileSystem::~VirtualFileSystem() {
+  EndAccessProfile();
+
   // Delete all devices.
   // This will explode if anyone is still using data from them.
   devices_.clear();
@@ -34,6 +52,7 @@ VirtualFileSystem::~VirtualFileSystem() {
 bool VirtualFileSystem::RegisterDevice(std::unique_ptr<Device> device) {
   auto global_lock = global_critical_region_.Acquire();
   devices_.emplace_back(std::move(device));
+  resolved_paths_.clear();
   return true;
 }
 
@@ -43,6 +62,7 @@ bool VirtualFileSystem::UnregisterDevice(const std::string_view path) {
     if ((*it)->mount_path() == path) {
       XELOGD("Unregistered device: {}", (*it)->mount_path());
       devices_.erase(it);
+      resolved_paths_.clear();
       return true;
     }
   }
@@ -53,6 +73,7 @@ bool VirtualFileSystem::RegisterSymbolicLink(const std::string_view path,
                                              const std::string_view target) {
   auto global_lock = global_critical_region_.Acquire();
   symlinks_.insert({std::string(path), std::string(target)});
+  resolved_paths_.clear();
   XELOGD("Registered symbolic link: {} => {}", path, target);
 
   return true;
@@ -69,6 +90,7 @@ bool VirtualFileSystem::UnregisterSymbolicLink(const std::string_view path) {
   XELOGD("Unregistered symbolic link: {} => {}", it->first, it->second);
 
   symlinks_.erase(it);
+  resolved_paths_.clear();
   return true;
 }
 
@@ -111,6 +133,16 @@ Entry* VirtualFileSystem::ResolvePath(const std::string_view path) {
   // Resolve relative paths
   auto normalized_path(xe::utf8::canonicalize_guest_path(path));
 
+  if (resolved_paths_tree_version_ != Entry::tree_version()) {
+    resolved_paths_.clear();
+    resolved_paths_tree_version_ = Entry::tree_version();
+  }
+  auto resolved_it = resolved_paths_.find(normalized_path);
+  if (resolved_it != resolved_paths_.end()) {
+    return resolved_it->second;
+  }
+  std::string cache_key = normalized_path;
+
   // Resolve symlinks.
   std::string resolved_path;
   if (ResolveSymbolicLink(normalized_path, resolved_path)) {
@@ -133,7 +165,13 @@ Entry* VirtualFileSystem::ResolvePath(const std::string_view path) {
 
   const auto& device = *it;
   auto relative_path = normalized_path.substr(device->mount_path().size());
-  return device->ResolvePath(relative_path);
+  Entry* entry = device->ResolvePath(relative_path);
+  // Not caching failures so the cache size is bounded by the number of entries
+  // that actually exist.
+  if (entry) {
+    resolved_paths_.emplace(std::move(cache_key), entry);
+  }
+  return entry;
 }
 
 Entry* VirtualFileSystem::CreatePath(const std::string_view path,
@@ -225,17 +263,13 @@ X_STATUS VirtualFileSystem::OpenFile(Entry* root_entry,
 
     // If the entry does not exist on the host then remove the cached entry
     if (parent_entry) {
-      const xe::vfs::HostPathEntry* host_Path =
-          dynamic_cast<const xe::vfs::HostPathEntry*>(parent_entry);
-
-      if (host_Path) {
-        auto const file_path = host_Path->host_path() / entry->name();
+      xe::vfs::HostPathEntry* host_path_entry =
+          dynamic_cast<xe::vfs::HostPathEntry*>(entry);
 
-        if (!std::filesystem::exists(file_path)) {
-          // Remove cached entry
-          entry->Delete();
-          entry = nullptr;
-        }
+      if (host_path_entry && !host_path_entry->IsPresentOnHost()) {
+        // Remove cached entry
+        entry->Delete();
+        entry = nullptr;
       }
     }
   }
@@ -329,17 +363,263 @@ X_STATUS VirtualFileSystem::OpenFile(Entry* root_entry,
   return result;
 }
 
-X_STATUS VirtualFileSystem::ExtractContentFiles(
-    Device* device, std::filesystem::path base_path) {
-  // Run through all the files, breadth-first style.
+void VirtualFileSystem::BeginAccessProfile(
+    const std::filesystem::path& profile_path) {
+  EndAccessProfile();
+  if (!cvars::vfs_access_profile_seconds) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(access_profile_mutex_);
+  access_profile_path_ = profile_path;
+  access_profile_records_.clear();
+
+  FILE* file = xe::filesystem::OpenFile(profile_path, "rb");
+  if (!file) {
+    // Nothing to preload yet - record the reads for the next launch.
+    access_profile_recording_ = true;
+    access_profile_recording_end_ms_ =
+        Clock::QueryHostUptimeMillis() +
+        uint64_t(cvars::vfs_access_profile_seconds) * 1000;
+    return;
+  }
+  // One record per line, "offset length path", the path being the last so it
+  // may contain spaces.
+  char line[1024];
+  while (std::fgets(line, sizeof(line), file)) {
+    unsigned long long offset, length;
+    int path_start;
+    if (std::sscanf(line, "%llu %llu %n", &offset, &length, &path_start) !=
+        2) {
+      continue;
+    }
+    std::string_view path(line + path_start);
+    while (!path.empty() && (path.back() == '\n' || path.back() == '\r')) {
+      path.remove_suffix(1);
+    }
+    if (path.empty() || !length) {
+      continue;
+    }
+    access_profile_records_.push_back(
+        {std::string(path), uint64_t(offset), uint64_t(length)});
+  }
+  std::fclose(file);
+  if (access_profile_records_.empty()) {
+    return;
+  }
+  XELOGI("Preloading {} file ranges from {}", access_profile_records_.size(),
+         xe::path_to_utf8(profile_path));
+  access_profile_preload_shutdown_ = false;
+  access_profile_preload_thread_ = xe::threading::Thread::Create(
+      {}, [this]() { AccessProfilePreloadThread(); });
+  if (access_profile_preload_thread_) {
+    access_profile_preload_thread_->set_name("VFS Access Profile Preload");
+  }
+}
+
+void VirtualFileSystem::EndAccessProfile() {
+  {
+    std::lock_guard<std::mutex> lock(access_profile_mutex_);
+    if (access_profile_recording_) {
+      WriteAccessProfile();
+    }
+    access_profile_preload_shutdown_ = true;
+  }
+  if (access_profile_preload_thread_) {
+    xe::threading::Wait(access_profile_preload_thread_.get(), false);
+    access_profile_preload_thread_.reset();
+  }
+  std::lock_guard<std::mutex> lock(access_profile_mutex_);
+  access_profile_records_.clear();
+}
+
+void VirtualFileSystem::RecordFileRead(const Entry* entry, uint64_t offset,
+                                       size_t length) {
+  if (!entry || !length) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(access_profile_mutex_);
+  if (!access_profile_recording_) {
+    return;
+  }
+  if (Clock::QueryHostUptimeMillis() >= access_profile_recording_end_ms_) {
+    WriteAccessProfile();
+    return;
+  }
+  const std::string& path = entry->absolute_path();
+  // Merge sequential reads, which are the most common case, into one range.
+  if (!access_profile_records_.empty()) {
+    AccessProfileRecord& last_record = access_profile_records_.back();
+    if (last_record.path == path &&
+        last_record.offset + last_record.length == offset) {
+      last_record.length += length;
+      return;
+    }
+  }
+  access_profile_records_.push_back({path, offset, uint64_t(length)});
+}
+
+void VirtualFileSystem::WriteAccessProfile() {
+  access_profile_recording_ = false;
+  if (access_profile_records_.empty()) {
+    return;
+  }
+  xe::filesystem::CreateParentFolder(access_profile_path_);
+  FILE* file = xe::filesystem::OpenFile(access_profile_path_, "wb");
+  if (!file) {
+    XELOGE("Failed to write the file access profile to {}",
+           xe::path_to_utf8(access_profile_path_));
+  } else {
+    for (const AccessProfileRecord& record : access_profile_records_) {
+      fmt::print(file, "{} {} {}\n", record.offset, record.length,
+                 record.path);
+    }
+    std::fclose(file);
+    XELOGI("Recorded {} file ranges to {}", access_profile_records_.size(),
+           xe::path_to_utf8(access_profile_path_));
+  }
+  access_profile_records_.clear();
+}
+
+void VirtualFileSystem::AccessProfilePreloadThread() {
+  std::vector<AccessProfileRecord> records;
+  {
+    std::lock_guard<std::mutex> lock(access_profile_mutex_);
+    records = access_profile_records_;
+  }
+  // Reading through the devices, so the data ends up in the host page cache
+  // and in the caches of the devices themselves.
+  constexpr size_t kChunkSize = 1_MiB;
+  std::vector<uint8_t> buffer(kChunkSize);
+  for (const AccessProfileRecord& record : records) {
+    Entry* entry = ResolvePath(record.path);
+    if (!entry) {
+      continue;
+    }
+    File* file = nullptr;
+    if (XFAILED(entry->Open(FileAccess::kGenericRead, &file)) || !file) {
+      continue;
+    }
+    uint64_t offset = record.offset;
+    uint64_t end = std::min(record.offset + record.length,
+                            uint64_t(entry->size()));
+    while (offset < end) {
+      {
+        std::lock_guard<std::mutex> lock(access_profile_mutex_);
+        if (access_profile_preload_shutdown_) {
+          file->Destroy();
+          return;
+        }
+      }
+      size_t bytes_read = 0;
+      size_t chunk_length =
+          size_t(std::min(uint64_t(kChunkSize), end - offset));
+      if (XFAILED(file->ReadSync(buffer.data(), chunk_length, size_t(offset),
+                                 &bytes_read)) ||
+          !bytes_read) {
+        break;
+      }
+      offset += bytes_read;
+    }
+    file->Destroy();
+  }
+}
+
+namespace {
+// Extracting in parts rather than whole files so the memory usage doesn't
+// depend on the file sizes and multiple files can be extracted at once.
+constexpr size_t kExtractionChunkSize = 16_MiB;
+
+// Runs the function on the calling thread and thread_count - 1 more threads.
+void RunOnThreads(uint32_t thread_count, const std::function<void()>& fn) {
+  std::vector<std::unique_ptr<xe::threading::Thread>> threads;
+  for (uint32_t i = 1; i < thread_count; ++i) {
+    auto thread = xe::threading::Thread::Create({}, fn);
+    if (!thread) {
+      break;
+    }
+    thread->set_name(fmt::format("VFS Extraction {}", i));
+    threads.push_back(std::move(thread));
+  }
+  fn();
+  for (auto& thread : threads) {
+    xe::threading::Wait(thread.get(), false);
+  }
+}
+
+bool ExtractFile(Entry* entry, const std::filesystem::path& dest_name,
+                 std::vector<uint8_t>& buffer, uint64_t* hash_out) {
+  vfs::File* in_file = nullptr;
+  if (entry->Open(FileAccess::kFileReadData, &in_file) != X_STATUS_SUCCESS) {
+    XELOGE("Failed to open {} for extraction", entry->path());
+    return false;
+  }
+
+  auto file = xe::filesystem::OpenFile(dest_name, "wb");
+  if (!file) {
+    XELOGE("Failed to create {}", xe::path_to_utf8(dest_name));
+    in_file->Destroy();
+    return false;
+  }
+
+  XXH3_state_t hash_state;
+  if (hash_out) {
+    XXH3_64bits_reset(&hash_state);
+  }
+  bool succeeded = true;
+  if (entry->can_map()) {
+    auto map = entry->OpenMapped(xe::MappedMemory::Mode::kRead);
+    if (map) {
+      if (hash_out) {
+        XXH3_64bits_update(&hash_state, map->data(), map->size());
+      }
+      succeeded = fwrite(map->data(), 1, map->size(), file) == map->size();
+      map->Close();
+    } else {
+      succeeded = false;
+    }
+  } else {
+    // Can't map the file into memory. Copy it through the buffer.
+    size_t offset = 0;
+    while (succeeded && offset < entry->size()) {
+      size_t bytes_read = 0;
+      if (XFAILED(in_file->ReadSync(
+              buffer.data(), std::min(buffer.size(), entry->size() - offset),
+              offset, &bytes_read)) ||
+          !bytes_read) {
+        succeeded = false;
+        break;
+      }
+      if (hash_out) {
+        XXH3_64bits_update(&hash_state, buffer.data(), bytes_read);
+      }
+      succeeded = fwrite(buffer.data(), 1, bytes_read, file) == bytes_read;
+      offset += bytes_read;
+    }
+  }
+  if (hash_out) {
+    *hash_out = XXH3_64bits_digest(&hash_state);
+  }
+
+  fclose(file);
+  in_file->Destroy();
+  if (!succeeded) {
+    XELOGE("Failed to extract {}", entry->path());
+  }
+  return succeeded;
+}
+}  // namespace
+
+X_STATUS VirtualFileSystem::ExtractContentFiles(Device* device,
+                                                std::filesystem::path base_path,
+                                                uint32_t thread_count,
+                                                bool verify) {
+  // Create the directories and gather the files, breadth-first style.
+  std::vector<vfs::Entry*> files;
   std::queue<vfs::Entry*> queue;
   auto root = device->ResolvePath("/");
   queue.push(root);
 
-  // Allocate a buffer when needed.
-  size_t buffer_size = 0;
-  uint8_t* buffer = nullptr;
-
   while (!queue.empty()) {
     auto entry = queue.front();
     queue.pop();
@@ -347,7 +627,6 @@ X_STATUS VirtualFileSystem::ExtractContentFiles(
       queue.push(entry.get());
     }
 
-    XELOGI("Extracting file: {}", entry->path());
     auto dest_name = base_path / xe::to_path(entry->path());
     if (entry->attributes() & kFileAttributeDirectory) {
       std::error_code error_code;
@@ -357,48 +636,77 @@ X_STATUS VirtualFileSystem::ExtractContentFiles(
       }
       continue;
     }
+    files.push_back(entry);
+  }
 
-    vfs::File* in_file = nullptr;
-    if (entry->Open(FileAccess::kFileReadData, &in_file) != X_STATUS_SUCCESS) {
-      continue;
-    }
+  // Largest first so a big file isn't started last while the other threads
+  // have nothing more to do.
+  std::stable_sort(files.begin(), files.end(),
+                   [](const Entry* a, const Entry* b) {
+                     return a->size() > b->size();
+                   });
 
-    auto file = xe::filesystem::OpenFile(dest_name, "wb");
-    if (!file) {
-      in_file->Destroy();
-      continue;
+  if (!thread_count) {
+    thread_count = std::min(xe::threading::logical_processor_count(), 8u);
+  }
+  thread_count =
+      std::max(uint32_t(std::min(size_t(thread_count), files.size())), 1u);
+
+  std::vector<uint64_t> hashes(verify ? files.size() : 0);
+  std::atomic<size_t> next_file_index(0);
+  RunOnThreads(thread_count, [&]() {
+    std::vector<uint8_t> buffer(kExtractionChunkSize);
+    while (true) {
+      size_t file_index = next_file_index++;
+      if (file_index >= files.size()) {
+        break;
+      }
+      Entry* entry = files[file_index];
+      XELOGI("Extracting file: {}", entry->path());
+      ExtractFile(entry, base_path / xe::to_path(entry->path()), buffer,
+                  verify ? &hashes[file_index] : nullptr);
     }
+  });
 
-    if (entry->can_map()) {
-      auto map = entry->OpenMapped(xe::MappedMemory::Mode::kRead);
-      fwrite(map->data(), map->size(), 1, file);
-      map->Close();
-    } else {
-      // Can't map the file into memory. Read it into a temporary buffer.
-      if (!buffer || entry->size() > buffer_size) {
-        // Resize the buffer.
-        if (buffer) {
-          delete[] buffer;
+  if (!verify) {
+    return X_STATUS_SUCCESS;
+  }
+  std::atomic<size_t> mismatch_count(0);
+  next_file_index = 0;
+  RunOnThreads(thread_count, [&]() {
+    std::vector<uint8_t> buffer(kExtractionChunkSize);
+    while (true) {
+      size_t file_index = next_file_index++;
+      if (file_index >= files.size()) {
+        break;
+      }
+      Entry* entry = files[file_index];
+      auto file = xe::filesystem::OpenFile(
+          base_path / xe::to_path(entry->path()), "rb");
+      XXH3_state_t hash_state;
+      XXH3_64bits_reset(&hash_state);
+      uint64_t size = 0;
+      if (file) {
+        size_t bytes_read;
+        while ((bytes_read = fread(buffer.data(), 1, buffer.size(), file))) {
+          XXH3_64bits_update(&hash_state, buffer.data(), bytes_read);
+          size += bytes_read;
         }
-
-        // Allocate a buffer rounded up to the nearest 512MB.
-        buffer_size = xe::round_up(entry->size(), 512_MiB);
-        buffer = new uint8_t[buffer_size];
+        fclose(file);
+      }
+      if (!file || size != entry->size() ||
+          XXH3_64bits_digest(&hash_state) != hashes[file_index]) {
+        XELOGE("Verification of the extracted {} failed", entry->path());
+        ++mismatch_count;
       }
-
-      size_t bytes_read = 0;
-      in_file->ReadSync(buffer, entry->size(), 0, &bytes_read);
-      fwrite(buffer, bytes_read, 1, file);
     }
-
-    fclose(file);
-    in_file->Destroy();
+  });
+  if (mismatch_count) {
+    XELOGE("{} of {} extracted files failed verification",
+           mismatch_count.load(), files.size());
+    return X_STATUS_UNSUCCESSFUL;
   }
-
-  if (buffer) {
-    delete[] buffer;
-  }
-
+  XELOGI("Verified {} extracted files", files.size());
   return X_STATUS_SUCCESS;
 }
 
@@ -10,12 +10,15 @@
 #ifndef XENIA_VFS_VIRTUAL_FILE_SYSTEM_H_
 #define XENIA_VFS_VIRTUAL_FILE_SYSTEM_H_
 
+#include <filesystem>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 #include "xenia/base/mutex.h"
+#include "xenia/base/threading.h"
 #include "xenia/vfs/device.h"
 #include "xenia/vfs/entry.h"
 #include "xenia/vfs/file.h"
@@ -47,8 +50,22 @@ class VirtualFileSystem {
                     bool is_non_directory, File** out_file,
                     FileAction* out_action);
 
+  // Boot-time file access profile. If a profile exists at the path, the file
+  // ranges listed in it are read in the same order on a background thread so
+  // they're in the host and device caches by the time the title requests
+  // them. Otherwise, the reads done by the title during the first seconds are
+  // recorded and written to the path.
+  void BeginAccessProfile(const std::filesystem::path& profile_path);
+  void EndAccessProfile();
+  void RecordFileRead(const Entry* entry, uint64_t offset, size_t length);
+
+  // Extracts the files on thread_count threads (0 to choose based on the
+  // number of logical processors). If verify is true, the written files are
+  // read back and their hashes are compared to the hashes of the source data.
   static X_STATUS ExtractContentFiles(Device* device,
-                                      std::filesystem::path base_path);
+                                      std::filesystem::path base_path,
+                                      uint32_t thread_count = 0,
+                                      bool verify = false);
   static void ExtractContentHeader(Device* device,
                                    std::filesystem::path base_path);
 
@@ -56,8 +73,29 @@ class VirtualFileSystem {
   xe::global_critical_region global_critical_region_;
   std::vector<std::unique_ptr<Device>> devices_;
   std::unordered_map<std::string, std::string> symlinks_;
+  // Successful ResolvePath results by the canonicalized path, valid while the
+  // devices, the symbolic links and the entry tree are unchanged.
+  std::unordered_map<std::string, Entry*> resolved_paths_;
+  uint64_t resolved_paths_tree_version_ = 0;
 
   bool ResolveSymbolicLink(const std::string_view path, std::string& result);
+
+  struct AccessProfileRecord {
+    std::string path;
+    uint64_t offset;
+    uint64_t length;
+  };
+  // Must be called with access_profile_mutex_ locked.
+  void WriteAccessProfile();
+  void AccessProfilePreloadThread();
+
+  std::mutex access_profile_mutex_;
+  std::filesystem::path access_profile_path_;
+  bool access_profile_recording_ = false;
+  uint64_t access_profile_recording_end_ms_ = 0;
+  std::vector<AccessProfileRecord> access_profile_records_;
+  bool access_profile_preload_shutdown_ = false;
+  std::unique_ptr<xe::threading::Thread> access_profile_preload_thread_;
 };
 
 }  // namespace vfs
@@ -0,0 +1,203 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+"""Reports from the guest function call traces recorded with
+--trace_function_calls_path.
+
+python function_trace.py [--map symbols.txt] trace.bin hot
+    Functions by exclusive (self) time, with call counts and inclusive time.
+python function_trace.py trace.bin callgraph [--dot callgraph.dot]
+    Caller to callee edges by call count and inclusive time.
+python function_trace.py trace.bin coverage
+    Every function called, by call count and the threads calling it.
+python function_trace.py trace.bin paths [--depth 8]
+    Call stacks by inclusive time of their innermost function.
+
+The optional symbol map has one "<hex address> <name>" pair per line.
+"""
+
+import argparse
+import collections
+import struct
+import sys
+
+FILE_HEADER = struct.Struct('<IIQ')
+BLOCK_HEADER = struct.Struct('<IIQ')
+EVENT = struct.Struct('<QII')
+FILE_MAGIC = 0x54434658  # 'XFCT'
+FILE_VERSION = 1
+EVENT_CALL = 0
+EVENT_RETURN = 1
+
+
+class FunctionStats(object):
+
+  def __init__(self):
+    self.calls = 0
+    self.inclusive_ticks = 0
+    self.exclusive_ticks = 0
+    self.threads = set()
+
+
+class Trace(object):
+
+  def __init__(self, depth):
+    self.depth = depth
+    self.tick_frequency = 1
+    self.functions = collections.defaultdict(FunctionStats)
+    # (caller, callee) -> [calls, inclusive ticks]
+    self.edges = collections.defaultdict(lambda: [0, 0])
+    # (outermost, ..., innermost) -> inclusive ticks of the innermost
+    self.paths = collections.Counter()
+    self.event_count = 0
+    self.dropped_event_count = 0
+    self.unmatched_return_count = 0
+    # thread id -> [[address, call ticks, child ticks]]
+    self.stacks = collections.defaultdict(list)
+
+  def read(self, path):
+    with open(path, 'rb') as f:
+      data = f.read()
+    if len(data) < FILE_HEADER.size:
+      raise ValueError('%s is too short for a function call trace' % path)
+    magic, version, self.tick_frequency = FILE_HEADER.unpack_from(data, 0)
+    if magic != FILE_MAGIC or version != FILE_VERSION:
+      raise ValueError('%s is not a version %d function call trace' %
+                       (path, FILE_VERSION))
+    offset = FILE_HEADER.size
+    while offset + BLOCK_HEADER.size <= len(data):
+      thread_id, event_count, dropped_event_count = (
+          BLOCK_HEADER.unpack_from(data, offset))
+      offset += BLOCK_HEADER.size
+      if dropped_event_count:
+        # The events lost leave the stack unknown, start over from here.
+        self.dropped_event_count += dropped_event_count
+        self.stacks[thread_id] = []
+      end = min(offset + event_count * EVENT.size, len(data))
+      for ticks, address, event_type in EVENT.iter_unpack(
+          data[offset:end - (end - offset) % EVENT.size]):
+        self.process_event(thread_id, ticks, address, event_type)
+      offset = end
+
+  def process_event(self, thread_id, ticks, address, event_type):
+    self.event_count += 1
+    stack = self.stacks[thread_id]
+    if event_type == EVENT_CALL:
+      stack.append([address, ticks, 0])
+      stats = self.functions[address]
+      stats.calls += 1
+      stats.threads.add(thread_id)
+      caller = stack[-2][0] if len(stack) >= 2 else None
+      self.edges[(caller, address)][0] += 1
+      return
+    # Tail calls and longjmps skip the returns of some frames, so unwind to
+    # the frame of the returning function.
+    index = len(stack) - 1
+    while index >= 0 and stack[index][0] != address:
+      index -= 1
+    if index < 0:
+      self.unmatched_return_count += 1
+      return
+    path = tuple(frame[0] for frame in stack[max(index + 1 - self.depth, 0):
+                                             index + 1])
+    while len(stack) > index:
+      frame_address, call_ticks, child_ticks = stack.pop()
+      inclusive_ticks = ticks - call_ticks
+      stats = self.functions[frame_address]
+      stats.inclusive_ticks += inclusive_ticks
+      stats.exclusive_ticks += max(inclusive_ticks - child_ticks, 0)
+      caller = stack[-1][0] if stack else None
+      self.edges[(caller, frame_address)][1] += inclusive_ticks
+      if stack:
+        stack[-1][2] += inclusive_ticks
+      if frame_address == address:
+        self.paths[path] += inclusive_ticks
+
+
+def load_symbols(path):
+  symbols = {}
+  if not path:
+    return symbols
+  with open(path, encoding='utf-8') as f:
+    for line in f:
+      parts = line.split(None, 1)
+      if len(parts) == 2:
+        try:
+          symbols[int(parts[0], 16)] = parts[1].strip()
+        except ValueError:
+          pass
+  return symbols
+
+
+def main():
+  parser = argparse.ArgumentParser(
+      description=__doc__, formatter_class=argparse.RawTextHelpFormatter)
+  parser.add_argument('trace')
+  parser.add_argument('--map', help='symbol map, "<hex address> <name>"')
+  parser.add_argument('--top', type=int, default=50,
+                      help='number of rows to print, 0 for all')
+  parser.add_argument('--depth', type=int, default=8,
+                      help='innermost frames kept in the call paths')
+  subparsers = parser.add_subparsers(dest='report')
+  subparsers.required = True
+  subparsers.add_parser('hot')
+  callgraph_parser = subparsers.add_parser('callgraph')
+  callgraph_parser.add_argument('--dot', help='also write a Graphviz graph')
+  subparsers.add_parser('coverage')
+  subparsers.add_parser('paths')
+  args = parser.parse_args()
+
+  trace = Trace(max(args.depth, 1))
+  trace.read(args.trace)
+  symbols = load_symbols(args.map)
+  ms_per_tick = 1000.0 / trace.tick_frequency
+
+  def name(address):
+    if address is None:
+      return '<root>'
+    symbol = symbols.get(address)
+    return '%08X %s' % (address, symbol) if symbol else '%08X' % address
+
+  def top(rows):
+    return rows[:args.top] if args.top > 0 else rows
+
+  print('%d events, %d dropped, %d unmatched returns, %d functions' %
+        (trace.event_count, trace.dropped_event_count,
+         trace.unmatched_return_count, len(trace.functions)))
+
+  if args.report == 'hot':
+    print('%12s %12s %12s  function' % ('calls', 'self ms', 'total ms'))
+    rows = sorted(trace.functions.items(),
+                  key=lambda item: item[1].exclusive_ticks, reverse=True)
+    for address, stats in top(rows):
+      print('%12d %12.3f %12.3f  %s' %
+            (stats.calls, stats.exclusive_ticks * ms_per_tick,
+             stats.inclusive_ticks * ms_per_tick, name(address)))
+  elif args.report == 'callgraph':
+    print('%12s %12s  caller -> callee' % ('calls', 'total ms'))
+    rows = sorted(trace.edges.items(), key=lambda item: item[1][0],
+                  reverse=True)
+    for (caller, callee), (calls, ticks) in top(rows):
+      print('%12d %12.3f  %s -> %s' %
+            (calls, ticks * ms_per_tick, name(caller), name(callee)))
+    if args.dot:
+      with open(args.dot, 'w', encoding='utf-8') as f:
+        f.write('digraph calls {\n')
+        for (caller, callee), (calls, ticks) in rows:
+          f.write('  "%s" -> "%s" [label="%d, %.3f ms"];\n' %
+                  (name(caller), name(callee), calls, ticks * ms_per_tick))
+        f.write('}\n')
+  elif args.report == 'coverage':
+    print('%12s %8s  function' % ('calls', 'threads'))
+    rows = sorted(trace.functions.items())
+    for address, stats in top(rows):
+      print('%12d %8d  %s' % (stats.calls, len(stats.threads), name(address)))
+  elif args.report == 'paths':
+    print('%12s  path, outermost first' % 'total ms')
+    for path, ticks in top(trace.paths.most_common()):
+      print('%12.3f  %s' % (ticks * ms_per_tick,
+                            ' > '.join(name(address) for address in path)))
+  return 0
+
+
+if __name__ == '__main__':
+  sys.exit(main())